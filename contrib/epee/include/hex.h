@@ -62,10 +62,25 @@ namespace epee
     //! Append `< + src + >` as hex to `out`.
     static void formatted(std::ostream& out, const span<const std::uint8_t> src);
 
+    //! Write `src` bytes as hex to `out`. `out` must be twice the length
+    static void buffer_unchecked(char* out, const span<const std::uint8_t> src) noexcept;
+
   private:
     template<typename T> T static convert(const span<const std::uint8_t> src);
+  };
 
-    //! Write `src` bytes as hex to `out`. `out` must be twice the length
-    static void buffer_unchecked(char* out, const span<const std::uint8_t> src) noexcept;
+  struct from_hex
+  {
+    //! \return The value of hex digit `c`, or -1 if it isn't one.
+    static int value(char c) noexcept
+    {
+      return values[static_cast<unsigned char>(c)];
+    }
+
+    //! Decode `src` to `out`, which must be half its length. \return False if `src` has a non hex digit.
+    static bool to_buffer(span<std::uint8_t> out, span<const char> src) noexcept;
+
+  private:
+    static const std::int8_t values[256];
   };
 }
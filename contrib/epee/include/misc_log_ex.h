@@ -30,6 +30,7 @@
 
 #ifdef __cplusplus
 
+#include <cstdint>
 #include <string>
 
 #include "easylogging++.h"
@@ -39,6 +40,7 @@
 #endif
 #define MAX_LOG_FILE_SIZE 104850000 // 100 MB - 7600 bytes
 #define MAX_LOG_FILES 50
+#define MLOG_ASYNC_RING_SIZE 8192
 
 #ifdef __cplusplus
 #if __cplusplus >= 201103L
@@ -60,30 +62,35 @@ extern thread_local std::string mlog_current_log_category;
 #endif
 
 extern bool mlog_syslog;
+
+// Whether a message of level in category would be logged, without taking the easylogging++ locks. The
+// macros below check it first so the message isn't formatted when it would be dropped anyway
+bool mlog_enabled(el::Level level, const char *category);
+
 #ifdef ELPP_SYSLOG
 #define INITIALIZE_SYSLOG(id) ELPP_INITIALIZE_SYSLOG(id, LOG_PID, LOG_USER)
 
 #define CLOGX(LEVEL,cat) ((mlog_syslog)? CSYSLOG(LEVEL,cat) : CLOG(LEVEL,cat))
-#define MCLOG(level,cat,x) ELPP_WRITE_LOG(el::base::Writer, level, \
+#define MCLOG(level,cat,x) do { if (mlog_enabled(level, cat)) { ELPP_WRITE_LOG(el::base::Writer, level, \
     (mlog_syslog)? el::base::DispatchAction::SysLog : el::base::DispatchAction::NormalLog \
-    , cat) << x
+    , cat) << x; } } while (0)
 #define MCLOG_COLOR(level,cat,color,x) MCLOG(level,cat, ((mlog_syslog)? "" : "\033[1;" color "m") << x << ((mlog_syslog)? "" : "\033[0m"))
 #else //ELPP_SYSLOG
 #define INITIALIZE_SYSLOG(id)
 
 #define CLOGX(LEVEL,cat) CLOG(LEVEL,cat)
-#define MCLOG(level,cat,x) ELPP_WRITE_LOG(el::base::Writer, level, el::base::DispatchAction::NormalLog, cat) << x
+#define MCLOG(level,cat,x) do { if (mlog_enabled(level, cat)) { ELPP_WRITE_LOG(el::base::Writer, level, el::base::DispatchAction::NormalLog, cat) << x; } } while (0)
 #define MCLOG_COLOR(level,cat,color,x) MCLOG(level,cat,"\033[1;" color "m" << x << "\033[0m")
 #endif //ELPP_SYSLOG
 
-#define MCFATAL(cat,x) CLOGX(FATAL,cat) << x
-#define MCERROR(cat,x) CLOGX(ERROR,cat) << x
-#define MCWARNING(cat,x) CLOGX(WARNING,cat) << x
-#define MCINFO(cat,x) CLOGX(INFO,cat) << x
-#define MCDEBUG(cat,x) CLOGX(DEBUG,cat) << x
-#define MCTRACE(cat,x) CLOGX(TRACE,cat) << x
+#define MCFATAL(cat,x) MCLOG(el::Level::Fatal,cat,x)
+#define MCERROR(cat,x) MCLOG(el::Level::Error,cat,x)
+#define MCWARNING(cat,x) MCLOG(el::Level::Warning,cat,x)
+#define MCINFO(cat,x) MCLOG(el::Level::Info,cat,x)
+#define MCDEBUG(cat,x) MCLOG(el::Level::Debug,cat,x)
+#define MCTRACE(cat,x) MCLOG(el::Level::Trace,cat,x)
 
-#define MCLOG_FILE(level,cat,x) ELPP_WRITE_LOG(el::base::Writer, level, el::base::DispatchAction::FileOnlyLog, cat) << x
+#define MCLOG_FILE(level,cat,x) do { if (mlog_enabled(level, cat)) { ELPP_WRITE_LOG(el::base::Writer, level, el::base::DispatchAction::FileOnlyLog, cat) << x; } } while (0)
 
 #define MCLOG_RED(level,cat,x) MCLOG_COLOR(level,cat,"31",x)
 #define MCLOG_GREEN(level,cat,x) MCLOG_COLOR(level,cat,"32",x)
@@ -152,6 +159,13 @@ void mlog_set_categories(const char *categories);
 std::string mlog_get_categories();
 void mlog_set_log_level(int level);
 void mlog_set_log(const char *log);
+// Hands log lines to a background writer through a ring buffer of ring_size lines per logging thread,
+// lines logged while the ring of their thread is full are dropped and counted. Not available with syslog
+bool mlog_start_async(std::size_t ring_size = MLOG_ASYNC_RING_SIZE);
+// Writes out the lines still queued and goes back to writing them on the logging threads
+void mlog_stop_async();
+// Lines dropped so far by the async writer
+uint64_t mlog_get_async_dropped();
 
 namespace epee
 {
@@ -29,6 +29,7 @@
 #pragma once 
 
 #include <map>
+#include <cstddef>
 #include <boost/thread/mutex.hpp>
 
 namespace epee
@@ -47,8 +48,13 @@ namespace epee
     static void unlock(void *ptr, size_t len);
 
   private:
+    // pages no longer used are kept locked up to this many, so objects coming and going on the
+    // same pages (keys on the stack mostly) don't cost a mlock/munlock each time
+    static constexpr size_t max_idle_pages = 64;
+
     static size_t page_size;
     static size_t num_locked_objects;
+    static size_t num_idle_pages;
 
     static boost::mutex &mutex();
     static std::map<size_t, unsigned int> &map();
@@ -59,6 +65,35 @@ namespace epee
     size_t len;
   };
 
+  /// Locked memory for containers of secrets
+  ///
+  /// Small blocks are carved from chunks locked once and recycled through free lists by size
+  /// class, so allocating doesn't need any system call. Blocks are wiped when freed
+  class mlocked_pool
+  {
+  public:
+    static void *allocate(size_t len);
+    static void deallocate(void *ptr, size_t len) noexcept;
+
+    static size_t get_num_chunks();
+    static size_t get_num_allocated_blocks();
+  };
+
+  template <class T>
+  struct mlocked_allocator
+  {
+    typedef T value_type;
+
+    mlocked_allocator() noexcept {}
+    template <class U> mlocked_allocator(const mlocked_allocator<U>&) noexcept {}
+
+    T *allocate(size_t n) { return static_cast<T*>(mlocked_pool::allocate(n * sizeof(T))); }
+    void deallocate(T *ptr, size_t n) noexcept { mlocked_pool::deallocate(ptr, n * sizeof(T)); }
+
+    template <class U> bool operator==(const mlocked_allocator<U>&) const noexcept { return true; }
+    template <class U> bool operator!=(const mlocked_allocator<U>&) const noexcept { return false; }
+  };
+
   /// Locks memory while in scope
   ///
   /// Primarily useful for making sure that private keys don't get swapped out
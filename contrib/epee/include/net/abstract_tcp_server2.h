@@ -58,11 +58,15 @@
 #include "syncobj.h"
 #include "connection_basic.hpp"
 #include "network_throttle-detail.hpp"
+#include "network_scheduler.hpp"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net"
 
 #define ABSTRACT_SERVER_SEND_QUE_MAX_COUNT (1024)
+#define ABSTRACT_SERVER_SEND_QUE_MAX_GATHER (64) // queued buffers written with one vectored write
+#define ABSTRACT_SERVER_READ_BUFFER_SIZE (8192)
+#define ABSTRACT_SERVER_READ_BUFFER_MAX_SIZE (256 * 1024)
 
 namespace epee
 {
@@ -135,7 +139,10 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb); ///< (see do_send from i_service_endpoint)
+    virtual bool do_send(const shared_buffer& buff); ///< queues the buffer itself, without copying
+    virtual bool do_send(const shared_buffer& buff, traffic_class cls); ///< ditto, scheduling the upload as cls
     virtual bool do_send_chunk(const void* ptr, size_t cb); ///< will send (or queue) a part of data
+    bool do_send_chunk(shared_buffer buff, traffic_class cls = traffic_class_other);
     virtual bool send_done();
     virtual bool close();
     virtual bool call_run_once_service_io();
@@ -152,6 +159,13 @@ namespace net_utils
 
     /// Handle completion of a write operation.
     void handle_write(const boost::system::error_code& e, size_t cb);
+    /// Writes the buffers at the front of m_send_que, which must be locked, with one async_write once the
+    /// upload scheduler lets them go
+    void start_write();
+    /// Writes the first m_send_que_writing buffers, m_send_que must be locked
+    void write_queued();
+    /// Called on the strand once the scheduler lets a waiting write go
+    void resume_write();
     void handle_write_after_delay1(const boost::system::error_code& e, size_t bytes_sent);
     void handle_write_after_delay2(const boost::system::error_code& e, size_t bytes_sent);
 
@@ -164,8 +178,8 @@ namespace net_utils
     /// host connection count tracking
     unsigned int host_count(const std::string &host, int delta = 0);
 
-    /// Buffer for incoming data.
-    boost::array<char, 8192> buffer_;
+    /// Buffer for incoming data, grows while reads fill it (bulk transfers) and shrinks back when they don't.
+    std::vector<char> buffer_;
 
     t_connection_context context;
     i_connection_filter* &m_pfilter;
@@ -200,8 +214,8 @@ namespace net_utils
         if (!m_send_que_lock.tryLock())
             return false;
         int64_t bytes_in_que = 0;
-        for (auto entry : m_send_que)
-            bytes_in_que += entry.size();
+        for (const auto& entry : m_send_que)
+            bytes_in_que += entry.m_buffer->size();
 
         int64_t bytes_to_wait = bytes_in_que + callback.first;
 
@@ -248,6 +262,12 @@ namespace net_utils
     /// Run the server's io_service loop.
     bool run_server(size_t threads_count, bool wait = true, const boost::thread::attributes& attrs = boost::thread::attributes());
 
+    /// Gives each server thread an io_service and SO_REUSEPORT acceptor of its own, the connections staying
+    /// on the thread accepting them while the kernel spreads new ones over the acceptors. Idle handlers,
+    /// async calls and outgoing connections still run on the first thread. Should be called before
+    /// init_server, it's ignored where SO_REUSEPORT is missing
+    void set_acceptor_per_thread(bool enable);
+
     /// wait for service workers stop
     bool timed_wait_server_stop(uint64_t wait_mseconds);
 
@@ -269,12 +289,15 @@ namespace net_utils
     bool connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeot, const t_callback &cb, const std::string& bind_ip = "0.0.0.0");
 
     typename t_protocol_handler::config_type& get_config_object(){return m_config;}
+    const typename t_protocol_handler::config_type& get_config_object() const {return m_config;}
 
     int get_binded_port(){return m_port;}
 
     long get_connections_count() const
     {
-      auto connections_count = (m_sock_count > 0) ? (m_sock_count - 1) : 0; // Socket count minus listening socket
+      // Socket count minus the connection each acceptor waits with
+      const long acceptors = m_accept_lanes.size();
+      auto connections_count = (m_sock_count > acceptors) ? (m_sock_count - acceptors) : 0;
       return connections_count;
     }
 
@@ -339,10 +362,29 @@ namespace net_utils
     typename t_protocol_handler::config_type m_config;
 
   private:
-    /// Run the server's io_service loop.
-    bool worker_thread();
+    /// An acceptor and the io_service running the connections it accepts
+    struct accept_lane
+    {
+      explicit accept_lane(boost::asio::io_service& io_service): io_service(io_service), acceptor(io_service) {}
+
+      boost::asio::io_service& io_service;
+      boost::asio::ip::tcp::acceptor acceptor;
+      /// The next connection to be accepted
+      connection_ptr new_connection;
+    };
+
+#ifdef SO_REUSEPORT
+    typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
+    /// Run an io_service loop.
+    bool worker_thread(boost::asio::io_service* io_service);
+    /// Accept the next connection of lane.
+    void start_accept(accept_lane* lane);
     /// Handle completion of an asynchronous accept operation.
-    void handle_accept(const boost::system::error_code& e);
+    void handle_accept(accept_lane* lane, const boost::system::error_code& e);
+    /// Open another acceptor on the port of the first one, with an io_service of its own.
+    bool add_accept_lane();
 
     bool is_thread_worker();
 
@@ -350,8 +392,11 @@ namespace net_utils
     std::unique_ptr<boost::asio::io_service> m_io_service_local_instance;
     boost::asio::io_service& io_service_;    
 
-    /// Acceptor used to listen for incoming connections.
-    boost::asio::ip::tcp::acceptor acceptor_;
+    /// io_services of the lanes after the first one
+    std::vector<std::unique_ptr<boost::asio::io_service>> m_lane_io_services;
+    /// Acceptors used to listen for incoming connections, the first one runs on io_service_
+    std::vector<std::unique_ptr<accept_lane>> m_accept_lanes;
+    bool m_acceptor_per_thread;
 
     std::atomic<bool> m_stop_signal_sent;
     uint32_t m_port;
@@ -368,9 +413,6 @@ namespace net_utils
 
     t_connection_type m_connection_type;
 
-    /// The next connection to be accepted
-    connection_ptr new_connection_;
-
     boost::mutex connections_mutex;
     std::deque<std::pair<boost::system_time, connection_ptr>> connections_;
     boost::asio::io_service::strand m_strand;
@@ -423,17 +465,14 @@ namespace net_utils
         con_->m_send_que_lock.lock(); // *** critical ***
         epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){con_->m_send_que_lock.unlock();});
 
-        con_->m_send_que.resize(con_->m_send_que.size()+1);
-        con_->m_send_que.back().assign((const char*)mach->message, mach->length);
+        con_->m_send_que.push_back({std::make_shared<const std::string>((const char*)mach->message, mach->length), traffic_class_other});
+        con_->add_buffered_bytes(mach->length);
         typename connection<t_protocol_handler>::callback_type callback = boost::bind(&do_send_chunk_state_machine::send_result,mach,_1);
         con_->add_on_write_callback(std::pair<int64_t, typename connection<t_protocol_handler>::callback_type> { mach->length, callback } );
 
-        if(con_->m_send_que.size() == 1) {
+        if(!con_->m_send_que_writing) {
           // no active operation
-          auto size_now = con_->m_send_que.front().size();
-          boost::asio::async_write(con_->socket_, boost::asio::buffer(con_->m_send_que.front().data(), size_now ) ,
-                                   boost::bind(&connection<t_protocol_handler>::handle_write, con_, _1, _2)
-                                   );
+          con_->start_write();
         }
       }
 
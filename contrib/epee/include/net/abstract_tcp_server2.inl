@@ -80,6 +80,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 	)
 	: 
 		connection_basic(io_service, ref_sock_count, sock_number), 
+		buffer_(ABSTRACT_SERVER_READ_BUFFER_SIZE),
 		m_protocol_handler(this, config, context),
 		m_pfilter( pfilter ),
 		m_connection_type( connection_type ),
@@ -89,6 +90,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		m_local(false),
 		m_ready_to_close(false)
   {
+    add_buffered_bytes(buffer_.size());
     MDEBUG("test, connection constructor set m_connection_type="<<m_connection_type);
   }
 PRAGMA_WARNING_DISABLE_VS(4355)
@@ -102,6 +104,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       shutdown();
     }
 
+    add_buffered_bytes(-(int64_t)buffer_.size());
     _dbg3("[sock " << socket_.native_handle() << "] Socket destroyed");
   }
   //---------------------------------------------------------------------------------
@@ -348,6 +351,12 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       }else
       {
         reset_timer(get_timeout_from_bytes_read(bytes_transferred), false);
+        const size_t buffer_size = buffer_.size();
+        if (bytes_transferred == buffer_.size() && buffer_.size() < ABSTRACT_SERVER_READ_BUFFER_MAX_SIZE)
+          buffer_.resize(buffer_.size() * 2);
+        else if (bytes_transferred < buffer_.size() / 8 && buffer_.size() > ABSTRACT_SERVER_READ_BUFFER_SIZE)
+          buffer_.resize(buffer_.size() / 2);
+        add_buffered_bytes((int64_t)buffer_.size() - (int64_t)buffer_size);
         socket_.async_read_some(boost::asio::buffer(buffer_),
           strand_.wrap(
             boost::bind(&connection<t_protocol_handler>::handle_read, connection<t_protocol_handler>::shared_from_this(),
@@ -496,9 +505,28 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
 	} // do_send()
 
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send(const shared_buffer& buff)
+  {
+    // splitting is off for all connections (see above), so the buffer is queued as a whole
+    return do_send_chunk(buff);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send(const shared_buffer& buff, traffic_class cls)
+  {
+    return do_send_chunk(buff, cls);
+  }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send_chunk(const void* ptr, size_t cb)
+  {
+    return do_send_chunk(std::make_shared<const std::string>((const char*)ptr, cb));
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send_chunk(shared_buffer buff, traffic_class cls)
   {
     TRY_ENTRY();
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -507,6 +535,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return false;
     if(m_was_shutdown)
       return false;
+    const size_t cb = buff->size();
     {
 		CRITICAL_REGION_LOCAL(m_throttle_speed_out_mutex);
 		m_throttle_speed_out.handle_trafic_exact(cb);
@@ -532,36 +561,19 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return false;
     }
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
+    add_buffered_bytes(buff->size());
+    m_send_que.push_back({std::move(buff), cls});
     
-    if(m_send_que.size() > 1)
+    if(m_send_que_writing)
     { // active operation should be in progress, nothing to do, just wait last operation callback
-        auto size_now = cb;
-        MDEBUG("do_send_chunk() NOW just queues: packet="<<size_now<<" B, is added to queue-size="<<m_send_que.size());
-        //do_send_handler_delayed( ptr , size_now ); // (((H))) // empty function
+        MDEBUG("do_send_chunk() NOW just queues: packet="<<cb<<" B, is added to queue-size="<<m_send_que.size());
       
-      LOG_TRACE_CC(context, "[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front().size());
+      LOG_TRACE_CC(context, "[sock " << socket_.native_handle() << "] Async send requested " << m_send_que.front().m_buffer->size());
     }
     else
     { // no active operation
-
-        if(m_send_que.size()!=1) {// It means that we've forgotten protect m_send_que
-                                  // by m_send_que_lock somewhere in the code
-            _erro("Looks like no active operations, but send que size != 1!!");
-            return false;
-        }
-
-        auto size_now = m_send_que.front().size();
-        MDEBUG("do_send_chunk() NOW SENSD: packet="<<size_now<<" B");
-
-        CHECK_AND_ASSERT_MES( size_now == m_send_que.front().size(), false, "Unexpected queue size");
-        reset_timer(get_default_timeout(), false);
-        boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), size_now ) ,
-//                                 strand_.wrap( // Was commented. Why?
-                                 boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2)
-//                                 )
-                                 );
+        MDEBUG("do_send_chunk() NOW SENSD: packet="<<cb<<" B, queue-size="<<m_send_que.size());
+        start_write();
     }
     
     //do_send_handler_stop( ptr , cb ); // empty function
@@ -572,6 +584,73 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   } // do_send_chunk
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_write()
+  {
+    // everything queued behind a running write goes out with the next one, so a levin header and
+    // its body, or a burst of small notifies, cost a single syscall. A write carries one traffic class,
+    // which the upload scheduler accounts it to
+    const traffic_class cls = m_send_que.front().m_class;
+    size_t bytes = 0;
+    m_send_que_writing = 0;
+    for (const queued_buffer& entry : m_send_que)
+    {
+      if (m_send_que_writing == ABSTRACT_SERVER_SEND_QUE_MAX_GATHER || entry.m_class != cls)
+        break;
+      bytes += entry.m_buffer->size();
+      ++m_send_que_writing;
+    }
+
+    if (speed_limit_is_enabled())
+    {
+      boost::weak_ptr<connection<t_protocol_handler>> weak_self = connection<t_protocol_handler>::shared_from_this();
+      auto resume = [weak_self]() {
+        auto self = weak_self.lock();
+        if (self)
+          self->strand_.post(boost::bind(&connection<t_protocol_handler>::resume_write, self));
+      };
+      if (!network_scheduler::get_out().request((uintptr_t)this, cls, bytes, resume))
+      {
+        MTRACE("Upload of " << bytes << " bytes waits for the scheduler");
+        m_send_que_waiting = true;
+        return;
+      }
+    }
+    write_queued();
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::resume_write()
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_send_que_lock);
+    if (m_was_shutdown || !m_send_que_waiting)
+      return;
+    m_send_que_waiting = false;
+    write_queued();
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::resume_write", void());
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::write_queued()
+  {
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(m_send_que_writing);
+    for (const queued_buffer& entry : m_send_que)
+    {
+      if (buffers.size() == m_send_que_writing)
+        break;
+      buffers.push_back(boost::asio::buffer(entry.m_buffer->data(), entry.m_buffer->size()));
+    }
+
+    reset_timer(get_default_timeout(), false);
+    boost::asio::async_write(socket_, buffers,
+      strand_.wrap(
+        boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)
+      )
+    );
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   boost::posix_time::milliseconds connection<t_protocol_handler>::get_default_timeout()
   {
     unsigned count;
@@ -645,6 +724,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     m_was_shutdown = true;
     // Initiate graceful connection closure.
     m_timer.cancel();
+    if (speed_limit_is_enabled())
+      network_scheduler::get_out().cancel((uintptr_t)this);
     boost::system::error_code ignored_ec;
     socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
     if (!m_host.empty())
@@ -721,15 +802,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return;
     }
 
-#if 0
-                // The single sleeping that is needed for correctly handling "out" speed throttling
-		if (speed_limit_is_enabled()) {
-			sleep_before_packet(cb, 1, 1);
-		}
-#endif
-
     bool do_shutdown = false;
-    connection<t_protocol_handler>::callback_type callback; // my "crutch"
+    std::vector<connection<t_protocol_handler>::callback_type> callbacks; // my "crutch"
     CRITICAL_REGION_BEGIN(m_send_que_lock);
     if(m_send_que.empty()) // we've forgotten protect m_send_que by m_send_mutex_lock
     {
@@ -737,21 +811,25 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return;
     }
 
-    if (on_write_callback_list.size()) { // my crutch
+    // one write can cover the data several callbacks wait for, each waits for bytes past the previous one
+    int64_t bytes_left = bytes_sent;
+    while (bytes_left > 0 && on_write_callback_list.size()) { // my crutch
       std::pair<int64_t, callback_type>& next_callback = on_write_callback_list.front();
-      next_callback.first -= bytes_sent;
-      int64_t tmp = next_callback.first;
-      if (tmp <= 0) {
-        callback = next_callback.second;
-        on_write_callback_list.pop_front();
-        if (on_write_callback_list.size() && tmp < 0) {
-            std::pair<int64_t, callback_type>& next_callback = on_write_callback_list.front();
-            next_callback.first += tmp;
-        }
+      if (next_callback.first > bytes_left) {
+        next_callback.first -= bytes_left;
+        break;
       }
+      bytes_left -= next_callback.first;
+      callbacks.push_back(next_callback.second);
+      on_write_callback_list.pop_front();
     }
 
-    m_send_que.pop_front();
+    for (; m_send_que_writing && !m_send_que.empty(); --m_send_que_writing)
+    {
+      add_buffered_bytes(-(int64_t)m_send_que.front().m_buffer->size());
+      m_send_que.pop_front();
+    }
+    m_send_que_writing = 0;
     if(m_send_que.empty())
     {
       if(boost::interprocess::ipcdetail::atomic_read32(&m_want_close_connection))
@@ -761,25 +839,12 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }else
     {
       //have more data to send
-		reset_timer(get_default_timeout(), false);
-		auto size_now = m_send_que.front().size();
-		MDEBUG("handle_write() NOW SENDS: packet="<<size_now<<" B" <<", from  queue size="<<m_send_que.size());
-#if 0 // Hang io thread for any time by sleep instruction is a bad idea
-        if (speed_limit_is_enabled())
-            do_send_handler_write_from_queue(e, m_send_que.front().size() , m_send_que.size()); // (((H)))
-#endif // Comment thread sleep instructions
-
-        // Whether we've forgotten somewhere protect m_send_que by m_send_que_lock
-        CHECK_AND_ASSERT_MES( size_now == m_send_que.front().size(), void(), "Unexpected queue size");
-
-		boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), size_now) , 
-         strand_.wrap( // Was commented. Why?
-          boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)
-                 )
-        );
+		MDEBUG("handle_write() NOW SENDS: packet="<<m_send_que.front().m_buffer->size()<<" B" <<", from  queue size="<<m_send_que.size());
+		start_write();
     }
     CRITICAL_REGION_END();
-    if (callback)
+    for (const auto& callback : callbacks)
+      if (callback)
         (*callback.get())(e);
 
 
@@ -837,14 +902,14 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server( t_connection_type connection_type ) :
     m_io_service_local_instance(new boost::asio::io_service()),
     io_service_(*m_io_service_local_instance.get()),
-    acceptor_(io_service_),
+    m_acceptor_per_thread(false),
     m_stop_signal_sent(false), m_port(0), 
 	m_sock_count(0), m_sock_number(0), m_threads_count(0), 
 	m_pfilter(NULL), m_thread_index(0),
-		m_connection_type( connection_type ),
-    new_connection_()
+		m_connection_type( connection_type )
   , m_strand(io_service_)
   {
+    m_accept_lanes.emplace_back(new accept_lane(io_service_));
     create_server_type_map();
     m_thread_name_prefix = "NET";
   }
@@ -852,14 +917,14 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   template<class t_protocol_handler>
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server(boost::asio::io_service& extarnal_io_service, t_connection_type connection_type) :
     io_service_(extarnal_io_service),
-    acceptor_(io_service_),
+    m_acceptor_per_thread(false),
     m_stop_signal_sent(false), m_port(0), 
 		m_sock_count(0), m_sock_number(0), m_threads_count(0), 
 		m_pfilter(NULL), m_thread_index(0),
-		m_connection_type(connection_type),
-    new_connection_()
+		m_connection_type(connection_type)
   , m_strand(io_service_)
   {
+    m_accept_lanes.emplace_back(new accept_lane(io_service_));
     create_server_type_map();
     m_thread_name_prefix = "NET";
   }
@@ -890,17 +955,19 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     boost::asio::ip::tcp::resolver resolver(io_service_);
     boost::asio::ip::tcp::resolver::query query(address, boost::lexical_cast<std::string>(port), boost::asio::ip::tcp::resolver::query::canonical_name);
     boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query);
-    acceptor_.open(endpoint.protocol());
-    acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-    acceptor_.bind(endpoint);
-    acceptor_.listen();
-    boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
+    boost::asio::ip::tcp::acceptor& acceptor = m_accept_lanes.front()->acceptor;
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+    if (m_acceptor_per_thread)
+      acceptor.set_option(reuse_port(true));
+#endif
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    boost::asio::ip::tcp::endpoint binded_endpoint = acceptor.local_endpoint();
     m_port = binded_endpoint.port();
     MDEBUG("start accept");
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
-    acceptor_.async_accept(new_connection_->socket(),
-      boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
-      boost::asio::placeholders::error));
+    start_accept(m_accept_lanes.front().get());
 
     return true;
     }
@@ -932,7 +999,7 @@ DISABLE_GCC_WARNING(maybe-uninitialized)
 POP_WARNINGS
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool boosted_tcp_server<t_protocol_handler>::worker_thread()
+  bool boosted_tcp_server<t_protocol_handler>::worker_thread(boost::asio::io_service* io_service)
   {
     TRY_ENTRY();
     uint32_t local_thr_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index); 
@@ -944,7 +1011,7 @@ POP_WARNINGS
     {
       try
       {
-        io_service_.run();
+        io_service->run();
       }
       catch(const std::exception& ex)
       {
@@ -977,12 +1044,57 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::set_acceptor_per_thread(bool enable)
+  {
+#ifdef SO_REUSEPORT
+    m_acceptor_per_thread = enable;
+#else
+    if (enable)
+      MWARNING("SO_REUSEPORT is not available, connections are accepted by a single acceptor");
+#endif
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool boosted_tcp_server<t_protocol_handler>::add_accept_lane()
+  {
+#ifdef SO_REUSEPORT
+    try
+    {
+      const boost::asio::ip::tcp::endpoint endpoint = m_accept_lanes.front()->acceptor.local_endpoint();
+      m_lane_io_services.emplace_back(new boost::asio::io_service());
+      std::unique_ptr<accept_lane> lane(new accept_lane(*m_lane_io_services.back()));
+      lane->acceptor.open(endpoint.protocol());
+      lane->acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+      lane->acceptor.set_option(reuse_port(true));
+      lane->acceptor.bind(endpoint);
+      lane->acceptor.listen();
+      start_accept(lane.get());
+      m_accept_lanes.push_back(std::move(lane));
+      return true;
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to open another acceptor on port " << m_port << ": " << e.what());
+      return false;
+    }
+#else
+    return false;
+#endif
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   bool boosted_tcp_server<t_protocol_handler>::run_server(size_t threads_count, bool wait, const boost::thread::attributes& attrs)
   {
     TRY_ENTRY();
     m_threads_count = threads_count;
     m_main_thread_id = boost::this_thread::get_id();
     MLOG_SET_THREAD_NAME("[SRV_MAIN]");
+    // threads without a lane of their own, if an acceptor failed to open, share the first one
+    if (m_acceptor_per_thread && m_accept_lanes.front()->acceptor.is_open())
+    {
+      while (m_accept_lanes.size() < threads_count && add_accept_lane());
+      MINFO("Accepting connections on " << m_accept_lanes.size() << " acceptors");
+    }
     while(!m_stop_signal_sent)
     {
 
@@ -990,8 +1102,9 @@ POP_WARNINGS
       CRITICAL_REGION_BEGIN(m_threads_lock);
       for (std::size_t i = 0; i < threads_count; ++i)
       {
+        boost::asio::io_service* io_service = i < m_accept_lanes.size() ? &m_accept_lanes[i]->io_service : &io_service_;
         boost::shared_ptr<boost::thread> thread(new boost::thread(
-          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this)));
+          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this, io_service)));
           _note("Run server thread name: " << m_thread_name_prefix);
         m_threads.push_back(thread);
       }
@@ -1077,6 +1190,8 @@ POP_WARNINGS
     connections_.clear();
     connections_mutex.unlock();
     io_service_.stop();
+    for (auto &io_service: m_lane_io_services)
+      io_service->stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
   //---------------------------------------------------------------------------------
@@ -1087,7 +1202,16 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  void boosted_tcp_server<t_protocol_handler>::handle_accept(const boost::system::error_code& e)
+  void boosted_tcp_server<t_protocol_handler>::start_accept(accept_lane* lane)
+  {
+    lane->new_connection.reset(new connection<t_protocol_handler>(lane->io_service, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
+    lane->acceptor.async_accept(lane->new_connection->socket(),
+      boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this, lane,
+      boost::asio::placeholders::error));
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::handle_accept(accept_lane* lane, const boost::system::error_code& e)
   {
     MDEBUG("handle_accept");
     try
@@ -1096,13 +1220,10 @@ POP_WARNINGS
     {
 		if (m_connection_type == e_connection_type_RPC) {
 			MDEBUG("New server for RPC connections");
-			new_connection_->setRpcStation(); // hopefully this is not needed actually
+			lane->new_connection->setRpcStation(); // hopefully this is not needed actually
 		}
-		connection_ptr conn(std::move(new_connection_));
-      new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
-      acceptor_.async_accept(new_connection_->socket(),
-        boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
-        boost::asio::placeholders::error));
+		connection_ptr conn(std::move(lane->new_connection));
+      start_accept(lane);
 
       boost::asio::socket_base::keep_alive opt(true);
       conn->socket().set_option(opt);
@@ -1124,10 +1245,7 @@ POP_WARNINGS
     // error path, if e or exception
     _erro("Some problems at accept: " << e.message() << ", connections_count = " << m_sock_count);
     misc_utils::sleep_no_w(100);
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
-    acceptor_.async_accept(new_connection_->socket(),
-      boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
-      boost::asio::placeholders::error));
+    start_accept(lane);
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
@@ -90,7 +90,14 @@ class connection_basic { // not-templated base class for rapid developmet of som
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
     critical_section m_send_que_lock;
-    std::list<std::string> m_send_que;
+    struct queued_buffer
+    {
+      shared_buffer m_buffer;
+      traffic_class m_class;
+    };
+    std::list<queued_buffer> m_send_que;
+    size_t m_send_que_writing; ///< buffers at the front of m_send_que the running write is sending, 0 when idle
+    bool m_send_que_waiting; ///< the write of the m_send_que_writing buffers waits for the upload scheduler
     volatile bool m_is_multithreaded;
     double m_start_time;
     /// Strand to ensure the connection's handlers are not called concurrently.
@@ -133,6 +140,10 @@ class connection_basic { // not-templated base class for rapid developmet of som
 		static double get_sleep_time(size_t cb);
 		
 		static void set_save_graph(bool save_graph);
+
+		/// Bytes held by the read buffers and send queues of all connections, a buffer queued on several connections counted for each
+		static uint64_t get_buffered_bytes();
+		static void add_buffered_bytes(int64_t bytes);
 };
 
 } // nameserver
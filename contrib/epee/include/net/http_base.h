@@ -30,6 +30,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include <boost/utility/string_ref.hpp>
+#include <functional>
 #include <string>
 #include <utility>
 
@@ -194,6 +195,8 @@ namespace net_utils
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
 			int                 m_http_ver_lo;// OUT paramter only
+			// when set, produces the body in pieces in place of m_body, which is sent with chunked transfer encoding
+			std::function<bool(const std::function<bool(std::string&&)>& write)> m_body_stream;
 
 			void clear()
 			{
@@ -41,9 +41,7 @@
 #include "net_helper.h"
 #include "http_client_base.h"
 
-#ifdef HTTP_ENABLE_GZIP
-#include "gzip_encoding.h"
-#endif 
+#include "http_content_encoding.h"
 
 #include "string_tools.h"
 #include "reg_exp_definer.h"
@@ -60,6 +58,9 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
 
+// largest body a compressed response may expand to
+#define HTTP_MAX_DECODED_BODY_SIZE (512 * 1024 * 1024)
+
 extern epee::critical_section gregexp_lock;
 
 
@@ -789,6 +790,7 @@ namespace net_utils
 			std::string m_chunked_cache;
 			critical_section m_lock;
 			bool m_ssl;
+			bool m_accept_compression;
 
 		public:
             explicit http_simple_client_template(boost::shared_ptr<boost::asio::io_service> ios = boost::shared_ptr<boost::asio::io_service>(new boost::asio::io_service()))
@@ -807,6 +809,7 @@ namespace net_utils
 				, m_chunked_cache()
 				, m_lock()
 				, m_ssl(false)
+				, m_accept_compression(true)
 			{}
 
 
@@ -833,6 +836,13 @@ namespace net_utils
 				m_ssl = ssl;
 			}
 
+			/// Whether requests send Accept-Encoding with the codings this build decodes, on by default
+			void set_accept_compression(bool accept)
+			{
+				CRITICAL_REGION_LOCAL(m_lock);
+				m_accept_compression = accept;
+			}
+
       bool connect(std::chrono::milliseconds timeout)
       {
         CRITICAL_REGION_LOCAL(m_lock);
@@ -890,6 +900,8 @@ namespace net_utils
 				req_buff.append(method.data(), method.size()).append(" ").append(uri.data(), uri.size()).append(" HTTP/1.1\r\n");
 				add_field(req_buff, "Host", m_host_buff);
 				add_field(req_buff, "Content-Length", std::to_string(body.size()));
+				if (m_accept_compression && !accepted_content_codings().empty())
+					add_field(req_buff, "Accept-Encoding", accepted_content_codings());
 
 				//handle "additional_params"
 				for(const auto& field : additional_params)
@@ -1373,21 +1385,16 @@ namespace net_utils
 			inline
 				bool set_reply_content_encoder()
 			{
-				STATIC_REGEXP_EXPR_1(rexp_match_gzip, "^.*?((gzip)|(deflate))", boost::regex::icase | boost::regex::normal);
-				boost::smatch result;						//   12      3
-				if(boost::regex_search( m_response_info.m_header_info.m_content_encoding, result, rexp_match_gzip, boost::match_default) && result[0].matched)
+				bool unsupported = false;
+				const content_coding coding = parse_content_coding(m_response_info.m_header_info.m_content_encoding, unsupported);
+				if (coding != content_coding::identity)
 				{
-#ifdef HTTP_ENABLE_GZIP
-					m_pcontent_encoding_handler.reset(new content_encoding_gzip(this, result[3].matched));
-#else
-          m_pcontent_encoding_handler.reset(new do_nothing_sub_handler(this));
-          LOG_ERROR("GZIP encoding not supported in this build, please add zlib to your project and define HTTP_ENABLE_GZIP");
-          return false;
-#endif
+					m_pcontent_encoding_handler.reset(new content_decoding_handler(this, coding, HTTP_MAX_DECODED_BODY_SIZE));
 				}
-				else 
+				else
 				{
 					m_pcontent_encoding_handler.reset(new do_nothing_sub_handler(this));
+					CHECK_AND_ASSERT_MES(!unsupported, false, "Unsupported response Content-Encoding: " << m_response_info.m_header_info.m_content_encoding);
 				}
 
 				return true;
@@ -0,0 +1,136 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "misc_log_ex.h"
+#include "net/http_client_base.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.http"
+
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  /// Content codings of http bodies, gzip needs zlib (HTTP_ENABLE_GZIP) and zstd libzstd (HAVE_ZSTD)
+  enum class content_coding
+  {
+    identity,
+    gzip,
+    zstd
+  };
+
+  /// The token of coding in Content-Encoding and Accept-Encoding
+  const char* content_coding_name(content_coding coding);
+
+  /// Whether this build can encode and decode coding
+  bool content_coding_available(content_coding coding);
+
+  /// The Accept-Encoding value listing the codings this build decodes, empty when there are none
+  const std::string& accepted_content_codings();
+
+  /// The coding a response should use for a request sending accept_encoding: the available one with the
+  /// highest q value, zstd winning ties with gzip, identity when nothing else is acceptable
+  content_coding negotiate_content_coding(const std::string& accept_encoding);
+
+  /// The coding named by a Content-Encoding value, identity when it's empty or names one this build
+  /// can't decode (unsupported is set then)
+  content_coding parse_content_coding(const std::string& content_encoding, bool& unsupported);
+
+  /// Compresses a body piece by piece, so a streamed body is compressed as it is produced
+  class content_encoder
+  {
+  public:
+    explicit content_encoder(content_coding coding);
+    ~content_encoder();
+
+    /// Appends the compressed output ready so far to out
+    bool update(const char* data, size_t size, std::string& out);
+    /// Appends the rest of the compressed output to out, the encoder can't be updated afterwards
+    bool finish(std::string& out);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+  };
+
+  /// Decompresses a body piece by piece, failing once the output exceeds max_size
+  class content_decoder
+  {
+  public:
+    content_decoder(content_coding coding, size_t max_size);
+    ~content_decoder();
+
+    /// Appends the decompressed output of data to out
+    bool update(const char* data, size_t size, std::string& out);
+    /// Whether the whole compressed stream was seen
+    bool finished() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+  };
+
+  /// Compresses body with coding at once
+  bool encode_body(content_coding coding, std::string& body);
+
+  /// Decodes the body of a http_simple_client response as it arrives
+  class content_decoding_handler : public i_sub_handler
+  {
+  public:
+    content_decoding_handler(i_target_handler* powner_filter, content_coding coding, size_t max_size)
+      : m_powner_filter(powner_filter), m_decoder(coding, max_size)
+    {}
+
+    virtual bool update_in(std::string& piece_of_transfer)
+    {
+      std::string decoded;
+      const bool r = m_decoder.update(piece_of_transfer.data(), piece_of_transfer.size(), decoded);
+      piece_of_transfer.clear();
+      CHECK_AND_ASSERT_MES(r, false, "Failed to decode response body");
+      return decoded.empty() || m_powner_filter->handle_target_data(decoded);
+    }
+
+    virtual void stop(std::string& collect_remains)
+    {
+    }
+
+  private:
+    i_target_handler* m_powner_filter;
+    content_decoder m_decoder;
+  };
+}
+}
+}
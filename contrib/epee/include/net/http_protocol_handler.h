@@ -31,11 +31,14 @@
 #define _HTTP_SERVER_H_
 
 #include <boost/optional/optional.hpp>
+#include <memory>
 #include <string>
 #include "net_utils_base.h"
 #include "to_nonconst_iterator.h"
 #include "http_auth.h"
 #include "http_base.h"
+#include "http_request_dispatcher.h"
+#include "http_content_encoding.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
@@ -57,6 +60,8 @@ namespace net_utils
 			std::vector<std::string> m_access_control_origins;
 			boost::optional<login> m_user;
 			critical_section m_lock;
+			std::shared_ptr<request_dispatcher> m_dispatcher; //requests are handled on the io threads when not set
+			size_t m_compression_threshold = 0; //smallest body compressed for clients sending Accept-Encoding, 0 to never compress
 		};
 
 		/************************************************************************/
@@ -128,6 +133,11 @@ namespace net_utils
 
 			//major function 
 			inline bool handle_request_and_send_response(const http::http_request_info& query_info);
+			bool get_response(const http::http_request_info& query_info, http_response_info& response);
+			bool send_response(const http::http_request_info& query_info, http_response_info& response, bool res);
+			bool send_body_chunk(std::string&& piece);
+			bool encode_response(const http::http_request_info& query_info, http_response_info& response);
+			bool dispatch_request(bool fail_on_error);
 
 
 			std::string get_not_found_response_body(const std::string& URI);
@@ -142,6 +152,8 @@ namespace net_utils
 			config_type& m_config;
 			bool m_want_close;
 			size_t m_newlines;
+			critical_section m_handling_lock;
+			bool m_request_in_flight;
 		protected:
 			i_service_endpoint* m_psnd_hndlr; 
 			t_connection_context& m_conn_context;
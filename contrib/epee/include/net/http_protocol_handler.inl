@@ -39,6 +39,7 @@
 #define HTTP_MAX_URI_LEN		 9000 
 #define HTTP_MAX_HEADER_LEN		 100000
 #define HTTP_MAX_STARTING_NEWLINES       8
+#define HTTP_MAX_PIPELINED_DATA          (32 * 1024 * 1024)
 
 namespace epee
 {
@@ -205,6 +206,7 @@ namespace net_utils
 		m_config(config),
 		m_want_close(false),
 		m_newlines(0),
+		m_request_in_flight(false),
 		m_psnd_hndlr(psnd_hndlr),
 		m_conn_context(conn_context)
 	{
@@ -226,6 +228,15 @@ namespace net_utils
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_recv(const void* ptr, size_t cb)
 	{
+		CRITICAL_REGION_LOCAL(m_handling_lock);
+		if(m_request_in_flight)
+		{
+			//pipelined requests are parsed once the response to the one on the workers is queued
+			m_cache.append((const char*)ptr, cb);
+			CHECK_AND_ASSERT_MES(m_cache.size() <= HTTP_MAX_PIPELINED_DATA, false, "Too much data pipelined behind a running request");
+			return true;
+		}
+
 		std::string buf((const char*)ptr, cb);
 		//LOG_PRINT_L0("HTTP_RECV: " << ptr << "\r\n" << buf);
 		//file_io_utils::save_string_to_file(string_tools::get_current_module_folder() + "/" + boost::lexical_cast<std::string>(ptr), std::string((const char*)ptr, cb));
@@ -307,7 +318,13 @@ namespace net_utils
 					break;
 				}
 			case http_state_retriving_body:
-				return handle_retriving_query_body();
+				if(!handle_retriving_query_body())
+					return false;
+				if(m_state == http_state_retriving_body)
+					m_is_stop_handling = true;
+				else if(m_state == http_state_error)
+					return true;
+				break;
 			case http_state_connection_close:
 				return false;
 			default:
@@ -318,7 +335,7 @@ namespace net_utils
 				return false;
 			}
 
-			if(!m_cache.size())
+			if(!m_cache.size() || m_want_close)
 				m_is_stop_handling = true;
 		}
 
@@ -359,7 +376,7 @@ namespace net_utils
 		boost::smatch result;	
 		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
 		{
-			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi))
+			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_lo))
 			{
 				m_state = http_state_error;
 				MERROR("Failed to analyze method");
@@ -434,18 +451,14 @@ namespace net_utils
 				m_state = http_state_error;
 				return false;
 			}
+			m_len_remain = m_len_summary;
 			if(0 == m_len_summary)
 			{	//current query finished, next will be next query
-				if(handle_request_and_send_response(m_query_info))
-					set_ready_state();
-				else
-					m_state = http_state_error;
+				dispatch_request(true);
 			}
-			m_len_remain = m_len_summary;
 		}else
 		{//current query finished, next will be next query
-			handle_request_and_send_response(m_query_info);
-			set_ready_state();
+			dispatch_request(false);
 		}
 
 		return true;
@@ -488,12 +501,54 @@ namespace net_utils
 		}
 
 		if(!m_len_remain)
+			dispatch_request(true);
+		return true;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::dispatch_request(bool fail_on_error)
+	{
+		if(!m_config.m_dispatcher)
 		{
-			if(handle_request_and_send_response(m_query_info))
+			if(handle_request_and_send_response(m_query_info) || !fail_on_error)
 				set_ready_state();
 			else
 				m_state = http_state_error;
+			return true;
 		}
+
+		//the connection, and this handler with it, is kept until the job is done
+		if(!m_psnd_hndlr->add_ref())
+		{
+			m_state = http_state_error;
+			return false;
+		}
+		m_request_in_flight = true;
+		m_is_stop_handling = true;
+		m_config.m_dispatcher->post(m_query_info.m_uri_content.m_path, [this, fail_on_error]() {
+			http_response_info response{};
+			bool res = get_response(m_query_info, response);
+			bool keep = false;
+			{
+				CRITICAL_REGION_LOCAL(m_handling_lock);
+				res = send_response(m_query_info, response, res);
+				m_request_in_flight = false;
+				if(res || !fail_on_error)
+					set_ready_state();
+				else
+					m_state = http_state_error;
+
+				keep = !m_want_close && m_state != http_state_error;
+				if(keep && m_cache.size())
+				{
+					std::string buf;
+					keep = handle_buff_in(buf) && !m_want_close;
+				}
+				if(!keep && !m_request_in_flight)
+					m_psnd_hndlr->close();
+			}
+			m_psnd_hndlr->release();
+		});
 		return true;
 	}
 	//--------------------------------------------------------------------------------------------
@@ -571,6 +626,13 @@ namespace net_utils
 	{
 		http_response_info response{};
 		//CHECK_AND_ASSERT_MES(res, res, "handle_request(query_info, response) returned false" );
+		bool res = get_response(query_info, response);
+		return send_response(query_info, response, res);
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::get_response(const http::http_request_info& query_info, http_response_info& response)
+	{
 		bool res = true;
 
 		if (query_info.m_http_method != http::http_method_options)
@@ -582,6 +644,20 @@ namespace net_utils
 			response.m_response_code = 200;
 			response.m_response_comment = "OK";
 		}
+		return res;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_response(const http::http_request_info& query_info, http_response_info& response, bool res)
+	{
+		// HTTP/1.0 clients can't take a chunked body, and HEAD needs its length
+		const bool chunked_ok = query_info.m_http_ver_hi > 1 || (query_info.m_http_ver_hi == 1 && query_info.m_http_ver_lo >= 1);
+		if (response.m_body_stream && (!chunked_ok || query_info.m_http_method == http::http_method_head))
+		{
+			res = response.m_body_stream([&response](std::string&& piece) { response.m_body += piece; return true; }) && res;
+			response.m_body_stream = nullptr;
+		}
+		encode_response(query_info, response);
 
 		std::string response_data = get_response_header(response);
 		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
@@ -589,12 +665,82 @@ namespace net_utils
     LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
 		
 		m_psnd_hndlr->do_send((void*)response_data.data(), response_data.size());
-		if ((response.m_body.size() && (query_info.m_http_method != http::http_method_head)) || (query_info.m_http_method == http::http_method_options))
-			m_psnd_hndlr->do_send((void*)response.m_body.data(), response.m_body.size());
+		if (response.m_body_stream)
+		{
+			// a body cut short by a failing stream can't be finished, the connection is dropped instead
+			if (!response.m_body_stream([this](std::string&& piece) { return send_body_chunk(std::move(piece)); }))
+			{
+				m_psnd_hndlr->close();
+				return false;
+			}
+			m_psnd_hndlr->do_send("0\r\n\r\n", 5);
+		}
+		else if ((response.m_body.size() && (query_info.m_http_method != http::http_method_head)) || (query_info.m_http_method == http::http_method_options))
+			m_psnd_hndlr->do_send(std::make_shared<const std::string>(std::move(response.m_body)));
 		m_psnd_hndlr->send_done();
 		return res;
 	}
 	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_body_chunk(std::string&& piece)
+	{
+		if (piece.empty())
+			return true;
+		std::stringstream size_line;
+		size_line << std::hex << piece.size() << "\r\n";
+		std::string chunk = size_line.str();
+		chunk.reserve(chunk.size() + piece.size() + 2);
+		chunk += piece;
+		chunk += "\r\n";
+		return m_psnd_hndlr->do_send(std::make_shared<const std::string>(std::move(chunk)));
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::encode_response(const http::http_request_info& query_info, http_response_info& response)
+	{
+		// streamed bodies are big by design, they are compressed piece by piece as they are produced
+		if (!m_config.m_compression_threshold || query_info.m_http_method == http::http_method_head ||
+			(!response.m_body_stream && response.m_body.size() < m_config.m_compression_threshold))
+			return true;
+		for (const auto& field : response.m_additional_fields)
+			if (!string_tools::compare_no_case(field.first, "Content-Encoding"))
+				return true;
+
+		response.m_additional_fields.push_back(std::make_pair("Vary", "Accept-Encoding"));
+		content_coding coding = content_coding::identity;
+		for (const auto& field : query_info.m_header_info.m_etc_fields)
+			if (!string_tools::compare_no_case(field.first, "Accept-Encoding"))
+				coding = negotiate_content_coding(field.second);
+		if (coding == content_coding::identity)
+			return true;
+		// a body failing to compress is sent as it is
+		if (!response.m_body_stream && !encode_body(coding, response.m_body))
+			return false;
+		response.m_additional_fields.push_back(std::make_pair("Content-Encoding", content_coding_name(coding)));
+		if (!response.m_body_stream)
+			return true;
+
+		auto body_stream = std::move(response.m_body_stream);
+		response.m_body_stream = [body_stream, coding](const std::function<bool(std::string&&)>& write)
+		{
+			content_encoder encoder(coding);
+			std::string encoded;
+			const bool res = body_stream([&encoder, &encoded, &write](std::string&& piece) {
+				if (!encoder.update(piece.data(), piece.size(), encoded))
+					return false;
+				if (encoded.empty())
+					return true;
+				std::string out;
+				out.swap(encoded);
+				return write(std::move(out));
+			});
+			if (!res || !encoder.finish(encoded))
+				return false;
+			return encoded.empty() || write(std::move(encoded));
+		};
+		return true;
+	}
+	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_request(const http::http_request_info& query_info, http_response_info& response)
 	{
@@ -630,9 +776,11 @@ namespace net_utils
 	{
 		std::string buf = "HTTP/1.1 ";
 		buf += boost::lexical_cast<std::string>(response.m_response_code) + " " + response.m_response_comment + "\r\n" +
-			"Server: Epee-based\r\n"
-			"Content-Length: ";
-		buf += boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
+			"Server: Epee-based\r\n";
+		if(response.m_body_stream)
+			buf += "Transfer-Encoding: chunked\r\n";
+		else
+			buf += "Content-Length: " + boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
 
 		if(!response.m_mime_tipe.empty())
 		{
@@ -648,16 +796,18 @@ namespace net_utils
 		//Wed, 01 Dec 2010 03:27:41 GMT"
 
 		string_tools::trim(m_query_info.m_header_info.m_connection);
-		if(m_query_info.m_header_info.m_connection.size())
+		//HTTP/1.0 connections are only kept when the client asks for it
+		const bool http10 = m_query_info.m_http_ver_hi < 1 || (m_query_info.m_http_ver_hi == 1 && m_query_info.m_http_ver_lo == 0);
+		const bool keep_alive = !string_tools::compare_no_case("keep-alive", m_query_info.m_header_info.m_connection);
+		if(!string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection) || (http10 && !keep_alive))
 		{
-			if(!string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection))
-			{
-        //closing connection after sending
-				buf += "Connection: close\r\n";
-				m_state = http_state_connection_close;
-				m_want_close = true;
-			}
+      //closing connection after sending
+			buf += "Connection: close\r\n";
+			m_state = http_state_connection_close;
+			m_want_close = true;
 		}
+		else if(http10)
+			buf += "Connection: keep-alive\r\n";
 
 		// Cross-origin resource sharing
 		if(m_query_info.m_header_info.m_origin.size())
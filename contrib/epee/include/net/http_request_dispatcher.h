@@ -0,0 +1,206 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.http"
+
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  /// Runs http requests on worker threads of its own, so the io threads only read and write sockets and a
+  /// slow request doesn't hold up the other connections served by the same io thread. URIs given a limit
+  /// run at most that many requests at a time, the rest waiting in a queue of the URI, so heavy requests
+  /// can't take all the workers from the light ones.
+  class request_dispatcher
+  {
+  public:
+    typedef std::function<void()> job_t;
+
+    struct endpoint_stats
+    {
+      uint64_t handled = 0;
+      uint64_t queue_time_us = 0;
+      uint64_t max_queue_time_us = 0;
+      size_t running = 0;
+      size_t queued = 0;
+      size_t limit = 0;
+    };
+
+    /// thread_init and thread_deinit, when set, run in each worker as it starts and stops
+    request_dispatcher(size_t threads_count, std::function<void()> thread_init = {}, std::function<void()> thread_deinit = {})
+      : m_work(new boost::asio::io_service::work(m_io))
+    {
+      for (size_t i = 0; i < std::max<size_t>(threads_count, 1); ++i)
+      {
+        m_threads.create_thread([this, thread_init, thread_deinit]() {
+          if (thread_init)
+            thread_init();
+          m_io.run();
+          if (thread_deinit)
+            thread_deinit();
+        });
+      }
+    }
+
+    ~request_dispatcher()
+    {
+      stop();
+    }
+
+    /// Runs at most max_running requests for uri at a time, 0 for no limit
+    void set_limit(const std::string& uri, size_t max_running)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      m_endpoints[uri].m_stats.limit = max_running;
+    }
+
+    void post(const std::string& uri, job_t job)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      auto it = m_endpoints.find(uri);
+      endpoint& e = it == m_endpoints.end() ? m_default : it->second;
+      queued_job qj{std::move(job), clock::now()};
+      if (e.m_stats.limit && e.m_stats.running >= e.m_stats.limit)
+      {
+        e.m_queue.push_back(std::move(qj));
+        return;
+      }
+      ++e.m_stats.running;
+      lock.unlock();
+      start(e, std::move(qj));
+    }
+
+    /// Counters of the URIs with a limit, the other requests being counted under ""
+    std::map<std::string, endpoint_stats> get_stats() const
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      std::map<std::string, endpoint_stats> stats;
+      stats[""] = m_default.stats();
+      for (const auto& e : m_endpoints)
+        stats[e.first] = e.second.stats();
+      return stats;
+    }
+
+    /// Finishes the requests already posted and joins the workers
+    void stop()
+    {
+      m_work.reset();
+      m_threads.join_all();
+    }
+
+  private:
+    typedef std::chrono::steady_clock clock;
+
+    struct queued_job
+    {
+      job_t m_job;
+      clock::time_point m_queued;
+    };
+
+    struct endpoint
+    {
+      endpoint_stats m_stats;
+      std::deque<queued_job> m_queue;
+
+      endpoint_stats stats() const
+      {
+        endpoint_stats s = m_stats;
+        s.queued = m_queue.size();
+        return s;
+      }
+    };
+
+    void start(endpoint& e, queued_job qj)
+    {
+      m_io.post([this, &e, qj]() { run(e, qj); });
+    }
+
+    void run(endpoint& e, const queued_job& qj)
+    {
+      const uint64_t queue_time_us = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - qj.m_queued).count();
+      {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        ++e.m_stats.handled;
+        e.m_stats.queue_time_us += queue_time_us;
+        e.m_stats.max_queue_time_us = std::max(e.m_stats.max_queue_time_us, queue_time_us);
+      }
+      MDEBUG("Request waited " << queue_time_us << " us for a worker");
+
+      try
+      {
+        qj.m_job();
+      }
+      catch (const std::exception& ex)
+      {
+        MERROR("Exception in http request job: " << ex.what());
+      }
+      catch (...)
+      {
+        MERROR("Unknown exception in http request job");
+      }
+
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (e.m_queue.empty())
+      {
+        --e.m_stats.running;
+        return;
+      }
+      queued_job next = std::move(e.m_queue.front());
+      e.m_queue.pop_front();
+      lock.unlock();
+      start(e, std::move(next));
+    }
+
+    boost::asio::io_service m_io;
+    std::unique_ptr<boost::asio::io_service::work> m_work;
+    boost::thread_group m_threads;
+    mutable boost::mutex m_lock;
+    std::map<std::string, endpoint> m_endpoints;
+    endpoint m_default;
+  };
+}
+}
+}
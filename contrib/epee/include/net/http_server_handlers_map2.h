@@ -34,6 +34,26 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
 
+namespace epee
+{
+namespace json_rpc
+{
+  //! Splits the response to `id` around its result, so that head + result stored at indent 1 + tail
+  //! is what store_t_to_json writes for the whole response
+  inline void get_response_json_frame(const epee::serialization::storage_entry& id, std::string& head, std::string& tail)
+  {
+    response_head rh;
+    rh.jsonrpc = "2.0";
+    rh.id = id;
+    epee::serialization::store_t_to_json(rh, head);
+    // drop the closing "\r\n}", "result" sorts after "id" and "jsonrpc"
+    head.resize(head.size() - 3);
+    head += ",\r\n  \"result\": ";
+    tail = "\r\n}";
+  }
+}
+}
+
 
 #define CHAIN_HTTP_TO_MAP2(context_type) bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, \
               epee::net_utils::http::http_response_info& response, \
@@ -85,8 +105,76 @@
 
 #define MAP_URI_AUTO_JON2(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, true)
 
-#define MAP_URI_AUTO_BIN2(s_pattern, callback_f, command_type) \
+// the response is moved into the body stream and written to the connection as it is serialized, for
+// commands with responses too large to hold a copy of in the tree and in the body
+#define STREAM_OBJECTS_TO_JSON(resp_type, resp) \
+  { \
+    std::shared_ptr<resp_type> stream_resp = std::make_shared<resp_type>(std::move(resp)); \
+    response_info.m_body_stream = [stream_resp](const std::function<bool(std::string&&)>& write) { \
+      return epee::serialization::store_t_to_json_stream(*stream_resp, write); \
+    }; \
+  }
+
+#define MAP_URI_AUTO_JON2_STREAM(s_pattern, callback_f, command_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      uint64_t ticks = misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse json: \r\n" << query_info.m_body); \
+      uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::response> resp;\
+      if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp))) \
+      { \
+        LOG_ERROR("Failed to " << #callback_f << "()"); \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+      STREAM_OBJECTS_TO_JSON(command_type::response, static_cast<command_type::response&>(resp)) \
+      response_info.m_mime_tipe = "application/json"; \
+      response_info.m_header_info.m_content_type = " application/json"; \
+      MDEBUG( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms, streaming response"); \
+    }
+
+// the serialized response is taken from or put to `cache`, which has the get/put/is_cacheable of
+// cryptonote::rpc_response_cache and keeps it by the handler and request under `policy`
+#define MAP_URI_AUTO_JON2_CACHED(s_pattern, callback_f, command_type, cache, policy) \
     else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      uint64_t ticks = misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse json: \r\n" << query_info.m_body); \
+      const std::string cache_key = std::string(#callback_f) + '\n' + epee::serialization::store_t_to_binary(static_cast<command_type::request&>(req)); \
+      decltype(cache)::stamp cache_stamp; \
+      const bool cache_hit = cache.get(cache_key, policy, response_info.m_body, cache_stamp); \
+      uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
+      if (!cache_hit) \
+      { \
+        boost::value_initialized<command_type::response> resp;\
+        if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp))) \
+        { \
+          LOG_ERROR("Failed to " << #callback_f << "()"); \
+          response_info.m_response_code = 500; \
+          response_info.m_response_comment = "Internal Server Error"; \
+          return true; \
+        } \
+        epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), response_info.m_body); \
+        if (cache.is_cacheable(static_cast<command_type::response&>(resp))) \
+          cache.put(cache_key, policy, cache_stamp, response_info.m_body); \
+      } \
+      uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+      response_info.m_mime_tipe = "application/json"; \
+      response_info.m_header_info.m_content_type = " application/json"; \
+      MDEBUG( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms" << (cache_hit ? ", cached" : "")); \
+    }
+
+#define MAP_URI_AUTO_BIN2_IF(s_pattern, callback_f, command_type, cond) \
+    else if((query_info.m_URI == s_pattern) && (cond)) \
     { \
       handled = true; \
       uint64_t ticks = misc_utils::get_tick_count(); \
@@ -110,6 +198,72 @@
       MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
     }
 
+#define MAP_URI_AUTO_BIN2(s_pattern, callback_f, command_type) MAP_URI_AUTO_BIN2_IF(s_pattern, callback_f, command_type, true)
+
+// as MAP_URI_AUTO_BIN2, computing the response once for identical requests handled at the same time
+#define MAP_URI_AUTO_BIN2_COALESCED(s_pattern, callback_f, command_type, coalescer) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      uint64_t ticks = misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), query_info.m_body); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse bin body data, body size=" << query_info.m_body.size()); \
+      const std::string coalesce_key = std::string(#callback_f) + '\n' + epee::serialization::store_t_to_binary(static_cast<command_type::request&>(req)); \
+      uint64_t ticks1 = misc_utils::get_tick_count(); \
+      bool shared = false; \
+      const bool r = coalescer.run(coalesce_key, [&](std::string& body) { \
+        boost::value_initialized<command_type::response> resp;\
+        if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp))) \
+          return false; \
+        return epee::serialization::store_t_to_binary(static_cast<command_type::response&>(resp), body); \
+      }, response_info.m_body, shared); \
+      if (!r) \
+      { \
+        LOG_ERROR("Failed to " << #callback_f << "()"); \
+        response_info.m_body.clear(); \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      uint64_t ticks2 = misc_utils::get_tick_count(); \
+      response_info.m_mime_tipe = " application/octet-stream"; \
+      response_info.m_header_info.m_content_type = " application/octet-stream"; \
+      MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms" << (shared ? ", shared" : "")); \
+    }
+
+// as MAP_URI_AUTO_BIN2_COALESCED, for a JSON request and response
+#define MAP_URI_AUTO_JON2_COALESCED(s_pattern, callback_f, command_type, coalescer) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      uint64_t ticks = misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse json: \r\n" << query_info.m_body); \
+      const std::string coalesce_key = std::string(#callback_f) + '\n' + epee::serialization::store_t_to_binary(static_cast<command_type::request&>(req)); \
+      uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
+      bool shared = false; \
+      const bool r = coalescer.run(coalesce_key, [&](std::string& body) { \
+        boost::value_initialized<command_type::response> resp;\
+        if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp))) \
+          return false; \
+        return epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), body); \
+      }, response_info.m_body, shared); \
+      if (!r) \
+      { \
+        LOG_ERROR("Failed to " << #callback_f << "()"); \
+        response_info.m_body.clear(); \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+      response_info.m_mime_tipe = "application/json"; \
+      response_info.m_header_info.m_content_type = " application/json"; \
+      MDEBUG( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms" << (shared ? ", shared" : "")); \
+    }
+
 #define CHAIN_URI_MAP2(callback) else {callback(query_info, response_info, m_conn_context);handled = true;}
 
 #define END_URI_MAP2() return handled;}
@@ -172,6 +326,13 @@
   response_info.m_header_info.m_content_type = " application/json"; \
   MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms");
 
+#define FINALIZE_OBJECTS_TO_JSON_STREAM(method_name) \
+  uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+  STREAM_OBJECTS_TO_JSON(std::decay<decltype(resp)>::type, resp) \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms, streaming response");
+
 #define MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, cond) \
     else if((callback_name == method_name) && (cond)) \
 { \
@@ -190,6 +351,22 @@
 
 #define MAP_JON_RPC_WE(method_name, callback_f, command_type) MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, true)
 
+#define MAP_JON_RPC_WE_STREAM(method_name, callback_f, command_type) \
+    else if(callback_name == method_name) \
+{ \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+  fail_resp.jsonrpc = "2.0"; \
+  fail_resp.id = req.id; \
+  if(!callback_f(req.params, resp.result, fail_resp.error)) \
+  { \
+    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    return true; \
+  } \
+  FINALIZE_OBJECTS_TO_JSON_STREAM(method_name) \
+  return true;\
+}
+
 #define MAP_JON_RPC_WERI(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
@@ -206,6 +383,102 @@
   return true;\
 }
 
+// as MAP_URI_AUTO_JON2_CACHED, for the result of a JSON-RPC method; the response around it is made for each
+// request's id
+#define MAP_JON_RPC_WE_CACHED(method_name, callback_f, command_type, cache, policy) \
+    else if(callback_name == method_name) \
+{ \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  const std::string cache_key = std::string(#callback_f) + '\n' + epee::serialization::store_t_to_binary(req.params); \
+  std::string result_json; \
+  decltype(cache)::stamp cache_stamp; \
+  const bool cache_hit = cache.get(cache_key, policy, result_json, cache_stamp); \
+  if (!cache_hit) \
+  { \
+    epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+    fail_resp.jsonrpc = "2.0"; \
+    fail_resp.id = req.id; \
+    if(!callback_f(req.params, resp.result, fail_resp.error)) \
+    { \
+      epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+      return true; \
+    } \
+    epee::serialization::store_t_to_json(resp.result, result_json, 1); \
+    if (cache.is_cacheable(resp.result)) \
+      cache.put(cache_key, policy, cache_stamp, result_json); \
+  } \
+  uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+  std::string response_tail; \
+  epee::json_rpc::get_response_json_frame(resp.id, response_info.m_body, response_tail); \
+  response_info.m_body += result_json; \
+  response_info.m_body += response_tail; \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms" << (cache_hit ? ", cached" : "")); \
+  return true;\
+}
+
+// as MAP_JON_RPC_WE_CACHED, streaming the result when it isn't cached and keeping a copy of it while
+// it's no larger than the cache takes
+#define MAP_JON_RPC_WE_CACHED_STREAM(method_name, callback_f, command_type, cache, policy) \
+    else if(callback_name == method_name) \
+{ \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  const std::string cache_key = std::string(#callback_f) + '\n' + epee::serialization::store_t_to_binary(req.params); \
+  std::string result_json; \
+  decltype(cache)::stamp cache_stamp; \
+  const bool cache_hit = cache.get(cache_key, policy, result_json, cache_stamp); \
+  std::string response_tail; \
+  if (cache_hit) \
+  { \
+    epee::json_rpc::get_response_json_frame(resp.id, response_info.m_body, response_tail); \
+    response_info.m_body += result_json; \
+    response_info.m_body += response_tail; \
+  } \
+  else \
+  { \
+    epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+    fail_resp.jsonrpc = "2.0"; \
+    fail_resp.id = req.id; \
+    if(!callback_f(req.params, resp.result, fail_resp.error)) \
+    { \
+      epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+      return true; \
+    } \
+    std::string response_head; \
+    epee::json_rpc::get_response_json_frame(resp.id, response_head, response_tail); \
+    typedef typename std::decay<decltype(resp.result)>::type result_type; \
+    std::shared_ptr<result_type> stream_result = std::make_shared<result_type>(std::move(resp.result)); \
+    auto *result_cache = &cache; \
+    const bool cacheable = cache.is_cacheable(*stream_result); \
+    const size_t max_cached = cacheable ? cache.max_entry_size() : 0; \
+    const auto policy_ = policy; \
+    response_info.m_body_stream = [=](const std::function<bool(std::string&&)>& write) { \
+      if (!write(std::string(response_head))) \
+        return false; \
+      std::string copy; \
+      bool keep = max_cached > 0; \
+      const bool r = epee::serialization::store_t_to_json_stream(*stream_result, [&](std::string&& part) { \
+        if (keep && copy.size() + part.size() <= max_cached) \
+          copy += part; \
+        else \
+          keep = false; \
+        return write(std::move(part)); \
+      }, 1); \
+      if (!r || !write(std::string(response_tail))) \
+        return false; \
+      if (keep) \
+        result_cache->put(cache_key, policy_, cache_stamp, copy); \
+      return true; \
+    }; \
+  } \
+  uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms" << (cache_hit ? ", cached" : ", streaming response")); \
+  return true;\
+}
+
 #define MAP_JON_RPC(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
@@ -30,6 +30,8 @@
 #pragma once 
 
 
+#include <map>
+#include <memory>
 #include <boost/thread.hpp>
 #include <boost/bind.hpp> 
 
@@ -83,6 +85,45 @@ namespace epee
       return true;
     }
 
+    /// Gives each server thread a SO_REUSEPORT acceptor of its own, see boosted_tcp_server::set_acceptor_per_thread.
+    /// Should be called before init()
+    void set_acceptor_per_thread(bool enable)
+    {
+      m_net_server.set_acceptor_per_thread(enable);
+    }
+
+    /// Hands requests to threads_count worker threads rather than handling them on the io threads, running
+    /// at most limits[uri] requests to uri at a time. The handler must be safe to call from several threads.
+    /// Should be called before run()
+    void set_request_workers(size_t threads_count, const std::map<std::string, size_t>& limits = {})
+    {
+      t_child_class* child = static_cast<t_child_class*>(this);
+      auto dispatcher = std::make_shared<net_utils::http::request_dispatcher>(threads_count,
+        [child]() { child->init_server_thread(); }, [child]() { child->deinit_server_thread(); });
+      for (const auto& limit : limits)
+        dispatcher->set_limit(limit.first, limit.second);
+      MINFO("Handling requests on " << threads_count << " worker threads");
+      m_net_server.get_config_object().m_dispatcher = std::move(dispatcher);
+    }
+
+    /// Compresses response bodies of at least threshold bytes for clients sending Accept-Encoding, 0 to never
+    /// compress. Should be called before run()
+    void set_response_compression(size_t threshold)
+    {
+      m_net_server.get_config_object().m_compression_threshold = threshold;
+      if (threshold && net_utils::http::accepted_content_codings().empty())
+        MWARNING("Response compression requested but this build has no compression library");
+    }
+
+    /// Per URI request counters of the workers, empty when requests are handled on the io threads
+    std::map<std::string, net_utils::http::request_dispatcher::endpoint_stats> get_request_stats() const
+    {
+      const auto& dispatcher = m_net_server.get_config_object().m_dispatcher;
+      if (!dispatcher)
+        return {};
+      return dispatcher->get_stats();
+    }
+
     bool run(size_t threads_count, bool wait = true)
     {
       //go to loop
@@ -99,6 +140,9 @@ namespace epee
 
     bool deinit()
     {
+      auto& dispatcher = m_net_server.get_config_object().m_dispatcher;
+      if (dispatcher)
+        dispatcher->stop();
       return m_net_server.deinit_server();
     }
 
@@ -90,6 +90,17 @@ namespace epee
     };
 
     typedef response<dummy_result, error> error_response;
+
+    //! A response without its result, to write around a result serialized on its own
+    struct response_head
+    {
+      std::string jsonrpc;
+      epee::serialization::storage_entry id;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(jsonrpc)
+        KV_SERIALIZE(id)
+      END_KV_SERIALIZE_MAP()
+    };
   }
 }
 
@@ -86,6 +86,7 @@ namespace levin
 
     virtual void on_connection_new(t_connection_context& context){};
     virtual void on_connection_close(t_connection_context& context){};
+    virtual net_utils::traffic_class get_traffic_class(int command) { return net_utils::traffic_class_other; }
 
     virtual ~levin_commands_handler(){}
   };
@@ -100,6 +100,7 @@ public:
   int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, const callback_t &cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
 
   int notify(int command, const std::string& in_buff, boost::uuids::uuid connection_id);
+  int notify(int command, const net_utils::shared_buffer& in_buff, boost::uuids::uuid connection_id);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
@@ -326,6 +327,14 @@ public:
     return true;
   }
 
+  // the class the upload scheduler accounts the messages of a command to
+  net_utils::traffic_class get_traffic_class(int command) const
+  {
+    if(!m_config.m_pcommands_handler)
+      return net_utils::traffic_class_other;
+    return m_config.m_pcommands_handler->get_traffic_class(command);
+  }
+
   bool release_protocol()
   {
     decltype(m_invoke_response_handlers) local_invoke_response_handlers;
@@ -390,15 +399,27 @@ public:
 
     m_cache_in_buffer.append((const char*)ptr, cb);
 
+    // frames are parsed in place from cache_offset on, the consumed prefix is dropped once on return
+    // instead of after every frame
+    size_t cache_offset = 0;
+    auto cache_compactor = misc_utils::create_scope_leave_handler([&](){
+      if (cache_offset)
+        m_cache_in_buffer.erase(0, cache_offset);
+    });
+
     bool is_continue = true;
     while(is_continue)
     {
       switch(m_state)
       {
       case stream_state_body:
-        if(m_cache_in_buffer.size() < m_current_head.m_cb)
+        if(m_cache_in_buffer.size() - cache_offset < m_current_head.m_cb)
         {
           is_continue = false;
+          // the rest of the body is appended in place, without reallocating the buffer as it grows
+          m_cache_in_buffer.erase(0, cache_offset);
+          cache_offset = 0;
+          m_cache_in_buffer.reserve(m_current_head.m_cb);
           if(cb >= MIN_BYTES_WANTED)
           {
             CRITICAL_REGION_LOCAL(m_invoke_response_handlers_lock);
@@ -414,12 +435,18 @@ public:
         }
         {
           std::string buff_to_invoke;
-          if(m_cache_in_buffer.size()  == m_current_head.m_cb)
+          if(cache_offset == 0)
+          {
+            // a body received in place is handed over as is, only bytes of the next frames are copied
+            std::string next_frames(m_cache_in_buffer, (std::string::size_type)m_current_head.m_cb);
+            m_cache_in_buffer.resize((std::string::size_type)m_current_head.m_cb);
             buff_to_invoke.swap(m_cache_in_buffer);
+            m_cache_in_buffer.swap(next_frames);
+          }
           else
           {
-            buff_to_invoke.assign(m_cache_in_buffer, 0, (std::string::size_type)m_current_head.m_cb);
-            m_cache_in_buffer.erase(0, (std::string::size_type)m_current_head.m_cb);
+            buff_to_invoke.assign(m_cache_in_buffer, cache_offset, (std::string::size_type)m_current_head.m_cb);
+            cache_offset += m_current_head.m_cb;
           }
 
           bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags&LEVIN_PACKET_RESPONSE);
@@ -478,10 +505,12 @@ public:
               m_current_head.m_have_to_return_data = false;
               m_current_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
               m_current_head.m_flags = LEVIN_PACKET_RESPONSE;
-              std::string send_buff((const char*)&m_current_head, sizeof(m_current_head));
-              send_buff += return_buff;
+              // the header and the response are queued separately and go out with one vectored write
               CRITICAL_REGION_BEGIN(m_send_lock);
-              if(!m_pservice_endpoint->do_send(send_buff.data(), send_buff.size()))
+              const net_utils::traffic_class cls = get_traffic_class(m_current_head.m_command);
+              if(!m_pservice_endpoint->do_send(std::make_shared<const std::string>((const char*)&m_current_head, sizeof(m_current_head)), cls))
+                return false;
+              if(!m_pservice_endpoint->do_send(std::make_shared<const std::string>(std::move(return_buff)), cls))
                 return false;
               CRITICAL_REGION_END();
               MDEBUG(m_connection_context << "LEVIN_PACKET_SENT. [len=" << m_current_head.m_cb
@@ -498,9 +527,11 @@ public:
         break;
       case stream_state_head:
         {
-          if(m_cache_in_buffer.size() < sizeof(bucket_head2))
+          if(m_cache_in_buffer.size() - cache_offset < sizeof(bucket_head2))
           {
-            if(m_cache_in_buffer.size() >= sizeof(uint64_t) && *((uint64_t*)m_cache_in_buffer.data()) != LEVIN_SIGNATURE)
+            uint64_t signature;
+            if(m_cache_in_buffer.size() - cache_offset >= sizeof(signature) &&
+               (memcpy(&signature, m_cache_in_buffer.data() + cache_offset, sizeof(signature)), signature != LEVIN_SIGNATURE))
             {
               MWARNING(m_connection_context << "Signature mismatch, connection will be closed");
               return false;
@@ -509,15 +540,15 @@ public:
             break;
           }
 
-          bucket_head2* phead = (bucket_head2*)m_cache_in_buffer.data();
-          if(LEVIN_SIGNATURE != phead->m_signature)
+          // frames after the first one start at any offset, the header is copied out rather than cast
+          memcpy(&m_current_head, m_cache_in_buffer.data() + cache_offset, sizeof(bucket_head2));
+          if(LEVIN_SIGNATURE != m_current_head.m_signature)
           {
             LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
             return false;
           }
-          m_current_head = *phead;
 
-          m_cache_in_buffer.erase(0, sizeof(bucket_head2));
+          cache_offset += sizeof(bucket_head2);
           m_state = stream_state_body;
           m_oponent_protocol_ver = m_current_head.m_protocol_version;
           if(m_current_head.m_cb > m_config.m_max_packet_size)
@@ -586,7 +617,7 @@ public:
       boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
       CRITICAL_REGION_BEGIN(m_send_lock);
       CRITICAL_REGION_LOCAL1(m_invoke_response_handlers_lock);
-      if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
+      if(!m_pservice_endpoint->do_send(std::make_shared<const std::string>((const char*)&head, sizeof(head)), get_traffic_class(command)))
       {
         LOG_ERROR_CC(m_connection_context, "Failed to do_send");
         err_code = LEVIN_ERROR_CONNECTION;
@@ -599,7 +630,7 @@ public:
         break;
       }
 
-      if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+      if(!m_pservice_endpoint->do_send(std::make_shared<const std::string>(in_buff), get_traffic_class(command)))
       {
         LOG_ERROR_CC(m_connection_context, "Failed to do_send");
         err_code = LEVIN_ERROR_CONNECTION;
@@ -644,13 +675,13 @@ public:
 
     boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
+    if(!m_pservice_endpoint->do_send(std::make_shared<const std::string>((const char*)&head, sizeof(head)), get_traffic_class(command)))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send");
       return LEVIN_ERROR_CONNECTION;
     }
 
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    if(!m_pservice_endpoint->do_send(std::make_shared<const std::string>(in_buff), get_traffic_class(command)))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send");
       return LEVIN_ERROR_CONNECTION;
@@ -695,6 +726,11 @@ public:
   }
 
   int notify(int command, const std::string& in_buff)
+  {
+    return notify(command, std::make_shared<const std::string>(in_buff));
+  }
+
+  int notify(int command, const net_utils::shared_buffer& in_buff)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
                           boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -710,19 +746,19 @@ public:
     bucket_head2 head = {0};
     head.m_signature = LEVIN_SIGNATURE;
     head.m_have_to_return_data = false;
-    head.m_cb = in_buff.size();
+    head.m_cb = in_buff->size();
 
     head.m_command = command;
     head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
     head.m_flags = LEVIN_PACKET_REQUEST;
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
+    if(!m_pservice_endpoint->do_send(std::make_shared<const std::string>((const char*)&head, sizeof(head)), get_traffic_class(command)))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
     }
 
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    if(!m_pservice_endpoint->do_send(in_buff, get_traffic_class(command)))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
@@ -892,6 +928,14 @@ int async_protocol_handler_config<t_connection_context>::notify(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::notify(int command, const net_utils::shared_buffer& in_buff, boost::uuids::uuid connection_id)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->notify(command, in_buff) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
 bool async_protocol_handler_config<t_connection_context>::close(boost::uuids::uuid connection_id)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
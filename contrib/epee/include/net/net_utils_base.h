@@ -31,6 +31,8 @@
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/asio/io_service.hpp>
+#include <memory>
+#include <string>
 #include <typeinfo>
 #include <type_traits>
 #include "serialization/keyvalue_serialization.h"
@@ -277,9 +279,25 @@ namespace net_utils
 	/************************************************************************/
 	/*                                                                      */
 	/************************************************************************/
+	/// Immutable send buffer which can be queued to many connections without copying
+	typedef std::shared_ptr<const std::string> shared_buffer;
+
+	/// Kinds of outgoing traffic the upload scheduler shares the bandwidth between
+	enum traffic_class
+	{
+		traffic_class_block_relay,
+		traffic_class_rta,
+		traffic_class_tx_relay,
+		traffic_class_sync,
+		traffic_class_other,
+		traffic_class_count
+	};
+
 	struct i_service_endpoint
 	{
 		virtual bool do_send(const void* ptr, size_t cb)=0;
+    virtual bool do_send(const shared_buffer& buff) { return do_send(buff->data(), buff->size()); }
+    virtual bool do_send(const shared_buffer& buff, traffic_class cls) { return do_send(buff); }
     virtual bool close()=0;
     virtual bool send_done()=0;
     virtual bool call_run_once_service_io()=0;
@@ -0,0 +1,149 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "net/net_utils_base.h"
+
+namespace epee
+{
+namespace net_utils
+{
+
+/***
+@brief Shares the upload bandwidth between the traffic classes and the peers, without sleeping
+
+The limit is a root token bucket, and each class has a bucket of its own filling at its weighted share of
+the limit. A class may always send on its own tokens, and borrows from the root when other classes leave
+tokens unused, the classes before it in traffic_class order borrowing first. Peers waiting in a class are
+served by start-time fair queueing, so each gets the same number of bytes whatever the size of its writes,
+though a connection only has one write waiting at a time.
+
+Buckets may go into debt by a write bigger than what they hold, which then waits for the debt to be paid.
+Writes which can't go at once are granted from the scheduler's thread, which calls their resume callback.
+*/
+class network_scheduler
+{
+public:
+	typedef boost::chrono::steady_clock clock;
+	typedef std::function<void()> resume_t;
+
+	struct class_stats
+	{
+		uint64_t bytes = 0; ///< granted, including the borrowed bytes
+		uint64_t borrowed_bytes = 0; ///< granted on tokens of the root other classes left unused
+		uint64_t delayed = 0; ///< writes which had to wait
+		uint64_t wait_us = 0; ///< time the delayed writes waited
+		size_t waiting = 0;
+	};
+
+	network_scheduler();
+	~network_scheduler();
+
+	/// The scheduler of the p2p uploads
+	static network_scheduler& get_out();
+
+	/// Sets the limit, 0 for none
+	void set_rate(uint64_t bytes_per_second);
+	uint64_t get_rate() const;
+	void set_weight(traffic_class cls, unsigned weight);
+
+	/// Returns true when flow may write bytes of cls now, which are then accounted for. Otherwise resume is
+	/// called once it may, from the scheduler's thread. A flow has at most one write waiting
+	bool request(uint64_t flow, traffic_class cls, size_t bytes, resume_t resume);
+	/// Drops the write flow has waiting, if any, and what is known of it
+	void cancel(uint64_t flow);
+
+	std::array<class_stats, traffic_class_count> get_stats() const;
+
+	/// The scheduling step, for the thread and the tests: grants the writes which may go at now and
+	/// returns their callbacks, and when to call it next as next, clock::time_point::max() when none waits
+	bool request(uint64_t flow, traffic_class cls, size_t bytes, resume_t resume, clock::time_point now);
+	std::vector<resume_t> dispatch(clock::time_point now, clock::time_point& next);
+
+private:
+	struct bucket
+	{
+		double m_rate = 0; // bytes per second
+		double m_tokens = 0;
+
+		void refill(double seconds);
+		double burst() const;
+		void take(size_t bytes);
+	};
+
+	struct waiting_write
+	{
+		uint64_t m_flow;
+		size_t m_bytes;
+		resume_t m_resume;
+		uint64_t m_start; // virtual time of the class the write is due at
+		clock::time_point m_since;
+	};
+
+	struct traffic_class_state
+	{
+		unsigned m_weight = 1;
+		bucket m_bucket;
+		std::deque<waiting_write> m_waiting;
+		uint64_t m_vtime = 0; // start of the last granted write
+		std::unordered_map<uint64_t, uint64_t> m_finish; // virtual time each flow's last write ends at
+		class_stats m_stats;
+	};
+
+	bool request_locked(uint64_t flow, traffic_class cls, size_t bytes, resume_t& resume, clock::time_point now);
+	std::vector<resume_t> dispatch_locked(clock::time_point now, clock::time_point& next);
+	void refill(clock::time_point now);
+	void update_rates();
+	void grant(traffic_class_state& c, size_t bytes, bool borrowed);
+	uint64_t start_of(traffic_class_state& c, uint64_t flow, size_t bytes);
+	bool grant_next(traffic_class_state& c, bool borrowed, clock::time_point now, std::vector<resume_t>& resumes);
+	void run();
+
+	mutable boost::mutex m_lock;
+	boost::condition_variable m_cond;
+	boost::thread m_thread;
+	bool m_stop;
+	uint64_t m_rate;
+	bucket m_root;
+	std::array<traffic_class_state, traffic_class_count> m_classes;
+	clock::time_point m_last_refill;
+};
+
+} // namespace net_utils
+} // namespace epee
@@ -109,6 +109,8 @@ namespace epee
     constexpr std::size_t size() const noexcept { return len; }
     constexpr std::size_t size_bytes() const noexcept { return size() * sizeof(value_type); }
 
+    constexpr reference operator[](std::size_t index) const noexcept { return ptr[index]; }
+
   private:
     T* ptr;
     std::size_t len;
@@ -144,6 +146,14 @@ namespace epee
     return {reinterpret_cast<const std::uint8_t*>(src.data()), src.size_bytes()}; 
   }
 
+  //! \return `span<const T>` over the bytes of the string-like `src`.
+  template<typename T, typename U>
+  span<const T> strspan(const U& src) noexcept
+  {
+    static_assert(sizeof(typename U::value_type) == 1 && sizeof(T) == 1, "only byte strings can be viewed as bytes");
+    return {reinterpret_cast<const T*>(src.data()), src.size()};
+  }
+
   //! \return `span<const std::uint8_t>` which represents the bytes at `&src`.
   template<typename T>
   span<const std::uint8_t> as_byte_span(const T& src) noexcept
@@ -43,7 +43,7 @@ namespace epee
       if(!transport.is_connected())
         return false;
 
-      serialization::portable_storage stg;
+      serialization::direct_binary_writer stg;
       out_struct.store(stg);
       std::string buff_to_send, buff_to_recv;
       stg.store_to_binary(buff_to_send);
@@ -54,7 +54,7 @@ namespace epee
         MERROR("Failed to invoke command " << command << " return code " << res);
         return false;
       }
-      serialization::portable_storage stg_ret;
+      serialization::direct_binary_reader stg_ret;
       if(!stg_ret.load_from_binary(buff_to_recv))
       {
         LOG_ERROR("Failed to load_from_binary on command " << command);
@@ -87,7 +87,7 @@ namespace epee
     bool invoke_remote_command2(boost::uuids::uuid conn_id, int command, const t_arg& out_struct, t_result& result_struct, t_transport& transport)
     {
 
-      typename serialization::portable_storage stg;
+      typename serialization::direct_binary_writer stg;
       out_struct.store(stg);
       std::string buff_to_send, buff_to_recv;
       stg.store_to_binary(buff_to_send);
@@ -98,7 +98,7 @@ namespace epee
         LOG_PRINT_L1("Failed to invoke command " << command << " return code " << res);
         return false;
       }
-      typename serialization::portable_storage stg_ret;
+      typename serialization::direct_binary_reader stg_ret;
       if(!stg_ret.load_from_binary(buff_to_recv))
       {
         LOG_ERROR("Failed to load_from_binary on command " << command);
@@ -110,7 +110,7 @@ namespace epee
     template<class t_result, class t_arg, class callback_t, class t_transport>
     bool async_invoke_remote_command2(boost::uuids::uuid conn_id, int command, const t_arg& out_struct, t_transport& transport, const callback_t &cb, size_t inv_timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED)
     {
-      typename serialization::portable_storage stg;
+      typename serialization::direct_binary_writer stg;
       const_cast<t_arg&>(out_struct).store(stg);//TODO: add true const support to searilzation
       std::string buff_to_send;
       stg.store_to_binary(buff_to_send);
@@ -123,7 +123,7 @@ namespace epee
           cb(code, result_struct, context);
           return false;
         }
-        serialization::portable_storage stg_ret;
+        serialization::direct_binary_reader stg_ret;
         if(!stg_ret.load_from_binary(buff))
         {
           LOG_ERROR("Failed to load_from_binary on command " << command);
@@ -151,7 +151,7 @@ namespace epee
     bool notify_remote_command2(boost::uuids::uuid conn_id, int command, const t_arg& out_struct, t_transport& transport)
     {
 
-      serialization::portable_storage stg;
+      serialization::direct_binary_writer stg;
       out_struct.store(stg);
       std::string buff_to_send;
       stg.store_to_binary(buff_to_send);
@@ -169,7 +169,7 @@ namespace epee
     template<class t_owner, class t_in_type, class t_out_type, class t_context, class callback_t>
     int buff_to_t_adapter(int command, const std::string& in_buff, std::string& buff_out, callback_t cb, t_context& context )
     {
-      serialization::portable_storage strg;
+      serialization::direct_binary_reader strg;
       if(!strg.load_from_binary(in_buff))
       {
         LOG_ERROR("Failed to load_from_binary in command " << command);
@@ -184,7 +184,7 @@ namespace epee
         return -1;
       }
       int res = cb(command, static_cast<t_in_type&>(in_struct), static_cast<t_out_type&>(out_struct), context);
-      serialization::portable_storage strg_out;
+      serialization::direct_binary_writer strg_out;
       static_cast<t_out_type&>(out_struct).store(strg_out);
 
       if(!strg_out.store_to_binary(buff_out))
@@ -199,7 +199,7 @@ namespace epee
     template<class t_owner, class t_in_type, class t_context, class callback_t>
     int buff_to_t_adapter(t_owner* powner, int command, const std::string& in_buff, callback_t cb, t_context& context)
     {
-      serialization::portable_storage strg;
+      serialization::direct_binary_reader strg;
       if(!strg.load_from_binary(in_buff))
       {
         LOG_ERROR("Failed to load_from_binary in notify " << command);
@@ -0,0 +1,898 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include "misc_language.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+#include "portable_storage_from_bin.h"
+#include "portable_storage_val_converters.h"
+
+// Storages for KV_SERIALIZE structs which write and read the portable_storage binary format directly,
+// without building the storage_entry tree. The output of direct_binary_writer is byte for byte what
+// portable_storage::store_to_binary produces, and direct_binary_reader accepts exactly the buffers
+// portable_storage::load_from_binary does, with the same type conversions on the way out.
+
+namespace epee
+{
+  namespace serialization
+  {
+    template<class t_type> struct serialize_type_code;
+    template<> struct serialize_type_code<int64_t>     { static const uint8_t value = SERIALIZE_TYPE_INT64; };
+    template<> struct serialize_type_code<int32_t>     { static const uint8_t value = SERIALIZE_TYPE_INT32; };
+    template<> struct serialize_type_code<int16_t>     { static const uint8_t value = SERIALIZE_TYPE_INT16; };
+    template<> struct serialize_type_code<int8_t>      { static const uint8_t value = SERIALIZE_TYPE_INT8; };
+    template<> struct serialize_type_code<uint64_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT64; };
+    template<> struct serialize_type_code<uint32_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT32; };
+    template<> struct serialize_type_code<uint16_t>    { static const uint8_t value = SERIALIZE_TYPE_UINT16; };
+    template<> struct serialize_type_code<uint8_t>     { static const uint8_t value = SERIALIZE_TYPE_UINT8; };
+    template<> struct serialize_type_code<double>      { static const uint8_t value = SERIALIZE_TYPE_DUOBLE; };
+    template<> struct serialize_type_code<bool>        { static const uint8_t value = SERIALIZE_TYPE_BOOL; };
+    template<> struct serialize_type_code<std::string> { static const uint8_t value = SERIALIZE_TYPE_STRING; };
+
+    /// Stream interface of pack_varint/pack_entry_to_buff over a string
+    struct string_stream_writer
+    {
+      std::string& m_buff;
+      explicit string_stream_writer(std::string& buff): m_buff(buff) {}
+      void write(const char* ptr, size_t size) { m_buff.append(ptr, size); }
+    };
+
+    inline size_t varint_size(size_t val)
+    {
+      if(val <= 63)
+        return 1;
+      if(val <= 16383)
+        return 2;
+      if(val <= 1073741823)
+        return 4;
+      return 8;
+    }
+
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /// Values are encoded as they are set, sections only keep their entries until store_to_binary sorts
+    /// them by name as std::map does in the tree.
+    class direct_binary_writer
+    {
+    public:
+      struct section_node;
+      struct entry
+      {
+        std::string m_name;
+        uint8_t m_type; // type byte, SERIALIZE_FLAG_ARRAY set for arrays, 0 for an encoded storage_entry
+        std::string m_data; // encoded values, without the size of arrays
+        size_t m_count;
+        section_node* m_section;
+        std::vector<section_node*> m_sections;
+      };
+      struct section_node
+      {
+        std::vector<entry*> m_entries;
+      };
+
+      typedef section_node* hsection;
+      typedef entry* harray;
+      typedef storage_entry meta_entry;
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& v, hsection hparent_section);
+      bool set_value(const std::string& value_name, const storage_entry& v, hsection hparent_section);
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& v, hsection hparent_section);
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& v);
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section);
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection);
+
+      bool store_to_binary(binarybuffer& target);
+
+    private:
+      template<class t_value>
+      static void append_value(std::string& data, const t_value& v) { data.append((const char*)&v, sizeof(v)); }
+      static void append_value(std::string& data, const std::string& v) { string_stream_writer strm(data); put_string(strm, v); }
+
+      entry* find_entry(const std::string& name, hsection hparent_section);
+      entry& reset_entry(const std::string& name, hsection hparent_section, uint8_t type);
+      section_node* new_section();
+
+      static size_t section_size(const section_node& sec);
+      static void write_section(std::string& target, section_node& sec);
+
+      section_node m_root;
+      std::deque<entry> m_entry_pool;
+      std::deque<section_node> m_section_pool;
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_writer::entry* direct_binary_writer::find_entry(const std::string& name, hsection hparent_section)
+    {
+      section_node& sec = hparent_section ? *hparent_section : m_root;
+      for(entry* e: sec.m_entries)
+        if(e->m_name == name)
+          return e;
+      return nullptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_writer::entry& direct_binary_writer::reset_entry(const std::string& name, hsection hparent_section, uint8_t type)
+    {
+      //setting an existing name replaces its value, as in the tree
+      entry* e = find_entry(name, hparent_section);
+      if(!e)
+      {
+        m_entry_pool.emplace_back();
+        e = &m_entry_pool.back();
+        e->m_name = name;
+        (hparent_section ? *hparent_section : m_root).m_entries.push_back(e);
+      }
+      e->m_type = type;
+      e->m_data.clear();
+      e->m_count = 0;
+      e->m_section = nullptr;
+      e->m_sections.clear();
+      return *e;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_writer::section_node* direct_binary_writer::new_section()
+    {
+      m_section_pool.emplace_back();
+      return &m_section_pool.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_writer::hsection direct_binary_writer::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      TRY_ENTRY();
+      entry* e = find_entry(section_name, hparent_section);
+      if(e && e->m_type == SERIALIZE_TYPE_OBJECT)
+        return e->m_section;
+      if(!create_if_notexist)
+        return nullptr;
+      entry& sec = reset_entry(section_name, hparent_section, SERIALIZE_TYPE_OBJECT);
+      sec.m_section = new_section();
+      return sec.m_section;
+      CATCH_ENTRY("direct_binary_writer::open_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool direct_binary_writer::set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      entry& e = reset_entry(value_name, hparent_section, serialize_type_code<t_value>::value);
+      append_value(e.m_data, v);
+      return true;
+      CATCH_ENTRY("direct_binary_writer::set_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool direct_binary_writer::set_value(const std::string& value_name, const storage_entry& v, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      entry& e = reset_entry(value_name, hparent_section, 0);
+      string_stream_writer strm(e.m_data);
+      return pack_entry_to_buff(strm, v);
+      CATCH_ENTRY("direct_binary_writer::set_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    direct_binary_writer::harray direct_binary_writer::insert_first_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      entry& e = reset_entry(value_name, hparent_section, serialize_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY);
+      append_value(e.m_data, v);
+      e.m_count = 1;
+      return &e;
+      CATCH_ENTRY("direct_binary_writer::insert_first_value", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool direct_binary_writer::insert_next_value(harray hval_array, const t_value& v)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT(hval_array, false);
+      CHECK_AND_ASSERT_MES(hval_array->m_type == (serialize_type_code<t_value>::value | SERIALIZE_FLAG_ARRAY),
+        false, "unexpected type in insert_next_value: " << typeid(t_value).name());
+      append_value(hval_array->m_data, v);
+      ++hval_array->m_count;
+      return true;
+      CATCH_ENTRY("direct_binary_writer::insert_next_value", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_writer::harray direct_binary_writer::insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      entry& e = reset_entry(section_name, hparent_section, SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY);
+      hinserted_childsection = new_section();
+      e.m_sections.push_back(hinserted_childsection);
+      return &e;
+      CATCH_ENTRY("direct_binary_writer::insert_first_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool direct_binary_writer::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT(hsec_array, false);
+      CHECK_AND_ASSERT_MES(hsec_array->m_type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY),
+        false, "unexpected type(not 'section') in insert_next_section, type: " << (int)hsec_array->m_type);
+      hinserted_childsection = new_section();
+      hsec_array->m_sections.push_back(hinserted_childsection);
+      return true;
+      CATCH_ENTRY("direct_binary_writer::insert_next_section", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    size_t direct_binary_writer::section_size(const section_node& sec)
+    {
+      size_t size = varint_size(sec.m_entries.size());
+      for(const entry* e: sec.m_entries)
+      {
+        size += 1 + e->m_name.size();
+        if(e->m_type == 0)
+          size += e->m_data.size();
+        else if(e->m_type == SERIALIZE_TYPE_OBJECT)
+          size += 1 + section_size(*e->m_section);
+        else if(e->m_type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY))
+        {
+          size += 1 + varint_size(e->m_sections.size());
+          for(const section_node* s: e->m_sections)
+            size += section_size(*s);
+        }
+        else if(e->m_type & SERIALIZE_FLAG_ARRAY)
+          size += 1 + varint_size(e->m_count) + e->m_data.size();
+        else
+          size += 1 + e->m_data.size();
+      }
+      return size;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_writer::write_section(std::string& target, section_node& sec)
+    {
+      string_stream_writer strm(target);
+      std::sort(sec.m_entries.begin(), sec.m_entries.end(), [](const entry* a, const entry* b) { return a->m_name < b->m_name; });
+      pack_varint(strm, sec.m_entries.size());
+      for(entry* e: sec.m_entries)
+      {
+        CHECK_AND_ASSERT_THROW_MES(e->m_name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << e->m_name.size() << ", val: " << e->m_name);
+        target.push_back(static_cast<char>(e->m_name.size()));
+        target.append(e->m_name);
+        if(e->m_type == 0)
+        {
+          target.append(e->m_data);
+          continue;
+        }
+        target.push_back(static_cast<char>(e->m_type));
+        if(e->m_type == SERIALIZE_TYPE_OBJECT)
+          write_section(target, *e->m_section);
+        else if(e->m_type == (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY))
+        {
+          pack_varint(strm, e->m_sections.size());
+          for(section_node* s: e->m_sections)
+            write_section(target, *s);
+        }
+        else
+        {
+          if(e->m_type & SERIALIZE_FLAG_ARRAY)
+            pack_varint(strm, e->m_count);
+          target.append(e->m_data);
+        }
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool direct_binary_writer::store_to_binary(binarybuffer& target)
+    {
+      TRY_ENTRY();
+      const uint32_t signature_a = PORTABLE_STORAGE_SIGNATUREA, signature_b = PORTABLE_STORAGE_SIGNATUREB;
+      const uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+      target.clear();
+      target.reserve(sizeof(signature_a) + sizeof(signature_b) + sizeof(ver) + section_size(m_root));
+      target.append((const char*)&signature_a, sizeof(signature_a));
+      target.append((const char*)&signature_b, sizeof(signature_b));
+      target.append((const char*)&ver, sizeof(ver));
+      write_section(target, m_root);
+      return true;
+      CATCH_ENTRY("direct_binary_writer::store_to_binary", false);
+    }
+
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /// Indexes the entries of every section in one pass over the buffer, which must outlive the reader,
+    /// and converts values straight from it when they are read. The pass mirrors throwable_buffer_reader
+    /// call for call, down to its recursion accounting, so it rejects the same buffers.
+    class direct_binary_reader
+    {
+    public:
+      struct section_index;
+      struct array_index
+      {
+        uint8_t m_type; // type of the values, without SERIALIZE_FLAG_ARRAY
+        size_t m_count;
+        const uint8_t* m_values;
+        std::vector<section_index*> m_sections;
+        size_t m_next;
+        const uint8_t* m_next_value;
+      };
+      struct entry_index
+      {
+        const char* m_name;
+        uint8_t m_name_size;
+        uint8_t m_type; // SERIALIZE_TYPE_ARRAY for arrays
+        const uint8_t* m_entry; // type byte
+        const uint8_t* m_value;
+        section_index* m_section;
+        array_index* m_array;
+      };
+      struct section_index
+      {
+        std::vector<entry_index> m_entries;
+      };
+
+      typedef section_index* hsection;
+      typedef array_index* harray;
+      typedef storage_entry meta_entry;
+
+      bool load_from_binary(const binarybuffer& source);
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool get_value(const std::string& value_name, t_value& val, hsection hparent_section);
+      bool get_value(const std::string& value_name, storage_entry& val, hsection hparent_section);
+      template<class t_value>
+      harray get_first_value(const std::string& value_name, t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool get_next_value(harray hval_array, t_value& target);
+      harray get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section);
+      bool get_next_section(harray hsec_array, hsection& h_child_section);
+
+    private:
+      struct recursion_guard
+      {
+        size_t& m_counter_ref;
+        recursion_guard(size_t& counter):m_counter_ref(counter)
+        {
+          ++m_counter_ref;
+          CHECK_AND_ASSERT_THROW_MES(m_counter_ref < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+        }
+        ~recursion_guard() { --m_counter_ref; }
+      };
+
+      //indexing, one function for every throwable_buffer_reader function it mirrors
+      const uint8_t* read_raw(size_t count);
+      template<class t_pod_type>
+      void read(t_pod_type& pod_val);
+      template<class t_type>
+      t_type read();
+      size_t read_varint();
+      void read_sec_name(entry_index& e);
+      void read_string();
+      template<class t_type>
+      void read_pod_ae(array_index& a);
+      void read_string_ae(array_index& a);
+      void read_section_ae(array_index& a);
+      void read_array_ae(array_index& a);
+      array_index* load_storage_array_entry(uint8_t type);
+      template<class t_type>
+      void read_pod_se(entry_index& e);
+      void read_string_se(entry_index& e);
+      void read_section_se(entry_index& e);
+      void read_array_se(entry_index& e);
+      void load_storage_entry(entry_index& e);
+      void read_section(section_index& sec);
+
+      //access to indexed values
+      static size_t decode_varint(const uint8_t*& p);
+      static void decode_string(const uint8_t*& p, std::string& target);
+      template<class t_value>
+      static void convert_string(const uint8_t*& p, t_value& target);
+      static void convert_string(const uint8_t*& p, std::string& target) { decode_string(p, target); }
+      template<class t_pod_type, class t_value>
+      static void convert_pod(const uint8_t* p, t_value& target);
+      template<class t_value>
+      static void convert_value(uint8_t type, const uint8_t*& p, t_value& target);
+      const entry_index* find_entry(const std::string& name, hsection hparent_section) const;
+
+      section_index m_root;
+      std::deque<section_index> m_sections;
+      std::deque<array_index> m_arrays;
+      const uint8_t* m_ptr;
+      const uint8_t* m_end;
+      size_t m_count;
+      size_t m_recursion_count;
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool direct_binary_reader::load_from_binary(const binarybuffer& source)
+    {
+      m_root.m_entries.clear();
+      m_sections.clear();
+      m_arrays.clear();
+      const size_t header_size = sizeof(uint32_t) * 2 + sizeof(uint8_t);
+      if(source.size() < header_size)
+      {
+        LOG_ERROR("portable_storage: wrong binary format, packet size = " << source.size() << " less than expected sizeof(storage_block_header)=" << header_size);
+        return false;
+      }
+      uint32_t signature_a, signature_b;
+      uint8_t ver;
+      memcpy(&signature_a, source.data(), sizeof(signature_a));
+      memcpy(&signature_b, source.data() + sizeof(signature_a), sizeof(signature_b));
+      memcpy(&ver, source.data() + sizeof(signature_a) + sizeof(signature_b), sizeof(ver));
+      if(signature_a != PORTABLE_STORAGE_SIGNATUREA || signature_b != PORTABLE_STORAGE_SIGNATUREB)
+      {
+        LOG_ERROR("portable_storage: wrong binary format - signature mismatch");
+        return false;
+      }
+      if(ver != PORTABLE_STORAGE_FORMAT_VER)
+      {
+        LOG_ERROR("portable_storage: wrong binary format - unknown format ver = " << ver);
+        return false;
+      }
+      TRY_ENTRY();
+      if(source.size() == header_size)
+        throw std::runtime_error("throwable_buffer_reader: sz==0");
+      m_ptr = (const uint8_t*)source.data() + header_size;
+      m_count = source.size() - header_size;
+      m_end = m_ptr + m_count;
+      m_recursion_count = 0;
+      read_section(m_root);
+      return true;
+      CATCH_ENTRY("direct_binary_reader::load_from_binary", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const uint8_t* direct_binary_reader::read_raw(size_t count)
+    {
+      recursion_guard rg(m_recursion_count);
+      CHECK_AND_ASSERT_THROW_MES(m_count >= count, " attempt to read " << count << " bytes from buffer with " << m_count << " bytes remained");
+      const uint8_t* p = m_ptr;
+      m_ptr += count;
+      m_count -= count;
+      return p;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_pod_type>
+    void direct_binary_reader::read(t_pod_type& pod_val)
+    {
+      recursion_guard rg(m_recursion_count);
+      static_assert(std::is_pod<t_pod_type>::value, "POD type expected");
+      memcpy(&pod_val, read_raw(sizeof(pod_val)), sizeof(pod_val));
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_type>
+    t_type direct_binary_reader::read()
+    {
+      recursion_guard rg(m_recursion_count);
+      t_type v;
+      read(v);
+      return v;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    size_t direct_binary_reader::read_varint()
+    {
+      recursion_guard rg(m_recursion_count);
+      CHECK_AND_ASSERT_THROW_MES(m_count >= 1, "empty buff, expected place for varint");
+      size_t v = 0;
+      uint8_t size_mask = (*m_ptr) & PORTABLE_RAW_SIZE_MARK_MASK;
+      switch (size_mask)
+      {
+      case PORTABLE_RAW_SIZE_MARK_BYTE: v = read<uint8_t>();break;
+      case PORTABLE_RAW_SIZE_MARK_WORD: v = read<uint16_t>();break;
+      case PORTABLE_RAW_SIZE_MARK_DWORD: v = read<uint32_t>();break;
+      case PORTABLE_RAW_SIZE_MARK_INT64: v = read<uint64_t>();break;
+      }
+      v >>= 2;
+      return v;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_sec_name(entry_index& e)
+    {
+      recursion_guard rg(m_recursion_count);
+      uint8_t name_len = 0;
+      read(name_len);
+      e.m_name = (const char*)read_raw(name_len);
+      e.m_name_size = name_len;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_string()
+    {
+      recursion_guard rg(m_recursion_count);
+      size_t len = read_varint();
+      CHECK_AND_ASSERT_THROW_MES(len < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << len);
+      CHECK_AND_ASSERT_THROW_MES(m_count >= len, "string len count value " << len << " goes out of remain storage len " << m_count);
+      m_ptr += len;
+      m_count -= len;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_type>
+    void direct_binary_reader::read_pod_ae(array_index& a)
+    {
+      recursion_guard rg(m_recursion_count);
+      a.m_count = read_varint();
+      a.m_values = m_ptr;
+      if(!a.m_count)
+        return;
+      //every value is read the same way, the first one goes through the calls the tree makes for each
+      read<t_type>();
+      CHECK_AND_ASSERT_THROW_MES(a.m_count - 1 <= m_count / sizeof(t_type), " attempt to read " << (a.m_count - 1) << " values of " << sizeof(t_type) << " bytes from buffer with " << m_count << " bytes remained");
+      m_ptr += (a.m_count - 1) * sizeof(t_type);
+      m_count -= (a.m_count - 1) * sizeof(t_type);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_string_ae(array_index& a)
+    {
+      recursion_guard rg(m_recursion_count);
+      size_t size = read_varint();
+      a.m_values = m_ptr;
+      a.m_count = 0;
+      while(size--)
+      {
+        recursion_guard rg_value(m_recursion_count);
+        read_string();
+        ++a.m_count;
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_section_ae(array_index& a)
+    {
+      recursion_guard rg(m_recursion_count);
+      size_t size = read_varint();
+      a.m_values = m_ptr;
+      while(size--)
+      {
+        recursion_guard rg_value(m_recursion_count);
+        m_sections.emplace_back();
+        a.m_sections.push_back(&m_sections.back());
+        read_section(m_sections.back());
+      }
+      a.m_count = a.m_sections.size();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_array_ae(array_index& a)
+    {
+      recursion_guard rg(m_recursion_count);
+      a.m_count = read_varint();
+      a.m_values = m_ptr;
+      if(a.m_count)
+      {
+        recursion_guard rg_value(m_recursion_count);
+        recursion_guard rg_array(m_recursion_count);
+        CHECK_AND_ASSERT_THROW_MES(false, "Reading array entry is not supported");
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_reader::array_index* direct_binary_reader::load_storage_array_entry(uint8_t type)
+    {
+      recursion_guard rg(m_recursion_count);
+      type &= ~SERIALIZE_FLAG_ARRAY;
+      m_arrays.emplace_back();
+      array_index& a = m_arrays.back();
+      a.m_type = type;
+      a.m_next = 0;
+      a.m_next_value = nullptr;
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64:  read_pod_ae<int64_t>(a); break;
+      case SERIALIZE_TYPE_INT32:  read_pod_ae<int32_t>(a); break;
+      case SERIALIZE_TYPE_INT16:  read_pod_ae<int16_t>(a); break;
+      case SERIALIZE_TYPE_INT8:   read_pod_ae<int8_t>(a); break;
+      case SERIALIZE_TYPE_UINT64: read_pod_ae<uint64_t>(a); break;
+      case SERIALIZE_TYPE_UINT32: read_pod_ae<uint32_t>(a); break;
+      case SERIALIZE_TYPE_UINT16: read_pod_ae<uint16_t>(a); break;
+      case SERIALIZE_TYPE_UINT8:  read_pod_ae<uint8_t>(a); break;
+      case SERIALIZE_TYPE_DUOBLE: read_pod_ae<double>(a); break;
+      case SERIALIZE_TYPE_BOOL:   read_pod_ae<bool>(a); break;
+      case SERIALIZE_TYPE_STRING: read_string_ae(a); break;
+      case SERIALIZE_TYPE_OBJECT: read_section_ae(a); break;
+      case SERIALIZE_TYPE_ARRAY:  read_array_ae(a); break;
+      default:
+        CHECK_AND_ASSERT_THROW_MES(false, "unknown entry_type code = " << type);
+      }
+      return &a;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_type>
+    void direct_binary_reader::read_pod_se(entry_index& e)
+    {
+      recursion_guard rg(m_recursion_count);
+      e.m_value = m_ptr;
+      t_type v;
+      read(v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_string_se(entry_index& e)
+    {
+      recursion_guard rg(m_recursion_count);
+      recursion_guard rg_value(m_recursion_count);
+      e.m_value = m_ptr;
+      read_string();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_section_se(entry_index& e)
+    {
+      recursion_guard rg(m_recursion_count);
+      m_sections.emplace_back();
+      e.m_section = &m_sections.back();
+      read_section(*e.m_section);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_array_se(entry_index& e)
+    {
+      recursion_guard rg(m_recursion_count);
+      uint8_t ent_type = 0;
+      read(ent_type);
+      CHECK_AND_ASSERT_THROW_MES(ent_type&SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+      e.m_array = load_storage_array_entry(ent_type);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::load_storage_entry(entry_index& e)
+    {
+      recursion_guard rg(m_recursion_count);
+      e.m_entry = m_ptr;
+      uint8_t ent_type = 0;
+      read(ent_type);
+      if(ent_type&SERIALIZE_FLAG_ARRAY)
+      {
+        e.m_type = SERIALIZE_TYPE_ARRAY;
+        e.m_array = load_storage_array_entry(ent_type);
+        return;
+      }
+
+      e.m_type = ent_type;
+      switch(ent_type)
+      {
+      case SERIALIZE_TYPE_INT64:  read_pod_se<int64_t>(e); break;
+      case SERIALIZE_TYPE_INT32:  read_pod_se<int32_t>(e); break;
+      case SERIALIZE_TYPE_INT16:  read_pod_se<int16_t>(e); break;
+      case SERIALIZE_TYPE_INT8:   read_pod_se<int8_t>(e); break;
+      case SERIALIZE_TYPE_UINT64: read_pod_se<uint64_t>(e); break;
+      case SERIALIZE_TYPE_UINT32: read_pod_se<uint32_t>(e); break;
+      case SERIALIZE_TYPE_UINT16: read_pod_se<uint16_t>(e); break;
+      case SERIALIZE_TYPE_UINT8:  read_pod_se<uint8_t>(e); break;
+      case SERIALIZE_TYPE_DUOBLE: read_pod_se<double>(e); break;
+      case SERIALIZE_TYPE_BOOL:   read_pod_se<bool>(e); break;
+      case SERIALIZE_TYPE_STRING: read_string_se(e); break;
+      case SERIALIZE_TYPE_OBJECT: read_section_se(e); break;
+      case SERIALIZE_TYPE_ARRAY:  read_array_se(e); break;
+      default:
+        CHECK_AND_ASSERT_THROW_MES(false, "unknown entry_type code = " << ent_type);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::read_section(section_index& sec)
+    {
+      recursion_guard rg(m_recursion_count);
+      sec.m_entries.clear();
+      size_t count = read_varint();
+      //an entry takes at least two bytes, which bounds what a forged count can reserve
+      sec.m_entries.reserve(std::min(count, m_count / 2));
+      while(count--)
+      {
+        entry_index e = AUTO_VAL_INIT(e);
+        read_sec_name(e);
+        load_storage_entry(e);
+        sec.m_entries.push_back(e);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    size_t direct_binary_reader::decode_varint(const uint8_t*& p)
+    {
+      uint64_t v = 0;
+      switch ((*p) & PORTABLE_RAW_SIZE_MARK_MASK)
+      {
+      case PORTABLE_RAW_SIZE_MARK_BYTE: { uint8_t x; memcpy(&x, p, sizeof(x)); v = x; p += sizeof(x); break; }
+      case PORTABLE_RAW_SIZE_MARK_WORD: { uint16_t x; memcpy(&x, p, sizeof(x)); v = x; p += sizeof(x); break; }
+      case PORTABLE_RAW_SIZE_MARK_DWORD: { uint32_t x; memcpy(&x, p, sizeof(x)); v = x; p += sizeof(x); break; }
+      case PORTABLE_RAW_SIZE_MARK_INT64: { memcpy(&v, p, sizeof(v)); p += sizeof(v); break; }
+      }
+      return v >> 2;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void direct_binary_reader::decode_string(const uint8_t*& p, std::string& target)
+    {
+      const size_t len = decode_varint(p);
+      target.assign((const char*)p, len);
+      p += len;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void direct_binary_reader::convert_string(const uint8_t*& p, t_value& target)
+    {
+      std::string v;
+      decode_string(p, v);
+      convert_t(v, target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_pod_type, class t_value>
+    void direct_binary_reader::convert_pod(const uint8_t* p, t_value& target)
+    {
+      t_pod_type v;
+      memcpy(&v, p, sizeof(v));
+      convert_t(v, target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void direct_binary_reader::convert_value(uint8_t type, const uint8_t*& p, t_value& target)
+    {
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64:  convert_pod<int64_t>(p, target); break;
+      case SERIALIZE_TYPE_INT32:  convert_pod<int32_t>(p, target); break;
+      case SERIALIZE_TYPE_INT16:  convert_pod<int16_t>(p, target); break;
+      case SERIALIZE_TYPE_INT8:   convert_pod<int8_t>(p, target); break;
+      case SERIALIZE_TYPE_UINT64: convert_pod<uint64_t>(p, target); break;
+      case SERIALIZE_TYPE_UINT32: convert_pod<uint32_t>(p, target); break;
+      case SERIALIZE_TYPE_UINT16: convert_pod<uint16_t>(p, target); break;
+      case SERIALIZE_TYPE_UINT8:  convert_pod<uint8_t>(p, target); break;
+      case SERIALIZE_TYPE_DUOBLE: convert_pod<double>(p, target); break;
+      case SERIALIZE_TYPE_BOOL:   convert_pod<bool>(p, target); break;
+      case SERIALIZE_TYPE_STRING: convert_string(p, target); break;
+      //the tree can't convert sections and arrays to values either
+      case SERIALIZE_TYPE_OBJECT: convert_t(section(), target); break;
+      default:                    convert_t(array_entry(), target); break;
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const direct_binary_reader::entry_index* direct_binary_reader::find_entry(const std::string& name, hsection hparent_section) const
+    {
+      //the tree keeps the first of entries with the same name
+      const section_index& sec = hparent_section ? *hparent_section : m_root;
+      for(const entry_index& e: sec.m_entries)
+        if(e.m_name_size == name.size() && !memcmp(e.m_name, name.data(), name.size()))
+          return &e;
+      return nullptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_reader::hsection direct_binary_reader::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      const entry_index* e = find_entry(section_name, hparent_section);
+      if(!e || e->m_type != SERIALIZE_TYPE_OBJECT)
+        return nullptr;
+      return e->m_section;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool direct_binary_reader::get_value(const std::string& value_name, t_value& val, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      const entry_index* e = find_entry(value_name, hparent_section);
+      if(!e)
+        return false;
+      const uint8_t* p = e->m_value;
+      convert_value(e->m_type, p, val);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool direct_binary_reader::get_value(const std::string& value_name, storage_entry& val, hsection hparent_section)
+    {
+      const entry_index* e = find_entry(value_name, hparent_section);
+      if(!e)
+        return false;
+      throwable_buffer_reader buf_reader(e->m_entry, m_end - e->m_entry);
+      val = buf_reader.load_storage_entry();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    direct_binary_reader::harray direct_binary_reader::get_first_value(const std::string& value_name, t_value& target, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      const entry_index* e = find_entry(value_name, hparent_section);
+      if(!e || e->m_type != SERIALIZE_TYPE_ARRAY)
+        return nullptr;
+      array_index* a = e->m_array;
+      a->m_next = 0;
+      a->m_next_value = a->m_values;
+      if(!get_next_value(a, target))
+        return nullptr;
+      return a;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool direct_binary_reader::get_next_value(harray hval_array, t_value& target)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      CHECK_AND_ASSERT(hval_array, false);
+      array_index& a = *hval_array;
+      if(a.m_next >= a.m_count)
+        return false;
+      switch(a.m_type)
+      {
+      case SERIALIZE_TYPE_INT64:  convert_pod<int64_t>(a.m_values + a.m_next * sizeof(int64_t), target); break;
+      case SERIALIZE_TYPE_INT32:  convert_pod<int32_t>(a.m_values + a.m_next * sizeof(int32_t), target); break;
+      case SERIALIZE_TYPE_INT16:  convert_pod<int16_t>(a.m_values + a.m_next * sizeof(int16_t), target); break;
+      case SERIALIZE_TYPE_INT8:   convert_pod<int8_t>(a.m_values + a.m_next * sizeof(int8_t), target); break;
+      case SERIALIZE_TYPE_UINT64: convert_pod<uint64_t>(a.m_values + a.m_next * sizeof(uint64_t), target); break;
+      case SERIALIZE_TYPE_UINT32: convert_pod<uint32_t>(a.m_values + a.m_next * sizeof(uint32_t), target); break;
+      case SERIALIZE_TYPE_UINT16: convert_pod<uint16_t>(a.m_values + a.m_next * sizeof(uint16_t), target); break;
+      case SERIALIZE_TYPE_UINT8:  convert_pod<uint8_t>(a.m_values + a.m_next * sizeof(uint8_t), target); break;
+      case SERIALIZE_TYPE_DUOBLE: convert_pod<double>(a.m_values + a.m_next * sizeof(double), target); break;
+      case SERIALIZE_TYPE_BOOL:   convert_pod<bool>(a.m_values + a.m_next * sizeof(bool), target); break;
+      default:                    convert_value(a.m_type, a.m_next_value, target); break;
+      }
+      ++a.m_next;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    direct_binary_reader::harray direct_binary_reader::get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section)
+    {
+      const entry_index* e = find_entry(section_name, hparent_section);
+      if(!e || e->m_type != SERIALIZE_TYPE_ARRAY || e->m_array->m_type != SERIALIZE_TYPE_OBJECT || e->m_array->m_sections.empty())
+        return nullptr;
+      array_index* a = e->m_array;
+      a->m_next = 1;
+      h_child_section = a->m_sections.front();
+      return a;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool direct_binary_reader::get_next_section(harray hsec_array, hsection& h_child_section)
+    {
+      CHECK_AND_ASSERT(hsec_array, false);
+      if(hsec_array->m_type != SERIALIZE_TYPE_OBJECT)
+        return false;
+      if(hsec_array->m_next >= hsec_array->m_sections.size())
+      {
+        h_child_section = nullptr;
+        return false;
+      }
+      h_child_section = hsec_array->m_sections[hsec_array->m_next++];
+      return true;
+    }
+  }
+}
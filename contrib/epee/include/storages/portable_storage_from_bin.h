@@ -134,12 +134,14 @@ namespace epee
     {
       RECURSION_LIMITATION();
       //for pod types
-      array_entry_t<type_name> sa;
+      //the array is filled in place, copying it into the entry would copy every nested section and string
+      storage_entry se{array_entry(array_entry_t<type_name>())};
+      array_entry_t<type_name>& sa = boost::get<array_entry_t<type_name>>(boost::get<array_entry>(se));
       size_t size = read_varint();
-      //TODO: add some optimization here later
       while(size--)
-        sa.m_array.push_back(read<type_name>());        
-      return storage_entry(array_entry(sa));
+        sa.m_array.push_back(read<type_name>());
+      sa.m_it = sa.m_array.end();
+      return se;
     }
 
     inline 
@@ -264,7 +266,8 @@ namespace epee
         //read section name string
         std::string sec_name;
         read_sec_name(sec_name);
-        sec.m_entries.insert(std::make_pair(sec_name, load_storage_entry()));
+        //entries are stored in key order, so they are appended at the end of the map without a lookup
+        sec.m_entries.emplace_hint(sec.m_entries.end(), std::move(sec_name), load_storage_entry());
       }
     }
     inline 
@@ -0,0 +1,268 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <sstream>
+#include <string>
+#include "misc_log_ex.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_json.h"
+#include "parserse_base_utils.h"
+
+#define JSON_STREAM_CHUNK_SIZE (64*1024)
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /// Storage for KV_SERIALIZE structs which writes JSON as the struct is stored, in the layout of
+    /// portable_storage::dump_as_json, and hands it to the sink in pieces instead of building the tree and
+    /// the whole document first. Entries come out in the order the map stores them rather than sorted by
+    /// name, and a name stored twice in a section is written twice.
+    ///
+    /// The map must store sections depth first, as KV_SERIALIZE does: storing into a section closes the
+    /// sections and arrays opened in it since, and those can't be stored into again.
+    class json_stream_writer
+    {
+    public:
+      /// Takes the next piece of the document, returns false to stop writing
+      typedef std::function<bool(std::string&& piece)> sink_t;
+
+      struct frame
+      {
+        bool m_array;
+        bool m_first;
+        size_t m_indent;
+      };
+
+      typedef frame* hsection;
+      typedef frame* harray;
+      typedef storage_entry meta_entry;
+
+      json_stream_writer(const sink_t& sink, size_t indent = 0, bool insert_newlines = true);
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& v, hsection hparent_section);
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& v, hsection hparent_section);
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& v);
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section);
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection);
+
+      /// Closes the document and passes what is left of it to the sink
+      bool finish();
+
+    private:
+      void write_value(const std::string& v, size_t indent) { m_buff += '"'; m_buff += misc_utils::parse::transform_to_escape_sequence(v); m_buff += '"'; }
+      void write_value(int8_t v, size_t indent) { m_buff += std::to_string(static_cast<int32_t>(v)); }
+      void write_value(uint8_t v, size_t indent) { m_buff += std::to_string(static_cast<int32_t>(v)); }
+      void write_value(bool v, size_t indent) { m_buff += v ? "true" : "false"; }
+      void write_value(double v, size_t indent) { std::stringstream ss; ss << v; m_buff += ss.str(); }
+      void write_value(const storage_entry& v, size_t indent) { std::stringstream ss; dump_as_json(ss, v, indent, m_insert_newlines); m_buff += ss.str(); }
+      template<class t_value>
+      void write_value(const t_value& v, size_t indent) { m_buff += std::to_string(v); }
+
+      frame& unwind_to(hsection hsec);
+      void close_top();
+      void begin_entry(frame& sec, const std::string& name);
+      frame& open_frame(bool array, size_t indent);
+      void flush(bool all);
+
+      sink_t m_sink;
+      std::string m_buff;
+      std::string m_newline;
+      bool m_insert_newlines;
+      std::deque<frame> m_frames;
+      uint64_t m_written;
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    json_stream_writer::json_stream_writer(const sink_t& sink, size_t indent, bool insert_newlines):
+      m_sink(sink), m_newline(insert_newlines ? "\r\n" : ""), m_insert_newlines(insert_newlines), m_written(0)
+    {
+      open_frame(false, indent);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    json_stream_writer::frame& json_stream_writer::unwind_to(hsection hsec)
+    {
+      frame* f = hsec ? hsec : &m_frames.front();
+      while(&m_frames.back() != f)
+      {
+        CHECK_AND_ASSERT_THROW_MES(m_frames.size() > 1, "json_stream_writer: storing into a closed section");
+        close_top();
+      }
+      return *f;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void json_stream_writer::close_top()
+    {
+      const frame& f = m_frames.back();
+      if(f.m_array)
+        m_buff += ']';
+      else
+      {
+        if(!f.m_first)
+          m_buff += m_newline;
+        m_buff += make_indent(f.m_indent);
+        m_buff += '}';
+      }
+      m_frames.pop_back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void json_stream_writer::begin_entry(frame& sec, const std::string& name)
+    {
+      CHECK_AND_ASSERT_THROW_MES(!sec.m_array, "json_stream_writer: storing a named entry into an array");
+      if(!sec.m_first)
+      {
+        m_buff += ',';
+        m_buff += m_newline;
+      }
+      sec.m_first = false;
+      m_buff += make_indent(sec.m_indent + 1);
+      m_buff += '"';
+      m_buff += misc_utils::parse::transform_to_escape_sequence(name);
+      m_buff += "\": ";
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    json_stream_writer::frame& json_stream_writer::open_frame(bool array, size_t indent)
+    {
+      if(array)
+        m_buff += '[';
+      else
+      {
+        m_buff += '{';
+        m_buff += m_newline;
+      }
+      m_frames.push_back(frame{array, true, indent});
+      return m_frames.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void json_stream_writer::flush(bool all)
+    {
+      //pieces grow with the document, so that a large one doesn't make for a long send queue
+      if(!all && m_buff.size() < std::max<uint64_t>(JSON_STREAM_CHUNK_SIZE, m_written / 8))
+        return;
+      if(m_buff.empty())
+        return;
+      m_written += m_buff.size();
+      std::string piece;
+      piece.swap(m_buff);
+      CHECK_AND_ASSERT_THROW_MES(m_sink(std::move(piece)), "json_stream_writer: sink failed after " << m_written << " bytes");
+      m_buff.clear();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    json_stream_writer::hsection json_stream_writer::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      CHECK_AND_ASSERT_THROW_MES(create_if_notexist, "json_stream_writer can't open existing sections");
+      frame& parent = unwind_to(hparent_section);
+      begin_entry(parent, section_name);
+      return &open_frame(false, parent.m_indent + 1);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool json_stream_writer::set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      frame& parent = unwind_to(hparent_section);
+      begin_entry(parent, value_name);
+      write_value(v, parent.m_indent + 1);
+      flush(false);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    json_stream_writer::harray json_stream_writer::insert_first_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      frame& parent = unwind_to(hparent_section);
+      begin_entry(parent, value_name);
+      frame& array = open_frame(true, parent.m_indent + 1);
+      array.m_first = false;
+      write_value(v, array.m_indent);
+      flush(false);
+      return &array;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool json_stream_writer::insert_next_value(harray hval_array, const t_value& v)
+    {
+      CHECK_AND_ASSERT(hval_array, false);
+      frame& array = unwind_to(hval_array);
+      CHECK_AND_ASSERT_THROW_MES(array.m_array, "json_stream_writer: inserting a value into a section");
+      m_buff += ',';
+      write_value(v, array.m_indent);
+      flush(false);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    json_stream_writer::harray json_stream_writer::insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      frame& parent = unwind_to(hparent_section);
+      begin_entry(parent, section_name);
+      frame& array = open_frame(true, parent.m_indent + 1);
+      array.m_first = false;
+      hinserted_childsection = &open_frame(false, array.m_indent);
+      return &array;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool json_stream_writer::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      CHECK_AND_ASSERT(hsec_array, false);
+      frame& array = unwind_to(hsec_array);
+      CHECK_AND_ASSERT_THROW_MES(array.m_array, "json_stream_writer: inserting a section into a section");
+      m_buff += ',';
+      flush(false);
+      hinserted_childsection = &open_frame(false, array.m_indent);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool json_stream_writer::finish()
+    {
+      unwind_to(nullptr);
+      close_top();
+      flush(true);
+      return true;
+    }
+  }
+}
@@ -30,6 +30,8 @@
 
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_direct.h"
+#include "portable_storage_json_stream.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -76,6 +78,16 @@ namespace epee
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
+    bool store_t_to_json_stream(t_struct& str_in, const json_stream_writer::sink_t& sink, size_t indent = 0, bool insert_newlines = true)
+    {
+      TRY_ENTRY();
+      json_stream_writer writer(sink, indent, insert_newlines);
+      str_in.store(writer);
+      return writer.finish();
+      CATCH_ENTRY("store_t_to_json_stream", false);
+    }
+    //-----------------------------------------------------------------------------------------------------------
+    template<class t_struct>
     bool store_t_to_json_file(t_struct& str_in, const std::string& fpath)
     {
       std::string json_buff;
@@ -86,12 +98,12 @@ namespace epee
     template<class t_struct>
     bool load_t_from_binary(t_struct& out, const std::string& binary_buff)
     {
-      portable_storage ps;
-      bool rs = ps.load_from_binary(binary_buff);
+      direct_binary_reader reader;
+      bool rs = reader.load_from_binary(binary_buff);
       if(!rs)
         return false;
 
-      return out.load(ps);
+      return out.load(reader);
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
@@ -107,9 +119,9 @@ namespace epee
     template<class t_struct>
     bool store_t_to_binary(t_struct& str_in, std::string& binary_buff, size_t indent = 0)
     {
-      portable_storage ps;
-      str_in.store(ps);
-      return ps.store_to_binary(binary_buff);
+      direct_binary_writer writer;
+      str_in.store(writer);
+      return writer.store_to_binary(binary_buff);
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
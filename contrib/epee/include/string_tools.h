@@ -103,28 +103,30 @@ namespace string_tools
     res.clear();
     if (!allow_partial_byte && (s.size() & 1))
       return false;
-    try
+    res.resize((s.size() + 1) / 2);
+    for(size_t i = 0; i < s.size() / 2; i++)
     {
-      long v = 0;
-      for(size_t i = 0; i < (s.size() + 1) / 2; i++)
+      const int hi = from_hex::value(s[2 * i]);
+      const int lo = from_hex::value(s[2 * i + 1]);
+      if ((hi | lo) < 0)
       {
-        CharT byte_str[3];
-        size_t copied = s.copy(byte_str, 2, 2 * i);
-        byte_str[copied] = CharT(0);
-        CharT* endptr;
-        v = strtoul(byte_str, &endptr, 16);
-        if (v < 0 || 0xFF < v || endptr != byte_str + copied)
-        {
-          return false;
-        }
-        res.push_back(static_cast<unsigned char>(v));
+        res.clear();
+        return false;
       }
-
-      return true;
-    }catch(...)
+      res[i] = static_cast<CharT>((hi << 4) | lo);
+    }
+    if (s.size() & 1)
     {
-      return false;
+      // a trailing partial byte is its low nibble
+      const int lo = from_hex::value(s.back());
+      if (lo < 0)
+      {
+        res.clear();
+        return false;
+      }
+      res.back() = static_cast<CharT>(lo);
     }
+    return true;
   }
   //----------------------------------------------------------------------------
   template<class t_pod_type>
@@ -340,16 +342,11 @@ POP_WARNINGS
   bool hex_to_pod(const std::string& hex_str, t_pod_type& s)
   {
     static_assert(std::is_pod<t_pod_type>::value, "expected pod type");
-    std::string hex_str_tr = trim(hex_str);
-    if(sizeof(s)*2 != hex_str.size())
-      return false;
-    std::string bin_buff;
-    if(!parse_hexstr_to_binbuff(hex_str_tr, bin_buff))
-      return false;
-    if(bin_buff.size()!=sizeof(s))
+    t_pod_type pod;
+    if(!from_hex::to_buffer({reinterpret_cast<std::uint8_t*>(&pod), sizeof(pod)}, to_span(hex_str)))
       return false;
 
-    s = *(t_pod_type*)bin_buff.data();
+    s = pod;
     return true;
   }
   //----------------------------------------------------------------------------
@@ -78,6 +78,7 @@
 
 // TODO:
 #include "net/network_throttle-detail.hpp"
+#include "net/network_scheduler.hpp"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.p2p"
@@ -143,6 +144,7 @@ connection_basic_pimpl::connection_basic_pimpl(const std::string &name) : m_thro
 
 // static variables:
 int connection_basic_pimpl::m_default_tos;
+static std::atomic<int64_t> buffered_bytes(0);
 
 // methods:
 connection_basic::connection_basic(boost::asio::io_service& io_service, std::atomic<long> &ref_sock_count, std::atomic<long> &sock_number)
@@ -152,6 +154,8 @@ connection_basic::connection_basic(boost::asio::io_service& io_service, std::ato
 	socket_(io_service),
 	m_want_close_connection(false), 
 	m_was_shutdown(false),
+	m_send_que_writing(0),
+	m_send_que_waiting(false),
 	m_ref_sock_count(ref_sock_count)
 { 
 	++ref_sock_count; // increase the global counter
@@ -167,15 +171,26 @@ connection_basic::connection_basic(boost::asio::io_service& io_service, std::ato
 connection_basic::~connection_basic() noexcept(false) {
 	std::string remote_addr_str = "?";
 	m_ref_sock_count--;
+	for (const queued_buffer& entry : m_send_que)
+		add_buffered_bytes(-(int64_t)entry.m_buffer->size());
 	try { boost::system::error_code e; remote_addr_str = socket_.remote_endpoint(e).address().to_string(); } catch(...){} ;
 	_note("Destructing connection p2p#"<<mI->m_peer_number << " to " << remote_addr_str);
 }
 
+uint64_t connection_basic::get_buffered_bytes() {
+	return buffered_bytes.load(std::memory_order_relaxed);
+}
+
+void connection_basic::add_buffered_bytes(int64_t bytes) {
+	buffered_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
 void connection_basic::set_rate_up_limit(uint64_t limit) {
 	{
 		CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
 		network_throttle_manager::get_global_throttle_out().set_target_speed(limit);
 	}
+	network_scheduler::get_out().set_rate(limit * 1024);
 	save_limit_to_file(limit);
 }
 
@@ -0,0 +1,455 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "net/http_content_encoding.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef HTTP_ENABLE_GZIP
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// compressed output is produced in pieces of this size
+#define CONTENT_CODING_OUT_PIECE (16 * 1024)
+// responses are compressed on the request threads, low levels keep that cheap while most of the size is saved
+#define CONTENT_CODING_GZIP_LEVEL 3
+#define CONTENT_CODING_ZSTD_LEVEL 3
+
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  const char* content_coding_name(content_coding coding)
+  {
+    switch (coding)
+    {
+      case content_coding::gzip: return "gzip";
+      case content_coding::zstd: return "zstd";
+      default: return "identity";
+    }
+  }
+
+  bool content_coding_available(content_coding coding)
+  {
+    switch (coding)
+    {
+      case content_coding::identity: return true;
+#ifdef HTTP_ENABLE_GZIP
+      case content_coding::gzip: return true;
+#endif
+#ifdef HAVE_ZSTD
+      case content_coding::zstd: return true;
+#endif
+      default: return false;
+    }
+  }
+
+  const std::string& accepted_content_codings()
+  {
+    static const std::string codings = []() {
+      std::string res;
+      for (const content_coding coding: {content_coding::zstd, content_coding::gzip})
+      {
+        if (!content_coding_available(coding))
+          continue;
+        if (!res.empty())
+          res += ", ";
+        res += content_coding_name(coding);
+      }
+      return res;
+    }();
+    return codings;
+  }
+
+  content_coding negotiate_content_coding(const std::string& accept_encoding)
+  {
+    content_coding best = content_coding::identity;
+    double best_q = 0;
+    double wildcard_q = -1;
+    double zstd_q = -1, gzip_q = -1;
+
+    size_t pos = 0;
+    while (pos < accept_encoding.size())
+    {
+      size_t end = accept_encoding.find(',', pos);
+      if (end == std::string::npos)
+        end = accept_encoding.size();
+      std::string element = accept_encoding.substr(pos, end - pos);
+      pos = end + 1;
+
+      double q = 1;
+      const size_t params = element.find(';');
+      if (params != std::string::npos)
+      {
+        std::string param = element.substr(params + 1);
+        boost::algorithm::trim(param);
+        if (boost::algorithm::istarts_with(param, "q="))
+          q = std::strtod(param.c_str() + 2, nullptr);
+        element.resize(params);
+      }
+      boost::algorithm::trim(element);
+
+      if (boost::algorithm::iequals(element, "zstd"))
+        zstd_q = q;
+      else if (boost::algorithm::iequals(element, "gzip") || boost::algorithm::iequals(element, "x-gzip"))
+        gzip_q = q;
+      else if (element == "*")
+        wildcard_q = q;
+    }
+
+    // a coding not listed takes the q of the wildcard
+    if (zstd_q < 0)
+      zstd_q = wildcard_q;
+    if (gzip_q < 0)
+      gzip_q = wildcard_q;
+    if (content_coding_available(content_coding::zstd) && zstd_q > best_q)
+    {
+      best = content_coding::zstd;
+      best_q = zstd_q;
+    }
+    if (content_coding_available(content_coding::gzip) && gzip_q > best_q)
+      best = content_coding::gzip;
+    return best;
+  }
+
+  content_coding parse_content_coding(const std::string& content_encoding, bool& unsupported)
+  {
+    std::string name = content_encoding;
+    boost::algorithm::trim(name);
+    unsupported = false;
+    content_coding coding = content_coding::identity;
+    if (boost::algorithm::iequals(name, "gzip") || boost::algorithm::iequals(name, "x-gzip") || boost::algorithm::iequals(name, "deflate"))
+      coding = content_coding::gzip;
+    else if (boost::algorithm::iequals(name, "zstd"))
+      coding = content_coding::zstd;
+    else if (!name.empty() && !boost::algorithm::iequals(name, "identity"))
+      unsupported = true;
+    if (!content_coding_available(coding))
+    {
+      unsupported = true;
+      coding = content_coding::identity;
+    }
+    return coding;
+  }
+
+  //-----------------------------------------------------------------------------------------------
+  struct content_encoder::impl
+  {
+    content_coding coding;
+    bool ok = true;
+#ifdef HTTP_ENABLE_GZIP
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CStream* zcs = nullptr;
+#endif
+  };
+
+  content_encoder::content_encoder(content_coding coding)
+    : m_impl(new impl)
+  {
+    m_impl->coding = coding;
+    switch (coding)
+    {
+#ifdef HTTP_ENABLE_GZIP
+      case content_coding::gzip:
+        memset(&m_impl->zs, 0, sizeof(m_impl->zs));
+        // 16 + max window bits asks for a gzip wrapper rather than a zlib one
+        m_impl->ok = deflateInit2(&m_impl->zs, CONTENT_CODING_GZIP_LEVEL, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        break;
+#endif
+#ifdef HAVE_ZSTD
+      case content_coding::zstd:
+        m_impl->zcs = ZSTD_createCStream();
+        m_impl->ok = m_impl->zcs && !ZSTD_isError(ZSTD_initCStream(m_impl->zcs, CONTENT_CODING_ZSTD_LEVEL));
+        break;
+#endif
+      case content_coding::identity:
+        break;
+      default:
+        m_impl->ok = false;
+        break;
+    }
+  }
+
+  content_encoder::~content_encoder()
+  {
+#ifdef HTTP_ENABLE_GZIP
+    if (m_impl->coding == content_coding::gzip)
+      deflateEnd(&m_impl->zs);
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_freeCStream(m_impl->zcs);
+#endif
+  }
+
+  bool content_encoder::update(const char* data, size_t size, std::string& out)
+  {
+    if (!m_impl->ok)
+      return false;
+    switch (m_impl->coding)
+    {
+#ifdef HTTP_ENABLE_GZIP
+      case content_coding::gzip:
+      {
+        z_stream& zs = m_impl->zs;
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = (uInt)size;
+        while (zs.avail_in)
+        {
+          const size_t out_size = out.size();
+          out.resize(out_size + CONTENT_CODING_OUT_PIECE);
+          zs.next_out = (Bytef*)&out[out_size];
+          zs.avail_out = CONTENT_CODING_OUT_PIECE;
+          m_impl->ok = deflate(&zs, Z_NO_FLUSH) == Z_OK;
+          out.resize(out.size() - zs.avail_out);
+          CHECK_AND_ASSERT_MES(m_impl->ok, false, "Failed to gzip response body");
+        }
+        return true;
+      }
+#endif
+#ifdef HAVE_ZSTD
+      case content_coding::zstd:
+      {
+        ZSTD_inBuffer in = { data, size, 0 };
+        while (in.pos < in.size)
+        {
+          const size_t out_size = out.size();
+          out.resize(out_size + CONTENT_CODING_OUT_PIECE);
+          ZSTD_outBuffer zout = { &out[out_size], CONTENT_CODING_OUT_PIECE, 0 };
+          m_impl->ok = !ZSTD_isError(ZSTD_compressStream(m_impl->zcs, &zout, &in));
+          out.resize(out_size + zout.pos);
+          CHECK_AND_ASSERT_MES(m_impl->ok, false, "Failed to zstd compress response body");
+        }
+        return true;
+      }
+#endif
+      case content_coding::identity:
+        out.append(data, size);
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool content_encoder::finish(std::string& out)
+  {
+    if (!m_impl->ok)
+      return false;
+    m_impl->ok = false;
+    switch (m_impl->coding)
+    {
+#ifdef HTTP_ENABLE_GZIP
+      case content_coding::gzip:
+      {
+        z_stream& zs = m_impl->zs;
+        zs.next_in = nullptr;
+        zs.avail_in = 0;
+        int ret = Z_OK;
+        while (ret == Z_OK)
+        {
+          const size_t out_size = out.size();
+          out.resize(out_size + CONTENT_CODING_OUT_PIECE);
+          zs.next_out = (Bytef*)&out[out_size];
+          zs.avail_out = CONTENT_CODING_OUT_PIECE;
+          ret = deflate(&zs, Z_FINISH);
+          out.resize(out.size() - zs.avail_out);
+        }
+        CHECK_AND_ASSERT_MES(ret == Z_STREAM_END, false, "Failed to finish gzip response body");
+        return true;
+      }
+#endif
+#ifdef HAVE_ZSTD
+      case content_coding::zstd:
+      {
+        size_t remaining = 1;
+        while (remaining)
+        {
+          const size_t out_size = out.size();
+          out.resize(out_size + CONTENT_CODING_OUT_PIECE);
+          ZSTD_outBuffer zout = { &out[out_size], CONTENT_CODING_OUT_PIECE, 0 };
+          remaining = ZSTD_endStream(m_impl->zcs, &zout);
+          out.resize(out_size + zout.pos);
+          CHECK_AND_ASSERT_MES(!ZSTD_isError(remaining), false, "Failed to finish zstd response body");
+        }
+        return true;
+      }
+#endif
+      case content_coding::identity:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  //-----------------------------------------------------------------------------------------------
+  struct content_decoder::impl
+  {
+    content_coding coding;
+    size_t max_size;
+    size_t decoded = 0;
+    bool ok = true;
+    bool finished = false;
+#ifdef HTTP_ENABLE_GZIP
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream* zds = nullptr;
+#endif
+  };
+
+  content_decoder::content_decoder(content_coding coding, size_t max_size)
+    : m_impl(new impl)
+  {
+    m_impl->coding = coding;
+    m_impl->max_size = max_size;
+    switch (coding)
+    {
+#ifdef HTTP_ENABLE_GZIP
+      case content_coding::gzip:
+        memset(&m_impl->zs, 0, sizeof(m_impl->zs));
+        // 32 + max window bits detects either of a gzip or zlib wrapper
+        m_impl->ok = inflateInit2(&m_impl->zs, 32 + MAX_WBITS) == Z_OK;
+        break;
+#endif
+#ifdef HAVE_ZSTD
+      case content_coding::zstd:
+        m_impl->zds = ZSTD_createDStream();
+        m_impl->ok = m_impl->zds && !ZSTD_isError(ZSTD_initDStream(m_impl->zds));
+        break;
+#endif
+      case content_coding::identity:
+        break;
+      default:
+        m_impl->ok = false;
+        break;
+    }
+  }
+
+  content_decoder::~content_decoder()
+  {
+#ifdef HTTP_ENABLE_GZIP
+    if (m_impl->coding == content_coding::gzip)
+      inflateEnd(&m_impl->zs);
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_freeDStream(m_impl->zds);
+#endif
+  }
+
+  bool content_decoder::update(const char* data, size_t size, std::string& out)
+  {
+    if (!m_impl->ok)
+      return false;
+    const size_t initial_size = out.size();
+    switch (m_impl->coding)
+    {
+#ifdef HTTP_ENABLE_GZIP
+      case content_coding::gzip:
+      {
+        z_stream& zs = m_impl->zs;
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = (uInt)size;
+        while (zs.avail_in && !m_impl->finished)
+        {
+          const size_t out_size = out.size();
+          out.resize(out_size + CONTENT_CODING_OUT_PIECE);
+          zs.next_out = (Bytef*)&out[out_size];
+          zs.avail_out = CONTENT_CODING_OUT_PIECE;
+          const int ret = inflate(&zs, Z_NO_FLUSH);
+          out.resize(out.size() - zs.avail_out);
+          m_impl->finished = ret == Z_STREAM_END;
+          m_impl->ok = ret == Z_OK || ret == Z_STREAM_END;
+          CHECK_AND_ASSERT_MES(m_impl->ok, false, "Failed to inflate response body, err = " << ret);
+          m_impl->ok = m_impl->decoded + out.size() - initial_size <= m_impl->max_size;
+          CHECK_AND_ASSERT_MES(m_impl->ok, false, "Decoded response body is larger than " << m_impl->max_size);
+        }
+        break;
+      }
+#endif
+#ifdef HAVE_ZSTD
+      case content_coding::zstd:
+      {
+        ZSTD_inBuffer in = { data, size, 0 };
+        while (in.pos < in.size)
+        {
+          const size_t out_size = out.size();
+          out.resize(out_size + CONTENT_CODING_OUT_PIECE);
+          ZSTD_outBuffer zout = { &out[out_size], CONTENT_CODING_OUT_PIECE, 0 };
+          const size_t ret = ZSTD_decompressStream(m_impl->zds, &zout, &in);
+          out.resize(out_size + zout.pos);
+          m_impl->ok = !ZSTD_isError(ret);
+          CHECK_AND_ASSERT_MES(m_impl->ok, false, "Failed to zstd decompress response body: " << ZSTD_getErrorName(ret));
+          // 0 once a frame is complete, another one may follow
+          m_impl->finished = ret == 0;
+          m_impl->ok = m_impl->decoded + out.size() - initial_size <= m_impl->max_size;
+          CHECK_AND_ASSERT_MES(m_impl->ok, false, "Decoded response body is larger than " << m_impl->max_size);
+        }
+        break;
+      }
+#endif
+      case content_coding::identity:
+        m_impl->ok = m_impl->decoded + size <= m_impl->max_size;
+        CHECK_AND_ASSERT_MES(m_impl->ok, false, "Response body is larger than " << m_impl->max_size);
+        out.append(data, size);
+        break;
+      default:
+        return false;
+    }
+    m_impl->decoded += out.size() - initial_size;
+    return true;
+  }
+
+  bool content_decoder::finished() const
+  {
+    return m_impl->coding == content_coding::identity || m_impl->finished;
+  }
+
+  //-----------------------------------------------------------------------------------------------
+  bool encode_body(content_coding coding, std::string& body)
+  {
+    if (coding == content_coding::identity)
+      return true;
+    std::string encoded;
+    content_encoder encoder(coding);
+    if (!encoder.update(body.data(), body.size(), encoded) || !encoder.finish(encoded))
+      return false;
+    body.swap(encoded);
+    return true;
+  }
+}
+}
+}
@@ -36,6 +36,7 @@
 #endif
 #include "misc_log_ex.h"
 #include "syncobj.h"
+#include "memwipe.h"
 #include "mlocker.h"
 
 static size_t query_page_size()
@@ -79,8 +80,10 @@ static void do_unlock(void *ptr, size_t len)
 
 namespace epee
 {
+  constexpr size_t mlocker::max_idle_pages;
   size_t mlocker::page_size = 0;
   size_t mlocker::num_locked_objects = 0;
+  size_t mlocker::num_idle_pages = 0;
 
   boost::mutex &mlocker::mutex()
   {
@@ -141,7 +144,7 @@ namespace epee
   size_t mlocker::get_num_locked_pages()
   {
     CRITICAL_REGION_LOCAL(mutex());
-    return map().size();
+    return map().size() - num_idle_pages;
   }
 
   size_t mlocker::get_num_locked_objects()
@@ -159,6 +162,8 @@ namespace epee
     }
     else
     {
+      if (p.first->second == 0)
+        --num_idle_pages;
       ++p.first->second;
     }
   }
@@ -166,7 +171,7 @@ namespace epee
   void mlocker::unlock_page(size_t page)
   {
     std::map<size_t, unsigned int>::iterator i = map().find(page);
-    if (i == map().end())
+    if (i == map().end() || i->second == 0)
     {
       MERROR("Attempt to unlock unlocked page at " << (void*)(page * page_size));
     }
@@ -174,9 +179,136 @@ namespace epee
     {
       if (!--i->second)
       {
-        map().erase(i);
-        do_unlock((void*)(page * page_size), page_size);
+        if (num_idle_pages < max_idle_pages)
+        {
+          ++num_idle_pages;
+        }
+        else
+        {
+          map().erase(i);
+          do_unlock((void*)(page * page_size), page_size);
+        }
       }
     }
   }
+
+  namespace
+  {
+    constexpr size_t pool_min_block_size = 16;
+    constexpr size_t pool_num_size_classes = 9; // up to 4096 bytes
+    constexpr size_t pool_max_block_size = pool_min_block_size << (pool_num_size_classes - 1);
+    constexpr size_t pool_chunk_size = 64 * 1024;
+
+    struct pool_free_block
+    {
+      pool_free_block *next;
+    };
+
+    struct pool_state
+    {
+      boost::mutex mutex;
+      pool_free_block *free_blocks[pool_num_size_classes] = {};
+      char *chunk_ptr = nullptr; // unused part of the last chunk
+      size_t chunk_left = 0;
+      size_t num_chunks = 0;
+      size_t num_allocated_blocks = 0;
+    };
+
+    pool_state &pool()
+    {
+      // never destroyed, blocks may be freed by static destructors
+      static pool_state *state = new pool_state();
+      return *state;
+    }
+
+    size_t pool_size_class(size_t len)
+    {
+      size_t size_class = 0;
+      while ((pool_min_block_size << size_class) < len)
+        ++size_class;
+      return size_class;
+    }
+  }
+
+  void *mlocked_pool::allocate(size_t len)
+  {
+    if (len > pool_max_block_size)
+    {
+      char *ptr = new char[len];
+      mlocker::lock(ptr, len);
+      return ptr;
+    }
+
+    const size_t size_class = pool_size_class(len);
+    const size_t block_size = pool_min_block_size << size_class;
+    pool_state &state = pool();
+    CRITICAL_REGION_LOCAL(state.mutex);
+    ++state.num_allocated_blocks;
+    if (pool_free_block *block = state.free_blocks[size_class])
+    {
+      state.free_blocks[size_class] = block->next;
+      block->next = nullptr;
+      return block;
+    }
+    if (state.chunk_left < block_size)
+    {
+      // whatever is left of the previous chunk gets into the free lists of the smaller classes
+      for (size_t c = size_class; c-- > 0 && state.chunk_left >= pool_min_block_size; )
+      {
+        const size_t size = pool_min_block_size << c;
+        while (state.chunk_left >= size)
+        {
+          pool_free_block *block = reinterpret_cast<pool_free_block*>(state.chunk_ptr);
+          block->next = state.free_blocks[c];
+          state.free_blocks[c] = block;
+          state.chunk_ptr += size;
+          state.chunk_left -= size;
+        }
+      }
+      char *chunk = new char[pool_chunk_size];
+      mlocker::lock(chunk, pool_chunk_size);
+      ++state.num_chunks;
+      state.chunk_ptr = chunk;
+      state.chunk_left = pool_chunk_size;
+    }
+    void *ptr = state.chunk_ptr;
+    state.chunk_ptr += block_size;
+    state.chunk_left -= block_size;
+    return ptr;
+  }
+
+  void mlocked_pool::deallocate(void *ptr, size_t len) noexcept
+  {
+    if (!ptr)
+      return;
+    memwipe(ptr, len);
+    if (len > pool_max_block_size)
+    {
+      mlocker::unlock(ptr, len);
+      delete[] static_cast<char*>(ptr);
+      return;
+    }
+
+    const size_t size_class = pool_size_class(len);
+    pool_state &state = pool();
+    CRITICAL_REGION_LOCAL(state.mutex);
+    pool_free_block *block = static_cast<pool_free_block*>(ptr);
+    block->next = state.free_blocks[size_class];
+    state.free_blocks[size_class] = block;
+    --state.num_allocated_blocks;
+  }
+
+  size_t mlocked_pool::get_num_chunks()
+  {
+    pool_state &state = pool();
+    CRITICAL_REGION_LOCAL(state.mutex);
+    return state.num_chunks;
+  }
+
+  size_t mlocked_pool::get_num_allocated_blocks()
+  {
+    pool_state &state = pool();
+    CRITICAL_REGION_LOCAL(state.mutex);
+    return state.num_allocated_blocks;
+  }
 }
@@ -36,7 +36,15 @@
 #endif
 
 #include <time.h>
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include "string_tools.h"
@@ -53,6 +61,9 @@ thread_local std::string mlog_current_log_category;
 
 bool mlog_syslog = false;
 
+// bumped whenever the categories change, invalidating the per thread caches of mlog_enabled
+static std::atomic<unsigned> mlog_categories_generation(1);
+
 using namespace epee;
 
 static std::string generate_log_filename(const char *base)
@@ -298,6 +309,7 @@ void mlog_set_categories(const char *categories)
     }
   }
   el::Loggers::setCategories(new_categories.c_str(), true);
+  ++mlog_categories_generation;
   MLOG_LOG("New log categories: " << el::Loggers::getCategories());
 }
 
@@ -500,6 +512,309 @@ void reset_console_color() {
 
 }
 
+namespace
+{
+  struct category_levels
+  {
+    std::string category;
+    unsigned known = 0; // levels looked up in easylogging++
+    unsigned allowed = 0;
+  };
+
+  struct enabled_cache
+  {
+    unsigned generation = 0;
+    // categories are mostly string literals, the pointer finds them and the name guards against reuse
+    std::unordered_map<const char*, category_levels> categories;
+  };
+}
+
+bool mlog_enabled(el::Level level, const char *category)
+{
+  // without it easylogging++ doesn't look at categories but at the levels enabled for the logger
+  if (!category || !el::Loggers::hasFlag(el::LoggingFlag::HierarchicalLogging))
+    return true;
+
+  static thread_local enabled_cache cache;
+  const unsigned generation = mlog_categories_generation.load(std::memory_order_acquire);
+  if (cache.generation != generation || cache.categories.size() > 1024)
+  {
+    cache.categories.clear();
+    cache.generation = generation;
+  }
+
+  category_levels &levels = cache.categories[category];
+  if (levels.category != category)
+  {
+    levels = category_levels();
+    levels.category = category;
+  }
+  const unsigned bit = static_cast<unsigned>(level);
+  if (!(levels.known & bit))
+  {
+    if (ELPP->vRegistry()->allowed(level, category))
+      levels.allowed |= bit;
+    levels.known |= bit;
+  }
+  return levels.allowed & bit;
+}
+
+namespace
+{
+  struct async_log_line
+  {
+    uint64_t seq;
+    el::Level level;
+    el::Logger *logger;
+    bool file_only;
+    std::string line;
+  };
+
+  /// Lines of one logging thread on their way to the writer, written by that thread only
+  class async_log_ring
+  {
+  public:
+    explicit async_log_ring(size_t size): m_lines(size), m_head(0), m_tail(0), m_closed(false) {}
+
+    bool push(async_log_line &&line)
+    {
+      const size_t head = m_head.load(std::memory_order_relaxed);
+      if (head - m_tail.load(std::memory_order_acquire) >= m_lines.size())
+        return false;
+      m_lines[head % m_lines.size()] = std::move(line);
+      m_head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// run by the writer only
+    void pop_all(std::vector<async_log_line> &lines)
+    {
+      const size_t tail = m_tail.load(std::memory_order_relaxed);
+      const size_t head = m_head.load(std::memory_order_acquire);
+      for (size_t i = tail; i != head; ++i)
+        lines.push_back(std::move(m_lines[i % m_lines.size()]));
+      m_tail.store(head, std::memory_order_release);
+    }
+
+    size_t queued() const { return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed); }
+    size_t size() const { return m_lines.size(); }
+    bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed); }
+    void close() { m_closed = true; }
+    bool closed() const { return m_closed; }
+
+  private:
+    std::vector<async_log_line> m_lines;
+    std::atomic<size_t> m_head;
+    std::atomic<size_t> m_tail;
+    std::atomic<bool> m_closed;
+  };
+
+  class async_log_writer
+  {
+  public:
+    static async_log_writer &instance()
+    {
+      static async_log_writer writer;
+      return writer;
+    }
+
+    ~async_log_writer() { stop(); }
+
+    bool start(size_t ring_size)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_running)
+        return true;
+      m_ring_size = std::max<size_t>(ring_size, 16);
+      ++m_rings_generation;
+      m_running = true;
+      m_thread = std::thread([this]() { run(); });
+      return true;
+    }
+
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+          return;
+        m_running = false;
+      }
+      m_cond.notify_one();
+      m_thread.join();
+    }
+
+    bool running() const { return m_running; }
+
+    void push(async_log_line &&line)
+    {
+      struct ring_holder
+      {
+        std::shared_ptr<async_log_ring> ring;
+        unsigned generation = 0;
+        ~ring_holder() { if (ring) ring->close(); }
+      };
+      static thread_local ring_holder holder;
+      if (!holder.ring || holder.generation != m_rings_generation)
+      {
+        if (holder.ring)
+          holder.ring->close();
+        holder.ring = std::make_shared<async_log_ring>(m_ring_size);
+        holder.generation = m_rings_generation;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rings.push_back(holder.ring);
+      }
+      line.seq = m_seq++;
+      if (!holder.ring->push(std::move(line)))
+        ++m_dropped;
+      else if (holder.ring->queued() > holder.ring->size() / 2)
+        m_cond.notify_one();
+    }
+
+    uint64_t dropped() const { return m_dropped; }
+
+  private:
+    async_log_writer(): m_running(false), m_ring_size(MLOG_ASYNC_RING_SIZE), m_rings_generation(0), m_seq(0), m_dropped(0) {}
+
+    void run()
+    {
+      MLOG_SET_THREAD_NAME("[LOG]");
+      std::vector<async_log_line> lines;
+      uint64_t reported_dropped = m_dropped;
+      bool running = true;
+      while (running)
+      {
+        std::vector<std::shared_ptr<async_log_ring>> rings;
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_cond.wait_for(lock, std::chrono::milliseconds(50));
+          running = m_running;
+          // rings of threads gone are dropped once written out
+          m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(),
+              [](const std::shared_ptr<async_log_ring> &ring) { return ring->closed() && ring->empty(); }), m_rings.end());
+          rings = m_rings;
+        }
+
+        lines.clear();
+        for (const auto &ring: rings)
+          ring->pop_all(lines);
+        // the rings are ordered by thread, the sequence numbers put the lines back in the order they were logged
+        std::sort(lines.begin(), lines.end(), [](const async_log_line &a, const async_log_line &b) { return a.seq < b.seq; });
+        write(lines);
+
+        const uint64_t dropped = m_dropped;
+        if (dropped != reported_dropped)
+        {
+          MCWARNING("logging", "Async log writer dropped " << dropped - reported_dropped << " lines, " << dropped << " in total");
+          reported_dropped = dropped;
+        }
+      }
+    }
+
+    static void write(std::vector<async_log_line> &lines)
+    {
+      std::vector<std::pair<el::Logger*, el::Level>> written;
+      for (async_log_line &line: lines)
+      {
+        el::base::TypedConfigurations *tc = line.logger->typedConfigurations();
+        if (tc->toFile(line.level))
+        {
+          // rolling over is done here since the logging threads don't touch the files any more
+          const std::pair<el::Logger*, el::Level> file(line.logger, line.level);
+          if (std::find(written.begin(), written.end(), file) == written.end())
+          {
+            el::Helpers::validateFileRolling(line.logger, line.level);
+            written.push_back(file);
+          }
+          el::base::type::fstream_t *fs = tc->fileStream(line.level);
+          if (fs)
+            fs->write(line.line.c_str(), line.line.size());
+        }
+        if (!line.file_only && tc->toStandardOutput(line.level))
+        {
+          if (el::Loggers::hasFlag(el::LoggingFlag::ColoredTerminalOutput))
+            line.logger->logBuilder()->convertToColoredOutput(&line.line, line.level);
+          ELPP_COUT << ELPP_COUT_LINE(line.line);
+        }
+      }
+      // one flush per batch rather than per line
+      for (const auto &file: written)
+      {
+        el::base::type::fstream_t *fs = file.first->typedConfigurations()->fileStream(file.second);
+        if (fs)
+          fs->flush();
+      }
+      if (!lines.empty())
+        ELPP_COUT << std::flush;
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    size_t m_ring_size;
+    std::atomic<unsigned> m_rings_generation;
+    std::vector<std::shared_ptr<async_log_ring>> m_rings;
+    std::atomic<uint64_t> m_seq;
+    std::atomic<uint64_t> m_dropped;
+  };
+
+  /// Queues the lines for the async writer instead of writing them out like DefaultLogDispatchCallback
+  class async_log_dispatch_callback: public el::LogDispatchCallback
+  {
+  protected:
+    void handle(const el::LogDispatchData *data)
+    {
+      const el::base::DispatchAction action = data->dispatchAction();
+      if (action != el::base::DispatchAction::NormalLog && action != el::base::DispatchAction::FileOnlyLog)
+        return;
+      const el::LogMessage *message = data->logMessage();
+      async_log_line line;
+      line.level = message->level();
+      line.logger = message->logger();
+      line.file_only = action == el::base::DispatchAction::FileOnlyLog;
+      line.line = message->logger()->logBuilder()->build(message, true);
+      async_log_writer::instance().push(std::move(line));
+    }
+  };
+}
+
+bool mlog_start_async(std::size_t ring_size)
+{
+  if (mlog_syslog)
+  {
+    MWARNING("Async logging is not available with syslog");
+    return false;
+  }
+  async_log_writer &writer = async_log_writer::instance();
+  if (writer.running())
+    return true;
+  writer.start(ring_size);
+  // files are only written by the writer then, which also rolls them over
+  el::Loggers::removeFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+  el::Helpers::installLogDispatchCallback<async_log_dispatch_callback>("AsyncLogDispatchCallback");
+  el::Helpers::logDispatchCallback<el::base::DefaultLogDispatchCallback>("DefaultLogDispatchCallback")->setEnabled(false);
+  MINFO("Logging asynchronously, " << ring_size << " lines queued at most per thread");
+  return true;
+}
+
+void mlog_stop_async()
+{
+  async_log_writer &writer = async_log_writer::instance();
+  if (!writer.running())
+    return;
+  el::Helpers::logDispatchCallback<el::base::DefaultLogDispatchCallback>("DefaultLogDispatchCallback")->setEnabled(true);
+  el::Helpers::uninstallLogDispatchCallback<async_log_dispatch_callback>("AsyncLogDispatchCallback");
+  el::Loggers::addFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+  // lines queued before the switch are written out as it stops
+  writer.stop();
+}
+
+uint64_t mlog_get_async_dropped()
+{
+  return async_log_writer::instance().dropped();
+}
+
 static bool mlog(el::Level level, const char *category, const char *format, va_list ap) noexcept
 {
   int size = 0;
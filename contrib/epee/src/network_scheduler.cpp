@@ -0,0 +1,309 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+
+#include "misc_log_ex.h"
+#include "net/network_scheduler.hpp"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.throttle"
+
+namespace
+{
+	// unused tokens are kept for this long, so short bursts go without waiting
+	const double BURST_SECONDS = 0.25;
+	const double MIN_BURST = 16 * 1024;
+	const unsigned DEFAULT_WEIGHTS[epee::net_utils::traffic_class_count] = {
+		8, // block relay
+		4, // rta
+		2, // tx relay
+		2, // sync
+		2, // other
+	};
+}
+
+namespace epee
+{
+namespace net_utils
+{
+
+void network_scheduler::bucket::refill(double seconds)
+{
+	m_tokens = std::min(burst(), m_tokens + m_rate * seconds);
+}
+
+double network_scheduler::bucket::burst() const
+{
+	return std::max(MIN_BURST, m_rate * BURST_SECONDS);
+}
+
+void network_scheduler::bucket::take(size_t bytes)
+{
+	// the debt is kept to a burst or the write, so a class borrowing for long isn't locked out for as long
+	m_tokens = std::max(m_tokens - bytes, -std::max(burst(), (double)bytes));
+}
+
+network_scheduler::network_scheduler()
+	: m_stop(false), m_rate(0), m_last_refill(clock::now())
+{
+	for (size_t i = 0; i < traffic_class_count; ++i)
+		m_classes[i].m_weight = DEFAULT_WEIGHTS[i];
+	update_rates();
+}
+
+network_scheduler::~network_scheduler()
+{
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		m_stop = true;
+	}
+	m_cond.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+network_scheduler& network_scheduler::get_out()
+{
+	static network_scheduler obj;
+	return obj;
+}
+
+void network_scheduler::set_rate(uint64_t bytes_per_second)
+{
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		refill(clock::now());
+		m_rate = bytes_per_second;
+		update_rates();
+	}
+	m_cond.notify_all();
+}
+
+uint64_t network_scheduler::get_rate() const
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	return m_rate;
+}
+
+void network_scheduler::set_weight(traffic_class cls, unsigned weight)
+{
+	{
+		boost::lock_guard<boost::mutex> lock(m_lock);
+		refill(clock::now());
+		m_classes[cls].m_weight = std::max(weight, 1u);
+		update_rates();
+	}
+	m_cond.notify_all();
+}
+
+void network_scheduler::update_rates()
+{
+	unsigned weights = 0;
+	for (const traffic_class_state& c : m_classes)
+		weights += c.m_weight;
+	m_root.m_rate = m_rate;
+	m_root.m_tokens = std::min(m_root.m_tokens, m_root.burst());
+	for (traffic_class_state& c : m_classes)
+	{
+		c.m_bucket.m_rate = (double)m_rate * c.m_weight / weights;
+		c.m_bucket.m_tokens = std::min(c.m_bucket.m_tokens, c.m_bucket.burst());
+	}
+}
+
+void network_scheduler::refill(clock::time_point now)
+{
+	if (now <= m_last_refill)
+		return;
+	const double seconds = boost::chrono::duration_cast<boost::chrono::microseconds>(now - m_last_refill).count() / 1e6;
+	m_last_refill = now;
+	m_root.refill(seconds);
+	for (traffic_class_state& c : m_classes)
+		c.m_bucket.refill(seconds);
+}
+
+uint64_t network_scheduler::start_of(traffic_class_state& c, uint64_t flow, size_t bytes)
+{
+	// a flow which kept sending is due after its previous write, one which was idle joins at the present
+	uint64_t& finish = c.m_finish[flow];
+	const uint64_t start = std::max(c.m_vtime, finish);
+	finish = start + bytes;
+	return start;
+}
+
+void network_scheduler::grant(traffic_class_state& c, size_t bytes, bool borrowed)
+{
+	c.m_bucket.take(bytes);
+	m_root.take(bytes);
+	c.m_stats.bytes += bytes;
+	if (borrowed)
+		c.m_stats.borrowed_bytes += bytes;
+}
+
+bool network_scheduler::request(uint64_t flow, traffic_class cls, size_t bytes, resume_t resume)
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	if (request_locked(flow, cls, bytes, resume, clock::now()))
+		return true;
+	if (!m_thread.joinable())
+		m_thread = boost::thread([this]() { run(); });
+	m_cond.notify_all();
+	return false;
+}
+
+bool network_scheduler::request(uint64_t flow, traffic_class cls, size_t bytes, resume_t resume, clock::time_point now)
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	return request_locked(flow, cls, bytes, resume, now);
+}
+
+bool network_scheduler::request_locked(uint64_t flow, traffic_class cls, size_t bytes, resume_t& resume, clock::time_point now)
+{
+	traffic_class_state& c = m_classes[cls];
+	if (!m_rate)
+	{
+		grant(c, bytes, false);
+		return true;
+	}
+
+	// peers already waiting in the class come first
+	refill(now);
+	if (c.m_waiting.empty())
+	{
+		if (c.m_bucket.m_tokens >= 0)
+		{
+			c.m_vtime = start_of(c, flow, bytes);
+			grant(c, bytes, false);
+			return true;
+		}
+		const bool before_waiting = std::all_of(m_classes.begin(), m_classes.begin() + cls,
+			[](const traffic_class_state& other) { return other.m_waiting.empty(); });
+		if (m_root.m_tokens >= 0 && before_waiting)
+		{
+			c.m_vtime = start_of(c, flow, bytes);
+			grant(c, bytes, true);
+			return true;
+		}
+	}
+
+	c.m_waiting.push_back({flow, bytes, std::move(resume), start_of(c, flow, bytes), now});
+	++c.m_stats.delayed;
+	return false;
+}
+
+void network_scheduler::cancel(uint64_t flow)
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	for (traffic_class_state& c : m_classes)
+	{
+		c.m_waiting.erase(std::remove_if(c.m_waiting.begin(), c.m_waiting.end(),
+			[flow](const waiting_write& w) { return w.m_flow == flow; }), c.m_waiting.end());
+		c.m_finish.erase(flow);
+	}
+}
+
+bool network_scheduler::grant_next(traffic_class_state& c, bool borrowed, clock::time_point now, std::vector<resume_t>& resumes)
+{
+	if (c.m_waiting.empty())
+		return false;
+	// few connections wait at once, so the earliest due is looked for rather than kept sorted
+	auto w = std::min_element(c.m_waiting.begin(), c.m_waiting.end(),
+		[](const waiting_write& a, const waiting_write& b) { return a.m_start < b.m_start; });
+	c.m_vtime = std::max(c.m_vtime, w->m_start);
+	grant(c, w->m_bytes, borrowed);
+	c.m_stats.wait_us += boost::chrono::duration_cast<boost::chrono::microseconds>(now - w->m_since).count();
+	resumes.push_back(std::move(w->m_resume));
+	c.m_waiting.erase(w);
+	return true;
+}
+
+std::vector<network_scheduler::resume_t> network_scheduler::dispatch(clock::time_point now, clock::time_point& next)
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	return dispatch_locked(now, next);
+}
+
+std::vector<network_scheduler::resume_t> network_scheduler::dispatch_locked(clock::time_point now, clock::time_point& next)
+{
+	std::vector<resume_t> resumes;
+	next = clock::time_point::max();
+	refill(now);
+
+	// the classes' own shares first, then what they left unused
+	for (traffic_class_state& c : m_classes)
+		while ((c.m_bucket.m_tokens >= 0 || !m_rate) && grant_next(c, false, now, resumes));
+	for (traffic_class_state& c : m_classes)
+		while (m_root.m_tokens >= 0 && grant_next(c, true, now, resumes));
+
+	for (const traffic_class_state& c : m_classes)
+	{
+		if (c.m_waiting.empty())
+			continue;
+		const double seconds = std::min(-c.m_bucket.m_tokens / c.m_bucket.m_rate, -m_root.m_tokens / m_root.m_rate);
+		const auto wait = boost::chrono::microseconds(std::max<int64_t>((int64_t)(seconds * 1e6), 1000));
+		next = std::min<clock::time_point>(next, now + wait);
+	}
+	return resumes;
+}
+
+void network_scheduler::run()
+{
+	boost::unique_lock<boost::mutex> lock(m_lock);
+	while (!m_stop)
+	{
+		clock::time_point next;
+		std::vector<resume_t> resumes = dispatch_locked(clock::now(), next);
+		if (!resumes.empty())
+		{
+			lock.unlock();
+			for (const resume_t& resume : resumes)
+				resume();
+			lock.lock();
+			continue;
+		}
+		if (next == clock::time_point::max())
+			m_cond.wait(lock);
+		else
+			m_cond.wait_until(lock, next);
+	}
+}
+
+std::array<network_scheduler::class_stats, traffic_class_count> network_scheduler::get_stats() const
+{
+	boost::lock_guard<boost::mutex> lock(m_lock);
+	std::array<class_stats, traffic_class_count> stats;
+	for (size_t i = 0; i < traffic_class_count; ++i)
+	{
+		stats[i] = m_classes[i].m_stats;
+		stats[i].waiting = m_classes[i].m_waiting.size();
+	}
+	return stats;
+}
+
+} // namespace net_utils
+} // namespace epee
@@ -26,6 +26,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <boost/optional/optional.hpp>
 #include <string.h>
 #include "memwipe.h"
@@ -103,23 +104,16 @@ void wipeable_string::grow(size_t sz, size_t reserved)
 {
   if (reserved < sz)
     reserved = sz;
-  if (reserved <= buffer.capacity())
+  if (reserved > buffer.capacity())
   {
-    if (sz < buffer.size())
-      memwipe(buffer.data() + sz, buffer.size() - sz);
-    buffer.resize(sz);
-    return;
+    // growing one append at a time doubles the capacity, an explicit reserve gets what it asks for
+    if (reserved == sz)
+      reserved = std::max(reserved, 2 * buffer.capacity());
+    buffer.reserve(reserved);
   }
-  size_t old_sz = buffer.size();
-  std::unique_ptr<char[]> tmp{new char[old_sz]};
-  memcpy(tmp.get(), buffer.data(), old_sz * sizeof(char));
-  if (old_sz > 0)
-    memwipe(buffer.data(), old_sz * sizeof(char));
-  buffer.reserve(reserved);
+  if (sz < buffer.size())
+    memwipe(buffer.data() + sz, buffer.size() - sz);
   buffer.resize(sz);
-  memcpy(buffer.data(), tmp.get(), old_sz * sizeof(char));
-  if (old_sz > 0)
-    memwipe(tmp.get(), old_sz * sizeof(char));
 }
 
 void wipeable_string::push_back(char c)
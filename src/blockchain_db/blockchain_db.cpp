@@ -87,7 +87,7 @@ const command_line::arg_descriptor<std::string> arg_db_type = {
 };
 const command_line::arg_descriptor<std::string> arg_db_sync_mode = {
   "db-sync-mode"
-, "Specify sync option, using format [safe|fast|fastest]:[sync|async]:[<nblocks_per_sync>[blocks]|<nbytes_per_sync>[bytes]]." 
+, "Specify sync option, using format [safe|fast|fastest]:[sync|async|group]:[<nblocks_per_sync>[blocks]|<nbytes_per_sync>[bytes]|<max_sync_delay>ms]. group syncs on a dedicated thread, at most max_sync_delay (default 100ms) after a commit" 
 , "fast:async:250000000bytes"
 };
 const command_line::arg_descriptor<bool> arg_db_salvage  = {
@@ -95,6 +95,11 @@ const command_line::arg_descriptor<bool> arg_db_salvage  = {
 , "Try to salvage a blockchain database if it seems corrupted"
 , false
 };
+const command_line::arg_descriptor<bool> arg_db_compress_txs  = {
+  "db-compress-txs"
+, "Compress transaction blobs in the blockchain database with zstd. The existing transactions are compressed on the next start, this can't be undone"
+, false
+};
 
 BlockchainDB *new_db(const std::string& db_type)
 {
@@ -112,6 +117,7 @@ void BlockchainDB::init_options(boost::program_options::options_description& des
   command_line::add_arg(desc, arg_db_type);
   command_line::add_arg(desc, arg_db_sync_mode);
   command_line::add_arg(desc, arg_db_salvage);
+  command_line::add_arg(desc, arg_db_compress_txs);
 }
 
 void BlockchainDB::pop_block()
@@ -304,6 +310,63 @@ block BlockchainDB::get_block_from_height(const uint64_t& height) const
   return b;
 }
 
+void BlockchainDB::get_block_blobs_from_height(uint64_t start_height, size_t count, std::vector<blobdata>& blobs) const
+{
+  blobs.clear();
+  blobs.reserve(count);
+  for (uint64_t height = start_height; height < start_height + count; ++height)
+    blobs.push_back(get_block_blob_from_height(height));
+}
+
+void BlockchainDB::get_block_infos_from_height(uint64_t start_height, size_t count, std::vector<block_info_t>& infos) const
+{
+  infos.clear();
+  infos.reserve(count);
+  for (uint64_t height = start_height; height < start_height + count; ++height)
+  {
+    block_info_t info;
+    info.height = height;
+    info.timestamp = get_block_timestamp(height);
+    info.already_generated_coins = get_block_already_generated_coins(height);
+    info.weight = get_block_weight(height);
+    info.cumulative_difficulty = get_block_cumulative_difficulty(height);
+    info.hash = get_block_hash_from_height(height);
+    info.cumulative_rct_outputs = get_block_cumulative_rct_outputs({height}).front();
+    infos.push_back(info);
+  }
+}
+
+void BlockchainDB::get_block_blobs(const std::vector<crypto::hash>& hashes, std::vector<blobdata>& blobs, std::vector<bool>& found) const
+{
+  blobs.clear();
+  blobs.resize(hashes.size());
+  found.assign(hashes.size(), false);
+  for (size_t i = 0; i < hashes.size(); ++i)
+  {
+    uint64_t height;
+    if (block_exists(hashes[i], &height))
+    {
+      blobs[i] = get_block_blob_from_height(height);
+      found[i] = true;
+    }
+  }
+}
+
+void BlockchainDB::get_tx_blobs(const std::vector<crypto::hash>& hashes, std::vector<blobdata>& txs, std::vector<bool>& found, bool pruned) const
+{
+  txs.clear();
+  txs.resize(hashes.size());
+  found.assign(hashes.size(), false);
+  for (size_t i = 0; i < hashes.size(); ++i)
+    found[i] = pruned ? get_pruned_tx_blob(hashes[i], txs[i]) : get_tx_blob(hashes[i], txs[i]);
+}
+
+bool BlockchainDB::get_stake_tx_hashes(uint64_t height, std::vector<crypto::hash>& tx_hashes) const
+{
+  tx_hashes.clear();
+  return false;
+}
+
 block BlockchainDB::get_block(const crypto::hash& h) const
 {
   blobdata bd = get_block_blob(h);
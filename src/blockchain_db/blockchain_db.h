@@ -106,6 +106,7 @@ typedef std::pair<crypto::hash, uint64_t> tx_out_index;
 extern const command_line::arg_descriptor<std::string> arg_db_type;
 extern const command_line::arg_descriptor<std::string> arg_db_sync_mode;
 extern const command_line::arg_descriptor<bool, false> arg_db_salvage;
+extern const command_line::arg_descriptor<bool, false> arg_db_compress_txs;
 
 #pragma pack(push, 1)
 
@@ -121,6 +122,20 @@ struct output_data_t
 };
 #pragma pack(pop)
 
+/**
+ * @brief the per block fields kept in the block info table
+ */
+struct block_info_t
+{
+  uint64_t height;
+  uint64_t timestamp;
+  uint64_t already_generated_coins; //!< up to and including this block
+  uint64_t weight;
+  difficulty_type cumulative_difficulty;
+  crypto::hash hash;
+  uint64_t cumulative_rct_outputs;
+};
+
 #pragma pack(push, 1)
 struct tx_data_t
 {
@@ -153,11 +168,24 @@ struct txpool_tx_meta_t
   uint8_t padding[76]; // till 192 bytes
 };
 
+/**
+ * @brief the metadata kept along with an alternative block
+ */
+struct alt_block_data_t
+{
+  uint64_t height;
+  uint64_t cumulative_weight;
+  difficulty_type cumulative_difficulty;
+  uint64_t already_generated_coins;
+  crypto::hash pow;
+};
+
 #define DBF_SAFE       1
 #define DBF_FAST       2
 #define DBF_FASTEST    4
 #define DBF_RDONLY     8
 #define DBF_SALVAGE 0x10
+#define DBF_COMPRESS_TXS 0x20
 
 /***********************************
  * Exception Definitions
@@ -633,6 +661,33 @@ public:
    */
   virtual void safesyncmode(const bool onoff) = 0;
 
+  /**
+   * @brief sync commits in groups on a dedicated thread
+   *
+   * Commits return without waiting for the disk; a background thread
+   * syncs everything committed since its last sync, so a commit is
+   * durable at most max_delay_millis (plus the sync time) after it is
+   * made. The default implementation leaves syncing as it is.
+   *
+   * @param max_delay_millis the durability delay, 0 to stop group commits
+   */
+  virtual void set_group_commit(uint64_t max_delay_millis) {}
+
+  /**
+   * @brief copy the database files to another folder
+   *
+   * The copy is a consistent snapshot of the database and may be taken
+   * while it is in use. The default implementation doesn't support
+   * copying and throws.
+   *
+   * @param folder an existing folder which holds no database files
+   * @param compact whether to omit free pages from the copy
+   */
+  virtual void copy_to(const std::string& folder, bool compact) const
+  {
+    throw DB_ERROR("Copying is not supported by this database");
+  }
+
   /**
    * @brief Remove everything from the BlockchainDB
    *
@@ -773,6 +828,26 @@ public:
   virtual void block_txn_stop() = 0;
   virtual void block_txn_abort() = 0;
 
+  /**
+   * @brief starts a read session for the calling thread
+   *
+   * Until block_rtxn_stop(), all reads made by the thread share one read
+   * transaction, and so one consistent snapshot, and keep their cursors open.
+   * Sessions do not nest: only the call which returned true should be
+   * matched with block_rtxn_stop(), which db_rtxn_guard takes care of.
+   *
+   * The default implementation has no sessions.
+   *
+   * @return true if a session was started, false if the thread already reads
+   * in a transaction
+   */
+  virtual bool block_rtxn_start() const { return false; }
+
+  /**
+   * @brief ends the read session started by block_rtxn_start()
+   */
+  virtual void block_rtxn_stop() const {}
+
   virtual void set_hard_fork(HardFork* hf);
 
   // adds a block with the given metadata to the top of the blockchain, returns the new height
@@ -880,6 +955,46 @@ public:
    */
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const = 0;
 
+  /**
+   * @brief fetch consecutive block blobs by height
+   *
+   * The default implementation fetches the blocks one by one, subclasses
+   * may walk a single cursor instead.
+   *
+   * If a block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param start_height the height of the first block
+   * @param count the number of blocks
+   * @param blobs return-by-reference the block blobs
+   */
+  virtual void get_block_blobs_from_height(uint64_t start_height, size_t count, std::vector<cryptonote::blobdata>& blobs) const;
+
+  /**
+   * @brief fetch the block info of consecutive blocks by height
+   *
+   * The default implementation fetches each field of each block on its own,
+   * subclasses may walk a single cursor over their block info instead.
+   *
+   * If a block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param start_height the height of the first block
+   * @param count the number of blocks
+   * @param infos return-by-reference the block infos
+   */
+  virtual void get_block_infos_from_height(uint64_t start_height, size_t count, std::vector<block_info_t>& infos) const;
+
+  /**
+   * @brief fetch the block blobs with the given hashes
+   *
+   * The default implementation fetches the blocks one by one, subclasses
+   * may look them up in key order instead.
+   *
+   * @param hashes the hashes to look for
+   * @param blobs return-by-reference the block blobs, in the order of the hashes
+   * @param found return-by-reference whether each block was found
+   */
+  virtual void get_block_blobs(const std::vector<crypto::hash>& hashes, std::vector<cryptonote::blobdata>& blobs, std::vector<bool>& found) const;
+
   /**
    * @brief fetch a block by height
    *
@@ -1165,6 +1280,19 @@ public:
    */
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const = 0;
 
+  /**
+   * @brief fetches the transaction blobs with the given hashes
+   *
+   * The default implementation fetches the transactions one by one,
+   * subclasses may look them up in key order instead.
+   *
+   * @param hashes the hashes to look for
+   * @param txs return-by-reference the transaction blobs, in the order of the hashes
+   * @param found return-by-reference whether each transaction was found
+   * @param pruned whether to fetch pruned transaction blobs
+   */
+  virtual void get_tx_blobs(const std::vector<crypto::hash>& hashes, std::vector<cryptonote::blobdata>& txs, std::vector<bool>& found, bool pruned) const;
+
   /**
    * @brief fetches the prunable transaction hash
    *
@@ -1178,6 +1306,21 @@ public:
    */
   virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const = 0;
 
+  /**
+   * @brief fetches hashes of the block's transactions which carry graft stake extra
+   *
+   * The subclass may keep an index of stake transactions to let the stake
+   * processing skip blocks without them. If the index doesn't cover the
+   * given height, the subclass should return false and the caller has to
+   * scan all transactions of the block. The default implementation has no index.
+   *
+   * @param height the height of the block
+   * @param tx_hashes return-by-reference hashes of stake transactions, in no particular order
+   *
+   * @return true iff the index covers the block
+   */
+  virtual bool get_stake_tx_hashes(uint64_t height, std::vector<crypto::hash>& tx_hashes) const;
+
   /**
    * @brief fetches the total number of transactions ever
    *
@@ -1312,6 +1455,22 @@ public:
    * @param outputs return-by-reference a list of outputs' metadata
    */
   virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false) = 0;
+
+  /**
+   * @brief gets outputs' data and the tx hashes and indices of the transactions creating them
+   *
+   * This function has the results of both get_output_key and get_output_tx_and_index
+   * for a list of outputs, looking each output up once in the amount table.
+   * Lookups are fastest with the offsets in increasing order.
+   *
+   * If any of the outputs cannot be found, the subclass should throw OUTPUT_DNE.
+   *
+   * @param amount an output amount
+   * @param offsets a list of amount-specific output indices
+   * @param outputs return-by-reference a list of outputs' metadata
+   * @param indices return-by-reference a list of tx hashes and output indices (as pairs)
+   */
+  virtual void get_output_keys_and_txs(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, std::vector<tx_out_index> &indices) const = 0;
   
   /*
    * FIXME: Need to check with git blame and ask what this does to
@@ -1420,6 +1579,79 @@ public:
    */
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)>, bool include_blob = false, bool include_unrelayed_txes = true) const = 0;
 
+  /**
+   * @brief store a block which isn't on the main chain
+   *
+   * The default implementation doesn't keep alternative blocks, so they are
+   * lost on restart.
+   *
+   * @param blkid the block's hash
+   * @param data the block's metadata
+   * @param blob the block's blob
+   */
+  virtual void add_alt_block(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata &blob) {}
+
+  /**
+   * @brief remove a stored alternative block, if present
+   *
+   * @param blkid the block's hash
+   */
+  virtual void remove_alt_block(const crypto::hash &blkid) {}
+
+  /**
+   * @brief remove all stored alternative blocks
+   */
+  virtual void drop_alt_blocks() {}
+
+  /**
+   * @brief runs a function over all stored alternative blocks
+   *
+   * If any call to the function returns false, the subclass should return
+   * false.  Otherwise, the subclass returns true.
+   *
+   * @param std::function fn the function to run
+   *
+   * @return false if the function returns false for any block, otherwise true
+   */
+  virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash&, const alt_block_data_t&, const cryptonote::blobdata&)> f) const { return true; }
+
+  /**
+   * @brief get the pruning stripe of the database
+   *
+   * @return the stripe of the blocks whose prunable transaction data is
+   * kept, or 0 if the database isn't pruned
+   *
+   * @see tools::get_pruning_stripe
+   */
+  virtual uint32_t get_blockchain_pruning_stripe() const { return 0; }
+
+  /**
+   * @brief start pruning the database
+   *
+   * Only sets the stripe to keep, the data is removed by prune_old_blocks.
+   * The stripe of a database that is already pruned can't be changed.
+   *
+   * The default implementation doesn't support pruning.
+   *
+   * @param pruning_stripe the stripe to keep
+   *
+   * @return true if the database is now pruned with that stripe, false otherwise
+   */
+  virtual bool set_blockchain_pruning_stripe(uint32_t pruning_stripe) { return false; }
+
+  /**
+   * @brief remove the prunable transaction data of old blocks outside the stripe
+   *
+   * Goes through at most max_blocks blocks from where it stopped the last
+   * time, and never touches the last CRYPTONOTE_PRUNING_TIP_BLOCKS blocks.
+   * The miner transactions, whose prunable data is empty, are left alone.
+   *
+   * @param max_blocks how many blocks to go through
+   *
+   * @return true if all the blocks which can be pruned are, false if there is more to do
+   */
+  virtual bool prune_old_blocks(uint64_t max_blocks) { return true; }
+
   /**
    * @brief runs a function over all key images stored
    *
@@ -1555,6 +1787,28 @@ public:
    */
   virtual uint64_t get_database_size() const = 0;
 
+  /**
+   * @brief counters of storage map resizes
+   */
+  struct resize_stats
+  {
+    uint64_t resizes;             //!< resizes done while a write was waiting
+    uint64_t background_resizes;  //!< resizes done ahead of need while idle
+    uint64_t stall_micros;        //!< total time transactions were held off by resizes
+    uint64_t max_stall_micros;    //!< longest single hold off
+
+    resize_stats(): resizes(0), background_resizes(0), stall_micros(0), max_stall_micros(0) {}
+  };
+
+  /**
+   * @brief get counters of storage map resizes
+   *
+   * The default implementation never resizes.
+   *
+   * @return the counters
+   */
+  virtual resize_stats get_resize_stats() const { return resize_stats(); }
+
   // TODO: this should perhaps be (or call) a series of functions which
   // progressively update through version updates
   /**
@@ -1577,6 +1831,21 @@ public:
 
 };  // class BlockchainDB
 
+/**
+ * @brief keeps a read session of the calling thread for the guard's scope
+ *
+ * Nested guards are cheap: only the outermost one starts and ends the session.
+ */
+class db_rtxn_guard
+{
+public:
+  db_rtxn_guard(const BlockchainDB &db): m_db(db), m_session(db.block_rtxn_start()) {}
+  ~db_rtxn_guard() { if (m_session) m_db.block_rtxn_stop(); }
+private:
+  const BlockchainDB &m_db;
+  bool m_session;
+};
+
 BlockchainDB *new_db(const std::string& db_type);
 
 }  // namespace cryptonote
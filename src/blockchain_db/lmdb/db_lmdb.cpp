@@ -33,9 +33,14 @@
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
 #include <random>
+#include <chrono>
+#include <mutex>
 
 #include "string_tools.h"
 #include "file_io_utils.h"
+#include "misc_language.h"
+#include "common/metrics.h"
+#include "common/pruning.h"
 #include "common/util.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "crypto/crypto.h"
@@ -156,6 +161,23 @@ int compare_string(const MDB_val *a, const MDB_val *b)
   return strcmp(va, vb);
 }
 
+// order of hash duplicates in the hash indexed tables, so sorted lookups move cursors forward
+bool hash32_less(const crypto::hash &a, const crypto::hash &b)
+{
+  MDB_val va = {sizeof(a), (void *)&a}, vb = {sizeof(b), (void *)&b};
+  return compare_hash32(&va, &vb) < 0;
+}
+
+// indices of the hashes in hash index order
+std::vector<size_t> get_hash32_order(const std::vector<crypto::hash> &hashes)
+{
+  std::vector<size_t> order(hashes.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&hashes](size_t a, size_t b) { return hash32_less(hashes[a], hashes[b]); });
+  return order;
+}
+
 /* DB schema:
  *
  * Table            Key          Data
@@ -178,6 +200,8 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * txpool_meta      txn hash     txn metadata
  * txpool_blob      txn hash     txn blob
  *
+ * stake_txs        block ID     [txn hash...]
+ *
  * Note: where the data items are of uniform size, DUPFIXED tables have
  * been used to save space. In most of these cases, a dummy "zerokval"
  * key is used when accessing the table; the Key listed above will be
@@ -185,6 +209,18 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * (DUPFIXED saves 8 bytes per record.)
  *
  * The output_amounts table doesn't use a dummy key, but uses DUPSORT.
+ * The stake_txs table doesn't use a dummy key either; it lists hashes of
+ * transactions with graft stake extra for blocks starting from the height
+ * stored in the "stake_txs_index_height" property.
+ *
+ * When the "pruning_stripe" property is set, txs_prunable only has the
+ * records of the miner txs, of the blocks of that stripe and of the blocks
+ * from the "pruned_height" property on (see tools::get_pruning_stripe).
+ *
+ * When the "txs_compression" property is set, txs_pruned and txs_prunable
+ * records are tagged by tx_blob_codec and may be zstd frames made with the
+ * dictionaries stored in the "txs_pruned_dict" and "txs_prunable_dict"
+ * properties.
  */
 const char* const LMDB_BLOCKS = "blocks";
 const char* const LMDB_BLOCK_HEIGHTS = "block_heights";
@@ -209,6 +245,24 @@ const char* const LMDB_HF_VERSIONS = "hf_versions";
 
 const char* const LMDB_PROPERTIES = "properties";
 
+const char* const LMDB_STAKE_TXS = "stake_txs";
+const char* const LMDB_STAKE_TXS_INDEX_HEIGHT = "stake_txs_index_height";
+
+const char* const LMDB_ALT_BLOCKS = "alt_blocks";
+
+// stripe of the blocks whose prunable tx data is kept, and the height pruning got to
+const char* const LMDB_PRUNING_STRIPE = "pruning_stripe";
+const char* const LMDB_PRUNED_HEIGHT = "pruned_height";
+
+// next tx id to compress, or TXS_COMPRESSION_DONE once all txs are compressed
+const char* const LMDB_TXS_COMPRESSION = "txs_compression";
+const char* const LMDB_TXS_PRUNED_DICT = "txs_pruned_dict";
+const char* const LMDB_TXS_PRUNABLE_DICT = "txs_prunable_dict";
+
+const uint64_t TXS_COMPRESSION_DONE = std::numeric_limits<uint64_t>::max();
+const size_t TXS_DICT_MAX_SIZE = 64 * 1024;
+const uint64_t TXS_DICT_SAMPLES = 4096;
+
 const char zerokey[8] = {0};
 const MDB_val zerokval = { sizeof(zerokey), (void *)zerokey };
 
@@ -224,6 +278,17 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
     throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
 }
 
+bool has_graft_stake_tx_extra(const cryptonote::transaction& tx)
+{
+  std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+  cryptonote::parse_tx_extra(tx.extra, tx_extra_fields);
+
+  cryptonote::tx_extra_graft_stake_tx stake_tx_extra;
+  return cryptonote::find_tx_extra_field_by_type(tx_extra_fields, stake_tx_extra);
+}
+
+tools::metrics::histogram batch_commit_time("graft_db_commit_seconds", "Time spent committing database write transactions", "txn=\"batch\"");
+tools::metrics::histogram block_commit_time("graft_db_commit_seconds", "Time spent committing database write transactions", "txn=\"block\"");
 
 }  // anonymous namespace
 
@@ -497,6 +562,7 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   new_mapsize += (new_mapsize % mst.ms_psize);
 
+  const auto stall_start = std::chrono::steady_clock::now();
   mdb_txn_safe::prevent_new_txns();
 
   if (m_write_txn != nullptr)
@@ -513,13 +579,170 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   mdb_txn_safe::wait_no_active_txns();
 
-  int result = mdb_env_set_mapsize(m_env, new_mapsize);
+  int result;
+  {
+    boost::lock_guard<boost::mutex> sync_lock(m_env_sync_lock);
+    result = mdb_env_set_mapsize(m_env, new_mapsize);
+  }
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to set new mapsize: ", result).c_str()));
 
-  MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
+  mdb_txn_safe::allow_new_txns();
+
+  const uint64_t stall_micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stall_start).count();
+  record_resize_stall(stall_micros, false);
+
+  MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB"
+      << ", transactions held off for " << stall_micros << " us");
+}
+
+void BlockchainLMDB::record_resize_stall(uint64_t micros, bool background)
+{
+  if (background)
+    m_background_resizes++;
+  else
+    m_resizes++;
+
+  m_resize_stall_micros += micros;
+
+  uint64_t max_micros = m_max_resize_stall_micros;
+  while (micros > max_micros && !m_max_resize_stall_micros.compare_exchange_weak(max_micros, micros));
+}
+
+BlockchainDB::resize_stats BlockchainLMDB::get_resize_stats() const
+{
+  resize_stats stats;
+  stats.resizes            = m_resizes;
+  stats.background_resizes = m_background_resizes;
+  stats.stall_micros       = m_resize_stall_micros;
+  stats.max_stall_micros   = m_max_resize_stall_micros;
+  return stats;
+}
+
+bool BlockchainLMDB::try_resize_when_idle(uint64_t new_mapsize)
+{
+  // never wait for writers here; the next check will try again
+  std::unique_lock<epee::critical_section> lock(m_synchronization_lock, std::try_to_lock);
+  if (!lock.owns_lock())
+    return false;
+
+  const auto stall_start = std::chrono::steady_clock::now();
+  mdb_txn_safe::prevent_new_txns();
+
+  if (m_write_txn != nullptr || mdb_txn_safe::num_active_txns > 0)
+  {
+    mdb_txn_safe::allow_new_txns();
+    return false;
+  }
+
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
 
+  int result = 0;
+  if (new_mapsize > mei.me_mapsize)
+  {
+    boost::lock_guard<boost::mutex> sync_lock(m_env_sync_lock);
+    result = mdb_env_set_mapsize(m_env, new_mapsize);
+  }
   mdb_txn_safe::allow_new_txns();
+
+  if (result)
+  {
+    MERROR(lmdb_error("Failed to set new mapsize: ", result));
+    return false;
+  }
+
+  if (new_mapsize <= mei.me_mapsize)
+    return true;
+
+  const uint64_t stall_micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stall_start).count();
+  record_resize_stall(stall_micros, true);
+
+  MGINFO("LMDB Mapsize increased ahead of need." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB"
+      << ", transactions held off for " << stall_micros << " us");
+  return true;
+}
+
+void BlockchainLMDB::resize_monitor()
+{
+  const uint64_t idle_retries = 100;
+  const auto idle_retry_interval = boost::chrono::milliseconds(10);
+
+  boost::unique_lock<boost::mutex> lock(m_resize_lock);
+  while (!m_resize_stop)
+  {
+    m_resize_cond.wait_for(lock, boost::chrono::seconds(RESIZE_MONITOR_INTERVAL_SECONDS), [this]() { return m_resize_stop; });
+    if (m_resize_stop)
+      break;
+
+    MDB_envinfo mei;
+    mdb_env_info(m_env, &mei);
+
+    MDB_stat mst;
+    mdb_env_stat(m_env, &mst);
+
+    const uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+    const uint64_t size_remaining = mei.me_mapsize > size_used ? mei.me_mapsize - size_used : 0;
+    const uint64_t headroom = RESIZE_AHEAD_BATCHES * m_recent_batch_size;
+
+    if ((double)size_used / mei.me_mapsize <= RESIZE_AHEAD_PERCENT && size_remaining >= headroom)
+      continue;
+
+    // grow geometrically so the number of resizes stays logarithmic in the db size
+    uint64_t new_mapsize = std::max<uint64_t>(mei.me_mapsize * (1.0f + RESIZE_GROWTH), size_used + 2 * headroom);
+    new_mapsize += mst.ms_psize - new_mapsize % mst.ms_psize;
+
+    try
+    {
+      boost::filesystem::space_info si = boost::filesystem::space(boost::filesystem::path(m_folder));
+      if (si.available < new_mapsize - mei.me_mapsize)
+      {
+        MWARNING("Insufficient free space to extend database ahead of need: " <<
+            (si.available >> 20L) << " MB available, " << ((new_mapsize - mei.me_mapsize) >> 20L) << " MB needed");
+        continue;
+      }
+    }
+    catch(...)
+    {
+      MWARNING("Unable to query free disk space.");
+    }
+
+    // wait for a moment with no active transactions, e.g. between batches
+    bool resized = false;
+    for (uint64_t i = 0; i < idle_retries && !m_resize_stop && !resized; ++i)
+    {
+      resized = try_resize_when_idle(new_mapsize);
+      if (!resized)
+        m_resize_cond.wait_for(lock, idle_retry_interval, [this]() { return m_resize_stop; });
+    }
+
+    if (!resized)
+      MDEBUG("No idle moment to resize the database ahead of need, will retry");
+  }
+}
+
+void BlockchainLMDB::start_resize_monitor()
+{
+#if defined(ENABLE_AUTO_RESIZE)
+  if (is_read_only())
+    return;
+
+  m_resize_stop = false;
+  m_resize_thread = boost::thread([this]() { resize_monitor(); });
+#endif
+}
+
+void BlockchainLMDB::stop_resize_monitor()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_resize_lock);
+    m_resize_stop = true;
+  }
+
+  m_resize_cond.notify_all();
+
+  if (m_resize_thread.joinable())
+    m_resize_thread.join();
 }
 
 // threshold_size is used for batch transactions
@@ -590,6 +813,10 @@ void BlockchainLMDB::check_and_resize_for_batch(uint64_t batch_num_blocks, uint6
     // size is set to a very small numbers of blocks.
     increase_size = (threshold_size > min_increase_size) ? threshold_size : min_increase_size;
     MDEBUG("increase size: " << increase_size);
+
+    // the resize monitor keeps RESIZE_AHEAD_BATCHES of these ahead
+    const uint64_t recent_batch_size = m_recent_batch_size;
+    m_recent_batch_size = recent_batch_size ? (recent_batch_size * 3 + threshold_size) / 4 : threshold_size;
   }
 
   // if threshold_size is 0 (i.e. number of blocks for batch not passed in), it
@@ -836,15 +1063,15 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   if (!r)
     throw0(DB_ERROR("Failed to serialize pruned tx"));
   std::string pruned = ss.str();
-  MDB_val_copy<blobdata> pruned_blob(pruned);
+  std::string record;
+  MDB_val pruned_blob = make_tx_record(m_txs_pruned_codec, pruned.data(), pruned.size(), record);
   result = mdb_cursor_put(m_cur_txs_pruned, &val_tx_id, &pruned_blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add pruned tx blob to db transaction: ", result).c_str()));
 
   if (pruned.size() > blob.size())
     throw0(DB_ERROR("pruned tx size is larger than tx size"));
-  cryptonote::blobdata prunable(blob.data() + pruned.size(), blob.size() - pruned.size());
-  MDB_val_copy<blobdata> prunable_blob(prunable);
+  MDB_val prunable_blob = make_tx_record(m_txs_prunable_codec, blob.data() + pruned.size(), blob.size() - pruned.size(), record);
   result = mdb_cursor_put(m_cur_txs_prunable, &val_tx_id, &prunable_blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add prunable tx blob to db transaction: ", result).c_str()));
@@ -857,6 +1084,17 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
       throw0(DB_ERROR(lmdb_error("Failed to add prunable tx prunable hash to db transaction: ", result).c_str()));
   }
 
+  if (m_height >= m_stake_txs_index_height && has_graft_stake_tx_extra(tx))
+  {
+    CURSOR(stake_txs)
+
+    MDB_val_set(val_height, m_height);
+    MDB_val_set(val_stake_tx_hash, tx_hash);
+    result = mdb_cursor_put(m_cur_stake_txs, &val_height, &val_stake_tx_hash, MDB_NODUPDATA);
+    if (result && result != MDB_KEYEXIST)
+      throw0(DB_ERROR(lmdb_error("Failed to add stake tx hash to db transaction: ", result).c_str()));
+  }
+
   return tx_id;
 }
 
@@ -882,6 +1120,7 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
       throw1(TX_DNE("Attempting to remove transaction that isn't in the db"));
   txindex *tip = (txindex *)val_h.mv_data;
   MDB_val_set(val_tx_id, tip->data.tx_id);
+  uint64_t block_height = tip->data.block_id;
 
   if ((result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, NULL, MDB_SET)))
       throw1(DB_ERROR(lmdb_error("Failed to locate pruned tx for removal: ", result).c_str()));
@@ -889,11 +1128,16 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
   if (result)
       throw1(DB_ERROR(lmdb_error("Failed to add removal of pruned tx to db transaction: ", result).c_str()));
 
-  if ((result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET)))
+  // the prunable data of txs of pruned blocks is gone already
+  result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET);
+  if (result == 0)
+  {
+    result = mdb_cursor_del(m_cur_txs_prunable, 0);
+    if (result)
+        throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
+  }
+  else if (result != MDB_NOTFOUND || !m_pruning_stripe)
       throw1(DB_ERROR(lmdb_error("Failed to locate prunable tx for removal: ", result).c_str()));
-  result = mdb_cursor_del(m_cur_txs_prunable, 0);
-  if (result)
-      throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
 
   if (tx.version > 1)
   {
@@ -918,6 +1162,19 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
       throw1(DB_ERROR(lmdb_error("Failed to add removal of tx outputs to db transaction: ", result).c_str()));
   }
 
+  if (block_height >= m_stake_txs_index_height)
+  {
+    CURSOR(stake_txs)
+
+    MDB_val_set(val_height, block_height);
+    MDB_val_set(val_stake_tx_hash, tx_hash);
+    result = mdb_cursor_get(m_cur_stake_txs, &val_height, &val_stake_tx_hash, MDB_GET_BOTH);
+    if (!result)
+      result = mdb_cursor_del(m_cur_stake_txs, 0);
+    if (result && result != MDB_NOTFOUND)
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of stake tx hash to db transaction: ", result).c_str()));
+  }
+
   // Don't delete the tx_indices entry until the end, after we're done with val_tx_id
   if (mdb_cursor_del(m_cur_tx_indices, 0))
       throw1(DB_ERROR("Failed to add removal of tx index to db transaction"));
@@ -1087,6 +1344,21 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
     else
       throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
   }
+
+  // the key image is in the filter before its txn commits, so readers never miss it
+  if (key_image_filter* filter = m_key_image_filter.load(std::memory_order_relaxed))
+  {
+    if (++m_key_image_filter_size <= filter->get_capacity())
+      filter->insert(k_image);
+    else
+    {
+      MDB_stat db_stats;
+      if (auto result = mdb_stat(*m_write_txn, m_spent_keys, &db_stats))
+        throw0(DB_ERROR(lmdb_error("Failed to query m_spent_keys: ", result).c_str()));
+      rebuild_key_image_filter(m_cur_spent_keys, db_stats.ms_entries);
+      MDEBUG("Spent key image filter rebuilt with room for " << m_key_image_filter.load()->get_capacity() << " key images");
+    }
+  }
 }
 
 void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
@@ -1121,9 +1393,7 @@ blobdata BlockchainLMDB::output_to_blob(const tx_out& output) const
 tx_out BlockchainLMDB::output_from_blob(const blobdata& blob) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  std::stringstream ss;
-  ss << blob;
-  binary_archive<false> ba(ss);
+  binary_archive<false> ba{epee::strspan<std::uint8_t>(blob)};
   tx_out o;
 
   if (!(::serialization::serialize(ba, o)))
@@ -1166,6 +1436,21 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_stake_txs_index_height = std::numeric_limits<uint64_t>::max();
+  m_has_alt_blocks = false;
+  m_pruning_stripe = 0;
+  m_pruned_height = 0;
+  m_txs_compressed = false;
+  m_key_image_filter = nullptr;
+  m_key_image_filter_size = 0;
+  m_resize_stop = false;
+  m_group_commit_stop = false;
+  m_group_commit_millis = 0;
+  m_recent_batch_size = 0;
+  m_resizes = 0;
+  m_background_resizes = 0;
+  m_resize_stall_micros = 0;
+  m_max_resize_stall_micros = 0;
 
   // reset may also need changing when initialize things here
 
@@ -1222,7 +1507,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   // set up lmdb environment
   if ((result = mdb_env_create(&m_env)))
     throw0(DB_ERROR(lmdb_error("Failed to create lmdb environment: ", result).c_str()));
-  if ((result = mdb_env_set_maxdbs(m_env, 20)))
+  if ((result = mdb_env_set_maxdbs(m_env, 32)))
     throw0(DB_ERROR(lmdb_error("Failed to set max number of dbs: ", result).c_str()));
 
   int threads = tools::get_max_concurrency();
@@ -1304,16 +1589,42 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   lmdb_db_open(txn, LMDB_PROPERTIES, MDB_CREATE, m_properties, "Failed to open db handle for m_properties");
 
+  // the stake txs index may be absent in a database made by an older version, which can't be created read-only
+  bool has_stake_txs = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_STAKE_TXS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_stake_txs, "Failed to open db handle for m_stake_txs");
+  else if ((result = mdb_dbi_open(txn, LMDB_STAKE_TXS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, &m_stake_txs)))
+  {
+    if (result != MDB_NOTFOUND)
+      throw0(DB_OPEN_FAILURE(lmdb_error("Failed to open db handle for m_stake_txs: ", result).c_str()));
+    has_stake_txs = false;
+  }
+
+  // alternative blocks are kept by newer versions only, same as above
+  m_has_alt_blocks = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_ALT_BLOCKS, MDB_CREATE, m_alt_blocks, "Failed to open db handle for m_alt_blocks");
+  else if ((result = mdb_dbi_open(txn, LMDB_ALT_BLOCKS, 0, &m_alt_blocks)))
+  {
+    if (result != MDB_NOTFOUND)
+      throw0(DB_OPEN_FAILURE(lmdb_error("Failed to open db handle for m_alt_blocks: ", result).c_str()));
+    m_has_alt_blocks = false;
+  }
+
   mdb_set_dupsort(txn, m_spent_keys, compare_hash32);
   mdb_set_dupsort(txn, m_block_heights, compare_hash32);
   mdb_set_dupsort(txn, m_tx_indices, compare_hash32);
   mdb_set_dupsort(txn, m_output_amounts, compare_uint64);
   mdb_set_dupsort(txn, m_output_txs, compare_uint64);
   mdb_set_dupsort(txn, m_block_info, compare_uint64);
+  if (has_stake_txs)
+    mdb_set_dupsort(txn, m_stake_txs, compare_hash32);
 
   mdb_set_compare(txn, m_txpool_meta, compare_hash32);
   mdb_set_compare(txn, m_txpool_blob, compare_hash32);
   mdb_set_compare(txn, m_properties, compare_string);
+  if (m_has_alt_blocks)
+    mdb_set_compare(txn, m_alt_blocks, compare_hash32);
 
   if (!(mdb_flags & MDB_RDONLY))
   {
@@ -1329,6 +1640,44 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   LOG_PRINT_L2("Setting m_height to: " << db_stats.ms_entries);
   uint64_t m_height = db_stats.ms_entries;
 
+  // the stake txs index only covers blocks added since it was created; older blocks have to be scanned
+  m_stake_txs_index_height = std::numeric_limits<uint64_t>::max();
+  if (has_stake_txs)
+  {
+    MDB_val_copy<const char*> k(LMDB_STAKE_TXS_INDEX_HEIGHT);
+    MDB_val v;
+    result = mdb_get(txn, m_properties, &k, &v);
+    if (result == MDB_SUCCESS)
+      m_stake_txs_index_height = *(const uint64_t*)v.mv_data;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to query stake txs index height: ", result).c_str()));
+    else if (!(mdb_flags & MDB_RDONLY))
+    {
+      MDB_val_copy<uint64_t> vh(m_height);
+      if ((result = mdb_put(txn, m_properties, &k, &vh, 0)))
+        throw0(DB_ERROR(lmdb_error("Failed to write stake txs index height: ", result).c_str()));
+      m_stake_txs_index_height = m_height;
+    }
+  }
+
+  m_pruning_stripe = 0;
+  m_pruned_height = 0;
+  {
+    MDB_val_copy<const char*> k(LMDB_PRUNING_STRIPE);
+    MDB_val v;
+    result = mdb_get(txn, m_properties, &k, &v);
+    if (result == MDB_SUCCESS)
+      m_pruning_stripe = *(const uint32_t*)v.mv_data;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to query pruning stripe: ", result).c_str()));
+    MDB_val_copy<const char*> kh(LMDB_PRUNED_HEIGHT);
+    result = mdb_get(txn, m_properties, &kh, &v);
+    if (result == MDB_SUCCESS)
+      m_pruned_height = *(const uint64_t*)v.mv_data;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to query pruned height: ", result).c_str()));
+  }
+
   bool compatible = true;
 
   MDB_val_copy<const char*> k("version");
@@ -1351,6 +1700,9 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       txn.commit();
       m_open = true;
       migrate(db_version);
+      init_txs_compression(db_flags & DBF_COMPRESS_TXS);
+      init_key_image_filter();
+      start_resize_monitor();
       return;
     }
 #endif
@@ -1398,11 +1750,17 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   m_open = true;
   // from here, init should be finished
+
+  init_txs_compression(db_flags & DBF_COMPRESS_TXS);
+  init_key_image_filter();
+  start_resize_monitor();
 }
 
 void BlockchainLMDB::close()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  stop_resize_monitor();
+  stop_group_commit();
   if (m_batch_active)
   {
     LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
@@ -1414,6 +1772,9 @@ void BlockchainLMDB::close()
   // FIXME: not yet thread safe!!!  Use with care.
   mdb_env_close(m_env);
   m_open = false;
+
+  m_key_image_filter = nullptr;
+  m_key_image_filters.clear();
 }
 
 void BlockchainLMDB::sync()
@@ -1438,6 +1799,89 @@ void BlockchainLMDB::safesyncmode(const bool onoff)
   mdb_env_set_flags(m_env, MDB_NOSYNC|MDB_MAPASYNC, !onoff);
 }
 
+void BlockchainLMDB::set_group_commit(uint64_t max_delay_millis)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  stop_group_commit();
+
+  if (!max_delay_millis || is_read_only())
+    return;
+
+  // commits only reach the OS here; without MDB_WRITEMAP a crash loses at most
+  // the commits since the last sync, but never leaves a half written one
+  if (auto result = mdb_env_set_flags(m_env, MDB_NOSYNC, 1))
+    throw0(DB_ERROR(lmdb_error("Failed to set MDB_NOSYNC for group commits: ", result).c_str()));
+
+  MGINFO("Syncing the database in groups, at most " << max_delay_millis << " ms after a commit");
+  m_group_commit_millis = max_delay_millis;
+  m_group_commit_stop = false;
+  m_group_commit_thread = boost::thread([this]() { group_commit(); });
+}
+
+void BlockchainLMDB::copy_to(const std::string& folder, bool compact) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  MGINFO("Copying the database to " << folder << (compact ? " with compaction" : ""));
+  if (auto result = mdb_env_copy2(m_env, folder.c_str(), compact ? MDB_CP_COMPACT : 0))
+    throw0(DB_ERROR(lmdb_error("Failed to copy the database: ", result).c_str()));
+}
+
+void BlockchainLMDB::group_commit()
+{
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
+  size_t synced_txnid = mei.me_last_txnid;
+
+  boost::unique_lock<boost::mutex> lock(m_group_commit_lock);
+  while (!m_group_commit_stop)
+  {
+    m_group_commit_cond.wait_for(lock, boost::chrono::milliseconds(m_group_commit_millis), [this]() { return m_group_commit_stop; });
+    if (m_group_commit_stop)
+      break;
+
+    // every write txn commit bumps the last txn id, reads don't
+    mdb_env_info(m_env, &mei);
+    if (mei.me_last_txnid == synced_txnid)
+      continue;
+
+    lock.unlock();
+    const auto sync_start = std::chrono::steady_clock::now();
+    int result;
+    {
+      boost::lock_guard<boost::mutex> sync_lock(m_env_sync_lock);
+      result = mdb_env_sync(m_env, 1);
+    }
+    lock.lock();
+
+    if (result)
+    {
+      MERROR(lmdb_error("Failed to sync database: ", result));
+      continue;
+    }
+
+    MDEBUG("Synced " << (mei.me_last_txnid - synced_txnid) << " commit(s) in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - sync_start).count() << " ms");
+    synced_txnid = mei.me_last_txnid;
+  }
+}
+
+void BlockchainLMDB::stop_group_commit()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_group_commit_lock);
+    m_group_commit_stop = true;
+  }
+
+  m_group_commit_cond.notify_all();
+
+  if (m_group_commit_thread.joinable())
+    m_group_commit_thread.join();
+}
+
 void BlockchainLMDB::reset()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -1474,6 +1918,10 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_hf_versions: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_properties, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_properties: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_stake_txs, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_stake_txs: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_alt_blocks, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_alt_blocks: ", result).c_str()));
 
   // init with current version
   MDB_val_copy<const char*> k("version");
@@ -1481,9 +1929,21 @@ void BlockchainLMDB::reset()
   if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
+  // the stake txs index covers the whole chain from now on
+  MDB_val_copy<const char*> kh(LMDB_STAKE_TXS_INDEX_HEIGHT);
+  MDB_val_copy<uint64_t> vh(0);
+  if (auto result = mdb_put(txn, m_properties, &kh, &vh, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to write stake txs index height: ", result).c_str()));
+
   txn.commit();
   m_cum_size = 0;
   m_cum_count = 0;
+  m_stake_txs_index_height = 0;
+  m_pruning_stripe = 0;
+  m_pruned_height = 0;
+  m_txs_compressed = false;
+  if (m_key_image_filter)
+    rebuild_key_image_filter(nullptr, 0);
 }
 
 std::vector<std::string> BlockchainLMDB::get_filenames() const
@@ -1550,13 +2010,15 @@ void BlockchainLMDB::unlock()
       throw0(DB_ERROR(lmdb_error(std::string("Failed to create a transaction for the db in ")+__FUNCTION__+": ", mdb_res).c_str())); \
   } \
 
+// Within a read session the txn is already counted as active, and waiting at
+// the creation gate could deadlock with a resize waiting for the session.
 #define TXN_PREFIX_RDONLY() \
   MDB_txn *m_txn; \
   mdb_txn_cursors *m_cursors; \
-  mdb_txn_safe auto_txn; \
+  mdb_txn_safe auto_txn(!in_rtxn_session()); \
   bool my_rtxn = block_rtxn_start(&m_txn, &m_cursors); \
   if (my_rtxn) auto_txn.m_tinfo = m_tinfo.get(); \
-  else auto_txn.uncheck()
+  else if (auto_txn.m_check) auto_txn.uncheck()
 #define TXN_POSTFIX_RDONLY()
 
 #define TXN_POSTFIX_SUCCESS() \
@@ -1838,6 +2300,205 @@ bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&,
   return ret;
 }
 
+void BlockchainLMDB::add_alt_block(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata &blob)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_BLOCK_PREFIX(0);
+
+  // the metadata is followed by the block blob
+  MDB_val k = {sizeof(blkid), (void *)&blkid};
+  MDB_val v;
+  v.mv_size = sizeof(data) + blob.size();
+  int result = mdb_put(*txn_ptr, m_alt_blocks, &k, &v, MDB_RESERVE);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error adding alternative block to db transaction: ", result).c_str()));
+  memcpy(v.mv_data, &data, sizeof(data));
+  memcpy((char*)v.mv_data + sizeof(data), blob.data(), blob.size());
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+}
+
+void BlockchainLMDB::remove_alt_block(const crypto::hash &blkid)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_BLOCK_PREFIX(0);
+
+  MDB_val k = {sizeof(blkid), (void *)&blkid};
+  int result = mdb_del(*txn_ptr, m_alt_blocks, &k, NULL);
+  if (result && result != MDB_NOTFOUND)
+    throw1(DB_ERROR(lmdb_error("Error adding removal of alternative block to db transaction: ", result).c_str()));
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+}
+
+void BlockchainLMDB::drop_alt_blocks()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_BLOCK_PREFIX(0);
+
+  int result = mdb_drop(*txn_ptr, m_alt_blocks, 0);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error dropping alternative blocks: ", result).c_str()));
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+}
+
+bool BlockchainLMDB::for_all_alt_blocks(std::function<bool(const crypto::hash&, const alt_block_data_t&, const cryptonote::blobdata&)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (!m_has_alt_blocks)
+    return true;
+
+  TXN_PREFIX_RDONLY();
+
+  MDB_cursor *cur;
+  int result = mdb_cursor_open(m_txn, m_alt_blocks, &cur);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for alternative blocks: ", result).c_str()));
+  epee::misc_utils::auto_scope_leave_caller cursor_closer = epee::misc_utils::create_scope_leave_handler([cur](){ mdb_cursor_close(cur); });
+
+  MDB_val k;
+  MDB_val v;
+  bool ret = true;
+
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    result = mdb_cursor_get(cur, &k, &v, op);
+    op = MDB_NEXT;
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate alternative blocks: ", result).c_str()));
+    if (k.mv_size != sizeof(crypto::hash) || v.mv_size < sizeof(alt_block_data_t))
+      throw0(DB_ERROR("Unexpected alternative block record size"));
+    const crypto::hash &blkid = *(const crypto::hash*)k.mv_data;
+    alt_block_data_t data;
+    memcpy(&data, v.mv_data, sizeof(data));
+    const cryptonote::blobdata blob((const char*)v.mv_data + sizeof(data), v.mv_size - sizeof(data));
+    if (!f(blkid, data, blob)) {
+      ret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return ret;
+}
+
+uint32_t BlockchainLMDB::get_blockchain_pruning_stripe() const
+{
+  return m_pruning_stripe;
+}
+
+bool BlockchainLMDB::set_blockchain_pruning_stripe(uint32_t pruning_stripe)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (pruning_stripe == 0 || pruning_stripe > CRYPTONOTE_PRUNING_NUM_STRIPES)
+    return false;
+  // the data of the other stripes is gone already
+  if (m_pruning_stripe)
+    return m_pruning_stripe == pruning_stripe;
+  if (is_read_only())
+    return false;
+
+  TXN_BLOCK_PREFIX(0);
+
+  MDB_val_copy<const char*> k(LMDB_PRUNING_STRIPE);
+  MDB_val_copy<uint32_t> v(pruning_stripe);
+  int result = mdb_put(*txn_ptr, m_properties, &k, &v, 0);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Failed to write pruning stripe: ", result).c_str()));
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+
+  m_pruning_stripe = pruning_stripe;
+  m_pruned_height = 0;
+  return true;
+}
+
+bool BlockchainLMDB::prune_old_blocks(uint64_t max_blocks)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  const uint64_t blockchain_height = height();
+  if (!m_pruning_stripe || blockchain_height <= CRYPTONOTE_PRUNING_TIP_BLOCKS)
+    return true;
+  const uint64_t prunable_height = blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS;
+  if (m_pruned_height >= prunable_height)
+    return true;
+  const uint64_t end = std::min(prunable_height, m_pruned_height + max_blocks);
+
+  if (! m_batch_active && need_resize())
+  {
+    LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+    do_resize();
+  }
+
+  TXN_BLOCK_PREFIX(0);
+
+  MDB_cursor *cur_tx_indices;
+  int result = mdb_cursor_open(*txn_ptr, m_tx_indices, &cur_tx_indices);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+
+  uint64_t num_txs = 0;
+  uint64_t h = m_pruned_height;
+  for (; h < end; ++h)
+  {
+    if (tools::get_pruning_stripe(h) == m_pruning_stripe)
+    {
+      // our stripe is kept as a whole, skip to its last block
+      h = std::min(end, h - h % CRYPTONOTE_PRUNING_STRIPE_SIZE + CRYPTONOTE_PRUNING_STRIPE_SIZE) - 1;
+      continue;
+    }
+
+    MDB_val_copy<uint64_t> kb(h);
+    MDB_val v;
+    if ((result = mdb_get(*txn_ptr, m_blocks, &kb, &v)))
+      throw0(DB_ERROR(lmdb_error("Failed to get a block to prune: ", result).c_str()));
+    block b;
+    if (!parse_and_validate_block_from_blob(blobdata((const char*)v.mv_data, v.mv_size), b))
+      throw0(DB_ERROR("Failed to parse a block to prune"));
+
+    for (const crypto::hash &tx_hash: b.tx_hashes)
+    {
+      MDB_val_set(vh, tx_hash);
+      if ((result = mdb_cursor_get(cur_tx_indices, (MDB_val *)&zerokval, &vh, MDB_GET_BOTH)))
+        throw0(DB_ERROR(lmdb_error("Failed to get the tx index of a tx to prune: ", result).c_str()));
+      MDB_val_set(val_tx_id, ((const txindex *)vh.mv_data)->data.tx_id);
+      result = mdb_del(*txn_ptr, m_txs_prunable, &val_tx_id, NULL);
+      if (result && result != MDB_NOTFOUND)
+        throw0(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
+      ++num_txs;
+    }
+  }
+  mdb_cursor_close(cur_tx_indices);
+
+  MDB_val_copy<const char*> k(LMDB_PRUNED_HEIGHT);
+  MDB_val_copy<uint64_t> vp(h);
+  if ((result = mdb_put(*txn_ptr, m_properties, &k, &vp, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to write pruned height: ", result).c_str()));
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+
+  MDEBUG("Pruned " << num_txs << " txs of blocks " << m_pruned_height << " - " << h - 1);
+  m_pruned_height = h;
+  return h == prunable_height;
+}
+
 bool BlockchainLMDB::block_exists(const crypto::hash& h, uint64_t *height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -1877,6 +2538,52 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob(const crypto::hash& h) const
   return get_block_blob_from_height(get_block_height(h));
 }
 
+void BlockchainLMDB::get_block_blobs(const std::vector<crypto::hash>& hashes, std::vector<cryptonote::blobdata>& blobs, std::vector<bool>& found) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  blobs.clear();
+  blobs.resize(hashes.size());
+  found.assign(hashes.size(), false);
+  if (hashes.empty())
+    return;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(block_heights);
+  RCURSOR(blocks);
+
+  // find heights in hash order, then read the blocks in height order
+  std::vector<std::pair<uint64_t, size_t>> heights;
+  heights.reserve(hashes.size());
+  for (size_t i: get_hash32_order(hashes))
+  {
+    MDB_val_set(key, hashes[i]);
+    auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+      continue;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch block index from hash", get_result).c_str()));
+    heights.emplace_back(((const blk_height *)key.mv_data)->bh_height, i);
+  }
+  std::sort(heights.begin(), heights.end());
+
+  for (const auto &height: heights)
+  {
+    MDB_val_copy<uint64_t> key(height.first);
+    MDB_val result;
+    auto get_result = mdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
+    if (get_result == MDB_NOTFOUND)
+      continue;
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
+    blobs[height.second].assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+    found[height.second] = true;
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
 uint64_t BlockchainLMDB::get_block_height(const crypto::hash& h) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -1945,15 +2652,76 @@ uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
   auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
+    throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
+  }
+  else if (get_result)
+    throw0(DB_ERROR("Error attempting to retrieve a timestamp from the db"));
+
+  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
+  uint64_t ret = bi->bi_timestamp;
+  TXN_POSTFIX_RDONLY();
+  return ret;
+}
+
+void BlockchainLMDB::get_block_blobs_from_height(uint64_t start_height, size_t count, std::vector<cryptonote::blobdata>& blobs) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  blobs.clear();
+  if (count == 0)
+    return;
+  blobs.reserve(count);
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(blocks);
+
+  MDB_val_copy<uint64_t> key(start_height);
+  MDB_val k = key, result;
+  MDB_cursor_op op = MDB_SET;
+  for (uint64_t height = start_height; height < start_height + count; ++height)
+  {
+    auto get_result = mdb_cursor_get(m_cur_blocks, &k, &result, op);
+    op = MDB_NEXT;
+    if (get_result == MDB_NOTFOUND || (get_result == 0 && *(const uint64_t *)k.mv_data != height))
+      throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
+    blobs.emplace_back(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
+void BlockchainLMDB::get_block_infos_from_height(uint64_t start_height, size_t count, std::vector<block_info_t>& infos) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  infos.clear();
+  if (count == 0)
+    return;
+  infos.reserve(count);
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(block_info);
+
+  MDB_val_set(v, start_height);
+  MDB_cursor_op op = MDB_GET_BOTH;
+  for (uint64_t height = start_height; height < start_height + count; ++height)
+  {
+    MDB_val k = zerokval;
+    auto get_result = mdb_cursor_get(m_cur_block_info, &k, &v, op);
+    op = MDB_NEXT_DUP;
+    if (get_result == MDB_NOTFOUND || (get_result == 0 && ((const mdb_block_info *)v.mv_data)->bi_height != height))
+      throw0(BLOCK_DNE(std::string("Attempt to get block info from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+    else if (get_result)
+      throw0(DB_ERROR("Error attempting to retrieve a block info from the db"));
+    const mdb_block_info *bi = (const mdb_block_info *)v.mv_data;
+    infos.push_back({bi->bi_height, bi->bi_timestamp, bi->bi_coins, bi->bi_weight, bi->bi_diff, bi->bi_hash, bi->bi_cum_rct});
   }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a timestamp from the db"));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  uint64_t ret = bi->bi_timestamp;
   TXN_POSTFIX_RDONLY();
-  return ret;
 }
 
 std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const
@@ -2327,8 +3095,9 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
-  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+  bd.clear();
+  append_tx_record(m_txs_pruned_codec, result0, bd);
+  append_tx_record(m_txs_prunable_codec, result1, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -2358,13 +3127,67 @@ bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  append_tx_record(m_txs_pruned_codec, result, bd);
 
   TXN_POSTFIX_RDONLY();
 
   return true;
 }
 
+void BlockchainLMDB::get_tx_blobs(const std::vector<crypto::hash>& hashes, std::vector<cryptonote::blobdata>& txs, std::vector<bool>& found, bool pruned) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  txs.clear();
+  txs.resize(hashes.size());
+  found.assign(hashes.size(), false);
+  if (hashes.empty())
+    return;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(txs_pruned);
+  RCURSOR(txs_prunable);
+
+  // find tx ids in hash order, then read the txs in id order
+  std::vector<std::pair<uint64_t, size_t>> tx_ids;
+  tx_ids.reserve(hashes.size());
+  for (size_t i: get_hash32_order(hashes))
+  {
+    MDB_val_set(v, hashes[i]);
+    auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+      continue;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
+    tx_ids.emplace_back(((const txindex *)v.mv_data)->data.tx_id, i);
+  }
+  std::sort(tx_ids.begin(), tx_ids.end());
+
+  for (const auto &tx_id: tx_ids)
+  {
+    MDB_val_copy<uint64_t> val_tx_id(tx_id.first);
+    MDB_val result0, result1;
+    auto get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
+    if (get_result == 0 && !pruned)
+      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
+    if (get_result == MDB_NOTFOUND)
+      continue;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
+
+    cryptonote::blobdata &bd = txs[tx_id.second];
+    append_tx_record(m_txs_pruned_codec, result0, bd);
+    if (!pruned)
+      append_tx_record(m_txs_prunable_codec, result1, bd);
+    found[tx_id.second] = true;
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
 bool BlockchainLMDB::get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2395,6 +3218,34 @@ bool BlockchainLMDB::get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::h
   return true;
 }
 
+bool BlockchainLMDB::get_stake_tx_hashes(uint64_t height, std::vector<crypto::hash>& tx_hashes) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  tx_hashes.clear();
+
+  if (height < m_stake_txs_index_height)
+    return false;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(stake_txs);
+
+  MDB_val_set(k, height);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_stake_txs, &k, &v, MDB_SET);
+  while (!result)
+  {
+    tx_hashes.push_back(*(const crypto::hash*)v.mv_data);
+    result = mdb_cursor_get(m_cur_stake_txs, &k, &v, MDB_NEXT_DUP);
+  }
+  if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch stake tx hashes: ", result).c_str()));
+
+  TXN_POSTFIX_RDONLY();
+  return true;
+}
+
 uint64_t BlockchainLMDB::get_tx_count() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2584,6 +3435,11 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  // most key images looked up are not spent, answer those without a txn
+  const key_image_filter* filter = m_key_image_filter.load(std::memory_order_acquire);
+  if (filter && !filter->may_contain(img))
+    return false;
+
   bool ret;
 
   TXN_PREFIX_RDONLY();
@@ -2716,7 +3572,7 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
       throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
     transaction tx;
     blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    append_tx_record(m_txs_pruned_codec, v, bd);
     if (pruned)
     {
       if (!parse_and_validate_tx_base_from_blob(bd, tx))
@@ -2725,9 +3581,11 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
     else
     {
       ret = mdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
+      if (ret == MDB_NOTFOUND && m_pruning_stripe)
+        continue;
       if (ret)
         throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data the db: ", ret).c_str()));
-      bd.append(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      append_tx_record(m_txs_prunable_codec, v, bd);
       if (!parse_and_validate_tx_from_blob(bd, tx))
         throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
     }
@@ -2831,6 +3689,7 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
     throw0(DB_ERROR("batch transaction attempted, but m_write_txn already in use"));
   check_open();
 
+  end_rtxn_session();
   m_writer = boost::this_thread::get_id();
   check_and_resize_for_batch(batch_num_blocks, batch_bytes);
 
@@ -2877,7 +3736,10 @@ void BlockchainLMDB::batch_commit()
 
   LOG_PRINT_L3("batch transaction: committing...");
   TIME_MEASURE_START(time1);
-  m_write_txn->commit();
+  {
+    tools::metrics::histogram::timer commit_timer(batch_commit_time);
+    m_write_txn->commit();
+  }
   TIME_MEASURE_FINISH(time1);
   time_commit1 += time1;
   LOG_PRINT_L3("batch transaction: committed");
@@ -2914,7 +3776,10 @@ void BlockchainLMDB::batch_stop()
   TIME_MEASURE_START(time1);
   try
   {
-    m_write_txn->commit();
+    {
+      tools::metrics::histogram::timer commit_timer(batch_commit_time);
+      m_write_txn->commit();
+    }
     TIME_MEASURE_FINISH(time1);
     time_commit1 += time1;
     cleanup_batch();
@@ -2980,6 +3845,7 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
     m_tinfo.reset(tinfo);
     memset(&tinfo->m_ti_rcursors, 0, sizeof(tinfo->m_ti_rcursors));
     memset(&tinfo->m_ti_rflags, 0, sizeof(tinfo->m_ti_rflags));
+    tinfo->m_ti_session = false;
     if (auto mdb_res = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, &tinfo->m_ti_rtxn))
       throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
     ret = true;
@@ -2999,11 +3865,47 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
   return ret;
 }
 
+bool BlockchainLMDB::block_rtxn_start() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  if (in_rtxn_session())
+    return false;
+
+  // a session counts as an active txn for its whole length, so that resizes
+  // wait for it to end
+  mdb_txn_safe auto_txn;
+  MDB_txn *mtxn;
+  mdb_txn_cursors *mcur;
+  if (!block_rtxn_start(&mtxn, &mcur))
+    return false;
+
+  auto_txn.m_check = false;
+  m_tinfo->m_ti_session = true;
+  return true;
+}
+
 void BlockchainLMDB::block_rtxn_stop() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   mdb_txn_reset(m_tinfo->m_ti_rtxn);
   memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+  if (m_tinfo->m_ti_session)
+  {
+    m_tinfo->m_ti_session = false;
+    mdb_txn_safe::num_active_txns--;
+  }
+}
+
+bool BlockchainLMDB::in_rtxn_session() const
+{
+  return m_tinfo.get() && m_tinfo->m_ti_session;
+}
+
+void BlockchainLMDB::end_rtxn_session() const
+{
+  if (in_rtxn_session())
+    block_rtxn_stop();
 }
 
 void BlockchainLMDB::block_txn_start(bool readonly)
@@ -3028,6 +3930,7 @@ void BlockchainLMDB::block_txn_start(bool readonly)
     throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when write txn already exists in ")+__FUNCTION__).c_str()));
   if (! m_batch_active)
   {
+    end_rtxn_session();
     m_writer = boost::this_thread::get_id();
     m_write_txn = new mdb_txn_safe();
     if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_txn))
@@ -3055,7 +3958,10 @@ void BlockchainLMDB::block_txn_stop()
     if (! m_batch_active)
 	{
       TIME_MEASURE_START(time1);
-      m_write_txn->commit();
+      {
+        tools::metrics::histogram::timer commit_timer(block_commit_time);
+        m_write_txn->commit();
+      }
       TIME_MEASURE_FINISH(time1);
       time_commit1 += time1;
 
@@ -3066,8 +3972,7 @@ void BlockchainLMDB::block_txn_stop()
   }
   else if (m_tinfo->m_ti_rtxn)
   {
-    mdb_txn_reset(m_tinfo->m_ti_rtxn);
-    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+    block_rtxn_stop();
   }
 }
 
@@ -3085,8 +3990,7 @@ void BlockchainLMDB::block_txn_abort()
   }
   else if (m_tinfo->m_ti_rtxn)
   {
-    mdb_txn_reset(m_tinfo->m_ti_rtxn);
-    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+    block_rtxn_stop();
   }
   else
   {
@@ -3264,6 +4168,55 @@ void BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const std::
   LOG_PRINT_L3("db3: " << db3);
 }
 
+void BlockchainLMDB::get_output_keys_and_txs(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, std::vector<tx_out_index> &indices) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  outputs.clear();
+  indices.clear();
+
+  TXN_PREFIX_RDONLY();
+
+  RCURSOR(output_amounts);
+
+  // the data and the global index of each output come from the same amount table entry
+  std::vector<uint64_t> output_ids;
+  outputs.reserve(offsets.size());
+  output_ids.reserve(offsets.size());
+  MDB_val_set(k, amount);
+  for (const uint64_t &index : offsets)
+  {
+    MDB_val_set(v, index);
+
+    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+      throw1(OUTPUT_DNE((std::string("Attempting to get output by index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(index) + "), but key does not exist").c_str()));
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output from the db", get_result).c_str()));
+
+    output_data_t data;
+    if (amount == 0)
+    {
+      const outkey *okp = (const outkey *)v.mv_data;
+      data = okp->data;
+      output_ids.push_back(okp->output_id);
+    }
+    else
+    {
+      const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
+      memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
+      data.commitment = rct::zeroCommit(amount);
+      output_ids.push_back(okp->output_id);
+    }
+    outputs.push_back(data);
+  }
+
+  if (!output_ids.empty())
+    get_output_tx_and_index_from_global(output_ids, indices);
+
+  TXN_POSTFIX_RDONLY();
+}
+
 std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -4336,6 +5289,279 @@ void BlockchainLMDB::migrate_2_3()
   txn.commit();
 }
 
+MDB_val BlockchainLMDB::make_tx_record(const tx_blob_codec& codec, const char* data, size_t size, std::string& buffer) const
+{
+  if (m_txs_compressed)
+  {
+    codec.encode(data, size, buffer);
+    data = buffer.data();
+    size = buffer.size();
+  }
+  MDB_val record;
+  record.mv_data = (void*)data;
+  record.mv_size = size;
+  return record;
+}
+
+void BlockchainLMDB::append_tx_record(const tx_blob_codec& codec, const MDB_val& record, cryptonote::blobdata& bd) const
+{
+  if (m_txs_compressed)
+    codec.decode_append(reinterpret_cast<const char*>(record.mv_data), record.mv_size, bd);
+  else
+    bd.append(reinterpret_cast<const char*>(record.mv_data), record.mv_size);
+}
+
+void BlockchainLMDB::init_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (is_read_only())
+    return;
+
+  int result;
+  mdb_txn_safe txn;
+  if ((result = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, txn)))
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_spent_keys, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_spent_keys: ", result).c_str()));
+
+  MDB_cursor *cur;
+  if ((result = mdb_cursor_open(txn, m_spent_keys, &cur)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for spent_keys: ", result).c_str()));
+
+  const auto start = std::chrono::steady_clock::now();
+  rebuild_key_image_filter(cur, db_stats.ms_entries);
+  mdb_cursor_close(cur);
+  txn.commit();
+
+  MINFO("Spent key image filter: " << db_stats.ms_entries << " key images, room for " << m_key_image_filter.load()->get_capacity()
+      << ", built in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms");
+}
+
+void BlockchainLMDB::rebuild_key_image_filter(MDB_cursor* cur, uint64_t num_key_images)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // double the room on every rebuild, so a sync from scratch rebuilds a logarithmic number of times
+  std::unique_ptr<key_image_filter> filter(new key_image_filter(std::max<uint64_t>(key_image_filter::MIN_CAPACITY, 2 * num_key_images)));
+  uint64_t size = 0;
+
+  // spent_keys is DUPFIXED under zerokval, read it a page at a time
+  MDB_val k = zerokval, v;
+  int result = cur ? mdb_cursor_get(cur, &k, &v, MDB_SET) : MDB_NOTFOUND;
+  if (!result)
+    result = mdb_cursor_get(cur, &k, &v, MDB_GET_MULTIPLE);
+  while (!result)
+  {
+    const crypto::key_image* k_images = (const crypto::key_image*)v.mv_data;
+    for (size_t i = 0; i < v.mv_size / sizeof(crypto::key_image); ++i)
+      filter->insert(k_images[i]);
+    size += v.mv_size / sizeof(crypto::key_image);
+    result = mdb_cursor_get(cur, &k, &v, MDB_NEXT_MULTIPLE);
+  }
+  if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to enumerate key images: ", result).c_str()));
+
+  // readers may still look at the old filter, it is freed on close
+  m_key_image_filter_size = size;
+  m_key_image_filter.store(filter.get(), std::memory_order_release);
+  m_key_image_filters.push_back(std::move(filter));
+}
+
+void BlockchainLMDB::init_txs_compression(bool compress)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+  bool found = false;
+  uint64_t next_tx_id = 0;
+
+  m_txs_compressed = false;
+  m_txs_pruned_codec.set_dictionary(std::string());
+  m_txs_prunable_codec.set_dictionary(std::string());
+
+  {
+    mdb_txn_safe txn;
+    if ((result = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, txn)))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+    MDB_val_copy<const char*> k(LMDB_TXS_COMPRESSION);
+    MDB_val v;
+    result = mdb_get(txn, m_properties, &k, &v);
+    if (result == MDB_SUCCESS)
+    {
+      found = true;
+      next_tx_id = *(const uint64_t*)v.mv_data;
+
+      std::pair<const char*, tx_blob_codec*> dictionaries[] = {
+        {LMDB_TXS_PRUNED_DICT, &m_txs_pruned_codec},
+        {LMDB_TXS_PRUNABLE_DICT, &m_txs_prunable_codec}
+      };
+      for (const auto &d: dictionaries)
+      {
+        MDB_val_copy<const char*> kd(d.first);
+        result = mdb_get(txn, m_properties, &kd, &v);
+        if (result == MDB_SUCCESS && tx_blob_codec::available())
+          d.second->set_dictionary(std::string(reinterpret_cast<const char*>(v.mv_data), v.mv_size));
+        else if (result && result != MDB_NOTFOUND)
+          throw0(DB_ERROR(lmdb_error("Failed to query tx compression dictionary: ", result).c_str()));
+      }
+    }
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to query tx compression state: ", result).c_str()));
+    txn.commit();
+  }
+
+  if (!found)
+  {
+    if (!compress)
+      return;
+    if (!tx_blob_codec::available())
+    {
+      MERROR("Compression of transaction blobs was requested, but zstd support is not built in");
+      return;
+    }
+    if (is_read_only())
+    {
+      MWARNING("Can't compress transaction blobs of a read only database");
+      return;
+    }
+    migrate_compress_txs(true, 0);
+  }
+  else
+  {
+    if (!tx_blob_codec::available())
+      throw0(DB_ERROR("The database has compressed transaction blobs, but zstd support is not built in"));
+    if (next_tx_id != TXS_COMPRESSION_DONE)
+    {
+      if (is_read_only())
+        throw0(DB_ERROR("Compression of transaction blobs was interrupted, open the database read-write to finish it"));
+      migrate_compress_txs(false, next_tx_id);
+    }
+  }
+
+  m_txs_compressed = true;
+}
+
+void BlockchainLMDB::migrate_compress_txs(bool start, uint64_t next_tx_id)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val v;
+
+  MGINFO_YELLOW("Compressing transaction blobs in the database - this may take a while:");
+
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_txs_pruned, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
+  const uint64_t num_txs = db_stats.ms_entries;
+
+  if (start)
+  {
+    MINFO("training dictionaries on " << std::min(num_txs, TXS_DICT_SAMPLES) << " transactions...");
+
+    std::pair<MDB_dbi, tx_blob_codec*> tables[] = {{m_txs_pruned, &m_txs_pruned_codec}, {m_txs_prunable, &m_txs_prunable_codec}};
+    const char* const keys[] = {LMDB_TXS_PRUNED_DICT, LMDB_TXS_PRUNABLE_DICT};
+
+    for (size_t t = 0; t < 2; ++t)
+    {
+      std::vector<std::string> samples;
+      // spread the samples over the chain, txs of different eras look differently
+      for (uint64_t i = 0; i < std::min(num_txs, TXS_DICT_SAMPLES); ++i)
+      {
+        uint64_t tx_id = i * num_txs / std::min(num_txs, TXS_DICT_SAMPLES);
+        MDB_val_set(ks, tx_id);
+        result = mdb_get(txn, tables[t].first, &ks, &v);
+        if (result == MDB_NOTFOUND && m_pruning_stripe)
+          continue;
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get a tx record: ", result).c_str()));
+        if (v.mv_size)
+          samples.emplace_back(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+      }
+
+      std::string dictionary = tx_blob_codec::train_dictionary(samples, TXS_DICT_MAX_SIZE);
+      tables[t].second->set_dictionary(dictionary);
+      MINFO(keys[t] << ": " << dictionary.size() << " bytes");
+
+      MDB_val_copy<const char*> kd(keys[t]);
+      v.mv_data = (void*)dictionary.data();
+      v.mv_size = dictionary.size();
+      if ((result = mdb_put(txn, m_properties, &kd, &v, 0)))
+        throw0(DB_ERROR(lmdb_error("Failed to write tx compression dictionary: ", result).c_str()));
+    }
+
+    MDB_val_copy<const char*> kc(LMDB_TXS_COMPRESSION);
+    MDB_val_copy<uint64_t> vc(next_tx_id);
+    if ((result = mdb_put(txn, m_properties, &kc, &vc, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to write tx compression state: ", result).c_str()));
+  }
+
+  // records are rewritten in place, so the compression state commits with each batch and a restart resumes
+  std::string record;
+  while (1)
+  {
+    const uint64_t batch_end = std::min(num_txs, next_tx_id + 1000);
+
+    MDB_cursor *c_pruned, *c_prunable;
+    result = mdb_cursor_open(txn, m_txs_pruned, &c_pruned);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
+    result = mdb_cursor_open(txn, m_txs_prunable, &c_prunable);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+
+    for (; next_tx_id < batch_end; ++next_tx_id)
+    {
+      std::pair<MDB_cursor*, const tx_blob_codec*> tables[] = {{c_pruned, &m_txs_pruned_codec}, {c_prunable, &m_txs_prunable_codec}};
+      for (const auto &t: tables)
+      {
+        MDB_val_set(k, next_tx_id);
+        result = mdb_cursor_get(t.first, &k, &v, MDB_SET);
+        if (result == MDB_NOTFOUND && m_pruning_stripe)
+          continue;
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get a tx record: ", result).c_str()));
+        t.second->encode(reinterpret_cast<const char*>(v.mv_data), v.mv_size, record);
+        v.mv_data = (void*)record.data();
+        v.mv_size = record.size();
+        result = mdb_cursor_put(t.first, &k, &v, MDB_CURRENT);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to put a compressed tx record: ", result).c_str()));
+      }
+    }
+
+    const bool done = next_tx_id >= num_txs;
+    MDB_val_copy<const char*> kc(LMDB_TXS_COMPRESSION);
+    MDB_val_copy<uint64_t> vc(done ? TXS_COMPRESSION_DONE : next_tx_id);
+    if ((result = mdb_put(txn, m_properties, &kc, &vc, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to write tx compression state: ", result).c_str()));
+    txn.commit();
+
+    if (done)
+      break;
+
+    LOGIF(el::Level::Info) {
+      std::cout << next_tx_id << " / " << num_txs << "  \r" << std::flush;
+    }
+
+    if (need_resize())
+    {
+      LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+      do_resize();
+    }
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  }
+}
+
 void BlockchainLMDB::migrate(const uint32_t oldversion)
 {
   switch(oldversion) {
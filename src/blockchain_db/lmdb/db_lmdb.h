@@ -31,7 +31,11 @@
 #include "blockchain_db/blockchain_db.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include "tx_blob_codec.h"
+#include "key_image_filter.h"
 #include <boost/thread/tss.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include <lmdb.h>
 
@@ -62,6 +66,8 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_txpool_blob;
 
   MDB_cursor *m_txc_hf_versions;
+
+  MDB_cursor *m_txc_stake_txs;
 } mdb_txn_cursors;
 
 #define m_cur_blocks	m_cursors->m_txc_blocks
@@ -79,6 +85,7 @@ typedef struct mdb_txn_cursors
 #define m_cur_txpool_meta	m_cursors->m_txc_txpool_meta
 #define m_cur_txpool_blob	m_cursors->m_txc_txpool_blob
 #define m_cur_hf_versions	m_cursors->m_txc_hf_versions
+#define m_cur_stake_txs	m_cursors->m_txc_stake_txs
 
 typedef struct mdb_rflags
 {
@@ -98,6 +105,7 @@ typedef struct mdb_rflags
   bool m_rf_txpool_meta;
   bool m_rf_txpool_blob;
   bool m_rf_hf_versions;
+  bool m_rf_stake_txs;
 } mdb_rflags;
 
 typedef struct mdb_threadinfo
@@ -105,6 +113,7 @@ typedef struct mdb_threadinfo
   MDB_txn *m_ti_rtxn;	// per-thread read txn
   mdb_txn_cursors m_ti_rcursors;	// per-thread read cursors
   mdb_rflags m_ti_rflags;	// per-thread read state
+  bool m_ti_session;	// the read txn is held by block_rtxn_start()
 
   ~mdb_threadinfo();
 } mdb_threadinfo;
@@ -177,6 +186,10 @@ public:
 
   virtual void safesyncmode(const bool onoff);
 
+  virtual void set_group_commit(uint64_t max_delay_millis);
+
+  virtual void copy_to(const std::string& folder, bool compact) const;
+
   virtual void reset();
 
   virtual std::vector<std::string> get_filenames() const;
@@ -199,6 +212,12 @@ public:
 
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const;
 
+  virtual void get_block_blobs_from_height(uint64_t start_height, size_t count, std::vector<cryptonote::blobdata>& blobs) const;
+
+  virtual void get_block_infos_from_height(uint64_t start_height, size_t count, std::vector<block_info_t>& infos) const;
+
+  virtual void get_block_blobs(const std::vector<crypto::hash>& hashes, std::vector<cryptonote::blobdata>& blobs, std::vector<bool>& found) const;
+
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const;
 
   virtual uint64_t get_block_timestamp(const uint64_t& height) const;
@@ -232,8 +251,11 @@ public:
 
   virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+  virtual void get_tx_blobs(const std::vector<crypto::hash>& hashes, std::vector<cryptonote::blobdata>& txs, std::vector<bool>& found, bool pruned) const;
   virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const;
 
+  virtual bool get_stake_tx_hashes(uint64_t height, std::vector<crypto::hash>& tx_hashes) const;
+
   virtual uint64_t get_tx_count() const;
 
   virtual std::vector<transaction> get_tx_list(const std::vector<crypto::hash>& hlist) const;
@@ -244,6 +266,7 @@ public:
 
   virtual output_data_t get_output_key(const uint64_t& amount, const uint64_t& index);
   virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false);
+  virtual void get_output_keys_and_txs(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, std::vector<tx_out_index> &indices) const;
 
   virtual tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const;
   virtual void get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
@@ -266,6 +289,15 @@ public:
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const;
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob = false, bool include_unrelayed_txes = true) const;
 
+  virtual void add_alt_block(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata &blob);
+  virtual void remove_alt_block(const crypto::hash &blkid);
+  virtual void drop_alt_blocks();
+  virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash&, const alt_block_data_t&, const cryptonote::blobdata&)> f) const;
+
+  virtual uint32_t get_blockchain_pruning_stripe() const;
+  virtual bool set_blockchain_pruning_stripe(uint32_t pruning_stripe);
+  virtual bool prune_old_blocks(uint64_t max_blocks);
+
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
   virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>, bool pruned) const;
@@ -289,7 +321,10 @@ public:
   virtual void block_txn_stop();
   virtual void block_txn_abort();
   virtual bool block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) const;
+  virtual bool block_rtxn_start() const;
   virtual void block_rtxn_stop() const;
+  bool in_rtxn_session() const;
+  void end_rtxn_session() const; // before the calling thread writes
 
   virtual void pop_block(block& blk, std::vector<transaction>& txs);
 
@@ -309,9 +344,28 @@ public:
 
   bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
 
+  virtual resize_stats get_resize_stats() const;
+
 private:
   void do_resize(uint64_t size_increase=0);
 
+  /**
+   * @brief grows the map ahead of need, while no transaction is active
+   *
+   * Wakes up every RESIZE_MONITOR_INTERVAL_SECONDS and grows the map by
+   * RESIZE_GROWTH once it is RESIZE_AHEAD_PERCENT full, or when it has less
+   * room left than RESIZE_AHEAD_BATCHES batches of the recent estimated size.
+   */
+  void resize_monitor();
+  bool try_resize_when_idle(uint64_t new_mapsize);
+  void start_resize_monitor();
+  void stop_resize_monitor();
+  void record_resize_stall(uint64_t micros, bool background);
+
+  // syncs the env every m_group_commit_millis if anything was committed since the last sync
+  void group_commit();
+  void stop_group_commit();
+
   bool need_resize(uint64_t threshold_size=0) const;
   void check_and_resize_for_batch(uint64_t batch_num_blocks, uint64_t batch_bytes);
   uint64_t get_estimated_batch_size(uint64_t batch_num_blocks, uint64_t batch_bytes) const;
@@ -396,6 +450,24 @@ private:
   // migrate from DB version 2 to 3
   void migrate_2_3();
 
+  // load the compression state of txs_pruned / txs_prunable, compressing them if asked to
+  void init_txs_compression(bool compress);
+
+  // train the dictionaries if start is set, then compress the records from next_tx_id on
+  void migrate_compress_txs(bool start, uint64_t next_tx_id);
+
+  // record of a txs_pruned / txs_prunable blob; points either to data or to buffer
+  MDB_val make_tx_record(const tx_blob_codec& codec, const char* data, size_t size, std::string& buffer) const;
+
+  // append the blob of a txs_pruned / txs_prunable record to bd
+  void append_tx_record(const tx_blob_codec& codec, const MDB_val& record, cryptonote::blobdata& bd) const;
+
+  // build the spent key image filter on open; read only dbs may be written by another process and get none
+  void init_key_image_filter();
+
+  // fill a new filter with every key image in spent_keys as seen through cur, and make it current
+  void rebuild_key_image_filter(MDB_cursor* cur, uint64_t num_key_images);
+
   void cleanup_batch();
 
 private:
@@ -425,6 +497,24 @@ private:
 
   MDB_dbi m_properties;
 
+  MDB_dbi m_stake_txs;
+
+  uint64_t m_stake_txs_index_height; // first block height covered by m_stake_txs
+
+  MDB_dbi m_alt_blocks;
+  bool m_has_alt_blocks; // false when opened read-only without the table
+
+  uint32_t m_pruning_stripe; // 0 when not pruned
+  uint64_t m_pruned_height; // blocks below are pruned, except the ones of the stripe
+
+  bool m_txs_compressed; // records of m_txs_pruned and m_txs_prunable are tagged by tx_blob_codec
+  tx_blob_codec m_txs_pruned_codec;
+  tx_blob_codec m_txs_prunable_codec;
+
+  std::atomic<key_image_filter*> m_key_image_filter; // null when there is no filter
+  std::vector<std::unique_ptr<key_image_filter>> m_key_image_filters; // the current one and outgrown ones readers may still use
+  uint64_t m_key_image_filter_size; // key images inserted into the current filter, removed ones included
+
   mutable uint64_t m_cum_size;	// used in batch size estimation
   mutable unsigned int m_cum_count;
   std::string m_folder;
@@ -450,6 +540,30 @@ private:
 #endif
 
   constexpr static float RESIZE_PERCENT = 0.9f;
+
+  // for resize_monitor
+  boost::thread m_resize_thread;
+  boost::mutex m_resize_lock;
+  boost::condition_variable m_resize_cond;
+  bool m_resize_stop;
+  std::atomic<uint64_t> m_recent_batch_size; // moving average of batch size estimates
+  std::atomic<uint64_t> m_resizes;
+  std::atomic<uint64_t> m_background_resizes;
+  std::atomic<uint64_t> m_resize_stall_micros;
+  std::atomic<uint64_t> m_max_resize_stall_micros;
+
+  // for group_commit
+  boost::thread m_group_commit_thread;
+  boost::mutex m_group_commit_lock;
+  boost::condition_variable m_group_commit_cond;
+  bool m_group_commit_stop;
+  uint64_t m_group_commit_millis;
+  boost::mutex m_env_sync_lock; // keeps a background sync and a map resize apart
+
+  constexpr static uint64_t RESIZE_MONITOR_INTERVAL_SECONDS = 10;
+  constexpr static float RESIZE_AHEAD_PERCENT = 0.75f;
+  constexpr static uint64_t RESIZE_AHEAD_BATCHES = 10;
+  constexpr static float RESIZE_GROWTH = 0.25f;
 };
 
 }  // namespace cryptonote
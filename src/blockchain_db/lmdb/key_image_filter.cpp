@@ -0,0 +1,63 @@
+#include <cstring>
+
+#include "key_image_filter.h"
+
+using namespace cryptonote;
+
+constexpr size_t key_image_filter::BITS_PER_KEY;
+constexpr size_t key_image_filter::MIN_CAPACITY;
+constexpr size_t key_image_filter::WORDS_PER_BLOCK;
+
+key_image_filter::key_image_filter(uint64_t capacity)
+  : m_seed(crypto::rand<uint64_t>())
+{
+  const uint64_t block_bits = WORDS_PER_BLOCK * 64;
+  uint64_t blocks = 1;
+
+  while (blocks * block_bits < capacity * BITS_PER_KEY)
+    blocks *= 2;
+
+  m_capacity   = blocks * block_bits / BITS_PER_KEY;
+  m_block_mask = blocks - 1;
+  m_words.reset(new std::atomic<uint64_t>[blocks * WORDS_PER_BLOCK]);
+
+  for (uint64_t i=0; i<blocks * WORDS_PER_BLOCK; i++)
+    m_words[i].store(0, std::memory_order_relaxed);
+}
+
+uint64_t key_image_filter::hash(const crypto::key_image& k_image, size_t half) const
+{
+    //key images are curve points, their bytes are already well spread; the seed keeps
+    //crafted images from hitting the same blocks in every node
+
+  uint64_t words[2];
+  memcpy(words, reinterpret_cast<const char*>(&k_image) + half * sizeof(words), sizeof(words));
+
+  uint64_t h = (words[0] ^ m_seed) * 0x9e3779b97f4a7c15ull;
+  h ^= words[1] + (h >> 29);
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 32;
+
+  return h;
+}
+
+void key_image_filter::insert(const crypto::key_image& k_image)
+{
+  std::atomic<uint64_t>* block = &m_words[(hash(k_image, 0) & m_block_mask) * WORDS_PER_BLOCK];
+  uint64_t bits = hash(k_image, 1);
+
+  for (size_t i=0; i<WORDS_PER_BLOCK; i++, bits >>= 6)
+    block[i].fetch_or(uint64_t(1) << (bits & 63), std::memory_order_release);
+}
+
+bool key_image_filter::may_contain(const crypto::key_image& k_image) const
+{
+  const std::atomic<uint64_t>* block = &m_words[(hash(k_image, 0) & m_block_mask) * WORDS_PER_BLOCK];
+  uint64_t bits = hash(k_image, 1);
+
+  for (size_t i=0; i<WORDS_PER_BLOCK; i++, bits >>= 6)
+    if (!(block[i].load(std::memory_order_acquire) & (uint64_t(1) << (bits & 63))))
+      return false;
+
+  return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "crypto/crypto.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief Blocked Bloom filter over spent key images
+   *
+   * Each key image maps to one 512 bit block and sets one bit in each of its
+   * eight 64 bit words, so a lookup touches a single cache line. Bits are never
+   * cleared: key images of popped blocks or aborted txns stay in the filter as
+   * false positives, so a negative answer is always exact.
+   *
+   * One writer may insert while any number of readers look up.
+   */
+  class key_image_filter
+  {
+  public:
+    static constexpr size_t BITS_PER_KEY = 16;
+    static constexpr size_t MIN_CAPACITY = 1 << 20;
+
+    /// make a filter for up to capacity key images, rounded up to a power of two number of blocks
+    explicit key_image_filter(uint64_t capacity);
+
+    void insert(const crypto::key_image& k_image);
+    bool may_contain(const crypto::key_image& k_image) const;
+
+    uint64_t get_capacity() const { return m_capacity; }
+
+  private:
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+
+    /// hash of the first (half 0) or second (half 1) 16 bytes of a key image
+    uint64_t hash(const crypto::key_image& k_image, size_t half) const;
+
+    uint64_t m_capacity;
+    uint64_t m_block_mask;
+    uint64_t m_seed;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+  };
+}
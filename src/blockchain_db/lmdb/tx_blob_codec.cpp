@@ -0,0 +1,183 @@
+#include "tx_blob_codec.h"
+#include "blockchain_db/blockchain_db.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+using namespace cryptonote;
+
+namespace
+{
+
+#ifdef HAVE_ZSTD
+
+/// zstd contexts are expensive to create, keep one of each per thread
+struct zstd_contexts
+{
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
+
+  zstd_contexts() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx())
+  {
+    if (!cctx || !dctx)
+      throw DB_ERROR("Failed to create zstd contexts");
+  }
+
+  ~zstd_contexts()
+  {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+};
+
+zstd_contexts& get_contexts()
+{
+  static thread_local zstd_contexts contexts;
+  return contexts;
+}
+
+#endif
+
+}
+
+constexpr char tx_blob_codec::TAG_RAW;
+constexpr char tx_blob_codec::TAG_ZSTD;
+constexpr int tx_blob_codec::COMPRESSION_LEVEL;
+
+struct tx_blob_codec::dictionaries
+{
+#ifdef HAVE_ZSTD
+  ZSTD_CDict* cdict = nullptr;
+  ZSTD_DDict* ddict = nullptr;
+
+  ~dictionaries()
+  {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+  }
+#endif
+};
+
+tx_blob_codec::tx_blob_codec()
+  : m_dictionaries(new dictionaries)
+{
+}
+
+tx_blob_codec::~tx_blob_codec()
+{
+}
+
+bool tx_blob_codec::available()
+{
+#ifdef HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::string tx_blob_codec::train_dictionary(const std::vector<std::string>& samples, size_t max_size)
+{
+#ifdef HAVE_ZSTD
+  std::string buffer;
+  std::vector<size_t> sizes;
+  sizes.reserve(samples.size());
+
+  for (const std::string& sample : samples)
+  {
+    buffer.append(sample);
+    sizes.push_back(sample.size());
+  }
+
+  std::string dictionary(max_size, '\0');
+  size_t size = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(), buffer.data(), sizes.data(), sizes.size());
+
+  if (ZDICT_isError(size))
+    return std::string();
+
+  dictionary.resize(size);
+  return dictionary;
+#else
+  return std::string();
+#endif
+}
+
+void tx_blob_codec::set_dictionary(const std::string& dictionary)
+{
+  std::unique_ptr<dictionaries> d(new dictionaries);
+
+#ifdef HAVE_ZSTD
+  if (!dictionary.empty())
+  {
+    d->cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), COMPRESSION_LEVEL);
+    d->ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+
+    if (!d->cdict || !d->ddict)
+      throw DB_ERROR("Failed to load zstd dictionary");
+  }
+#endif
+
+  m_dictionary   = dictionary;
+  m_dictionaries = std::move(d);
+}
+
+void tx_blob_codec::encode(const char* data, size_t size, std::string& record) const
+{
+#ifdef HAVE_ZSTD
+  zstd_contexts& contexts = get_contexts();
+
+  record.resize(1 + ZSTD_compressBound(size));
+  record[0] = TAG_ZSTD;
+
+  size_t compressed_size = m_dictionaries->cdict
+    ? ZSTD_compress_usingCDict(contexts.cctx, &record[1], record.size() - 1, data, size, m_dictionaries->cdict)
+    : ZSTD_compressCCtx(contexts.cctx, &record[1], record.size() - 1, data, size, COMPRESSION_LEVEL);
+
+  if (!ZSTD_isError(compressed_size) && compressed_size < size)
+  {
+    record.resize(1 + compressed_size);
+    return;
+  }
+#endif
+
+  record.assign(1, TAG_RAW);
+  record.append(data, size);
+}
+
+void tx_blob_codec::decode_append(const char* data, size_t size, std::string& bd) const
+{
+  if (!size)
+    throw DB_ERROR("Empty compressed tx record");
+
+  if (data[0] == TAG_RAW)
+  {
+    bd.append(data + 1, size - 1);
+    return;
+  }
+
+  if (data[0] != TAG_ZSTD)
+    throw DB_ERROR("Unknown compressed tx record tag");
+
+#ifdef HAVE_ZSTD
+  unsigned long long content_size = ZSTD_getFrameContentSize(data + 1, size - 1);
+
+  if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN)
+    throw DB_ERROR("Invalid zstd frame in compressed tx record");
+
+  size_t offset = bd.size();
+  bd.resize(offset + content_size);
+
+  zstd_contexts& contexts = get_contexts();
+
+  size_t decompressed_size = m_dictionaries->ddict
+    ? ZSTD_decompress_usingDDict(contexts.dctx, &bd[offset], content_size, data + 1, size - 1, m_dictionaries->ddict)
+    : ZSTD_decompressDCtx(contexts.dctx, &bd[offset], content_size, data + 1, size - 1);
+
+  if (ZSTD_isError(decompressed_size) || decompressed_size != content_size)
+    throw DB_ERROR("Failed to decompress tx record");
+#else
+  throw DB_ERROR("Compressed tx record found, but zstd support is not built in");
+#endif
+}
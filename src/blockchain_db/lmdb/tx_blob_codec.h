@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cryptonote
+{
+  /**
+   * @brief Codec of txs_pruned / txs_prunable records in a compressed LMDB database
+   *
+   * Every record of a compressed table starts with a one byte tag: TAG_RAW for blobs
+   * stored as is (zstd didn't make them smaller) and TAG_ZSTD for zstd frames made
+   * with the table's dictionary, if it has one. The dictionary is trained once when
+   * the tables are compressed and can't change afterwards.
+   */
+  class tx_blob_codec
+  {
+  public:
+    static constexpr char TAG_RAW = 0;
+    static constexpr char TAG_ZSTD = 1;
+
+    static constexpr int COMPRESSION_LEVEL = 3;
+
+    tx_blob_codec();
+    ~tx_blob_codec();
+
+    /// whether the daemon was built with zstd
+    static bool available();
+
+    /// train a dictionary of at most max_size bytes; returns an empty string if there are too few samples
+    static std::string train_dictionary(const std::vector<std::string>& samples, size_t max_size);
+
+    void set_dictionary(const std::string& dictionary);
+    const std::string& get_dictionary() const { return m_dictionary; }
+
+    /// make a tagged record out of a blob
+    void encode(const char* data, size_t size, std::string& record) const;
+
+    /// decode a tagged record and append the blob to bd
+    void decode_append(const char* data, size_t size, std::string& bd) const;
+
+  private:
+    struct dictionaries;
+
+    std::string m_dictionary;
+    std::unique_ptr<dictionaries> m_dictionaries;
+  };
+}
@@ -26,6 +26,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <atomic>
 #include <unordered_map>
 #include <unordered_set>
 #include <boost/range/adaptor/transformed.hpp>
@@ -34,6 +35,7 @@
 #include <boost/archive/portable_binary_oarchive.hpp>
 #include "common/unordered_containers_boost_serialization.h"
 #include "common/command_line.h"
+#include "common/threadpool.h"
 #include "common/varint.h"
 #include "cryptonote_basic/cryptonote_boost_serialization.h"
 #include "cryptonote_core/tx_pool.h"
@@ -46,6 +48,9 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
 
+#define ANCESTRY_BATCH_BLOCKS 100
+#define ANCESTRY_TXES_PER_THREAD_MIN 16
+
 namespace po = boost::program_options;
 using namespace epee;
 using namespace cryptonote;
@@ -132,14 +137,19 @@ struct tx_data_t
 struct ancestry_state_t
 {
   uint64_t height;
+  crypto::hash top_hash;
   std::unordered_map<crypto::hash, std::unordered_set<ancestor>> ancestry;
   std::unordered_map<ancestor, crypto::hash> output_cache;
   std::unordered_map<crypto::hash, ::tx_data_t> tx_cache;
   std::vector<cryptonote::block> block_cache;
 
+  ancestry_state_t(): height(0), top_hash(crypto::null_hash) {}
+
   template <typename t_archive> void serialize(t_archive &a, const unsigned int ver)
   {
     a & height;
+    if (ver >= 3)
+      a & top_hash;
     a & ancestry;
     a & output_cache;
     if (ver < 1)
@@ -167,7 +177,7 @@ struct ancestry_state_t
     }
   }
 };
-BOOST_CLASS_VERSION(ancestry_state_t, 2)
+BOOST_CLASS_VERSION(ancestry_state_t, 3)
 
 static void add_ancestor(std::unordered_map<ancestor, unsigned int> &ancestry, uint64_t amount, uint64_t offset)
 {
@@ -219,6 +229,126 @@ static std::unordered_set<ancestor> get_ancestry(const std::unordered_map<crypto
   return i->second;
 }
 
+// a tx and the txes which created each of its ring members, looked up outside of the ancestry state
+struct tx_origins_t
+{
+  crypto::hash txid;
+  ::tx_data_t tx_data;
+  bool cached_tx;
+  size_t cached_outputs;
+  std::vector<std::pair<ancestor, crypto::hash>> origins;
+
+  tx_origins_t(const crypto::hash &txid): txid(txid), cached_tx(false), cached_outputs(0) {}
+};
+
+static void get_tx_origins(const BlockchainDB *db, const ancestry_state_t &state, tx_origins_t &t)
+{
+  std::unordered_map<crypto::hash, ::tx_data_t>::const_iterator i = state.tx_cache.find(t.txid);
+  if (i != state.tx_cache.end())
+  {
+    t.cached_tx = true;
+    t.tx_data = i->second;
+  }
+  else
+  {
+    cryptonote::blobdata bd;
+    if (!db->get_pruned_tx_blob(t.txid, bd))
+      throw std::runtime_error("Failed to get txid " + epee::string_tools::pod_to_hex(t.txid) + " from db");
+    cryptonote::transaction tx;
+    if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
+      throw std::runtime_error("Bad tx: " + epee::string_tools::pod_to_hex(t.txid));
+    t.tx_data = ::tx_data_t(tx);
+  }
+  if (t.tx_data.coinbase)
+    return;
+
+  std::vector<tx_out_index> indices;
+  for (const auto &ring: t.tx_data.vin)
+  {
+    const uint64_t amount = ring.first;
+    std::vector<uint64_t> missing;
+    for (uint64_t offset: ring.second)
+    {
+      std::unordered_map<ancestor, crypto::hash>::const_iterator i = state.output_cache.find({amount, offset});
+      if (i == state.output_cache.end())
+      {
+        missing.push_back(offset);
+        continue;
+      }
+      ++t.cached_outputs;
+      t.origins.push_back(std::make_pair(ancestor{amount, offset}, i->second));
+    }
+    if (missing.empty())
+      continue;
+    // the output index in the db maps each output to the tx which created it
+    indices.clear();
+    db->get_output_tx_and_index(amount, missing, indices);
+    if (indices.size() != missing.size())
+      throw std::runtime_error("Output originating transaction not found");
+    for (size_t n = 0; n < missing.size(); ++n)
+      t.origins.push_back(std::make_pair(ancestor{amount, missing[n]}, indices[n].first));
+  }
+}
+
+static bool load_state(const std::string &path, ancestry_state_t &state)
+{
+  LOG_PRINT_L0("Loading state data from " << path);
+  std::ifstream state_data_in;
+  state_data_in.open(path, std::ios_base::binary | std::ios_base::in);
+  if (state_data_in.fail())
+    return false;
+  try
+  {
+    boost::archive::portable_binary_iarchive a(state_data_in);
+    a >> state;
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to load state data from " << path << ", restarting from scratch");
+    state = ancestry_state_t();
+    return false;
+  }
+  return true;
+}
+
+static bool save_state(const std::string &path, const ancestry_state_t &state)
+{
+  LOG_PRINT_L0("Saving state data to " << path);
+  // written aside first, so a save interrupted half way leaves the previous state usable
+  const std::string tmp_path = path + ".tmp";
+  std::ofstream state_data_out;
+  state_data_out.open(tmp_path, std::ios_base::binary | std::ios_base::out | std::ios::trunc);
+  if (state_data_out.fail())
+  {
+    MERROR("Failed to open " << tmp_path);
+    return false;
+  }
+  try
+  {
+    boost::archive::portable_binary_oarchive a(state_data_out);
+    a << state;
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to save state data to " << tmp_path);
+    return false;
+  }
+  state_data_out.close();
+  if (state_data_out.fail())
+  {
+    MERROR("Failed to save state data to " << tmp_path);
+    return false;
+  }
+  boost::system::error_code ec;
+  boost::filesystem::rename(tmp_path, path, ec);
+  if (ec)
+  {
+    MERROR("Failed to rename " << tmp_path << " to " << path << ": " << ec.message());
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char* argv[])
 {
   TRY_ENTRY();
@@ -250,6 +380,7 @@ int main(int argc, char* argv[])
   const command_line::arg_descriptor<bool> arg_cache_blocks  = {"cache-blocks", "Cache blocks (memory hungry)", false};
   const command_line::arg_descriptor<bool> arg_include_coinbase  = {"include-coinbase", "Including coinbase tx", false};
   const command_line::arg_descriptor<bool> arg_show_cache_stats  = {"show-cache-stats", "Show cache statistics", false};
+  const command_line::arg_descriptor<uint64_t> arg_save_interval  = {"save-interval", "Save the --all state every this many blocks, 0 to only save on exit", 10000};
 
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
@@ -264,6 +395,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_cache_blocks);
   command_line::add_arg(desc_cmd_sett, arg_include_coinbase);
   command_line::add_arg(desc_cmd_sett, arg_show_cache_stats);
+  command_line::add_arg(desc_cmd_sett, arg_save_interval);
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
   po::options_description desc_options("Allowed options");
@@ -307,6 +439,7 @@ int main(int argc, char* argv[])
   bool opt_cache_blocks = command_line::get_arg(vm, arg_cache_blocks);
   bool opt_include_coinbase = command_line::get_arg(vm, arg_include_coinbase);
   bool opt_show_cache_stats = command_line::get_arg(vm, arg_show_cache_stats);
+  uint64_t opt_save_interval = command_line::get_arg(vm, arg_save_interval);
 
   if ((!opt_txid_string.empty()) + !!opt_height + !!opt_all > 1)
   {
@@ -379,238 +512,144 @@ int main(int argc, char* argv[])
     ancestry_state_t state;
 
     const std::string state_file_path = (boost::filesystem::path(opt_data_dir) / "ancestry-state.bin").string();
-    LOG_PRINT_L0("Loading state data from " << state_file_path);
-    std::ifstream state_data_in;
-    state_data_in.open(state_file_path, std::ios_base::binary | std::ios_base::in);
-    if (!state_data_in.fail())
-    {
-      try
-      {
-        boost::archive::portable_binary_iarchive a(state_data_in);
-        a >> state;
-      }
-      catch (const std::exception &e)
-      {
-        MERROR("Failed to load state data from " << state_file_path << ", restarting from scratch");
-        state = ancestry_state_t();
-      }
-      state_data_in.close();
-    }
+    load_state(state_file_path, state);
 
     tools::signal_handler::install([](int type) {
       stop_requested = true;
     });
 
-    MINFO("Starting from height " << state.height);
     const uint64_t db_height = db->height();
+    // the state only ever grows, so a reorg below its height means starting over
+    if (state.height > db_height || (state.top_hash != crypto::null_hash && db->get_block_hash_from_height(state.height - 1) != state.top_hash))
+    {
+      MWARNING("The chain does not match the saved state at height " << state.height << ", restarting from scratch");
+      state = ancestry_state_t();
+    }
+
+    MINFO("Starting from height " << state.height);
     state.block_cache.reserve(db_height);
-    for (uint64_t h = state.height; h < db_height; ++h)
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    uint64_t saved_height = state.height;
+    while (state.height < db_height && !stop_requested)
     {
-      size_t block_ancestry_size = 0;
-      const crypto::hash block_hash = db->get_block_hash_from_height(h);
-      const cryptonote::blobdata bd = db->get_block_blob(block_hash);
-      ++total_blocks;
-      cryptonote::block b;
-      if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
+      // origins are looked up for a batch of blocks at a time, then added to the ancestry in chain order
+      const uint64_t batch_end = std::min<uint64_t>(state.height + ANCESTRY_BATCH_BLOCKS, db_height);
+      std::vector<std::vector<tx_origins_t>> batch;
+      std::vector<tx_origins_t*> work;
+      crypto::hash block_hash = crypto::null_hash;
+      batch.reserve(batch_end - state.height);
+      for (uint64_t h = state.height; h < batch_end; ++h)
       {
-        LOG_PRINT_L0("Bad block from db");
-        return 1;
-      }
-      if (opt_cache_blocks)
-      {
-        state.block_cache.resize(h + 1);
-        state.block_cache[h] = b;
-      }
-      std::vector<crypto::hash> txids;
-      txids.reserve(1 + b.tx_hashes.size());
-      if (opt_include_coinbase)
-        txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
-      for (const auto &h: b.tx_hashes)
-        txids.push_back(h);
-      for (const crypto::hash &txid: txids)
-      {
-        printf("%lu/%lu               \r", (unsigned long)h, (unsigned long)db_height);
-        fflush(stdout);
-        ::tx_data_t tx_data;
-        std::unordered_map<crypto::hash, ::tx_data_t>::const_iterator i = state.tx_cache.find(txid);
-        ++total_txes;
-        if (i != state.tx_cache.end())
+        block_hash = db->get_block_hash_from_height(h);
+        cryptonote::block b;
+        ++total_blocks;
+        if (state.block_cache.size() > h && !state.block_cache[h].miner_tx.vin.empty())
         {
-          ++cached_txes;
-          tx_data = i->second;
+          ++cached_blocks;
+          b = state.block_cache[h];
         }
         else
         {
-          cryptonote::blobdata bd;
-          if (!db->get_pruned_tx_blob(txid, bd))
+          const cryptonote::blobdata bd = db->get_block_blob(block_hash);
+          if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
           {
-            LOG_PRINT_L0("Failed to get txid " << txid << " from db");
+            LOG_PRINT_L0("Bad block from db");
             return 1;
           }
-          cryptonote::transaction tx;
-          if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
+          if (opt_cache_blocks)
           {
-            LOG_PRINT_L0("Bad tx: " << txid);
-            return 1;
+            state.block_cache.resize(h + 1);
+            state.block_cache[h] = b;
           }
-          tx_data = ::tx_data_t(tx);
-          if (opt_cache_txes)
-            state.tx_cache.insert(std::make_pair(txid, tx_data));
         }
-        if (tx_data.coinbase)
-        {
-          add_ancestry(state.ancestry, txid, std::unordered_set<ancestor>());
-        }
-        else
-        {
-          for (size_t ring = 0; ring < tx_data.vin.size(); ++ring)
-          {
-            if (1)
-            {
-              const uint64_t amount = tx_data.vin[ring].first;
-              const std::vector<uint64_t> &absolute_offsets = tx_data.vin[ring].second;
-              for (uint64_t offset: absolute_offsets)
-              {
-                const output_data_t od = db->get_output_key(amount, offset);
-                add_ancestry(state.ancestry, txid, ancestor{amount, offset});
-                cryptonote::block b;
-                ++total_blocks;
-                if (state.block_cache.size() > od.height && !state.block_cache[od.height].miner_tx.vin.empty())
-                {
-                  ++cached_blocks;
-                  b = state.block_cache[od.height];
-                }
-                else
-                {
-                  const crypto::hash block_hash = db->get_block_hash_from_height(od.height);
-                  cryptonote::blobdata bd = db->get_block_blob(block_hash);
-                  if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
-                  {
-                    LOG_PRINT_L0("Bad block from db");
-                    return 1;
-                  }
-                  if (opt_cache_blocks)
-                  {
-                    state.block_cache.resize(od.height + 1);
-                    state.block_cache[od.height] = b;
-                  }
-                }
-                // find the tx which created this output
-                bool found = false;
-                std::unordered_map<ancestor, crypto::hash>::const_iterator i = state.output_cache.find({amount, offset});
-                ++total_outputs;
-                if (i != state.output_cache.end())
-                {
-                  ++cached_outputs;
-                  add_ancestry(state.ancestry, txid, get_ancestry(state.ancestry, i->second));
-                  found = true;
-                }
-                else for (size_t out = 0; out < b.miner_tx.vout.size(); ++out)
-                {
-                  if (b.miner_tx.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                  {
-                    const auto &txout = boost::get<cryptonote::txout_to_key>(b.miner_tx.vout[out].target);
-                    if (txout.key == od.pubkey)
-                    {
-                      found = true;
-                      add_ancestry(state.ancestry, txid, get_ancestry(state.ancestry, cryptonote::get_transaction_hash(b.miner_tx)));
-                      if (opt_cache_outputs)
-                        state.output_cache.insert(std::make_pair(ancestor{amount, offset}, cryptonote::get_transaction_hash(b.miner_tx)));
-                      break;
-                    }
-                  }
-                  else
-                  {
-                    LOG_PRINT_L0("Bad vout type in txid " << cryptonote::get_transaction_hash(b.miner_tx));
-                    return 1;
-                  }
-                }
-                for (const crypto::hash &block_txid: b.tx_hashes)
-                {
-                  if (found)
-                    break;
-                  ::tx_data_t tx_data2;
-                  std::unordered_map<crypto::hash, ::tx_data_t>::const_iterator i = state.tx_cache.find(block_txid);
-                  ++total_txes;
-                  if (i != state.tx_cache.end())
-                  {
-                    ++cached_txes;
-                    tx_data2 = i->second;
-                  }
-                  else
-                  {
-                    cryptonote::blobdata bd;
-                    if (!db->get_pruned_tx_blob(block_txid, bd))
-                    {
-                      LOG_PRINT_L0("Failed to get txid " << block_txid << " from db");
-                      return 1;
-                    }
-                    cryptonote::transaction tx;
-                    if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
-                    {
-                      LOG_PRINT_L0("Bad tx: " << block_txid);
-                      return 1;
-                    }
-                    tx_data2 = ::tx_data_t(tx);
-                    if (opt_cache_txes)
-                      state.tx_cache.insert(std::make_pair(block_txid, tx_data2));
-                  }
-                  for (size_t out = 0; out < tx_data2.vout.size(); ++out)
-                  {
-                    if (tx_data2.vout[out] == od.pubkey)
-                    {
-                      found = true;
-                      add_ancestry(state.ancestry, txid, get_ancestry(state.ancestry, block_txid));
-                      if (opt_cache_outputs)
-                        state.output_cache.insert(std::make_pair(ancestor{amount, offset}, block_txid));
-                      break;
-                    }
-                  }
-                }
-                if (!found)
-                {
-                  LOG_PRINT_L0("Output originating transaction not found");
-                  return 1;
-                }
-              }
-            }
-          }
-        }
-        const size_t ancestry_size = get_ancestry(state.ancestry, txid).size();
-        block_ancestry_size += ancestry_size;
-        MINFO(txid << ": " << ancestry_size);
+        batch.push_back({});
+        std::vector<tx_origins_t> &txes = batch.back();
+        txes.reserve(1 + b.tx_hashes.size());
+        if (opt_include_coinbase)
+          txes.push_back(tx_origins_t(cryptonote::get_transaction_hash(b.miner_tx)));
+        for (const auto &txid: b.tx_hashes)
+          txes.push_back(tx_origins_t(txid));
       }
-      if (!txids.empty())
+      for (auto &txes: batch)
+        for (auto &t: txes)
+          work.push_back(&t);
+
+      // lookups only read the state, which is not changed until they are all done
+      const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), work.size() / ANCESTRY_TXES_PER_THREAD_MIN));
+      const size_t per_thread = (work.size() + threads - 1) / threads;
+      std::atomic<bool> failed(false);
+      tools::threadpool::waiter waiter;
+      for (size_t start = 0; start < work.size(); start += per_thread)
       {
-        std::string stats_msg;
-        if (opt_show_cache_stats)
-          stats_msg = std::string(", cache: txes ") + std::to_string(cached_txes*100./total_txes)
-              + ", blocks " + std::to_string(cached_blocks*100./total_blocks) + ", outputs "
-              + std::to_string(cached_outputs*100./total_outputs);
-        MINFO("Height " << h << ": " << (block_ancestry_size / txids.size()) << " average over " << txids.size() << stats_msg);
+        const size_t end = std::min(start + per_thread, work.size());
+        tpool.submit(&waiter, [db, &state, &work, &failed, start, end]() {
+          try
+          {
+            db_rtxn_guard rtxn_guard(*db);
+            for (size_t i = start; i < end; ++i)
+              get_tx_origins(db, state, *work[i]);
+          }
+          catch (const std::exception &e)
+          {
+            LOG_PRINT_L0(e.what());
+            failed = true;
+          }
+        }, true);
       }
-      state.height = h;
-      if (stop_requested)
-        break;
-    }
+      waiter.wait(&tpool);
+      if (failed)
+        return 1;
 
-    LOG_PRINT_L0("Saving state data to " << state_file_path);
-    std::ofstream state_data_out;
-    state_data_out.open(state_file_path, std::ios_base::binary | std::ios_base::out | std::ios::trunc);
-    if (!state_data_out.fail())
-    {
-      try
+      for (size_t n = 0; n < batch.size(); ++n)
       {
-        boost::archive::portable_binary_oarchive a(state_data_out);
-        a << state;
+        const uint64_t h = state.height + n;
+        size_t block_ancestry_size = 0;
+        printf("%lu/%lu               \r", (unsigned long)h, (unsigned long)db_height);
+        fflush(stdout);
+        for (const tx_origins_t &t: batch[n])
+        {
+          ++total_txes;
+          if (t.cached_tx)
+            ++cached_txes;
+          else if (opt_cache_txes)
+            state.tx_cache.insert(std::make_pair(t.txid, t.tx_data));
+          total_outputs += t.origins.size();
+          cached_outputs += t.cached_outputs;
+          if (t.tx_data.coinbase)
+            add_ancestry(state.ancestry, t.txid, std::unordered_set<ancestor>());
+          for (const auto &origin: t.origins)
+          {
+            add_ancestry(state.ancestry, t.txid, origin.first);
+            add_ancestry(state.ancestry, t.txid, get_ancestry(state.ancestry, origin.second));
+            if (opt_cache_outputs)
+              state.output_cache.insert(origin);
+          }
+          const size_t ancestry_size = get_ancestry(state.ancestry, t.txid).size();
+          block_ancestry_size += ancestry_size;
+          MINFO(t.txid << ": " << ancestry_size);
+        }
+        if (!batch[n].empty())
+        {
+          std::string stats_msg;
+          if (opt_show_cache_stats)
+            stats_msg = std::string(", cache: txes ") + std::to_string(cached_txes*100./total_txes)
+                + ", blocks " + std::to_string(cached_blocks*100./total_blocks) + ", outputs "
+                + std::to_string(cached_outputs*100./total_outputs);
+          MINFO("Height " << h << ": " << (block_ancestry_size / batch[n].size()) << " average over " << batch[n].size() << stats_msg);
+        }
       }
-      catch (const std::exception &e)
+      state.height = batch_end;
+      state.top_hash = block_hash;
+
+      if (opt_save_interval && state.height - saved_height >= opt_save_interval && state.height < db_height && !stop_requested)
       {
-        MERROR("Failed to save state data to " << state_file_path);
+        save_state(state_file_path, state);
+        saved_height = state.height;
       }
-      state_data_out.close();
     }
 
+    save_state(state_file_path, state);
+
     goto done;
   }
 
@@ -677,76 +716,9 @@ int main(int argc, char* argv[])
           for (uint64_t offset: absolute_offsets)
           {
             add_ancestor(ancestry, amount, offset);
-            const output_data_t od = db->get_output_key(amount, offset);
-            const crypto::hash block_hash = db->get_block_hash_from_height(od.height);
-            bd = db->get_block_blob(block_hash);
-            cryptonote::block b;
-            if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
-            {
-              LOG_PRINT_L0("Bad block from db");
-              return 1;
-            }
-            // find the tx which created this output
-            bool found = false;
-            for (size_t out = 0; out < b.miner_tx.vout.size(); ++out)
-            {
-              if (b.miner_tx.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-              {
-                const auto &txout = boost::get<cryptonote::txout_to_key>(b.miner_tx.vout[out].target);
-                if (txout.key == od.pubkey)
-                {
-                  found = true;
-                  txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
-                  MDEBUG("adding txid: " << cryptonote::get_transaction_hash(b.miner_tx));
-                  break;
-                }
-              }
-              else
-              {
-                LOG_PRINT_L0("Bad vout type in txid " << cryptonote::get_transaction_hash(b.miner_tx));
-                return 1;
-              }
-            }
-            for (const crypto::hash &block_txid: b.tx_hashes)
-            {
-              if (found)
-                break;
-              if (!db->get_pruned_tx_blob(block_txid, bd))
-              {
-                LOG_PRINT_L0("Failed to get txid " << block_txid << " from db");
-                return 1;
-              }
-              cryptonote::transaction tx2;
-              if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx2))
-              {
-                LOG_PRINT_L0("Bad tx: " << block_txid);
-                return 1;
-              }
-              for (size_t out = 0; out < tx2.vout.size(); ++out)
-              {
-                if (tx2.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                {
-                  const auto &txout = boost::get<cryptonote::txout_to_key>(tx2.vout[out].target);
-                  if (txout.key == od.pubkey)
-                  {
-                    found = true;
-                    txids.push_back(block_txid);
-                    MDEBUG("adding txid: " << block_txid);
-                    break;
-                  }
-                }
-                else
-                {
-                  LOG_PRINT_L0("Bad vout type in txid " << block_txid);
-                  return 1;
-                }
-              }
-            }
-            if (!found)
-            {
-              LOG_PRINT_L0("Output originating transaction not found");
-              return 1;
-            }
+            const tx_out_index toi = db->get_output_tx_and_index(amount, offset);
+            txids.push_back(toi.first);
+            MDEBUG("adding txid: " << toi.first);
           }
         }
         else
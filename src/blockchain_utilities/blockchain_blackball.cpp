@@ -33,6 +33,7 @@
 #include "common/unordered_containers_boost_serialization.h"
 #include "common/command_line.h"
 #include "common/varint.h"
+#include "common/threadpool.h"
 #include "serialization/crypto.h"
 #include "cryptonote_basic/cryptonote_boost_serialization.h"
 #include "cryptonote_core/tx_pool.h"
@@ -72,6 +73,42 @@ struct output_data
   bool operator==(const output_data &other) const { return other.amount == amount && other.offset == offset; }
 };
 
+// the outputs in dbi_spent, as a bitmap over each amount's output indices, so rings can be checked
+// without a database lookup per member and from several threads at once
+class spent_output_set
+{
+public:
+  spent_output_set(): m_count(0) {}
+
+  bool insert(const output_data &od)
+  {
+    std::vector<bool> &spent = m_spent[od.amount];
+    if (od.offset >= spent.size())
+      spent.resize(od.offset + 1, false);
+    if (spent[od.offset])
+      return false;
+    spent[od.offset] = true;
+    ++m_count;
+    return true;
+  }
+  bool contains(const output_data &od) const
+  {
+    const auto i = m_spent.find(od.amount);
+    return i != m_spent.end() && od.offset < i->second.size() && i->second[od.offset];
+  }
+  uint64_t size() const { return m_count; }
+
+private:
+  std::unordered_map<uint64_t, std::vector<bool>> m_spent;
+  uint64_t m_count;
+};
+static spent_output_set spent_outputs;
+
+// blobs read from the blockchain before being parsed together
+#define PARSE_BATCH_SIZE 4096
+// spent outputs whose rings a thread checks, at least
+#define CHAIN_REACTION_OUTPUTS_PER_THREAD_MIN 256
+
 //
 // relative_rings: key_image -> vector<uint64_t>
 // outputs: 128 bits -> set of key images
@@ -366,37 +403,64 @@ static bool for_all_transactions(const std::string &filename, uint64_t &start_id
 
   bool fret = true;
 
+  // txes are read in batches, parsed on all threads, and handed over in order
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  std::vector<std::pair<uint64_t, blobdata>> blobs;
+  std::vector<cryptonote::transaction_prefix> txs;
+  std::unique_ptr<bool[]> parsed(new bool[PARSE_BATCH_SIZE]);
   k.mv_size = sizeof(uint64_t);
   k.mv_data = &start_idx;
   MDB_cursor_op op = MDB_SET;
-  while (1)
+  bool end = false;
+  while (!end)
   {
-    int ret = mdb_cursor_get(cur, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(ret)));
+    blobs.clear();
+    while (blobs.size() < PARSE_BATCH_SIZE)
+    {
+      int ret = mdb_cursor_get(cur, &k, &v, op);
+      op = MDB_NEXT;
+      if (ret == MDB_NOTFOUND)
+      {
+        end = true;
+        break;
+      }
+      if (ret)
+        throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(ret)));
+
+      if (k.mv_size != sizeof(uint64_t))
+        throw std::runtime_error("Bad key size");
+      const uint64_t idx = *(uint64_t*)k.mv_data;
+      if (idx < start_idx)
+        continue;
+      blobs.emplace_back(idx, blobdata(reinterpret_cast<char*>(v.mv_data), v.mv_size));
+    }
 
-    if (k.mv_size != sizeof(uint64_t))
-      throw std::runtime_error("Bad key size");
-    const uint64_t idx = *(uint64_t*)k.mv_data;
-    if (idx < start_idx)
-      continue;
+    txs.clear();
+    txs.resize(blobs.size());
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), blobs.size() / 64));
+    const size_t per_thread = (blobs.size() + threads - 1) / threads;
+    tools::threadpool::waiter waiter;
+    for (size_t t = 0; t < threads; ++t)
+    {
+      tpool.submit(&waiter, [&, t]() {
+        for (size_t i = t * per_thread; i < std::min(blobs.size(), (t + 1) * per_thread); ++i)
+        {
+          binary_archive<false> ba{epee::strspan<std::uint8_t>(blobs[i].second)};
+          parsed[i] = do_serialize(ba, txs[i]);
+        }
+      }, true);
+    }
+    waiter.wait(&tpool);
 
-    cryptonote::transaction_prefix tx;
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    std::stringstream ss;
-    ss << bd;
-    binary_archive<false> ba(ss);
-    bool r = do_serialize(ba, tx);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
-
-    start_idx = *(uint64_t*)k.mv_data;
-    if (!f(tx)) {
-      fret = false;
-      break;
+    for (size_t i = 0; i < blobs.size(); ++i)
+    {
+      CHECK_AND_ASSERT_MES(parsed[i], false, "Failed to parse transaction from blob");
+      start_idx = blobs[i].first;
+      if (!f(txs[i])) {
+        fret = false;
+        end = true;
+        break;
+      }
     }
   }
 
@@ -544,17 +608,13 @@ static bool add_spent_output(MDB_cursor *cur, const output_data &od)
   if (dbr == MDB_KEYEXIST)
     return false;
   CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to add spent output: " + std::string(mdb_strerror(dbr)));
+  spent_outputs.insert(od);
   return true;
 }
 
-static bool is_output_spent(MDB_cursor *cur, const output_data &od)
+static bool is_output_spent(const output_data &od)
 {
-  MDB_val k = {sizeof(od.amount), (void*)&od.amount};
-  MDB_val v = {sizeof(od.offset), (void*)&od.offset};
-  int dbr = mdb_cursor_get(cur, &k, &v, MDB_GET_BOTH);
-  CHECK_AND_ASSERT_THROW_MES(!dbr || dbr == MDB_NOTFOUND, "Failed to get spent output: " + std::string(mdb_strerror(dbr)));
-  bool spent = dbr == 0;
-  return spent;
+  return spent_outputs.contains(od);
 }
 
 static std::vector<output_data> get_spent_outputs(MDB_txn *txn)
@@ -565,12 +625,14 @@ static std::vector<output_data> get_spent_outputs(MDB_txn *txn)
   MDB_val k, v;
   mdb_size_t count = 0;
   dbr = mdb_cursor_get(cur, &k, &v, MDB_FIRST);
-  if (dbr != MDB_NOTFOUND)
+  if (dbr == MDB_NOTFOUND)
   {
-    CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to get first spent output: " + std::string(mdb_strerror(dbr)));
-    dbr = mdb_cursor_count(cur, &count);
-    CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to count entries: " + std::string(mdb_strerror(dbr)));
+    mdb_cursor_close(cur);
+    return {};
   }
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to get first spent output: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_cursor_count(cur, &count);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to count entries: " + std::string(mdb_strerror(dbr)));
   std::vector<output_data> outs;
   outs.reserve(count);
   while (1)
@@ -1122,6 +1184,14 @@ int main(int argc, char* argv[])
   size_t done = 0;
 
   const uint64_t start_blackballed_outputs = get_num_spent_outputs();
+  {
+    MDB_txn *txn;
+    int dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+    CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+    for (const output_data &od: get_spent_outputs(txn))
+      spent_outputs.insert(od);
+    mdb_txn_abort(txn);
+  }
 
   tools::ringdb ringdb(output_file_path.string(), epee::string_tools::pod_to_hex(get_genesis_block_hash(inputs[0])));
 
@@ -1153,7 +1223,7 @@ int main(int argc, char* argv[])
     std::vector<std::pair<uint64_t, uint64_t>> blackballs;
     for (const std::pair<uint64_t, uint64_t> &output: extra_spent_outputs)
     {
-      if (!is_output_spent(cur, output_data(output.first, output.second)))
+      if (!is_output_spent(output_data(output.first, output.second)))
       {
         blackballs.push_back(output);
         if (add_spent_output(cur, output_data(output.first, output.second)))
@@ -1356,6 +1426,68 @@ int main(int argc, char* argv[])
   {
     LOG_PRINT_L0("Secondary pass on " << work_spent.size() << " spent outputs");
 
+    std::vector<output_data> scan_spent = std::move(work_spent);
+    work_spent.clear();
+
+    // the rings of the outputs are checked on all threads against what was known to be spent when the
+    // pass started, anything one of them reveals is looked at again in the next pass
+    struct revealed_output { output_data od; size_t ring_size; };
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), scan_spent.size() / CHAIN_REACTION_OUTPUTS_PER_THREAD_MIN));
+    const size_t per_thread = (scan_spent.size() + threads - 1) / threads;
+    std::vector<std::vector<revealed_output>> revealed(threads);
+    std::atomic<bool> failed(false);
+    tools::threadpool::waiter waiter;
+    for (size_t t = 0; t < threads; ++t)
+    {
+      tpool.submit(&waiter, [&, t]() {
+        MDB_txn *txn = NULL;
+        try
+        {
+          int dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+          CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+          for (size_t i = t * per_thread; i < std::min(scan_spent.size(), (t + 1) * per_thread) && !stop_requested; ++i)
+          {
+            const output_data &od = scan_spent[i];
+            std::vector<crypto::key_image> key_images = get_key_images(txn, od);
+            for (const crypto::key_image &ki: key_images)
+            {
+              std::vector<uint64_t> relative_ring;
+              CHECK_AND_ASSERT_THROW_MES(get_relative_ring(txn, ki, relative_ring), "Relative ring not found");
+              std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(relative_ring);
+              size_t known = 0;
+              uint64_t last_unknown = 0;
+              for (uint64_t out: absolute)
+              {
+                output_data new_od(od.amount, out);
+                if (is_output_spent(new_od))
+                  ++known;
+                else
+                  last_unknown = out;
+              }
+              if (known == absolute.size() - 1)
+                revealed[t].push_back({output_data(od.amount, last_unknown), absolute.size()});
+            }
+          }
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to check rings: " << e.what());
+          failed = true;
+        }
+        if (txn)
+          mdb_txn_abort(txn);
+      }, true);
+    }
+    waiter.wait(&tpool);
+    CHECK_AND_ASSERT_THROW_MES(!failed, "Failed to check rings of spent outputs");
+
+    if (stop_requested)
+    {
+      MINFO("Stopping secondary passes. Secondary passes are not incremental, they will re-run fully.");
+      return 0;
+    }
+
     int dbr = resize_env(cache_dir.c_str());
     CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to resize LMDB database: " + std::string(mdb_strerror(dbr)));
 
@@ -1366,46 +1498,24 @@ int main(int argc, char* argv[])
     dbr = mdb_cursor_open(txn, dbi_spent, &cur);
     CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB cursor: " + std::string(mdb_strerror(dbr)));
 
+    // merged in the order the outputs were scanned, several rings can reveal the same output
     std::vector<std::pair<uint64_t, uint64_t>> blackballs;
-    std::vector<output_data> scan_spent = std::move(work_spent);
-    work_spent.clear();
-    for (const output_data &od: scan_spent)
+    for (const std::vector<revealed_output> &outputs: revealed)
     {
-      std::vector<crypto::key_image> key_images = get_key_images(txn, od);
-      for (const crypto::key_image &ki: key_images)
+      for (const revealed_output &r: outputs)
       {
-        std::vector<uint64_t> relative_ring;
-        CHECK_AND_ASSERT_THROW_MES(get_relative_ring(txn, ki, relative_ring), "Relative ring not found");
-        std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(relative_ring);
-        size_t known = 0;
-        uint64_t last_unknown = 0;
-        for (uint64_t out: absolute)
-        {
-          output_data new_od(od.amount, out);
-          if (is_output_spent(cur, new_od))
-            ++known;
-          else
-            last_unknown = out;
-        }
-        if (known == absolute.size() - 1)
+        if (is_output_spent(r.od))
+          continue;
+        const std::pair<uint64_t, uint64_t> output = std::make_pair(r.od.amount, r.od.offset);
+        if (opt_verbose)
         {
-          const std::pair<uint64_t, uint64_t> output = std::make_pair(od.amount, last_unknown);
-          if (opt_verbose)
-          {
-            MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in a " <<
-                absolute.size() << "-ring where all other outputs are known to be spent");
-          }
-          blackballs.push_back(output);
-          if (add_spent_output(cur, output_data(od.amount, last_unknown)))
-            inc_stat(txn, od.amount ? "pre-rct-chain-reaction" : "rct-chain-reaction");
-          work_spent.push_back(output_data(od.amount, last_unknown));
+          MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in a " <<
+              r.ring_size << "-ring where all other outputs are known to be spent");
         }
-      }
-
-      if (stop_requested)
-      {
-        MINFO("Stopping secondary passes. Secondary passes are not incremental, they will re-run fully.");
-        return 0;
+        blackballs.push_back(output);
+        if (add_spent_output(cur, r.od))
+          inc_stat(txn, r.od.amount ? "pre-rct-chain-reaction" : "rct-chain-reaction");
+        work_spent.push_back(r.od);
       }
     }
     if (!blackballs.empty())
@@ -26,9 +26,13 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/string.hpp>
 #include "common/command_line.h"
+#include "common/threadpool.h"
 #include "common/varint.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
@@ -44,6 +48,71 @@ namespace po = boost::program_options;
 using namespace epee;
 using namespace cryptonote;
 
+#define DEPTH_TXES_PER_THREAD_MIN 16
+
+// the txes which created the ring members of a tx, left empty for a coinbase tx
+static void get_tx_parents(const BlockchainDB *db, const crypto::hash &txid, std::vector<crypto::hash> &parents)
+{
+  cryptonote::blobdata bd;
+  if (!db->get_pruned_tx_blob(txid, bd))
+    throw std::runtime_error("Failed to get txid " + epee::string_tools::pod_to_hex(txid) + " from db");
+  cryptonote::transaction tx;
+  if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
+    throw std::runtime_error("Bad tx: " + epee::string_tools::pod_to_hex(txid));
+  std::vector<tx_out_index> indices;
+  for (size_t ring = 0; ring < tx.vin.size(); ++ring)
+  {
+    if (tx.vin[ring].type() == typeid(cryptonote::txin_gen))
+    {
+      MDEBUG(txid << " is a coinbase transaction");
+      parents.clear();
+      return;
+    }
+    if (tx.vin[ring].type() != typeid(cryptonote::txin_to_key))
+      throw std::runtime_error("Bad vin type in txid " + epee::string_tools::pod_to_hex(txid));
+    const cryptonote::txin_to_key &txin = boost::get<cryptonote::txin_to_key>(tx.vin[ring]);
+    const std::vector<uint64_t> absolute_offsets = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
+    // the output index in the db maps each output to the tx which created it
+    indices.clear();
+    db->get_output_tx_and_index(txin.amount, absolute_offsets, indices);
+    if (indices.size() != absolute_offsets.size())
+      throw std::runtime_error("Output originating transaction not found");
+    for (const tx_out_index &toi: indices)
+      parents.push_back(toi.first);
+  }
+}
+
+// looks up the parents of independent txes side by side, each thread in its own read txn
+static bool get_txes_parents(const BlockchainDB *db, const std::vector<crypto::hash> &txids, std::vector<std::vector<crypto::hash>> &parents)
+{
+  parents.clear();
+  parents.resize(txids.size());
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), txids.size() / DEPTH_TXES_PER_THREAD_MIN));
+  const size_t per_thread = (txids.size() + threads - 1) / threads;
+  std::atomic<bool> failed(false);
+  tools::threadpool::waiter waiter;
+  for (size_t start = 0; start < txids.size(); start += per_thread)
+  {
+    const size_t end = std::min(start + per_thread, txids.size());
+    tpool.submit(&waiter, [db, &txids, &parents, &failed, start, end]() {
+      try
+      {
+        db_rtxn_guard rtxn_guard(*db);
+        for (size_t i = start; i < end; ++i)
+          get_tx_parents(db, txids[i], parents[i]);
+      }
+      catch (const std::exception &e)
+      {
+        LOG_PRINT_L0(e.what());
+        failed = true;
+      }
+    }, true);
+  }
+  waiter.wait(&tpool);
+  return !failed;
+}
+
 int main(int argc, char* argv[])
 {
   TRY_ENTRY();
@@ -207,6 +276,8 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  // parents of every tx looked at so far, shared by all the start txids
+  std::unordered_map<crypto::hash, std::vector<crypto::hash>> parents_cache;
   std::vector<uint64_t> depths;
   for (const crypto::hash &start_txid: start_txids)
   {
@@ -218,122 +289,34 @@ int main(int argc, char* argv[])
     while (!coinbase)
     {
       LOG_PRINT_L0("Considering "<< txids.size() << " transaction(s) at depth " << depth);
-      std::vector<crypto::hash> new_txids;
+      std::vector<crypto::hash> missing;
+      for (const crypto::hash &txid: txids)
+        if (parents_cache.find(txid) == parents_cache.end())
+          missing.push_back(txid);
+      std::vector<std::vector<crypto::hash>> missing_parents;
+      if (!get_txes_parents(db, missing, missing_parents))
+        return 1;
+      for (size_t i = 0; i < missing.size(); ++i)
+        parents_cache.emplace(missing[i], std::move(missing_parents[i]));
+
+      // a tx reached through several rings only needs looking at once at the next depth
+      std::unordered_set<crypto::hash> new_txids;
       for (const crypto::hash &txid: txids)
       {
-        cryptonote::blobdata bd;
-        if (!db->get_pruned_tx_blob(txid, bd))
-        {
-          LOG_PRINT_L0("Failed to get txid " << txid << " from db");
-          return 1;
-        }
-        cryptonote::transaction tx;
-        if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
-        {
-          LOG_PRINT_L0("Bad tx: " << txid);
-          return 1;
-        }
-        for (size_t ring = 0; ring < tx.vin.size(); ++ring)
+        const std::vector<crypto::hash> &parents = parents_cache[txid];
+        if (parents.empty())
         {
-          if (tx.vin[ring].type() == typeid(cryptonote::txin_gen))
-          {
-            MDEBUG(txid << " is a coinbase transaction");
-            coinbase = true;
-            goto done;
-          }
-          if (tx.vin[ring].type() == typeid(cryptonote::txin_to_key))
-          {
-            const cryptonote::txin_to_key &txin = boost::get<cryptonote::txin_to_key>(tx.vin[ring]);
-            const uint64_t amount = txin.amount;
-            auto absolute_offsets = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
-            for (uint64_t offset: absolute_offsets)
-            {
-              const output_data_t od = db->get_output_key(amount, offset);
-              const crypto::hash block_hash = db->get_block_hash_from_height(od.height);
-              bd = db->get_block_blob(block_hash);
-              cryptonote::block b;
-              if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
-              {
-                LOG_PRINT_L0("Bad block from db");
-                return 1;
-              }
-              // find the tx which created this output
-              bool found = false;
-              for (size_t out = 0; out < b.miner_tx.vout.size(); ++out)
-              {
-                if (b.miner_tx.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                {
-                  const auto &txout = boost::get<cryptonote::txout_to_key>(b.miner_tx.vout[out].target);
-                  if (txout.key == od.pubkey)
-                  {
-                    found = true;
-                    new_txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
-                    MDEBUG("adding txid: " << cryptonote::get_transaction_hash(b.miner_tx));
-                    break;
-                  }
-                }
-                else
-                {
-                  LOG_PRINT_L0("Bad vout type in txid " << cryptonote::get_transaction_hash(b.miner_tx));
-                  return 1;
-                }
-              }
-              for (const crypto::hash &block_txid: b.tx_hashes)
-              {
-                if (found)
-                  break;
-                if (!db->get_pruned_tx_blob(block_txid, bd))
-                {
-                  LOG_PRINT_L0("Failed to get txid " << block_txid << " from db");
-                  return 1;
-                }
-                cryptonote::transaction tx2;
-                if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx2))
-                {
-                  LOG_PRINT_L0("Bad tx: " << block_txid);
-                  return 1;
-                }
-                for (size_t out = 0; out < tx2.vout.size(); ++out)
-                {
-                  if (tx2.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                  {
-                    const auto &txout = boost::get<cryptonote::txout_to_key>(tx2.vout[out].target);
-                    if (txout.key == od.pubkey)
-                    {
-                      found = true;
-                      new_txids.push_back(block_txid);
-                      MDEBUG("adding txid: " << block_txid);
-                      break;
-                    }
-                  }
-                  else
-                  {
-                    LOG_PRINT_L0("Bad vout type in txid " << block_txid);
-                    return 1;
-                  }
-                }
-              }
-              if (!found)
-              {
-                LOG_PRINT_L0("Output originating transaction not found");
-                return 1;
-              }
-            }
-          }
-          else
-          {
-            LOG_PRINT_L0("Bad vin type in txid " << txid);
-            return 1;
-          }
+          coinbase = true;
+          break;
         }
+        new_txids.insert(parents.begin(), parents.end());
       }
       if (!coinbase)
       {
-        std::swap(txids, new_txids);
+        txids.assign(new_txids.begin(), new_txids.end());
         ++depth;
       }
     }
-done:
     LOG_PRINT_L0("Min depth for txid " << start_txid << ": " << depth);
     depths.push_back(depth);
   }
@@ -28,7 +28,9 @@
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "bootstrap_file.h"
+#include "chunked_bootstrap_file.h"
 #include "blocksdat_file.h"
+#include "columnar_export.h"
 #include "common/command_line.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
@@ -56,6 +58,8 @@ int main(int argc, char* argv[])
   uint32_t log_level = 0;
   uint64_t block_stop = 0;
   bool blocks_dat = false;
+  bool chunked = false;
+  bool columnar = false;
 
   tools::on_startup();
 
@@ -70,6 +74,8 @@ int main(int argc, char* argv[])
     "database", available_dbs.c_str(), default_db_type
   };
   const command_line::arg_descriptor<bool> arg_blocks_dat = {"blocksdat", "Output in blocks.dat format", blocks_dat};
+  const command_line::arg_descriptor<bool> arg_chunked = {"chunked", "Output independently compressed chunks, built in parallel", chunked};
+  const command_line::arg_descriptor<bool> arg_columnar = {"columnar", "Output tx and output columns for analytics to the --output-file directory", columnar};
 
 
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
@@ -80,6 +86,8 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_block_stop);
   command_line::add_arg(desc_cmd_sett, arg_blocks_dat);
+  command_line::add_arg(desc_cmd_sett, arg_chunked);
+  command_line::add_arg(desc_cmd_sett, arg_columnar);
 
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
@@ -120,6 +128,13 @@ int main(int argc, char* argv[])
     return 1;
   }
   bool opt_blocks_dat = command_line::get_arg(vm, arg_blocks_dat);
+  bool opt_chunked = command_line::get_arg(vm, arg_chunked);
+  bool opt_columnar = command_line::get_arg(vm, arg_columnar);
+  if (opt_blocks_dat + opt_chunked + opt_columnar > 1)
+  {
+    std::cerr << "Only one of --blocksdat, --chunked and --columnar can be given" << std::endl;
+    return 1;
+  }
 
   std::string m_config_folder;
 
@@ -134,6 +149,8 @@ int main(int argc, char* argv[])
 
   if (command_line::has_arg(vm, arg_output_file))
     output_file_path = boost::filesystem::path(command_line::get_arg(vm, arg_output_file));
+  else if (opt_columnar)
+    output_file_path = boost::filesystem::path(m_config_folder) / "export" / "columns";
   else
     output_file_path = boost::filesystem::path(m_config_folder) / "export" / BLOCKCHAIN_RAW;
   LOG_PRINT_L0("Export output file: " << output_file_path.string());
@@ -187,6 +204,16 @@ int main(int argc, char* argv[])
     BlocksdatFile blocksdat;
     r = blocksdat.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop);
   }
+  else if (opt_chunked)
+  {
+    ChunkedBootstrapFile bootstrap;
+    r = bootstrap.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop);
+  }
+  else if (opt_columnar)
+  {
+    ColumnarExport columns;
+    r = columns.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop);
+  }
   else
   {
     BootstrapFile bootstrap;
@@ -31,12 +31,15 @@
 #include <cstdio>
 #include <algorithm>
 #include <fstream>
+#include <iomanip>
+#include <map>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
 #include <unistd.h>
 #include "misc_log_ex.h"
 #include "bootstrap_file.h"
+#include "chunked_bootstrap_file.h"
 #include "bootstrap_serialization.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "serialization/binary_utils.h" // dump_binary(), parse_binary()
@@ -44,6 +47,10 @@
 #include "include_base_utils.h"
 #include "blockchain_db/db_types.h"
 #include "cryptonote_core/cryptonote_core.h"
+#include "common/threadpool.h"
+#include "common/trace.h"
+#include "common/util.h"
+#include "misc_language.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
@@ -56,6 +63,7 @@ bool opt_verify  = true; // use add_new_block, which does verification before ca
 bool opt_resume  = true;
 bool opt_testnet = true;
 bool opt_stagenet = true;
+bool opt_replay  = false; // verify-only replay into a throwaway database, also processing stakes
 
 // number of blocks per batch transaction
 // adjustable through command-line argument according to available RAM
@@ -198,6 +206,7 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
   for(const block_complete_entry& block_entry: blocks)
   {
     // process transactions
+    tools::trace::span txs_span("import.handle_incoming_txs");
     for(auto& tx_blob: block_entry.txs)
     {
       tx_verification_context tvc = AUTO_VAL_INIT(tvc);
@@ -210,6 +219,7 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
         return 1;
       }
     }
+    txs_span.stop();
 
     // process block
 
@@ -235,10 +245,182 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
   if (!core.cleanup_handle_incoming_blocks())
     return 1;
 
+  // a syncing daemon catches its stakes up on idle, between batches of blocks
+  if (opt_replay)
+    core.synchronize_stakes();
+
   blocks.clear();
   return 0;
 }
 
+int import_from_chunked_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop)
+{
+  ChunkedBootstrapFile bootstrap;
+  if (!bootstrap.open_reader(import_file_path))
+    return 2;
+
+  const std::vector<bootstrap::chunk_info>& chunks = bootstrap.get_chunks();
+  uint64_t total_source_blocks = bootstrap.count_blocks();
+  MINFO("bootstrap file last block number: " << total_source_blocks-1 << " (zero-based height)  total blocks: " << total_source_blocks);
+
+  uint64_t start_height = 1;
+  if (opt_resume)
+    start_height = core.get_blockchain_storage().get_current_blockchain_height();
+
+  if (total_source_blocks-1 <= start_height)
+  {
+    return false;
+  }
+
+  if (! block_stop || block_stop > total_source_blocks - 1)
+  {
+    block_stop = total_source_blocks - 1;
+  }
+  MINFO("start block: " << start_height << "  stop block: " <<
+      block_stop);
+
+  bool use_batch = opt_batch && !opt_verify;
+  BlockchainDB& db = core.get_blockchain_storage().get_db();
+
+  // chunks are decompressed and parsed a window ahead of the one being added,
+  // block verification itself is parallelized by prepare_handle_incoming_blocks
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  const size_t window = 2 * std::max(1u, tpool.get_max_concurrency());
+  auto window_size = [&](size_t first) -> size_t {
+    size_t count = 0;
+    while (first + count < chunks.size() && count < window && chunks[first + count].block_first <= block_stop)
+      ++count;
+    return count;
+  };
+
+  size_t first = 0;
+  while (first < chunks.size() && chunks[first].block_first + chunks[first].num_blocks <= start_height)
+    ++first;
+  size_t count = window_size(first);
+
+  std::vector<bootstrap::chunk> current, next;
+  bootstrap.read_chunks(first, count, current, waiter);
+  waiter.wait(&tpool);
+
+  MINFO("Reading blockchain from bootstrap file...");
+  std::cout << ENDL;
+
+  if (use_batch)
+    db.batch_start(db_batch_size);
+
+  std::vector<block_complete_entry> blocks;
+  uint64_t h = start_height;
+  uint64_t num_imported = 0;
+  int quit = 0;
+  while (count && !quit)
+  {
+    const size_t next_first = first + count;
+    const size_t next_count = window_size(next_first);
+    bootstrap.read_chunks(next_first, next_count, next, waiter);
+
+    for (size_t c = 0; c < count && !quit; ++c)
+    {
+      const bootstrap::chunk_info& info = chunks[first + c];
+      if (current[c].blocks.size() != info.num_blocks)
+      {
+        std::cout << refresh_string;
+        MFATAL("Error in deserialization of chunk at height " << info.block_first);
+        quit = 2;
+        break;
+      }
+
+      for (size_t i = 0; i < current[c].blocks.size(); ++i)
+      {
+        if (info.block_first + i < h)
+          continue;
+        if (h > block_stop)
+        {
+          std::cout << refresh_string;
+          MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
+          quit = 1;
+          break;
+        }
+
+        const bootstrap::block_package& bp = current[c].blocks[i];
+        if (opt_verify)
+        {
+          cryptonote::blobdata block;
+          cryptonote::block_to_blob(bp.block, block);
+          std::vector<cryptonote::blobdata> txs;
+          for (const auto &tx: bp.txs)
+          {
+            txs.push_back(cryptonote::blobdata());
+            cryptonote::tx_to_blob(tx, txs.back());
+          }
+          blocks.push_back({block, txs});
+          if (check_flush(core, blocks, false))
+          {
+            quit = 2; // make sure we don't commit partial block data
+            break;
+          }
+        }
+        else
+        {
+          try
+          {
+            db.add_block(bp.block, bp.block_weight, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
+          }
+          catch (const std::exception& e)
+          {
+            std::cout << refresh_string;
+            MFATAL("Error adding block to blockchain: " << e.what());
+            quit = 2; // make sure we don't commit partial block data
+            break;
+          }
+
+          if (use_batch && h % db_batch_size == 0)
+          {
+            std::cout << refresh_string;
+            std::cout << ENDL << "[- batch commit at height " << h << " -]" << ENDL;
+            db.batch_stop();
+            db.batch_start(db_batch_size);
+            std::cout << ENDL;
+            db.show_stats();
+          }
+        }
+        ++h;
+        ++num_imported;
+      }
+      std::cout << refresh_string << "block " << h-1
+        << " / " << block_stop
+        << std::flush;
+    }
+
+    // the next window's jobs reference next, so they must be done before it's reused
+    waiter.wait(&tpool);
+    std::swap(current, next);
+    first = next_first;
+    count = next_count;
+  }
+  std::cout << ENDL;
+
+  if (opt_verify && quit < 2)
+  {
+    int ret = check_flush(core, blocks, true);
+    if (ret)
+      return ret;
+  }
+
+  if (use_batch && quit < 2)
+  {
+    // on error, the destructor aborts the write txn
+    db.batch_stop();
+  }
+
+  db.show_stats();
+  MINFO("Number of blocks imported: " << num_imported);
+  MINFO("Finished at block: " << h-1 << "  total blocks: " << h);
+
+  std::cout << ENDL;
+  return quit > 1 ? 2 : 0;
+}
+
 int import_from_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop=0)
 {
   // Reset stats, in case we're using newly created db, accumulating stats
@@ -254,6 +436,9 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
     return false;
   }
 
+  if (ChunkedBootstrapFile::is_chunked(import_file_path))
+    return import_from_chunked_file(core, import_file_path, block_stop);
+
   uint64_t start_height = 1, seek_height;
   if (opt_resume)
     start_height = core.get_blockchain_storage().get_current_blockchain_height();
@@ -558,6 +743,116 @@ quitting:
   return 0;
 }
 
+void print_replay_report(uint64_t first_height, uint64_t blocks, uint64_t elapsed_ns)
+{
+  std::map<std::string, tools::trace::histogram> histograms;
+  for (const tools::trace::histogram &h: tools::trace::get_histograms())
+    histograms[h.name] = h;
+
+  // the stages below run one after the other on the importing thread, besides the threads
+  // prepare_handle_incoming_blocks hands the PoW of a batch to
+  static const struct { const char *span; const char *label; } stages[] = {
+    { "prepare_handle_incoming_blocks", "prepare (parallel PoW, outputs)" },
+    { "handle_block_to_main_chain.pow", "PoW check" },
+    { "import.handle_incoming_txs", "tx pool admission" },
+    { "handle_block_to_main_chain.txs", "tx verify" },
+    { "handle_block_to_main_chain.db", "DB write" },
+    { "StakeTransactionProcessor::synchronize", "stake processing" },
+    { "handle_block_to_main_chain", "block handling, total" },
+  };
+
+  const double elapsed = elapsed_ns / 1e9;
+  std::cout << ENDL << "Replayed " << blocks << " blocks";
+  if (blocks)
+    std::cout << " (" << first_height << " - " << first_height + blocks - 1 << ")";
+  std::cout << " in " << std::fixed << std::setprecision(3) << elapsed << " s: "
+      << std::setprecision(1) << (elapsed > 0 ? blocks / elapsed : 0.0) << " blocks/s, max concurrency "
+      << tools::get_max_concurrency() << ENDL << ENDL;
+  std::cout << std::left << std::setw(34) << "stage" << std::right << std::setw(12) << "total s"
+      << std::setw(10) << "% wall" << std::setw(14) << "ms / block" << ENDL;
+  for (const auto &stage: stages)
+  {
+    const auto i = histograms.find(stage.span);
+    const uint64_t total_ns = i == histograms.end() ? 0 : i->second.total_ns;
+    std::cout << std::left << std::setw(34) << stage.label << std::right
+        << std::setw(12) << std::setprecision(3) << total_ns / 1e9
+        << std::setw(10) << std::setprecision(1) << (elapsed_ns ? 100.0 * total_ns / elapsed_ns : 0.0)
+        << std::setw(14) << std::setprecision(3) << (blocks ? total_ns / 1e6 / blocks : 0.0) << ENDL;
+  }
+  std::cout << ENDL;
+}
+
+//! Verify-only replay: blocks below replay_start are added to a throwaway database without
+//! verification, then the blocks from replay_start go through the same verification a syncing
+//! daemon does, reporting the throughput and where the time went
+int replay_blocks(po::variables_map& vm, const std::string& import_file_path, uint64_t replay_start, uint64_t block_stop)
+{
+  const boost::filesystem::path base_dir = command_line::is_arg_defaulted(vm, cryptonote::arg_data_dir)
+      ? boost::filesystem::temp_directory_path()
+      : boost::filesystem::path(command_line::get_arg(vm, cryptonote::arg_data_dir));
+  const boost::filesystem::path replay_dir = base_dir / boost::filesystem::unique_path("graft-replay-%%%%-%%%%-%%%%");
+  boost::system::error_code ec;
+  if (!boost::filesystem::create_directories(replay_dir, ec))
+  {
+    MFATAL("Failed to create replay database directory " << replay_dir << ": " << ec.message());
+    return 1;
+  }
+  auto replay_dir_remover = epee::misc_utils::create_scope_leave_handler([&replay_dir]() {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(replay_dir, ec);
+  });
+  vm.erase(cryptonote::arg_data_dir.name);
+  vm.emplace(cryptonote::arg_data_dir.name, po::variable_value(replay_dir.string(), false));
+  MINFO("replay database path: " << replay_dir.string());
+
+  cryptonote::cryptonote_protocol_stub pr;
+  if (replay_start > 1)
+  {
+    // the verifying core is a fresh one, loading its state from the database like a restarted daemon
+    cryptonote::core core(&pr);
+    core.disable_dns_checkpoints(true);
+    if (!core.init(vm, NULL))
+    {
+      std::cerr << "Failed to initialize core" << ENDL;
+      return 1;
+    }
+    core.get_blockchain_storage().get_db().set_batch_transactions(true);
+    MINFO("Adding blocks up to " << replay_start - 1 << " without verification");
+    opt_verify = false;
+    const int ret = import_from_file(core, import_file_path, replay_start - 1);
+    opt_verify = true;
+    core.deinit();
+    if (ret)
+      return ret;
+  }
+
+  // fast-block-sync is one of the core's options
+  if (vm["fast-block-sync"].as<uint64_t>())
+    MWARNING("Transactions of blocks with embedded hashes are not verified, use --fast-block-sync=0 to verify them");
+
+  cryptonote::core core(&pr);
+  core.disable_dns_checkpoints(true);
+  if (!core.init(vm, NULL))
+  {
+    std::cerr << "Failed to initialize core" << ENDL;
+    return 1;
+  }
+  core.get_blockchain_storage().get_db().set_batch_transactions(true);
+
+  const uint64_t first_height = core.get_blockchain_storage().get_current_blockchain_height();
+  tools::trace::clear();
+  tools::trace::enable(true);
+  const uint64_t start_ns = epee::misc_utils::get_ns_count();
+  const int ret = import_from_file(core, import_file_path, block_stop);
+  const uint64_t elapsed_ns = epee::misc_utils::get_ns_count() - start_ns;
+  tools::trace::enable(false);
+  const uint64_t blocks = core.get_blockchain_storage().get_current_blockchain_height() - first_height;
+  core.deinit();
+
+  print_replay_report(first_height, blocks, elapsed_ns);
+  return ret;
+}
+
 int main(int argc, char* argv[])
 {
   TRY_ENTRY();
@@ -572,6 +867,7 @@ int main(int argc, char* argv[])
   uint32_t log_level = 0;
   uint64_t num_blocks = 0;
   uint64_t block_stop = 0;
+  uint64_t replay_start = 1;
   std::string m_config_folder;
   std::string db_arg_str;
 
@@ -601,16 +897,25 @@ int main(int argc, char* argv[])
     "Batch transactions for faster import", true};
   const command_line::arg_descriptor<bool> arg_resume =  {"resume",
     "Resume from current height if output database already exists", true};
+  const command_line::arg_descriptor<bool> arg_replay = {"replay",
+    "Verify the blocks into a throwaway database under the data dir (or the temp dir), processing stakes as well, and report blocks/s and the time spent by stage", false};
+  const command_line::arg_descriptor<uint64_t> arg_replay_start = {"replay-start",
+    "Block number --replay starts verifying at, the blocks below are added without verification", replay_start};
+  const command_line::arg_descriptor<unsigned> arg_max_concurrency = {"max-concurrency",
+    "Max number of threads to use for a parallel job", 0};
 
   command_line::add_arg(desc_cmd_sett, arg_input_file);
   command_line::add_arg(desc_cmd_sett, arg_log_level);
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_batch_size);
   command_line::add_arg(desc_cmd_sett, arg_block_stop);
+  command_line::add_arg(desc_cmd_sett, arg_max_concurrency);
 
   command_line::add_arg(desc_cmd_only, arg_count_blocks);
   command_line::add_arg(desc_cmd_only, arg_pop_blocks);
   command_line::add_arg(desc_cmd_only, arg_drop_hf);
+  command_line::add_arg(desc_cmd_only, arg_replay);
+  command_line::add_arg(desc_cmd_only, arg_replay_start);
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
   // call add_options() directly for these arguments since
@@ -640,6 +945,8 @@ int main(int argc, char* argv[])
   opt_resume    = command_line::get_arg(vm, arg_resume);
   block_stop    = command_line::get_arg(vm, arg_block_stop);
   db_batch_size = command_line::get_arg(vm, arg_batch_size);
+  opt_replay    = command_line::get_arg(vm, arg_replay);
+  replay_start  = std::max<uint64_t>(1, command_line::get_arg(vm, arg_replay_start));
 
   if (command_line::get_arg(vm, command_line::arg_help))
   {
@@ -658,6 +965,23 @@ int main(int argc, char* argv[])
     std::cerr << "Error: batch-size must be > 0" << ENDL;
     return 1;
   }
+  if (opt_replay && (!opt_verify || !opt_resume))
+  {
+    std::cerr << "Error: replay verifies all the blocks it adds, from the start of its database" << ENDL;
+    return 1;
+  }
+  if (!command_line::is_arg_defaulted(vm, arg_replay_start) && !opt_replay)
+  {
+    std::cerr << "Error: replay-start set, but replay option not enabled" << ENDL;
+    return 1;
+  }
+  if (opt_replay && block_stop && block_stop < replay_start)
+  {
+    std::cerr << "Error: block-stop is below replay-start" << ENDL;
+    return 1;
+  }
+  if (!command_line::is_arg_defaulted(vm, arg_max_concurrency))
+    tools::set_max_concurrency(command_line::get_arg(vm, arg_max_concurrency));
   if (opt_verify && command_line::is_arg_defaulted(vm, arg_batch_size))
   {
     // usually want batch size default lower if verify on, so progress can be
@@ -700,7 +1024,13 @@ int main(int argc, char* argv[])
 
   if (command_line::has_arg(vm, arg_count_blocks))
   {
-    BootstrapFile bootstrap;
+    ChunkedBootstrapFile bootstrap;
+    if (ChunkedBootstrapFile::is_chunked(import_file_path))
+    {
+      if (!bootstrap.open_reader(import_file_path))
+        return 1;
+      return 0;
+    }
     bootstrap.count_blocks(import_file_path);
     return 0;
   }
@@ -740,6 +1070,19 @@ int main(int argc, char* argv[])
   MINFO("bootstrap file path: " << import_file_path);
   MINFO("database path:       " << m_config_folder);
 
+  if (opt_replay)
+  {
+    try
+    {
+      return replay_blocks(vm, import_file_path, replay_start, block_stop);
+    }
+    catch (const DB_ERROR& e)
+    {
+      std::cout << std::string("Error loading blockchain db: ") + e.what() + " -- shutting down now" << ENDL;
+      return 1;
+    }
+  }
+
   if (!opt_verify)
   {
     MCLOG_RED(el::Level::Warning, "global", "\n"
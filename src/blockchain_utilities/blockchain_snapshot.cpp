@@ -0,0 +1,194 @@
+#include <boost/filesystem.hpp>
+
+#include "common/command_line.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/blockchain_snapshot.h"
+#include "cryptonote_core/stake_transaction_processor.h"
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/db_types.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+
+// StakeTransactionProcessor::synchronize processes at most this number of blocks per call
+const uint64_t STAKE_SYNC_BLOCKS_PER_CALL = 10000;
+
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  std::string default_db_type = "lmdb";
+
+  std::string available_dbs = cryptonote::blockchain_db_types(", ");
+  available_dbs = "available: " + available_dbs;
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_output_dir = {"output-dir", "Specify the snapshot folder, which must not exist or be empty", ""};
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<std::string> arg_database = {
+    "database", available_dbs.c_str(), default_db_type
+  };
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, arg_output_dir);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_database);
+
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Graft '" << GRAFT_RELEASE_NAME << "' (v" << GRAFT_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("graft-blockchain-snapshot.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO,snapshot:INFO").c_str());
+
+  LOG_PRINT_L0("Starting...");
+
+  bool opt_testnet = command_line::get_arg(vm, cryptonote::arg_testnet_on);
+  bool opt_stagenet = command_line::get_arg(vm, cryptonote::arg_stagenet_on);
+  if (opt_testnet && opt_stagenet)
+  {
+    std::cerr << "Can't specify more than one of --testnet and --stagenet" << std::endl;
+    return 1;
+  }
+  const network_type nettype = opt_testnet ? cryptonote::TESTNET : opt_stagenet ? cryptonote::STAGENET : cryptonote::MAINNET;
+
+  std::string m_config_folder = command_line::get_arg(vm, cryptonote::arg_data_dir);
+
+  std::string db_type = command_line::get_arg(vm, arg_database);
+  if (!cryptonote::blockchain_valid_db_type(db_type))
+  {
+    std::cerr << "Invalid database type: " << db_type << std::endl;
+    return 1;
+  }
+
+  boost::filesystem::path output_dir;
+  if (command_line::has_arg(vm, arg_output_dir))
+    output_dir = boost::filesystem::path(command_line::get_arg(vm, arg_output_dir));
+  else
+    output_dir = boost::filesystem::path(m_config_folder) / "export" / "snapshot";
+  if (boost::filesystem::exists(output_dir) && !boost::filesystem::is_empty(output_dir))
+  {
+    std::cerr << "Snapshot folder " << output_dir.string() << " is not empty" << std::endl;
+    return 1;
+  }
+  LOG_PRINT_L0("Snapshot folder: " << output_dir.string());
+
+  // the snapshot stops at a block covered by the compiled-in block hashes,
+  // so the loading daemon can verify it without a trusted signer
+  const uint64_t covered_height = Blockchain::get_compiled_in_block_hashes_height(nettype);
+
+  std::unique_ptr<BlockchainDB> db(new_db(db_type));
+  if (!db)
+  {
+    LOG_ERROR("Attempted to use non-existent database type: " << db_type);
+    return 1;
+  }
+  const boost::filesystem::path source_folder = boost::filesystem::path(m_config_folder) / db->get_db_name();
+  const boost::filesystem::path target_folder = output_dir / db->get_db_name();
+
+  uint64_t snapshot_height = 0;
+  try
+  {
+    LOG_PRINT_L0("Loading blockchain from folder " << source_folder.string() << " ...");
+    db->open(source_folder.string(), DBF_RDONLY);
+    const uint64_t source_height = db->height();
+
+    if (covered_height)
+      snapshot_height = std::min(source_height, covered_height - 1) / HASH_OF_HASHES_STEP * HASH_OF_HASHES_STEP;
+    if (!snapshot_height)
+    {
+      LOG_ERROR("The blockchain has no blocks covered by the compiled-in block hashes");
+      return 1;
+    }
+
+    boost::filesystem::create_directories(target_folder);
+    db->copy_to(target_folder.string(), true);
+    db->close();
+
+    LOG_PRINT_L0("Rolling the copy back from height " << source_height << " to " << snapshot_height);
+    db.reset(new_db(db_type));
+    db->open(target_folder.string(), 0);
+    db->batch_start();
+    block popped_block;
+    std::vector<transaction> popped_txs;
+    while (db->height() > snapshot_height)
+      db->pop_block(popped_block, popped_txs);
+    db->batch_stop();
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR("Error copying the database: " << e.what());
+    return 1;
+  }
+
+  // If we wanted to use the memory pool, we would set up a fake_core.
+  Blockchain* core_storage = NULL;
+  tx_memory_pool m_mempool(*core_storage);
+  core_storage = new Blockchain(m_mempool);
+
+  r = core_storage->init(db.release(), nettype);
+  CHECK_AND_ASSERT_MES(r, 1, "Failed to initialize the snapshot blockchain storage");
+
+  const crypto::hash top_hash = core_storage->get_block_id_by_height(snapshot_height - 1);
+
+  // stake processing storages are rebuilt for the snapshot height rather than
+  // copied, the daemon's own ones are ahead of it
+  LOG_PRINT_L0("Building stake transaction storages...");
+  {
+    StakeTransactionProcessor processor(*core_storage);
+    processor.init_storages(output_dir.string());
+    for (uint64_t i = 0; i <= snapshot_height / STAKE_SYNC_BLOCKS_PER_CALL + 1; ++i)
+      processor.synchronize();
+  }
+
+  core_storage->deinit();
+  delete core_storage;
+
+  LOG_PRINT_L0("Writing snapshot manifest...");
+  write_snapshot_manifest(output_dir.string(), nettype, snapshot_height, top_hash);
+
+  LOG_PRINT_L0("Blockchain snapshot at height " << snapshot_height << " (top block " << top_hash << ") written OK");
+  return 0;
+
+  CATCH_ENTRY("Snapshot error", 1);
+}
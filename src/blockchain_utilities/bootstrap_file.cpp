@@ -112,7 +112,7 @@ bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
 }
 
 
-bool BootstrapFile::initialize_file()
+bool BootstrapFile::initialize_file(uint8_t major_version, uint8_t minor_version)
 {
   const uint32_t file_magic = blockchain_raw_magic;
 
@@ -124,8 +124,8 @@ bool BootstrapFile::initialize_file()
   *m_raw_data_file << blob;
 
   bootstrap::file_info bfi;
-  bfi.major_version = 0;
-  bfi.minor_version = 1;
+  bfi.major_version = major_version;
+  bfi.minor_version = minor_version;
   bfi.header_size = header_size;
 
   bootstrap::blocks_info bbi;
@@ -324,6 +324,12 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
 }
 
 uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file)
+{
+  uint8_t major_version;
+  return seek_to_first_chunk(import_file, major_version);
+}
+
+uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file, uint8_t& major_version)
 {
   uint32_t file_magic;
 
@@ -370,6 +376,7 @@ uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file)
 
   uint64_t full_header_size = sizeof(file_magic) + bfi.header_size;
   import_file.seekg(full_header_size);
+  major_version = bfi.major_version;
 
   return full_header_size;
 }
@@ -61,6 +61,7 @@ public:
   uint64_t count_blocks(const std::string& dir_path, std::streampos& start_pos, uint64_t& seek_height);
   uint64_t count_blocks(const std::string& dir_path);
   uint64_t seek_to_first_chunk(std::ifstream& import_file);
+  uint64_t seek_to_first_chunk(std::ifstream& import_file, uint8_t& major_version);
 
   bool store_blockchain_raw(cryptonote::Blockchain* cs, cryptonote::tx_memory_pool* txp,
       boost::filesystem::path& output_file, uint64_t use_block_height=0);
@@ -77,7 +78,7 @@ protected:
 
   // open export file for write
   bool open_writer(const boost::filesystem::path& file_path);
-  bool initialize_file();
+  bool initialize_file(uint8_t major_version = 0, uint8_t minor_version = 1);
   bool close();
   void write_block(block& block);
   void flush_chunk();
@@ -83,6 +83,43 @@ namespace cryptonote
       END_SERIALIZE()
     };
 
+    // chunked files (major version 1) hold independently compressed chunks of
+    // block packages, followed by an index of the chunks and a footer
+    struct chunk
+    {
+      std::vector<block_package> blocks;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(blocks)
+      END_SERIALIZE()
+    };
+
+    struct chunk_info
+    {
+      uint64_t block_first;
+      uint64_t num_blocks;
+
+      // file position and size of the compressed chunk
+      uint64_t offset;
+      uint64_t size;
+
+      BEGIN_SERIALIZE_OBJECT()
+        VARINT_FIELD(block_first);
+        VARINT_FIELD(num_blocks);
+        VARINT_FIELD(offset);
+        VARINT_FIELD(size);
+      END_SERIALIZE()
+    };
+
+    struct chunk_index
+    {
+      std::vector<chunk_info> chunks;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(chunks)
+      END_SERIALIZE()
+    };
+
   }
 
 }
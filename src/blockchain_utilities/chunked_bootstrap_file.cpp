@@ -0,0 +1,266 @@
+#include "misc_language.h"
+#include "chunked_bootstrap_file.h"
+#include "blockchain_db/lmdb/tx_blob_codec.h"
+#include "serialization/binary_utils.h" // dump_binary(), parse_binary()
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+using namespace cryptonote;
+
+namespace
+{
+  // footer of a chunked file: offset of the chunk index, then this magic
+  const uint32_t chunk_index_magic = 0x5c4e71d2;
+  const size_t footer_size = sizeof(uint64_t) + sizeof(uint32_t);
+
+  std::string refresh_string = "\r                                    \r";
+}
+
+constexpr uint8_t ChunkedBootstrapFile::MAJOR_VERSION;
+
+bool ChunkedBootstrapFile::is_chunked(const std::string& import_file_path)
+{
+  std::ifstream import_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+  if (import_file.fail())
+    return false;
+
+  try
+  {
+    BootstrapFile bootstrap;
+    uint8_t major_version;
+    bootstrap.seek_to_first_chunk(import_file, major_version);
+    return major_version == MAJOR_VERSION;
+  }
+  catch (const std::exception& e)
+  {
+    return false;
+  }
+}
+
+bool ChunkedBootstrapFile::make_chunk(uint64_t block_first, uint64_t num_blocks, std::string& record) const
+{
+  try
+  {
+    const BlockchainDB& db = m_blockchain_storage->get_db();
+    bootstrap::chunk c;
+    c.blocks.resize(num_blocks);
+
+    for (uint64_t i = 0; i < num_blocks; ++i)
+    {
+      const uint64_t height = block_first + i;
+      bootstrap::block_package& bp = c.blocks[i];
+
+      if (!parse_and_validate_block_from_blob(db.get_block_blob_from_height(height), bp.block))
+        throw std::runtime_error("Failed to parse block at height " + std::to_string(height));
+
+      for (const auto& tx_id : bp.block.tx_hashes)
+        bp.txs.push_back(db.get_tx(tx_id));
+
+      bp.block_weight = db.get_block_weight(height);
+      bp.cumulative_difficulty = db.get_block_cumulative_difficulty(height);
+      bp.coins_generated = db.get_block_already_generated_coins(height);
+    }
+
+    const blobdata bd = t_serializable_object_to_blob(c);
+    tx_blob_codec codec;
+    codec.encode(bd.data(), bd.size(), record);
+    return true;
+  }
+  catch (const std::exception& e)
+  {
+    MERROR("Failed to export chunk at height " << block_first << ": " << e.what());
+    return false;
+  }
+}
+
+bool ChunkedBootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_memory_pool* _tx_pool, boost::filesystem::path& output_file, uint64_t requested_block_stop)
+{
+  m_blockchain_storage = _blockchain_storage;
+  m_tx_pool = _tx_pool;
+  m_index.chunks.clear();
+
+  // chunks are not appended to, unlike plain bootstrap files
+  if (boost::filesystem::exists(output_file))
+  {
+    MFATAL("export file already exists: " << output_file);
+    return false;
+  }
+  const boost::filesystem::path dir_path = output_file.parent_path();
+  if (!dir_path.empty() && !boost::filesystem::exists(dir_path) && !boost::filesystem::create_directories(dir_path))
+  {
+    MFATAL("Failed to create directory " << dir_path);
+    return false;
+  }
+
+  std::unique_ptr<std::ofstream> raw_data_file(new std::ofstream(output_file.string(), std::ios_base::binary | std::ios_base::out | std::ios::trunc));
+  if (raw_data_file->fail())
+    return false;
+  m_raw_data_file = raw_data_file.get();
+  auto raw_data_file_reset = epee::misc_utils::create_scope_leave_handler([this]() { m_raw_data_file = nullptr; });
+  initialize_file(MAJOR_VERSION, 0);
+
+  const uint64_t height = m_blockchain_storage->get_current_blockchain_height();
+  const uint64_t block_stop = requested_block_stop > 0 && requested_block_stop < height ? requested_block_stop : height - 1;
+  MINFO("Storing blocks raw data in compressed chunks, up to height " << block_stop << (tx_blob_codec::available() ? "" : " (no zstd support, chunks are not compressed)"));
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t window = 2 * std::max(1u, tpool.get_max_concurrency());
+  uint64_t bytes_out = 0;
+
+  for (uint64_t block_first = 0; block_first <= block_stop; )
+  {
+    // build a window of chunks in parallel, then write them out in order
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (uint64_t h = block_first; h <= block_stop && ranges.size() < window; h += NUM_BLOCKS_PER_COMPRESSED_CHUNK)
+      ranges.emplace_back(h, std::min<uint64_t>(NUM_BLOCKS_PER_COMPRESSED_CHUNK, block_stop + 1 - h));
+
+    std::vector<std::string> records(ranges.size());
+    std::unique_ptr<bool[]> ok(new bool[ranges.size()]);
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < ranges.size(); ++i)
+      tpool.submit(&waiter, [&, i]() { ok[i] = make_chunk(ranges[i].first, ranges[i].second, records[i]); }, true);
+    waiter.wait(&tpool);
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      if (!ok[i])
+        return false;
+
+      bootstrap::chunk_info info;
+      info.block_first = ranges[i].first;
+      info.num_blocks = ranges[i].second;
+      info.offset = m_raw_data_file->tellp();
+      info.size = records[i].size();
+      m_raw_data_file->write(records[i].data(), records[i].size());
+      m_index.chunks.push_back(info);
+      bytes_out += records[i].size();
+    }
+    if (m_raw_data_file->fail())
+    {
+      MFATAL("Error writing chunks at height " << block_first);
+      return false;
+    }
+
+    block_first = ranges.back().first + ranges.back().second;
+    std::cout << refresh_string << "block " << block_first - 1 << "/" << block_stop << std::flush;
+  }
+  std::cout << ENDL;
+
+  std::string blob;
+  const uint64_t index_offset = m_raw_data_file->tellp();
+  const blobdata index = t_serializable_object_to_blob(m_index);
+  m_raw_data_file->write(index.data(), index.size());
+  if (! ::serialization::dump_binary(const_cast<uint64_t&>(index_offset), blob))
+    throw std::runtime_error("Error in serialization of chunk index offset");
+  *m_raw_data_file << blob;
+  if (! ::serialization::dump_binary(const_cast<uint32_t&>(chunk_index_magic), blob))
+    throw std::runtime_error("Error in serialization of chunk index magic");
+  *m_raw_data_file << blob;
+
+  m_raw_data_file->flush();
+  if (m_raw_data_file->fail())
+    return false;
+
+  MINFO("Number of blocks exported: " << block_stop + 1 << " in " << m_index.chunks.size() << " chunks, " << bytes_out << " bytes");
+  return true;
+}
+
+bool ChunkedBootstrapFile::open_reader(const std::string& import_file_path)
+{
+  m_import_file.open(import_file_path, std::ios_base::binary | std::ifstream::in);
+  if (m_import_file.fail())
+  {
+    MFATAL("import_file.open() fail");
+    return false;
+  }
+
+  try
+  {
+    uint8_t major_version;
+    const uint64_t full_header_size = seek_to_first_chunk(m_import_file, major_version);
+    if (major_version != MAJOR_VERSION)
+    {
+      MFATAL("not a chunked bootstrap file");
+      return false;
+    }
+
+    m_import_file.seekg(0, std::ios_base::end);
+    const uint64_t file_size = m_import_file.tellg();
+    if (file_size < full_header_size + footer_size)
+      throw std::runtime_error("File is too small for a chunk index");
+
+    std::string footer(footer_size, '\0');
+    m_import_file.seekg(file_size - footer_size);
+    m_import_file.read(&footer[0], footer.size());
+
+    uint64_t index_offset;
+    uint32_t magic;
+    if (!m_import_file || ! ::serialization::parse_binary(footer.substr(0, sizeof(index_offset)), index_offset)
+        || ! ::serialization::parse_binary(footer.substr(sizeof(index_offset)), magic) || magic != chunk_index_magic)
+      throw std::runtime_error("Chunk index footer not found, the file may be truncated");
+    if (index_offset < full_header_size || index_offset > file_size - footer_size)
+      throw std::runtime_error("Invalid chunk index offset");
+
+    std::string index(file_size - footer_size - index_offset, '\0');
+    m_import_file.seekg(index_offset);
+    m_import_file.read(&index[0], index.size());
+    if (!m_import_file || ! ::serialization::parse_binary(index, m_index))
+      throw std::runtime_error("Error in deserialization of the chunk index");
+
+    for (const auto& info : m_index.chunks)
+      if (info.offset < full_header_size || info.size > index_offset || info.offset > index_offset - info.size || !info.num_blocks)
+        throw std::runtime_error("Invalid chunk in the chunk index");
+  }
+  catch (const std::exception& e)
+  {
+    MFATAL("Failed to read bootstrap file: " << e.what());
+    return false;
+  }
+
+  MINFO("chunked bootstrap file: " << m_index.chunks.size() << " chunks, " << count_blocks() << " blocks");
+  return true;
+}
+
+uint64_t ChunkedBootstrapFile::count_blocks() const
+{
+  return m_index.chunks.empty() ? 0 : m_index.chunks.back().block_first + m_index.chunks.back().num_blocks;
+}
+
+void ChunkedBootstrapFile::read_chunks(size_t first, size_t count, std::vector<bootstrap::chunk>& chunks, tools::threadpool::waiter& waiter)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  chunks.clear();
+  chunks.resize(count);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const bootstrap::chunk_info& info = m_index.chunks[first + i];
+    std::string record(info.size, '\0');
+    m_import_file.seekg(info.offset);
+    m_import_file.read(&record[0], record.size());
+    if (!m_import_file)
+    {
+      MERROR("Failed to read chunk at height " << info.block_first);
+      m_import_file.clear();
+      continue;
+    }
+
+    bootstrap::chunk& c = chunks[i];
+    tpool.submit(&waiter, [record, &c]() {
+      try
+      {
+        tx_blob_codec codec;
+        blobdata bd;
+        codec.decode_append(record.data(), record.size(), bd);
+        if (! ::serialization::parse_binary(bd, c))
+          c.blocks.clear();
+      }
+      catch (const std::exception& e)
+      {
+        MERROR("Failed to decompress chunk: " << e.what());
+        c.blocks.clear();
+      }
+    }, true);
+  }
+}
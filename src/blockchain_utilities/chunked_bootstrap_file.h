@@ -0,0 +1,48 @@
+#pragma once
+
+#include "bootstrap_file.h"
+#include "bootstrap_serialization.h"
+#include "common/threadpool.h"
+
+/**
+ * @brief Bootstrap file of independently compressed chunks
+ *
+ * After the usual header (with major version 1) come chunks of
+ * NUM_BLOCKS_PER_COMPRESSED_CHUNK block packages, each compressed on its own
+ * with zstd when it is built in, then a bootstrap::chunk_index and a footer
+ * pointing to it. Chunks are built and parsed on the thread pool, while the file
+ * is written and read sequentially.
+ */
+class ChunkedBootstrapFile : public BootstrapFile
+{
+public:
+  static constexpr uint8_t MAJOR_VERSION = 1;
+
+  /// whether the file at import_file_path is a chunked bootstrap file
+  static bool is_chunked(const std::string& import_file_path);
+
+  bool store_blockchain_raw(cryptonote::Blockchain* cs, cryptonote::tx_memory_pool* txp,
+      boost::filesystem::path& output_file, uint64_t use_block_height=0);
+
+  /// open a chunked file and load its index
+  bool open_reader(const std::string& import_file_path);
+
+  const std::vector<cryptonote::bootstrap::chunk_info>& get_chunks() const { return m_index.chunks; }
+  using BootstrapFile::count_blocks;
+  uint64_t count_blocks() const;
+
+  /**
+   * @brief read chunks [first, first + count) and parse them on the thread pool
+   *
+   * The compressed chunks are read on the calling thread. chunks must stay
+   * untouched until waiter is done; a chunk that fails to decompress or parse
+   * is left with no blocks.
+   */
+  void read_chunks(size_t first, size_t count, std::vector<cryptonote::bootstrap::chunk>& chunks, tools::threadpool::waiter& waiter);
+
+private:
+  bool make_chunk(uint64_t block_first, uint64_t num_blocks, std::string& record) const;
+
+  std::ifstream m_import_file;
+  cryptonote::bootstrap::chunk_index m_index;
+};
@@ -0,0 +1,317 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <fstream>
+#include <boost/filesystem/operations.hpp>
+#include "columnar_export.h"
+#include "common/int-util.h"
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+using namespace cryptonote;
+
+namespace
+{
+  const uint64_t BLOCKS_PER_RANGE = 1000;
+
+  std::string refresh_string = "\r                                    \r";
+
+  // the columns of a range of blocks, as built by the thread pool
+  struct column_block
+  {
+    std::vector<uint64_t> tx_height;
+    std::vector<crypto::hash> tx_hash;
+    std::vector<uint8_t> tx_version;
+    std::vector<uint8_t> tx_coinbase;
+    std::vector<uint8_t> tx_rta;
+    std::vector<uint8_t> tx_stake;
+    std::vector<uint32_t> tx_inputs;
+    std::vector<uint32_t> tx_outputs;
+    std::vector<uint32_t> tx_ring_size;
+    std::vector<uint64_t> tx_fee;
+    std::vector<uint64_t> tx_unlock_time;
+
+    std::vector<uint64_t> out_height;
+    std::vector<uint64_t> out_tx; // row of the tx within this block, until written
+    std::vector<uint64_t> out_amount;
+    std::vector<uint64_t> out_amount_index;
+  };
+
+  struct column_file
+  {
+    std::string name;
+    std::string type;
+    std::unique_ptr<std::ofstream> file;
+    uint64_t rows;
+  };
+
+  class column_set
+  {
+  public:
+    column_set(const boost::filesystem::path& dir): m_dir(dir) {}
+
+    void append(const std::string& name, const std::vector<uint64_t>& values)
+    {
+      std::vector<uint64_t> le(values.size());
+      for (size_t i = 0; i < values.size(); ++i)
+        le[i] = SWAP64LE(values[i]);
+      write(name, "u64", le.data(), le.size() * sizeof(uint64_t), values.size());
+    }
+    void append(const std::string& name, const std::vector<uint32_t>& values)
+    {
+      std::vector<uint32_t> le(values.size());
+      for (size_t i = 0; i < values.size(); ++i)
+        le[i] = SWAP32LE(values[i]);
+      write(name, "u32", le.data(), le.size() * sizeof(uint32_t), values.size());
+    }
+    void append(const std::string& name, const std::vector<uint8_t>& values)
+    {
+      write(name, "u8", values.data(), values.size(), values.size());
+    }
+    void append(const std::string& name, const std::vector<crypto::hash>& values)
+    {
+      write(name, "bytes32", values.data(), values.size() * sizeof(crypto::hash), values.size());
+    }
+
+    bool good() const
+    {
+      for (const column_file& c : m_columns)
+        if (!c.file->good())
+          return false;
+      return true;
+    }
+
+    bool close()
+    {
+      std::ofstream schema((m_dir / "schema.txt").string(), std::ios_base::out | std::ios::trunc);
+      for (column_file& c : m_columns)
+      {
+        c.file->close();
+        schema << c.name << " " << c.type << " " << c.rows << std::endl;
+      }
+      schema.close();
+      return !schema.fail() && good();
+    }
+
+  private:
+    // columns are opened in the order they are first appended to
+    void write(const std::string& name, const char* type, const void* data, size_t size, uint64_t rows)
+    {
+      auto it = std::find_if(m_columns.begin(), m_columns.end(), [&name](const column_file& c) { return c.name == name; });
+      if (it == m_columns.end())
+      {
+        column_file c;
+        c.name = name;
+        c.type = type;
+        c.rows = 0;
+        c.file.reset(new std::ofstream((m_dir / (name + ".bin")).string(), std::ios_base::binary | std::ios_base::out | std::ios::trunc));
+        m_columns.push_back(std::move(c));
+        it = m_columns.end() - 1;
+      }
+      it->file->write(static_cast<const char*>(data), size);
+      it->rows += rows;
+    }
+
+    boost::filesystem::path m_dir;
+    std::vector<column_file> m_columns;
+  };
+
+  void add_tx(const BlockchainDB& db, uint64_t height, const crypto::hash& txid, const transaction& tx, column_block& b)
+  {
+    const bool coinbase = tx.vin.size() == 1 && tx.vin[0].type() == typeid(txin_gen);
+    size_t ring_size = 0;
+    for (const auto& in : tx.vin)
+      if (in.type() == typeid(txin_to_key))
+        ring_size = std::max(ring_size, boost::get<txin_to_key>(in).key_offsets.size());
+
+    // a partly parsed extra still has the fields up to where it failed
+    std::vector<tx_extra_field> fields;
+    parse_tx_extra(tx.extra, fields);
+    bool rta = false, stake = false;
+    for (const auto& field : fields)
+    {
+      rta |= field.type() == typeid(tx_extra_graft_rta_header);
+      stake |= field.type() == typeid(tx_extra_graft_stake_tx);
+    }
+
+    uint64_t tx_id;
+    if (!db.tx_exists(txid, tx_id))
+      throw std::runtime_error("Tx " + epee::string_tools::pod_to_hex(txid) + " not found");
+    const std::vector<uint64_t> indices = db.get_tx_amount_output_indices(tx_id);
+    if (indices.size() != tx.vout.size())
+      throw std::runtime_error("Bad output indices for tx " + epee::string_tools::pod_to_hex(txid));
+
+    const uint64_t row = b.tx_height.size();
+    b.tx_height.push_back(height);
+    b.tx_hash.push_back(txid);
+    b.tx_version.push_back(tx.version);
+    b.tx_coinbase.push_back(coinbase);
+    b.tx_rta.push_back(rta);
+    b.tx_stake.push_back(stake);
+    b.tx_inputs.push_back(tx.vin.size());
+    b.tx_outputs.push_back(tx.vout.size());
+    b.tx_ring_size.push_back(ring_size);
+    b.tx_fee.push_back(coinbase ? 0 : get_tx_fee(tx));
+    b.tx_unlock_time.push_back(tx.unlock_time);
+
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+    {
+      b.out_height.push_back(height);
+      b.out_tx.push_back(row);
+      b.out_amount.push_back(tx.vout[i].amount);
+      b.out_amount_index.push_back(indices[i]);
+    }
+  }
+
+  bool make_block(const BlockchainDB& db, uint64_t block_first, uint64_t num_blocks, column_block& b)
+  {
+    try
+    {
+      db_rtxn_guard rtxn_guard(db);
+      for (uint64_t height = block_first; height < block_first + num_blocks; ++height)
+      {
+        block blk;
+        if (!parse_and_validate_block_from_blob(db.get_block_blob_from_height(height), blk))
+          throw std::runtime_error("Failed to parse block at height " + std::to_string(height));
+        add_tx(db, height, get_transaction_hash(blk.miner_tx), blk.miner_tx, b);
+
+        // the prunable part holds nothing the columns need, so it is never read
+        for (const crypto::hash& txid : blk.tx_hashes)
+        {
+          blobdata bd;
+          if (!db.get_pruned_tx_blob(txid, bd))
+            throw std::runtime_error("Tx " + epee::string_tools::pod_to_hex(txid) + " not found");
+          transaction tx;
+          if (!parse_and_validate_tx_base_from_blob(bd, tx))
+            throw std::runtime_error("Failed to parse tx " + epee::string_tools::pod_to_hex(txid));
+          add_tx(db, height, txid, tx, b);
+        }
+      }
+      return true;
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Failed to export blocks at height " << block_first << ": " << e.what());
+      return false;
+    }
+  }
+
+  void write_block(column_set& columns, const column_block& b)
+  {
+    columns.append("tx_height", b.tx_height);
+    columns.append("tx_hash", b.tx_hash);
+    columns.append("tx_version", b.tx_version);
+    columns.append("tx_coinbase", b.tx_coinbase);
+    columns.append("tx_rta", b.tx_rta);
+    columns.append("tx_stake", b.tx_stake);
+    columns.append("tx_inputs", b.tx_inputs);
+    columns.append("tx_outputs", b.tx_outputs);
+    columns.append("tx_ring_size", b.tx_ring_size);
+    columns.append("tx_fee", b.tx_fee);
+    columns.append("tx_unlock_time", b.tx_unlock_time);
+    columns.append("out_height", b.out_height);
+    columns.append("out_tx", b.out_tx);
+    columns.append("out_amount", b.out_amount);
+    columns.append("out_amount_index", b.out_amount_index);
+  }
+}
+
+bool ColumnarExport::store_blockchain_raw(Blockchain* _blockchain_storage, tx_memory_pool* _tx_pool, boost::filesystem::path& output_dir, uint64_t requested_block_stop)
+{
+  if (boost::filesystem::exists(output_dir) && !boost::filesystem::is_empty(output_dir))
+  {
+    MFATAL("export directory already exists and is not empty: " << output_dir);
+    return false;
+  }
+  if (!boost::filesystem::exists(output_dir) && !boost::filesystem::create_directories(output_dir))
+  {
+    MFATAL("Failed to create directory " << output_dir);
+    return false;
+  }
+
+  const BlockchainDB& db = _blockchain_storage->get_db();
+  const uint64_t height = _blockchain_storage->get_current_blockchain_height();
+  const uint64_t block_stop = requested_block_stop > 0 && requested_block_stop < height ? requested_block_stop : height - 1;
+  MINFO("Storing tx and output columns, up to height " << block_stop);
+
+  column_set columns(output_dir);
+  // an empty block opens every column, in order
+  write_block(columns, column_block());
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t window = 2 * std::max(1u, tpool.get_max_concurrency());
+  uint64_t tx_rows = 0, out_rows = 0;
+
+  for (uint64_t block_first = 0; block_first <= block_stop; )
+  {
+    // build a window of ranges in parallel, then append them in order
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (uint64_t h = block_first; h <= block_stop && ranges.size() < window; h += BLOCKS_PER_RANGE)
+      ranges.emplace_back(h, std::min<uint64_t>(BLOCKS_PER_RANGE, block_stop + 1 - h));
+
+    std::vector<column_block> blocks(ranges.size());
+    std::unique_ptr<bool[]> ok(new bool[ranges.size()]);
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < ranges.size(); ++i)
+      tpool.submit(&waiter, [&, i]() { ok[i] = make_block(db, ranges[i].first, ranges[i].second, blocks[i]); }, true);
+    waiter.wait(&tpool);
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      if (!ok[i])
+        return false;
+      for (uint64_t& row : blocks[i].out_tx)
+        row += tx_rows;
+      write_block(columns, blocks[i]);
+      tx_rows += blocks[i].tx_height.size();
+      out_rows += blocks[i].out_height.size();
+    }
+    if (!columns.good())
+    {
+      MFATAL("Error writing columns at height " << block_first);
+      return false;
+    }
+
+    block_first = ranges.back().first + ranges.back().second;
+    std::cout << refresh_string << "block " << block_first - 1 << "/" << block_stop << std::flush;
+  }
+  std::cout << ENDL;
+
+  if (!columns.close())
+  {
+    MFATAL("Error closing columns");
+    return false;
+  }
+
+  MINFO("Number of blocks exported: " << block_stop + 1 << ", " << tx_rows << " txes, " << out_rows << " outputs");
+  return true;
+}
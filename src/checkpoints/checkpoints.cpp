@@ -225,6 +225,24 @@ namespace cryptonote
     return true;
   }
 
+  bool checkpoints::save_checkpoints_to_json(const std::string &json_hashfile_fullpath) const
+  {
+    t_hash_json hashes;
+    for (const auto &pt: m_points)
+    {
+      t_hashline line;
+      line.height = pt.first;
+      line.hash = epee::string_tools::pod_to_hex(pt.second);
+      hashes.hashlines.push_back(line);
+    }
+    if (!epee::serialization::store_t_to_json_file(hashes, json_hashfile_fullpath))
+    {
+      MERROR("Error saving checkpoints to " << json_hashfile_fullpath);
+      return false;
+    }
+    return true;
+  }
+
   bool checkpoints::load_checkpoints_from_dns(network_type nettype)
   {
     std::vector<std::string> records;
@@ -177,6 +177,15 @@ namespace cryptonote
      */
     bool load_checkpoints_from_json(const std::string &json_hashfile_fullpath);
 
+    /**
+     * @brief save the checkpoints to json, in the format read by load_checkpoints_from_json
+     *
+     * @param json_hashfile_fullpath path to the json checkpoints file
+     *
+     * @return true if the file was written
+     */
+    bool save_checkpoints_to_json(const std::string &json_hashfile_fullpath) const;
+
     /**
      * @brief load new checkpoints from DNS
      *
@@ -31,6 +31,7 @@
 #include "base58.h"
 
 #include <assert.h>
+#include <string.h>
 #include <string>
 #include <vector>
 
@@ -56,25 +57,23 @@ namespace tools
       {
         reverse_alphabet()
         {
-          m_data.resize(alphabet[alphabet_size - 1] - alphabet[0] + 1, -1);
+          memset(m_data, -1, sizeof(m_data));
 
           for (size_t i = 0; i < alphabet_size; ++i)
           {
-            size_t idx = static_cast<size_t>(alphabet[i] - alphabet[0]);
-            m_data[idx] = static_cast<int8_t>(i);
+            m_data[static_cast<uint8_t>(alphabet[i])] = static_cast<int8_t>(i);
           }
         }
 
         int operator()(char letter) const
         {
-          size_t idx = static_cast<size_t>(letter - alphabet[0]);
-          return idx < m_data.size() ? m_data[idx] : -1;
+          return m_data[static_cast<uint8_t>(letter)];
         }
 
         static reverse_alphabet instance;
 
       private:
-        std::vector<int8_t> m_data;
+        int8_t m_data[256];
       };
 
       reverse_alphabet reverse_alphabet::instance;
@@ -133,11 +132,33 @@ namespace tools
         memcpy(data, reinterpret_cast<uint8_t*>(&num_be) + sizeof(uint64_t) - size, size);
       }
 
+      // 58^5 fits 32 bits and 2^64 < 58^11, so a full block is two groups of five digits, computed
+      // with 32 bit arithmetic, and a last digit
+      const uint32_t alphabet_size_pow5 = 656356768;
+
+      void encode_digits(uint32_t num, char* res)
+      {
+        for (int i = 4; 0 <= i; --i)
+        {
+          res[i] = alphabet[num % alphabet_size];
+          num /= alphabet_size;
+        }
+      }
+
       void encode_block(const char* block, size_t size, char* res)
       {
         assert(1 <= size && size <= full_block_size);
 
         uint64_t num = uint_8be_to_64(reinterpret_cast<const uint8_t*>(block), size);
+        if (size == full_block_size)
+        {
+          encode_digits(static_cast<uint32_t>(num % alphabet_size_pow5), res + 6);
+          num /= alphabet_size_pow5;
+          encode_digits(static_cast<uint32_t>(num % alphabet_size_pow5), res + 1);
+          res[0] = alphabet[num / alphabet_size_pow5];
+          return;
+        }
+
         int i = static_cast<int>(encoded_block_sizes[size]) - 1;
         while (0 < num)
         {
@@ -156,22 +177,25 @@ namespace tools
         if (res_size <= 0)
           return false; // Invalid block size
 
+        // All but the last digit never overflow, 58^10 < 2^64
         uint64_t res_num = 0;
-        uint64_t order = 1;
-        for (size_t i = size - 1; i < size; --i)
+        for (size_t i = 0; i + 1 < size; ++i)
         {
           int digit = reverse_alphabet::instance(block[i]);
           if (digit < 0)
             return false; // Invalid symbol
+          res_num = res_num * alphabet_size + digit;
+        }
 
-          uint64_t product_hi;
-          uint64_t tmp = res_num + mul128(order, digit, &product_hi);
-          if (tmp < res_num || 0 != product_hi)
-            return false; // Overflow
+        int digit = reverse_alphabet::instance(block[size - 1]);
+        if (digit < 0)
+          return false; // Invalid symbol
 
-          res_num = tmp;
-          order *= alphabet_size; // Never overflows, 58^10 < 2^64
-        }
+        uint64_t product_hi;
+        uint64_t product = mul128(res_num, alphabet_size, &product_hi);
+        res_num = product + digit;
+        if (0 != product_hi || res_num < product)
+          return false; // Overflow
 
         if (static_cast<size_t>(res_size) < full_block_size && (UINT64_C(1) << (8 * res_size)) <= res_num)
           return false; // Overflow
@@ -239,7 +263,9 @@ namespace tools
 
     std::string encode_addr(uint64_t tag, const std::string& data)
     {
-      std::string buf = get_varint_data(tag);
+      std::string buf;
+      buf.reserve((sizeof(tag) * 8 + 6) / 7 + data.size() + addr_checksum_size);
+      buf = get_varint_data(tag);
       buf += data;
       crypto::hash hash = crypto::cn_fast_hash(buf.data(), buf.size());
       const char* hash_data = reinterpret_cast<const char*>(&hash);
@@ -254,18 +280,15 @@ namespace tools
       if (!r) return false;
       if (addr_data.size() <= addr_checksum_size) return false;
 
-      std::string checksum(addr_checksum_size, '\0');
-      checksum = addr_data.substr(addr_data.size() - addr_checksum_size);
-
-      addr_data.resize(addr_data.size() - addr_checksum_size);
-      crypto::hash hash = crypto::cn_fast_hash(addr_data.data(), addr_data.size());
-      std::string expected_checksum(reinterpret_cast<const char*>(&hash), addr_checksum_size);
-      if (expected_checksum != checksum) return false;
+      const size_t payload_size = addr_data.size() - addr_checksum_size;
+      crypto::hash hash = crypto::cn_fast_hash(addr_data.data(), payload_size);
+      if (memcmp(&hash, addr_data.data() + payload_size, addr_checksum_size)) return false;
 
+      addr_data.resize(payload_size);
       int read = tools::read_varint(addr_data.begin(), addr_data.end(), tag);
       if (read <= 0) return false;
 
-      data = addr_data.substr(read);
+      data.assign(addr_data, read, std::string::npos);
       return true;
     }
   }
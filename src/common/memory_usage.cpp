@@ -0,0 +1,104 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include "memory_usage.h"
+
+namespace
+{
+  struct registry
+  {
+    std::mutex mutex;
+    std::vector<const tools::memory::account*> accounts;
+  };
+
+  registry &get_registry()
+  {
+    static registry r;
+    return r;
+  }
+}
+
+namespace tools
+{
+namespace memory
+{
+  account::account(const char *subsystem, probe p): m_subsystem(subsystem), m_probe(std::move(p)), m_gauge(*this)
+  {
+    registry &r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.accounts.push_back(this);
+  }
+
+  account::~account()
+  {
+    registry &r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.accounts.erase(std::remove(r.accounts.begin(), r.accounts.end(), this), r.accounts.end());
+  }
+
+  uint64_t account::value() const
+  {
+    uint64_t bytes;
+    if (m_probe && m_probe(bytes))
+      m_probed.store(bytes, std::memory_order_relaxed);
+    return m_tracked.load(std::memory_order_relaxed) + m_probed.load(std::memory_order_relaxed);
+  }
+
+  account::gauge::gauge(const account &a):
+    metric("graft_memory_bytes", "Memory used by each subsystem", GAUGE, std::string("subsystem=\"") + a.subsystem() + "\""), m_account(a)
+  {
+  }
+
+  void account::gauge::write(std::ostream &out) const
+  {
+    out << name() << '{' << labels() << "} " << m_account.value() << '\n';
+  }
+
+  std::vector<stat> get_stats()
+  {
+    registry &r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::vector<stat> stats;
+    for (const account *a: r.accounts)
+    {
+      const uint64_t bytes = a->value();
+      auto it = std::find_if(stats.begin(), stats.end(), [a](const stat &s) { return s.subsystem == a->subsystem(); });
+      if (it == stats.end())
+        stats.push_back({a->subsystem(), bytes});
+      else
+        it->bytes += bytes;
+    }
+    std::sort(stats.begin(), stats.end(), [](const stat &a, const stat &b) { return a.subsystem < b.subsystem; });
+    return stats;
+  }
+}
+}
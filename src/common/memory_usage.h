@@ -0,0 +1,111 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "metrics.h"
+
+namespace tools
+{
+namespace memory
+{
+  //! Memory used by a subsystem, written as the graft_memory_bytes gauge labelled with the
+  //! subsystem and listed by get_stats(). It is what the subsystem adds and subtracts around its
+  //! allocations plus what its probe, if it has one, measures when read: containers which are not
+  //! worth instrumenting are measured from their sizes.
+  //!
+  //! Probes run under the registry locks, so a probe must not wait for a lock of its subsystem:
+  //! it returns false if it can't take it right away, and the last value is reported. An account
+  //! which is a member of what it measures is declared after what it measures, so it is
+  //! unregistered before those are destroyed.
+  class account
+  {
+  public:
+    typedef std::function<bool(uint64_t &bytes)> probe;
+
+    explicit account(const char *subsystem, probe p = probe());
+    ~account();
+    account(const account&) = delete;
+    account &operator=(const account&) = delete;
+
+    void add(uint64_t bytes) { m_tracked.fetch_add(bytes, std::memory_order_relaxed); }
+    void sub(uint64_t bytes) { m_tracked.fetch_sub(bytes, std::memory_order_relaxed); }
+
+    const char *subsystem() const { return m_subsystem; }
+    uint64_t value() const;
+
+  private:
+    class gauge: public metrics::metric
+    {
+    public:
+      gauge(const account &a);
+      void write(std::ostream &out) const override;
+
+    private:
+      const account &m_account;
+    };
+
+    const char *m_subsystem;
+    probe m_probe;
+    std::atomic<uint64_t> m_tracked{0};
+    mutable std::atomic<uint64_t> m_probed{0};
+    gauge m_gauge; // last, so it is unregistered before the rest is destroyed
+  };
+
+  struct stat
+  {
+    std::string subsystem;
+    uint64_t bytes;
+  };
+
+  //! Memory of all subsystems, accounts of the same subsystem added up, by subsystem name
+  std::vector<stat> get_stats();
+
+  // Estimates of the heap memory held by standard containers, not counting what their elements
+  // point to. Nodes are taken to carry three pointers of links and the allocator's header.
+  static constexpr uint64_t NODE_OVERHEAD = 4 * sizeof(void*);
+
+  inline uint64_t string_bytes(const std::string &s) { return s.capacity() > 15 ? s.capacity() + 1 : 0; }
+
+  template<typename T>
+  uint64_t vector_bytes(const std::vector<T> &v) { return v.capacity() * sizeof(T); }
+
+  //! list, set, map and their multi versions
+  template<typename C>
+  uint64_t node_bytes(const C &c) { return c.size() * (sizeof(typename C::value_type) + NODE_OVERHEAD); }
+
+  //! unordered set and map, a node per element and a pointer per bucket
+  template<typename C>
+  uint64_t hash_bytes(const C &c) { return c.size() * (sizeof(typename C::value_type) + NODE_OVERHEAD) + c.bucket_count() * sizeof(void*); }
+}
+}
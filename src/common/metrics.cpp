@@ -0,0 +1,205 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include "metrics.h"
+
+namespace
+{
+  struct registry
+  {
+    std::mutex mutex;
+    std::vector<tools::metrics::metric*> metrics;
+  };
+
+  registry &get_registry()
+  {
+    static registry r;
+    return r;
+  }
+
+  std::atomic<size_t> next_shard(0);
+
+  void write_seconds(std::ostream &out, uint64_t micros)
+  {
+    out << micros / 1000000 << '.' << std::setw(6) << std::setfill('0') << micros % 1000000 << std::setfill(' ');
+  }
+
+  void write_name(std::ostream &out, const char *name, const char *suffix, const std::string &labels)
+  {
+    out << name << suffix;
+    if (!labels.empty())
+      out << '{' << labels << '}';
+    out << ' ';
+  }
+}
+
+namespace tools
+{
+namespace metrics
+{
+  size_t get_shard()
+  {
+    static thread_local const size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    return shard;
+  }
+
+  metric::metric(const char *name, const char *help, type t, std::string labels): m_name(name), m_help(help), m_type(t), m_labels(std::move(labels))
+  {
+    registry &r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.metrics.push_back(this);
+  }
+
+  metric::~metric()
+  {
+    registry &r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.metrics.erase(std::remove(r.metrics.begin(), r.metrics.end(), this), r.metrics.end());
+  }
+
+  counter::counter(const char *name, const char *help, std::string labels): metric(name, help, COUNTER, std::move(labels))
+  {
+  }
+
+  uint64_t counter::value() const
+  {
+    uint64_t v = 0;
+    for (const shard &s: m_shards)
+      v += s.value.load(std::memory_order_relaxed);
+    return v;
+  }
+
+  void counter::write(std::ostream &out) const
+  {
+    write_name(out, name(), "", labels());
+    out << value() << '\n';
+  }
+
+  gauge::gauge(const char *name, const char *help, std::string labels): metric(name, help, GAUGE, std::move(labels))
+  {
+  }
+
+  void gauge::write(std::ostream &out) const
+  {
+    write_name(out, name(), "", labels());
+    out << value() << '\n';
+  }
+
+  constexpr size_t histogram::BUCKETS_COUNT;
+  const std::array<uint64_t, histogram::BUCKETS_COUNT> histogram::BUCKET_BOUNDS_MICROS = {{
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000, 250000, 1000000, 5000000, 30000000
+  }};
+
+  histogram::histogram(const char *name, const char *help, std::string labels): metric(name, help, HISTOGRAM, std::move(labels))
+  {
+  }
+
+  void histogram::observe(uint64_t micros)
+  {
+    const size_t bucket = std::lower_bound(BUCKET_BOUNDS_MICROS.begin(), BUCKET_BOUNDS_MICROS.end(), micros) - BUCKET_BOUNDS_MICROS.begin();
+    shard &s = m_shards[get_shard()];
+    s.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    s.sum_micros.fetch_add(micros, std::memory_order_relaxed);
+  }
+
+  uint64_t histogram::count() const
+  {
+    uint64_t n = 0;
+    for (const shard &s: m_shards)
+      for (const auto &bucket: s.buckets)
+        n += bucket.load(std::memory_order_relaxed);
+    return n;
+  }
+
+  uint64_t histogram::sum_micros() const
+  {
+    uint64_t sum = 0;
+    for (const shard &s: m_shards)
+      sum += s.sum_micros.load(std::memory_order_relaxed);
+    return sum;
+  }
+
+  void histogram::write(std::ostream &out) const
+  {
+    const std::string bucket_labels = labels().empty() ? std::string() : labels() + ",";
+    uint64_t cumulative_count = 0;
+    for (size_t i = 0; i <= BUCKETS_COUNT; ++i)
+    {
+      for (const shard &s: m_shards)
+        cumulative_count += s.buckets[i].load(std::memory_order_relaxed);
+      out << name() << "_bucket{" << bucket_labels << "le=\"";
+      if (i < BUCKETS_COUNT)
+        write_seconds(out, BUCKET_BOUNDS_MICROS[i]);
+      else
+        out << "+Inf";
+      out << "\"} " << cumulative_count << '\n';
+    }
+
+    write_name(out, name(), "_sum", labels());
+    write_seconds(out, sum_micros());
+    out << '\n';
+
+    write_name(out, name(), "_count", labels());
+    out << cumulative_count << '\n';
+  }
+
+  void write(std::ostream &out)
+  {
+    static const char *type_names[] = { "counter", "gauge", "histogram" };
+
+    registry &r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::vector<const metric*> metrics(r.metrics.begin(), r.metrics.end());
+    std::stable_sort(metrics.begin(), metrics.end(), [](const metric *a, const metric *b) { return strcmp(a->name(), b->name()) < 0; });
+
+    const char *last_name = NULL;
+    for (const metric *m: metrics)
+    {
+      if (!last_name || strcmp(last_name, m->name()))
+      {
+        out << "# HELP " << m->name() << ' ' << m->help() << '\n';
+        out << "# TYPE " << m->name() << ' ' << type_names[m->get_type()] << '\n';
+        last_name = m->name();
+      }
+      m->write(out);
+    }
+  }
+
+  std::string get()
+  {
+    std::ostringstream out;
+    write(out);
+    return out.str();
+  }
+}
+}
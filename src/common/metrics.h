@@ -0,0 +1,179 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace tools
+{
+namespace metrics
+{
+  //! Process wide counters, gauges and histograms written by write() in the Prometheus text
+  //! format. Metrics register themselves when constructed, usually as statics next to the code
+  //! they measure, and unregister when destroyed.
+  //!
+  //! Updates go to one of SHARDS cache line sized slots picked per thread, so threads updating
+  //! the same metric don't contend on it; reading sums the slots.
+
+  static constexpr size_t SHARDS = 8;
+
+  size_t get_shard();
+
+  class metric
+  {
+  public:
+    enum type { COUNTER, GAUGE, HISTOGRAM };
+
+    //! labels are either empty or a comma separated list of label="value"
+    metric(const char *name, const char *help, type t, std::string labels);
+    virtual ~metric();
+    metric(const metric&) = delete;
+    metric &operator=(const metric&) = delete;
+
+    const char *name() const { return m_name; }
+    const char *help() const { return m_help; }
+    type get_type() const { return m_type; }
+    const std::string &labels() const { return m_labels; }
+
+    //! Writes the samples, without the HELP and TYPE lines
+    virtual void write(std::ostream &out) const = 0;
+
+  private:
+    const char *m_name;
+    const char *m_help;
+    type m_type;
+    std::string m_labels;
+  };
+
+  class counter: public metric
+  {
+  public:
+    counter(const char *name, const char *help, std::string labels = std::string());
+
+    void inc(uint64_t n = 1) { m_shards[get_shard()].value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const;
+
+    void write(std::ostream &out) const override;
+
+  private:
+    struct alignas(64) shard { std::atomic<uint64_t> value{0}; };
+    std::array<shard, SHARDS> m_shards;
+  };
+
+  class gauge: public metric
+  {
+  public:
+    gauge(const char *name, const char *help, std::string labels = std::string());
+
+    void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+    void add(int64_t v) { m_value.fetch_add(v, std::memory_order_relaxed); }
+    int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+    void write(std::ostream &out) const override;
+
+  private:
+    std::atomic<int64_t> m_value{0};
+  };
+
+  //! Latency histogram, observations and bucket bounds in microseconds, written in seconds
+  class histogram: public metric
+  {
+  public:
+    static constexpr size_t BUCKETS_COUNT = 14;
+    static const std::array<uint64_t, BUCKETS_COUNT> BUCKET_BOUNDS_MICROS;
+
+    histogram(const char *name, const char *help, std::string labels = std::string());
+
+    void observe(uint64_t micros);
+    uint64_t count() const;
+    uint64_t sum_micros() const;
+
+    void write(std::ostream &out) const override;
+
+    //! Observes the time until it is destroyed
+    class timer
+    {
+    public:
+      explicit timer(histogram &h): m_histogram(h), m_start(std::chrono::steady_clock::now()) {}
+      ~timer() { m_histogram.observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count()); }
+      timer(const timer&) = delete;
+      timer &operator=(const timer&) = delete;
+
+    private:
+      histogram &m_histogram;
+      std::chrono::steady_clock::time_point m_start;
+    };
+
+  private:
+    struct alignas(64) shard
+    {
+      std::array<std::atomic<uint64_t>, BUCKETS_COUNT + 1> buckets{}; // the last bucket is +Inf
+      std::atomic<uint64_t> sum_micros{0};
+    };
+    std::array<shard, SHARDS> m_shards;
+  };
+
+  //! Metrics of one name told apart by the value of a label, created when first used
+  template<typename T>
+  class family
+  {
+  public:
+    family(const char *name, const char *help, const char *label): m_name(name), m_help(help), m_label(label) {}
+
+    //! The metric for the given label value, which must not need escaping
+    T &get(const std::string &value)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      std::unique_ptr<T> &m = m_metrics[value];
+      if (!m)
+        m.reset(new T(m_name, m_help, std::string(m_label) + "=\"" + value + "\""));
+      return *m;
+    }
+
+  private:
+    const char *m_name;
+    const char *m_help;
+    const char *m_label;
+    std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<T>> m_metrics;
+  };
+
+  //! Writes all registered metrics, those sharing a name under one HELP and TYPE
+  void write(std::ostream &out);
+  std::string get();
+}
+}
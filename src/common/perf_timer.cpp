@@ -124,6 +124,11 @@ LoggingPerformanceTimer::LoggingPerformanceTimer(const std::string &s, uint64_t
   performance_timers->push_back(this);
 }
 
+LoggingPerformanceTimer::LoggingPerformanceTimer(const char *s, uint64_t unit, el::Level l): LoggingPerformanceTimer(std::string(s), unit, l)
+{
+  span.start(s);
+}
+
 PerformanceTimer::~PerformanceTimer()
 {
   if (!paused)
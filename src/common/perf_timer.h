@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <memory>
 #include "misc_log_ex.h"
+#include "trace.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "perf"
@@ -68,9 +69,12 @@ class LoggingPerformanceTimer: public PerformanceTimer
 {
 public:
   LoggingPerformanceTimer(const std::string &s, uint64_t unit, el::Level l = el::Level::Debug);
+  //! Also records a trace span under the given name, which must be a literal
+  LoggingPerformanceTimer(const char *s, uint64_t unit, el::Level l = el::Level::Debug);
   ~LoggingPerformanceTimer();
 
 private:
+  trace::span span;
   std::string name;
   uint64_t unit;
   el::Level level;
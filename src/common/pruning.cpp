@@ -0,0 +1,94 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "crypto/crypto.h"
+#include "cryptonote_config.h"
+#include "pruning.h"
+
+namespace tools
+{
+
+uint32_t get_pruning_stripe(uint64_t block_height)
+{
+  return (block_height / CRYPTONOTE_PRUNING_STRIPE_SIZE) % CRYPTONOTE_PRUNING_NUM_STRIPES + 1;
+}
+
+bool has_unpruned_block(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_stripe)
+{
+  if (pruning_stripe == 0)
+    return true;
+  if (block_height + CRYPTONOTE_PRUNING_TIP_BLOCKS >= blockchain_height)
+    return true;
+  return get_pruning_stripe(block_height) == pruning_stripe;
+}
+
+uint64_t get_next_unpruned_block_height(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_stripe)
+{
+  if (has_unpruned_block(block_height, blockchain_height, pruning_stripe))
+    return block_height;
+  // the stripes repeat every CRYPTONOTE_PRUNING_NUM_STRIPES spans, so the next one of ours is
+  // less than a cycle away
+  const uint64_t cycle = CRYPTONOTE_PRUNING_STRIPE_SIZE * CRYPTONOTE_PRUNING_NUM_STRIPES;
+  const uint64_t cycle_start = block_height - block_height % cycle;
+  uint64_t next = cycle_start + (pruning_stripe - 1) * (uint64_t)CRYPTONOTE_PRUNING_STRIPE_SIZE;
+  if (next <= block_height)
+    next += cycle;
+  const uint64_t tip_start = blockchain_height > CRYPTONOTE_PRUNING_TIP_BLOCKS ? blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS : 0;
+  return std::min(next, tip_start);
+}
+
+uint64_t get_next_pruned_block_height(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_stripe)
+{
+  if (pruning_stripe == 0)
+    return blockchain_height;
+  const uint64_t tip_start = blockchain_height > CRYPTONOTE_PRUNING_TIP_BLOCKS ? blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS : 0;
+  if (block_height >= tip_start)
+    return blockchain_height;
+  if (get_pruning_stripe(block_height) != pruning_stripe)
+    return block_height;
+  const uint64_t span_end = block_height - block_height % CRYPTONOTE_PRUNING_STRIPE_SIZE + CRYPTONOTE_PRUNING_STRIPE_SIZE;
+  return span_end >= tip_start ? blockchain_height : span_end;
+}
+
+uint32_t get_random_pruning_stripe()
+{
+  return crypto::rand<uint8_t>() % CRYPTONOTE_PRUNING_NUM_STRIPES + 1;
+}
+
+uint32_t get_pruning_stripe_from_support_flags(uint32_t support_flags)
+{
+  return (support_flags & P2P_SUPPORT_FLAG_PRUNING_STRIPE_MASK) >> P2P_SUPPORT_FLAG_PRUNING_STRIPE_SHIFT;
+}
+
+uint32_t make_pruning_support_flags(uint32_t pruning_stripe)
+{
+  return (pruning_stripe << P2P_SUPPORT_FLAG_PRUNING_STRIPE_SHIFT) & P2P_SUPPORT_FLAG_PRUNING_STRIPE_MASK;
+}
+
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+
+namespace tools
+{
+  //! Pruned nodes keep the prunable part of transactions (signatures, range proofs) of one in
+  //! CRYPTONOTE_PRUNING_NUM_STRIPES spans of CRYPTONOTE_PRUNING_STRIPE_SIZE blocks, plus the
+  //! last CRYPTONOTE_PRUNING_TIP_BLOCKS blocks of the chain. Stripes are numbered from 1, 0
+  //! means the node is not pruned and has everything.
+
+  //! Returns the stripe the block at block_height is kept by
+  uint32_t get_pruning_stripe(uint64_t block_height);
+
+  //! Returns whether a node with the given stripe keeps the full block at block_height
+  bool has_unpruned_block(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_stripe);
+
+  //! Returns the first height from block_height a node with the given stripe keeps the full block
+  //! of, which is block_height itself if it keeps that one
+  uint64_t get_next_unpruned_block_height(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_stripe);
+
+  //! Returns the first height from block_height a node with the given stripe doesn't keep the
+  //! full block of, or blockchain_height if it keeps everything from there on
+  uint64_t get_next_pruned_block_height(uint64_t block_height, uint64_t blockchain_height, uint32_t pruning_stripe);
+
+  //! Picks a stripe for a node which starts pruning, so the network keeps all of them
+  uint32_t get_random_pruning_stripe();
+
+  //! Pruning stripes are advertised in the P2P support flags
+  uint32_t get_pruning_stripe_from_support_flags(uint32_t support_flags);
+  uint32_t make_pruning_support_flags(uint32_t pruning_stripe);
+}
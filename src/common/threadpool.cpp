@@ -37,17 +37,22 @@
 
 static __thread int depth = 0;
 static __thread bool is_leaf = false;
+// the pool whose worker the thread is, and its index there
+static __thread const tools::threadpool *worker_pool = NULL;
+static __thread int worker_index = -1;
 
 namespace tools
 {
-threadpool::threadpool(unsigned int max_threads) : running(true), active(0) {
+threadpool::threadpool(unsigned int max_threads) : pending(0), sleeping(0), active(0), running(true),
+    n_submitted(0), n_inlined(0), n_executed(0), n_steals(0) {
   boost::thread::attributes attrs;
   attrs.set_stack_size(THREAD_STACK_SIZE);
   max = max_threads ? max_threads : tools::get_max_concurrency();
-  size_t i = max ? max - 1 : 0;
-  while(i--) {
-    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, false)));
-  }
+  const size_t n_threads = max ? max - 1 : 0;
+  for (size_t i = 0; i < n_threads; ++i)
+    worker_queues.emplace_back(new task_queue());
+  for (size_t i = 0; i < n_threads; ++i)
+    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, false, (int)i)));
 }
 
 threadpool::~threadpool() {
@@ -62,33 +67,114 @@ threadpool::~threadpool() {
   }
 }
 
-void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf) {
+bool threadpool::run_inline(bool leaf) const {
+  // if all available threads are already running
+  // and there's work waiting, just run in current thread
+  return !leaf && ((active == max && pending > 0) || depth > 0);
+}
+
+void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf, priority prio) {
   CHECK_AND_ASSERT_THROW_MES(!is_leaf, "A leaf routine is using a thread pool");
-  boost::unique_lock<boost::mutex> lock(mutex);
-  if (!leaf && ((active == max && !queue.empty()) || depth > 0)) {
-    // if all available threads are already running
-    // and there's work waiting, just run in current thread
-    lock.unlock();
+  if (run_inline(leaf)) {
+    ++n_inlined;
     ++depth;
-    is_leaf = leaf;
     f();
     --depth;
-    is_leaf = false;
   } else {
     if (obj)
       obj->inc();
-    if (leaf)
-      queue.push_front({obj, f, leaf});
+    entry e{obj, std::move(f), leaf};
+    enqueue(&e, 1, prio);
+  }
+}
+
+void threadpool::submit(waiter *obj, std::vector<std::function<void()>> fs, bool leaf, priority prio) {
+  CHECK_AND_ASSERT_THROW_MES(!is_leaf, "A leaf routine is using a thread pool");
+  if (fs.empty())
+    return;
+  if (run_inline(leaf)) {
+    n_inlined += fs.size();
+    ++depth;
+    for (auto &f: fs)
+      f();
+    --depth;
+  } else {
+    if (obj)
+      obj->inc(fs.size());
+    std::vector<entry> entries;
+    entries.reserve(fs.size());
+    for (auto &f: fs)
+      entries.push_back({obj, std::move(f), leaf});
+    enqueue(entries.data(), entries.size(), prio);
+  }
+}
+
+void threadpool::enqueue(entry *entries, size_t n, priority prio) {
+  // counted before they can be taken, so pending never drops below the queued tasks
+  pending += n;
+  task_queue &q = prio == PRIORITY_HIGH ? high_queue : worker_pool == this ? *worker_queues[worker_index] : shared_queue;
+  {
+    const boost::unique_lock<boost::mutex> lock(q.mutex);
+    for (size_t i = 0; i < n; ++i) {
+      if (entries[i].leaf)
+        q.tasks.push_front(std::move(entries[i]));
+      else
+        q.tasks.push_back(std::move(entries[i]));
+    }
+    q.size += n;
+  }
+  n_submitted += n;
+  if (sleeping > 0) {
+    const boost::unique_lock<boost::mutex> lock(mutex);
+    if (n == 1)
+      has_work.notify_one();
     else
-      queue.push_back({obj, f, leaf});
-    has_work.notify_one();
+      has_work.notify_all();
+  }
+}
+
+bool threadpool::pop(entry &e) {
+  const auto take = [&e](task_queue &q, bool back) {
+    if (q.size == 0)
+      return false;
+    const boost::unique_lock<boost::mutex> lock(q.mutex);
+    if (q.tasks.empty())
+      return false;
+    if (back) {
+      e = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    } else {
+      e = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    --q.size;
+    return true;
+  };
+
+  const int self = worker_pool == this ? worker_index : -1;
+  bool found = take(high_queue, false) || (self >= 0 && take(*worker_queues[self], false)) || take(shared_queue, false);
+  // the oldest task of another worker is the one it is the least likely to get to soon
+  const size_t n_queues = worker_queues.size();
+  for (size_t i = 0; !found && i < n_queues; ++i) {
+    const size_t victim = (self + 1 + i) % n_queues;
+    if ((int)victim != self && take(*worker_queues[victim], true)) {
+      found = true;
+      ++n_steals;
+    }
   }
+  if (found)
+    --pending;
+  return found;
 }
 
 unsigned int threadpool::get_max_concurrency() const {
   return max;
 }
 
+threadpool::stats threadpool::get_stats() const {
+  return {n_submitted, n_inlined, n_executed, n_steals, pending};
+}
+
 threadpool::waiter::~waiter()
 {
   {
@@ -114,9 +200,9 @@ void threadpool::waiter::wait(threadpool *tpool) {
     cv.wait(lock);
 }
 
-void threadpool::waiter::inc() {
+void threadpool::waiter::inc(int n) {
   const boost::unique_lock<boost::mutex> lock(mt);
-  num++;
+  num += n;
 }
 
 void threadpool::waiter::dec() {
@@ -126,31 +212,35 @@ void threadpool::waiter::dec() {
     cv.notify_all();
 }
 
-void threadpool::run(bool flush) {
-  boost::unique_lock<boost::mutex> lock(mutex);
+void threadpool::run(bool flush, int index) {
+  if (index >= 0) {
+    worker_pool = this;
+    worker_index = index;
+  }
   while (running) {
     entry e;
-    while(queue.empty() && running)
+    if (!pop(e))
     {
       if (flush)
         return;
-      has_work.wait(lock);
+      boost::unique_lock<boost::mutex> lock(mutex);
+      ++sleeping;
+      while (pending == 0 && running)
+        has_work.wait(lock);
+      --sleeping;
+      continue;
     }
-    if (!running) break;
 
     active++;
-    e = queue.front();
-    queue.pop_front();
-    lock.unlock();
     ++depth;
     is_leaf = e.leaf;
     e.f();
     --depth;
     is_leaf = false;
+    ++n_executed;
 
     if (e.wo)
       e.wo->dec();
-    lock.lock();
     active--;
   }
 }
@@ -30,8 +30,11 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <atomic>
 #include <cstddef>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <utility>
 #include <vector>
 #include <stdexcept>
@@ -39,6 +42,11 @@
 namespace tools
 {
 //! A global thread pool
+//!
+//! Each worker thread has a deque of its own: tasks it submits go to its front and it takes
+//! its next task from there, while idle workers steal from the back of the others'. Tasks
+//! submitted from outside the pool go to a shared queue, high priority ones to a queue taken
+//! before all others.
 class threadpool
 {
 public:
@@ -57,19 +65,32 @@ public:
     boost::condition_variable cv;
     int num;
     public:
-    void inc();
+    void inc(int n = 1);
     void dec();
     void wait(threadpool *tpool);  //! Wait for a set of tasks to finish.
     waiter() : num(0){}
     ~waiter();
   };
 
+  enum priority { PRIORITY_NORMAL, PRIORITY_HIGH };
+
+  struct stats {
+    uint64_t submitted;  //! tasks queued
+    uint64_t inlined;    //! tasks run by the submitting thread instead
+    uint64_t executed;   //! queued tasks run so far
+    uint64_t steals;     //! tasks taken from another worker's deque
+    uint64_t queued;     //! tasks waiting to run
+  };
+
   // Submit a task to the pool. The waiter pointer may be
   // NULL if the caller doesn't care to wait for the
   // task to finish.
-  void submit(waiter *waiter, std::function<void()> f, bool leaf = false);
+  void submit(waiter *waiter, std::function<void()> f, bool leaf = false, priority prio = PRIORITY_NORMAL);
+  // Submit tasks in one go, as submit() would one by one
+  void submit(waiter *waiter, std::vector<std::function<void()>> fs, bool leaf = false, priority prio = PRIORITY_NORMAL);
 
   unsigned int get_max_concurrency() const;
+  stats get_stats() const;
 
   ~threadpool();
 
@@ -80,14 +101,28 @@ public:
       std::function<void()> f;
       bool leaf;
     } entry;
-    std::deque<entry> queue;
+    struct task_queue {
+      boost::mutex mutex;
+      std::deque<entry> tasks;
+      std::atomic<size_t> size;
+      task_queue(): size(0) {}
+    };
+    task_queue high_queue;
+    task_queue shared_queue;
+    std::vector<std::unique_ptr<task_queue>> worker_queues;
+    std::atomic<size_t> pending;
+    std::atomic<unsigned int> sleeping;
     boost::condition_variable has_work;
     boost::mutex mutex;
     std::vector<boost::thread> threads;
-    unsigned int active;
+    std::atomic<unsigned int> active;
     unsigned int max;
-    bool running;
-    void run(bool flush = false);
+    std::atomic<bool> running;
+    std::atomic<uint64_t> n_submitted, n_inlined, n_executed, n_steals;
+    bool run_inline(bool leaf) const;
+    void enqueue(entry *entries, size_t n, priority prio);
+    bool pop(entry &e);
+    void run(bool flush = false, int index = -1);
 };
 
 }
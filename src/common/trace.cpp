@@ -0,0 +1,305 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include "perf_timer.h"
+#include "trace.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "perf.trace"
+
+// events kept per thread, older ones are overwritten
+#define TRACE_BUFFER_EVENTS 16384
+
+namespace
+{
+  struct histogram_data
+  {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[tools::trace::histogram::BUCKETS];
+  };
+
+  // written by the owning thread only, the head is published after the event it covers
+  struct thread_buffer
+  {
+    thread_buffer(uint32_t index): index(index), events(new tools::trace::event[TRACE_BUFFER_EVENTS]), head(0), cleared(0), next_span(0), in_use(true) {}
+
+    const uint32_t index;
+    std::unique_ptr<tools::trace::event[]> events;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> cleared;  // events before this one were dropped by clear()
+    uint64_t next_span;
+    std::atomic<bool> in_use;
+
+    // only contended while the histograms are read
+    boost::mutex histograms_mutex;
+    std::unordered_map<const char*, histogram_data> histograms;
+  };
+
+  boost::mutex buffers_mutex;
+  std::vector<std::unique_ptr<thread_buffer>> buffers;
+  const uint64_t base_ticks = tools::get_tick_count();
+
+  // hands the buffer over to a later thread when this one exits
+  struct buffer_holder
+  {
+    thread_buffer *buffer = NULL;
+    ~buffer_holder() { if (buffer) buffer->in_use.store(false, std::memory_order_release); }
+  };
+  thread_local buffer_holder local_buffer;
+  thread_local uint64_t local_current_span = 0;
+
+  thread_buffer *get_local_buffer()
+  {
+    if (local_buffer.buffer)
+      return local_buffer.buffer;
+    boost::lock_guard<boost::mutex> lock(buffers_mutex);
+    for (const auto &buffer: buffers)
+    {
+      bool in_use = false;
+      if (buffer->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+        return local_buffer.buffer = buffer.get();
+    }
+    buffers.emplace_back(new thread_buffer(buffers.size()));
+    return local_buffer.buffer = buffers.back().get();
+  }
+
+  size_t bucket(uint64_t ns)
+  {
+    size_t b = 0;
+    while (ns && b < tools::trace::histogram::BUCKETS - 1)
+    {
+      ns >>= 1;
+      ++b;
+    }
+    return b;
+  }
+
+  void write_json_string(std::ostream &s, const char *str)
+  {
+    s << '"';
+    for (; *str; ++str)
+    {
+      if (*str == '"' || *str == '\\')
+        s << '\\' << *str;
+      else if ((unsigned char)*str >= 0x20)
+        s << *str;
+    }
+    s << '"';
+  }
+
+  void write_us(std::ostream &s, uint64_t ns)
+  {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu.%03u", (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+    s << buf;
+  }
+}
+
+namespace tools
+{
+namespace trace
+{
+  std::atomic<bool> enabled_flag(false);
+
+  void enable(bool enable)
+  {
+    enabled_flag.store(enable, std::memory_order_relaxed);
+    MINFO("Tracing " << (enable ? "enabled" : "disabled"));
+  }
+
+  void clear()
+  {
+    boost::lock_guard<boost::mutex> lock(buffers_mutex);
+    for (const auto &buffer: buffers)
+    {
+      buffer->cleared.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+      boost::lock_guard<boost::mutex> histograms_lock(buffer->histograms_mutex);
+      buffer->histograms.clear();
+    }
+  }
+
+  uint64_t current_span()
+  {
+    return local_current_span;
+  }
+
+  void span::begin(const char *n, uint64_t parent)
+  {
+    thread_buffer *buffer = get_local_buffer();
+    name = n;
+    span_id = ((uint64_t)(buffer->index + 1) << 40) | (++buffer->next_span & 0xffffffffff);
+    parent_id = parent;
+    outer_id = local_current_span;
+    local_current_span = span_id;
+    start_ticks = get_tick_count();
+  }
+
+  void span::finish()
+  {
+    const uint64_t end_ticks = get_tick_count();
+    local_current_span = outer_id;
+    thread_buffer *buffer = local_buffer.buffer;
+    const uint64_t duration_ns = ticks_to_ns(end_ticks - start_ticks);
+
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    event &e = buffer->events[head % TRACE_BUFFER_EVENTS];
+    e.name = name;
+    e.span_id = span_id;
+    e.parent_id = parent_id;
+    e.start_ns = ticks_to_ns(start_ticks - base_ticks);
+    e.duration_ns = duration_ns;
+    e.thread = buffer->index;
+    buffer->head.store(head + 1, std::memory_order_release);
+
+    boost::lock_guard<boost::mutex> lock(buffer->histograms_mutex);
+    histogram_data &h = buffer->histograms[name];
+    ++h.count;
+    h.total_ns += duration_ns;
+    h.max_ns = std::max(h.max_ns, duration_ns);
+    ++h.buckets[bucket(duration_ns)];
+  }
+
+  uint64_t histogram::percentile_ns(double fraction) const
+  {
+    const uint64_t target = count * fraction;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+      seen += buckets[i];
+      if (seen > target)
+        return std::min(max_ns, i == 0 ? (uint64_t)0 : ((uint64_t)1 << i) - 1);
+    }
+    return max_ns;
+  }
+
+  std::vector<event> get_events()
+  {
+    std::vector<event> events;
+    boost::lock_guard<boost::mutex> lock(buffers_mutex);
+    for (const auto &buffer: buffers)
+    {
+      const uint64_t head = buffer->head.load(std::memory_order_acquire);
+      const uint64_t first = std::max(head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0, buffer->cleared.load(std::memory_order_relaxed));
+      if (first >= head)
+        continue;
+      const size_t offset = events.size();
+      for (uint64_t i = first; i < head; ++i)
+        events.push_back(buffer->events[i % TRACE_BUFFER_EVENTS]);
+
+      // the writer may have gone round over the oldest ones while they were copied
+      const uint64_t new_head = buffer->head.load(std::memory_order_acquire);
+      const uint64_t overwritten = new_head > TRACE_BUFFER_EVENTS + first ? new_head - TRACE_BUFFER_EVENTS - first : 0;
+      events.erase(events.begin() + offset, events.begin() + offset + std::min<uint64_t>(overwritten, head - first));
+    }
+    std::sort(events.begin(), events.end(), [](const event &a, const event &b) { return a.start_ns < b.start_ns; });
+    return events;
+  }
+
+  std::vector<histogram> get_histograms()
+  {
+    std::map<std::string, histogram> merged;
+    {
+      boost::lock_guard<boost::mutex> lock(buffers_mutex);
+      for (const auto &buffer: buffers)
+      {
+        boost::lock_guard<boost::mutex> histograms_lock(buffer->histograms_mutex);
+        for (const auto &e: buffer->histograms)
+        {
+          auto it = merged.find(e.first);
+          if (it == merged.end())
+          {
+            histogram h{};
+            h.name = e.first;
+            it = merged.emplace(h.name, h).first;
+          }
+          histogram &h = it->second;
+          h.count += e.second.count;
+          h.total_ns += e.second.total_ns;
+          h.max_ns = std::max(h.max_ns, e.second.max_ns);
+          for (size_t i = 0; i < histogram::BUCKETS; ++i)
+            h.buckets[i] += e.second.buckets[i];
+        }
+      }
+    }
+
+    std::vector<histogram> histograms;
+    histograms.reserve(merged.size());
+    for (auto &e: merged)
+      histograms.push_back(std::move(e.second));
+    std::sort(histograms.begin(), histograms.end(), [](const histogram &a, const histogram &b) { return a.total_ns > b.total_ns; });
+    return histograms;
+  }
+
+  size_t write_chrome_trace(std::ostream &s)
+  {
+    const std::vector<event> events = get_events();
+    s << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+      const event &e = events[i];
+      s << (i ? ",\n" : "\n") << "{\"ph\":\"X\",\"cat\":\"graft\",\"pid\":1,\"tid\":" << e.thread << ",\"name\":";
+      write_json_string(s, e.name);
+      s << ",\"ts\":";
+      write_us(s, e.start_ns);
+      s << ",\"dur\":";
+      write_us(s, e.duration_ns);
+      s << ",\"args\":{\"span\":" << e.span_id << ",\"parent\":" << e.parent_id << "}}";
+    }
+    s << "\n]}\n";
+    return events.size();
+  }
+
+  bool write_chrome_trace(const std::string &filename, size_t &events)
+  {
+    std::ofstream s(filename, std::ios::out | std::ios::trunc);
+    if (!s)
+    {
+      MERROR("Failed to open " << filename);
+      return false;
+    }
+    events = write_chrome_trace(s);
+    s.close();
+    if (!s)
+    {
+      MERROR("Failed to write " << filename);
+      return false;
+    }
+    MINFO("Wrote " << events << " trace events to " << filename);
+    return true;
+  }
+}
+}
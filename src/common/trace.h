@@ -0,0 +1,124 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace tools
+{
+namespace trace
+{
+  //! Hot path tracing: spans are recorded into a lock free ring buffer owned by the thread
+  //! running them and summed into per thread histograms, both read back without stopping
+  //! the writers. Nothing is recorded, and a span costs a single relaxed load, until tracing
+  //! is enabled.
+  //!
+  //! Span names must be string literals (or otherwise outlive the process), they are stored
+  //! as pointers.
+
+  extern std::atomic<bool> enabled_flag;
+
+  inline bool enabled() { return enabled_flag.load(std::memory_order_relaxed); }
+  void enable(bool enable);
+  //! Drops recorded events and histograms
+  void clear();
+
+  //! Id of the span running on this thread, 0 if none
+  uint64_t current_span();
+
+  class span
+  {
+  public:
+    span(): name(NULL) {}
+    explicit span(const char *name) { start(name); }
+    //! A span continuing work of a span from another thread, e.g. a threadpool task
+    span(const char *name, uint64_t parent) { start(name, parent); }
+    ~span() { if (name) finish(); }
+    span(const span&) = delete;
+    span &operator=(const span&) = delete;
+
+    void start(const char *n) { name = NULL; if (enabled()) begin(n, current_span()); }
+    void start(const char *n, uint64_t parent) { name = NULL; if (enabled()) begin(n, parent); }
+    //! Finishes the span before it goes out of scope, for spans covering part of a function
+    void stop() { if (name) finish(); name = NULL; }
+    uint64_t id() const { return name ? span_id : 0; }
+
+  private:
+    void begin(const char *n, uint64_t parent);
+    void finish();
+
+    const char *name;
+    uint64_t span_id;
+    uint64_t parent_id;
+    uint64_t outer_id;
+    uint64_t start_ticks;
+  };
+
+  struct event
+  {
+    const char *name;
+    uint64_t span_id;
+    uint64_t parent_id;
+    uint64_t start_ns;  //! since the process started
+    uint64_t duration_ns;
+    uint32_t thread;
+  };
+
+  struct histogram
+  {
+    static const size_t BUCKETS = 48;  //! bucket i holds durations in [2^(i-1), 2^i) ns
+
+    std::string name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[BUCKETS];
+
+    //! Upper bound of the bucket the given fraction of the spans falls within
+    uint64_t percentile_ns(double fraction) const;
+  };
+
+  //! Events still held by the ring buffers, oldest first
+  std::vector<event> get_events();
+  //! Histograms of all spans finished since the last clear, by name, busiest first
+  std::vector<histogram> get_histograms();
+  //! Writes the recorded events in the Chrome trace event format, loaded by chrome://tracing
+  //! and Perfetto. Returns the number of events written.
+  size_t write_chrome_trace(std::ostream &s);
+  bool write_chrome_trace(const std::string &filename, size_t &events);
+}
+}
+
+#define TRACE_SPAN_CONCAT_(a, b) a##b
+#define TRACE_SPAN_CONCAT(a, b) TRACE_SPAN_CONCAT_(a, b)
+#define TRACE_SPAN(name) tools::trace::span TRACE_SPAN_CONCAT(trace_span_, __LINE__)(name)
@@ -42,7 +42,7 @@ static const char sigma[] = "expand 32-byte k";
 
 DISABLE_GCC_AND_CLANG_WARNING(strict-aliasing)
 
-static void chacha(unsigned rounds, const void* data, size_t length, const uint8_t* key, const uint8_t* iv, char* cipher) {
+static void chacha_scalar(unsigned rounds, const void* data, size_t length, const uint8_t* key, const uint8_t* iv, uint64_t counter, char* cipher) {
   uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
   uint32_t j0, j1, j2, j3, j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15;
   char* ctarget = 0;
@@ -63,8 +63,8 @@ static void chacha(unsigned rounds, const void* data, size_t length, const uint8
   j9  = U8TO32_LITTLE(key + 20);
   j10 = U8TO32_LITTLE(key + 24);
   j11 = U8TO32_LITTLE(key + 28);
-  j12 = 0;
-  j13 = 0;
+  j12 = (uint32_t)counter;
+  j13 = (uint32_t)(counter >> 32);
   j14 = U8TO32_LITTLE(iv + 0);
   j15 = U8TO32_LITTLE(iv + 4);
 
@@ -171,6 +171,192 @@ static void chacha(unsigned rounds, const void* data, size_t length, const uint8
   }
 }
 
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHACHA_SSE2 1
+#include <emmintrin.h>
+
+/*
+ * Vectorized implementations process several blocks at once, every vector holds the same
+ * word of consecutive blocks. The results are identical to the scalar implementation.
+ */
+
+#define ROTATE_SSE2(v,c) _mm_or_si128(_mm_slli_epi32(v, c), _mm_srli_epi32(v, 32 - (c)))
+
+#define QUARTERROUND_SSE2(a,b,c,d) \
+  a = _mm_add_epi32(a,b); d = ROTATE_SSE2(_mm_xor_si128(d,a),16); \
+  c = _mm_add_epi32(c,d); b = ROTATE_SSE2(_mm_xor_si128(b,c),12); \
+  a = _mm_add_epi32(a,b); d = ROTATE_SSE2(_mm_xor_si128(d,a), 8); \
+  c = _mm_add_epi32(c,d); b = ROTATE_SSE2(_mm_xor_si128(b,c), 7);
+
+/* transposes words a,b,c,d of 4 blocks into 4 consecutive words of every block */
+#define TRANSPOSE4_SSE2(a,b,c,d) { \
+  __m128i t0 = _mm_unpacklo_epi32(a,b), t1 = _mm_unpacklo_epi32(c,d); \
+  __m128i t2 = _mm_unpackhi_epi32(a,b), t3 = _mm_unpackhi_epi32(c,d); \
+  a = _mm_unpacklo_epi64(t0,t1); b = _mm_unpackhi_epi64(t0,t1); \
+  c = _mm_unpacklo_epi64(t2,t3); d = _mm_unpackhi_epi64(t2,t3); }
+
+#define XOR_STORE_SSE2(offset, v) \
+  _mm_storeu_si128((__m128i*)(cipher + (offset)), _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)((const char*)data + (offset)))))
+
+/* returns count of processed bytes, it is a multiple of 256 */
+static size_t chacha_sse2(unsigned rounds, const void* data, size_t length, const uint32_t* j, uint64_t counter, char* cipher)
+{
+  size_t processed = 0;
+  __m128i x[16], s[16];
+  unsigned i, r;
+
+  for (i = 0; i < 16; i++)
+    s[i] = _mm_set1_epi32((int)j[i]);
+
+  for (; length - processed >= 256; processed += 256, counter += 4) {
+    s[12] = _mm_set_epi32((int)(uint32_t)(counter + 3), (int)(uint32_t)(counter + 2), (int)(uint32_t)(counter + 1), (int)(uint32_t)counter);
+    s[13] = _mm_set_epi32((int)(uint32_t)((counter + 3) >> 32), (int)(uint32_t)((counter + 2) >> 32), (int)(uint32_t)((counter + 1) >> 32), (int)(uint32_t)(counter >> 32));
+
+    for (i = 0; i < 16; i++)
+      x[i] = s[i];
+    for (r = rounds; r > 0; r -= 2) {
+      QUARTERROUND_SSE2(x[0], x[4], x[8], x[12])
+      QUARTERROUND_SSE2(x[1], x[5], x[9], x[13])
+      QUARTERROUND_SSE2(x[2], x[6], x[10], x[14])
+      QUARTERROUND_SSE2(x[3], x[7], x[11], x[15])
+      QUARTERROUND_SSE2(x[0], x[5], x[10], x[15])
+      QUARTERROUND_SSE2(x[1], x[6], x[11], x[12])
+      QUARTERROUND_SSE2(x[2], x[7], x[8], x[13])
+      QUARTERROUND_SSE2(x[3], x[4], x[9], x[14])
+    }
+    for (i = 0; i < 16; i++)
+      x[i] = _mm_add_epi32(x[i], s[i]);
+
+    for (i = 0; i < 16; i += 4) {
+      TRANSPOSE4_SSE2(x[i], x[i + 1], x[i + 2], x[i + 3])
+      XOR_STORE_SSE2(0 * 64 + i * 4, x[i]);
+      XOR_STORE_SSE2(1 * 64 + i * 4, x[i + 1]);
+      XOR_STORE_SSE2(2 * 64 + i * 4, x[i + 2]);
+      XOR_STORE_SSE2(3 * 64 + i * 4, x[i + 3]);
+    }
+    data = (const char*)data + 256;
+    cipher += 256;
+  }
+  return processed;
+}
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#define CHACHA_AVX2 1
+#include <immintrin.h>
+
+#define ROTATE_AVX2(v,c) _mm256_or_si256(_mm256_slli_epi32(v, c), _mm256_srli_epi32(v, 32 - (c)))
+
+#define QUARTERROUND_AVX2(a,b,c,d) \
+  a = _mm256_add_epi32(a,b); d = ROTATE_AVX2(_mm256_xor_si256(d,a),16); \
+  c = _mm256_add_epi32(c,d); b = ROTATE_AVX2(_mm256_xor_si256(b,c),12); \
+  a = _mm256_add_epi32(a,b); d = ROTATE_AVX2(_mm256_xor_si256(d,a), 8); \
+  c = _mm256_add_epi32(c,d); b = ROTATE_AVX2(_mm256_xor_si256(b,c), 7);
+
+/* transposes within 128 bit lanes: the low lane gets blocks 0-3, the high lane gets blocks 4-7 */
+#define TRANSPOSE4_AVX2(a,b,c,d) { \
+  __m256i t0 = _mm256_unpacklo_epi32(a,b), t1 = _mm256_unpacklo_epi32(c,d); \
+  __m256i t2 = _mm256_unpackhi_epi32(a,b), t3 = _mm256_unpackhi_epi32(c,d); \
+  a = _mm256_unpacklo_epi64(t0,t1); b = _mm256_unpackhi_epi64(t0,t1); \
+  c = _mm256_unpacklo_epi64(t2,t3); d = _mm256_unpackhi_epi64(t2,t3); }
+
+#define XOR_STORE_AVX2(offset, v) \
+  _mm256_storeu_si256((__m256i*)(cipher + (offset)), _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i*)((const char*)data + (offset)))))
+
+/* returns count of processed bytes, it is a multiple of 512 */
+__attribute__((target("avx2")))
+static size_t chacha_avx2(unsigned rounds, const void* data, size_t length, const uint32_t* j, uint64_t counter, char* cipher)
+{
+  size_t processed = 0;
+  __m256i x[16], s[16];
+  unsigned i, r;
+  uint32_t lo[8], hi[8];
+
+  for (i = 0; i < 16; i++)
+    s[i] = _mm256_set1_epi32((int)j[i]);
+
+  for (; length - processed >= 512; processed += 512, counter += 8) {
+    for (i = 0; i < 8; i++) {
+      lo[i] = (uint32_t)(counter + i);
+      hi[i] = (uint32_t)((counter + i) >> 32);
+    }
+    s[12] = _mm256_loadu_si256((const __m256i*)lo);
+    s[13] = _mm256_loadu_si256((const __m256i*)hi);
+
+    for (i = 0; i < 16; i++)
+      x[i] = s[i];
+    for (r = rounds; r > 0; r -= 2) {
+      QUARTERROUND_AVX2(x[0], x[4], x[8], x[12])
+      QUARTERROUND_AVX2(x[1], x[5], x[9], x[13])
+      QUARTERROUND_AVX2(x[2], x[6], x[10], x[14])
+      QUARTERROUND_AVX2(x[3], x[7], x[11], x[15])
+      QUARTERROUND_AVX2(x[0], x[5], x[10], x[15])
+      QUARTERROUND_AVX2(x[1], x[6], x[11], x[12])
+      QUARTERROUND_AVX2(x[2], x[7], x[8], x[13])
+      QUARTERROUND_AVX2(x[3], x[4], x[9], x[14])
+    }
+    for (i = 0; i < 16; i++)
+      x[i] = _mm256_add_epi32(x[i], s[i]);
+
+    for (i = 0; i < 16; i += 4)
+      TRANSPOSE4_AVX2(x[i], x[i + 1], x[i + 2], x[i + 3])
+
+    /* x[k + 4 * n] holds words 4n..4n+3 of blocks k and k + 4 */
+    for (i = 0; i < 4; i++) {
+      XOR_STORE_AVX2(i * 64,            _mm256_permute2x128_si256(x[i], x[i + 4], 0x20));
+      XOR_STORE_AVX2(i * 64 + 32,       _mm256_permute2x128_si256(x[i + 8], x[i + 12], 0x20));
+      XOR_STORE_AVX2((i + 4) * 64,      _mm256_permute2x128_si256(x[i], x[i + 4], 0x31));
+      XOR_STORE_AVX2((i + 4) * 64 + 32, _mm256_permute2x128_si256(x[i + 8], x[i + 12], 0x31));
+    }
+    data = (const char*)data + 512;
+    cipher += 512;
+  }
+  return processed;
+}
+
+static int chacha_has_avx2(void)
+{
+  static int has_avx2 = -1;
+  if (has_avx2 < 0)
+    has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  return has_avx2;
+}
+#endif
+#endif
+
+static void chacha(unsigned rounds, const void* data, size_t length, const uint8_t* key, const uint8_t* iv, char* cipher) {
+  size_t processed = 0;
+
+#if defined(CHACHA_SSE2)
+  if (length >= 256) {
+    uint32_t j[16];
+    j[0]  = U8TO32_LITTLE(sigma + 0);
+    j[1]  = U8TO32_LITTLE(sigma + 4);
+    j[2]  = U8TO32_LITTLE(sigma + 8);
+    j[3]  = U8TO32_LITTLE(sigma + 12);
+    j[4]  = U8TO32_LITTLE(key + 0);
+    j[5]  = U8TO32_LITTLE(key + 4);
+    j[6]  = U8TO32_LITTLE(key + 8);
+    j[7]  = U8TO32_LITTLE(key + 12);
+    j[8]  = U8TO32_LITTLE(key + 16);
+    j[9]  = U8TO32_LITTLE(key + 20);
+    j[10] = U8TO32_LITTLE(key + 24);
+    j[11] = U8TO32_LITTLE(key + 28);
+    j[12] = 0;
+    j[13] = 0;
+    j[14] = U8TO32_LITTLE(iv + 0);
+    j[15] = U8TO32_LITTLE(iv + 4);
+
+#if defined(CHACHA_AVX2)
+    if (chacha_has_avx2())
+      processed = chacha_avx2(rounds, data, length, j, 0, cipher);
+#endif
+    processed += chacha_sse2(rounds, (const char*)data + processed, length - processed, j, processed / 64, cipher + processed);
+  }
+#endif
+
+  chacha_scalar(rounds, (const char*)data + processed, length - processed, key, iv, processed / 64, cipher + processed);
+}
+
 void chacha8(const void* data, size_t length, const uint8_t* key, const uint8_t* iv, char* cipher)
 {
   chacha(8, data, length, key, iv, cipher);
@@ -0,0 +1,608 @@
+/*
+ * Variable base scalar multiplications on 64-bit limbs
+ *
+ * Field elements have 5 limbs of 51 bits (radix 2^51, as in curve25519-donna-c64),
+ * so a multiplication takes 25 64x64->128 bit products instead of the 100 32x32->64
+ * bit products of the ref10 field arithmetic in crypto-ops.c. The point formulas and
+ * the scalar recodings are the same as the ref10 ones; points are converted from and
+ * to the ref10 representation at the boundaries.
+ *
+ * Only functions with ge_p2 results are implemented: their results are consumed
+ * through ge_tobytes / ge_mul8, so the different limb representation is not visible.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "crypto-ops.h"
+
+#if defined(CRYPTO_OPS_64)
+
+typedef unsigned __int128 uint128_t;
+typedef uint64_t fe51[5];
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+} ge51_p2;
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p3;
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p1p1;
+
+typedef struct {
+  fe51 YplusX;
+  fe51 YminusX;
+  fe51 Z;
+  fe51 T2d;
+} ge51_cached;
+
+typedef struct {
+  fe51 yplusx;
+  fe51 yminusx;
+  fe51 xy2d;
+} ge51_precomp;
+
+static const uint64_t FE51_MASK = (((uint64_t) 1) << 51) - 1;
+
+static const fe51 fe51_d2 = {0x69b9426b2f159, 0x35050762add7a, 0x3cf44c0038052, 0x6738cc7407977, 0x2406d9dc56dff};
+
+/* ge_Bi of crypto-ops-data.c: B, 3B, 5B, 7B, 9B, 11B, 13B, 15B */
+static const ge51_precomp ge51_Bi[8] = {
+  {
+    {0x493c6f58c3b85, 0x0df7181c325f7, 0x0f50b0b3e4cb7, 0x5329385a44c32, 0x07cf9d3a33d4b},
+    {0x03905d740913e, 0x0ba2817d673a2, 0x23e2827f4e67c, 0x133d2e0c21a34, 0x44fd2f9298f81},
+    {0x11205877aaa68, 0x479955893d579, 0x50d66309b67a0, 0x2d42d0dbee5ee, 0x6f117b689f0c6}
+  },
+  {
+    {0x5b0a84cee9730, 0x61d10c97155e4, 0x4059cc8096a10, 0x47a608da8014f, 0x7a164e1b9a80f},
+    {0x11fe8a4fcd265, 0x7bcb8374faacc, 0x52f5af4ef4d4f, 0x5314098f98d10, 0x2ab91587555bd},
+    {0x6933f0dd0d889, 0x44386bb4c4295, 0x3cb6d3162508c, 0x26368b872a2c6, 0x5a2826af12b9b}
+  },
+  {
+    {0x2bc4408a5bb33, 0x078ebdda05442, 0x2ffb112354123, 0x375ee8df5862d, 0x2945ccf146e20},
+    {0x182c3a447d6ba, 0x22964e536eff2, 0x192821f540053, 0x2f9f19e788e5c, 0x154a7e73eb1b5},
+    {0x3dbf1812a8285, 0x0fa17ba3f9797, 0x6f69cb49c3820, 0x34d5a0db3858d, 0x43aabe696b3bb}
+  },
+  {
+    {0x25cd0944ea3bf, 0x75673b81a4d63, 0x150b925d1c0d4, 0x13f38d9294114, 0x461bea69283c9},
+    {0x72c9aaa3221b1, 0x267774474f74d, 0x064b0e9b28085, 0x3f04ef53b27c9, 0x1d6edd5d2e531},
+    {0x36dc801b8b3a2, 0x0e0a7d4935e30, 0x1deb7cecc0d7d, 0x053a94e20dd2c, 0x7a9fbb1c6a0f9}
+  },
+  {
+    {0x6678aa6a8632f, 0x5ea3788d8b365, 0x21bd6d6994279, 0x7ace75919e4e3, 0x34b9ed338add7},
+    {0x6217e039d8064, 0x6dea408337e6d, 0x57ac112628206, 0x647cb65e30473, 0x49c05a51fadc9},
+    {0x4e8bf9045af1b, 0x514e33a45e0d6, 0x7533c5b8bfe0f, 0x583557b7e14c9, 0x73c172021b008}
+  },
+  {
+    {0x700848a802ade, 0x1e04605c4e5f7, 0x5c0d01b9767fb, 0x7d7889f42388b, 0x4275aae2546d8},
+    {0x75b0249864348, 0x52ee11070262b, 0x237ae54fb5acd, 0x3bfd1d03aaab5, 0x18ab598029d5c},
+    {0x32cc5fd6089e9, 0x426505c949b05, 0x46a18880c7ad2, 0x4a4221888ccda, 0x3dc65522b53df}
+  },
+  {
+    {0x0c222a2007f6d, 0x356b79bdb77ee, 0x41ee81efe12ce, 0x120a9bd07097d, 0x234fd7eec346f},
+    {0x7013b327fbf93, 0x1336eeded6a0d, 0x2b565a2bbf3af, 0x253ce89591955, 0x0267882d17602},
+    {0x0a119732ea378, 0x63bf1ba8e2a6c, 0x69f94cc90df9a, 0x431d1779bfc48, 0x497ba6fdaa097}
+  },
+  {
+    {0x6cc0313cfeaa0, 0x1a313848da499, 0x7cb534219230a, 0x39596dedefd60, 0x61e22917f12de},
+    {0x3cd86468ccf0b, 0x48553221ac081, 0x6c9464b4e0a6e, 0x75fba84180403, 0x43b5cd4218d05},
+    {0x2762f9bd0b516, 0x1c6e7fbddcbb3, 0x75909c3ace2bd, 0x42101972d3ec9, 0x511d61210ae4d}
+  },
+};
+
+/* Field arithmetic
+ *
+ * Results of fe51_mul, fe51_sq and fe51_sub have limbs below 2^51 + 2^13, sums of two
+ * such elements are accepted by every function; fe51_sub takes operands below 2^53.
+ */
+
+static uint64_t load_8(const unsigned char *in) {
+  uint64_t result = 0;
+  int i;
+  for (i = 7; i >= 0; i--)
+    result = (result << 8) | in[i];
+  return result;
+}
+
+static void fe51_0(fe51 h) {
+  h[0] = h[1] = h[2] = h[3] = h[4] = 0;
+}
+
+static void fe51_1(fe51 h) {
+  h[0] = 1;
+  h[1] = h[2] = h[3] = h[4] = 0;
+}
+
+static void fe51_copy(fe51 h, const fe51 f) {
+  memcpy(h, f, sizeof(fe51));
+}
+
+static void fe51_add(fe51 h, const fe51 f, const fe51 g) {
+  h[0] = f[0] + g[0];
+  h[1] = f[1] + g[1];
+  h[2] = f[2] + g[2];
+  h[3] = f[3] + g[3];
+  h[4] = f[4] + g[4];
+}
+
+static void fe51_carry(fe51 h) {
+  uint64_t c;
+  c = h[0] >> 51; h[0] &= FE51_MASK; h[1] += c;
+  c = h[1] >> 51; h[1] &= FE51_MASK; h[2] += c;
+  c = h[2] >> 51; h[2] &= FE51_MASK; h[3] += c;
+  c = h[3] >> 51; h[3] &= FE51_MASK; h[4] += c;
+  c = h[4] >> 51; h[4] &= FE51_MASK; h[0] += c * 19;
+}
+
+/* h = f - g, computed as f + 4p - g */
+static void fe51_sub(fe51 h, const fe51 f, const fe51 g) {
+  h[0] = (f[0] + 0x1fffffffffffb4) - g[0];
+  h[1] = (f[1] + 0x1ffffffffffffc) - g[1];
+  h[2] = (f[2] + 0x1ffffffffffffc) - g[2];
+  h[3] = (f[3] + 0x1ffffffffffffc) - g[3];
+  h[4] = (f[4] + 0x1ffffffffffffc) - g[4];
+  fe51_carry(h);
+}
+
+static void fe51_neg(fe51 h, const fe51 f) {
+  fe51 zero;
+  fe51_0(zero);
+  fe51_sub(h, zero, f);
+}
+
+static void fe51_mul(fe51 h, const fe51 f, const fe51 g) {
+  const uint64_t g1_19 = 19 * g[1], g2_19 = 19 * g[2], g3_19 = 19 * g[3], g4_19 = 19 * g[4];
+  uint128_t t0, t1, t2, t3, t4;
+  uint64_t r0, r1, r2, r3, r4, c;
+
+  t0 = (uint128_t) f[0] * g[0] + (uint128_t) f[1] * g4_19 + (uint128_t) f[2] * g3_19 + (uint128_t) f[3] * g2_19 + (uint128_t) f[4] * g1_19;
+  t1 = (uint128_t) f[0] * g[1] + (uint128_t) f[1] * g[0] + (uint128_t) f[2] * g4_19 + (uint128_t) f[3] * g3_19 + (uint128_t) f[4] * g2_19;
+  t2 = (uint128_t) f[0] * g[2] + (uint128_t) f[1] * g[1] + (uint128_t) f[2] * g[0] + (uint128_t) f[3] * g4_19 + (uint128_t) f[4] * g3_19;
+  t3 = (uint128_t) f[0] * g[3] + (uint128_t) f[1] * g[2] + (uint128_t) f[2] * g[1] + (uint128_t) f[3] * g[0] + (uint128_t) f[4] * g4_19;
+  t4 = (uint128_t) f[0] * g[4] + (uint128_t) f[1] * g[3] + (uint128_t) f[2] * g[2] + (uint128_t) f[3] * g[1] + (uint128_t) f[4] * g[0];
+
+  r0 = (uint64_t) t0 & FE51_MASK; t1 += (uint64_t) (t0 >> 51);
+  r1 = (uint64_t) t1 & FE51_MASK; t2 += (uint64_t) (t1 >> 51);
+  r2 = (uint64_t) t2 & FE51_MASK; t3 += (uint64_t) (t2 >> 51);
+  r3 = (uint64_t) t3 & FE51_MASK; t4 += (uint64_t) (t3 >> 51);
+  r4 = (uint64_t) t4 & FE51_MASK; c = (uint64_t) (t4 >> 51);
+
+  r0 += c * 19; c = r0 >> 51; r0 &= FE51_MASK;
+  r1 += c;
+
+  h[0] = r0;
+  h[1] = r1;
+  h[2] = r2;
+  h[3] = r3;
+  h[4] = r4;
+}
+
+static void fe51_sq(fe51 h, const fe51 f) {
+  const uint64_t f0_2 = 2 * f[0], f1_2 = 2 * f[1];
+  const uint64_t f1_38 = 38 * f[1], f2_38 = 38 * f[2], f3_38 = 38 * f[3];
+  const uint64_t f3_19 = 19 * f[3], f4_19 = 19 * f[4];
+  uint128_t t0, t1, t2, t3, t4;
+  uint64_t r0, r1, r2, r3, r4, c;
+
+  t0 = (uint128_t) f[0] * f[0] + (uint128_t) f1_38 * f[4] + (uint128_t) f2_38 * f[3];
+  t1 = (uint128_t) f0_2 * f[1] + (uint128_t) f2_38 * f[4] + (uint128_t) f3_19 * f[3];
+  t2 = (uint128_t) f0_2 * f[2] + (uint128_t) f[1] * f[1] + (uint128_t) f3_38 * f[4];
+  t3 = (uint128_t) f0_2 * f[3] + (uint128_t) f1_2 * f[2] + (uint128_t) f4_19 * f[4];
+  t4 = (uint128_t) f0_2 * f[4] + (uint128_t) f1_2 * f[3] + (uint128_t) f[2] * f[2];
+
+  r0 = (uint64_t) t0 & FE51_MASK; t1 += (uint64_t) (t0 >> 51);
+  r1 = (uint64_t) t1 & FE51_MASK; t2 += (uint64_t) (t1 >> 51);
+  r2 = (uint64_t) t2 & FE51_MASK; t3 += (uint64_t) (t2 >> 51);
+  r3 = (uint64_t) t3 & FE51_MASK; t4 += (uint64_t) (t3 >> 51);
+  r4 = (uint64_t) t4 & FE51_MASK; c = (uint64_t) (t4 >> 51);
+
+  r0 += c * 19; c = r0 >> 51; r0 &= FE51_MASK;
+  r1 += c;
+
+  h[0] = r0;
+  h[1] = r1;
+  h[2] = r2;
+  h[3] = r3;
+  h[4] = r4;
+}
+
+/* Replace (f,g) with (g,g) if b == 1; replace (f,g) with (f,g) if b == 0. */
+static void fe51_cmov(fe51 f, const fe51 g, unsigned int b) {
+  const uint64_t mask = (uint64_t) 0 - b;
+  f[0] ^= mask & (f[0] ^ g[0]);
+  f[1] ^= mask & (f[1] ^ g[1]);
+  f[2] ^= mask & (f[2] ^ g[2]);
+  f[3] ^= mask & (f[3] ^ g[3]);
+  f[4] ^= mask & (f[4] ^ g[4]);
+}
+
+static void fe51_frombytes(fe51 h, const unsigned char *s) {
+  h[0] = load_8(s) & FE51_MASK;
+  h[1] = (load_8(s + 6) >> 3) & FE51_MASK;
+  h[2] = (load_8(s + 12) >> 6) & FE51_MASK;
+  h[3] = (load_8(s + 19) >> 1) & FE51_MASK;
+  h[4] = (load_8(s + 24) >> 12) & FE51_MASK;
+}
+
+static void fe51_tobytes(unsigned char *s, const fe51 f) {
+  uint64_t h[5], q;
+  int i;
+
+  fe51_copy(h, f);
+  fe51_carry(h);
+  fe51_carry(h);
+
+  /* q = 1 if h >= p */
+  q = (h[0] + 19) >> 51;
+  q = (h[1] + q) >> 51;
+  q = (h[2] + q) >> 51;
+  q = (h[3] + q) >> 51;
+  q = (h[4] + q) >> 51;
+
+  h[0] += 19 * q;
+  h[1] += h[0] >> 51; h[0] &= FE51_MASK;
+  h[2] += h[1] >> 51; h[1] &= FE51_MASK;
+  h[3] += h[2] >> 51; h[2] &= FE51_MASK;
+  h[4] += h[3] >> 51; h[3] &= FE51_MASK;
+  h[4] &= FE51_MASK;
+
+  for (i = 0; i < 32; i++) {
+    const int bit = i * 8, limb = bit / 51, shift = bit % 51;
+    uint64_t v = h[limb] >> shift;
+    if (shift > 43 && limb < 4)
+      v |= h[limb + 1] << (51 - shift);
+    s[i] = (unsigned char) v;
+  }
+}
+
+/* Conversions from and to the ref10 representation */
+
+static void fe51_from_fe(fe51 h, const fe f) {
+  unsigned char s[32];
+  fe_tobytes(s, f);
+  fe51_frombytes(h, s);
+}
+
+/* From fe_frombytes.c */
+static void fe_from_fe51(fe h, const fe51 f) {
+  unsigned char s[32];
+  int64_t h0, h1, h2, h3, h4, h5, h6, h7, h8, h9;
+  int64_t carry0, carry1, carry2, carry3, carry4, carry5, carry6, carry7, carry8, carry9;
+
+  fe51_tobytes(s, f);
+
+  h0 = load_4(s);
+  h1 = load_3(s + 4) << 6;
+  h2 = load_3(s + 7) << 5;
+  h3 = load_3(s + 10) << 3;
+  h4 = load_3(s + 13) << 2;
+  h5 = load_4(s + 16);
+  h6 = load_3(s + 20) << 7;
+  h7 = load_3(s + 23) << 5;
+  h8 = load_3(s + 26) << 4;
+  h9 = (load_3(s + 29) & 8388607) << 2;
+
+  carry9 = (h9 + (int64_t) (1<<24)) >> 25; h0 += carry9 * 19; h9 -= carry9 << 25;
+  carry1 = (h1 + (int64_t) (1<<24)) >> 25; h2 += carry1; h1 -= carry1 << 25;
+  carry3 = (h3 + (int64_t) (1<<24)) >> 25; h4 += carry3; h3 -= carry3 << 25;
+  carry5 = (h5 + (int64_t) (1<<24)) >> 25; h6 += carry5; h5 -= carry5 << 25;
+  carry7 = (h7 + (int64_t) (1<<24)) >> 25; h8 += carry7; h7 -= carry7 << 25;
+
+  carry0 = (h0 + (int64_t) (1<<25)) >> 26; h1 += carry0; h0 -= carry0 << 26;
+  carry2 = (h2 + (int64_t) (1<<25)) >> 26; h3 += carry2; h2 -= carry2 << 26;
+  carry4 = (h4 + (int64_t) (1<<25)) >> 26; h5 += carry4; h4 -= carry4 << 26;
+  carry6 = (h6 + (int64_t) (1<<25)) >> 26; h7 += carry6; h6 -= carry6 << 26;
+  carry8 = (h8 + (int64_t) (1<<25)) >> 26; h9 += carry8; h8 -= carry8 << 26;
+
+  h[0] = (int32_t) h0;
+  h[1] = (int32_t) h1;
+  h[2] = (int32_t) h2;
+  h[3] = (int32_t) h3;
+  h[4] = (int32_t) h4;
+  h[5] = (int32_t) h5;
+  h[6] = (int32_t) h6;
+  h[7] = (int32_t) h7;
+  h[8] = (int32_t) h8;
+  h[9] = (int32_t) h9;
+}
+
+static void ge51_from_p3(ge51_p3 *r, const ge_p3 *p) {
+  fe51_from_fe(r->X, p->X);
+  fe51_from_fe(r->Y, p->Y);
+  fe51_from_fe(r->Z, p->Z);
+  fe51_from_fe(r->T, p->T);
+}
+
+static void ge51_to_p2(ge_p2 *r, const ge51_p2 *p) {
+  fe_from_fe51(r->X, p->X);
+  fe_from_fe51(r->Y, p->Y);
+  fe_from_fe51(r->Z, p->Z);
+}
+
+/* Group operations, see the ref10 ones in crypto-ops.c */
+
+static void ge51_add(ge51_p1p1 *r, const ge51_p3 *p, const ge51_cached *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->YplusX);
+  fe51_mul(r->Y, r->Y, q->YminusX);
+  fe51_mul(r->T, q->T2d, p->T);
+  fe51_mul(r->X, p->Z, q->Z);
+  fe51_add(t0, r->X, r->X);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_add(r->Z, t0, r->T);
+  fe51_sub(r->T, t0, r->T);
+}
+
+static void ge51_sub(ge51_p1p1 *r, const ge51_p3 *p, const ge51_cached *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->YminusX);
+  fe51_mul(r->Y, r->Y, q->YplusX);
+  fe51_mul(r->T, q->T2d, p->T);
+  fe51_mul(r->X, p->Z, q->Z);
+  fe51_add(t0, r->X, r->X);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_sub(r->Z, t0, r->T);
+  fe51_add(r->T, t0, r->T);
+}
+
+static void ge51_madd(ge51_p1p1 *r, const ge51_p3 *p, const ge51_precomp *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->yplusx);
+  fe51_mul(r->Y, r->Y, q->yminusx);
+  fe51_mul(r->T, q->xy2d, p->T);
+  fe51_add(t0, p->Z, p->Z);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_add(r->Z, t0, r->T);
+  fe51_sub(r->T, t0, r->T);
+}
+
+static void ge51_msub(ge51_p1p1 *r, const ge51_p3 *p, const ge51_precomp *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->yminusx);
+  fe51_mul(r->Y, r->Y, q->yplusx);
+  fe51_mul(r->T, q->xy2d, p->T);
+  fe51_add(t0, p->Z, p->Z);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_sub(r->Z, t0, r->T);
+  fe51_add(r->T, t0, r->T);
+}
+
+static void ge51_p1p1_to_p2(ge51_p2 *r, const ge51_p1p1 *p) {
+  fe51_mul(r->X, p->X, p->T);
+  fe51_mul(r->Y, p->Y, p->Z);
+  fe51_mul(r->Z, p->Z, p->T);
+}
+
+static void ge51_p1p1_to_p3(ge51_p3 *r, const ge51_p1p1 *p) {
+  fe51_mul(r->X, p->X, p->T);
+  fe51_mul(r->Y, p->Y, p->Z);
+  fe51_mul(r->Z, p->Z, p->T);
+  fe51_mul(r->T, p->X, p->Y);
+}
+
+static void ge51_p2_0(ge51_p2 *h) {
+  fe51_0(h->X);
+  fe51_1(h->Y);
+  fe51_1(h->Z);
+}
+
+static void ge51_p2_dbl(ge51_p1p1 *r, const ge51_p2 *p) {
+  fe51 t0;
+  fe51_sq(r->X, p->X);
+  fe51_sq(r->Z, p->Y);
+  fe51_sq(r->T, p->Z);
+  fe51_add(r->T, r->T, r->T);
+  fe51_add(r->Y, p->X, p->Y);
+  fe51_sq(t0, r->Y);
+  fe51_add(r->Y, r->Z, r->X);
+  fe51_sub(r->Z, r->Z, r->X);
+  fe51_sub(r->X, t0, r->Y);
+  fe51_sub(r->T, r->T, r->Z);
+}
+
+static void ge51_p3_dbl(ge51_p1p1 *r, const ge51_p3 *p) {
+  ge51_p2 q;
+  fe51_copy(q.X, p->X);
+  fe51_copy(q.Y, p->Y);
+  fe51_copy(q.Z, p->Z);
+  ge51_p2_dbl(r, &q);
+}
+
+static void ge51_p3_to_cached(ge51_cached *r, const ge51_p3 *p) {
+  fe51_add(r->YplusX, p->Y, p->X);
+  fe51_sub(r->YminusX, p->Y, p->X);
+  fe51_copy(r->Z, p->Z);
+  fe51_mul(r->T2d, p->T, fe51_d2);
+}
+
+static void ge51_cached_0(ge51_cached *r) {
+  fe51_1(r->YplusX);
+  fe51_1(r->YminusX);
+  fe51_1(r->Z);
+  fe51_0(r->T2d);
+}
+
+static void ge51_cached_cmov(ge51_cached *t, const ge51_cached *u, unsigned char b) {
+  fe51_cmov(t->YplusX, u->YplusX, b);
+  fe51_cmov(t->YminusX, u->YminusX, b);
+  fe51_cmov(t->Z, u->Z, b);
+  fe51_cmov(t->T2d, u->T2d, b);
+}
+
+static unsigned char equal(signed char b, signed char c) {
+  unsigned char ub = b;
+  unsigned char uc = c;
+  unsigned char x = ub ^ uc; /* 0: yes; 1..255: no */
+  uint32_t y = x; /* 0: yes; 1..255: no */
+  y -= 1; /* 4294967295: yes; 0..254: no */
+  y >>= 31; /* 1: yes; 0: no */
+  return y;
+}
+
+static unsigned char negative(signed char b) {
+  unsigned long long x = b; /* 18446744073709551361..18446744073709551615: yes; 0..255: no */
+  x >>= 63; /* 1: yes; 0: no */
+  return x;
+}
+
+/* From ge_double_scalarmult.c, see slide() in crypto-ops.c */
+static void slide(signed char *r, const unsigned char *a) {
+  int i;
+  int b;
+  int k;
+
+  for (i = 0; i < 256; ++i) {
+    r[i] = 1 & (a[i >> 3] >> (i & 7));
+  }
+
+  for (i = 0; i < 256; ++i) {
+    if (r[i]) {
+      for (b = 1; b <= 6 && i + b < 256; ++b) {
+        if (r[i + b]) {
+          if (r[i] + (r[i + b] << b) <= 15) {
+            r[i] += r[i + b] << b; r[i + b] = 0;
+          } else if (r[i] - (r[i + b] << b) >= -15) {
+            r[i] -= r[i + b] << b;
+            for (k = i + b; k < 256; ++k) {
+              if (!r[k]) {
+                r[k] = 1;
+                break;
+              }
+              r[k] = 0;
+            }
+          } else
+            break;
+        }
+      }
+    }
+  }
+}
+
+/* e is the recoding of ge_scalarmult_recode */
+void ge64_scalarmult_recoded(ge_p2 *res, const signed char *e, const ge_p3 *A3) {
+  int i;
+  ge51_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
+  ge51_p1p1 t;
+  ge51_p3 A, u;
+  ge51_p2 r;
+
+  ge51_from_p3(&A, A3);
+  ge51_p3_to_cached(&Ai[0], &A);
+  for (i = 0; i < 7; i++) {
+    ge51_add(&t, &A, &Ai[i]);
+    ge51_p1p1_to_p3(&u, &t);
+    ge51_p3_to_cached(&Ai[i + 1], &u);
+  }
+
+  ge51_p2_0(&r);
+  for (i = 63; i >= 0; i--) {
+    signed char b = e[i];
+    unsigned char bnegative = negative(b);
+    unsigned char babs = b - (((-bnegative) & b) << 1);
+    ge51_cached cur, minuscur;
+    ge51_p2_dbl(&t, &r);
+    ge51_p1p1_to_p2(&r, &t);
+    ge51_p2_dbl(&t, &r);
+    ge51_p1p1_to_p2(&r, &t);
+    ge51_p2_dbl(&t, &r);
+    ge51_p1p1_to_p2(&r, &t);
+    ge51_p2_dbl(&t, &r);
+    ge51_p1p1_to_p3(&u, &t);
+    ge51_cached_0(&cur);
+    ge51_cached_cmov(&cur, &Ai[0], equal(babs, 1));
+    ge51_cached_cmov(&cur, &Ai[1], equal(babs, 2));
+    ge51_cached_cmov(&cur, &Ai[2], equal(babs, 3));
+    ge51_cached_cmov(&cur, &Ai[3], equal(babs, 4));
+    ge51_cached_cmov(&cur, &Ai[4], equal(babs, 5));
+    ge51_cached_cmov(&cur, &Ai[5], equal(babs, 6));
+    ge51_cached_cmov(&cur, &Ai[6], equal(babs, 7));
+    ge51_cached_cmov(&cur, &Ai[7], equal(babs, 8));
+    fe51_copy(minuscur.YplusX, cur.YminusX);
+    fe51_copy(minuscur.YminusX, cur.YplusX);
+    fe51_copy(minuscur.Z, cur.Z);
+    fe51_neg(minuscur.T2d, cur.T2d);
+    ge51_cached_cmov(&cur, &minuscur, bnegative);
+    ge51_add(&t, &u, &cur);
+    ge51_p1p1_to_p2(&r, &t);
+  }
+
+  ge51_to_p2(res, &r);
+}
+
+void ge64_double_scalarmult_base_vartime(ge_p2 *res, const unsigned char *a, const ge_p3 *A3, const unsigned char *b) {
+  signed char aslide[256];
+  signed char bslide[256];
+  ge51_cached Ai[8]; /* A, 3A, 5A, 7A, 9A, 11A, 13A, 15A */
+  ge51_p1p1 t;
+  ge51_p3 A, A2, u;
+  ge51_p2 r;
+  int i;
+
+  slide(aslide, a);
+  slide(bslide, b);
+
+  ge51_from_p3(&A, A3);
+  ge51_p3_to_cached(&Ai[0], &A);
+  ge51_p3_dbl(&t, &A); ge51_p1p1_to_p3(&A2, &t);
+  for (i = 0; i < 7; i++) {
+    ge51_add(&t, &A2, &Ai[i]);
+    ge51_p1p1_to_p3(&u, &t);
+    ge51_p3_to_cached(&Ai[i + 1], &u);
+  }
+
+  ge51_p2_0(&r);
+
+  for (i = 255; i >= 0; --i) {
+    if (aslide[i] || bslide[i]) break;
+  }
+
+  for (; i >= 0; --i) {
+    ge51_p2_dbl(&t, &r);
+
+    if (aslide[i] > 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_add(&t, &u, &Ai[aslide[i]/2]);
+    } else if (aslide[i] < 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_sub(&t, &u, &Ai[(-aslide[i])/2]);
+    }
+
+    if (bslide[i] > 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_madd(&t, &u, &ge51_Bi[bslide[i]/2]);
+    } else if (bslide[i] < 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_msub(&t, &u, &ge51_Bi[(-bslide[i])/2]);
+    }
+
+    ge51_p1p1_to_p2(&r, &t);
+  }
+
+  ge51_to_p2(res, &r);
+}
+
+#endif
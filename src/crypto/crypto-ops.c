@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "warnings.h"
@@ -1194,6 +1195,14 @@ B is the Ed25519 base point (x,4/5) with x positive.
 */
 
 void ge_double_scalarmult_base_vartime(ge_p2 *r, const unsigned char *a, const ge_p3 *A, const unsigned char *b) {
+#if defined(CRYPTO_OPS_64)
+  ge64_double_scalarmult_base_vartime(r, a, A, b);
+#else
+  ge_double_scalarmult_base_vartime_ref10(r, a, A, b);
+#endif
+}
+
+void ge_double_scalarmult_base_vartime_ref10(ge_p2 *r, const unsigned char *a, const ge_p3 *A, const unsigned char *b) {
   signed char aslide[256];
   signed char bslide[256];
   ge_dsmp Ai; /* A, 3A, 5A, 7A, 9A, 11A, 13A, 15A */
@@ -1663,6 +1672,41 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* ge_tobytes of count points with one field inversion per 64 points; no Z may be zero */
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, size_t count) {
+  fe acc[64];
+  fe recip;
+  fe x;
+  fe y;
+  size_t n, i;
+
+  while (count > 0) {
+    n = count < 64 ? count : 64;
+
+    fe_copy(acc[0], h[0].Z);
+    for (i = 1; i < n; i++)
+      fe_mul(acc[i], acc[i - 1], h[i].Z);
+
+    fe_invert(recip, acc[n - 1]);
+    for (i = n - 1; i > 0; i--) {
+      fe_mul(acc[i], recip, acc[i - 1]); /* 1 / Z[i] */
+      fe_mul(recip, recip, h[i].Z);
+    }
+    fe_copy(acc[0], recip);
+
+    for (i = 0; i < n; i++) {
+      fe_mul(x, h[i].X, acc[i]);
+      fe_mul(y, h[i].Y, acc[i]);
+      fe_tobytes(s + 32 * i, y);
+      s[32 * i + 31] ^= fe_isnegative(x) << 7;
+    }
+
+    s += 32 * n;
+    h += n;
+    count -= n;
+  }
+}
+
 /* From sc_reduce.c */
 
 /*
@@ -1985,12 +2029,8 @@ static void ge_cached_cmov(ge_cached *t, const ge_cached *u, unsigned char b) {
 }
 
 /* Assumes that a[31] <= 127 */
-void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
-  signed char e[64];
+void ge_scalarmult_recode(signed char *e, const unsigned char *a) {
   int carry, carry2, i;
-  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
-  ge_p1p1 t;
-  ge_p3 u;
 
   carry = 0; /* 0..1 */
   for (i = 0; i < 31; i++) {
@@ -2004,6 +2044,13 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   carry2 = (carry + 8) >> 4; /* 0..8 */
   e[62] = carry - (carry2 << 4); /* -8..7 */
   e[63] = carry2; /* 0..8 */
+}
+
+static void ge_scalarmult_recoded_ref10(ge_p2 *r, const signed char *e, const ge_p3 *A) {
+  int i;
+  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
+  ge_p1p1 t;
+  ge_p3 u;
 
   ge_p3_to_cached(&Ai[0], A);
   for (i = 0; i < 7; i++) {
@@ -2045,6 +2092,27 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   }
 }
 
+void ge_scalarmult_recoded(ge_p2 *r, const signed char *e, const ge_p3 *A) {
+#if defined(CRYPTO_OPS_64)
+  ge64_scalarmult_recoded(r, e, A);
+#else
+  ge_scalarmult_recoded_ref10(r, e, A);
+#endif
+}
+
+/* Assumes that a[31] <= 127 */
+void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
+  signed char e[64];
+  ge_scalarmult_recode(e, a);
+  ge_scalarmult_recoded(r, e, A);
+}
+
+void ge_scalarmult_ref10(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
+  signed char e[64];
+  ge_scalarmult_recode(e, a);
+  ge_scalarmult_recoded_ref10(r, e, A);
+}
+
 void ge_scalarmult_p3(ge_p3 *r3, const unsigned char *a, const ge_p3 *A) {
   signed char e[64];
   int carry, carry2, i;
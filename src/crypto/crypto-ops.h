@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 /* From fe.h */
 
 typedef int32_t fe[10];
@@ -79,6 +81,7 @@ typedef ge_cached ge_dsmp[8];
 extern const ge_precomp ge_Bi[8];
 void ge_dsm_precomp(ge_dsmp r, const ge_p3 *s);
 void ge_double_scalarmult_base_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *);
+void ge_double_scalarmult_base_vartime_ref10(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *);
 void ge_double_scalarmult_base_vartime_p3(ge_p3 *, const unsigned char *, const ge_p3 *, const unsigned char *);
 
 /* From ge_frombytes.c, modified */
@@ -128,6 +131,10 @@ void sc_reduce(unsigned char *);
 /* New code */
 
 void ge_scalarmult(ge_p2 *, const unsigned char *, const ge_p3 *);
+void ge_scalarmult_ref10(ge_p2 *, const unsigned char *, const ge_p3 *);
+void ge_scalarmult_recode(signed char *, const unsigned char *); /* signed char[64] */
+void ge_scalarmult_recoded(ge_p2 *, const signed char *, const ge_p3 *);
+void ge_tobytes_batch(unsigned char *, const ge_p2 *, size_t);
 void ge_scalarmult_p3(ge_p3 *, const unsigned char *, const ge_p3 *);
 void ge_double_scalarmult_precomp_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *, const ge_dsmp);
 void ge_double_scalarmult_precomp_vartime2(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
@@ -161,3 +168,12 @@ void fe_tobytes(unsigned char *, const fe);
 void fe_invert(fe out, const fe z);
 
 int ge_p3_is_point_at_infinity(const ge_p3 *p);
+
+/* From crypto-ops-64.c: ge_scalarmult_recoded and ge_double_scalarmult_base_vartime on radix 2^51 field elements,
+   used by them when 64x64->128 bit multiplications are available */
+
+#if defined(__SIZEOF_INT128__)
+#define CRYPTO_OPS_64 1
+void ge64_scalarmult_recoded(ge_p2 *, const signed char *, const ge_p3 *);
+void ge64_double_scalarmult_base_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *);
+#endif
@@ -29,14 +29,13 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/lock_guard.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "common/varint.h"
@@ -91,9 +90,8 @@ namespace crypto {
 
   void generate_random_bytes_thread_safe(size_t N, uint8_t *bytes)
   {
-    static boost::mutex random_lock;
-    boost::lock_guard<boost::mutex> lock(random_lock);
-    generate_random_bytes_not_thread_safe(N, bytes);
+    // each thread has its own generator, so parallel tx construction and proving don't serialize on a lock
+    generate_random_bytes_thread_local(N, bytes);
   }
 
   static inline bool less32(const unsigned char *k0, const unsigned char *k1)
@@ -186,6 +184,38 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::generate_key_derivations(const secret_key &key2, epee::span<const public_key> keys, epee::span<key_derivation> derivations) {
+    static constexpr size_t BATCH_SIZE = 64;
+    signed char e[64];
+    ge_p2 points[BATCH_SIZE];
+    unsigned char bytes[BATCH_SIZE * 32];
+    size_t indices[BATCH_SIZE];
+    bool valid = true;
+    assert(sc_check(&key2) == 0);
+    assert(keys.size() == derivations.size());
+    ge_scalarmult_recode(e, &unwrap(key2));
+    for (size_t begin = 0; begin < keys.size(); begin += BATCH_SIZE) {
+      const size_t end = std::min(keys.size(), begin + BATCH_SIZE);
+      size_t count = 0;
+      for (size_t i = begin; i < end; ++i) {
+        ge_p3 point;
+        ge_p1p1 point3;
+        if (ge_frombytes_vartime(&point, &keys.data()[i]) != 0) {
+          valid = false;
+          continue;
+        }
+        ge_scalarmult_recoded(&points[count], e, &point);
+        ge_mul8(&point3, &points[count]);
+        ge_p1p1_to_p2(&points[count], &point3);
+        indices[count++] = i;
+      }
+      ge_tobytes_batch(bytes, points, count);
+      for (size_t i = 0; i < count; ++i)
+        memcpy(&derivations.data()[indices[i]], bytes + 32 * i, 32);
+    }
+    return valid;
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     struct {
       key_derivation derivation;
@@ -312,6 +342,46 @@ namespace crypto {
     return sc_isnonzero(&c) == 0;
   }
 
+  bool crypto_ops::check_signatures(const hash &prefix_hash, epee::span<const public_key> pubs, epee::span<const signature> sigs) {
+    static constexpr size_t BATCH_SIZE = 64;
+    static const ec_point infinity = {{ 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    ge_p2 comms[BATCH_SIZE];
+    unsigned char bytes[BATCH_SIZE * 32];
+    if (pubs.size() != sigs.size())
+      return false;
+    for (size_t begin = 0; begin < pubs.size(); begin += BATCH_SIZE) {
+      const size_t end = std::min(pubs.size(), begin + BATCH_SIZE);
+      for (size_t i = begin; i < end; ++i) {
+        const public_key &pub = pubs.data()[i];
+        const signature &sig = sigs.data()[i];
+        ge_p3 tmp3;
+        assert(check_key(pub));
+        if (ge_frombytes_vartime(&tmp3, &pub) != 0) {
+          return false;
+        }
+        if (sc_check(&sig.c) != 0 || sc_check(&sig.r) != 0 || !sc_isnonzero(&sig.c)) {
+          return false;
+        }
+        ge_double_scalarmult_base_vartime(&comms[i - begin], &sig.c, &tmp3, &sig.r);
+      }
+      ge_tobytes_batch(bytes, comms, end - begin);
+      for (size_t i = begin; i < end; ++i) {
+        ec_scalar c;
+        s_comm buf;
+        buf.h = prefix_hash;
+        buf.key = pubs.data()[i];
+        memcpy(&buf.comm, bytes + 32 * (i - begin), 32);
+        if (memcmp(&buf.comm, &infinity, 32) == 0)
+          return false;
+        hash_to_scalar(&buf, sizeof(s_comm), c);
+        sc_sub(&c, &c, &sigs.data()[i].c);
+        if (sc_isnonzero(&c) != 0)
+          return false;
+      }
+    }
+    return true;
+  }
+
   void crypto_ops::generate_tx_proof(const hash &prefix_hash, const public_key &R, const public_key &A, const boost::optional<public_key> &B, const public_key &D, const secret_key &r, signature &sig) {
     // sanity check
     ge_p3 R_p3;
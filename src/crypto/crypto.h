@@ -120,6 +120,8 @@ namespace crypto {
     friend bool secret_key_to_public_key(const secret_key &, public_key &);
     static bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
     friend bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
+    static bool generate_key_derivations(const secret_key &, epee::span<const public_key>, epee::span<key_derivation>);
+    friend bool generate_key_derivations(const secret_key &, epee::span<const public_key>, epee::span<key_derivation>);
     static void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     friend void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     static bool derive_public_key(const key_derivation &, std::size_t, const public_key &, public_key &);
@@ -132,6 +134,8 @@ namespace crypto {
     friend void generate_signature(const hash &, const public_key &, const secret_key &, signature &);
     static bool check_signature(const hash &, const public_key &, const signature &);
     friend bool check_signature(const hash &, const public_key &, const signature &);
+    static bool check_signatures(const hash &, epee::span<const public_key>, epee::span<const signature>);
+    friend bool check_signatures(const hash &, epee::span<const public_key>, epee::span<const signature>);
     static void generate_tx_proof(const hash &, const public_key &, const public_key &, const boost::optional<public_key> &, const public_key &, const secret_key &, signature &);
     friend void generate_tx_proof(const hash &, const public_key &, const public_key &, const boost::optional<public_key> &, const public_key &, const secret_key &, signature &);
     static bool check_tx_proof(const hash &, const public_key &, const public_key &, const boost::optional<public_key> &, const public_key &, const signature &);
@@ -192,6 +196,13 @@ namespace crypto {
   inline bool generate_key_derivation(const public_key &key1, const secret_key &key2, key_derivation &derivation) {
     return crypto_ops::generate_key_derivation(key1, key2, derivation);
   }
+  /* Same as generate_key_derivation for each of keys with the same secret key, sharing the scalar recoding and
+   * the final field inversions. Returns false if any of keys is not a valid point, the derivations of those keys
+   * are left unchanged.
+   */
+  inline bool generate_key_derivations(const secret_key &key2, epee::span<const public_key> keys, epee::span<key_derivation> derivations) {
+    return crypto_ops::generate_key_derivations(key2, keys, derivations);
+  }
   inline bool derive_public_key(const key_derivation &derivation, std::size_t output_index,
     const public_key &base, public_key &derived_key) {
     return crypto_ops::derive_public_key(derivation, output_index, base, derived_key);
@@ -215,6 +226,12 @@ namespace crypto {
   inline bool check_signature(const hash &prefix_hash, const public_key &pub, const signature &sig) {
     return crypto_ops::check_signature(prefix_hash, pub, sig);
   }
+  /* Same as check_signature for each of pubs and sigs signing the same prefix hash, sharing the final field
+   * inversions of the commitments. Returns true if all signatures are valid.
+   */
+  inline bool check_signatures(const hash &prefix_hash, epee::span<const public_key> pubs, epee::span<const signature> sigs) {
+    return crypto_ops::check_signatures(prefix_hash, pubs, sigs);
+  }
 
   /* Generation and checking of a tx proof; given a tx pubkey R, the recipient's view pubkey A, and the key 
    * derivation D, the signature proves the knowledge of the tx secret key r such that R=r*G and D=r*A
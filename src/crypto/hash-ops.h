@@ -84,7 +84,13 @@ enum {
 #define CN_MODIFIER_REVERSE_WALTZ   CN_MODIFIER_WALTZ | CN_MODIFIER_REVERSE
 
 void cn_fast_hash(const void *data, size_t length, char *hash);
+void cn_fast_hash_batch(const void *const *data, const size_t *length, char (*hashes)[HASH_SIZE], size_t count);
 void cn_slow_hash(const void *data, size_t length, char *hash, int variant, int prehashed, int modifier);
+void cn_slow_hash_allocate_state(void);
+void cn_slow_hash_free_state(void);
+// benchmark overrides: huge_pages 0 to allocate the scratchpad with malloc, software_aes 1/0 to force software/hardware AES or -1 for the default
+void cn_slow_hash_set_options(int huge_pages, int software_aes);
+int cn_slow_hash_huge_pages_allocated(void);
 
 void hash_extra_blake(const void *data, size_t length, char *hash);
 void hash_extra_groestl(const void *data, size_t length, char *hash);
@@ -100,3 +106,7 @@ uint64_t rx_seedheight(const uint64_t height);
 void rx_seedheights(const uint64_t height, uint64_t *seed_height, uint64_t *next_height);
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length, char *hash, int miners, int is_alt);
 void rx_reorg(const uint64_t split_height);
+void rx_prepare_seedhash(const uint64_t seedheight, const char *seedhash);
+void rx_mining_hash_first(const uint64_t seedheight, const char *seedhash, const void *data, size_t length, int miners);
+void rx_mining_hash_next(const void *next_data, size_t length, char *hash);
+size_t rx_memory_usage(void);
@@ -48,3 +48,7 @@ void cn_fast_hash(const void *data, size_t length, char *hash) {
   hash_process(&state, data, length);
   memcpy(hash, &state, HASH_SIZE);
 }
+
+void cn_fast_hash_batch(const void *const *data, const size_t *length, char (*hashes)[HASH_SIZE], size_t count) {
+  keccak_batch((const uint8_t *const *)data, length, (uint8_t*)hashes, count);
+}
@@ -71,6 +71,11 @@ namespace crypto {
     return h;
   }
 
+  /// the same as cn_fast_hash of each message, hashes must not overlap the messages
+  inline void cn_fast_hash_batch(const void *const *data, const std::size_t *length, hash *hashes, std::size_t count) {
+    cn_fast_hash_batch(data, length, reinterpret_cast<char (*)[HASH_SIZE]>(hashes), count);
+  }
+
   inline void cn_slow_hash(const void *data, std::size_t length, hash &hash, int variant = 0, int modifier = 0) {
     cn_slow_hash(data, length, reinterpret_cast<char *>(&hash), variant, 0/*prehashed*/, modifier);
   }
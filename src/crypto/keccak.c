@@ -211,3 +211,227 @@ void keccak_finish(KECCAK_CTX * ctx, uint8_t *md){
         memcpy(md, ctx->hash, KECCAK_DIGESTSIZE);
     }
 }
+
+#define KECCAK_DIGEST_WORDS (KECCAK_DIGESTSIZE / 8)
+
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#define KECCAK_MULTI_BUFFER 1
+#include <immintrin.h>
+
+#define KECCAK_MAX_LANES 8
+
+// one round over interleaved lanes, the K_* operations are defined by each implementation
+#define KECCAK_LANES_ROUND(A, B, C, D, rc) \
+  C[0] = K_XOR5(A[0], A[5], A[10], A[15], A[20]);  \
+  C[1] = K_XOR5(A[1], A[6], A[11], A[16], A[21]);  \
+  C[2] = K_XOR5(A[2], A[7], A[12], A[17], A[22]);  \
+  C[3] = K_XOR5(A[3], A[8], A[13], A[18], A[23]);  \
+  C[4] = K_XOR5(A[4], A[9], A[14], A[19], A[24]);  \
+  D[0] = K_XOR(C[4], K_ROL(C[1], 1));              \
+  D[1] = K_XOR(C[0], K_ROL(C[2], 1));              \
+  D[2] = K_XOR(C[1], K_ROL(C[3], 1));              \
+  D[3] = K_XOR(C[2], K_ROL(C[4], 1));              \
+  D[4] = K_XOR(C[3], K_ROL(C[0], 1));              \
+  B[0] = K_ROL(K_XOR(A[0], D[0]), 0);              \
+  B[10] = K_ROL(K_XOR(A[1], D[1]), 1);             \
+  B[20] = K_ROL(K_XOR(A[2], D[2]), 62);            \
+  B[5] = K_ROL(K_XOR(A[3], D[3]), 28);             \
+  B[15] = K_ROL(K_XOR(A[4], D[4]), 27);            \
+  B[16] = K_ROL(K_XOR(A[5], D[0]), 36);            \
+  B[1] = K_ROL(K_XOR(A[6], D[1]), 44);             \
+  B[11] = K_ROL(K_XOR(A[7], D[2]), 6);             \
+  B[21] = K_ROL(K_XOR(A[8], D[3]), 55);            \
+  B[6] = K_ROL(K_XOR(A[9], D[4]), 20);             \
+  B[7] = K_ROL(K_XOR(A[10], D[0]), 3);             \
+  B[17] = K_ROL(K_XOR(A[11], D[1]), 10);           \
+  B[2] = K_ROL(K_XOR(A[12], D[2]), 43);            \
+  B[12] = K_ROL(K_XOR(A[13], D[3]), 25);           \
+  B[22] = K_ROL(K_XOR(A[14], D[4]), 39);           \
+  B[23] = K_ROL(K_XOR(A[15], D[0]), 41);           \
+  B[8] = K_ROL(K_XOR(A[16], D[1]), 45);            \
+  B[18] = K_ROL(K_XOR(A[17], D[2]), 15);           \
+  B[3] = K_ROL(K_XOR(A[18], D[3]), 21);            \
+  B[13] = K_ROL(K_XOR(A[19], D[4]), 8);            \
+  B[14] = K_ROL(K_XOR(A[20], D[0]), 18);           \
+  B[24] = K_ROL(K_XOR(A[21], D[1]), 2);            \
+  B[9] = K_ROL(K_XOR(A[22], D[2]), 61);            \
+  B[19] = K_ROL(K_XOR(A[23], D[3]), 56);           \
+  B[4] = K_ROL(K_XOR(A[24], D[4]), 14);            \
+  A[0] = K_CHI(B[0], B[1], B[2]);                  \
+  A[1] = K_CHI(B[1], B[2], B[3]);                  \
+  A[2] = K_CHI(B[2], B[3], B[4]);                  \
+  A[3] = K_CHI(B[3], B[4], B[0]);                  \
+  A[4] = K_CHI(B[4], B[0], B[1]);                  \
+  A[5] = K_CHI(B[5], B[6], B[7]);                  \
+  A[6] = K_CHI(B[6], B[7], B[8]);                  \
+  A[7] = K_CHI(B[7], B[8], B[9]);                  \
+  A[8] = K_CHI(B[8], B[9], B[5]);                  \
+  A[9] = K_CHI(B[9], B[5], B[6]);                  \
+  A[10] = K_CHI(B[10], B[11], B[12]);              \
+  A[11] = K_CHI(B[11], B[12], B[13]);              \
+  A[12] = K_CHI(B[12], B[13], B[14]);              \
+  A[13] = K_CHI(B[13], B[14], B[10]);              \
+  A[14] = K_CHI(B[14], B[10], B[11]);              \
+  A[15] = K_CHI(B[15], B[16], B[17]);              \
+  A[16] = K_CHI(B[16], B[17], B[18]);              \
+  A[17] = K_CHI(B[17], B[18], B[19]);              \
+  A[18] = K_CHI(B[18], B[19], B[15]);              \
+  A[19] = K_CHI(B[19], B[15], B[16]);              \
+  A[20] = K_CHI(B[20], B[21], B[22]);              \
+  A[21] = K_CHI(B[21], B[22], B[23]);              \
+  A[22] = K_CHI(B[22], B[23], B[24]);              \
+  A[23] = K_CHI(B[23], B[24], B[20]);              \
+  A[24] = K_CHI(B[24], B[20], B[21]);              \
+  A[0] = K_RC(A[0], rc);
+// while a lane has no message left it keeps permuting garbage, its result is ignored
+static void keccak_lanes(const uint8_t *const *in, const size_t *inlen, uint8_t *md, size_t count,
+    size_t lanes, void (*permute)(uint64_t *st))
+{
+    uint64_t st[25 * KECCAK_MAX_LANES] __attribute__((aligned(64)));
+    uint64_t block[KECCAK_WORDS];
+    const uint8_t *lane_in[KECCAK_MAX_LANES];
+    size_t lane_left[KECCAK_MAX_LANES], lane_msg[KECCAK_MAX_LANES];
+    int lane_final[KECCAK_MAX_LANES];
+    size_t next = 0, active = 0, lane, i;
+
+    for (lane = 0; lane < lanes; lane++)
+        lane_msg[lane] = count;
+
+    for (;;) {
+        for (lane = 0; lane < lanes; lane++) {
+            if (lane_msg[lane] == count) {
+                if (next == count)
+                    continue;
+                lane_msg[lane] = next;
+                lane_in[lane] = in[next];
+                lane_left[lane] = inlen[next];
+                ++next;
+                ++active;
+                for (i = 0; i < 25; i++)
+                    st[i * lanes + lane] = 0;
+            }
+
+            // same blocks and padding as keccak()
+            if (lane_left[lane] >= KECCAK_BLOCKLEN) {
+                memcpy(block, lane_in[lane], KECCAK_BLOCKLEN);
+                lane_in[lane] += KECCAK_BLOCKLEN;
+                lane_left[lane] -= KECCAK_BLOCKLEN;
+                lane_final[lane] = 0;
+            } else {
+                memcpy(block, lane_in[lane], lane_left[lane]);
+                ((uint8_t*)block)[lane_left[lane]] = 1;
+                memset((uint8_t*)block + lane_left[lane] + 1, 0, KECCAK_BLOCKLEN - lane_left[lane] - 1);
+                ((uint8_t*)block)[KECCAK_BLOCKLEN - 1] |= 0x80;
+                lane_final[lane] = 1;
+            }
+            for (i = 0; i < KECCAK_WORDS; i++)
+                st[i * lanes + lane] ^= swap64le(block[i]);
+        }
+
+        if (!active)
+            break;
+
+        permute(st);
+
+        for (lane = 0; lane < lanes; lane++) {
+            if (lane_msg[lane] == count || !lane_final[lane])
+                continue;
+            for (i = 0; i < KECCAK_DIGEST_WORDS; i++) {
+                const uint64_t w = swap64le(st[i * lanes + lane]);
+                memcpy(md + KECCAK_DIGESTSIZE * lane_msg[lane] + 8 * i, &w, 8);
+            }
+            lane_msg[lane] = count;
+            --active;
+        }
+    }
+}
+
+#define K_XOR(a, b) _mm256_xor_si256(a, b)
+#define K_XOR5(a, b, c, d, e) _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(c, d)), e)
+#define K_ROL(a, n) _mm256_or_si256(_mm256_slli_epi64(a, n), _mm256_srli_epi64(a, 64 - (n)))
+#define K_CHI(a, b, c) _mm256_xor_si256(a, _mm256_andnot_si256(b, c))
+#define K_RC(a, rc) _mm256_xor_si256(a, _mm256_set1_epi64x((long long)(rc)))
+
+__attribute__((target("avx2")))
+static void keccakf_x4_avx2(uint64_t *st)
+{
+    __m256i A[25], B[25], C[5], D[5];
+    int i, round;
+
+    for (i = 0; i < 25; i++)
+        A[i] = _mm256_load_si256((const __m256i*)(st + 4 * i));
+    for (round = 0; round < KECCAK_ROUNDS; round++) {
+        KECCAK_LANES_ROUND(A, B, C, D, keccakf_rndc[round])
+    }
+    for (i = 0; i < 25; i++)
+        _mm256_store_si256((__m256i*)(st + 4 * i), A[i]);
+}
+
+#undef K_XOR
+#undef K_XOR5
+#undef K_ROL
+#undef K_CHI
+#undef K_RC
+
+#define K_XOR(a, b) _mm512_xor_si512(a, b)
+#define K_XOR5(a, b, c, d, e) _mm512_ternarylogic_epi64(_mm512_ternarylogic_epi64(a, b, c, 0x96), d, e, 0x96)
+#define K_ROL(a, n) _mm512_rol_epi64(a, n)
+#define K_CHI(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0xd2)
+#define K_RC(a, rc) _mm512_xor_si512(a, _mm512_set1_epi64((long long)(rc)))
+
+__attribute__((target("avx512f")))
+static void keccakf_x8_avx512(uint64_t *st)
+{
+    __m512i A[25], B[25], C[5], D[5];
+    int i, round;
+
+    for (i = 0; i < 25; i++)
+        A[i] = _mm512_load_si512((const void*)(st + 8 * i));
+    for (round = 0; round < KECCAK_ROUNDS; round++) {
+        KECCAK_LANES_ROUND(A, B, C, D, keccakf_rndc[round])
+    }
+    for (i = 0; i < 25; i++)
+        _mm512_store_si512((void*)(st + 8 * i), A[i]);
+}
+
+#undef K_XOR
+#undef K_XOR5
+#undef K_ROL
+#undef K_CHI
+#undef K_RC
+
+static int keccak_has_avx2(void)
+{
+    static int has_avx2 = -1;
+    if (has_avx2 < 0)
+        has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return has_avx2;
+}
+
+static int keccak_has_avx512(void)
+{
+    static int has_avx512 = -1;
+    if (has_avx512 < 0)
+        has_avx512 = __builtin_cpu_supports("avx512f") ? 1 : 0;
+    return has_avx512;
+}
+#endif
+
+void keccak_batch(const uint8_t *const *in, const size_t *inlen, uint8_t *md, size_t count)
+{
+    size_t i;
+
+#if defined(KECCAK_MULTI_BUFFER)
+    if (count > 4 && keccak_has_avx512()) {
+        keccak_lanes(in, inlen, md, count, 8, keccakf_x8_avx512);
+        return;
+    }
+    if (count > 1 && keccak_has_avx2()) {
+        keccak_lanes(in, inlen, md, count, 4, keccakf_x4_avx2);
+        return;
+    }
+#endif
+
+    for (i = 0; i < count; i++)
+        keccak(in[i], inlen[i], md + KECCAK_DIGESTSIZE * i, KECCAK_DIGESTSIZE);
+}
@@ -34,6 +34,10 @@ void keccakf(uint64_t st[25], int norounds);
 
 void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md);
 
+// compute 32 byte keccak hashes of count messages into md, the same as keccak(in[i], inlen[i], md + 32 * i, 32),
+// several messages are hashed at once when the cpu supports it, md must not overlap the messages
+void keccak_batch(const uint8_t *const *in, const size_t *inlen, uint8_t *md, size_t count);
+
 void keccak_init(KECCAK_CTX * ctx);
 void keccak_update(KECCAK_CTX * ctx, const uint8_t *in, size_t inlen);
 void keccak_finish(KECCAK_CTX * ctx, uint8_t *md);
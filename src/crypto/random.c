@@ -109,9 +109,87 @@ FINALIZER(deinit_random) {
   memset(&state, 0, sizeof(union hash_state));
 }
 
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+enum {
+  RESEED_INTERVAL = 1 << 16 /* permutations of a thread state between mixing in system entropy */
+};
+
+/* Generator of one thread: the keccak state, output bytes of its rate area are handed out
+ * until they are used up, so small requests share one permutation */
+struct thread_random_state {
+  union hash_state state;
+  size_t used;
+  size_t permutations;
+  unsigned generation; /* fork_generation the state was seeded in, 0 if it is not seeded yet */
+};
+
+static THREAD_LOCAL struct thread_random_state thread_state;
+static volatile unsigned fork_generation = 1;
+
+#if !defined(_WIN32)
+#include <pthread.h>
+
+/* the child has a copy of the parent's states, so they are reseeded before the next use */
+static void random_fork_child(void) {
+  ++fork_generation;
+}
+#endif
+
+static void mix_system_random_bytes(struct thread_random_state *ts) {
+  uint8_t seed[32];
+  size_t i;
+  generate_system_random_bytes(sizeof(seed), seed);
+  for (i = 0; i < sizeof(seed); i++) {
+    ts->state.b[i] ^= seed[i];
+  }
+  memset(seed, 0, sizeof(seed));
+  hash_permutation(&ts->state);
+  ts->used = HASH_DATA_AREA;
+  ts->permutations = 0;
+}
+
+void generate_random_bytes_thread_local(size_t n, void *result) {
+  struct thread_random_state *ts = &thread_state;
+  if (ts->generation != fork_generation) {
+    if (ts->generation == 0) {
+      memset(&ts->state, 0, sizeof(union hash_state));
+    }
+    mix_system_random_bytes(ts);
+    ts->generation = fork_generation;
+  }
+  while (n > 0) {
+    size_t chunk;
+    if (ts->used == HASH_DATA_AREA) {
+      if (++ts->permutations >= RESEED_INTERVAL) {
+        mix_system_random_bytes(ts);
+      }
+      hash_permutation(&ts->state);
+      ts->used = 0;
+    }
+    chunk = HASH_DATA_AREA - ts->used;
+    if (chunk > n) {
+      chunk = n;
+    }
+    memcpy(result, ts->state.b + ts->used, chunk);
+    /* bytes handed out are not kept in the state, the capacity part still carries its entropy */
+    memset(ts->state.b + ts->used, 0, chunk);
+    ts->used += chunk;
+    result = padd(result, chunk);
+    n -= chunk;
+  }
+}
+
 INITIALIZER(init_random) {
   generate_system_random_bytes(32, &state);
   REGISTER_FINALIZER(deinit_random);
+#if !defined(_WIN32)
+  pthread_atfork(NULL, NULL, random_fork_child);
+#endif
 #if !defined(NDEBUG)
   assert(curstate == 0);
   curstate = 1;
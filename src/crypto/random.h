@@ -33,3 +33,5 @@
 #include <stddef.h>
 
 void generate_random_bytes_not_thread_safe(size_t n, void *result);
+/* Per-thread generator seeded from the OS on first use in a thread (and after fork), reseeded periodically */
+void generate_random_bytes_thread_local(size_t n, void *result);
@@ -35,6 +35,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#endif
+
 #include "randomx.h"
 #include "c_threads.h"
 #include "hash-ops.h"
@@ -179,7 +187,65 @@ void rx_seedheights(const uint64_t height, uint64_t *seedheight, uint64_t *nexth
   *nextheight = rx_seedheight(height + SEEDHASH_EPOCH_LAG);
 }
 
+typedef struct prepareinfo {
+  uint64_t pi_height;
+  char pi_hash[32];
+} prepareinfo;
+
+static CTHR_MUTEX_TYPE rx_prepare_mutex = CTHR_MUTEX_INIT;
+static CTHR_THREAD_TYPE rx_prepare_thread;
+static int rx_prepare_started;
+static prepareinfo rx_prepare_info;
+
+/* builds the cache of the next seed epoch in its slot, the current epoch uses the other one */
+static CTHR_THREAD_RTYPE rx_preparethread(void *arg) {
+  prepareinfo *pi = arg;
+  int toggle = (pi->pi_height & SEEDHASH_EPOCH_BLOCKS) != 0;
+  rx_state *rx_sp = &rx_s[toggle];
+  randomx_flags flags = RANDOMX_FLAG_DEFAULT;
+  randomx_cache *cache;
+
+  CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
+  if (rx_sp->rs_height != pi->pi_height || rx_sp->rs_cache == NULL || memcmp(pi->pi_hash, rx_sp->rs_hash, sizeof(rx_sp->rs_hash))) {
+    cache = rx_sp->rs_cache;
+    if (cache == NULL) {
+      if (use_rx_jit())
+        flags |= RANDOMX_FLAG_JIT;
+      cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+      if (cache == NULL)
+        cache = randomx_alloc_cache(flags);
+    }
+    if (cache != NULL) {
+      mdebug(RX_LOGCAT, "Preparing RandomX cache for the next seed");
+      randomx_init_cache(cache, pi->pi_hash, 32);
+      rx_sp->rs_cache = cache;
+      rx_sp->rs_height = pi->pi_height;
+      memcpy(rx_sp->rs_hash, pi->pi_hash, sizeof(rx_sp->rs_hash));
+    }
+  }
+  CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+  CTHR_THREAD_RETURN;
+}
+
+void rx_prepare_seedhash(const uint64_t seedheight, const char *seedhash) {
+  CTHR_MUTEX_LOCK(rx_prepare_mutex);
+  if (rx_prepare_started) {
+    if (rx_prepare_info.pi_height == seedheight && !memcmp(rx_prepare_info.pi_hash, seedhash, sizeof(rx_prepare_info.pi_hash))) {
+      CTHR_MUTEX_UNLOCK(rx_prepare_mutex);
+      return;
+    }
+    CTHR_THREAD_JOIN(rx_prepare_thread);
+    rx_prepare_started = 0;
+  }
+  rx_prepare_info.pi_height = seedheight;
+  memcpy(rx_prepare_info.pi_hash, seedhash, sizeof(rx_prepare_info.pi_hash));
+  CTHR_THREAD_CREATE(rx_prepare_thread, rx_preparethread, &rx_prepare_info);
+  rx_prepare_started = 1;
+  CTHR_MUTEX_UNLOCK(rx_prepare_mutex);
+}
+
 typedef struct seedinfo {
+  randomx_dataset *si_dataset;
   randomx_cache *si_cache;
   unsigned long si_start;
   unsigned long si_count;
@@ -187,11 +253,11 @@ typedef struct seedinfo {
 
 static CTHR_THREAD_RTYPE rx_seedthread(void *arg) {
   seedinfo *si = arg;
-  randomx_init_dataset(rx_dataset, si->si_cache, si->si_start, si->si_count);
+  randomx_init_dataset(si->si_dataset, si->si_cache, si->si_start, si->si_count);
   CTHR_THREAD_RETURN;
 }
 
-static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_t seedheight) {
+static void rx_initdataset(randomx_dataset *rd, randomx_cache *rs_cache, const int miners) {
   if (miners > 1) {
     unsigned long delta = randomx_dataset_item_count() / miners;
     unsigned long start = 0;
@@ -207,29 +273,209 @@ static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_
       local_abort("Couldn't allocate RandomX mining threadlist");
     }
     for (i=0; i<miners-1; i++) {
+      si[i].si_dataset = rd;
       si[i].si_cache = rs_cache;
       si[i].si_start = start;
       si[i].si_count = delta;
       start += delta;
     }
+    si[i].si_dataset = rd;
     si[i].si_cache = rs_cache;
     si[i].si_start = start;
     si[i].si_count = randomx_dataset_item_count() - start;
     for (i=1; i<miners; i++) {
       CTHR_THREAD_CREATE(st[i], rx_seedthread, &si[i]);
     }
-    randomx_init_dataset(rx_dataset, rs_cache, 0, si[0].si_count);
+    randomx_init_dataset(rd, rs_cache, 0, si[0].si_count);
     for (i=1; i<miners; i++) {
       CTHR_THREAD_JOIN(st[i]);
     }
     free(st);
     free(si);
   } else {
-    randomx_init_dataset(rx_dataset, rs_cache, 0, randomx_dataset_item_count());
+    randomx_init_dataset(rd, rs_cache, 0, randomx_dataset_item_count());
   }
+}
+
+static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_t seedheight) {
+  rx_initdataset(rx_dataset, rs_cache, miners);
   rx_dataset_height = seedheight;
 }
 
+#if defined(__linux__)
+
+/* Opt-in full dataset verification shared by all local processes.  MONERO_RANDOMX_SHARED_DATASET
+ * names a file, preferably on hugetlbfs (e.g. /dev/hugepages/graft-rx) or else on tmpfs, which
+ * holds a header and one 2GB dataset.  The first process seeing a newer mainchain seed rebuilds
+ * it; readers use a sequence number to discard hashes computed while it was being rebuilt and
+ * fall back to the light cache whenever the dataset does not match their seed. */
+
+#define RX_SHARED_MAGIC	0x47524654524e5831ULL	/* "GRFTRNX1" */
+
+typedef struct rx_shared_header {
+  uint64_t sh_magic;
+  uint64_t sh_seq;	/* odd while the dataset is being rebuilt */
+  uint64_t sh_seedheight;
+  char sh_hash[32];
+} rx_shared_header;
+
+static CTHR_MUTEX_TYPE rx_shared_mutex = CTHR_MUTEX_INIT;
+static volatile int rx_shared_state = -1;	/* -1 unknown, 0 disabled, 1 ready */
+static int rx_shared_fd = -1;
+static rx_shared_header *rx_shared_hdr;
+static randomx_dataset *rx_shared_dataset;
+static THREADV randomx_vm *rx_shared_vm = NULL;
+
+/* RandomX allocates dataset memory itself, so a dataset is allocated as usual (its memory is never
+ * touched, hence never resident) and its memory pointer is redirected to the shared mapping.
+ * Only done after checking that the pointer is where randomx_get_dataset_memory finds it. */
+static int rx_shared_redirect(randomx_dataset *rd, void *memory) {
+  void **slot = (void **)rd;
+  if (*slot != randomx_get_dataset_memory(rd))
+    return 0;
+  *slot = memory;
+  return 1;
+}
+
+static int rx_shared_open(void) {
+  const char *path;
+  struct statfs sfs;
+  struct stat st;
+  size_t block, header_size, dataset_size, total;
+  void *map;
+
+  if (rx_shared_state != -1)
+    return rx_shared_state;
+
+  CTHR_MUTEX_LOCK(rx_shared_mutex);
+  if (rx_shared_state != -1) {
+    CTHR_MUTEX_UNLOCK(rx_shared_mutex);
+    return rx_shared_state;
+  }
+  rx_shared_state = 0;
+
+  path = getenv("MONERO_RANDOMX_SHARED_DATASET");
+  if (path == NULL || *path == '\0')
+    goto out;
+
+  rx_shared_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (rx_shared_fd < 0) {
+    mwarning(RX_LOGCAT, "Couldn't open RandomX shared dataset file");
+    goto out;
+  }
+
+  /* hugetlbfs reports the huge page size as block size, mappings must be multiples of it */
+  block = (fstatfs(rx_shared_fd, &sfs) == 0 && sfs.f_bsize > 0) ? (size_t)sfs.f_bsize : 4096;
+  header_size = block;
+  dataset_size = randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+  total = header_size + (dataset_size + block - 1) / block * block;
+
+  if (fstat(rx_shared_fd, &st) != 0 || ((size_t)st.st_size < total && ftruncate(rx_shared_fd, total) != 0)) {
+    mwarning(RX_LOGCAT, "Couldn't size RandomX shared dataset file");
+    goto fail;
+  }
+
+  map = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, rx_shared_fd, 0);
+  if (map == MAP_FAILED) {
+    mwarning(RX_LOGCAT, "Couldn't map RandomX shared dataset");
+    goto fail;
+  }
+
+  rx_shared_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+  if (rx_shared_dataset == NULL || !rx_shared_redirect(rx_shared_dataset, (char *)map + header_size)) {
+    mwarning(RX_LOGCAT, "Couldn't attach RandomX shared dataset");
+    if (rx_shared_dataset != NULL)
+      randomx_release_dataset(rx_shared_dataset);
+    rx_shared_dataset = NULL;
+    munmap(map, total);
+    goto fail;
+  }
+
+  rx_shared_hdr = map;
+  /* a fresh file is zero filled, i.e. holds no seed */
+  if (flock(rx_shared_fd, LOCK_EX) == 0) {
+    if (rx_shared_hdr->sh_magic != RX_SHARED_MAGIC) {
+      memset(rx_shared_hdr, 0, sizeof(*rx_shared_hdr));
+      rx_shared_hdr->sh_magic = RX_SHARED_MAGIC;
+    }
+    flock(rx_shared_fd, LOCK_UN);
+  }
+  minfo(RX_LOGCAT, "Using RandomX shared dataset");
+  rx_shared_state = 1;
+  goto out;
+
+fail:
+  close(rx_shared_fd);
+  rx_shared_fd = -1;
+out:
+  CTHR_MUTEX_UNLOCK(rx_shared_mutex);
+  return rx_shared_state;
+}
+
+/* returns the sequence number of the dataset if it is stable and built from seedhash, 0 otherwise */
+static uint64_t rx_shared_current(const char *seedhash) {
+  uint64_t seq = __atomic_load_n(&rx_shared_hdr->sh_seq, __ATOMIC_ACQUIRE);
+  if (seq == 0 || (seq & 1) || memcmp(rx_shared_hdr->sh_hash, seedhash, sizeof(rx_shared_hdr->sh_hash)))
+    return 0;
+  return seq;
+}
+
+/* rebuilds the shared dataset if it holds an older seed and nobody else is rebuilding it */
+static void rx_shared_update(const uint64_t seedheight, const char *seedhash, randomx_cache *cache) {
+  uint64_t seq;
+  long threads;
+
+  if (rx_shared_current(seedhash))
+    return;
+  seq = __atomic_load_n(&rx_shared_hdr->sh_seq, __ATOMIC_ACQUIRE);
+  if (seq && !(seq & 1) && rx_shared_hdr->sh_seedheight >= seedheight)
+    return;	/* another process keeps a newer seed, e.g. we are syncing old blocks */
+
+  if (pthread_mutex_trylock(&rx_shared_mutex))
+    return;
+  if (flock(rx_shared_fd, LOCK_EX | LOCK_NB)) {
+    CTHR_MUTEX_UNLOCK(rx_shared_mutex);
+    return;
+  }
+
+  seq = __atomic_load_n(&rx_shared_hdr->sh_seq, __ATOMIC_ACQUIRE);
+  if (!rx_shared_current(seedhash) && (!seq || (seq & 1) || rx_shared_hdr->sh_seedheight < seedheight)) {
+    seq |= 1;	/* odd even if a previous builder died half way */
+    __atomic_store_n(&rx_shared_hdr->sh_seq, seq, __ATOMIC_RELEASE);
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+    mdebug(RX_LOGCAT, "Building RandomX shared dataset");
+    rx_initdataset(rx_shared_dataset, cache, threads > 0 ? (int)threads : 1);
+    rx_shared_hdr->sh_seedheight = seedheight;
+    memcpy(rx_shared_hdr->sh_hash, seedhash, sizeof(rx_shared_hdr->sh_hash));
+    __atomic_store_n(&rx_shared_hdr->sh_seq, seq + 1, __ATOMIC_RELEASE);
+  }
+
+  flock(rx_shared_fd, LOCK_UN);
+  CTHR_MUTEX_UNLOCK(rx_shared_mutex);
+}
+
+/* hashes with the shared dataset, returns 0 if the caller has to use the light cache */
+static int rx_shared_hash(const char *seedhash, randomx_cache *cache, randomx_flags flags, const void *data, size_t length, char *hash) {
+  uint64_t seq = rx_shared_current(seedhash);
+  if (!seq)
+    return 0;
+
+  if (rx_shared_vm == NULL) {
+    flags |= RANDOMX_FLAG_FULL_MEM;
+    rx_shared_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, cache, rx_shared_dataset);
+    if (rx_shared_vm == NULL)
+      rx_shared_vm = randomx_create_vm(flags, cache, rx_shared_dataset);
+    if (rx_shared_vm == NULL)
+      return 0;
+  }
+
+  randomx_calculate_hash(rx_shared_vm, data, length, hash);
+  /* the dataset may have been rebuilt meanwhile */
+  return __atomic_load_n(&rx_shared_hdr->sh_seq, __ATOMIC_ACQUIRE) == seq;
+}
+
+#endif
+
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length,
   char *hash, int miners, int is_alt) {
   uint64_t s_height = rx_seedheight(mainheight);
@@ -238,6 +484,7 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
   randomx_flags flags = RANDOMX_FLAG_DEFAULT;
   rx_state *rx_sp;
   randomx_cache *cache;
+  int shared_tried = 0;
 
   toggle = (toggle & SEEDHASH_EPOCH_BLOCKS) != 0;
   CTHR_MUTEX_LOCK(rx_mutex);
@@ -259,6 +506,7 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
   CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
   CTHR_MUTEX_UNLOCK(rx_mutex);
 
+reinit:
   cache = rx_sp->rs_cache;
   if (cache == NULL) {
     if (use_rx_jit())
@@ -280,6 +528,24 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     memcpy(rx_sp->rs_hash, seedhash, sizeof(rx_sp->rs_hash));
     changed = 1;
   }
+#if defined(__linux__)
+  if (!shared_tried && !miners && !is_alt && rx_shared_open()) {
+    randomx_flags vflags = RANDOMX_FLAG_DEFAULT;
+    if (use_rx_jit())
+      vflags |= RANDOMX_FLAG_JIT | RANDOMX_FLAG_SECURE;
+    if (!force_software_aes() && check_aes_hw())
+      vflags |= RANDOMX_FLAG_HARD_AES;
+    /* the cache of this seed stays valid while we hold its slot */
+    rx_shared_update(seedheight, seedhash, rx_sp->rs_cache);
+    CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+    if (rx_shared_hash(seedhash, rx_sp->rs_cache, vflags, data, length, hash))
+      return;
+    /* light cache fallback, the slot may have been reseeded while unlocked */
+    shared_tried = 1;
+    CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
+    goto reinit;
+  }
+#endif
   if (rx_vm == NULL) {
     randomx_flags flags = RANDOMX_FLAG_DEFAULT;
     if (use_rx_jit()) {
@@ -336,6 +602,82 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
 }
 
+/* Mining hashes the same blob with nonce after nonce.  The seed and the dataset are checked once per
+ * blob in rx_mining_hash_first, which starts the thread's pipelined VM on it, then every
+ * rx_mining_hash_next starts on the blob of the next nonce and returns the hash of the previous one
+ * without taking any lock.  Only used by mainchain miners, with the full dataset if it fits. */
+static THREADV randomx_vm *rx_mining_vm = NULL;
+static THREADV int rx_mining_full_mem;
+
+void rx_mining_hash_first(const uint64_t seedheight, const char *seedhash, const void *data, size_t length, int miners) {
+  int toggle = (seedheight & SEEDHASH_EPOCH_BLOCKS) != 0;
+  rx_state *rx_sp = &rx_s[toggle];
+  randomx_flags flags = RANDOMX_FLAG_DEFAULT;
+  randomx_cache *cache;
+
+  if (use_rx_jit())
+    flags |= RANDOMX_FLAG_JIT;
+  CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
+  cache = rx_sp->rs_cache;
+  if (cache == NULL) {
+    cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+    if (cache == NULL) {
+      mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX cache");
+      cache = randomx_alloc_cache(flags);
+    }
+    if (cache == NULL)
+      local_abort("Couldn't allocate RandomX cache");
+  }
+  if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, sizeof(rx_sp->rs_hash))) {
+    randomx_init_cache(cache, seedhash, 32);
+    rx_sp->rs_cache = cache;
+    rx_sp->rs_height = seedheight;
+    memcpy(rx_sp->rs_hash, seedhash, sizeof(rx_sp->rs_hash));
+  }
+  CTHR_MUTEX_LOCK(rx_dataset_mutex);
+  if (rx_dataset == NULL) {
+    rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+    if (rx_dataset == NULL) {
+      mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX dataset");
+      rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+    }
+    if (rx_dataset != NULL)
+      rx_initdata(cache, miners, seedheight);
+    else
+      mwarning(RX_LOGCAT, "Couldn't allocate RandomX dataset for miner");
+  } else if (rx_dataset_height != seedheight) {
+    rx_initdata(cache, miners, seedheight);
+  }
+  CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
+
+  if (rx_mining_vm == NULL) {
+    if (!force_software_aes() && check_aes_hw())
+      flags |= RANDOMX_FLAG_HARD_AES;
+    rx_mining_full_mem = rx_dataset != NULL;
+    if (rx_mining_full_mem)
+      flags |= RANDOMX_FLAG_FULL_MEM;
+    rx_mining_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, cache, rx_dataset);
+    if (rx_mining_vm == NULL) {
+      mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX VM");
+      rx_mining_vm = randomx_create_vm(flags, cache, rx_dataset);
+    }
+    if (rx_mining_vm == NULL) {
+      flags = RANDOMX_FLAG_DEFAULT | (rx_mining_full_mem ? RANDOMX_FLAG_FULL_MEM : 0);
+      rx_mining_vm = randomx_create_vm(flags, cache, rx_dataset);
+    }
+    if (rx_mining_vm == NULL)
+      local_abort("Couldn't allocate RandomX VM");
+  } else if (!rx_mining_full_mem) {
+    randomx_vm_set_cache(rx_mining_vm, cache);
+  }
+  CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+  randomx_calculate_hash_first(rx_mining_vm, data, length);
+}
+
+void rx_mining_hash_next(const void *next_data, size_t length, char *hash) {
+  randomx_calculate_hash_next(rx_mining_vm, next_data, length, hash);
+}
+
 void rx_slow_hash_allocate_state(void) {
 }
 
@@ -344,6 +686,16 @@ void rx_slow_hash_free_state(void) {
     randomx_destroy_vm(rx_vm);
     rx_vm = NULL;
   }
+  if (rx_mining_vm != NULL) {
+    randomx_destroy_vm(rx_mining_vm);
+    rx_mining_vm = NULL;
+  }
+#if defined(__linux__)
+  if (rx_shared_vm != NULL) {
+    randomx_destroy_vm(rx_shared_vm);
+    rx_shared_vm = NULL;
+  }
+#endif
 }
 
 void rx_stop_mining(void) {
@@ -355,3 +707,20 @@ void rx_stop_mining(void) {
   }
   CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
 }
+
+/* RandomX does not export the cache size, this is RANDOMX_ARGON_MEMORY KiB of the default configuration.
+ * Read without the locks, which may be held while a cache or dataset is initialized: the result is
+ * an estimate for reporting. The shared dataset is a mapped file and is not counted. */
+#define RX_CACHE_SIZE	(262144ull * 1024)
+
+size_t rx_memory_usage(void) {
+  size_t bytes = 0;
+  int i;
+
+  for (i = 0; i < 2; i++)
+    if (rx_s[i].rs_cache != NULL)
+      bytes += RX_CACHE_SIZE;
+  if (rx_dataset != NULL)
+    bytes += randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+  return bytes;
+}
@@ -214,6 +214,16 @@ extern int aesb_pseudo_round(const uint8_t *in, uint8_t *out, const uint8_t *exp
   } while (0)
 
 
+// runtime overrides for benchmarks, they must be set before any thread starts hashing
+static int use_huge_pages = 1;
+static int use_software_aes = -1; // -1 to follow MONERO_USE_SOFTWARE_AES and the cpu
+
+void cn_slow_hash_set_options(int huge_pages, int software_aes)
+{
+  use_huge_pages = huge_pages;
+  use_software_aes = software_aes;
+}
+
 #if !defined NO_AES && (defined(__x86_64__) || (defined(_MSC_VER) && defined(_WIN64)))
 // Optimised code below, uses x86-specific intrinsics, SSE2, AES-NI
 // Fall back to more portable code is down at the bottom
@@ -370,6 +380,9 @@ STATIC INLINE int force_software_aes(void)
 {
   static int use = -1;
 
+  if (use_software_aes != -1)
+    return use_software_aes;
+
   if (use != -1)
     return use;
 
@@ -615,6 +628,13 @@ void cn_slow_hash_allocate_state(void)
     if(hp_state != NULL)
         return;
 
+    if(!use_huge_pages)
+    {
+        hp_allocated = 0;
+        hp_state = (uint8_t *) malloc(MEMORY);
+        return;
+    }
+
 #if defined(_MSC_VER) || defined(__MINGW32__)
     SetLockPagesPrivilege(GetCurrentProcess(), TRUE);
     hp_state = (uint8_t *) VirtualAlloc(hp_state, MEMORY, MEM_LARGE_PAGES |
@@ -663,6 +683,11 @@ void cn_slow_hash_free_state(void)
     hp_allocated = 0;
 }
 
+int cn_slow_hash_huge_pages_allocated(void)
+{
+    return hp_state != NULL && hp_allocated;
+}
+
 /**
  * @brief the hash function implementing CryptoNight, used for the Monero proof-of-work
  *
@@ -867,6 +892,11 @@ void cn_slow_hash_free_state(void)
   return;
 }
 
+int cn_slow_hash_huge_pages_allocated(void)
+{
+  return 0;
+}
+
 #if defined(__GNUC__)
 #define RDATA_ALIGN16 __attribute__ ((aligned(16)))
 #define STATIC static
@@ -1448,6 +1478,11 @@ void slow_hash_free_state(void)
   return;
 }
 
+int cn_slow_hash_huge_pages_allocated(void)
+{
+  return 0;
+}
+
 static void (*const extra_hashes[4])(const void *, size_t, char *) = {
   hash_extra_blake, hash_extra_groestl, hash_extra_jh, hash_extra_skein
 };
@@ -171,6 +171,17 @@ namespace cryptonote {
     return summ;
   }
   //-----------------------------------------------------------------------
+  // The binary serialization of an address is its two keys, which are written directly rather than
+  // through an archive: addresses of the stakes and the blockchain based list are encoded often
+  static std::string address_to_blob(const account_public_address& adr)
+  {
+    std::string blob;
+    blob.reserve(2 * sizeof(crypto::public_key) + sizeof(crypto::hash8));
+    blob.append(reinterpret_cast<const char*>(&adr.m_spend_public_key), sizeof(adr.m_spend_public_key));
+    blob.append(reinterpret_cast<const char*>(&adr.m_view_public_key), sizeof(adr.m_view_public_key));
+    return blob;
+  }
+  //-----------------------------------------------------------------------
   std::string get_account_address_as_str(
       network_type nettype
     , bool subaddress
@@ -179,7 +190,7 @@ namespace cryptonote {
   {
     uint64_t address_prefix = subaddress ? get_config(nettype).CRYPTONOTE_PUBLIC_SUBADDRESS_BASE58_PREFIX : get_config(nettype).CRYPTONOTE_PUBLIC_ADDRESS_BASE58_PREFIX;
 
-    return tools::base58::encode_addr(address_prefix, t_serializable_object_to_blob(adr));
+    return tools::base58::encode_addr(address_prefix, address_to_blob(adr));
   }
   //-----------------------------------------------------------------------
   std::string get_account_integrated_address_as_str(
@@ -190,10 +201,26 @@ namespace cryptonote {
   {
     uint64_t integrated_address_prefix = get_config(nettype).CRYPTONOTE_PUBLIC_INTEGRATED_ADDRESS_BASE58_PREFIX;
 
-    integrated_address iadr = {
-      adr, payment_id
-    };
-    return tools::base58::encode_addr(integrated_address_prefix, t_serializable_object_to_blob(iadr));
+    std::string blob = address_to_blob(adr);
+    blob.append(reinterpret_cast<const char*>(&payment_id), sizeof(payment_id));
+    return tools::base58::encode_addr(integrated_address_prefix, blob);
+  }
+  //-----------------------------------------------------------------------
+  std::string account_address_string_cache::get(network_type nettype, const account_public_address& adr)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_nettype != nettype || m_strings.size() >= m_max_size)
+    {
+      m_strings.clear();
+      m_nettype = nettype;
+    }
+
+    auto it = m_strings.find(adr);
+    if (it == m_strings.end())
+      it = m_strings.emplace(adr, get_account_address_as_str(nettype, false, adr)).first;
+
+    return it->second;
   }
   //-----------------------------------------------------------------------
   bool is_coinbase(const transaction& tx)
@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <mutex>
+#include <unordered_map>
 #include "cryptonote_basic.h"
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
@@ -118,6 +120,25 @@ namespace cryptonote {
     , std::function<std::string(const std::string&, const std::vector<std::string>&, bool)> dns_confirm = return_first_address
     );
 
+  /************************************************************************/
+  /* Strings of standard addresses which are encoded again and again,    */
+  /* like the stakes and blockchain based list addresses; thread safe,   */
+  /* cleared when it grows over max_size                                 */
+  /************************************************************************/
+  class account_address_string_cache
+  {
+  public:
+    explicit account_address_string_cache(size_t max_size = 4096) : m_max_size(max_size), m_nettype(UNDEFINED) {}
+
+    std::string get(network_type nettype, const account_public_address& adr);
+
+  private:
+    std::mutex m_mutex;
+    size_t m_max_size;
+    network_type m_nettype;
+    std::unordered_map<account_public_address, std::string> m_strings;
+  };
+
   bool is_coinbase(const transaction& tx);
 
   bool operator ==(const cryptonote::transaction& a, const cryptonote::transaction& b);
@@ -32,6 +32,7 @@
 #include "include_base_utils.h"
 using namespace epee;
 
+#include <array>
 #include <atomic>
 #include <boost/algorithm/string.hpp>
 #include "wipeable_string.h"
@@ -126,6 +127,15 @@ namespace cryptonote
     return h;
   }
   //---------------------------------------------------------------
+  void get_transaction_prefix_hashes(const std::vector<const transaction_prefix*>& txs, std::vector<crypto::hash>& hashes)
+  {
+    std::vector<blobdata> blobs;
+    blobs.reserve(txs.size());
+    for (const transaction_prefix* tx: txs)
+      blobs.push_back(t_serializable_object_to_blob(*tx));
+    get_blob_hashes(blobs, hashes);
+  }
+  //---------------------------------------------------------------
   bool expand_transaction_1(transaction &tx, bool base_only)
   {
     if (tx.version >= 2 && !is_coinbase(tx))
@@ -180,9 +190,7 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(tx_blob)};
     bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     CHECK_AND_ASSERT_MES(expand_transaction_1(tx, false), false, "Failed to expand transaction data");
@@ -190,11 +198,18 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, const crypto::hash& tx_hash)
+  {
+    if (!parse_and_validate_tx_from_blob(tx_blob, tx))
+      return false;
+    tx.set_hash(tx_hash);
+    tx.set_blob_size(tx_blob.size());
+    return true;
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_tx_base_from_blob(const blobdata& tx_blob, transaction& tx)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(tx_blob)};
     bool r = tx.serialize_base(ba);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     CHECK_AND_ASSERT_MES(expand_transaction_1(tx, true), false, "Failed to expand transaction data");
@@ -203,9 +218,7 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(tx_blob)};
     bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     CHECK_AND_ASSERT_MES(expand_transaction_1(tx, false), false, "Failed to expand transaction data");
@@ -416,9 +429,7 @@ namespace cryptonote
     if(tx_extra.empty())
       return true;
 
-    std::string extra_str(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
-    binary_archive<false> ar(iss);
+    binary_archive<false> ar{epee::to_span(tx_extra)};
 
     bool eof = false;
     while (!eof)
@@ -428,9 +439,7 @@ namespace cryptonote
       CHECK_AND_NO_ASSERT_MES_L1(r, false, "failed to deserialize extra field. extra = " << string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size())));
       tx_extra_fields.push_back(field);
 
-      std::ios_base::iostate state = iss.rdstate();
-      eof = (EOF == iss.peek());
-      iss.clear(state);
+      eof = ar.remaining_bytes() == 0;
     }
     CHECK_AND_NO_ASSERT_MES_L1(::serialization::check_stream_state(ar), false, "failed to deserialize extra field. extra = " << string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size())));
 
@@ -531,9 +540,7 @@ namespace cryptonote
   {
     if (tx_extra.empty())
       return true;
-    std::string extra_str(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
-    binary_archive<false> ar(iss);
+    binary_archive<false> ar{epee::to_span(tx_extra)};
     std::ostringstream oss;
     binary_archive<true> newar(oss);
 
@@ -546,9 +553,7 @@ namespace cryptonote
       if (field.type() != type)
         ::do_serialize(newar, field);
 
-      std::ios_base::iostate state = iss.rdstate();
-      eof = (EOF == iss.peek());
-      iss.clear(state);
+      eof = ar.remaining_bytes() == 0;
     }
     CHECK_AND_NO_ASSERT_MES_L1(::serialization::check_stream_state(ar), false, "failed to deserialize extra field. extra = " << string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size())));
     tx_extra.clear();
@@ -831,6 +836,21 @@ namespace cryptonote
     return h;
   }
   //---------------------------------------------------------------
+  void get_blob_hashes(const std::vector<blobdata>& blobs, std::vector<crypto::hash>& hashes)
+  {
+    std::vector<const void*> data;
+    std::vector<size_t> lengths;
+    data.reserve(blobs.size());
+    lengths.reserve(blobs.size());
+    for (const blobdata& blob: blobs)
+    {
+      data.push_back(blob.data());
+      lengths.push_back(blob.size());
+    }
+    hashes.resize(blobs.size());
+    crypto::cn_fast_hash_batch(data.data(), lengths.data(), hashes.data(), blobs.size());
+  }
+  //---------------------------------------------------------------
   crypto::hash get_transaction_hash(const transaction& t)
   {
     crypto::hash h = null_hash;
@@ -843,10 +863,21 @@ namespace cryptonote
     return get_transaction_hash(t, res, NULL);
   }
   //---------------------------------------------------------------
-  bool calculate_transaction_prunable_hash(const transaction& t, crypto::hash& res)
+  static bool get_transaction_rct_base_blob(const transaction& t, blobdata& blob)
+  {
+    transaction &tt = const_cast<transaction&>(t);
+    std::stringstream ss;
+    binary_archive<true> ba(ss);
+    const size_t inputs = t.vin.size();
+    const size_t outputs = t.vout.size();
+    bool r = tt.rct_signatures.serialize_rctsig_base(ba, inputs, outputs);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to serialize rct signatures base");
+    blob = ss.str();
+    return true;
+  }
+  //---------------------------------------------------------------
+  static bool get_transaction_rct_prunable_blob(const transaction& t, blobdata& blob)
   {
-    if (t.version == 1)
-      return false;
     transaction &tt = const_cast<transaction&>(t);
     std::stringstream ss;
     binary_archive<true> ba(ss);
@@ -855,7 +886,18 @@ namespace cryptonote
     const size_t mixin = t.vin.empty() ? 0 : t.vin[0].type() == typeid(txin_to_key) ? boost::get<txin_to_key>(t.vin[0]).key_offsets.size() - 1 : 0;
     bool r = tt.rct_signatures.p.serialize_rctsig_prunable(ba, t.rct_signatures.type, inputs, outputs, mixin);
     CHECK_AND_ASSERT_MES(r, false, "Failed to serialize rct signatures prunable");
-    cryptonote::get_blob_hash(ss.str(), res);
+    blob = ss.str();
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool calculate_transaction_prunable_hash(const transaction& t, crypto::hash& res)
+  {
+    if (t.version == 1)
+      return false;
+    blobdata blob;
+    if (!get_transaction_rct_prunable_blob(t, blob))
+      return false;
+    cryptonote::get_blob_hash(blob, res);
     return true;
   }
   //---------------------------------------------------------------
@@ -913,17 +955,12 @@ namespace cryptonote
     // prefix
     get_transaction_prefix_hash(t, hashes[0]);
 
-    transaction &tt = const_cast<transaction&>(t);
-
     // base rct
     {
-      std::stringstream ss;
-      binary_archive<true> ba(ss);
-      const size_t inputs = t.vin.size();
-      const size_t outputs = t.vout.size();
-      bool r = tt.rct_signatures.serialize_rctsig_base(ba, inputs, outputs);
-      CHECK_AND_ASSERT_MES(r, false, "Failed to serialize rct signatures base");
-      cryptonote::get_blob_hash(ss.str(), hashes[1]);
+      blobdata blob;
+      if (!get_transaction_rct_base_blob(t, blob))
+        return false;
+      cryptonote::get_blob_hash(blob, hashes[1]);
     }
 
     // prunable rct
@@ -980,6 +1017,77 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  bool get_transaction_hashes(const std::vector<const transaction*>& txs, std::vector<crypto::hash>& hashes)
+  {
+    // same parts as calculate_transaction_hash, each step hashes the parts of all txs in one batch
+    std::vector<size_t> calculated, first_blob;
+    std::vector<blobdata> blobs;
+    hashes.resize(txs.size());
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+      const transaction& t = *txs[i];
+      if (t.is_hash_valid())
+      {
+        hashes[i] = t.hash;
+        ++tx_hashes_cached_count;
+        continue;
+      }
+      calculated.push_back(i);
+      first_blob.push_back(blobs.size());
+      if (t.version == 1)
+      {
+        blobs.push_back(t_serializable_object_to_blob(t));
+        continue;
+      }
+      blobs.push_back(t_serializable_object_to_blob(static_cast<const transaction_prefix&>(t)));
+      blobs.emplace_back();
+      if (!get_transaction_rct_base_blob(t, blobs.back()))
+        return false;
+      if (t.rct_signatures.type != rct::RCTTypeNull)
+      {
+        blobs.emplace_back();
+        if (!get_transaction_rct_prunable_blob(t, blobs.back()))
+          return false;
+      }
+    }
+
+    std::vector<crypto::hash> blob_hashes;
+    get_blob_hashes(blobs, blob_hashes);
+
+    // the hash of a v2 tx is the hash of the hashes of its 3 parts
+    std::vector<size_t> v2_txs;
+    std::vector<std::array<crypto::hash, 3>> parts;
+    for (size_t k = 0; k < calculated.size(); ++k)
+    {
+      const size_t i = calculated[k], b = first_blob[k];
+      const transaction& t = *txs[i];
+      if (t.version == 1)
+      {
+        hashes[i] = blob_hashes[b];
+        continue;
+      }
+      v2_txs.push_back(i);
+      parts.push_back({{blob_hashes[b], blob_hashes[b + 1], t.rct_signatures.type == rct::RCTTypeNull ? crypto::null_hash : blob_hashes[b + 2]}});
+    }
+
+    std::vector<const void*> data;
+    std::vector<size_t> lengths(parts.size(), sizeof(parts[0]));
+    for (const auto &p: parts)
+      data.push_back(p.data());
+    std::vector<crypto::hash> v2_hashes(parts.size());
+    crypto::cn_fast_hash_batch(data.data(), lengths.data(), v2_hashes.data(), parts.size());
+    for (size_t k = 0; k < v2_txs.size(); ++k)
+      hashes[v2_txs[k]] = v2_hashes[k];
+
+    for (size_t i: calculated)
+    {
+      ++tx_hashes_calculated_count;
+      txs[i]->hash = hashes[i];
+      txs[i]->set_hash_valid(true);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------
   bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size)
   {
     return get_transaction_hash(t, res, &blob_size);
@@ -1056,9 +1164,7 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash *block_hash)
   {
-    std::stringstream ss;
-    ss << b_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(b_blob)};
     bool r = ::serialization::serialize(ba, b);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
     b.invalidate_hashes();
@@ -1078,6 +1184,15 @@ namespace cryptonote
     return parse_and_validate_block_from_blob(b_blob, b, NULL);
   }
   //---------------------------------------------------------------
+  bool parse_block_header_from_hashing_blob(const blobdata& hashing_blob, block_header& header)
+  {
+    // the hashing blob starts with the serialized header, followed by the tx tree root and the tx count
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(hashing_blob)};
+    bool r = ::serialization::serialize(ba, header);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse block header from hashing blob");
+    return true;
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash &block_hash)
   {
     return parse_and_validate_block_from_blob(b_blob, b, &block_hash);
@@ -50,8 +50,11 @@ namespace cryptonote
   //---------------------------------------------------------------
   void get_transaction_prefix_hash(const transaction_prefix& tx, crypto::hash& h);
   crypto::hash get_transaction_prefix_hash(const transaction_prefix& tx);
+  void get_transaction_prefix_hashes(const std::vector<const transaction_prefix*>& txs, std::vector<crypto::hash>& hashes);
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash);
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx);
+  // tx_blob must be a stored blob and tx_hash its known hash (e.g. the key it was stored with); both go to the caches of tx instead of being recomputed
+  bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, const crypto::hash& tx_hash);
   bool parse_and_validate_tx_base_from_blob(const blobdata& tx_blob, transaction& tx);
 
   template<typename T>
@@ -187,12 +190,14 @@ namespace cryptonote
   bool generate_key_image_helper_precomp(const account_keys& ack, const crypto::public_key& out_key, const crypto::key_derivation& recv_derivation, size_t real_output_index, const subaddress_index& received_index, keypair& in_ephemeral, crypto::key_image& ki, hw::device &hwdev);
   void get_blob_hash(const blobdata& blob, crypto::hash& res);
   crypto::hash get_blob_hash(const blobdata& blob);
+  void get_blob_hashes(const std::vector<blobdata>& blobs, std::vector<crypto::hash>& hashes);
   std::string short_hash_str(const crypto::hash& h);
 
   crypto::hash get_transaction_hash(const transaction& t);
   bool get_transaction_hash(const transaction& t, crypto::hash& res);
   bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size);
   bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t* blob_size);
+  bool get_transaction_hashes(const std::vector<const transaction*>& txs, std::vector<crypto::hash>& hashes);
   bool calculate_transaction_prunable_hash(const transaction& t, crypto::hash& res);
   crypto::hash get_transaction_prunable_hash(const transaction& t);
   bool calculate_transaction_hash(const transaction& t, crypto::hash& res, size_t* blob_size);
@@ -204,6 +209,7 @@ namespace cryptonote
   crypto::hash get_block_hash(const block& b);
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash *block_hash);
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b);
+  bool parse_block_header_from_hashing_blob(const blobdata& hashing_blob, block_header& header);
   bool get_inputs_money_amount(const transaction& tx, uint64_t& money);
   uint64_t get_outs_money_amount(const transaction& tx);
   bool check_inputs_types_supported(const transaction& tx);
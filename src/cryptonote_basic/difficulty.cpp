@@ -137,7 +137,6 @@ namespace cryptonote {
     }
     static_assert(DIFFICULTY_WINDOW >= 2, "Window is too small");
     assert(length <= DIFFICULTY_WINDOW);
-    sort(timestamps.begin(), timestamps.end());
     size_t cut_begin, cut_end;
     static_assert(2 * DIFFICULTY_CUT <= DIFFICULTY_WINDOW - 2, "Cut length is too large");
     if (length <= DIFFICULTY_WINDOW - 2 * DIFFICULTY_CUT) {
@@ -148,6 +147,9 @@ namespace cryptonote {
       cut_end = cut_begin + (DIFFICULTY_WINDOW - 2 * DIFFICULTY_CUT);
     }
     assert(/*cut_begin >= 0 &&*/ cut_begin + 2 <= cut_end && cut_end <= length);
+    // only the bounds of the cut are used, so they are selected instead of sorting the whole window
+    std::nth_element(timestamps.begin(), timestamps.begin() + cut_begin, timestamps.end());
+    std::nth_element(timestamps.begin() + cut_begin + 1, timestamps.begin() + cut_end - 1, timestamps.end());
     uint64_t time_span = timestamps[cut_end - 1] - timestamps[cut_begin];
     if (time_span == 0) {
       time_span = 1;
@@ -173,15 +175,17 @@ namespace cryptonote {
   // https://github.com/masari-project/masari/blob/master/src/cryptonote_basic/difficulty.cpp
   //
   // Graft Settings: adjust = 0.9909
-  difficulty_type next_difficulty_v8(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
+  difficulty_type next_difficulty_v8(const std::vector<std::uint64_t>& timestamps, const std::vector<difficulty_type>& cumulative_difficulties, size_t target_seconds) {
+    assert(timestamps.size() == cumulative_difficulties.size());
+    return next_difficulty_v8(timestamps.data(), cumulative_difficulties.data(), timestamps.size(), target_seconds);
+  }
+
+  difficulty_type next_difficulty_v8(const std::uint64_t* timestamps, const difficulty_type* cumulative_difficulties, size_t length, size_t target_seconds) {
 
-    if (timestamps.size() > DIFFICULTY_BLOCKS_COUNT_V8) {
-      timestamps.resize(DIFFICULTY_BLOCKS_COUNT_V8);
-      cumulative_difficulties.resize(DIFFICULTY_BLOCKS_COUNT_V8);
+    if (length > DIFFICULTY_BLOCKS_COUNT_V8) {
+      length = DIFFICULTY_BLOCKS_COUNT_V8;
     }
 
-    size_t length = timestamps.size();
-    assert(length == cumulative_difficulties.size());
     if (length <= 1) {
       return 1;
     }
@@ -218,7 +222,7 @@ namespace cryptonote {
       weighted_timespans = minimum_timespan;
     }
 
-    difficulty_type total_work = cumulative_difficulties.back() - cumulative_difficulties.front();
+    difficulty_type total_work = cumulative_difficulties[length - 1] - cumulative_difficulties[0];
     assert(total_work > 0);
 
     uint64_t low, high;
@@ -230,15 +234,17 @@ namespace cryptonote {
     return result > 0 ? result : 1;
   }
 
-  difficulty_type next_difficulty_v9(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
+  difficulty_type next_difficulty_v9(const std::vector<std::uint64_t>& timestamps, const std::vector<difficulty_type>& cumulative_difficulties, size_t target_seconds) {
+    assert(timestamps.size() == cumulative_difficulties.size());
+    return next_difficulty_v9(timestamps.data(), cumulative_difficulties.data(), timestamps.size(), target_seconds);
+  }
+
+  difficulty_type next_difficulty_v9(const std::uint64_t* timestamps, const difficulty_type* cumulative_difficulties, size_t length, size_t target_seconds) {
 
-    if (timestamps.size() > DIFFICULTY_BLOCKS_COUNT_V8) {
-      timestamps.resize(DIFFICULTY_BLOCKS_COUNT_V8);
-      cumulative_difficulties.resize(DIFFICULTY_BLOCKS_COUNT_V8);
+    if (length > DIFFICULTY_BLOCKS_COUNT_V8) {
+      length = DIFFICULTY_BLOCKS_COUNT_V8;
     }
 
-    size_t length = timestamps.size();
-    assert(length == cumulative_difficulties.size());
     if (length <= 1) {
       return 1;
     }
@@ -272,7 +278,7 @@ namespace cryptonote {
     if (length >= 4 && timestamps[length - 1] - timestamps[length - 3] > 0) {
       double d_last = 1.0 * (cumulative_difficulties[length - 1] - cumulative_difficulties[length - 2]);
       double d_prev = 1.0 * (cumulative_difficulties[length - 3] - cumulative_difficulties[length - 4]);
-      double h = 1.0 * (timestamps[length - 1] - timestamps[0]) / timestamps.size();
+      double h = 1.0 * (timestamps[length - 1] - timestamps[0]) / length;
       if (h > 0) {
         derivative = (d_last - d_prev) / h;
       }
@@ -289,7 +295,7 @@ namespace cryptonote {
       weighted_timespans = minimum_timespan;
     }
 
-    difficulty_type total_work = cumulative_difficulties.back() - cumulative_difficulties.front();
+    difficulty_type total_work = cumulative_difficulties[length - 1] - cumulative_difficulties[0];
     assert(total_work > 0);
 
     uint64_t low, high;
@@ -53,6 +53,12 @@ namespace cryptonote
      */
     bool check_hash(const crypto::hash &hash, difficulty_type difficulty);
     difficulty_type next_difficulty(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
-    difficulty_type next_difficulty_v8(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
-    difficulty_type next_difficulty_v9(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
+    difficulty_type next_difficulty_v8(const std::vector<std::uint64_t>& timestamps, const std::vector<difficulty_type>& cumulative_difficulties, size_t target_seconds);
+    difficulty_type next_difficulty_v9(const std::vector<std::uint64_t>& timestamps, const std::vector<difficulty_type>& cumulative_difficulties, size_t target_seconds);
+
+    /**
+     * @brief same as the vector versions, reading length entries of the window in place
+     */
+    difficulty_type next_difficulty_v8(const std::uint64_t* timestamps, const difficulty_type* cumulative_difficulties, size_t length, size_t target_seconds);
+    difficulty_type next_difficulty_v9(const std::uint64_t* timestamps, const difficulty_type* cumulative_difficulties, size_t length, size_t target_seconds);
 }
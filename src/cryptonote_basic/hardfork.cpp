@@ -61,7 +61,8 @@ HardFork::HardFork(cryptonote::BlockchainDB &db, uint8_t original_version, uint6
   forked_time(forked_time),
   update_time(update_time),
   window_size(window_size),
-  default_threshold_percent(default_threshold_percent)
+  default_threshold_percent(default_threshold_percent),
+  cached_height(0)
 {
   if (window_size == 0)
     throw "window_size needs to be strictly positive";
@@ -138,6 +139,7 @@ bool HardFork::add(uint8_t block_version, uint8_t voting_version, uint64_t heigh
     return false;
 
   db.set_hard_fork_version(height, heights[current_fork_index].version);
+  cache_version(height, heights[current_fork_index].version);
 
   voting_version = get_effective_version(voting_version);
 
@@ -204,6 +206,55 @@ void HardFork::init()
     rescan_from_chain_height(height);
   }
   MDEBUG("reorganization done");
+  load_versions();
+}
+
+void HardFork::load_versions()
+{
+  CRITICAL_REGION_LOCAL(lock);
+  version_intervals.clear();
+  cached_height = 0;
+
+  // the version stored for a block is the current one when it was added, which never goes
+  // down along a chain, so each version's last height can be searched for
+  const uint64_t height = db.height();
+  try
+  {
+    uint64_t first_height = 0;
+    while (first_height < height)
+    {
+      const uint8_t version = db.get_hard_fork_version(first_height);
+      uint64_t last_height = first_height, end = height;
+      while (end - last_height > 1)
+      {
+        const uint64_t mid = last_height + (end - last_height) / 2;
+        if (db.get_hard_fork_version(mid) == version)
+          last_height = mid;
+        else
+          end = mid;
+      }
+      version_intervals.push_back({first_height, version});
+      first_height = last_height + 1;
+    }
+    cached_height = height;
+  }
+  catch (const std::exception &e)
+  {
+    MWARNING("Failed to load hard fork versions, they will be read from the db: " << e.what());
+    version_intervals.clear();
+  }
+}
+
+void HardFork::cache_version(uint64_t height, uint8_t version)
+{
+  // only the heights from 0 up are kept, so a lookup always finds the interval of a height
+  if (height > cached_height)
+    return;
+  while (!version_intervals.empty() && version_intervals.back().first_height >= height)
+    version_intervals.pop_back();
+  if (version_intervals.empty() || version_intervals.back().version != version)
+    version_intervals.push_back({height, version});
+  cached_height = height + 1;
 }
 
 uint8_t HardFork::get_block_version(uint64_t height) const
@@ -351,6 +402,11 @@ uint8_t HardFork::get(uint64_t height) const
   if (height == db.height()) {
     return get_current_version();
   }
+  if (height < cached_height) {
+    const auto i = std::upper_bound(version_intervals.begin(), version_intervals.end(), height,
+        [](uint64_t h, const version_interval &interval) { return h < interval.first_height; });
+    return (i - 1)->version;
+  }
   return db.get_hard_fork_version(height);
 }
 
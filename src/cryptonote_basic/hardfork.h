@@ -240,6 +240,9 @@ namespace cryptonote
     bool rescan_from_block_height(uint64_t height);
     bool rescan_from_chain_height(uint64_t height);
 
+    void load_versions();
+    void cache_version(uint64_t height, uint8_t version);
+
   private:
 
     BlockchainDB &db;
@@ -258,6 +261,13 @@ namespace cryptonote
     unsigned int last_versions[256]; /* count of the block versions in the last N blocks */
     uint32_t current_fork_index;
 
+    struct version_interval {
+      uint64_t first_height;
+      uint8_t version;
+    };
+    std::vector<version_interval> version_intervals; /* the versions stored for heights below cached_height, by the height each starts at */
+    uint64_t cached_height;
+
     mutable epee::critical_section lock;
   };
 
@@ -47,6 +47,12 @@
 #include "string_tools.h"
 #include "storages/portable_storage_template_helper.h"
 #include "boost/logic/tribool.hpp"
+#include "common/int-util.h"
+
+#if defined(__linux__)
+  #include <pthread.h>
+  #include <sched.h>
+#endif
 
 #ifdef __APPLE__
   #include <sys/times.h>
@@ -94,6 +100,23 @@ namespace cryptonote
     const command_line::arg_descriptor<uint64_t>    arg_bg_mining_min_idle_interval_seconds =  {"bg-mining-min-idle-interval", "Specify min lookback interval in seconds for determining idle state", miner::BACKGROUND_MINING_DEFAULT_MIN_IDLE_INTERVAL_IN_SECONDS, true};
     const command_line::arg_descriptor<uint16_t>     arg_bg_mining_idle_threshold_percentage =  {"bg-mining-idle-threshold", "Specify minimum avg idle percentage over lookback interval", miner::BACKGROUND_MINING_DEFAULT_IDLE_THRESHOLD_PERCENTAGE, true};
     const command_line::arg_descriptor<uint16_t>     arg_bg_mining_miner_target_percentage =  {"bg-mining-miner-target", "Specify maximum percentage cpu use by miner(s)", miner::BACKGROUND_MINING_DEFAULT_MINING_TARGET_PERCENTAGE, true};
+    const command_line::arg_descriptor<std::string> arg_mining_affinity =  {"mining-affinity", "Comma separated CPUs to pin mining threads to, in thread order", "", true};
+
+    void set_thread_affinity(uint32_t cpu)
+    {
+#if defined(__linux__)
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      if (cpu >= CPU_SETSIZE || pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        MWARNING("Failed to pin miner thread to CPU " << cpu);
+#elif defined(_WIN32)
+      if (cpu >= sizeof(DWORD_PTR) * 8 || !SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu))
+        MWARNING("Failed to pin miner thread to CPU " << cpu);
+#else
+      MWARNING("Pinning miner threads is not supported on this platform");
+#endif
+    }
   }
 
 
@@ -198,6 +221,8 @@ namespace cryptonote
       m_last_hash_rates.push_back(m_current_hash_rate);
       if(m_last_hash_rates.size() > 19)
         m_last_hash_rates.pop_front();
+      for (size_t i = 0; i < m_thread_hash_rates.size(); ++i)
+        m_thread_hash_rates[i] = m_thread_hashes[i].exchange(0) * 1000 / ((misc_utils::get_tick_count() - m_last_hr_merge_time + 1));
       if(m_do_print_hashrate)
       {
         uint64_t total_hr = std::accumulate(m_last_hash_rates.begin(), m_last_hash_rates.end(), 0);
@@ -205,6 +230,13 @@ namespace cryptonote
         const auto flags = std::cout.flags();
         const auto precision = std::cout.precision();
         std::cout << "hashrate: " << std::setprecision(4) << std::fixed << hr << flags << precision << ENDL;
+        if (m_thread_hash_rates.size() > 1)
+        {
+          std::cout << "per thread:";
+          for (uint64_t thread_hr: m_thread_hash_rates)
+            std::cout << " " << thread_hr;
+          std::cout << ENDL;
+        }
       }
     }
     m_last_hr_merge_time = misc_utils::get_tick_count();
@@ -221,6 +253,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_bg_mining_min_idle_interval_seconds);
     command_line::add_arg(desc, arg_bg_mining_idle_threshold_percentage);
     command_line::add_arg(desc, arg_bg_mining_miner_target_percentage);
+    command_line::add_arg(desc, arg_mining_affinity);
   }
   //-----------------------------------------------------------------------------------------------------
   bool miner::init(const boost::program_options::variables_map& vm, network_type nettype)
@@ -265,6 +298,23 @@ namespace cryptonote
       }
     }
 
+    if(command_line::has_arg(vm, arg_mining_affinity))
+    {
+      std::vector<std::string> cpus;
+      boost::split(cpus, command_line::get_arg(vm, arg_mining_affinity), boost::is_any_of(","), boost::token_compress_on);
+      for (std::string& cpu: cpus)
+      {
+        string_tools::trim(cpu);
+        uint32_t n;
+        if (!string_tools::get_xtype_from_string(n, cpu))
+        {
+          LOG_ERROR("Invalid CPU in --" << arg_mining_affinity.name << ": " << cpu);
+          return false;
+        }
+        m_affinity.push_back(n);
+      }
+    }
+
     // Background mining parameters
     // Let init set all parameters even if background mining is not enabled, they can start later with params set
     if(command_line::has_arg(vm, arg_bg_mining_enable))
@@ -295,7 +345,8 @@ namespace cryptonote
     return m_threads_total;
   }
   //-----------------------------------------------------------------------------------------------------
-  bool miner::start(const account_public_address& adr, size_t threads_count, const boost::thread::attributes& attrs, bool do_background, bool ignore_battery)
+  bool miner::start(const account_public_address& adr, size_t threads_count, const boost::thread::attributes& attrs, bool do_background, bool ignore_battery,
+      const std::vector<uint32_t>& affinity)
   {
     m_mine_address = adr;
     m_threads_total = static_cast<uint32_t>(threads_count);
@@ -315,6 +366,16 @@ namespace cryptonote
 
     request_block_template();//lets update block template
 
+    if (!affinity.empty())
+      m_affinity = affinity;
+    {
+      CRITICAL_REGION_LOCAL(m_last_hash_rates_lock);
+      m_thread_hashes.reset(new std::atomic<uint64_t>[threads_count]);
+      for (size_t i = 0; i < threads_count; ++i)
+        m_thread_hashes[i] = 0;
+      m_thread_hash_rates.assign(threads_count, 0);
+    }
+
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 0);
     boost::interprocess::ipcdetail::atomic_write32(&m_thread_index, 0);
     set_is_background_mining_enabled(do_background);
@@ -351,6 +412,14 @@ namespace cryptonote
     }
   }
   //-----------------------------------------------------------------------------------------------------
+  std::vector<uint64_t> miner::get_threads_speed() const
+  {
+    if (!is_mining())
+      return std::vector<uint64_t>();
+    CRITICAL_REGION_LOCAL(m_last_hash_rates_lock);
+    return m_thread_hash_rates;
+  }
+  //-----------------------------------------------------------------------------------------------------
   void miner::send_stop_signal()
   {
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 1);
@@ -444,11 +513,20 @@ namespace cryptonote
     uint32_t th_local_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index);
     MLOG_SET_THREAD_NAME(std::string("[miner ") + std::to_string(th_local_index) + "]");
     MGINFO("Miner thread was started ["<< th_local_index << "]");
+    if (!m_affinity.empty())
+      set_thread_affinity(m_affinity[th_local_index % m_affinity.size()]);
     uint32_t nonce = m_starter_nonce + th_local_index;
     uint64_t height = 0;
     difficulty_type local_diff = 0;
     uint32_t local_template_ver = 0;
     block b;
+    // RandomX templates are hashed from one hashing blob, patching the nonce in
+    blobdata hashing_blob;
+    size_t nonce_offset = 0;
+    uint64_t main_height = 0, seed_height = 0;
+    crypto::hash seed_hash = crypto::null_hash;
+    bool rx_pending = false;
+    uint32_t rx_pending_nonce = 0;
     slow_hash_allocate_state();
     while(!m_stop)
     {
@@ -480,6 +558,13 @@ namespace cryptonote
         CRITICAL_REGION_END();
         local_template_ver = m_template_no;
         nonce = m_starter_nonce + th_local_index;
+        rx_pending = false;
+        if (b.major_version >= RX_BLOCK_VERSION)
+        {
+          hashing_blob = get_block_hashing_blob(b);
+          nonce_offset = t_serializable_object_to_blob(static_cast<const block_header&>(b)).size() - sizeof(uint32_t);
+          get_block_longhash_seed(m_pbc, height, main_height, seed_height, seed_hash);
+        }
       }
 
       if(!local_template_ver)//no any set_block_template call
@@ -491,7 +576,27 @@ namespace cryptonote
 
       b.nonce = nonce;
       crypto::hash h;
-      get_block_longhash(m_pbc, b, h, height, tools::get_max_concurrency());
+      if (b.major_version >= RX_BLOCK_VERSION)
+      {
+        // the hash of a nonce comes out of the VM when the next nonce goes in
+        const uint32_t nonce_le = SWAP32LE(nonce);
+        memcpy(&hashing_blob[nonce_offset], &nonce_le, sizeof(nonce_le));
+        if (!rx_pending)
+        {
+          crypto::rx_mining_hash_first(seed_height, seed_hash.data, hashing_blob.data(), hashing_blob.size(), tools::get_max_concurrency());
+          rx_pending = true;
+          rx_pending_nonce = nonce;
+          nonce += m_threads_total;
+          continue;
+        }
+        crypto::rx_mining_hash_next(hashing_blob.data(), hashing_blob.size(), h.data);
+        b.nonce = rx_pending_nonce;
+        rx_pending_nonce = nonce;
+      }
+      else
+      {
+        get_block_longhash(m_pbc, b, h, height, tools::get_max_concurrency());
+      }
 
       if(check_hash(h, local_diff))
       {
@@ -510,6 +615,7 @@ namespace cryptonote
       }
       nonce+=m_threads_total;
       ++m_hashes;
+      ++m_thread_hashes[th_local_index];
     }
     slow_hash_free_state();
     MGINFO("Miner thread stopped ["<< th_local_index << "]");
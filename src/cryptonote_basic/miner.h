@@ -70,8 +70,11 @@ namespace cryptonote
     static void init_options(boost::program_options::options_description& desc);
     bool set_block_template(const block& bl, const difficulty_type& diffic, uint64_t height);
     bool on_block_chain_update();
-    bool start(const account_public_address& adr, size_t threads_count, const boost::thread::attributes& attrs, bool do_background = false, bool ignore_battery = false);
+    /// affinity lists the CPUs mining thread i is pinned to at i modulo its size, empty for the --mining-affinity ones
+    bool start(const account_public_address& adr, size_t threads_count, const boost::thread::attributes& attrs, bool do_background = false, bool ignore_battery = false,
+        const std::vector<uint32_t>& affinity = std::vector<uint32_t>());
     uint64_t get_speed() const;
+    std::vector<uint64_t> get_threads_speed() const;
     uint32_t get_threads_count() const;
     void send_stop_signal();
     bool stop();
@@ -146,8 +149,11 @@ namespace cryptonote
     std::atomic<uint64_t> m_last_hr_merge_time;
     std::atomic<uint64_t> m_hashes;
     std::atomic<uint64_t> m_current_hash_rate;
-    epee::critical_section m_last_hash_rates_lock;
+    mutable epee::critical_section m_last_hash_rates_lock;
     std::list<uint64_t> m_last_hash_rates;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_thread_hashes;
+    std::vector<uint64_t> m_thread_hash_rates;
+    std::vector<uint32_t> m_affinity;
     bool m_do_print_hashrate;
     bool m_do_mining;
 
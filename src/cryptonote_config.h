@@ -51,6 +51,14 @@
 #define BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW               60
 #define BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW_V9            11
 
+#define BLOCKCHAIN_MAX_ALT_BLOCKS                       4096 // alternative blocks kept, the ones with the least work are evicted first
+#define BLOCKCHAIN_MAX_INVALID_BLOCKS                   1024
+
+#define CRYPTONOTE_PRUNING_STRIPE_SIZE                  4096 // blocks
+#define CRYPTONOTE_PRUNING_NUM_STRIPES                  8
+#define CRYPTONOTE_PRUNING_TIP_BLOCKS                   5500 // the last blocks are kept in full by all nodes, deeper than any reorg
+#define CRYPTONOTE_PRUNING_BLOCKS_PER_STEP              1000 // blocks the background pruning goes through at once
+
 // MONEY_SUPPLY - total number coins to be generated
 #define MONEY_SUPPLY                                    ((uint64_t)(-1))
 #define EMISSION_SPEED_FACTOR_PER_MINUTE                (20)
@@ -100,12 +108,16 @@
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4       100    //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              20     //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_MAX_COUNT                  2048   //must be a power of 2, greater than 128, equal to SEEDHASH_EPOCH_BLOCKS
+#define BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT           2048   //max block hashing blobs sent along with block ids in synchronizing
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    (86400*3) //seconds, three days
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
+#define CRYPTONOTE_MEMPOOL_BULLETPROOF_BATCH_WINDOW       5      //milliseconds, bulletproofs of txs relayed within the window are verified in one batch
+#define CRYPTONOTE_MEMPOOL_BULLETPROOF_BATCH_MAX_TXS      64
 
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
+#define COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN_MAX_COUNT 100000
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
 #define P2P_LOCAL_GRAY_PEERLIST_LIMIT                   5000
@@ -127,7 +139,18 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_ANNOUNCE_BATCH                 0x02
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS                 0x04
+#define P2P_SUPPORT_FLAG_TX_ANNOUNCE                    0x08
+#define P2P_SUPPORT_FLAG_ZSTD_PAYLOADS                  0x10
+#define P2P_SUPPORT_FLAG_PRUNING_STRIPE_SHIFT           8
+#define P2P_SUPPORT_FLAG_PRUNING_STRIPE_MASK            (0xf << P2P_SUPPORT_FLAG_PRUNING_STRIPE_SHIFT) // the stripe a pruned node keeps, 0 if it's not pruned
+#ifdef HAVE_ZSTD
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_ANNOUNCE_BATCH | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_TX_ANNOUNCE | P2P_SUPPORT_FLAG_ZSTD_PAYLOADS)
+#else
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_ANNOUNCE_BATCH | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_TX_ANNOUNCE)
+#endif
+#define P2P_COMPRESSED_PAYLOAD_MIN_SIZE                 (64*1024)  //smaller bulk sync responses are sent as they are
 
 #define ALLOW_DEBUG_COMMANDS
 
@@ -136,6 +159,8 @@
 #define CRYPTONOTE_BLOCKCHAINDATA_FILENAME      "data.mdb"
 #define CRYPTONOTE_BLOCKCHAINDATA_LOCK_FILENAME "lock.mdb"
 #define P2P_NET_DATA_FILENAME                   "p2pstate.bin"
+#define P2P_SEED_NODES_FILENAME                 "seed_nodes.txt"
+#define CRYPTONOTE_DNS_CHECKPOINTS_FILENAME     "dns_checkpoints.json"
 #define MINER_CONFIG_FILE_NAME                  "miner_conf.json"
 
 #define THREAD_STACK_SIZE                       5 * 1024 * 1024
@@ -152,6 +177,9 @@
 #define HASH_OF_HASHES_STEP                     256
 
 #define DEFAULT_TXPOOL_MAX_WEIGHT               648000000ull // 3 days at 300000, in bytes
+#define DEFAULT_RTA_BLOCK_WEIGHT_PERCENT        25 // of median block weight reserved for rta txs
+#define DEFAULT_TXPOOL_RTA_SHARE_PERCENT        25 // of max txpool size kept for rta txs when the pool is full
+#define DEFAULT_TXPOOL_STAKE_SHARE_PERCENT      10 // of max txpool size kept for stake txs when the pool is full
 
 #define BULLETPROOF_MAX_OUTPUTS                 16
 
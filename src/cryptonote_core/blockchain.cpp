@@ -46,6 +46,7 @@
 #include "profile_tools.h"
 #include "file_io_utils.h"
 #include "common/int-util.h"
+#include "common/metrics.h"
 #include "common/threadpool.h"
 #include "common/boost_serialization_helper.h"
 #include "warnings.h"
@@ -53,6 +54,8 @@
 #include "cryptonote_core.h"
 #include "ringct/rctSigs.h"
 #include "common/perf_timer.h"
+#include "common/pruning.h"
+#include "common/trace.h"
 #include "common/notify.h"
 #if defined(PER_BLOCK_CHECKPOINT)
 #include "blocks/blocks.h"
@@ -62,6 +65,8 @@
 #define MONERO_DEFAULT_LOG_CATEGORY "blockchain"
 
 #define FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE (100*1024*1024) // 100 MB
+#define FIND_BLOCKCHAIN_SUPPLEMENT_BATCH_SIZE 64 // blocks read at once
+#define GET_OUTS_MIN_RANGE_SIZE 256 // smallest run of outputs of an amount looked up on a thread of its own
 
 using namespace crypto;
 
@@ -85,6 +90,13 @@ DISABLE_VS_WARNINGS(4267)
 // used to overestimate the block reward when estimating a per kB to use
 #define BLOCK_REWARD_OVERESTIMATE (10 * 1000000000000)
 
+#define VERIFIED_TXS_MAX_COUNT 100000
+
+static tools::metrics::histogram block_verification_time("graft_block_verification_seconds", "Time spent verifying blocks to add to the main chain");
+static tools::metrics::counter blocks_added("graft_blocks_total", "Blocks verified to add to the main chain by outcome", "result=\"added\"");
+static tools::metrics::counter blocks_rejected("graft_blocks_total", "Blocks verified to add to the main chain by outcome", "result=\"rejected\"");
+static tools::memory::account randomx_memory("randomx", [](uint64_t& bytes) { bytes = crypto::rx_memory_usage(); return true; });
+
 static const struct {
   uint8_t version;
   uint64_t height;
@@ -200,10 +212,12 @@ static const struct {
 Blockchain::Blockchain(tx_memory_pool& tx_pool)
 : m_db(), m_tx_pool(tx_pool)
 , m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
-  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
+  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(0), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
   m_difficulty_for_next_block_top_hash(crypto::null_hash),
+  m_refreshed_top_hash(crypto::null_hash),
   m_difficulty_for_next_block(1),
   m_btc_valid(false),
+  m_tip_cookie(0),
   m_prepare_height(0)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -233,7 +247,7 @@ bool Blockchain::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
 // and collects the public key for each from the transaction it was included in
 // via the visitor passed to it.
 template <class visitor_t>
-bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height) const
+bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, uint64_t* pmax_related_block_height) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 
@@ -250,25 +264,27 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   // TODO: Investigate if this is necessary / why this is done.
   std::vector<uint64_t> absolute_offsets = relative_output_offsets_to_absolute(tx_in_to_key.key_offsets);
   std::vector<output_data_t> outputs;
+  outputs.reserve(absolute_offsets.size());
 
-  bool found = false;
-  auto it = m_scan_table.find(tx_prefix_hash);
-  if (it != m_scan_table.end())
+  // use the outputs prefetched for the incoming blocks, the rest is queried in one go
+  for (const uint64_t& i : absolute_offsets)
   {
-    auto its = it->second.find(tx_in_to_key.k_image);
-    if (its != it->second.end())
-    {
-      outputs = its->second;
-      found = true;
-    }
+    auto it = m_output_cache.find(std::make_pair(tx_in_to_key.amount, i));
+    if (it == m_output_cache.end())
+      break;
+    outputs.push_back(it->second);
   }
 
-  if (!found)
+  if (outputs.size() < absolute_offsets.size())
   {
+    if (!outputs.empty())
+      MDEBUG("Additional outputs needed: " << absolute_offsets.size() - outputs.size());
+    std::vector<uint64_t> add_offsets(absolute_offsets.begin() + outputs.size(), absolute_offsets.end());
+    std::vector<output_data_t> add_outputs;
     try
     {
-      m_db->get_output_key(tx_in_to_key.amount, absolute_offsets, outputs, true);
-      if (absolute_offsets.size() != outputs.size())
+      m_db->get_output_key(tx_in_to_key.amount, add_offsets, add_outputs, true);
+      if (add_offsets.size() != add_outputs.size())
       {
         MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
         return false;
@@ -279,34 +295,7 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
       MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
       return false;
     }
-  }
-  else
-  {
-    // check for partial results and add the rest if needed;
-    if (outputs.size() < absolute_offsets.size() && outputs.size() > 0)
-    {
-      MDEBUG("Additional outputs needed: " << absolute_offsets.size() - outputs.size());
-      std::vector < uint64_t > add_offsets;
-      std::vector<output_data_t> add_outputs;
-      add_outputs.reserve(absolute_offsets.size() - outputs.size());
-      for (size_t i = outputs.size(); i < absolute_offsets.size(); i++)
-        add_offsets.push_back(absolute_offsets[i]);
-      try
-      {
-        m_db->get_output_key(tx_in_to_key.amount, add_offsets, add_outputs, true);
-        if (add_offsets.size() != add_outputs.size())
-        {
-          MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
-          return false;
-        }
-      }
-      catch (...)
-      {
-        MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
-        return false;
-      }
-      outputs.insert(outputs.end(), add_outputs.begin(), add_outputs.end());
-    }
+    outputs.insert(outputs.end(), add_outputs.begin(), add_outputs.end());
   }
 
   size_t count = 0;
@@ -523,12 +512,14 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   }
   if (num_popped_blocks > 0)
   {
-    m_timestamps_and_difficulties_height = 0;
     m_hardfork->reorganize_from_chain_height(get_current_blockchain_height());
     m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
   }
 
+  load_alternative_blocks();
+
   update_next_cumulative_weight_limit();
+  publish_tip_snapshot();
   return true;
 }
 //------------------------------------------------------------------
@@ -580,6 +571,16 @@ bool Blockchain::deinit()
 
  // stop async service
   m_async_work_idle.reset();
+  take_prefetched_longhashes();
+  {
+    boost::thread header_pow_thread;
+    {
+      boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+      header_pow_thread = std::move(m_header_pow_thread);
+    }
+    if (header_pow_thread.joinable())
+      header_pow_thread.join();
+  }
   m_async_pool.join_all();
   m_async_service.stop();
 
@@ -591,6 +592,15 @@ bool Blockchain::deinit()
     throw DB_ERROR("The db pointer is null in Blockchain, the blockchain may be corrupt!");
   }
 
+  try
+  {
+    store_txpool_snapshot();
+  }
+  catch (const std::exception& e)
+  {
+    LOG_ERROR(std::string("Error storing txpool snapshot: ") + e.what());
+  }
+
   try
   {
     m_db->close();
@@ -620,11 +630,10 @@ block Blockchain::pop_block_from_blockchain()
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   block popped_block;
   std::vector<transaction> popped_txs;
 
+  const uint64_t popped_height = m_db->height() - 1;
   try
   {
     m_db->pop_block(popped_block, popped_txs);
@@ -641,6 +650,19 @@ block Blockchain::pop_block_from_blockchain()
     LOG_ERROR("Error popping block from blockchain, throwing!");
     throw;
   }
+  ++m_tip_cookie;
+
+  // the window is short of a block at its start now, read back when needed
+  if (m_timestamps_and_difficulties_height == popped_height + 1 && !m_timestamps.empty())
+  {
+    m_timestamps.pop_back();
+    m_difficulties.pop_back();
+    m_timestamps_and_difficulties_height = popped_height;
+  }
+  else
+  {
+    m_timestamps_and_difficulties_height = 0;
+  }
 
   // return transactions from popped block to the tx_pool
   for (transaction& tx : popped_txs)
@@ -673,14 +695,18 @@ block Blockchain::pop_block_from_blockchain()
   }
 
   m_blocks_longhash_table.clear();
-  m_scan_table.clear();
+  clear_output_cache();
   m_blocks_txs_check.clear();
   m_check_txin_table.clear();
 
   update_next_cumulative_weight_limit();
+  publish_tip_snapshot();
   m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
   invalidate_block_template_cache();
 
+  if (m_block_popped_handler)
+    m_block_popped_handler(m_db->height());
+
   return popped_block;
 }
 //------------------------------------------------------------------
@@ -741,7 +767,7 @@ bool Blockchain::get_short_chain_history(std::list<crypto::hash>& ids) const
   if(!sz)
     return true;
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(*m_db);
   bool genesis_included = false;
   uint64_t current_back_offset = 1;
   while(current_back_offset < sz)
@@ -768,7 +794,6 @@ bool Blockchain::get_short_chain_history(std::list<crypto::hash>& ids) const
   {
     ids.push_back(m_db->get_block_hash_from_height(0));
   }
-  m_db->block_txn_stop();
 
   return true;
 }
@@ -871,70 +896,77 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   }
 
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  std::vector<uint64_t> timestamps;
-  std::vector<difficulty_type> difficulties;
+  // the difficulty is cached for the top block seen with the blockchain lock held
+  top_hash = get_tail_id();
   auto height = m_db->height();
 
   uint8_t version = get_current_hard_fork_version();
   size_t difficulty_blocks_count = (version < 8) ? DIFFICULTY_BLOCKS_COUNT : DIFFICULTY_BLOCKS_COUNT_V8;
 
-  // ND: Speedup
-  // 1. Keep a list of the last 735 (or less) blocks that is used to compute difficulty,
-  //    then when the next block difficulty is queried, push the latest height data and
-  //    pop the oldest one from the list. This only requires 1x read per height instead
-  //    of doing 735 (DIFFICULTY_BLOCKS_COUNT).
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1) && m_timestamps.size() >= DIFFICULTY_BLOCKS_COUNT)
+  // the timestamps and cumulative difficulties of the blocks the difficulty is computed from
+  // are kept as a rolling window, which blocks added to and popped from the main chain update,
+  // so the DB is only read when the window doesn't follow the chain
+  const size_t window_size = std::min<uint64_t>(difficulty_blocks_count, height ? height - 1 : 0);
+  if (m_timestamps_and_difficulties_height != height)
   {
-    uint64_t index = height - 1;
-    m_timestamps.push_back(m_db->get_block_timestamp(index));
-    m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
-    while (m_timestamps.size() > difficulty_blocks_count)
-      m_timestamps.erase(m_timestamps.begin());
-    while (m_difficulties.size() > difficulty_blocks_count)
-      m_difficulties.erase(m_difficulties.begin());
-
+    m_timestamps.clear();
+    m_difficulties.clear();
     m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
   }
-  else
+  if (m_timestamps.size() < window_size)
   {
-    size_t offset = height - std::min < size_t > (height, static_cast<size_t>(difficulty_blocks_count));
-    if (offset == 0)
-      ++offset;
-
-    timestamps.clear();
-    difficulties.clear();
-    if (height > offset)
+    // blocks are missing at the start after blocks were popped, or the window got larger
+    std::vector<uint64_t> missing_timestamps;
+    std::vector<difficulty_type> missing_difficulties;
+    const uint64_t first = height - window_size, end = height - m_timestamps.size();
+    missing_timestamps.reserve(end - first);
+    missing_difficulties.reserve(end - first);
+    for (uint64_t h = first; h < end; ++h)
     {
-      timestamps.reserve(height - offset);
-      difficulties.reserve(height - offset);
+      missing_timestamps.push_back(m_db->get_block_timestamp(h));
+      missing_difficulties.push_back(m_db->get_block_cumulative_difficulty(h));
     }
-    for (; offset < height; offset++)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-    }
-
-    m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
+    m_timestamps.insert(m_timestamps.begin(), missing_timestamps.begin(), missing_timestamps.end());
+    m_difficulties.insert(m_difficulties.begin(), missing_difficulties.begin(), missing_difficulties.end());
   }
+  // LWMA reads the window in place, the old algorithm reorders its own copy
+  const uint64_t *window_timestamps = m_timestamps.data() + m_timestamps.size() - window_size;
+  const difficulty_type *window_difficulties = m_difficulties.data() + m_difficulties.size() - window_size;
 
   const size_t target = get_difficulty_target();
+  difficulty_type diff;
   if (version < 8)
   {
-      return next_difficulty(timestamps, difficulties, target);
+      diff = next_difficulty(std::vector<uint64_t>(window_timestamps, window_timestamps + window_size),
+                             std::vector<difficulty_type>(window_difficulties, window_difficulties + window_size), target);
   }
   else if (version == 8 || version >= 10)
   {
-      return next_difficulty_v8(timestamps, difficulties, target);
+      diff = next_difficulty_v8(window_timestamps, window_difficulties, window_size, target);
   }
   else
   {
-      return next_difficulty_v9(timestamps, difficulties, target);
+      diff = next_difficulty_v9(window_timestamps, window_difficulties, window_size, target);
   }
+
+  CRITICAL_REGION_LOCAL1(m_difficulty_lock);
+  m_difficulty_for_next_block_top_hash = top_hash;
+  m_difficulty_for_next_block = diff;
+  return diff;
+}
+//------------------------------------------------------------------
+namespace
+{
+  /// Batch write transaction, stopped when leaving the scope; does nothing if a batch is already active
+  class db_batch_guard
+  {
+  public:
+    db_batch_guard(BlockchainDB &db): m_db(db), m_batch(db.batch_start()) {}
+    ~db_batch_guard() { try { if (m_batch) m_db.batch_stop(); } catch (const std::exception &e) { MWARNING("db_batch_guard dtor filtering exception: " << e.what()); } }
+  private:
+    BlockchainDB &m_db;
+    bool m_batch;
+  };
 }
 //------------------------------------------------------------------
 // This function removes blocks from the blockchain until it gets to the
@@ -999,6 +1031,9 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
     return false;
   }
 
+  // pop and push all blocks in one write transaction
+  db_batch_guard batch_guard(*m_db);
+
   // pop blocks from the blockchain until the top block is the parent
   // of the front block of the alt chain.
   std::list<block> disconnected_chain;
@@ -1010,6 +1045,13 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
 
   auto split_height = m_db->height();
 
+  // proof of work of alternative blocks was checked when they were received, don't hash them again
+  for (const auto &ch_ent : alt_chain)
+  {
+    if (ch_ent->second.pow != crypto::null_hash)
+      m_blocks_longhash_table.emplace(ch_ent->first, ch_ent->second.pow);
+  }
+
   //connecting new alternative chain
   for(auto alt_ch_iter = alt_chain.begin(); alt_ch_iter != alt_chain.end(); alt_ch_iter++)
   {
@@ -1035,17 +1077,25 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
       // looking into.
       add_block_as_invalid(ch_ent->second, get_block_hash(ch_ent->second.bl));
       MERROR("The block was inserted as invalid while connecting new alternative chain, block_id: " << get_block_hash(ch_ent->second.bl));
-      m_alternative_chains.erase(*alt_ch_iter++);
+      remove_alternative_block(*alt_ch_iter++);
 
       for(auto alt_ch_to_orph_iter = alt_ch_iter; alt_ch_to_orph_iter != alt_chain.end(); )
       {
         add_block_as_invalid((*alt_ch_to_orph_iter)->second, (*alt_ch_to_orph_iter)->first);
-        m_alternative_chains.erase(*alt_ch_to_orph_iter++);
+        remove_alternative_block(*alt_ch_to_orph_iter++);
       }
+      publish_tip_snapshot();
       return false;
     }
   }
 
+  // removing alt_chain entries from alternative chains container, before
+  // adding the old chain as its blocks could evict them
+  for (auto ch_ent: alt_chain)
+  {
+    remove_alternative_block(ch_ent);
+  }
+
   // if we're to keep the disconnected blocks, add them as alternates
   if(!discard_disconnected_chain)
   {
@@ -1063,16 +1113,15 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
     }
   }
 
-  //removing alt_chain entries from alternative chains container
-  for (auto ch_ent: alt_chain)
-  {
-    m_alternative_chains.erase(ch_ent);
-  }
+  publish_tip_snapshot();
 
   m_hardfork->reorganize_from_chain_height(split_height);
   get_block_longhash_reorg(split_height);
 
   MGINFO_GREEN("REORGANIZE SUCCESS! on height: " << split_height << ", new blockchain size: " << m_db->height());
+
+  if (m_reorg_handler)
+    m_reorg_handler(split_height, split_height + disconnected_chain.size(), m_db->height());
   return true;
 }
 //------------------------------------------------------------------
@@ -1262,7 +1311,7 @@ void Blockchain::get_last_n_blocks_weights(std::vector<size_t>& weights, size_t
   if(h == 0)
     return;
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(*m_db);
   // add weight of last <count> blocks to vector <weights> (or less, if blockchain size < count)
   size_t start_offset = h - std::min<size_t>(h, count);
   weights.reserve(weights.size() + h - start_offset);
@@ -1270,7 +1319,6 @@ void Blockchain::get_last_n_blocks_weights(std::vector<size_t>& weights, size_t
   {
     weights.push_back(m_db->get_block_weight(i));
   }
-  m_db->block_txn_stop();
 }
 //------------------------------------------------------------------
 uint64_t Blockchain::get_current_cumulative_block_weight_limit() const
@@ -1507,6 +1555,104 @@ bool Blockchain::complete_timestamps_vector(uint64_t start_top_height, std::vect
   return true;
 }
 //------------------------------------------------------------------
+Blockchain::blocks_ext_by_hash::iterator Blockchain::add_alternative_block(const crypto::hash& id, const block_extended_info& bei)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
+  if (!i_res.second)
+    return m_alternative_chains.end();
+
+  alt_block_data_t data;
+  data.height = bei.height;
+  data.cumulative_weight = bei.block_cumulative_weight;
+  data.cumulative_difficulty = bei.cumulative_difficulty;
+  data.already_generated_coins = bei.already_generated_coins;
+  data.pow = bei.pow;
+  try
+  {
+    m_db->add_alt_block(id, data, block_to_blob(bei.bl));
+  }
+  catch (const std::exception &e)
+  {
+    // the block is still usable from memory, it just won't survive a restart
+    MERROR("Failed to store alternative block " << id << ": " << e.what());
+  }
+
+  evict_alternative_blocks(id);
+  return i_res.first;
+}
+//------------------------------------------------------------------
+void Blockchain::remove_alternative_block(blocks_ext_by_hash::iterator it)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  try
+  {
+    m_db->remove_alt_block(it->first);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to remove alternative block " << it->first << ": " << e.what());
+  }
+  m_alternative_chains.erase(it);
+}
+//------------------------------------------------------------------
+void Blockchain::evict_alternative_blocks(const crypto::hash& keep)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  while (m_alternative_chains.size() > BLOCKCHAIN_MAX_ALT_BLOCKS)
+  {
+    std::unordered_set<crypto::hash> parents;
+    parents.reserve(m_alternative_chains.size());
+    for (const auto &e: m_alternative_chains)
+      parents.insert(e.second.bl.prev_id);
+
+    // evicting a tip leaves the rest of its chain connected
+    auto victim = m_alternative_chains.end();
+    for (auto it = m_alternative_chains.begin(); it != m_alternative_chains.end(); ++it)
+    {
+      if (it->first == keep || parents.find(it->first) != parents.end())
+        continue;
+      if (victim == m_alternative_chains.end() || it->second.cumulative_difficulty < victim->second.cumulative_difficulty)
+        victim = it;
+    }
+    if (victim == m_alternative_chains.end())
+      break;
+    MDEBUG("Evicting alternative block " << victim->first << " at height " << victim->second.height << ", cumulative difficulty " << victim->second.cumulative_difficulty);
+    remove_alternative_block(victim);
+  }
+}
+//------------------------------------------------------------------
+void Blockchain::load_alternative_blocks()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  std::vector<crypto::hash> stale;
+  m_db->for_all_alt_blocks([&](const crypto::hash &id, const alt_block_data_t &data, const cryptonote::blobdata &blob) {
+    block_extended_info bei = boost::value_initialized<block_extended_info>();
+    if (!parse_and_validate_block_from_blob(blob, bei.bl) || m_db->block_exists(id))
+    {
+      stale.push_back(id);
+      return true;
+    }
+    bei.height = data.height;
+    bei.block_cumulative_weight = data.cumulative_weight;
+    bei.cumulative_difficulty = data.cumulative_difficulty;
+    bei.already_generated_coins = data.already_generated_coins;
+    bei.pow = data.pow;
+    m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
+    return true;
+  });
+
+  if (!m_db->is_read_only())
+  {
+    for (const crypto::hash &id: stale)
+      m_db->remove_alt_block(id);
+    evict_alternative_blocks(crypto::null_hash);
+  }
+  if (!m_alternative_chains.empty())
+    MINFO("Loaded " << m_alternative_chains.size() << " alternative blocks");
+}
+//------------------------------------------------------------------
 // If a block is to be added and its parent block is not the current
 // main chain top block, then we need to see if we know about its parent block.
 // If its parent block is part of a known forked chain, then we need to see
@@ -1547,7 +1693,8 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
   //block is not related with head of main chain
   //first of all - look in alternative chains container
   auto it_prev = m_alternative_chains.find(b.prev_id);
-  bool parent_in_main = m_db->block_exists(b.prev_id);
+  uint64_t parent_height = 0;
+  bool parent_in_main = m_db->block_exists(b.prev_id, &parent_height);
   if(it_prev != m_alternative_chains.end() || parent_in_main)
   {
     //we have new block in alternative chain
@@ -1570,18 +1717,12 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
       // make sure alt chain doesn't somehow start past the end of the main chain
       CHECK_AND_ASSERT_MES(m_db->height() > alt_chain.front()->second.height, false, "main blockchain wrong height");
 
-      // make sure that the blockchain contains the block that should connect
-      // this alternate chain with it.
-      if (!m_db->block_exists(alt_chain.front()->second.bl.prev_id))
-      {
-        MERROR("alternate chain does not appear to connect to main chain...");
-        return false;
-      }
-
-      // make sure block connects correctly to the main chain
-      auto h = m_db->get_block_hash_from_height(alt_chain.front()->second.height - 1);
+      // make sure block connects correctly to the main chain, the main
+      // chain block at the height below the alt chain is its parent
+      const uint64_t connection_height = alt_chain.front()->second.height - 1;
+      auto h = m_db->get_block_hash_from_height(connection_height);
       CHECK_AND_ASSERT_MES(h == alt_chain.front()->second.bl.prev_id, false, "alternative chain has wrong connection to main chain");
-      complete_timestamps_vector(m_db->get_block_height(alt_chain.front()->second.bl.prev_id), timestamps);
+      complete_timestamps_vector(connection_height, timestamps);
     }
     // if block not associated with known alternate chain
     else
@@ -1590,7 +1731,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
       // we ignore it
       CHECK_AND_ASSERT_MES(parent_in_main, false, "internal error: broken imperative condition: parent_in_main");
 
-      complete_timestamps_vector(m_db->get_block_height(b.prev_id), timestamps);
+      complete_timestamps_vector(parent_height, timestamps);
     }
 
     // verify that the block's timestamp is within the acceptable range
@@ -1605,7 +1746,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     // FIXME: consider moving away from block_extended_info at some point
     block_extended_info bei = boost::value_initialized<block_extended_info>();
     bei.bl = b;
-    bei.height = alt_chain.size() ? it_prev->second.height + 1 : m_db->get_block_height(b.prev_id) + 1;
+    bei.height = alt_chain.size() ? it_prev->second.height + 1 : parent_height + 1;
 
     bool is_a_checkpoint;
     if(!m_checkpoints.check_block(bei.height, id, is_a_checkpoint))
@@ -1643,6 +1784,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     {
       get_block_longhash(this, bei.bl, proof_of_work, bei.height, 0);
     }
+    bei.pow = proof_of_work;
     if(!check_hash(proof_of_work, current_diff))
     {
       MERROR_VER("Block with id: " << id << std::endl << " for alternative chain, does not have enough proof of work: " << proof_of_work << std::endl << " expected difficulty: " << current_diff);
@@ -1668,15 +1810,16 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     else
     {
       // passed-in block's previous block's cumulative difficulty, found on the main chain
-      bei.cumulative_difficulty = m_db->get_block_cumulative_difficulty(m_db->get_block_height(b.prev_id));
+      bei.cumulative_difficulty = m_db->get_block_cumulative_difficulty(parent_height);
     }
     bei.cumulative_difficulty += current_diff;
 
     // add block to alternate blocks storage,
     // as well as the current "alt chain" container
-    auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
-    CHECK_AND_ASSERT_MES(i_res.second, false, "insertion of new alternative block returned as it already exist");
-    alt_chain.push_back(i_res.first);
+    auto i_res = add_alternative_block(id, bei);
+    CHECK_AND_ASSERT_MES(i_res != m_alternative_chains.end(), false, "insertion of new alternative block returned as it already exist");
+    alt_chain.push_back(i_res);
+    publish_tip_snapshot();
 
     // FIXME: is it even possible for a checkpoint to show up not on the main chain?
     if(is_a_checkpoint)
@@ -1694,7 +1837,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     else if(main_chain_cumulative_difficulty < bei.cumulative_difficulty) //check if difficulty bigger then in main chain
     {
       //do reorganize!
-      MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db->height() - 1 << " with cum_difficulty " << m_db->get_block_cumulative_difficulty(m_db->height() - 1) << std::endl << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << bei.cumulative_difficulty);
+      MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db->height() - 1 << " with cum_difficulty " << main_chain_cumulative_difficulty << std::endl << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << bei.cumulative_difficulty);
 
       bool r = switch_to_alternative_blockchain(alt_chain, false);
       if (r)
@@ -1751,10 +1894,12 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
   if(start_offset >= height)
     return false;
 
-  blocks.reserve(blocks.size() + height - start_offset);
-  for(size_t i = start_offset; i < start_offset + count && i < height;i++)
+  std::vector<cryptonote::blobdata> blobs;
+  m_db->get_block_blobs_from_height(start_offset, std::min<uint64_t>(count, height - start_offset), blobs);
+  blocks.reserve(blocks.size() + blobs.size());
+  for (auto &blob: blobs)
   {
-    blocks.push_back(std::make_pair(m_db->get_block_blob_from_height(i), block()));
+    blocks.push_back(std::make_pair(std::move(blob), block()));
     if (!parse_and_validate_block_from_blob(blocks.back().first, blocks.back().second))
     {
       LOG_ERROR("Invalid block");
@@ -1775,23 +1920,59 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(*m_db);
   rsp.current_blockchain_height = get_current_blockchain_height();
   std::vector<std::pair<cryptonote::blobdata,block>> blocks;
   get_blocks(arg.blocks, blocks, rsp.missed_ids);
 
+  // the txs of all blocks are read in one batch
+  std::vector<crypto::hash> block_tx_hashes;
+  for (const auto& bl: blocks)
+    block_tx_hashes.insert(block_tx_hashes.end(), bl.second.tx_hashes.begin(), bl.second.tx_hashes.end());
+  std::vector<cryptonote::blobdata> block_txs;
+  std::vector<bool> found;
+  try
+  {
+    m_db->get_tx_blobs(block_tx_hashes, block_txs, found, false);
+  }
+  catch (const std::exception& e)
+  {
+    return false;
+  }
+
+  const uint32_t pruning_stripe = m_db->get_blockchain_pruning_stripe();
+  size_t tx_index = 0;
   for (auto& bl: blocks)
   {
     std::vector<crypto::hash> missed_tx_ids;
-    std::vector<cryptonote::blobdata> txs;
 
     rsp.blocks.push_back(block_complete_entry());
     block_complete_entry& e = rsp.blocks.back();
 
+    e.txs.reserve(bl.second.tx_hashes.size());
+    for (size_t i = 0; i < bl.second.tx_hashes.size(); ++i, ++tx_index)
+    {
+      if (found[tx_index])
+        e.txs.push_back(std::move(block_txs[tx_index]));
+      else
+        missed_tx_ids.push_back(block_tx_hashes[tx_index]);
+    }
+
+    // blocks we pruned are missed, the peer has to get them elsewhere
+    if (missed_tx_ids.size() != 0 && pruning_stripe)
+    {
+      const uint64_t height = cryptonote::get_block_height(bl.second);
+      if (!tools::has_unpruned_block(height, rsp.current_blockchain_height, pruning_stripe))
+      {
+        MDEBUG("Block " << height << " is pruned, sending it as missed");
+        rsp.missed_ids.push_back(get_block_hash(bl.second));
+        rsp.blocks.pop_back();
+        continue;
+      }
+    }
+
     // FIXME: s/rsp.missed_ids/missed_tx_id/ ?  Seems like rsp.missed_ids
     //        is for missed blocks, not missed transactions as well.
-    get_transactions_blobs(bl.second.tx_hashes, e.txs, missed_tx_ids);
-
     if (missed_tx_ids.size() != 0)
     {
       LOG_ERROR("Error retrieving blocks, missed " << missed_tx_ids.size()
@@ -1803,7 +1984,6 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
       // as done below if any standalone transactions were requested
       // and missed.
       rsp.missed_ids.insert(rsp.missed_ids.end(), missed_tx_ids.begin(), missed_tx_ids.end());
-      m_db->block_txn_stop();
       return false;
     }
 
@@ -1814,7 +1994,6 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
   std::vector<cryptonote::blobdata> txs;
   get_transactions_blobs(arg.txs, rsp.txs, rsp.missed_ids);
 
-  m_db->block_txn_stop();
   return true;
 }
 //------------------------------------------------------------------
@@ -1870,33 +2049,100 @@ bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMA
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   res.outs.clear();
-  res.outs.reserve(req.outputs.size());
-  try
+
+  // the request in amount then index order, so that each output is looked up next to the previous one
+  std::vector<size_t> order(req.outputs.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&req](size_t a, size_t b) {
+    const auto &oa = req.outputs[a], &ob = req.outputs[b];
+    return oa.amount < ob.amount || (oa.amount == ob.amount && oa.index < ob.index);
+  });
+
+  // split into ranges of a single amount, large requests are shared among the threadpool
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t threads = m_db->can_thread_bulk_indices() ? tpool.get_max_concurrency() : 1;
+  const size_t range_size = std::max<size_t>((order.size() + threads - 1) / threads, GET_OUTS_MIN_RANGE_SIZE);
+  struct outs_range
+  {
+    uint64_t amount;
+    size_t begin;
+    std::vector<uint64_t> offsets;
+    std::vector<output_data_t> outputs;
+    std::vector<tx_out_index> txs;
+    bool ok;
+  };
+  std::vector<outs_range> ranges;
+  for (size_t begin = 0; begin < order.size(); )
   {
-    for (const auto &i: req.outputs)
-    {
-      // get tx_hash, tx_out_index from DB
-      const output_data_t od = m_db->get_output_key(i.amount, i.index);
-      tx_out_index toi = m_db->get_output_tx_and_index(i.amount, i.index);
-      bool unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
+    const uint64_t amount = req.outputs[order[begin]].amount;
+    ranges.push_back({amount, begin, {}, {}, {}, false});
+    size_t end = begin;
+    for (; end < order.size() && end - begin < range_size && req.outputs[order[end]].amount == amount; ++end)
+      ranges.back().offsets.push_back(req.outputs[order[end]].index);
+    begin = end;
+  }
 
-      res.outs.push_back({od.pubkey, od.commitment, unlocked, od.height, toi.first});
+  const auto lookup = [this](outs_range &range) {
+    try
+    {
+      m_db->get_output_keys_and_txs(range.amount, range.offsets, range.outputs, range.txs);
+      range.ok = range.outputs.size() == range.offsets.size() && range.txs.size() == range.offsets.size();
+    }
+    catch (const std::exception &e)
+    {
+      MDEBUG("Failed to get outputs of amount " << range.amount << ": " << e.what());
     }
+  };
+  if (threads > 1 && ranges.size() > 1)
+  {
+    tools::threadpool::waiter waiter;
+    for (outs_range &range: ranges)
+      tpool.submit(&waiter, [&lookup, &range]() { lookup(range); }, true);
+    waiter.wait(&tpool);
   }
-  catch (const std::exception &e)
+  else
   {
-    return false;
+    for (outs_range &range: ranges)
+      lookup(range);
+  }
+
+  // the unlock time of an output is its transaction's, so it doesn't need looking up
+  res.outs.resize(req.outputs.size());
+  for (const outs_range &range: ranges)
+  {
+    if (!range.ok)
+    {
+      res.outs.clear();
+      return false;
+    }
+    for (size_t j = 0; j < range.offsets.size(); ++j)
+    {
+      const output_data_t &od = range.outputs[j];
+      res.outs[order[range.begin + j]] = {od.pubkey, od.commitment, is_tx_spendtime_unlocked(od.unlock_time), od.height, range.txs[j].first};
+    }
   }
   return true;
 }
 //------------------------------------------------------------------
 void Blockchain::get_output_key_mask_unlocked(const uint64_t& amount, const uint64_t& index, crypto::public_key& key, rct::key& mask, bool& unlocked) const
 {
+  {
+    boost::lock_guard<boost::mutex> lock(m_output_cache_lock);
+    auto it = m_output_cache.find(std::make_pair(amount, index));
+    if (it != m_output_cache.end())
+    {
+      key = it->second.pubkey;
+      mask = it->second.commitment;
+      unlocked = is_tx_spendtime_unlocked(it->second.unlock_time);
+      return;
+    }
+  }
+
   const auto o_data = m_db->get_output_key(amount, index);
   key = o_data.pubkey;
   mask = o_data.commitment;
-  tx_out_index toi = m_db->get_output_tx_and_index(amount, index);
-  unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
+  unlocked = is_tx_spendtime_unlocked(o_data.unlock_time);
 }
 //------------------------------------------------------------------
 bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
@@ -1963,14 +2209,13 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     return false;
   }
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(*m_db);
   // make sure that the last block in the request's block list matches
   // the genesis block
   auto gen_hash = m_db->get_block_hash_from_height(0);
   if(qblock_ids.back() != gen_hash)
   {
     MCERROR("net.p2p", "Client sent wrong NOTIFY_REQUEST_CHAIN: genesis block mismatch: " << std::endl << "id: " << qblock_ids.back() << ", " << std::endl << "expected: " << gen_hash << "," << std::endl << " dropping connection");
-	m_db->block_txn_abort();
     return false;
   }
 
@@ -1988,11 +2233,9 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     catch (const std::exception& e)
     {
       MWARNING("Non-critical error trying to find block by hash in BlockchainDB, hash: " << *bl_it);
-	  m_db->block_txn_abort();
       return false;
     }
   }
-  m_db->block_txn_stop();
 
   // this should be impossible, as we checked that we share the genesis block,
   // but just in case...
@@ -2037,28 +2280,32 @@ bool Blockchain::get_blocks(const t_ids_container& block_ids, t_blocks_container
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   reserve_container(blocks, block_ids.size());
-  for (const auto& block_hash : block_ids)
+  const std::vector<crypto::hash> hashes(block_ids.begin(), block_ids.end());
+  std::vector<cryptonote::blobdata> blobs;
+  std::vector<bool> found;
+  try
   {
-    try
+    m_db->get_block_blobs(hashes, blobs, found);
+  }
+  catch (const std::exception& e)
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < hashes.size(); ++i)
+  {
+    if (found[i])
     {
-      uint64_t height = 0;
-      if (m_db->block_exists(block_hash, &height))
+      blocks.push_back(std::make_pair(std::move(blobs[i]), block()));
+      if (!parse_and_validate_block_from_blob(blocks.back().first, blocks.back().second))
       {
-        blocks.push_back(std::make_pair(m_db->get_block_blob_from_height(height), block()));
-        if (!parse_and_validate_block_from_blob(blocks.back().first, blocks.back().second))
-        {
-          LOG_ERROR("Invalid block: " << block_hash);
-          blocks.pop_back();
-          missed_bs.push_back(block_hash);
-        }
+        LOG_ERROR("Invalid block: " << hashes[i]);
+        blocks.pop_back();
+        missed_bs.push_back(hashes[i]);
       }
-      else
-        missed_bs.push_back(block_hash);
-    }
-    catch (const std::exception& e)
-    {
-      return false;
     }
+    else
+      missed_bs.push_back(hashes[i]);
   }
   return true;
 }
@@ -2072,22 +2319,24 @@ bool Blockchain::get_transactions_blobs(const t_ids_container& txs_ids, t_tx_con
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   reserve_container(txs, txs_ids.size());
-  for (const auto& tx_hash : txs_ids)
+  const std::vector<crypto::hash> hashes(txs_ids.begin(), txs_ids.end());
+  std::vector<cryptonote::blobdata> blobs;
+  std::vector<bool> found;
+  try
   {
-    try
-    {
-      cryptonote::blobdata tx;
-      if (pruned && m_db->get_pruned_tx_blob(tx_hash, tx))
-        txs.push_back(std::move(tx));
-      else if (!pruned && m_db->get_tx_blob(tx_hash, tx))
-        txs.push_back(std::move(tx));
-      else
-        missed_txs.push_back(tx_hash);
-    }
-    catch (const std::exception& e)
-    {
-      return false;
-    }
+    m_db->get_tx_blobs(hashes, blobs, found, pruned);
+  }
+  catch (const std::exception& e)
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < hashes.size(); ++i)
+  {
+    if (found[i])
+      txs.push_back(std::move(blobs[i]));
+    else
+      missed_txs.push_back(hashes[i]);
   }
   return true;
 }
@@ -2107,7 +2356,7 @@ bool Blockchain::get_transactions(const t_ids_container& txs_ids, t_tx_container
       if (m_db->get_tx_blob(tx_hash, tx))
       {
         txs.push_back(transaction());
-        if (!parse_and_validate_tx_from_blob(tx, txs.back()))
+        if (!parse_and_validate_tx_from_blob(tx, txs.back(), tx_hash))
         {
           LOG_ERROR("Invalid transaction");
           return false;
@@ -2138,7 +2387,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     return false;
   }
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(*m_db);
   current_height = get_current_blockchain_height();
   size_t count = 0;
   hashes.reserve(std::max((size_t)(current_height - start_height), (size_t)BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT));
@@ -2147,11 +2396,10 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     hashes.push_back(m_db->get_block_hash_from_height(i));
   }
 
-  m_db->block_txn_stop();
   return true;
 }
 
-bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const
+bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool request_headers) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -2160,6 +2408,25 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
   if (result)
     resp.cumulative_difficulty = m_db->get_block_cumulative_difficulty(resp.total_height - 1);
 
+  if (result && request_headers)
+  {
+    const size_t count = std::min<size_t>(resp.m_block_ids.size(), BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT);
+    resp.m_block_hashing_blobs.reserve(count);
+
+    db_rtxn_guard rtxn_guard(*m_db);
+    for (size_t i = 0; i < count; ++i)
+    {
+      block b;
+      if (!parse_and_validate_block_from_blob(m_db->get_block_blob_from_height(resp.start_height + i), b))
+      {
+        MERROR("Failed to parse block at height " << resp.start_height + i);
+        resp.m_block_hashing_blobs.clear();
+        break;
+      }
+      resp.m_block_hashing_blobs.push_back(get_block_hashing_blob(b));
+    }
+  }
+
   return result;
 }
 //------------------------------------------------------------------
@@ -2190,20 +2457,35 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
     }
   }
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(*m_db);
   total_height = get_current_blockchain_height();
   size_t count = 0, size = 0;
   blocks.reserve(std::min(std::min(max_count, (size_t)10000), (size_t)(total_height - start_height)));
+  std::vector<cryptonote::blobdata> block_blobs;
+  size_t next_block_blob = 0;
   for(uint64_t i = start_height; i < total_height && count < max_count && (size < FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE || count < 3); i++, count++)
   {
+    // the size limit is not known ahead, so blocks are read in small batches
+    if (next_block_blob == block_blobs.size())
+    {
+      m_db->get_block_blobs_from_height(i, std::min<uint64_t>(std::min<uint64_t>(FIND_BLOCKCHAIN_SUPPLEMENT_BATCH_SIZE, max_count - count), total_height - i), block_blobs);
+      next_block_blob = 0;
+    }
     blocks.resize(blocks.size()+1);
-    blocks.back().first.first = m_db->get_block_blob_from_height(i);
+    blocks.back().first.first = std::move(block_blobs[next_block_blob++]);
     block b;
     CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(blocks.back().first.first, b), false, "internal error, invalid block");
     blocks.back().first.second = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
     std::vector<crypto::hash> mis;
     std::vector<cryptonote::blobdata> txs;
     get_transactions_blobs(b.tx_hashes, txs, mis, pruned);
+    if (!mis.empty() && !tools::has_unpruned_block(i, total_height, m_db->get_blockchain_pruning_stripe()))
+    {
+      // the full txs of pruned blocks are gone, what's before them is still sent
+      blocks.pop_back();
+      CHECK_AND_ASSERT_MES(count > 0, false, "Block " << i << " is pruned, its transactions can only be sent pruned");
+      break;
+    }
     CHECK_AND_ASSERT_MES(!mis.size(), false, "internal error, transaction from block not found");
     size += blocks.back().first.first.size();
     for (const auto &t: txs)
@@ -2216,7 +2498,6 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
       blocks.back().second.push_back(std::make_pair(b.tx_hashes[i], std::move(txs[i])));
     }
   }
-  m_db->block_txn_stop();
   return true;
 }
 //------------------------------------------------------------------
@@ -2232,6 +2513,8 @@ bool Blockchain::add_block_as_invalid(const block_extended_info& bei, const cryp
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  if (m_invalid_blocks.size() >= BLOCKCHAIN_MAX_INVALID_BLOCKS)
+    m_invalid_blocks.erase(m_invalid_blocks.begin());
   auto i_res = m_invalid_blocks.insert(std::map<crypto::hash, block_extended_info>::value_type(h, bei));
   CHECK_AND_ASSERT_MES(i_res.second, false, "at insertion invalid by tx returned status existed");
   MINFO("BLOCK ADDED AS INVALID: " << h << std::endl << ", prev_id=" << bei.bl.prev_id << ", m_invalid_blocks count=" << m_invalid_blocks.size());
@@ -2424,25 +2707,54 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
 
   CHECK_AND_ASSERT_MES(max_used_block_height < m_db->height(), false,  "internal error: max used block index=" << max_used_block_height << " is not less then blockchain size = " << m_db->height());
   max_used_block_id = m_db->get_block_hash_from_height(max_used_block_height);
+
+  if (m_verified_txs.size() >= VERIFIED_TXS_MAX_COUNT)
+    m_verified_txs.clear();
+  m_verified_txs[get_transaction_hash(tx)] = verified_tx{max_used_block_height, max_used_block_id, m_hardfork->get_current_version()};
+
   return true;
 }
 //------------------------------------------------------------------
-bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc)
+bool Blockchain::is_tx_verified(const crypto::hash &tx_id, const transaction &tx)
 {
-  LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  auto it = m_verified_txs.find(tx_id);
+  if (it == m_verified_txs.end())
+    return false;
 
-  const uint8_t hf_version = m_hardfork->get_current_version();
+  const verified_tx verified = it->second;
+  m_verified_txs.erase(it);
 
-  // from hard fork 2, we forbid dust and compound outputs
-  if (hf_version >= 2) {
-    for (auto &o: tx.vout) {
-      if (tx.version == 1)
-      {
-        if (!is_valid_decomposed_amount(o.amount)) {
-          tvc.m_invalid_output = true;
-          return false;
-        }
+  if (verified.hf_version != m_hardfork->get_current_version())
+    return false;
+
+  if (verified.max_used_block_height >= m_db->height() || m_db->get_block_hash_from_height(verified.max_used_block_height) != verified.max_used_block_id)
+    return false;
+
+  if (have_tx_keyimges_as_spent(tx))
+  {
+    MERROR_VER("Key image already spent in blockchain for tx " << tx_id);
+    return false;
+  }
+
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  const uint8_t hf_version = m_hardfork->get_current_version();
+
+  // from hard fork 2, we forbid dust and compound outputs
+  if (hf_version >= 2) {
+    for (auto &o: tx.vout) {
+      if (tx.version == 1)
+      {
+        if (!is_valid_decomposed_amount(o.amount)) {
+          tvc.m_invalid_output = true;
+          return false;
+        }
       }
     }
   }
@@ -2588,7 +2900,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height)
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, std::vector<rct::rctSig> *deferred_rct)
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2890,6 +3202,9 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
+      if (deferred_rct)
+        break;
+
       if (!rct::verRctNonSemanticsSimple(rv))
       {
         MERROR_VER("Failed to check ringct signatures!");
@@ -2976,6 +3291,9 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
     }
+
+    if (deferred_rct && (rv.type == rct::RCTTypeSimple || rv.type == rct::RCTTypeBulletproof))
+      deferred_rct->push_back(std::move(tx.rct_signatures));
   }
   return true;
 }
@@ -3211,7 +3529,7 @@ bool Blockchain::check_tx_input(size_t tx_version, const txin_to_key& txin, cons
 
   // collect output keys
   outputs_visitor vi(output_keys, *this);
-  if (!scan_outputkeys_for_indexes(tx_version, txin, vi, tx_prefix_hash, pmax_related_block_height))
+  if (!scan_outputkeys_for_indexes(tx_version, txin, vi, pmax_related_block_height))
   {
     MERROR_VER("Failed to get output keys for tx with amount = " << print_money(txin.amount) << " and count indexes " << txin.key_offsets.size());
     return false;
@@ -3338,6 +3656,14 @@ bool Blockchain::flush_txes_from_pool(const std::vector<crypto::hash> &txids)
 bool Blockchain::handle_block_to_main_chain(const block& bl, const crypto::hash& id, block_verification_context& bvc)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  TRACE_SPAN("handle_block_to_main_chain");
+  tools::metrics::histogram::timer verification_timer(block_verification_time);
+  auto count_outcome = epee::misc_utils::create_scope_leave_handler([&bvc]() {
+    if (bvc.m_added_to_main_chain)
+      blocks_added.inc();
+    else if (bvc.m_verifivation_failed)
+      blocks_rejected.inc();
+  });
 
   TIME_MEASURE_START(block_processing_time);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -3389,6 +3715,7 @@ leave:
 
   TIME_MEASURE_FINISH(t2);
   //check proof of work
+  tools::trace::span pow_span("handle_block_to_main_chain.pow");
   TIME_MEASURE_START(target_calculating_time);
 
   // get the target difficulty for the block.
@@ -3470,6 +3797,7 @@ leave:
   }
 
   TIME_MEASURE_FINISH(longhash_calculating_time);
+  pow_span.stop();
   if (precomputed)
     longhash_calculating_time += m_fake_pow_calc_time;
 
@@ -3498,6 +3826,11 @@ leave:
 
 // XXX old code adds miner tx here
 
+  // MLSAGs of all txes of the block are verified together after the loop
+  std::vector<rct::rctSig> deferred_rct;
+  deferred_rct.reserve(bl.tx_hashes.size());
+
+  tools::trace::span txs_span("handle_block_to_main_chain.txs");
   size_t tx_index = 0;
   // Iterate over the block's transaction hashes, grabbing each
   // from the tx_pool and validating them.  Each is then added
@@ -3562,9 +3895,10 @@ leave:
     if (!fast_check)
 #endif
     {
-      // validate that transaction inputs and the keys spending them are correct.
+      // validate that transaction inputs and the keys spending them are correct;
+      // signatures of txs verified at pool admission are not checked again
       tx_verification_context tvc;
-      if(!check_tx_inputs(tx, tvc))
+      if(!is_tx_verified(tx_id, tx) && !check_tx_inputs(tx, tvc, NULL, &deferred_rct))
       {
         MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
 
@@ -3601,6 +3935,27 @@ leave:
 
   m_blocks_txs_check.clear();
 
+  if (!deferred_rct.empty())
+  {
+    TIME_MEASURE_START(rct);
+    std::vector<const rct::rctSig*> rvv;
+    rvv.reserve(deferred_rct.size());
+    for (const rct::rctSig &rv: deferred_rct)
+      rvv.push_back(&rv);
+    if (!rct::verRctNonSemanticsSimple(rvv))
+    {
+      MERROR_VER("Block with id: " << id  << " has at least one transaction with wrong ringct signatures.");
+      add_block_as_invalid(bl, id);
+      MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+      bvc.m_verifivation_failed = true;
+      return_tx_to_pool(txs);
+      goto leave;
+    }
+    TIME_MEASURE_FINISH(rct);
+    t_checktx += rct;
+  }
+  txs_span.stop();
+
   TIME_MEASURE_START(vmt);
   uint64_t base_reward = 0;
   uint64_t already_generated_coins = m_db->height() ? m_db->get_block_already_generated_coins(m_db->height() - 1) : 0;
@@ -3632,6 +3987,7 @@ leave:
     block_processing_time += m_fake_pow_calc_time;
 
   m_db->block_txn_stop();
+  tools::trace::span db_span("handle_block_to_main_chain.db");
   TIME_MEASURE_START(addblock);
   uint64_t new_height = 0;
   if (!bvc.m_verifivation_failed)
@@ -3662,6 +4018,19 @@ leave:
   }
 
   TIME_MEASURE_FINISH(addblock);
+  db_span.stop();
+
+  if (m_timestamps_and_difficulties_height == new_height - 1)
+  {
+    m_timestamps.push_back(bl.timestamp);
+    m_difficulties.push_back(cumulative_difficulty);
+    if (m_timestamps.size() > DIFFICULTY_BLOCKS_COUNT)
+    {
+      m_timestamps.erase(m_timestamps.begin());
+      m_difficulties.erase(m_difficulties.begin());
+    }
+    m_timestamps_and_difficulties_height = new_height;
+  }
 
   // do this after updating the hard fork state since the weight limit may change due to fork
   update_next_cumulative_weight_limit();
@@ -3679,18 +4048,82 @@ leave:
   bvc.m_added_to_main_chain = true;
   ++m_sync_counter;
 
+  // the seed of the next RandomX epoch is known SEEDHASH_EPOCH_LAG blocks ahead, build its cache now
+  // so the first block of the epoch is not stalled
+  if (bl.major_version >= RX_BLOCK_VERSION)
+  {
+    uint64_t seed_height, next_height;
+    crypto::rx_seedheights(new_height, &seed_height, &next_height);
+    if (next_height != seed_height)
+      get_block_longhash_prepare(next_height, m_db->get_block_hash_from_height(next_height));
+  }
+
+  ++m_tip_cookie;
+
   // appears to be a NOP *and* is called elsewhere.  wat?
   m_tx_pool.on_blockchain_inc(new_height, id);
   get_difficulty_for_next_block(); // just to cache it
+  publish_tip_snapshot();
   invalidate_block_template_cache();
 
   std::shared_ptr<tools::Notify> block_notify = m_block_notify;
   if (block_notify)
     block_notify->notify(epee::string_tools::pod_to_hex(id).c_str());
 
+  if (m_block_committed_handler)
+    m_block_committed_handler(new_height - 1, id, bl, txs);
+
+  if (m_block_added_handler)
+    m_block_added_handler(new_height - 1, id, bl);
+
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::publish_tip_snapshot()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  const uint64_t height = m_db->height();
+  if (height == 0)
+  {
+    std::atomic_store(&m_tip_snapshot, std::shared_ptr<const tip_snapshot>());
+    return;
+  }
+  auto snapshot = std::make_shared<tip_snapshot>();
+  snapshot->height = height;
+  snapshot->top_hash = m_db->top_block_hash();
+  snapshot->top_block = m_db->get_top_block();
+  snapshot->top_block_weight = m_db->get_block_weight(snapshot->height - 1);
+  snapshot->top_difficulty = m_db->get_block_difficulty(snapshot->height - 1);
+  snapshot->cumulative_difficulty = m_db->get_block_cumulative_difficulty(snapshot->height - 1);
+  snapshot->next_difficulty = get_difficulty_for_next_block();
+  snapshot->tx_count = m_db->get_tx_count();
+  snapshot->block_weight_limit = m_current_block_cumul_weight_limit;
+  snapshot->block_weight_median = m_current_block_cumul_weight_median;
+  snapshot->alt_blocks_count = m_alternative_chains.size();
+  std::atomic_store(&m_tip_snapshot, std::shared_ptr<const tip_snapshot>(std::move(snapshot)));
+  notify_template_change();
+}
+//------------------------------------------------------------------
+bool Blockchain::wait_for_template_change(const crypto::hash &top_hash, uint64_t pool_cookie, uint64_t pool_changes, std::chrono::milliseconds timeout) const
+{
+  // only reads atomics, so it can be checked under m_template_change_lock without ordering it with other locks
+  const auto changed = [&]() {
+    const std::shared_ptr<const tip_snapshot> tip = get_tip_snapshot();
+    return m_cancel || (tip && tip->top_hash != top_hash) || (pool_changes && m_tx_pool.cookie() - pool_cookie >= pool_changes);
+  };
+  boost::unique_lock<boost::mutex> lock(m_template_change_lock);
+  return m_template_change.wait_for(lock, boost::chrono::milliseconds(timeout.count()), changed);
+}
+//------------------------------------------------------------------
+void Blockchain::notify_template_change() const
+{
+  // the change is visible before the lock is taken, so a waiter either sees it or is woken
+  {
+    boost::lock_guard<boost::mutex> lock(m_template_change_lock);
+  }
+  m_template_change.notify_all();
+}
+//------------------------------------------------------------------
 bool Blockchain::update_next_cumulative_weight_limit()
 {
   uint64_t full_reward_zone = get_min_block_weight(get_current_hard_fork_version());
@@ -3789,57 +4222,198 @@ bool Blockchain::update_checkpoints(const std::string& file_path, bool check_dns
   }
 
   // if we're checking both dns and json, load checkpoints from dns.
-  // if we're not hard-enforcing dns checkpoints, handle accordingly
-  if (m_enforce_dns_checkpoints && check_dns && !m_offline)
-  {
-    if (!m_checkpoints.load_checkpoints_from_dns())
-    {
-      return false;
-    }
-  }
-  else if (check_dns && !m_offline)
+  if (check_dns && !m_offline)
   {
     checkpoints dns_points;
     dns_points.load_checkpoints_from_dns();
-    if (m_checkpoints.check_for_conflicts(dns_points))
-    {
-      check_against_checkpoints(dns_points, false);
-    }
-    else
+    return apply_dns_checkpoints(dns_points);
+  }
+
+  check_against_checkpoints(m_checkpoints, true);
+
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::apply_dns_checkpoints(const checkpoints& dns_points)
+{
+  // if we're not hard-enforcing dns checkpoints, only report a mismatch
+  if (m_enforce_dns_checkpoints)
+  {
+    for (const auto &pt: dns_points.get_points())
     {
-      MERROR("One or more checkpoints fetched from DNS conflicted with existing checkpoints!");
+      if (!m_checkpoints.add_checkpoint(pt.first, epee::string_tools::pod_to_hex(pt.second)))
+        return false;
     }
   }
+  else if (m_checkpoints.check_for_conflicts(dns_points))
+  {
+    check_against_checkpoints(dns_points, false);
+  }
+  else
+  {
+    MERROR("One or more checkpoints fetched from DNS conflicted with existing checkpoints!");
+  }
 
   check_against_checkpoints(m_checkpoints, true);
 
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::prune_blockchain(uint32_t pruning_stripe)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint32_t current_stripe = m_db->get_blockchain_pruning_stripe();
+  if (current_stripe)
+  {
+    if (pruning_stripe && pruning_stripe != current_stripe)
+    {
+      MERROR("The blockchain is pruned with stripe " << current_stripe << " already, it can't be changed to " << pruning_stripe);
+      return false;
+    }
+    return true;
+  }
+  if (!pruning_stripe)
+    pruning_stripe = tools::get_random_pruning_stripe();
+  if (!m_db->set_blockchain_pruning_stripe(pruning_stripe))
+  {
+    MERROR("Failed to set the pruning stripe of the blockchain, pruning is not supported by this database");
+    return false;
+  }
+  MGINFO("The blockchain is pruned from now on, keeping stripe " << pruning_stripe << " of " << CRYPTONOTE_PRUNING_NUM_STRIPES);
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::update_blockchain_pruning()
+{
+  if (!m_db->get_blockchain_pruning_stripe())
+    return true;
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  try
+  {
+    m_db->prune_old_blocks(CRYPTONOTE_PRUNING_BLOCKS_PER_STEP);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to prune the blockchain: " << e.what());
+  }
+  return true;
+}
+//------------------------------------------------------------------
 void Blockchain::set_enforce_dns_checkpoints(bool enforce_checkpoints)
 {
   m_enforce_dns_checkpoints = enforce_checkpoints;
 }
 
 //------------------------------------------------------------------
-void Blockchain::block_longhash_worker(uint64_t height, const std::vector<block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const
+void Blockchain::block_longhash_worker(uint64_t height, const std::vector<block> &blocks, std::atomic<size_t> &next_block,
+    std::vector<crypto::hash> &ids, std::vector<crypto::hash> &pows) const
 {
   TIME_MEASURE_START(t);
   slow_hash_allocate_state();
 
-  for (const auto & block : blocks)
+  for (size_t i = next_block++; i < blocks.size(); i = next_block++)
   {
     if (m_cancel)
        break;
-    crypto::hash id = get_block_hash(block);
-    crypto::hash pow = get_block_longhash(this, block, height++, 0);
-    map.emplace(id, pow);
+    if (pows[i] != crypto::null_hash)
+      continue;
+    ids[i] = get_block_hash(blocks[i]);
+    pows[i] = get_block_longhash(this, blocks[i], height + i, 0);
   }
 
   slow_hash_free_state();
   TIME_MEASURE_FINISH(t);
 }
 
+//------------------------------------------------------------------
+void Blockchain::prefetch_block_longhashes(const std::vector<block_complete_entry> &blocks_entry, uint64_t height)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  if (blocks_entry.size() < 2 || tpool.get_max_concurrency() < 2 || m_max_prepare_blocks_threads == 1)
+    return;
+
+  boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+  if (m_prefetch_thread.joinable())
+  {
+    if (!m_prefetch_thread.try_join_for(boost::chrono::milliseconds(0)))
+      return;
+  }
+  m_prefetched_longhashes.clear();
+
+  m_prefetch_thread = boost::thread([this, blocks_entry, height]() {
+    try
+    {
+      // without the blockchain lock only committed blocks can be read, so RandomX
+      // seeds must be below the height which was committed when prefetch started
+      const uint64_t committed_height = m_db->height();
+      std::vector<block> blocks;
+      blocks.reserve(blocks_entry.size());
+      for (const auto &entry : blocks_entry)
+      {
+        block b;
+        if (!parse_and_validate_block_from_blob(entry.block, b))
+          break;
+        if (b.major_version >= RX_BLOCK_VERSION && crypto::rx_seedheight(height + blocks.size()) >= committed_height)
+          break;
+        blocks.push_back(std::move(b));
+      }
+      if (blocks.empty())
+        return;
+
+      tools::threadpool& tpool = tools::threadpool::getInstance();
+      uint64_t threads = tpool.get_max_concurrency();
+      if (m_max_prepare_blocks_threads && threads > m_max_prepare_blocks_threads)
+        threads = m_max_prepare_blocks_threads;
+      if (threads > blocks.size())
+        threads = blocks.size();
+
+      std::vector<crypto::hash> ids(blocks.size(), crypto::null_hash), pows(blocks.size(), crypto::null_hash);
+      std::atomic<size_t> next_block(0);
+      tools::threadpool::waiter waiter;
+      for (uint64_t i = 0; i < threads; i++)
+        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, height, std::cref(blocks), std::ref(next_block), std::ref(ids), std::ref(pows)), true);
+      waiter.wait(&tpool);
+
+      if (m_cancel)
+        return;
+
+      boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+      for (size_t i = 0; i < blocks.size(); i++)
+        m_prefetched_longhashes.emplace(ids[i], pows[i]);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to prefetch block hashes: " << e.what());
+    }
+  });
+}
+//------------------------------------------------------------------
+std::unordered_map<crypto::hash, crypto::hash> Blockchain::take_prefetched_longhashes()
+{
+  boost::thread prefetch_thread;
+  {
+    boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+    prefetch_thread = std::move(m_prefetch_thread);
+  }
+  if (prefetch_thread.joinable())
+    prefetch_thread.join();
+
+  boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+  std::unordered_map<crypto::hash, crypto::hash> result;
+  result.swap(m_prefetched_longhashes);
+  return result;
+}
+//------------------------------------------------------------------
+bool Blockchain::take_header_longhash(const crypto::hash &id, crypto::hash &pow)
+{
+  boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+  auto found = m_header_longhashes.find(id);
+  if (found == m_header_longhashes.end())
+    return false;
+  pow = found->second;
+  m_header_longhashes.erase(found);
+  return true;
+}
 //------------------------------------------------------------------
 bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 {
@@ -3880,7 +4454,7 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
       {
         store_blockchain();
       }
-      else // db_nosync
+      else // db_nosync, db_group
       {
         // DO NOTHING, not required to call sync.
       }
@@ -3889,7 +4463,7 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 
   TIME_MEASURE_FINISH(t1);
   m_blocks_longhash_table.clear();
-  m_scan_table.clear();
+  clear_output_cache();
   m_blocks_txs_check.clear();
   m_check_txin_table.clear();
 
@@ -3898,7 +4472,6 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   {
     MINFO("Dumping block hashes, we're now 4k past " << m_blocks_hash_check.size());
     m_blocks_hash_check.clear();
-    m_blocks_hash_check.shrink_to_fit();
   }
 
   CRITICAL_REGION_END();
@@ -3908,8 +4481,7 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 }
 
 //------------------------------------------------------------------
-//FIXME: unused parameter txs
-void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, std::unordered_map<crypto::hash, cryptonote::transaction> &txs) const
+void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs) const
 {
   try
   {
@@ -3925,6 +4497,12 @@ void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uin
   }
 }
 
+void Blockchain::clear_output_cache()
+{
+  boost::lock_guard<boost::mutex> lock(m_output_cache_lock);
+  m_output_cache.clear();
+}
+
 uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes)
 {
   // new: . . . . . X X X X X . . . . . .
@@ -4004,7 +4582,7 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
       {
         CHECK_AND_ASSERT_MES(m_blocks_hash_check[i] == crypto::null_hash || m_blocks_hash_check[i] == data[i - first_index * HASH_OF_HASHES_STEP],
             0, "Consistency failure in m_blocks_hash_check construction");
-        m_blocks_hash_check[i] = data[i - first_index * HASH_OF_HASHES_STEP];
+        m_blocks_hash_check.set(i, data[i - first_index * HASH_OF_HASHES_STEP]);
       }
       usable += HASH_OF_HASHES_STEP;
     }
@@ -4021,16 +4599,130 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
   return usable;
 }
 
+uint64_t Blockchain::prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &ids, const std::vector<blobdata> &hashing_blobs)
+{
+  const size_t count = std::min(ids.size(), hashing_blobs.size());
+  std::vector<uint8_t> versions;
+  versions.reserve(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    block_header header;
+    crypto::hash id;
+    if (!parse_block_header_from_hashing_blob(hashing_blobs[i], header) || !get_object_hash(hashing_blobs[i], id) || id != ids[i])
+    {
+      MDEBUG("Header of block " << ids[i] << " at height " << height + i << " does not match its id");
+      break;
+    }
+    if (i > 0 && header.prev_id != ids[i - 1])
+    {
+      MDEBUG("Header of block " << ids[i] << " at height " << height + i << " does not follow " << ids[i - 1]);
+      break;
+    }
+    versions.push_back(header.major_version);
+  }
+  const uint64_t valid = versions.size();
+
+  // blocks we already have and blocks in the compiled-in hash area are not hashed
+  const uint64_t committed_height = m_db->height();
+  const uint64_t first = std::max<uint64_t>(std::max<uint64_t>(committed_height, m_blocks_hash_check.size()), height) - height;
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  if (first >= valid || tpool.get_max_concurrency() < 2 || m_max_prepare_blocks_threads == 1)
+    return valid;
+
+  // RandomX seeds are either among the ids, or in our chain if the ids start from it
+  const bool on_our_chain = height < committed_height && m_db->get_block_hash_from_height(height) == ids[0];
+  std::vector<std::pair<uint64_t, crypto::hash>> seeds;
+  seeds.reserve(valid - first);
+  std::pair<uint64_t, crypto::hash> chain_seed(std::numeric_limits<uint64_t>::max(), crypto::null_hash);
+  for (size_t i = first; i < valid; ++i)
+  {
+    if (versions[i] < RX_BLOCK_VERSION)
+    {
+      seeds.emplace_back(0, crypto::null_hash);
+      continue;
+    }
+    const uint64_t seed_height = crypto::rx_seedheight(height + i);
+    if (seed_height >= height)
+      seeds.emplace_back(seed_height, ids[seed_height - height]);
+    else if (on_our_chain)
+    {
+      if (chain_seed.first != seed_height)
+        chain_seed = std::make_pair(seed_height, m_db->get_block_hash_from_height(seed_height));
+      seeds.push_back(chain_seed);
+    }
+    else
+      break;
+  }
+  if (seeds.empty())
+    return valid;
+
+  boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+  if (m_header_pow_thread.joinable())
+  {
+    if (!m_header_pow_thread.try_join_for(boost::chrono::milliseconds(0)))
+      return valid;
+  }
+  if (m_header_longhashes.size() > 4 * BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT)
+    m_header_longhashes.clear();
+
+  const size_t end = first + seeds.size();
+  std::vector<crypto::hash> header_ids(ids.begin() + first, ids.begin() + end);
+  std::vector<blobdata> blobs(hashing_blobs.begin() + first, hashing_blobs.begin() + end);
+  versions.erase(versions.begin() + end, versions.end());
+  versions.erase(versions.begin(), versions.begin() + first);
+
+  m_header_pow_thread = boost::thread([this, committed_height, header_ids, blobs, versions, seeds]() {
+    try
+    {
+      uint64_t threads = tools::threadpool::getInstance().get_max_concurrency();
+      if (m_max_prepare_blocks_threads && threads > m_max_prepare_blocks_threads)
+        threads = m_max_prepare_blocks_threads;
+      if (threads > blobs.size())
+        threads = blobs.size();
+
+      std::vector<crypto::hash> pows(blobs.size(), crypto::null_hash);
+      std::atomic<size_t> next_header(0);
+      tools::threadpool& tpool = tools::threadpool::getInstance();
+      tools::threadpool::waiter waiter;
+      for (uint64_t i = 0; i < threads; i++)
+      {
+        tpool.submit(&waiter, [&]() {
+          slow_hash_allocate_state();
+          for (size_t n = next_header++; n < blobs.size() && !m_cancel; n = next_header++)
+            get_block_longhash_from_hashing_blob(versions[n], blobs[n], pows[n], committed_height, seeds[n].first, seeds[n].second);
+          slow_hash_free_state();
+        }, true);
+      }
+      waiter.wait(&tpool);
+
+      if (m_cancel)
+        return;
+
+      boost::unique_lock<boost::mutex> lock(m_prefetch_lock);
+      for (size_t i = 0; i < header_ids.size(); i++)
+        m_header_longhashes.emplace(header_ids[i], pows[i]);
+      MDEBUG("Hashed " << header_ids.size() << " block headers ahead of their bodies");
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to hash block headers: " << e.what());
+    }
+  });
+
+  return valid;
+}
+
 //------------------------------------------------------------------
 // ND: Speedups:
 // 1. Thread long_hash computations if possible (m_max_prepare_blocks_threads = nthreads, default = 4)
-// 2. Group all amounts (from txs) and related absolute offsets and form a table of tx_prefix_hash
-//    vs [k_image, output_keys] (m_scan_table). This is faster because it takes advantage of bulk queries
-//    and is threaded if possible. The table (m_scan_table) will be used later when querying output
-//    keys.
+// 2. Group all amounts (from txs) and related absolute offsets of the whole span, split the sorted
+//    offsets into ranges queried in parallel and keep the results in a table keyed by (amount, global
+//    index) (m_output_cache). Sorted bulk queries keep LMDB reads local, and the table is used later
+//    when querying output keys.
 bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry)
 {
   MTRACE("Blockchain::" << __func__);
+  TRACE_SPAN("prepare_handle_incoming_blocks");
   TIME_MEASURE_START(prepare);
   bool stop_batch;
   uint64_t bytes = 0;
@@ -4081,87 +4773,73 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   tools::threadpool& tpool = tools::threadpool::getInstance();
   uint64_t threads = tpool.get_max_concurrency();
 
-  if (blocks_entry.size() > 1 && threads > 1 && m_max_prepare_blocks_threads > 1)
+  if (blocks_entry.size() > 1 && threads > 1 && m_max_prepare_blocks_threads != 1)
   {
-    // limit threads, default limit = 4
-    if(threads > m_max_prepare_blocks_threads)
+    // limit threads, 0 = all threads of the pool
+    if (m_max_prepare_blocks_threads && threads > m_max_prepare_blocks_threads)
       threads = m_max_prepare_blocks_threads;
 
     uint64_t height = m_db->height();
-    int batches = blocks_entry.size() / threads;
-    int extra = blocks_entry.size() % threads;
-    MDEBUG("block_batches: " << batches);
-    std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(threads);
-    std::vector < std::vector < block >> blocks(threads);
-    auto it = blocks_entry.begin();
+    std::vector<block> blocks;
+    blocks.reserve(blocks_entry.size());
 
-    for (uint64_t i = 0; i < threads; i++)
+    for (const auto &entry : blocks_entry)
     {
-      blocks[i].reserve(batches + 1);
-      for (int j = 0; j < batches; j++)
-      {
-        block block;
+      block block;
 
-        if (!parse_and_validate_block_from_blob(it->block, block))
-        {
-          std::advance(it, 1);
-          continue;
-        }
+      // heights of the following blocks would be wrong, they are hashed when added instead
+      if (!parse_and_validate_block_from_blob(entry.block, block))
+        break;
 
-        // check first block and skip all blocks if its not chained properly
-        if (i == 0 && j == 0)
-        {
-          crypto::hash tophash = m_db->top_block_hash();
-          if (block.prev_id != tophash)
-          {
-            MDEBUG("Skipping prepare blocks. New blocks don't belong to chain.");
-            return true;
-          }
-        }
-        if (have_block(get_block_hash(block)))
+      // check first block and skip all blocks if its not chained properly
+      if (blocks.empty())
+      {
+        crypto::hash tophash = m_db->top_block_hash();
+        if (block.prev_id != tophash)
         {
-          blocks_exist = true;
-          break;
+          MDEBUG("Skipping prepare blocks. New blocks don't belong to chain.");
+          return true;
         }
-
-        blocks[i].push_back(std::move(block));
-        std::advance(it, 1);
-      }
-    }
-
-    for (int i = 0; i < extra && !blocks_exist; i++)
-    {
-      block block;
-
-      if (!parse_and_validate_block_from_blob(it->block, block))
-      {
-        std::advance(it, 1);
-        continue;
       }
-
       if (have_block(get_block_hash(block)))
       {
         blocks_exist = true;
         break;
       }
 
-      blocks[i].push_back(std::move(block));
-      std::advance(it, 1);
+      blocks.push_back(std::move(block));
     }
 
     if (!blocks_exist)
     {
       m_blocks_longhash_table.clear();
-      uint64_t thread_height = height;
-      tools::threadpool::waiter waiter;
-//      m_prepare_height = height;
-//      m_prepare_nblocks = blocks_entry.size();
-//      m_prepare_blocks = &blocks;
-      for (unsigned int i = 0; i < threads; i++)
+      if (threads > blocks.size())
+        threads = blocks.size();
+
+      // one worker per thread pulls blocks one by one, so a slow block does not hold up a whole batch
+      std::vector<crypto::hash> ids(blocks.size(), crypto::null_hash), pows(blocks.size(), crypto::null_hash);
+
+      // blocks hashed while the previous ones were added are skipped by workers
+      // as are blocks whose headers were hashed before their bodies arrived
+      const std::unordered_map<crypto::hash, crypto::hash> prefetched = take_prefetched_longhashes();
+      for (size_t i = 0; i < blocks.size(); i++)
       {
-        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, thread_height, std::cref(blocks[i]), std::ref(maps[i])), true);
-        thread_height += blocks[i].size();
+        const crypto::hash id = get_block_hash(blocks[i]);
+        auto found = prefetched.find(id);
+        if (found != prefetched.end())
+        {
+          ids[i] = id;
+          pows[i] = found->second;
+        }
+        else if (take_header_longhash(id, pows[i]))
+        {
+          ids[i] = id;
+        }
       }
+      std::atomic<size_t> next_block(0);
+      tools::threadpool::waiter waiter;
+      for (uint64_t i = 0; i < threads; i++)
+        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, height, std::cref(blocks), std::ref(next_block), std::ref(ids), std::ref(pows)), true);
 
       waiter.wait(&tpool);
       m_prepare_height = 0;
@@ -4169,10 +4847,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       if (m_cancel)
          return false;
 
-      for (const auto & map : maps)
-      {
-        m_blocks_longhash_table.insert(map.begin(), map.end());
-      }
+      for (size_t i = 0; i < blocks.size(); i++)
+        m_blocks_longhash_table.emplace(ids[i], pows[i]);
     }
   }
 
@@ -4188,7 +4864,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   m_fake_scan_time = 0;
   m_fake_pow_calc_time = 0;
 
-  m_scan_table.clear();
+  clear_output_cache();
   m_check_txin_table.clear();
 
   TIME_MEASURE_FINISH(prepare);
@@ -4199,23 +4875,18 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
 
   TIME_MEASURE_START(scantable);
 
-  // [input] stores all unique amounts found
-  std::vector < uint64_t > amounts;
   // [input] stores all absolute_offsets for each amount
   std::map<uint64_t, std::vector<uint64_t>> offset_map;
-  // [output] stores all output_data_t for each absolute_offset
-  std::map<uint64_t, std::vector<output_data_t>> tx_map;
-  std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes(total_txs);
+  std::unordered_set<crypto::hash> tx_prefix_hashes;
 
 #define SCAN_TABLE_QUIT(m) \
         do { \
             MERROR_VER(m) ;\
-            m_scan_table.clear(); \
             return false; \
         } while(0); \
 
-  // generate sorted tables for all amounts and absolute offsets
-  size_t tx_index = 0;
+  // parse the txs of the incoming blocks, their prefix hashes are computed in one batch
+  std::vector<transaction> txs;
   for (const auto &entry : blocks_entry)
   {
     if (m_cancel)
@@ -4223,149 +4894,93 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
 
     for (const auto &tx_blob : entry.txs)
     {
-      if (tx_index >= txes.size())
-        SCAN_TABLE_QUIT("tx_index is out of sync");
-      transaction &tx = txes[tx_index].first;
-      crypto::hash &tx_prefix_hash = txes[tx_index].second;
-      ++tx_index;
-
-      if (!parse_and_validate_tx_base_from_blob(tx_blob, tx))
+      txs.emplace_back();
+      if (!parse_and_validate_tx_base_from_blob(tx_blob, txs.back()))
         SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
-      cryptonote::get_transaction_prefix_hash(tx, tx_prefix_hash);
-
-      auto its = m_scan_table.find(tx_prefix_hash);
-      if (its != m_scan_table.end())
-        SCAN_TABLE_QUIT("Duplicate tx found from incoming blocks.");
-
-      m_scan_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>());
-      its = m_scan_table.find(tx_prefix_hash);
-      assert(its != m_scan_table.end());
-
-      // get all amounts from tx.vin(s)
-      for (const auto &txin : tx.vin)
-      {
-        const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
-
-        // check for duplicate
-        auto it = its->second.find(in_to_key.k_image);
-        if (it != its->second.end())
-          SCAN_TABLE_QUIT("Duplicate key_image found from incoming blocks.");
-
-        amounts.push_back(in_to_key.amount);
-      }
-
-      // sort and remove duplicate amounts from amounts list
-      std::sort(amounts.begin(), amounts.end());
-      auto last = std::unique(amounts.begin(), amounts.end());
-      amounts.erase(last, amounts.end());
-
-      // add amount to the offset_map and tx_map
-      for (const uint64_t &amount : amounts)
-      {
-        if (offset_map.find(amount) == offset_map.end())
-          offset_map.emplace(amount, std::vector<uint64_t>());
+    }
+  }
 
-        if (tx_map.find(amount) == tx_map.end())
-          tx_map.emplace(amount, std::vector<output_data_t>());
-      }
+  std::vector<const transaction_prefix*> tx_prefixes;
+  tx_prefixes.reserve(txs.size());
+  for (const auto &tx : txs)
+    tx_prefixes.push_back(&tx);
+  std::vector<crypto::hash> prefix_hashes;
+  cryptonote::get_transaction_prefix_hashes(tx_prefixes, prefix_hashes);
 
-      // add new absolute_offsets to offset_map
-      for (const auto &txin : tx.vin)
-      {
-        const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
-        // no need to check for duplicate here.
-        auto absolute_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
-        for (const auto & offset : absolute_offsets)
-          offset_map[in_to_key.amount].push_back(offset);
+  // collect the absolute offsets of all ring members of the incoming blocks
+  for (size_t i = 0; i < txs.size(); ++i)
+  {
+    if (!tx_prefix_hashes.insert(prefix_hashes[i]).second)
+      SCAN_TABLE_QUIT("Duplicate tx found from incoming blocks.");
 
-      }
+    for (const auto &txin : txs[i].vin)
+    {
+      const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
+      const std::vector<uint64_t> absolute_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
+      std::vector<uint64_t> &offsets = offset_map[in_to_key.amount];
+      offsets.insert(offsets.end(), absolute_offsets.begin(), absolute_offsets.end());
     }
   }
+  txs.clear();
 
   // sort and remove duplicate absolute_offsets in offset_map
+  size_t total_offsets = 0;
   for (auto &offsets : offset_map)
   {
     std::sort(offsets.second.begin(), offsets.second.end());
     auto last = std::unique(offsets.second.begin(), offsets.second.end());
     offsets.second.erase(last, offsets.second.end());
+    total_offsets += offsets.second.size();
   }
 
-  // [output] stores all transactions for each tx_out_index::hash found
-  std::vector<std::unordered_map<crypto::hash, cryptonote::transaction>> transactions(amounts.size());
-
   threads = tpool.get_max_concurrency();
   if (!m_db->can_thread_bulk_indices())
     threads = 1;
 
-  if (threads > 1)
-  {
-    tools::threadpool::waiter waiter;
+  // split the offsets into sorted ranges, so that most amounts (rct ones) are scanned by all threads
+  static const size_t min_scan_range_size = 256;
+  const size_t range_size = std::max<size_t>((total_offsets + threads - 1) / threads, min_scan_range_size);
 
-    for (size_t i = 0; i < amounts.size(); i++)
+  // [input] stores amount and sorted absolute_offsets of each range
+  std::vector<std::pair<uint64_t, std::vector<uint64_t>>> ranges;
+  for (const auto &offsets : offset_map)
+  {
+    for (size_t i = 0; i < offsets.second.size(); i += range_size)
     {
-      uint64_t amount = amounts[i];
-      tpool.submit(&waiter, boost::bind(&Blockchain::output_scan_worker, this, amount, std::cref(offset_map[amount]), std::ref(tx_map[amount]), std::ref(transactions[i])), true);
+      auto begin = offsets.second.begin() + i;
+      auto end = offsets.second.begin() + std::min(i + range_size, offsets.second.size());
+      ranges.emplace_back(offsets.first, std::vector<uint64_t>(begin, end));
     }
+  }
+
+  // [output] stores all output_data_t found for each range
+  std::vector<std::vector<output_data_t>> range_outputs(ranges.size());
+
+  if (threads > 1 && ranges.size() > 1)
+  {
+    tools::threadpool::waiter waiter;
+
+    for (size_t i = 0; i < ranges.size(); i++)
+      tpool.submit(&waiter, boost::bind(&Blockchain::output_scan_worker, this, ranges[i].first, std::cref(ranges[i].second), std::ref(range_outputs[i])), true);
     waiter.wait(&tpool);
   }
   else
   {
-    for (size_t i = 0; i < amounts.size(); i++)
-    {
-      uint64_t amount = amounts[i];
-      output_scan_worker(amount, offset_map[amount], tx_map[amount], transactions[i]);
-    }
+    for (size_t i = 0; i < ranges.size(); i++)
+      output_scan_worker(ranges[i].first, ranges[i].second, range_outputs[i]);
   }
 
-  // now generate a table for each tx_prefix and k_image hashes
-  tx_index = 0;
-  for (const auto &entry : blocks_entry)
-  {
-    if (m_cancel)
-      return false;
+  if (m_cancel)
+    return false;
 
-    for (const auto &tx_blob : entry.txs)
+  // partial results are prefixes of the ranges, outputs created by the incoming blocks themselves are not there yet
+  {
+    boost::lock_guard<boost::mutex> lock(m_output_cache_lock);
+    m_output_cache.reserve(total_offsets);
+    for (size_t i = 0; i < ranges.size(); i++)
     {
-      if (tx_index >= txes.size())
-        SCAN_TABLE_QUIT("tx_index is out of sync");
-      const transaction &tx = txes[tx_index].first;
-      const crypto::hash &tx_prefix_hash = txes[tx_index].second;
-      ++tx_index;
-
-      auto its = m_scan_table.find(tx_prefix_hash);
-      if (its == m_scan_table.end())
-        SCAN_TABLE_QUIT("Tx not found on scan table from incoming blocks.");
-
-      for (const auto &txin : tx.vin)
-      {
-        const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
-        auto needed_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
-
-        std::vector<output_data_t> outputs;
-        for (const uint64_t & offset_needed : needed_offsets)
-        {
-          size_t pos = 0;
-          bool found = false;
-
-          for (const uint64_t &offset_found : offset_map[in_to_key.amount])
-          {
-            if (offset_needed == offset_found)
-            {
-              found = true;
-              break;
-            }
-
-            ++pos;
-          }
-
-          if (found && pos < tx_map[in_to_key.amount].size())
-            outputs.push_back(tx_map[in_to_key.amount].at(pos));
-          else
-            break;
-        }
-
-        its->second.emplace(in_to_key.k_image, outputs);
-      }
+      for (size_t j = 0; j < range_outputs[i].size(); j++)
+        m_output_cache.emplace(std::make_pair(ranges[i].first, ranges[i].second[j]), range_outputs[i][j]);
     }
   }
 
@@ -4382,44 +4997,169 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
 
 void Blockchain::add_txpool_tx(transaction &tx, const txpool_tx_meta_t &meta)
 {
-  m_db->add_txpool_tx(tx, meta);
+  if (m_volatile_txpool)
+    m_volatile_txpool->add_tx(get_transaction_hash(tx), meta, tx_to_blob(tx));
+  else
+    m_db->add_txpool_tx(tx, meta);
 }
 
 void Blockchain::update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta)
 {
-  m_db->update_txpool_tx(txid, meta);
+  if (m_volatile_txpool)
+    m_volatile_txpool->update_tx(txid, meta);
+  else
+    m_db->update_txpool_tx(txid, meta);
 }
 
 void Blockchain::remove_txpool_tx(const crypto::hash &txid)
 {
-  m_db->remove_txpool_tx(txid);
+  if (m_volatile_txpool)
+    m_volatile_txpool->remove_tx(txid);
+  else
+    m_db->remove_txpool_tx(txid);
 }
 
 uint64_t Blockchain::get_txpool_tx_count(bool include_unrelayed_txes) const
 {
+  if (m_volatile_txpool)
+    return m_volatile_txpool->get_tx_count(include_unrelayed_txes);
   return m_db->get_txpool_tx_count(include_unrelayed_txes);
 }
 
 bool Blockchain::get_txpool_tx_meta(const crypto::hash& txid, txpool_tx_meta_t &meta) const
 {
+  if (m_volatile_txpool)
+    return m_volatile_txpool->get_tx_meta(txid, meta);
   return m_db->get_txpool_tx_meta(txid, meta);
 }
 
 bool Blockchain::get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const
 {
+  if (m_volatile_txpool)
+    return m_volatile_txpool->get_tx_blob(txid, bd);
   return m_db->get_txpool_tx_blob(txid, bd);
 }
 
 cryptonote::blobdata Blockchain::get_txpool_tx_blob(const crypto::hash& txid) const
 {
+  if (m_volatile_txpool)
+  {
+    cryptonote::blobdata bd;
+    if (!m_volatile_txpool->get_tx_blob(txid, bd))
+      throw DB_ERROR("Tx not found in txpool: ");
+    return bd;
+  }
   return m_db->get_txpool_tx_blob(txid);
 }
 
 bool Blockchain::for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob, bool include_unrelayed_txes) const
 {
+  if (m_volatile_txpool)
+    return m_volatile_txpool->for_all_txes(f, include_blob, include_unrelayed_txes);
   return m_db->for_all_txpool_txes(f, include_blob, include_unrelayed_txes);
 }
 
+bool Blockchain::txpool_has_tx(const crypto::hash &txid) const
+{
+  if (m_volatile_txpool)
+    return m_volatile_txpool->has_tx(txid);
+  return m_db->txpool_has_tx(txid);
+}
+
+void Blockchain::set_txpool_in_memory(bool snapshot)
+{
+  if (m_volatile_txpool)
+    return;
+
+  std::unique_ptr<volatile_txpool> pool(new volatile_txpool);
+  std::vector<crypto::hash> txids;
+
+  if (m_db->is_read_only())
+  {
+    MINFO("Txpool is kept in memory, the txpool of the read only db is not loaded");
+    m_volatile_txpool = std::move(pool);
+    m_txpool_snapshot = false;
+    return;
+  }
+
+  m_db->for_all_txpool_txes([&](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+    pool->add_tx(txid, meta, cryptonote::blobdata(*bd));
+    txids.push_back(txid);
+    return true;
+  }, true);
+
+  if (!snapshot && !txids.empty())
+  {
+    db_batch_guard batch_guard(*m_db);
+    for (const crypto::hash &txid : txids)
+      m_db->remove_txpool_tx(txid);
+  }
+
+  MINFO("Txpool is kept in memory" << (snapshot ? " with snapshots" : "") << ", " << txids.size() << " tx(es) loaded from the db");
+
+  m_volatile_txpool = std::move(pool);
+  m_txpool_snapshot = snapshot;
+}
+
+void Blockchain::store_txpool_snapshot()
+{
+  if (!m_volatile_txpool || !m_txpool_snapshot || m_db->is_read_only())
+    return;
+
+  PERF_TIMER(store_txpool_snapshot);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  std::unordered_map<crypto::hash, txpool_tx_meta_t> stored;
+  m_db->for_all_txpool_txes([&](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+    stored.emplace(txid, meta);
+    return true;
+  });
+
+  db_batch_guard batch_guard(*m_db);
+
+  m_volatile_txpool->for_all_txes([&](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+    auto it = stored.find(txid);
+    if (it != stored.end())
+    {
+      if (memcmp(&it->second, &meta, sizeof(meta)))
+        m_db->update_txpool_tx(txid, meta);
+      stored.erase(it);
+      return true;
+    }
+    transaction tx;
+    if (!parse_and_validate_tx_from_blob(*bd, tx, txid))
+    {
+      MERROR("Failed to parse txpool tx " << txid << " for the snapshot");
+      return true;
+    }
+    m_db->add_txpool_tx(tx, meta);
+    return true;
+  }, true);
+
+  for (const auto &tx : stored)
+    m_db->remove_txpool_tx(tx.first);
+}
+
+bool Blockchain::refresh_from_db()
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  const crypto::hash top_hash = m_db->top_block_hash();
+  if (top_hash == m_refreshed_top_hash)
+    return false;
+
+  if (m_refreshed_top_hash != crypto::null_hash)
+    MDEBUG("Top block changed in the db to " << top_hash << " at height " << m_db->height() - 1);
+  m_refreshed_top_hash = top_hash;
+
+  // the chain may also have been reorganized, so drop rather than extend the caches
+  m_timestamps_and_difficulties_height = 0;
+  m_hardfork->init();
+  invalidate_block_template_cache();
+  update_next_cumulative_weight_limit();
+  return true;
+}
+
 void Blockchain::set_user_options(uint64_t maxthreads, bool sync_on_blocks, uint64_t sync_threshold, blockchain_db_sync_mode sync_mode, bool fast_sync)
 {
   if (sync_mode == db_defaultsync)
@@ -4535,6 +5275,7 @@ std::list<std::pair<Blockchain::block_extended_info,std::vector<crypto::hash>>>
 void Blockchain::cancel()
 {
   m_cancel = true;
+  notify_template_change();
 }
 // TODO
 #if defined(PER_BLOCK_CHECKPOINT)
@@ -4545,13 +5286,28 @@ void Blockchain::load_compiled_in_block_hashes()
   const bool stagenet = m_nettype == STAGENET;
   if (m_fast_sync && get_blocks_dat_start(testnet, stagenet) != nullptr && get_blocks_dat_size(testnet, stagenet) > 0)
   {
-    MINFO("Loading precomputed blocks (" << get_blocks_dat_size(testnet, stagenet) << " bytes)");
+    const unsigned char *p = get_blocks_dat_start(testnet, stagenet);
+    const size_t size = get_blocks_dat_size(testnet, stagenet);
+    if (size <= 4)
+      return;
+    const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
+    if (nblocks > (std::numeric_limits<uint32_t>::max() - 4) / sizeof(crypto::hash))
+    {
+      MERROR("Block hash data is too large");
+      return;
+    }
+    const size_t size_needed = 4 + nblocks * sizeof(crypto::hash);
+    // a chain past the compiled-in hashes doesn't need them, nor their verification
+    if (nblocks == 0 || nblocks <= (m_db->height() + HASH_OF_HASHES_STEP - 1) / HASH_OF_HASHES_STEP || size < size_needed)
+      return;
+
+    MINFO("Loading precomputed blocks (" << size << " bytes)");
 
     if (m_nettype == MAINNET)
     {
       // first check hash
       crypto::hash hash;
-      if (!tools::sha256sum(get_blocks_dat_start(testnet, stagenet), get_blocks_dat_size(testnet, stagenet), hash))
+      if (!tools::sha256sum(p, size, hash))
       {
         MERROR("Failed to hash precomputed blocks data");
         return;
@@ -4571,60 +5327,157 @@ void Blockchain::load_compiled_in_block_hashes()
       }
     }
 
-    if (get_blocks_dat_size(testnet, stagenet) > 4)
+    // the hashes are used where they were compiled in, and the block hashes they validate are
+    // only kept from the group the chain is at
+    static_assert(sizeof(crypto::hash) == sizeof(crypto::hash::data) && alignof(crypto::hash) == 1, "crypto::hash must be plain bytes");
+    m_blocks_hash_of_hashes = {reinterpret_cast<const crypto::hash*>(p + sizeof(uint32_t)), nblocks};
+    m_blocks_hash_check.reset(m_db->height() / HASH_OF_HASHES_STEP * HASH_OF_HASHES_STEP, m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP);
+    MINFO(nblocks << " block hashes loaded");
+
+    // FIXME: clear tx_pool because the process might have been
+    // terminated and caused it to store txs kept by blocks.
+    // The core will not call check_tx_inputs(..) for these
+    // transactions in this case. Consequently, the sanity check
+    // for tx hashes will fail in handle_block_to_main_chain(..)
+    CRITICAL_REGION_LOCAL(m_tx_pool);
+
+    std::vector<transaction> txs;
+    m_tx_pool.get_transactions(txs);
+
+    size_t tx_weight;
+    uint64_t fee;
+    bool relayed, do_not_relay, double_spend_seen;
+    transaction pool_tx;
+    for(const transaction &tx : txs)
     {
-      const unsigned char *p = get_blocks_dat_start(testnet, stagenet);
-      const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
-      if (nblocks > (std::numeric_limits<uint32_t>::max() - 4) / sizeof(hash))
+      crypto::hash tx_hash = get_transaction_hash(tx);
+      m_tx_pool.take_tx(tx_hash, pool_tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen);
+    }
+  }
+}
+#endif
+
+bool Blockchain::is_within_compiled_block_hash_area(uint64_t height) const
+{
+#if defined(PER_BLOCK_CHECKPOINT)
+  return height < m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP;
+#else
+  return false;
+#endif
+}
+
+uint64_t Blockchain::get_compiled_in_block_hashes_height(network_type nettype)
+{
+#if defined(PER_BLOCK_CHECKPOINT)
+  const bool testnet = nettype == TESTNET;
+  const bool stagenet = nettype == STAGENET;
+  const unsigned char *p = get_blocks_dat_start(testnet, stagenet);
+  if (p == nullptr || get_blocks_dat_size(testnet, stagenet) <= 4)
+    return 0;
+  const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
+  if (get_blocks_dat_size(testnet, stagenet) < 4 + nblocks * (uint64_t)sizeof(crypto::hash))
+    return 0;
+  return nblocks * HASH_OF_HASHES_STEP;
+#else
+  return 0;
+#endif
+}
+
+bool Blockchain::verify_snapshot(uint64_t height, const crypto::hash& top_hash) const
+{
+#if defined(PER_BLOCK_CHECKPOINT)
+  if (m_db->height() != height)
+  {
+    MERROR("Snapshot height " << height << " does not match the blockchain height " << m_db->height());
+    return false;
+  }
+  if (!height || height % HASH_OF_HASHES_STEP || !is_within_compiled_block_hash_area(height - 1))
+  {
+    MERROR("Snapshot height " << height << " is not covered by the compiled-in block hashes (is fast block sync disabled?)");
+    return false;
+  }
+  if (m_db->get_block_hash_from_height(height - 1) != top_hash)
+  {
+    MERROR("Snapshot top block does not match the snapshot manifest");
+    return false;
+  }
+
+  MGINFO("Verifying " << height << " blocks of the snapshot...");
+  std::atomic<bool> valid(true);
+  auto verify_group = [this, &valid](uint64_t n) {
+    std::vector<crypto::hash> ids(HASH_OF_HASHES_STEP);
+    const uint64_t first = n * HASH_OF_HASHES_STEP;
+    crypto::hash prev_id = first ? m_db->get_block_hash_from_height(first - 1) : crypto::null_hash;
+    for (uint64_t i = 0; i < HASH_OF_HASHES_STEP && valid; ++i)
+    {
+      block b;
+      if (!parse_and_validate_block_from_blob(m_db->get_block_blob_from_height(first + i), b, &ids[i]) ||
+          b.prev_id != prev_id || ids[i] != m_db->get_block_hash_from_height(first + i))
       {
-        MERROR("Block hash data is too large");
+        MERROR("Snapshot block " << first + i << " is invalid");
+        valid = false;
         return;
       }
-      const size_t size_needed = 4 + nblocks * sizeof(crypto::hash);
-      if(nblocks > 0 && nblocks > (m_db->height() + HASH_OF_HASHES_STEP - 1) / HASH_OF_HASHES_STEP && get_blocks_dat_size(testnet, stagenet) >= size_needed)
+      prev_id = ids[i];
+
+      std::vector<crypto::hash> tx_ids(1, get_transaction_hash(b.miner_tx));
+      tx_ids.insert(tx_ids.end(), b.tx_hashes.begin(), b.tx_hashes.end());
+      for (const crypto::hash& tx_id : tx_ids)
       {
-        p += sizeof(uint32_t);
-        m_blocks_hash_of_hashes.reserve(nblocks);
-        for (uint32_t i = 0; i < nblocks; i++)
+        cryptonote::blobdata tx_blob;
+        transaction tx;
+        crypto::hash id, prefix_hash;
+        bool tx_valid;
+        if (m_db->get_tx_blob(tx_id, tx_blob))
+          tx_valid = parse_and_validate_tx_from_blob(tx_blob, tx, id, prefix_hash) && id == tx_id;
+        else
         {
-          crypto::hash hash;
-          memcpy(hash.data, p, sizeof(hash.data));
-          p += sizeof(hash.data);
-          m_blocks_hash_of_hashes.push_back(hash);
+          // txs of pruned blocks are checked against their stored prunable hash, v1 txs hash
+          // the whole blob so only their presence can be checked
+          crypto::hash prunable_hash;
+          tx_valid = m_db->get_pruned_tx_blob(tx_id, tx_blob) && parse_and_validate_tx_base_from_blob(tx_blob, tx)
+              && (tx.version == 1 || (m_db->get_prunable_tx_hash(tx_id, prunable_hash) && get_pruned_transaction_hash(tx, prunable_hash) == tx_id));
         }
-        m_blocks_hash_check.resize(m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP, crypto::null_hash);
-        MINFO(nblocks << " block hashes loaded");
-
-        // FIXME: clear tx_pool because the process might have been
-        // terminated and caused it to store txs kept by blocks.
-        // The core will not call check_tx_inputs(..) for these
-        // transactions in this case. Consequently, the sanity check
-        // for tx hashes will fail in handle_block_to_main_chain(..)
-        CRITICAL_REGION_LOCAL(m_tx_pool);
-
-        std::vector<transaction> txs;
-        m_tx_pool.get_transactions(txs);
-
-        size_t tx_weight;
-        uint64_t fee;
-        bool relayed, do_not_relay, double_spend_seen;
-        transaction pool_tx;
-        for(const transaction &tx : txs)
+        if (!tx_valid)
         {
-          crypto::hash tx_hash = get_transaction_hash(tx);
-          m_tx_pool.take_tx(tx_hash, pool_tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen);
+          MERROR("Snapshot transaction " << tx_id << " of block " << first + i << " is missing or invalid");
+          valid = false;
+          return;
         }
       }
     }
+
+    crypto::hash hash;
+    cn_fast_hash(ids.data(), HASH_OF_HASHES_STEP * sizeof(crypto::hash), hash);
+    if (valid && hash != m_blocks_hash_of_hashes[n])
+    {
+      MERROR("Snapshot blocks " << first << " - " << first + HASH_OF_HASHES_STEP - 1 << " do not match the compiled-in block hashes");
+      valid = false;
+    }
+  };
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  for (uint64_t n = 0; n < height / HASH_OF_HASHES_STEP; ++n)
+  {
+    tpool.submit(&waiter, [&verify_group, &valid, n]() {
+      try
+      {
+        if (valid)
+          verify_group(n);
+      }
+      catch (const std::exception& e)
+      {
+        MERROR("Failed to verify snapshot blocks " << n * HASH_OF_HASHES_STEP << ": " << e.what());
+        valid = false;
+      }
+    }, true);
   }
-}
-#endif
+  waiter.wait(&tpool);
 
-bool Blockchain::is_within_compiled_block_hash_area(uint64_t height) const
-{
-#if defined(PER_BLOCK_CHECKPOINT)
-  return height < m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP;
+  return valid;
 #else
+  MERROR("Snapshots need compiled-in block hashes");
   return false;
 #endif
 }
@@ -4687,6 +5540,26 @@ void Blockchain::cache_block_template(const block &b, const cryptonote::account_
   m_btc_valid = true;
 }
 
+bool Blockchain::get_alt_blocks_memory_usage(uint64_t& bytes) const
+{
+  std::unique_lock<epee::critical_section> lock(m_blockchain_lock, std::try_to_lock);
+  if (!lock.owns_lock())
+    return false;
+
+  bytes = 0;
+  for (const blocks_ext_by_hash* blocks : {&m_alternative_chains, &m_invalid_blocks})
+  {
+    bytes += tools::memory::hash_bytes(*blocks);
+    for (const auto& entry : *blocks)
+    {
+      const block& bl = entry.second.bl;
+      bytes += tools::memory::vector_bytes(bl.tx_hashes) + tools::memory::vector_bytes(bl.miner_tx.vin)
+        + tools::memory::vector_bytes(bl.miner_tx.vout) + tools::memory::vector_bytes(bl.miner_tx.extra);
+    }
+  }
+  return true;
+}
+
 namespace cryptonote {
 template bool Blockchain::get_transactions(const std::vector<crypto::hash>&, std::vector<transaction>&, std::vector<crypto::hash>&) const;
 template bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>&, std::vector<cryptonote::blobdata>&, std::vector<crypto::hash>&, bool) const;
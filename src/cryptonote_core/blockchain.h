@@ -37,14 +37,19 @@
 #include <boost/multi_index/global_fun.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <atomic>
+#include <chrono>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "syncobj.h"
 #include "string_tools.h"
+#include "span.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "common/util.h"
+#include "common/memory_usage.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
@@ -54,6 +59,7 @@
 #include "checkpoints/checkpoints.h"
 #include "cryptonote_basic/hardfork.h"
 #include "blockchain_db/blockchain_db.h"
+#include "volatile_txpool.h"
 
 namespace tools { class Notify; }
 
@@ -70,7 +76,8 @@ namespace cryptonote
     db_defaultsync, //!< user didn't specify, use db_async
     db_sync,  //!< handle syncing calls instead of the backing db, synchronously
     db_async, //!< handle syncing calls instead of the backing db, asynchronously
-    db_nosync //!< Leave syncing up to the backing db (safest, but slowest because of disk I/O)
+    db_nosync, //!< Leave syncing up to the backing db (safest, but slowest because of disk I/O)
+    db_group //!< Leave syncing up to the backing db, which syncs commits in groups on its own thread
   };
 
   /************************************************************************/
@@ -100,6 +107,7 @@ namespace cryptonote
       size_t block_cumulative_weight; //!< the weight of the block
       difficulty_type cumulative_difficulty; //!< the accumulated difficulty after that block
       uint64_t already_generated_coins; //!< the total coins minted after that block
+      crypto::hash pow; //!< the proof of work hash, reused when the block moves to the main chain
     };
 
     /**
@@ -230,6 +238,36 @@ namespace cryptonote
      */
     bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks);
 
+    /**
+     * @brief starts computing the PoW of blocks which will be prepared next
+     *
+     * Runs in the background while the current blocks are verified and written,
+     * prepare_handle_incoming_blocks picks the results up. At most one set of
+     * blocks is hashed ahead, the call is ignored while the previous one runs.
+     *
+     * @param blocks a list of incoming blocks following the ones being added
+     * @param height the height of the first block
+     */
+    void prefetch_block_longhashes(const std::vector<block_complete_entry> &blocks, uint64_t height);
+
+    /**
+     * @brief checks block headers received ahead of the bodies and hashes them
+     *
+     * Each hashing blob must hash to the block id at the same index and each
+     * header must point to the previous id. The PoW hashes of the headers
+     * above the compiled-in hash area are computed in the background and
+     * picked up by prepare_handle_incoming_blocks when the bodies arrive; the
+     * difficulty is checked when the blocks are added. At most one set of
+     * headers is hashed ahead, no PoW is computed while the previous set runs.
+     *
+     * @param height the height of the first block
+     * @param ids the block ids
+     * @param hashing_blobs the hashing blobs of the first ids
+     *
+     * @return the number of leading headers which match their ids
+     */
+    uint64_t prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &ids, const std::vector<blobdata> &hashing_blobs);
+
     /**
      * @brief incoming blocks post-processing, cleanup, and disk sync
      *
@@ -399,10 +437,11 @@ namespace cryptonote
      *
      * @param qblock_ids the foreign chain's "short history" (see get_short_chain_history)
      * @param resp return-by-reference the split height and subsequent blocks' hashes
+     * @param request_headers also return the hashing blobs of up to BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT first blocks
      *
      * @return true if a block found in common, else false
      */
-    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const;
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool request_headers = false) const;
 
     /**
      * @brief find the most recent common point between ours and a foreign chain
@@ -704,13 +743,52 @@ namespace cryptonote
      */
     bool update_checkpoints(const std::string& file_path, bool check_dns);
 
+    /**
+     * @brief applies checkpoints fetched from DNS
+     *
+     * When DNS checkpoints are enforced they are added to the checkpoints
+     * and the chain is rolled back if it fails them, otherwise a chain
+     * failing them is only reported.
+     *
+     * @param dns_points the checkpoints fetched from DNS
+     *
+     * @return false if enforced checkpoints conflict with existing ones, otherwise true
+     */
+    bool apply_dns_checkpoints(const checkpoints& dns_points);
+
+    /**
+     * @brief starts pruning the blockchain
+     *
+     * The prunable transaction data of old blocks outside the stripe is
+     * then removed bit by bit by update_blockchain_pruning.
+     *
+     * @param pruning_stripe the stripe to keep, 0 to pick one at random
+     *
+     * @return true if the blockchain is pruned now, false if it can't be pruned or is pruned with another stripe
+     */
+    bool prune_blockchain(uint32_t pruning_stripe = 0);
+
+    /**
+     * @brief removes the prunable data of the next batch of old blocks, if the blockchain is pruned
+     *
+     * @return true
+     */
+    bool update_blockchain_pruning();
+
+    /**
+     * @brief gets the pruning stripe of the blockchain
+     *
+     * @return the stripe kept, or 0 if the blockchain isn't pruned
+     */
+    uint32_t get_blockchain_pruning_stripe() const { return m_db->get_blockchain_pruning_stripe(); }
+
 
     // user options, must be called before calling init()
 
     /**
      * @brief sets various performance options
      *
-     * @param maxthreads max number of threads when preparing blocks for addition
+     * @param maxthreads max number of threads when preparing blocks for addition, 0 for all
      * @param sync_on_blocks whether to sync based on blocks or bytes
      * @param sync_threshold number of blocks/bytes to cache before syncing to database
      * @param sync_mode the ::blockchain_db_sync_mode to use
@@ -726,6 +804,110 @@ namespace cryptonote
      */
     void set_block_notify(const std::shared_ptr<tools::Notify> &notify) { m_block_notify = notify; }
 
+    typedef std::function<void(uint64_t height, const crypto::hash& id, const block& b)> block_added_handler;
+
+    /**
+     * @brief sets a handler to call for every block added to the main chain
+     *
+     * The handler is called from the thread adding the block, with the blockchain locked.
+     *
+     * @param handler the handler
+     */
+    void set_block_added_handler(const block_added_handler& handler) { m_block_added_handler = handler; }
+
+    typedef std::function<void(uint64_t split_height, uint64_t old_height, uint64_t new_height)> reorg_handler;
+
+    /**
+     * @brief sets a handler to call after switching to an alternative chain
+     *
+     * The blocks of the new chain have been passed to the block added handler before it's called.
+     *
+     * @param handler the handler
+     */
+    void set_reorg_handler(const reorg_handler& handler) { m_reorg_handler = handler; }
+
+    typedef std::function<void(uint64_t height, const crypto::hash& id, const block& b, const std::vector<transaction>& txs)> block_committed_handler;
+
+    /**
+     * @brief sets a handler to call for every block committed to the main chain, with its parsed transactions
+     *
+     * Meant for in-core processing of new blocks without reading them back from the db. The handler is
+     * called from the thread adding the block, with the blockchain locked, before the block added handler.
+     * The transactions are in the order of the block's tx_hashes.
+     *
+     * @param handler the handler
+     */
+    void set_block_committed_handler(const block_committed_handler& handler) { m_block_committed_handler = handler; }
+
+    typedef std::function<void(uint64_t new_height)> block_popped_handler;
+
+    /**
+     * @brief sets a handler to call after the top block is removed from the main chain
+     *
+     * The handler is called with the blockchain locked, once for every removed block.
+     *
+     * @param handler the handler
+     */
+    void set_block_popped_handler(const block_popped_handler& handler) { m_block_popped_handler = handler; }
+
+    /**
+     * @brief gets a number which changes whenever a block is added to or popped from the main chain
+     *
+     * It's read without taking the blockchain lock, and changes after the database does.
+     *
+     * @return the tip cookie
+     */
+    uint64_t get_tip_cookie() const { return m_tip_cookie; }
+
+    /**
+     * @brief state of the top of the main chain, as published after each change
+     */
+    struct tip_snapshot
+    {
+      uint64_t height; //!< blockchain height, the top block's plus one
+      crypto::hash top_hash;
+      block top_block;
+      uint64_t top_block_weight;
+      difficulty_type top_difficulty;
+      difficulty_type cumulative_difficulty;
+      difficulty_type next_difficulty;
+      uint64_t tx_count;
+      uint64_t block_weight_limit;
+      uint64_t block_weight_median;
+      size_t alt_blocks_count;
+    };
+
+    /**
+     * @brief gets the state of the top of the main chain without taking the blockchain lock
+     *
+     * The snapshot is replaced as a whole when blocks are added, popped or alternative blocks
+     * received, so its fields are consistent with each other even while a block is verified.
+     *
+     * @return the latest snapshot, null before init
+     */
+    std::shared_ptr<const tip_snapshot> get_tip_snapshot() const { return std::atomic_load(&m_tip_snapshot); }
+
+    /**
+     * @brief waits for a change calling for a new block template
+     *
+     * Lets miners and pools long-poll for a template instead of asking for the same one repeatedly.
+     * The pool cookie is compared modulo 2^64, as it starts at a random value.
+     *
+     * @param top_hash the top block the caller's template builds on
+     * @param pool_cookie the pool cookie when the caller's template was made
+     * @param pool_changes how far the pool cookie must advance past pool_cookie, 0 to only wait for a new top block
+     * @param timeout how long to wait at most
+     *
+     * @return true if the top block changed, the pool cookie advanced enough or the blockchain is being
+     * cancelled before the timeout, false otherwise
+     */
+    bool wait_for_template_change(const crypto::hash &top_hash, uint64_t pool_cookie, uint64_t pool_changes, std::chrono::milliseconds timeout) const;
+
+    /**
+     * @brief wakes the callers of wait_for_template_change, after the top block or the pool changed
+     */
+    void notify_template_change() const;
+
     /**
      * @brief Put DB in safe sync mode
      */
@@ -915,22 +1097,30 @@ namespace cryptonote
      *
      * @param amount the amount
      * @param offsets the indices (indexed to the amount) of the outputs
-     * @param outputs return-by-reference the outputs collected
-     * @param txs unused, candidate for removal
+     * @param outputs return-by-reference the outputs collected, a prefix of offsets if some are missing
      */
     void output_scan_worker(const uint64_t amount,const std::vector<uint64_t> &offsets,
-        std::vector<output_data_t> &outputs, std::unordered_map<crypto::hash,
-        cryptonote::transaction> &txs) const;
+        std::vector<output_data_t> &outputs) const;
+
+    /**
+     * @brief drops the outputs prefetched for the incoming blocks
+     */
+    void clear_output_cache();
 
     /**
      * @brief computes the "short" and "long" hashes for a set of blocks
      *
+     * Workers share the blocks, each one keeps taking the next unhashed block,
+     * so they stay busy until the set is done and reuse their hashing state.
+     *
      * @param height the height of the first block
      * @param blocks the blocks to be hashed
-     * @param map return-by-reference the hashes for each block
+     * @param next_block index of the next block to hash, shared by workers
+     * @param ids return-by-reference the "short" hash of each block
+     * @param pows return-by-reference the "long" hash of each block
      */
-    void block_longhash_worker(uint64_t height, const std::vector<block> &blocks,
-        std::unordered_map<crypto::hash, crypto::hash> &map) const;
+    void block_longhash_worker(uint64_t height, const std::vector<block> &blocks, std::atomic<size_t> &next_block,
+        std::vector<crypto::hash> &ids, std::vector<crypto::hash> &pows) const;
 
     /**
      * @brief returns a set of known alternate chains
@@ -947,8 +1137,67 @@ namespace cryptonote
     bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const;
     cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const;
     bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)>, bool include_blob = false, bool include_unrelayed_txes = true) const;
+    bool txpool_has_tx(const crypto::hash &txid) const;
+
+    /**
+     * @brief keeps txpool txes in memory instead of the txpool tables of the db
+     *
+     * Txes already in the db are moved into memory. Without snapshots the db
+     * tables are emptied, otherwise they are rewritten by store_txpool_snapshot()
+     * and at deinit. With a read only db the in-memory txpool starts empty and
+     * is never written, the db txpool belongs to the daemon writing the db.
+     *
+     * @param snapshot whether the in-memory txpool is written back to the db
+     */
+    void set_txpool_in_memory(bool snapshot);
+
+    /**
+     * @brief checks whether txpool txes are kept in memory
+     */
+    bool is_txpool_in_memory() const { return (bool)m_volatile_txpool; }
+
+    /**
+     * @brief writes the in-memory txpool to the txpool tables of the db, in a single batch
+     */
+    void store_txpool_snapshot();
+
+    /**
+     * @brief catches up with blocks stored in the db by another process
+     *
+     * Used with a read only db: when the top block changed, the cached chain
+     * state (hard fork state, difficulty and weight caches, block template)
+     * is rebuilt from the db.
+     *
+     * @return true if the top block changed
+     */
+    bool refresh_from_db();
 
     bool is_within_compiled_block_hash_area(uint64_t height) const;
+
+    /**
+     * @brief gets the number of blocks covered by the compiled-in block hashes of a network
+     *
+     * @return the height covered, 0 if there are no compiled-in hashes
+     */
+    static uint64_t get_compiled_in_block_hashes_height(network_type nettype);
+
+    /**
+     * @brief verifies a blockchain loaded from a snapshot against the compiled-in block hashes
+     *
+     * Checks that the db holds exactly height blocks, that each block blob
+     * hashes to its stored id and links to the previous block, that the
+     * stored txs of each block hash to the ids the block commits to, and
+     * that the block ids match the compiled-in hashes of hashes. Txs of
+     * pruned blocks are checked with their stored prunable hash. Groups
+     * of blocks are verified in parallel. Outputs and key images are
+     * derived from these txs and are not checked.
+     *
+     * @param height the snapshot height, a multiple of HASH_OF_HASHES_STEP within the compiled-in area
+     * @param top_hash the id of the top block of the snapshot
+     *
+     * @return true if the snapshot is valid
+     */
+    bool verify_snapshot(uint64_t height, const crypto::hash& top_hash) const;
     bool is_within_compiled_block_hash_area() const { return is_within_compiled_block_hash_area(m_db->height()); }
     uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes);
 
@@ -988,6 +1237,9 @@ namespace cryptonote
 
     BlockchainDB* m_db;
 
+    std::unique_ptr<volatile_txpool> m_volatile_txpool; //!< txpool storage when the txpool is not persisted in the db
+    bool m_txpool_snapshot = false;
+
     tx_memory_pool& m_tx_pool;
 
     mutable epee::critical_section m_blockchain_lock; // TODO: add here reader/writer lock
@@ -998,13 +1250,57 @@ namespace cryptonote
     size_t m_current_block_cumul_weight_median;
 
     // metadata containers
-    std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
+    //! ring members of the incoming blocks keyed by (amount, global index), written under both locks; readers without m_blockchain_lock take m_output_cache_lock
+    std::unordered_map<std::pair<uint64_t, uint64_t>, output_data_t, boost::hash<std::pair<uint64_t, uint64_t>>> m_output_cache;
+    mutable boost::mutex m_output_cache_lock;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
 
-    // SHA-3 hashes for each block and for fast pow checking
-    std::vector<crypto::hash> m_blocks_hash_of_hashes;
-    std::vector<crypto::hash> m_blocks_hash_check;
+    //! pool txs whose inputs have been verified, so they aren't verified again when included in a block
+    struct verified_tx
+    {
+      uint64_t max_used_block_height;
+      crypto::hash max_used_block_id;
+      uint8_t hf_version;
+    };
+    std::unordered_map<crypto::hash, verified_tx> m_verified_txs;
+
+    /// Block hashes validated against the compiled-in hashes of hashes, for the heights from the group
+    /// the chain was at when those were loaded; size() is the end of the compiled-in area, and heights
+    /// not validated (yet) read as null_hash
+    class block_hash_check
+    {
+    public:
+      block_hash_check(): m_start(0), m_end(0) {}
+
+      void reset(uint64_t start, uint64_t end) { m_start = std::min(start, end); m_end = end; m_hashes.clear(); }
+      void clear() { reset(0, 0); m_hashes.shrink_to_fit(); }
+      bool empty() const { return m_end == 0; }
+      uint64_t size() const { return m_end; }
+
+      const crypto::hash &operator[](uint64_t height) const
+      {
+        return height >= m_start && height - m_start < m_hashes.size() ? m_hashes[height - m_start] : crypto::null_hash;
+      }
+      void set(uint64_t height, const crypto::hash &hash)
+      {
+        if (height < m_start || height >= m_end)
+          return;
+        if (height - m_start >= m_hashes.size())
+          m_hashes.resize(height - m_start + 1, crypto::null_hash);
+        m_hashes[height - m_start] = hash;
+      }
+
+    private:
+      uint64_t m_start;
+      uint64_t m_end;
+      std::vector<crypto::hash> m_hashes;
+    };
+
+    // SHA-3 hashes for each block and for fast pow checking; the hashes of hashes point into the
+    // compiled-in data
+    epee::span<const crypto::hash> m_blocks_hash_of_hashes;
+    block_hash_check m_blocks_hash_check;
     std::vector<crypto::hash> m_blocks_txs_check;
 
     blockchain_db_sync_mode m_db_sync_mode;
@@ -1026,6 +1322,8 @@ namespace cryptonote
     crypto::hash m_difficulty_for_next_block_top_hash;
     difficulty_type m_difficulty_for_next_block;
 
+    crypto::hash m_refreshed_top_hash; // for refresh_from_db
+
     boost::asio::io_service m_async_service;
     boost::thread_group m_async_pool;
     std::unique_ptr<boost::asio::io_service::work> m_async_work_idle;
@@ -1036,6 +1334,9 @@ namespace cryptonote
     // some invalid blocks
     blocks_ext_by_hash m_invalid_blocks;     // crypto::hash -> block_extended_info
 
+    //! alternative and invalid blocks kept in memory, declared after them
+    tools::memory::account m_alt_blocks_memory{"alt_blocks", [this](uint64_t& bytes) { return get_alt_blocks_memory_usage(bytes); }};
+
 
     checkpoints m_checkpoints;
     bool m_enforce_dns_checkpoints;
@@ -1057,13 +1358,41 @@ namespace cryptonote
     uint64_t m_btc_expected_reward;
     bool m_btc_valid;
 
+    std::atomic<uint64_t> m_tip_cookie;
+    std::shared_ptr<const tip_snapshot> m_tip_snapshot; //!< accessed with std::atomic_load and std::atomic_store
+    mutable boost::mutex m_template_change_lock; //!< only guards waiting on m_template_change, never held with other locks
+    mutable boost::condition_variable m_template_change;
+
     std::shared_ptr<tools::Notify> m_block_notify;
+    block_added_handler m_block_added_handler;
+    reorg_handler m_reorg_handler;
+    block_committed_handler m_block_committed_handler;
+    block_popped_handler m_block_popped_handler;
 
     // for prepare_handle_incoming_blocks
     uint64_t m_prepare_height;
     uint64_t m_prepare_nblocks;
     std::vector<block> *m_prepare_blocks;
 
+    // for prefetch_block_longhashes
+    boost::mutex m_prefetch_lock;
+    boost::thread m_prefetch_thread;
+    std::unordered_map<crypto::hash, crypto::hash> m_prefetched_longhashes;
+
+    /**
+     * @brief waits for the running prefetch and takes its results
+     */
+    std::unordered_map<crypto::hash, crypto::hash> take_prefetched_longhashes();
+
+    // for prevalidate_block_headers, guarded by m_prefetch_lock
+    boost::thread m_header_pow_thread;
+    std::unordered_map<crypto::hash, crypto::hash> m_header_longhashes;
+
+    /**
+     * @brief takes the PoW hash computed from the header of a block, if any
+     */
+    bool take_header_longhash(const crypto::hash &id, crypto::hash &pow);
+
     /**
      * @brief collects the keys for all outputs being "spent" as an input
      *
@@ -1077,14 +1406,13 @@ namespace cryptonote
      * @tparam visitor_t a class encapsulating tx is unlocked and collect tx key
      * @param tx_in_to_key a transaction input instance
      * @param vis an instance of the visitor to use
-     * @param tx_prefix_hash the hash of the associated transaction_prefix
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
      * @param tx_version version of the tx, if > 1 we also get commitments
      *
      * @return false if any keys are not found or any inputs are not unlocked, otherwise true
      */
     template<class visitor_t>
-    inline bool scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, const crypto::hash &tx_prefix_hash, uint64_t* pmax_related_block_height = NULL) const;
+    inline bool scan_outputkeys_for_indexes(size_t tx_version, const txin_to_key& tx_in_to_key, visitor_t &vis, uint64_t* pmax_related_block_height = NULL) const;
 
     /**
      * @brief collect output public keys of a transaction input set
@@ -1125,10 +1453,26 @@ namespace cryptonote
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param deferred_rct if not NULL, simple ringct MLSAGs are not verified but the expanded
+     *        signature is moved here, the caller verifies them in a batch
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, std::vector<rct::rctSig> *deferred_rct = NULL);
+
+    /**
+     * @brief checks if the transaction inputs have been verified at pool admission and are still valid
+     *
+     * The verification holds if it was done under the current hard fork version and the
+     * most recent block used by the inputs is still in the main chain. Key images are
+     * checked against the blockchain again, as they may have been spent since.
+     *
+     * @param tx_id the transaction hash
+     * @param tx the transaction
+     *
+     * @return true if signature checks can be skipped for the transaction
+     */
+    bool is_tx_verified(const crypto::hash &tx_id, const transaction &tx);
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1205,6 +1549,39 @@ namespace cryptonote
      */
     difficulty_type get_next_difficulty_for_alternative_chain(const std::list<blocks_ext_by_hash::iterator>& alt_chain, block_extended_info& bei) const;
 
+    /**
+     * @brief stores a block in the alternative blocks container and the db
+     *
+     * Once the container holds more than BLOCKCHAIN_MAX_ALT_BLOCKS, the
+     * chain tips with the least cumulative difficulty are evicted.  Only tips
+     * are evicted so the remaining alternative chains stay connected.
+     *
+     * @param id the hash of the block
+     * @param bei the block and its metadata
+     *
+     * @return the block's entry, or end() if it was already stored
+     */
+    blocks_ext_by_hash::iterator add_alternative_block(const crypto::hash& id, const block_extended_info& bei);
+
+    /**
+     * @brief removes a block from the alternative blocks container and the db
+     *
+     * @param it the block's entry
+     */
+    void remove_alternative_block(blocks_ext_by_hash::iterator it);
+
+    /**
+     * @brief evicts alternative blocks until the container is within its limit
+     *
+     * @param keep the hash of a block which must not be evicted
+     */
+    void evict_alternative_blocks(const crypto::hash& keep);
+
+    /**
+     * @brief loads the alternative blocks stored in the db
+     */
+    void load_alternative_blocks();
+
     /**
      * @brief sanity checks a miner transaction before validating an entire block
      *
@@ -1354,6 +1731,13 @@ namespace cryptonote
      */
     bool complete_timestamps_vector(uint64_t start_height, std::vector<uint64_t>& timestamps);
 
+    /**
+     * @brief publishes the current state of the top of the main chain for get_tip_snapshot
+     *
+     * The caller must hold the blockchain lock.
+     */
+    void publish_tip_snapshot();
+
     /**
      * @brief calculate the block weight limit for the next block to be added
      *
@@ -1413,5 +1797,12 @@ namespace cryptonote
      * At some point, may be used to push an update to miners
      */
     void cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t expected_reward, uint64_t pool_cookie);
+
+    /**
+     * @brief estimates the memory held by m_alternative_chains and m_invalid_blocks
+     *
+     * @return false if the blockchain lock is busy
+     */
+    bool get_alt_blocks_memory_usage(uint64_t& bytes) const;
   };
 }  // namespace cryptonote
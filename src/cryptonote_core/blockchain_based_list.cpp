@@ -1,7 +1,13 @@
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
 #include "file_io_utils.h"
+#include "common/memory_usage.h"
+#include "common/threadpool.h"
 #include "stake_transaction_processor.h"
 #include "graft_rta_config.h"
 #include "blockchain_based_list.h"
+#include "storage_journal.h"
 #include "serialization/binary_utils.h"
 
 using namespace cryptonote;  
@@ -12,51 +18,168 @@ namespace
 const size_t BLOCKCHAIN_BASED_LIST_SIZE = 32; //TODO: configuration parameter
 const size_t PREVIOS_BLOCKCHAIN_BASED_LIST_MAX_SIZE = 16; //TODO: configuration parameter
 const size_t BLOCKCHAIN_BASED_LISTS_HISTORY_DEPTH   = 1000;
+const size_t JOURNAL_MAX_RECORDS_COUNT              = 1000; //journal is compacted to a new snapshot after this number of records
+const char*  JOURNAL_FILE_NAME_SUFFIX               = ".journal";
+const char   SNAPSHOT_MAGIC[8]                      = {'G', 'R', 'F', 'T', 'B', 'B', 'L', 'S'};
+
+/// Header of the snapshot file; it's followed by index of history entries and serialized tiers of each entry
+struct snapshot_header
+{
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  uint64_t journal_generation;
+  uint64_t block_height;
+  uint64_t history_depth;
+  uint64_t entries_count;
+};
+
+struct snapshot_index_entry
+{
+  uint64_t offset;
+  uint64_t size;
+};
+
+enum blockchain_based_list_journal_record_type
+{
+  JOURNAL_RECORD_ADD_BLOCK = 1,
+  JOURNAL_RECORD_REMOVE_BLOCK,
+};
+
+struct blockchain_based_list_journal_record
+{
+  uint8_t type;
+  uint64_t block_height;
+  BlockchainBasedList::supernode_tier_array tiers;
+
+  blockchain_based_list_journal_record() : type(), block_height() {}
+
+  BEGIN_SERIALIZE_OBJECT()
+    FIELD(type)
+    FIELD(block_height)
+    FIELD(tiers)
+  END_SERIALIZE()
+};
+
+/// Select items from a list keeping their order; one random number is drawn for each item of the source list
+template <class T>
+void select_supernodes(std::mt19937_64& rng, size_t items_count, const std::vector<T>& src_list, std::vector<T>& dst_list)
+{
+  size_t src_list_size = src_list.size();
+
+  if (items_count > src_list_size)
+    items_count = src_list_size;
+
+  for (size_t i=0; i<src_list_size; i++)
+  {
+    size_t random_value = rng() % (src_list_size - i);
+
+    if (random_value >= items_count)
+      continue;
+
+    dst_list.push_back(src_list[i]);
 
+    items_count--;
+  }
 }
 
+}
+
+struct BlockchainBasedList::mapped_snapshot
+{
+  boost::interprocess::file_mapping file;
+  boost::interprocess::mapped_region region;
+
+  mapped_snapshot(const std::string& file_name)
+    : file(file_name.c_str(), boost::interprocess::read_only)
+    , region(file, boost::interprocess::read_only)
+  {
+  }
+
+  const char* data() const { return static_cast<const char*>(region.get_address()); }
+  size_t size() const { return region.get_size(); }
+};
+
 BlockchainBasedList::BlockchainBasedList(const std::string& m_storage_file_name, uint64_t first_block_number)
   : m_storage_file_name(m_storage_file_name)
   , m_block_height(first_block_number)
+  , m_history(BLOCKCHAIN_BASED_LISTS_HISTORY_DEPTH)
   , m_history_depth()
   , m_first_block_number(first_block_number)
+  , m_journal(m_storage_file_name + JOURNAL_FILE_NAME_SUFFIX)
   , m_need_store()
+  , m_need_snapshot()
 {
   load();
 }
 
-const BlockchainBasedList::supernode_tier_array& BlockchainBasedList::tiers(size_t depth) const
+BlockchainBasedList::~BlockchainBasedList()
 {
-  if (depth >= m_history_depth)
-    throw std::runtime_error("internal error: attempt to get tier which is not present in a blockchain based list");
+}
+
+const BlockchainBasedList::supernode_tier_array& BlockchainBasedList::get_tiers(const history_entry& entry) const
+{
+  if (entry.tiers)
+    return *entry.tiers;
 
-  if (!depth)
-    return m_history.back();
+    //decode tiers from the mapped snapshot
 
-  list_history::const_reverse_iterator it = m_history.rbegin();
+  CHECK_AND_ASSERT_THROW_MES(m_snapshot, "internal error: blockchain based list history entry is not mapped");
 
-  std::advance(it, depth);
+  std::string blob(m_snapshot->data() + entry.blob_offset, entry.blob_size);
+  std::shared_ptr<supernode_tier_array> tiers = std::make_shared<supernode_tier_array>();
 
-  return *it;
+  CHECK_AND_ASSERT_THROW_MES(::serialization::parse_binary(blob, *tiers),
+    "internal error: failed to deserialize blockchain based list history entry from file '" << m_storage_file_name << "'");
+
+  entry.tiers = tiers;
+
+  return *entry.tiers;
 }
 
-void BlockchainBasedList::select_supernodes(size_t items_count, const supernode_array& src_list, supernode_array& dst_list)
+const BlockchainBasedList::supernode_tier_array& BlockchainBasedList::tiers(size_t depth) const
 {
-  size_t src_list_size = src_list.size();
+  if (depth >= m_history_depth)
+    throw std::runtime_error("internal error: attempt to get tier which is not present in a blockchain based list");
 
-  if (items_count > src_list_size)
-    items_count = src_list_size;
+  return get_tiers(m_history[m_history.size() - 1 - depth]);
+}
 
-  for (size_t i=0; i<src_list_size; i++)
+void BlockchainBasedList::select_auth_sample(const supernode_tier_array& tiers, const crypto::hash& block_hash, supernode_array& sample)
+{
+  std::seed_seq seed(reinterpret_cast<const unsigned char*>(&block_hash.data[0]), reinterpret_cast<const unsigned char*>(&block_hash.data[sizeof(block_hash.data)]));
+  std::mt19937_64 rng(seed);
+
+  sample.clear();
+  sample.reserve(config::graft::AUTH_SAMPLE_SIZE);
+
+    //equal share for each tier, shortage of a tier is taken from next tiers
+
+  size_t items_per_tier = config::graft::AUTH_SAMPLE_SIZE / config::graft::TIERS_COUNT, missing_items_count = 0;
+  std::vector<size_t> indexes;
+
+  for (size_t i=0; i<tiers.size(); i++)
   {
-    size_t random_value = m_rng() % (src_list_size - i);
+    const supernode_array& tier = tiers[i];
+    size_t items_count = items_per_tier + missing_items_count;
 
-    if (random_value >= items_count)
-      continue;
+    if (items_count > tier.size())
+    {
+      missing_items_count = items_count - tier.size();
+      items_count         = tier.size();
+    }
+    else missing_items_count = 0;
 
-    dst_list.push_back(src_list[i]);
+      //partial Fisher-Yates shuffle
 
-    items_count--;
+    indexes.resize(tier.size());
+
+    for (size_t j=0; j<indexes.size(); j++)
+      indexes[j] = j;
+
+    for (size_t j=0; j<items_count; j++)
+    {
+      std::swap(indexes[j], indexes[j + rng() % (indexes.size() - j)]);
+      sample.push_back(tier[indexes[j]]);
+    }
   }
 }
 
@@ -70,25 +193,34 @@ void BlockchainBasedList::apply_block(uint64_t block_height, const crypto::hash&
 
   const StakeTransactionStorage::supernode_stake_array& stakes = stake_txs_storage.get_supernode_stakes(block_height);
 
-    //build blockchain based list for each tier
+    //split stakes and valid supernodes of the previous list by tier; supernodes are referenced by stake index,
+    //so the storage isn't accessed by the tier builders
 
-  supernode_array prev_supernodes, current_supernodes;
-  supernode_tier_array new_tier;
+  m_tier_buffers.resize(config::graft::TIERS_COUNT);
 
-  for (size_t i=0; i<config::graft::TIERS_COUNT; i++)
+  for (tier_buffers& buffers : m_tier_buffers)
   {
-    prev_supernodes.clear();
-    current_supernodes.clear();
+    buffers.prev_supernodes.clear();
+    buffers.current_supernodes.clear();
+  }
 
-      //prepare lists of valid supernodes for this tier
+  for (size_t i=0; i<stakes.size(); i++)
+  {
+    const supernode_stake& stake = stakes[i];
 
-    if (!m_history.empty())
-    {
-      const supernode_array& full_prev_supernodes = m_history.back()[i];
+    if (!stake.amount || !stake.tier || stake.tier > config::graft::TIERS_COUNT)
+      continue;
 
-      prev_supernodes.reserve(full_prev_supernodes.size());
+    m_tier_buffers[stake.tier - 1].current_supernodes.push_back(i);
+  }
+
+  if (!m_history.empty())
+  {
+    const supernode_tier_array& prev_tiers = get_tiers(m_history.back());
 
-      for (const supernode& sn : full_prev_supernodes)
+    for (size_t i=0; i<config::graft::TIERS_COUNT && i<prev_tiers.size(); i++)
+    {
+      for (const supernode& sn : prev_tiers[i])
       {
         const supernode_stake* stake = stake_txs_storage.find_supernode_stake(block_height, sn.supernode_public_id);
 
@@ -98,89 +230,132 @@ void BlockchainBasedList::apply_block(uint64_t block_height, const crypto::hash&
         if (stake->tier != i + 1)
           continue;
 
-        prev_supernodes.push_back(sn);
+        m_tier_buffers[i].prev_supernodes.push_back({&sn, size_t(stake - stakes.data())});
       }
     }
+  }
 
-    current_supernodes.reserve(stakes.size());
+    //build blockchain based list for each tier; tiers don't depend on each other
 
-    for (const supernode_stake& stake : stakes)
-    {
-      if (!stake.amount)
-        continue;
+  supernode_tier_array new_tier(config::graft::TIERS_COUNT);
 
-      if (stake.tier != i + 1)
-        continue;
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
 
-      supernode sn;
+  for (size_t i=0; i<config::graft::TIERS_COUNT; i++)
+    tpool.submit(&waiter, [&, i]() { build_tier(block_hash, stakes, m_tier_buffers[i], new_tier[i]); }, true);
 
-      sn.supernode_public_id      = stake.supernode_public_id;
-      sn.supernode_public_address = stake.supernode_public_address;
-      sn.amount                   = stake.amount;
-      sn.block_height             = stake.block_height;
-      sn.unlock_time              = stake.unlock_time;
+  waiter.wait(&tpool);
 
-      current_supernodes.emplace_back(std::move(sn));
-    }
+    //journal new tiers
 
-      //seed RNG
+  blockchain_based_list_journal_record record;
 
-    std::seed_seq seed(reinterpret_cast<const unsigned char*>(&block_hash.data[0]),
-                       reinterpret_cast<const unsigned char*>(&block_hash.data[sizeof block_hash.data]));
+  record.type         = JOURNAL_RECORD_ADD_BLOCK;
+  record.block_height = block_height;
+  record.tiers        = new_tier;
 
-    m_rng.seed(seed);
+  add_journal_record(record);
 
-      //sort valid supernodes by the age of stake
+    //update history
 
-    std::stable_sort(current_supernodes.begin(), current_supernodes.end(), [](const supernode& s1, const supernode& s2) {
-      return s1.block_height < s2.block_height || (s1.block_height == s2.block_height && s1.supernode_public_id < s2.supernode_public_id);
-    });
+  add_tiers(block_height, std::move(new_tier));
+}
 
-      //select supernodes from the previous list
+void BlockchainBasedList::build_tier(const crypto::hash& block_hash, const StakeTransactionStorage::supernode_stake_array& stakes,
+  tier_buffers& buffers, supernode_array& new_supernodes)
+{
+  std::vector<size_t>& current_supernodes = buffers.current_supernodes;
 
-    supernode_array new_supernodes;
-  
-    select_supernodes(PREVIOS_BLOCKCHAIN_BASED_LIST_MAX_SIZE, prev_supernodes, new_supernodes);
+    //seed RNG
 
-    if (new_supernodes.size() < BLOCKCHAIN_BASED_LIST_SIZE)
-    {
-        //remove supernodes of prev list from current list
+  std::seed_seq seed(reinterpret_cast<const unsigned char*>(&block_hash.data[0]),
+                     reinterpret_cast<const unsigned char*>(&block_hash.data[sizeof block_hash.data]));
 
-      auto duplicates_filter = [&](const supernode& sn1) {
-        for (const supernode& sn2 : new_supernodes)
-          if (sn1.supernode_public_id == sn2.supernode_public_id)
-            return true;
+  std::mt19937_64 rng(seed);
 
-        return false;
-      };
+    //sort valid supernodes by the age of stake
 
-      current_supernodes.erase(std::remove_if(current_supernodes.begin(), current_supernodes.end(), duplicates_filter), current_supernodes.end());
+  std::stable_sort(current_supernodes.begin(), current_supernodes.end(), [&](size_t i1, size_t i2) {
+    const supernode_stake &s1 = stakes[i1], &s2 = stakes[i2];
+    return s1.block_height < s2.block_height || (s1.block_height == s2.block_height && s1.supernode_public_id < s2.supernode_public_id);
+  });
 
-        //select supernodes from the current list
+    //select supernodes from the previous list
 
-      select_supernodes(BLOCKCHAIN_BASED_LIST_SIZE - new_supernodes.size(), current_supernodes, new_supernodes);
-    }
+  std::vector<prev_supernode>& selected_prev_supernodes = buffers.selected_prev_supernodes;
 
-      //update tier
+  selected_prev_supernodes.clear();
 
-    //LOG_PRINT_L0("Blockchain based list has been built for block " << block_height << " and tier " << i << " with " << new_supernodes.size() << " supernode(s)");
+  select_supernodes(rng, PREVIOS_BLOCKCHAIN_BASED_LIST_MAX_SIZE, buffers.prev_supernodes, selected_prev_supernodes);
+
+  new_supernodes.clear();
+  new_supernodes.reserve(BLOCKCHAIN_BASED_LIST_SIZE);
+
+  for (const prev_supernode& prev : selected_prev_supernodes)
+    new_supernodes.push_back(*prev.sn);
+
+  if (new_supernodes.size() >= BLOCKCHAIN_BASED_LIST_SIZE)
+    return;
 
-    new_tier.emplace_back(std::move(new_supernodes));
+    //remove supernodes of prev list from current list; stake indexes are unique per supernode
+
+  std::vector<uint8_t>& selected = buffers.selected_stakes;
+
+  selected.assign(stakes.size(), 0);
+
+  for (const prev_supernode& prev : selected_prev_supernodes)
+    selected[prev.stake_index] = 1;
+
+  current_supernodes.erase(std::remove_if(current_supernodes.begin(), current_supernodes.end(), [&](size_t index) { return selected[index] != 0; }),
+    current_supernodes.end());
+
+    //select supernodes from the current list
+
+  std::vector<size_t>& selected_current_supernodes = buffers.selected_current_supernodes;
+
+  selected_current_supernodes.clear();
+
+  select_supernodes(rng, BLOCKCHAIN_BASED_LIST_SIZE - new_supernodes.size(), current_supernodes, selected_current_supernodes);
+
+  for (size_t index : selected_current_supernodes)
+  {
+    const supernode_stake& stake = stakes[index];
+
+    supernode sn;
+
+    sn.supernode_public_id      = stake.supernode_public_id;
+    sn.supernode_public_address = stake.supernode_public_address;
+    sn.amount                   = stake.amount;
+    sn.block_height             = stake.block_height;
+    sn.unlock_time              = stake.unlock_time;
+
+    new_supernodes.emplace_back(std::move(sn));
   }
+}
 
-    //update history
+void BlockchainBasedList::add_tiers(uint64_t block_height, supernode_tier_array&& tiers)
+{
+  history_entry entry;
 
-  m_history.emplace_back(std::move(new_tier));
+    //share tiers with the previous block if nothing has been changed
 
-  if (m_history_depth < BLOCKCHAIN_BASED_LISTS_HISTORY_DEPTH)
+  if (!m_history.empty() && m_history.back().tiers && *m_history.back().tiers == tiers)
   {
-    m_history_depth++;
+    entry.tiers = m_history.back().tiers;
   }
   else
   {
-    m_history.pop_front();
+    entry.tiers = std::make_shared<const supernode_tier_array>(std::move(tiers));
   }
 
+    //the oldest entry is overwritten when the history is full
+
+  m_history.push_back(std::move(entry));
+
+  if (m_history_depth < BLOCKCHAIN_BASED_LISTS_HISTORY_DEPTH)
+    m_history_depth++;
+
   m_block_height = block_height;
   m_need_store = true;
 }
@@ -199,78 +374,346 @@ void BlockchainBasedList::remove_latest_block()
 
   if (m_history.empty())
     m_block_height = m_first_block_number;
+
+  blockchain_based_list_journal_record record;
+
+  record.type = JOURNAL_RECORD_REMOVE_BLOCK;
+
+  add_journal_record(record);
 }
 
-namespace
+void BlockchainBasedList::get_checkpoint(checkpoint& result) const
 {
+  result.block_height = m_block_height;
+
+  result.history.clear();
+  result.history.reserve(m_history.size());
+
+    //decoded tiers are shared with the history, so the checkpoint doesn't depend on the mapped snapshot
+
+  for (const history_entry& entry : m_history)
+  {
+    get_tiers(entry);
+    result.history.push_back(entry.tiers);
+  }
+}
 
-struct blockchain_based_list_container
+void BlockchainBasedList::restore_checkpoint(const checkpoint& checkpoint)
 {
-  uint64_t block_height;
-  size_t history_depth;
-  BlockchainBasedList::list_history& history;
+  m_history.clear();
 
-  blockchain_based_list_container(uint64_t block_height, size_t history_depth, BlockchainBasedList::list_history& history)
-    : block_height(block_height), history_depth(history_depth), history(history) {}
+  for (const std::shared_ptr<const supernode_tier_array>& tiers : checkpoint.history)
+  {
+    history_entry entry;
 
-  BEGIN_SERIALIZE_OBJECT()
-    FIELD(block_height)
-    FIELD(history_depth)
-    FIELD(history)
-  END_SERIALIZE()
-};
+    entry.tiers = tiers;
+
+    m_history.push_back(std::move(entry));
+  }
+
+  m_block_height  = checkpoint.block_height;
+  m_history_depth = m_history.size();
 
+    //pending journal records are superseded by the snapshot
+
+  m_journal_records.clear();
+
+  m_need_store    = true;
+  m_need_snapshot = true;
 }
 
-void BlockchainBasedList::store() const
+template <class T> void BlockchainBasedList::add_journal_record(T& record)
+{
+  std::string blob;
+
+  if (!::serialization::dump_binary(record, blob))
+    throw std::runtime_error("internal error: failed to serialize blockchain based list journal record");
+
+  m_journal_records.emplace_back(std::move(blob));
+}
+
+bool BlockchainBasedList::apply_journal_record(const std::string& blob)
 {
-  blockchain_based_list_container data(m_block_height, m_history_depth, const_cast<list_history&>(m_history));
+  blockchain_based_list_journal_record record;
 
-  std::ofstream ostr;
-  ostr.open(m_storage_file_name, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+  if (!::serialization::parse_binary(blob, record))
+  {
+    MWARNING("Can't parse blockchain based list journal record");
+    return false;
+  }
 
-  binary_archive<true> oar(ostr);
+  switch (record.type)
+  {
+    case JOURNAL_RECORD_ADD_BLOCK:
+      if (record.block_height != m_block_height + 1)
+      {
+        MWARNING("Unexpected block " << record.block_height << " in blockchain based list journal (last block is " << m_block_height << ")");
+        return false;
+      }
+
+      add_tiers(record.block_height, std::move(record.tiers));
+
+      return true;
+    case JOURNAL_RECORD_REMOVE_BLOCK:
+      remove_latest_block();
+      return true;
+    default:
+      MWARNING("Unknown blockchain based list journal record type " << int(record.type));
+      return false;
+  }
+}
+
+void BlockchainBasedList::store() const
+{
+  if (!m_need_snapshot && boost::filesystem::exists(m_storage_file_name) && m_journal.records_count() + m_journal_records.size() < JOURNAL_MAX_RECORDS_COUNT)
+  {
+    m_journal.append(m_journal_records);
+  }
+  else
+  {
+      //compact journal to a new snapshot
 
-  bool success = ::serialization::serialize(oar, data);
+    store_snapshot();
 
-  ostr.close();
+    m_need_snapshot = false;
+  }
 
-  CHECK_AND_ASSERT_THROW_MES(success && ostr.good(), "Error at save blockchain based list file '" << m_storage_file_name << "'");
+  m_journal_records.clear();
 
   m_need_store = false;
 }
 
-void BlockchainBasedList::load()
+void BlockchainBasedList::store_snapshot() const
 {
-  if (!boost::filesystem::exists(m_storage_file_name))
-    return;
+    //serialize decoded entries and copy not decoded entries from the mapped snapshot as is
 
-  std::string buffer;
-  bool r = epee::file_io_utils::load_file_to_string(m_storage_file_name, buffer);
+  std::vector<std::string> blobs;
+  std::vector<size_t> blob_indexes; //index of the blob for each history entry
 
-  CHECK_AND_ASSERT_THROW_MES(r, "blockchain based list file '" << m_storage_file_name << "' is not found");
+  blobs.reserve(m_history.size());
+  blob_indexes.reserve(m_history.size());
 
-  try
+  for (size_t i=0; i<m_history.size(); i++)
   {
-    LOG_PRINT_L0("Trying to parse blockchain based list");
+    const history_entry& entry = m_history[i];
+
+    if (i)
+    {
+        //shared entries are stored once
+
+      const history_entry& prev_entry = m_history[i - 1];
+
+      if (entry.tiers ? entry.tiers == prev_entry.tiers : !prev_entry.tiers && entry.blob_offset == prev_entry.blob_offset)
+      {
+        blob_indexes.push_back(blobs.size() - 1);
+        continue;
+      }
+    }
+
+    std::string blob;
+
+    if (entry.tiers)
+    {
+      if (!::serialization::dump_binary(const_cast<supernode_tier_array&>(*entry.tiers), blob))
+        throw std::runtime_error("internal error: failed to serialize blockchain based list history entry");
+    }
+    else
+    {
+      CHECK_AND_ASSERT_THROW_MES(m_snapshot, "internal error: blockchain based list history entry is not mapped");
 
-    list_history new_history;
-    blockchain_based_list_container data(0, 0, new_history);
+      blob.assign(m_snapshot->data() + entry.blob_offset, entry.blob_size);
+    }
+
+    blob_indexes.push_back(blobs.size());
+    blobs.emplace_back(std::move(blob));
+  }
 
-    r = ::serialization::parse_binary(buffer, data);
+  snapshot_header header;
 
-    CHECK_AND_ASSERT_THROW_MES(r, "internal error: failed to deserialize blockchain based list file '" << m_storage_file_name << "'");
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
 
-    m_block_height  = data.block_height;
-    m_history_depth = data.history_depth;
+  header.journal_generation = m_journal.generation() + 1;
+  header.block_height       = m_block_height;
+  header.history_depth      = m_history_depth;
+  header.entries_count      = blob_indexes.size();
 
-    std::swap(m_history, data.history);
+  std::vector<snapshot_index_entry> index(blob_indexes.size());
+  std::vector<uint64_t> blob_offsets(blobs.size());
 
-    m_need_store = false;
+  uint64_t offset = sizeof(header) + sizeof(snapshot_index_entry) * index.size();
+
+  for (size_t i=0; i<blobs.size(); i++)
+  {
+    blob_offsets[i] = offset;
+    offset         += blobs[i].size();
+  }
+
+  for (size_t i=0; i<index.size(); i++)
+  {
+    index[i].offset = blob_offsets[blob_indexes[i]];
+    index[i].size   = blobs[blob_indexes[i]].size();
+  }
+
+    //release mapping before the snapshot file is replaced
+
+  m_snapshot.reset();
+
+  try
+  {
+    store_file_atomically(m_storage_file_name, [&](std::ostream& ostr) {
+      ostr.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      ostr.write(reinterpret_cast<const char*>(index.data()), sizeof(snapshot_index_entry) * index.size());
+
+      for (const std::string& blob : blobs)
+        ostr.write(blob.data(), blob.size());
+
+      return ostr.good();
+    });
+
+    m_snapshot.reset(new mapped_snapshot(m_storage_file_name));
   }
   catch (...)
   {
-    LOG_PRINT_L0("Can't parse blockchain based list file '" << m_storage_file_name << "'");
+      //keep history in memory if the snapshot can't be stored
+
+    for (size_t i=0; i<m_history.size(); i++)
+    {
+      if (m_history[i].tiers)
+        continue;
+
+      std::shared_ptr<supernode_tier_array> tiers = std::make_shared<supernode_tier_array>();
+
+      if (::serialization::parse_binary(blobs[blob_indexes[i]], *tiers))
+        m_history[i].tiers = tiers;
+    }
+
     throw;
   }
+
+    //remap history entries to the new snapshot; only the latest entry is kept decoded
+
+  m_journal.reset(header.journal_generation);
+
+  for (size_t i=0; i<m_history.size(); i++)
+  {
+    history_entry& entry = m_history[i];
+
+    entry.blob_offset = index[i].offset;
+    entry.blob_size   = index[i].size;
+
+    if (i + 1 != index.size())
+      entry.tiers.reset();
+  }
+}
+
+void BlockchainBasedList::load_snapshot(uint64_t& journal_generation)
+{
+  std::unique_ptr<mapped_snapshot> snapshot(new mapped_snapshot(m_storage_file_name));
+
+  snapshot_header header;
+
+  CHECK_AND_ASSERT_THROW_MES(snapshot->size() >= sizeof(header), "blockchain based list file '" << m_storage_file_name << "' is too small");
+
+  memcpy(&header, snapshot->data(), sizeof(header));
+
+  CHECK_AND_ASSERT_THROW_MES(!memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)),
+    "blockchain based list file '" << m_storage_file_name << "' has invalid format");
+  CHECK_AND_ASSERT_THROW_MES(header.entries_count == header.history_depth && header.entries_count <= BLOCKCHAIN_BASED_LISTS_HISTORY_DEPTH,
+    "blockchain based list file '" << m_storage_file_name << "' has invalid history depth");
+  CHECK_AND_ASSERT_THROW_MES(snapshot->size() >= sizeof(header) + sizeof(snapshot_index_entry) * header.entries_count,
+    "blockchain based list file '" << m_storage_file_name << "' has truncated index");
+
+  history_buffer history(BLOCKCHAIN_BASED_LISTS_HISTORY_DEPTH);
+
+  for (size_t i=0; i<header.entries_count; i++)
+  {
+    snapshot_index_entry index_entry;
+
+    memcpy(&index_entry, snapshot->data() + sizeof(header) + sizeof(snapshot_index_entry) * i, sizeof(index_entry));
+
+    CHECK_AND_ASSERT_THROW_MES(index_entry.offset <= snapshot->size() && index_entry.size <= snapshot->size() - index_entry.offset,
+      "blockchain based list file '" << m_storage_file_name << "' has invalid history entry " << i);
+
+    history_entry entry;
+
+    entry.blob_offset = index_entry.offset;
+    entry.blob_size   = index_entry.size;
+
+    history.push_back(std::move(entry));
+  }
+
+  journal_generation = header.journal_generation;
+  m_block_height     = header.block_height;
+  m_history_depth    = header.history_depth;
+
+  std::swap(m_history, history);
+  std::swap(m_snapshot, snapshot);
+}
+
+void BlockchainBasedList::load()
+{
+  uint64_t journal_generation = 0;
+
+  if (boost::filesystem::exists(m_storage_file_name))
+  {
+    try
+    {
+      LOG_PRINT_L0("Trying to parse blockchain based list");
+
+      load_snapshot(journal_generation);
+    }
+    catch (...)
+    {
+      LOG_PRINT_L0("Can't parse blockchain based list file '" << m_storage_file_name << "'");
+      throw;
+    }
+  }
+
+    //replay journal on top of the snapshot
+
+  m_journal.load(journal_generation, [this](const std::string& blob) { return apply_journal_record(blob); });
+
+  if (m_journal.records_count())
+    MDEBUG("Blockchain based list journal has been applied with " << m_journal.records_count() << " record(s)");
+
+  m_journal_records.clear();
+
+  m_need_store = false;
+}
+
+uint64_t BlockchainBasedList::get_memory_usage() const
+{
+  using namespace tools::memory;
+
+  uint64_t bytes = m_history.capacity() * sizeof(history_entry);
+  const supernode_tier_array* prev_tiers = nullptr;
+
+  for (const history_entry& entry : m_history)
+  {
+    const supernode_tier_array* tiers = entry.tiers.get();
+
+    if (!tiers || tiers == prev_tiers)
+      continue;
+
+    prev_tiers = tiers;
+    bytes += sizeof(supernode_tier_array) + vector_bytes(*tiers);
+
+    for (const supernode_array& tier : *tiers)
+    {
+      bytes += vector_bytes(tier);
+      for (const supernode& sn : tier)
+        bytes += string_bytes(sn.supernode_public_id);
+    }
+  }
+
+  bytes += vector_bytes(m_tier_buffers);
+  for (const tier_buffers& buffers : m_tier_buffers)
+    bytes += vector_bytes(buffers.prev_supernodes) + vector_bytes(buffers.selected_prev_supernodes) + vector_bytes(buffers.current_supernodes)
+      + vector_bytes(buffers.selected_current_supernodes) + vector_bytes(buffers.selected_stakes);
+
+  bytes += node_bytes(m_journal_records);
+  for (const std::string& record : m_journal_records)
+    bytes += string_bytes(record);
+
+  return bytes;
 }
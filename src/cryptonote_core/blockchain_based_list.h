@@ -1,6 +1,8 @@
 #pragma once
 
+#include <memory>
 #include <random>
+#include <boost/circular_buffer.hpp>
 
 #include "blockchain.h"
 #include "serialization/crypto.h"
@@ -8,6 +10,7 @@
 #include "serialization/vector.h"
 #include "serialization/string.h"
 #include "cryptonote_core/stake_transaction_storage.h"
+#include "cryptonote_core/storage_journal.h"
 
 namespace cryptonote
 {
@@ -23,6 +26,12 @@ public:
     uint64_t block_height;
     uint64_t unlock_time;
 
+    bool operator==(const supernode& rhs) const
+    {
+      return amount == rhs.amount && block_height == rhs.block_height && unlock_time == rhs.unlock_time &&
+             supernode_public_id == rhs.supernode_public_id && supernode_public_address == rhs.supernode_public_address;
+    }
+
     BEGIN_SERIALIZE_OBJECT()
       FIELD(amount)
       FIELD(block_height)
@@ -34,10 +43,29 @@ public:
 
   typedef std::vector<supernode>           supernode_array;
   typedef std::vector<supernode_array>     supernode_tier_array;
-  typedef std::list<supernode_tier_array>  list_history;
+
+  /// History entry which is decoded from the mapped snapshot on first access; equal tiers of consecutive blocks are shared
+  struct history_entry
+  {
+    mutable std::shared_ptr<const supernode_tier_array> tiers; //nullptr if entry has not been decoded yet
+    uint64_t blob_offset;                                        //offset of serialized tiers in the mapped snapshot
+    uint64_t blob_size;
+
+    history_entry() : blob_offset(), blob_size() {}
+  };
+
+  typedef boost::circular_buffer<history_entry> history_buffer;
+
+  /// State of the list at a block which can be restored when the blockchain is reorganized deeper than the history
+  struct checkpoint
+  {
+    uint64_t block_height;
+    std::vector<std::shared_ptr<const supernode_tier_array>> history; //decoded tiers from the oldest block to the latest one
+  };
 
   /// Constructors
   BlockchainBasedList(const std::string& file_name, uint64_t first_block_number);
+  ~BlockchainBasedList();
 
   /// List of tiers
   const supernode_tier_array& tiers(size_t depth = 0) const;
@@ -54,27 +82,81 @@ public:
   /// Remove latest block
   void remove_latest_block();
 
-  /// Save list to file
+  /// Get state of the list at the latest block
+  void get_checkpoint(checkpoint&) const;
+
+  /// Restore state of the list from a checkpoint (the list is compacted to a snapshot at next store)
+  void restore_checkpoint(const checkpoint&);
+
+  /// Save list to file (appends changes to the journal and periodically compacts it to a snapshot)
   void store() const;
 
   /// Is the list requires store
   bool need_store() const { return m_need_store; }
 
+  /// Estimate of the memory held by the list (the mapped snapshot is not counted, decoded tiers shared by entries are counted once)
+  uint64_t get_memory_usage() const;
+
+  /// Select auth sample from tiers of a block; the same tiers and block hash always give the same sample
+  static void select_auth_sample(const supernode_tier_array& tiers, const crypto::hash& block_hash, supernode_array& sample);
+
 private:
+  struct mapped_snapshot;
+
   /// Load list from file
   void load();
 
-  /// Select supernodes from a list
-  void select_supernodes(size_t max_items_count, const supernode_array& src_list, supernode_array& dst_list);
+  /// Map snapshot file and build lazily decoded history from its index
+  void load_snapshot(uint64_t& journal_generation);
+
+  /// Write snapshot file and remap history entries to it
+  void store_snapshot() const;
+
+  /// Get tiers of the history entry decoding them if needed
+  const supernode_tier_array& get_tiers(const history_entry&) const;
+
+  /// Supernode of the previous list which is still valid, with the index of its current stake
+  struct prev_supernode
+  {
+    const supernode* sn;
+    size_t stake_index;
+  };
+
+  /// Scratch buffers of a tier which are reused between blocks
+  struct tier_buffers
+  {
+    std::vector<prev_supernode> prev_supernodes;
+    std::vector<prev_supernode> selected_prev_supernodes;
+    std::vector<size_t> current_supernodes; //stake indexes
+    std::vector<size_t> selected_current_supernodes;
+    std::vector<uint8_t> selected_stakes;   //flags by stake index
+  };
+
+  /// Build tier list from valid supernodes of the previous list and stakes of the tier
+  static void build_tier(const crypto::hash& block_hash, const StakeTransactionStorage::supernode_stake_array& stakes,
+    tier_buffers& buffers, supernode_array& new_supernodes);
+
+  /// Add tiers of the next block to the history
+  void add_tiers(uint64_t block_height, supernode_tier_array&& tiers);
+
+  /// Add record to the list of records which will be appended to the journal at store
+  template <class T> void add_journal_record(T& record);
+
+  /// Apply journal record during the load
+  bool apply_journal_record(const std::string& blob);
 
 private:
   std::string m_storage_file_name;
-  list_history m_history;
+  mutable history_buffer m_history; //entries are remapped to the new snapshot at store
   uint64_t m_block_height;
   size_t m_history_depth;
-  std::mt19937_64 m_rng;
+  std::vector<tier_buffers> m_tier_buffers;
   uint64_t m_first_block_number;
+  mutable std::unique_ptr<mapped_snapshot> m_snapshot; //mapped snapshot file for lazily decoded history entries
+  mutable StorageJournal m_journal;
+  mutable StorageJournal::record_list m_journal_records; //records which have not been written to the journal yet
   mutable bool m_need_store;
+  mutable bool m_need_snapshot; //journal can't describe changes since the last snapshot
 };
 
 }
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "misc_log_ex.h"
+#include "common/threadpool.h"
+#include "blockchain_snapshot.h"
+#include "storage_journal.h"
+#include "serialization/binary_utils.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "snapshot"
+
+using namespace cryptonote;
+
+namespace
+{
+
+const uint32_t SNAPSHOT_VERSION    = 1;
+const size_t   SNAPSHOT_PIECE_SIZE = 64 * 1024 * 1024; //files are hashed in pieces of this size
+
+}
+
+const char* cryptonote::SNAPSHOT_MANIFEST_FILE_NAME = "snapshot.manifest";
+
+crypto::hash cryptonote::get_snapshot_file_hash(const std::string& file_name)
+{
+  const uint64_t size = boost::filesystem::file_size(file_name);
+
+  std::vector<crypto::hash> piece_hashes((size + SNAPSHOT_PIECE_SIZE - 1) / SNAPSHOT_PIECE_SIZE, crypto::null_hash);
+
+  if (size)
+  {
+    boost::interprocess::file_mapping file(file_name.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+
+    const char* data = static_cast<const char*>(region.get_address());
+
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+
+    for (size_t i=0; i<piece_hashes.size(); i++)
+    {
+      tpool.submit(&waiter, [&, i]() {
+        const uint64_t offset = i * SNAPSHOT_PIECE_SIZE;
+        crypto::cn_fast_hash(data + offset, std::min<uint64_t>(SNAPSHOT_PIECE_SIZE, size - offset), piece_hashes[i]);
+      }, true);
+    }
+
+    waiter.wait(&tpool);
+  }
+
+  crypto::hash result;
+  crypto::cn_fast_hash(piece_hashes.data(), piece_hashes.size() * sizeof(crypto::hash), result);
+
+  return result;
+}
+
+void cryptonote::write_snapshot_manifest(const std::string& folder, network_type nettype, uint64_t height, const crypto::hash& top_hash)
+{
+  snapshot_manifest manifest;
+
+  manifest.version  = SNAPSHOT_VERSION;
+  manifest.nettype  = nettype;
+  manifest.height   = height;
+  manifest.top_hash = top_hash;
+
+  const boost::filesystem::path root(folder);
+
+  std::string prefix = root.generic_string();
+
+  if (prefix.empty() || prefix.back() != '/')
+    prefix += '/';
+
+  for (boost::filesystem::recursive_directory_iterator it(root), end; it != end; ++it)
+  {
+    if (!boost::filesystem::is_regular_file(it->status()))
+      continue;
+
+    const std::string name = it->path().filename().string();
+
+    if (name == SNAPSHOT_MANIFEST_FILE_NAME || name == CRYPTONOTE_BLOCKCHAINDATA_LOCK_FILENAME)
+      continue;
+
+    snapshot_file file;
+
+    file.path = it->path().generic_string().substr(prefix.size());
+    file.size = boost::filesystem::file_size(it->path());
+    file.hash = get_snapshot_file_hash(it->path().string());
+
+    MINFO("Snapshot file " << file.path << ": " << file.size << " bytes, hash " << file.hash);
+
+    manifest.files.push_back(std::move(file));
+  }
+
+  std::sort(manifest.files.begin(), manifest.files.end(), [](const snapshot_file& a, const snapshot_file& b) { return a.path < b.path; });
+
+  std::string blob;
+
+  if (!::serialization::dump_binary(manifest, blob))
+    throw std::runtime_error("internal error: failed to serialize snapshot manifest");
+
+  store_file_atomically((root / SNAPSHOT_MANIFEST_FILE_NAME).string(), [&](std::ostream& ostr) {
+    return !!ostr.write(blob.data(), blob.size());
+  });
+}
+
+snapshot_manifest cryptonote::load_snapshot_manifest(const std::string& folder, network_type nettype)
+{
+  const boost::filesystem::path root(folder);
+  const std::string manifest_file_name = (root / SNAPSHOT_MANIFEST_FILE_NAME).string();
+
+  std::ifstream istr(manifest_file_name, std::ios_base::binary | std::ios_base::in);
+  std::string blob((std::istreambuf_iterator<char>(istr)), std::istreambuf_iterator<char>());
+
+  snapshot_manifest manifest;
+
+  if (!istr.good() && !istr.eof())
+    throw std::runtime_error("Failed to read snapshot manifest '" + manifest_file_name + "'");
+
+  if (!::serialization::parse_binary(blob, manifest))
+    throw std::runtime_error("Failed to parse snapshot manifest '" + manifest_file_name + "'");
+
+  if (manifest.version != SNAPSHOT_VERSION)
+    throw std::runtime_error("Unsupported snapshot version " + std::to_string(manifest.version));
+
+  if (manifest.nettype != nettype)
+    throw std::runtime_error("Snapshot is made for another network");
+
+  for (const snapshot_file& file : manifest.files)
+  {
+    const boost::filesystem::path path = root / file.path;
+
+    if (file.path.empty() || file.path.find("..") != std::string::npos || boost::filesystem::path(file.path).is_absolute())
+      throw std::runtime_error("Invalid snapshot file path '" + file.path + "'");
+
+    if (!boost::filesystem::is_regular_file(path) || boost::filesystem::file_size(path) != file.size)
+      throw std::runtime_error("Snapshot file '" + path.string() + "' is missing or has unexpected size");
+
+    if (get_snapshot_file_hash(path.string()) != file.hash)
+      throw std::runtime_error("Snapshot file '" + path.string() + "' is corrupted");
+  }
+
+  MINFO("Snapshot at height " << manifest.height << " with " << manifest.files.size() << " file(s) is intact");
+
+  return manifest;
+}
+
+std::vector<std::string> cryptonote::install_snapshot(const std::string& folder, const snapshot_manifest& manifest, const std::string& data_folder)
+{
+  std::vector<std::string> installed_files;
+
+  try
+  {
+    for (const snapshot_file& file : manifest.files)
+    {
+      const boost::filesystem::path source = boost::filesystem::path(folder) / file.path,
+                                    target = boost::filesystem::path(data_folder) / file.path;
+
+      MINFO("Installing snapshot file " << target.string());
+
+      boost::filesystem::create_directories(target.parent_path());
+      installed_files.push_back(target.string());
+      boost::filesystem::copy_file(source, target, boost::filesystem::copy_option::overwrite_if_exists);
+    }
+  }
+  catch (...)
+  {
+      //don't leave a partially installed snapshot
+
+    for (const std::string& file : installed_files)
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove(file, ec);
+    }
+
+    throw;
+  }
+
+  return installed_files;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cryptonote_config.h>
+#include <string>
+#include <vector>
+
+#include "crypto/hash.h"
+#include "serialization/crypto.h"
+#include "serialization/string.h"
+#include "serialization/vector.h"
+
+namespace cryptonote
+{
+
+/// File of a blockchain snapshot; the path is relative to the snapshot folder and mirrors the data folder layout
+struct snapshot_file
+{
+  std::string path;
+  uint64_t size;
+  crypto::hash hash;
+
+  BEGIN_SERIALIZE_OBJECT()
+    FIELD(path)
+    VARINT_FIELD(size)
+    FIELD(hash)
+  END_SERIALIZE()
+};
+
+/// Manifest of a blockchain snapshot: a copy of the blockchain db and of the stake processing storages
+/// at a height within the compiled-in block hashes, which the loading daemon verifies the blocks against
+struct snapshot_manifest
+{
+  uint32_t version;
+  uint8_t nettype;
+  uint64_t height;
+  crypto::hash top_hash;
+  std::vector<snapshot_file> files;
+
+  snapshot_manifest() : version(), nettype(), height(), top_hash(crypto::null_hash) {}
+
+  BEGIN_SERIALIZE_OBJECT()
+    VARINT_FIELD(version)
+    FIELD(nettype)
+    VARINT_FIELD(height)
+    FIELD(top_hash)
+    FIELD(files)
+  END_SERIALIZE()
+};
+
+extern const char* SNAPSHOT_MANIFEST_FILE_NAME;
+
+/// Hash of a file computed over fixed size pieces on the thread pool (the file is memory-mapped)
+crypto::hash get_snapshot_file_hash(const std::string& file_name);
+
+/// Write the manifest of all files in the snapshot folder
+void write_snapshot_manifest(const std::string& folder, network_type nettype, uint64_t height, const crypto::hash& top_hash);
+
+/// Load the manifest of a snapshot and check the sizes and hashes of its files (throws on error)
+snapshot_manifest load_snapshot_manifest(const std::string& folder, network_type nettype);
+
+/// Copy files of a checked snapshot into the data folder; returns paths of the installed files
+std::vector<std::string> install_snapshot(const std::string& folder, const snapshot_manifest& manifest, const std::string& data_folder);
+
+}
@@ -0,0 +1,123 @@
+#include "misc_log_ex.h"
+#include "ringct/rctSigs.h"
+#include "bulletproof_batch_verifier.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "txpool"
+
+using namespace cryptonote;
+
+bulletproof_batch_verifier::bulletproof_batch_verifier(uint64_t window_millis, size_t max_batch_size)
+  : m_window_millis(window_millis)
+  , m_max_batch_size(max_batch_size)
+  , m_pending_size(0)
+  , m_collecting(false)
+{
+}
+
+void bulletproof_batch_verifier::verify_range(const std::vector<const rct::rctSig*>& rvs, size_t begin, size_t end, std::vector<uint8_t>& results)
+{
+  if (begin == end)
+    return;
+
+  bool valid;
+
+  if (begin == 0 && end == rvs.size())
+    valid = rct::verRctSemanticsSimple(rvs);
+  else
+    valid = rct::verRctSemanticsSimple(std::vector<const rct::rctSig*>(rvs.begin() + begin, rvs.begin() + end));
+
+  if (valid || end - begin == 1)
+  {
+    std::fill(results.begin() + begin, results.begin() + end, valid ? 1 : 0);
+    return;
+  }
+
+  const size_t middle = begin + (end - begin) / 2;
+
+  verify_range(rvs, begin, middle, results);
+  verify_range(rvs, middle, end, results);
+}
+
+void bulletproof_batch_verifier::verify_batch(const std::vector<request*>& batch)
+{
+  std::vector<const rct::rctSig*> rvs;
+
+  for (const request* r : batch)
+    rvs.insert(rvs.end(), r->rvs->begin(), r->rvs->end());
+
+  std::vector<uint8_t> results(rvs.size(), 0);
+
+  try
+  {
+    verify_range(rvs, 0, rvs.size(), results);
+  }
+  catch (const std::exception& e)
+  {
+    MERROR("Exception in bulletproof batch verification: " << e.what());
+  }
+
+  MDEBUG("Verified bulletproofs of " << rvs.size() << " transaction(s) from " << batch.size() << " caller(s)");
+
+  size_t offset = 0;
+
+  for (request* r : batch)
+  {
+    r->results->assign(results.begin() + offset, results.begin() + offset + r->rvs->size());
+    offset += r->rvs->size();
+  }
+}
+
+void bulletproof_batch_verifier::verify(const std::vector<const rct::rctSig*>& rvs, std::vector<uint8_t>& results, bool join_window)
+{
+  results.assign(rvs.size(), 0);
+
+  if (rvs.empty())
+    return;
+
+  if (!join_window || !m_window_millis || rvs.size() >= m_max_batch_size)
+  {
+    verify_range(rvs, 0, rvs.size(), results);
+    return;
+  }
+
+  request req{&rvs, &results, false};
+
+  boost::unique_lock<boost::mutex> lock(m_lock);
+
+  m_pending.push_back(&req);
+  m_pending_size += rvs.size();
+
+  if (m_collecting)
+  {
+      //another caller collects the batch, wake it up if the batch is full and wait for the results
+
+    if (m_pending_size >= m_max_batch_size)
+      m_cond.notify_all();
+
+    m_cond.wait(lock, [&req]() { return req.done; });
+    return;
+  }
+
+  m_collecting = true;
+
+  m_cond.wait_for(lock, boost::chrono::milliseconds(m_window_millis), [this]() { return m_pending_size >= m_max_batch_size; });
+
+  std::vector<request*> batch;
+  batch.swap(m_pending);
+  m_pending_size = 0;
+  m_collecting = false;
+
+    //the next caller starts collecting a new batch while this one is verified
+
+  lock.unlock();
+
+  verify_batch(batch);
+
+  lock.lock();
+
+  for (request* r : batch)
+    r->done = true;
+
+  m_cond.notify_all();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "ringct/rctTypes.h"
+
+namespace cryptonote
+{
+
+/// Semantics checks of bulletproof rct signatures of pool transactions. Signatures of concurrent callers arriving
+/// within a short admission window are checked as one batch (one bulletproof multiexp); a failed batch is
+/// bisected to find the invalid signatures
+class bulletproof_batch_verifier
+{
+public:
+  /// Batches are closed window_millis after their first signature arrived or once max_batch_size signatures are pending
+  bulletproof_batch_verifier(uint64_t window_millis, size_t max_batch_size);
+
+  /// Check semantics of rct signatures; results[i] is set to 1 if rvs[i] is valid and 0 otherwise.
+  /// If join_window is set, waits for signatures of other callers, otherwise checks rvs alone
+  void verify(const std::vector<const rct::rctSig*>& rvs, std::vector<uint8_t>& results, bool join_window);
+
+  /// Check semantics of rvs[begin, end) as one batch, bisecting it on failure
+  static void verify_range(const std::vector<const rct::rctSig*>& rvs, size_t begin, size_t end, std::vector<uint8_t>& results);
+
+private:
+  struct request
+  {
+    const std::vector<const rct::rctSig*>* rvs;
+    std::vector<uint8_t>* results;
+    bool done;
+  };
+
+  void verify_batch(const std::vector<request*>& batch);
+
+  uint64_t m_window_millis;
+  size_t m_max_batch_size;
+  boost::mutex m_lock;
+  boost::condition_variable m_cond;
+  std::vector<request*> m_pending;
+  size_t m_pending_size;
+  bool m_collecting;
+};
+
+}
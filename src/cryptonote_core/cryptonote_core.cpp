@@ -29,7 +29,9 @@
 //
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <sstream>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "include_base_utils.h"
 #include "string_tools.h"
@@ -51,6 +53,7 @@ using namespace epee;
 #include "file_io_utils.h"
 #include <csignal>
 #include "checkpoints/checkpoints.h"
+#include "blockchain_snapshot.h"
 #include "ringct/rctTypes.h"
 #include "blockchain_db/blockchain_db.h"
 #include "ringct/rctSigs.h"
@@ -66,6 +69,39 @@ DISABLE_VS_WARNINGS(4355)
 
 #define BAD_SEMANTICS_TXES_MAX_SIZE 100
 
+// smallest batch of key images checked on a threadpool thread of its own
+#define KEY_IMAGES_PER_THREAD_MIN 512
+
+namespace
+{
+  // reads prep_blocks_threads=N from a "key=value" profile, '#' lines are comments
+  bool load_prep_blocks_threads_profile(const std::string &path, uint64_t &threads)
+  {
+    std::string contents;
+    if (!epee::file_io_utils::load_file_to_string(path, contents))
+      return false;
+
+    std::istringstream in(contents);
+    std::string line;
+    while (std::getline(in, line))
+    {
+      static const std::string key = "prep_blocks_threads=";
+      if (line.compare(0, key.size(), key) != 0)
+        continue;
+      try
+      {
+        threads = boost::lexical_cast<uint64_t>(boost::algorithm::trim_copy(line.substr(key.size())));
+        return true;
+      }
+      catch (const boost::bad_lexical_cast &)
+      {
+        return false;
+      }
+    }
+    return false;
+  }
+}
+
 namespace cryptonote
 {
   const command_line::arg_descriptor<bool, false> arg_testnet_on  = {
@@ -105,6 +141,10 @@ namespace cryptonote
     "offline"
   , "Do not listen for peers, nor connect to any"
   };
+  const command_line::arg_descriptor<bool> arg_rpc_replica = {
+    "rpc-replica"
+  , "Open the blockchain of another daemon using the same data directory read only and serve restricted RPC from it; implies --offline"
+  };
   const command_line::arg_descriptor<bool> arg_disable_dns_checkpoints = {
     "disable-dns-checkpoints"
   , "Do not retrieve checkpoints from DNS"
@@ -136,8 +176,13 @@ namespace cryptonote
   };
   static const command_line::arg_descriptor<uint64_t> arg_prep_blocks_threads = {
     "prep-blocks-threads"
-  , "Max number of threads to use when preparing block hashes in groups."
-  , 4
+  , "Max number of threads to use when preparing block hashes in groups, 0 to use all."
+  , 0
+  };
+  static const command_line::arg_descriptor<std::string> arg_prep_blocks_threads_profile = {
+    "prep-blocks-threads-profile"
+  , "Take --prep-blocks-threads from a tuning profile written by performance_tests --cn-slow-hash-tuning, unless it's given explicitly."
+  , ""
   };
   static const command_line::arg_descriptor<uint64_t> arg_show_time_stats  = {
     "show-time-stats"
@@ -169,11 +214,46 @@ namespace cryptonote
   , "Set maximum txpool weight in bytes."
   , DEFAULT_TXPOOL_MAX_WEIGHT
   };
+  static const command_line::arg_descriptor<size_t> arg_rta_block_weight_percent  = {
+    "rta-block-weight-percent"
+  , "Percent of median block weight reserved for RTA transactions in block templates."
+  , DEFAULT_RTA_BLOCK_WEIGHT_PERCENT
+  };
+  static const command_line::arg_descriptor<size_t> arg_txpool_rta_share_percent  = {
+    "txpool-rta-share-percent"
+  , "Percent of max txpool weight kept for RTA transactions when the pool is full."
+  , DEFAULT_TXPOOL_RTA_SHARE_PERCENT
+  };
+  static const command_line::arg_descriptor<size_t> arg_txpool_stake_share_percent  = {
+    "txpool-stake-share-percent"
+  , "Percent of max txpool weight kept for stake transactions when the pool is full."
+  , DEFAULT_TXPOOL_STAKE_SHARE_PERCENT
+  };
+  static const command_line::arg_descriptor<bool> arg_txpool_in_memory  = {
+    "txpool-in-memory"
+  , "Keep txpool transactions in memory instead of the database, they are lost at restart."
+  , false
+  };
+  static const command_line::arg_descriptor<bool> arg_txpool_snapshot  = {
+    "txpool-snapshot"
+  , "Periodically store the in-memory txpool in the database, and at exit."
+  , false
+  };
+  static const command_line::arg_descriptor<std::string> arg_bootstrap_snapshot = {
+    "bootstrap-snapshot"
+  , "Initialize an empty blockchain from a snapshot folder made by graft-blockchain-snapshot, then sync the blocks above it."
+  , ""
+  };
   static const command_line::arg_descriptor<std::string> arg_block_notify = {
     "block-notify"
   , "Run a program for each new block, '%s' will be replaced by the block hash"
   , ""
   };
+  static const command_line::arg_descriptor<bool> arg_prune_blockchain = {
+    "prune-blockchain"
+  , "Prune the blockchain: keep the signatures and range proofs of one in " BOOST_PP_STRINGIZE(CRYPTONOTE_PRUNING_NUM_STRIPES) " old blocks only. This can't be undone"
+  , false
+  };
   static const command_line::arg_descriptor<bool> arg_disable_stake_tx_processing = {
     "disable-stake-tx-processing"
   , "Disable stake transaction processing."
@@ -185,6 +265,7 @@ namespace cryptonote
               m_mempool(m_blockchain_storage),
               m_blockchain_storage(m_mempool),
               m_graft_stake_transaction_processor(m_blockchain_storage),
+              m_bulletproof_batch_verifier(CRYPTONOTE_MEMPOOL_BULLETPROOF_BATCH_WINDOW, CRYPTONOTE_MEMPOOL_BULLETPROOF_BATCH_MAX_TXS),
               m_miner(this, &m_blockchain_storage),
               m_miner_address(boost::value_initialized<account_public_address>()),
               m_starter_message_showed(false),
@@ -195,7 +276,9 @@ namespace cryptonote
               m_disable_dns_checkpoints(false),
               m_update_download(0),
               m_nettype(UNDEFINED),
-              m_update_available(false)
+              m_update_available(false),
+              m_offline(false),
+              m_replica(false)
   {
     m_checkpoints_updating.clear();
     set_cryptonote_protocol(pprotocol);
@@ -230,13 +313,41 @@ namespace cryptonote
     if (m_checkpoints_updating.test_and_set()) return true;
 
     bool res = true;
-    if (time(NULL) - m_last_dns_checkpoints_update >= 3600)
+    const std::string dns_checkpoints_path = m_config_folder + "/" + CRYPTONOTE_DNS_CHECKPOINTS_FILENAME;
+    if (m_last_dns_checkpoints_update == 0)
     {
-      res = m_blockchain_storage.update_checkpoints(m_checkpoints_path, true);
+      // checkpoints fetched by a previous run stand in until the lookup is done
+      checkpoints cached_points;
+      if (cached_points.load_checkpoints_from_json(dns_checkpoints_path) && !cached_points.get_points().empty())
+        res = m_blockchain_storage.apply_dns_checkpoints(cached_points);
+    }
+
+    if (res && m_dns_checkpoints_lookup && m_dns_checkpoints_lookup->done.load(std::memory_order_acquire))
+    {
+      res = m_blockchain_storage.apply_dns_checkpoints(m_dns_checkpoints_lookup->points);
+      if (res && !m_replica && !m_dns_checkpoints_lookup->points.get_points().empty())
+        m_dns_checkpoints_lookup->points.save_checkpoints_to_json(dns_checkpoints_path);
+      m_dns_checkpoints_lookup.reset();
+    }
+
+    if (res && time(NULL) - m_last_dns_checkpoints_update >= 3600)
+    {
+      res = m_blockchain_storage.update_checkpoints(m_checkpoints_path, false);
+      if (!m_dns_checkpoints_lookup && !m_offline)
+      {
+        // DNS can take seconds to answer, so it is never waited for here
+        std::shared_ptr<dns_checkpoints_lookup> lookup = std::make_shared<dns_checkpoints_lookup>();
+        const network_type nettype = m_nettype;
+        m_dns_checkpoints_lookup = lookup;
+        boost::thread([lookup, nettype]() {
+          lookup->points.load_checkpoints_from_dns(nettype);
+          lookup->done.store(true, std::memory_order_release);
+        }).detach();
+      }
       m_last_dns_checkpoints_update = time(NULL);
       m_last_json_checkpoints_update = time(NULL);
     }
-    else if (time(NULL) - m_last_json_checkpoints_update >= 600)
+    else if (res && time(NULL) - m_last_json_checkpoints_update >= 600)
     {
       res = m_blockchain_storage.update_checkpoints(m_checkpoints_path, false);
       m_last_json_checkpoints_update = time(NULL);
@@ -279,6 +390,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_fixed_difficulty);
     command_line::add_arg(desc, arg_dns_checkpoints);
     command_line::add_arg(desc, arg_prep_blocks_threads);
+    command_line::add_arg(desc, arg_prep_blocks_threads_profile);
     command_line::add_arg(desc, arg_fast_block_sync);
     command_line::add_arg(desc, arg_show_time_stats);
     command_line::add_arg(desc, arg_block_sync_size);
@@ -287,9 +399,17 @@ namespace cryptonote
     command_line::add_arg(desc, arg_no_fluffy_blocks);
     command_line::add_arg(desc, arg_test_dbg_lock_sleep);
     command_line::add_arg(desc, arg_offline);
+    command_line::add_arg(desc, arg_rpc_replica);
     command_line::add_arg(desc, arg_disable_dns_checkpoints);
     command_line::add_arg(desc, arg_max_txpool_weight);
+    command_line::add_arg(desc, arg_rta_block_weight_percent);
+    command_line::add_arg(desc, arg_txpool_rta_share_percent);
+    command_line::add_arg(desc, arg_txpool_stake_share_percent);
+    command_line::add_arg(desc, arg_txpool_in_memory);
+    command_line::add_arg(desc, arg_txpool_snapshot);
+    command_line::add_arg(desc, arg_bootstrap_snapshot);
     command_line::add_arg(desc, arg_block_notify);
+    command_line::add_arg(desc, arg_prune_blockchain);
     command_line::add_arg(desc, arg_disable_stake_tx_processing);
 
     miner::init_options(desc);
@@ -330,7 +450,8 @@ namespace cryptonote
     set_enforce_dns_checkpoints(command_line::get_arg(vm, arg_dns_checkpoints));
     test_drop_download_height(command_line::get_arg(vm, arg_test_drop_download_height));
     m_fluffy_blocks_enabled = !get_arg(vm, arg_no_fluffy_blocks);
-    m_offline = get_arg(vm, arg_offline);
+    m_replica = get_arg(vm, arg_rpc_replica);
+    m_offline = get_arg(vm, arg_offline) || m_replica;
     m_disable_dns_checkpoints = get_arg(vm, arg_disable_dns_checkpoints);
     if (!command_line::is_arg_defaulted(vm, arg_fluffy_blocks))
       MWARNING(arg_fluffy_blocks.name << " is obsolete, it is now default");
@@ -422,10 +543,25 @@ namespace cryptonote
     std::string db_type = command_line::get_arg(vm, cryptonote::arg_db_type);
     std::string db_sync_mode = command_line::get_arg(vm, cryptonote::arg_db_sync_mode);
     bool db_salvage = command_line::get_arg(vm, cryptonote::arg_db_salvage) != 0;
+    bool db_compress_txs = command_line::get_arg(vm, cryptonote::arg_db_compress_txs) != 0;
     bool fast_sync = command_line::get_arg(vm, arg_fast_block_sync) != 0;
     uint64_t blocks_threads = command_line::get_arg(vm, arg_prep_blocks_threads);
+    const std::string blocks_threads_profile = command_line::get_arg(vm, arg_prep_blocks_threads_profile);
+    if (!blocks_threads_profile.empty() && command_line::is_arg_defaulted(vm, arg_prep_blocks_threads))
+    {
+      if (!load_prep_blocks_threads_profile(blocks_threads_profile, blocks_threads))
+        MWARNING("Failed to load prep blocks threads from " << blocks_threads_profile << ", using all threads");
+      else
+        MINFO("Using " << blocks_threads << " prep blocks threads from " << blocks_threads_profile);
+    }
     std::string check_updates_string = command_line::get_arg(vm, arg_check_updates);
     size_t max_txpool_weight = command_line::get_arg(vm, arg_max_txpool_weight);
+    size_t rta_block_weight_percent = command_line::get_arg(vm, arg_rta_block_weight_percent);
+    size_t txpool_rta_share_percent = command_line::get_arg(vm, arg_txpool_rta_share_percent);
+    size_t txpool_stake_share_percent = command_line::get_arg(vm, arg_txpool_stake_share_percent);
+    bool txpool_in_memory = command_line::get_arg(vm, arg_txpool_in_memory);
+    bool txpool_snapshot = command_line::get_arg(vm, arg_txpool_snapshot);
+    std::string bootstrap_snapshot = command_line::get_arg(vm, arg_bootstrap_snapshot);
 
     boost::filesystem::path folder(m_config_folder);
     if (m_nettype == FAKECHAIN)
@@ -451,8 +587,12 @@ namespace cryptonote
     // folder might not be a directory, etc, etc
     catch (...) { }
 
-    MGINFO("Initialize stake transaction processor");
-    m_graft_stake_transaction_processor.init_storages(folder.string());
+    // the stake processor storages belong to the daemon writing the blockchain
+    if (!m_replica)
+    {
+      MGINFO("Initialize stake transaction processor");
+      m_graft_stake_transaction_processor.init_storages(folder.string());
+    }
 
     std::unique_ptr<BlockchainDB> db(new_db(db_type));
 
@@ -470,8 +610,9 @@ namespace cryptonote
     blockchain_db_sync_mode sync_mode = db_defaultsync;
     bool sync_on_blocks = true;
     uint64_t sync_threshold = 1;
+    uint64_t group_commit_millis = 100; // default durability delay of group syncs
 
-    if (m_nettype == FAKECHAIN)
+    if (m_nettype == FAKECHAIN && !m_replica)
     {
       // reset the db by removing the database file before opening it
       if (!db->remove_data_file(filename))
@@ -481,6 +622,30 @@ namespace cryptonote
       }
     }
 
+    snapshot_manifest snapshot;
+    std::vector<std::string> snapshot_files;
+    if (!bootstrap_snapshot.empty() && !m_replica)
+    {
+      if (boost::filesystem::exists(folder) && !boost::filesystem::is_empty(folder))
+      {
+        MWARNING("The blockchain in " << filename << " already exists, ignoring the snapshot");
+      }
+      else
+      {
+        try
+        {
+          MGINFO("Loading blockchain snapshot from " << bootstrap_snapshot << " ...");
+          snapshot = load_snapshot_manifest(bootstrap_snapshot, m_nettype);
+          snapshot_files = install_snapshot(bootstrap_snapshot, snapshot, folder.parent_path().string());
+        }
+        catch (const std::exception& e)
+        {
+          MERROR("Failed to load snapshot: " << e.what());
+          return false;
+        }
+      }
+    }
+
     try
     {
       uint64_t db_flags = 0;
@@ -532,6 +697,8 @@ namespace cryptonote
           sync_mode = db_sync_mode_is_default ? db_defaultsync : db_sync;
         else if(options[1] == "async")
           sync_mode = db_sync_mode_is_default ? db_defaultsync : db_async;
+        else if(options[1] == "group")
+          sync_mode = db_group;
       }
 
       if(options.size() >= 3 && !safemode)
@@ -548,6 +715,10 @@ namespace cryptonote
           sync_on_blocks = false;
           sync_threshold = threshold;
         }
+        else if (!strcmp(endptr, "ms") && sync_mode == db_group && threshold)
+        {
+          group_commit_millis = threshold;
+        }
         else
         {
           LOG_ERROR("Invalid db sync mode: " << options[2]);
@@ -558,9 +729,21 @@ namespace cryptonote
       if (db_salvage)
         db_flags |= DBF_SALVAGE;
 
+      if (db_compress_txs)
+        db_flags |= DBF_COMPRESS_TXS;
+
+      if (m_replica)
+      {
+        MGINFO("Opening the blockchain read only as an RPC replica");
+        db_flags |= DBF_RDONLY;
+      }
+
       db->open(filename, db_flags);
       if(!db->m_open)
         return false;
+
+      if (sync_mode == db_group)
+        db->set_group_commit(group_commit_millis);
     }
     catch (const DB_ERROR& e)
     {
@@ -588,13 +771,47 @@ namespace cryptonote
     const difficulty_type fixed_difficulty = command_line::get_arg(vm, arg_fixed_difficulty);
     r = m_blockchain_storage.init(db.release(), m_nettype, m_offline, regtest ? &regtest_test_options : test_options, fixed_difficulty);
 
+    if (r && !snapshot_files.empty())
+    {
+      if (!m_blockchain_storage.verify_snapshot(snapshot.height, snapshot.top_hash))
+      {
+        MERROR("Blockchain snapshot verification failed, removing the snapshot files");
+        for (const std::string& file : snapshot_files)
+        {
+          boost::system::error_code ec;
+          boost::filesystem::remove(file, ec);
+        }
+        return false;
+      }
+      MGINFO("Blockchain snapshot at height " << snapshot.height << " verified");
+    }
+
+    if (r && (txpool_in_memory || m_replica))
+      m_blockchain_storage.set_txpool_in_memory(txpool_snapshot);
+
+    // a pruned blockchain keeps being pruned, the option only starts it
+    if (r && !m_replica && get_arg(vm, arg_prune_blockchain))
+      r = m_blockchain_storage.prune_blockchain();
+
     m_mempool.set_stake_transaction_processor(&m_graft_stake_transaction_processor);
+    m_mempool.set_rta_block_weight_percent(rta_block_weight_percent);
+    m_mempool.set_txpool_class_shares(txpool_rta_share_percent, txpool_stake_share_percent);
 
     r = m_mempool.init(max_txpool_weight);
 
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
 
-    m_graft_stake_transaction_processor.synchronize();
+    // stakes are synchronized after startup (see synchronize_stakes), tools that need them right away call it
+    // after that every new block is processed as it's committed, synchronize stays the catch-up for gaps
+    if (!m_replica)
+    {
+      m_blockchain_storage.set_block_committed_handler([this](uint64_t height, const crypto::hash& id, const block& b, const std::vector<transaction>& txs) {
+        m_graft_stake_transaction_processor.process_committed_block(height, id, b, txs);
+      });
+      m_blockchain_storage.set_block_popped_handler([this](uint64_t new_height) {
+        m_graft_stake_transaction_processor.process_popped_block(new_height);
+      });
+    }
 
     // now that we have a valid m_blockchain_storage, we can clean out any
     // transactions in the pool that do not conform to the current fork
@@ -773,6 +990,7 @@ namespace cryptonote
     }
 
     std::vector<const rct::rctSig*> rvv;
+    std::vector<size_t> rvv_tx_info;
     for (size_t n = 0; n < tx_info.size(); ++n)
     {
       if (!check_tx_semantic(*tx_info[n].tx, keeped_by_block))
@@ -824,6 +1042,7 @@ namespace cryptonote
             break;
           }
           rvv.push_back(&rv); // delayed batch verification
+          rvv_tx_info.push_back(n);
           break;
         default:
           MERROR_VER("Unknown rct type: " << rv.type);
@@ -833,23 +1052,21 @@ namespace cryptonote
           break;
       }
     }
-    if (!rvv.empty() && !rct::verRctSemanticsSimple(rvv))
+    if (!rvv.empty())
     {
-      LOG_PRINT_L1("One transaction among this group has bad semantics, verifying one at a time");
-      ret = false;
-      const bool assumed_bad = rvv.size() == 1; // if there's only one tx, it must be the bad one
-      for (size_t n = 0; n < tx_info.size(); ++n)
+      // relayed txs join the bulletproof batches of other connections, txs of blocks are checked right away
+      std::vector<uint8_t> rvv_results;
+      m_bulletproof_batch_verifier.verify(rvv, rvv_results, !keeped_by_block);
+      for (size_t i = 0; i < rvv.size(); ++i)
       {
-        if (!tx_info[n].result)
-          continue;
-        if (tx_info[n].tx->rct_signatures.type != rct::RCTTypeBulletproof)
+        if (rvv_results[i])
           continue;
-        if (assumed_bad || !rct::verRctSemanticsSimple(tx_info[n].tx->rct_signatures))
-        {
-          set_semantics_failed(tx_info[n].tx_hash);
-          tx_info[n].tvc.m_verifivation_failed = true;
-          tx_info[n].result = false;
-        }
+        const size_t n = rvv_tx_info[i];
+        MERROR_VER("rct signature semantics check failed for tx " << tx_info[n].tx_hash);
+        set_semantics_failed(tx_info[n].tx_hash);
+        tx_info[n].tvc.m_verifivation_failed = true;
+        tx_info[n].result = false;
+        ret = false;
       }
     }
 
@@ -859,7 +1076,7 @@ namespace cryptonote
   bool core::handle_incoming_txs(const std::vector<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
   {
     TRY_ENTRY();
-    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
+    boost::unique_lock<epee::critical_section> incoming_tx_lock(m_incoming_tx_lock);
 
     struct result { bool res; cryptonote::transaction tx; crypto::hash hash; crypto::hash prefix_hash; bool in_txpool; bool in_blockchain; };
     std::vector<result> results(tx_blobs.size());
@@ -922,9 +1139,54 @@ namespace cryptonote
       tx_info.push_back({&results[i].tx, results[i].hash, tvc[i], results[i].res});
     }
     if (!tx_info.empty())
-      handle_incoming_tx_accumulated_batch(tx_info, keeped_by_block);
+    {
+      if (keeped_by_block)
+      {
+        handle_incoming_tx_accumulated_batch(tx_info, keeped_by_block);
+      }
+      else
+      {
+        // let other connections add their txs to the bulletproof batch meanwhile
+        incoming_tx_lock.unlock();
+        handle_incoming_tx_accumulated_batch(tx_info, keeped_by_block);
+        incoming_tx_lock.lock();
+
+        for (size_t i = 0; i < tx_blobs.size(); i++) {
+          if (!results[i].res || already_have[i])
+            continue;
+          if (m_mempool.have_tx(results[i].hash) || m_blockchain_storage.have_tx(results[i].hash))
+          {
+            LOG_PRINT_L2("tx " << results[i].hash << " has been added by another connection");
+            already_have[i] = true;
+          }
+        }
+      }
+    }
+
+    // rta validation and spent key images don't need the pool lock, check them in parallel
+    if (!keeped_by_block)
+    {
+      for (size_t i = 0; i < tx_blobs.size(); i++) {
+        if (!results[i].res || already_have[i])
+          continue;
+        tpool.submit(&waiter, [&, i] {
+          try
+          {
+            results[i].res = m_mempool.precheck_tx(results[i].tx, results[i].hash, tvc[i]);
+          }
+          catch (const std::exception &e)
+          {
+            MERROR_VER("Exception in precheck_tx: " << e.what());
+            results[i].res = false;
+          }
+        });
+      }
+      waiter.wait(&tpool);
+    }
 
     bool ok = true;
+    std::vector<tx_memory_pool::tx_batch_entry> batch;
+    batch.reserve(tx_blobs.size());
     it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
       if (already_have[i])
@@ -935,15 +1197,23 @@ namespace cryptonote
         continue;
       }
 
-      const size_t weight = get_transaction_weight(results[i].tx, it->size());
-      ok &= add_new_tx(results[i].tx, results[i].hash, results[i].prefix_hash, weight, tvc[i], keeped_by_block, relayed, do_not_relay);
-      if(tvc[i].m_verifivation_failed)
-      {MERROR_VER("Transaction verification failed: " << results[i].hash);}
-      else if(tvc[i].m_verifivation_impossible)
-      {MERROR_VER("Transaction verification impossible: " << results[i].hash);}
+      if (keeped_by_block)
+        get_blockchain_storage().on_new_tx_from_block(results[i].tx);
+      batch.push_back({&results[i].tx, results[i].hash, get_transaction_weight(results[i].tx, it->size()), &tvc[i]});
+    }
+
+    // the pool lock is taken once for the whole batch
+    if (!batch.empty())
+      ok &= m_mempool.add_txs(batch, keeped_by_block, relayed, do_not_relay, m_blockchain_storage.get_current_hard_fork_version());
 
-      if(tvc[i].m_added_to_pool)
-        MDEBUG("tx added: " << results[i].hash);
+    for (const tx_memory_pool::tx_batch_entry &entry : batch) {
+      if(entry.tvc->m_verifivation_failed)
+      {MERROR_VER("Transaction verification failed: " << entry.id);}
+      else if(entry.tvc->m_verifivation_impossible)
+      {MERROR_VER("Transaction verification impossible: " << entry.id);}
+
+      if(entry.tvc->m_added_to_pool)
+        MDEBUG("tx added: " << entry.id);
     }
     return ok;
 
@@ -1055,10 +1325,46 @@ namespace cryptonote
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
     spent.clear();
-    for(auto& ki: key_im)
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), key_im.size() / KEY_IMAGES_PER_THREAD_MIN));
+    if (threads == 1)
     {
-      spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
+      for(auto& ki: key_im)
+      {
+        spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
+      }
+      return true;
     }
+
+    // large batches are split over the threadpool, each part checked in a read txn of its own
+    std::vector<char> spent_flags(key_im.size(), 0);
+    std::atomic<bool> failed(false);
+    const size_t per_thread = (key_im.size() + threads - 1) / threads;
+    tools::threadpool::waiter waiter;
+    for (size_t start = 0; start < key_im.size(); start += per_thread)
+    {
+      const size_t end = std::min(start + per_thread, key_im.size());
+      tpool.submit(&waiter, [this, &key_im, &spent_flags, &failed, start, end]() {
+        try
+        {
+          db_rtxn_guard rtxn_guard(m_blockchain_storage.get_db());
+          for (size_t i = start; i < end; ++i)
+            spent_flags[i] = m_blockchain_storage.have_tx_keyimg_as_spent(key_im[i]);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to check key images: " << e.what());
+          failed = true;
+        }
+      }, true);
+    }
+    waiter.wait(&tpool);
+    if (failed)
+      return false;
+
+    spent.reserve(key_im.size());
+    for (char s: spent_flags)
+      spent.push_back(s);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -1069,11 +1375,11 @@ namespace cryptonote
     return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
+  bool core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent, bool include_sensitive_data) const
   {
     spent.clear();
 
-    return m_mempool.check_for_key_images(key_im, spent);
+    return m_mempool.check_for_key_images(key_im, spent, include_sensitive_data);
   }
   //-----------------------------------------------------------------------------------------------
   std::pair<uint64_t, uint64_t> core::get_coinbase_tx_sum(const uint64_t start_offset, const size_t count)
@@ -1218,9 +1524,9 @@ namespace cryptonote
     return m_blockchain_storage.create_block_template(b, adr, diffic, height, expected_reward, ex_nonce);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const
+  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool request_headers) const
   {
-    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp);
+    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp, request_headers);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const
@@ -1346,6 +1652,11 @@ namespace cryptonote
     m_graft_stake_transaction_processor.invoke_update_stakes_handler(true);
   }
   //-----------------------------------------------------------------------------------------------
+  void core::set_stakes_change_handler(const supernode_stakes_update_handler& handler)
+  {
+    m_graft_stake_transaction_processor.set_on_stakes_change_handler(handler);
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::set_update_blockchain_based_list_handler(const blockchain_based_list_update_handler& handler)
   {
     m_graft_stake_transaction_processor.set_on_update_blockchain_based_list_handler(handler);
@@ -1357,12 +1668,47 @@ namespace cryptonote
     m_graft_stake_transaction_processor.invoke_update_blockchain_based_list_handler(true, depth);
   }
   //-----------------------------------------------------------------------------------------------
+  void core::set_blockchain_based_list_change_handler(const blockchain_based_list_update_handler& handler)
+  {
+    m_graft_stake_transaction_processor.set_on_blockchain_based_list_change_handler(handler);
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::synchronize_stakes()
+  {
+    m_graft_stake_transaction_processor.synchronize();
+  }
+  //-----------------------------------------------------------------------------------------------
+  auth_sample_ptr core::get_auth_sample(uint64_t block_height) const
+  {
+    return m_graft_stake_transaction_processor.get_auth_sample(block_height);
+  }
+  //-----------------------------------------------------------------------------------------------
+  supernode_stakes_snapshot_ptr core::get_supernode_stakes_snapshot(uint64_t block_height) const
+  {
+    return m_graft_stake_transaction_processor.get_supernode_stakes_snapshot(block_height);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_supernode_stakes(uint64_t first_block_height, uint64_t count, StakeTransactionProcessor::block_stakes_array& stakes) const
+  {
+    return m_graft_stake_transaction_processor.get_supernode_stakes(first_block_height, count, stakes);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::get_blockchain_based_lists(uint64_t first_block_height, uint64_t count, StakeTransactionProcessor::block_tiers_array& lists) const
+  {
+    return m_graft_stake_transaction_processor.get_blockchain_based_lists(first_block_height, count, lists);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks)
   {
     m_incoming_tx_lock.lock();
     m_blockchain_storage.prepare_handle_incoming_blocks(blocks);
     return true;
   }
+  //-----------------------------------------------------------------------------------------------
+  void core::prefetch_incoming_blocks(const std::vector<block_complete_entry> &blocks, uint64_t height)
+  {
+    m_blockchain_storage.prefetch_block_longhashes(blocks, height);
+  }
 
   //-----------------------------------------------------------------------------------------------
   bool core::cleanup_handle_incoming_blocks(bool force_sync)
@@ -1462,6 +1808,11 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_pool_cookie() const
+  {
+    return m_mempool.cookie();
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_pool_transaction_stats(struct txpool_stats& stats, bool include_sensitive_data) const
   {
     m_mempool.get_transaction_stats(stats, include_sensitive_data);
@@ -1473,6 +1824,11 @@ namespace cryptonote
     return m_mempool.get_transaction(id, tx);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::wait_added_pool_transactions(uint64_t start, std::chrono::milliseconds timeout, std::vector<crypto::hash>& tx_hashes, uint64_t& next) const
+  {
+    return m_mempool.wait_added_transactions(start, timeout, tx_hashes, next);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::pool_has_tx(const crypto::hash &id) const
   {
     return m_mempool.have_tx(id);
@@ -1524,7 +1880,9 @@ namespace cryptonote
     if(!m_starter_message_showed)
     {
       std::string main_message;
-      if (m_offline)
+      if (m_replica)
+        main_message = "The daemon is running as a read-only RPC replica and follows the blocks stored by another daemon.";
+      else if (m_offline)
         main_message = "The daemon is running offline and will not attempt to sync to the Monero network.";
       else
         main_message = "The daemon will start synchronizing with the network. This may take a long time to complete.";
@@ -1540,10 +1898,19 @@ namespace cryptonote
       m_starter_message_showed = true;
     }
 
+    if (m_replica)
+    {
+      // follow the blocks stored by the daemon writing the blockchain
+      m_blockchain_storage.refresh_from_db();
+      return true;
+    }
+
     m_fork_moaner.do_call(boost::bind(&core::check_fork_time, this));
     m_txpool_auto_relayer.do_call(boost::bind(&core::relay_txpool_transactions, this));
+    m_txpool_snapshot_interval.do_call([this]() { m_blockchain_storage.store_txpool_snapshot(); return true; });
     m_check_updates_interval.do_call(boost::bind(&core::check_updates, this));
     m_check_disk_space_interval.do_call(boost::bind(&core::check_disk_space, this));
+    m_blockchain_pruning_interval.do_call(boost::bind(&Blockchain::update_blockchain_pruning, &m_blockchain_storage));
     m_miner.on_idle();
     m_mempool.on_idle();
     m_graft_stake_transaction_processor.synchronize();
@@ -1748,6 +2115,11 @@ namespace cryptonote
     return get_blockchain_storage().prevalidate_block_hashes(height, hashes);
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &ids, const std::vector<blobdata> &hashing_blobs)
+  {
+    return get_blockchain_storage().prevalidate_block_headers(height, ids, hashing_blobs);
+  }
+  //-----------------------------------------------------------------------------------------------
   uint64_t core::get_free_space() const
   {
     boost::filesystem::path path(m_config_folder);
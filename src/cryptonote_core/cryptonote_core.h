@@ -43,6 +43,7 @@
 #include "tx_pool.h"
 #include "blockchain.h"
 #include "stake_transaction_processor.h"
+#include "bulletproof_batch_verifier.h"
 #include "cryptonote_basic/miner.h"
 #include "cryptonote_basic/connection_context.h"
 #include "cryptonote_basic/cryptonote_stat_info.h"
@@ -64,6 +65,7 @@ namespace cryptonote
   extern const command_line::arg_descriptor<bool, false> arg_regtest_on;
   extern const command_line::arg_descriptor<difficulty_type> arg_fixed_difficulty;
   extern const command_line::arg_descriptor<bool> arg_offline;
+  extern const command_line::arg_descriptor<bool> arg_rpc_replica;
 
   /************************************************************************/
   /*                                                                      */
@@ -161,6 +163,13 @@ namespace cryptonote
       */
      bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks);
 
+     /**
+      * @copydoc Blockchain::prefetch_block_longhashes
+      *
+      * @note see Blockchain::prefetch_block_longhashes
+      */
+     void prefetch_incoming_blocks(const std::vector<block_complete_entry> &blocks, uint64_t height);
+
      /**
       * @copydoc Blockchain::cleanup_handle_incoming_blocks
       *
@@ -449,6 +458,13 @@ namespace cryptonote
       */
      bool get_pool_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const;
 
+     /**
+      * @copydoc tx_memory_pool::cookie
+      *
+      * @note see tx_memory_pool::cookie
+      */
+     uint64_t get_pool_cookie() const;
+
      /**
       * @copydoc tx_memory_pool::get_transactions
       * @param include_unrelayed_txes include unrelayed txes in result
@@ -464,6 +480,13 @@ namespace cryptonote
       */
      bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx) const;
 
+     /**
+      * @copydoc tx_memory_pool::wait_added_transactions
+      *
+      * @note see tx_memory_pool::wait_added_transactions
+      */
+     bool wait_added_pool_transactions(uint64_t start, std::chrono::milliseconds timeout, std::vector<crypto::hash>& tx_hashes, uint64_t& next) const;
+
      /**
       * @copydoc tx_memory_pool::get_pool_transactions_and_spent_keys_info
       * @param include_unrelayed_txes include unrelayed txes in result
@@ -508,11 +531,11 @@ namespace cryptonote
      bool get_short_chain_history(std::list<crypto::hash>& ids) const;
 
      /**
-      * @copydoc Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&) const
+      * @copydoc Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&, bool) const
       *
-      * @note see Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&) const
+      * @note see Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&, bool) const
       */
-     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const;
+     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, bool request_headers = false) const;
 
      /**
       * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<cryptonote::blobdata, std::vector<cryptonote::blobdata> > >&, uint64_t&, uint64_t&, size_t) const
@@ -593,6 +616,13 @@ namespace cryptonote
       */
      const Blockchain& get_blockchain_storage()const{return m_blockchain_storage;}
 
+     /**
+      * @brief gets the tx_memory_pool instance
+      *
+      * @return a reference to the tx_memory_pool instance
+      */
+     tx_memory_pool& get_pool(){return m_mempool;}
+
      /**
       * @copydoc tx_memory_pool::print_pool
       *
@@ -667,8 +697,9 @@ namespace cryptonote
       *
       * This function will check if enough time has passed since the last
       * time checkpoints were updated and tell the Blockchain to update
-      * its checkpoints if it is time.  If updating checkpoints fails,
-      * the daemon is told to shut down.
+      * its checkpoints if it is time.  DNS checkpoints are looked up in
+      * the background and applied by a later call once they arrive.  If
+      * updating checkpoints fails, the daemon is told to shut down.
       *
       * @note see Blockchain::update_checkpoints()
       */
@@ -701,10 +732,12 @@ namespace cryptonote
       *
       * plural version of is_key_image_spent()
       *
+      * Large batches are checked on the threadpool.
+      *
       * @param key_im list of key images to check
       * @param spent return-by-reference result for each image checked
       *
-      * @return true
+      * @return true, false if the database could not be read
       */
      bool are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const;
 
@@ -713,10 +746,11 @@ namespace cryptonote
       *
       * @param key_im list of key images to check
       * @param spent return-by-reference result for each image checked
+      * @param include_sensitive_data whether transactions not relayed yet count
       *
       * @return true
       */
-     bool are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const;
+     bool are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent, bool include_sensitive_data = true) const;
 
      /**
       * @brief get the number of blocks to sync in one go
@@ -763,6 +797,13 @@ namespace cryptonote
       */
      uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes);
 
+     /**
+      * @copydoc Blockchain::prevalidate_block_headers
+      *
+      * @note see Blockchain::prevalidate_block_headers
+      */
+     uint64_t prevalidate_block_headers(uint64_t height, const std::vector<crypto::hash> &ids, const std::vector<blobdata> &hashing_blobs);
+
      /**
       * @brief get free disk space on the blockchain partition
       *
@@ -777,6 +818,23 @@ namespace cryptonote
       */
      bool offline() const { return m_offline; }
 
+     /**
+      * @brief get the pruning stripe of the blockchain
+      *
+      * @return the stripe kept, or 0 if the blockchain isn't pruned
+      */
+     uint32_t get_blockchain_pruning_stripe() const { return m_blockchain_storage.get_blockchain_pruning_stripe(); }
+
+     /**
+      * @brief get whether the core is a read-only replica
+      *
+      * A replica opens the blockchain of another daemon read only, follows
+      * the blocks that daemon stores and only serves RPC.
+      *
+      * @return whether the core is a read-only replica
+      */
+     bool replica() const { return m_replica; }
+
      /**
       * @brief set update handler for supernode stakes
       */
@@ -789,6 +847,11 @@ namespace cryptonote
       */
      void invoke_update_stakes_handler();
 
+     /**
+      * @brief set handler for supernode stakes changes
+      */
+     void set_stakes_change_handler(const supernode_stakes_update_handler&);
+
      /**
       * @brief set update handler for new blockchain based list
       */
@@ -801,6 +864,46 @@ namespace cryptonote
       */
      void invoke_update_blockchain_based_list_handler(uint64_t last_received_block_height);
 
+     /**
+      * @brief set handler for blockchain based list changes
+      */
+     void set_blockchain_based_list_change_handler(const blockchain_based_list_update_handler&);
+
+     /**
+      * @brief bring supernode stakes and the blockchain based list up to the blockchain height
+      *
+      * This is otherwise done on idle, and by add_new_block.
+      */
+     void synchronize_stakes();
+
+     /**
+      * @brief get precomputed auth sample of a recent block
+      *
+      * @return the sample or nullptr if it isn't available for the block
+      */
+     auth_sample_ptr get_auth_sample(uint64_t block_height) const;
+
+     /**
+      * @brief get supernode stakes of a block
+      *
+      * @return the snapshot or nullptr if stake transaction processing isn't initialized
+      */
+     supernode_stakes_snapshot_ptr get_supernode_stakes_snapshot(uint64_t block_height) const;
+
+     /**
+      * @brief get supernode stakes for a range of blocks in the supernodes history window
+      *
+      * @return false if stake transaction processing isn't initialized
+      */
+     bool get_supernode_stakes(uint64_t first_block_height, uint64_t count, StakeTransactionProcessor::block_stakes_array& stakes) const;
+
+     /**
+      * @brief get blockchain based lists for a range of blocks in the list history
+      *
+      * @return false if stake transaction processing isn't initialized
+      */
+     bool get_blockchain_based_lists(uint64_t first_block_height, uint64_t count, StakeTransactionProcessor::block_tiers_array& lists) const;
+
    private:
 
      /**
@@ -981,6 +1084,7 @@ namespace cryptonote
      i_cryptonote_protocol* m_pprotocol; //!< cryptonote protocol instance
 
      epee::critical_section m_incoming_tx_lock; //!< incoming transaction lock
+     bulletproof_batch_verifier m_bulletproof_batch_verifier; //!< batches bulletproof checks of txs relayed by different connections
 
      //m_miner and m_miner_addres are probably temporary here
      miner m_miner; //!< miner instance
@@ -993,8 +1097,10 @@ namespace cryptonote
      epee::math_helper::once_a_time_seconds<60*60*12, false> m_store_blockchain_interval; //!< interval for manual storing of Blockchain, if enabled
      epee::math_helper::once_a_time_seconds<60*60*2, true> m_fork_moaner; //!< interval for checking HardFork status
      epee::math_helper::once_a_time_seconds<60*2, false> m_txpool_auto_relayer; //!< interval for checking re-relaying txpool transactions
+     epee::math_helper::once_a_time_seconds<60*10, false> m_txpool_snapshot_interval; //!< interval for storing the in-memory txpool, if enabled
      epee::math_helper::once_a_time_seconds<60*60*12, true> m_check_updates_interval; //!< interval for checking for new versions
      epee::math_helper::once_a_time_seconds<60*10, true> m_check_disk_space_interval; //!< interval for checking for disk space
+     epee::math_helper::once_a_time_seconds<10, false> m_blockchain_pruning_interval; //!< interval for pruning another batch of old blocks, if pruned
 
      std::atomic<bool> m_starter_message_showed; //!< has the "daemon will sync now" message been shown?
 
@@ -1009,6 +1115,20 @@ namespace cryptonote
      time_t m_last_json_checkpoints_update; //!< time when json checkpoints were last updated
 
      std::atomic_flag m_checkpoints_updating; //!< set if checkpoints are currently updating to avoid multiple threads attempting to update at once
+
+     /**
+      * @brief a DNS checkpoints lookup running in the background
+      *
+      * Shared with the lookup thread, which may outlive the core.
+      */
+     struct dns_checkpoints_lookup
+     {
+       std::atomic<bool> done;
+       checkpoints points;
+
+       dns_checkpoints_lookup(): done(false) {}
+     };
+     std::shared_ptr<dns_checkpoints_lookup> m_dns_checkpoints_lookup; //!< the lookup in progress, if any
      bool m_disable_dns_checkpoints;
 
      size_t block_sync_size;
@@ -1031,6 +1151,7 @@ namespace cryptonote
 
      bool m_fluffy_blocks_enabled;
      bool m_offline;
+     bool m_replica;
    };
 }
 
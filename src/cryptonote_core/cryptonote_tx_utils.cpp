@@ -695,17 +695,7 @@ namespace cryptonote
     {
       uint64_t seed_height, main_height;
       crypto::hash hash;
-      if (pbc != NULL)
-      {
-        seed_height = rx_seedheight(height);
-        hash = pbc->get_pending_block_id_by_height(seed_height);
-        main_height = pbc->get_current_blockchain_height();
-      } else
-      {
-        memset(&hash, 0, sizeof(hash));  // only happens when generating genesis block
-        seed_height = 0;
-        main_height = 0;
-      }
+      get_block_longhash_seed(pbc, height, main_height, seed_height, hash);
       rx_slow_hash(main_height, seed_height, hash.data, bd.data(), bd.size(), res.data, miners, 0);
     } else {
       const int cn_variant = b.major_version < 8 ? 0 : b.major_version >= 11 ? 2 : 1;
@@ -722,8 +712,41 @@ namespace cryptonote
     return p;
   }
 
+  void get_block_longhash_from_hashing_blob(const uint8_t major_version, const blobdata& bd, crypto::hash& res, const uint64_t main_height,
+    const uint64_t seed_height, const crypto::hash& seed_hash)
+  {
+    if (major_version >= RX_BLOCK_VERSION)
+    {
+      rx_slow_hash(main_height, seed_height, seed_hash.data, bd.data(), bd.size(), res.data, 0, 0);
+    } else {
+      const int cn_variant = major_version < 8 ? 0 : major_version >= 11 ? 2 : 1;
+      const int cn_modifier = major_version < 12 ? CN_MODIFIER_NONE : CN_MODIFIER_REVERSE_WALTZ;
+      crypto::cn_slow_hash(bd.data(), bd.size(), res, cn_variant, cn_modifier);
+    }
+  }
+
+  void get_block_longhash_seed(const Blockchain *pbc, const uint64_t height, uint64_t& main_height, uint64_t& seed_height, crypto::hash& seed_hash)
+  {
+    if (pbc != NULL)
+    {
+      seed_height = rx_seedheight(height);
+      seed_hash = pbc->get_pending_block_id_by_height(seed_height);
+      main_height = pbc->get_current_blockchain_height();
+    } else
+    {
+      seed_hash = crypto::null_hash;  // only happens when generating genesis block
+      seed_height = 0;
+      main_height = 0;
+    }
+  }
+
   void get_block_longhash_reorg(const uint64_t split_height)
   {
     rx_reorg(split_height);
   }
+
+  void get_block_longhash_prepare(const uint64_t seed_height, const crypto::hash& seed_hash)
+  {
+    rx_prepare_seedhash(seed_height, seed_hash.data);
+  }
 }
@@ -104,7 +104,11 @@ namespace cryptonote
   void get_altblock_longhash(const block& b, crypto::hash& res, const uint64_t main_height, const uint64_t height,
     const uint64_t seed_height, const crypto::hash& seed_hash);
   crypto::hash get_block_longhash(const Blockchain *pb, const block& b, const uint64_t height, const int miners);
+  void get_block_longhash_from_hashing_blob(const uint8_t major_version, const blobdata& bd, crypto::hash& res, const uint64_t main_height,
+    const uint64_t seed_height, const crypto::hash& seed_hash);
   void get_block_longhash_reorg(const uint64_t split_height);
+  void get_block_longhash_seed(const Blockchain *pb, const uint64_t height, uint64_t& main_height, uint64_t& seed_height, crypto::hash& seed_hash);
+  void get_block_longhash_prepare(const uint64_t seed_height, const crypto::hash& seed_hash);
 
 }
 
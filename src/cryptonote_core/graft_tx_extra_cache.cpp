@@ -0,0 +1,99 @@
+#include "graft_tx_extra_cache.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+
+using namespace cryptonote;
+
+constexpr size_t graft_tx_extra_cache::DEFAULT_MAX_SIZE;
+
+graft_tx_extra_cache::graft_tx_extra_cache(size_t max_size)
+  : m_max_size(max_size ? max_size : 1)
+{
+}
+
+graft_tx_extra_ptr graft_tx_extra_cache::parse(const transaction& tx)
+{
+  std::shared_ptr<graft_tx_extra> result = std::make_shared<graft_tx_extra>();
+
+  if (tx.type == transaction::tx_type_rta)
+  {
+    result->has_rta_header     = get_graft_rta_header_from_extra(tx, result->rta_hdr);
+    result->has_rta_signatures = get_graft_rta_signatures_from_extra2(tx, result->rta_signatures);
+  }
+  else
+  {
+    result->has_stake = get_graft_stake_tx_extra_from_extra(tx, result->supernode_public_id, result->supernode_public_address,
+      result->supernode_signature, result->tx_secret_key);
+
+    if (result->has_stake)
+      result->tx_prefix_hash = get_transaction_prefix_hash(tx);
+  }
+
+  return result;
+}
+
+graft_tx_extra_ptr graft_tx_extra_cache::find(const crypto::hash& tx_hash) const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  extra_map::const_iterator it = m_extras.find(tx_hash);
+
+  if (it == m_extras.end())
+    return nullptr;
+
+  m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+
+  return it->second.first;
+}
+
+graft_tx_extra_ptr graft_tx_extra_cache::get(const crypto::hash& tx_hash, const transaction& tx)
+{
+  if (graft_tx_extra_ptr cached = find(tx_hash))
+    return cached;
+
+    //parse outside of the lock; concurrent parsing of the same tx gives equal results
+
+  graft_tx_extra_ptr extra = parse(tx);
+
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  if (m_extras.find(tx_hash) != m_extras.end())
+    return extra;
+
+  if (m_extras.size() >= m_max_size)
+  {
+    m_extras.erase(m_lru.back());
+    m_lru.pop_back();
+  }
+
+  m_lru.push_front(tx_hash);
+  m_extras.emplace(tx_hash, std::make_pair(extra, m_lru.begin()));
+
+  return extra;
+}
+
+void graft_tx_extra_cache::erase(const crypto::hash& tx_hash)
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  extra_map::iterator it = m_extras.find(tx_hash);
+
+  if (it == m_extras.end())
+    return;
+
+  m_lru.erase(it->second.second);
+  m_extras.erase(it);
+}
+
+void graft_tx_extra_cache::clear()
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  m_extras.clear();
+  m_lru.clear();
+}
+
+size_t graft_tx_extra_cache::size() const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+  return m_extras.size();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "cryptonote_basic/cryptonote_basic.h"
+
+namespace cryptonote
+{
+
+/// Graft fields parsed from tx extra and extra2
+struct graft_tx_extra
+{
+  bool has_rta_header = false;
+  rta_header rta_hdr;
+
+  bool has_rta_signatures = false;
+  std::vector<rta_signature> rta_signatures;
+
+  bool has_stake = false;
+  std::string supernode_public_id;
+  account_public_address supernode_public_address;
+  crypto::signature supernode_signature;
+  crypto::secret_key tx_secret_key;
+  crypto::hash tx_prefix_hash = crypto::null_hash; //only for stake txs
+};
+
+typedef std::shared_ptr<const graft_tx_extra> graft_tx_extra_ptr;
+
+/// Parsed graft extras by tx hash, so each tx is parsed once from pool admission to stake processing
+class graft_tx_extra_cache
+{
+public:
+  static constexpr size_t DEFAULT_MAX_SIZE = 16384;
+
+  graft_tx_extra_cache(size_t max_size = DEFAULT_MAX_SIZE);
+
+  /// Get parsed extras of the transaction; extras are parsed and cached on first call
+  graft_tx_extra_ptr get(const crypto::hash& tx_hash, const transaction& tx);
+
+  /// Get cached extras (returns nullptr if the tx has not been parsed yet)
+  graft_tx_extra_ptr find(const crypto::hash& tx_hash) const;
+
+  void erase(const crypto::hash& tx_hash);
+  void clear();
+  size_t size() const;
+
+  /// Parse graft extras of the transaction without caching
+  static graft_tx_extra_ptr parse(const transaction& tx);
+
+private:
+  typedef std::list<crypto::hash> lru_list;
+  typedef std::unordered_map<crypto::hash, std::pair<graft_tx_extra_ptr, lru_list::iterator>> extra_map;
+
+  size_t m_max_size;
+  mutable boost::mutex m_lock;
+  mutable lru_list m_lru; //most recently used first
+  extra_map m_extras;
+};
+
+}
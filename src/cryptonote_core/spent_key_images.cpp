@@ -0,0 +1,122 @@
+#include <cstring>
+
+#include "common/memory_usage.h"
+#include "spent_key_images.h"
+
+using namespace cryptonote;
+
+constexpr size_t spent_key_images::STRIPES_COUNT;
+
+spent_key_images::stripe& spent_key_images::get_stripe(const crypto::key_image& key_image)
+{
+  return const_cast<stripe&>(static_cast<const spent_key_images&>(*this).get_stripe(key_image));
+}
+
+const spent_key_images::stripe& spent_key_images::get_stripe(const crypto::key_image& key_image) const
+{
+    //key images are uniformly distributed, so any of their bytes are good enough for striping
+
+  uint64_t key = 0;
+  memcpy(&key, &key_image, sizeof(key));
+
+  return m_stripes[key % STRIPES_COUNT];
+}
+
+bool spent_key_images::contains(const crypto::key_image& key_image) const
+{
+  const stripe& s = get_stripe(key_image);
+  boost::lock_guard<boost::mutex> lock(s.lock);
+  return s.key_images.find(key_image) != s.key_images.end();
+}
+
+bool spent_key_images::insert(const crypto::key_image& key_image, const crypto::hash& tx_id, bool allow_double_spend)
+{
+  stripe& s = get_stripe(key_image);
+  boost::lock_guard<boost::mutex> lock(s.lock);
+
+  std::unordered_set<crypto::hash>& tx_ids = s.key_images[key_image];
+
+  if (!allow_double_spend && !tx_ids.empty())
+    return false;
+
+  return tx_ids.insert(tx_id).second;
+}
+
+bool spent_key_images::erase(const crypto::key_image& key_image, const crypto::hash& tx_id)
+{
+  stripe& s = get_stripe(key_image);
+  boost::lock_guard<boost::mutex> lock(s.lock);
+
+  key_images_container::iterator it = s.key_images.find(key_image);
+
+  if (it == s.key_images.end() || !it->second.erase(tx_id))
+    return false;
+
+  if (it->second.empty())
+    s.key_images.erase(it);
+
+  return true;
+}
+
+std::vector<crypto::hash> spent_key_images::get_tx_ids(const crypto::key_image& key_image) const
+{
+  const stripe& s = get_stripe(key_image);
+  boost::lock_guard<boost::mutex> lock(s.lock);
+
+  key_images_container::const_iterator it = s.key_images.find(key_image);
+
+  if (it == s.key_images.end())
+    return std::vector<crypto::hash>();
+
+  return std::vector<crypto::hash>(it->second.begin(), it->second.end());
+}
+
+spent_key_images::key_images_container spent_key_images::get_all() const
+{
+  key_images_container result;
+
+  for (const stripe& s : m_stripes)
+  {
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    result.insert(s.key_images.begin(), s.key_images.end());
+  }
+
+  return result;
+}
+
+uint64_t spent_key_images::memory_usage() const
+{
+  uint64_t result = 0;
+
+  for (const stripe& s : m_stripes)
+  {
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    result += tools::memory::hash_bytes(s.key_images);
+    for (const auto& entry : s.key_images)
+      result += tools::memory::hash_bytes(entry.second);
+  }
+
+  return result;
+}
+
+size_t spent_key_images::size() const
+{
+  size_t result = 0;
+
+  for (const stripe& s : m_stripes)
+  {
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    result += s.key_images.size();
+  }
+
+  return result;
+}
+
+void spent_key_images::clear()
+{
+  for (stripe& s : m_stripes)
+  {
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    s.key_images.clear();
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+
+/// Key images spent by pool transactions. The set is split into stripes by key image, each with
+/// its own lock, so lookups from many threads don't serialize on one lock
+class spent_key_images
+{
+public:
+  typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash>> key_images_container;
+
+  static constexpr size_t STRIPES_COUNT = 16;
+
+  /// Check if key image is spent by any pool transaction
+  bool contains(const crypto::key_image& key_image) const;
+
+  /// Register key image spent by the transaction; fails if it is already spent by another transaction
+  /// (unless allow_double_spend is set) or if it has been already registered for this transaction
+  bool insert(const crypto::key_image& key_image, const crypto::hash& tx_id, bool allow_double_spend);
+
+  /// Unregister key image spent by the transaction; returns false if it has not been registered
+  bool erase(const crypto::key_image& key_image, const crypto::hash& tx_id);
+
+  /// Transactions spending the key image
+  std::vector<crypto::hash> get_tx_ids(const crypto::key_image& key_image) const;
+
+  /// Copy of all key images with their transactions
+  key_images_container get_all() const;
+
+  size_t size() const;
+  void clear();
+
+  /// Heap memory held by the key images and their transaction sets
+  uint64_t memory_usage() const;
+
+private:
+  struct stripe
+  {
+    mutable boost::mutex lock;
+    key_images_container key_images;
+  };
+
+  stripe& get_stripe(const crypto::key_image& key_image);
+  const stripe& get_stripe(const crypto::key_image& key_image) const;
+
+  std::array<stripe, STRIPES_COUNT> m_stripes;
+};
+
+}
@@ -1,8 +1,12 @@
 #include <string_tools.h>
 
+#include "common/metrics.h"
+#include "common/threadpool.h"
+#include "common/trace.h"
 #include "stake_transaction_processor.h"
 #include "../graft_rta_config.h"
 
+#include <algorithm>
 #include <mutex>
 
 
@@ -15,8 +19,18 @@ using namespace cryptonote;
 namespace
 {
 
-const char* STAKE_TRANSACTION_STORAGE_FILE_NAME = "stake_transactions.v2.bin";
-const char* BLOCKCHAIN_BASED_LIST_FILE_NAME     = "blockchain_based_list.v5.bin";
+const char* STAKE_TRANSACTION_STORAGE_FILE_NAME = "stake_transactions.v3.bin";
+const char* BLOCKCHAIN_BASED_LIST_FILE_NAME     = "blockchain_based_list.v7.bin";
+const size_t PARALLEL_SYNC_MIN_BLOCKS_COUNT    = 16; //blocks are prepared in the thread pool starting from this number
+const size_t STAKE_SIGNATURE_CACHE_MAX_SIZE    = 100000;
+const uint64_t CHECKPOINT_INTERVAL             = 1000; //storages are checkpointed in memory at heights which are multiple of this number
+const size_t CHECKPOINTS_MAX_COUNT             = 5;
+
+tools::metrics::histogram sync_time("graft_stake_sync_seconds", "Time spent synchronizing stakes and the blockchain based list with the blockchain");
+tools::metrics::counter sync_blocks("graft_stake_sync_blocks_total", "Blocks processed by the stake synchronization");
+tools::metrics::counter sync_errors("graft_stake_sync_errors_total", "Stake synchronizations stopped by an error");
+tools::metrics::gauge sync_height("graft_stake_sync_height", "Height up to which stakes are synchronized");
+tools::metrics::counter sync_checkpoint_restores("graft_stake_sync_checkpoint_restores_total", "Reorganizations recovered from a checkpoint of the stake storages");
 
 }
 
@@ -41,19 +55,303 @@ StakeTransactionProcessor::StakeTransactionProcessor(Blockchain& blockchain)
 {
 }
 
-const supernode_stake* StakeTransactionProcessor::find_supernode_stake(uint64_t block_number, const std::string& supernode_public_id) const
+const supernode_stake* supernode_stakes_snapshot::find_supernode_stake(const std::string& supernode_public_id) const
+{
+  std::unordered_map<std::string, size_t>::const_iterator it = stake_indexes.find(supernode_public_id);
+
+  if (it == stake_indexes.end())
+    return nullptr;
+
+  return &stakes[it->second];
+}
+
+void supernode_stakes_snapshot::build_indexes()
+{
+  stake_indexes.clear();
+  stake_indexes.reserve(stakes.size());
+
+  size_t table_size = 1;
+
+  while (table_size < stakes.size() * 2)
+    table_size *= 2;
+
+  stake_key_table.assign(table_size, std::make_pair(crypto::null_pkey, SIZE_MAX));
+  valid_stakes.assign(stakes.size(), false);
+
+  for (size_t i=0, count=stakes.size(); i<count; i++)
+  {
+    const supernode_stake& stake = stakes[i];
+
+    stake_indexes[stake.supernode_public_id] = i;
+    valid_stakes[i] = stake.amount >= config::graft::TIER1_STAKE_AMOUNT;
+
+    crypto::public_key key;
+
+    if (!epee::string_tools::hex_to_pod(stake.supernode_public_id, key))
+      continue;
+
+    size_t slot = std::hash<crypto::public_key>()(key) & (table_size - 1);
+
+    while (stake_key_table[slot].second != SIZE_MAX && stake_key_table[slot].first != key)
+      slot = (slot + 1) & (table_size - 1);
+
+    stake_key_table[slot] = std::make_pair(key, i);
+  }
+}
+
+size_t supernode_stakes_snapshot::find_stake_index(const crypto::public_key& supernode_public_key) const
+{
+  if (stake_key_table.empty())
+    return SIZE_MAX;
+
+  const size_t mask = stake_key_table.size() - 1;
+
+  for (size_t slot = std::hash<crypto::public_key>()(supernode_public_key) & mask;; slot = (slot + 1) & mask)
+  {
+    const std::pair<crypto::public_key, size_t>& entry = stake_key_table[slot];
+
+    if (entry.second == SIZE_MAX || entry.first == supernode_public_key)
+      return entry.second;
+  }
+}
+
+const supernode_stake* supernode_stakes_snapshot::find_supernode_stake(const crypto::public_key& supernode_public_key) const
+{
+  size_t index = find_stake_index(supernode_public_key);
+
+  if (index == SIZE_MAX)
+    return nullptr;
+
+  return &stakes[index];
+}
+
+bool supernode_stakes_snapshot::is_valid_supernode(const crypto::public_key& supernode_public_key) const
 {
+  size_t index = find_stake_index(supernode_public_key);
+
+  return index != SIZE_MAX && valid_stakes[index];
+}
+
+supernode_stakes_snapshot_ptr StakeTransactionProcessor::get_supernode_stakes_snapshot(uint64_t block_number) const
+{
+  supernode_stakes_snapshot_map_ptr snapshots = std::atomic_load(&m_stakes_snapshots);
+
+  if (snapshots)
+  {
+    supernode_stakes_snapshot_map::const_iterator it = snapshots->find(block_number);
+
+    if (it != snapshots->end())
+      return it->second;
+  }
+
   CRITICAL_REGION_LOCAL1(m_storage_lock);
 
+  return get_supernode_stakes_snapshot_impl(block_number);
+}
+
+supernode_stakes_snapshot_ptr StakeTransactionProcessor::get_supernode_stakes_snapshot_impl(uint64_t block_number) const
+{
+  static const size_t MAX_SNAPSHOTS_COUNT = 16;
+
   if (!m_storage)
     return nullptr;
 
-  return m_storage->find_supernode_stake(block_number, supernode_public_id);
+  supernode_stakes_snapshot_map_ptr snapshots = std::atomic_load(&m_stakes_snapshots);
+
+  if (snapshots)
+  {
+    supernode_stakes_snapshot_map::const_iterator it = snapshots->find(block_number);
+
+    if (it != snapshots->end())
+      return it->second; //has been built by another thread while waiting for the lock
+  }
+
+  std::shared_ptr<supernode_stakes_snapshot> snapshot = std::make_shared<supernode_stakes_snapshot>();
+
+  snapshot->block_number = block_number;
+  snapshot->stakes       = m_storage->get_supernode_stakes(block_number);
+
+  snapshot->build_indexes();
+
+    //stakes of blocks which have not been processed yet may change, so don't share them
+
+  if (block_number > m_storage->get_last_processed_block_index())
+    return snapshot;
+
+  std::shared_ptr<supernode_stakes_snapshot_map> new_snapshots = snapshots ? std::make_shared<supernode_stakes_snapshot_map>(*snapshots)
+                                                                           : std::make_shared<supernode_stakes_snapshot_map>();
+
+  (*new_snapshots)[block_number] = snapshot;
+
+  while (new_snapshots->size() > MAX_SNAPSHOTS_COUNT)
+    new_snapshots->erase(new_snapshots->begin());
+
+  std::atomic_store(&m_stakes_snapshots, supernode_stakes_snapshot_map_ptr(std::move(new_snapshots)));
+
+  return snapshot;
+}
+
+void StakeTransactionProcessor::remove_supernode_stakes_snapshots(uint64_t first_block_number)
+{
+  supernode_stakes_snapshot_map_ptr snapshots = std::atomic_load(&m_stakes_snapshots);
+
+  if (!snapshots || snapshots->lower_bound(first_block_number) == snapshots->end())
+    return;
+
+  std::shared_ptr<supernode_stakes_snapshot_map> new_snapshots = std::make_shared<supernode_stakes_snapshot_map>(*snapshots);
+
+  new_snapshots->erase(new_snapshots->lower_bound(first_block_number), new_snapshots->end());
+
+  std::atomic_store(&m_stakes_snapshots, supernode_stakes_snapshot_map_ptr(std::move(new_snapshots)));
+}
+
+bool StakeTransactionProcessor::get_supernode_stakes(uint64_t first_block_number, uint64_t count, block_stakes_array& stakes) const
+{
+  CRITICAL_REGION_LOCAL1(m_storage_lock);
+
+  stakes.clear();
+
+  if (!m_storage)
+    return false;
+
+  if (!m_storage->has_last_processed_block())
+    return true;
+
+  uint64_t last_block_number = m_storage->get_last_processed_block_index();
+
+  if (last_block_number >= config::graft::SUPERNODE_HISTORY_SIZE)
+    first_block_number = std::max(first_block_number, last_block_number - config::graft::SUPERNODE_HISTORY_SIZE + 1);
+
+  if (first_block_number > last_block_number)
+    return true;
+
+  uint64_t end_block_number = std::min(last_block_number - first_block_number + 1, count) + first_block_number;
+
+    //ascending order lets the storage update stakes incrementally after the first block
+
+  for (uint64_t block_number=first_block_number; block_number<end_block_number; block_number++)
+    stakes.emplace_back(block_number, m_storage->get_supernode_stakes(block_number));
+
+  return true;
+}
+
+bool StakeTransactionProcessor::get_blockchain_based_lists(uint64_t first_block_number, uint64_t count, block_tiers_array& lists) const
+{
+  CRITICAL_REGION_LOCAL1(m_storage_lock);
+
+  lists.clear();
+
+  if (!m_blockchain_based_list || !m_blockchain_based_list->history_depth())
+    return m_blockchain_based_list != nullptr;
+
+  uint64_t last_block_number = m_blockchain_based_list->block_height();
+
+  first_block_number = std::max(first_block_number, last_block_number - m_blockchain_based_list->history_depth() + 1);
+
+  if (first_block_number > last_block_number)
+    return true;
+
+  uint64_t end_block_number = std::min(last_block_number - first_block_number + 1, count) + first_block_number;
+
+  for (uint64_t block_number=first_block_number; block_number<end_block_number; block_number++)
+    lists.emplace_back(block_number, m_blockchain_based_list->tiers(last_block_number - block_number));
+
+  return true;
+}
+
+auth_sample_ptr StakeTransactionProcessor::get_auth_sample(uint64_t block_number) const
+{
+  auth_sample_map_ptr samples = std::atomic_load(&m_auth_samples);
+
+  if (!samples)
+    return nullptr;
+
+  auth_sample_map::const_iterator it = samples->find(block_number);
+
+  return it != samples->end() ? it->second : nullptr;
+}
+
+void StakeTransactionProcessor::update_auth_samples()
+{
+  uint64_t last_block_number = m_blockchain_based_list->block_height();
+  size_t   depth             = std::min<uint64_t>(m_blockchain_based_list->history_depth(), config::graft::SUPERNODE_HISTORY_SIZE);
+
+  if (!depth)
+    return;
+
+  uint64_t first_block_number = last_block_number + 1 - depth;
+
+  auth_sample_map_ptr samples = std::atomic_load(&m_auth_samples);
+
+  if (samples && samples->count(last_block_number) && samples->begin()->first >= first_block_number)
+    return;
+
+  std::shared_ptr<auth_sample_map> new_samples = samples ? std::make_shared<auth_sample_map>(*samples)
+                                                         : std::make_shared<auth_sample_map>();
+
+  new_samples->erase(new_samples->begin(), new_samples->lower_bound(first_block_number));
+
+  for (uint64_t block_number=first_block_number; block_number<=last_block_number; block_number++)
+  {
+    if (new_samples->count(block_number))
+      continue;
+
+    std::shared_ptr<auth_sample> sample = std::make_shared<auth_sample>();
+
+    sample->block_number = block_number;
+    sample->block_hash   = m_blockchain.get_block_id_by_height(block_number);
+
+    BlockchainBasedList::select_auth_sample(m_blockchain_based_list->tiers(last_block_number - block_number), sample->block_hash, sample->supernodes);
+
+    (*new_samples)[block_number] = std::move(sample);
+  }
+
+  std::atomic_store(&m_auth_samples, auth_sample_map_ptr(std::move(new_samples)));
+}
+
+void StakeTransactionProcessor::remove_auth_samples(uint64_t first_block_number)
+{
+  auth_sample_map_ptr samples = std::atomic_load(&m_auth_samples);
+
+  if (!samples || samples->lower_bound(first_block_number) == samples->end())
+    return;
+
+  std::shared_ptr<auth_sample_map> new_samples = std::make_shared<auth_sample_map>(*samples);
+
+  new_samples->erase(new_samples->lower_bound(first_block_number), new_samples->end());
+
+  std::atomic_store(&m_auth_samples, auth_sample_map_ptr(std::move(new_samples)));
 }
 
 namespace
 {
 
+/// Key of the stake signature check result in the cache
+crypto::hash get_stake_signature_key(const stake_transaction& stake_tx)
+{
+  std::string data = stake_tx.supernode_public_id;
+
+  data.append(reinterpret_cast<const char*>(&stake_tx.supernode_public_address), sizeof(stake_tx.supernode_public_address));
+  data.append(reinterpret_cast<const char*>(&stake_tx.supernode_signature), sizeof(stake_tx.supernode_signature));
+
+  return crypto::cn_fast_hash(data.data(), data.size());
+}
+
+bool check_stake_signature(network_type nettype, const stake_transaction& stake_tx)
+{
+  crypto::public_key W;
+  if (!epee::string_tools::hex_to_pod(stake_tx.supernode_public_id, W))
+    return false;
+
+  const bool is_subaddress = false;
+  std::string supernode_public_address_str = cryptonote::get_account_address_as_str(nettype, is_subaddress, stake_tx.supernode_public_address);
+  std::string data = supernode_public_address_str + ":" + stake_tx.supernode_public_id;
+  crypto::hash hash;
+  crypto::cn_fast_hash(data.data(), data.size(), hash);
+
+  return crypto::check_signature(hash, W, stake_tx.supernode_signature);
+}
+
 uint64_t get_transaction_amount(const transaction& tx, const account_public_address& address, const crypto::secret_key& tx_key)
 {
   crypto::key_derivation derivation;
@@ -148,24 +446,143 @@ void StakeTransactionProcessor::init_storages_impl()
   m_blockchain_based_list.reset(new BlockchainBasedList(m_config_dir + "/" + BLOCKCHAIN_BASED_LIST_FILE_NAME, first_block_number));
 }
 
-void StakeTransactionProcessor::process_block_stake_transaction(uint64_t block_index, const block& block, const crypto::hash& block_hash, bool update_storage)
+bool StakeTransactionProcessor::parse_stake_transaction(uint64_t block_index, const crypto::hash& tx_id, const transaction& tx, uint8_t current_hard_fork_version, stake_transaction& stake_tx) const
 {
-  if (block_index <= m_storage->get_last_processed_block_index())
-    return;
+  crypto::hash tx_hash = crypto::null_hash;
 
-  if (m_blockchain.get_hard_fork_version(block_index) >= config::graft::STAKE_TRANSACTION_PROCESSING_DB_VERSION)
+  try
   {
-      //analyze block transactions and add new stake transactions if exist
+      //extras and prefix hashes of txs which passed through the pool have been already computed
 
-    stake_transaction stake_tx;
+    if (graft_tx_extra_ptr extra = m_tx_extra_cache.find(tx_id))
+    {
+      if (!extra->has_stake)
+        return false;
+
+      stake_tx.supernode_public_id      = extra->supernode_public_id;
+      stake_tx.supernode_public_address = extra->supernode_public_address;
+      stake_tx.supernode_signature      = extra->supernode_signature;
+      stake_tx.tx_secret_key            = extra->tx_secret_key;
+      tx_hash                           = extra->tx_prefix_hash;
+    }
+    else if (get_graft_stake_tx_extra_from_extra(tx, stake_tx.supernode_public_id, stake_tx.supernode_public_address, stake_tx.supernode_signature, stake_tx.tx_secret_key))
+    {
+      tx_hash = get_transaction_prefix_hash(tx);
+    }
+    else
+    {
+      return false;
+    }
 
-    std::vector<transaction> txs;
-    std::vector<crypto::hash> missed_txs;
-    
-    if (!m_blockchain.get_transactions(block.tx_hashes, txs, missed_txs))
+    crypto::public_key W;
+    if (!epee::string_tools::hex_to_pod(stake_tx.supernode_public_id, W) || !check_key(W))
     {
-      MWARNING("Unable to get transactions for block #" << block_index);
+      MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash
+        << " because of invalid supernode public identifier '" << stake_tx.supernode_public_id << "'");
+      return false;
+    }
+
+    uint64_t unlock_time = tx.unlock_time - block_index;
+
+    if (unlock_time < config::graft::STAKE_MIN_UNLOCK_TIME)
+    {
+      MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
+        << " because unlock time " << unlock_time << " is less than minimum allowed " << config::graft::STAKE_MIN_UNLOCK_TIME);
+      return false;
+    }
+    const auto CURRENT_STAKE_MAX_UNLOCK_TIME = current_hard_fork_version < 16 ? config::graft::STAKE_MAX_UNLOCK_TIME_V15
+                                                                              : config::graft::STAKE_MAX_UNLOCK_TIME;
+    if (unlock_time > CURRENT_STAKE_MAX_UNLOCK_TIME)
+    {
+      MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
+        << " because unlock time " << unlock_time << " is greater than maximum allowed " << CURRENT_STAKE_MAX_UNLOCK_TIME);
+      return false;
+    }
+
+    uint64_t amount = get_transaction_amount(tx, stake_tx.supernode_public_address, stake_tx.tx_secret_key);
+
+    if (!amount)
+    {
+      MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
+        << " because of error at parsing amount");
+      return false;
+    }
+
+    stake_tx.amount = amount;
+    stake_tx.block_height = block_index;
+    stake_tx.hash = tx_hash;
+    stake_tx.unlock_time = unlock_time;
+
+    return true; //supernode signature is checked later for all blocks of the batch
+  }
+  catch (std::exception& e)
+  {
+    MWARNING("Ignore transaction at block #" << block_index << ", tx_id=" << tx_id << " because of error at parsing: " << e.what());
+  }
+  catch (...)
+  {
+    MWARNING("Ignore transaction at block #" << block_index << ", tx_id=" << tx_id << " because of unknown error at parsing");
+  }
+
+  return false;
+}
+
+void StakeTransactionProcessor::prepare_block(uint8_t current_hard_fork_version, prepared_block& result) const
+{
+  const BlockchainDB& db = m_blockchain.get_db();
+  uint64_t block_index = result.index;
+
+  try
+  {
+    result.hash  = db.get_block_hash_from_height(block_index);
+    result.found = true;
+
+    if (!result.has_stake_transactions)
       return;
+
+      //use stake transactions index if it covers the block; otherwise all block transactions have to be analyzed
+
+    std::vector<crypto::hash> stake_tx_hashes;
+    bool is_indexed = db.get_stake_tx_hashes(block_index, stake_tx_hashes);
+
+    if (is_indexed && stake_tx_hashes.empty())
+      return;
+
+      //analyze block transactions and collect new stake transactions if exist
+
+    block block = db.get_block_from_height(block_index);
+
+    std::vector<crypto::hash> missed_txs;
+
+    for (const crypto::hash& tx_hash : block.tx_hashes)
+    {
+      if (is_indexed && std::find(stake_tx_hashes.begin(), stake_tx_hashes.end(), tx_hash) == stake_tx_hashes.end())
+        continue;
+
+      cryptonote::blobdata tx_blob;
+      transaction tx;
+
+      if (db.get_tx_blob(tx_hash, tx_blob))
+      {
+        if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash))
+          throw std::runtime_error("Unable to get transactions for block #" + std::to_string(block_index));
+      }
+      else if (db.get_pruned_tx_blob(tx_hash, tx_blob))
+      {
+        // stakes only need the tx prefix and the output amounts, which pruning keeps
+        if (!parse_and_validate_tx_base_from_blob(tx_blob, tx))
+          throw std::runtime_error("Unable to get transactions for block #" + std::to_string(block_index));
+      }
+      else
+      {
+        missed_txs.push_back(tx_hash);
+        continue;
+      }
+
+      stake_transaction stake_tx;
+
+      if (parse_stake_transaction(block_index, tx_hash, tx, current_hard_fork_version, stake_tx))
+        result.stake_txs.emplace_back(std::move(stake_tx));
     }
 
     if (!missed_txs.empty())
@@ -175,81 +592,139 @@ void StakeTransactionProcessor::process_block_stake_transaction(uint64_t block_i
       for (const crypto::hash& tx_hash : missed_txs)
         MWARNING("  " << tx_hash);
     }
+  }
+  catch (BLOCK_DNE&)
+  {
+    //block does not exist, waiting until it will be received
+    result.found = false;
+  }
+  catch (std::exception& e)
+  {
+    result.error = e.what();
+  }
+  catch (...)
+  {
+    result.error = "unknown error at preparing block #" + std::to_string(block_index);
+  }
+}
 
-    for (const transaction& tx : txs)
+void StakeTransactionProcessor::prepare_blocks(uint64_t first_block_index, size_t count, std::vector<prepared_block>& blocks) const
+{
+  uint8_t current_hard_fork_version = m_blockchain.get_current_hard_fork_version();
+
+  blocks.clear();
+  blocks.resize(count);
+
+  for (size_t i=0; i<count; i++)
+  {
+    prepared_block& block = blocks[i];
+
+    block.index                  = first_block_index + i;
+    block.has_stake_transactions = block.index > m_storage->get_last_processed_block_index() &&
+                                   m_blockchain.get_hard_fork_version(block.index) >= config::graft::STAKE_TRANSACTION_PROCESSING_DB_VERSION;
+  }
+
+  if (count < PARALLEL_SYNC_MIN_BLOCKS_COUNT)
+  {
+    for (prepared_block& block : blocks)
+      prepare_block(current_hard_fork_version, block);
+  }
+  else
+  {
+      //fetch and parse blocks in parallel; results are applied in order by the caller
+
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+
+    for (prepared_block& block : blocks)
+      tpool.submit(&waiter, [this, current_hard_fork_version, &block]() { prepare_block(current_hard_fork_version, block); }, true);
+
+    waiter.wait(&tpool);
+  }
+
+  check_stake_signatures(blocks);
+}
+
+void StakeTransactionProcessor::check_stake_signatures(std::vector<prepared_block>& blocks) const
+{
+    //collect distinct signatures which have not been checked yet (restakes usually repeat the same signature)
+
+  std::vector<std::pair<crypto::hash, const stake_transaction*>> unchecked_signatures;
+
+  for (const prepared_block& block : blocks)
+  {
+    for (const stake_transaction& stake_tx : block.stake_txs)
     {
-      const crypto::hash tx_hash = get_transaction_prefix_hash(tx);
+      crypto::hash key = get_stake_signature_key(stake_tx);
 
-      try
-      {
-        if (!get_graft_stake_tx_extra_from_extra(tx, stake_tx.supernode_public_id, stake_tx.supernode_public_address, stake_tx.supernode_signature, stake_tx.tx_secret_key))
-          continue;
+      if (m_stake_signature_cache.find(key) != m_stake_signature_cache.end())
+        continue;
 
-        crypto::public_key W;
-        if (!epee::string_tools::hex_to_pod(stake_tx.supernode_public_id, W) || !check_key(W))
-        {
-          MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash
-            << " because of invalid supernode public identifier '" << stake_tx.supernode_public_id << "'");
-          continue;
-        }
+      m_stake_signature_cache[key] = false;
 
-        const bool is_subaddress = false;
-        std::string supernode_public_address_str = cryptonote::get_account_address_as_str(m_blockchain.nettype(), is_subaddress, stake_tx.supernode_public_address);
-        std::string data = supernode_public_address_str + ":" + stake_tx.supernode_public_id;
-        crypto::hash hash;
-        crypto::cn_fast_hash(data.data(), data.size(), hash);
+      unchecked_signatures.emplace_back(key, &stake_tx);
+    }
+  }
 
-        if (!crypto::check_signature(hash, W, stake_tx.supernode_signature))
-        {
-          MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
-            << " because of invalid supernode signature (mismatch)");
-          continue;
-        }
+  if (!unchecked_signatures.empty())
+  {
+    std::unique_ptr<bool[]> results(new bool[unchecked_signatures.size()]);
+    network_type nettype = m_blockchain.nettype();
 
-        uint64_t unlock_time = tx.unlock_time - block_index;
+    if (unchecked_signatures.size() < PARALLEL_SYNC_MIN_BLOCKS_COUNT)
+    {
+      for (size_t i=0; i<unchecked_signatures.size(); i++)
+        results[i] = check_stake_signature(nettype, *unchecked_signatures[i].second);
+    }
+    else
+    {
+      tools::threadpool& tpool = tools::threadpool::getInstance();
+      tools::threadpool::waiter waiter;
 
-        if (unlock_time < config::graft::STAKE_MIN_UNLOCK_TIME)
-        {
-          MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
-            << " because unlock time " << unlock_time << " is less than minimum allowed " << config::graft::STAKE_MIN_UNLOCK_TIME);
-          continue;
-        }
-        const auto CURRENT_STAKE_MAX_UNLOCK_TIME = m_blockchain.get_current_hard_fork_version() < 16 ? config::graft::STAKE_MAX_UNLOCK_TIME_V15
-                                                                                                     : config::graft::STAKE_MAX_UNLOCK_TIME;
-        if (unlock_time > CURRENT_STAKE_MAX_UNLOCK_TIME)
-        {
-          MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
-            << " because unlock time " << unlock_time << " is greater than maximum allowed " << CURRENT_STAKE_MAX_UNLOCK_TIME);
-          continue;
-        }
+      for (size_t i=0; i<unchecked_signatures.size(); i++)
+        tpool.submit(&waiter, [&, i]() { results[i] = check_stake_signature(nettype, *unchecked_signatures[i].second); }, true);
 
-        uint64_t amount = get_transaction_amount(tx, stake_tx.supernode_public_address, stake_tx.tx_secret_key);
+      waiter.wait(&tpool);
+    }
 
-        if (!amount)
-        {
-          MWARNING("Ignore stake transaction at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
-            << " because of error at parsing amount");
-          continue;
-        }
+    for (size_t i=0; i<unchecked_signatures.size(); i++)
+      m_stake_signature_cache[unchecked_signatures[i].first] = results[i];
+  }
 
-        stake_tx.amount = amount;
-        stake_tx.block_height = block_index;
-        stake_tx.hash = tx_hash;
-        stake_tx.unlock_time = unlock_time;
+    //drop stake transactions with invalid signatures
 
-        m_storage->add_tx(stake_tx);
+  for (prepared_block& block : blocks)
+  {
+    block.stake_txs.erase(std::remove_if(block.stake_txs.begin(), block.stake_txs.end(), [&](const stake_transaction& stake_tx) {
+      if (m_stake_signature_cache[get_stake_signature_key(stake_tx)])
+        return false;
 
-        MDEBUG("New stake transaction found at block #" << block_index << ", tx_hash=" << tx_hash << ", supernode_public_id '" << stake_tx.supernode_public_id
-          << "', amount=" << amount / double(COIN));
-      }
-      catch (std::exception& e)
-      {
-        MWARNING("Ignore transaction at block #" << block_index << ", tx_hash=" << tx_hash << " because of error at parsing: " << e.what());
-      }
-      catch (...)
-      {
-        MWARNING("Ignore transaction at block #" << block_index << ", tx_hash=" << tx_hash << " because of unknown error at parsing");
-      }
+      MWARNING("Ignore stake transaction at block #" << block.index << ", tx_hash=" << stake_tx.hash << ", supernode_public_id '" << stake_tx.supernode_public_id << "'"
+        << " because of invalid supernode signature (mismatch)");
+
+      return true;
+    }), block.stake_txs.end());
+  }
+
+  if (m_stake_signature_cache.size() > STAKE_SIGNATURE_CACHE_MAX_SIZE)
+    m_stake_signature_cache.clear();
+}
+
+void StakeTransactionProcessor::process_block_stake_transaction(const prepared_block& block, bool update_storage)
+{
+  uint64_t block_index = block.index;
+
+  if (block_index <= m_storage->get_last_processed_block_index())
+    return;
+
+  if (block.has_stake_transactions)
+  {
+    for (const stake_transaction& stake_tx : block.stake_txs)
+    {
+      m_storage->add_tx(stake_tx);
+
+      MDEBUG("New stake transaction found at block #" << block_index << ", tx_hash=" << stake_tx.hash << ", supernode_public_id '" << stake_tx.supernode_public_id
+        << "', amount=" << stake_tx.amount / double(COIN));
     }
 
     m_stakes_need_update = true; //TODO: cache for stakes
@@ -261,17 +736,17 @@ void StakeTransactionProcessor::process_block_stake_transaction(uint64_t block_i
 
     //update cache entries and save storage
 
-  m_storage->add_last_processed_block(block_index, block_hash);
+  m_storage->add_last_processed_block(block_index, block.hash);
 
   if (update_storage)
     m_storage->store();
 }
 
-void StakeTransactionProcessor::process_block_blockchain_based_list(uint64_t block_index, const block& block, const crypto::hash& block_hash, bool update_storage)
+void StakeTransactionProcessor::process_block_blockchain_based_list(const prepared_block& block, bool update_storage)
 {
   uint64_t prev_block_height = m_blockchain_based_list->block_height();
 
-  m_blockchain_based_list->apply_block(block_index, block_hash, *m_storage);
+  m_blockchain_based_list->apply_block(block.index, block.hash, *m_storage);
 
   if (m_blockchain_based_list->need_store() || prev_block_height != m_blockchain_based_list->block_height())
   {
@@ -282,18 +757,236 @@ void StakeTransactionProcessor::process_block_blockchain_based_list(uint64_t blo
   }
 }
 
-void StakeTransactionProcessor::process_block(uint64_t block_index, const block& block, const crypto::hash& block_hash, bool update_storage)
+void StakeTransactionProcessor::process_block(const prepared_block& block, bool update_storage)
 {
-  process_block_stake_transaction(block_index, block, block_hash, update_storage);
-  process_block_blockchain_based_list(block_index, block, block_hash, update_storage);
+  process_block_stake_transaction(block, update_storage);
+  process_block_blockchain_based_list(block, update_storage);
+
+  if (block.index % CHECKPOINT_INTERVAL == 0)
+    add_checkpoint(block);
+}
+
+void StakeTransactionProcessor::add_checkpoint(const prepared_block& block)
+{
+  if (m_storage->get_last_processed_block_index() != block.index || m_blockchain_based_list->block_height() != block.index)
+    return;
+
+  if (m_checkpoints.count(block.index))
+    return;
+
+  checkpoint& new_checkpoint = m_checkpoints[block.index];
+
+  new_checkpoint.block_hash = block.hash;
+
+  m_storage->get_checkpoint(new_checkpoint.storage);
+  m_blockchain_based_list->get_checkpoint(new_checkpoint.blockchain_based_list);
+
+  while (m_checkpoints.size() > CHECKPOINTS_MAX_COUNT)
+    m_checkpoints.erase(m_checkpoints.begin());
+}
+
+bool StakeTransactionProcessor::restore_checkpoint(uint64_t height)
+{
+    //use the latest checkpoint which is still in the blockchain
+
+  while (!m_checkpoints.empty())
+  {
+    checkpoint_map::iterator it = std::prev(m_checkpoints.end());
+    uint64_t block_index = it->first;
+
+    if (block_index < height && block_index <= m_storage->get_last_processed_block_index())
+    {
+      crypto::hash block_hash = crypto::null_hash;
+
+      try
+      {
+        block_hash = m_blockchain.get_block_id_by_height(block_index);
+      }
+      catch (BLOCK_DNE&)
+      {
+      }
+
+      if (block_hash == it->second.block_hash)
+      {
+        MWARNING("Stake transactions processing: restore checkpoint at block " << block_index << " (height=" << height << ")");
+
+        m_storage->restore_checkpoint(it->second.storage);
+        m_blockchain_based_list->restore_checkpoint(it->second.blockchain_based_list);
+
+        remove_supernode_stakes_snapshots(block_index + 1);
+        remove_auth_samples(block_index + 1);
+
+        m_stakes_need_update                = true;
+        m_blockchain_based_list_need_update = true;
+
+        sync_checkpoint_restores.inc();
+
+        return true;
+      }
+    }
+
+    m_checkpoints.erase(it);
+  }
+
+  return false;
+}
+
+bool StakeTransactionProcessor::unroll_processed_blocks(uint64_t height)
+{
+    //unroll already processed blocks for alternative chains
+
+  while (m_storage->has_last_processed_block())
+  {
+    size_t   stake_tx_count = m_storage->get_tx_count();
+    uint64_t last_processed_block_index = m_storage->get_last_processed_block_index();
+
+    if (last_processed_block_index < height)
+    {
+      try
+      {
+        const crypto::hash& last_processed_block_hash  = m_storage->get_last_processed_block_hash();
+        crypto::hash        last_blockchain_block_hash = m_blockchain.get_block_id_by_height(last_processed_block_index);
+
+        if (!memcmp(&last_processed_block_hash.data[0], &last_blockchain_block_hash.data[0], sizeof(last_blockchain_block_hash.data)))
+          break; //latest block hash is the same as processed
+      }
+      catch (BLOCK_DNE&)
+      {
+        //block does not exist, waiting until it will be received
+        return false;
+      }
+    }
+    
+      //unrolling the last block hash would restore storages from the beginning, a checkpoint needs a shorter replay
+
+    if ((m_storage->get_last_processed_block_hashes_count() <= 1 || m_blockchain_based_list->history_depth() <= 1) && restore_checkpoint(height))
+      continue;
+
+    MWARNING("Stake transactions processing: unroll block " << last_processed_block_index << " (height=" << height << ")");
+
+    m_checkpoints.erase(m_checkpoints.lower_bound(last_processed_block_index), m_checkpoints.end());
+
+    m_storage->remove_last_processed_block();
+
+    remove_supernode_stakes_snapshots(last_processed_block_index);
+
+    if (stake_tx_count != m_storage->get_tx_count())
+      m_storage->clear_supernode_stakes();
+
+    if (m_blockchain_based_list->block_height() == last_processed_block_index)
+    {
+      m_blockchain_based_list->remove_latest_block();
+      remove_auth_samples(last_processed_block_index);
+    }
+  }
+
+  return true;
+}
+
+void StakeTransactionProcessor::publish_updates(uint64_t top_block_index, size_t depth)
+{
+  get_supernode_stakes_snapshot_impl(top_block_index); //publish stakes of the top block for readers
+
+  update_auth_samples();
+
+  if (m_stakes_need_update && (m_on_stakes_update || m_on_stakes_change))
+    invoke_update_stakes_handler_impl(top_block_index);
+
+  if (m_blockchain_based_list_need_update && (m_on_blockchain_based_list_update || m_on_blockchain_based_list_change))
+    invoke_update_blockchain_based_list_handler_impl(depth);
+}
+
+void StakeTransactionProcessor::process_committed_block(uint64_t block_index, const crypto::hash& block_hash, const block& b, const std::vector<transaction>& txs)
+{
+  TRACE_SPAN("StakeTransactionProcessor::process_committed_block");
+
+    //the blockchain is locked by the caller; if synchronize() holds the storages, it will pick the block up
+
+  std::unique_lock<epee::critical_section> storage_lock{m_storage_lock, std::try_to_lock};
+
+  if (!storage_lock || !m_storage || !m_blockchain_based_list)
+    return;
+
+  uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(block_index);
+
+  if (hard_fork_version < config::graft::STAKE_TRANSACTION_PROCESSING_DB_VERSION)
+    return;
+
+    //only the block right after the processed ones; gaps and alternative chains are left to synchronize()
+
+  if (!m_storage->has_last_processed_block() || m_storage->get_last_processed_block_index() + 1 != block_index ||
+      m_blockchain_based_list->block_height() + 1 != block_index || m_storage->get_last_processed_block_hash() != b.prev_id)
+    return;
+
+  try
+  {
+    tools::metrics::histogram::timer sync_timer(sync_time);
+
+    std::vector<prepared_block> blocks(1);
+    prepared_block& block = blocks.front();
+
+    block.index                  = block_index;
+    block.hash                   = block_hash;
+    block.found                  = true;
+    block.has_stake_transactions = true;
+
+    for (size_t i=0; i<txs.size() && i<b.tx_hashes.size(); i++)
+    {
+      stake_transaction stake_tx;
+
+      if (parse_stake_transaction(block_index, b.tx_hashes[i], txs[i], hard_fork_version, stake_tx))
+        block.stake_txs.emplace_back(std::move(stake_tx));
+    }
+
+    check_stake_signatures(blocks);
+
+    process_block(block, false);
+
+    sync_blocks.inc();
+    sync_height.set(block_index + 1);
+
+    if (m_blockchain_based_list->need_store())
+      m_blockchain_based_list->store();
+
+    if (m_storage->need_store())
+      m_storage->store();
+
+    publish_updates(block_index, 1);
+  }
+  catch (const std::exception &e)
+  {
+    sync_errors.inc();
+    MWARNING(e.what());
+  }
+}
+
+void StakeTransactionProcessor::process_popped_block(uint64_t height)
+{
+  std::unique_lock<epee::critical_section> storage_lock{m_storage_lock, std::try_to_lock};
+
+  if (!storage_lock || !m_storage || !m_blockchain_based_list)
+    return;
+
+  try
+  {
+    unroll_processed_blocks(height);
+  }
+  catch (const std::exception &e)
+  {
+    sync_errors.inc();
+    MWARNING(e.what());
+  }
 }
 
 void StakeTransactionProcessor::synchronize()
 {
+  TRACE_SPAN("StakeTransactionProcessor::synchronize");
+
   std::unique_lock<epee::critical_section> storage_lock{m_storage_lock, std::defer_lock};
   std::unique_lock<Blockchain> blockchain_lock{m_blockchain, std::defer_lock};
   std::lock(storage_lock, blockchain_lock);
 
+  tools::metrics::histogram::timer sync_timer(sync_time);
   uint64_t height = m_blockchain.get_current_blockchain_height();
 
   if (!height || m_blockchain.get_hard_fork_version(height - 1) < config::graft::STAKE_TRANSACTION_PROCESSING_DB_VERSION)
@@ -304,42 +997,10 @@ void StakeTransactionProcessor::synchronize()
     init_storages_impl();
   }
 
-    //unroll already processed blocks for alternative chains
-  
   try
   {
-    while (m_storage->has_last_processed_block())
-    {
-      size_t   stake_tx_count = m_storage->get_tx_count();
-      uint64_t last_processed_block_index = m_storage->get_last_processed_block_index();
-
-      if (last_processed_block_index < height)
-      {
-        try
-        {
-          const crypto::hash& last_processed_block_hash  = m_storage->get_last_processed_block_hash();
-          crypto::hash        last_blockchain_block_hash = m_blockchain.get_block_id_by_height(last_processed_block_index);
-
-          if (!memcmp(&last_processed_block_hash.data[0], &last_blockchain_block_hash.data[0], sizeof(last_blockchain_block_hash.data)))
-            break; //latest block hash is the same as processed
-        }
-        catch (BLOCK_DNE&)
-        {
-          //block does not exist, waiting until it will be received
-          return;
-        }
-      }
-      
-      MWARNING("Stake transactions processing: unroll block " << last_processed_block_index << " (height=" << height << ")");
-
-      m_storage->remove_last_processed_block();
-
-      if (stake_tx_count != m_storage->get_tx_count())
-        m_storage->clear_supernode_stakes();
-
-      if (m_blockchain_based_list->block_height() == last_processed_block_index)
-        m_blockchain_based_list->remove_latest_block();
-    }
+    if (!unroll_processed_blocks(height))
+      return;
 
     //apply new blocks
 
@@ -350,6 +1011,7 @@ void StakeTransactionProcessor::synchronize()
 
     static const uint64_t SYNC_DEBUG_LOG_STEP  = 10000;
     static const uint64_t MAX_ITERATIONS_COUNT = 10000;
+    static const uint64_t SYNC_BATCH_SIZE      = 256;
 
     uint64_t last_block_index = first_block_index,
              last_block_index_for_sync = height;
@@ -357,31 +1019,37 @@ void StakeTransactionProcessor::synchronize()
     if (last_block_index_for_sync - last_block_index > MAX_ITERATIONS_COUNT)
       last_block_index_for_sync = first_block_index + MAX_ITERATIONS_COUNT;
 
-    for (; last_block_index<last_block_index_for_sync; last_block_index++)
+    std::vector<prepared_block> blocks;
+    bool all_blocks_found = true;
+
+    while (all_blocks_found && last_block_index < last_block_index_for_sync)
     {
-      if (last_block_index % SYNC_DEBUG_LOG_STEP == 0 || last_block_index == height - 1)
-        MDEBUG("RTA block sync " << last_block_index << "/" << (height - 1));
+      prepare_blocks(last_block_index, std::min(SYNC_BATCH_SIZE, last_block_index_for_sync - last_block_index), blocks);
 
-      try
+      for (const prepared_block& block : blocks)
       {
-        crypto::hash block_hash = m_blockchain.get_block_id_by_height(last_block_index);
-        block block;
+        if (last_block_index % SYNC_DEBUG_LOG_STEP == 0 || last_block_index == height - 1)
+          MDEBUG("RTA block sync " << last_block_index << "/" << (height - 1));
 
-        if (!m_blockchain.get_block_by_hash(block_hash, block))
+        if (!block.found)
         {
-          MWARNING("Block with hash " << block_hash << " has not been found");
-          throw std::runtime_error("Error at parsing blockchain. Block hash has not been found");
+          //block does not exist, waiting until it will be received
+          all_blocks_found = false;
+          break;
         }
 
-        process_block(last_block_index, block, block_hash, false);
-      }
-      catch (BLOCK_DNE&)
-      {
-        //block does not exist, waiting until it will be received
-        break;
+        if (!block.error.empty())
+          throw std::runtime_error("Error at parsing blockchain: " + block.error);
+
+        process_block(block, false);
+
+        last_block_index++;
       }
     }
 
+    sync_blocks.inc(last_block_index - first_block_index);
+    sync_height.set(last_block_index);
+
     if (m_blockchain_based_list->need_store())
       m_blockchain_based_list->store();
 
@@ -390,11 +1058,7 @@ void StakeTransactionProcessor::synchronize()
 
     if (last_block_index == height)
     {
-      if (m_stakes_need_update && m_on_stakes_update)
-        invoke_update_stakes_handler_impl(last_block_index - 1);
-
-      if (m_blockchain_based_list_need_update && m_on_blockchain_based_list_update)
-        invoke_update_blockchain_based_list_handler_impl(last_block_index - first_block_index);
+      publish_updates(last_block_index - 1, last_block_index - first_block_index);
 
       if (first_block_index != last_block_index)
         MDEBUG("Stake transactions sync OK");
@@ -402,6 +1066,7 @@ void StakeTransactionProcessor::synchronize()
   }
   catch (const std::exception &e)
   {
+    sync_errors.inc();
     MWARNING(e.what());
   }
 }
@@ -416,10 +1081,16 @@ void StakeTransactionProcessor::invoke_update_stakes_handler_impl(uint64_t block
 {
   try
   {
-    if (!m_storage)
+    supernode_stakes_snapshot_ptr snapshot = get_supernode_stakes_snapshot_impl(block_index);
+
+    if (!snapshot)
       return;
 
-    m_on_stakes_update(block_index, m_storage->get_supernode_stakes(block_index));
+    if (m_on_stakes_update)
+      m_on_stakes_update(block_index, snapshot->stakes);
+
+    if (m_stakes_need_update && m_on_stakes_change)
+      m_on_stakes_change(block_index, snapshot->stakes);
 
     m_stakes_need_update = false;
   }
@@ -442,6 +1113,12 @@ void StakeTransactionProcessor::invoke_update_stakes_handler(bool force)
   invoke_update_stakes_handler_impl(m_blockchain.get_db().height() - 1);
 }
 
+void StakeTransactionProcessor::set_on_stakes_change_handler(const supernode_stakes_update_handler& handler)
+{
+  CRITICAL_REGION_LOCAL1(m_storage_lock);
+  m_on_stakes_change = handler;
+}
+
 void StakeTransactionProcessor::set_on_update_blockchain_based_list_handler(const blockchain_based_list_update_handler& handler)
 {
   CRITICAL_REGION_LOCAL1(m_storage_lock);
@@ -466,8 +1143,12 @@ void StakeTransactionProcessor::invoke_update_blockchain_based_list_handler_impl
 
     uint64_t height = m_blockchain_based_list->block_height();
 
-    for (size_t i=0; i<depth; i++)
-      m_on_blockchain_based_list_update(height - i, m_blockchain_based_list->tiers(i));
+    if (m_on_blockchain_based_list_update)
+      for (size_t i=0; i<depth; i++)
+        m_on_blockchain_based_list_update(height - i, m_blockchain_based_list->tiers(i));
+
+    if (m_blockchain_based_list_need_update && m_on_blockchain_based_list_change)
+      m_on_blockchain_based_list_change(height, m_blockchain_based_list->tiers(0));
 
     m_blockchain_based_list_need_update = false;
   }
@@ -493,6 +1174,12 @@ void StakeTransactionProcessor::invoke_update_blockchain_based_list_handler(bool
   invoke_update_blockchain_based_list_handler_impl(depth);
 }
 
+void StakeTransactionProcessor::set_on_blockchain_based_list_change_handler(const blockchain_based_list_update_handler& handler)
+{
+  CRITICAL_REGION_LOCAL1(m_storage_lock);
+  m_on_blockchain_based_list_change = handler;
+}
+
 void StakeTransactionProcessor::set_enabled(bool arg)
 {
   m_enabled = arg;
@@ -502,3 +1189,33 @@ bool StakeTransactionProcessor::is_enabled() const
 {
   return m_enabled;
 }
+
+bool StakeTransactionProcessor::get_stake_txs_memory_usage(uint64_t& bytes) const
+{
+  std::unique_lock<epee::critical_section> lock(m_storage_lock, std::try_to_lock);
+
+  if (!lock.owns_lock())
+    return false;
+
+  bytes = tools::memory::hash_bytes(m_stake_signature_cache) + tools::memory::node_bytes(m_checkpoints);
+
+  for (const auto& checkpoint : m_checkpoints)
+    bytes += tools::memory::vector_bytes(checkpoint.second.storage.stake_txs) + tools::memory::node_bytes(checkpoint.second.storage.last_processed_block_hashes);
+
+  if (m_storage)
+    bytes += m_storage->get_memory_usage();
+
+  return true;
+}
+
+bool StakeTransactionProcessor::get_blockchain_based_list_memory_usage(uint64_t& bytes) const
+{
+  std::unique_lock<epee::critical_section> lock(m_storage_lock, std::try_to_lock);
+
+  if (!lock.owns_lock())
+    return false;
+
+  bytes = m_blockchain_based_list ? m_blockchain_based_list->get_memory_usage() : 0;
+
+  return true;
+}
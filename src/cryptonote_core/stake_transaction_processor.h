@@ -1,15 +1,62 @@
 #pragma once
 
 #include <functional>
+#include <map>
 #include <memory>
+#include <unordered_map>
 
 #include "blockchain.h"
+#include "common/memory_usage.h"
 #include "cryptonote_core/blockchain_based_list.h"
 #include "cryptonote_core/stake_transaction_storage.h"
+#include "cryptonote_core/graft_tx_extra_cache.h"
 
 namespace cryptonote
 {
 
+/// Immutable supernode stakes for a block; may be shared between threads without locking
+struct supernode_stakes_snapshot
+{
+  typedef StakeTransactionStorage::supernode_stake_array supernode_stake_array;
+
+  uint64_t block_number;
+  supernode_stake_array stakes;
+  std::unordered_map<std::string, size_t> stake_indexes;
+
+  /// Stake indexes by supernode public key in an open addressing table, so keys are looked up without hex conversions
+  std::vector<std::pair<crypto::public_key, size_t>> stake_key_table;
+
+  /// Stakes which make their supernode valid at block_number (at least tier 1 amount), by stake index
+  std::vector<bool> valid_stakes;
+
+  /// Search supernode stake by supernode public id (returns nullptr if no stake is found)
+  const supernode_stake* find_supernode_stake(const std::string& supernode_public_id) const;
+
+  /// Search supernode stake by supernode public key (returns nullptr if no stake is found)
+  const supernode_stake* find_supernode_stake(const crypto::public_key& supernode_public_key) const;
+
+  /// Check if the supernode with this public key has a valid stake at block_number
+  bool is_valid_supernode(const crypto::public_key& supernode_public_key) const;
+
+  /// Build stake_indexes, stake_key_table and valid_stakes from stakes
+  void build_indexes();
+
+private:
+  size_t find_stake_index(const crypto::public_key& supernode_public_key) const;
+};
+
+typedef std::shared_ptr<const supernode_stakes_snapshot> supernode_stakes_snapshot_ptr;
+
+/// Auth sample of a block; may be shared between threads without locking
+struct auth_sample
+{
+  uint64_t block_number;
+  crypto::hash block_hash;
+  BlockchainBasedList::supernode_array supernodes;
+};
+
+typedef std::shared_ptr<const auth_sample> auth_sample_ptr;
+
 class StakeTransactionProcessor
 {
 public:
@@ -20,12 +67,30 @@ public:
   /// Initialize storages
   void init_storages(const std::string& config_dir);
 
-  /// Search supernode stake by supernode public id (returns nullptr if no stake is found)
-  const supernode_stake* find_supernode_stake(uint64_t block_number, const std::string& supernode_public_id) const;
+  /// Get supernode stakes for the block (returns nullptr if storages are not initialized);
+  /// recently used snapshots are returned without waiting for the synchronization
+  supernode_stakes_snapshot_ptr get_supernode_stakes_snapshot(uint64_t block_number) const;
 
-  /// Synchronize with blockchain
+  /// Get auth sample of one of the latest SUPERNODE_HISTORY_SIZE blocks (returns nullptr if it's not available);
+  /// samples are precomputed at synchronization, so the call doesn't wait for it
+  auth_sample_ptr get_auth_sample(uint64_t block_number) const;
+
+  typedef std::vector<std::pair<uint64_t, supernode_stake_array>> block_stakes_array;
+
+  /// Get supernode stakes for blocks [first_block_number, first_block_number + count) which are in the supernodes history window
+  /// (returns false if storages are not initialized)
+  bool get_supernode_stakes(uint64_t first_block_number, uint64_t count, block_stakes_array& stakes) const;
+
+  /// Synchronize with blockchain; catch-up for blocks which haven't been processed on commit
   void synchronize();
 
+  /// Process the block just committed to the main chain from its parsed transactions and publish updates;
+  /// blocks which don't directly follow the processed ones are left to synchronize()
+  void process_committed_block(uint64_t block_index, const crypto::hash& block_hash, const block& b, const std::vector<transaction>& txs);
+
+  /// Unroll processed blocks which have been removed from the main chain
+  void process_popped_block(uint64_t height);
+
   typedef std::function<void(uint64_t block_number, const supernode_stake_array&)> supernode_stakes_update_handler;
 
   /// Update handler for new stakes
@@ -34,6 +99,10 @@ public:
   /// Force invoke update handler for stakes
   void invoke_update_stakes_handler(bool force = true);
 
+  /// Handler for stakes changes, unlike the update handler it isn't called on forced invocations
+  /// when nothing changed since the last call
+  void set_on_stakes_change_handler(const supernode_stakes_update_handler&);
+
   typedef BlockchainBasedList::supernode_tier_array supernode_tier_array;
   typedef std::function<void(uint64_t block_number, const supernode_tier_array&)> blockchain_based_list_update_handler;
 
@@ -43,19 +112,59 @@ public:
   /// Force invoke update handler for blockchain based list
   void invoke_update_blockchain_based_list_handler(bool force = true, size_t depth = 1);
 
+  /// Handler for blockchain based list changes, called with the list of the top block only
+  /// and not on forced invocations when nothing changed since the last call
+  void set_on_blockchain_based_list_change_handler(const blockchain_based_list_update_handler&);
+
+  typedef std::vector<std::pair<uint64_t, supernode_tier_array>> block_tiers_array;
+
+  /// Get blockchain based lists for blocks [first_block_number, first_block_number + count) which are in the list history
+  /// (returns false if storages are not initialized)
+  bool get_blockchain_based_lists(uint64_t first_block_number, uint64_t count, block_tiers_array& lists) const;
+
   /// Turns on/off processing
   void set_enabled(bool arg);
 
 
   bool is_enabled() const;
 
+  /// Parsed graft extras shared with the tx pool
+  graft_tx_extra_cache& get_tx_extra_cache() const { return m_tx_extra_cache; }
+
 private:
+  /// Block loaded from blockchain with parsed stake transactions
+  struct prepared_block
+  {
+    uint64_t index;
+    crypto::hash hash;
+    bool found;                  //false if block does not exist yet
+    bool has_stake_transactions; //block has to be scanned for stake transactions
+    std::vector<stake_transaction> stake_txs;
+    std::string error;
+
+    prepared_block() : index(), hash(crypto::null_hash), found(), has_stake_transactions() {}
+  };
+
   void init_storages_impl();
-  void process_block(uint64_t block_index, const block& block, const crypto::hash& block_hash, bool update_storage = true);
+  bool parse_stake_transaction(uint64_t block_index, const crypto::hash& tx_hash, const transaction& tx, uint8_t current_hard_fork_version, stake_transaction& stake_tx) const;
+  void prepare_block(uint8_t current_hard_fork_version, prepared_block& block) const;
+  void prepare_blocks(uint64_t first_block_index, size_t count, std::vector<prepared_block>& blocks) const;
+  void check_stake_signatures(std::vector<prepared_block>& blocks) const;
+  supernode_stakes_snapshot_ptr get_supernode_stakes_snapshot_impl(uint64_t block_number) const;
+  void remove_supernode_stakes_snapshots(uint64_t first_block_number);
+  void update_auth_samples();
+  void remove_auth_samples(uint64_t first_block_number);
+  void process_block(const prepared_block& block, bool update_storage = true);
+  void add_checkpoint(const prepared_block& block);
+  bool restore_checkpoint(uint64_t height);
   void invoke_update_stakes_handler_impl(uint64_t block_index);
+  bool unroll_processed_blocks(uint64_t height);
+  void publish_updates(uint64_t top_block_index, size_t depth);
   void invoke_update_blockchain_based_list_handler_impl(size_t depth);
-  void process_block_stake_transaction(uint64_t block_index, const block& block, const crypto::hash& block_hash, bool update_storage = true);
-  void process_block_blockchain_based_list(uint64_t block_index, const block& block, const crypto::hash& block_hash, bool update_storage = true);
+  void process_block_stake_transaction(const prepared_block& block, bool update_storage = true);
+  void process_block_blockchain_based_list(const prepared_block& block, bool update_storage = true);
+  bool get_stake_txs_memory_usage(uint64_t& bytes) const;
+  bool get_blockchain_based_list_memory_usage(uint64_t& bytes) const;
 
 private:
   std::string m_config_dir;
@@ -65,9 +174,38 @@ private:
   mutable epee::critical_section m_storage_lock;
   supernode_stakes_update_handler m_on_stakes_update;
   blockchain_based_list_update_handler m_on_blockchain_based_list_update;
+  supernode_stakes_update_handler m_on_stakes_change;
+  blockchain_based_list_update_handler m_on_blockchain_based_list_change;
   bool m_stakes_need_update;
   bool m_blockchain_based_list_need_update;
   bool m_enabled {true};
+  mutable std::unordered_map<crypto::hash, bool> m_stake_signature_cache; //results of supernode signature checks
+  mutable graft_tx_extra_cache m_tx_extra_cache;
+
+  typedef std::map<uint64_t, supernode_stakes_snapshot_ptr> supernode_stakes_snapshot_map;
+  typedef std::shared_ptr<const supernode_stakes_snapshot_map> supernode_stakes_snapshot_map_ptr;
+
+  mutable supernode_stakes_snapshot_map_ptr m_stakes_snapshots; //copy-on-write; replaced under m_storage_lock, read with std::atomic_load
+
+  typedef std::map<uint64_t, auth_sample_ptr> auth_sample_map;
+  typedef std::shared_ptr<const auth_sample_map> auth_sample_map_ptr;
+
+  auth_sample_map_ptr m_auth_samples; //copy-on-write; replaced under m_storage_lock, read with std::atomic_load
+
+  /// State of the storages at a processed block
+  struct checkpoint
+  {
+    crypto::hash block_hash;
+    StakeTransactionStorage::checkpoint storage;
+    BlockchainBasedList::checkpoint blockchain_based_list;
+  };
+
+  typedef std::map<uint64_t, checkpoint> checkpoint_map;
+
+  checkpoint_map m_checkpoints; //latest checkpoints which let reorganizations deeper than the storages history skip the replay from the first block
+
+  tools::memory::account m_stake_txs_memory{"stake_txs", [this](uint64_t& bytes) { return get_stake_txs_memory_usage(bytes); }};
+  tools::memory::account m_blockchain_based_list_memory{"blockchain_based_list", [this](uint64_t& bytes) { return get_blockchain_based_list_memory_usage(bytes); }};
 };
 
 }
@@ -4,6 +4,8 @@
 #include "serialization/binary_utils.h"
 #include "../graft_rta_config.h"
 #include "stake_transaction_storage.h"
+#include "storage_journal.h"
+#include "common/memory_usage.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "staketransaction.storage"
@@ -15,9 +17,12 @@ namespace
 
 const uint64_t BLOCK_HASHES_HISTORY_DEPTH       = 1000;
 const uint64_t STAKE_TRANSACTIONS_HISTORY_DEPTH = BLOCK_HASHES_HISTORY_DEPTH + config::graft::STAKE_VALIDATION_PERIOD + config::graft::TRUSTED_RESTAKING_PERIOD;
+const size_t   JOURNAL_MAX_RECORDS_COUNT        = 1000; //journal is compacted to a new snapshot after this number of records
+const char*    JOURNAL_FILE_NAME_SUFFIX         = ".journal";
 
 struct stake_transaction_file_data
 {
+  uint64_t journal_generation;
   uint64_t last_processed_block_index;
   size_t last_processed_block_hashes_count;
   StakeTransactionStorage::stake_transaction_array& stake_txs;
@@ -25,7 +30,8 @@ struct stake_transaction_file_data
 
   stake_transaction_file_data(uint64_t in_last_processed_block_index, StakeTransactionStorage::stake_transaction_array& in_stake_txs,
     size_t in_last_processed_block_hashes_count, StakeTransactionStorage::block_hash_list& in_block_hashes)
-    : last_processed_block_index(in_last_processed_block_index)
+    : journal_generation()
+    , last_processed_block_index(in_last_processed_block_index)
     , last_processed_block_hashes_count(in_last_processed_block_hashes_count)
     , stake_txs(in_stake_txs)
     , block_hashes(in_block_hashes)
@@ -33,6 +39,7 @@ struct stake_transaction_file_data
   }
 
   BEGIN_SERIALIZE_OBJECT()
+    FIELD(journal_generation)
     FIELD(last_processed_block_index)
     FIELD(last_processed_block_hashes_count)
     FIELD(block_hashes)
@@ -40,6 +47,29 @@ struct stake_transaction_file_data
   END_SERIALIZE()
 };
 
+enum stake_transaction_journal_record_type
+{
+  JOURNAL_RECORD_ADD_BLOCK = 1,
+  JOURNAL_RECORD_REMOVE_BLOCK,
+};
+
+struct stake_transaction_journal_record
+{
+  uint8_t type;
+  uint64_t block_index;
+  crypto::hash block_hash;
+  StakeTransactionStorage::stake_transaction_array stake_txs;
+
+  stake_transaction_journal_record() : type(), block_index(), block_hash(crypto::null_hash) {}
+
+  BEGIN_SERIALIZE_OBJECT()
+    FIELD(type)
+    FIELD(block_index)
+    FIELD(block_hash)
+    FIELD(stake_txs)
+  END_SERIALIZE()
+};
+
 }
 
 StakeTransactionStorage::StakeTransactionStorage(const std::string& storage_file_name, uint64_t first_block_number)
@@ -48,7 +78,12 @@ StakeTransactionStorage::StakeTransactionStorage(const std::string& storage_file
   , m_last_processed_block_hashes_count()
   , m_need_store()
   , m_supernode_stakes_update_block_number()
+  , m_stakes_history_first_block_number()
+  , m_historical_stakes_block_number()
   , m_first_block_number(first_block_number)
+  , m_journal(storage_file_name + JOURNAL_FILE_NAME_SUFFIX)
+  , m_journaled_tx_count()
+  , m_need_snapshot()
 {
   load();
 }
@@ -57,6 +92,19 @@ void StakeTransactionStorage::add_tx(const stake_transaction& tx)
 {
   m_stake_txs.push_back(tx);
 
+  if (m_supernode_stakes_update_block_number)
+  {
+      //register transaction in the index of supernode stakes
+
+    size_t tx_index = m_stake_txs.size() - 1;
+
+    m_supernode_tx_indexes[tx.supernode_public_id].push_back(tx_index);
+
+    add_stake_events(tx_index, m_supernode_stakes_update_block_number);
+
+    m_dirty_supernodes.insert(tx.supernode_public_id);
+  }
+
   m_need_store = true;
 }
 
@@ -87,6 +135,20 @@ void StakeTransactionStorage::add_last_processed_block(uint64_t index, const cry
   }
 
   m_last_processed_block_index = index;
+
+    //journal new block with its stake transactions
+
+  stake_transaction_journal_record record;
+
+  record.type        = JOURNAL_RECORD_ADD_BLOCK;
+  record.block_index = index;
+  record.block_hash  = hash;
+
+  record.stake_txs.assign(m_stake_txs.begin() + m_journaled_tx_count, m_stake_txs.end());
+
+  m_journaled_tx_count = m_stake_txs.size();
+
+  add_journal_record(record);
 }
 
 void StakeTransactionStorage::remove_last_processed_block()
@@ -96,10 +158,15 @@ void StakeTransactionStorage::remove_last_processed_block()
 
   m_need_store = true;
 
+  size_t stake_tx_count = m_stake_txs.size();
+
   m_stake_txs.erase(std::remove_if(m_stake_txs.begin(), m_stake_txs.end(), [&](const stake_transaction& tx) {
     return tx.block_height == m_last_processed_block_index;
   }), m_stake_txs.end());
 
+  if (stake_tx_count != m_stake_txs.size())
+    clear_supernode_stakes(); //indexes of stake transactions are not valid anymore
+
   m_last_processed_block_hashes_count--;
   m_last_processed_block_index--;
 
@@ -111,12 +178,100 @@ void StakeTransactionStorage::remove_last_processed_block()
 
     m_stake_txs.clear();
 
+    clear_supernode_stakes();
+
     m_last_processed_block_index = m_first_block_number;
   }
+
+  if (m_journaled_tx_count > m_stake_txs.size())
+    m_journaled_tx_count = m_stake_txs.size();
+
+  stake_transaction_journal_record record;
+
+  record.type = JOURNAL_RECORD_REMOVE_BLOCK;
+
+  add_journal_record(record);
+}
+
+void StakeTransactionStorage::get_checkpoint(checkpoint& result) const
+{
+  result.last_processed_block_index        = m_last_processed_block_index;
+  result.last_processed_block_hashes       = m_last_processed_block_hashes;
+  result.last_processed_block_hashes_count = m_last_processed_block_hashes_count;
+  result.stake_txs                         = m_stake_txs;
+}
+
+void StakeTransactionStorage::restore_checkpoint(const checkpoint& checkpoint)
+{
+  m_last_processed_block_index        = checkpoint.last_processed_block_index;
+  m_last_processed_block_hashes       = checkpoint.last_processed_block_hashes;
+  m_last_processed_block_hashes_count = checkpoint.last_processed_block_hashes_count;
+  m_stake_txs                         = checkpoint.stake_txs;
+
+  clear_supernode_stakes();
+
+    //pending journal records are superseded by the snapshot
+
+  m_journal_records.clear();
+
+  m_journaled_tx_count = m_stake_txs.size();
+  m_need_store         = true;
+  m_need_snapshot      = true;
+}
+
+template <class T> void StakeTransactionStorage::add_journal_record(T& record)
+{
+  std::string blob;
+
+  if (!::serialization::dump_binary(record, blob))
+    throw std::runtime_error("internal error: failed to serialize stake transaction storage journal record");
+
+  m_journal_records.emplace_back(std::move(blob));
+}
+
+bool StakeTransactionStorage::apply_journal_record(const std::string& blob)
+{
+  stake_transaction_journal_record record;
+
+  if (!::serialization::parse_binary(blob, record))
+  {
+    MWARNING("Can't parse stake transaction storage journal record");
+    return false;
+  }
+
+  switch (record.type)
+  {
+    case JOURNAL_RECORD_ADD_BLOCK:
+      if (record.block_index != m_last_processed_block_index + 1)
+      {
+        MWARNING("Unexpected block " << record.block_index << " in stake transaction storage journal (last processed block is " <<
+          m_last_processed_block_index << ")");
+        return false;
+      }
+
+      for (const stake_transaction& tx : record.stake_txs)
+        add_tx(tx);
+
+      add_last_processed_block(record.block_index, record.block_hash);
+
+      return true;
+    case JOURNAL_RECORD_REMOVE_BLOCK:
+      remove_last_processed_block();
+      return true;
+    default:
+      MWARNING("Unknown stake transaction storage journal record type " << int(record.type));
+      return false;
+  }
 }
 
 const StakeTransactionStorage::supernode_stake_array& StakeTransactionStorage::get_supernode_stakes(uint64_t block_number)
 {
+  if (is_in_stakes_history(block_number))
+  {
+    build_historical_stakes(block_number);
+    return m_historical_stakes;
+  }
+
   update_supernode_stakes(block_number);
   return m_supernode_stakes;
 }
@@ -125,8 +280,16 @@ void StakeTransactionStorage::clear_supernode_stakes()
 {
   m_supernode_stakes.clear();
   m_supernode_stake_indexes.clear();
+  m_supernode_tx_indexes.clear();
+  m_stake_events.clear();
+  m_dirty_supernodes.clear();
+  m_stakes_history.clear();
+  m_historical_stakes.clear();
+  m_historical_stake_indexes.clear();
 
   m_supernode_stakes_update_block_number = 0;
+  m_stakes_history_first_block_number    = 0;
+  m_historical_stakes_block_number       = 0;
 }
 
 namespace
@@ -141,138 +304,288 @@ unsigned int get_tier(uint64_t stake)
     (stake >= config::graft::TIER4_STAKE_AMOUNT);
 }
 
+/// Stake transaction is invalid and is out of supernodes history window
+bool is_stake_transaction_expired(const stake_transaction& tx, uint64_t block_number)
+{
+  if (tx.is_valid(block_number))
+    return false;
+
+  uint64_t first_history_block = block_number - config::graft::SUPERNODE_HISTORY_SIZE;
+
+  return tx.block_height + tx.unlock_time < first_history_block;
 }
 
-void StakeTransactionStorage::update_supernode_stakes(uint64_t block_number)
+/// Accumulate stake transaction to the supernode stake (returns false if transaction has been ignored)
+bool accumulate_stake_transaction(uint64_t block_number, const stake_transaction& tx, bool has_stake, supernode_stake& stake)
 {
-  if (block_number == m_supernode_stakes_update_block_number)
-    return;
+  if (is_stake_transaction_expired(tx, block_number))
+    return false;
 
-  MDEBUG("Build stakes for block " << block_number);
+    //add stake transaction with zero amount to indicate correspondent node presense for search in supernode
 
-  m_supernode_stakes.clear();
-  m_supernode_stake_indexes.clear();
+  bool obsolete_stake = !tx.is_valid(block_number);
 
-  try
+  MDEBUG("...use stake transaction " << tx.hash << " as " << (obsolete_stake ? "obsolete" : "normal") << " stake transaction ");
+
+    //compute stake validity period
+
+  uint64_t min_tx_block_height = tx.block_height + config::graft::STAKE_VALIDATION_PERIOD,
+           max_tx_block_height = tx.block_height + tx.unlock_time + config::graft::TRUSTED_RESTAKING_PERIOD;
+
+  if (!has_stake)
   {
-    m_supernode_stakes.reserve(m_stake_txs.size());
+      //add new supernode stake
 
-    for (const stake_transaction& tx : m_stake_txs)
+    if (obsolete_stake)
+    {
+      stake.amount       = 0;
+      stake.tier         = 0;
+      stake.block_height = 0;
+      stake.unlock_time  = 0;
+    }
+    else
     {
-      bool obsolete_stake = false;
+      stake.amount       = tx.amount;
+      stake.tier         = get_tier(stake.amount);
+      stake.block_height = min_tx_block_height;
+      stake.unlock_time  = max_tx_block_height - min_tx_block_height;
 
-      if (!tx.is_valid(block_number))
-      {
-        uint64_t first_history_block = block_number - config::graft::SUPERNODE_HISTORY_SIZE;
+      MDEBUG("...first stake transaction for supernode " << tx.supernode_public_id << ": amount=" << tx.amount << ", tier=" <<
+        stake.tier << ", validity=[" << min_tx_block_height << ";" << max_tx_block_height << ")");
+    }
 
-        if (tx.block_height + tx.unlock_time < first_history_block)
-          continue;
+    stake.supernode_public_id      = tx.supernode_public_id;
+    stake.supernode_public_address = tx.supernode_public_address;
 
-          //add stake transaction with zero amount to indicate correspondent node presense for search in supernode
+    return true;
+  }
 
-        obsolete_stake = true;
-      }
+    //update existing supernode's stake
 
-      MDEBUG("...use stake transaction " << tx.hash << " as " << (obsolete_stake ? "obsolete" : "normal") << " stake transaction ");
+  if (obsolete_stake)
+    return true; //no need to aggregate fields from obsolete stake
 
-        //compute stake validity period
+  MDEBUG("...accumulate stake transaction for supernode " << tx.supernode_public_id << ": amount=" << tx.amount <<
+    ", validity=[" << min_tx_block_height << ";" << max_tx_block_height << ")");
 
-      uint64_t min_tx_block_height = tx.block_height + config::graft::STAKE_VALIDATION_PERIOD,
-               max_tx_block_height = tx.block_height + tx.unlock_time + config::graft::TRUSTED_RESTAKING_PERIOD;
+  if (!stake.amount)
+  {
+      //set fields for supernode which has been constructed for obsolete stake
 
-        //search for a stake of the corresponding supernode
+    stake.amount       = tx.amount;
+    stake.tier         = get_tier(stake.amount);
+    stake.block_height = min_tx_block_height;
+    stake.unlock_time  = max_tx_block_height - min_tx_block_height;
 
-      supernode_stake_index_map::iterator it = m_supernode_stake_indexes.find(tx.supernode_public_id);
+    return true;
+  }
 
-      if (it == m_supernode_stake_indexes.end())
-      {
-          //add new supernode stake
+    //aggregate fields for existing stake
 
-        supernode_stake new_stake;
+  stake.amount += tx.amount;
+  stake.tier    = get_tier(stake.amount);
 
-        if (obsolete_stake)
-        {
-          new_stake.amount       = 0;
-          new_stake.tier         = 0;
-          new_stake.block_height = 0;
-          new_stake.unlock_time  = 0;
-        }
-        else
-        {
-          new_stake.amount       = tx.amount;
-          new_stake.tier         = get_tier(new_stake.amount);
-          new_stake.block_height = min_tx_block_height;
-          new_stake.unlock_time  = max_tx_block_height - min_tx_block_height;
+    //find intersection of stake transaction intervals
 
-          MDEBUG("...first stake transaction for supernode " << tx.supernode_public_id << ": amount=" << tx.amount << ", tier=" <<
-            new_stake.tier << ", validity=[" << min_tx_block_height << ";" << max_tx_block_height << ")");
-        }
+  uint64_t min_block_height = stake.block_height,
+           max_block_height = min_block_height + stake.unlock_time;
 
-        new_stake.supernode_public_id      = tx.supernode_public_id;
-        new_stake.supernode_public_address = tx.supernode_public_address;
+  if (min_tx_block_height > min_block_height)
+    min_block_height = min_tx_block_height;
 
-        m_supernode_stakes.emplace_back(std::move(new_stake));
+  if (max_tx_block_height < max_block_height)
+    max_block_height = max_tx_block_height;
 
-        m_supernode_stake_indexes[tx.supernode_public_id] = m_supernode_stakes.size() - 1;
+  if (max_block_height <= min_block_height)
+    max_block_height = min_block_height;
 
-        continue;
-      }
+  stake.block_height = min_block_height;
+  stake.unlock_time  = max_block_height - min_block_height;
 
-        //update existing supernode's stake
+  MDEBUG("...stake for supernode " << tx.supernode_public_id << ": amount=" << stake.amount << ", tier=" << stake.tier <<
+    ", validity=[" << min_block_height << ";" << max_block_height << ")");
 
-      if (obsolete_stake)
-        continue; //no need to aggregate fields from obsolete stake
+  return true;
+}
 
-      MDEBUG("...accumulate stake transaction for supernode " << tx.supernode_public_id << ": amount=" << tx.amount <<
-        ", validity=[" << min_tx_block_height << ";" << max_tx_block_height << ")");
+}
 
-      supernode_stake& stake = m_supernode_stakes[it->second];
+void StakeTransactionStorage::add_stake_events(size_t tx_index, uint64_t block_number)
+{
+  const stake_transaction& tx = m_stake_txs[tx_index];
 
-      if (!stake.amount)
-      {
-          //set fields for supernode which has been constructed for obsolete stake
+    //stake transaction changes its state at activation, at expiration and at leaving supernodes history window
 
-        stake.amount       = tx.amount;
-        stake.tier         = get_tier(stake.amount);
-        stake.block_height = min_tx_block_height;
-        stake.unlock_time  = max_tx_block_height - min_tx_block_height;
+  const uint64_t event_heights[] = {
+    tx.block_height + config::graft::STAKE_VALIDATION_PERIOD,
+    tx.block_height + tx.unlock_time + config::graft::TRUSTED_RESTAKING_PERIOD,
+    tx.block_height + tx.unlock_time + config::graft::SUPERNODE_HISTORY_SIZE + 1,
+  };
 
-        continue;
-      }
+  for (uint64_t height : event_heights)
+    if (height > block_number)
+      m_stake_events.emplace(height, tx_index);
+}
 
-        //aggregate fields for existing stake
+void StakeTransactionStorage::update_supernode_stake(uint64_t block_number, const std::string& supernode_public_id)
+{
+  supernode_stake stake;
+  bool has_stake = false;
 
-      stake.amount += tx.amount;
-      stake.tier    = get_tier(stake.amount);
+  supernode_tx_index_map::iterator txs_it = m_supernode_tx_indexes.find(supernode_public_id);
 
-        //find intersection of stake transaction intervals
+  if (txs_it != m_supernode_tx_indexes.end())
+  {
+    std::vector<size_t>& tx_indexes = txs_it->second;
+
+      //expired transactions will never be used again until full rebuild of stakes
 
-      uint64_t min_block_height = stake.block_height,
-               max_block_height = min_block_height + stake.unlock_time;
+    tx_indexes.erase(std::remove_if(tx_indexes.begin(), tx_indexes.end(), [&](size_t tx_index) {
+      return is_stake_transaction_expired(m_stake_txs[tx_index], block_number);
+    }), tx_indexes.end());
 
-      if (min_tx_block_height > min_block_height)
-        min_block_height = min_tx_block_height;
+    for (size_t tx_index : tx_indexes)
+      if (accumulate_stake_transaction(block_number, m_stake_txs[tx_index], has_stake, stake))
+        has_stake = true;
 
-      if (max_tx_block_height < max_block_height)
-        max_block_height = max_tx_block_height;
+    if (tx_indexes.empty())
+      m_supernode_tx_indexes.erase(txs_it);
+  }
 
-      if (max_block_height <= min_block_height)
-        max_block_height = min_block_height;
+  supernode_stake_index_map::iterator it = m_supernode_stake_indexes.find(supernode_public_id);
 
-      stake.block_height = min_block_height;
-      stake.unlock_time  = max_block_height - min_block_height;
+  add_stake_version(block_number, supernode_public_id, has_stake ? &stake : nullptr);
 
-      MDEBUG("...stake for supernode " << tx.supernode_public_id << ": amount=" << stake.amount << ", tier=" << stake.tier <<
-        ", validity=[" << min_block_height << ";" << max_block_height << ")");
+  if (has_stake)
+  {
+    if (it == m_supernode_stake_indexes.end())
+    {
+      m_supernode_stakes.emplace_back(std::move(stake));
+      m_supernode_stake_indexes[supernode_public_id] = m_supernode_stakes.size() - 1;
+    }
+    else
+    {
+      m_supernode_stakes[it->second] = std::move(stake);
+    }
+
+    return;
+  }
+
+  if (it == m_supernode_stake_indexes.end())
+    return;
+
+    //remove supernode stake by moving the last stake to its place
+
+  size_t index = it->second;
+
+  m_supernode_stake_indexes.erase(it);
+
+  if (index != m_supernode_stakes.size() - 1)
+  {
+    m_supernode_stakes[index] = std::move(m_supernode_stakes.back());
+    m_supernode_stake_indexes[m_supernode_stakes[index].supernode_public_id] = index;
+  }
+
+  m_supernode_stakes.pop_back();
+}
+
+void StakeTransactionStorage::rebuild_supernode_stakes(uint64_t block_number)
+{
+  MDEBUG("Build stakes for block " << block_number);
+
+  clear_supernode_stakes();
+
+  try
+  {
+    m_supernode_stakes.reserve(m_stake_txs.size());
+
+    for (size_t i=0, count=m_stake_txs.size(); i<count; i++)
+    {
+      m_supernode_tx_indexes[m_stake_txs[i].supernode_public_id].push_back(i);
+
+      add_stake_events(i, block_number);
+    }
+
+      //build stakes in order of first stake transaction of each supernode
+
+    for (size_t i=0, count=m_stake_txs.size(); i<count; i++)
+    {
+      const std::string& supernode_public_id = m_stake_txs[i].supernode_public_id;
+
+      supernode_tx_index_map::const_iterator txs_it = m_supernode_tx_indexes.find(supernode_public_id);
+
+      if (txs_it == m_supernode_tx_indexes.end() || txs_it->second.front() != i)
+        continue;
+
+      update_supernode_stake(block_number, supernode_public_id);
     }
   }
   catch (...)
   {
-    m_supernode_stakes.clear();
-    m_supernode_stake_indexes.clear();
+    clear_supernode_stakes();
+    throw;
+  }
+
+  m_supernode_stakes_update_block_number = block_number;
+  m_stakes_history_first_block_number    = block_number;
+}
+
+void StakeTransactionStorage::update_supernode_stakes(uint64_t block_number)
+{
+  if (block_number == m_supernode_stakes_update_block_number && m_dirty_supernodes.empty())
+    return;
+
+    //incremental update is possible only forward and after supernodes history window is filled
 
-    m_supernode_stakes_update_block_number = 0;
+  if (!m_supernode_stakes_update_block_number || block_number < m_supernode_stakes_update_block_number ||
+      block_number <= config::graft::SUPERNODE_HISTORY_SIZE)
+  {
+    rebuild_supernode_stakes(block_number);
+    return;
+  }
 
+  MDEBUG("Update stakes for block " << block_number);
+
+  try
+  {
+      //update supernodes which stake transactions have changed their state at the heights of the changes,
+      //so the stakes history has stakes of the skipped blocks; supernodes with new stake transactions are updated last
+
+    stake_event_queue::iterator events_end = m_stake_events.upper_bound(block_number);
+    supernode_id_set changed_supernodes;
+
+    for (stake_event_queue::iterator it=m_stake_events.begin(); it!=events_end;)
+    {
+      const uint64_t height = it->first;
+
+      changed_supernodes.clear();
+
+      for (; it!=events_end && it->first == height; ++it)
+      {
+        const std::string& supernode_public_id = m_stake_txs[it->second].supernode_public_id;
+
+        if (height == block_number || m_dirty_supernodes.find(supernode_public_id) != m_dirty_supernodes.end())
+          m_dirty_supernodes.insert(supernode_public_id);
+        else
+          changed_supernodes.insert(supernode_public_id);
+      }
+
+      for (const std::string& supernode_public_id : changed_supernodes)
+        update_supernode_stake(height, supernode_public_id);
+    }
+
+    m_stake_events.erase(m_stake_events.begin(), events_end);
+
+    for (const std::string& supernode_public_id : m_dirty_supernodes)
+      update_supernode_stake(block_number, supernode_public_id);
+
+    m_dirty_supernodes.clear();
+
+    prune_stakes_history(block_number);
+  }
+  catch (...)
+  {
+    clear_supernode_stakes();
     throw;
   }
 
@@ -281,6 +594,18 @@ void StakeTransactionStorage::update_supernode_stakes(uint64_t block_number)
 
 const supernode_stake* StakeTransactionStorage::find_supernode_stake(uint64_t block_number, const std::string& supernode_public_id)
 {
+  if (is_in_stakes_history(block_number))
+  {
+    if (block_number != m_historical_stakes_block_number)
+      return find_stake_version(block_number, supernode_public_id);
+
+      //the stake is in the list returned for the block, as it is for the current stakes
+
+    supernode_stake_index_map::const_iterator it = m_historical_stake_indexes.find(supernode_public_id);
+
+    return it != m_historical_stake_indexes.end() ? &m_historical_stakes[it->second] : nullptr;
+  }
+
   update_supernode_stakes(block_number);
 
   supernode_stake_index_map::const_iterator it = m_supernode_stake_indexes.find(supernode_public_id);
@@ -291,58 +616,253 @@ const supernode_stake* StakeTransactionStorage::find_supernode_stake(uint64_t bl
   return &m_supernode_stakes[it->second];
 }
 
-void StakeTransactionStorage::load()
+bool StakeTransactionStorage::is_in_stakes_history(uint64_t block_number) const
 {
-  if (!boost::filesystem::exists(m_storage_file_name))
+    //stakes of the last updated block are the current ones; the history is kept only while stakes are updated incrementally
+
+  if (!m_stakes_history_first_block_number || block_number <= config::graft::SUPERNODE_HISTORY_SIZE)
+    return false;
+
+  return block_number >= m_stakes_history_first_block_number && block_number < m_supernode_stakes_update_block_number &&
+         block_number + config::graft::SUPERNODE_HISTORY_SIZE >= m_supernode_stakes_update_block_number;
+}
+
+void StakeTransactionStorage::add_stake_version(uint64_t block_number, const std::string& supernode_public_id, const supernode_stake* stake)
+{
+  std::vector<supernode_stake_version>& versions = m_stakes_history[supernode_public_id];
+
+  if (!versions.empty() && versions.back().block_number == block_number)
+    versions.pop_back(); //stake has been updated again for the same block
+
+  if (!stake && (versions.empty() || !versions.back().has_stake))
     return;
 
-  std::string buffer;
-  bool r = epee::file_io_utils::load_file_to_string(m_storage_file_name, buffer);
+  versions.push_back(supernode_stake_version());
 
-  CHECK_AND_ASSERT_THROW_MES(r, "stake transaction storage file '" << m_storage_file_name << "' is not found");
+  supernode_stake_version& version = versions.back();
 
-  try
+  version.block_number = block_number;
+  version.has_stake    = stake != nullptr;
+
+  if (stake)
+    version.stake = *stake;
+}
+
+const supernode_stake* StakeTransactionStorage::find_stake_version(uint64_t block_number, const std::string& supernode_public_id) const
+{
+  supernode_stakes_history_map::const_iterator it = m_stakes_history.find(supernode_public_id);
+
+  if (it == m_stakes_history.end())
+    return nullptr;
+
+    //the last version which starts at or before the block
+
+  const std::vector<supernode_stake_version>& versions = it->second;
+
+  std::vector<supernode_stake_version>::const_iterator version = std::upper_bound(versions.begin(), versions.end(), block_number,
+    [](uint64_t block_number, const supernode_stake_version& version) { return block_number < version.block_number; });
+
+  if (version == versions.begin())
+    return nullptr;
+
+  --version;
+
+  return version->has_stake ? &version->stake : nullptr;
+}
+
+void StakeTransactionStorage::build_historical_stakes(uint64_t block_number)
+{
+  if (block_number == m_historical_stakes_block_number)
+    return;
+
+  MDEBUG("Build stakes for block " << block_number << " from stakes history");
+
+  m_historical_stakes.clear();
+  m_historical_stake_indexes.clear();
+
+  m_historical_stakes_block_number = 0;
+
+    //same order as rebuilt stakes: by first stake transaction of each supernode
+
+  m_historical_stakes.reserve(m_stakes_history.size());
+
+  for (const stake_transaction& tx : m_stake_txs)
   {
-    LOG_PRINT_L0("Trying to parse stake transaction file");
+    if (m_historical_stake_indexes.find(tx.supernode_public_id) != m_historical_stake_indexes.end())
+      continue;
+
+    const supernode_stake* stake = find_stake_version(block_number, tx.supernode_public_id);
+
+    m_historical_stake_indexes[tx.supernode_public_id] = stake ? m_historical_stakes.size() : SIZE_MAX;
+
+    if (stake)
+      m_historical_stakes.push_back(*stake);
+  }
+
+  for (supernode_stake_index_map::iterator it=m_historical_stake_indexes.begin(); it!=m_historical_stake_indexes.end();)
+  {
+    if (it->second == SIZE_MAX) it = m_historical_stake_indexes.erase(it);
+    else                        ++it;
+  }
 
-    StakeTransactionStorage::stake_transaction_array tmp_stake_txs;
-    StakeTransactionStorage::block_hash_list tmp_block_hashes;
-    stake_transaction_file_data data(0, tmp_stake_txs, 0, tmp_block_hashes);
+  m_historical_stakes_block_number = block_number;
+}
+
+void StakeTransactionStorage::prune_stakes_history(uint64_t block_number)
+{
+    //versions are pruned once per history window, so it takes amortized constant time per block
+
+  if (block_number < m_stakes_history_first_block_number + 2 * config::graft::SUPERNODE_HISTORY_SIZE)
+    return;
+
+  const uint64_t first_block_number = block_number - config::graft::SUPERNODE_HISTORY_SIZE;
+
+  for (supernode_stakes_history_map::iterator it=m_stakes_history.begin(); it!=m_stakes_history.end();)
+  {
+    std::vector<supernode_stake_version>& versions = it->second;
 
-    r = ::serialization::parse_binary(buffer, data);
+      //keep the version which is in effect at the first block of the window
 
-    CHECK_AND_ASSERT_THROW_MES(r, "internal error: failed to deserialize stake transaction storage file '" << m_storage_file_name << "'");
+    size_t first_used = 0;
 
-    m_last_processed_block_index        = data.last_processed_block_index;
-    m_last_processed_block_hashes_count = data.last_processed_block_hashes_count;
+    while (first_used + 1 < versions.size() && versions[first_used + 1].block_number <= first_block_number)
+      first_used++;
 
-    std::swap(m_stake_txs, data.stake_txs);
-    std::swap(m_last_processed_block_hashes, data.block_hashes);
+    versions.erase(versions.begin(), versions.begin() + first_used);
 
-    m_need_store = false;
+    if (versions.size() == 1 && !versions.front().has_stake && versions.front().block_number <= first_block_number)
+      it = m_stakes_history.erase(it);
+    else
+      ++it;
   }
-  catch (...)
+
+  m_stakes_history_first_block_number = first_block_number;
+  m_historical_stakes_block_number    = 0;
+}
+
+void StakeTransactionStorage::load()
+{
+  uint64_t journal_generation = 0;
+
+  if (boost::filesystem::exists(m_storage_file_name))
   {
-    LOG_PRINT_L0("Can't parse stake transaction storage file '" << m_storage_file_name << "'");
-    throw;
+    std::string buffer;
+    bool r = epee::file_io_utils::load_file_to_string(m_storage_file_name, buffer);
+
+    CHECK_AND_ASSERT_THROW_MES(r, "stake transaction storage file '" << m_storage_file_name << "' is not found");
+
+    try
+    {
+      LOG_PRINT_L0("Trying to parse stake transaction file");
+
+      StakeTransactionStorage::stake_transaction_array tmp_stake_txs;
+      StakeTransactionStorage::block_hash_list tmp_block_hashes;
+      stake_transaction_file_data data(0, tmp_stake_txs, 0, tmp_block_hashes);
+
+      r = ::serialization::parse_binary(buffer, data);
+
+      CHECK_AND_ASSERT_THROW_MES(r, "internal error: failed to deserialize stake transaction storage file '" << m_storage_file_name << "'");
+
+      journal_generation                  = data.journal_generation;
+      m_last_processed_block_index        = data.last_processed_block_index;
+      m_last_processed_block_hashes_count = data.last_processed_block_hashes_count;
+
+      std::swap(m_stake_txs, data.stake_txs);
+      std::swap(m_last_processed_block_hashes, data.block_hashes);
+    }
+    catch (...)
+    {
+      LOG_PRINT_L0("Can't parse stake transaction storage file '" << m_storage_file_name << "'");
+      throw;
+    }
   }
+
+    //replay journal on top of the snapshot
+
+  m_journaled_tx_count = m_stake_txs.size();
+
+  m_journal.load(journal_generation, [this](const std::string& blob) { return apply_journal_record(blob); });
+
+  if (m_journal.records_count())
+    MDEBUG("Stake transaction storage journal has been applied with " << m_journal.records_count() << " record(s)");
+
+  m_journal_records.clear();
+
+  m_need_store = false;
 }
 
 void StakeTransactionStorage::store() const
 {
-  stake_transaction_file_data data(m_last_processed_block_index, const_cast<stake_transaction_array&>(m_stake_txs),
-    m_last_processed_block_hashes_count, const_cast<block_hash_list&>(m_last_processed_block_hashes));
+  if (!m_need_snapshot && boost::filesystem::exists(m_storage_file_name) && m_journal.records_count() + m_journal_records.size() < JOURNAL_MAX_RECORDS_COUNT)
+  {
+    m_journal.append(m_journal_records);
+  }
+  else
+  {
+      //compact journal to a new snapshot
 
-  std::ofstream ostr;
-  ostr.open(m_storage_file_name, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+    stake_transaction_file_data data(m_last_processed_block_index, const_cast<stake_transaction_array&>(m_stake_txs),
+      m_last_processed_block_hashes_count, const_cast<block_hash_list&>(m_last_processed_block_hashes));
 
-  binary_archive<true> oar(ostr);
+    data.journal_generation = m_journal.generation() + 1;
 
-  bool success = ::serialization::serialize(oar, data);
+    store_file_atomically(m_storage_file_name, [&](std::ostream& ostr) {
+      binary_archive<true> oar(ostr);
+      return ::serialization::serialize(oar, data);
+    });
 
-  ostr.close();
-  
-  CHECK_AND_ASSERT_THROW_MES(success && ostr.good(), "Error at save stake transaction storage file '" << m_storage_file_name << "'");
+    m_journal.reset(data.journal_generation);
+
+    m_need_snapshot = false;
+  }
+
+  m_journal_records.clear();
 
   m_need_store = false;
 }
+
+uint64_t StakeTransactionStorage::get_memory_usage() const
+{
+  using namespace tools::memory;
+
+  uint64_t bytes = node_bytes(m_last_processed_block_hashes) + vector_bytes(m_stake_txs);
+
+  for (const stake_transaction& tx : m_stake_txs)
+    bytes += string_bytes(tx.supernode_public_id);
+
+  for (const supernode_stake_array* stakes : {&m_supernode_stakes, &m_historical_stakes})
+  {
+    bytes += vector_bytes(*stakes);
+    for (const supernode_stake& stake : *stakes)
+      bytes += string_bytes(stake.supernode_public_id);
+  }
+
+  for (const supernode_stake_index_map* indexes : {&m_supernode_stake_indexes, &m_historical_stake_indexes})
+  {
+    bytes += hash_bytes(*indexes);
+    for (const auto& index : *indexes)
+      bytes += string_bytes(index.first);
+  }
+
+  bytes += hash_bytes(m_supernode_tx_indexes);
+  for (const auto& indexes : m_supernode_tx_indexes)
+    bytes += string_bytes(indexes.first) + vector_bytes(indexes.second);
+
+  bytes += node_bytes(m_stake_events) + hash_bytes(m_dirty_supernodes);
+  for (const std::string& id : m_dirty_supernodes)
+    bytes += string_bytes(id);
+
+  bytes += hash_bytes(m_stakes_history);
+  for (const auto& versions : m_stakes_history)
+  {
+    bytes += string_bytes(versions.first) + vector_bytes(versions.second);
+    for (const supernode_stake_version& version : versions.second)
+      bytes += string_bytes(version.stake.supernode_public_id);
+  }
+
+  bytes += node_bytes(m_journal_records);
+  for (const std::string& record : m_journal_records)
+    bytes += string_bytes(record);
+
+  return bytes;
+}
@@ -2,7 +2,9 @@
 
 #include <cryptonote_config.h>
 #include <list>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "crypto/hash.h"
 #include "cryptonote_basic/cryptonote_basic.h"
@@ -10,6 +12,7 @@
 #include "serialization/list.h"
 #include "serialization/vector.h"
 #include "serialization/string.h"
+#include "cryptonote_core/storage_journal.h"
 
 namespace cryptonote
 {
@@ -56,6 +59,15 @@ public:
   typedef std::list<crypto::hash>        block_hash_list;
   typedef std::vector<supernode_stake>   supernode_stake_array;
 
+  /// State of the storage at a processed block which can be restored when the blockchain is reorganized deeper than the block hashes history
+  struct checkpoint
+  {
+    uint64_t last_processed_block_index;
+    block_hash_list last_processed_block_hashes;
+    size_t last_processed_block_hashes_count;
+    stake_transaction_array stake_txs;
+  };
+
   StakeTransactionStorage(const std::string& storage_file_name, uint64_t first_block_number);
 
   /// Get number of transactions
@@ -73,6 +85,9 @@ public:
   /// Has last processed blocks
   bool has_last_processed_block() const { return m_last_processed_block_hashes_count > 0; }
 
+  /// Number of last processed blocks which can be removed before the storage is restored from the beginning
+  size_t get_last_processed_block_hashes_count() const { return m_last_processed_block_hashes_count; }
+
   /// Add new processed block
   void add_last_processed_block(uint64_t index, const crypto::hash& hash);
 
@@ -82,29 +97,81 @@ public:
   /// Add transaction
   void add_tx(const stake_transaction&);
 
-  /// List of supernode stakes
+  /// List of supernode stakes (blocks of the stakes history are answered without updating the stakes)
   const supernode_stake_array& get_supernode_stakes(uint64_t block_number);
 
   /// Search supernode stake by supernode public id (returns nullptr if no stake is found)
   const supernode_stake* find_supernode_stake(uint64_t block_number, const std::string& supernode_public_id);
 
-  /// Update supernode stakes
+  /// Are stakes of the block answered from the stakes history
+  bool is_in_stakes_history(uint64_t block_number) const;
+
+  /// Update supernode stakes (incrementally if possible)
   void update_supernode_stakes(uint64_t block_number);
 
   /// Clear supernode stakes
   void clear_supernode_stakes();
 
-  /// Save storage to file
+  /// Get state of the storage at the last processed block
+  void get_checkpoint(checkpoint&) const;
+
+  /// Restore state of the storage from a checkpoint (the storage is compacted to a snapshot at next store)
+  void restore_checkpoint(const checkpoint&);
+
+  /// Save storage to file (appends changes to the journal and periodically compacts it to a snapshot)
   void store() const;
 
   /// Is the list requires store
   bool need_store() const { return m_need_store; }
 
+  /// Estimate of the memory held by the storage
+  uint64_t get_memory_usage() const;
+
 private:
   /// Load storage from file
   void load();
 
+  /// Rebuild supernode stakes from all stake transactions
+  void rebuild_supernode_stakes(uint64_t block_number);
+
+  /// Recompute stake of the supernode from its stake transactions
+  void update_supernode_stake(uint64_t block_number, const std::string& supernode_public_id);
+
+  /// Register transaction's state change heights in the events queue
+  void add_stake_events(size_t tx_index, uint64_t block_number);
+
+  /// Stake of the supernode from the block, the supernode has no stake if it's nullptr
+  void add_stake_version(uint64_t block_number, const std::string& supernode_public_id, const supernode_stake* stake);
+
+  /// Stake of the supernode at the block from the stakes history (returns nullptr if the supernode has no stake)
+  const supernode_stake* find_stake_version(uint64_t block_number, const std::string& supernode_public_id) const;
+
+  /// Build list of supernode stakes at the block from the stakes history
+  void build_historical_stakes(uint64_t block_number);
+
+  /// Remove versions which are out of supernodes history window
+  void prune_stakes_history(uint64_t block_number);
+
+  /// Add record to the list of records which will be appended to the journal at store
+  template <class T> void add_journal_record(T& record);
+
+  /// Apply journal record during the load
+  bool apply_journal_record(const std::string& blob);
+
   typedef std::unordered_map<std::string, size_t> supernode_stake_index_map;
+  typedef std::unordered_map<std::string, std::vector<size_t>> supernode_tx_index_map;
+  typedef std::multimap<uint64_t, size_t> stake_event_queue;
+  typedef std::unordered_set<std::string> supernode_id_set;
+
+  /// Stake of a supernode from a block up to the block of the next version
+  struct supernode_stake_version
+  {
+    uint64_t block_number;
+    bool has_stake;
+    supernode_stake stake;
+  };
+
+  typedef std::unordered_map<std::string, std::vector<supernode_stake_version>> supernode_stakes_history_map;
 
 private:
   std::string m_storage_file_name;
@@ -115,8 +182,20 @@ private:
   uint64_t m_supernode_stakes_update_block_number;
   supernode_stake_array m_supernode_stakes;
   supernode_stake_index_map m_supernode_stake_indexes;
+  supernode_tx_index_map m_supernode_tx_indexes; //indexes of stake transactions for each supernode
+  stake_event_queue m_stake_events; //activation / expiration heights of stake transactions
+  supernode_id_set m_dirty_supernodes; //supernodes with new stake transactions
+  supernode_stakes_history_map m_stakes_history; //versions of supernode stakes since m_stakes_history_first_block_number
+  uint64_t m_stakes_history_first_block_number;
+  uint64_t m_historical_stakes_block_number; //block of m_historical_stakes (0 if they have not been built)
+  supernode_stake_array m_historical_stakes;
+  supernode_stake_index_map m_historical_stake_indexes;
   uint64_t m_first_block_number;
+  mutable StorageJournal m_journal;
+  mutable StorageJournal::record_list m_journal_records; //records which have not been written to the journal yet
+  size_t m_journaled_tx_count; //number of stake transactions which have been added to the journal records
   mutable bool m_need_store;
+  mutable bool m_need_snapshot; //journal can't describe changes since the last snapshot
 };
 
 }
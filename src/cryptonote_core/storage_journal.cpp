@@ -0,0 +1,164 @@
+#include <cstring>
+#include <fstream>
+#include <boost/filesystem.hpp>
+
+#include "misc_log_ex.h"
+#include "crypto/hash.h"
+#include "storage_journal.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "storage.journal"
+
+using namespace cryptonote;
+
+namespace
+{
+
+const char     JOURNAL_MAGIC[8]       = {'G', 'R', 'F', 'T', 'J', 'R', 'N', 'L'};
+const uint32_t JOURNAL_MAX_RECORD_SIZE = 256 * 1024 * 1024;
+
+struct journal_header
+{
+  char magic[sizeof(JOURNAL_MAGIC)];
+  uint64_t generation;
+};
+
+struct journal_record_header
+{
+  uint32_t size;
+  crypto::hash checksum;
+};
+
+}
+
+StorageJournal::StorageJournal(const std::string& file_name)
+  : m_file_name(file_name)
+  , m_generation()
+  , m_records_count()
+{
+}
+
+void StorageJournal::load(uint64_t generation, const record_handler& handler)
+{
+  m_generation    = generation;
+  m_records_count = 0;
+
+  if (!boost::filesystem::exists(m_file_name))
+    return;
+
+  std::ifstream istr(m_file_name, std::ios_base::binary | std::ios_base::in);
+
+  journal_header header;
+
+  if (!istr.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) ||
+      header.generation != generation)
+  {
+    MWARNING("Journal '" << m_file_name << "' does not correspond to the snapshot and will be discarded");
+    istr.close();
+    reset(generation);
+    return;
+  }
+
+  uint64_t valid_size = sizeof(header);
+  std::string blob;
+
+  for (;;)
+  {
+    journal_record_header record_header;
+
+    if (!istr.read(reinterpret_cast<char*>(&record_header), sizeof(record_header)))
+      break;
+
+    if (record_header.size > JOURNAL_MAX_RECORD_SIZE)
+      break;
+
+    blob.resize(record_header.size);
+
+    if (!istr.read(&blob[0], blob.size()))
+      break;
+
+    crypto::hash checksum;
+    crypto::cn_fast_hash(blob.data(), blob.size(), checksum);
+
+    if (checksum != record_header.checksum)
+      break;
+
+    if (!handler(blob))
+      break;
+
+    valid_size += sizeof(record_header) + blob.size();
+    m_records_count++;
+  }
+
+  istr.close();
+
+  if (valid_size != boost::filesystem::file_size(m_file_name))
+  {
+      //drop partially written or corrupted tail of the journal
+
+    MWARNING("Journal '" << m_file_name << "' has been truncated after " << m_records_count << " record(s)");
+    boost::filesystem::resize_file(m_file_name, valid_size);
+  }
+}
+
+void StorageJournal::append(const record_list& records)
+{
+  if (records.empty())
+    return;
+
+  if (!boost::filesystem::exists(m_file_name))
+    reset(m_generation);
+
+  std::ofstream ostr(m_file_name, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+
+  for (const std::string& blob : records)
+  {
+    journal_record_header record_header;
+
+    record_header.size = static_cast<uint32_t>(blob.size());
+    crypto::cn_fast_hash(blob.data(), blob.size(), record_header.checksum);
+
+    ostr.write(reinterpret_cast<const char*>(&record_header), sizeof(record_header));
+    ostr.write(blob.data(), blob.size());
+  }
+
+  ostr.close();
+
+  CHECK_AND_ASSERT_THROW_MES(ostr.good(), "Error at append to journal file '" << m_file_name << "'");
+
+  m_records_count += records.size();
+}
+
+void StorageJournal::reset(uint64_t generation)
+{
+  journal_header header;
+
+  memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+  header.generation = generation;
+
+  std::ofstream ostr(m_file_name, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+
+  ostr.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  ostr.close();
+
+  CHECK_AND_ASSERT_THROW_MES(ostr.good(), "Error at reset journal file '" << m_file_name << "'");
+
+  m_generation    = generation;
+  m_records_count = 0;
+}
+
+void cryptonote::store_file_atomically(const std::string& file_name, const std::function<bool(std::ostream&)>& writer)
+{
+  std::string tmp_file_name = file_name + ".tmp";
+
+  std::ofstream ostr;
+  ostr.open(tmp_file_name, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+
+  bool success = writer(ostr);
+
+  ostr.close();
+
+  CHECK_AND_ASSERT_THROW_MES(success && ostr.good(), "Error at save file '" << tmp_file_name << "'");
+
+  boost::filesystem::rename(tmp_file_name, file_name);
+}
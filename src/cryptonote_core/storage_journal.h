@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+
+namespace cryptonote
+{
+
+/// Append-only checksummed journal of records applied on top of a storage snapshot
+class StorageJournal
+{
+public:
+  typedef std::list<std::string>                       record_list;
+  typedef std::function<bool(const std::string& blob)> record_handler;
+
+  StorageJournal(const std::string& file_name);
+
+  /// Journal file name
+  const std::string& file_name() const { return m_file_name; }
+
+  /// Generation of the snapshot the journal is applied to
+  uint64_t generation() const { return m_generation; }
+
+  /// Number of records in the journal
+  size_t records_count() const { return m_records_count; }
+
+  /// Read records of the specified generation (journal of other generation is discarded); replay stops when handler returns false
+  void load(uint64_t generation, const record_handler& handler);
+
+  /// Append records to the journal
+  void append(const record_list& records);
+
+  /// Start empty journal for new snapshot generation
+  void reset(uint64_t generation);
+
+private:
+  std::string m_file_name;
+  uint64_t m_generation;
+  size_t m_records_count;
+};
+
+/// Write file atomically through temporary file
+void store_file_atomically(const std::string& file_name, const std::function<bool(std::ostream&)>& writer);
+
+}
@@ -41,9 +41,11 @@
 #include "blockchain_db/blockchain_db.h"
 #include "common/boost_serialization_helper.h"
 #include "common/int-util.h"
+#include "common/metrics.h"
 #include "misc_language.h"
 #include "warnings.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "crypto/hash.h"
 #include "stake_transaction_processor.h"
 #include "graft_rta_config.h"
@@ -91,6 +93,21 @@ namespace cryptonote
         return get_min_block_weight(version) - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
     }
 
+    tools::metrics::histogram add_tx_time("graft_txpool_add_tx_seconds", "Time spent checking and adding transactions to the pool");
+    tools::metrics::counter txes_added("graft_txpool_txes_total", "Transactions offered to the pool by outcome", "result=\"added\"");
+    tools::metrics::counter txes_rejected("graft_txpool_txes_total", "Transactions offered to the pool by outcome", "result=\"rejected\"");
+    tools::metrics::counter txes_not_added("graft_txpool_txes_total", "Transactions offered to the pool by outcome", "result=\"not_added\"");
+
+    // times add_tx and counts its outcome when it returns
+    class add_tx_metrics {
+    public:
+      add_tx_metrics(const tx_verification_context &tvc): m_tvc(tvc), m_timer(add_tx_time) {}
+      ~add_tx_metrics() { (m_tvc.m_verifivation_failed ? txes_rejected : m_tvc.m_added_to_pool ? txes_added : txes_not_added).inc(); }
+    private:
+      const tx_verification_context &m_tvc;
+      tools::metrics::histogram::timer m_timer;
+    };
+
     // This class is meant to create a batch when none currently exists.
     // If a batch exists, it can't be from another thread, since we can
     // only be called with the txpool lock taken, and it is held during
@@ -98,7 +115,8 @@ namespace cryptonote
     class LockedTXN {
     public:
       LockedTXN(Blockchain &b): m_blockchain(b), m_batch(false) {
-        m_batch = m_blockchain.get_db().batch_start();
+        if (!m_blockchain.is_txpool_in_memory())
+          m_batch = m_blockchain.get_db().batch_start();
       }
       ~LockedTXN() { try { if (m_batch) { m_blockchain.get_db().batch_stop(); } } catch (const std::exception &e) { MWARNING("LockedTXN dtor filtering exception: " << e.what()); } }
     private:
@@ -108,9 +126,21 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0)
+  constexpr size_t tx_memory_pool::MAX_ADDED_TXS_JOURNAL_SIZE;
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0), m_txs_count(0), m_rta_block_weight_percent(DEFAULT_RTA_BLOCK_WEIGHT_PERCENT)
   {
-
+    for (size_t cls = 0; cls < tx_pool_class_count; ++cls)
+      m_class_bytes[cls] = 0;
+    m_class_share_percent[tx_pool_class_rta] = DEFAULT_TXPOOL_RTA_SHARE_PERCENT;
+    m_class_share_percent[tx_pool_class_stake] = DEFAULT_TXPOOL_STAKE_SHARE_PERCENT;
+    m_class_share_percent[tx_pool_class_regular] = 100 - DEFAULT_TXPOOL_RTA_SHARE_PERCENT - DEFAULT_TXPOOL_STAKE_SHARE_PERCENT;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::bump_cookie()
+  {
+    ++m_cookie;
+    m_blockchain.notify_template_change();
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_hash,*/ const crypto::hash &id, size_t tx_weight, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version)
@@ -119,6 +149,7 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
 
     PERF_TIMER(add_tx);
+    add_tx_metrics metrics(tvc);
 
     MTRACE("tx_type: " << tx.type);
     MTRACE("tx_version: " << tx.version);
@@ -188,17 +219,18 @@ namespace cryptonote
     // 1. if tx.type == tx_type_rta and tx.rta_signatures.size() > 0
     // 2. if tx.version >= 3 and tx.rta_signatures.size() > 0
 
+    // graft extras are parsed once here and reused by stake processing
+    graft_tx_extra_ptr graft_extra = m_stp ? m_stp->get_tx_extra_cache().get(id, tx) : graft_tx_extra_cache::parse(tx);
+
     bool is_rta_tx = tx.type == transaction::tx_type_rta;
     if (is_rta_tx) {
-      cryptonote::rta_header rta_hdr;
-      if (!cryptonote::get_graft_rta_header_from_extra(tx, rta_hdr)) {
+      if (!graft_extra->has_rta_header) {
         MERROR("Failed to parse rta-header from tx extra: " << id);
         tvc.m_rta_signature_failed = true;
         tvc.m_verifivation_failed = true;
         return false;
       }
-      std::vector<cryptonote::rta_signature> rta_signatures;
-      if (!cryptonote::get_graft_rta_signatures_from_extra2(tx, rta_signatures)) {
+      if (!graft_extra->has_rta_signatures) {
         MERROR("Failed to parse rta signatures from tx extra: " << id);
         tvc.m_rta_signature_failed = true;
         tvc.m_verifivation_failed = true;
@@ -206,8 +238,8 @@ namespace cryptonote
       }
 
       // validate rta tx only if it wasn't processed before AND stake processing enabled
-      if (!kept_by_block && m_stp->is_enabled() && !validate_rta_tx(id, rta_signatures, rta_hdr)) {
-        LOG_ERROR("failed to validate rta tx, tx contains " << rta_signatures.size() << " signatures");
+      if (!kept_by_block && m_stp && m_stp->is_enabled() && !validate_rta_tx(id, graft_extra->rta_signatures, graft_extra->rta_hdr)) {
+        LOG_ERROR("failed to validate rta tx, tx contains " << graft_extra->rta_signatures.size() << " signatures");
         tvc.m_rta_signature_failed = true;
         tvc.m_verifivation_failed = true;
         return false;
@@ -262,6 +294,11 @@ namespace cryptonote
     crypto::hash max_used_block_id = null_hash;
     uint64_t max_used_block_height = 0;
     cryptonote::txpool_tx_meta_t meta;
+    const tx_pool_class pool_class = get_tx_pool_class(tx, graft_extra->has_stake);
+    size_t blob_size = 0;
+    crypto::hash blob_hash;
+    get_transaction_hash(tx, blob_hash, &blob_size);
+
     bool ch_inp_res = check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, id, max_used_block_height, max_used_block_id, tvc, kept_by_block);
     if(!ch_inp_res)
     {
@@ -290,7 +327,7 @@ namespace cryptonote
           m_blockchain.add_txpool_tx(tx, meta);
           if (!insert_key_images(tx, kept_by_block))
             return false;
-          m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+          add_tx_to_sorted_container(fee / (double)tx_weight, receive_time, id, pool_class, blob_size);
         }
         catch (const std::exception &e)
         {
@@ -332,7 +369,7 @@ namespace cryptonote
         m_blockchain.add_txpool_tx(tx, meta);
         if (!insert_key_images(tx, kept_by_block))
           return false;
-        m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+        add_tx_to_sorted_container(fee / (double)tx_weight, receive_time, id, pool_class, blob_size);
       }
       catch (const std::exception &e)
       {
@@ -349,11 +386,19 @@ namespace cryptonote
     tvc.m_verifivation_failed = false;
     m_txpool_weight += tx_weight;
 
-    ++m_cookie;
+    bump_cookie();
+
+    if (!do_not_relay)
+    {
+      add_to_added_txs_journal(id);
+      if (m_tx_added_handler)
+        m_tx_added_handler(id, tx_weight, fee);
+    }
 
     MINFO("Transaction added to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)tx_weight));
 
-    prune(m_txpool_max_weight);
+    if (!m_batch_insert)
+      prune(m_txpool_max_weight);
 
     return true;
   }
@@ -367,6 +412,68 @@ namespace cryptonote
     return add_tx(tx, h, get_transaction_weight(tx, blob_size), tvc, keeped_by_block, relayed, do_not_relay, version);
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::precheck_tx(const transaction &tx, const crypto::hash &id, tx_verification_context &tvc) const
+  {
+    if (m_blockchain.have_tx_keyimges_as_spent(tx))
+    {
+      LOG_PRINT_L1("Transaction with id= "<< id << " used key images spent in blockchain");
+      tvc.m_verifivation_failed = true;
+      tvc.m_double_spend = true;
+      return false;
+    }
+
+    if (tx.type != transaction::tx_type_rta || !m_stp || !m_stp->is_enabled())
+      return true;
+
+    // a missing header or signatures are reported by add_tx
+    graft_tx_extra_ptr graft_extra = m_stp->get_tx_extra_cache().get(id, tx);
+    if (!graft_extra->has_rta_header || !graft_extra->has_rta_signatures)
+      return true;
+
+    if (!validate_rta_tx(id, graft_extra->rta_signatures, graft_extra->rta_hdr))
+    {
+      LOG_ERROR("failed to validate rta tx, tx contains " << graft_extra->rta_signatures.size() << " signatures");
+      tvc.m_rta_signature_failed = true;
+      tvc.m_verifivation_failed = true;
+      return false;
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_txs(const std::vector<tx_batch_entry> &txs, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+
+    bool ok = true;
+    m_batch_insert = true;
+    try
+    {
+      for (const tx_batch_entry &entry : txs)
+      {
+        if (have_tx(entry.id))
+        {
+          LOG_PRINT_L2("tx " << entry.id << "already have transaction in tx_pool");
+          continue;
+        }
+        if (m_blockchain.have_tx(entry.id))
+        {
+          LOG_PRINT_L2("tx " << entry.id << " already have transaction in blockchain");
+          continue;
+        }
+        ok &= add_tx(*entry.tx, entry.id, entry.weight, *entry.tvc, kept_by_block, relayed, do_not_relay, version);
+      }
+    }
+    catch (...)
+    {
+      m_batch_insert = false;
+      throw;
+    }
+    m_batch_insert = false;
+
+    prune(m_txpool_max_weight);
+    return ok;
+  }
+  //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_txpool_weight() const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -379,6 +486,30 @@ namespace cryptonote
     m_txpool_max_weight = bytes;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_rta_block_weight_percent(size_t percent)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_rta_block_weight_percent = std::min<size_t>(percent, 100);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_txpool_class_shares(size_t rta_percent, size_t stake_percent)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    rta_percent = std::min<size_t>(rta_percent, 100);
+    stake_percent = std::min<size_t>(stake_percent, 100 - rta_percent);
+    m_class_share_percent[tx_pool_class_rta] = rta_percent;
+    m_class_share_percent[tx_pool_class_stake] = stake_percent;
+    m_class_share_percent[tx_pool_class_regular] = 100 - rta_percent - stake_percent;
+  }
+  //---------------------------------------------------------------------------------
+  size_t tx_memory_pool::get_txpool_bytes(tx_pool_class cls) const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (cls < tx_pool_class_count)
+      return m_class_bytes[cls];
+    return m_class_bytes[tx_pool_class_regular] + m_class_bytes[tx_pool_class_stake] + m_class_bytes[tx_pool_class_rta];
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::prune(size_t bytes)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -388,15 +519,28 @@ namespace cryptonote
     LockedTXN lock(m_blockchain);
     bool changed = false;
 
-    // this will never remove the first one, but we don't care
-    auto it = --m_txs_by_fee_and_receive_time.end();
-    while (it != m_txs_by_fee_and_receive_time.begin())
+    // per class position of the next eviction candidate, just after it; kept_by_block txs are stepped over
+    sorted_tx_container::iterator evict_its[tx_pool_class_count];
+    for (size_t cls = 0; cls < tx_pool_class_count; ++cls)
+      evict_its[cls] = m_txs_by_class[cls].end();
+
+    size_t pool_bytes = get_txpool_bytes();
+    while (pool_bytes > bytes)
     {
-      if (m_txpool_weight <= bytes)
+      // the pool is over the limit, so at least one class is over its share; regular txs go first
+      size_t cls = 0;
+      for (; cls < tx_pool_class_count; ++cls)
+      {
+        if (evict_its[cls] != m_txs_by_class[cls].begin() && m_class_bytes[cls] > bytes / 100 * m_class_share_percent[cls])
+          break;
+      }
+      if (cls == tx_pool_class_count)
         break;
+
+      auto it = std::prev(evict_its[cls]);
       try
       {
-        const crypto::hash &txid = it->second;
+        const crypto::hash txid = it->second;
         txpool_tx_meta_t meta;
         if (!m_blockchain.get_txpool_tx_meta(txid, meta))
         {
@@ -406,23 +550,26 @@ namespace cryptonote
         // don't prune the kept_by_block ones, they're likely added because we're adding a block with those
         if (meta.kept_by_block)
         {
-          --it;
+          evict_its[cls] = it;
           continue;
         }
         cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
         cryptonote::transaction tx;
-        if (!parse_and_validate_tx_from_blob(txblob, tx))
+        if (!parse_and_validate_tx_from_blob(txblob, tx, txid))
         {
           MERROR("Failed to parse tx from txpool");
           return;
         }
+        auto sorted_it = m_txs_index.at(txid).sorted_it;
         // remove first, in case this throws, so key images aren't removed
-        MINFO("Pruning tx " << txid << " from txpool: weight: " << it->first.second << ", fee/byte: " << it->first.first);
+        MINFO("Pruning tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first << ", class: " << cls);
         m_blockchain.remove_txpool_tx(txid);
-        m_txpool_weight -= it->first.second;
+        m_txpool_weight -= meta.weight;
         remove_transaction_keyimages(tx);
-        MINFO("Pruned tx " << txid << " from txpool: weight: " << it->first.second << ", fee/byte: " << it->first.first);
-        m_txs_by_fee_and_receive_time.erase(it--);
+        if (m_tx_removed_handler)
+          m_tx_removed_handler(txid, removed_pruned);
+        remove_tx_from_sorted_container(sorted_it);
+        pool_bytes = get_txpool_bytes();
         changed = true;
       }
       catch (const std::exception &e)
@@ -432,9 +579,9 @@ namespace cryptonote
       }
     }
     if (changed)
-      ++m_cookie;
-    if (m_txpool_weight > bytes)
-      MINFO("Pool weight after pruning is larger than limit: " << m_txpool_weight << "/" << bytes);
+      bump_cookie();
+    if (pool_bytes > bytes)
+      MINFO("Pool size after pruning is larger than limit: " << pool_bytes << "/" << bytes);
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::insert_key_images(const transaction &tx, bool kept_by_block)
@@ -443,14 +590,11 @@ namespace cryptonote
     {
       const crypto::hash id = get_transaction_hash(tx);
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
-      std::unordered_set<crypto::hash>& kei_image_set = m_spent_key_images[txin.k_image];
-      CHECK_AND_ASSERT_MES(kept_by_block || kei_image_set.size() == 0, false, "internal error: kept_by_block=" << kept_by_block
-                                          << ",  kei_image_set.size()=" << kei_image_set.size() << ENDL << "txin.k_image=" << txin.k_image << ENDL
+      CHECK_AND_ASSERT_MES(m_spent_key_images.insert(txin.k_image, id, kept_by_block), false, "internal error: kept_by_block=" << kept_by_block
+                                          << ", key image is already spent or duplicated" << ENDL << "txin.k_image=" << txin.k_image << ENDL
                                           << "tx_id=" << id );
-      auto ins_res = kei_image_set.insert(id);
-      CHECK_AND_ASSERT_MES(ins_res.second, false, "internal error: try to insert duplicate iterator in key_image set");
     }
-    ++m_cookie;
+    bump_cookie();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -467,25 +611,10 @@ namespace cryptonote
     for(const txin_v& vi: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(vi, const txin_to_key, txin, false);
-      auto it = m_spent_key_images.find(txin.k_image);
-      CHECK_AND_ASSERT_MES(it != m_spent_key_images.end(), false, "failed to find transaction input in key images. img=" << txin.k_image << ENDL
-                                    << "transaction id = " << get_transaction_hash(tx));
-      std::unordered_set<crypto::hash>& key_image_set =  it->second;
-      CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << txin.k_image << ENDL
+      CHECK_AND_ASSERT_MES(m_spent_key_images.erase(txin.k_image, actual_hash), false, "transaction id not found in key images, img=" << txin.k_image << ENDL
         << "transaction id = " << actual_hash);
-
-      auto it_in_set = key_image_set.find(actual_hash);
-      CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << txin.k_image << ENDL
-        << "transaction id = " << actual_hash);
-      key_image_set.erase(it_in_set);
-      if(!key_image_set.size())
-      {
-        //it is now empty hash container for this key_image
-        m_spent_key_images.erase(it);
-      }
-
     }
-    ++m_cookie;
+    bump_cookie();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -508,7 +637,7 @@ namespace cryptonote
         return false;
       }
       cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(id);
-      if (!parse_and_validate_tx_from_blob(txblob, tx))
+      if (!parse_and_validate_tx_from_blob(txblob, tx, id))
       {
         MERROR("Failed to parse tx from txpool");
         return false;
@@ -523,6 +652,8 @@ namespace cryptonote
       m_blockchain.remove_txpool_tx(id);
       m_txpool_weight -= tx_weight;
       remove_transaction_keyimages(tx);
+      if (m_tx_removed_handler)
+        m_tx_removed_handler(id, removed_mined);
     }
     catch (const std::exception &e)
     {
@@ -530,8 +661,8 @@ namespace cryptonote
       return false;
     }
 
-    m_txs_by_fee_and_receive_time.erase(sorted_it);
-    ++m_cookie;
+    remove_tx_from_sorted_container(sorted_it);
+    bump_cookie();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -542,11 +673,53 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
   {
-    return std::find_if( m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end()
-                       , [&](const sorted_tx_container::value_type& a){
-                         return a.second == id;
-                       }
-    );
+    const auto it = m_txs_index.find(id);
+    if (it == m_txs_index.end())
+      return m_txs_by_fee_and_receive_time.end();
+    return it->second.sorted_it;
+  }
+  //---------------------------------------------------------------------------------
+  tx_pool_class tx_memory_pool::get_tx_pool_class(const transaction& tx, bool is_stake)
+  {
+    if (tx.type == transaction::tx_type_rta)
+      return tx_pool_class_rta;
+    return is_stake ? tx_pool_class_stake : tx_pool_class_regular;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_tx_to_sorted_container(double fee_per_byte, std::time_t receive_time, const crypto::hash& id, tx_pool_class cls, size_t blob_size)
+  {
+    // memory held by a pool tx besides its blob: the meta record and the nodes of the in-memory indexes
+    static constexpr size_t tx_overhead = sizeof(txpool_tx_meta_t)
+      + 2 * (sizeof(tx_by_fee_and_receive_time_entry) + 4 * sizeof(void*))
+      + sizeof(crypto::hash) + sizeof(pool_tx_index_entry) + 2 * sizeof(void*);
+
+    const auto key = std::pair<double, std::time_t>(fee_per_byte, receive_time);
+    auto inserted = m_txs_by_fee_and_receive_time.emplace(key, id);
+    m_txs_count = m_txs_by_fee_and_receive_time.size();
+    if (!inserted.second)
+      return;
+    m_txs_by_class[cls].emplace(key, id);
+    const size_t bytes = blob_size + tx_overhead;
+    m_class_bytes[cls] += bytes;
+    m_txs_index[id] = pool_tx_index_entry{cls, bytes, inserted.first};
+    if (cls == tx_pool_class_rta)
+      m_rta_txs_by_receive_time.emplace(receive_time, id);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_tx_from_sorted_container(sorted_tx_container::const_iterator it)
+  {
+    const auto index_it = m_txs_index.find(it->second);
+    if (index_it != m_txs_index.end())
+    {
+      const pool_tx_index_entry &entry = index_it->second;
+      m_txs_by_class[entry.cls].erase(*it);
+      m_class_bytes[entry.cls] -= entry.bytes;
+      m_txs_index.erase(index_it);
+    }
+    m_rta_txs_by_receive_time.erase(std::make_pair(it->first.second, it->second));
+    m_template_txs.erase(it->second);
+    m_txs_by_fee_and_receive_time.erase(it);
+    m_txs_count = m_txs_by_fee_and_receive_time.size();
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
@@ -569,7 +742,7 @@ namespace cryptonote
         }
         else
         {
-          m_txs_by_fee_and_receive_time.erase(sorted_it);
+          remove_tx_from_sorted_container(sorted_it);
         }
         m_timed_out_transactions.insert(txid);
         remove.insert(txid);
@@ -586,7 +759,7 @@ namespace cryptonote
         {
           cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
           cryptonote::transaction tx;
-          if (!parse_and_validate_tx_from_blob(bd, tx))
+          if (!parse_and_validate_tx_from_blob(bd, tx, txid))
           {
             MERROR("Failed to parse tx from txpool");
             // continue
@@ -597,6 +770,8 @@ namespace cryptonote
             m_blockchain.remove_txpool_tx(txid);
             m_txpool_weight -= get_transaction_weight(tx, bd.size());
             remove_transaction_keyimages(tx);
+            if (m_tx_removed_handler)
+              m_tx_removed_handler(txid, removed_stuck);
           }
         }
         catch (const std::exception &e)
@@ -605,7 +780,7 @@ namespace cryptonote
           // ignore error
         }
       }
-      ++m_cookie;
+      bump_cookie();
     }
     return true;
   }
@@ -657,6 +832,8 @@ namespace cryptonote
         txpool_tx_meta_t meta;
         if (m_blockchain.get_txpool_tx_meta(it->first, meta))
         {
+          if (!meta.relayed)
+            bump_cookie(); // the tx now shows up for restricted RPC
           meta.relayed = true;
           meta.last_relayed_time = now;
           m_blockchain.update_txpool_tx(it->first, meta);
@@ -677,6 +854,30 @@ namespace cryptonote
     return m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_memory_usage(uint64_t& bytes) const
+  {
+    std::unique_lock<epee::critical_section> lock(m_transactions_lock, std::try_to_lock);
+    boost::unique_lock<boost::mutex> rta_lock(m_rta_validation_cache_lock, boost::try_to_lock);
+    if (!lock.owns_lock() || !rta_lock.owns_lock())
+      return false;
+
+    bytes = m_spent_key_images.memory_usage();
+    bytes += tools::memory::node_bytes(m_txs_by_fee_and_receive_time) + tools::memory::node_bytes(m_rta_txs_by_receive_time);
+    for (const sorted_tx_container& txs : m_txs_by_class)
+      bytes += tools::memory::node_bytes(txs);
+    bytes += tools::memory::hash_bytes(m_txs_index);
+    bytes += tools::memory::hash_bytes(m_template_txs);
+    for (const auto& entry : m_template_txs)
+      bytes += tools::memory::vector_bytes(entry.second.key_images);
+    bytes += tools::memory::hash_bytes(m_timed_out_transactions);
+    bytes += tools::memory::hash_bytes(m_input_cache) + tools::memory::hash_bytes(m_rta_validation_cache);
+
+    boost::unique_lock<boost::mutex> added_lock(m_added_txs_lock, boost::try_to_lock);
+    if (added_lock.owns_lock())
+      bytes += m_added_txs.size() * sizeof(crypto::hash);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::vector<transaction>& txs, bool include_unrelayed_txes) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -684,7 +885,7 @@ namespace cryptonote
     txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
     m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      if (!parse_and_validate_tx_from_blob(*bd, tx, txid))
       {
         MERROR("Failed to parse tx from txpool");
         // continue
@@ -695,6 +896,52 @@ namespace cryptonote
     }, true, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
+  void tx_memory_pool::add_to_added_txs_journal(const crypto::hash& id)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_added_txs_lock);
+      m_added_txs.push_back(id);
+      if (m_added_txs.size() > MAX_ADDED_TXS_JOURNAL_SIZE)
+      {
+        m_added_txs.pop_front();
+        ++m_added_txs_start;
+      }
+    }
+    m_added_txs_cond.notify_all();
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::wait_added_transactions(uint64_t start, std::chrono::milliseconds timeout, std::vector<crypto::hash>& tx_hashes, uint64_t& next) const
+  {
+    tx_hashes.clear();
+
+    boost::unique_lock<boost::mutex> lock(m_added_txs_lock);
+
+    if (!start)
+      start = m_added_txs_start;
+
+    bool complete = true;
+    if (start < m_added_txs_start || start > m_added_txs_start + m_added_txs.size())
+    {
+      // entries have been dropped, or the position comes from a previous run of the daemon
+      start = m_added_txs_start;
+      complete = false;
+    }
+    else
+    {
+      m_added_txs_cond.wait_for(lock, boost::chrono::milliseconds(timeout.count()), [&]() { return start < m_added_txs_start + m_added_txs.size(); });
+      if (start < m_added_txs_start)
+      {
+        start = m_added_txs_start;
+        complete = false;
+      }
+    }
+
+    tx_hashes.assign(m_added_txs.begin() + (start - m_added_txs_start), m_added_txs.end());
+    next = m_added_txs_start + m_added_txs.size();
+
+    return complete;
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -807,7 +1054,7 @@ namespace cryptonote
       txi.id_hash = epee::string_tools::pod_to_hex(txid);
       txi.tx_blob = *bd;
       transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      if (!parse_and_validate_tx_from_blob(*bd, tx, txid))
       {
         MERROR("Failed to parse tx from txpool");
         // continue
@@ -834,7 +1081,7 @@ namespace cryptonote
     }, true, include_sensitive_data);
 
     txpool_tx_meta_t meta;
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
+    for (const key_images_container::value_type& kee : m_spent_key_images.get_all()) {
       const crypto::key_image& k_image = kee.first;
       const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
       spent_key_image_info ki;
@@ -879,7 +1126,7 @@ namespace cryptonote
       cryptonote::rpc::tx_in_pool txi;
       txi.tx_hash = txid;
       transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      if (!parse_and_validate_tx_from_blob(*bd, tx, txid))
       {
         MERROR("Failed to parse tx from txpool");
         // continue
@@ -903,7 +1150,7 @@ namespace cryptonote
       return true;
     }, true, false);
 
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
+    for (const key_images_container::value_type& kee : m_spent_key_images.get_all()) {
       std::vector<crypto::hash> tx_hashes;
       const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
       for (const crypto::hash& tx_id_hash : kei_image_set)
@@ -917,21 +1164,79 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const
+  bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool>& spent, bool include_sensitive_data) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-
     spent.clear();
 
+    if (include_sensitive_data)
+    {
+      for (const auto& image : key_images)
+      {
+        spent.push_back(m_spent_key_images.contains(image));
+      }
+      return true;
+    }
+
+    // only a relayed transaction shows a key image as spent to restricted RPC
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    txpool_tx_meta_t meta;
     for (const auto& image : key_images)
     {
-      spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+      bool relayed_spend = false;
+      for (const crypto::hash& txid : m_spent_key_images.get_tx_ids(image))
+      {
+        try
+        {
+          if (m_blockchain.get_txpool_tx_meta(txid, meta) && meta.relayed)
+          {
+            relayed_spend = true;
+            break;
+          }
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to get tx meta from txpool: " << e.what());
+          return false;
+        }
+      }
+      spent.push_back(relayed_spend);
     }
 
     return true;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<bool>& double_spend_seen) const
+  {
+    txblobs.clear();
+    txblobs.resize(ids.size());
+    double_spend_seen.assign(ids.size(), false);
+
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    txpool_tx_meta_t meta;
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+      try
+      {
+        if (!m_blockchain.get_txpool_tx_meta(ids[i], meta))
+          continue;
+        if (!m_blockchain.get_txpool_tx_blob(ids[i], txblobs[i]))
+        {
+          MERROR("Failed to get tx blob from txpool");
+          return false;
+        }
+        double_spend_seen[i] = meta.double_spend_seen;
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to get tx from txpool: " << e.what());
+        return false;
+      }
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_transaction(const crypto::hash& id, cryptonote::blobdata& txblob) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -957,6 +1262,8 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_input_cache.clear();
+    boost::lock_guard<boost::mutex> lock(m_rta_validation_cache_lock);
+    m_rta_validation_cache.clear(); // stakes may change after reorg
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -964,13 +1271,11 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_db().txpool_has_tx(id);
+    return m_blockchain.txpool_has_tx(id);
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction& tx) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     for(const auto& in: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, tokey_in, true);//should never fail
@@ -982,8 +1287,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image& key_im) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    return m_spent_key_images.end() != m_spent_key_images.find(key_im);
+    return m_spent_key_images.contains(key_im);
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::lock() const
@@ -1019,21 +1323,22 @@ namespace cryptonote
   {
     struct transction_parser
     {
-      transction_parser(const cryptonote::blobdata &txblob, transaction &tx): txblob(txblob), tx(tx), parsed(false) {}
+      transction_parser(const cryptonote::blobdata &txblob, const crypto::hash &txid, transaction &tx): txblob(txblob), txid(txid), tx(tx), parsed(false) {}
       cryptonote::transaction &operator()()
       {
         if (!parsed)
         {
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          if (!parse_and_validate_tx_from_blob(txblob, tx, txid))
             throw std::runtime_error("failed to parse transaction blob");
           parsed = true;
         }
         return tx;
       }
       const cryptonote::blobdata &txblob;
+      const crypto::hash &txid;
       transaction &tx;
       bool parsed;
-    } lazy_tx(txblob, tx);
+    } lazy_tx(txblob, txid, tx);
 
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
@@ -1111,10 +1416,10 @@ namespace cryptonote
     for(size_t i = 0; i!= tx.vin.size(); i++)
     {
       CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, void());
-      const key_images_container::const_iterator it = m_spent_key_images.find(itk.k_image);
-      if (it != m_spent_key_images.end())
+      const std::vector<crypto::hash> txids = m_spent_key_images.get_tx_ids(itk.k_image);
+      if (!txids.empty())
       {
-        for (const crypto::hash &txid: it->second)
+        for (const crypto::hash &txid: txids)
         {
           txpool_tx_meta_t meta;
           if (!m_blockchain.get_txpool_tx_meta(txid, meta))
@@ -1142,7 +1447,7 @@ namespace cryptonote
       }
     }
     if (changed)
-      ++m_cookie;
+      bump_cookie();
   }
   //---------------------------------------------------------------------------------
   std::string tx_memory_pool::print_pool(bool short_format) const
@@ -1154,7 +1459,7 @@ namespace cryptonote
       ss << "id: " << txid << std::endl;
       if (!short_format) {
         cryptonote::transaction tx;
-        if (!parse_and_validate_tx_from_blob(*txblob, tx))
+        if (!parse_and_validate_tx_from_blob(*txblob, tx, txid))
         {
           MERROR("Failed to parse tx from txpool");
           return true; // continue
@@ -1199,19 +1504,145 @@ namespace cryptonote
 
     LockedTXN lock(m_blockchain);
 
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
+    // readiness of txs depends only on the chain, so it's kept between template builds until the chain tip changes
+    const crypto::hash top_id = m_blockchain.get_tail_id();
+    if (top_id != m_template_txs_top_id)
     {
+      m_template_txs.clear();
+      m_template_txs_top_id = top_id;
+    }
+
+    auto get_template_tx = [&](const crypto::hash &txid) -> template_tx_entry* {
+      auto it = m_template_txs.find(txid);
+      if (it != m_template_txs.end())
+        return &it->second;
       txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
+      if (!m_blockchain.get_txpool_tx_meta(txid, meta))
       {
         MERROR("  failed to find tx meta");
+        return nullptr;
+      }
+      template_tx_entry entry;
+      entry.checked = false;
+      entry.ready = false;
+      entry.weight = meta.weight;
+      entry.fee = meta.fee;
+      return &m_template_txs.emplace(txid, std::move(entry)).first->second;
+    };
+
+    // Skip transactions that are not ready to be
+    // included into the blockchain or that are
+    // missing key images
+    auto check_ready = [&](const crypto::hash &txid, template_tx_entry &entry) {
+      if (!entry.checked)
+      {
+        txpool_tx_meta_t meta;
+        if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+        {
+          MERROR("  failed to find tx meta");
+          return false;
+        }
+        cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
+        cryptonote::transaction tx;
+        const cryptonote::txpool_tx_meta_t original_meta = meta;
+        bool ready = false;
+        try
+        {
+          ready = is_transaction_ready_to_go(meta, txid, txblob, tx);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to check transaction readiness: " << e.what());
+          // continue, not fatal
+        }
+        if (memcmp(&original_meta, &meta, sizeof(meta)))
+        {
+          try
+	  {
+	    m_blockchain.update_txpool_tx(txid, meta);
+	  }
+          catch (const std::exception &e)
+	  {
+	    MERROR("Failed to update tx meta: " << e.what());
+	    // continue, not fatal
+	  }
+        }
+        if (ready)
+        {
+          for (const auto &in: tx.vin)
+            if (in.type() == typeid(txin_to_key))
+              entry.key_images.push_back(boost::get<txin_to_key>(in).k_image);
+        }
+        entry.checked = true;
+        entry.ready = ready;
+      }
+      if (!entry.ready)
+      {
+        LOG_PRINT_L2("  not ready to go");
+        return false;
+      }
+      for (const crypto::key_image &k_image: entry.key_images)
+      {
+        if (k_images.count(k_image))
+        {
+          LOG_PRINT_L2("  key images already seen");
+          return false;
+        }
+      }
+      return true;
+    };
+
+    // rta txs don't pay fee, so they go first, oldest first, within the reserved part of median weight,
+    // where the block reward isn't penalized
+    std::unordered_set<crypto::hash> rta_added;
+    const size_t max_rta_weight = std::min(median_weight * m_rta_block_weight_percent / 100, max_total_weight);
+
+    for (auto rta_it = m_rta_txs_by_receive_time.begin(); rta_it != m_rta_txs_by_receive_time.end() && total_weight < max_rta_weight; ++rta_it)
+    {
+      const crypto::hash &txid = rta_it->second;
+      template_tx_entry *entry = get_template_tx(txid);
+      if (!entry)
+        continue;
+      LOG_PRINT_L2("Considering rta " << txid << ", weight " << entry->weight << ", current block weight " << total_weight << "/" << max_rta_weight);
+
+      if (max_rta_weight < total_weight + entry->weight)
+      {
+        LOG_PRINT_L2("  would exceed reserved rta weight");
         continue;
       }
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
+
+      uint64_t block_reward;
+      if (!get_block_reward(median_weight, total_weight + entry->weight, already_generated_coins, block_reward, version))
+      {
+        LOG_PRINT_L2("  would exceed maximum block weight");
+        continue;
+      }
+
+      if (!check_ready(txid, *entry))
+        continue;
+
+      bl.tx_hashes.push_back(txid);
+      rta_added.insert(txid);
+      total_weight += entry->weight;
+      fee += entry->fee;
+      best_coinbase = block_reward + fee;
+      k_images.insert(entry->key_images.begin(), entry->key_images.end());
+      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+    }
+
+    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
+    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
+    {
+      if (rta_added.count(sorted_it->second))
+        continue;
+
+      template_tx_entry *entry = get_template_tx(sorted_it->second);
+      if (!entry)
+        continue;
+      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << entry->weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
 
       // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
+      if (max_total_weight < total_weight + entry->weight)
       {
         LOG_PRINT_L2("  would exceed maximum block weight");
         continue;
@@ -1223,12 +1654,12 @@ namespace cryptonote
         // If we're getting lower coinbase tx,
         // stop including more tx
         uint64_t block_reward;
-        if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, block_reward, version))
+        if(!get_block_reward(median_weight, total_weight + entry->weight, already_generated_coins, block_reward, version))
         {
           LOG_PRINT_L2("  would exceed maximum block weight");
           continue;
         }
-        coinbase = block_reward + fee + meta.fee;
+        coinbase = block_reward + fee + entry->fee;
         if (coinbase < template_accept_threshold(best_coinbase))
         {
           LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
@@ -1246,51 +1677,14 @@ namespace cryptonote
         }
       }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
-
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = false;
-      try
-      {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
-      }
-      catch (const std::exception &e)
-      {
-        MERROR("Failed to check transaction readiness: " << e.what());
-        // continue, not fatal
-      }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
-      {
-        try
-	{
-	  m_blockchain.update_txpool_tx(sorted_it->second, meta);
-	}
-        catch (const std::exception &e)
-	{
-	  MERROR("Failed to update tx meta: " << e.what());
-	  // continue, not fatal
-	}
-      }
-      if (!ready)
-      {
-        LOG_PRINT_L2("  not ready to go");
-        continue;
-      }
-      if (have_key_images(k_images, tx))
-      {
-        LOG_PRINT_L2("  key images already seen");
+      if (!check_ready(sorted_it->second, *entry))
         continue;
-      }
 
       bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-      fee += meta.fee;
+      total_weight += entry->weight;
+      fee += entry->fee;
       best_coinbase = coinbase;
-      append_key_images(k_images, tx);
+      k_images.insert(entry->key_images.begin(), entry->key_images.end());
       LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
     }
 
@@ -1332,7 +1726,7 @@ namespace cryptonote
         {
           cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
           cryptonote::transaction tx;
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          if (!parse_and_validate_tx_from_blob(txblob, tx, txid))
           {
             MERROR("Failed to parse tx from txpool");
             continue;
@@ -1341,6 +1735,8 @@ namespace cryptonote
           m_blockchain.remove_txpool_tx(txid);
           m_txpool_weight -= get_transaction_weight(tx, txblob.size());
           remove_transaction_keyimages(tx);
+          if (m_tx_removed_handler)
+            m_tx_removed_handler(txid, removed_invalid);
           auto sorted_it = find_tx_in_sorted_container(txid);
           if (sorted_it == m_txs_by_fee_and_receive_time.end())
           {
@@ -1348,7 +1744,7 @@ namespace cryptonote
           }
           else
           {
-            m_txs_by_fee_and_receive_time.erase(sorted_it);
+            remove_tx_from_sorted_container(sorted_it);
           }
           ++n_removed;
         }
@@ -1360,7 +1756,7 @@ namespace cryptonote
       }
     }
     if (n_removed > 0)
-      ++m_cookie;
+      bump_cookie();
     return n_removed;
   }
   //---------------------------------------------------------------------------------
@@ -1371,6 +1767,15 @@ namespace cryptonote
 
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
     m_txs_by_fee_and_receive_time.clear();
+    m_txs_count = 0;
+    m_rta_txs_by_receive_time.clear();
+    m_txs_index.clear();
+    for (size_t cls = 0; cls < tx_pool_class_count; ++cls)
+    {
+      m_txs_by_class[cls].clear();
+      m_class_bytes[cls] = 0;
+    }
+    m_template_txs.clear();
     m_spent_key_images.clear();
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
@@ -1384,7 +1789,7 @@ namespace cryptonote
         if (!!kept != !!meta.kept_by_block)
           return true;
         cryptonote::transaction tx;
-        if (!parse_and_validate_tx_from_blob(*bd, tx))
+        if (!parse_and_validate_tx_from_blob(*bd, tx, txid))
         {
           MWARNING("Failed to parse tx from txpool, removing");
           remove.push_back(txid);
@@ -1395,7 +1800,8 @@ namespace cryptonote
           MFATAL("Failed to insert key images from txpool tx");
           return false;
         }
-        m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.weight, meta.receive_time), txid);
+        graft_tx_extra_ptr graft_extra = m_stp ? m_stp->get_tx_extra_cache().get(txid, tx) : graft_tx_extra_cache::parse(tx);
+        add_tx_to_sorted_container(meta.fee / (double)meta.weight, meta.receive_time, txid, get_tx_pool_class(tx, graft_extra->has_stake), bd->size());
         m_txpool_weight += meta.weight;
         return true;
       }, true);
@@ -1419,7 +1825,7 @@ namespace cryptonote
       }
     }
 
-    m_cookie = 0;
+    m_cookie = crypto::rand<uint64_t>();
 
     // Ignore deserialization error
     return true;
@@ -1434,48 +1840,109 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::validate_rta_tx(const crypto::hash &txid, const std::vector<rta_signature> &rta_signs, const rta_header &rta_hdr) const
   {
-    bool result = true;
+    static const size_t MAX_RTA_VALIDATION_CACHE_SIZE = 4096;
 
     if (rta_hdr.keys.size() == 0) {
       MERROR("Failed to validate rta tx, missing auth sample keys for tx: " << txid );
       return false;
     }
+
+    // relayed tx may come again from other peers, don't validate it twice
+    {
+      boost::lock_guard<boost::mutex> lock(m_rta_validation_cache_lock);
+      const auto cached = m_rta_validation_cache.find(txid);
+      if (cached != m_rta_validation_cache.end() && cached->second == rta_hdr.auth_sample_height)
+        return true;
+    }
+
 #if 0  // don't validate signatures for rta mining
     if (rta_hdr.keys.size() != rta_signs.size()) {
       MERROR("Failed to validate rta tx: " << txid << ", keys.size() != signatures.size()");
       return false;
     }
 
+    if (!check_rta_signatures(txid, rta_signs, rta_hdr.keys))
+      return false;
+#endif
+    // one snapshot for all keys; stake lookup is a hash search, so it's not worth to be dispatched to threadpool
+    supernode_stakes_snapshot_ptr stakes = m_stp->get_supernode_stakes_snapshot(rta_hdr.auth_sample_height);
+    if (!stakes) {
+      MERROR("Failed to validate rta tx: " << epee::string_tools::pod_to_hex(txid) << ", no stakes for auth sample height " << rta_hdr.auth_sample_height);
+      return false;
+    }
+
+    for (const crypto::public_key &key : rta_hdr.keys) {
+      if (!stakes->is_valid_supernode(key)) {
+        MERROR("Failed to validate rta tx: " << epee::string_tools::pod_to_hex(txid) << ", key: " << key << " doesn't belong to a valid supernode");
+        return false;
+      }
+    }
+
+    boost::lock_guard<boost::mutex> lock(m_rta_validation_cache_lock);
+    if (m_rta_validation_cache.size() >= MAX_RTA_VALIDATION_CACHE_SIZE)
+      m_rta_validation_cache.clear();
+
+    m_rta_validation_cache[txid] = rta_hdr.auth_sample_height;
+
+    return true;
+  }
+
+  bool tx_memory_pool::check_rta_signatures(const crypto::hash &txid, const std::vector<rta_signature> &rta_signs, const std::vector<crypto::public_key> &keys) const
+  {
     for (const auto &rta_sign : rta_signs) {
       // check if key index is in range
-      if (rta_sign.key_index >= rta_hdr.keys.size()) {
+      if (rta_sign.key_index >= keys.size()) {
         MERROR("signature: " << rta_sign.signature << " has wrong key index: " << rta_sign.key_index);
-        result = false;
-        break;
+        return false;
       }
+    }
 
+    std::vector<crypto::public_key> sign_keys;
+    std::vector<crypto::signature> signatures;
+    sign_keys.reserve(rta_signs.size());
+    signatures.reserve(rta_signs.size());
+    for (const auto &rta_sign : rta_signs) {
+      sign_keys.push_back(keys[rta_sign.key_index]);
+      signatures.push_back(rta_sign.signature);
+    }
 
-      result &= crypto::check_signature(txid, rta_hdr.keys[rta_sign.key_index], rta_sign.signature);
-      if (!result) {
-        MERROR("Failed to validate rta tx signature: " << epee::string_tools::pod_to_hex(txid) << " for key: " << rta_hdr.keys[rta_sign.key_index]);
-        break;
+    // signatures are checked in batches, one per thread; a failed batch is checked again one by one to find the invalid signature
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    const size_t threads = std::max(1u, tpool.get_max_concurrency());
+    const size_t batch_size = std::max<size_t>(4, (rta_signs.size() + threads - 1) / threads);
+    const size_t batches_count = (rta_signs.size() + batch_size - 1) / batch_size;
+
+    auto check_batch = [&](size_t batch) {
+      const size_t begin = batch * batch_size, end = std::min(rta_signs.size(), begin + batch_size);
+      return crypto::check_signatures(txid, {sign_keys.data() + begin, end - begin}, {signatures.data() + begin, end - begin});
+    };
+
+    std::vector<uint8_t> results(batches_count, 0);
+
+    if (batches_count > 1)
+    {
+      tools::threadpool::waiter waiter;
+      for (size_t i = 0; i < batches_count; ++i)
+      {
+        tpool.submit(&waiter, [&, i]() {
+          results[i] = check_batch(i);
+        }, true);
       }
+      waiter.wait(&tpool);
     }
-#endif
-    for (const crypto::public_key &key : rta_hdr.keys) {
-      result &= validate_supernode(rta_hdr.auth_sample_height, key);
-      if (!result) {
-        MERROR("Failed to validate rta tx: " << epee::string_tools::pod_to_hex(txid) << ", key: " << key << " doesn't belong to a valid supernode");
-        break;
+    else
+    {
+      for (size_t i = 0; i < batches_count; ++i)
+        results[i] = check_batch(i);
+    }
+
+    for (size_t i = 0; i < rta_signs.size(); ++i) {
+      if (!results[i / batch_size] && !crypto::check_signature(txid, sign_keys[i], signatures[i])) {
+        MERROR("Failed to validate rta tx signature: " << epee::string_tools::pod_to_hex(txid) << " for key: " << sign_keys[i]);
+        return false;
       }
     }
 
-    return result;
+    return true;
   }
-
-  bool tx_memory_pool::validate_supernode(uint64_t height, const public_key &id) const
-  {
-    supernode_stake * stake = const_cast<supernode_stake*>(m_stp->find_supernode_stake(height, epee::string_tools::pod_to_hex(id)));
-    return stake ? stake->amount >= config::graft::TIER1_STAKE_AMOUNT : false;
-  };
 }
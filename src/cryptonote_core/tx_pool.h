@@ -35,18 +35,24 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
 
 #include "string_tools.h"
 #include "syncobj.h"
 #include "math_helper.h"
+#include "common/memory_usage.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
 #include "cryptonote_basic/verification_context.h"
 #include "blockchain_db/blockchain_db.h"
 #include "crypto/hash.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "rpc/message_data_structs.h"
+#include "spent_key_images.h"
 
 namespace cryptonote
 {
@@ -77,6 +83,30 @@ namespace cryptonote
   //! container for sorting transactions by fee per unit size
   typedef std::set<tx_by_fee_and_receive_time_entry, txCompare> sorted_tx_container;
 
+  typedef std::pair<std::time_t, crypto::hash> rta_tx_by_receive_time_entry;
+
+  class rtaTxCompare
+  {
+  public:
+    bool operator()(const rta_tx_by_receive_time_entry& a, const rta_tx_by_receive_time_entry& b) const
+    {
+      if (a.first != b.first) return a.first < b.first;
+      return memcmp(&a.second, &b.second, sizeof(crypto::hash)) < 0;
+    }
+  };
+
+  //! container for rta transactions ordered by receive time, oldest first
+  typedef std::set<rta_tx_by_receive_time_entry, rtaTxCompare> rta_tx_container;
+
+  //! budget classes of pool txs, each keeps its share of the pool when the pool is full
+  enum tx_pool_class
+  {
+    tx_pool_class_regular = 0,
+    tx_pool_class_stake,
+    tx_pool_class_rta,
+    tx_pool_class_count
+  };
+
   /**
    * @brief Transaction pool, handles transactions which are not part of a block
    *
@@ -129,6 +159,49 @@ namespace cryptonote
      */
     bool add_tx(transaction &tx, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version);
 
+    /**
+     * @brief checks of a transaction which don't depend on the pool contents
+     *
+     * Safe to run in parallel for the transactions of a batch without the pool
+     * lock: rejects key images spent in the blockchain and validates the rta
+     * header against the stakes snapshot, so add_tx finds the result cached.
+     *
+     * @param tx the transaction
+     * @param id the transaction's hash
+     * @param tvc return-by-reference status, set on failure only
+     *
+     * @return false if the transaction is to be rejected
+     */
+    bool precheck_tx(const transaction &tx, const crypto::hash &id, tx_verification_context &tvc) const;
+
+    /**
+     * @brief a transaction of a batch for add_txs
+     */
+    struct tx_batch_entry
+    {
+      transaction *tx;
+      crypto::hash id;
+      size_t weight;
+      tx_verification_context *tvc;
+    };
+
+    /**
+     * @brief adds a batch of transactions taking the pool lock once
+     *
+     * Each transaction goes through add_tx, the pool is pruned once after
+     * the batch. Transactions which are already in the pool or in the
+     * blockchain are skipped.
+     *
+     * @param txs the transactions
+     * @param kept_by_block have these transactions been in a block?
+     * @param relayed were these transactions from the network or a local client?
+     * @param do_not_relay to avoid relaying the transactions to the network
+     * @param version the version used to create the transactions
+     *
+     * @return true if all transactions pass validations
+     */
+    bool add_txs(const std::vector<tx_batch_entry> &txs, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version);
+
     /**
      * @brief takes a transaction with the given hash from the pool
      *
@@ -297,10 +370,22 @@ namespace cryptonote
      *
      * @param key_images [in] vector of key images to check
      * @param spent [out] vector of bool to return
+     * @param include_sensitive_data [in] whether transactions not relayed yet count
      *
      * @return true
      */
-    bool check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const;
+    bool check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool>& spent, bool include_sensitive_data = true) const;
+
+    /**
+     * @brief look up transactions in the pool by hash
+     *
+     * @param ids [in] hashes of the transactions to look up
+     * @param txblobs [out] blob of each transaction, empty if it isn't in the pool
+     * @param double_spend_seen [out] whether a double spend of each transaction was seen
+     *
+     * @return true, false if the pool could not be read
+     */
+    bool get_transactions(const std::vector<crypto::hash>& ids, std::vector<cryptonote::blobdata>& txblobs, std::vector<bool>& double_spend_seen) const;
 
     /**
      * @brief get a specific transaction from the pool
@@ -312,6 +397,18 @@ namespace cryptonote
      */
     bool get_transaction(const crypto::hash& h, cryptonote::blobdata& txblob) const;
 
+    /**
+     * @brief wait for relayable transactions added to the pool after a position of the added txes journal
+     *
+     * @param start journal position returned by the previous call, 0 for the oldest kept entry
+     * @param timeout how long to wait if there are no transactions after start
+     * @param tx_hashes return-by-reference hashes of the added transactions
+     * @param next return-by-reference position for the next call
+     *
+     * @return false if some entries after start have been dropped from the journal already
+     */
+    bool wait_added_transactions(uint64_t start, std::chrono::milliseconds timeout, std::vector<crypto::hash>& tx_hashes, uint64_t& next) const;
+
     /**
      * @brief get a list of all relayable transactions and their hashes
      *
@@ -341,6 +438,13 @@ namespace cryptonote
      */
     size_t get_transactions_count(bool include_unrelayed_txes = true) const;
 
+    /**
+     * @brief get the total number of transactions in the pool without taking the pool lock
+     *
+     * @return the number of transactions in the pool, as of the last change
+     */
+    size_t get_transactions_count_unlocked() const { return m_txs_count; }
+
     /**
      * @brief get a string containing human-readable pool information
      *
@@ -366,10 +470,46 @@ namespace cryptonote
      /**
       * @brief return the cookie
       *
+      * The cookie changes whenever transactions are added to or removed from the pool, or
+      * become relayed or double spent, and starts at a random value so it doesn't repeat
+      * across restarts.
+      *
       * @return the cookie
       */
     uint64_t cookie() const { return m_cookie; }
 
+    /**
+     * @brief why a transaction left the pool
+     */
+    enum removal_reason
+    {
+      removed_mined,   //!< included in a block
+      removed_pruned,  //!< dropped to keep the pool under its maximum weight
+      removed_stuck,   //!< stayed in the pool for too long
+      removed_invalid  //!< no longer valid for the current hard fork version
+    };
+
+    typedef std::function<void(const crypto::hash& id, size_t weight, uint64_t fee)> tx_added_handler;
+    typedef std::function<void(const crypto::hash& id, removal_reason reason)> tx_removed_handler;
+
+    /**
+     * @brief sets a handler to call for every relayable transaction added to the pool
+     *
+     * The handler is called with the pool locked, so it must not call back into it.
+     *
+     * @param handler the handler
+     */
+    void set_tx_added_handler(const tx_added_handler& handler) { m_tx_added_handler = handler; }
+
+    /**
+     * @brief sets a handler to call for every transaction removed from the pool
+     *
+     * The handler is called with the pool locked, so it must not call back into it.
+     *
+     * @param handler the handler
+     */
+    void set_tx_removed_handler(const tx_removed_handler& handler) { m_tx_removed_handler = handler; }
+
     /**
      * @brief get the cumulative txpool weight in bytes
      *
@@ -384,6 +524,32 @@ namespace cryptonote
      */
     void set_txpool_max_weight(size_t bytes);
 
+    /**
+     * @brief set the part of median block weight which is filled with rta txs before fee paying ones
+     *
+     * @param percent percent of median block weight, 0 disables the reservation
+     */
+    void set_rta_block_weight_percent(size_t percent);
+
+    /**
+     * @brief set the parts of the pool kept for rta and stake txs when it is full
+     *
+     * A class may use more than its share while the pool has room; when the pool is over
+     * its maximum, txs are evicted only from classes above their share, so zero fee rta txs
+     * are not pushed out by a flood of fee paying ones. Regular txs get the rest.
+     *
+     * @param rta_percent percent of the max pool size kept for rta txs
+     * @param stake_percent percent of the max pool size kept for stake txs
+     */
+    void set_txpool_class_shares(size_t rta_percent, size_t stake_percent);
+
+    /**
+     * @brief get the memory accounted to the txs of a class: blobs, metadata and index entries
+     *
+     * @param cls the class, or tx_pool_class_count for the whole pool
+     */
+    size_t get_txpool_bytes(tx_pool_class cls = tx_pool_class_count) const;
+
     void set_stake_transaction_processor(StakeTransactionProcessor * arg)
     {
       m_stp = arg;
@@ -527,16 +693,24 @@ namespace cryptonote
     void mark_double_spend(const transaction &tx);
 
     /**
-     * @brief prune lowest fee/byte txes till we're not above bytes
+     * @brief evict txes till the accounted pool memory is not above bytes
+     *
+     * Only classes above their share of bytes are evicted from, lowest fee/byte and newest first.
      *
      * if bytes is 0, use m_txpool_max_weight
      */
     void prune(size_t bytes = 0);
 
+    /**
+     * @brief advances the cookie and wakes the callers waiting for a new block template
+     */
+    void bump_cookie();
+
 
     bool validate_rta_tx(const crypto::hash &txid, const std::vector<cryptonote::rta_signature> &rta_signs, const cryptonote::rta_header &rta_hdr) const;
 
-    bool validate_supernode(uint64_t height, const crypto::public_key &id) const;
+    //! check rta signatures against auth sample keys, in parallel on the common threadpool
+    bool check_rta_signatures(const crypto::hash &txid, const std::vector<cryptonote::rta_signature> &rta_signs, const std::vector<crypto::public_key> &keys) const;
 
     //TODO: confirm the below comments and investigate whether or not this
     //      is the desired behavior
@@ -547,7 +721,7 @@ namespace cryptonote
      *  transaction on the assumption that the original will not be in a
      *  block again.
      */
-    typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash> > key_images_container;
+    typedef spent_key_images::key_images_container key_images_container;
 
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
 public:
@@ -557,8 +731,9 @@ public:
 private:
 #endif
 
-    //! container for spent key images from the transactions in the pool
-    key_images_container m_spent_key_images;  
+    //! container for spent key images from the transactions in the pool;
+    //! it has its own locks, so lookups don't need m_transactions_lock, changes are done under it
+    spent_key_images m_spent_key_images;
 
     //TODO: this time should be a named constant somewhere, not hard-coded
     //! interval on which to check for stale/"stuck" transactions
@@ -568,7 +743,52 @@ private:
     //!< container for transactions organized by fee per size and receive time
     sorted_tx_container m_txs_by_fee_and_receive_time;
 
+    //! rta transactions, which are also kept in m_txs_by_fee_and_receive_time
+    rta_tx_container m_rta_txs_by_receive_time;
+
+    //! per tx bookkeeping: class, accounted memory and entry in m_txs_by_fee_and_receive_time
+    struct pool_tx_index_entry
+    {
+      tx_pool_class cls;
+      size_t bytes;
+      sorted_tx_container::iterator sorted_it;
+    };
+    std::unordered_map<crypto::hash, pool_tx_index_entry> m_txs_index;
+
+    //! eviction order of each class, the cheapest tx last
+    sorted_tx_container m_txs_by_class[tx_pool_class_count];
+    size_t m_class_bytes[tx_pool_class_count]; //!< accounted memory of each class
+    size_t m_class_share_percent[tx_pool_class_count]; //!< share of the max pool size kept for each class
+
+    size_t m_rta_block_weight_percent;
+
+    //! pool txs considered for block templates; readiness is valid while the chain tip is m_template_txs_top_id
+    struct template_tx_entry
+    {
+      bool checked;
+      bool ready;
+      size_t weight;
+      uint64_t fee;
+      std::vector<crypto::key_image> key_images;
+    };
+    std::unordered_map<crypto::hash, template_tx_entry> m_template_txs;
+    crypto::hash m_template_txs_top_id = crypto::null_hash;
+
     std::atomic<uint64_t> m_cookie; //!< incremented at each change
+    std::atomic<size_t> m_txs_count; //!< size of m_txs_by_fee_and_receive_time, for readers not taking the lock
+
+    tx_added_handler m_tx_added_handler;
+    tx_removed_handler m_tx_removed_handler;
+
+    static constexpr size_t MAX_ADDED_TXS_JOURNAL_SIZE = 4096;
+
+    mutable boost::mutex m_added_txs_lock;
+    mutable boost::condition_variable m_added_txs_cond;
+    std::deque<crypto::hash> m_added_txs; //!< recently added relayable txes, for subscribers
+    uint64_t m_added_txs_start = 1; //!< journal position of m_added_txs.front()
+
+    //! append tx to the journal of added txes and wake up waiting subscribers
+    void add_to_added_txs_journal(const crypto::hash& id);
 
     /**
      * @brief get an iterator to a transaction in the sorted container
@@ -579,6 +799,15 @@ private:
      */
     sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id) const;
 
+    //! add tx to the sorted container, its class and, for rta txs, to the rta lane; blob_size is used for memory accounting
+    void add_tx_to_sorted_container(double fee_per_byte, std::time_t receive_time, const crypto::hash& id, tx_pool_class cls, size_t blob_size);
+
+    //! remove tx from the sorted container, its class and the rta lane
+    void remove_tx_from_sorted_container(sorted_tx_container::const_iterator it);
+
+    //! class of a pool tx, is_stake is taken from its parsed graft extra
+    static tx_pool_class get_tx_pool_class(const transaction& tx, bool is_stake);
+
     //! cache/call Blockchain::check_tx_inputs results
     bool check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false) const;
 
@@ -595,7 +824,18 @@ private:
 
     mutable std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>> m_input_cache;
 
+    //! rta txs which passed validate_rta_tx, with auth sample height they were validated against
+    mutable std::unordered_map<crypto::hash, uint64_t> m_rta_validation_cache;
+    mutable boost::mutex m_rta_validation_cache_lock; //!< validate_rta_tx runs from precheck_tx without the pool lock
+
+    bool m_batch_insert = false; //!< add_txs prunes once after the batch
+
     StakeTransactionProcessor * m_stp = nullptr;
+
+    //! memory probe of the pool indexes and caches, see tools::memory::account; the txs themselves are in the db
+    bool get_memory_usage(uint64_t& bytes) const;
+
+    tools::memory::account m_memory_account{"txpool", [this](uint64_t& bytes) { return get_memory_usage(bytes); }};
   };
 }
 
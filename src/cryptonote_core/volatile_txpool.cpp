@@ -0,0 +1,117 @@
+#include <vector>
+
+#include "volatile_txpool.h"
+
+using namespace cryptonote;
+
+void volatile_txpool::add_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta, cryptonote::blobdata &&blob)
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  if (!m_txes.emplace(txid, entry{meta, std::move(blob)}).second)
+    throw DB_ERROR("Attempting to add txpool tx metadata that's already in the pool");
+}
+
+void volatile_txpool::update_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  auto it = m_txes.find(txid);
+
+  if (it == m_txes.end())
+    throw DB_ERROR("Error finding txpool tx meta to update");
+
+  it->second.meta = meta;
+}
+
+void volatile_txpool::remove_tx(const crypto::hash &txid)
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+  m_txes.erase(txid);
+}
+
+uint64_t volatile_txpool::get_tx_count(bool include_unrelayed_txes) const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  if (include_unrelayed_txes)
+    return m_txes.size();
+
+  uint64_t count = 0;
+
+  for (const auto &tx : m_txes)
+    if (!tx.second.meta.do_not_relay)
+      count++;
+
+  return count;
+}
+
+bool volatile_txpool::has_tx(const crypto::hash &txid) const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+  return m_txes.find(txid) != m_txes.end();
+}
+
+bool volatile_txpool::get_tx_meta(const crypto::hash &txid, txpool_tx_meta_t &meta) const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  auto it = m_txes.find(txid);
+
+  if (it == m_txes.end())
+    return false;
+
+  meta = it->second.meta;
+
+  return true;
+}
+
+bool volatile_txpool::get_tx_blob(const crypto::hash &txid, cryptonote::blobdata &bd) const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  auto it = m_txes.find(txid);
+
+  if (it == m_txes.end())
+    return false;
+
+  bd = it->second.blob;
+
+  return true;
+}
+
+bool volatile_txpool::for_all_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob, bool include_unrelayed_txes) const
+{
+    //iterate over a copy of metas, blobs are fetched one by one; txes removed in the meanwhile are skipped
+
+  std::vector<std::pair<crypto::hash, txpool_tx_meta_t>> metas;
+
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+
+    metas.reserve(m_txes.size());
+
+    for (const auto &tx : m_txes)
+      if (include_unrelayed_txes || !tx.second.meta.do_not_relay)
+        metas.emplace_back(tx.first, tx.second.meta);
+  }
+
+  cryptonote::blobdata bd;
+
+  for (const auto &tx : metas)
+  {
+    if (include_blob && !get_tx_blob(tx.first, bd))
+      continue;
+
+    if (!f(tx.first, tx.second, include_blob ? &bd : nullptr))
+      return false;
+  }
+
+  return true;
+}
+
+void volatile_txpool::clear()
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+  m_txes.clear();
+}
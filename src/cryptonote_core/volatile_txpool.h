@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+
+#include <boost/thread/mutex.hpp>
+
+#include "blockchain_db/blockchain_db.h"
+
+namespace cryptonote
+{
+
+/// In-memory replacement of the txpool_meta / txpool_blob db tables, with the same semantics
+class volatile_txpool
+{
+public:
+  void add_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta, cryptonote::blobdata &&blob);
+  void update_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta);
+  void remove_tx(const crypto::hash &txid);
+  uint64_t get_tx_count(bool include_unrelayed_txes = true) const;
+  bool has_tx(const crypto::hash &txid) const;
+  bool get_tx_meta(const crypto::hash &txid, txpool_tx_meta_t &meta) const;
+  bool get_tx_blob(const crypto::hash &txid, cryptonote::blobdata &bd) const;
+
+  /// The function is called without the lock held, so it may modify the pool
+  bool for_all_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob = false, bool include_unrelayed_txes = true) const;
+
+  void clear();
+
+private:
+  struct entry
+  {
+    txpool_tx_meta_t meta;
+    cryptonote::blobdata blob;
+  };
+
+  mutable boost::mutex m_lock;
+  std::unordered_map<crypto::hash, entry> m_txes;
+};
+
+}
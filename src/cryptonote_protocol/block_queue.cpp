@@ -28,10 +28,12 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <algorithm>
 #include <vector>
 #include <unordered_map>
 #include <boost/uuid/nil_generator.hpp>
 #include "string_tools.h"
+#include "common/pruning.h"
 #include "cryptonote_protocol_defs.h"
 #include "block_queue.h"
 
@@ -50,12 +52,22 @@ namespace std {
 namespace cryptonote
 {
 
+constexpr float block_queue::SPAN_TARGET_SECONDS;
+
 void block_queue::add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   std::vector<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
+  const uint64_t nblocks = bcel.size();
   blocks.insert(span(height, std::move(bcel), connection_id, rate, size));
+
+  // same pseudo average as get_speed used to do over queued spans, the latest rate matters most
+  peer_stats &stats = peers[connection_id];
+  stats.rate = stats.nspans ? (stats.rate + rate) / 2 : rate;
+  stats.nblocks += nblocks;
+  stats.size += size;
+  stats.nspans++;
   if (has_hashes)
   {
     for (const crypto::hash &h: hashes)
@@ -107,6 +119,14 @@ void block_queue::flush_stale_spans(const std::set<boost::uuids::uuid> &live_con
       erase_block(j);
     }
   }
+
+  for (auto p = peers.begin(); p != peers.end(); )
+  {
+    if (live_connections.find(p->first) == live_connections.end())
+      p = peers.erase(p);
+    else
+      ++p;
+  }
 }
 
 bool block_queue::remove_span(uint64_t start_block_height, std::vector<crypto::hash> *hashes)
@@ -183,7 +203,7 @@ bool block_queue::requested(const crypto::hash &hash) const
   return requested_internal(hash);
 }
 
-std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_height, uint64_t last_block_height, uint64_t max_blocks, const boost::uuids::uuid &connection_id, const std::vector<crypto::hash> &block_hashes, boost::posix_time::ptime time)
+std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_height, uint64_t last_block_height, uint64_t max_blocks, const boost::uuids::uuid &connection_id, const std::vector<crypto::hash> &block_hashes, uint32_t pruning_stripe, uint64_t blockchain_height, boost::posix_time::ptime time)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
 
@@ -193,16 +213,17 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
     return std::make_pair(0, 0);
   }
 
+  // a pruned peer only gets the blocks it has in full, the others are left to other peers
   uint64_t span_start_height = last_block_height - block_hashes.size() + 1;
   std::vector<crypto::hash>::const_iterator i = block_hashes.begin();
-  while (i != block_hashes.end() && requested_internal(*i))
+  while (i != block_hashes.end() && (requested_internal(*i) || !tools::has_unpruned_block(span_start_height, blockchain_height, pruning_stripe)))
   {
     ++i;
     ++span_start_height;
   }
   uint64_t span_length = 0;
   std::vector<crypto::hash> hashes;
-  while (i != block_hashes.end() && span_length < max_blocks)
+  while (i != block_hashes.end() && span_length < max_blocks && tools::has_unpruned_block(span_start_height + span_length, blockchain_height, pruning_stripe))
   {
     hashes.push_back(*i);
     ++i;
@@ -298,6 +319,22 @@ bool block_queue::get_next_span(uint64_t &height, std::vector<cryptonote::block_
   return false;
 }
 
+bool block_queue::get_filled_span(uint64_t height, std::vector<cryptonote::block_complete_entry> &bcel) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  for (const auto &span: blocks)
+  {
+    if (span.start_block_height > height)
+      break;
+    if (span.start_block_height == height && !span.blocks.empty())
+    {
+      bcel = span.blocks;
+      return true;
+    }
+  }
+  return false;
+}
+
 bool block_queue::has_next_span(const boost::uuids::uuid &connection_id, bool &filled) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
@@ -383,27 +420,13 @@ bool block_queue::has_spans(const boost::uuids::uuid &connection_id) const
 float block_queue::get_speed(const boost::uuids::uuid &connection_id) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
-  std::unordered_map<boost::uuids::uuid, float> speeds;
-  for (const auto &span: blocks)
-  {
-    if (span.blocks.empty())
-      continue;
-    // note that the average below does not average over the whole set, but over the
-    // previous pseudo average and the latest rate: this gives much more importance
-    // to the latest measurements, which is fine here
-    std::unordered_map<boost::uuids::uuid, float>::iterator i = speeds.find(span.connection_id);
-    if (i == speeds.end())
-      speeds.insert(std::make_pair(span.connection_id, span.rate));
-    else
-      i->second = (i->second + span.rate) / 2;
-  }
   float conn_rate = -1, best_rate = 0;
-  for (const auto &i: speeds)
+  for (const auto &i: peers)
   {
     if (i.first == connection_id)
-      conn_rate = i.second;
-    if (i.second > best_rate)
-      best_rate = i.second;
+      conn_rate = i.second.rate;
+    if (i.second.rate > best_rate)
+      best_rate = i.second.rate;
   }
 
   if (conn_rate <= 0)
@@ -416,6 +439,43 @@ float block_queue::get_speed(const boost::uuids::uuid &connection_id) const
   return speed;
 }
 
+bool block_queue::get_peer_stats(const boost::uuids::uuid &connection_id, peer_stats &stats) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  auto i = peers.find(connection_id);
+  if (i == peers.end())
+    return false;
+  stats = i->second;
+  return true;
+}
+
+uint64_t block_queue::get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_size, uint64_t max_size) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  auto i = peers.find(connection_id);
+  if (i == peers.end() || i->second.nblocks == 0 || i->second.size == 0 || i->second.rate <= 0)
+    return default_size;
+
+  // as many blocks as the peer sends in SPAN_TARGET_SECONDS, but not more than the chain
+  // takes in that time, or the span would just sit in the queue while other peers wait
+  const float block_size = i->second.size / (float)i->second.nblocks;
+  float nblocks = i->second.rate * SPAN_TARGET_SECONDS / block_size;
+  if (add_rate > 0 && nblocks > add_rate * SPAN_TARGET_SECONDS)
+    nblocks = add_rate * SPAN_TARGET_SECONDS;
+
+  const uint64_t min_size = std::max<uint64_t>(default_size / 4, 1);
+  const uint64_t span_size = std::min<uint64_t>(std::max<uint64_t>(nblocks, min_size), max_size);
+  MTRACE("Span size for " << connection_id << ": " << span_size << " (" << i->second.rate << " B/s, " << block_size << " B/block, " << add_rate << " blocks/s added)");
+  return span_size;
+}
+
+void block_queue::on_blocks_added(uint64_t nblocks, uint64_t micros)
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const float rate = nblocks * 1e6f / std::max<uint64_t>(micros, 1);
+  add_rate = add_rate > 0 ? (add_rate + rate) / 2 : rate;
+}
+
 bool block_queue::foreach(std::function<bool(const span&)> f, bool include_blockchain_placeholder) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
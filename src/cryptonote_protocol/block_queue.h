@@ -32,6 +32,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <set>
 #include <unordered_set>
 #include <boost/thread/recursive_mutex.hpp>
@@ -67,6 +68,19 @@ namespace cryptonote
     };
     typedef std::set<span> block_map;
 
+    /// Download throughput measured for a peer from the spans it filled
+    struct peer_stats
+    {
+      float rate; //!< bytes per second, weighted towards the latest spans
+      uint64_t nblocks;
+      uint64_t size;
+      uint64_t nspans;
+
+      peer_stats(): rate(0.0f), nblocks(0), size(0), nspans(0) {}
+    };
+
+    static constexpr float SPAN_TARGET_SECONDS = 5.0f; //!< time a span should take to download and to add
+
   public:
     void add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size);
     void add_blocks(uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, boost::posix_time::ptime time = boost::date_time::min_date_time);
@@ -77,12 +91,13 @@ namespace cryptonote
     uint64_t get_max_block_height() const;
     void print() const;
     std::string get_overview() const;
-    std::pair<uint64_t, uint64_t> reserve_span(uint64_t first_block_height, uint64_t last_block_height, uint64_t max_blocks, const boost::uuids::uuid &connection_id, const std::vector<crypto::hash> &block_hashes, boost::posix_time::ptime time = boost::posix_time::microsec_clock::universal_time());
+    std::pair<uint64_t, uint64_t> reserve_span(uint64_t first_block_height, uint64_t last_block_height, uint64_t max_blocks, const boost::uuids::uuid &connection_id, const std::vector<crypto::hash> &block_hashes, uint32_t pruning_stripe = 0, uint64_t blockchain_height = 0, boost::posix_time::ptime time = boost::posix_time::microsec_clock::universal_time());
     bool is_blockchain_placeholder(const span &span) const;
     std::pair<uint64_t, uint64_t> get_start_gap_span() const;
     std::pair<uint64_t, uint64_t> get_next_span_if_scheduled(std::vector<crypto::hash> &hashes, boost::uuids::uuid &connection_id, boost::posix_time::ptime &time) const;
     void set_span_hashes(uint64_t start_height, const boost::uuids::uuid &connection_id, std::vector<crypto::hash> hashes);
     bool get_next_span(uint64_t &height, std::vector<cryptonote::block_complete_entry> &bcel, boost::uuids::uuid &connection_id, bool filled = true) const;
+    bool get_filled_span(uint64_t height, std::vector<cryptonote::block_complete_entry> &bcel) const;
     bool has_next_span(const boost::uuids::uuid &connection_id, bool &filled) const;
     size_t get_data_size() const;
     size_t get_num_filled_spans_prefix() const;
@@ -90,6 +105,9 @@ namespace cryptonote
     crypto::hash get_last_known_hash(const boost::uuids::uuid &connection_id) const;
     bool has_spans(const boost::uuids::uuid &connection_id) const;
     float get_speed(const boost::uuids::uuid &connection_id) const;
+    bool get_peer_stats(const boost::uuids::uuid &connection_id, peer_stats &stats) const;
+    uint64_t get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_size, uint64_t max_size) const;
+    void on_blocks_added(uint64_t nblocks, uint64_t micros);
     bool foreach(std::function<bool(const span&)> f, bool include_blockchain_placeholder = false) const;
     bool requested(const crypto::hash &hash) const;
 
@@ -101,5 +119,7 @@ namespace cryptonote
     block_map blocks;
     mutable boost::recursive_mutex mutex;
     std::unordered_set<crypto::hash> requested_hashes;
+    std::map<boost::uuids::uuid, peer_stats> peers;
+    float add_rate = 0.0f; // blocks per second added to the chain
   };
 }
@@ -0,0 +1,83 @@
+#include <cstring>
+#include <unordered_map>
+
+#include "compact_block.h"
+#include "common/int-util.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+uint64_t read_short_id(const char *data)
+{
+  uint64_t id = 0;
+  memcpy(&id, data, COMPACT_BLOCK_SHORT_ID_SIZE);
+  return SWAP64LE(id);
+}
+
+}
+
+uint64_t cryptonote::get_compact_short_id(uint64_t salt, const crypto::hash &tx_hash)
+{
+  char buf[sizeof(salt) + sizeof(tx_hash)];
+  salt = SWAP64LE(salt);
+  memcpy(buf, &salt, sizeof(salt));
+  memcpy(buf + sizeof(salt), &tx_hash, sizeof(tx_hash));
+
+  crypto::hash h;
+  crypto::cn_fast_hash(buf, sizeof(buf), h);
+
+  return read_short_id(h.data);
+}
+
+std::string cryptonote::get_compact_short_ids(uint64_t salt, const std::vector<crypto::hash> &tx_hashes)
+{
+  std::string result;
+  result.reserve(tx_hashes.size() * COMPACT_BLOCK_SHORT_ID_SIZE);
+
+  for (const crypto::hash &tx_hash : tx_hashes)
+  {
+    uint64_t id = SWAP64LE(get_compact_short_id(salt, tx_hash));
+    result.append(reinterpret_cast<const char*>(&id), COMPACT_BLOCK_SHORT_ID_SIZE);
+  }
+
+  return result;
+}
+
+bool cryptonote::resolve_compact_short_ids(uint64_t salt, const std::string &short_ids, const std::vector<crypto::hash> &candidates,
+                                           std::vector<crypto::hash> &tx_hashes, std::vector<uint64_t> &missing_indices)
+{
+  missing_indices.clear();
+
+  if (short_ids.size() != tx_hashes.size() * COMPACT_BLOCK_SHORT_ID_SIZE)
+    return false;
+
+    //null hash marks ids shared by several candidates
+
+  std::unordered_map<uint64_t, crypto::hash> known;
+  known.reserve(candidates.size());
+
+  for (const crypto::hash &candidate : candidates)
+  {
+    auto result = known.emplace(get_compact_short_id(salt, candidate), candidate);
+
+    if (!result.second && result.first->second != candidate)
+      result.first->second = crypto::null_hash;
+  }
+
+  for (size_t i=0; i<tx_hashes.size(); i++)
+  {
+    if (tx_hashes[i] != crypto::null_hash)
+      continue;
+
+    auto it = known.find(read_short_id(short_ids.data() + i * COMPACT_BLOCK_SHORT_ID_SIZE));
+
+    if (it != known.end() && it->second != crypto::null_hash)
+      tx_hashes[i] = it->second;
+    else
+      missing_indices.push_back(i);
+  }
+
+  return true;
+}
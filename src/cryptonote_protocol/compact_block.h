@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+
+/// Size in bytes of a salted short tx id of a compact block
+constexpr size_t COMPACT_BLOCK_SHORT_ID_SIZE = 6;
+
+/// Short tx id: the first COMPACT_BLOCK_SHORT_ID_SIZE bytes of keccak(salt | tx hash), little endian
+uint64_t get_compact_short_id(uint64_t salt, const crypto::hash &tx_hash);
+
+/// Concatenated short ids of the given tx hashes, as sent in NOTIFY_NEW_COMPACT_BLOCK
+std::string get_compact_short_ids(uint64_t salt, const std::vector<crypto::hash> &tx_hashes);
+
+/**
+ * @brief matches the short ids of a compact block against known tx hashes
+ *
+ * Ids matching no candidate or more than one are left as null hashes in tx_hashes and their
+ * indices are returned in missing_indices. Entries of tx_hashes which are already set are kept.
+ *
+ * @return false if short_ids is malformed or doesn't match the size of tx_hashes
+ */
+bool resolve_compact_short_ids(uint64_t salt, const std::string &short_ids, const std::vector<crypto::hash> &candidates,
+                               std::vector<crypto::hash> &tx_hashes, std::vector<uint64_t> &missing_indices);
+
+}
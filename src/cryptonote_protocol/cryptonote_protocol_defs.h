@@ -214,9 +214,11 @@ namespace cryptonote
     struct request
     {
       std::list<crypto::hash> block_ids; /*IDs of the first 10 blocks are sequential, next goes with pow(2,n) offset, like 2, 4, 8, 16, 32, 64 and so on, and the last one is always genesis block */
+      bool request_headers; //ask for the hashing blobs of the first returned blocks, so their PoW can be computed before the bodies arrive
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids)
+        KV_SERIALIZE_OPT(request_headers, false)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -231,12 +233,14 @@ namespace cryptonote
       uint64_t total_height;
       uint64_t cumulative_difficulty;
       std::vector<crypto::hash> m_block_ids;
+      std::vector<blobdata> m_block_hashing_blobs; //hashing blobs of the first m_block_ids, if requested
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(start_height)
         KV_SERIALIZE(total_height)
         KV_SERIALIZE(cumulative_difficulty)
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(m_block_ids)
+        KV_SERIALIZE(m_block_hashing_blobs)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -280,5 +284,87 @@ namespace cryptonote
       END_KV_SERIALIZE_MAP()
     };
   }; 
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request
+    {
+      blobdata block; // without tx hashes, they are restored from short_ids
+      crypto::hash block_hash;
+      uint64_t current_blockchain_height;
+      uint64_t short_id_salt;
+      std::string short_ids; // COMPACT_BLOCK_SHORT_ID_SIZE bytes per tx, in block order
+      std::vector<uint64_t> prefilled_tx_indices;
+      std::vector<blobdata> prefilled_txs; // txs the peer likely doesn't have, such as RTA ones
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+        KV_SERIALIZE(current_blockchain_height)
+        KV_SERIALIZE(short_id_salt)
+        KV_SERIALIZE(short_ids)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(prefilled_tx_indices)
+        KV_SERIALIZE(prefilled_txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_NEW_TX_HASHES
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request
+    {
+      std::vector<crypto::hash> txs; // announced pool txs, peers ask for the ones they miss with NOTIFY_REQUEST_TXS
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_TXS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request
+    {
+      std::vector<crypto::hash> txs; // answered with NOTIFY_NEW_TRANSACTIONS holding the ones still in the pool
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_COMPRESSED_PAYLOAD
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 13;
+
+    struct request
+    {
+      uint32_t command; // NOTIFY_RESPONSE_GET_OBJECTS or NOTIFY_RESPONSE_CHAIN_ENTRY
+      std::string blob; // zstd frame of the serialized notification, only sent to peers with P2P_SUPPORT_FLAG_ZSTD_PAYLOADS
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(command)
+        KV_SERIALIZE(blob)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
     
 }
@@ -36,6 +36,8 @@
 
 #include <boost/program_options/variables_map.hpp>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "math_helper.h"
 #include "storages/levin_abstract_invoke2.h"
@@ -43,6 +45,8 @@
 #include "cryptonote_protocol_defs.h"
 #include "cryptonote_protocol_handler_common.h"
 #include "block_queue.h"
+#include "compact_block.h"
+#include "payload_compression.h"
 #include "cryptonote_basic/connection_context.h"
 #include "cryptonote_basic/cryptonote_stat_info.h"
 #include <boost/circular_buffer.hpp>
@@ -90,6 +94,10 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_TX_HASHES, &cryptonote_protocol_handler::handle_notify_new_tx_hashes)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TXS, &cryptonote_protocol_handler::handle_request_txs)
+      HANDLE_NOTIFY_T2(NOTIFY_COMPRESSED_PAYLOAD, &cryptonote_protocol_handler::handle_notify_compressed_payload)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -119,19 +127,27 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_tx_hashes(int command, NOTIFY_NEW_TX_HASHES::request& arg, cryptonote_connection_context& context);
+    int handle_request_txs(int command, NOTIFY_REQUEST_TXS::request& arg, cryptonote_connection_context& context);
+    int handle_notify_compressed_payload(int command, NOTIFY_COMPRESSED_PAYLOAD::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
     virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context);
     //----------------------------------------------------------------------------------
+    bool make_compact_block(const NOTIFY_NEW_BLOCK::request& arg, NOTIFY_NEW_COMPACT_BLOCK::request& compact_arg);
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span = false);
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();
     bool should_download_next_span(cryptonote_connection_context& context) const;
+    uint32_t get_peer_pruning_stripe(const cryptonote_connection_context& context) const;
     void drop_connection(cryptonote_connection_context &context, bool add_fail, bool flush_all_spans);
     bool kick_idle_peers();
     int try_add_next_blocks(cryptonote_connection_context &context);
+    void add_block_announce(uint64_t height, cryptonote_connection_context& context);
+    void add_known_txs(const boost::uuids::uuid& connection_id, const std::vector<crypto::hash>& tx_hashes);
 
     t_core& m_core;
 
@@ -148,6 +164,13 @@ namespace cryptonote
     double get_avg_block_size();
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
 
+    boost::mutex m_block_announces_lock;
+    std::map<uint64_t, boost::posix_time::ptime> m_block_announces; // when each recent height was first announced
+
+    boost::mutex m_known_txs_lock;
+    std::map<boost::uuids::uuid, std::unordered_set<crypto::hash>> m_known_txs; // txs each peer has or was sent, they're not announced to it
+    std::unordered_map<crypto::hash, time_t> m_requested_txs; // announced txs asked for, they're not asked again from other peers until a timeout
+
     template<class t_parameter>
       bool post_notify(typename t_parameter::request& arg, cryptonote_connection_context& context)
       {
@@ -158,6 +181,33 @@ namespace cryptonote
         return m_p2p->invoke_notify_to_peer(t_parameter::ID, blob, context);
       }
 
+      // bulk responses go out as NOTIFY_COMPRESSED_PAYLOAD when large enough and the peer accepts it
+      template<class t_parameter>
+      bool post_notify_compressed(typename t_parameter::request& arg, cryptonote_connection_context& context)
+      {
+        LOG_PRINT_L2("[" << epee::net_utils::print_connection_context_short(context) << "] post " << typeid(t_parameter).name() << " -->");
+        std::string blob;
+        epee::serialization::store_t_to_binary(arg, blob);
+        if (blob.size() >= P2P_COMPRESSED_PAYLOAD_MIN_SIZE)
+        {
+          uint32_t support_flags = 0;
+          m_p2p->for_connection(context.m_connection_id, [&support_flags](cryptonote_connection_context&, nodetool::peerid_type, uint32_t flags) {
+            support_flags = flags;
+            return true;
+          });
+          NOTIFY_COMPRESSED_PAYLOAD::request compressed;
+          if ((support_flags & P2P_SUPPORT_FLAG_ZSTD_PAYLOADS) && compress_payload(blob, compressed.blob))
+          {
+            LOG_PRINT_L2("[" << epee::net_utils::print_connection_context_short(context) << "] compressed " << blob.size() << " bytes to " << compressed.blob.size());
+            compressed.command = t_parameter::ID;
+            blob.clear();
+            epee::serialization::store_t_to_binary(compressed, blob);
+            return m_p2p->invoke_notify_to_peer(NOTIFY_COMPRESSED_PAYLOAD::ID, blob, context);
+          }
+        }
+        return m_p2p->invoke_notify_to_peer(t_parameter::ID, blob, context);
+      }
+
       template<class t_parameter>
       bool relay_post_notify(typename t_parameter::request& arg, cryptonote_connection_context& exclude_context)
       {
@@ -39,6 +39,8 @@
 #include <list>
 #include <ctime>
 
+#include "common/pruning.h"
+#include "common/trace.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
@@ -53,6 +55,13 @@
 #define REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD (5 * 1000000) // microseconds
 #define IDLE_PEER_KICK_TIME (600 * 1000000) // microseconds
 #define PASSIVE_PEER_KICK_TIME (60 * 1000000) // microseconds
+#define PEER_THROUGHPUT_MIN_SPAN_SIZE (64 * 1024) // bytes, smaller spans measure the latency more than the throughput
+#define BLOCK_ANNOUNCES_KEPT 16 // heights
+#define BLOCK_ANNOUNCE_MAX_DELAY (60 * 1000) // milliseconds
+#define TX_ANNOUNCE_MAX_COUNT 1000 // tx hashes per announce or request
+#define KNOWN_TXS_MAX_COUNT 16384 // per peer, the filter is cleared when it grows past this
+#define TX_REQUEST_TIMEOUT 30 // seconds before an announced tx is asked from another peer
+#define RTA_TX_PUSH_MAX_SIZE (16 * 1024) // bytes, smaller RTA txs are pushed to all peers as they're waited for by supernodes
 
 namespace cryptonote
 {
@@ -338,10 +347,35 @@ namespace cryptonote
     epee::serialization::store_t_to_binary(hsd, data);
     return true;
   }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_block_announce(uint64_t height, cryptonote_connection_context& context)
+  {
+    // the delay is from the first peer to announce a block at that height, which is 0 for it
+    const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    uint64_t delay_ms = 0;
+    {
+      boost::unique_lock<boost::mutex> lock(m_block_announces_lock);
+      auto it = m_block_announces.find(height);
+      if (it == m_block_announces.end())
+      {
+        m_block_announces.emplace(height, now);
+        while (m_block_announces.size() > BLOCK_ANNOUNCES_KEPT)
+          m_block_announces.erase(m_block_announces.begin());
+      }
+      else
+      {
+        delay_ms = (now - it->second).total_milliseconds();
+      }
+    }
+    if (delay_ms <= BLOCK_ANNOUNCE_MAX_DELAY)
+      m_p2p->add_peer_block_delay(context, delay_ms);
+  }
   //------------------------------------------------------------------------------------------------------------------------
     template<class t_core>
     int t_cryptonote_protocol_handler<t_core>::handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_notify_new_block");
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_BLOCK (" << arg.b.txs.size() << " txes)");
     if(context.m_state != cryptonote_connection_context::state_normal)
       return 1;
@@ -350,6 +384,7 @@ namespace cryptonote
       LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
       return 1;
     }
+    add_block_announce(arg.current_blockchain_height, context);
     m_core.pause_mine();
     std::vector<block_complete_entry> blocks;
     blocks.push_back(arg.b);
@@ -402,6 +437,7 @@ namespace cryptonote
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_notify_new_fluffy_block");
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_FLUFFY_BLOCK (height " << arg.current_blockchain_height << ", " << arg.b.txs.size() << " txes)");
     if(context.m_state != cryptonote_connection_context::state_normal)
       return 1;
@@ -410,6 +446,9 @@ namespace cryptonote
       LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
       return 1;
     }
+    // the second notification, with the txs we asked for, isn't an announce
+    if(context.m_requested_objects.empty())
+      add_block_announce(arg.current_blockchain_height, context);
     
     m_core.pause_mine();
       
@@ -685,6 +724,7 @@ namespace cryptonote
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_request_fluffy_missing_tx");
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_FLUFFY_MISSING_TX (" << arg.missing_tx_indices.size() << " txes), block hash " << arg.block_hash);
     
     std::vector<std::pair<cryptonote::blobdata, block>> local_blocks;
@@ -759,8 +799,85 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    TRACE_SPAN("p2p.handle_notify_new_compact_block");
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_COMPACT_BLOCK (height " << arg.current_blockchain_height << ", " << arg.short_ids.size() / COMPACT_BLOCK_SHORT_ID_SIZE << " txes, " << arg.prefilled_txs.size() << " prefilled)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+      return 1;
+    }
+    add_block_announce(arg.current_blockchain_height, context);
+
+    block new_block;
+    if(!parse_and_validate_block_from_blob(arg.block, new_block) || !new_block.tx_hashes.empty() ||
+       arg.short_ids.size() % COMPACT_BLOCK_SHORT_ID_SIZE || arg.prefilled_tx_indices.size() != arg.prefilled_txs.size())
+    {
+      LOG_ERROR_CCONTEXT("sent wrong compact block " << arg.block_hash << ", dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    std::vector<crypto::hash> tx_hashes(arg.short_ids.size() / COMPACT_BLOCK_SHORT_ID_SIZE, crypto::null_hash);
+
+    // txs sent along are placed by index, they are verified when the block is handled as a fluffy one
+    for (size_t i = 0; i < arg.prefilled_txs.size(); ++i)
+    {
+      transaction tx;
+      crypto::hash tx_prefix_hash;
+      if (arg.prefilled_tx_indices[i] >= tx_hashes.size() || !parse_and_validate_tx_from_blob(arg.prefilled_txs[i], tx, tx_hashes[arg.prefilled_tx_indices[i]], tx_prefix_hash))
+      {
+        LOG_ERROR_CCONTEXT("sent wrong prefilled tx in compact block " << arg.block_hash << ", dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+    }
+
+    std::vector<crypto::hash> pool_tx_hashes;
+    m_core.get_pool_transaction_hashes(pool_tx_hashes);
+
+    std::vector<uint64_t> need_tx_indices;
+    resolve_compact_short_ids(arg.short_id_salt, arg.short_ids, pool_tx_hashes, tx_hashes, need_tx_indices);
+
+    if (need_tx_indices.empty())
+    {
+      new_block.tx_hashes = std::move(tx_hashes);
+      new_block.invalidate_hashes();
+
+      // a short id collision picks a wrong tx, ask for all of them then
+      if (get_block_hash(new_block) != arg.block_hash)
+      {
+        MDEBUG("Compact block " << arg.block_hash << " was not reconstructed from the pool");
+        for (uint64_t i = 0; i < new_block.tx_hashes.size(); ++i)
+          need_tx_indices.push_back(i);
+      }
+    }
+
+    if (!need_tx_indices.empty())
+    {
+      MDEBUG("We are missing " << need_tx_indices.size() << " txes for this compact block");
+      NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+      missing_tx_req.block_hash = arg.block_hash;
+      missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+      missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+      post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+      return 1;
+    }
+
+    NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+    fluffy_arg.b.block = block_to_blob(new_block);
+    fluffy_arg.b.txs = std::move(arg.prefilled_txs);
+    fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+    return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_notify_new_transactions");
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTIONS (" << arg.txs.size() << " txes)");
     if(context.m_state != cryptonote_connection_context::state_normal)
       return 1;
@@ -793,7 +910,6 @@ namespace cryptonote
 
     if(arg.txs.size())
     {
-      //TODO: add announce usage here
       relay_transactions(arg, context);
     }
 
@@ -801,8 +917,160 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_tx_hashes(int command, NOTIFY_NEW_TX_HASHES::request& arg, cryptonote_connection_context& context)
+  {
+    TRACE_SPAN("p2p.handle_notify_new_tx_hashes");
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TX_HASHES (" << arg.txs.size() << " txes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new tx hashes while syncing, ignored");
+      return 1;
+    }
+
+    if(arg.txs.size() > TX_ANNOUNCE_MAX_COUNT)
+    {
+      LOG_PRINT_CCONTEXT_L1("Too many tx hashes announced (" << arg.txs.size() << "), dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    std::vector<crypto::hash> missing_txs;
+    for (const crypto::hash &tx_hash: arg.txs)
+      if (!m_core.pool_has_tx(tx_hash))
+        missing_txs.push_back(tx_hash);
+
+    NOTIFY_REQUEST_TXS::request req;
+    {
+      boost::unique_lock<boost::mutex> lock(m_known_txs_lock);
+      add_known_txs(context.m_connection_id, arg.txs);
+
+      const time_t now = time(NULL);
+      if (m_requested_txs.size() > KNOWN_TXS_MAX_COUNT)
+      {
+        for (auto it = m_requested_txs.begin(); it != m_requested_txs.end(); )
+        {
+          if (now - it->second >= TX_REQUEST_TIMEOUT)
+            it = m_requested_txs.erase(it);
+          else
+            ++it;
+        }
+      }
+
+      // each tx is asked from the first peer announcing it, the others are only asked if it doesn't come
+      for (const crypto::hash &tx_hash: missing_txs)
+      {
+        auto it = m_requested_txs.find(tx_hash);
+        if (it != m_requested_txs.end() && now - it->second < TX_REQUEST_TIMEOUT)
+          continue;
+        m_requested_txs[tx_hash] = now;
+        req.txs.push_back(tx_hash);
+      }
+    }
+
+    if (!req.txs.empty())
+    {
+      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_TXS: txs.size()=" << req.txs.size());
+      post_notify<NOTIFY_REQUEST_TXS>(req, context);
+    }
+
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_txs(int command, NOTIFY_REQUEST_TXS::request& arg, cryptonote_connection_context& context)
+  {
+    TRACE_SPAN("p2p.handle_request_txs");
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_TXS (" << arg.txs.size() << " txes)");
+    if(arg.txs.size() > TX_ANNOUNCE_MAX_COUNT)
+    {
+      LOG_PRINT_CCONTEXT_L1("Too many txes requested (" << arg.txs.size() << "), dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // txs which left the pool meanwhile are skipped, the peer gets them with the block
+    NOTIFY_NEW_TRANSACTIONS::request rsp;
+    std::vector<crypto::hash> sent_txs;
+    for (const crypto::hash &tx_hash: arg.txs)
+    {
+      blobdata tx_blob;
+      if (m_core.get_pool_transaction(tx_hash, tx_blob))
+      {
+        rsp.txs.push_back(std::move(tx_blob));
+        sent_txs.push_back(tx_hash);
+      }
+    }
+
+    if (rsp.txs.empty())
+      return 1;
+
+    {
+      boost::unique_lock<boost::mutex> lock(m_known_txs_lock);
+      add_known_txs(context.m_connection_id, sent_txs);
+    }
+
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_NEW_TRANSACTIONS: txs.size()=" << rsp.txs.size());
+    post_notify<NOTIFY_NEW_TRANSACTIONS>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_compressed_payload(int command, NOTIFY_COMPRESSED_PAYLOAD::request& arg, cryptonote_connection_context& context)
+  {
+    TRACE_SPAN("p2p.handle_notify_compressed_payload");
+    MLOG_P2P_MESSAGE("Received NOTIFY_COMPRESSED_PAYLOAD (command " << arg.command << ", " << arg.blob.size() << " bytes)");
+    // the uncompressed notification is held to the same limit as a packet
+    std::string blob;
+    if(!decompress_payload(arg.blob, blob, P2P_DEFAULT_PACKET_MAX_SIZE))
+    {
+      LOG_ERROR_CCONTEXT("failed to decompress NOTIFY_COMPRESSED_PAYLOAD, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    arg.blob.clear();
+
+    // only bulk sync responses are ever compressed
+    switch(arg.command)
+    {
+      case NOTIFY_RESPONSE_GET_OBJECTS::ID:
+      {
+        NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
+        if(epee::serialization::load_t_from_binary(rsp, blob))
+          return handle_response_get_objects(NOTIFY_RESPONSE_GET_OBJECTS::ID, rsp, context);
+        break;
+      }
+      case NOTIFY_RESPONSE_CHAIN_ENTRY::ID:
+      {
+        NOTIFY_RESPONSE_CHAIN_ENTRY::request rsp;
+        if(epee::serialization::load_t_from_binary(rsp, blob))
+          return handle_response_chain_entry(NOTIFY_RESPONSE_CHAIN_ENTRY::ID, rsp, context);
+        break;
+      }
+      default:
+        break;
+    }
+
+    LOG_ERROR_CCONTEXT("sent wrong NOTIFY_COMPRESSED_PAYLOAD with command " << arg.command << ", dropping connection");
+    drop_connection(context, false, false);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_known_txs(const boost::uuids::uuid& connection_id, const std::vector<crypto::hash>& tx_hashes)
+  {
+    std::unordered_set<crypto::hash> &known_txs = m_known_txs[connection_id];
+    if (known_txs.size() + tx_hashes.size() > KNOWN_TXS_MAX_COUNT)
+      known_txs.clear();
+    known_txs.insert(tx_hashes.begin(), tx_hashes.end());
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_request_get_objects");
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_GET_OBJECTS (" << arg.blocks.size() << " blocks, " << arg.txs.size() << " txes)");
     NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
     if(!m_core.handle_get_objects(arg, rsp, context))
@@ -813,7 +1081,7 @@ namespace cryptonote
     }
     LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_GET_OBJECTS: blocks.size()=" << rsp.blocks.size() << ", txs.size()=" << rsp.txs.size()
                             << ", rsp.m_current_blockchain_height=" << rsp.current_blockchain_height << ", missed_ids.size()=" << rsp.missed_ids.size());
-    post_notify<NOTIFY_RESPONSE_GET_OBJECTS>(rsp, context);
+    post_notify_compressed<NOTIFY_RESPONSE_GET_OBJECTS>(rsp, context);
     //handler_response_blocks_now(sizeof(rsp)); // XXX
     //handler_response_blocks_now(200);
     return 1;
@@ -838,6 +1106,7 @@ namespace cryptonote
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_response_get_objects(int command, NOTIFY_RESPONSE_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_response_get_objects");
     MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_GET_OBJECTS (" << arg.blocks.size() << " blocks, " << arg.txs.size() << " txes)");
 
     // calculate size of request
@@ -931,6 +1200,15 @@ namespace cryptonote
       block_hashes.push_back(block_hash);
     }
 
+    if(context.m_requested_objects.size() && !arg.missed_ids.empty() && get_peer_pruning_stripe(context))
+    {
+      // pruned peers don't have the full old blocks of other stripes, their span is for someone else
+      MDEBUG(context << " pruned peer missed " << arg.missed_ids.size() << " blocks, leaving them to other peers");
+      context.m_requested_objects.clear();
+      m_block_queue.flush_spans(context.m_connection_id);
+      return 1;
+    }
+
     if(context.m_requested_objects.size())
     {
       MERROR("returned not all requested objects (context.m_requested_objects.size()="
@@ -957,6 +1235,8 @@ namespace cryptonote
       const boost::posix_time::time_duration dt = now - context.m_last_request_time;
       const float rate = size * 1e6 / (dt.total_microseconds() + 1);
       MDEBUG(context << " adding span: " << arg.blocks.size() << " at height " << start_height << ", " << dt.total_microseconds()/1e6 << " seconds, " << (rate/1e3) << " kB/s, size now " << (m_block_queue.get_data_size() + blocks_size) / 1048576.f << " MB");
+      if (size >= PEER_THROUGHPUT_MIN_SPAN_SIZE)
+        m_p2p->add_peer_throughput(context, rate);
       m_block_queue.add_blocks(start_height, arg.blocks, context.m_connection_id, rate, blocks_size);
 
       context.m_last_known_hash = last_block_hash;
@@ -1051,6 +1331,13 @@ skip:
 
           m_core.prepare_handle_incoming_blocks(blocks);
 
+          // hash the next span while this one is verified and written
+          {
+            std::vector<cryptonote::block_complete_entry> next_blocks;
+            if (m_block_queue.get_filled_span(start_height + blocks.size(), next_blocks))
+              m_core.prefetch_incoming_blocks(next_blocks, start_height + blocks.size());
+          }
+
           uint64_t block_process_time_full = 0, transactions_process_time_full = 0;
           size_t num_txs = 0;
           for(const block_complete_entry& block_entry: blocks)
@@ -1161,6 +1448,7 @@ skip:
           if (m_core.get_current_blockchain_height() > previous_height)
           {
             const boost::posix_time::time_duration dt = boost::posix_time::microsec_clock::universal_time() - start;
+            m_block_queue.on_blocks_added(m_core.get_current_blockchain_height() - previous_height, dt.total_microseconds());
             std::string timing_message = "";
             if (ELPP->vRegistry()->allowed(el::Level::Info, "sync-info"))
               timing_message = std::string(" (") + std::to_string(dt.total_microseconds()/1e6) + " sec, "
@@ -1245,20 +1533,32 @@ skip:
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_request_chain");
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_CHAIN (" << arg.block_ids.size() << " blocks");
     NOTIFY_RESPONSE_CHAIN_ENTRY::request r;
-    if(!m_core.find_blockchain_supplement(arg.block_ids, r))
+    if(!m_core.find_blockchain_supplement(arg.block_ids, r, arg.request_headers))
     {
       LOG_ERROR_CCONTEXT("Failed to handle NOTIFY_REQUEST_CHAIN.");
       drop_connection(context, false, false);
       return 1;
     }
     LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_CHAIN_ENTRY: m_start_height=" << r.start_height << ", m_total_height=" << r.total_height << ", m_block_ids.size()=" << r.m_block_ids.size());
-    post_notify<NOTIFY_RESPONSE_CHAIN_ENTRY>(r, context);
+    post_notify_compressed<NOTIFY_RESPONSE_CHAIN_ENTRY>(r, context);
     return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  uint32_t t_cryptonote_protocol_handler<t_core>::get_peer_pruning_stripe(const cryptonote_connection_context& context) const
+  {
+    uint32_t pruning_stripe = 0;
+    m_p2p->for_connection(context.m_connection_id, [&pruning_stripe](cryptonote_connection_context&, nodetool::peerid_type, uint32_t support_flags) {
+      pruning_stripe = tools::get_pruning_stripe_from_support_flags(support_flags);
+      return true;
+    });
+    return pruning_stripe;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::should_download_next_span(cryptonote_connection_context& context) const
   {
     std::vector<crypto::hash> hashes;
@@ -1400,7 +1700,7 @@ skip:
       NOTIFY_REQUEST_GET_OBJECTS::request req;
       bool is_next = false;
       size_t count = 0;
-      const size_t count_limit = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+      const size_t count_limit = m_block_queue.get_span_size(context.m_connection_id, m_core.get_block_sync_size(m_core.get_current_blockchain_height()), BLOCKS_SYNCHRONIZING_MAX_COUNT);
       std::pair<uint64_t, uint64_t> span = std::make_pair(0, 0);
       {
         MDEBUG(context << " checking for gap");
@@ -1466,9 +1766,17 @@ skip:
         if (skip > 0)
           context.m_needed_objects = std::vector<crypto::hash>(context.m_needed_objects.begin() + skip, context.m_needed_objects.end());
 
+        const uint32_t pruning_stripe = get_peer_pruning_stripe(context);
         const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
-        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_needed_objects);
+        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_needed_objects,
+            pruning_stripe, context.m_remote_blockchain_height);
         MDEBUG(context << " span from " << first_block_height << ": " << span.first << "/" << span.second);
+        if (span.second == 0 && pruning_stripe)
+        {
+          // asking for the chain again would get the same hashes, the peer is kicked as idle if no one else can use it
+          MDEBUG(context << " pruned peer (stripe " << pruning_stripe << ") has none of the blocks we need, leaving them to other peers");
+          return true;
+        }
       }
       if (span.second == 0 && !force_next_span)
       {
@@ -1548,6 +1856,7 @@ skip:
       }
 
       handler_request_blocks_history( r.block_ids ); // change the limit(?), sleep(?)
+      r.request_headers = true;
 
       //std::string blob; // for calculate size of request
       //epee::serialization::store_t_to_binary(r, blob);
@@ -1617,6 +1926,7 @@ skip:
   template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context)
   {
+    TRACE_SPAN("p2p.handle_response_chain_entry");
     MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_CHAIN_ENTRY: m_block_ids.size()=" << arg.m_block_ids.size()
       << ", m_start_height=" << arg.start_height << ", m_total_height=" << arg.total_height);
 
@@ -1652,6 +1962,18 @@ skip:
       return 1;
     }
 
+    // headers sent along with the ids are hashed ahead, so PoW is ready when the bodies arrive from any peer
+    if (!arg.m_block_hashing_blobs.empty())
+    {
+      if (arg.m_block_hashing_blobs.size() > arg.m_block_ids.size() || arg.m_block_hashing_blobs.size() > BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT
+        || m_core.prevalidate_block_headers(arg.start_height, arg.m_block_ids, arg.m_block_hashing_blobs) < arg.m_block_hashing_blobs.size())
+      {
+        LOG_ERROR_CCONTEXT("sent block headers not matching their ids, dropping connection");
+        drop_connection(context, true, false);
+        return 1;
+      }
+    }
+
     uint64_t added = 0;
     for(auto& bl_id: arg.m_block_ids)
     {
@@ -1683,13 +2005,18 @@ skip:
     fluffy_arg.b = arg.b;
     fluffy_arg.b.txs = fluffy_txs;
 
-    // sort peers between fluffy ones and others
-    std::list<boost::uuids::uuid> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // sort peers between compact, fluffy ones and others
+    std::list<boost::uuids::uuid> fullConnections, fluffyConnections, compactConnections;
+    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id)
       {
-        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+        {
+          LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING SHORT TX IDS");
+          compactConnections.push_back(context.m_connection_id);
+        }
+        else if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
           fluffyConnections.push_back(context.m_connection_id);
@@ -1703,7 +2030,22 @@ skip:
       return true;
     });
 
-    // send fluffy ones first, we want to encourage people to run that
+    if (!compactConnections.empty())
+    {
+      NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+      if (make_compact_block(arg, compact_arg))
+      {
+        std::string compactBlob;
+        epee::serialization::store_t_to_binary(compact_arg, compactBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, compactBlob, compactConnections);
+      }
+      else
+      {
+        fluffyConnections.splice(fluffyConnections.end(), compactConnections);
+      }
+    }
+
+    // send compact and fluffy ones first, we want to encourage people to run that
     if (!fluffyConnections.empty())
     {
       std::string fluffyBlob;
@@ -1721,12 +2063,130 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::make_compact_block(const NOTIFY_NEW_BLOCK::request& arg, NOTIFY_NEW_COMPACT_BLOCK::request& compact_arg)
+  {
+    block b;
+    if (!parse_and_validate_block_from_blob(arg.b.block, b))
+    {
+      MERROR("Failed to parse block to relay");
+      return false;
+    }
+
+    compact_arg.block_hash = get_block_hash(b);
+    compact_arg.current_blockchain_height = arg.current_blockchain_height;
+    compact_arg.short_id_salt = crypto::rand<uint64_t>();
+    compact_arg.short_ids = get_compact_short_ids(compact_arg.short_id_salt, b.tx_hashes);
+
+    // RTA txs are not necessarily relayed to every node before the block is, send them along
+    for (const blobdata &tx_blob : arg.b.txs)
+    {
+      transaction tx;
+      crypto::hash tx_hash, tx_prefix_hash;
+      if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash) || tx.type != transaction::tx_type_rta)
+        continue;
+
+      auto it = std::find(b.tx_hashes.begin(), b.tx_hashes.end(), tx_hash);
+      if (it == b.tx_hashes.end())
+        continue;
+
+      compact_arg.prefilled_tx_indices.push_back(it - b.tx_hashes.begin());
+      compact_arg.prefilled_txs.push_back(tx_blob);
+    }
+
+    b.tx_hashes.clear();
+    compact_arg.block = block_to_blob(b);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
   {
     // no check for success, so tell core they're relayed unconditionally
-    for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_blob_it)
-      m_core.on_transaction_relayed(*tx_blob_it);
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+    std::vector<crypto::hash> tx_hashes(arg.txs.size(), crypto::null_hash);
+    std::vector<char> push_txs(arg.txs.size(), 0);
+    for(size_t i = 0; i < arg.txs.size(); ++i)
+    {
+      m_core.on_transaction_relayed(arg.txs[i]);
+
+      // txs which can't be parsed here are pushed, the peers will judge them
+      transaction tx;
+      crypto::hash tx_prefix_hash;
+      if (!parse_and_validate_tx_from_blob(arg.txs[i], tx, tx_hashes[i], tx_prefix_hash))
+        push_txs[i] = 1;
+      else if (tx.type == transaction::tx_type_rta && arg.txs[i].size() <= RTA_TX_PUSH_MAX_SIZE)
+        push_txs[i] = 1;
+    }
+
+    // peers taking announces get the hashes of the txs they don't know, the others the txs themselves
+    std::list<boost::uuids::uuid> fullConnections, announceConnections;
+    m_p2p->for_each_connection([&exclude_context, &fullConnections, &announceConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      if (peer_id && exclude_context.m_connection_id != context.m_connection_id)
+      {
+        if (support_flags & P2P_SUPPORT_FLAG_TX_ANNOUNCE)
+          announceConnections.push_back(context.m_connection_id);
+        else
+          fullConnections.push_back(context.m_connection_id);
+      }
+      return true;
+    });
+
+    // peers with the same known txs get the same messages
+    std::map<std::vector<size_t>, std::list<boost::uuids::uuid>> announces;
+    {
+      boost::unique_lock<boost::mutex> lock(m_known_txs_lock);
+      if (!exclude_context.m_connection_id.is_nil())
+        add_known_txs(exclude_context.m_connection_id, tx_hashes);
+
+      for (const boost::uuids::uuid &connection_id: announceConnections)
+      {
+        std::vector<size_t> new_txs;
+        auto known_it = m_known_txs.find(connection_id);
+        for (size_t i = 0; i < arg.txs.size(); ++i)
+          if (known_it == m_known_txs.end() || !known_it->second.count(tx_hashes[i]))
+            new_txs.push_back(i);
+        add_known_txs(connection_id, tx_hashes);
+        if (!new_txs.empty())
+          announces[new_txs].push_back(connection_id);
+      }
+    }
+
+    for (const auto &announce: announces)
+    {
+      NOTIFY_NEW_TRANSACTIONS::request push_arg;
+      NOTIFY_NEW_TX_HASHES::request announce_arg;
+      for (size_t i: announce.first)
+      {
+        if (push_txs[i])
+          push_arg.txs.push_back(arg.txs[i]);
+        else
+          announce_arg.txs.push_back(tx_hashes[i]);
+      }
+
+      if (!push_arg.txs.empty())
+      {
+        std::string pushBlob;
+        epee::serialization::store_t_to_binary(push_arg, pushBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, pushBlob, announce.second);
+      }
+      for (size_t offset = 0; offset < announce_arg.txs.size(); offset += TX_ANNOUNCE_MAX_COUNT)
+      {
+        NOTIFY_NEW_TX_HASHES::request batch_arg;
+        batch_arg.txs.assign(announce_arg.txs.begin() + offset, announce_arg.txs.begin() + std::min<size_t>(offset + TX_ANNOUNCE_MAX_COUNT, announce_arg.txs.size()));
+        std::string announceBlob;
+        epee::serialization::store_t_to_binary(batch_arg, announceBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_TX_HASHES::ID, announceBlob, announce.second);
+      }
+    }
+
+    if (!fullConnections.empty())
+    {
+      std::string fullBlob;
+      epee::serialization::store_t_to_binary(arg, fullBlob);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, fullBlob, fullConnections);
+    }
+
+    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
@@ -1760,6 +2220,9 @@ skip:
     }
 
     m_block_queue.flush_spans(context.m_connection_id, false);
+
+    boost::unique_lock<boost::mutex> lock(m_known_txs_lock);
+    m_known_txs.erase(context.m_connection_id);
   }
 
   //------------------------------------------------------------------------------------------------------------------------
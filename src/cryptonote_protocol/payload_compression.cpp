@@ -0,0 +1,113 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "payload_compression.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+
+#ifdef HAVE_ZSTD
+
+/// Fast level, bulk sync responses are compressed on the serving node's network thread
+constexpr int PAYLOAD_COMPRESSION_LEVEL = 3;
+
+/// zstd contexts are expensive to create, keep one of each per thread
+struct zstd_contexts
+{
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
+
+  zstd_contexts() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {}
+
+  ~zstd_contexts()
+  {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+};
+
+zstd_contexts& get_contexts()
+{
+  static thread_local zstd_contexts contexts;
+  return contexts;
+}
+
+#endif
+
+}
+
+bool cryptonote::payload_compression_available()
+{
+#ifdef HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool cryptonote::compress_payload(const std::string &blob, std::string &compressed)
+{
+#ifdef HAVE_ZSTD
+  zstd_contexts& contexts = get_contexts();
+  if (!contexts.cctx)
+    return false;
+
+  compressed.resize(ZSTD_compressBound(blob.size()));
+  size_t size = ZSTD_compressCCtx(contexts.cctx, &compressed[0], compressed.size(), blob.data(), blob.size(), PAYLOAD_COMPRESSION_LEVEL);
+  if (ZSTD_isError(size) || size >= blob.size())
+    return false;
+
+  compressed.resize(size);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool cryptonote::decompress_payload(const std::string &compressed, std::string &blob, size_t max_size)
+{
+#ifdef HAVE_ZSTD
+  unsigned long long content_size = ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+  if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size > max_size)
+    return false;
+
+  zstd_contexts& contexts = get_contexts();
+  if (!contexts.dctx)
+    return false;
+
+  blob.resize(content_size);
+  size_t size = ZSTD_decompressDCtx(contexts.dctx, &blob[0], blob.size(), compressed.data(), compressed.size());
+  return !ZSTD_isError(size) && size == content_size;
+#else
+  return false;
+#endif
+}
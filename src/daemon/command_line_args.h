@@ -87,6 +87,11 @@ namespace daemon_args
   , ""
   , ""
   };
+  const command_line::arg_descriptor<bool> arg_log_async = {
+    "log-async"
+  , "Write the log from a background thread, lines are dropped when it can't keep up"
+  , false
+  };
   const command_line::arg_descriptor<std::vector<std::string>> arg_command = {
     "daemon_command"
   , "Hidden"
@@ -121,6 +126,30 @@ namespace daemon_args
     }
   };
 
+  const command_line::arg_descriptor<unsigned> arg_zmq_rpc_threads = {
+    "zmq-rpc-threads"
+  , "Number of threads handling ZMQ RPC requests"
+  , 4
+  };
+
+  const command_line::arg_descriptor<std::string> arg_zmq_pub_bind_ip   = {
+    "zmq-pub-bind-ip"
+      , "IP for ZMQ block, txpool and stake event publisher to listen on"
+      , "127.0.0.1"
+  };
+
+  const command_line::arg_descriptor<std::string> arg_zmq_pub_bind_port = {
+    "zmq-pub-bind-port"
+  , "Port for ZMQ block, txpool and stake event publisher to listen on, events are not published if empty"
+  , ""
+  };
+
+  const command_line::arg_descriptor<bool> arg_light_wallet_server = {
+    "light-wallet-server"
+  , "Scan the chain for the wallets logging in with their view key and serve them the light wallet RPC API"
+  , false
+  };
+
 }  // namespace daemon_args
 
 #endif // DAEMON_COMMAND_LINE_ARGS_H
@@ -154,6 +154,17 @@ bool t_command_parser_executor::set_log_level(const std::vector<std::string>& ar
   }
 }
 
+bool t_command_parser_executor::trace(const std::vector<std::string>& args)
+{
+  if (args.empty() || args.size() > 2 || (args[0] == "dump") != (args.size() == 2))
+  {
+    std::cout << "use: trace start|stop|clear|stats|dump <file>" << std::endl;
+    return true;
+  }
+
+  return m_executor.trace(args[0], args.size() == 2 ? args[1] : std::string());
+}
+
 bool t_command_parser_executor::print_height(const std::vector<std::string>& args) 
 {
   if (!args.empty()) return false;
@@ -79,6 +79,8 @@ public:
 
   bool set_log_categories(const std::vector<std::string>& args);
 
+  bool trace(const std::vector<std::string>& args);
+
   bool print_height(const std::vector<std::string>& args);
 
   bool print_block(const std::vector<std::string>& args);
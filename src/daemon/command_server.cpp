@@ -148,6 +148,12 @@ t_command_server::t_command_server(
     , "set_log <level>|<{+,-,}categories>"
     , "Change the current log level/categories where <level> is a number 0-4."
     );
+  m_command_lookup.set_handler(
+      "trace"
+    , std::bind(&t_command_parser_executor::trace, &m_parser, p::_1)
+    , "trace start|stop|clear|stats|dump <file>"
+    , "Start or stop recording hot path spans, show their timing histograms or write the recorded spans to <file> in the Chrome trace format."
+    );
   m_command_lookup.set_handler(
       "diff"
     , std::bind(&t_command_parser_executor::show_difficulty, &m_parser, p::_1)
@@ -51,12 +51,14 @@ private:
   // TEMPORARY HACK - Yes, this creates a copy, but otherwise the original
   // variable map could go out of scope before the run method is called
   boost::program_options::variables_map const m_vm_HACK;
+  bool m_deinitialized;
 public:
   t_core(
       boost::program_options::variables_map const & vm
     )
     : m_core{nullptr}
     , m_vm_HACK{vm}
+    , m_deinitialized{false}
   {
   }
 
@@ -98,8 +100,11 @@ public:
     return m_core;
   }
 
-  ~t_core()
+  void deinit()
   {
+    if (m_deinitialized)
+      return;
+    m_deinitialized = true;
     MGINFO("Deinitializing core...");
     try {
       m_core.deinit();
@@ -108,6 +113,11 @@ public:
       MERROR("Failed to deinitialize core...");
     }
   }
+
+  ~t_core()
+  {
+    deinit();
+  }
 };
 
 }
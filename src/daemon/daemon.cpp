@@ -31,9 +31,12 @@
 #include <memory>
 #include <stdexcept>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/filesystem/path.hpp>
 #include "misc_log_ex.h"
 #include "daemon/daemon.h"
 #include "rpc/daemon_handler.h"
+#include "rpc/light_wallet_server.h"
+#include "rpc/zmq_pub.h"
 #include "rpc/zmq_server.h"
 
 #include "common/password.h"
@@ -50,6 +53,7 @@
 using namespace epee;
 
 #include <functional>
+#include <future>
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "daemon"
@@ -57,28 +61,40 @@ using namespace epee;
 namespace daemonize {
 
 struct t_internals {
+public:
+  // declared first so the core, which calls its handlers, goes away before it
+  std::unique_ptr<cryptonote::rpc::ZmqPublisher> zmq_pub;
 private:
   t_protocol protocol;
 public:
   t_core core;
   t_p2p p2p;
   std::vector<std::unique_ptr<t_rpc>> rpcs;
+  std::unique_ptr<cryptonote::light_wallet_server> light_wallet;
+  std::string light_wallet_path;
 
   t_internals(
       boost::program_options::variables_map const & vm
     )
     : core{vm}
-    , protocol{vm, core, command_line::get_arg(vm, cryptonote::arg_offline)}
+    , protocol{vm, core, command_line::get_arg(vm, cryptonote::arg_offline) || command_line::get_arg(vm, cryptonote::arg_rpc_replica)}
     , p2p{vm, protocol}
   {
     // Handle circular dependencies
     protocol.set_p2p_endpoint(p2p.get());
     core.set_protocol(protocol.get());
 
+    if (!command_line::get_arg(vm, daemon_args::arg_zmq_pub_bind_port).empty())
+    {
+      zmq_pub.reset(new cryptonote::rpc::ZmqPublisher());
+      zmq_pub->attach(core.get());
+    }
+
     const auto testnet = command_line::get_arg(vm, cryptonote::arg_testnet_on);
     const auto stagenet = command_line::get_arg(vm, cryptonote::arg_stagenet_on);
     const auto regtest = command_line::get_arg(vm, cryptonote::arg_regtest_on);
-    const auto restricted = command_line::get_arg(vm, cryptonote::core_rpc_server::arg_restricted_rpc);
+    // a replica only serves restricted RPC
+    const auto restricted = command_line::get_arg(vm, cryptonote::core_rpc_server::arg_restricted_rpc) || command_line::get_arg(vm, cryptonote::arg_rpc_replica);
     const auto main_rpc_port = command_line::get_arg(vm, cryptonote::core_rpc_server::arg_rpc_bind_port);
     rpcs.emplace_back(new t_rpc{vm, core, p2p, restricted, testnet ? cryptonote::TESTNET : stagenet ? cryptonote::STAGENET : regtest ? cryptonote::FAKECHAIN : cryptonote::MAINNET, main_rpc_port, "core"});
 
@@ -88,6 +104,32 @@ public:
       auto restricted_rpc_port = command_line::get_arg(vm, restricted_rpc_port_arg);
       rpcs.emplace_back(new t_rpc{vm, core, p2p, true, testnet ? cryptonote::TESTNET : stagenet ? cryptonote::STAGENET : cryptonote::MAINNET, restricted_rpc_port, "restricted"});
     }
+
+    if (command_line::get_arg(vm, daemon_args::arg_light_wallet_server))
+    {
+      // opened once the core is, next to the blockchain
+      boost::filesystem::path path = command_line::get_arg(vm, cryptonote::arg_data_dir);
+      const std::string config_subdir = core.get_config_subdir();
+      if (!config_subdir.empty())
+        path /= config_subdir;
+      light_wallet_path = (path / "lightwallet").string();
+      light_wallet.reset(new cryptonote::light_wallet_server(core.get()));
+      for (auto& rpc: rpcs)
+        rpc->get_server()->set_light_wallet_server(light_wallet.get());
+    }
+  }
+
+  ~t_internals()
+  {
+    rpcs.clear();
+    if (light_wallet)
+      light_wallet->stop();
+
+    // the p2p state (and UPnP mapping removal) and the blockchain are stored at the same time;
+    // p2p threads are stopped at this point, so they don't use the core any more
+    std::future<void> p2p_deinit = std::async(std::launch::async, [this]() { p2p.deinit(); });
+    core.deinit();
+    p2p_deinit.wait();
   }
 };
 
@@ -105,6 +147,10 @@ t_daemon::t_daemon(
 {
   zmq_rpc_bind_port = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_bind_port);
   zmq_rpc_bind_address = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_bind_ip);
+  zmq_rpc_threads = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_threads);
+  log_async = command_line::get_arg(vm, daemon_args::arg_log_async);
+  zmq_pub_bind_port = command_line::get_arg(vm, daemon_args::arg_zmq_pub_bind_port);
+  zmq_pub_bind_address = command_line::get_arg(vm, daemon_args::arg_zmq_pub_bind_ip);
 }
 
 t_daemon::~t_daemon() = default;
@@ -137,6 +183,10 @@ bool t_daemon::run(bool interactive)
     throw std::runtime_error{"Can't run stopped daemon"};
   }
 
+  // started here rather than in main since the writer thread wouldn't survive forking to background
+  if (log_async)
+    mlog_start_async();
+
   std::atomic<bool> stop(false), shutdown(false);
   boost::thread stop_thread = boost::thread([&stop, &shutdown, this] {
     while (!stop)
@@ -147,17 +197,46 @@ bool t_daemon::run(bool interactive)
   epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){
     stop = true;
     stop_thread.join();
+    mlog_stop_async();
   });
   tools::signal_handler::install([&stop, &shutdown](int){ stop = shutdown = true; });
 
   try
   {
+    if (mp_internals->zmq_pub)
+    {
+      if (!mp_internals->zmq_pub->addTCPSocket(zmq_pub_bind_address, zmq_pub_bind_port))
+      {
+        LOG_ERROR(std::string("Failed to add TCP Socket (") + zmq_pub_bind_address
+            + ":" + zmq_pub_bind_port + ") to ZMQ publisher");
+        return false;
+      }
+      mp_internals->zmq_pub->run();
+      MINFO(std::string("ZMQ publisher started at ") + zmq_pub_bind_address
+            + ":" + zmq_pub_bind_port + ".");
+    }
+
+    // the p2p server is initialized in the background meanwhile
     if (!mp_internals->core.run())
       return false;
 
+    if (mp_internals->light_wallet)
+    {
+      mp_internals->light_wallet->init(mp_internals->light_wallet_path);
+      mp_internals->light_wallet->run();
+    }
+
+    mp_internals->p2p.wait_init();
+
     for(auto& rpc: mp_internals->rpcs)
       rpc->run();
 
+    // stake storages are loaded and brought up to the chain once RPC is up, next to the p2p startup
+    boost::thread stakes_sync_thread([this]() { mp_internals->core.get().synchronize_stakes(); });
+    epee::misc_utils::auto_scope_leave_caller stakes_sync_joiner = epee::misc_utils::create_scope_leave_handler([&]() {
+      stakes_sync_thread.join();
+    });
+
     std::unique_ptr<daemonize::t_command_server> rpc_commands;
     if (interactive && mp_internals->rpcs.size())
     {
@@ -167,7 +246,7 @@ bool t_daemon::run(bool interactive)
     }
 
     cryptonote::rpc::DaemonHandler rpc_daemon_handler(mp_internals->core.get(), mp_internals->p2p.get());
-    cryptonote::rpc::ZmqServer zmq_server(rpc_daemon_handler);
+    cryptonote::rpc::ZmqServer zmq_server(rpc_daemon_handler, zmq_rpc_threads);
 
     if (!zmq_server.addTCPSocket(zmq_rpc_bind_address, zmq_rpc_bind_port))
     {
@@ -196,8 +275,13 @@ bool t_daemon::run(bool interactive)
 
     zmq_server.stop();
 
+    if (mp_internals->zmq_pub)
+      mp_internals->zmq_pub->stop();
+
     for(auto& rpc : mp_internals->rpcs)
       rpc->stop();
+    if (mp_internals->light_wallet)
+      mp_internals->light_wallet->stop();
     mp_internals->core.get().get_miner().stop();
     MGINFO("Node stopped.");
     return true;
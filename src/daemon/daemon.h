@@ -45,6 +45,10 @@ private:
   std::unique_ptr<t_internals> mp_internals;
   std::string zmq_rpc_bind_address;
   std::string zmq_rpc_bind_port;
+  unsigned zmq_rpc_threads;
+  bool log_async;
+  std::string zmq_pub_bind_address;
+  std::string zmq_pub_bind_port;
 public:
   t_daemon(
       boost::program_options::variables_map const & vm
@@ -87,9 +87,14 @@ int main(int argc, char const * argv[])
       command_line::add_arg(core_settings, daemon_args::arg_log_level);
       command_line::add_arg(core_settings, daemon_args::arg_max_log_file_size);
       command_line::add_arg(core_settings, daemon_args::arg_max_log_files);
+      command_line::add_arg(core_settings, daemon_args::arg_log_async);
       command_line::add_arg(core_settings, daemon_args::arg_max_concurrency);
       command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_bind_ip);
       command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_bind_port);
+      command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_threads);
+      command_line::add_arg(core_settings, daemon_args::arg_zmq_pub_bind_ip);
+      command_line::add_arg(core_settings, daemon_args::arg_zmq_pub_bind_port);
+      command_line::add_arg(core_settings, daemon_args::arg_light_wallet_server);
 
       daemonizer::init_options(hidden_options, visible_options);
       daemonize::t_executor::init_options(core_settings);
@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <future>
+
 #include "cryptonote_protocol/cryptonote_protocol_handler.h"
 #include "p2p/net_node.h"
 #include "daemon/protocol.h"
@@ -52,20 +54,33 @@ public:
   }
 private:
   t_node_server m_server;
+  std::future<void> m_init;
+  bool m_initialized;
 public:
   t_p2p(
       boost::program_options::variables_map const & vm
     , t_protocol & protocol
     )
     : m_server{protocol.get()}
+    , m_initialized{false}
   {
-    //initialize objects
+    //initialize objects while the core is initialized; the core is only given handlers here
     MGINFO("Initializing p2p server...");
-    if (!m_server.init(vm))
-    {
-      throw std::runtime_error("Failed to initialize p2p server.");
-    }
-    MGINFO("p2p server initialized OK");
+    m_init = std::async(std::launch::async, [this, vm]() {
+      if (!m_server.init(vm))
+      {
+        throw std::runtime_error("Failed to initialize p2p server.");
+      }
+      m_initialized = true;
+      MGINFO("p2p server initialized OK");
+    });
+  }
+
+  /// Wait for the initialization; throws if it has failed
+  void wait_init()
+  {
+    if (m_init.valid())
+      m_init.get();
   }
 
   t_node_server & get()
@@ -85,8 +100,15 @@ public:
     m_server.send_stop_signal();
   }
 
-  ~t_p2p()
+  void deinit()
   {
+    try {
+      wait_init();
+    } catch (...) {
+    }
+    if (!m_initialized)
+      return;
+    m_initialized = false;
     MGINFO("Deinitializing p2p...");
     try {
       m_server.deinit();
@@ -94,6 +116,11 @@ public:
       MERROR("Failed to deinitialize p2p...");
     }
   }
+
+  ~t_p2p()
+  {
+    deinit();
+  }
 };
 
 }
@@ -637,6 +637,43 @@ bool t_rpc_command_executor::set_log_categories(const std::string &categories) {
   return true;
 }
 
+bool t_rpc_command_executor::trace(const std::string &action, const std::string &file) {
+  cryptonote::COMMAND_RPC_TRACE::request req;
+  cryptonote::COMMAND_RPC_TRACE::response res;
+  req.action = action;
+  req.file = file;
+
+  std::string fail_message = "Unsuccessful";
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->rpc_request(req, res, "/trace", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_trace(req, res) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << make_error(fail_message, res.status);
+      return true;
+    }
+  }
+
+  if (action == "dump")
+    tools::success_msg_writer() << "Wrote " << res.events << " events to " << file;
+  else if (action == "stats")
+  {
+    tools::msg_writer() << boost::format("%-48s %10s %12s %10s %10s %10s") % "span" % "count" % "total ms" % "p50 us" % "p99 us" % "max us";
+    for (const auto &h: res.histograms)
+      tools::msg_writer() << boost::format("%-48s %10u %12.3f %10.1f %10.1f %10.1f") % h.name % h.count % (h.total_ns / 1e6) % (h.p50_ns / 1e3) % (h.p99_ns / 1e3) % (h.max_ns / 1e3);
+  }
+  tools::success_msg_writer() << "Tracing is " << (res.enabled ? "enabled" : "disabled");
+
+  return true;
+}
+
 bool t_rpc_command_executor::print_height() {
   cryptonote::COMMAND_RPC_GET_HEIGHT::request req;
   cryptonote::COMMAND_RPC_GET_HEIGHT::response res;
@@ -1933,7 +1970,7 @@ bool t_rpc_command_executor::sync_info()
       for (const auto &s: res.spans)
         if (s.rate > 0.0f && s.connection_id == p.info.connection_id)
           nblocks += s.nblocks, size += s.size;
-      tools::success_msg_writer() << address << "  " << epee::string_tools::pad_string(p.info.peer_id, 16, '0', true) << "  " << epee::string_tools::pad_string(p.info.state, 16) << "  " << p.info.height << "  "  << p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued";
+      tools::success_msg_writer() << address << "  " << epee::string_tools::pad_string(p.info.peer_id, 16, '0', true) << "  " << epee::string_tools::pad_string(p.info.state, 16) << "  " << p.info.height << "  "  << p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued, " << (unsigned)(p.rate/1e3) << " kB/s measured over " << p.nblocks << " blocks, span " << p.span_size;
     }
 
     uint64_t total_size = 0;
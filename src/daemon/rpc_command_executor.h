@@ -89,6 +89,8 @@ public:
 
   bool set_log_categories(const std::string &categories);
 
+  bool trace(const std::string &action, const std::string &file);
+
   bool print_height();
 
   bool print_block_by_hash(crypto::hash block_hash);
@@ -32,12 +32,14 @@
 
 #include "device_default.hpp"
 #include "common/int-util.h"
+#include "common/threadpool.h"
 #include "cryptonote_basic/account.h"
 #include "cryptonote_basic/subaddress_index.h"
 #include "ringct/rctOps.h"
 
 #define ENCRYPTED_PAYMENT_ID_TAIL 0x8d
 #define CHACHA8_KEY_TAIL 0x8c
+#define SUBADDRESS_PARALLEL_MIN_KEYS 256
 
 namespace hw {
 
@@ -143,38 +145,66 @@ namespace hw {
         std::vector<crypto::public_key>  device_default::get_subaddress_spend_public_keys(const cryptonote::account_keys &keys, uint32_t account, uint32_t begin, uint32_t end) {
             CHECK_AND_ASSERT_THROW_MES(begin <= end, "begin > end");
 
-            std::vector<crypto::public_key> pkeys;
-            pkeys.reserve(end - begin);
-            cryptonote::subaddress_index index = {account, begin};
+            std::vector<crypto::public_key> pkeys(end - begin);
 
-            ge_p3 p3;
+            ge_p3 B;
             ge_cached cached;
-            CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&p3, (const unsigned char*)keys.m_account_address.m_spend_public_key.data) == 0,
+            CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&B, (const unsigned char*)keys.m_account_address.m_spend_public_key.data) == 0,
                 "ge_frombytes_vartime failed to convert spend public key");
-            ge_p3_to_cached(&cached, &p3);
+            ge_p3_to_cached(&cached, &B);
 
-            for (uint32_t idx = begin; idx < end; ++idx)
-            {
-                index.minor = idx;
-                if (index.is_zero())
+            // D = B + m*G for minor indices [first, last), converted to bytes with shared field inversions
+            auto derive = [&](uint32_t first, uint32_t last) {
+                std::vector<ge_p2> points(last - first);
+                cryptonote::subaddress_index index = {account, first};
+                for (uint32_t idx = first; idx < last; ++idx)
                 {
-                    pkeys.push_back(keys.m_account_address.m_spend_public_key);
-                    continue;
+                    index.minor = idx;
+                    if (index.is_zero())
+                    {
+                        ge_p3_to_p2(&points[idx - first], &B);
+                        continue;
+                    }
+                    // m = Hs(a || index_major || index_minor)
+                    crypto::secret_key m = get_subaddress_secret_key(keys.m_view_secret_key, index);
+
+                    // M = m*G
+                    ge_p3 M;
+                    ge_scalarmult_base(&M, (const unsigned char*)m.data);
+
+                    // D = B + M
+                    ge_p1p1 p1p1;
+                    ge_add(&p1p1, &M, &cached);
+                    ge_p1p1_to_p2(&points[idx - first], &p1p1);
                 }
-                crypto::secret_key m = get_subaddress_secret_key(keys.m_view_secret_key, index);
+                ge_tobytes_batch((unsigned char*)pkeys[first - begin].data, points.data(), points.size());
+            };
 
-                // M = m*G
-                ge_scalarmult_base(&p3, (const unsigned char*)m.data);
+            const uint32_t count = end - begin;
+            tools::threadpool& tpool = tools::threadpool::getInstance();
+            const uint32_t threads = tpool.get_max_concurrency();
+            if (count < 2 * SUBADDRESS_PARALLEL_MIN_KEYS || threads < 2)
+            {
+                if (count)
+                    derive(begin, end);
+            }
+            else
+            {
+                // large lookahead windows (e.g. per order addresses of merchant wallets) are generated in parallel
+                const uint32_t chunk = std::max<uint32_t>(SUBADDRESS_PARALLEL_MIN_KEYS, (count + threads - 1) / threads);
+                tools::threadpool::waiter waiter;
+                for (uint32_t first = begin; first < end; first += std::min(chunk, end - first))
+                {
+                    const uint32_t last = first + std::min(chunk, end - first);
+                    tpool.submit(&waiter, [&derive, first, last]() { derive(first, last); }, true);
+                }
+                waiter.wait(&tpool);
+            }
 
-                // D = B + M
-                crypto::public_key D;
-                ge_p1p1 p1p1;
-                ge_add(&p1p1, &p3, &cached);
-                ge_p1p1_to_p3(&p3, &p1p1);
-                ge_p3_tobytes((unsigned char*)D.data, &p3);
+            // the spend key as is, rather than its re-encoding
+            if (account == 0 && begin == 0 && count)
+                pkeys[0] = keys.m_account_address.m_spend_public_key;
 
-                pkeys.push_back(D);
-            }
             return pkeys;
         }
 
@@ -241,6 +271,10 @@ namespace hw {
             return crypto::generate_key_derivation(key1, key2, derivation);
         }
 
+        bool device_default::generate_key_derivations(const crypto::secret_key &sec, epee::span<const crypto::public_key> pubs, epee::span<crypto::key_derivation> derivations) {
+            return crypto::generate_key_derivations(sec, pubs, derivations);
+        }
+
         bool device_default::derivation_to_scalar(const crypto::key_derivation &derivation, const size_t output_index, crypto::ec_scalar &res){
             crypto::derivation_to_scalar(derivation,output_index, res);
             return true;
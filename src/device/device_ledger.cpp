@@ -288,6 +288,7 @@ namespace hw {
 
     bool device_ledger::reset() {
         send_simple(INS_RESET);
+        clear_response_cache();
         return true;
     }
      
@@ -305,6 +306,37 @@ namespace hw {
       return this->sw;
     }
 
+    unsigned int device_ledger::exchange_cached() {
+      //only scanning commands are served from the cache, the device may track the other ones
+      if (this->mode != TRANSACTION_PARSE && this->mode != NONE) {
+        return this->exchange();
+      }
+
+      std::string command((const char*)this->buffer_send, this->length_send);
+      auto it = this->response_cache.find(command);
+      if (it != this->response_cache.end()) {
+        memmove(this->buffer_recv, it->second.data(), it->second.size());
+        this->length_recv = it->second.size();
+        this->sw = 0x9000;
+        return this->sw;
+      }
+
+      this->exchange();
+
+      if (this->response_cache.size() >= RESPONSE_CACHE_MAX_SIZE) {
+        this->clear_response_cache();
+      }
+      this->response_cache.emplace(std::move(command), std::string((const char*)this->buffer_recv, this->length_recv));
+      return this->sw;
+    }
+
+    void device_ledger::clear_response_cache() {
+      for (auto &e : this->response_cache) {
+        memwipe(&e.second[0], e.second.size());
+      }
+      this->response_cache.clear();
+    }
+
     void device_ledger::reset_buffer() {
       this->length_send = 0;
       memset(this->buffer_send, 0, BUFFER_SEND_SIZE);
@@ -359,6 +391,7 @@ namespace hw {
 
     bool device_ledger::disconnect() {
       hw_device.disconnect();
+      clear_response_cache();
       return true;
     }
 
@@ -511,7 +544,7 @@ namespace hw {
 
         this->buffer_send[4] = offset-5;
         this->length_send = offset;
-        this->exchange();
+        this->exchange_cached();
 
         //pub key
         memmove(derived_pub.data, &this->buffer_recv[0], 32);
@@ -845,7 +878,7 @@ namespace hw {
 
         this->buffer_send[4] = offset-5;
         this->length_send = offset;
-        this->exchange();
+        this->exchange_cached();
 
         //derivattion data
         memmove(derivation.data, &this->buffer_recv[0], 32);
@@ -864,6 +897,22 @@ namespace hw {
       return r;
     }
 
+    bool device_ledger::generate_key_derivations(const crypto::secret_key &sec, epee::span<const crypto::public_key> pubs, epee::span<crypto::key_derivation> derivations) {
+      if ((this->mode == TRANSACTION_PARSE)  && has_view_key) {
+        //same as generate_key_derivation, the view key is known so do that without the device
+        MDEBUG( "generate_key_derivations : PARSE mode with known viewkey");
+        assert(is_fake_view_key(sec));
+        return crypto::generate_key_derivations(this->viewkey, pubs, derivations);
+      }
+
+      bool r = true;
+      for (size_t i = 0; i < pubs.size(); ++i) {
+        if (!this->generate_key_derivation(pubs.data()[i], sec, derivations.data()[i]))
+          r = false;
+      }
+      return r;
+    }
+
     bool device_ledger::conceal_derivation(crypto::key_derivation &derivation, const crypto::public_key &tx_pub_key, const std::vector<crypto::public_key> &additional_tx_pub_keys, const crypto::key_derivation &main_derivation, const std::vector<crypto::key_derivation> &additional_derivations) {
       const crypto::public_key *pkey=NULL;
       if (derivation == main_derivation) {        
@@ -908,7 +957,7 @@ namespace hw {
 
         this->buffer_send[4] = offset-5;
         this->length_send = offset;
-        this->exchange();
+        this->exchange_cached();
 
         //derivattion data
         memmove(res.data, &this->buffer_recv[0], 32);
@@ -952,7 +1001,7 @@ namespace hw {
 
         this->buffer_send[4] = offset-5;
         this->length_send = offset;
-        this->exchange();
+        this->exchange_cached();
 
         //pub key
         memmove(derived_sec.data, &this->buffer_recv[0], 32);
@@ -996,7 +1045,7 @@ namespace hw {
 
         this->buffer_send[4] = offset-5;
         this->length_send = offset;
-        this->exchange();
+        this->exchange_cached();
 
         //pub key
         memmove(derived_pub.data, &this->buffer_recv[0], 32);
@@ -1064,7 +1113,7 @@ namespace hw {
 
         this->buffer_send[4] = offset-5;
         this->length_send = offset;
-        this->exchange();
+        this->exchange_cached();
 
         //pub key
         memmove(image.data, &this->buffer_recv[0], 32);
@@ -32,6 +32,7 @@
 
 #include <cstddef>
 #include <string>
+#include <unordered_map>
 #include "device.hpp"
 #include "device_io_hid.hpp"
 #include <boost/thread/mutex.hpp>
@@ -76,6 +77,7 @@ namespace hw {
 
     #define BUFFER_SEND_SIZE 262
     #define BUFFER_RECV_SIZE 262
+    #define RESPONSE_CACHE_MAX_SIZE 8192
 
     class device_ledger : public hw::device {
     private:
@@ -95,6 +97,8 @@ namespace hw {
         void logCMD(void);
         void logRESP(void);
         unsigned int exchange(unsigned int ok=0x9000, unsigned int mask=0xFFFF);
+        unsigned int exchange_cached();
+        void clear_response_cache();
         void reset_buffer(void);
         int  set_command_header(unsigned char ins, unsigned char p1 = 0x00, unsigned char p2 = 0x00);
         int  set_command_header_noopt(unsigned char ins, unsigned char p1 = 0x00, unsigned char p2 = 0x00);
@@ -105,6 +109,10 @@ namespace hw {
         device_mode mode;
         // map public destination key to ephemeral destination key
         Keymap key_map;
+        // responses to the deterministic commands sent while scanning, by command APDU, so the wallet
+        // asking again for a derivation or a key image of the same output doesn't cost a USB round trip;
+        // inputs and outputs are encrypted with the session key, so entries are valid until the next reset
+        std::unordered_map<std::string, std::string> response_cache;
 
         // To speed up blockchain parsing the view key maybe handle here.
         crypto::secret_key viewkey;
@@ -175,6 +183,7 @@ namespace hw {
         bool  sc_secret_add(crypto::secret_key &r, const crypto::secret_key &a, const crypto::secret_key &b) override;
         crypto::secret_key  generate_keys(crypto::public_key &pub, crypto::secret_key &sec, const crypto::secret_key& recovery_key = crypto::secret_key(), bool recover = false) override;
         bool  generate_key_derivation(const crypto::public_key &pub, const crypto::secret_key &sec, crypto::key_derivation &derivation) override;
+        bool  generate_key_derivations(const crypto::secret_key &sec, epee::span<const crypto::public_key> pubs, epee::span<crypto::key_derivation> derivations) override;
         bool  conceal_derivation(crypto::key_derivation &derivation, const crypto::public_key &tx_pub_key, const std::vector<crypto::public_key> &additional_tx_pub_keys, const crypto::key_derivation &main_derivation, const std::vector<crypto::key_derivation> &additional_derivations) override;
         bool  derivation_to_scalar(const crypto::key_derivation &derivation, const size_t output_index, crypto::ec_scalar &res) override;
         bool  derive_secret_key(const crypto::key_derivation &derivation, const std::size_t output_index, const crypto::secret_key &sec,  crypto::secret_key &derived_sec) override;
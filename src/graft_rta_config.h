@@ -31,6 +31,8 @@ constexpr uint64_t TIER4_STAKE_AMOUNT = COIN * 250000;
 
 constexpr size_t TIERS_COUNT = 4;
 
+constexpr size_t AUTH_SAMPLE_SIZE = 8;
+
 }
 
 }
@@ -0,0 +1,217 @@
+#include <algorithm>
+
+#include "misc_log_ex.h"
+#include "storages/portable_storage_template_helper.h"
+#include "local_supernode.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.p2p"
+
+using namespace nodetool;
+
+namespace
+{
+
+/// Common part of supernode responses
+struct supernode_response
+{
+  int64_t status;
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(status)
+  END_KV_SERIALIZE_MAP()
+};
+
+}
+
+constexpr size_t local_supernode::MAX_QUEUE_SIZE;
+constexpr size_t local_supernode::HTTP_TIMEOUT_MILLIS;
+constexpr size_t local_supernode::MIN_BACKOFF_MILLIS;
+constexpr size_t local_supernode::MAX_BACKOFF_MILLIS;
+
+local_supernode::local_supernode(std::string host, uint64_t port, std::string uri)
+  : stakes_block_height(0)
+  , blockchain_based_list_block_height(0)
+  , delta_updates_supported(true)
+  , m_http_host(std::move(host))
+  , m_http_port(port)
+  , m_uri(std::move(uri))
+  , m_location_changed(true)
+  , m_stop(false)
+  , m_dropped_requests_count(0)
+  , m_connection_failed(false)
+  , m_failed_requests_count(0)
+{
+  m_thread = boost::thread([this]() { run(); });
+}
+
+local_supernode::~local_supernode()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    m_stop = true;
+  }
+
+  m_cond.notify_all();
+
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+void local_supernode::update(const std::string &new_host, uint64_t new_port, const std::string &new_uri)
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+
+  if (new_host == m_http_host && new_port == m_http_port)
+    return;
+
+  m_http_host        = new_host;
+  m_http_port        = new_port;
+  m_uri              = new_uri;
+  m_location_changed = true;
+
+  reset_delivered_updates();
+}
+
+void local_supernode::reset_delivered_updates()
+{
+  stakes_block_height                = 0;
+  blockchain_based_list_block_height = 0;
+}
+
+void local_supernode::enqueue(job&& new_job, const std::string &coalesce_key)
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+
+    if (!coalesce_key.empty())
+    {
+      auto it = std::find_if(m_queue.begin(), m_queue.end(), [&](const queued_job& j) { return j.coalesce_key == coalesce_key; });
+
+      if (it != m_queue.end())
+      {
+        it->handler = std::move(new_job);
+        return;
+      }
+    }
+
+    if (m_queue.size() >= MAX_QUEUE_SIZE)
+    {
+      m_queue.pop_front();
+      m_dropped_requests_count++;
+
+      if (m_dropped_requests_count % MAX_QUEUE_SIZE == 1)
+        MWARNING("Supernode at " << m_http_host << ":" << m_http_port << " is too slow, " << m_dropped_requests_count << " request(s) have been dropped");
+    }
+
+    m_queue.push_back(queued_job{std::move(new_job), coalesce_key, std::chrono::steady_clock::now()});
+  }
+
+  m_cond.notify_one();
+}
+
+size_t local_supernode::get_queue_size() const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+  return m_queue.size();
+}
+
+uint64_t local_supernode::get_dropped_requests_count() const
+{
+  boost::lock_guard<boost::mutex> lock(m_lock);
+  return m_dropped_requests_count;
+}
+
+bool local_supernode::post(const std::string &uri, const std::string &body, bool binary)
+{
+  epee::net_utils::http::fields_list additional_params;
+  additional_params.push_back(std::make_pair("Content-Type", binary ? "application/octet-stream" : "application/json; charset=utf-8"));
+
+  const epee::net_utils::http::http_response_info* info = nullptr;
+
+  if (!m_client.invoke(m_client_uri + uri, "POST", body, std::chrono::milliseconds(HTTP_TIMEOUT_MILLIS), &info, std::move(additional_params)) || !info)
+  {
+    LOG_PRINT_L1("Failed to invoke http request to " << m_client_uri + uri);
+    m_connection_failed = true;
+    return false;
+  }
+
+  if (info->m_response_code != 200)
+  {
+    LOG_PRINT_L1("Failed to invoke http request to " << m_client_uri + uri << ", wrong response code: " << info->m_response_code);
+    return false;
+  }
+
+  supernode_response response = AUTO_VAL_INIT(response);
+
+  // the supernode may answer a binary request in either format
+  bool binary_response = info->m_header_info.m_content_type.find("application/octet-stream") != std::string::npos;
+
+  if (!(binary_response ? epee::serialization::load_t_from_binary(response, info->m_body) : epee::serialization::load_t_from_json(response, info->m_body)))
+    return false;
+
+  return response.status != 0;
+}
+
+void local_supernode::run()
+{
+  size_t backoff_millis = 0;
+
+  for (;;)
+  {
+    queued_job next_job;
+
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+
+      if (backoff_millis)
+      {
+          //supernode is unreachable, don't flood it with requests
+
+        m_cond.wait_for(lock, boost::chrono::milliseconds(backoff_millis), [this]() { return m_stop; });
+      }
+
+      m_cond.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+
+      if (m_stop)
+        return;
+
+      next_job = std::move(m_queue.front());
+
+      m_queue.pop_front();
+
+      if (m_location_changed)
+      {
+        if (m_client.is_connected())
+          m_client.disconnect();
+
+        m_client.set_server(m_http_host, std::to_string(m_http_port), {});
+
+        m_client_uri       = m_uri;
+        m_location_changed = false;
+      }
+    }
+
+    m_connection_failed = false;
+
+    bool delivered = false;
+
+    try
+    {
+      delivered = next_job.handler(*this);
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Exception in supernode request handler: " << e.what());
+    }
+
+    if (!delivered)
+      m_failed_requests_count++;
+
+    m_delivery_time.observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - next_job.enqueue_time).count());
+
+    if (m_connection_failed)
+      backoff_millis = backoff_millis ? std::min(backoff_millis * 2, MAX_BACKOFF_MILLIS) : MIN_BACKOFF_MILLIS;
+    else
+      backoff_millis = 0;
+  }
+}
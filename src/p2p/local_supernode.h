@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "net/http_client.h"
+#include "p2p_metrics.h"
+
+namespace nodetool
+{
+  /// Supernode connected to this node over HTTP; requests are delivered by the supernode's own worker thread
+  class local_supernode
+  {
+  public:
+    /// Delivery job which runs on the worker thread; returns true if the supernode has accepted the request
+    typedef std::function<bool(local_supernode&)> job;
+
+    static constexpr size_t MAX_QUEUE_SIZE = 1024;
+    // sometimes supernode gets very busy so it doesn't respond within 1 second, increasing timeout to 3s
+    static constexpr size_t HTTP_TIMEOUT_MILLIS = 3 * 1000;
+    static constexpr size_t MIN_BACKOFF_MILLIS = 100;
+    static constexpr size_t MAX_BACKOFF_MILLIS = 10 * 1000;
+
+    local_supernode(std::string host, uint64_t port, std::string uri);
+    ~local_supernode();
+
+    local_supernode(const local_supernode&) = delete;
+    local_supernode& operator=(const local_supernode&) = delete;
+
+    /// Change supernode location; the change is applied before the next queued request
+    void update(const std::string &new_host, uint64_t new_port, const std::string &new_uri);
+
+    /// Queue job for delivery; a pending job with the same non-empty key is replaced by the new one,
+    /// the oldest pending job is dropped if the queue is full
+    void enqueue(job&& new_job, const std::string &coalesce_key = std::string());
+
+    /// Post JSON (or portable storage binary) request to the supernode and wait for the response (worker thread only)
+    bool post(const std::string &uri, const std::string &body, bool binary = false);
+
+    /// Forget heights of updates delivered to the supernode (the next updates will be sent in full)
+    void reset_delivered_updates();
+
+    size_t get_queue_size() const;
+    uint64_t get_dropped_requests_count() const;
+    uint64_t get_failed_requests_count() const { return m_failed_requests_count; }
+    /// Time from queueing of a request to the end of its delivery
+    const latency_histogram& get_delivery_time() const { return m_delivery_time; }
+
+    std::atomic<uint64_t> stakes_block_height; // height of the last stakes delivered to the supernode, 0 if unknown
+    std::atomic<uint64_t> blockchain_based_list_block_height; // height of the last blockchain based list delivered to the supernode, 0 if unknown
+    std::atomic<bool> delta_updates_supported;
+
+  private:
+    struct queued_job
+    {
+      job handler;
+      std::string coalesce_key;
+      std::chrono::steady_clock::time_point enqueue_time;
+    };
+
+    void run();
+
+    mutable boost::mutex m_lock; // protects the queue and the supernode location
+    boost::condition_variable m_cond;
+    std::deque<queued_job> m_queue;
+    std::string m_http_host;
+    uint64_t m_http_port;
+    std::string m_uri;
+    bool m_location_changed;
+    bool m_stop;
+    uint64_t m_dropped_requests_count;
+
+    // used by the worker thread only
+    epee::net_utils::http::http_simple_client m_client;
+    std::string m_client_uri;
+    bool m_connection_failed;
+    std::atomic<uint64_t> m_failed_requests_count;
+    latency_histogram m_delivery_time;
+
+    boost::thread m_thread;
+  };
+}
@@ -66,4 +66,10 @@ namespace nodetool
     const command_line::arg_descriptor<int64_t> arg_limit_rate = {"limit-rate", "set limit-rate [kB/s]", -1};
 
     const command_line::arg_descriptor<bool> arg_save_graph = {"save-graph", "Save data for dr monero", false};
+
+    // read buffers and send queues of the p2p and rpc connections
+    static tools::memory::account connection_buffers("connections", [](uint64_t& bytes) {
+      bytes = epee::net_utils::connection_basic::get_buffered_bytes();
+      return true;
+    });
 }
@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #pragma once
+#include <deque>
 #include <boost/thread.hpp>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
@@ -46,15 +47,24 @@
 #include "math_helper.h"
 #include "net_node_common.h"
 #include "common/command_line.h"
+#include "common/memory_usage.h"
 #include "net/jsonrpc_structs.h"
 #include "storages/http_abstract_invoke.h"
+#include "local_supernode.h"
+#include "request_cache.h"
+#include "p2p_metrics.h"
 
 #include <map>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
+#include <tuple>
 #include <iomanip>
 
+#define REQUEST_CACHE_TIME 2 * 60 * 1000
+#define MAX_TUNNEL_PEERS (3u)
+#define MAX_UNICAST_TUNNEL_PEERS (2u)
+
 PUSH_WARNINGS
 DISABLE_VS_WARNINGS(4355)
 
@@ -65,32 +75,12 @@ namespace nodetool
   template<class base_type>
   struct p2p_connection_context_t: base_type //t_payload_net_handler::connection_context //public net_utils::connection_context_base
   {
-    p2p_connection_context_t(): peer_id(0), support_flags(0), m_in_timedsync(false) {}
+    p2p_connection_context_t(): peer_id(0), support_flags(0), m_in_timedsync(false), m_peerlist_since(0) {}
 
     peerid_type peer_id;
     uint32_t support_flags;
     bool m_in_timedsync;
-  };
-
-  struct local_supernode {
-    local_supernode(std::string host, uint64_t port, std::string uri) : http_host(std::move(host)), http_port(port), uri(std::move(uri)) {
-        client.set_server(http_host, std::to_string(http_port), {});
-    }
-
-    void update(const std::string &new_host, uint64_t new_port, const std::string &new_uri) {
-        if (new_host != http_host || new_port != http_port) {
-            if (client.is_connected()) client.disconnect();
-            client.set_server(new_host, std::to_string(new_port), {});
-            http_host = new_host;
-            http_port = new_port;
-            uri = new_uri;
-        }
-    }
-
-    std::string http_host;
-    uint64_t http_port;
-    std::string uri;
-    epee::net_utils::http::http_simple_client client;
+    uint64_t m_peerlist_since; // remote local_time of the last peerlist received from this peer
   };
 
   template<class t_payload_net_handler>
@@ -114,10 +104,12 @@ namespace nodetool
       :m_payload_handler(payload_handler),
     m_current_number_of_out_peers(0),
     m_current_number_of_in_peers(0),
+    m_supernode_requests_cache(REQUEST_CACHE_TIME),
     m_allow_local_ip(false),
     m_hide_my_port(false),
     m_no_igd(false),
     m_offline(false),
+    m_replica(false),
     m_save_graph(false),
     is_closing(false),
     m_net_server( epee::net_utils::e_connection_type_P2P ) // this is a P2P connection of the main p2p node server, because this is class node_server<>
@@ -144,6 +136,12 @@ namespace nodetool
         peerid_type peer_id = AUTO_VAL_INIT (peer_id);
         a & peer_id;
       }
+      if (ver >= 2)
+      {
+        // tunnels to supernodes, so a restarted node can route RTA messages before new announces arrive
+        boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+        a & m_supernode_routes;
+      }
     }
     // debug functions
     bool log_peerlist();
@@ -193,11 +191,24 @@ namespace nodetool
 
     typedef COMMAND_REQUEST_STAT_INFO_T<typename t_payload_net_handler::stat_info> COMMAND_REQUEST_STAT_INFO;
 
-    CHAIN_LEVIN_INVOKE_MAP2(p2p_connection_context); //move levin_commands_handler interface invoke(...) callbacks into invoke map
-    CHAIN_LEVIN_NOTIFY_MAP2(p2p_connection_context); //move levin_commands_handler interface notify(...) callbacks into nothing
+    //levin_commands_handler interface callbacks are timed and moved into invoke map
+    int invoke(int command, const std::string& in_buff, std::string& buff_out, p2p_connection_context& context)
+    {
+      bool handled = false;
+      p2p_metrics::command_timer timer(m_metrics, command, in_buff.size());
+      return handle_invoke_map(false, command, in_buff, buff_out, context, handled);
+    }
+
+    int notify(int command, const std::string& in_buff, p2p_connection_context& context)
+    {
+      bool handled = false; std::string fake_str;
+      p2p_metrics::command_timer timer(m_metrics, command, in_buff.size());
+      return handle_invoke_map(true, command, in_buff, fake_str, context, handled);
+    }
 
     BEGIN_INVOKE_MAP2(node_server)
       HANDLE_NOTIFY_T2(COMMAND_SUPERNODE_ANNOUNCE, &node_server::handle_supernode_announce)
+      HANDLE_NOTIFY_T2(COMMAND_SUPERNODE_ANNOUNCE_BATCH, &node_server::handle_supernode_announce_batch)
       HANDLE_NOTIFY_T2(COMMAND_BROADCAST, &node_server::handle_broadcast)
       HANDLE_NOTIFY_T2(COMMAND_MULTICAST, &node_server::handle_multicast)
       HANDLE_NOTIFY_T2(COMMAND_UNICAST, &node_server::handle_unicast)
@@ -217,16 +228,14 @@ namespace nodetool
     enum PeerType { anchor = 0, white, gray };
 
     //----------------- helper functions ------------------------------------------------
-    bool multicast_send(int command, const std::string &data, const std::list<std::string> &addresses,
-                        const std::list<peerid_type> &exclude_peerids = std::list<peerid_type>());
+    bool multicast_send(int command, const epee::net_utils::shared_buffer &data, const std::list<std::string> &addresses,
+                        const std::list<peerid_type> &exclude_peerids = std::list<peerid_type>(),
+                        unsigned int max_tunnel_peers = MAX_TUNNEL_PEERS);
     uint64_t get_max_hop(const std::list<std::string> &addresses);
     std::list<std::string> get_routes();
 
-    // sometimes supernode gets very busy so it doesn't respond within 1 second, increasing timeout to 3s
-    static constexpr size_t SUPERNODE_HTTP_TIMEOUT_MILLIS = 3 * 1000;
     template<class request_struct>
-    int post_request_to_supernode(local_supernode &supernode, const std::string &method, const typename request_struct::request &body,
-                                  const std::string &endpoint = std::string())
+    static std::shared_ptr<const std::string> make_supernode_request_body(const std::string &method, const typename request_struct::request &body)
     {
         boost::value_initialized<epee::json_rpc::request<typename request_struct::request> > init_req;
         epee::json_rpc::request<typename request_struct::request>& req = static_cast<epee::json_rpc::request<typename request_struct::request> &>(init_req);
@@ -235,36 +244,72 @@ namespace nodetool
         req.method = method;
         req.params = body;
 
-        std::string uri = "/" + method;
-        if (!endpoint.empty())
-        {
-            uri = endpoint;
-        }
-        typename request_struct::response resp = AUTO_VAL_INIT(resp);
-        bool r = epee::net_utils::invoke_http_json(supernode.uri + uri,
-                                                   req, resp, supernode.client,
-                                                   std::chrono::milliseconds(size_t(SUPERNODE_HTTP_TIMEOUT_MILLIS)), "POST");
-        if (!r || resp.status == 0)
-        {
-            return 0;
-        }
-        return 1;
+        std::shared_ptr<std::string> result = std::make_shared<std::string>();
+        epee::serialization::store_t_to_json(req, *result);
+        return result;
     }
 
+    // binary requests carry the bare request in the portable storage format, so raw data bytes aren't escaped
     template<class request_struct>
-    int post_request_to_supernodes(const std::string &method, const typename request_struct::request &body,
-                                   const std::string &endpoint = std::string())
+    static std::shared_ptr<const std::string> make_supernode_binary_request_body(const typename request_struct::request &body)
     {
-        int ret = 0;
+        std::shared_ptr<std::string> result = std::make_shared<std::string>();
+        epee::serialization::store_t_to_binary(body, *result);
+        return result;
+    }
+
+    static std::string make_supernode_request_uri(const std::string &method, const std::string &endpoint)
+    {
+        return endpoint.empty() ? "/" + method : endpoint;
+    }
+
+    // requests are queued and delivered by the supernode's worker thread, so p2p threads never wait for supernodes
+    static void enqueue_request_to_supernode(local_supernode &supernode, const std::string &uri, const std::shared_ptr<const std::string> &body,
+                                             const std::string &coalesce_key = std::string(), bool binary = false)
+    {
+        supernode.enqueue([uri, body, binary](local_supernode &sn) { return sn.post(uri, *body, binary); }, coalesce_key);
+    }
+
+    template<class request_struct>
+    void post_request_to_supernode(local_supernode &supernode, const std::string &method, const typename request_struct::request &body,
+                                   const std::string &endpoint = std::string(), const std::string &coalesce_key = std::string(), bool binary = false)
+    {
+        std::shared_ptr<const std::string> request_body = binary ? make_supernode_binary_request_body<request_struct>(body) : make_supernode_request_body<request_struct>(method, body);
+        enqueue_request_to_supernode(supernode, make_supernode_request_uri(method, endpoint), request_body, coalesce_key, binary);
+    }
+
+    template<class request_struct>
+    void post_request_to_supernodes(const std::string &method, const typename request_struct::request &body,
+                                    const std::string &endpoint = std::string(), const std::string &coalesce_key = std::string(), bool binary = false)
+    {
+        if (m_supernodes.empty())
+            return;
+        std::string uri = make_supernode_request_uri(method, endpoint);
+        std::shared_ptr<const std::string> request_body = binary ? make_supernode_binary_request_body<request_struct>(body) : make_supernode_request_body<request_struct>(method, body);
         for (auto &supernode : m_supernodes)
-            ret += post_request_to_supernode<request_struct>(supernode.second, method, body, endpoint);
-        return ret;
+            enqueue_request_to_supernode(supernode.second, uri, request_body, coalesce_key, binary);
     }
 
     void remove_old_request_cache();
+    /// Drop stored routes which are too old to be useful or lead only through peers we no longer know
+    void prune_restored_supernode_routes();
+
+    /// Memory probes of the supernode routes and of the request and announce caches, see tools::memory::account
+    bool get_supernode_routes_memory_usage(uint64_t& bytes);
+    bool get_request_caches_memory_usage(uint64_t& bytes);
+    static uint64_t get_request_cache_time();
+
+    /// Check announce height, supernode stake and signature; results are cached by (id, height, signature)
+    bool check_supernode_announce(const COMMAND_SUPERNODE_ANNOUNCE::request& arg, const p2p_connection_context& context);
+    /// Update supernode routes by the announce; returns true if the announce has to be relayed to neighbours
+    bool process_supernode_announce(const COMMAND_SUPERNODE_ANNOUNCE::request& arg, const p2p_connection_context& context);
+    /// Queue announce for relay; announces are sent to neighbours in batches by relay_pending_announces
+    void queue_announce_relay(COMMAND_SUPERNODE_ANNOUNCE::request arg);
+    bool relay_pending_announces();
 
     //----------------- commands handlers ----------------------------------------------
     int handle_supernode_announce(int command, typename COMMAND_SUPERNODE_ANNOUNCE::request& arg, p2p_connection_context& context);
+    int handle_supernode_announce_batch(int command, typename COMMAND_SUPERNODE_ANNOUNCE_BATCH::request& arg, p2p_connection_context& context);
     int handle_broadcast(int command, typename COMMAND_BROADCAST::request &arg, p2p_connection_context &context);
     int handle_multicast(int command, typename COMMAND_MULTICAST::request &arg, p2p_connection_context &context);
     int handle_unicast(int command, typename COMMAND_UNICAST::request &arg, p2p_connection_context &context);
@@ -286,6 +331,7 @@ namespace nodetool
     virtual void on_connection_new(p2p_connection_context& context);
     virtual void on_connection_close(p2p_connection_context& context);
     virtual void callback(p2p_connection_context& context);
+    virtual epee::net_utils::traffic_class get_traffic_class(int command);
     //----------------- i_p2p_endpoint -------------------------------------------------------------
     virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid> &connections);
     virtual bool relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context);
@@ -296,6 +342,8 @@ namespace nodetool
     virtual void for_each_connection(std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, uint32_t)> f);
     virtual bool for_connection(const boost::uuids::uuid&, std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, uint32_t)> f);
     virtual bool add_host_fail(const epee::net_utils::network_address &address);
+    virtual void add_peer_throughput(const epee::net_utils::connection_context_base& context, uint64_t bytes_per_second);
+    virtual void add_peer_block_delay(const epee::net_utils::connection_context_base& context, uint32_t delay_ms);
     // added, non virtual
     /*!
      * \brief relay_notify    - send command to remote connection
@@ -304,7 +352,9 @@ namespace nodetool
      * \param connection_id   - connection id
      * \return                - true on success
      */
-    bool relay_notify(int command, const std::string& data_buff, const boost::uuids::uuid& connection_id);
+    bool relay_notify(int command, const epee::net_utils::shared_buffer& data_buff, const boost::uuids::uuid& connection_id);
+    bool relay_notify_to_list(int command, const epee::net_utils::shared_buffer& data_buff, const std::list<boost::uuids::uuid> &connections);
+    bool relay_notify_to_all(int command, const epee::net_utils::shared_buffer& data_buff, const epee::net_utils::connection_context_base& context);
     //----------------- i_connection_filter  --------------------------------------------------------
     virtual bool is_remote_host_allowed(const epee::net_utils::network_address &address);
     //-----------------------------------------------------------------------------------------------
@@ -323,12 +373,12 @@ namespace nodetool
     bool connections_maker();
     bool peer_sync_idle_maker();
     bool do_handshake_with_peer(peerid_type& pi, p2p_connection_context& context, bool just_take_peerlist = false);
-    bool do_peer_timed_sync(const epee::net_utils::connection_context_base& context, peerid_type peer_id);
+    bool do_peer_timed_sync(const epee::net_utils::connection_context_base& context, peerid_type peer_id, uint64_t peerlist_since);
 
     bool make_new_connection_from_anchor_peerlist(const std::vector<anchor_peerlist_entry>& anchor_peerlist);
     bool make_new_connection_from_peerlist(bool use_white_list);
+    bool make_new_connection_from_white_peerlist();
     bool try_to_connect_and_handshake_with_new_peer(const epee::net_utils::network_address& na, bool just_take_peerlist = false, uint64_t last_seen_stamp = 0, PeerType peer_type = white, uint64_t first_seen_stamp = 0);
-    size_t get_random_index_with_fixed_probability(size_t max_index);
     bool is_peer_used(const peerlist_entry& peer);
     bool is_peer_used(const anchor_peerlist_entry& peer);
     bool is_addr_connected(const epee::net_utils::network_address& peer);
@@ -343,7 +393,10 @@ namespace nodetool
     bool is_priority_node(const epee::net_utils::network_address& na);
     std::set<std::string> get_seed_nodes(cryptonote::network_type nettype) const;
     bool connect_to_seed();
+    void apply_seed_nodes_lookup();
     bool find_connection_id_by_peer(const peerlist_entry &pe, boost::uuids::uuid &conn_id);
+    void register_peer_connection(const p2p_connection_context& context);
+    void unregister_peer_connection(const p2p_connection_context& context);
     template <class Container>
     bool connect_to_peerlist(const Container& peers);
 
@@ -452,10 +505,12 @@ namespace nodetool
         m_supernodes.clear();
     }
 
-    bool notify_peer_list(int command, const std::string& buf, const std::vector<peerlist_entry>& peers_to_send, bool try_connect = false);
+    bool notify_peer_list(int command, const epee::net_utils::shared_buffer& buf, const std::vector<peerlist_entry>& peers_to_send, bool try_connect = false);
 
-    void send_stakes_to_supernode();
-    void send_blockchain_based_list_to_supernode(uint64_t last_received_block_height);
+    /// Bring the supernode's stakes up to date; only the deltas after last_received_block_height are sent if they are journaled
+    void send_stakes_to_supernode(const std::string& supernode_public_id, uint64_t last_received_block_height);
+    /// Bring the supernode's blockchain based list up to date, resuming from last_received_block_height like stakes
+    void send_blockchain_based_list_to_supernode(const std::string& supernode_public_id, uint64_t last_received_block_height);
 
     uint64_t get_announce_bytes_in() const { return m_announce_bytes_in; }
     uint64_t get_announce_bytes_out() const { return m_announce_bytes_out; }
@@ -464,17 +519,71 @@ namespace nodetool
     uint64_t get_multicast_bytes_in() const { return m_multicast_bytes_in; }
     uint64_t get_multicast_bytes_out() const { return m_multicast_bytes_out; }
 
+    /// Traffic, command handler and local supernode delivery metrics in Prometheus text format
+    std::string get_metrics();
+
   private:
     void handle_stakes_update(uint64_t block_number, const cryptonote::StakeTransactionProcessor::supernode_stake_array& stakes);
     void handle_blockchain_based_list_update(uint64_t block_number, const cryptonote::StakeTransactionProcessor::supernode_tier_array& tiers);
+    const std::string& get_supernode_address_str(const std::string& supernode_public_id, const cryptonote::account_public_address& address);
+
+    // last stakes and blockchain based list sent to supernodes; deltas are computed against them
+    struct sent_supernode_stake
+    {
+      cryptonote::supernode_stake stake;
+      cryptonote::COMMAND_RPC_SUPERNODE_STAKES::supernode_stake rpc_stake;
+    };
+
+    typedef std::unordered_map<std::string, sent_supernode_stake> sent_supernode_stake_map;
+    typedef std::unordered_map<std::string, cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::supernode> sent_tier_supernode_map;
+    typedef std::unordered_map<std::string, std::pair<cryptonote::account_public_address, std::string>> supernode_address_string_map;
+
+    // recent deltas sent to supernodes, contiguous by heights: each one's base is the previous one's height;
+    // block heights are the sequence numbers of the updates, a delivered post is the supernode's ack
+    struct journaled_update
+    {
+      uint64_t base_block_height;
+      uint64_t block_height;
+      std::shared_ptr<const std::string> body;
+    };
+
+    typedef std::deque<journaled_update> update_journal;
+
+    static constexpr size_t UPDATE_JOURNAL_MAX_SIZE = 64;
+
+    static void add_to_update_journal(update_journal& journal, uint64_t base_block_height, uint64_t block_height, const std::shared_ptr<const std::string>& body);
+    /// Get deltas which bring a supernode from from_block_height to to_block_height; false if they aren't journaled
+    static bool get_journaled_updates(const update_journal& journal, uint64_t from_block_height, uint64_t to_block_height, std::vector<std::shared_ptr<const std::string>>& bodies);
+
+    struct relayed_announce
+    {
+      uint64_t height;
+      std::string network_address;
+      uint64_t time;
+    };
 
   private:
-    std::multimap<int, std::string> m_supernode_requests_timestamps;
-    std::set<std::string> m_supernode_requests_cache;
+    request_cache m_supernode_requests_cache;
     std::map<std::string, nodetool::supernode_route> m_supernode_routes;
     std::unordered_map<std::string, local_supernode> m_supernodes;
     boost::recursive_mutex m_supernode_lock;
+    uint64_t m_sent_stakes_block_height = 0;
+    sent_supernode_stake_map m_sent_stakes;
+    uint64_t m_sent_tiers_block_height = 0;
+    sent_tier_supernode_map m_sent_tier_supernodes;
+    std::shared_ptr<const cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request> m_sent_stakes_request;
+    std::shared_ptr<const std::string> m_sent_tiers_body;
+    update_journal m_stakes_journal;
+    update_journal m_tiers_journal;
+    supernode_address_string_map m_supernode_address_strings; // cached address strings by supernode public id
     boost::recursive_mutex m_request_cache_lock;
+    std::unordered_map<peerid_type, boost::uuids::uuid> m_peer_connections; // connection of each handshaked peer
+    boost::mutex m_peer_connections_lock;
+    std::unordered_map<std::string, COMMAND_SUPERNODE_ANNOUNCE::request> m_pending_announces; // announces waiting for relay by supernode public id
+    std::unordered_map<std::string, relayed_announce> m_relayed_announces; // last relayed announce by supernode public id
+    boost::mutex m_pending_announces_lock;
+    std::unordered_map<std::string, bool> m_announce_check_cache; // announce check results by supernode public id, height and signature
+    boost::mutex m_announce_check_cache_lock;
     std::vector<epee::net_utils::network_address> m_custom_seed_nodes;
 
     std::string m_config_folder;
@@ -488,6 +597,7 @@ namespace nodetool
     bool m_hide_my_port;
     bool m_no_igd;
     bool m_offline;
+    bool m_replica;
     std::atomic<bool> m_save_graph;
     std::atomic<bool> is_closing;
     std::unique_ptr<boost::thread> mPeersLoggerThread;
@@ -502,6 +612,7 @@ namespace nodetool
     epee::math_helper::once_a_time_seconds<60*30, false> m_peerlist_store_interval;
     epee::math_helper::once_a_time_seconds<60> m_gray_peerlist_housekeeping_interval;
     epee::math_helper::once_a_time_seconds<900, false> m_incoming_connections_interval;
+    epee::math_helper::once_a_time_seconds<1> m_announces_relay_interval;
 
     std::string m_bind_ip;
     std::string m_port;
@@ -512,6 +623,17 @@ namespace nodetool
     std::vector<epee::net_utils::network_address> m_exclusive_peers;
     std::vector<epee::net_utils::network_address> m_seed_nodes;
     bool m_fallback_seed_nodes_added;
+
+    // a DNS lookup of the seed node host names running in the background,
+    // shared with the lookup thread which may outlive the node
+    struct seed_nodes_lookup
+    {
+      std::atomic<bool> done;
+      std::vector<std::string> addresses; // ip:port strings
+
+      seed_nodes_lookup(): done(false) {}
+    };
+    std::shared_ptr<seed_nodes_lookup> m_seed_nodes_lookup;
     std::list<nodetool::peerlist_entry> m_command_line_peers;
     uint64_t m_peer_livetime;
     //keep connections to initiate some interactions
@@ -535,6 +657,10 @@ namespace nodetool
     std::atomic<uint64_t> m_broadcast_bytes_out {0};
     std::atomic<uint64_t> m_multicast_bytes_in {0};
     std::atomic<uint64_t> m_multicast_bytes_out {0};
+    p2p_metrics m_metrics;
+
+    tools::memory::account m_supernode_routes_memory{"supernode_routes", [this](uint64_t& bytes) { return get_supernode_routes_memory_usage(bytes); }};
+    tools::memory::account m_request_caches_memory{"request_caches", [this](uint64_t& bytes) { return get_request_caches_memory_usage(bytes); }};
   };
 
   const int64_t default_limit_up = 2048;    // kB/s
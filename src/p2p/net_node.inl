@@ -34,18 +34,24 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <numeric>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/bind.hpp>
 #include <atomic>
 #include <random>
+#include <sstream>
 #include <boost/algorithm/string/join.hpp> // for logging
 
 #include "version.h"
 #include "string_tools.h"
+#include "file_io_utils.h"
 #include "common/util.h"
 #include "common/dns_utils.h"
+#include "common/pruning.h"
+#include "graft_rta_config.h"
 #include "net/net_helper.h"
 #include "math_helper.h"
 #include "p2p_protocol_defs.h"
@@ -54,6 +60,7 @@
 #include "crypto/crypto.h"
 #include "storages/levin_abstract_invoke2.h"
 #include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "storages/http_abstract_invoke.h"
 
 #include <miniupnp/miniupnpc/miniupnpc.h>
@@ -67,9 +74,13 @@
 
 #define MIN_WANTED_SEED_NODES 12
 
-#define MAX_TUNNEL_PEERS (3u)
-#define REQUEST_CACHE_TIME 2 * 60 * 1000
 #define HOP_RETRIES_MULTIPLIER 2
+#define ANNOUNCE_BATCH_MAX_SIZE 256
+#define ANNOUNCE_RELAY_MIN_INTERVAL 10 // seconds between relays of announces of the same supernode
+#define ANNOUNCE_UNCHANGED_RELAY_INTERVAL DIFFICULTY_TARGET_V2 // seconds to suppress relay of announces with the same route info
+#define ANNOUNCE_MAX_FUTURE_BLOCKS 10 // announces ahead of the local chain by more blocks are dropped
+#define ANNOUNCE_CHECK_CACHE_MAX_SIZE 4096
+#define SUPERNODE_ROUTE_RESTORE_MAX_AGE (60 * 60) // seconds, older stored routes are dropped on start
 
 namespace nodetool
 {
@@ -104,6 +115,51 @@ namespace nodetool
     const command_line::arg_descriptor<bool> arg_save_graph = {"save-graph", "Save data for dr monero", false};
     const command_line::arg_descriptor<Uuid> arg_p2p_net_id = {"net-id", "The way to replace hardcoded NETWORK_ID. Effective only with --testnet, ex.: 'net-id = 54686520-4172-7420-6f77-205761722037'"};
 
+    // peers we have no measurements of weigh as ones with these
+    const double PEER_DEFAULT_RTT_MS = 250;
+    const double PEER_DEFAULT_BLOCK_DELAY_MS = 500;
+    // throughput of a block span from a peer weighing as much as an unmeasured one
+    const double PEER_REFERENCE_THROUGHPUT = 256 * 1024;
+    const double PEER_SAME_SUBNET_PENALTY = 4;
+
+    // peers answering fast and announcing blocks early are picked more often, though all may be
+    double get_peer_weight(const peer_quality& pq)
+    {
+      const double rtt_ms = pq.rtt_samples ? pq.rtt_ms : PEER_DEFAULT_RTT_MS;
+      const double block_delay_ms = pq.block_delay_samples ? pq.block_delay_ms : PEER_DEFAULT_BLOCK_DELAY_MS;
+      double weight = 1000 / (100 + rtt_ms + block_delay_ms);
+      if (pq.throughput_samples)
+        weight *= std::sqrt(std::min(std::max(pq.throughput / PEER_REFERENCE_THROUGHPUT, 0.25), 4.0));
+      return weight;
+    }
+
+    // returns weights.size() when all weights are 0
+    size_t get_weighted_random_index(const std::vector<double>& weights)
+    {
+      const double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+      if (total <= 0)
+        return weights.size();
+      double point = crypto::rand<uint64_t>() / (double)std::numeric_limits<uint64_t>::max() * total;
+      size_t last = weights.size();
+      for (size_t i = 0; i < weights.size(); ++i)
+      {
+        if (weights[i] <= 0)
+          continue;
+        if (point < weights[i])
+          return i;
+        point -= weights[i];
+        last = i;
+      }
+      return last; // rounding
+    }
+
+    uint32_t get_subnet16(const epee::net_utils::network_address& na)
+    {
+      if (na.get_type_id() != epee::net_utils::ipv4_network_address::ID)
+        return 0;
+      return na.as<const epee::net_utils::ipv4_network_address>().ip() & 0xffff; // first two bytes, as in is_ip_local
+    }
+
     // helper struct used to notify peers by uuid
     struct connection_info
     {
@@ -141,6 +197,16 @@ namespace nodetool
         epee::serialization::store_t_to_binary(arg, buff);
         return buff.size();
     }
+    /*!
+     * helper to serialize p2p command once for sending to many connections
+     */
+    template <typename T>
+    epee::net_utils::shared_buffer make_command_buffer(const T &arg)
+    {
+        std::shared_ptr<std::string> buff = std::make_shared<std::string>();
+        epee::serialization::store_t_to_binary(arg, *buff);
+        return buff;
+    }
 
   }
 
@@ -201,6 +267,7 @@ namespace nodetool
           {
             MWARNING("Failed to load p2p config file, falling back to default config");
             m_peerlist = peerlist_manager(); // it was probably half clobbered by the failed load
+            m_supernode_routes.clear();
             make_default_config();
           }
         }
@@ -217,6 +284,8 @@ namespace nodetool
     // always recreate a new peer id
     make_default_peer_id();
 
+    prune_restored_supernode_routes();
+
     //at this moment we have hardcoded config
     m_config.m_net_config.handshake_interval = P2P_DEFAULT_HANDSHAKE_INTERVAL;
     m_config.m_net_config.packet_max_size = P2P_DEFAULT_PACKET_MAX_SIZE; //20 MB limit
@@ -328,6 +397,21 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::add_peer_throughput(const epee::net_utils::connection_context_base& context, uint64_t bytes_per_second)
+  {
+    // incoming connections come from a port other than the one the peer listens on
+    if (!context.m_is_income)
+      m_peerlist.add_peer_throughput(context.m_remote_address, bytes_per_second);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::add_peer_block_delay(const epee::net_utils::connection_context_base& context, uint32_t delay_ms)
+  {
+    if (!context.m_is_income)
+      m_peerlist.add_peer_block_delay(context.m_remote_address, delay_ms);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::parse_peer_from_string(epee::net_utils::network_address& pe, const std::string& node_addr, uint16_t default_port)
   {
     return epee::net_utils::create_network_address(pe, node_addr, default_port);
@@ -347,7 +431,8 @@ namespace nodetool
     m_external_port = command_line::get_arg(vm, arg_p2p_external_port);
     m_allow_local_ip = command_line::get_arg(vm, arg_p2p_allow_local_ip);
     m_no_igd = command_line::get_arg(vm, arg_no_igd);
-    m_offline = command_line::get_arg(vm, cryptonote::arg_offline);
+    m_replica = command_line::get_arg(vm, cryptonote::arg_rpc_replica);
+    m_offline = command_line::get_arg(vm, cryptonote::arg_offline) || m_replica;
 
     if (command_line::has_arg(vm, arg_p2p_add_peer))
     {
@@ -561,6 +646,14 @@ namespace nodetool
     bool res = handle_command_line(vm);
     CHECK_AND_ASSERT_MES(res, false, "Failed to handle command line");
 
+    m_config_folder = command_line::get_arg(vm, cryptonote::arg_data_dir);
+
+    if ((m_nettype == cryptonote::MAINNET && m_port != std::to_string(::config::P2P_DEFAULT_PORT))
+        || (m_nettype == cryptonote::TESTNET && m_port != std::to_string(::config::testnet::P2P_DEFAULT_PORT))
+        || (m_nettype == cryptonote::STAGENET && m_port != std::to_string(::config::stagenet::P2P_DEFAULT_PORT))) {
+      m_config_folder = m_config_folder + "/" + m_port;
+    }
+
     m_fallback_seed_nodes_added = false;
     if (m_nettype == cryptonote::TESTNET)
     {
@@ -579,81 +672,58 @@ namespace nodetool
       assign_network_id(vm, false, m_network_id);
       if (m_exclusive_peers.empty())
       {
-      // for each hostname in the seed nodes list, attempt to DNS resolve and
-      // add the result addresses as seed nodes
+      // the seed node host names are resolved in the background, so startup
+      // never waits on DNS; the addresses found by the previous run stand in
+      // until the lookup is done
       // TODO: at some point add IPv6 support, but that won't be relevant
       // for some time yet.
-
-      std::vector<std::vector<std::string>> dns_results;
-      dns_results.resize(m_seed_nodes_list.size());
-
-      std::list<boost::thread> dns_threads;
-      uint64_t result_index = 0;
-      for (const std::string& addr_str : m_seed_nodes_list)
+      if (!m_seed_nodes_list.empty() && !m_offline)
       {
-        boost::thread th = boost::thread([=, &dns_results, &addr_str]
+        std::shared_ptr<seed_nodes_lookup> lookup = std::make_shared<seed_nodes_lookup>();
+        const std::vector<std::string> hosts = m_seed_nodes_list;
+        const std::string port = std::to_string(cryptonote::get_config(m_nettype).P2P_DEFAULT_PORT);
+        m_seed_nodes_lookup = lookup;
+        boost::thread([lookup, hosts, port]()
         {
-          MDEBUG("dns_threads[" << result_index << "] created for: " << addr_str);
-          // TODO: care about dnssec avail/valid
-          bool avail, valid;
-          std::vector<std::string> addr_list;
-
-          try
+          for (const std::string& addr_str : hosts)
           {
-            addr_list = tools::DNSResolver::instance().get_ipv4(addr_str, avail, valid);
-            MDEBUG("dns_threads[" << result_index << "] DNS resolve done");
-            boost::this_thread::interruption_point();
-          }
-          catch(const boost::thread_interrupted&)
-          {
-            // thread interruption request
-            // even if we now have results, finish thread without setting
-            // result variables, which are now out of scope in main thread
-            MWARNING("dns_threads[" << result_index << "] interrupted");
-            return;
+            // TODO: care about dnssec avail/valid
+            bool avail, valid;
+            std::vector<std::string> addr_list;
+            try
+            {
+              addr_list = tools::DNSResolver::instance().get_ipv4(addr_str, avail, valid);
+            }
+            catch (const std::exception &e)
+            {
+              MWARNING("DNS lookup for seed node " << addr_str << " failed: " << e.what());
+            }
+            MINFO("DNS lookup for seed node " << addr_str << ": " << addr_list.size() << " results");
+            for (const auto& addr_string : addr_list)
+              lookup->addresses.push_back(addr_string + ":" + port);
           }
-
-          MINFO("dns_threads[" << result_index << "] addr_str: " << addr_str << "  number of results: " << addr_list.size());
-          dns_results[result_index] = addr_list;
-        });
-
-        dns_threads.push_back(std::move(th));
-        ++result_index;
-      }
-
-      MDEBUG("dns_threads created, now waiting for completion or timeout of " << CRYPTONOTE_DNS_TIMEOUT_MS << "ms");
-      boost::chrono::system_clock::time_point deadline = boost::chrono::system_clock::now() + boost::chrono::milliseconds(CRYPTONOTE_DNS_TIMEOUT_MS);
-      uint64_t i = 0;
-      for (boost::thread& th : dns_threads)
-      {
-        if (! th.try_join_until(deadline))
-        {
-          MWARNING("dns_threads[" << i << "] timed out, sending interrupt");
-          th.interrupt();
-        }
-        ++i;
+          lookup->done.store(true, std::memory_order_release);
+        }).detach();
       }
 
-      i = 0;
-      for (const auto& result : dns_results)
+      std::string cached_seed_nodes;
+      if (epee::file_io_utils::load_file_to_string(m_config_folder + "/" + P2P_SEED_NODES_FILENAME, cached_seed_nodes))
       {
-        MDEBUG("DNS lookup for " << m_seed_nodes_list[i] << ": " << result.size() << " results");
-        // if no results for node, thread's lookup likely timed out
-        if (result.size())
-        {
-          for (const auto& addr_string : result)
-            full_addrs.insert(addr_string + ":" + std::to_string(cryptonote::get_config(m_nettype).P2P_DEFAULT_PORT));
-        }
-        ++i;
+        std::istringstream ss(cached_seed_nodes);
+        std::string full_addr;
+        while (std::getline(ss, full_addr))
+          if (!full_addr.empty())
+            full_addrs.insert(full_addr);
+        MDEBUG("Loaded " << full_addrs.size() << " seed nodes found by DNS previously");
       }
 
       // append the fallback nodes if we have too few seed nodes to start with
       if (full_addrs.size() < MIN_WANTED_SEED_NODES)
       {
         if (full_addrs.empty())
-          MINFO("DNS seed node lookup either timed out or failed, falling back to defaults");
+          MINFO("No DNS seed nodes known yet, falling back to defaults");
         else
-          MINFO("Not enough DNS seed nodes found, using fallback defaults too");
+          MINFO("Not enough DNS seed nodes known, using fallback defaults too");
 
         for (const auto &peer: get_seed_nodes(cryptonote::MAINNET))
           full_addrs.insert(peer);
@@ -669,14 +739,6 @@ namespace nodetool
     }
     MDEBUG("Number of seed nodes: " << m_seed_nodes.size());
 
-    m_config_folder = command_line::get_arg(vm, cryptonote::arg_data_dir);
-
-    if ((m_nettype == cryptonote::MAINNET && m_port != std::to_string(::config::P2P_DEFAULT_PORT))
-        || (m_nettype == cryptonote::TESTNET && m_port != std::to_string(::config::testnet::P2P_DEFAULT_PORT))
-        || (m_nettype == cryptonote::STAGENET && m_port != std::to_string(::config::stagenet::P2P_DEFAULT_PORT))) {
-      m_config_folder = m_config_folder + "/" + m_port;
-    }
-
     res = init_config();
     CHECK_AND_ASSERT_MES(res, false, "Failed to init config.");
 
@@ -794,6 +856,9 @@ namespace nodetool
     // remove UPnP port mapping
     if(!m_no_igd)
       delete_upnp_port_mapping(m_listening_port);
+    // the state file belongs to the daemon writing the data directory
+    if (m_replica)
+      return true;
     return store_config();
   }
   //-----------------------------------------------------------------------------------
@@ -846,7 +911,7 @@ namespace nodetool
   }
 
   template<class t_payload_net_handler>
-  bool node_server<t_payload_net_handler>::notify_peer_list(int command, const std::string& buf, const std::vector<peerlist_entry>& peers_to_send, bool try_connect)
+  bool node_server<t_payload_net_handler>::notify_peer_list(int command, const epee::net_utils::shared_buffer& buf, const std::vector<peerlist_entry>& peers_to_send, bool try_connect)
   {
       MDEBUG("P2P Request: notify_peer_list: start notify, total peers: " << peers_to_send.size());
       for (unsigned i = 0; i < peers_to_send.size(); i++) {
@@ -887,56 +952,44 @@ namespace nodetool
 
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
-  bool node_server<t_payload_net_handler>::multicast_send(int command, const std::string &data, const std::list<std::string> &addresses, const std::list<peerid_type> &exclude_peerids)
+  bool node_server<t_payload_net_handler>::multicast_send(int command, const epee::net_utils::shared_buffer &data, const std::list<std::string> &addresses, const std::list<peerid_type> &exclude_peerids, unsigned int max_tunnel_peers)
   {
       MDEBUG("P2P Request: multicast_send: Start tunneling for addresses: "
                    << boost::algorithm::join(addresses, ", "));
       std::vector<peerlist_entry> tunnels;
       {
-          std::map<std::string, nodetool::supernode_route> local_supernode_routes;
-          {
-              MDEBUG("P2P Request: multicast_send: lock");
-              boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
-              MDEBUG("P2P Request: multicast_send: unlock");
-              local_supernode_routes = m_supernode_routes;
-          }
-          for (auto addr : addresses)
+          // excluded peers and peers which have been already selected are skipped
+          std::unordered_set<peerid_type> skipped_peerids(exclude_peerids.begin(), exclude_peerids.end());
+
+          MDEBUG("P2P Request: multicast_send: lock");
+          boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+          MDEBUG("P2P Request: multicast_send: unlock");
+          boost::lock_guard<boost::mutex> connections_guard(m_peer_connections_lock);
+
+          for (const std::string &addr : addresses)
           {
               MDEBUG("P2P Request: multicast_send: looking for tunnel for " << addr);
-              auto it = local_supernode_routes.find(addr);
-              if (it == local_supernode_routes.end())
+              auto it = m_supernode_routes.find(addr);
+              if (it == m_supernode_routes.end())
               {
                   MWARNING("no tunnel found for address: " << addr);
                   continue;
               }
-              // peers for address
-              std::vector<peerlist_entry> addr_tunnels = (*it).second.peers;
+              // peers for address, the closest ones are tried first
               unsigned int count = 0;
-              for (auto peer_it = addr_tunnels.begin(); peer_it != addr_tunnels.end(); ++peer_it)
+              for (const peerlist_entry &addr_tunnel : it->second.peers)
               {
-                  peerlist_entry addr_tunnel = *peer_it;
-
-
                   // check if peer connected connections
-                  boost::uuids::uuid dummy;
-                  if (!find_connection_id_by_peer(addr_tunnel, dummy))
+                  if (m_peer_connections.find(addr_tunnel.id) == m_peer_connections.end())
                     continue;
 
-                  // don't allow duplicate entries
-                  auto tunnel_it = std::find_if(tunnels.begin(), tunnels.end(),
-                                                [addr_tunnel](const peerlist_entry &entry) -> bool {
-                      return entry.id == addr_tunnel.id;
-                  });
-                  // check if our peer is in excluded peers
-                  auto exclude_it = std::find(exclude_peerids.begin(), exclude_peerids.end(),
-                                              addr_tunnel.id);
-                  if (tunnel_it == tunnels.end() && exclude_it == exclude_peerids.end())
+                  if (skipped_peerids.insert(addr_tunnel.id).second)
                   {
                       MDEBUG("found tunnel for address: " << addr << ":  " << addr_tunnel.adr.str());
                       tunnels.push_back(addr_tunnel);
                       count++;
                   }
-                  if (count >= MAX_TUNNEL_PEERS)
+                  if (count >= max_tunnel_peers)
                   {
                       break;
                   }
@@ -944,7 +997,7 @@ namespace nodetool
           }
       }
       MDEBUG("P2P Request: multicast_send: End tunneling, tunnels found: " << tunnels.size());
-      m_multicast_bytes_out += data.size() * tunnels.size();
+      m_multicast_bytes_out += data->size() * tunnels.size();
 
       return notify_peer_list(command, data, tunnels);
   }
@@ -955,17 +1008,13 @@ namespace nodetool
   {
       uint64_t max_hop = 0;
       {
-          std::map<std::string, nodetool::supernode_route> local_supernode_routes;
-          {
-              MDEBUG("P2P Request: multicast_send: lock");
-              boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
-              MDEBUG("P2P Request: multicast_send: unlock");
-              local_supernode_routes = m_supernode_routes;
-          }
-          for (auto addr : addresses)
+          MDEBUG("P2P Request: get_max_hop: lock");
+          boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+          MDEBUG("P2P Request: get_max_hop: unlock");
+          for (const std::string &addr : addresses)
           {
-              auto it = local_supernode_routes.find(addr);
-              if (it != local_supernode_routes.end() && max_hop < (*it).second.max_hop)
+              auto it = m_supernode_routes.find(addr);
+              if (it != m_supernode_routes.end() && max_hop < (*it).second.max_hop)
               {
                   max_hop = (*it).second.max_hop;
               }
@@ -980,14 +1029,10 @@ namespace nodetool
   {
       std::list<std::string> routes;
       {
-          std::map<std::string, nodetool::supernode_route> local_supernode_routes;
-          {
-              MDEBUG("P2P Request: multicast_send: lock");
-              boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
-              MDEBUG("P2P Request: multicast_send: unlock");
-              local_supernode_routes = m_supernode_routes;
-          }
-          for (auto it = local_supernode_routes.begin(); it != local_supernode_routes.end(); ++it)
+          MDEBUG("P2P Request: get_routes: lock");
+          boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+          MDEBUG("P2P Request: get_routes: unlock");
+          for (auto it = m_supernode_routes.begin(); it != m_supernode_routes.end(); ++it)
           {
               routes.push_back((*it).first);
           }
@@ -995,23 +1040,101 @@ namespace nodetool
       return routes;
   }
 
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  uint64_t node_server<t_payload_net_handler>::get_request_cache_time()
+  {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   void node_server<t_payload_net_handler>::remove_old_request_cache()
   {
-      int timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-      for (auto it = m_supernode_requests_timestamps.begin(); it != m_supernode_requests_timestamps.end();)
+      m_supernode_requests_cache.expire(get_request_cache_time());
+  }
+
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::prune_restored_supernode_routes()
+  {
+      // restored routes are revalidated lazily: multicast_send only tunnels through peers
+      // which have connected again, and the next announce of a supernode replaces its route
+      boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+      const uint64_t now = time(nullptr);
+      for (auto it = m_supernode_routes.begin(); it != m_supernode_routes.end(); )
       {
-          if ((*it).first + REQUEST_CACHE_TIME < timestamp)
+          supernode_route &route = it->second;
+          if (route.peers.size() != route.peer_hops.size() || route.last_announce_time + SUPERNODE_ROUTE_RESTORE_MAX_AGE < now)
           {
-              m_supernode_requests_cache.erase((*it).second);
-              it = m_supernode_requests_timestamps.erase(it);
+              it = m_supernode_routes.erase(it);
+              continue;
           }
-          else
+          peerlist_entry pe;
+          size_t kept = 0;
+          for (size_t i = 0; i < route.peers.size(); ++i)
           {
-              break;
+              if (!m_peerlist.find_peer(route.peers[i].id, pe))
+                  continue;
+              route.peers[kept] = route.peers[i];
+              route.peer_hops[kept] = route.peer_hops[i];
+              ++kept;
+          }
+          route.peers.resize(kept);
+          route.peer_hops.resize(kept);
+          if (route.peers.empty())
+          {
+              it = m_supernode_routes.erase(it);
+              continue;
           }
+          route.max_hop = *std::max_element(route.peer_hops.begin(), route.peer_hops.end());
+          ++it;
       }
+      if (!m_supernode_routes.empty())
+          MINFO("Restored " << m_supernode_routes.size() << " supernode routes");
+  }
+
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::get_supernode_routes_memory_usage(uint64_t& bytes)
+  {
+      boost::unique_lock<boost::recursive_mutex> lock(m_supernode_lock, boost::try_to_lock);
+      if (!lock.owns_lock())
+          return false;
+
+      bytes = tools::memory::node_bytes(m_supernode_routes);
+      for (const auto& route : m_supernode_routes)
+      {
+          bytes += tools::memory::string_bytes(route.first);
+          bytes += tools::memory::vector_bytes(route.second.peers) + tools::memory::vector_bytes(route.second.peer_hops);
+      }
+      bytes += tools::memory::hash_bytes(m_supernodes) + tools::memory::hash_bytes(m_sent_stakes) + tools::memory::hash_bytes(m_sent_tier_supernodes);
+      bytes += tools::memory::hash_bytes(m_supernode_address_strings);
+      for (const update_journal* journal : {&m_stakes_journal, &m_tiers_journal})
+      {
+          bytes += journal->size() * sizeof(journaled_update);
+          for (const journaled_update& update : *journal)
+              bytes += update.body ? update.body->size() : 0;
+      }
+      return true;
+  }
+
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::get_request_caches_memory_usage(uint64_t& bytes)
+  {
+      boost::unique_lock<boost::recursive_mutex> request_cache_lock(m_request_cache_lock, boost::try_to_lock);
+      boost::unique_lock<boost::mutex> pending_announces_lock(m_pending_announces_lock, boost::try_to_lock);
+      boost::unique_lock<boost::mutex> announce_check_cache_lock(m_announce_check_cache_lock, boost::try_to_lock);
+      if (!request_cache_lock.owns_lock() || !pending_announces_lock.owns_lock() || !announce_check_cache_lock.owns_lock())
+          return false;
+
+      bytes = m_supernode_requests_cache.memory_usage();
+      bytes += tools::memory::hash_bytes(m_pending_announces) + tools::memory::hash_bytes(m_relayed_announces);
+      bytes += tools::memory::hash_bytes(m_announce_check_cache);
+      for (const auto& announce : m_announce_check_cache)
+          bytes += tools::memory::string_bytes(announce.first);
+      return true;
   }
 
   //-----------------------------------------------------------------------------------
@@ -1030,8 +1153,106 @@ namespace nodetool
 #ifdef LOCK_RTA_SENDING
     return 1;
 #endif
+      if (check_supernode_announce(arg, context) && process_supernode_announce(arg, context))
+          queue_announce_relay(std::move(arg));
+
+      MDEBUG("P2P Request: handle_supernode_announce: end");
+      return 1;
+  }
+
+  template<class t_payload_net_handler>
+  int node_server<t_payload_net_handler>::handle_supernode_announce_batch(int command, COMMAND_SUPERNODE_ANNOUNCE_BATCH::request& arg, p2p_connection_context& context)
+  {
+      MDEBUG("P2P Request: handle_supernode_announce_batch: start, announces: " << arg.announces.size());
+
+      m_announce_bytes_in += get_command_size(arg);
+
+      if (context.m_state != p2p_connection_context::state_normal) {
+          MWARNING(context << " invalid connection (no handshake)");
+          return 1;
+      }
+
+#ifdef LOCK_RTA_SENDING
+    return 1;
+#endif
+      if (arg.announces.size() > ANNOUNCE_BATCH_MAX_SIZE) {
+          MWARNING(context << " too many announces in batch: " << arg.announces.size());
+          return 1;
+      }
+
+      for (auto &announce : arg.announces)
+      {
+          if (check_supernode_announce(announce, context) && process_supernode_announce(announce, context))
+              queue_announce_relay(std::move(announce));
+      }
+
+      MDEBUG("P2P Request: handle_supernode_announce_batch: end");
+      return 1;
+  }
+
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::check_supernode_announce(const COMMAND_SUPERNODE_ANNOUNCE::request& arg, const p2p_connection_context& context)
+  {
+      // stakes and heights can't be judged until the local chain catches up; announces are accepted as before
+      if (!m_payload_handler.is_synchronized())
+          return true;
+
+      uint64_t chain_height = m_payload_handler.get_core().get_current_blockchain_height();
+      if (arg.height + ::config::graft::SUPERNODE_HISTORY_SIZE < chain_height || arg.height > chain_height + ANNOUNCE_MAX_FUTURE_BLOCKS) {
+          MDEBUG(context << " drop announce of " << arg.supernode_public_id << " for height " << arg.height << ", chain height " << chain_height);
+          return false;
+      }
+
+      // announces of the same supernode arrive from every neighbour, verify each of them once
+      std::string key = arg.supernode_public_id + ':' + std::to_string(arg.height) + ':' + arg.signature;
+      {
+          boost::lock_guard<boost::mutex> guard(m_announce_check_cache_lock);
+          auto it = m_announce_check_cache.find(key);
+          if (it != m_announce_check_cache.end())
+              return it->second;
+      }
+
+      bool valid = true;
+
+      cryptonote::supernode_stakes_snapshot_ptr stakes = m_payload_handler.get_core().get_supernode_stakes_snapshot(arg.height);
+      if (stakes) {
+          const cryptonote::supernode_stake* stake = stakes->find_supernode_stake(arg.supernode_public_id);
+          if (!stake || stake->amount < ::config::graft::TIER1_STAKE_AMOUNT) {
+              MDEBUG(context << " drop announce of unstaked supernode " << arg.supernode_public_id << " for height " << arg.height);
+              valid = false;
+          }
+      }
+
+      if (valid) {
+          crypto::public_key id_key;
+          crypto::signature sign;
+          if (!epee::string_tools::hex_to_pod(arg.supernode_public_id, id_key) || !epee::string_tools::hex_to_pod(arg.signature, sign)) {
+              MDEBUG(context << " drop malformed announce of " << arg.supernode_public_id);
+              valid = false;
+          }
+          else {
+              std::string msg = arg.supernode_public_id + std::to_string(arg.height);
+              crypto::hash hash;
+              crypto::cn_fast_hash(msg.data(), msg.size(), hash);
+              valid = crypto::check_signature(hash, id_key, sign);
+              if (!valid)
+                  MDEBUG(context << " drop announce of " << arg.supernode_public_id << " with invalid signature");
+          }
+      }
+
+      boost::lock_guard<boost::mutex> guard(m_announce_check_cache_lock);
+      if (m_announce_check_cache.size() >= ANNOUNCE_CHECK_CACHE_MAX_SIZE)
+          m_announce_check_cache.clear();
+      m_announce_check_cache.emplace(std::move(key), valid);
+
+      return valid;
+  }
+
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::process_supernode_announce(const COMMAND_SUPERNODE_ANNOUNCE::request& arg, const p2p_connection_context& context)
+  {
       static std::string supernode_endpoint("send_supernode_announce");
-      std::string supernode_str = arg.supernode_public_id;
+      const std::string &supernode_str = arg.supernode_public_id;
 
       bool is_local;
       {
@@ -1039,43 +1260,42 @@ namespace nodetool
           is_local = m_supernodes.count(supernode_str) > 0;
       }
       if (!is_local) {
-          MDEBUG("P2P Request: handle_supernode_announce: update tunnels for " << arg.supernode_public_id << " Hop: " << arg.hop << " Address: " << arg.network_address);
+          MDEBUG("P2P Request: process_supernode_announce: update tunnels for " << arg.supernode_public_id << " Hop: " << arg.hop << " Address: " << arg.network_address);
 
           peerlist_entry pe;
           // TODO: Need to investigate it and mechanism for adding peer to the peerlist
           if (!m_peerlist.find_peer(context.peer_id, pe))
           { // unknown peer, alternative handshake with it
               MDEBUG("unknown peer, alternative handshake with it " << context.peer_id);
-              return 1;
+              return false;
           }
           {
-              MDEBUG("P2P Request: handle_supernode_announce: lock");
+              MDEBUG("P2P Request: process_supernode_announce: lock");
               boost::lock_guard<boost::recursive_mutex> guard(m_request_cache_lock);
-              MDEBUG("P2P Request: handle_supernode_announce: unlock");
+              MDEBUG("P2P Request: process_supernode_announce: unlock");
               remove_old_request_cache();
           }
-          MDEBUG("P2P Request: handle_supernode_announce: lock");
+          MDEBUG("P2P Request: process_supernode_announce: lock");
           boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
-          MDEBUG("P2P Request: handle_supernode_announce: unlock");
+          MDEBUG("P2P Request: process_supernode_announce: unlock");
 
-          MDEBUG("P2P Request: handle_supernode_announce: routes number - " << m_supernode_routes.size());
+          MDEBUG("P2P Request: process_supernode_announce: routes number - " << m_supernode_routes.size());
           for (auto it2 = m_supernode_routes.begin(); it2 != m_supernode_routes.end(); ++it2)
           {
-              MDEBUG("P2P Request: handle_supernode_announce: " << (*it2).first << " " << (*it2).second.peers.size());
+              MDEBUG("P2P Request: process_supernode_announce: " << (*it2).first << " " << (*it2).second.peers.size());
           }
 
 
           auto it = m_supernode_routes.find(supernode_str);
           if (it == m_supernode_routes.end())
           {
-              std::vector<peerlist_entry> peer_vec;
-              peer_vec.push_back(pe);
               nodetool::supernode_route route;
               route.last_announce_height = arg.height;
               route.last_announce_time = time(nullptr);
               route.max_hop = arg.hop;
-              route.peers = peer_vec;
-              m_supernode_routes[supernode_str] = route;
+              route.peers.push_back(pe);
+              route.peer_hops.push_back(arg.hop);
+              m_supernode_routes[supernode_str] = std::move(route);
           }
           else {
               auto &route = it->second;
@@ -1085,7 +1305,7 @@ namespace nodetool
               {
                   MINFO("SUPERNODE_ANNOUNCE from " << context.peer_id
                         << " too old, corrent route height " << (*it).second.last_announce_height);
-                  return 1;
+                  return false;
               }
 #endif
 
@@ -1097,70 +1317,180 @@ namespace nodetool
                                               [pe](const peerlist_entry &p) -> bool { return pe.id == p.id; });
                   if (peer_it == route.peers.end())
                   {
-                      route.peers.push_back(pe);
+                      // keep peers ordered by distance, so unicasts follow the shortest known path
+                      auto hop_it = std::upper_bound(route.peer_hops.begin(), route.peer_hops.end(), arg.hop);
+                      route.peers.insert(route.peers.begin() + (hop_it - route.peer_hops.begin()), pe);
+                      route.peer_hops.insert(hop_it, arg.hop);
                       if (route.max_hop < arg.hop)
                       {
                           route.max_hop = arg.hop;
                       }
                   }
-                  return 1;
+                  return false;
               }
               route.peers.clear();
               route.peers.push_back(pe);
+              route.peer_hops.clear();
+              route.peer_hops.push_back(arg.hop);
               route.last_announce_height = arg.height;
               route.last_announce_time = time(nullptr);
               route.max_hop = arg.hop;
           }
       }
 
-      std::list<std::reference_wrapper<local_supernode>> post_to_sn;
       {
-          LOG_PRINT_L3("P2P Request: handle_supernode_announce: lock");
+          LOG_PRINT_L3("P2P Request: process_supernode_announce: lock");
           boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
-          LOG_PRINT_L3("P2P Request: handle_supernode_announce: unlock");
+          LOG_PRINT_L3("P2P Request: process_supernode_announce: unlock");
+          std::string uri = make_supernode_request_uri(supernode_endpoint, std::string());
+          std::shared_ptr<const std::string> body;
           for (auto &sn : m_supernodes) {
-              if (sn.first != supernode_str)
-                  post_to_sn.push_back(std::ref(sn.second));
+              if (sn.first == supernode_str)
+                  continue;
+              if (!body)
+                  body = make_supernode_request_body<cryptonote::COMMAND_RPC_SUPERNODE_ANNOUNCE>(supernode_endpoint, arg);
+              LOG_PRINT_L1("P2P Request: process_supernode_announce: post to supernode");
+              // newer announce of the same supernode replaces the pending one
+              enqueue_request_to_supernode(sn.second, uri, body, "announce:" + arg.supernode_public_id);
           }
       }
-      for (auto &sn : post_to_sn) {
-          LOG_PRINT_L1("P2P Request: handle_supernode_announce: post to supernode");
-          post_request_to_supernode<cryptonote::COMMAND_RPC_SUPERNODE_ANNOUNCE>(sn, supernode_endpoint, arg);
-      }
 
-      if (!is_local) {
-          // Notify neighbours about new ANNOUNCE
-          arg.hop++;
-          MDEBUG("P2P Request: handle_supernode_announce: notify peers " << arg.hop);
+      return !is_local;
+  }
+
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::queue_announce_relay(COMMAND_SUPERNODE_ANNOUNCE::request arg)
+  {
+      arg.hop++;
+
+      boost::lock_guard<boost::mutex> guard(m_pending_announces_lock);
+      // newer announce of the same supernode replaces the pending one
+      std::string id = arg.supernode_public_id;
+      m_pending_announces[id] = std::move(arg);
+  }
 
-          std::list<boost::uuids::uuid> all_connections, random_connections;
-          m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::relay_pending_announces()
+  {
+      std::vector<COMMAND_SUPERNODE_ANNOUNCE::request> announces;
+      uint64_t now = time(nullptr);
+
+      {
+          boost::lock_guard<boost::mutex> guard(m_pending_announces_lock);
+
+          for (auto it = m_pending_announces.begin(); it != m_pending_announces.end();)
           {
-            // skip ourself connections
-            if(cntxt.peer_id == m_config.m_peer_id)
-              return true;
-            all_connections.push_back(cntxt.m_connection_id);
-            return true;
-          });
+              const COMMAND_SUPERNODE_ANNOUNCE::request &announce = it->second;
+              auto relayed_it = m_relayed_announces.find(it->first);
+
+              if (relayed_it != m_relayed_announces.end())
+              {
+                  const relayed_announce &relayed = relayed_it->second;
 
-          if (all_connections.empty()) {
-            MWARNING("P2P Request: no connections to relay announce");
-            return 1;
+                  if (relayed.height == announce.height && relayed.network_address == announce.network_address &&
+                      relayed.time + ANNOUNCE_UNCHANGED_RELAY_INTERVAL > now)
+                  {
+                      // route info has not changed since the last relay
+                      it = m_pending_announces.erase(it);
+                      continue;
+                  }
+
+                  if (relayed.time + ANNOUNCE_RELAY_MIN_INTERVAL > now)
+                  {
+                      // per-origin rate limit; keep the announce pending, newer one may replace it
+                      ++it;
+                      continue;
+                  }
+              }
+
+              m_relayed_announces[it->first] = relayed_announce{announce.height, announce.network_address, now};
+              announces.push_back(std::move(it->second));
+              it = m_pending_announces.erase(it);
           }
 
-          select_subset_with_probability(1.0 / all_connections.size(), all_connections, random_connections);
+          for (auto it = m_relayed_announces.begin(); it != m_relayed_announces.end();)
+          {
+              if (it->second.time + std::max(ANNOUNCE_UNCHANGED_RELAY_INTERVAL, ANNOUNCE_RELAY_MIN_INTERVAL) <= now)
+                  it = m_relayed_announces.erase(it);
+              else
+                  ++it;
+          }
+      }
+
+      if (announces.empty())
+          return true;
+
+      MDEBUG("P2P Request: relay_pending_announces: announces: " << announces.size());
 
-          std::string arg_buff;
-          epee::serialization::store_t_to_binary(arg, arg_buff);
+      std::vector<std::pair<boost::uuids::uuid, uint32_t>> connections; // connection id and support flags
+      m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
+      {
+        // skip ourself connections
+        if(cntxt.peer_id == m_config.m_peer_id)
+          return true;
+        connections.emplace_back(cntxt.m_connection_id, cntxt.support_flags);
+        return true;
+      });
+
+      if (connections.empty()) {
+        MWARNING("P2P Request: no connections to relay announces");
+        return true;
+      }
+
+      // each announce is relayed to its own random subset of neighbours, announces to the same neighbour are packed together
+      std::vector<size_t> all_indexes(connections.size()), random_indexes;
+      std::vector<std::vector<size_t>> connection_announces(connections.size());
 
-          MDEBUG("P2P Request: handle_supernode_announce: relaying to neighbours: " << random_connections.size());
+      for (size_t i=0; i<all_indexes.size(); i++)
+          all_indexes[i] = i;
 
-          relay_notify_to_list(command, arg_buff, random_connections);
-          m_announce_bytes_out += arg_buff.size() * random_connections.size();
+      for (size_t i=0; i<announces.size(); i++)
+      {
+          random_indexes.clear();
+          select_subset_with_probability(1.0 / connections.size(), all_indexes, random_indexes);
+          for (size_t connection_index : random_indexes)
+              connection_announces[connection_index].push_back(i);
       }
 
-      MDEBUG("P2P Request: handle_supernode_announce: end");
-      return 1;
+      std::vector<epee::net_utils::shared_buffer> announce_buffs(announces.size());
+
+      for (size_t i=0; i<connections.size(); i++)
+      {
+          const std::vector<size_t> &indexes = connection_announces[i];
+
+          if (indexes.empty())
+              continue;
+
+          if (connections[i].second & P2P_SUPPORT_FLAG_ANNOUNCE_BATCH)
+          {
+              for (size_t first=0; first<indexes.size(); first+=ANNOUNCE_BATCH_MAX_SIZE)
+              {
+                  COMMAND_SUPERNODE_ANNOUNCE_BATCH::request batch;
+                  size_t last = std::min(indexes.size(), first + ANNOUNCE_BATCH_MAX_SIZE);
+
+                  for (size_t j=first; j<last; j++)
+                      batch.announces.push_back(announces[indexes[j]]);
+
+                  epee::net_utils::shared_buffer batch_buff = make_command_buffer(batch);
+                  m_net_server.get_config_object().notify(COMMAND_SUPERNODE_ANNOUNCE_BATCH::ID, batch_buff, connections[i].first);
+                  m_announce_bytes_out += batch_buff->size();
+              }
+          }
+          else
+          {
+              // old peer, relay announces one by one
+              for (size_t index : indexes)
+              {
+                  epee::net_utils::shared_buffer &announce_buff = announce_buffs[index];
+                  if (!announce_buff)
+                      announce_buff = make_command_buffer(announces[index]);
+                  m_net_server.get_config_object().notify(COMMAND_SUPERNODE_ANNOUNCE::ID, announce_buff, connections[i].first);
+                  m_announce_bytes_out += announce_buff->size();
+              }
+          }
+      }
+
+      return true;
   }
 
   template<class t_payload_net_handler>
@@ -1187,24 +1517,20 @@ namespace nodetool
           MDEBUG("P2P Request: handle_broadcast: unlock");
           MDEBUG("P2P Request: handle_broadcast: sender_address: " << arg.sender_address
                        << ", our address(es): " << join_supernodes_addresses(", "));
-          if (m_supernode_requests_cache.find(arg.message_id) == m_supernode_requests_cache.end())
+          if (m_supernode_requests_cache.insert(arg.message_id, get_request_cache_time()))
           {
               MDEBUG("P2P Request: handle_broadcast: post to supernodes");
-              m_supernode_requests_cache.insert(arg.message_id);
-              int timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-              m_supernode_requests_timestamps.insert(std::make_pair(timestamp, arg.message_id));
 
-              post_request_to_supernodes<cryptonote::COMMAND_RPC_BROADCAST>("broadcast", arg, arg.callback_uri);
+              post_request_to_supernodes<cryptonote::COMMAND_RPC_BROADCAST>("broadcast", arg, arg.callback_uri, std::string(), arg.binary_data);
 
               if (arg.hop > 0)
               {
                   MDEBUG("P2P Request: handle_broadcast: notify broadcast from " << arg.sender_address
                                << " to peers. Hop level: " << arg.hop);
                   arg.hop--;
-                  std::string buff;
-                  epee::serialization::store_t_to_binary(arg, buff);
+                  epee::net_utils::shared_buffer buff = make_command_buffer(arg);
 
-                  m_broadcast_bytes_out += buff.size() * get_connections_count();
+                  m_broadcast_bytes_out += buff->size() * get_connections_count();
 
                   relay_notify_to_all(command, buff, context);
               }
@@ -1249,17 +1575,18 @@ namespace nodetool
           MDEBUG("P2P Request: handle_multicast: sender_address: " << arg.sender_address
                        << ", receiver_addresses: " << boost::algorithm::join(arg.receiver_addresses, ", ")
                        << ", our address(es): " << join_supernodes_addresses(", "));
-          if (m_supernode_requests_cache.find(arg.message_id) == m_supernode_requests_cache.end())
+          if (m_supernode_requests_cache.insert(arg.message_id, get_request_cache_time()))
           {
               MDEBUG("P2P Request: handle_multicast: post to supernodes");
-              m_supernode_requests_cache.insert(arg.message_id);
-              int timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-              m_supernode_requests_timestamps.insert(std::make_pair(timestamp, arg.message_id));
+              // only addressed supernodes get the message, each of them once even if it's listed several times
+              std::unordered_set<std::string> posted;
               for (auto it = addresses.begin(); it != addresses.end(); ) {
                   auto snit = m_supernodes.find(*it);
                   if (snit != m_supernodes.end()) {
-                      MDEBUG("P2P Request: handle_multicast: posting to local supernode " << snit->first);
-                      post_request_to_supernode<cryptonote::COMMAND_RPC_MULTICAST>(snit->second, "multicast", arg, arg.callback_uri);
+                      if (posted.insert(snit->first).second) {
+                          MDEBUG("P2P Request: handle_multicast: posting to local supernode " << snit->first);
+                          post_request_to_supernode<cryptonote::COMMAND_RPC_MULTICAST>(snit->second, "multicast", arg, arg.callback_uri, std::string(), arg.binary_data);
+                      }
                       it = addresses.erase(it);
                   } else {
                       ++it;
@@ -1291,9 +1618,7 @@ namespace nodetool
           std::list<peerid_type> exclude_peers;
           exclude_peers.push_back(context.peer_id);
 
-          std::string buff;
-          epee::serialization::store_t_to_binary(arg, buff);
-          multicast_send(command, buff, addresses, exclude_peers);
+          multicast_send(command, make_command_buffer(arg), addresses, exclude_peers);
       }
       MDEBUG("P2P Request: handle_multicast: end");
       return 1;
@@ -1324,17 +1649,14 @@ namespace nodetool
           MDEBUG("P2P Request: handle_unicast: sender_address: " << arg.sender_address
                        << ", receiver_address: " << arg.receiver_address
                        << ", our address(es): " << join_supernodes_addresses(", "));
-          if (m_supernode_requests_cache.find(arg.message_id) == m_supernode_requests_cache.end())
+          if (m_supernode_requests_cache.insert(arg.message_id, get_request_cache_time()))
           {
               MDEBUG("P2P Request: handle_unicast: post to supernodes");
-              m_supernode_requests_cache.insert(arg.message_id);
-              int timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-              m_supernode_requests_timestamps.insert(std::make_pair(timestamp, arg.message_id));
               auto it = m_supernodes.find(address);
               bool local_sn = it != m_supernodes.end();
               if (local_sn) {
                   MDEBUG("P2P Request: handle_unicast: sending to local supernode " << address);
-                  post_request_to_supernode<cryptonote::COMMAND_RPC_UNICAST>(it->second, "unicast", arg, arg.callback_uri);
+                  post_request_to_supernode<cryptonote::COMMAND_RPC_UNICAST>(it->second, "unicast", arg, arg.callback_uri, std::string(), arg.binary_data);
               }
               else if (arg.hop > 0)
               {
@@ -1365,9 +1687,7 @@ namespace nodetool
           std::list<peerid_type> exclude_peers;
           exclude_peers.push_back(context.peer_id);
 
-          std::string buff;
-          epee::serialization::store_t_to_binary(arg, buff);
-          multicast_send(command, buff, addresses, exclude_peers);
+          multicast_send(command, make_command_buffer(arg), addresses, exclude_peers, MAX_UNICAST_TUNNEL_PEERS);
       }
       MDEBUG("P2P Request: handle_unicast: end");
       return 1;
@@ -1408,6 +1728,7 @@ namespace nodetool
         add_host_fail(context.m_remote_address);
         return;
       }
+      context.m_peerlist_since = rsp.node_data.local_time;
       hsh_result = true;
       if(!just_take_peerlist)
       {
@@ -1419,6 +1740,7 @@ namespace nodetool
         }
 
         pi = context.peer_id = rsp.node_data.peer_id;
+        register_peer_connection(context);
         m_peerlist.set_peer_just_seen(rsp.node_data.peer_id, context.m_remote_address);
 
         if(rsp.node_data.peer_id == m_config.m_peer_id)
@@ -1456,13 +1778,15 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
-  bool node_server<t_payload_net_handler>::do_peer_timed_sync(const epee::net_utils::connection_context_base& context_, peerid_type peer_id)
+  bool node_server<t_payload_net_handler>::do_peer_timed_sync(const epee::net_utils::connection_context_base& context_, peerid_type peer_id, uint64_t peerlist_since)
   {
     typename COMMAND_TIMED_SYNC::request arg = AUTO_VAL_INIT(arg);
     m_payload_handler.get_payload_sync_data(arg.payload_data);
+    arg.peerlist_since = peerlist_since;
 
+    const auto start = std::chrono::steady_clock::now();
     bool r = epee::net_utils::async_invoke_remote_command2<typename COMMAND_TIMED_SYNC::response>(context_.m_connection_id, COMMAND_TIMED_SYNC::ID, arg, m_net_server.get_config_object(),
-      [this](int code, const typename COMMAND_TIMED_SYNC::response& rsp, p2p_connection_context& context)
+      [this, start](int code, const typename COMMAND_TIMED_SYNC::response& rsp, p2p_connection_context& context)
     {
       context.m_in_timedsync = false;
       if(code < 0)
@@ -1477,8 +1801,15 @@ namespace nodetool
         m_net_server.get_config_object().close(context.m_connection_id );
         add_host_fail(context.m_remote_address);
       }
+      else
+      {
+        context.m_peerlist_since = rsp.local_time;
+      }
       if(!context.m_is_income)
+      {
         m_peerlist.set_peer_just_seen(context.peer_id, context.m_remote_address);
+        m_peerlist.add_peer_rtt(context.m_remote_address, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+      }
       m_payload_handler.process_payload_sync_data(rsp.payload_data, context, false);
     });
 
@@ -1491,19 +1822,6 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
-  size_t node_server<t_payload_net_handler>::get_random_index_with_fixed_probability(size_t max_index)
-  {
-    //divide by zero workaround
-    if(!max_index)
-      return 0;
-
-    size_t x = crypto::rand<size_t>()%(max_index+1);
-    size_t res = (x*x*x)/(max_index*max_index); //parabola \/
-    MDEBUG("Random connection index=" << res << "(x="<< x << ", max_index=" << max_index << ")");
-    return res;
-  }
-  //-----------------------------------------------------------------------------------
-  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::is_peer_used(const peerlist_entry& peer)
   {
 
@@ -1746,7 +2064,10 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::make_new_connection_from_peerlist(bool use_white_list)
   {
-    size_t local_peers_count = use_white_list ? m_peerlist.get_white_peers_count():m_peerlist.get_gray_peers_count();
+    if (use_white_list)
+      return make_new_connection_from_white_peerlist();
+
+    size_t local_peers_count = m_peerlist.get_gray_peers_count();
     if(!local_peers_count)
       return false;//no peers
 
@@ -1759,20 +2080,10 @@ namespace nodetool
     while(rand_count < (max_random_index+1)*3 &&  try_count < 10 && !m_net_server.is_stop_signal_sent())
     {
       ++rand_count;
-      size_t random_index;
-
-      if (use_white_list) {
-        local_peers_count = m_peerlist.get_white_peers_count();
-        if (!local_peers_count)
-          return false;
-        max_random_index = std::min<uint64_t>(local_peers_count -1, 20);
-        random_index = get_random_index_with_fixed_probability(max_random_index);
-      } else {
-        local_peers_count = m_peerlist.get_gray_peers_count();
-        if (!local_peers_count)
-          return false;
-        random_index = crypto::rand<size_t>() % local_peers_count;
-      }
+      local_peers_count = m_peerlist.get_gray_peers_count();
+      if (!local_peers_count)
+        return false;
+      size_t random_index = crypto::rand<size_t>() % local_peers_count;
 
       CHECK_AND_ASSERT_MES(random_index < local_peers_count, false, "random_starter_index < peers_local.size() failed!!");
 
@@ -1781,7 +2092,7 @@ namespace nodetool
 
       tried_peers.insert(random_index);
       peerlist_entry pe = AUTO_VAL_INIT(pe);
-      bool r = use_white_list ? m_peerlist.get_white_peer_by_index(pe, random_index):m_peerlist.get_gray_peer_by_index(pe, random_index);
+      bool r = m_peerlist.get_gray_peer_by_index(pe, random_index);
       CHECK_AND_ASSERT_MES(r, false, "Failed to get random peer from peerlist(white:" << use_white_list << ")");
 
       ++try_count;
@@ -1800,10 +2111,10 @@ namespace nodetool
         continue;
 
       MDEBUG("Selected peer: " << peerid_to_string(pe.id) << " " << pe.adr.str()
-                    << "[peer_list=" << (use_white_list ? white : gray)
+                    << "[peer_list=" << gray
                     << "] last_seen: " << (pe.last_seen ? epee::misc_utils::get_time_interval_string(time(NULL) - pe.last_seen) : "never"));
 
-      if(!try_to_connect_and_handshake_with_new_peer(pe.adr, false, pe.last_seen, use_white_list ? white : gray)) {
+      if(!try_to_connect_and_handshake_with_new_peer(pe.adr, false, pe.last_seen, gray)) {
         _note("Handshake failed");
         continue;
       }
@@ -1814,21 +2125,113 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
-  bool node_server<t_payload_net_handler>::find_connection_id_by_peer(const peerlist_entry &pe, boost::uuids::uuid& conn_id)
+  bool node_server<t_payload_net_handler>::make_new_connection_from_white_peerlist()
   {
-    bool ret = false;
-    MDEBUG("find_connection_id_by_peer: looking for: " << pe.adr.str());
-    m_net_server.get_config_object().foreach_connection([&pe, &ret, &conn_id](p2p_connection_context& cntxt)
+    std::vector<std::pair<peerlist_entry, peer_quality>> peers;
+    m_peerlist.get_white_peers_with_quality(peers);
+    if (peers.empty())
+      return false;//no peers
+
+    // out peers already in a /16 make the others there less likely, so that one network can't take them all
+    std::map<uint32_t, size_t> out_subnets;
+    m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
     {
-      if (cntxt.peer_id == pe.id) {
-        conn_id = cntxt.m_connection_id;
-        ret = true;
-        return false; // found connection, stopping foreach_connection loop
-      }
+      if (!cntxt.m_is_income)
+        ++out_subnets[get_subnet16(cntxt.m_remote_address)];
       return true;
     });
+
+    std::vector<double> weights(peers.size());
+    for (size_t i = 0; i < peers.size(); ++i)
+    {
+      const auto subnet = out_subnets.find(get_subnet16(peers[i].first.adr));
+      weights[i] = get_peer_weight(peers[i].second) / (subnet == out_subnets.end() ? 1 : 1 + PEER_SAME_SUBNET_PENALTY * subnet->second);
+    }
+
+    size_t try_count = 0;
+    while (try_count < 10 && !m_net_server.is_stop_signal_sent())
+    {
+      const size_t index = get_weighted_random_index(weights);
+      if (index == weights.size())
+        return false;
+      weights[index] = 0;
+      const peerlist_entry& pe = peers[index].first;
+      const peer_quality& pq = peers[index].second;
+
+      ++try_count;
+
+      _note("Considering connecting (out) to peer: " << peerid_to_string(pe.id) << " " << pe.adr.str());
+
+      if(is_peer_used(pe)) {
+        _note("Peer is used");
+        continue;
+      }
+
+      if(!is_remote_host_allowed(pe.adr))
+        continue;
+
+      if(is_addr_recently_failed(pe.adr))
+        continue;
+
+      MDEBUG("Selected peer: " << peerid_to_string(pe.id) << " " << pe.adr.str()
+                    << "[peer_list=" << white
+                    << "] last_seen: " << (pe.last_seen ? epee::misc_utils::get_time_interval_string(time(NULL) - pe.last_seen) : "never")
+                    << ", rtt: " << (pq.rtt_samples ? std::to_string(pq.rtt_ms) + " ms" : "unknown")
+                    << ", throughput: " << (pq.throughput_samples ? std::to_string(pq.throughput / 1024) + " kB/s" : "unknown")
+                    << ", block delay: " << (pq.block_delay_samples ? std::to_string(pq.block_delay_ms) + " ms" : "unknown"));
+
+      if(!try_to_connect_and_handshake_with_new_peer(pe.adr, false, pe.last_seen, white)) {
+        _note("Handshake failed");
+        continue;
+      }
+
+      return true;
+    }
+    return false;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::find_connection_id_by_peer(const peerlist_entry &pe, boost::uuids::uuid& conn_id)
+  {
+    MDEBUG("find_connection_id_by_peer: looking for: " << pe.adr.str());
+    boost::lock_guard<boost::mutex> guard(m_peer_connections_lock);
+    auto it = m_peer_connections.find(pe.id);
+    if (it == m_peer_connections.end())
+      return false;
+    conn_id = it->second;
     MDEBUG("find_connection_id_by_peer: done looking for: " << pe.adr.str() << ", found: " << conn_id);
-    return ret;
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::register_peer_connection(const p2p_connection_context& context)
+  {
+    if (!context.peer_id)
+      return;
+    boost::lock_guard<boost::mutex> guard(m_peer_connections_lock);
+    m_peer_connections[context.peer_id] = context.m_connection_id;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::unregister_peer_connection(const p2p_connection_context& context)
+  {
+    if (!context.peer_id)
+      return;
+    {
+      boost::lock_guard<boost::mutex> guard(m_peer_connections_lock);
+      auto it = m_peer_connections.find(context.peer_id);
+      if (it == m_peer_connections.end() || it->second != context.m_connection_id)
+        return;
+      m_peer_connections.erase(it);
+    }
+    // the peer may have another connection
+    m_net_server.get_config_object().foreach_connection([this, &context](p2p_connection_context& cntxt)
+    {
+      if (cntxt.peer_id != context.peer_id || cntxt.m_connection_id == context.m_connection_id)
+        return true;
+      register_peer_connection(cntxt);
+      return false;
+    });
   }
 
 
@@ -1879,6 +2282,33 @@ namespace nodetool
       return true;
   }
   //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::apply_seed_nodes_lookup()
+  {
+    if (!m_seed_nodes_lookup || !m_seed_nodes_lookup->done.load(std::memory_order_acquire))
+      return;
+    const std::vector<std::string> addresses = std::move(m_seed_nodes_lookup->addresses);
+    m_seed_nodes_lookup.reset();
+    if (addresses.empty())
+    {
+      MINFO("DNS seed node lookup failed");
+      return;
+    }
+
+    std::string cached_seed_nodes;
+    for (const auto& full_addr : addresses)
+    {
+      std::vector<epee::net_utils::network_address> resolved_addrs;
+      append_net_address(resolved_addrs, full_addr, cryptonote::get_config(m_nettype).P2P_DEFAULT_PORT);
+      for (const auto& na : resolved_addrs)
+        if (std::find(m_seed_nodes.begin(), m_seed_nodes.end(), na) == m_seed_nodes.end())
+          m_seed_nodes.push_back(na);
+      cached_seed_nodes += full_addr + "\n";
+    }
+    MDEBUG("DNS seed node lookup done, number of seed nodes: " << m_seed_nodes.size());
+
+    epee::file_io_utils::save_string_to_file(m_config_folder + "/" + P2P_SEED_NODES_FILENAME, cached_seed_nodes);
+  }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::connections_maker()
@@ -1888,6 +2318,8 @@ namespace nodetool
 
     if (!m_exclusive_peers.empty()) return true;
 
+    apply_seed_nodes_lookup();
+
     size_t start_conn_count = get_outgoing_connections_count();
     if(!m_peerlist.get_white_peers_count() && m_seed_nodes.size())
     {
@@ -2007,6 +2439,7 @@ namespace nodetool
     m_gray_peerlist_housekeeping_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::gray_peerlist_housekeeping, this));
     m_peerlist_store_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::store_config, this));
     m_incoming_connections_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::check_incoming_connections, this));
+    m_announces_relay_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::relay_pending_announces, this));
     return true;
   }
   //-----------------------------------------------------------------------------------
@@ -2027,19 +2460,19 @@ namespace nodetool
   bool node_server<t_payload_net_handler>::peer_sync_idle_maker()
   {
     MDEBUG("STARTED PEERLIST IDLE HANDSHAKE");
-    typedef std::list<std::pair<epee::net_utils::connection_context_base, peerid_type> > local_connects_type;
+    typedef std::list<std::tuple<epee::net_utils::connection_context_base, peerid_type, uint64_t> > local_connects_type;
     local_connects_type cncts;
     m_net_server.get_config_object().foreach_connection([&](p2p_connection_context& cntxt)
     {
       if(cntxt.peer_id && !cntxt.m_in_timedsync)
       {
         cntxt.m_in_timedsync = true;
-        cncts.push_back(local_connects_type::value_type(cntxt, cntxt.peer_id));//do idle sync only with handshaked connections
+        cncts.push_back(local_connects_type::value_type(cntxt, cntxt.peer_id, cntxt.m_peerlist_since));//do idle sync only with handshaked connections
       }
       return true;
     });
 
-    std::for_each(cncts.begin(), cncts.end(), [&](const typename local_connects_type::value_type& vl){do_peer_timed_sync(vl.first, vl.second);});
+    std::for_each(cncts.begin(), cncts.end(), [&](const typename local_connects_type::value_type& vl){do_peer_timed_sync(std::get<0>(vl), std::get<1>(vl), std::get<2>(vl));});
 
     MDEBUG("FINISHED PEERLIST IDLE HANDSHAKE");
     return true;
@@ -2177,7 +2610,8 @@ namespace nodetool
   template<class t_payload_net_handler>
   int node_server<t_payload_net_handler>::handle_get_support_flags(int command, COMMAND_REQUEST_SUPPORT_FLAGS::request& arg, COMMAND_REQUEST_SUPPORT_FLAGS::response& rsp, p2p_connection_context& context)
   {
-    rsp.support_flags = m_config.m_support_flags;
+    // the stripe is set once pruning starts, which can be after init
+    rsp.support_flags = m_config.m_support_flags | tools::make_pruning_support_flags(m_payload_handler.get_core().get_blockchain_pruning_stripe());
     return 1;
   }
   //-----------------------------------------------------------------------------------
@@ -2188,13 +2622,19 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
-  bool node_server<t_payload_net_handler>::relay_notify(int command, const std::string& data_buff, const boost::uuids::uuid& connection_id)
+  bool node_server<t_payload_net_handler>::relay_notify(int command, const epee::net_utils::shared_buffer& data_buff, const boost::uuids::uuid& connection_id)
   {
       return m_net_server.get_config_object().notify(command, data_buff, connection_id) >= 0;
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid> &connections)
+  {
+    return relay_notify_to_list(command, std::make_shared<const std::string>(data_buff), connections);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const epee::net_utils::shared_buffer& data_buff, const std::list<boost::uuids::uuid> &connections)
   {
     for(const auto& c_id: connections)
     {
@@ -2205,6 +2645,12 @@ namespace nodetool
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context)
+  {
+    return relay_notify_to_all(command, std::make_shared<const std::string>(data_buff), context);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::relay_notify_to_all(int command, const epee::net_utils::shared_buffer& data_buff, const epee::net_utils::connection_context_base& context)
   {
     std::list<boost::uuids::uuid> connections;
     m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
@@ -2223,6 +2669,35 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  epee::net_utils::traffic_class node_server<t_payload_net_handler>::get_traffic_class(int command)
+  {
+    switch (command)
+    {
+      case cryptonote::NOTIFY_NEW_BLOCK::ID:
+      case cryptonote::NOTIFY_NEW_FLUFFY_BLOCK::ID:
+      case cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID:
+      case cryptonote::NOTIFY_NEW_COMPACT_BLOCK::ID:
+        return epee::net_utils::traffic_class_block_relay;
+      case COMMAND_SUPERNODE_ANNOUNCE::ID:
+      case COMMAND_SUPERNODE_ANNOUNCE_BATCH::ID:
+      case NOTIFY_SUPERNODE_ANNOUNCE::ID:
+      case COMMAND_BROADCAST::ID:
+      case COMMAND_MULTICAST::ID:
+      case COMMAND_UNICAST::ID:
+        return epee::net_utils::traffic_class_rta;
+      case cryptonote::NOTIFY_NEW_TRANSACTIONS::ID:
+        return epee::net_utils::traffic_class_tx_relay;
+      case cryptonote::NOTIFY_REQUEST_GET_OBJECTS::ID:
+      case cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::ID:
+      case cryptonote::NOTIFY_REQUEST_CHAIN::ID:
+      case cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::ID:
+        return epee::net_utils::traffic_class_sync;
+      default:
+        return epee::net_utils::traffic_class_other;
+    }
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)
   {
     int res = m_net_server.get_config_object().notify(command, req_buff, context.m_connection_id);
@@ -2352,9 +2827,9 @@ namespace nodetool
 
     //fill response
     rsp.local_time = time(NULL);
-    m_peerlist.get_peerlist_head(rsp.local_peerlist_new);
+    m_peerlist.get_peerlist_head(rsp.local_peerlist_new, P2P_DEFAULT_PEERS_IN_HANDSHAKE, arg.peerlist_since);
     m_payload_handler.get_payload_sync_data(rsp.payload_data);
-    LOG_DEBUG_CC(context, "COMMAND_TIMED_SYNC");
+    LOG_DEBUG_CC(context, "COMMAND_TIMED_SYNC, " << rsp.local_peerlist_new.size() << " peers since " << arg.peerlist_since);
     return 1;
   }
   //-----------------------------------------------------------------------------------
@@ -2409,6 +2884,7 @@ namespace nodetool
     //associate peer_id with this connection
     context.peer_id = arg.node_data.peer_id;
     context.m_in_timedsync = false;
+    register_peer_connection(context);
 
     if(arg.node_data.peer_id != m_config.m_peer_id && arg.node_data.my_port)
     {
@@ -2495,12 +2971,11 @@ namespace nodetool
         MDEBUG("P2P Request: do_supernode_announce: lock");
         boost::unique_lock<boost::recursive_mutex> guard(m_supernode_lock);
         MDEBUG("P2P Request: do_supernode_announce: lock acquired");
-        post_request_to_supernodes<cryptonote::COMMAND_RPC_SUPERNODE_ANNOUNCE>("send_supernode_announce", p2p_req);
+        post_request_to_supernodes<cryptonote::COMMAND_RPC_SUPERNODE_ANNOUNCE>("send_supernode_announce", p2p_req, std::string(), "send_supernode_announce");
     }
 
     MDEBUG("P2P Request: do_supernode_announce: prepare peerlist");
-    std::string blob;
-    epee::serialization::store_t_to_binary(p2p_req, blob);
+    epee::net_utils::shared_buffer blob = make_command_buffer(p2p_req);
     std::set<peerid_type> announced_peers;
 
 
@@ -2532,7 +3007,7 @@ namespace nodetool
         else
             LOG_ERROR("[" << c.info << "] failed to invoke COMMAND_SUPERNODE_ANNOUNCE");
     }
-    m_announce_bytes_out += blob.size() * announced_peers.size();
+    m_announce_bytes_out += blob->size() * announced_peers.size();
 
     return;
     // XXX: not clear why do we need to send to "peers" if we already sent to all the connected neighbours?
@@ -2584,7 +3059,7 @@ namespace nodetool
           LOG_PRINT_L3("P2P Request: do_broadcast: lock");
           boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
           LOG_PRINT_L3("P2P Request: do_broadcast: unlock");
-          post_request_to_supernodes<cryptonote::COMMAND_RPC_BROADCAST>("broadcast", req, req.callback_uri);
+          post_request_to_supernodes<cryptonote::COMMAND_RPC_BROADCAST>("broadcast", req, req.callback_uri, std::string(), req.binary_data);
       }
 
 #ifdef LOCK_RTA_SENDING
@@ -2596,6 +3071,7 @@ namespace nodetool
       p2p_req.callback_uri = req.callback_uri;
       p2p_req.data = req.data;
       p2p_req.wait_answer = req.wait_answer;
+      p2p_req.binary_data = req.binary_data;
       p2p_req.hop = HOP_RETRIES_MULTIPLIER * get_max_hop(get_routes());
       p2p_req.message_id = epee::string_tools::pod_to_hex(message_hash);
 
@@ -2603,9 +3079,7 @@ namespace nodetool
           MDEBUG("P2P Request: do_broadcast: lock");
           boost::lock_guard<boost::recursive_mutex> guard(m_request_cache_lock);
           MDEBUG("P2P Request: do_broadcast: unlock");
-          m_supernode_requests_cache.insert(p2p_req.message_id);
-          int timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-          m_supernode_requests_timestamps.insert(std::make_pair(timestamp, p2p_req.message_id));
+          m_supernode_requests_cache.insert(p2p_req.message_id, get_request_cache_time());
 
           MDEBUG("P2P Request: do_broadcast: clean request cache");
           remove_old_request_cache();
@@ -2613,8 +3087,7 @@ namespace nodetool
 
       MDEBUG("P2P Request: do_broadcast: prepare peerlist");
 
-      std::string blob;
-      epee::serialization::store_t_to_binary(p2p_req, blob);
+      epee::net_utils::shared_buffer blob = make_command_buffer(p2p_req);
       std::set<peerid_type> announced_peers;
 
       // send to peers
@@ -2642,7 +3115,7 @@ namespace nodetool
           else
               LOG_ERROR("[" << c.info << "] failed to invoke COMMAND_BROADCAST");
       }
-      m_broadcast_bytes_out += blob.size() * announced_peers.size();
+      m_broadcast_bytes_out += blob->size() * announced_peers.size();
 
       std::list<peerlist_entry> peerlist_white, peerlist_gray;
       m_peerlist.get_peerlist_full(peerlist_gray, peerlist_white);
@@ -2656,7 +3129,7 @@ namespace nodetool
       MDEBUG("P2P Request: do_broadcast: peers_to_send size: " << peers_to_send.size() << ", peerlist_white size: " << peerlist_white.size() << ", announced_peers size: " << announced_peers.size());
       MDEBUG("P2P Request: do_broadcast: notify_peer_list");
       notify_peer_list(COMMAND_BROADCAST::ID, blob, peers_to_send);
-      m_broadcast_bytes_out += blob.size() * peers_to_send.size();
+      m_broadcast_bytes_out += blob->size() * peers_to_send.size();
 
       MDEBUG("P2P Request: do_broadcast: End");
   }
@@ -2685,11 +3158,14 @@ namespace nodetool
           MDEBUG("P2P Request: do_multicast: lock");
           boost::unique_lock<boost::recursive_mutex> guard(m_supernode_lock);
           MDEBUG("P2P Request: do_multicast: unlock");
+          std::unordered_set<std::string> posted;
           for (auto &addr : req.receiver_addresses) {
               auto it = m_supernodes.find(addr);
               if (it != m_supernodes.end()) {
+                  if (!posted.insert(addr).second)
+                      continue;
                   MDEBUG("P2P Request: do_multicast: multicast to " << addr);
-                  post_request_to_supernode<cryptonote::COMMAND_RPC_MULTICAST>(it->second, "multicast", req, req.callback_uri);
+                  post_request_to_supernode<cryptonote::COMMAND_RPC_MULTICAST>(it->second, "multicast", req, req.callback_uri, std::string(), req.binary_data);
               }
               else {
                   remaining_addresses.push_back(addr);
@@ -2712,6 +3188,7 @@ namespace nodetool
       p2p_req.callback_uri = req.callback_uri;
       p2p_req.data = req.data;
       p2p_req.wait_answer = req.wait_answer;
+      p2p_req.binary_data = req.binary_data;
       p2p_req.hop = HOP_RETRIES_MULTIPLIER * get_max_hop(p2p_req.receiver_addresses);
       p2p_req.message_id = epee::string_tools::pod_to_hex(message_hash);
 
@@ -2719,19 +3196,15 @@ namespace nodetool
           MDEBUG("P2P Request: do_multicast: lock");
           boost::lock_guard<boost::recursive_mutex> guard(m_request_cache_lock);
           MDEBUG("P2P Request: do_multicast: unlock");
-          m_supernode_requests_cache.insert(p2p_req.message_id);
-          int timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-          m_supernode_requests_timestamps.insert(std::make_pair(timestamp, p2p_req.message_id));
+          m_supernode_requests_cache.insert(p2p_req.message_id, get_request_cache_time());
 
           MDEBUG("P2P Request: do_multicast: clean request cache");
           remove_old_request_cache();
       }
 
       MDEBUG("P2P Request: do_multicast: multicast send");
-      std::string blob;
-      epee::serialization::store_t_to_binary(p2p_req, blob);
       // stat counter updated in multicast_send
-      multicast_send(COMMAND_MULTICAST::ID, blob, p2p_req.receiver_addresses);
+      multicast_send(COMMAND_MULTICAST::ID, make_command_buffer(p2p_req), p2p_req.receiver_addresses);
       MDEBUG("P2P Request: do_multicast: End");
   }
 
@@ -2768,7 +3241,7 @@ namespace nodetool
           auto it = m_supernodes.find(addr);
           if (it != m_supernodes.end()) {
               LOG_PRINT_L2("P2P Request: do_unicast: unicast to local supernode " << addr);
-              post_request_to_supernode<cryptonote::COMMAND_RPC_UNICAST>(it->second, "unicast", req, req.callback_uri);
+              post_request_to_supernode<cryptonote::COMMAND_RPC_UNICAST>(it->second, "unicast", req, req.callback_uri, std::string(), req.binary_data);
               LOG_PRINT_L2("P2P request: do_unicast: End (unicast recipient was local)");
               return;
           }
@@ -2780,6 +3253,7 @@ namespace nodetool
       p2p_req.callback_uri = req.callback_uri;
       p2p_req.data = req.data;
       p2p_req.wait_answer = req.wait_answer;
+      p2p_req.binary_data = req.binary_data;
       p2p_req.hop = HOP_RETRIES_MULTIPLIER * get_max_hop(addresses);
       p2p_req.message_id = epee::string_tools::pod_to_hex(message_hash);
 
@@ -2787,21 +3261,96 @@ namespace nodetool
           MDEBUG("P2P Request: do_unicast: lock");
           boost::lock_guard<boost::recursive_mutex> guard(m_request_cache_lock);
           MDEBUG("P2P Request: do_unicast: unlock");
-          m_supernode_requests_cache.insert(p2p_req.message_id);
-          int timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-          m_supernode_requests_timestamps.insert(std::make_pair(timestamp, p2p_req.message_id));
+          m_supernode_requests_cache.insert(p2p_req.message_id, get_request_cache_time());
 
           MDEBUG("P2P Request: do_unicast: clean request cache");
           remove_old_request_cache();
       }
 
       MDEBUG("P2P Request: do_unicast: unicast send");
-      std::string blob;
-      epee::serialization::store_t_to_binary(p2p_req, blob);
-      multicast_send(COMMAND_UNICAST::ID, blob, addresses);
+      multicast_send(COMMAND_UNICAST::ID, make_command_buffer(p2p_req), addresses, std::list<peerid_type>(), MAX_UNICAST_TUNNEL_PEERS);
       MDEBUG("P2P Request: do_unicast: End");
   }
 
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  std::string node_server<t_payload_net_handler>::get_metrics()
+  {
+      std::ostringstream out;
+
+      out << "# HELP graft_p2p_connections Number of p2p connections\n";
+      out << "# TYPE graft_p2p_connections gauge\n";
+      out << "graft_p2p_connections " << get_connections_count() << '\n';
+
+      out << "# HELP graft_rta_bytes_total RTA traffic by message type\n";
+      out << "# TYPE graft_rta_bytes_total counter\n";
+      out << "graft_rta_bytes_total{type=\"announce\",direction=\"in\"} " << m_announce_bytes_in << '\n';
+      out << "graft_rta_bytes_total{type=\"announce\",direction=\"out\"} " << m_announce_bytes_out << '\n';
+      out << "graft_rta_bytes_total{type=\"broadcast\",direction=\"in\"} " << m_broadcast_bytes_in << '\n';
+      out << "graft_rta_bytes_total{type=\"broadcast\",direction=\"out\"} " << m_broadcast_bytes_out << '\n';
+      out << "graft_rta_bytes_total{type=\"multicast\",direction=\"in\"} " << m_multicast_bytes_in << '\n';
+      out << "graft_rta_bytes_total{type=\"multicast\",direction=\"out\"} " << m_multicast_bytes_out << '\n';
+
+      {
+          boost::lock_guard<boost::recursive_mutex> guard(m_request_cache_lock);
+          out << "# HELP graft_rta_request_cache_size Number of message ids in the request cache\n";
+          out << "# TYPE graft_rta_request_cache_size gauge\n";
+          out << "graft_rta_request_cache_size " << m_supernode_requests_cache.size() << '\n';
+      }
+
+      m_metrics.write(out);
+
+      {
+          static const char *class_names[] = { "block_relay", "rta", "tx_relay", "sync", "other" };
+          static_assert(sizeof(class_names) / sizeof(class_names[0]) == epee::net_utils::traffic_class_count, "traffic class names out of date");
+          const auto scheduler_stats = epee::net_utils::network_scheduler::get_out().get_stats();
+          out << "# HELP graft_p2p_upload_bytes_total Bytes granted for upload by traffic class\n";
+          out << "# TYPE graft_p2p_upload_bytes_total counter\n";
+          for (size_t i = 0; i < scheduler_stats.size(); ++i)
+              out << "graft_p2p_upload_bytes_total{class=\"" << class_names[i] << "\"} " << scheduler_stats[i].bytes << '\n';
+          out << "# HELP graft_p2p_upload_borrowed_bytes_total Bytes sent over the class share from unused bandwidth\n";
+          out << "# TYPE graft_p2p_upload_borrowed_bytes_total counter\n";
+          for (size_t i = 0; i < scheduler_stats.size(); ++i)
+              out << "graft_p2p_upload_borrowed_bytes_total{class=\"" << class_names[i] << "\"} " << scheduler_stats[i].borrowed_bytes << '\n';
+          out << "# HELP graft_p2p_upload_delayed_total Writes held back by the upload limit\n";
+          out << "# TYPE graft_p2p_upload_delayed_total counter\n";
+          for (size_t i = 0; i < scheduler_stats.size(); ++i)
+              out << "graft_p2p_upload_delayed_total{class=\"" << class_names[i] << "\"} " << scheduler_stats[i].delayed << '\n';
+          out << "# HELP graft_p2p_upload_wait_seconds_total Time writes spent held back by the upload limit\n";
+          out << "# TYPE graft_p2p_upload_wait_seconds_total counter\n";
+          for (size_t i = 0; i < scheduler_stats.size(); ++i)
+              out << "graft_p2p_upload_wait_seconds_total{class=\"" << class_names[i] << "\"} " << scheduler_stats[i].wait_us / 1e6 << '\n';
+          out << "# HELP graft_p2p_upload_waiting Writes currently held back by the upload limit\n";
+          out << "# TYPE graft_p2p_upload_waiting gauge\n";
+          for (size_t i = 0; i < scheduler_stats.size(); ++i)
+              out << "graft_p2p_upload_waiting{class=\"" << class_names[i] << "\"} " << scheduler_stats[i].waiting << '\n';
+      }
+
+      boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+
+      out << "# HELP graft_supernode_queue_size Requests waiting for delivery to local supernode\n";
+      out << "# TYPE graft_supernode_queue_size gauge\n";
+      for (const auto &sn : m_supernodes)
+          out << "graft_supernode_queue_size{supernode=\"" << sn.first << "\"} " << sn.second.get_queue_size() << '\n';
+
+      out << "# HELP graft_supernode_dropped_requests_total Requests dropped because of local supernode queue overflow\n";
+      out << "# TYPE graft_supernode_dropped_requests_total counter\n";
+      for (const auto &sn : m_supernodes)
+          out << "graft_supernode_dropped_requests_total{supernode=\"" << sn.first << "\"} " << sn.second.get_dropped_requests_count() << '\n';
+
+      out << "# HELP graft_supernode_failed_requests_total Requests not accepted by local supernode\n";
+      out << "# TYPE graft_supernode_failed_requests_total counter\n";
+      for (const auto &sn : m_supernodes)
+          out << "graft_supernode_failed_requests_total{supernode=\"" << sn.first << "\"} " << sn.second.get_failed_requests_count() << '\n';
+
+      out << "# HELP graft_supernode_delivery_seconds Time to deliver request to local supernode\n";
+      out << "# TYPE graft_supernode_delivery_seconds histogram\n";
+      for (const auto &sn : m_supernodes)
+          sn.second.get_delivery_time().write(out, "graft_supernode_delivery_seconds", "supernode=\"" + sn.first + "\"");
+
+      return out.str();
+  }
+
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   std::vector<cryptonote::route_data> node_server<t_payload_net_handler>::get_tunnels() const
@@ -2864,6 +3413,8 @@ namespace nodetool
       m_peerlist.remove_from_peer_anchor(na);
     }
 
+    unregister_peer_connection(context);
+
     m_payload_handler.on_connection_close(context);
 
     MINFO("["<< epee::net_utils::print_connection_context(context) << "] CLOSE CONNECTION");
@@ -3163,10 +3714,29 @@ namespace nodetool
     }
   }
 
+  template<class t_payload_net_handler>
+  const std::string& node_server<t_payload_net_handler>::get_supernode_address_str(const std::string& supernode_public_id, const cryptonote::account_public_address& address)
+  {
+    typename supernode_address_string_map::iterator it = m_supernode_address_strings.find(supernode_public_id);
+
+    if (it == m_supernode_address_strings.end())
+    {
+      it = m_supernode_address_strings.emplace(supernode_public_id, std::make_pair(address, cryptonote::get_account_address_as_str(m_nettype, false, address))).first;
+    }
+    else if (!(it->second.first == address))
+    {
+      it->second.first  = address;
+      it->second.second = cryptonote::get_account_address_as_str(m_nettype, false, address);
+    }
+
+    return it->second.second;
+  }
+
   template<class t_payload_net_handler>
   void node_server<t_payload_net_handler>::handle_stakes_update(uint64_t block_height, const cryptonote::StakeTransactionProcessor::supernode_stake_array& stakes)
   {
     static std::string supernode_endpoint("send_supernode_stakes");
+    static std::string supernode_delta_endpoint("send_supernode_stakes_delta");
 
     boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
 
@@ -3175,32 +3745,192 @@ namespace nodetool
 
     MDEBUG("handle_stakes_update to supernode for block #" << block_height);
 
-    cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request request;
+      //compute changes since the previous update
+
+    cryptonote::COMMAND_RPC_SUPERNODE_STAKES_DELTA::request delta_request;
+
+    delta_request.block_height      = block_height;
+    delta_request.base_block_height = m_sent_stakes_block_height;
 
-    request.block_height = block_height;
+    sent_supernode_stake_map sent_stakes;
 
-    request.stakes.reserve(stakes.size());
+    sent_stakes.reserve(stakes.size());
 
     for (const cryptonote::supernode_stake& src_stake : stakes)
     {
-      cryptonote::COMMAND_RPC_SUPERNODE_STAKES::supernode_stake dst_stake;
+      typename sent_supernode_stake_map::iterator prev_it = m_sent_stakes.find(src_stake.supernode_public_id);
+
+      if (prev_it != m_sent_stakes.end())
+      {
+        const cryptonote::supernode_stake& prev_stake = prev_it->second.stake;
+
+        if (prev_stake.amount == src_stake.amount && prev_stake.tier == src_stake.tier && prev_stake.block_height == src_stake.block_height &&
+            prev_stake.unlock_time == src_stake.unlock_time && prev_stake.supernode_public_address == src_stake.supernode_public_address)
+        {
+          sent_stakes.emplace(src_stake.supernode_public_id, std::move(prev_it->second));
+          continue;
+        }
+      }
+
+      sent_supernode_stake& dst = sent_stakes[src_stake.supernode_public_id];
+
+      dst.stake = src_stake;
+
+      cryptonote::COMMAND_RPC_SUPERNODE_STAKES::supernode_stake& dst_stake = dst.rpc_stake;
 
       dst_stake.amount = src_stake.amount;
       dst_stake.tier = src_stake.tier;
       dst_stake.block_height = src_stake.block_height;
       dst_stake.unlock_time = src_stake.unlock_time;
       dst_stake.supernode_public_id = src_stake.supernode_public_id;
-      dst_stake.supernode_public_address = cryptonote::get_account_address_as_str(m_nettype, false, src_stake.supernode_public_address);
+      dst_stake.supernode_public_address = get_supernode_address_str(src_stake.supernode_public_id, src_stake.supernode_public_address);
+
+      delta_request.stakes.push_back(dst_stake);
+    }
+
+    for (const typename sent_supernode_stake_map::value_type& prev_stake : m_sent_stakes)
+    {
+      if (sent_stakes.find(prev_stake.first) != sent_stakes.end())
+        continue;
 
-      request.stakes.emplace_back(std::move(dst_stake));
+      delta_request.removed_supernode_public_ids.push_back(prev_stake.first);
+      m_supernode_address_strings.erase(prev_stake.first);
     }
 
-    post_request_to_supernodes<cryptonote::COMMAND_RPC_SUPERNODE_STAKES>(supernode_endpoint, request);
+      //send delta to supernodes which have received the previous update, full list to others;
+      //the choice is made at delivery time because older pending updates may be replaced by this one
+
+    bool is_resend = block_height == m_sent_stakes_block_height;
+    uint64_t base_block_height = m_sent_stakes_block_height;
+
+    std::shared_ptr<cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request> request = std::make_shared<cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request>();
+
+    request->block_height = block_height;
+
+    request->stakes.reserve(stakes.size());
+
+    for (const cryptonote::supernode_stake& src_stake : stakes)
+      request->stakes.push_back(sent_stakes[src_stake.supernode_public_id].rpc_stake);
+
+    std::string uri = make_supernode_request_uri(supernode_endpoint, std::string()),
+                delta_uri = make_supernode_request_uri(supernode_delta_endpoint, std::string());
+    std::shared_ptr<const std::string> delta_body = make_supernode_request_body<cryptonote::COMMAND_RPC_SUPERNODE_STAKES_DELTA>(supernode_delta_endpoint, delta_request);
+
+    auto delivery = [=](local_supernode &sn) {
+      bool delivered = false;
+      bool can_use_delta = !is_resend && sn.delta_updates_supported && sn.stakes_block_height && sn.stakes_block_height == base_block_height;
+
+      if (can_use_delta)
+        delivered = sn.post(delta_uri, *delta_body);
+
+      if (!delivered)
+      {
+        delivered = sn.post(uri, *make_supernode_request_body<cryptonote::COMMAND_RPC_SUPERNODE_STAKES>(supernode_endpoint, *request));
+
+        if (delivered && can_use_delta)
+          sn.delta_updates_supported = false; //supernode accepts full lists only
+      }
+
+      sn.stakes_block_height = delivered ? block_height : 0;
+
+      return delivered;
+    };
+
+    for (auto &supernode : m_supernodes)
+      supernode.second.enqueue(delivery, "stakes");
+
+    if (!is_resend && base_block_height)
+      add_to_update_journal(m_stakes_journal, base_block_height, block_height, delta_body);
+
+    m_sent_stakes.swap(sent_stakes);
+    m_sent_stakes_block_height = block_height;
+    m_sent_stakes_request = request;
+  }
+
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::add_to_update_journal(update_journal& journal, uint64_t base_block_height, uint64_t block_height, const std::shared_ptr<const std::string>& body)
+  {
+    if (!journal.empty() && journal.back().block_height != base_block_height)
+      journal.clear(); //a gap (resend of older heights), older deltas can't be chained with the new ones
+
+    journal.push_back(journaled_update{base_block_height, block_height, body});
+
+    while (journal.size() > UPDATE_JOURNAL_MAX_SIZE)
+      journal.pop_front();
+  }
+
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::get_journaled_updates(const update_journal& journal, uint64_t from_block_height, uint64_t to_block_height, std::vector<std::shared_ptr<const std::string>>& bodies)
+  {
+    bodies.clear();
+
+    if (!from_block_height || from_block_height > to_block_height)
+      return false;
+
+    if (from_block_height == to_block_height)
+      return true;
+
+    typename update_journal::const_iterator it = std::find_if(journal.begin(), journal.end(), [&](const journaled_update& update) {
+      return update.base_block_height == from_block_height;
+    });
+
+    if (it == journal.end() || journal.back().block_height != to_block_height)
+      return false;
+
+    for (; it != journal.end(); ++it)
+      bodies.push_back(it->body);
+
+    return true;
   }
 
   template<class t_payload_net_handler>
-  void node_server<t_payload_net_handler>::send_stakes_to_supernode()
+  void node_server<t_payload_net_handler>::send_stakes_to_supernode(const std::string& supernode_public_id, uint64_t last_received_block_height)
   {
+    static std::string supernode_endpoint("send_supernode_stakes");
+    static std::string supernode_delta_endpoint("send_supernode_stakes_delta");
+
+    {
+      boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+
+      typename std::unordered_map<std::string, local_supernode>::iterator sn_it = m_supernodes.find(supernode_public_id);
+
+      if (sn_it != m_supernodes.end() && m_sent_stakes_request)
+      {
+          //resume from the supernode's last received stakes if the missed deltas are journaled, otherwise send the last stakes in full
+
+        std::vector<std::shared_ptr<const std::string>> bodies;
+        bool resume = get_journaled_updates(m_stakes_journal, last_received_block_height, m_sent_stakes_block_height, bodies);
+        std::shared_ptr<const cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request> request = m_sent_stakes_request;
+        uint64_t block_height = m_sent_stakes_block_height;
+        std::string uri = make_supernode_request_uri(supernode_endpoint, std::string()),
+                    delta_uri = make_supernode_request_uri(supernode_delta_endpoint, std::string());
+
+        MDEBUG("send_stakes_to_supernode " << supernode_public_id << " from block #" << last_received_block_height << " to #" << block_height
+          << (resume ? ", deltas: " + std::to_string(bodies.size()) : std::string(", full list")));
+
+        auto delivery = [=](local_supernode &sn) {
+          bool delivered = resume && (bodies.empty() || sn.delta_updates_supported);
+
+          for (size_t i=0; delivered && i<bodies.size(); i++)
+            delivered = sn.post(delta_uri, *bodies[i]);
+
+          if (!delivered)
+            delivered = sn.post(uri, *make_supernode_request_body<cryptonote::COMMAND_RPC_SUPERNODE_STAKES>(supernode_endpoint, *request));
+
+          sn.stakes_block_height = delivered ? block_height : 0;
+
+          return delivered;
+        };
+
+        sn_it->second.stakes_block_height = resume ? last_received_block_height : 0;
+        sn_it->second.enqueue(delivery, "stakes");
+        return;
+      }
+
+      if (sn_it != m_supernodes.end())
+        sn_it->second.stakes_block_height = 0; //nothing has been sent yet, the list is built by the core
+    }
+
     m_payload_handler.get_core().invoke_update_stakes_handler();
   }
 
@@ -3208,6 +3938,7 @@ namespace nodetool
   void node_server<t_payload_net_handler>::handle_blockchain_based_list_update(uint64_t block_height, const cryptonote::StakeTransactionProcessor::supernode_tier_array& tiers)
   {
     static std::string supernode_endpoint("blockchain_based_list");
+    static std::string supernode_delta_endpoint("blockchain_based_list_delta");
 
     boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
 
@@ -3216,37 +3947,143 @@ namespace nodetool
 
     MDEBUG("handle_blockchain_based_list_update to supernode for block #" << block_height);
 
-    cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::request request;
+      //compute the list relative to the previous one (only for the next block; history is resent in full)
 
-    request.block_height = block_height;
+    bool has_base = m_sent_tiers_block_height && block_height == m_sent_tiers_block_height + 1;
+
+    cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::request       request;
+    cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST_DELTA::request delta_request;
+    sent_tier_supernode_map                                                sent_tier_supernodes;
+
+    request.block_height            = block_height;
+    delta_request.block_height      = block_height;
+    delta_request.base_block_height = m_sent_tiers_block_height;
 
     for (size_t i=0; i<tiers.size(); i++)
     {
       const cryptonote::StakeTransactionProcessor::supernode_tier_array::value_type& src_tier = tiers[i];
       cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::tier                  dst_tier;
+      cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST_DELTA::tier            dst_delta_tier;
 
       dst_tier.supernodes.reserve(src_tier.size());
+      dst_delta_tier.supernode_public_ids.reserve(src_tier.size());
 
       for (const cryptonote::BlockchainBasedList::supernode& src_supernode : src_tier)
       {
         cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::supernode dst_supernode;
 
         dst_supernode.supernode_public_id      = src_supernode.supernode_public_id;
-        dst_supernode.supernode_public_address = cryptonote::get_account_address_as_str(m_nettype, false, src_supernode.supernode_public_address);
+        dst_supernode.supernode_public_address = get_supernode_address_str(src_supernode.supernode_public_id, src_supernode.supernode_public_address);
         dst_supernode.amount                   = src_supernode.amount;
 
+        dst_delta_tier.supernode_public_ids.push_back(src_supernode.supernode_public_id);
+
+        typename sent_tier_supernode_map::const_iterator prev_it = m_sent_tier_supernodes.find(src_supernode.supernode_public_id);
+
+        if (!has_base || prev_it == m_sent_tier_supernodes.end() || prev_it->second.amount != dst_supernode.amount ||
+            prev_it->second.supernode_public_address != dst_supernode.supernode_public_address)
+          dst_delta_tier.supernodes.push_back(dst_supernode);
+
+        sent_tier_supernodes[src_supernode.supernode_public_id] = dst_supernode;
+
         dst_tier.supernodes.emplace_back(std::move(dst_supernode));
       }
 
       request.tiers.emplace_back(std::move(dst_tier));
+      delta_request.tiers.emplace_back(std::move(dst_delta_tier));
     }
 
-    post_request_to_supernodes<cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST>(supernode_endpoint, request);
+      //send delta to supernodes which have received the previous list, full list to others
+
+    uint64_t base_block_height = m_sent_tiers_block_height;
+
+    std::string uri = make_supernode_request_uri(supernode_endpoint, std::string()),
+                delta_uri = make_supernode_request_uri(supernode_delta_endpoint, std::string());
+    std::shared_ptr<const std::string> body = make_supernode_request_body<cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST>(supernode_endpoint, request);
+    std::shared_ptr<const std::string> delta_body;
+
+    if (has_base)
+      delta_body = make_supernode_request_body<cryptonote::COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST_DELTA>(supernode_delta_endpoint, delta_request);
+
+    auto delivery = [=](local_supernode &sn) {
+      bool delivered = false;
+      bool can_use_delta = delta_body && sn.delta_updates_supported && sn.blockchain_based_list_block_height == base_block_height;
+
+      if (can_use_delta)
+        delivered = sn.post(delta_uri, *delta_body);
+
+      if (!delivered)
+      {
+        delivered = sn.post(uri, *body);
+
+        if (delivered && can_use_delta)
+          sn.delta_updates_supported = false; //supernode accepts full lists only
+      }
+
+      sn.blockchain_based_list_block_height = delivered ? block_height : 0;
+
+      return delivered;
+    };
+
+    for (auto &supernode : m_supernodes)
+      supernode.second.enqueue(delivery, "blockchain_based_list:" + std::to_string(block_height));
+
+    if (delta_body)
+      add_to_update_journal(m_tiers_journal, base_block_height, block_height, delta_body);
+
+    m_sent_tier_supernodes.swap(sent_tier_supernodes);
+    m_sent_tiers_block_height = block_height;
+    m_sent_tiers_body = body;
   }
 
   template<class t_payload_net_handler>
-  void node_server<t_payload_net_handler>::send_blockchain_based_list_to_supernode(uint64_t last_received_block_height)
+  void node_server<t_payload_net_handler>::send_blockchain_based_list_to_supernode(const std::string& supernode_public_id, uint64_t last_received_block_height)
   {
+    static std::string supernode_endpoint("blockchain_based_list");
+    static std::string supernode_delta_endpoint("blockchain_based_list_delta");
+
+    {
+      boost::lock_guard<boost::recursive_mutex> guard(m_supernode_lock);
+
+      typename std::unordered_map<std::string, local_supernode>::iterator sn_it = m_supernodes.find(supernode_public_id);
+      std::vector<std::shared_ptr<const std::string>> bodies;
+
+      if (sn_it != m_supernodes.end() && m_sent_tiers_body &&
+          get_journaled_updates(m_tiers_journal, last_received_block_height, m_sent_tiers_block_height, bodies))
+      {
+          //the missed lists are journaled as deltas, each one brings the supernode to the next block
+
+        std::shared_ptr<const std::string> body = m_sent_tiers_body;
+        uint64_t block_height = m_sent_tiers_block_height;
+        std::string uri = make_supernode_request_uri(supernode_endpoint, std::string()),
+                    delta_uri = make_supernode_request_uri(supernode_delta_endpoint, std::string());
+
+        MDEBUG("send_blockchain_based_list_to_supernode " << supernode_public_id << " from block #" << last_received_block_height
+          << " to #" << block_height << ", deltas: " << bodies.size());
+
+        auto delivery = [=](local_supernode &sn) {
+          bool delivered = bodies.empty() || sn.delta_updates_supported;
+
+          for (size_t i=0; delivered && i<bodies.size(); i++)
+            delivered = sn.post(delta_uri, *bodies[i]);
+
+          if (!delivered)
+            delivered = sn.post(uri, *body);
+
+          sn.blockchain_based_list_block_height = delivered ? block_height : 0;
+
+          return delivered;
+        };
+
+        sn_it->second.blockchain_based_list_block_height = last_received_block_height;
+        sn_it->second.enqueue(delivery, "blockchain_based_list:resume");
+        return;
+      }
+
+      if (sn_it != m_supernodes.end())
+        sn_it->second.blockchain_based_list_block_height = 0; //the history after last_received_block_height is sent in full
+    }
+
     m_payload_handler.get_core().invoke_update_blockchain_based_list_handler(last_received_block_height);
   }
 }
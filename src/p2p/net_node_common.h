@@ -56,6 +56,8 @@ namespace nodetool
     virtual bool unblock_host(const epee::net_utils::network_address &address)=0;
     virtual std::map<std::string, time_t> get_blocked_hosts()=0;
     virtual bool add_host_fail(const epee::net_utils::network_address &address)=0;
+    virtual void add_peer_throughput(const epee::net_utils::connection_context_base& context, uint64_t bytes_per_second)=0;
+    virtual void add_peer_block_delay(const epee::net_utils::connection_context_base& context, uint32_t delay_ms)=0;
   };
 
   template<class t_connection_context>
@@ -114,5 +116,11 @@ namespace nodetool
     {
       return true;
     }
+    virtual void add_peer_throughput(const epee::net_utils::connection_context_base& context, uint64_t bytes_per_second)
+    {
+    }
+    virtual void add_peer_block_delay(const epee::net_utils::connection_context_base& context, uint32_t delay_ms)
+    {
+    }
   };
 }
@@ -33,6 +33,8 @@
 #include <list>
 #include <set>
 #include <map>
+#include <limits>
+#include <vector>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/portable_binary_oarchive.hpp>
 #include <boost/archive/portable_binary_iarchive.hpp>
@@ -52,7 +54,7 @@
 #include "net_peerlist_boost_serialization.h"
 
 
-#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    6
+#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    7
 
 namespace nodetool
 {
@@ -69,7 +71,7 @@ namespace nodetool
     size_t get_white_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_white.size();}
     size_t get_gray_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_gray.size();}
     bool merge_peerlist(const std::list<peerlist_entry>& outer_bs);
-    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE);
+    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE, uint64_t since = 0);
     bool get_peerlist_full(std::list<peerlist_entry>& pl_gray, std::list<peerlist_entry>& pl_white);
     bool get_white_peer_by_index(peerlist_entry& p, size_t i);
     bool get_gray_peer_by_index(peerlist_entry& p, size_t i);
@@ -84,6 +86,11 @@ namespace nodetool
     bool get_and_empty_anchor_peerlist(std::vector<anchor_peerlist_entry>& apl);
     bool remove_from_peer_anchor(const epee::net_utils::network_address& addr);
     bool find_peer(peerid_type id, peerlist_entry& pe);
+    bool add_peer_rtt(const epee::net_utils::network_address& addr, uint32_t rtt_ms);
+    bool add_peer_throughput(const epee::net_utils::network_address& addr, uint64_t bytes_per_second);
+    bool add_peer_block_delay(const epee::net_utils::network_address& addr, uint32_t delay_ms);
+    bool get_peer_quality(const epee::net_utils::network_address& addr, peer_quality& pq);
+    bool get_white_peers_with_quality(std::vector<std::pair<peerlist_entry, peer_quality>>& peers);
     
   private:
     struct by_time{};
@@ -182,6 +189,37 @@ namespace nodetool
       }
     }
 
+    template <class Archive, class t_version_type>
+    void serialize_quality(Archive &a, const t_version_type ver)
+    {
+      if (typename Archive::is_saving())
+      {
+        uint64_t size = m_peers_quality.size();
+        a & size;
+        for (const auto& p: m_peers_quality)
+        {
+          epee::net_utils::network_address adr = p.first;
+          peer_quality pq = p.second;
+          a & adr;
+          a & pq;
+        }
+      }
+      else
+      {
+        uint64_t size;
+        a & size;
+        m_peers_quality.clear();
+        while (size--)
+        {
+          epee::net_utils::network_address adr;
+          peer_quality pq;
+          a & adr;
+          a & pq;
+          m_peers_quality[adr] = pq;
+        }
+      }
+    }
+
     template <class Archive, class t_version_type>
     void serialize(Archive &a,  const t_version_type ver)
     {
@@ -201,12 +239,16 @@ namespace nodetool
       serialize_peers(a, m_peers_gray, peerlist_entry(), ver);
       serialize_peers(a, m_peers_anchor, anchor_peerlist_entry(), ver);
 #endif
+      // peer quality was added at v7
+      if (ver >= 7)
+        serialize_quality(a, ver);
     }
 
   private: 
     bool peers_indexed_from_old(const peers_indexed_old& pio, peers_indexed& pi);
     void trim_white_peerlist();
     void trim_gray_peerlist();
+    peer_quality* get_quality_for_update(const epee::net_utils::network_address& addr);
 
     friend class boost::serialization::access;
     epee::critical_section m_peerlist_lock;
@@ -217,6 +259,7 @@ namespace nodetool
     peers_indexed m_peers_gray;
     peers_indexed m_peers_white;
     anchor_peers_indexed m_peers_anchor;
+    std::map<epee::net_utils::network_address, peer_quality> m_peers_quality; // of white peers only
   };
   //--------------------------------------------------------------------------------------------------
   inline
@@ -261,6 +304,7 @@ namespace nodetool
     while(m_peers_white.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT)
     {
       peers_indexed::index<by_time>::type& sorted_index=m_peers_white.get<by_time>();
+      m_peers_quality.erase(sorted_index.begin()->adr);
       sorted_index.erase(sorted_index.begin());
     }
   }
@@ -269,11 +313,22 @@ namespace nodetool
   bool peerlist_manager::merge_peerlist(const std::list<peerlist_entry>& outer_bs)
   {
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    auto& white_by_addr = m_peers_white.get<by_addr>();
+    auto& gray_by_addr = m_peers_gray.get<by_addr>();
     for(const peerlist_entry& be:  outer_bs)
     {
-      append_with_peer_gray(be);
+      if(!is_host_allowed(be.adr))
+        continue;
+      if(white_by_addr.find(be.adr) != white_by_addr.end())
+        continue;
+
+      auto it = gray_by_addr.find(be.adr);
+      if(it == gray_by_addr.end())
+        m_peers_gray.insert(be);
+      else if(it->last_seen < be.last_seen || it->id != be.id)
+        gray_by_addr.replace(it, be); // only touch the time index when the entry changed
     }
-    // delete extra elements
+    // delete extra elements once for the whole list
     trim_gray_peerlist();    
     return true;
   }
@@ -316,7 +371,7 @@ namespace nodetool
   }
   //--------------------------------------------------------------------------------------------------
   inline 
-  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth)
+  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth, uint64_t since)
   {
     
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
@@ -324,6 +379,10 @@ namespace nodetool
     uint32_t cnt = 0;
     for(const peers_indexed::value_type& vl: boost::adaptors::reverse(by_time_index))
     {
+      // newest first, so everything past the first entry older than since was already sent
+      if(since && vl.last_seen < static_cast<int64_t>(since))
+        break;
+
       if(!vl.last_seen)
         continue;
 
@@ -550,6 +609,92 @@ namespace nodetool
     CATCH_ENTRY_L0("peerlist_manager::remove_from_peer_anchor()", false);
   }
   //--------------------------------------------------------------------------------------------------
+  inline
+  peer_quality* peerlist_manager::get_quality_for_update(const epee::net_utils::network_address& addr)
+  {
+    // samples of peers we don't know as reachable, such as incoming ones, would never be used
+    if (m_peers_white.get<by_addr>().find(addr) == m_peers_white.get<by_addr>().end())
+      return nullptr;
+    peer_quality& pq = m_peers_quality[addr];
+    pq.last_update = time(nullptr);
+    return &pq;
+  }
+  //--------------------------------------------------------------------------------------------------
+  template<typename T>
+  inline void add_peer_quality_sample(T& average, uint32_t& samples, T value)
+  {
+    // moving average giving the new sample a quarter, so that a peer getting slower shows soon
+    average = samples ? (average * 3 + value) / 4 : value;
+    if (samples < std::numeric_limits<uint32_t>::max())
+      ++samples;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::add_peer_rtt(const epee::net_utils::network_address& addr, uint32_t rtt_ms)
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality* pq = get_quality_for_update(addr);
+    if (!pq)
+      return false;
+    add_peer_quality_sample(pq->rtt_ms, pq->rtt_samples, rtt_ms);
+    return true;
+    CATCH_ENTRY_L0("peerlist_manager::add_peer_rtt()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::add_peer_throughput(const epee::net_utils::network_address& addr, uint64_t bytes_per_second)
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality* pq = get_quality_for_update(addr);
+    if (!pq)
+      return false;
+    add_peer_quality_sample(pq->throughput, pq->throughput_samples, bytes_per_second);
+    return true;
+    CATCH_ENTRY_L0("peerlist_manager::add_peer_throughput()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::add_peer_block_delay(const epee::net_utils::network_address& addr, uint32_t delay_ms)
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peer_quality* pq = get_quality_for_update(addr);
+    if (!pq)
+      return false;
+    add_peer_quality_sample(pq->block_delay_ms, pq->block_delay_samples, delay_ms);
+    return true;
+    CATCH_ENTRY_L0("peerlist_manager::add_peer_block_delay()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::get_peer_quality(const epee::net_utils::network_address& addr, peer_quality& pq)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    auto it = m_peers_quality.find(addr);
+    if (it == m_peers_quality.end())
+      return false;
+    pq = it->second;
+    return true;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::get_white_peers_with_quality(std::vector<std::pair<peerlist_entry, peer_quality>>& peers)
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    peers.clear();
+    peers.reserve(m_peers_white.size());
+    for (const peerlist_entry& pe: boost::adaptors::reverse(m_peers_white.get<by_time>()))
+    {
+      auto it = m_peers_quality.find(pe.adr);
+      peers.emplace_back(pe, it == m_peers_quality.end() ? peer_quality() : it->second);
+    }
+    return true;
+    CATCH_ENTRY_L0("peerlist_manager::get_white_peers_with_quality()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
 }
 
 BOOST_CLASS_VERSION(nodetool::peerlist_manager, CURRENT_PEERLIST_STORAGE_ARCHIVE_VER)
@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
 #include "net/net_utils_base.h"
 #include "p2p/p2p_protocol_defs.h"
 
@@ -86,5 +88,28 @@ namespace boost
       a & pl.id;
       a & pl.first_seen;
     }
+
+    template <class Archive, class ver_type>
+    inline void serialize(Archive &a, nodetool::peer_quality& pq, const ver_type ver)
+    {
+      a & pq.rtt_ms;
+      a & pq.rtt_samples;
+      a & pq.throughput;
+      a & pq.throughput_samples;
+      a & pq.block_delay_ms;
+      a & pq.block_delay_samples;
+      a & pq.last_update;
+    }
+
+    template <class Archive, class ver_type>
+    inline void serialize(Archive &a, nodetool::supernode_route& route, const ver_type ver)
+    {
+      a & reinterpret_cast<char (&)[sizeof(crypto::public_key)]>(route.addr);
+      a & route.last_announce_height;
+      a & route.last_announce_time;
+      a & route.max_hop;
+      a & route.peers;
+      a & route.peer_hops;
+    }
   }
 }
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "p2p_metrics.h"
+
+using namespace nodetool;
+
+namespace
+{
+
+void write_seconds(std::ostream &out, uint64_t micros)
+{
+  out << micros / 1000000 << '.' << std::setw(6) << std::setfill('0') << micros % 1000000 << std::setfill(' ');
+}
+
+void write_name(std::ostream &out, const std::string &name, const char *suffix, const std::string &labels)
+{
+  out << name << suffix;
+
+  if (!labels.empty())
+    out << '{' << labels << '}';
+
+  out << ' ';
+}
+
+}
+
+constexpr size_t latency_histogram::BUCKETS_COUNT;
+const std::array<uint64_t, latency_histogram::BUCKETS_COUNT> latency_histogram::BUCKET_BOUNDS_MICROS = {{
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000, 500000, 1000000, 5000000
+}};
+
+latency_histogram::latency_histogram()
+  : m_sum_micros(0)
+  , m_count(0)
+{
+  for (auto& bucket : m_buckets)
+    bucket = 0;
+}
+
+void latency_histogram::observe(uint64_t micros)
+{
+  size_t bucket = std::lower_bound(BUCKET_BOUNDS_MICROS.begin(), BUCKET_BOUNDS_MICROS.end(), micros) - BUCKET_BOUNDS_MICROS.begin();
+
+  m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_sum_micros.fetch_add(micros, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void latency_histogram::write(std::ostream &out, const std::string &name, const std::string &labels) const
+{
+  std::string bucket_labels = labels.empty() ? std::string() : labels + ",";
+  uint64_t cumulative_count = 0;
+
+  for (size_t i=0; i<=BUCKETS_COUNT; i++)
+  {
+    cumulative_count += m_buckets[i].load(std::memory_order_relaxed);
+
+    out << name << "_bucket{" << bucket_labels << "le=\"";
+
+    if (i < BUCKETS_COUNT)
+      write_seconds(out, BUCKET_BOUNDS_MICROS[i]);
+    else
+      out << "+Inf";
+
+    out << "\"} " << cumulative_count << '\n';
+  }
+
+  write_name(out, name, "_sum", labels);
+  write_seconds(out, m_sum_micros.load(std::memory_order_relaxed));
+  out << '\n';
+
+  write_name(out, name, "_count", labels);
+  out << cumulative_count << '\n';
+}
+
+constexpr int p2p_metrics::COMMANDS_POOL_SIZE;
+constexpr int p2p_metrics::COMMANDS_POOLS_COUNT;
+constexpr size_t p2p_metrics::SLOTS_COUNT;
+
+size_t p2p_metrics::get_slot(int command)
+{
+  int pool = command / 1000 - 1, index = command % 1000;
+
+  if (pool < 0 || pool >= COMMANDS_POOLS_COUNT || index >= COMMANDS_POOL_SIZE)
+    return SLOTS_COUNT - 1;
+
+  return pool * COMMANDS_POOL_SIZE + index;
+}
+
+std::string p2p_metrics::get_slot_label(size_t slot)
+{
+  if (slot == SLOTS_COUNT - 1)
+    return "command=\"other\"";
+
+  int command = (slot / COMMANDS_POOL_SIZE + 1) * 1000 + slot % COMMANDS_POOL_SIZE;
+
+  return "command=\"" + std::to_string(command) + "\"";
+}
+
+void p2p_metrics::on_command(int command, size_t bytes_in, uint64_t handler_micros)
+{
+  command_metrics& metrics = m_commands[get_slot(command)];
+
+  metrics.bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+  metrics.handler_time.observe(handler_micros);
+}
+
+void p2p_metrics::write(std::ostream &out) const
+{
+  out << "# HELP graft_p2p_command_bytes_in_total Bytes received in levin commands\n";
+  out << "# TYPE graft_p2p_command_bytes_in_total counter\n";
+
+  for (size_t i=0; i<SLOTS_COUNT; i++)
+  {
+    if (!m_commands[i].handler_time.get_count())
+      continue;
+
+    out << "graft_p2p_command_bytes_in_total{" << get_slot_label(i) << "} " << m_commands[i].bytes_in.load(std::memory_order_relaxed) << '\n';
+  }
+
+  out << "# HELP graft_p2p_command_handler_seconds Time spent in levin command handlers\n";
+  out << "# TYPE graft_p2p_command_handler_seconds histogram\n";
+
+  for (size_t i=0; i<SLOTS_COUNT; i++)
+  {
+    if (!m_commands[i].handler_time.get_count())
+      continue;
+
+    m_commands[i].handler_time.write(out, "graft_p2p_command_handler_seconds", get_slot_label(i));
+  }
+}
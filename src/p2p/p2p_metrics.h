@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace nodetool
+{
+  /// Lock-free latency histogram with fixed buckets, written in Prometheus text format
+  class latency_histogram
+  {
+  public:
+    static constexpr size_t BUCKETS_COUNT = 12;
+    static const std::array<uint64_t, BUCKETS_COUNT> BUCKET_BOUNDS_MICROS;
+
+    latency_histogram();
+
+    void observe(uint64_t micros);
+
+    uint64_t get_count() const { return m_count; }
+    uint64_t get_sum_micros() const { return m_sum_micros; }
+
+    /// Write _bucket, _sum and _count samples; labels are either empty or a comma separated list of label="value"
+    void write(std::ostream &out, const std::string &name, const std::string &labels) const;
+
+  private:
+    std::array<std::atomic<uint64_t>, BUCKETS_COUNT + 1> m_buckets; // the last bucket is +Inf
+    std::atomic<uint64_t> m_sum_micros;
+    std::atomic<uint64_t> m_count;
+  };
+
+  /// Per-command counters and handler time histograms of levin commands
+  class p2p_metrics
+  {
+  public:
+    static constexpr int COMMANDS_POOL_SIZE = 64;
+    static constexpr int COMMANDS_POOLS_COUNT = 2; // p2p commands (1000+) and cryptonote protocol commands (2000+)
+
+    void on_command(int command, size_t bytes_in, uint64_t handler_micros);
+
+    void write(std::ostream &out) const;
+
+    /// Measures handler time of a command and reports it when destroyed
+    class command_timer
+    {
+    public:
+      command_timer(p2p_metrics &metrics, int command, size_t bytes_in)
+        : m_metrics(metrics), m_command(command), m_bytes_in(bytes_in), m_start(std::chrono::steady_clock::now()) {}
+
+      ~command_timer()
+      {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+        m_metrics.on_command(m_command, m_bytes_in, micros);
+      }
+
+    private:
+      p2p_metrics &m_metrics;
+      int m_command;
+      size_t m_bytes_in;
+      std::chrono::steady_clock::time_point m_start;
+    };
+
+  private:
+    struct command_metrics
+    {
+      std::atomic<uint64_t> bytes_in {0};
+      latency_histogram handler_time;
+    };
+
+    static constexpr size_t SLOTS_COUNT = COMMANDS_POOL_SIZE * COMMANDS_POOLS_COUNT + 1; // the last slot is for other commands
+
+    static size_t get_slot(int command);
+    static std::string get_slot_label(size_t slot);
+
+    std::array<command_metrics, SLOTS_COUNT> m_commands;
+  };
+}
@@ -115,6 +115,18 @@ namespace nodetool
 
 #pragma pack(pop)
 
+  // what we measured of a peer we connected to, averaged over the samples, kept in the local peerlist only
+  struct peer_quality
+  {
+    uint32_t rtt_ms = 0; // of timed syncs
+    uint32_t rtt_samples = 0;
+    uint64_t throughput = 0; // bytes per second, of the block spans it sent
+    uint32_t throughput_samples = 0;
+    uint32_t block_delay_ms = 0; // after the first peer to announce the same block
+    uint32_t block_delay_samples = 0;
+    int64_t last_update = 0;
+  };
+
   inline 
   std::string print_peerlist_to_string(const std::list<peerlist_entry>& pl)
   {
@@ -170,7 +182,8 @@ namespace nodetool
       uint64_t last_announce_height;
       uint64_t last_announce_time;
       uint64_t max_hop;
-      std::vector<peerlist_entry> peers;
+      std::vector<peerlist_entry> peers; // ordered by distance to the supernode, closest first
+      std::vector<uint64_t> peer_hops; // hops of the announce received from each of peers
   };
 
 #define P2P_COMMANDS_POOL_BASE 1000
@@ -212,6 +225,7 @@ namespace nodetool
             KV_SERIALIZE(callback_uri)
             KV_SERIALIZE(data)
             KV_SERIALIZE(wait_answer)
+            KV_SERIALIZE_OPT(binary_data, false)
             KV_SERIALIZE(hop)
             KV_SERIALIZE(message_id)
           END_KV_SERIALIZE_MAP()
@@ -235,6 +249,7 @@ namespace nodetool
             KV_SERIALIZE(callback_uri)
             KV_SERIALIZE(data)
             KV_SERIALIZE(wait_answer)
+            KV_SERIALIZE_OPT(binary_data, false)
             KV_SERIALIZE(hop)
             KV_SERIALIZE(message_id)
           END_KV_SERIALIZE_MAP()
@@ -258,6 +273,7 @@ namespace nodetool
             KV_SERIALIZE(callback_uri)
             KV_SERIALIZE(data)
             KV_SERIALIZE(wait_answer)
+            KV_SERIALIZE_OPT(binary_data, false)
             KV_SERIALIZE(hop)
             KV_SERIALIZE(message_id)
           END_KV_SERIALIZE_MAP()
@@ -266,6 +282,20 @@ namespace nodetool
       struct response : public cryptonote::COMMAND_RPC_UNICAST::response { };
   };
 
+  struct COMMAND_SUPERNODE_ANNOUNCE_BATCH
+  {
+      const static int ID = P2P_COMMANDS_POOL_BASE + 24;
+
+      struct request
+      {
+          std::vector<COMMAND_SUPERNODE_ANNOUNCE::request> announces;
+
+          BEGIN_KV_SERIALIZE_MAP()
+            KV_SERIALIZE(announces)
+          END_KV_SERIALIZE_MAP()
+      };
+  };
+
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -339,8 +369,11 @@ namespace nodetool
     struct request
     {
       t_playload_type payload_data;
+      uint64_t peerlist_since; // local_time of the previous response, only white peers seen since then are sent back
+
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payload_data)
+        KV_SERIALIZE_OPT(peerlist_since, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <functional>
+
+#include "request_cache.h"
+
+using namespace nodetool;
+
+constexpr size_t request_cache::BUCKETS_COUNT;
+constexpr size_t request_cache::DEFAULT_BUCKET_CAPACITY;
+
+request_cache::request_cache(uint64_t expiration_millis, size_t bucket_capacity)
+  : m_bucket_duration(expiration_millis / (BUCKETS_COUNT - 1) + 1)
+  , m_buckets(BUCKETS_COUNT)
+  , m_current_bucket(0)
+{
+    //round capacity up to the power of two and keep tables at most half full
+
+  size_t capacity = 1;
+
+  while (capacity < bucket_capacity * 2)
+    capacity *= 2;
+
+  m_max_bucket_size = capacity / 2;
+
+  for (bucket& b : m_buckets)
+  {
+    b.start_time = 0;
+    b.size       = 0;
+    b.slots.resize(capacity, 0);
+  }
+}
+
+uint64_t request_cache::get_key(const std::string &message_id)
+{
+  uint64_t key = std::hash<std::string>()(message_id);
+  return key ? key : 1;
+}
+
+bool request_cache::contains(uint64_t key) const
+{
+  for (const bucket& b : m_buckets)
+  {
+    if (!b.size)
+      continue;
+
+    size_t mask = b.slots.size() - 1;
+
+    for (size_t i = key & mask;; i = (i + 1) & mask)
+    {
+      if (!b.slots[i])
+        break;
+
+      if (b.slots[i] == key)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+bool request_cache::contains(const std::string &message_id) const
+{
+  return contains(get_key(message_id));
+}
+
+void request_cache::start_bucket(uint64_t now_millis)
+{
+  m_current_bucket = (m_current_bucket + 1) % m_buckets.size();
+
+  bucket& b = m_buckets[m_current_bucket];
+
+  if (b.size)
+  {
+    std::fill(b.slots.begin(), b.slots.end(), 0);
+    b.size = 0;
+  }
+
+  b.start_time = now_millis;
+}
+
+void request_cache::expire(uint64_t now_millis)
+{
+  const bucket& current = m_buckets[m_current_bucket];
+
+  if (now_millis < current.start_time + m_bucket_duration)
+    return;
+
+  uint64_t elapsed_buckets = (now_millis - current.start_time) / m_bucket_duration;
+
+  if (elapsed_buckets > m_buckets.size())
+    elapsed_buckets = m_buckets.size();
+
+  for (uint64_t i=0; i<elapsed_buckets; i++)
+    start_bucket(now_millis);
+}
+
+bool request_cache::insert(const std::string &message_id, uint64_t now_millis)
+{
+  expire(now_millis);
+
+  uint64_t key = get_key(message_id);
+
+  if (contains(key))
+    return false;
+
+  if (m_buckets[m_current_bucket].size >= m_max_bucket_size)
+    start_bucket(now_millis); //overflow; ids expire earlier than requested
+
+  bucket& b    = m_buckets[m_current_bucket];
+  size_t  mask = b.slots.size() - 1;
+  size_t  i    = key & mask;
+
+  while (b.slots[i])
+    i = (i + 1) & mask;
+
+  b.slots[i] = key;
+  b.size++;
+
+  return true;
+}
+
+uint64_t request_cache::memory_usage() const
+{
+  uint64_t bytes = m_buckets.capacity() * sizeof(bucket);
+
+  for (const bucket& b : m_buckets)
+    bytes += b.slots.capacity() * sizeof(uint64_t);
+
+  return bytes;
+}
+
+size_t request_cache::size() const
+{
+  size_t result = 0;
+
+  for (const bucket& b : m_buckets)
+    result += b.size;
+
+  return result;
+}
+
+void request_cache::clear()
+{
+  for (bucket& b : m_buckets)
+  {
+    if (b.size)
+      std::fill(b.slots.begin(), b.slots.end(), 0);
+
+    b.size       = 0;
+    b.start_time = 0;
+  }
+
+  m_current_bucket = 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nodetool
+{
+  /// Fixed-memory set of recently seen message ids. Ids are kept as 64-bit hashes in time buckets,
+  /// and the oldest bucket is dropped as a whole when a new one is started
+  class request_cache
+  {
+  public:
+    static constexpr size_t BUCKETS_COUNT = 8;
+    static constexpr size_t DEFAULT_BUCKET_CAPACITY = 16384;
+
+    /// Ids are kept at least expiration_millis (unless the cache overflows)
+    request_cache(uint64_t expiration_millis, size_t bucket_capacity = DEFAULT_BUCKET_CAPACITY);
+
+    /// Register message id; returns false if the id has been already registered
+    bool insert(const std::string &message_id, uint64_t now_millis);
+
+    /// Check if message id has been registered
+    bool contains(const std::string &message_id) const;
+
+    /// Drop buckets which have expired
+    void expire(uint64_t now_millis);
+
+    /// Number of registered ids
+    size_t size() const;
+
+    /// Heap memory held by the buckets
+    uint64_t memory_usage() const;
+
+    void clear();
+
+  private:
+    struct bucket
+    {
+      uint64_t start_time;
+      size_t size;
+      std::vector<uint64_t> slots; //open addressing table, 0 is an empty slot
+    };
+
+    static uint64_t get_key(const std::string &message_id);
+    bool contains(uint64_t key) const;
+    void start_bucket(uint64_t now_millis);
+
+    uint64_t m_bucket_duration;
+    size_t m_max_bucket_size;
+    std::vector<bucket> m_buckets;
+    size_t m_current_bucket;
+  };
+}
@@ -34,6 +34,7 @@
 #include <boost/thread/mutex.hpp>
 #include "misc_log_ex.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "cryptonote_config.h"
 extern "C"
 {
@@ -42,6 +43,9 @@ extern "C"
 #include "rctOps.h"
 #include "multiexp.h"
 #include "bulletproofs.h"
+#ifdef BULLETPROOFS_PRECOMPUTED_TABLES
+#include "bulletproofs_tables.h"
+#endif
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "bulletproofs"
@@ -56,15 +60,25 @@ extern "C"
 namespace rct
 {
 
-static rct::key vector_exponent(const rct::keyV &a, const rct::keyV &b);
+static rct::key vector_exponent(const rct::keyV &a, const rct::keyV &b, tools::threadpool *tpool = NULL);
 static rct::keyV vector_powers(const rct::key &x, size_t n);
 static rct::keyV vector_dup(const rct::key &x, size_t n);
 static rct::key inner_product(const rct::keyV &a, const rct::keyV &b);
 
 static constexpr size_t maxN = 64;
 static constexpr size_t maxM = BULLETPROOF_MAX_OUTPUTS;
+#ifdef BULLETPROOFS_PRECOMPUTED_TABLES
+static_assert(bulletproofs_tables::GENERATORS_COUNT == maxN*maxM, "Precomputed tables do not match maxN/maxM");
+static_assert(bulletproofs_tables::STRAUS_POINTS_COUNT == STRAUS_SIZE_LIMIT, "Precomputed tables do not match STRAUS_SIZE_LIMIT");
+static_assert(PIPPENGER_SIZE_LIMIT == 0, "Precomputed tables contain all points for pippenger");
+static const rct::key (&Hi)[maxN*maxM] = bulletproofs_tables::Hi;
+static const rct::key (&Gi)[maxN*maxM] = bulletproofs_tables::Gi;
+static const ge_p3 (&Hi_p3)[maxN*maxM] = bulletproofs_tables::Hi_p3;
+static const ge_p3 (&Gi_p3)[maxN*maxM] = bulletproofs_tables::Gi_p3;
+#else
 static rct::key Hi[maxN*maxM], Gi[maxN*maxM];
 static ge_p3 Hi_p3[maxN*maxM], Gi_p3[maxN*maxM];
+#endif
 static std::shared_ptr<straus_cached_data> straus_HiGi_cache;
 static std::shared_ptr<pippenger_cached_data> pippenger_HiGi_cache;
 static const rct::key TWO = { {0x02, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00  } };
@@ -75,15 +89,42 @@ static const rct::keyV twoN = vector_powers(TWO, maxN);
 static const rct::key ip12 = inner_product(oneN, twoN);
 static boost::mutex init_mutex;
 
-static inline rct::key multiexp(const std::vector<MultiexpData> &data, bool HiGi)
+static inline rct::key multiexp(const std::vector<MultiexpData> &data, bool HiGi, tools::threadpool *tpool = NULL)
 {
   if (HiGi)
   {
     static_assert(128 <= STRAUS_SIZE_LIMIT, "Straus in precalc mode can only be calculated till STRAUS_SIZE_LIMIT");
-    return data.size() <= 128 ? straus(data, straus_HiGi_cache, 0) : pippenger(data, pippenger_HiGi_cache, get_pippenger_c(data.size()));
+    return data.size() <= 128 ? straus(data, straus_HiGi_cache, 0) : pippenger(data, pippenger_HiGi_cache, get_pippenger_c(data.size()), tpool);
   }
   else
-    return data.size() <= 64 ? straus(data, NULL, 0) : pippenger(data, NULL, get_pippenger_c(data.size()));
+    return data.size() <= 64 ? straus(data, NULL, 0) : pippenger(data, NULL, get_pippenger_c(data.size()), tpool);
+}
+
+// runs f(begin, end) over [0, n) on tpool, in at most one chunk per thread of at least min_chunk
+// elements, and rethrows here what a chunk threw
+template<typename F>
+static void parallel_for(tools::threadpool &tpool, size_t n, size_t min_chunk, const F &f)
+{
+  const size_t n_chunks = std::min<size_t>(tpool.get_max_concurrency(), n / min_chunk);
+  if (n_chunks <= 1)
+  {
+    f(0, n);
+    return;
+  }
+  const size_t chunk_size = (n + n_chunks - 1) / n_chunks;
+  std::vector<std::exception_ptr> errors(n_chunks);
+  tools::threadpool::waiter waiter;
+  for (size_t c = 0; c < n_chunks; ++c)
+  {
+    tpool.submit(&waiter, [&, c] {
+      try { f(c * chunk_size, std::min(n, (c + 1) * chunk_size)); }
+      catch (...) { errors[c] = std::current_exception(); }
+    });
+  }
+  waiter.wait(&tpool);
+  for (const std::exception_ptr &e: errors)
+    if (e)
+      std::rethrow_exception(e);
 }
 
 static bool is_reduced(const rct::key &scalar)
@@ -136,6 +177,8 @@ static rct::key scalarmultKey(const ge_p3 &P, const rct::key &a)
   return aP;
 }
 
+#ifndef BULLETPROOFS_PRECOMPUTED_TABLES
+// generate_bulletproofs_tables computes the same generators when the tables are built in
 static rct::key get_exponent(const rct::key &base, size_t idx)
 {
   static const std::string salt("bulletproof");
@@ -144,6 +187,7 @@ static rct::key get_exponent(const rct::key &base, size_t idx)
   CHECK_AND_ASSERT_THROW_MES(!(e == rct::identity()), "Exponent is point at infinity");
   return e;
 }
+#endif
 
 static void init_exponents()
 {
@@ -152,6 +196,10 @@ static void init_exponents()
   static bool init_done = false;
   if (init_done)
     return;
+#ifdef BULLETPROOFS_PRECOMPUTED_TABLES
+  straus_HiGi_cache = straus_init_cache_precomputed(bulletproofs_tables::straus_multiples, STRAUS_SIZE_LIMIT);
+  pippenger_HiGi_cache = pippenger_init_cache_precomputed(bulletproofs_tables::pippenger_cached, bulletproofs_tables::MULTIEXP_POINTS_COUNT);
+#else
   std::vector<MultiexpData> data;
   for (size_t i = 0; i < maxN*maxM; ++i)
   {
@@ -166,6 +214,7 @@ static void init_exponents()
 
   straus_HiGi_cache = straus_init_cache(data, STRAUS_SIZE_LIMIT);
   pippenger_HiGi_cache = pippenger_init_cache(data, PIPPENGER_SIZE_LIMIT);
+#endif
 
   MINFO("Hi/Gi cache size: " << (sizeof(Hi)+sizeof(Gi))/1024 << " kB");
   MINFO("Hi_p3/Gi_p3 cache size: " << (sizeof(Hi_p3)+sizeof(Gi_p3))/1024 << " kB");
@@ -177,7 +226,7 @@ static void init_exponents()
 }
 
 /* Given two scalar arrays, construct a vector commitment */
-static rct::key vector_exponent(const rct::keyV &a, const rct::keyV &b)
+static rct::key vector_exponent(const rct::keyV &a, const rct::keyV &b, tools::threadpool *tpool)
 {
   CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
   CHECK_AND_ASSERT_THROW_MES(a.size() <= maxN*maxM, "Incompatible sizes of a and maxN");
@@ -189,11 +238,11 @@ static rct::key vector_exponent(const rct::keyV &a, const rct::keyV &b)
     multiexp_data.emplace_back(a[i], Gi_p3[i]);
     multiexp_data.emplace_back(b[i], Hi_p3[i]);
   }
-  return multiexp(multiexp_data, true);
+  return multiexp(multiexp_data, true, tpool);
 }
 
 /* Compute a custom vector-scalar commitment */
-static rct::key vector_exponent_custom(const rct::keyV &A, const rct::keyV &B, const rct::keyV &a, const rct::keyV &b)
+static rct::key vector_exponent_custom(const rct::keyV &A, const rct::keyV &B, const rct::keyV &a, const rct::keyV &b, tools::threadpool *tpool = NULL)
 {
   CHECK_AND_ASSERT_THROW_MES(A.size() == B.size(), "Incompatible sizes of A and B");
   CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
@@ -211,7 +260,7 @@ static rct::key vector_exponent_custom(const rct::keyV &A, const rct::keyV &B, c
     multiexp_data.back().scalar = b[i];
     CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&multiexp_data.back().point, B[i].bytes) == 0, "ge_frombytes_vartime failed");
   }
-  return multiexp(multiexp_data, false);
+  return multiexp(multiexp_data, false, tpool);
 }
 
 /* Given a scalar, construct a vector of powers */
@@ -706,6 +755,11 @@ Bulletproof bulletproof_PROVE(uint64_t v, const rct::key &gamma)
 
 /* Given a set of values v (0..2^N-1) and masks gamma, construct a range proof */
 Bulletproof bulletproof_PROVE(const rct::keyV &sv, const rct::keyV &gamma)
+{
+  return bulletproof_PROVE(sv, gamma, tools::threadpool::getInstance());
+}
+
+Bulletproof bulletproof_PROVE(const rct::keyV &sv, const rct::keyV &gamma, tools::threadpool &tpool)
 {
   CHECK_AND_ASSERT_THROW_MES(sv.size() == gamma.size(), "Incompatible sizes of sv and gamma");
   CHECK_AND_ASSERT_THROW_MES(!sv.empty(), "sv is empty");
@@ -728,7 +782,6 @@ Bulletproof bulletproof_PROVE(const rct::keyV &sv, const rct::keyV &gamma)
 
   rct::keyV V(sv.size());
   rct::keyV aL(MN), aR(MN);
-  rct::key tmp;
 
   PERF_TIMER_START_BP(PROVE_v);
   for (size_t i = 0; i < sv.size(); ++i)
@@ -786,7 +839,7 @@ try_again:
   PERF_TIMER_START_BP(PROVE_step1);
   // PAPER LINES 38-39
   rct::key alpha = rct::skGen();
-  rct::key ve = vector_exponent(aL, aR);
+  rct::key ve = vector_exponent(aL, aR, &tpool);
   rct::key A;
   rct::addKeys(A, ve, rct::scalarmultBase(alpha));
   A = rct::scalarmultKey(A, INV_EIGHT);
@@ -794,7 +847,7 @@ try_again:
   // PAPER LINES 40-42
   rct::keyV sL = rct::skvGen(MN), sR = rct::skvGen(MN);
   rct::key rho = rct::skGen();
-  ve = vector_exponent(sL, sR);
+  ve = vector_exponent(sL, sR, &tpool);
   rct::key S;
   rct::addKeys(S, ve, rct::scalarmultBase(rho));
   S = rct::scalarmultKey(S, INV_EIGHT);
@@ -919,15 +972,16 @@ try_again:
   rct::keyV aprime(MN);
   rct::keyV bprime(MN);
   const rct::key yinv = invert(y);
-  rct::key yinvpow = rct::identity();
-  for (size_t i = 0; i < MN; ++i)
-  {
-    Gprime[i] = Gi[i];
-    Hprime[i] = scalarmultKey(Hi_p3[i], yinvpow);
-    sc_mul(yinvpow.bytes, yinvpow.bytes, yinv.bytes);
-    aprime[i] = l[i];
-    bprime[i] = r[i];
-  }
+  const rct::keyV yinvpow = vector_powers(yinv, MN);
+  parallel_for(tpool, MN, 64, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+    {
+      Gprime[i] = Gi[i];
+      Hprime[i] = scalarmultKey(Hi_p3[i], yinvpow[i]);
+      aprime[i] = l[i];
+      bprime[i] = r[i];
+    }
+  });
   rct::keyV L(logMN);
   rct::keyV R(logMN);
   int round = 0;
@@ -946,14 +1000,27 @@ try_again:
     rct::key cR = inner_product(slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
 
     // PAPER LINES 18-19
-    L[round] = vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()));
-    sc_mul(tmp.bytes, cL.bytes, x_ip.bytes);
-    rct::addKeys(L[round], L[round], rct::scalarmultH(tmp));
-    L[round] = rct::scalarmultKey(L[round], INV_EIGHT);
-    R[round] = vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
-    sc_mul(tmp.bytes, cR.bytes, x_ip.bytes);
-    rct::addKeys(R[round], R[round], rct::scalarmultH(tmp));
-    R[round] = rct::scalarmultKey(R[round], INV_EIGHT);
+    // L and R don't depend on each other, and each is a large multiexp in the first rounds
+    parallel_for(tpool, 2, nprime >= 32 ? 1 : 2, [&](size_t begin, size_t end) {
+      for (size_t side = begin; side < end; ++side)
+      {
+        rct::key tmp;
+        if (side == 0)
+        {
+          L[round] = vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()), &tpool);
+          sc_mul(tmp.bytes, cL.bytes, x_ip.bytes);
+          rct::addKeys(L[round], L[round], rct::scalarmultH(tmp));
+          L[round] = rct::scalarmultKey(L[round], INV_EIGHT);
+        }
+        else
+        {
+          R[round] = vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime), &tpool);
+          sc_mul(tmp.bytes, cR.bytes, x_ip.bytes);
+          rct::addKeys(R[round], R[round], rct::scalarmultH(tmp));
+          R[round] = rct::scalarmultKey(R[round], INV_EIGHT);
+        }
+      }
+    });
 
     // PAPER LINES 21-22
     w[round] = hash_cache_mash(hash_cache, L[round], R[round]);
@@ -966,8 +1033,21 @@ try_again:
 
     // PAPER LINES 24-25
     const rct::key winv = invert(w[round]);
-    Gprime = hadamard2(vector_scalar2(slice(Gprime, 0, nprime), winv), vector_scalar2(slice(Gprime, nprime, Gprime.size()), w[round]));
-    Hprime = hadamard2(vector_scalar2(slice(Hprime, 0, nprime), w[round]), vector_scalar2(slice(Hprime, nprime, Hprime.size()), winv));
+    // folded in place, element i only reads i and nprime + i
+    parallel_for(tpool, nprime, 32, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i)
+      {
+        rct::key lo, hi;
+        rct::scalarmultKey(lo, Gprime[i], winv);
+        rct::scalarmultKey(hi, Gprime[nprime + i], w[round]);
+        rct::addKeys(Gprime[i], lo, hi);
+        rct::scalarmultKey(lo, Hprime[i], w[round]);
+        rct::scalarmultKey(hi, Hprime[nprime + i], winv);
+        rct::addKeys(Hprime[i], lo, hi);
+      }
+    });
+    Gprime.resize(nprime);
+    Hprime.resize(nprime);
 
     // PAPER LINES 28-29
     aprime = vector_add(vector_scalar(slice(aprime, 0, nprime), w[round]), vector_scalar(slice(aprime, nprime, aprime.size()), winv));
@@ -982,6 +1062,11 @@ try_again:
 }
 
 Bulletproof bulletproof_PROVE(const std::vector<uint64_t> &v, const rct::keyV &gamma)
+{
+  return bulletproof_PROVE(v, gamma, tools::threadpool::getInstance());
+}
+
+Bulletproof bulletproof_PROVE(const std::vector<uint64_t> &v, const rct::keyV &gamma, tools::threadpool &tpool)
 {
   CHECK_AND_ASSERT_THROW_MES(v.size() == gamma.size(), "Incompatible sizes of v and gamma");
 
@@ -1001,7 +1086,7 @@ Bulletproof bulletproof_PROVE(const std::vector<uint64_t> &v, const rct::keyV &g
     sv[i].bytes[7] = (v[i] >> 56) & 255;
   }
   PERF_TIMER_STOP(PROVE_v);
-  return bulletproof_PROVE(sv, gamma);
+  return bulletproof_PROVE(sv, gamma, tpool);
 }
 
 /* Given a range proof, determine if it is valid */
@@ -33,6 +33,7 @@
 #ifndef BULLETPROOFS_H
 #define BULLETPROOFS_H
 
+#include "common/common_fwd.h"
 #include "rctTypes.h"
 
 namespace rct
@@ -42,6 +43,9 @@ Bulletproof bulletproof_PROVE(const rct::key &v, const rct::key &gamma);
 Bulletproof bulletproof_PROVE(uint64_t v, const rct::key &gamma);
 Bulletproof bulletproof_PROVE(const rct::keyV &v, const rct::keyV &gamma);
 Bulletproof bulletproof_PROVE(const std::vector<uint64_t> &v, const rct::keyV &gamma);
+// the multiexps and inner product rounds are spread over tpool's threads, the others use the global pool
+Bulletproof bulletproof_PROVE(const rct::keyV &v, const rct::keyV &gamma, tools::threadpool &tpool);
+Bulletproof bulletproof_PROVE(const std::vector<uint64_t> &v, const rct::keyV &gamma, tools::threadpool &tpool);
 bool bulletproof_VERIFY(const Bulletproof &proof);
 bool bulletproof_VERIFY(const std::vector<const Bulletproof*> &proofs);
 bool bulletproof_VERIFY(const std::vector<Bulletproof> &proofs);
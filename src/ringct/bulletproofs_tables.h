@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include "crypto/crypto-ops.h"
+#include "rctTypes.h"
+#include "cryptonote_config.h"
+
+namespace rct
+{
+  /// Bulletproofs generators and their multiexp caches, computed at build time by
+  /// generate_bulletproofs_tables (only available when BULLETPROOFS_PRECOMPUTED_TABLES is defined)
+  namespace bulletproofs_tables
+  {
+    static constexpr size_t GENERATORS_COUNT = 64 * BULLETPROOF_MAX_OUTPUTS; // maxN * maxM
+    static constexpr size_t MULTIEXP_POINTS_COUNT = 2 * GENERATORS_COUNT;     // Gi[0], Hi[0], Gi[1], Hi[1], ...
+    static constexpr size_t STRAUS_POINTS_COUNT = 128;
+    static constexpr size_t STRAUS_MULTIPLES_COUNT = 15;                      // 1P..15P of each point
+
+    extern const rct::key Hi[GENERATORS_COUNT];
+    extern const rct::key Gi[GENERATORS_COUNT];
+    extern const ge_p3 Hi_p3[GENERATORS_COUNT];
+    extern const ge_p3 Gi_p3[GENERATORS_COUNT];
+
+    /// d*P of the first STRAUS_POINTS_COUNT multiexp points, the multiple d of point j is at [j + STRAUS_POINTS_COUNT*(d-1)]
+    extern const ge_cached straus_multiples[STRAUS_MULTIPLES_COUNT * STRAUS_POINTS_COUNT];
+    /// All multiexp points in ge_cached form
+    extern const ge_cached pippenger_cached[MULTIEXP_POINTS_COUNT];
+  }
+}
@@ -0,0 +1,174 @@
+// Writes the bulletproofs Hi/Gi generators and their straus/pippenger caches as a C++ source,
+// so they are linked into ringct_basic instead of being computed at startup of every process.
+// The values must be exactly those computed by init_exponents in bulletproofs.cc.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "common/varint.h"
+#include "crypto/hash.h"
+#include "rctOps.h"
+#include "bulletproofs_tables.h"
+
+using namespace rct::bulletproofs_tables;
+
+namespace
+{
+
+void fail(const char *message)
+{
+  fprintf(stderr, "generate_bulletproofs_tables: %s\n", message);
+  exit(1);
+}
+
+rct::key hash_to_point(const crypto::hash &hh)
+{
+  ge_p2 point;
+  ge_p1p1 point2;
+  ge_p3 res;
+  rct::key pointk;
+  crypto::hash h = crypto::cn_fast_hash(&hh, sizeof(hh));
+  ge_fromfe_frombytes_vartime(&point, reinterpret_cast<const unsigned char*>(&h));
+  ge_mul8(&point2, &point);
+  ge_p1p1_to_p3(&res, &point2);
+  ge_p3_tobytes(pointk.bytes, &res);
+  return pointk;
+}
+
+rct::key get_exponent(const rct::key &base, size_t idx)
+{
+  static const std::string salt("bulletproof");
+  std::string hashed = std::string((const char*)base.bytes, sizeof(base)) + salt + tools::get_varint_data(idx);
+  const rct::key e = hash_to_point(crypto::cn_fast_hash(hashed.data(), hashed.size()));
+  if (e == rct::identity())
+    fail("exponent is point at infinity");
+  return e;
+}
+
+void write_key(FILE *out, const rct::key &k)
+{
+  fprintf(out, "  {{");
+  for (size_t i = 0; i < sizeof(k.bytes); ++i)
+    fprintf(out, "%s0x%02x", i ? "," : "", k.bytes[i]);
+  fprintf(out, "}},\n");
+}
+
+void write_fe(FILE *out, const fe f, bool last)
+{
+  fprintf(out, "{");
+  for (size_t i = 0; i < 10; ++i)
+    fprintf(out, "%s%d", i ? "," : "", (int)f[i]);
+  fprintf(out, "}%s", last ? "" : ",");
+}
+
+void write_p3(FILE *out, const ge_p3 &p)
+{
+  fprintf(out, "  {");
+  write_fe(out, p.X, false);
+  write_fe(out, p.Y, false);
+  write_fe(out, p.Z, false);
+  write_fe(out, p.T, true);
+  fprintf(out, "},\n");
+}
+
+void write_cached(FILE *out, const ge_cached &c)
+{
+  fprintf(out, "  {");
+  write_fe(out, c.YplusX, false);
+  write_fe(out, c.YminusX, false);
+  write_fe(out, c.Z, false);
+  write_fe(out, c.T2d, true);
+  fprintf(out, "},\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    fprintf(stderr, "usage: %s <output.cpp>\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<rct::key> Hi(GENERATORS_COUNT), Gi(GENERATORS_COUNT);
+  std::vector<ge_p3> Hi_p3(GENERATORS_COUNT), Gi_p3(GENERATORS_COUNT);
+  std::vector<const ge_p3*> points;
+
+  for (size_t i = 0; i < GENERATORS_COUNT; ++i)
+  {
+    Hi[i] = get_exponent(rct::H, i * 2);
+    if (ge_frombytes_vartime(&Hi_p3[i], Hi[i].bytes) != 0)
+      fail("ge_frombytes_vartime failed");
+    Gi[i] = get_exponent(rct::H, i * 2 + 1);
+    if (ge_frombytes_vartime(&Gi_p3[i], Gi[i].bytes) != 0)
+      fail("ge_frombytes_vartime failed");
+
+    points.push_back(&Gi_p3[i]);
+    points.push_back(&Hi_p3[i]);
+  }
+
+  // same layout and formulas as straus_init_cache with RAW_MEMORY_BLOCK
+  std::vector<ge_cached> straus(STRAUS_MULTIPLES_COUNT * STRAUS_POINTS_COUNT);
+  for (size_t j = 0; j < STRAUS_POINTS_COUNT; ++j)
+  {
+    ge_p1p1 p1;
+    ge_p3 p3;
+    ge_p3_to_cached(&straus[j], points[j]);
+    for (size_t d = 2; d <= STRAUS_MULTIPLES_COUNT; ++d)
+    {
+      ge_add(&p1, points[j], &straus[j + STRAUS_POINTS_COUNT * (d - 2)]);
+      ge_p1p1_to_p3(&p3, &p1);
+      ge_p3_to_cached(&straus[j + STRAUS_POINTS_COUNT * (d - 1)], &p3);
+    }
+  }
+
+  FILE *out = fopen(argv[1], "w");
+  if (!out)
+    fail("cannot open output file");
+
+  fprintf(out, "// Generated by generate_bulletproofs_tables, do not edit\n\n");
+  fprintf(out, "#include \"ringct/bulletproofs_tables.h\"\n\n");
+  fprintf(out, "namespace rct\n{\nnamespace bulletproofs_tables\n{\n\n");
+
+  fprintf(out, "alignas(64) const rct::key Hi[GENERATORS_COUNT] = {\n");
+  for (const rct::key &k: Hi)
+    write_key(out, k);
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "alignas(64) const rct::key Gi[GENERATORS_COUNT] = {\n");
+  for (const rct::key &k: Gi)
+    write_key(out, k);
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "alignas(64) const ge_p3 Hi_p3[GENERATORS_COUNT] = {\n");
+  for (const ge_p3 &p: Hi_p3)
+    write_p3(out, p);
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "alignas(64) const ge_p3 Gi_p3[GENERATORS_COUNT] = {\n");
+  for (const ge_p3 &p: Gi_p3)
+    write_p3(out, p);
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "alignas(64) const ge_cached straus_multiples[STRAUS_MULTIPLES_COUNT * STRAUS_POINTS_COUNT] = {\n");
+  for (const ge_cached &c: straus)
+    write_cached(out, c);
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "alignas(64) const ge_cached pippenger_cached[MULTIEXP_POINTS_COUNT] = {\n");
+  for (const ge_p3 *p: points)
+  {
+    ge_cached c;
+    ge_p3_to_cached(&c, p);
+    write_cached(out, c);
+  }
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "}\n}\n");
+
+  if (fclose(out) != 0)
+    fail("cannot write output file");
+  return 0;
+}
@@ -35,6 +35,7 @@ extern "C"
 #include "crypto/crypto-ops.h"
 }
 #include "common/aligned.h"
+#include "common/threadpool.h"
 #include "rctOps.h"
 #include "multiexp.h"
 
@@ -327,8 +328,9 @@ struct straus_cached_data
 #ifdef RAW_MEMORY_BLOCK
   size_t size;
   ge_cached *multiples;
-  straus_cached_data(): size(0), multiples(NULL) {}
-  ~straus_cached_data() { aligned_free(multiples); }
+  bool owned;
+  straus_cached_data(): size(0), multiples(NULL), owned(true) {}
+  ~straus_cached_data() { if (owned) aligned_free(multiples); }
 #else
   std::vector<std::vector<ge_cached>> multiples;
 #endif
@@ -412,6 +414,39 @@ std::shared_ptr<straus_cached_data> straus_init_cache(const std::vector<Multiexp
   return cache;
 }
 
+std::shared_ptr<straus_cached_data> straus_init_cache_precomputed(const ge_cached *multiples, size_t N)
+{
+  std::shared_ptr<straus_cached_data> cache(new straus_cached_data());
+
+#if defined(RAW_MEMORY_BLOCK) && !defined(ALTERNATE_LAYOUT)
+  // same layout as ours, the tables are read only
+  cache->size = N;
+  cache->multiples = const_cast<ge_cached*>(multiples);
+  cache->owned = false;
+#elif defined(RAW_MEMORY_BLOCK)
+  cache->multiples = (ge_cached*)aligned_realloc(cache->multiples, sizeof(ge_cached) * ((1<<STRAUS_C)-1) * N, 4096);
+  CHECK_AND_ASSERT_THROW_MES(cache->multiples, "Out of memory");
+  cache->size = N;
+  for (size_t j=0;j<N;++j)
+    for (size_t i=1;i<1<<STRAUS_C;++i)
+      CACHE_OFFSET(cache, j, i) = multiples[j + N*(i-1)];
+#elif defined(ALTERNATE_LAYOUT)
+  cache->multiples.resize(N);
+  for (size_t j=0;j<N;++j)
+  {
+    cache->multiples[j].resize((1<<STRAUS_C)-1);
+    for (size_t i=1;i<1<<STRAUS_C;++i)
+      cache->multiples[j][i-1] = multiples[j + N*(i-1)];
+  }
+#else
+  cache->multiples.resize(1<<STRAUS_C);
+  for (size_t i=1;i<1<<STRAUS_C;++i)
+    cache->multiples[i].assign(multiples + N*(i-1), multiples + N*i);
+#endif
+
+  return cache;
+}
+
 size_t straus_get_cache_size(const std::shared_ptr<straus_cached_data> &cache)
 {
   size_t sz = 0;
@@ -559,8 +594,9 @@ struct pippenger_cached_data
 {
   size_t size;
   ge_cached *cached;
-  pippenger_cached_data(): size(0), cached(NULL) {}
-  ~pippenger_cached_data() { aligned_free(cached); }
+  bool owned;
+  pippenger_cached_data(): size(0), cached(NULL), owned(true) {}
+  ~pippenger_cached_data() { if (owned) aligned_free(cached); }
 };
 
 std::shared_ptr<pippenger_cached_data> pippenger_init_cache(const std::vector<MultiexpData> &data, size_t N)
@@ -582,12 +618,73 @@ std::shared_ptr<pippenger_cached_data> pippenger_init_cache(const std::vector<Mu
   return cache;
 }
 
+std::shared_ptr<pippenger_cached_data> pippenger_init_cache_precomputed(const ge_cached *cached, size_t N)
+{
+  std::shared_ptr<pippenger_cached_data> cache(new pippenger_cached_data());
+
+  cache->size = N;
+  cache->cached = const_cast<ge_cached*>(cached);
+  cache->owned = false;
+  return cache;
+}
+
 size_t pippenger_get_cache_size(const std::shared_ptr<pippenger_cached_data> &cache)
 {
   return cache->size * sizeof(*cache->cached);
 }
 
-rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache, size_t c)
+// adds the sum of the points in window k, weighted by their digit there, to acc
+static void pippenger_window(const std::vector<MultiexpData> &data, const pippenger_cached_data &cache, size_t c, size_t k, ge_p3 *buckets, ge_p3 &acc)
+{
+  for (size_t i = 0; i < (1u<<c); ++i)
+    buckets[i] = ge_p3_identity;
+
+  // partition scalars into buckets
+  for (size_t i = 0; i < data.size(); ++i)
+  {
+    unsigned int bucket = 0;
+    for (size_t j = 0; j < c; ++j)
+      if (test(data[i].scalar, k*c+j))
+        bucket |= 1<<j;
+    if (bucket == 0)
+      continue;
+    if (!ge_p3_is_point_at_infinity(&buckets[bucket]))
+    {
+      add(buckets[bucket], cache.cached[i]);
+    }
+    else
+      buckets[bucket] = data[i].point;
+  }
+
+  // sum the buckets
+  ge_p3 pail = ge_p3_identity;
+  for (size_t i = (1<<c)-1; i > 0; --i)
+  {
+    if (!ge_p3_is_point_at_infinity(&buckets[i]))
+      add(pail, buckets[i]);
+    if (!ge_p3_is_point_at_infinity(&pail))
+      add(acc, pail);
+  }
+}
+
+static void pippenger_double(ge_p3 &result, size_t c)
+{
+  if (ge_p3_is_point_at_infinity(&result))
+    return;
+  ge_p2 p2;
+  ge_p3_to_p2(&p2, &result);
+  for (size_t i = 0; i < c; ++i)
+  {
+    ge_p1p1 p1;
+    ge_p2_dbl(&p1, &p2);
+    if (i == c - 1)
+      ge_p1p1_to_p3(&result, &p1);
+    else
+      ge_p1p1_to_p2(&p2, &p1);
+  }
+}
+
+rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache, size_t c, tools::threadpool *tpool)
 {
   CHECK_AND_ASSERT_THROW_MES(cache == NULL || cache->size >= data.size(), "Cache is too small");
   if (c == 0)
@@ -595,7 +692,6 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
   CHECK_AND_ASSERT_THROW_MES(c <= 9, "c is too large");
 
   ge_p3 result = ge_p3_identity;
-  std::unique_ptr<ge_p3[]> buckets{new ge_p3[1<<c]};
   std::shared_ptr<pippenger_cached_data> local_cache = cache == NULL ? pippenger_init_cache(data) : cache;
 
   rct::key maxscalar = rct::zero();
@@ -609,51 +705,34 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
     ++groups;
   groups = (groups + c - 1) / c;
 
-  for (size_t k = groups; k-- > 0; )
+  if (tpool && groups > 1 && tpool->get_max_concurrency() > 1)
   {
-    if (!ge_p3_is_point_at_infinity(&result))
+    // the windows don't depend on each other, each gets its buckets summed on its own thread,
+    // and only the doublings combining them are serial
+    std::vector<ge_p3> windows(groups, ge_p3_identity);
+    tools::threadpool::waiter waiter;
+    for (size_t k = 0; k < groups; ++k)
     {
-      ge_p2 p2;
-      ge_p3_to_p2(&p2, &result);
-      for (size_t i = 0; i < c; ++i)
-      {
-        ge_p1p1 p1;
-        ge_p2_dbl(&p1, &p2);
-        if (i == c - 1)
-          ge_p1p1_to_p3(&result, &p1);
-        else
-          ge_p1p1_to_p2(&p2, &p1);
-      }
+      tpool->submit(&waiter, [&, k] {
+        std::unique_ptr<ge_p3[]> buckets{new ge_p3[1<<c]};
+        pippenger_window(data, *local_cache, c, k, buckets.get(), windows[k]);
+      });
     }
-    for (size_t i = 0; i < (1u<<c); ++i)
-      buckets[i] = ge_p3_identity;
+    waiter.wait(tpool);
 
-    // partition scalars into buckets
-    for (size_t i = 0; i < data.size(); ++i)
+    for (size_t k = groups; k-- > 0; )
     {
-      unsigned int bucket = 0;
-      for (size_t j = 0; j < c; ++j)
-        if (test(data[i].scalar, k*c+j))
-          bucket |= 1<<j;
-      if (bucket == 0)
-        continue;
-      CHECK_AND_ASSERT_THROW_MES(bucket < (1u<<c), "bucket overflow");
-      if (!ge_p3_is_point_at_infinity(&buckets[bucket]))
-      {
-        add(buckets[bucket], local_cache->cached[i]);
-      }
-      else
-        buckets[bucket] = data[i].point;
+      pippenger_double(result, c);
+      add(result, windows[k]);
     }
-
-    // sum the buckets
-    ge_p3 pail = ge_p3_identity;
-    for (size_t i = (1<<c)-1; i > 0; --i)
+  }
+  else
+  {
+    std::unique_ptr<ge_p3[]> buckets{new ge_p3[1<<c]};
+    for (size_t k = groups; k-- > 0; )
     {
-      if (!ge_p3_is_point_at_infinity(&buckets[i]))
-        add(pail, buckets[i]);
-      if (!ge_p3_is_point_at_infinity(&pail))
-        add(result, pail);
+      pippenger_double(result, c);
+      pippenger_window(data, *local_cache, c, k, buckets.get(), result);
     }
   }
 
@@ -35,6 +35,7 @@
 
 #include <vector>
 #include "crypto/crypto.h"
+#include "common/common_fwd.h"
 #include "rctTypes.h"
 #include "misc_log_ex.h"
 
@@ -59,12 +60,17 @@ struct pippenger_cached_data;
 rct::key bos_coster_heap_conv(std::vector<MultiexpData> data);
 rct::key bos_coster_heap_conv_robust(std::vector<MultiexpData> data);
 std::shared_ptr<straus_cached_data> straus_init_cache(const std::vector<MultiexpData> &data, size_t N =0);
+// uses N points worth of precomputed multiples 1P..15P, the multiple d of point j being at multiples[j + N*(d-1)]
+std::shared_ptr<straus_cached_data> straus_init_cache_precomputed(const ge_cached *multiples, size_t N);
 size_t straus_get_cache_size(const std::shared_ptr<straus_cached_data> &cache);
 rct::key straus(const std::vector<MultiexpData> &data, const std::shared_ptr<straus_cached_data> &cache = NULL, size_t STEP = 0);
 std::shared_ptr<pippenger_cached_data> pippenger_init_cache(const std::vector<MultiexpData> &data, size_t N =0);
+// uses N precomputed points in ge_cached form
+std::shared_ptr<pippenger_cached_data> pippenger_init_cache_precomputed(const ge_cached *cached, size_t N);
 size_t pippenger_get_cache_size(const std::shared_ptr<pippenger_cached_data> &cache);
 size_t get_pippenger_c(size_t N);
-rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache = NULL, size_t c = 0);
+// the windows are summed in parallel on tpool if one is given
+rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache = NULL, size_t c = 0, tools::threadpool *tpool = NULL);
 
 }
 
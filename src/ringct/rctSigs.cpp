@@ -44,6 +44,25 @@ using namespace std;
 
 #define CHECK_AND_ASSERT_MES_L1(expr, ret, message) {if(!(expr)) {MCERROR("verify", message); return ret;}}
 
+namespace
+{
+    // MLSAGs are verified for every input of every tx, on all the threadpool threads at once.
+    // Each thread keeps its buffers between verifications instead of allocating them every time.
+    // They only ever hold public data.
+    struct verification_scratch
+    {
+        rct::keyV M;
+        rct::keyV toHash;
+        std::vector<rct::geDsmp> Ip;
+    };
+
+    verification_scratch &get_verification_scratch()
+    {
+        static thread_local verification_scratch scratch;
+        return scratch;
+    }
+}
+
 namespace rct {
     Bulletproof proveRangeBulletproof(key &C, key &mask, uint64_t amount)
     {
@@ -240,15 +259,11 @@ namespace rct {
     // Gen creates a signature which proves that for some column in the keymatrix "pk"
     //   the signer knows a secret key for each row in that column
     // Ver verifies that the MG sig was created correctly            
-    bool MLSAG_Ver(const key &message, const keyM & pk, const mgSig & rv, size_t dsRows) {
-
-        size_t cols = pk.size();
+    // pk(i, j) is the key in row j of column i, so callers can keep the matrix flat
+    template<typename PK>
+    static bool MLSAG_Ver(const key &message, const PK &pk, size_t cols, size_t rows, const mgSig & rv, size_t dsRows) {
         CHECK_AND_ASSERT_MES(cols >= 2, false, "Error! What is c if cols = 1!");
-        size_t rows = pk[0].size();
         CHECK_AND_ASSERT_MES(rows >= 1, false, "Empty pk");
-        for (size_t i = 1; i < cols; ++i) {
-          CHECK_AND_ASSERT_MES(pk[i].size() == rows, false, "pk is not rectangular");
-        }
         CHECK_AND_ASSERT_MES(rv.II.size() == dsRows, false, "Bad II size");
         CHECK_AND_ASSERT_MES(rv.ss.size() == cols, false, "Bad rv.ss size");
         for (size_t i = 0; i < cols; ++i) {
@@ -264,37 +279,52 @@ namespace rct {
         size_t i = 0, j = 0, ii = 0;
         key c,  L, R, Hi;
         key c_old = copy(rv.cc);
-        vector<geDsmp> Ip(dsRows);
+        verification_scratch &scratch = get_verification_scratch();
+        std::vector<geDsmp> &Ip = scratch.Ip;
+        Ip.resize(dsRows);
         for (i = 0 ; i < dsRows ; i++) {
             precomp(Ip[i].k, rv.II[i]);
         }
         size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper
-        keyV toHash(1 + 3 * dsRows + 2 * (rows - dsRows));
+        keyV &toHash = scratch.toHash;
+        toHash.resize(1 + 3 * dsRows + 2 * (rows - dsRows));
         toHash[0] = message;
         i = 0;
         while (i < cols) {
             sc_0(c.bytes);
             for (j = 0; j < dsRows; j++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                hashToPoint(Hi, pk[i][j]);
+                addKeys2(L, rv.ss[i][j], c_old, pk(i, j));
+                hashToPoint(Hi, pk(i, j));
                 CHECK_AND_ASSERT_MES(!(Hi == rct::identity()), false, "Data hashed to point at infinity");
                 addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
-                toHash[3 * j + 1] = pk[i][j];
+                toHash[3 * j + 1] = pk(i, j);
                 toHash[3 * j + 2] = L; 
                 toHash[3 * j + 3] = R;
             }
             for (j = dsRows, ii = 0 ; j < rows ; j++, ii++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                toHash[ndsRows + 2 * ii + 1] = pk[i][j];
+                addKeys2(L, rv.ss[i][j], c_old, pk(i, j));
+                toHash[ndsRows + 2 * ii + 1] = pk(i, j);
                 toHash[ndsRows + 2 * ii + 2] = L;
             }
-            c = hash_to_scalar(toHash);
+            hash_to_scalar(c, toHash.data(), toHash.size() * sizeof(key));
             copy(c_old, c);
             i = (i + 1);
         }
         sc_sub(c.bytes, c_old.bytes, rv.cc.bytes);
         return sc_isnonzero(c.bytes) == 0;  
     }
+
+    bool MLSAG_Ver(const key &message, const keyM & pk, const mgSig & rv, size_t dsRows) {
+
+        size_t cols = pk.size();
+        CHECK_AND_ASSERT_MES(cols >= 2, false, "Error! What is c if cols = 1!");
+        size_t rows = pk[0].size();
+        CHECK_AND_ASSERT_MES(rows >= 1, false, "Empty pk");
+        for (size_t i = 1; i < cols; ++i) {
+          CHECK_AND_ASSERT_MES(pk[i].size() == rows, false, "pk is not rectangular");
+        }
+        return MLSAG_Ver(message, [&pk](size_t i, size_t j) -> const key& { return pk[i][j]; }, cols, rows, rv, dsRows);
+    }
     
 
 
@@ -541,28 +571,30 @@ namespace rct {
           CHECK_AND_ASSERT_MES(pubs[i].size() == rows, false, "pubs is not rectangular");
         }
 
-        keyV tmp(rows + 1);
+        //the matrix to mg sig, column major with rows + 1 keys per column
+        const size_t stride = rows + 1;
+        keyV &M = get_verification_scratch().M;
+        M.resize(cols * stride);
         size_t i = 0, j = 0;
-        for (i = 0; i < rows + 1; i++) {
-            identity(tmp[i]);
+        for (i = 0; i < cols; i++) {
+            identity(M[i * stride + rows]);
         }
-        keyM M(cols, tmp);
 
         //create the matrix to mg sig
         for (j = 0; j < rows; j++) {
             for (i = 0; i < cols; i++) {
-                M[i][j] = pubs[i][j].dest;
-                addKeys(M[i][rows], M[i][rows], pubs[i][j].mask); //add Ci in last row
+                M[i * stride + j] = pubs[i][j].dest;
+                addKeys(M[i * stride + rows], M[i * stride + rows], pubs[i][j].mask); //add Ci in last row
             }
         }
         for (i = 0; i < cols; i++) {
             for (j = 0; j < outPk.size(); j++) {
-                subKeys(M[i][rows], M[i][rows], outPk[j].mask); //subtract output Ci's in last row
+                subKeys(M[i * stride + rows], M[i * stride + rows], outPk[j].mask); //subtract output Ci's in last row
             }
             //subtract txn fee output in last row
-            subKeys(M[i][rows], M[i][rows], txnFeeKey);
+            subKeys(M[i * stride + rows], M[i * stride + rows], txnFeeKey);
         }
-        return MLSAG_Ver(message, M, mg, rows);
+        return MLSAG_Ver(message, [&M, stride](size_t i, size_t j) -> const key& { return M[i * stride + j]; }, cols, stride, mg, rows);
     }
 
     //Ring-ct Simple MG sigs
@@ -577,16 +609,18 @@ namespace rct {
             size_t rows = 1;
             size_t cols = pubs.size();
             CHECK_AND_ASSERT_MES(cols >= 1, false, "Empty pubs");
-            keyV tmp(rows + 1);
+            //the matrix to mg sig, column major with 2 keys per column
+            const size_t stride = rows + 1;
+            keyV &M = get_verification_scratch().M;
+            M.resize(cols * stride);
             size_t i;
-            keyM M(cols, tmp);
             //create the matrix to mg sig
             for (i = 0; i < cols; i++) {
-                    M[i][0] = pubs[i].dest;
-                    subKeys(M[i][1], pubs[i].mask, C);
+                    M[i * stride] = pubs[i].dest;
+                    subKeys(M[i * stride + 1], pubs[i].mask, C);
             }
             //DP(C);
-            return MLSAG_Ver(message, M, mg, rows);
+            return MLSAG_Ver(message, [&M, stride](size_t i, size_t j) -> const key& { return M[i * stride + j]; }, cols, stride, mg, rows);
         }
         catch (...) { return false; }
     }
@@ -1029,41 +1063,48 @@ namespace rct {
 
     //ver RingCT simple
     //assumes only post-rct style inputs (at least for max anonymity)
-    bool verRctNonSemanticsSimple(const rctSig & rv) {
+    //MLSAGs of all the given signatures are verified together, so small txes keep all threads busy
+    bool verRctNonSemanticsSimple(const std::vector<const rctSig*> & rvv) {
       try
       {
         PERF_TIMER(verRctNonSemanticsSimple);
 
-        CHECK_AND_ASSERT_MES(rv.type == RCTTypeSimple || rv.type == RCTTypeBulletproof, false, "verRctNonSemanticsSimple called on non simple rctSig");
-        const bool bulletproof = is_rct_bulletproof(rv.type);
-        // semantics check is early, and mixRing/MGs aren't resolved yet
-        if (bulletproof)
-          CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
-        else
-          CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
+        std::vector<key> messages(rvv.size());
+        std::vector<std::pair<size_t, size_t>> inputs;
+        for (size_t n = 0; n < rvv.size(); ++n)
+        {
+          const rctSig &rv = *rvv[n];
+          CHECK_AND_ASSERT_MES(rv.type == RCTTypeSimple || rv.type == RCTTypeBulletproof, false, "verRctNonSemanticsSimple called on non simple rctSig");
+          const bool bulletproof = is_rct_bulletproof(rv.type);
+          // semantics check is early, and mixRing/MGs aren't resolved yet
+          if (bulletproof)
+            CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
+          else
+            CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
+          CHECK_AND_ASSERT_MES(rv.p.MGs.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.MGs and mixRing");
 
-        const size_t threads = std::max(rv.outPk.size(), rv.mixRing.size());
+          messages[n] = get_pre_mlsag_hash(rv, hw::get_device("default"));
+          for (size_t i = 0 ; i < rv.mixRing.size() ; i++)
+            inputs.emplace_back(n, i);
+        }
 
-        std::deque<bool> results(threads);
+        std::deque<bool> results(inputs.size());
         tools::threadpool& tpool = tools::threadpool::getInstance();
         tools::threadpool::waiter waiter;
 
-        const keyV &pseudoOuts = bulletproof ? rv.p.pseudoOuts : rv.pseudoOuts;
-
-        const key message = get_pre_mlsag_hash(rv, hw::get_device("default"));
-
-        results.clear();
-        results.resize(rv.mixRing.size());
-        for (size_t i = 0 ; i < rv.mixRing.size() ; i++) {
-          tpool.submit(&waiter, [&, i] {
-              results[i] = verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
+        for (size_t k = 0 ; k < inputs.size() ; k++) {
+          tpool.submit(&waiter, [&, k] {
+              const rctSig &rv = *rvv[inputs[k].first];
+              const size_t i = inputs[k].second;
+              const keyV &pseudoOuts = is_rct_bulletproof(rv.type) ? rv.p.pseudoOuts : rv.pseudoOuts;
+              results[k] = verRctMGSimple(messages[inputs[k].first], rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
           });
         }
         waiter.wait(&tpool);
 
-        for (size_t i = 0; i < results.size(); ++i) {
-          if (!results[i]) {
-            LOG_PRINT_L1("verRctMGSimple failed for input " << i);
+        for (size_t k = 0; k < results.size(); ++k) {
+          if (!results[k]) {
+            LOG_PRINT_L1("verRctMGSimple failed for input " << inputs[k].second << " of signature " << inputs[k].first);
             return false;
           }
         }
@@ -1083,6 +1124,11 @@ namespace rct {
       }
     }
 
+    bool verRctNonSemanticsSimple(const rctSig & rv)
+    {
+      return verRctNonSemanticsSimple(std::vector<const rctSig*>(1, &rv));
+    }
+
     //RingCT protocol
     //genRct: 
     //   creates an rctSig with all data necessary to verify the rangeProofs and that the signer owns one of the
@@ -29,6 +29,9 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <iomanip>
+#include <sstream>
+
 #include "include_base_utils.h"
 #include "string_tools.h"
 using namespace epee;
@@ -37,8 +40,12 @@ using namespace epee;
 #include "common/command_line.h"
 #include "common/updates.h"
 #include "common/download.h"
+#include "common/memory_usage.h"
+#include "common/metrics.h"
 #include "common/util.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
+#include "common/trace.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_basic/account.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
@@ -55,6 +62,10 @@ using namespace epee;
 
 #define MAX_RESTRICTED_FAKE_OUTS_COUNT 40
 #define MAX_RESTRICTED_GLOBAL_FAKE_OUTS_COUNT 5000
+// smallest batch of transactions encoded on a threadpool thread of its own
+#define GET_TRANSACTIONS_PER_THREAD_MIN 32
+// longest a block template request long-polls, in seconds, each holding an RPC thread meanwhile
+#define GETBLOCKTEMPLATE_LONGPOLL_MAX_TIMEOUT 60
 
 namespace
 {
@@ -64,6 +75,37 @@ namespace
       reasons += ", ";
     reasons += reason;
   }
+
+  /// Pins one db snapshot and its open cursors for a whole request. The
+  /// blockchain lock is taken first, since a writer resizing the db holds it
+  /// while it waits for read sessions to end.
+  struct db_read_session
+  {
+    db_read_session(cryptonote::Blockchain &blockchain): lock(blockchain), rtxn_guard(blockchain.get_db()) {}
+
+    std::unique_lock<cryptonote::Blockchain> lock;
+    cryptonote::db_rtxn_guard rtxn_guard;
+  };
+
+  /// As Blockchain::get_tx_outputs_gindexs, for a read session without the blockchain lock (which it
+  /// must not wait for, see db_read_session)
+  bool get_tx_outputs_gindexs(const cryptonote::BlockchainDB &db, const crypto::hash &tx_id, std::vector<uint64_t> &indices)
+  {
+    uint64_t tx_index;
+    if (!db.tx_exists(tx_id, tx_index))
+    {
+      MERROR("get_tx_outputs_gindexs failed to find transaction with id = " << tx_id);
+      return false;
+    }
+    indices = db.get_tx_amount_output_indices(tx_index);
+    // empty indices are only valid if the vout is empty, which is legal but rare
+    if (indices.empty())
+    {
+      const cryptonote::transaction tx = db.get_tx(tx_id);
+      CHECK_AND_ASSERT_MES(tx.vout.empty(), false, "internal error: global indexes for transaction " << tx_id << " is empty, and tx vout is not");
+    }
+    return true;
+  }
 }
 
 namespace cryptonote
@@ -82,6 +124,10 @@ namespace cryptonote
     command_line::add_arg(desc, arg_restricted_rpc);
     command_line::add_arg(desc, arg_bootstrap_daemon_address);
     command_line::add_arg(desc, arg_bootstrap_daemon_login);
+    command_line::add_arg(desc, arg_rpc_worker_threads);
+    command_line::add_arg(desc, arg_rpc_response_cache_size);
+    command_line::add_arg(desc, arg_rpc_compression_threshold);
+    command_line::add_arg(desc, arg_rpc_acceptor_per_thread);
     cryptonote::rpc_args::init_options(desc);
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -91,6 +137,10 @@ namespace cryptonote
     )
     : m_core(cr)
     , m_p2p(p2p)
+    , m_response_cache([&cr]() { return cr.get_blockchain_storage().get_tip_cookie(); }, [&cr]() { return cr.get_pool().cookie(); })
+    , m_light_wallet_server(nullptr)
+    , m_longpolls(0)
+    , m_max_longpolls(1)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::init(
@@ -137,6 +187,24 @@ namespace cryptonote
     if (rpc_config->login)
       http_login.emplace(std::move(rpc_config->login->username), std::move(rpc_config->login->password).password());
 
+    // requests run on workers of their own, with the heavy ones limited to half of them so they can't hold
+    // up light requests like get_height for the whole time they take
+    uint32_t worker_threads = command_line::get_arg(vm, arg_rpc_worker_threads);
+    if (!worker_threads)
+      worker_threads = std::max(4u, boost::thread::hardware_concurrency());
+    const size_t heavy_limit = std::max<size_t>(1, worker_threads / 2);
+    std::map<std::string, size_t> limits;
+    for (const char *uri: {"/get_blocks.bin", "/getblocks.bin", "/get_blocks_by_height.bin", "/getblocks_by_height.bin",
+        "/get_outs.bin", "/get_outs", "/get_transactions", "/gettransactions", "/get_transaction_pool"})
+      limits[uri] = heavy_limit;
+    set_request_workers(worker_threads, limits);
+    // long-polling block template requests hold a worker each, they get the same share as the heavy requests
+    m_max_longpolls = heavy_limit;
+
+    m_response_cache.set_max_size(command_line::get_arg(vm, arg_rpc_response_cache_size) << 20);
+    set_response_compression(command_line::get_arg(vm, arg_rpc_compression_threshold));
+    set_acceptor_per_thread(command_line::get_arg(vm, arg_rpc_acceptor_per_thread));
+
     auto rng = [](size_t len, uint8_t *ptr){ return crypto::rand(len, ptr); };
     return epee::http_server_impl_base<core_rpc_server, connection_context>::init(
       rng, std::move(port), std::move(rpc_config->bind_ip), std::move(rpc_config->access_control_origins), std::move(http_login)
@@ -161,7 +229,8 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_HEIGHT>(invoke_http_mode::JON, "/getheight", req, res, r))
       return r;
 
-    res.height = m_core.get_current_blockchain_height();
+    const auto tip = m_core.get_blockchain_storage().get_tip_snapshot();
+    res.height = tip ? tip->height : m_core.get_current_blockchain_height();
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -180,16 +249,21 @@ namespace cryptonote
       return r;
     }
 
-    crypto::hash top_hash;
-    m_core.get_blockchain_top(res.height, top_hash);
-    ++res.height; // turn top block height into blockchain height
-    res.top_block_hash = string_tools::pod_to_hex(top_hash);
+    // read from the published tip, so this doesn't wait for the blockchain or pool locks while a block is verified
+    const auto tip = m_core.get_blockchain_storage().get_tip_snapshot();
+    if (!tip)
+    {
+      res.status = "Failed";
+      return false;
+    }
+    res.height = tip->height;
+    res.top_block_hash = string_tools::pod_to_hex(tip->top_hash);
     res.target_height = m_core.get_target_blockchain_height();
-    res.difficulty = m_core.get_blockchain_storage().get_difficulty_for_next_block();
+    res.difficulty = tip->next_difficulty;
     res.target = m_core.get_blockchain_storage().get_difficulty_target();
-    res.tx_count = m_core.get_blockchain_storage().get_total_transactions() - res.height; //without coinbase
-    res.tx_pool_size = m_core.get_pool_transactions_count();
-    res.alt_blocks_count = m_core.get_blockchain_storage().get_alternative_blocks_count();
+    res.tx_count = tip->tx_count - res.height; //without coinbase
+    res.tx_pool_size = m_core.get_pool().get_transactions_count_unlocked();
+    res.alt_blocks_count = tip->alt_blocks_count;
     uint64_t total_conn = m_p2p.get_connections_count();
     res.outgoing_connections_count = m_p2p.get_outgoing_connections_count();
     res.incoming_connections_count = total_conn - res.outgoing_connections_count;
@@ -200,9 +274,9 @@ namespace cryptonote
     res.testnet = m_nettype == TESTNET;
     res.stagenet = m_nettype == STAGENET;
     res.nettype = m_nettype == MAINNET ? "mainnet" : m_nettype == TESTNET ? "testnet" : m_nettype == STAGENET ? "stagenet" : "fakechain";
-    res.cumulative_difficulty = m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(res.height - 1);
-    res.block_size_limit = res.block_weight_limit = m_core.get_blockchain_storage().get_current_cumulative_block_weight_limit();
-    res.block_size_median = res.block_weight_median = m_core.get_blockchain_storage().get_current_cumulative_block_weight_median();
+    res.cumulative_difficulty = tip->cumulative_difficulty;
+    res.block_size_limit = res.block_weight_limit = tip->block_weight_limit;
+    res.block_size_median = res.block_weight_median = tip->block_weight_median;
     res.status = CORE_RPC_STATUS_OK;
     res.start_time = m_restricted ? 0 : (uint64_t)m_core.get_start_time();
     res.free_space = m_restricted ? std::numeric_limits<uint64_t>::max() : m_core.get_free_space();
@@ -236,6 +310,35 @@ namespace cryptonote
     return ss.str();
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  static bool get_compact_tx_blob(const cryptonote::blobdata &pruned_blob, cryptonote::blobdata &compact_blob)
+  {
+    cryptonote::transaction tx;
+    if (!parse_and_validate_tx_base_from_blob(pruned_blob, tx))
+      return false;
+
+    // a wallet only checks key images of inputs, the rings of its own spends are fetched separately
+    for (auto &in: tx.vin)
+      if (in.type() == typeid(cryptonote::txin_to_key))
+        boost::get<cryptonote::txin_to_key>(in).key_offsets.clear();
+
+    std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+    parse_tx_extra(tx.extra, tx_extra_fields); // ok if partially parsed, the wallet uses what parses the same way
+    std::vector<uint8_t> extra;
+    cryptonote::tx_extra_pub_key pub_key_field;
+    for (size_t pk_index = 0; find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, pk_index); ++pk_index)
+      add_tx_pub_key_to_extra(extra, pub_key_field.pub_key);
+    cryptonote::tx_extra_additional_pub_keys additional_pub_keys;
+    if (find_tx_extra_field_by_type(tx_extra_fields, additional_pub_keys))
+      add_additional_tx_pub_keys_to_extra(extra, additional_pub_keys.data);
+    cryptonote::tx_extra_nonce extra_nonce;
+    if (find_tx_extra_field_by_type(tx_extra_fields, extra_nonce))
+      add_extra_nonce_to_tx_extra(extra, extra_nonce.nonce);
+    tx.extra = std::move(extra);
+
+    compact_blob = get_pruned_tx_blob(tx);
+    return !compact_blob.empty();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res)
   {
     PERF_TIMER(on_get_blocks);
@@ -243,6 +346,8 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_FAST>(invoke_http_mode::BIN, "/getblocks.bin", req, res, r))
       return r;
 
+    db_read_session read_session(m_core.get_blockchain_storage());
+
     std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > > bs;
 
     if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
@@ -295,6 +400,69 @@ namespace cryptonote
     MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, pruned size " << pruned_size << ", unpruned size " << unpruned_size);
     res.status = CORE_RPC_STATUS_OK;
     return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_compact(const COMMAND_RPC_GET_BLOCKS_COMPACT::request& req, COMMAND_RPC_GET_BLOCKS_COMPACT::response& res)
+  {
+    PERF_TIMER(on_get_blocks_compact);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_COMPACT>(invoke_http_mode::BIN, "/get_blocks_compact.bin", req, res, r))
+      return r;
+
+    db_read_session read_session(m_core.get_blockchain_storage());
+
+    std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > > bs;
+
+    // the pruned blobs are read as stored, only their base is parsed for the projection
+    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, true, !req.no_miner_tx, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    {
+      res.status = "Failed";
+      return false;
+    }
+
+    size_t pruned_size = 0, compact_size = 0, ntxes = 0;
+    res.blocks.reserve(bs.size());
+    res.output_indices.reserve(bs.size());
+    for(auto& bd: bs)
+    {
+      res.blocks.resize(res.blocks.size()+1);
+      res.blocks.back().block = std::move(bd.first.first);
+      pruned_size += res.blocks.back().block.size();
+      compact_size += res.blocks.back().block.size();
+      res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_COMPACT::block_output_indices());
+      res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
+      if (!req.no_miner_tx && !m_core.get_tx_outputs_gindexs(bd.first.second, res.output_indices.back().indices.back().indices))
+      {
+        res.status = "Failed";
+        return false;
+      }
+      ntxes += bd.second.size();
+      res.blocks.back().txs.resize(bd.second.size());
+      res.output_indices.back().indices.reserve(bd.second.size() + 1);
+      for (size_t i = 0; i < bd.second.size(); ++i)
+      {
+        pruned_size += bd.second[i].second.size();
+        if (!get_compact_tx_blob(bd.second[i].second, res.blocks.back().txs[i]))
+        {
+          res.status = "Failed to make compact tx " + epee::string_tools::pod_to_hex(bd.second[i].first);
+          return false;
+        }
+        compact_size += res.blocks.back().txs[i].size();
+        bd.second[i].second.clear();
+        bd.second[i].second.shrink_to_fit();
+
+        res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
+        if (!m_core.get_tx_outputs_gindexs(bd.second[i].first, res.output_indices.back().indices.back().indices))
+        {
+          res.status = "Failed";
+          return false;
+        }
+      }
+    }
+
+    MDEBUG("on_get_blocks_compact: " << bs.size() << " blocks, " << ntxes << " txes, pruned size " << pruned_size << ", compact size " << compact_size);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
   }
     bool core_rpc_server::on_get_alt_blocks_hashes(const COMMAND_RPC_GET_ALT_BLOCKS_HASHES::request& req, COMMAND_RPC_GET_ALT_BLOCKS_HASHES::response& res)
     {
@@ -330,6 +498,8 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_BY_HEIGHT>(invoke_http_mode::BIN, "/getblocks_by_height.bin", req, res, r))
       return r;
 
+    db_read_session read_session(m_core.get_blockchain_storage());
+
     res.status = "Failed";
     res.blocks.clear();
     res.blocks.reserve(req.heights.size());
@@ -364,6 +534,8 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_HASHES_FAST>(invoke_http_mode::BIN, "/gethashes.bin", req, res, r))
       return r;
 
+    db_read_session read_session(m_core.get_blockchain_storage());
+
     NOTIFY_RESPONSE_CHAIN_ENTRY::request resp;
 
     resp.start_height = req.start_height;
@@ -387,6 +559,8 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUTS_BIN>(invoke_http_mode::BIN, "/get_outs.bin", req, res, r))
       return r;
 
+    db_read_session read_session(m_core.get_blockchain_storage());
+
     res.status = "Failed";
 
     if (m_restricted)
@@ -407,6 +581,120 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_auth_sample_bin(const COMMAND_RPC_GET_AUTH_SAMPLE_BIN::request& req, COMMAND_RPC_GET_AUTH_SAMPLE_BIN::response& res)
+  {
+    PERF_TIMER(on_get_auth_sample_bin);
+
+    auth_sample_ptr sample = m_core.get_auth_sample(req.block_height);
+
+    if (!sample)
+    {
+      res.status = "Auth sample is not available for the block height";
+      return true;
+    }
+
+    res.block_height = sample->block_number;
+    res.block_hash   = sample->block_hash;
+
+    res.supernodes.reserve(sample->supernodes.size());
+
+    for (const BlockchainBasedList::supernode& sn : sample->supernodes)
+    {
+      COMMAND_RPC_GET_AUTH_SAMPLE_BIN::supernode dst;
+
+      dst.supernode_public_id      = sn.supernode_public_id;
+      dst.supernode_public_address = m_address_strings.get(m_core.get_nettype(), sn.supernode_public_address);
+      dst.amount                   = sn.amount;
+
+      res.supernodes.emplace_back(std::move(dst));
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_supernode_stakes_bin(const COMMAND_RPC_GET_SUPERNODE_STAKES_BIN::request& req, COMMAND_RPC_GET_SUPERNODE_STAKES_BIN::response& res)
+  {
+    PERF_TIMER(on_get_supernode_stakes_bin);
+
+    StakeTransactionProcessor::block_stakes_array stakes;
+
+    if (!m_core.get_supernode_stakes(req.start_height, req.count, stakes))
+    {
+      res.status = "Stake transaction processing is not initialized";
+      return true;
+    }
+
+    res.blocks.resize(stakes.size());
+
+    for (size_t i=0; i<stakes.size(); i++)
+    {
+      COMMAND_RPC_GET_SUPERNODE_STAKES_BIN::block_stakes& dst = res.blocks[i];
+
+      dst.block_height = stakes[i].first;
+      dst.stakes.reserve(stakes[i].second.size());
+
+      for (const supernode_stake& src_stake : stakes[i].second)
+      {
+        COMMAND_RPC_GET_SUPERNODE_STAKES_BIN::supernode_stake dst_stake;
+
+        dst_stake.amount              = src_stake.amount;
+        dst_stake.tier                = src_stake.tier;
+        dst_stake.block_height        = src_stake.block_height;
+        dst_stake.unlock_time         = src_stake.unlock_time;
+        dst_stake.supernode_public_id = src_stake.supernode_public_id;
+
+        dst_stake.supernode_public_address = m_address_strings.get(m_core.get_nettype(), src_stake.supernode_public_address);
+
+        dst.stakes.emplace_back(std::move(dst_stake));
+      }
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blockchain_based_list_bin(const COMMAND_RPC_GET_BLOCKCHAIN_BASED_LIST_BIN::request& req, COMMAND_RPC_GET_BLOCKCHAIN_BASED_LIST_BIN::response& res)
+  {
+    PERF_TIMER(on_get_blockchain_based_list_bin);
+
+    StakeTransactionProcessor::block_tiers_array lists;
+
+    if (!m_core.get_blockchain_based_lists(req.start_height, req.count, lists))
+    {
+      res.status = "Stake transaction processing is not initialized";
+      return true;
+    }
+
+    res.blocks.resize(lists.size());
+
+    for (size_t i=0; i<lists.size(); i++)
+    {
+      COMMAND_RPC_GET_BLOCKCHAIN_BASED_LIST_BIN::block_list& dst = res.blocks[i];
+
+      dst.block_height = lists[i].first;
+      dst.tiers.resize(lists[i].second.size());
+
+      for (size_t j=0; j<lists[i].second.size(); j++)
+      {
+        for (const BlockchainBasedList::supernode& sn : lists[i].second[j])
+        {
+          COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::supernode dst_sn;
+
+          dst_sn.supernode_public_id = sn.supernode_public_id;
+          dst_sn.amount              = sn.amount;
+
+          dst_sn.supernode_public_address = m_address_strings.get(m_core.get_nettype(), sn.supernode_public_address);
+
+          dst.tiers[j].supernodes.emplace_back(std::move(dst_sn));
+        }
+      }
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_outs(const COMMAND_RPC_GET_OUTPUTS::request& req, COMMAND_RPC_GET_OUTPUTS::response& res)
   {
     PERF_TIMER(on_get_outs);
@@ -414,6 +702,8 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUTS>(invoke_http_mode::JON, "/get_outs", req, res, r))
       return r;
 
+    db_read_session read_session(m_core.get_blockchain_storage());
+
     res.status = "Failed";
 
     if (m_restricted)
@@ -500,116 +790,159 @@ namespace cryptonote
     }
     LOG_PRINT_L2("Found " << txs.size() << "/" << vh.size() << " transactions on the blockchain");
 
-    // try the pool for any missing txes
-    size_t found_in_pool = 0;
-    std::unordered_set<crypto::hash> pool_tx_hashes;
-    std::unordered_map<crypto::hash, bool> double_spend_seen;
-    if (!missed_txs.empty())
-    {
-      std::vector<tx_info> pool_tx_info;
-      std::vector<spent_key_image_info> pool_key_image_info;
-      bool r = m_core.get_pool_transactions_and_spent_keys_info(pool_tx_info, pool_key_image_info);
-      if(r)
-      {
-        // sort to match original request
-        std::vector<transaction> sorted_txs;
-        std::vector<tx_info>::const_iterator i;
-        unsigned txs_processed = 0;
-        for (const crypto::hash &h: vh)
+    // index in the request of each tx, and the pool state of those found there
+    std::vector<size_t> tx_indices;
+    std::vector<char> in_pool;
+    std::vector<char> double_spend_seen;
+    if (missed_txs.empty())
+    {
+      tx_indices.resize(txs.size());
+      for (size_t n = 0; n < tx_indices.size(); ++n)
+        tx_indices[n] = n;
+      in_pool.resize(txs.size(), 0);
+      double_spend_seen.resize(txs.size(), 0);
+    }
+    else
+    {
+      // try the pool for any missing txes, looking them up by hash
+      std::vector<cryptonote::blobdata> pool_tx_blobs;
+      std::vector<bool> pool_double_spend_seen;
+      if (!m_core.get_pool().get_transactions(missed_txs, pool_tx_blobs, pool_double_spend_seen))
+      {
+        pool_tx_blobs.assign(missed_txs.size(), cryptonote::blobdata());
+        pool_double_spend_seen.assign(missed_txs.size(), false);
+      }
+      std::unordered_map<crypto::hash, size_t> missed_index;
+      for (size_t n = 0; n < missed_txs.size(); ++n)
+        missed_index.emplace(missed_txs[n], n);
+
+      // sort to match original request
+      std::vector<transaction> sorted_txs;
+      std::vector<char> still_missed(missed_txs.size(), 1);
+      size_t txs_processed = 0, found_in_pool = 0;
+      for (size_t n = 0; n < vh.size(); ++n)
+      {
+        const crypto::hash &h = vh[n];
+        auto missed = missed_index.find(h);
+        if (missed == missed_index.end())
         {
-          if (std::find(missed_txs.begin(), missed_txs.end(), h) == missed_txs.end())
+          if (txs.size() == txs_processed)
           {
-            if (txs.size() == txs_processed)
-            {
-              res.status = "Failed: internal error - txs is empty";
-              return true;
-            }
-            // core returns the ones it finds in the right order
-            if (get_transaction_hash(txs[txs_processed]) != h)
-            {
-              res.status = "Failed: tx hash mismatch";
-              return true;
-            }
-            sorted_txs.push_back(std::move(txs[txs_processed]));
-            ++txs_processed;
+            res.status = "Failed: internal error - txs is empty";
+            return true;
           }
-          else if ((i = std::find_if(pool_tx_info.begin(), pool_tx_info.end(), [h](const tx_info &txi) { return epee::string_tools::pod_to_hex(h) == txi.id_hash; })) != pool_tx_info.end())
+          // core returns the ones it finds in the right order
+          if (get_transaction_hash(txs[txs_processed]) != h)
           {
-            cryptonote::transaction tx;
-            if (!cryptonote::parse_and_validate_tx_from_blob(i->tx_blob, tx))
-            {
-              res.status = "Failed to parse and validate tx from blob";
-              return true;
-            }
-            sorted_txs.push_back(tx);
-            missed_txs.erase(std::find(missed_txs.begin(), missed_txs.end(), h));
-            pool_tx_hashes.insert(h);
-            const std::string hash_string = epee::string_tools::pod_to_hex(h);
-            for (const auto &ti: pool_tx_info)
-            {
-              if (ti.id_hash == hash_string)
-              {
-                double_spend_seen.insert(std::make_pair(h, ti.double_spend_seen));
-                break;
-              }
-            }
-            ++found_in_pool;
+            res.status = "Failed: tx hash mismatch";
+            return true;
+          }
+          sorted_txs.push_back(std::move(txs[txs_processed]));
+          ++txs_processed;
+          in_pool.push_back(0);
+          double_spend_seen.push_back(0);
+        }
+        else if (!pool_tx_blobs[missed->second].empty())
+        {
+          cryptonote::transaction tx;
+          if (!cryptonote::parse_and_validate_tx_from_blob(pool_tx_blobs[missed->second], tx, h))
+          {
+            res.status = "Failed to parse and validate tx from blob";
+            return true;
           }
+          sorted_txs.push_back(std::move(tx));
+          still_missed[missed->second] = 0;
+          in_pool.push_back(1);
+          double_spend_seen.push_back(pool_double_spend_seen[missed->second]);
+          ++found_in_pool;
         }
-        txs = sorted_txs;
+        else
+          continue;
+        tx_indices.push_back(n);
       }
+      txs = std::move(sorted_txs);
+      std::vector<crypto::hash> pool_missed_txs;
+      for (size_t n = 0; n < missed_txs.size(); ++n)
+        if (still_missed[n])
+          pool_missed_txs.push_back(missed_txs[n]);
+      missed_txs = std::move(pool_missed_txs);
       LOG_PRINT_L2("Found " << found_in_pool << "/" << vh.size() << " transactions in the pool");
     }
 
-    std::vector<std::string>::const_iterator txhi = req.txs_hashes.begin();
-    std::vector<crypto::hash>::const_iterator vhi = vh.begin();
-    for(auto& tx: txs)
-    {
-      res.txs.push_back(COMMAND_RPC_GET_TRANSACTIONS::entry());
-      COMMAND_RPC_GET_TRANSACTIONS::entry &e = res.txs.back();
-
-      crypto::hash tx_hash = *vhi++;
-      e.tx_hash = *txhi++;
-      blobdata blob = req.prune ? get_pruned_tx_blob(tx) : t_serializable_object_to_blob(tx);
-      e.as_hex = string_tools::buff_to_hex_nodelimer(blob);
-      if (req.decode_as_json)
-        e.as_json = req.prune ? get_pruned_tx_json(tx) : obj_to_json_str(tx);
-      e.in_pool = pool_tx_hashes.find(tx_hash) != pool_tx_hashes.end();
-      if (e.in_pool)
+    // encoding is split over the threadpool for large batches, each part reading the db in a txn of its own
+    res.txs.resize(txs.size());
+    res.txs_as_hex.resize(txs.size());
+    if (req.decode_as_json)
+      res.txs_as_json.resize(txs.size());
+    std::atomic<bool> failed(false);
+    auto fill_entries = [&](size_t start, size_t end) {
+      db_rtxn_guard rtxn_guard(m_core.get_blockchain_storage().get_db());
+      for (size_t n = start; n < end && !failed; ++n)
       {
-        e.block_height = e.block_timestamp = std::numeric_limits<uint64_t>::max();
-        if (double_spend_seen.find(tx_hash) != double_spend_seen.end())
+        transaction &tx = txs[n];
+        COMMAND_RPC_GET_TRANSACTIONS::entry &e = res.txs[n];
+
+        const crypto::hash &tx_hash = vh[tx_indices[n]];
+        e.tx_hash = req.txs_hashes[tx_indices[n]];
+        blobdata blob = req.prune ? get_pruned_tx_blob(tx) : t_serializable_object_to_blob(tx);
+        e.as_hex = string_tools::buff_to_hex_nodelimer(blob);
+        if (req.decode_as_json)
+          e.as_json = req.prune ? get_pruned_tx_json(tx) : obj_to_json_str(tx);
+        e.in_pool = in_pool[n];
+        if (e.in_pool)
         {
-          e.double_spend_seen = double_spend_seen[tx_hash];
+          e.block_height = e.block_timestamp = std::numeric_limits<uint64_t>::max();
+          e.double_spend_seen = double_spend_seen[n];
         }
         else
         {
-          MERROR("Failed to determine double spend status for " << tx_hash);
+          e.block_height = m_core.get_blockchain_storage().get_db().get_tx_block_height(tx_hash);
+          e.block_timestamp = m_core.get_blockchain_storage().get_db().get_block_timestamp(e.block_height);
           e.double_spend_seen = false;
         }
-      }
-      else
-      {
-        e.block_height = m_core.get_blockchain_storage().get_db().get_tx_block_height(tx_hash);
-        e.block_timestamp = m_core.get_blockchain_storage().get_db().get_block_timestamp(e.block_height);
-        e.double_spend_seen = false;
-      }
 
-      // fill up old style responses too, in case an old wallet asks
-      res.txs_as_hex.push_back(e.as_hex);
-      if (req.decode_as_json)
-        res.txs_as_json.push_back(e.as_json);
+        // fill up old style responses too, in case an old wallet asks
+        res.txs_as_hex[n] = e.as_hex;
+        if (req.decode_as_json)
+          res.txs_as_json[n] = e.as_json;
+
+        // output indices too if not in pool
+        if (!e.in_pool && !get_tx_outputs_gindexs(m_core.get_blockchain_storage().get_db(), tx_hash, e.output_indices))
+          failed = true;
+      }
+    };
 
-      // output indices too if not in pool
-      if (pool_tx_hashes.find(tx_hash) == pool_tx_hashes.end())
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), txs.size() / GET_TRANSACTIONS_PER_THREAD_MIN));
+    if (threads == 1)
+    {
+      fill_entries(0, txs.size());
+    }
+    else
+    {
+      const size_t per_thread = (txs.size() + threads - 1) / threads;
+      tools::threadpool::waiter waiter;
+      for (size_t start = 0; start < txs.size(); start += per_thread)
       {
-        bool r = m_core.get_tx_outputs_gindexs(tx_hash, e.output_indices);
-        if (!r)
-        {
-          res.status = "Failed";
-          return false;
-        }
+        const size_t end = std::min(start + per_thread, txs.size());
+        tpool.submit(&waiter, [&, start, end]() {
+          try
+          {
+            fill_entries(start, end);
+          }
+          catch (const std::exception &e)
+          {
+            MERROR("Failed to fill transaction entries: " << e.what());
+            failed = true;
+          }
+        }, true);
       }
+      waiter.wait(&tpool);
+    }
+    if (failed)
+    {
+      res.status = "Failed";
+      return false;
     }
 
     for(const auto& miss_tx: missed_txs)
@@ -641,6 +974,7 @@ namespace cryptonote
       if(b.size() != sizeof(crypto::key_image))
       {
         res.status = "Failed, size of data mismatch";
+        return true;
       }
       key_images.push_back(*reinterpret_cast<const crypto::key_image*>(b.data()));
     }
@@ -655,35 +989,17 @@ namespace cryptonote
     for (size_t n = 0; n < spent_status.size(); ++n)
       res.spent_status.push_back(spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
 
-    // check the pool too
-    std::vector<cryptonote::tx_info> txs;
-    std::vector<cryptonote::spent_key_image_info> ki;
-    r = m_core.get_pool_transactions_and_spent_keys_info(txs, ki, !request_has_rpc_origin || !m_restricted);
+    // check the pool too, looking the key images up in its index
+    std::vector<bool> pool_spent_status;
+    r = m_core.are_key_images_spent_in_pool(key_images, pool_spent_status, !request_has_rpc_origin || !m_restricted);
     if(!r)
     {
       res.status = "Failed";
       return true;
     }
-    for (std::vector<cryptonote::spent_key_image_info>::const_iterator i = ki.begin(); i != ki.end(); ++i)
-    {
-      crypto::hash hash;
-      crypto::key_image spent_key_image;
-      if (parse_hash256(i->id_hash, hash))
-      {
-        memcpy(&spent_key_image, &hash, sizeof(hash)); // a bit dodgy, should be other parse functions somewhere
-        for (size_t n = 0; n < res.spent_status.size(); ++n)
-        {
-          if (res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT)
-          {
-            if (key_images[n] == spent_key_image)
-            {
-              res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
-              break;
-            }
-          }
-        }
-      }
-    }
+    for (size_t n = 0; n < res.spent_status.size(); ++n)
+      if (res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT && pool_spent_status[n])
+        res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -698,6 +1014,14 @@ namespace cryptonote
 
     CHECK_CORE_READY();
 
+    if (m_core.replica())
+    {
+      // the txpool belongs to the daemon writing the blockchain
+      res.status = "Failed";
+      res.reason = "transactions are not accepted by a read-only replica";
+      return true;
+    }
+
     std::string tx_blob;
     if(!string_tools::parse_hexstr_to_binbuff(req.tx_as_hex, tx_blob))
     {
@@ -837,6 +1161,7 @@ namespace cryptonote
     if ( lMiner.is_mining() ) {
       res.speed = lMiner.get_speed();
       res.threads_count = lMiner.get_threads_count();
+      res.threads_speed = lMiner.get_threads_speed();
       const account_public_address& lMiningAdr = lMiner.get_mining_address();
       res.address = get_account_address_as_str(m_nettype, false, lMiningAdr);
     }
@@ -924,6 +1249,60 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_trace(const COMMAND_RPC_TRACE::request& req, COMMAND_RPC_TRACE::response& res)
+  {
+    PERF_TIMER(on_trace);
+    res.events = 0;
+    if (req.action == "start")
+      tools::trace::enable(true);
+    else if (req.action == "stop")
+      tools::trace::enable(false);
+    else if (req.action == "clear")
+      tools::trace::clear();
+    else if (req.action == "dump")
+    {
+      if (req.file.empty())
+      {
+        res.status = "Error: no file given";
+        return true;
+      }
+      size_t events = 0;
+      if (!tools::trace::write_chrome_trace(req.file, events))
+      {
+        res.status = "Error: failed to write " + req.file;
+        return true;
+      }
+      res.events = events;
+    }
+    else if (req.action != "stats")
+    {
+      res.status = "Error: unknown action, expected start, stop, clear, stats or dump";
+      return true;
+    }
+
+    if (req.action == "stats")
+    {
+      for (const tools::trace::histogram &h: tools::trace::get_histograms())
+        res.histograms.push_back({h.name, h.count, h.total_ns, h.max_ns, h.percentile_ns(0.5), h.percentile_ns(0.99)});
+    }
+    res.enabled = tools::trace::enabled();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_memory_stats(const COMMAND_RPC_GET_MEMORY_STATS::request& req, COMMAND_RPC_GET_MEMORY_STATS::response& res)
+  {
+    PERF_TIMER(on_get_memory_stats);
+    res.total = 0;
+    for (const tools::memory::stat &s: tools::memory::get_stats())
+    {
+      res.entries.push_back({s.subsystem, s.bytes});
+      res.total += s.bytes;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request& req, COMMAND_RPC_GET_TRANSACTION_POOL::response& res, bool request_has_rpc_origin)
   {
     PERF_TIMER(on_get_transaction_pool);
@@ -945,7 +1324,36 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN>(invoke_http_mode::JON, "/get_transaction_pool_hashes.bin", req, res, r))
       return r;
 
-    m_core.get_pool_transaction_hashes(res.tx_hashes, !request_has_rpc_origin || !m_restricted);
+    // read before the hashes, so a change in between shows up as a new cookie next time
+    res.cookie = m_core.get_pool_cookie();
+    res.unchanged = req.cookie != 0 && req.cookie == res.cookie;
+    if (!res.unchanged)
+      m_core.get_pool_transaction_hashes(res.tx_hashes, !request_has_rpc_origin || !m_restricted);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_transaction_pool_added_bin(const COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN::response& res)
+  {
+    PERF_TIMER(on_get_transaction_pool_added_bin);
+
+    static const uint64_t MAX_WAIT_MILLIS = 20000;
+
+    std::vector<crypto::hash> tx_hashes;
+    res.complete = m_core.wait_added_pool_transactions(req.start, std::chrono::milliseconds(std::min(req.wait_millis, MAX_WAIT_MILLIS)), tx_hashes, res.next);
+
+    res.tx_hashes.reserve(tx_hashes.size());
+    res.txs.reserve(tx_hashes.size());
+
+    for (const crypto::hash &tx_hash: tx_hashes)
+    {
+      cryptonote::blobdata blob;
+      if (!m_core.get_pool_transaction(tx_hash, blob))
+        continue; // already mined or dropped
+      res.tx_hashes.push_back(tx_hash);
+      res.txs.push_back(std::move(blob));
+    }
+
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -1084,6 +1492,31 @@ namespace cryptonote
       return false;
     }
 
+    // the restricted RPC doesn't long-poll, so that clients can't tie up its workers, and past the
+    // longpolls limit the template is returned right away
+    if (!req.longpoll_prev_hash.empty())
+    {
+      crypto::hash longpoll_prev_hash;
+      if (!epee::string_tools::hex_to_pod(req.longpoll_prev_hash, longpoll_prev_hash))
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+        error_resp.message = "Failed to parse longpoll_prev_hash";
+        return false;
+      }
+      if (!m_restricted)
+      {
+        const size_t longpolls = ++m_longpolls;
+        auto longpoll_done = epee::misc_utils::create_scope_leave_handler([this]() { --m_longpolls; });
+        if (longpolls <= m_max_longpolls)
+        {
+          const uint64_t timeout = req.longpoll_timeout ? std::min<uint64_t>(req.longpoll_timeout, GETBLOCKTEMPLATE_LONGPOLL_MAX_TIMEOUT) : GETBLOCKTEMPLATE_LONGPOLL_MAX_TIMEOUT;
+          m_core.get_blockchain_storage().wait_for_template_change(longpoll_prev_hash, req.longpoll_pool_cookie, req.longpoll_pool_changes, std::chrono::seconds(timeout));
+        }
+      }
+    }
+
+    // read before making the template, so that changes made meanwhile end the next long-poll
+    res.pool_cookie = m_core.get_pool().cookie();
     block b = AUTO_VAL_INIT(b);
     cryptonote::blobdata blob_reserve;
     blob_reserve.resize(req.reserve_size, 0);
@@ -1288,6 +1721,28 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::fill_block_header_response(const Blockchain::tip_snapshot& tip, block_header_response& response)
+  {
+    PERF_TIMER(fill_block_header_response);
+    const block& blk = tip.top_block;
+    response.major_version = blk.major_version;
+    response.minor_version = blk.minor_version;
+    response.timestamp = blk.timestamp;
+    response.prev_hash = string_tools::pod_to_hex(blk.prev_id);
+    response.nonce = blk.nonce;
+    response.orphan_status = false;
+    response.height = tip.height - 1;
+    response.depth = 0;
+    response.hash = string_tools::pod_to_hex(tip.top_hash);
+    response.difficulty = tip.top_difficulty;
+    response.cumulative_difficulty = tip.cumulative_difficulty;
+    response.reward = get_block_reward(blk);
+    response.block_size = response.block_weight = tip.top_block_weight;
+    response.num_txes = blk.tx_hashes.size();
+    response.pow_hash = "";
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   template <typename COMMAND_TYPE>
   bool core_rpc_server::use_bootstrap_daemon_if_necessary(const invoke_http_mode &mode, const std::string &command_name, const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, bool &r)
   {
@@ -1363,18 +1818,15 @@ namespace cryptonote
       return r;
 
     CHECK_CORE_READY();
-    uint64_t last_block_height;
-    crypto::hash last_block_hash;
-    m_core.get_blockchain_top(last_block_height, last_block_hash);
-    block last_block;
-    bool have_last_block = m_core.get_block_by_hash(last_block_hash, last_block);
-    if (!have_last_block)
+    const auto tip = m_core.get_blockchain_storage().get_tip_snapshot();
+    if (!tip)
     {
       error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
       error_resp.message = "Internal error: can't get last block.";
       return false;
     }
-    bool response_filled = fill_block_header_response(last_block, false, last_block_height, last_block_hash, res.block_header, req.fill_pow_hash);
+    bool response_filled = req.fill_pow_hash ? fill_block_header_response(tip->top_block, false, tip->height - 1, tip->top_hash, res.block_header, true)
+        : fill_block_header_response(*tip, res.block_header);
     if (!response_filled)
     {
       error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
@@ -1476,6 +1928,85 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_headers_range_bin(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::response& res)
+  {
+    PERF_TIMER(on_get_block_headers_range_bin);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN>(invoke_http_mode::BIN, "/get_block_headers_range.bin", req, res, r))
+      return r;
+
+    db_read_session read_session(m_core.get_blockchain_storage());
+    const uint64_t bc_height = m_core.get_current_blockchain_height();
+    if (req.start_height >= bc_height || req.end_height >= bc_height || req.start_height > req.end_height)
+    {
+      res.status = "Invalid start/end heights";
+      return true;
+    }
+    const uint64_t count = req.end_height - req.start_height + 1;
+    if (count > COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN_MAX_COUNT)
+    {
+      res.status = "Too many blocks requested, at most " + std::to_string(COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN_MAX_COUNT);
+      return true;
+    }
+
+    const BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    try
+    {
+      std::vector<block_info_t> infos;
+      db.get_block_infos_from_height(req.start_height, count, infos);
+      res.start_height = req.start_height;
+      res.hashes.reserve(count);
+      res.timestamps.reserve(count);
+      res.weights.reserve(count);
+      res.cumulative_difficulties.reserve(count);
+      res.already_generated_coins.reserve(count);
+      res.cumulative_rct_outputs.reserve(count);
+      for (const block_info_t &info: infos)
+      {
+        res.hashes.push_back(info.hash);
+        res.timestamps.push_back(info.timestamp);
+        res.weights.push_back(info.weight);
+        res.cumulative_difficulties.push_back(info.cumulative_difficulty);
+        res.already_generated_coins.push_back(info.already_generated_coins);
+        res.cumulative_rct_outputs.push_back(info.cumulative_rct_outputs);
+      }
+
+      if (req.include_block_fields)
+      {
+        std::vector<cryptonote::blobdata> blobs;
+        db.get_block_blobs_from_height(req.start_height, count, blobs);
+        res.major_versions.reserve(count);
+        res.minor_versions.reserve(count);
+        res.nonces.reserve(count);
+        res.rewards.reserve(count);
+        res.num_txes.reserve(count);
+        for (const cryptonote::blobdata &blob: blobs)
+        {
+          block blk;
+          if (!parse_and_validate_block_from_blob(blob, blk))
+          {
+            res.status = "Failed to parse block";
+            return true;
+          }
+          res.major_versions.push_back(blk.major_version);
+          res.minor_versions.push_back(blk.minor_version);
+          res.nonces.push_back(blk.nonce);
+          res.rewards.push_back(get_block_reward(blk));
+          res.num_txes.push_back(blk.tx_hashes.size());
+        }
+      }
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to get block headers: " << e.what());
+      res.status = "Failed";
+      return true;
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_block_header_by_height(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response& res, epee::json_rpc::error& error_resp){
     PERF_TIMER(on_get_block_header_by_height);
     bool r;
@@ -1594,16 +2125,21 @@ namespace cryptonote
       return r;
     }
 
-    crypto::hash top_hash;
-    m_core.get_blockchain_top(res.height, top_hash);
-    ++res.height; // turn top block height into blockchain height
-    res.top_block_hash = string_tools::pod_to_hex(top_hash);
+    // read from the published tip, so this doesn't wait for the blockchain or pool locks while a block is verified
+    const auto tip = m_core.get_blockchain_storage().get_tip_snapshot();
+    if (!tip)
+    {
+      res.status = "Failed";
+      return false;
+    }
+    res.height = tip->height;
+    res.top_block_hash = string_tools::pod_to_hex(tip->top_hash);
     res.target_height = m_core.get_target_blockchain_height();
-    res.difficulty = m_core.get_blockchain_storage().get_difficulty_for_next_block();
+    res.difficulty = tip->next_difficulty;
     res.target = m_core.get_blockchain_storage().get_current_hard_fork_version() < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2;
-    res.tx_count = m_core.get_blockchain_storage().get_total_transactions() - res.height; //without coinbase
-    res.tx_pool_size = m_core.get_pool_transactions_count();
-    res.alt_blocks_count = m_core.get_blockchain_storage().get_alternative_blocks_count();
+    res.tx_count = tip->tx_count - res.height; //without coinbase
+    res.tx_pool_size = m_core.get_pool().get_transactions_count_unlocked();
+    res.alt_blocks_count = tip->alt_blocks_count;
     uint64_t total_conn = m_p2p.get_connections_count();
     res.outgoing_connections_count = m_p2p.get_outgoing_connections_count();
     res.incoming_connections_count = total_conn - res.outgoing_connections_count;
@@ -1614,9 +2150,9 @@ namespace cryptonote
     res.testnet = m_nettype == TESTNET;
     res.stagenet = m_nettype == STAGENET;
     res.nettype = m_nettype == MAINNET ? "mainnet" : m_nettype == TESTNET ? "testnet" : m_nettype == STAGENET ? "stagenet" : "fakechain";
-    res.cumulative_difficulty = m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(res.height - 1);
-    res.block_size_limit = res.block_weight_limit = m_core.get_blockchain_storage().get_current_cumulative_block_weight_limit();
-    res.block_size_median = res.block_weight_median = m_core.get_blockchain_storage().get_current_cumulative_block_weight_median();
+    res.cumulative_difficulty = tip->cumulative_difficulty;
+    res.block_size_limit = res.block_weight_limit = tip->block_weight_limit;
+    res.block_size_median = res.block_weight_median = tip->block_weight_median;
     res.status = CORE_RPC_STATUS_OK;
     res.start_time = (uint64_t)m_core.get_start_time();
     res.free_space = m_restricted ? std::numeric_limits<uint64_t>::max() : m_core.get_free_space();
@@ -2041,6 +2577,71 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  template <typename REQUEST, typename RESPONSE>
+  bool core_rpc_server::call_light_wallet_server(bool (light_wallet_server::*handler)(const REQUEST&, RESPONSE&), const REQUEST& req, RESPONSE& res)
+  {
+    try
+    {
+      return (m_light_wallet_server->*handler)(req, res);
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Light wallet request failed: " << e.what());
+      return false;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res)
+  {
+    PERF_TIMER(on_login);
+    return call_light_wallet_server(&light_wallet_server::on_login, req, res);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res)
+  {
+    PERF_TIMER(on_import_wallet_request);
+    return call_light_wallet_server(&light_wallet_server::on_import_wallet_request, req, res);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res)
+  {
+    PERF_TIMER(on_get_address_info);
+    return call_light_wallet_server(&light_wallet_server::on_get_address_info, req, res);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res)
+  {
+    PERF_TIMER(on_get_address_txs);
+    return call_light_wallet_server(&light_wallet_server::on_get_address_txs, req, res);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res)
+  {
+    PERF_TIMER(on_get_unspent_outs);
+    return call_light_wallet_server(&light_wallet_server::on_get_unspent_outs, req, res);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_random_outs(const COMMAND_RPC_GET_RANDOM_OUTS::request& req, COMMAND_RPC_GET_RANDOM_OUTS::response& res)
+  {
+    PERF_TIMER(on_get_random_outs);
+    return call_light_wallet_server(&light_wallet_server::on_get_random_outs, req, res);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_submit_raw_tx(const COMMAND_RPC_SUBMIT_RAW_TX::request& req, COMMAND_RPC_SUBMIT_RAW_TX::response& res)
+  {
+    PERF_TIMER(on_submit_raw_tx);
+    COMMAND_RPC_SEND_RAW_TX::request send_req;
+    COMMAND_RPC_SEND_RAW_TX::response send_res;
+    send_req.tx_as_hex = req.tx;
+    send_req.do_not_relay = false;
+    if (!on_send_raw_tx(send_req, send_res))
+      return false;
+    // the light wallet status strings
+    res.status = send_res.status == CORE_RPC_STATUS_OK ? "success" : "error";
+    res.error = send_res.status == CORE_RPC_STATUS_OK ? std::string() : send_res.reason.empty() ? send_res.status : send_res.reason;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_relay_tx(const COMMAND_RPC_RELAY_TX::request& req, COMMAND_RPC_RELAY_TX::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_relay_tx);
@@ -2091,14 +2692,24 @@ namespace cryptonote
   {
     PERF_TIMER(on_sync_info);
 
-    crypto::hash top_hash;
-    m_core.get_blockchain_top(res.height, top_hash);
-    ++res.height; // turn top block height into blockchain height
+    const auto tip = m_core.get_blockchain_storage().get_tip_snapshot();
+    res.height = tip ? tip->height : m_core.get_current_blockchain_height();
     res.target_height = m_core.get_target_blockchain_height();
 
-    for (const auto &c: m_p2p.get_payload_object().get_connections())
-      res.peers.push_back({c});
     const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
+    const uint64_t default_span_size = m_core.get_block_sync_size(res.height);
+    for (const auto &c: m_p2p.get_payload_object().get_connections())
+    {
+      boost::uuids::uuid connection_id;
+      cryptonote::block_queue::peer_stats stats;
+      res.peers.push_back({c, 0, 0, default_span_size});
+      if (epee::string_tools::hex_to_pod(c.connection_id, connection_id) && block_queue.get_peer_stats(connection_id, stats))
+      {
+        res.peers.back().rate = (uint32_t)(stats.rate + 0.5f);
+        res.peers.back().nblocks = stats.nblocks;
+        res.peers.back().span_size = block_queue.get_span_size(connection_id, default_span_size, BLOCKS_SYNCHRONIZING_MAX_COUNT);
+      }
+    }
     block_queue.foreach([&](const cryptonote::block_queue::span &span) {
       const std::string span_connection_id = epee::string_tools::pod_to_hex(span.connection_id);
       uint32_t speed = (uint32_t)(100.0f * block_queue.get_speed(span.connection_id) + 0.5f);
@@ -2139,25 +2750,52 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUT_DISTRIBUTION>(invoke_http_mode::JON_RPC, "get_output_distribution", req, res, r))
       return r;
 
+    db_read_session read_session(m_core.get_blockchain_storage());
+
     try
     {
       // 0 is placeholder for the whole chain
       const uint64_t req_to_height = req.to_height ? req.to_height : (m_core.get_current_blockchain_height() - 1);
       for (uint64_t amount: req.amounts)
       {
+        // the rct distribution is kept for the latest from_height and extended or cut to the
+        // requested height, so wallets asking up to the current top only read the new blocks
         static struct D
         {
           boost::mutex mutex;
           std::vector<uint64_t> cached_distribution;
           uint64_t cached_from, cached_to, cached_start_height, cached_base;
+          crypto::hash cached_top_hash;
           bool cached;
-          D(): cached_from(0), cached_to(0), cached_start_height(0), cached_base(0), cached(false) {}
+          D(): cached_from(0), cached_to(0), cached_start_height(0), cached_base(0), cached_top_hash(crypto::null_hash), cached(false) {}
         } d;
         boost::unique_lock<boost::mutex> lock(d.mutex);
 
-        if (d.cached && amount == 0 && d.cached_from == req.from_height && d.cached_to == req_to_height)
+        if (d.cached && amount == 0 && d.cached_from == req.from_height && m_core.get_block_id_by_height(d.cached_to) != d.cached_top_hash)
+          d.cached = false; // reorganized below the cached top
+
+        const uint64_t cached_offset = std::max(d.cached_from, d.cached_start_height);
+        if (d.cached && amount == 0 && d.cached_from == req.from_height && req_to_height >= cached_offset)
         {
-          res.distributions.push_back({amount, d.cached_start_height, req.binary, d.cached_distribution, d.cached_base});
+          if (req_to_height > d.cached_to)
+          {
+            std::vector<uint64_t> extension;
+            uint64_t extension_start_height, extension_base;
+            if (!m_core.get_output_distribution(amount, d.cached_to + 1, req_to_height, extension_start_height, extension, extension_base)
+              || extension_start_height != d.cached_to + 1)
+            {
+              error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+              error_resp.message = "Failed to get rct distribution";
+              return false;
+            }
+            extension.resize(std::min<uint64_t>(extension.size(), req_to_height - d.cached_to));
+            d.cached_distribution.insert(d.cached_distribution.end(), extension.begin(), extension.end());
+            d.cached_to += extension.size();
+            d.cached_top_hash = m_core.get_block_id_by_height(d.cached_to);
+          }
+
+          const size_t size = std::min<uint64_t>(d.cached_distribution.size(), req_to_height - cached_offset + 1);
+          res.distributions.push_back({amount, d.cached_start_height, req.binary, std::vector<uint64_t>(d.cached_distribution.begin(), d.cached_distribution.begin() + size), d.cached_base});
           if (!req.cumulative)
           {
             auto &distribution = res.distributions.back().distribution;
@@ -2183,10 +2821,12 @@ namespace cryptonote
             distribution.resize(req_to_height - offset + 1);
         }
 
-        if (amount == 0)
+        // incremental requests from wallets keeping their own copy don't replace the whole distribution
+        if (amount == 0 && !distribution.empty() && (!d.cached || req.from_height <= d.cached_from))
         {
           d.cached_from = req.from_height;
-          d.cached_to = req_to_height;
+          d.cached_to = std::max(req.from_height, start_height) + distribution.size() - 1;
+          d.cached_top_hash = m_core.get_block_id_by_height(d.cached_to);
           d.cached_distribution = distribution;
           d.cached_start_height = start_height;
           d.cached_base = base;
@@ -2232,7 +2872,7 @@ namespace cryptonote
       LOG_PRINT_L0("RPC Request: on_supernode_stakes: start");
       // send p2p stakes
       m_p2p.add_supernode(req.supernode_public_id, req.network_address);
-      m_p2p.send_stakes_to_supernode();
+      m_p2p.send_stakes_to_supernode(req.supernode_public_id, req.last_received_block_height);
       res.status = 0;
       LOG_PRINT_L0("RPC Request: on_supernode_stakes: end");
       return true;
@@ -2244,7 +2884,7 @@ namespace cryptonote
       LOG_PRINT_L0("RPC Request: on_supernode_blockchain_based_list: start");
       // send p2p stake txs
       m_p2p.add_supernode(req.supernode_public_id, req.network_address);
-      m_p2p.send_blockchain_based_list_to_supernode(req.last_received_block_height);
+      m_p2p.send_blockchain_based_list_to_supernode(req.supernode_public_id, req.last_received_block_height);
       res.status = 0;
       LOG_PRINT_L0("RPC Request: on_supernode_blockchain_based_list: end");
       return true;
@@ -2329,6 +2969,46 @@ namespace cryptonote
       return true;
   }
 
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_broadcast_bin(const COMMAND_RPC_BROADCAST::request& req, COMMAND_RPC_BROADCAST::response& res)
+  {
+      // data holds raw bytes, the message is relayed as is and delivered to supernodes in binary requests
+      COMMAND_RPC_BROADCAST::request binary_req = req;
+      binary_req.binary_data = true;
+      json_rpc::error error_resp;
+      if (!on_broadcast(binary_req, res, error_resp))
+      {
+          MERROR("on_broadcast_bin: " << error_resp.message);
+          return false;
+      }
+      return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_multicast_bin(const COMMAND_RPC_MULTICAST::request& req, COMMAND_RPC_MULTICAST::response& res)
+  {
+      COMMAND_RPC_MULTICAST::request binary_req = req;
+      binary_req.binary_data = true;
+      json_rpc::error error_resp;
+      if (!on_multicast(binary_req, res, error_resp))
+      {
+          MERROR("on_multicast_bin: " << error_resp.message);
+          return false;
+      }
+      return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_unicast_bin(const COMMAND_RPC_UNICAST::request& req, COMMAND_RPC_UNICAST::response& res)
+  {
+      COMMAND_RPC_UNICAST::request binary_req = req;
+      binary_req.binary_data = true;
+      json_rpc::error error_resp;
+      if (!on_unicast(binary_req, res, error_resp))
+      {
+          MERROR("on_unicast_bin: " << error_resp.message);
+          return false;
+      }
+      return true;
+  }
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_tunnels(const COMMAND_RPC_TUNNEL_DATA::request &req, COMMAND_RPC_TUNNEL_DATA::response &res, json_rpc::error &error_resp)
   {
@@ -2357,6 +3037,86 @@ namespace cryptonote
 
   //------------------------------------------------------------------------------------------------------------------------------
 
+  bool core_rpc_server::on_get_metrics(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& context)
+  {
+      if (m_restricted)
+      {
+          response_info.m_response_code = 403;
+          response_info.m_response_comment = "Forbidden";
+          return true;
+      }
+
+      response_info.m_response_code = 200;
+      response_info.m_response_comment = "Ok";
+      response_info.m_mime_tipe = "text/plain; version=0.0.4";
+      response_info.m_body = m_p2p.get_metrics();
+
+      const BlockchainDB::resize_stats resize_stats = m_core.get_blockchain_storage().get_db().get_resize_stats();
+      std::ostringstream out;
+      out << std::fixed << std::setprecision(6);
+      out << "# HELP graft_db_resizes_total Database map resizes, done while a write waited (sync) or ahead of need (background)\n";
+      out << "# TYPE graft_db_resizes_total counter\n";
+      out << "graft_db_resizes_total{kind=\"sync\"} " << resize_stats.resizes << '\n';
+      out << "graft_db_resizes_total{kind=\"background\"} " << resize_stats.background_resizes << '\n';
+      out << "# HELP graft_db_resize_stall_seconds_total Time database transactions were held off by map resizes\n";
+      out << "# TYPE graft_db_resize_stall_seconds_total counter\n";
+      out << "graft_db_resize_stall_seconds_total " << resize_stats.stall_micros / 1e6 << '\n';
+      out << "# HELP graft_db_resize_stall_seconds_max Longest time database transactions were held off by a map resize\n";
+      out << "# TYPE graft_db_resize_stall_seconds_max gauge\n";
+      out << "graft_db_resize_stall_seconds_max " << resize_stats.max_stall_micros / 1e6 << '\n';
+
+      // requests not to a URI with a limit of its own are counted under uri=""
+      const auto request_stats = get_request_stats();
+      out << "# HELP graft_rpc_requests_total RPC requests handed to the workers\n";
+      out << "# TYPE graft_rpc_requests_total counter\n";
+      for (const auto &e: request_stats)
+        out << "graft_rpc_requests_total{uri=\"" << e.first << "\"} " << e.second.handled << '\n';
+      out << "# HELP graft_rpc_queue_seconds_total Time RPC requests waited for a worker\n";
+      out << "# TYPE graft_rpc_queue_seconds_total counter\n";
+      for (const auto &e: request_stats)
+        out << "graft_rpc_queue_seconds_total{uri=\"" << e.first << "\"} " << e.second.queue_time_us / 1e6 << '\n';
+      out << "# HELP graft_rpc_queue_seconds_max Longest time an RPC request waited for a worker\n";
+      out << "# TYPE graft_rpc_queue_seconds_max gauge\n";
+      for (const auto &e: request_stats)
+        out << "graft_rpc_queue_seconds_max{uri=\"" << e.first << "\"} " << e.second.max_queue_time_us / 1e6 << '\n';
+      out << "# HELP graft_rpc_requests_running RPC requests being handled\n";
+      out << "# TYPE graft_rpc_requests_running gauge\n";
+      for (const auto &e: request_stats)
+        out << "graft_rpc_requests_running{uri=\"" << e.first << "\"} " << e.second.running << '\n';
+      out << "# HELP graft_rpc_requests_queued RPC requests waiting for their URI to get below its limit\n";
+      out << "# TYPE graft_rpc_requests_queued gauge\n";
+      for (const auto &e: request_stats)
+        out << "graft_rpc_requests_queued{uri=\"" << e.first << "\"} " << e.second.queued << '\n';
+
+      const rpc_response_cache::stats cache_stats = m_response_cache.get_stats();
+      out << "# HELP graft_rpc_response_cache_hits_total RPC responses served from the response cache\n";
+      out << "# TYPE graft_rpc_response_cache_hits_total counter\n";
+      out << "graft_rpc_response_cache_hits_total " << cache_stats.hits << '\n';
+      out << "# HELP graft_rpc_response_cache_misses_total Cacheable RPC responses which had to be computed\n";
+      out << "# TYPE graft_rpc_response_cache_misses_total counter\n";
+      out << "graft_rpc_response_cache_misses_total " << cache_stats.misses << '\n';
+      out << "# HELP graft_rpc_response_cache_evictions_total Valid RPC responses evicted to make room\n";
+      out << "# TYPE graft_rpc_response_cache_evictions_total counter\n";
+      out << "graft_rpc_response_cache_evictions_total " << cache_stats.evictions << '\n';
+      out << "# HELP graft_rpc_response_cache_bytes Size of the RPC responses in the response cache\n";
+      out << "# TYPE graft_rpc_response_cache_bytes gauge\n";
+      out << "graft_rpc_response_cache_bytes " << cache_stats.size << '\n';
+      const rpc_request_coalescer::stats coalescer_stats = m_request_coalescer.get_stats();
+      out << "# HELP graft_rpc_coalesced_requests_total RPC requests answered with the response of an identical one handled at the same time\n";
+      out << "# TYPE graft_rpc_coalesced_requests_total counter\n";
+      out << "graft_rpc_coalesced_requests_total " << coalescer_stats.shared << '\n';
+      out << "# HELP graft_txpool_transactions Transactions in the pool\n";
+      out << "# TYPE graft_txpool_transactions gauge\n";
+      out << "graft_txpool_transactions " << m_core.get_pool().get_transactions_count_unlocked() << '\n';
+
+      // tx pool, block verification, database commit and stake sync metrics
+      tools::metrics::write(out);
+      response_info.m_body += out.str();
+      return true;
+  }
+
+  //------------------------------------------------------------------------------------------------------------------------------
+
 
   const command_line::arg_descriptor<std::string, false, true, 2> core_rpc_server::arg_rpc_bind_port = {
       "rpc-bind-port"
@@ -2395,4 +3155,28 @@ namespace cryptonote
     , "Specify username:password for the bootstrap daemon login"
     , ""
     };
+
+  const command_line::arg_descriptor<uint32_t> core_rpc_server::arg_rpc_worker_threads = {
+      "rpc-worker-threads"
+    , "Number of threads handling RPC requests, 0 for one per core (at least 4)"
+    , 0
+    };
+
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_rpc_response_cache_size = {
+      "rpc-response-cache-size"
+    , "Size in MB of the cache of recent block, fee estimate, output distribution and info responses, 0 to disable"
+    , 16
+    };
+
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_rpc_compression_threshold = {
+      "rpc-compression-threshold"
+    , "Smallest RPC response in bytes compressed (gzip or zstd) for clients accepting it, 0 to disable"
+    , 4096
+    };
+
+  const command_line::arg_descriptor<bool> core_rpc_server::arg_rpc_acceptor_per_thread = {
+      "rpc-acceptor-per-thread"
+    , "Accept RPC connections on a SO_REUSEPORT listening socket per RPC thread, keeping each connection on the thread accepting it"
+    , false
+    };
 }  // namespace cryptonote
@@ -36,6 +36,9 @@
 #include "net/http_server_impl_base.h"
 #include "net/http_client.h"
 #include "core_rpc_server_commands_defs.h"
+#include "rpc_request_coalescer.h"
+#include "rpc_response_cache.h"
+#include "light_wallet_server.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "p2p/net_node.h"
 #include "cryptonote_protocol/cryptonote_protocol_handler.h"
@@ -58,6 +61,10 @@ namespace cryptonote
     static const command_line::arg_descriptor<bool> arg_restricted_rpc;
     static const command_line::arg_descriptor<std::string> arg_bootstrap_daemon_address;
     static const command_line::arg_descriptor<std::string> arg_bootstrap_daemon_login;
+    static const command_line::arg_descriptor<uint32_t> arg_rpc_worker_threads;
+    static const command_line::arg_descriptor<size_t> arg_rpc_response_cache_size;
+    static const command_line::arg_descriptor<size_t> arg_rpc_compression_threshold;
+    static const command_line::arg_descriptor<bool> arg_rpc_acceptor_per_thread;
 
     typedef epee::net_utils::connection_context_base connection_context;
 
@@ -74,22 +81,32 @@ namespace cryptonote
         const std::string& port
       );
     network_type nettype() const { return m_nettype; }
+    /// Serves the light wallet API with it, which isn't otherwise
+    void set_light_wallet_server(light_wallet_server* server) { m_light_wallet_server = server; }
 
     CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
 
     BEGIN_URI_MAP2()
       MAP_URI_AUTO_JON2("/get_height", on_get_height, COMMAND_RPC_GET_HEIGHT)
       MAP_URI_AUTO_JON2("/getheight", on_get_height, COMMAND_RPC_GET_HEIGHT)
-      MAP_URI_AUTO_BIN2("/get_blocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST)
-      MAP_URI_AUTO_BIN2("/getblocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST)
+      MAP_URI_AUTO_BIN2_COALESCED("/get_blocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST, m_request_coalescer)
+      MAP_URI_AUTO_BIN2_COALESCED("/getblocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST, m_request_coalescer)
+      MAP_URI_AUTO_BIN2("/get_blocks_compact.bin", on_get_blocks_compact, COMMAND_RPC_GET_BLOCKS_COMPACT)
       MAP_URI_AUTO_BIN2("/get_blocks_by_height.bin", on_get_blocks_by_height, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT)
       MAP_URI_AUTO_BIN2("/getblocks_by_height.bin", on_get_blocks_by_height, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT)
       MAP_URI_AUTO_BIN2("/get_hashes.bin", on_get_hashes, COMMAND_RPC_GET_HASHES_FAST)
+      MAP_URI_AUTO_BIN2("/get_block_headers_range.bin", on_get_block_headers_range_bin, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN)
       MAP_URI_AUTO_BIN2("/gethashes.bin", on_get_hashes, COMMAND_RPC_GET_HASHES_FAST)
       MAP_URI_AUTO_BIN2("/get_o_indexes.bin", on_get_indexes, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES)      
       MAP_URI_AUTO_BIN2("/get_outs.bin", on_get_outs_bin, COMMAND_RPC_GET_OUTPUTS_BIN)
-      MAP_URI_AUTO_JON2("/get_transactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
-      MAP_URI_AUTO_JON2("/gettransactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
+      MAP_URI_AUTO_BIN2("/get_auth_sample.bin", on_get_auth_sample_bin, COMMAND_RPC_GET_AUTH_SAMPLE_BIN)
+      MAP_URI_AUTO_BIN2("/get_supernode_stakes.bin", on_get_supernode_stakes_bin, COMMAND_RPC_GET_SUPERNODE_STAKES_BIN)
+      MAP_URI_AUTO_BIN2("/get_blockchain_based_list.bin", on_get_blockchain_based_list_bin, COMMAND_RPC_GET_BLOCKCHAIN_BASED_LIST_BIN)
+      MAP_URI_AUTO_BIN2_IF("/broadcast.bin", on_broadcast_bin, COMMAND_RPC_BROADCAST, !m_restricted)
+      MAP_URI_AUTO_BIN2_IF("/multicast.bin", on_multicast_bin, COMMAND_RPC_MULTICAST, !m_restricted)
+      MAP_URI_AUTO_BIN2_IF("/unicast.bin", on_unicast_bin, COMMAND_RPC_UNICAST, !m_restricted)
+      MAP_URI_AUTO_JON2_STREAM("/get_transactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
+      MAP_URI_AUTO_JON2_STREAM("/gettransactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
       MAP_URI_AUTO_JON2("/get_alt_blocks_hashes", on_get_alt_blocks_hashes, COMMAND_RPC_GET_ALT_BLOCKS_HASHES)
       MAP_URI_AUTO_JON2("/is_key_image_spent", on_is_key_image_spent, COMMAND_RPC_IS_KEY_IMAGE_SPENT)
       MAP_URI_AUTO_JON2("/send_raw_transaction", on_send_raw_tx, COMMAND_RPC_SEND_RAW_TX)
@@ -102,21 +119,32 @@ namespace cryptonote
       MAP_URI_AUTO_JON2_IF("/set_log_hash_rate", on_set_log_hash_rate, COMMAND_RPC_SET_LOG_HASH_RATE, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/set_log_level", on_set_log_level, COMMAND_RPC_SET_LOG_LEVEL, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/set_log_categories", on_set_log_categories, COMMAND_RPC_SET_LOG_CATEGORIES, !m_restricted)
-      MAP_URI_AUTO_JON2("/get_transaction_pool", on_get_transaction_pool, COMMAND_RPC_GET_TRANSACTION_POOL)
-      MAP_URI_AUTO_JON2("/get_transaction_pool_hashes.bin", on_get_transaction_pool_hashes_bin, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN)
+      MAP_URI_AUTO_JON2_IF("/trace", on_trace, COMMAND_RPC_TRACE, !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/get_memory_stats", on_get_memory_stats, COMMAND_RPC_GET_MEMORY_STATS, !m_restricted)
+      MAP_URI_AUTO_JON2_STREAM("/get_transaction_pool", on_get_transaction_pool, COMMAND_RPC_GET_TRANSACTION_POOL)
+      MAP_URI_AUTO_JON2_COALESCED("/get_transaction_pool_hashes.bin", on_get_transaction_pool_hashes_bin, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN, m_request_coalescer)
+      MAP_URI_AUTO_BIN2("/get_transaction_pool_added.bin", on_get_transaction_pool_added_bin, COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN)
       MAP_URI_AUTO_JON2("/get_transaction_pool_hashes", on_get_transaction_pool_hashes, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES)
       MAP_URI_AUTO_JON2("/get_transaction_pool_stats", on_get_transaction_pool_stats, COMMAND_RPC_GET_TRANSACTION_POOL_STATS)
       MAP_URI_AUTO_JON2_IF("/stop_daemon", on_stop_daemon, COMMAND_RPC_STOP_DAEMON, !m_restricted)
-      MAP_URI_AUTO_JON2("/get_info", on_get_info, COMMAND_RPC_GET_INFO)
-      MAP_URI_AUTO_JON2("/getinfo", on_get_info, COMMAND_RPC_GET_INFO)
+      MAP_URI_AUTO_JON2_CACHED("/get_info", on_get_info, COMMAND_RPC_GET_INFO, m_response_cache, rpc_response_cache::same_tip_and_pool_fresh)
+      MAP_URI_AUTO_JON2_CACHED("/getinfo", on_get_info, COMMAND_RPC_GET_INFO, m_response_cache, rpc_response_cache::same_tip_and_pool_fresh)
       MAP_URI_AUTO_JON2("/get_limit", on_get_limit, COMMAND_RPC_GET_LIMIT)
       MAP_URI_AUTO_JON2_IF("/set_limit", on_set_limit, COMMAND_RPC_SET_LIMIT, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/out_peers", on_out_peers, COMMAND_RPC_OUT_PEERS, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/in_peers", on_in_peers, COMMAND_RPC_IN_PEERS, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/start_save_graph", on_start_save_graph, COMMAND_RPC_START_SAVE_GRAPH, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/stop_save_graph", on_stop_save_graph, COMMAND_RPC_STOP_SAVE_GRAPH, !m_restricted)
-      MAP_URI_AUTO_JON2("/get_outs", on_get_outs, COMMAND_RPC_GET_OUTPUTS)      
+      MAP_URI_AUTO_JON2_STREAM("/get_outs", on_get_outs, COMMAND_RPC_GET_OUTPUTS)      
       MAP_URI_AUTO_JON2_IF("/update", on_update, COMMAND_RPC_UPDATE, !m_restricted)
+      MAP_URI2("/metrics", on_get_metrics)
+      MAP_URI_AUTO_JON2_IF("/login", on_login, COMMAND_RPC_LOGIN, m_light_wallet_server)
+      MAP_URI_AUTO_JON2_IF("/import_wallet_request", on_import_wallet_request, COMMAND_RPC_IMPORT_WALLET_REQUEST, m_light_wallet_server)
+      MAP_URI_AUTO_JON2_IF("/get_address_info", on_get_address_info, COMMAND_RPC_GET_ADDRESS_INFO, m_light_wallet_server)
+      MAP_URI_AUTO_JON2_IF("/get_address_txs", on_get_address_txs, COMMAND_RPC_GET_ADDRESS_TXS, m_light_wallet_server)
+      MAP_URI_AUTO_JON2_IF("/get_unspent_outs", on_get_unspent_outs, COMMAND_RPC_GET_UNSPENT_OUTS, m_light_wallet_server)
+      MAP_URI_AUTO_JON2_IF("/get_random_outs", on_get_random_outs, COMMAND_RPC_GET_RANDOM_OUTS, m_light_wallet_server)
+      MAP_URI_AUTO_JON2_IF("/submit_raw_tx", on_submit_raw_tx, COMMAND_RPC_SUBMIT_RAW_TX, m_light_wallet_server)
       BEGIN_JSON_RPC_MAP("/json_rpc")
         MAP_JON_RPC("get_block_count",           on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
         MAP_JON_RPC("getblockcount",             on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
@@ -131,27 +159,27 @@ namespace cryptonote
         MAP_JON_RPC_WE("getlastblockheader",     on_get_last_block_header,      COMMAND_RPC_GET_LAST_BLOCK_HEADER)
         MAP_JON_RPC_WE("get_block_header_by_hash", on_get_block_header_by_hash,   COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH)
         MAP_JON_RPC_WE("getblockheaderbyhash",   on_get_block_header_by_hash,   COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH)
-        MAP_JON_RPC_WE("get_block_header_by_height", on_get_block_header_by_height, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT)
-        MAP_JON_RPC_WE("getblockheaderbyheight", on_get_block_header_by_height, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT)
-        MAP_JON_RPC_WE("get_block_headers_range", on_get_block_headers_range,    COMMAND_RPC_GET_BLOCK_HEADERS_RANGE)
-        MAP_JON_RPC_WE("getblockheadersrange",   on_get_block_headers_range,    COMMAND_RPC_GET_BLOCK_HEADERS_RANGE)
-        MAP_JON_RPC_WE("get_block",              on_get_block,                 COMMAND_RPC_GET_BLOCK)
-        MAP_JON_RPC_WE("getblock",                on_get_block,                 COMMAND_RPC_GET_BLOCK)
+        MAP_JON_RPC_WE_CACHED("get_block_header_by_height", on_get_block_header_by_height, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT, m_response_cache, rpc_response_cache::same_tip)
+        MAP_JON_RPC_WE_CACHED("getblockheaderbyheight", on_get_block_header_by_height, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT, m_response_cache, rpc_response_cache::same_tip)
+        MAP_JON_RPC_WE_STREAM("get_block_headers_range", on_get_block_headers_range,    COMMAND_RPC_GET_BLOCK_HEADERS_RANGE)
+        MAP_JON_RPC_WE_STREAM("getblockheadersrange", on_get_block_headers_range,    COMMAND_RPC_GET_BLOCK_HEADERS_RANGE)
+        MAP_JON_RPC_WE_CACHED("get_block",       on_get_block,                 COMMAND_RPC_GET_BLOCK, m_response_cache, rpc_response_cache::same_tip)
+        MAP_JON_RPC_WE_CACHED("getblock",        on_get_block,                 COMMAND_RPC_GET_BLOCK, m_response_cache, rpc_response_cache::same_tip)
         MAP_JON_RPC_WE_IF("get_connections",     on_get_connections,            COMMAND_RPC_GET_CONNECTIONS, !m_restricted)
-        MAP_JON_RPC_WE("get_info",               on_get_info_json,              COMMAND_RPC_GET_INFO)
+        MAP_JON_RPC_WE_CACHED("get_info",        on_get_info_json,              COMMAND_RPC_GET_INFO, m_response_cache, rpc_response_cache::same_tip_and_pool_fresh)
         MAP_JON_RPC_WE("hard_fork_info",         on_hard_fork_info,             COMMAND_RPC_HARD_FORK_INFO)
         MAP_JON_RPC_WE_IF("set_bans",            on_set_bans,                   COMMAND_RPC_SETBANS, !m_restricted)
         MAP_JON_RPC_WE_IF("get_bans",            on_get_bans,                   COMMAND_RPC_GETBANS, !m_restricted)
         MAP_JON_RPC_WE_IF("flush_txpool",        on_flush_txpool,               COMMAND_RPC_FLUSH_TRANSACTION_POOL, !m_restricted)
-        MAP_JON_RPC_WE("get_output_histogram",   on_get_output_histogram,       COMMAND_RPC_GET_OUTPUT_HISTOGRAM)
+        MAP_JON_RPC_WE_STREAM("get_output_histogram", on_get_output_histogram,       COMMAND_RPC_GET_OUTPUT_HISTOGRAM)
         MAP_JON_RPC_WE("get_version",            on_get_version,                COMMAND_RPC_GET_VERSION)
         MAP_JON_RPC_WE_IF("get_coinbase_tx_sum", on_get_coinbase_tx_sum,        COMMAND_RPC_GET_COINBASE_TX_SUM, !m_restricted)
-        MAP_JON_RPC_WE("get_fee_estimate",       on_get_base_fee_estimate,      COMMAND_RPC_GET_BASE_FEE_ESTIMATE)
+        MAP_JON_RPC_WE_CACHED("get_fee_estimate", on_get_base_fee_estimate,     COMMAND_RPC_GET_BASE_FEE_ESTIMATE, m_response_cache, rpc_response_cache::same_tip)
         MAP_JON_RPC_WE_IF("get_alternate_chains",on_get_alternate_chains,       COMMAND_RPC_GET_ALTERNATE_CHAINS, !m_restricted)
         MAP_JON_RPC_WE_IF("relay_tx",            on_relay_tx,                   COMMAND_RPC_RELAY_TX, !m_restricted)
         MAP_JON_RPC_WE_IF("sync_info",           on_sync_info,                  COMMAND_RPC_SYNC_INFO, !m_restricted)
         MAP_JON_RPC_WE("get_txpool_backlog",     on_get_txpool_backlog,         COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG)
-        MAP_JON_RPC_WE("get_output_distribution", on_get_output_distribution, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION)
+        MAP_JON_RPC_WE_CACHED_STREAM("get_output_distribution", on_get_output_distribution, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION, m_response_cache, rpc_response_cache::same_tip)
       END_JSON_RPC_MAP()
       // Graft RTA handlers start here
       BEGIN_JSON_RPC_MAP("/json_rpc/rta")
@@ -168,8 +196,10 @@ namespace cryptonote
     END_URI_MAP2()
 
     bool on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res);
+    bool on_get_metrics(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& context);
     bool on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res);
     bool on_get_alt_blocks_hashes(const COMMAND_RPC_GET_ALT_BLOCKS_HASHES::request& req, COMMAND_RPC_GET_ALT_BLOCKS_HASHES::response& res);
+    bool on_get_blocks_compact(const COMMAND_RPC_GET_BLOCKS_COMPACT::request& req, COMMAND_RPC_GET_BLOCKS_COMPACT::response& res);
     bool on_get_blocks_by_height(const COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::response& res);
     bool on_get_hashes(const COMMAND_RPC_GET_HASHES_FAST::request& req, COMMAND_RPC_GET_HASHES_FAST::response& res);
     bool on_get_transactions(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res);
@@ -180,6 +210,12 @@ namespace cryptonote
     bool on_stop_mining(const COMMAND_RPC_STOP_MINING::request& req, COMMAND_RPC_STOP_MINING::response& res);
     bool on_mining_status(const COMMAND_RPC_MINING_STATUS::request& req, COMMAND_RPC_MINING_STATUS::response& res);
     bool on_get_outs_bin(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res);        
+    bool on_get_auth_sample_bin(const COMMAND_RPC_GET_AUTH_SAMPLE_BIN::request& req, COMMAND_RPC_GET_AUTH_SAMPLE_BIN::response& res);
+    bool on_get_supernode_stakes_bin(const COMMAND_RPC_GET_SUPERNODE_STAKES_BIN::request& req, COMMAND_RPC_GET_SUPERNODE_STAKES_BIN::response& res);
+    bool on_broadcast_bin(const COMMAND_RPC_BROADCAST::request& req, COMMAND_RPC_BROADCAST::response& res);
+    bool on_multicast_bin(const COMMAND_RPC_MULTICAST::request& req, COMMAND_RPC_MULTICAST::response& res);
+    bool on_unicast_bin(const COMMAND_RPC_UNICAST::request& req, COMMAND_RPC_UNICAST::response& res);
+    bool on_get_blockchain_based_list_bin(const COMMAND_RPC_GET_BLOCKCHAIN_BASED_LIST_BIN::request& req, COMMAND_RPC_GET_BLOCKCHAIN_BASED_LIST_BIN::response& res);
     bool on_get_outs(const COMMAND_RPC_GET_OUTPUTS::request& req, COMMAND_RPC_GET_OUTPUTS::response& res);        
     bool on_get_info(const COMMAND_RPC_GET_INFO::request& req, COMMAND_RPC_GET_INFO::response& res);
     bool on_save_bc(const COMMAND_RPC_SAVE_BC::request& req, COMMAND_RPC_SAVE_BC::response& res);
@@ -187,8 +223,12 @@ namespace cryptonote
     bool on_set_log_hash_rate(const COMMAND_RPC_SET_LOG_HASH_RATE::request& req, COMMAND_RPC_SET_LOG_HASH_RATE::response& res);
     bool on_set_log_level(const COMMAND_RPC_SET_LOG_LEVEL::request& req, COMMAND_RPC_SET_LOG_LEVEL::response& res);
     bool on_set_log_categories(const COMMAND_RPC_SET_LOG_CATEGORIES::request& req, COMMAND_RPC_SET_LOG_CATEGORIES::response& res);
+    bool on_trace(const COMMAND_RPC_TRACE::request& req, COMMAND_RPC_TRACE::response& res);
+    bool on_get_memory_stats(const COMMAND_RPC_GET_MEMORY_STATS::request& req, COMMAND_RPC_GET_MEMORY_STATS::response& res);
     bool on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request& req, COMMAND_RPC_GET_TRANSACTION_POOL::response& res, bool request_has_rpc_origin = true);
     bool on_get_transaction_pool_hashes_bin(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response& res, bool request_has_rpc_origin = true);
+    bool on_get_block_headers_range_bin(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN::response& res);
+    bool on_get_transaction_pool_added_bin(const COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN::response& res);
     bool on_get_transaction_pool_hashes(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::response& res, bool request_has_rpc_origin = true);
     bool on_get_transaction_pool_stats(const COMMAND_RPC_GET_TRANSACTION_POOL_STATS::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_STATS::response& res, bool request_has_rpc_origin = true);
     bool on_stop_daemon(const COMMAND_RPC_STOP_DAEMON::request& req, COMMAND_RPC_STOP_DAEMON::response& res);
@@ -199,6 +239,14 @@ namespace cryptonote
     bool on_start_save_graph(const COMMAND_RPC_START_SAVE_GRAPH::request& req, COMMAND_RPC_START_SAVE_GRAPH::response& res);
     bool on_stop_save_graph(const COMMAND_RPC_STOP_SAVE_GRAPH::request& req, COMMAND_RPC_STOP_SAVE_GRAPH::response& res);
     bool on_update(const COMMAND_RPC_UPDATE::request& req, COMMAND_RPC_UPDATE::response& res);
+    // light wallet
+    bool on_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res);
+    bool on_import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res);
+    bool on_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res);
+    bool on_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res);
+    bool on_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res);
+    bool on_get_random_outs(const COMMAND_RPC_GET_RANDOM_OUTS::request& req, COMMAND_RPC_GET_RANDOM_OUTS::response& res);
+    bool on_submit_raw_tx(const COMMAND_RPC_SUBMIT_RAW_TX::request& req, COMMAND_RPC_SUBMIT_RAW_TX::response& res);
     
     //json_rpc
     bool on_getblockcount(const COMMAND_RPC_GETBLOCKCOUNT::request& req, COMMAND_RPC_GETBLOCKCOUNT::response& res);
@@ -245,7 +293,10 @@ private:
     //utils
     uint64_t get_block_reward(const block& blk);
     bool fill_block_header_response(const block& blk, bool orphan_status, uint64_t height, const crypto::hash& hash, block_header_response& response, bool fill_pow_hash);
+    bool fill_block_header_response(const Blockchain::tip_snapshot& tip, block_header_response& response);
     enum invoke_http_mode { JON, BIN, JON_RPC };
+    template <typename REQUEST, typename RESPONSE>
+    bool call_light_wallet_server(bool (light_wallet_server::*handler)(const REQUEST&, RESPONSE&), const REQUEST& req, RESPONSE& res);
     template <typename COMMAND_TYPE>
     bool use_bootstrap_daemon_if_necessary(const invoke_http_mode &mode, const std::string &command_name, const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, bool &r);
     
@@ -259,7 +310,13 @@ private:
     bool m_was_bootstrap_ever_used;
     network_type m_nettype;
     bool m_restricted;
+    rpc_response_cache m_response_cache;
+    rpc_request_coalescer m_request_coalescer;
+    light_wallet_server* m_light_wallet_server;
+    account_address_string_cache m_address_strings;
+    std::atomic<size_t> m_longpolls; //!< block template requests currently long-polling
+    size_t m_max_longpolls;
   };
 }
 
-BOOST_CLASS_VERSION(nodetool::node_server<cryptonote::t_cryptonote_protocol_handler<cryptonote::core> >, 1);
+BOOST_CLASS_VERSION(nodetool::node_server<cryptonote::t_cryptonote_protocol_handler<cryptonote::core> >, 2);
@@ -54,7 +54,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 2
-#define CORE_RPC_VERSION_MINOR 1
+#define CORE_RPC_VERSION_MINOR 2
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -135,6 +135,28 @@ namespace cryptonote
     };
   };
 
+  // Like COMMAND_RPC_GET_BLOCKS_FAST, but the txs are only what a wallet needs to scan them for own outputs
+  // and spends: the pruned tx without ring member offsets, with extra reduced to the tx public keys and nonce.
+  // They are parsed with parse_and_validate_tx_base_from_blob, their hashes are those in the block
+  struct COMMAND_RPC_GET_BLOCKS_COMPACT
+  {
+    typedef COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices block_output_indices;
+
+    struct request
+    {
+      std::list<crypto::hash> block_ids; // same as COMMAND_RPC_GET_BLOCKS_FAST
+      uint64_t    start_height;
+      bool        no_miner_tx;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE_OPT(no_miner_tx, false)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    typedef COMMAND_RPC_GET_BLOCKS_FAST::response response;
+  };
+
   struct COMMAND_RPC_GET_BLOCKS_BY_HEIGHT
   {
     struct request
@@ -977,6 +999,7 @@ namespace cryptonote
       bool active;
       uint64_t speed;
       uint32_t threads_count;
+      std::vector<uint64_t> threads_speed;
       std::string address;
       bool is_background_mining_enabled;
 
@@ -985,6 +1008,7 @@ namespace cryptonote
         KV_SERIALIZE(active)
         KV_SERIALIZE(speed)
         KV_SERIALIZE(threads_count)
+        KV_SERIALIZE(threads_speed)
         KV_SERIALIZE(address)
         KV_SERIALIZE(is_background_mining_enabled)
       END_KV_SERIALIZE_MAP()
@@ -1044,10 +1068,20 @@ namespace cryptonote
     {
       uint64_t reserve_size;       //max 255 bytes
       std::string wallet_address;
+      // long-poll: when set, the call waits until the top block isn't longpoll_prev_hash anymore or, if
+      // longpoll_pool_changes isn't 0, the pool cookie advanced that much past longpoll_pool_cookie
+      std::string longpoll_prev_hash;
+      uint64_t longpoll_pool_cookie;
+      uint64_t longpoll_pool_changes;
+      uint64_t longpoll_timeout;   //seconds, 0 for the longest the daemon allows
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(reserve_size)
         KV_SERIALIZE(wallet_address)
+        KV_SERIALIZE_OPT(longpoll_prev_hash, std::string())
+        KV_SERIALIZE_OPT(longpoll_pool_cookie, (uint64_t)0)
+        KV_SERIALIZE_OPT(longpoll_pool_changes, (uint64_t)0)
+        KV_SERIALIZE_OPT(longpoll_timeout, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1062,6 +1096,7 @@ namespace cryptonote
       std::string next_seed_hash;
       blobdata blocktemplate_blob;
       blobdata blockhashing_blob;
+      uint64_t pool_cookie;        //to pass back as longpoll_pool_cookie
       std::string status;
       bool untrusted;
 
@@ -1073,6 +1108,7 @@ namespace cryptonote
         KV_SERIALIZE(prev_hash)
         KV_SERIALIZE(blocktemplate_blob)
         KV_SERIALIZE(blockhashing_blob)
+        KV_SERIALIZE(pool_cookie)
         KV_SERIALIZE(status)
         KV_SERIALIZE(untrusted)
         KV_SERIALIZE(seed_hash)
@@ -1397,6 +1433,87 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_TRACE
+  {
+    struct histogram
+    {
+      std::string name;
+      uint64_t count;
+      uint64_t total_ns;
+      uint64_t max_ns;
+      uint64_t p50_ns;
+      uint64_t p99_ns;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(count)
+        KV_SERIALIZE(total_ns)
+        KV_SERIALIZE(max_ns)
+        KV_SERIALIZE(p50_ns)
+        KV_SERIALIZE(p99_ns)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      std::string action; // start, stop, clear, stats or dump
+      std::string file;   // where dump writes the events as a Chrome trace, on the daemon's host
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(action)
+        KV_SERIALIZE(file)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool enabled;
+      uint64_t events;
+      std::vector<histogram> histograms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(enabled)
+        KV_SERIALIZE(events)
+        KV_SERIALIZE(histograms)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_MEMORY_STATS
+  {
+    struct entry
+    {
+      std::string subsystem;
+      uint64_t bytes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(subsystem)
+        KV_SERIALIZE(bytes)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<entry> entries; // estimated heap memory of each subsystem, by subsystem name
+      uint64_t total;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(total)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct tx_info
   {
     std::string id_hash;
@@ -1475,7 +1592,10 @@ namespace cryptonote
   {
     struct request
     {
+      uint64_t cookie; // pool cookie of a previous response, 0 for none
+
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(cookie, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1484,11 +1604,47 @@ namespace cryptonote
       std::string status;
       std::vector<crypto::hash> tx_hashes;
       bool untrusted;
+      uint64_t cookie;
+      bool unchanged; // the pool is as it was for the requested cookie, tx_hashes is left empty
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
         KV_SERIALIZE(untrusted)
+        KV_SERIALIZE_OPT(cookie, (uint64_t)0)
+        KV_SERIALIZE_OPT(unchanged, false)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // long poll for relayable transactions added to the pool after a position of the pool journal
+  struct COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN
+  {
+    struct request
+    {
+      uint64_t start; // 0 for the oldest kept entry
+      uint64_t wait_millis;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start)
+        KV_SERIALIZE(wait_millis)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t next;
+      bool complete; // false if transactions after start have been missed
+      std::vector<crypto::hash> tx_hashes;
+      std::vector<std::string> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(next)
+        KV_SERIALIZE(complete)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+        KV_SERIALIZE(txs)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -1662,6 +1818,60 @@ namespace cryptonote
     };
   };
 
+  // Like COMMAND_RPC_GET_BLOCK_HEADERS_RANGE, with each field of the headers as a column of fixed size values,
+  // read from the block info kept by the db. The block fields are read from the blocks, when asked for
+  struct COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_BIN
+  {
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t end_height; // inclusive
+      bool include_block_fields;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(end_height)
+        KV_SERIALIZE_OPT(include_block_fields, false)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t start_height;
+      std::vector<crypto::hash> hashes;
+      std::vector<uint64_t> timestamps;
+      std::vector<uint64_t> weights;
+      std::vector<uint64_t> cumulative_difficulties;
+      std::vector<uint64_t> already_generated_coins;
+      std::vector<uint64_t> cumulative_rct_outputs;
+      // block fields
+      std::vector<uint8_t> major_versions;
+      std::vector<uint8_t> minor_versions;
+      std::vector<uint32_t> nonces;
+      std::vector<uint64_t> rewards;
+      std::vector<uint32_t> num_txes;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(hashes)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(timestamps)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(weights)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(cumulative_difficulties)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(already_generated_coins)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(cumulative_rct_outputs)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(major_versions)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(minor_versions)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(nonces)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(rewards)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(num_txes)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_STOP_DAEMON
   {
     struct request
@@ -2188,9 +2398,15 @@ namespace cryptonote
     struct peer
     {
       connection_info info;
+      uint32_t rate;
+      uint64_t nblocks;
+      uint64_t span_size;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(info)
+        KV_SERIALIZE_OPT(rate, (uint32_t)0)
+        KV_SERIALIZE_OPT(nblocks, (uint64_t)0)
+        KV_SERIALIZE_OPT(span_size, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -2240,9 +2456,11 @@ namespace cryptonote
     {
       std::string supernode_public_id;
       std::string network_address;
+      uint64_t    last_received_block_height; //height of the last stakes the supernode has, 0 to get them in full
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(supernode_public_id)
         KV_SERIALIZE(network_address)
+        KV_SERIALIZE_OPT(last_received_block_height, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -2294,6 +2512,34 @@ namespace cryptonote
     };
   };
 
+  // changes of supernode stakes since base_block_height which has been delivered to the supernode earlier
+  struct COMMAND_RPC_SUPERNODE_STAKES_DELTA
+  {
+    typedef COMMAND_RPC_SUPERNODE_STAKES::supernode_stake supernode_stake;
+
+    struct request
+    {
+      uint64_t block_height;
+      uint64_t base_block_height;
+      std::vector<supernode_stake> stakes; //added or changed stakes
+      std::vector<std::string> removed_supernode_public_ids;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block_height)
+        KV_SERIALIZE(base_block_height)
+        KV_SERIALIZE(stakes)
+        KV_SERIALIZE(removed_supernode_public_ids)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      int64_t status;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_SUPERNODE_GET_BLOCKCHAIN_BASED_LIST
   {
     struct request
@@ -2358,6 +2604,139 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_SUPERNODE_STAKES_BIN
+  {
+    typedef COMMAND_RPC_SUPERNODE_STAKES::supernode_stake supernode_stake;
+
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t count;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE_OPT(count, (uint64_t)1)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct block_stakes
+    {
+      uint64_t block_height;
+      std::vector<supernode_stake> stakes;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block_height)
+        KV_SERIALIZE(stakes)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<block_stakes> blocks;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(blocks)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_BLOCKCHAIN_BASED_LIST_BIN
+  {
+    typedef COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::tier tier;
+
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t count;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE_OPT(count, (uint64_t)1)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct block_list
+    {
+      uint64_t block_height;
+      std::vector<tier> tiers;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block_height)
+        KV_SERIALIZE(tiers)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<block_list> blocks;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(blocks)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_AUTH_SAMPLE_BIN
+  {
+    typedef COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::supernode supernode;
+
+    struct request
+    {
+      uint64_t block_height;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block_height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t block_height;
+      crypto::hash block_hash;
+      std::vector<supernode> supernodes;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(block_height)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+        KV_SERIALIZE(supernodes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // blockchain based list relative to base_block_height which has been delivered to the supernode earlier
+  struct COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST_DELTA
+  {
+    typedef COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::supernode supernode;
+
+    struct tier
+    {
+      std::vector<std::string> supernode_public_ids; //members of the tier in order
+      std::vector<supernode> supernodes; //members which are absent or differ in the base list
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(supernode_public_ids)
+        KV_SERIALIZE(supernodes)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      uint64_t block_height;
+      uint64_t base_block_height;
+      std::vector<tier> tiers;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block_height)
+        KV_SERIALIZE(base_block_height)
+        KV_SERIALIZE(tiers)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      int64_t status;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_SUPERNODE_ANNOUNCE
   {
     struct request
@@ -2393,11 +2772,13 @@ namespace cryptonote
       std::string callback_uri;
       std::string data;
       bool wait_answer;
+      bool binary_data; // data holds raw bytes, deliver it to supernodes in binary requests
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(sender_address)
         KV_SERIALIZE(callback_uri)
         KV_SERIALIZE(data)
         KV_SERIALIZE(wait_answer)
+        KV_SERIALIZE_OPT(binary_data, false)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -2419,12 +2800,14 @@ namespace cryptonote
       std::string callback_uri;
       std::string data;
       bool wait_answer;
+      bool binary_data; // data holds raw bytes, deliver it to supernodes in binary requests
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(receiver_addresses)
         KV_SERIALIZE(sender_address)
         KV_SERIALIZE(callback_uri)
         KV_SERIALIZE(data)
         KV_SERIALIZE(wait_answer)
+        KV_SERIALIZE_OPT(binary_data, false)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -2446,12 +2829,14 @@ namespace cryptonote
       std::string callback_uri;
       std::string data;
       bool wait_answer;
+      bool binary_data; // data holds raw bytes, deliver it to supernodes in binary requests
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(receiver_address)
         KV_SERIALIZE(sender_address)
         KV_SERIALIZE(callback_uri)
         KV_SERIALIZE(data)
         KV_SERIALIZE(wait_answer)
+        KV_SERIALIZE_OPT(binary_data, false)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -0,0 +1,495 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/thread/locks.hpp>
+#include <cstring>
+#include <stdexcept>
+
+#include "common/util.h"
+#include "misc_language.h"
+#include "misc_log_ex.h"
+#include "light_wallet_db.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "lightwallet.db"
+
+#define MDB_val_set(var, val)   MDB_val var = {sizeof(val), (void *)&val}
+
+namespace
+{
+  constexpr uint64_t INITIAL_MAP_SIZE = 256ull << 20;
+  constexpr uint64_t MAP_SIZE_INCREMENT = 256ull << 20;
+  // pages touched by deletions and index updates come on top of the records written
+  constexpr size_t WRITE_SLACK = 16 << 20;
+
+#pragma pack(push, 1)
+  struct owner_key
+  {
+    uint64_t index_amount;
+    uint64_t global_index;
+  };
+
+  struct owner
+  {
+    uint64_t account_id;
+    uint64_t amount;
+    crypto::public_key tx_pub_key;
+    uint32_t out_index;
+  };
+#pragma pack(pop)
+
+  void check(int dbr, const char *what)
+  {
+    if (dbr)
+      throw std::runtime_error(std::string(what) + ": " + mdb_strerror(dbr));
+  }
+
+  // outputs and spends are sorted by the height they start with, then bytewise
+  int compare_by_height(const MDB_val *a, const MDB_val *b)
+  {
+    uint64_t ha, hb;
+    memcpy(&ha, a->mv_data, sizeof(ha));
+    memcpy(&hb, b->mv_data, sizeof(hb));
+    if (ha != hb)
+      return ha < hb ? -1 : 1;
+    const size_t size = std::min(a->mv_size, b->mv_size);
+    const int r = memcmp((const char*)a->mv_data + sizeof(ha), (const char*)b->mv_data + sizeof(hb), size - sizeof(ha));
+    if (r)
+      return r;
+    return a->mv_size < b->mv_size ? -1 : a->mv_size > b->mv_size;
+  }
+
+  template<typename T>
+  std::vector<T> get_records(MDB_txn *txn, MDB_dbi dbi, uint64_t id, uint64_t from_height)
+  {
+    std::vector<T> records;
+    MDB_cursor *cur;
+    check(mdb_cursor_open(txn, dbi, &cur), "Failed to open LMDB cursor");
+    epee::misc_utils::auto_scope_leave_caller cur_dtor = epee::misc_utils::create_scope_leave_handler([&](){ mdb_cursor_close(cur); });
+    MDB_val_set(k, id);
+    MDB_val v;
+    int dbr;
+    for (dbr = mdb_cursor_get(cur, &k, &v, MDB_SET_KEY); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT_DUP))
+    {
+      if (v.mv_size != sizeof(T))
+        throw std::runtime_error("Unexpected light wallet record size");
+      T record;
+      memcpy(&record, v.mv_data, sizeof(record));
+      if (record.height >= from_height)
+        records.push_back(record);
+    }
+    if (dbr != MDB_NOTFOUND)
+      check(dbr, "Failed to read light wallet records");
+    return records;
+  }
+}
+
+namespace cryptonote
+{
+  class light_wallet_db::txn
+  {
+  public:
+    txn(light_wallet_db& db, bool write): m_lock(db.m_resize_lock), m_txn(nullptr)
+    {
+      check(mdb_txn_begin(db.m_env, NULL, write ? 0 : MDB_RDONLY, &m_txn), "Failed to create LMDB transaction");
+    }
+    ~txn()
+    {
+      if (m_txn)
+        mdb_txn_abort(m_txn);
+    }
+    void commit()
+    {
+      MDB_txn *t = m_txn;
+      m_txn = nullptr;
+      check(mdb_txn_commit(t), "Failed to commit light wallet transaction");
+    }
+    operator MDB_txn*() const { return m_txn; }
+
+  private:
+    boost::shared_lock<boost::shared_mutex> m_lock;
+    MDB_txn *m_txn;
+  };
+
+  //------------------------------------------------------------------------------------------------------------------------------
+  light_wallet_db::light_wallet_db(): m_env(nullptr)
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  light_wallet_db::~light_wallet_db()
+  {
+    close();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::open(const std::string& path)
+  {
+    CHECK_AND_ASSERT_THROW_MES(!m_env, "Light wallet database is already open");
+    CHECK_AND_ASSERT_THROW_MES(tools::create_directories_if_necessary(path), "Failed to create directory " << path);
+
+    check(mdb_env_create(&m_env), "Failed to create LMDB environment");
+    try
+    {
+      check(mdb_env_set_maxdbs(m_env, 6), "Failed to set max env dbs");
+      check(mdb_env_set_mapsize(m_env, INITIAL_MAP_SIZE), "Failed to set LMDB map size");
+      check(mdb_env_open(m_env, path.c_str(), MDB_NOTLS, 0600), ("Failed to open light wallet database " + path).c_str());
+
+      txn t(*this, true);
+      check(mdb_dbi_open(t, "accounts", MDB_CREATE | MDB_INTEGERKEY, &m_accounts), "Failed to open LMDB dbi");
+      check(mdb_dbi_open(t, "account_ids", MDB_CREATE, &m_account_ids), "Failed to open LMDB dbi");
+      check(mdb_dbi_open(t, "outputs", MDB_CREATE | MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, &m_outputs), "Failed to open LMDB dbi");
+      mdb_set_dupsort(t, m_outputs, compare_by_height);
+      check(mdb_dbi_open(t, "spends", MDB_CREATE | MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, &m_spends), "Failed to open LMDB dbi");
+      mdb_set_dupsort(t, m_spends, compare_by_height);
+      check(mdb_dbi_open(t, "owners", MDB_CREATE, &m_owners), "Failed to open LMDB dbi");
+      check(mdb_dbi_open(t, "blocks", MDB_CREATE | MDB_INTEGERKEY, &m_blocks), "Failed to open LMDB dbi");
+      t.commit();
+    }
+    catch (...)
+    {
+      mdb_env_close(m_env);
+      m_env = nullptr;
+      throw;
+    }
+    m_path = path;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::close()
+  {
+    if (!m_env)
+      return;
+    boost::unique_lock<boost::shared_mutex> lock(m_resize_lock);
+    mdb_env_close(m_env);
+    m_env = nullptr;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::grow_if_needed(size_t needed)
+  {
+    needed += WRITE_SLACK;
+    auto fits = [this, needed]() {
+      MDB_envinfo mei;
+      MDB_stat mst;
+      check(mdb_env_info(m_env, &mei), "Failed to get LMDB environment info");
+      check(mdb_env_stat(m_env, &mst), "Failed to get LMDB environment stats");
+      return mst.ms_psize * mei.me_last_pgno + needed <= mei.me_mapsize ? 0 : mei.me_mapsize;
+    };
+    if (!fits())
+      return;
+
+    boost::unique_lock<boost::shared_mutex> lock(m_resize_lock);
+    const uint64_t mapsize = fits();
+    if (!mapsize)
+      return;
+    const uint64_t new_mapsize = mapsize + std::max<uint64_t>(needed, MAP_SIZE_INCREMENT);
+    MINFO("Growing light wallet database to " << (new_mapsize >> 20) << " MB");
+    check(mdb_env_set_mapsize(m_env, new_mapsize), "Failed to set LMDB map size");
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_db::read_account(txn& t, uint64_t id, account& acc)
+  {
+    MDB_val_set(k, id);
+    MDB_val v;
+    const int dbr = mdb_get(t, m_accounts, &k, &v);
+    if (dbr == MDB_NOTFOUND)
+      return false;
+    check(dbr, "Failed to read light wallet account");
+    CHECK_AND_ASSERT_THROW_MES(v.mv_size == sizeof(acc), "Unexpected light wallet account size");
+    memcpy(&acc, v.mv_data, sizeof(acc));
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::write_account(txn& t, const account& acc)
+  {
+    MDB_val_set(k, acc.id);
+    MDB_val_set(v, acc);
+    check(mdb_put(t, m_accounts, &k, &v, 0), "Failed to write light wallet account");
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::vector<light_wallet_db::account> light_wallet_db::read_accounts(txn& t)
+  {
+    std::vector<account> accounts;
+    MDB_cursor *cur;
+    check(mdb_cursor_open(t, m_accounts, &cur), "Failed to open LMDB cursor");
+    epee::misc_utils::auto_scope_leave_caller cur_dtor = epee::misc_utils::create_scope_leave_handler([&](){ mdb_cursor_close(cur); });
+    MDB_val k, v;
+    int dbr;
+    for (dbr = mdb_cursor_get(cur, &k, &v, MDB_FIRST); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT))
+    {
+      CHECK_AND_ASSERT_THROW_MES(v.mv_size == sizeof(account), "Unexpected light wallet account size");
+      accounts.emplace_back();
+      memcpy(&accounts.back(), v.mv_data, sizeof(account));
+    }
+    if (dbr != MDB_NOTFOUND)
+      check(dbr, "Failed to read light wallet accounts");
+    return accounts;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::vector<light_wallet_db::account> light_wallet_db::get_accounts()
+  {
+    txn t(*this, false);
+    return read_accounts(t);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_db::get_account(const account_public_address& address, account& acc)
+  {
+    txn t(*this, false);
+    MDB_val_set(k, address);
+    MDB_val v;
+    const int dbr = mdb_get(t, m_account_ids, &k, &v);
+    if (dbr == MDB_NOTFOUND)
+      return false;
+    check(dbr, "Failed to read light wallet account id");
+    uint64_t id;
+    memcpy(&id, v.mv_data, sizeof(id));
+    return read_account(t, id, acc);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_db::add_account(const account_public_address& address, const crypto::secret_key& view_secret_key, uint64_t start_height, account& acc)
+  {
+    grow_if_needed(sizeof(account) * 4);
+    txn t(*this, true);
+    MDB_val_set(k, address);
+    MDB_val v;
+    int dbr = mdb_get(t, m_account_ids, &k, &v);
+    if (dbr == 0)
+    {
+      uint64_t id;
+      memcpy(&id, v.mv_data, sizeof(id));
+      read_account(t, id, acc);
+      return false;
+    }
+    if (dbr != MDB_NOTFOUND)
+      check(dbr, "Failed to read light wallet account id");
+
+    uint64_t id = 1;
+    {
+      MDB_cursor *cur;
+      check(mdb_cursor_open(t, m_accounts, &cur), "Failed to open LMDB cursor");
+      MDB_val last_k, last_v;
+      dbr = mdb_cursor_get(cur, &last_k, &last_v, MDB_LAST);
+      if (dbr == 0)
+        id = *(const uint64_t*)last_k.mv_data + 1;
+      mdb_cursor_close(cur);
+      if (dbr != MDB_NOTFOUND)
+        check(dbr, "Failed to read light wallet accounts");
+    }
+
+    acc.id = id;
+    acc.address = address;
+    memcpy(&acc.view_secret_key, &unwrap(unwrap(view_secret_key)), sizeof(acc.view_secret_key));
+    acc.start_height = start_height;
+    acc.scanned_height = start_height;
+    write_account(t, acc);
+    MDB_val_set(id_v, id);
+    check(mdb_put(t, m_account_ids, &k, &id_v, MDB_NOOVERWRITE), "Failed to write light wallet account id");
+    t.commit();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::remove_account_data(txn& t, uint64_t id, uint64_t height)
+  {
+    MDB_val_set(k, id);
+    for (const output& o: get_records<output>(t, m_outputs, id, height))
+    {
+      MDB_val_set(v, o);
+      check(mdb_del(t, m_outputs, &k, &v), "Failed to remove light wallet output");
+      const owner_key ok{o.index_amount, o.global_index};
+      MDB_val_set(owner_k, ok);
+      const int dbr = mdb_del(t, m_owners, &owner_k, NULL);
+      if (dbr != MDB_NOTFOUND)
+        check(dbr, "Failed to remove light wallet output owner");
+    }
+    for (const spend& s: get_records<spend>(t, m_spends, id, height))
+    {
+      MDB_val_set(v, s);
+      check(mdb_del(t, m_spends, &k, &v), "Failed to remove light wallet spend");
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::reset_account(uint64_t id, uint64_t start_height)
+  {
+    grow_if_needed(0);
+    txn t(*this, true);
+    account acc;
+    CHECK_AND_ASSERT_THROW_MES(read_account(t, id, acc), "Light wallet account " << id << " not found");
+    remove_account_data(t, id, 0);
+    acc.start_height = start_height;
+    acc.scanned_height = start_height;
+    write_account(t, acc);
+    t.commit();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::vector<light_wallet_db::output> light_wallet_db::get_outputs(uint64_t account_id)
+  {
+    txn t(*this, false);
+    return get_records<output>(t, m_outputs, account_id, 0);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::vector<light_wallet_db::spend> light_wallet_db::get_spends(uint64_t account_id)
+  {
+    txn t(*this, false);
+    return get_records<spend>(t, m_spends, account_id, 0);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_db::get_top_block(uint64_t& height, crypto::hash& hash)
+  {
+    txn t(*this, false);
+    MDB_cursor *cur;
+    check(mdb_cursor_open(t, m_blocks, &cur), "Failed to open LMDB cursor");
+    epee::misc_utils::auto_scope_leave_caller cur_dtor = epee::misc_utils::create_scope_leave_handler([&](){ mdb_cursor_close(cur); });
+    MDB_val k, v;
+    const int dbr = mdb_cursor_get(cur, &k, &v, MDB_LAST);
+    if (dbr == MDB_NOTFOUND)
+      return false;
+    check(dbr, "Failed to read light wallet blocks");
+    memcpy(&height, k.mv_data, sizeof(height));
+    memcpy(&hash, v.mv_data, sizeof(hash));
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_db::get_block_hash(uint64_t height, crypto::hash& hash)
+  {
+    txn t(*this, false);
+    MDB_val_set(k, height);
+    MDB_val v;
+    const int dbr = mdb_get(t, m_blocks, &k, &v);
+    if (dbr == MDB_NOTFOUND)
+      return false;
+    check(dbr, "Failed to read light wallet block");
+    memcpy(&hash, v.mv_data, sizeof(hash));
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::store(const scan_batch& batch)
+  {
+    grow_if_needed(batch.outputs.size() * (sizeof(output) + sizeof(owner_key) + sizeof(owner)) * 2 + batch.inputs.size() * sizeof(spend)
+        + batch.blocks.size() * (sizeof(uint64_t) + sizeof(crypto::hash)) * 2 + batch.scanned_from.size() * sizeof(account) * 2);
+    txn t(*this, true);
+
+    // accounts imported since their scan started are scanned again later
+    std::unordered_map<uint64_t, uint64_t> scanned_from;
+    for (const auto& e: batch.scanned_from)
+    {
+      account acc;
+      if (!read_account(t, e.first, acc) || acc.scanned_height != e.second)
+        continue;
+      scanned_from.insert(e);
+      acc.scanned_height = std::max(acc.scanned_height, batch.to_height);
+      write_account(t, acc);
+    }
+
+    for (const auto& e: batch.outputs)
+    {
+      if (!scanned_from.count(e.first))
+        continue;
+      const output& o = e.second;
+      MDB_val_set(k, e.first);
+      MDB_val_set(v, o);
+      check(mdb_put(t, m_outputs, &k, &v, 0), "Failed to write light wallet output");
+      const owner_key ok{o.index_amount, o.global_index};
+      const owner ov{e.first, o.amount, o.tx_pub_key, o.out_index};
+      MDB_val_set(owner_k, ok);
+      MDB_val_set(owner_v, ov);
+      check(mdb_put(t, m_owners, &owner_k, &owner_v, 0), "Failed to write light wallet output owner");
+    }
+
+    for (const input& in: batch.inputs)
+    {
+      for (uint64_t global_index: in.ring)
+      {
+        const owner_key ok{in.index_amount, global_index};
+        MDB_val_set(owner_k, ok);
+        MDB_val v;
+        const int dbr = mdb_get(t, m_owners, &owner_k, &v);
+        if (dbr == MDB_NOTFOUND)
+          continue;
+        check(dbr, "Failed to read light wallet output owner");
+        owner ov;
+        memcpy(&ov, v.mv_data, sizeof(ov));
+        // the spends of accounts which already had this block scanned are stored already
+        const auto it = scanned_from.find(ov.account_id);
+        if (it == scanned_from.end() || it->second > in.height)
+          continue;
+        spend s;
+        s.height = in.height;
+        s.key_image = in.key_image;
+        s.out_tx_pub_key = ov.tx_pub_key;
+        s.out_index = ov.out_index;
+        s.mixin = in.ring.size() - 1;
+        s.amount = ov.amount;
+        s.timestamp = in.timestamp;
+        s.unlock_time = in.unlock_time;
+        s.tx_hash = in.tx_hash;
+        MDB_val_set(k, ov.account_id);
+        MDB_val_set(spend_v, s);
+        check(mdb_put(t, m_spends, &k, &spend_v, 0), "Failed to write light wallet spend");
+      }
+    }
+
+    for (const auto& b: batch.blocks)
+    {
+      MDB_val_set(k, b.first);
+      MDB_val_set(v, b.second);
+      check(mdb_put(t, m_blocks, &k, &v, 0), "Failed to write light wallet block");
+    }
+    t.commit();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_db::rollback(uint64_t height)
+  {
+    grow_if_needed(0);
+    txn t(*this, true);
+    for (account& acc: read_accounts(t))
+    {
+      if (acc.scanned_height <= height)
+        continue;
+      remove_account_data(t, acc.id, height);
+      acc.scanned_height = std::max(height, acc.start_height);
+      write_account(t, acc);
+    }
+
+    std::vector<uint64_t> heights;
+    {
+      MDB_cursor *cur;
+      check(mdb_cursor_open(t, m_blocks, &cur), "Failed to open LMDB cursor");
+      epee::misc_utils::auto_scope_leave_caller cur_dtor = epee::misc_utils::create_scope_leave_handler([&](){ mdb_cursor_close(cur); });
+      MDB_val_set(k, height);
+      MDB_val v;
+      int dbr;
+      for (dbr = mdb_cursor_get(cur, &k, &v, MDB_SET_RANGE); dbr == 0; dbr = mdb_cursor_get(cur, &k, &v, MDB_NEXT))
+        heights.push_back(*(const uint64_t*)k.mv_data);
+      if (dbr != MDB_NOTFOUND)
+        check(dbr, "Failed to read light wallet blocks");
+    }
+    for (uint64_t h: heights)
+    {
+      MDB_val_set(k, h);
+      check(mdb_del(t, m_blocks, &k, NULL), "Failed to remove light wallet block");
+    }
+    t.commit();
+  }
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/shared_mutex.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <lmdb.h>
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "ringct/rctTypes.h"
+
+namespace cryptonote
+{
+  /// Outputs received and (candidate) spends of the accounts registered with the light wallet server,
+  /// in an LMDB environment of its own next to the blockchain.
+  ///
+  /// Spends are recorded for every input which has one of an account's outputs in its ring: without
+  /// the spend key the server can't tell the real ones, the wallet checks the key images itself.
+  class light_wallet_db
+  {
+  public:
+#pragma pack(push, 1)
+    struct account
+    {
+      uint64_t id;
+      account_public_address address;
+      crypto::ec_scalar view_secret_key;
+      uint64_t start_height;    //!< first block scanned for the account
+      uint64_t scanned_height;  //!< blocks below this one are scanned
+    };
+
+    struct output
+    {
+      uint64_t height;
+      uint64_t index_amount;    //!< amount the global index counts outputs of, 0 for RingCT ones
+      uint64_t global_index;
+      uint64_t amount;
+      uint64_t timestamp;
+      uint64_t unlock_time;
+      crypto::hash tx_hash;
+      crypto::hash tx_prefix_hash;
+      crypto::public_key tx_pub_key;
+      crypto::public_key key;
+      crypto::hash payment_id;  //!< null if none, short encrypted ones decrypted and zero padded
+      rct::key commitment;
+      rct::key encrypted_mask;
+      rct::key encrypted_amount;
+      uint32_t out_index;
+      uint32_t mixin;           //!< ring size - 1 of the tx inputs
+      uint8_t coinbase;
+      uint8_t rct;
+    };
+
+    struct spend
+    {
+      uint64_t height;
+      crypto::key_image key_image;
+      crypto::public_key out_tx_pub_key;  //!< tx pub key and index of the output in the ring
+      uint32_t out_index;
+      uint32_t mixin;
+      uint64_t amount;
+      uint64_t timestamp;
+      uint64_t unlock_time;
+      crypto::hash tx_hash;
+    };
+#pragma pack(pop)
+
+    /// Input of a scanned tx, matched against the outputs of all accounts when the scan is stored
+    struct input
+    {
+      uint64_t height;
+      uint64_t timestamp;
+      uint64_t unlock_time;
+      crypto::hash tx_hash;
+      crypto::key_image key_image;
+      uint64_t index_amount;
+      std::vector<uint64_t> ring;  //!< absolute global indexes
+    };
+
+    /// What a scan of blocks [from_height, to_height) found, stored at once
+    struct scan_batch
+    {
+      uint64_t to_height;
+      /// Accounts scanned, with the height their scan started at: blocks below it were already scanned
+      /// for them and are skipped. An account whose height changed meanwhile (imported) is left alone.
+      std::unordered_map<uint64_t, uint64_t> scanned_from;
+      std::vector<std::pair<uint64_t, output>> outputs;  //!< by account id
+      std::vector<input> inputs;
+      std::vector<std::pair<uint64_t, crypto::hash>> blocks;
+    };
+
+    light_wallet_db();
+    ~light_wallet_db();
+
+    void open(const std::string& path);
+    void close();
+
+    std::vector<account> get_accounts();
+    bool get_account(const account_public_address& address, account& acc);
+    /// Registers the address to be scanned from start_height on, returns false if it already is
+    bool add_account(const account_public_address& address, const crypto::secret_key& view_secret_key, uint64_t start_height, account& acc);
+    /// Forgets what was found for the account and scans it again from start_height
+    void reset_account(uint64_t id, uint64_t start_height);
+
+    std::vector<output> get_outputs(uint64_t account_id);
+    std::vector<spend> get_spends(uint64_t account_id);
+
+    bool get_top_block(uint64_t& height, crypto::hash& hash);
+    bool get_block_hash(uint64_t height, crypto::hash& hash);
+
+    void store(const scan_batch& batch);
+    /// Drops everything found from the block at height on, after a reorg
+    void rollback(uint64_t height);
+
+  private:
+    class txn;
+
+    void grow_if_needed(size_t needed);
+    void remove_account_data(txn& t, uint64_t id, uint64_t height);
+    std::vector<account> read_accounts(txn& t);
+    bool read_account(txn& t, uint64_t id, account& acc);
+    void write_account(txn& t, const account& acc);
+
+    std::string m_path;
+    MDB_env *m_env;
+    MDB_dbi m_accounts;     //!< account id -> account
+    MDB_dbi m_account_ids;  //!< address -> account id
+    MDB_dbi m_outputs;      //!< account id -> outputs, by height
+    MDB_dbi m_spends;       //!< account id -> spends, by height
+    MDB_dbi m_owners;       //!< (index amount, global index) -> account id and the output
+    MDB_dbi m_blocks;       //!< height -> hash of the scanned blocks
+    /// Held shared by transactions, and exclusively to grow the map which needs there to be none
+    boost::shared_mutex m_resize_lock;
+  };
+}
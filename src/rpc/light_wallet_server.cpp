@@ -0,0 +1,695 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <ctime>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "device/device.hpp"
+#include "ringct/rctSigs.h"
+#include "string_tools.h"
+#include "light_wallet_server.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "lightwallet"
+
+namespace
+{
+  // what the wallets (and OpenMonero) report, rather than CORE_RPC_STATUS_OK
+  const char STATUS_SUCCESS[] = "success";
+  const char STATUS_ERROR[] = "error";
+
+  constexpr uint64_t FEE_ESTIMATE_GRACE_BLOCKS = 10;
+  constexpr uint32_t MAX_RANDOM_OUTS = 64;
+
+  struct scanned_tx
+  {
+    uint64_t height;
+    uint64_t timestamp;
+    crypto::hash hash;
+    crypto::public_key pub_key;
+    bool coinbase;
+  };
+
+  struct output_match
+  {
+    size_t tx;
+    size_t out;
+    crypto::key_derivation derivation;
+  };
+
+  // the account's outputs in the txs of the blocks not scanned for it yet, deriving from all their tx pub keys at once
+  void find_outputs(const cryptonote::light_wallet_db::account& acc, const std::vector<cryptonote::transaction>& txs, const std::vector<scanned_tx>& infos, std::vector<output_match>& matches)
+  {
+    const size_t first = std::lower_bound(infos.begin(), infos.end(), acc.scanned_height,
+        [](const scanned_tx& info, uint64_t height) { return info.height < height; }) - infos.begin();
+    std::vector<crypto::public_key> pkeys;
+    pkeys.reserve(infos.size() - first);
+    for (size_t i = first; i < infos.size(); ++i)
+      pkeys.push_back(infos[i].pub_key);
+
+    crypto::key_derivation identity;
+    static_assert(sizeof(identity) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+    memcpy(&identity, rct::identity().bytes, sizeof(identity));
+    std::vector<crypto::key_derivation> derivations(pkeys.size(), identity);
+    crypto::secret_key view_secret_key;
+    memcpy(&unwrap(unwrap(view_secret_key)), &acc.view_secret_key, sizeof(acc.view_secret_key));
+    // txs without a valid pub key keep the identity derivation, which matches nothing
+    crypto::generate_key_derivations(view_secret_key, epee::to_span(pkeys), epee::to_mut_span(derivations));
+
+    for (size_t i = first; i < infos.size(); ++i)
+    {
+      if (infos[i].pub_key == crypto::null_pkey)
+        continue;
+      const crypto::key_derivation& derivation = derivations[i - first];
+      const std::vector<cryptonote::tx_out>& vout = txs[i].vout;
+      for (size_t k = 0; k < vout.size(); ++k)
+      {
+        if (vout[k].target.type() != typeid(cryptonote::txout_to_key))
+          continue;
+        crypto::public_key derived;
+        if (crypto::derive_public_key(derivation, k, acc.address.m_spend_public_key, derived) && derived == boost::get<cryptonote::txout_to_key>(vout[k].target).key)
+          matches.push_back({i, k, derivation});
+      }
+    }
+  }
+
+  uint64_t decode_amount(const cryptonote::transaction& tx, const crypto::key_derivation& derivation, size_t i, hw::device& hwdev)
+  {
+    crypto::secret_key scalar;
+    hwdev.derivation_to_scalar(derivation, i, scalar);
+    rct::key mask;
+    switch (tx.rct_signatures.type)
+    {
+    case rct::RCTTypeSimple:
+    case rct::RCTTypeBulletproof:
+      return rct::decodeRctSimple(tx.rct_signatures, rct::sk2rct(scalar), i, mask, hwdev);
+    case rct::RCTTypeFull:
+      return rct::decodeRct(tx.rct_signatures, rct::sk2rct(scalar), i, mask, hwdev);
+    default:
+      throw std::runtime_error("Unsupported rct type: " + std::to_string(tx.rct_signatures.type));
+    }
+  }
+
+  crypto::hash get_payment_id(const cryptonote::transaction& tx, const crypto::public_key& tx_pub_key, const crypto::secret_key& view_secret_key, hw::device& hwdev)
+  {
+    crypto::hash payment_id = crypto::null_hash;
+    std::vector<cryptonote::tx_extra_field> fields;
+    cryptonote::parse_tx_extra(tx.extra, fields);
+    cryptonote::tx_extra_nonce nonce;
+    if (!cryptonote::find_tx_extra_field_by_type(fields, nonce))
+      return payment_id;
+    crypto::hash8 payment_id8;
+    if (!cryptonote::get_payment_id_from_tx_extra_nonce(nonce.nonce, payment_id)
+        && cryptonote::get_encrypted_payment_id_from_tx_extra_nonce(nonce.nonce, payment_id8)
+        && hwdev.decrypt_payment_id(payment_id8, tx_pub_key, view_secret_key))
+      memcpy(payment_id.data, payment_id8.data, sizeof(payment_id8));
+    return payment_id;
+  }
+
+  // <commitment> + <encrypted mask> + <encrypted amount>, as light_wallet_parse_rct_str reads it
+  std::string rct_string(const cryptonote::light_wallet_db::output& o)
+  {
+    if (!o.rct)
+      return std::string();
+    return epee::string_tools::pod_to_hex(o.commitment) + epee::string_tools::pod_to_hex(o.encrypted_mask) + epee::string_tools::pod_to_hex(o.encrypted_amount);
+  }
+
+  // txs of an account by height, then hash
+  struct tx_order
+  {
+    bool operator()(const std::pair<uint64_t, crypto::hash>& a, const std::pair<uint64_t, crypto::hash>& b) const
+    {
+      return a.first != b.first ? a.first < b.first : memcmp(a.second.data, b.second.data, sizeof(a.second.data)) < 0;
+    }
+  };
+
+  uint64_t parse_uint64(const std::string& s, uint64_t def)
+  {
+    try { return s.empty() ? def : boost::lexical_cast<uint64_t>(s); }
+    catch (const boost::bad_lexical_cast&) { return def; }
+  }
+}
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  light_wallet_server::light_wallet_server(core& c): m_core(c), m_stop(false)
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  light_wallet_server::~light_wallet_server()
+  {
+    stop();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_server::init(const std::string& path)
+  {
+    m_db.open(path);
+    MGINFO("Light wallet server database opened at " << path << ", " << m_db.get_accounts().size() << " accounts");
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_server::run()
+  {
+    m_stop = false;
+    m_thread = boost::thread([this]() { scan_loop(); });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_server::stop()
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(m_wakeup_lock);
+      m_stop = true;
+    }
+    m_wakeup.notify_all();
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_server::scan_loop()
+  {
+    while (!m_stop)
+    {
+      bool scanned = false;
+      try
+      {
+        scanned = scan();
+      }
+      catch (const std::exception& e)
+      {
+        MERROR("Failed to scan blocks for light wallets: " << e.what());
+      }
+      if (scanned)
+        continue;
+      boost::unique_lock<boost::mutex> lock(m_wakeup_lock);
+      if (!m_stop)
+        m_wakeup.wait_for(lock, boost::chrono::seconds(1));
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void light_wallet_server::handle_reorg(uint64_t chain_height)
+  {
+    uint64_t top;
+    crypto::hash hash;
+    if (!m_db.get_top_block(top, hash))
+      return;
+    if (top < chain_height && m_core.get_block_id_by_height(top) == hash)
+      return;
+
+    // the lowest of the scanned blocks which aren't in the chain any more
+    uint64_t fork = top;
+    for (uint64_t height = top; height-- > 0; )
+    {
+      if (!m_db.get_block_hash(height, hash) || (height < chain_height && m_core.get_block_id_by_height(height) == hash))
+        break;
+      fork = height;
+    }
+    MINFO("Rolling light wallets back to height " << fork << " after a reorg");
+    m_db.rollback(fork);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::scan()
+  {
+    const uint64_t chain_height = m_core.get_current_blockchain_height();
+    handle_reorg(chain_height);
+
+    const std::vector<light_wallet_db::account> all_accounts = m_db.get_accounts();
+    std::vector<const light_wallet_db::account*> accounts;
+    uint64_t from = chain_height;
+    for (const light_wallet_db::account& acc: all_accounts)
+    {
+      if (acc.scanned_height >= chain_height)
+        continue;
+      accounts.push_back(&acc);
+      from = std::min(from, acc.scanned_height);
+    }
+    if (accounts.empty())
+      return false;
+
+    std::vector<block> blocks;
+    if (!m_core.get_blocks(from, std::min(chain_height - from, BLOCKS_PER_SCAN), blocks) || blocks.empty())
+      return false;
+
+    // the txs of the blocks, miner txs first, in chain order
+    light_wallet_db::scan_batch batch;
+    batch.to_height = from + blocks.size();
+    std::vector<transaction> txs;
+    std::vector<scanned_tx> infos;
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      const block& b = blocks[i];
+      const uint64_t height = from + i;
+      batch.blocks.emplace_back(height, get_block_hash(b));
+
+      std::vector<transaction> block_txs;
+      std::vector<crypto::hash> missed;
+      if (!m_core.get_transactions(b.tx_hashes, block_txs, missed) || !missed.empty())
+        throw std::runtime_error("Failed to get the transactions of block " + std::to_string(height));
+      txs.push_back(b.miner_tx);
+      infos.push_back({height, b.timestamp, get_transaction_hash(b.miner_tx), get_tx_pub_key_from_extra(b.miner_tx), true});
+      for (size_t j = 0; j < block_txs.size(); ++j)
+      {
+        infos.push_back({height, b.timestamp, b.tx_hashes[j], get_tx_pub_key_from_extra(block_txs[j]), false});
+        txs.push_back(std::move(block_txs[j]));
+      }
+    }
+
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+      for (const txin_v& in: txs[i].vin)
+      {
+        if (in.type() != typeid(txin_to_key))
+          continue;
+        const txin_to_key& in_to_key = boost::get<txin_to_key>(in);
+        batch.inputs.push_back({infos[i].height, infos[i].timestamp, txs[i].unlock_time, infos[i].hash, in_to_key.k_image,
+            in_to_key.amount, relative_output_offsets_to_absolute(in_to_key.key_offsets)});
+      }
+    }
+
+    // a job per account, which is where the scalar multiplications are
+    std::vector<std::vector<output_match>> matches(accounts.size());
+    {
+      tools::threadpool& tpool = tools::threadpool::getInstance();
+      tools::threadpool::waiter waiter;
+      for (size_t a = 0; a < accounts.size(); ++a)
+        tpool.submit(&waiter, [&, a]() { find_outputs(*accounts[a], txs, infos, matches[a]); }, true);
+      waiter.wait(&tpool);
+    }
+
+    hw::device& hwdev = hw::get_device("default");
+    std::unordered_map<size_t, std::vector<uint64_t>> global_indexes;
+    for (size_t a = 0; a < accounts.size(); ++a)
+    {
+      const light_wallet_db::account& acc = *accounts[a];
+      batch.scanned_from[acc.id] = acc.scanned_height;
+      if (matches[a].empty())
+        continue;
+      crypto::secret_key view_secret_key;
+      memcpy(&unwrap(unwrap(view_secret_key)), &acc.view_secret_key, sizeof(acc.view_secret_key));
+      for (const output_match& m: matches[a])
+      {
+        const transaction& tx = txs[m.tx];
+        const scanned_tx& info = infos[m.tx];
+        auto it = global_indexes.find(m.tx);
+        if (it == global_indexes.end())
+        {
+          it = global_indexes.emplace(m.tx, std::vector<uint64_t>()).first;
+          if (!m_core.get_tx_outputs_gindexs(info.hash, it->second) || it->second.size() != tx.vout.size())
+            throw std::runtime_error("Failed to get the output indexes of tx " + epee::string_tools::pod_to_hex(info.hash));
+        }
+
+        light_wallet_db::output o;
+        memset(&o, 0, sizeof(o));
+        o.height = info.height;
+        o.global_index = it->second[m.out];
+        o.timestamp = info.timestamp;
+        o.unlock_time = tx.unlock_time;
+        o.tx_hash = info.hash;
+        o.tx_prefix_hash = get_transaction_prefix_hash(tx);
+        o.tx_pub_key = info.pub_key;
+        o.key = boost::get<txout_to_key>(tx.vout[m.out].target).key;
+        o.payment_id = get_payment_id(tx, info.pub_key, view_secret_key, hwdev);
+        o.out_index = m.out;
+        o.coinbase = info.coinbase;
+        // as the blockchain db indexes them: v2 miner outputs are RingCT ones with an identity mask
+        o.rct = tx.version > 1;
+        if (info.coinbase && tx.version == 2)
+        {
+          o.amount = tx.vout[m.out].amount;
+          o.commitment = rct::zeroCommit(o.amount);
+        }
+        else if (tx.version > 1)
+        {
+          try
+          {
+            o.amount = decode_amount(tx, m.derivation, m.out, hwdev);
+          }
+          catch (const std::exception& e)
+          {
+            MWARNING("Failed to decode output " << m.out << " of tx " << info.hash << ": " << e.what());
+            continue;
+          }
+          o.commitment = tx.rct_signatures.outPk[m.out].mask;
+          o.encrypted_mask = tx.rct_signatures.ecdhInfo[m.out].mask;
+          o.encrypted_amount = tx.rct_signatures.ecdhInfo[m.out].amount;
+        }
+        else
+        {
+          o.amount = tx.vout[m.out].amount;
+        }
+        o.index_amount = o.rct ? 0 : o.amount;
+        for (const txin_v& in: tx.vin)
+        {
+          if (in.type() == typeid(txin_to_key))
+          {
+            o.mixin = boost::get<txin_to_key>(in).key_offsets.size() - 1;
+            break;
+          }
+        }
+        batch.outputs.emplace_back(acc.id, o);
+      }
+    }
+
+    m_db.store(batch);
+    MDEBUG("Scanned blocks " << from << "-" << batch.to_height - 1 << " for " << accounts.size() << " light wallets, "
+        << batch.outputs.size() << " outputs found");
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::parse_keys(const std::string& address, const std::string& view_key, account_public_address& addr, crypto::secret_key& key, std::string& error) const
+  {
+    address_parse_info info;
+    if (!get_account_address_from_str(info, m_core.get_nettype(), address))
+    {
+      error = "Invalid address";
+      return false;
+    }
+    if (info.is_subaddress)
+    {
+      error = "Subaddresses are not supported";
+      return false;
+    }
+    crypto::public_key view_public_key;
+    if (!epee::string_tools::hex_to_pod(view_key, key) || !crypto::secret_key_to_public_key(key, view_public_key) || view_public_key != info.address.m_view_public_key)
+    {
+      error = "Invalid view key";
+      return false;
+    }
+    addr = info.address;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::find_account(const std::string& address, const std::string& view_key, light_wallet_db::account& acc, std::string& error)
+  {
+    account_public_address addr;
+    crypto::secret_key key;
+    if (!parse_keys(address, view_key, addr, key, error))
+      return false;
+    if (!m_db.get_account(addr, acc))
+    {
+      error = "Account not found, log in first";
+      return false;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::is_unlocked(const light_wallet_db::output& o, uint64_t chain_height) const
+  {
+    if (o.height + (o.coinbase ? CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW : CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE) > chain_height)
+      return false;
+    if (o.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER)
+      return o.unlock_time <= chain_height - 1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS;
+    return o.unlock_time <= (uint64_t)time(NULL) + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_SECONDS_V2;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::on_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res)
+  {
+    res.new_address = false;
+    res.status = STATUS_ERROR;
+    try
+    {
+      account_public_address addr;
+      crypto::secret_key key;
+      if (!parse_keys(req.address, req.view_key, addr, key, res.reason))
+        return true;
+      light_wallet_db::account acc;
+      if (!m_db.get_account(addr, acc))
+      {
+        if (!req.create_account)
+        {
+          res.reason = "Account not found";
+          return true;
+        }
+        // new accounts have nothing before now, importing scans the whole chain
+        res.new_address = m_db.add_account(addr, key, m_core.get_current_blockchain_height(), acc);
+        if (res.new_address)
+          MINFO("Light wallet account " << acc.id << " registered at height " << acc.start_height);
+      }
+      res.status = STATUS_SUCCESS;
+    }
+    catch (const std::exception& e)
+    {
+      res.reason = e.what();
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::on_import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res)
+  {
+    res.import_fee = 0;
+    res.new_request = false;
+    res.request_fulfilled = false;
+    res.status = STATUS_ERROR;
+    try
+    {
+      light_wallet_db::account acc;
+      std::string error;
+      if (!find_account(req.address, req.view_key, acc, error))
+      {
+        res.status = error;
+        return true;
+      }
+      // importing is free, and done as soon as the chain is scanned again for the account
+      if (acc.start_height > 0)
+      {
+        m_db.reset_account(acc.id, 0);
+        res.new_request = true;
+        MINFO("Light wallet account " << acc.id << " imported, scanning again from the genesis block");
+        m_wakeup.notify_all();
+      }
+      res.request_fulfilled = true;
+      res.status = STATUS_SUCCESS;
+    }
+    catch (const std::exception& e)
+    {
+      res.status = e.what();
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::on_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res)
+  {
+    light_wallet_db::account acc;
+    std::string error;
+    if (!find_account(req.address, req.view_key, acc, error))
+    {
+      MDEBUG("get_address_info: " << error);
+      return false;
+    }
+    const uint64_t chain_height = m_core.get_current_blockchain_height();
+    res.locked_funds = 0;
+    res.total_received = 0;
+    res.total_sent = 0;
+    for (const light_wallet_db::output& o: m_db.get_outputs(acc.id))
+    {
+      res.total_received += o.amount;
+      if (!is_unlocked(o, chain_height))
+        res.locked_funds += o.amount;
+    }
+    for (const light_wallet_db::spend& s: m_db.get_spends(acc.id))
+    {
+      res.total_sent += s.amount;
+      res.spent_outputs.push_back({s.amount, epee::string_tools::pod_to_hex(s.key_image), epee::string_tools::pod_to_hex(s.out_tx_pub_key), s.out_index, s.mixin});
+    }
+    res.scanned_height = acc.scanned_height;
+    res.scanned_block_height = acc.scanned_height;
+    res.start_height = acc.start_height;
+    res.transaction_height = chain_height;
+    res.blockchain_height = chain_height;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::on_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res)
+  {
+    res.total_received = 0;
+    res.total_received_unlocked = 0;
+    res.status = STATUS_ERROR;
+    light_wallet_db::account acc;
+    std::string error;
+    if (!find_account(req.address, req.view_key, acc, error))
+    {
+      MDEBUG("get_address_txs: " << error);
+      return true;
+    }
+
+    const uint64_t chain_height = m_core.get_current_blockchain_height();
+    std::map<std::pair<uint64_t, crypto::hash>, COMMAND_RPC_GET_ADDRESS_TXS::transaction, tx_order> txs;
+    auto get_tx = [&txs](uint64_t height, const crypto::hash& hash, uint64_t timestamp, uint64_t unlock_time, bool coinbase, uint32_t mixin) -> COMMAND_RPC_GET_ADDRESS_TXS::transaction& {
+      auto it = txs.find(std::make_pair(height, hash));
+      if (it != txs.end())
+        return it->second;
+      COMMAND_RPC_GET_ADDRESS_TXS::transaction& t = txs[std::make_pair(height, hash)];
+      t.hash = epee::string_tools::pod_to_hex(hash);
+      t.timestamp = timestamp;
+      t.total_received = 0;
+      t.total_sent = 0;
+      t.unlock_time = unlock_time;
+      t.height = height;
+      t.payment_id = epee::string_tools::pod_to_hex(crypto::null_hash);
+      t.coinbase = coinbase;
+      t.mempool = false;
+      t.mixin = mixin;
+      return t;
+    };
+
+    for (const light_wallet_db::output& o: m_db.get_outputs(acc.id))
+    {
+      COMMAND_RPC_GET_ADDRESS_TXS::transaction& t = get_tx(o.height, o.tx_hash, o.timestamp, o.unlock_time, o.coinbase, o.mixin);
+      t.total_received += o.amount;
+      if (o.payment_id != crypto::null_hash)
+        t.payment_id = epee::string_tools::pod_to_hex(o.payment_id);
+      res.total_received += o.amount;
+      if (is_unlocked(o, chain_height))
+        res.total_received_unlocked += o.amount;
+    }
+    for (const light_wallet_db::spend& s: m_db.get_spends(acc.id))
+    {
+      COMMAND_RPC_GET_ADDRESS_TXS::transaction& t = get_tx(s.height, s.tx_hash, s.timestamp, s.unlock_time, false, s.mixin);
+      t.total_sent += s.amount;
+      t.spent_outputs.push_back({s.amount, epee::string_tools::pod_to_hex(s.key_image), epee::string_tools::pod_to_hex(s.out_tx_pub_key), s.out_index, s.mixin});
+    }
+
+    res.transactions.reserve(txs.size());
+    for (auto& e: txs)
+    {
+      e.second.id = res.transactions.size();
+      res.transactions.push_back(std::move(e.second));
+    }
+    res.scanned_height = acc.scanned_height;
+    res.scanned_block_height = acc.scanned_height;
+    res.blockchain_height = chain_height;
+    res.status = STATUS_SUCCESS;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::on_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res)
+  {
+    res.amount = 0;
+    res.per_kb_fee = 0;
+    res.status = STATUS_ERROR;
+    light_wallet_db::account acc;
+    if (!find_account(req.address, req.view_key, acc, res.reason))
+      return true;
+
+    const uint64_t min_amount = parse_uint64(req.amount, 0);
+    const uint64_t dust_threshold = parse_uint64(req.dust_threshold, ::config::DEFAULT_DUST_THRESHOLD);
+
+    // outputs are only ever known to be spent by the wallet, which checks the key images of their candidate spends
+    std::unordered_multimap<crypto::public_key, light_wallet_db::spend> spends;
+    for (const light_wallet_db::spend& s: m_db.get_spends(acc.id))
+      spends.emplace(s.out_tx_pub_key, s);
+
+    for (const light_wallet_db::output& o: m_db.get_outputs(acc.id))
+    {
+      if (o.amount < min_amount || (!req.use_dust && !o.rct && o.amount < dust_threshold))
+        continue;
+      COMMAND_RPC_GET_UNSPENT_OUTS::output out;
+      out.amount = o.amount;
+      out.public_key = epee::string_tools::pod_to_hex(o.key);
+      out.index = o.out_index;
+      out.global_index = o.global_index;
+      out.rct = rct_string(o);
+      out.tx_hash = epee::string_tools::pod_to_hex(o.tx_hash);
+      out.tx_pub_key = epee::string_tools::pod_to_hex(o.tx_pub_key);
+      out.tx_prefix_hash = epee::string_tools::pod_to_hex(o.tx_prefix_hash);
+      const auto range = spends.equal_range(o.tx_pub_key);
+      for (auto it = range.first; it != range.second; ++it)
+        if (it->second.out_index == o.out_index)
+          out.spend_key_images.push_back(epee::string_tools::pod_to_hex(it->second.key_image));
+      out.timestamp = o.timestamp;
+      out.height = o.height;
+      res.outputs.push_back(std::move(out));
+      res.amount += o.amount;
+    }
+
+    const Blockchain& bc = m_core.get_blockchain_storage();
+    const uint64_t fee = bc.get_dynamic_base_fee_estimate(FEE_ESTIMATE_GRACE_BLOCKS);
+    res.per_kb_fee = bc.get_current_hard_fork_version() >= HF_VERSION_PER_BYTE_FEE ? fee * 1024 : fee;
+    res.status = STATUS_SUCCESS;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool light_wallet_server::on_get_random_outs(const COMMAND_RPC_GET_RANDOM_OUTS::request& req, COMMAND_RPC_GET_RANDOM_OUTS::response& res)
+  {
+    const uint32_t count = std::min(req.count, MAX_RANDOM_OUTS);
+    const BlockchainDB& db = m_core.get_blockchain_storage().get_db();
+    for (const std::string& amount_str: req.amounts)
+    {
+      uint64_t amount;
+      try
+      {
+        amount = boost::lexical_cast<uint64_t>(amount_str);
+      }
+      catch (const boost::bad_lexical_cast&)
+      {
+        res.Error = "Invalid amount " + amount_str;
+        return true;
+      }
+
+      res.amount_outs.emplace_back();
+      COMMAND_RPC_GET_RANDOM_OUTS::amount_out& amount_out = res.amount_outs.back();
+      amount_out.amount = amount;
+      const uint64_t num_outputs = db.get_num_outputs(amount);
+      std::unordered_set<uint64_t> picked;
+      // locked outputs are skipped, so ask a few times for some more than needed
+      for (int attempt = 0; attempt < 8 && amount_out.outputs.size() < count && picked.size() < num_outputs; ++attempt)
+      {
+        COMMAND_RPC_GET_OUTPUTS_BIN::request outs_req;
+        COMMAND_RPC_GET_OUTPUTS_BIN::response outs_res;
+        const size_t wanted = std::min<uint64_t>(num_outputs - picked.size(), (count - amount_out.outputs.size()) * 3 / 2 + 1);
+        while (outs_req.outputs.size() < wanted)
+        {
+          const uint64_t index = crypto::rand<uint64_t>() % num_outputs;
+          if (picked.insert(index).second)
+            outs_req.outputs.push_back({amount, index});
+        }
+        if (!m_core.get_outs(outs_req, outs_res))
+        {
+          res.Error = "Failed to get outputs";
+          return true;
+        }
+        for (size_t i = 0; i < outs_res.outs.size() && amount_out.outputs.size() < count; ++i)
+        {
+          const COMMAND_RPC_GET_OUTPUTS_BIN::outkey& out = outs_res.outs[i];
+          if (!out.unlocked)
+            continue;
+          // only the commitment is read from random outputs
+          const std::string rct = amount == 0 ? epee::string_tools::pod_to_hex(out.mask) + std::string(128, '0') : std::string();
+          amount_out.outputs.push_back({epee::string_tools::pod_to_hex(out.key), outs_req.outputs[i].index, rct});
+        }
+      }
+    }
+    return true;
+  }
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <string>
+
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "light_wallet_db.h"
+
+namespace cryptonote
+{
+  class core;
+
+  /// Serves the light wallet API wallet2 speaks (login, get_address_info, get_unspent_outs...) for
+  /// the accounts which logged in with their view key.
+  ///
+  /// A thread scans each new block once for all of them, in chunks of blocks for which each account's
+  /// view key derivations of all the tx pub keys are computed in one batch, and keeps what it finds
+  /// in a light_wallet_db. Transactions in the pool aren't looked at, only mined ones are reported.
+  class light_wallet_server
+  {
+  public:
+    /// Number of blocks scanned and stored at once
+    static constexpr uint64_t BLOCKS_PER_SCAN = 100;
+
+    explicit light_wallet_server(core& c);
+    ~light_wallet_server();
+
+    /// Opens the database in the given directory
+    void init(const std::string& path);
+    /// Starts scanning
+    void run();
+    void stop();
+
+    bool on_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res);
+    bool on_import_wallet_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res);
+    bool on_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res);
+    bool on_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res);
+    bool on_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res);
+    bool on_get_random_outs(const COMMAND_RPC_GET_RANDOM_OUTS::request& req, COMMAND_RPC_GET_RANDOM_OUTS::response& res);
+
+  private:
+    void scan_loop();
+    /// Scans the next chunk of blocks, returns false if there was nothing to scan
+    bool scan();
+    void handle_reorg(uint64_t chain_height);
+    /// Parses the address and view key of a request, and finds the account if it's registered
+    bool parse_keys(const std::string& address, const std::string& view_key, account_public_address& addr, crypto::secret_key& key, std::string& error) const;
+    bool find_account(const std::string& address, const std::string& view_key, light_wallet_db::account& acc, std::string& error);
+    bool is_unlocked(const light_wallet_db::output& o, uint64_t chain_height) const;
+
+    core& m_core;
+    light_wallet_db m_db;
+    boost::thread m_thread;
+    std::atomic<bool> m_stop;
+    boost::mutex m_wakeup_lock;
+    boost::condition_variable m_wakeup;
+  };
+}
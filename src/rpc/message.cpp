@@ -33,6 +33,8 @@
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 
+#include <vector>
+
 namespace cryptonote
 {
 
@@ -52,6 +54,47 @@ constexpr const char id_field[] = "id";
 constexpr const char method_field[] = "method";
 constexpr const char params_field[] = "params";
 constexpr const char result_field[] = "result";
+
+// the first buffer fits most responses, chunks past it are sized for block and transaction lists
+constexpr size_t JSON_POOL_BUFFER_SIZE = 64 * 1024;
+constexpr size_t JSON_POOL_CHUNK_SIZE = 256 * 1024;
+constexpr size_t MAX_CACHED_JSON_ALLOCATORS = 4;
+}
+
+struct pooled_json_allocator
+{
+  pooled_json_allocator()
+    : buffer(new char[JSON_POOL_BUFFER_SIZE])
+    , allocator(buffer.get(), JSON_POOL_BUFFER_SIZE, JSON_POOL_CHUNK_SIZE)
+  {
+  }
+
+  std::unique_ptr<char[]> buffer;
+  rapidjson::MemoryPoolAllocator<> allocator;
+};
+
+namespace
+{
+thread_local std::vector<std::unique_ptr<pooled_json_allocator>> cached_json_allocators;
+
+pooled_json_allocator* acquire_json_allocator()
+{
+  if (cached_json_allocators.empty())
+    return new pooled_json_allocator();
+  pooled_json_allocator* allocator = cached_json_allocators.back().release();
+  cached_json_allocators.pop_back();
+  return allocator;
+}
+}
+
+void pooled_json_allocator_deleter::operator()(pooled_json_allocator* allocator) const
+{
+  std::unique_ptr<pooled_json_allocator> ptr(allocator);
+  if (cached_json_allocators.size() >= MAX_CACHED_JSON_ALLOCATORS)
+    return;
+  // frees the chunks allocated past the first buffer
+  ptr->allocator.Clear();
+  cached_json_allocators.push_back(std::move(ptr));
 }
 
 rapidjson::Value Message::toJson(rapidjson::Document& doc) const
@@ -75,7 +118,13 @@ void Message::fromJson(rapidjson::Value& val)
 }
 
 
-FullMessage::FullMessage(const std::string& request, Message* message)
+FullMessage::FullMessage()
+  : allocator(acquire_json_allocator())
+  , doc(&allocator->allocator)
+{
+}
+
+FullMessage::FullMessage(const std::string& request, Message* message) : FullMessage()
 {
   doc.SetObject();
 
@@ -86,7 +135,7 @@ FullMessage::FullMessage(const std::string& request, Message* message)
   doc.AddMember("jsonrpc", rapidjson::Value("2.0"), doc.GetAllocator());
 }
 
-FullMessage::FullMessage(Message* message)
+FullMessage::FullMessage(Message* message) : FullMessage()
 {
   doc.SetObject();
 
@@ -108,7 +157,7 @@ FullMessage::FullMessage(Message* message)
   }
 }
 
-FullMessage::FullMessage(const std::string& json_string, bool request)
+FullMessage::FullMessage(const std::string& json_string, bool request) : FullMessage()
 {
   doc.Parse(json_string.c_str());
   if (doc.HasParseError() || !doc.IsObject())
@@ -289,6 +338,17 @@ std::string BAD_JSON(const std::string& error_details)
   return fail_response.getJson();
 }
 
+std::string BUSY(const std::string& request, rapidjson::Value& id)
+{
+  Message busy;
+  busy.status = Message::STATUS_RETRY;
+  busy.error_details = std::string("too many concurrent \"") + request + "\" requests, retry later.";
+
+  FullMessage busy_response = FullMessage::responseMessage(&busy, id);
+
+  return busy_response.getJson();
+}
+
 
 }  // namespace rpc
 
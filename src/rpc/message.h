@@ -30,6 +30,7 @@
 
 #include "rapidjson/document.h"
 #include "rpc/message_data_structs.h"
+#include <memory>
 #include <string>
 
 /* I normally hate using macros, but in this case it would be untenably
@@ -78,12 +79,20 @@ namespace rpc
       uint32_t rpc_version;
   };
 
+  /// Memory pool of a FullMessage document, taken from and given back to a small per-thread cache so
+  /// the pool's first buffer is reused by later messages instead of allocated for each one
+  struct pooled_json_allocator;
+  struct pooled_json_allocator_deleter
+  {
+    void operator()(pooled_json_allocator* allocator) const;
+  };
+
   class FullMessage
   {
     public:
       ~FullMessage() { }
 
-      FullMessage(FullMessage&& rhs) noexcept : doc(std::move(rhs.doc)) { }
+      FullMessage(FullMessage&& rhs) noexcept : allocator(std::move(rhs.allocator)), doc(std::move(rhs.doc)) { }
 
       FullMessage(const std::string& json_string, bool request=false);
 
@@ -110,11 +119,13 @@ namespace rpc
       static FullMessage* timeoutMessage();
     private:
 
-      FullMessage() = default;
+      FullMessage();
 
       FullMessage(const std::string& request, Message* message);
       FullMessage(Message* message);
 
+      // declared before doc, which allocates from it
+      std::unique_ptr<pooled_json_allocator, pooled_json_allocator_deleter> allocator;
       rapidjson::Document doc;
   };
 
@@ -125,6 +136,9 @@ namespace rpc
 
   std::string BAD_JSON(const std::string& error_details);
 
+  // the request can't be handled right now, the client should retry later
+  std::string BUSY(const std::string& request, rapidjson::Value& id);
+
 
 }  // namespace rpc
 
@@ -0,0 +1,99 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "rpc_request_coalescer.h"
+
+namespace cryptonote
+{
+  rpc_request_coalescer::rpc_request_coalescer()
+    : m_computed(0)
+    , m_shared(0)
+  {
+  }
+
+  void rpc_request_coalescer::land(const std::string& key, const std::shared_ptr<flight>& f, bool ok, std::shared_ptr<const std::string> response)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      f->done = true;
+      f->ok = ok;
+      f->response = std::move(response);
+      m_flights.erase(key);
+    }
+    m_landed.notify_all();
+  }
+
+  bool rpc_request_coalescer::run(const std::string& key, const compute_t& compute, std::string& response, bool& shared)
+  {
+    shared = false;
+    std::shared_ptr<flight> f;
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      auto it = m_flights.find(key);
+      if (it != m_flights.end())
+      {
+        f = it->second;
+        while (!f->done)
+          m_landed.wait(lock);
+        if (f->ok)
+        {
+          ++m_shared;
+          lock.unlock();
+          response = *f->response;
+          shared = true;
+          return true;
+        }
+        // the call we waited for failed, try on our own rather than all failing the same way
+        lock.unlock();
+        return compute(response);
+      }
+      f = std::make_shared<flight>();
+      m_flights.emplace(key, f);
+      ++m_computed;
+    }
+
+    bool ok = false;
+    try
+    {
+      ok = compute(response);
+    }
+    catch (...)
+    {
+      land(key, f, false, nullptr);
+      throw;
+    }
+    land(key, f, ok, ok ? std::make_shared<const std::string>(response) : nullptr);
+    return ok;
+  }
+
+  rpc_request_coalescer::stats rpc_request_coalescer::get_stats() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    return {m_computed, m_shared};
+  }
+}
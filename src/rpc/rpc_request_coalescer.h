@@ -0,0 +1,79 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace cryptonote
+{
+  /// Runs identical RPC calls arriving while one of them is being computed only once: the later ones wait
+  /// for the first and get a copy of its serialized response. Responses are not kept once the call is
+  /// done, so this is for calls which are asked for in bursts, like blocks right after a new one is found.
+  class rpc_request_coalescer
+  {
+  public:
+    struct stats
+    {
+      uint64_t computed;
+      uint64_t shared;
+    };
+
+    typedef std::function<bool(std::string& response)> compute_t;
+
+    rpc_request_coalescer();
+
+    /// Sets `response` to the one `compute` makes for `key`, or to the one a running call with the same key
+    /// made, in which case `shared` is set. If that call fails, `compute` is run again for this one.
+    bool run(const std::string& key, const compute_t& compute, std::string& response, bool& shared);
+
+    stats get_stats() const;
+
+  private:
+    struct flight
+    {
+      bool done = false;
+      bool ok = false;
+      std::shared_ptr<const std::string> response;
+    };
+
+    void land(const std::string& key, const std::shared_ptr<flight>& f, bool ok, std::shared_ptr<const std::string> response);
+
+    mutable boost::mutex m_lock;
+    boost::condition_variable m_landed;
+    std::unordered_map<std::string, std::shared_ptr<flight>> m_flights;
+    uint64_t m_computed;
+    uint64_t m_shared;
+  };
+}
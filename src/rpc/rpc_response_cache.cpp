@@ -0,0 +1,158 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "rpc_response_cache.h"
+
+namespace
+{
+  constexpr std::chrono::seconds FRESH_TIME(1);
+  // a single response may take at most this part of the cache
+  constexpr size_t MAX_ENTRY_SHARE = 8;
+}
+
+namespace cryptonote
+{
+  rpc_response_cache::rpc_response_cache(cookie_source tip_cookie, cookie_source pool_cookie, size_t max_size)
+    : m_tip_cookie(std::move(tip_cookie))
+    , m_pool_cookie(std::move(pool_cookie))
+    , m_max_size(max_size)
+    , m_size(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+  {
+  }
+
+  void rpc_response_cache::set_max_size(size_t max_size)
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    m_max_size = max_size;
+    while (m_size > m_max_size)
+    {
+      erase(--m_entries.end());
+      ++m_evictions;
+    }
+  }
+
+  rpc_response_cache::stamp rpc_response_cache::get_stamp() const
+  {
+    return {m_tip_cookie(), m_pool_cookie(), std::chrono::steady_clock::now()};
+  }
+
+  bool rpc_response_cache::is_valid(policy p, const stamp& computed, const stamp& current)
+  {
+    if (computed.tip_cookie != current.tip_cookie)
+      return false;
+    if (p == same_tip)
+      return true;
+    if (computed.pool_cookie != current.pool_cookie)
+      return false;
+    return p == same_tip_and_pool || current.time - computed.time <= FRESH_TIME;
+  }
+
+  void rpc_response_cache::erase(entry_list::iterator it)
+  {
+    m_size -= entry_size(it->key, it->response);
+    m_index.erase(it->key);
+    m_entries.erase(it);
+  }
+
+  bool rpc_response_cache::get(const std::string& key, policy p, std::string& response, stamp& current)
+  {
+    current = get_stamp();
+
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    if (!m_max_size)
+      return false;
+
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+      ++m_misses;
+      return false;
+    }
+    if (!is_valid(p, it->second->computed, current))
+    {
+      erase(it->second);
+      ++m_misses;
+      return false;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    response = it->second->response;
+    ++m_hits;
+    return true;
+  }
+
+  void rpc_response_cache::put(const std::string& key, policy p, const stamp& current, const std::string& response)
+  {
+    const size_t size = entry_size(key, response);
+
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    if (!m_max_size || size > m_max_size / MAX_ENTRY_SHARE)
+      return;
+
+    // a block or tx added while computing makes the response stale already
+    if (!is_valid(p, current, get_stamp()))
+      return;
+
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+      erase(it->second);
+
+    while (m_size + size > m_max_size)
+    {
+      erase(--m_entries.end());
+      ++m_evictions;
+    }
+
+    m_entries.push_front({key, response, p, current});
+    m_index.emplace(key, m_entries.begin());
+    m_size += size;
+  }
+
+  void rpc_response_cache::clear()
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    m_entries.clear();
+    m_index.clear();
+    m_size = 0;
+  }
+
+  size_t rpc_response_cache::max_entry_size() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    return m_max_size / MAX_ENTRY_SHARE;
+  }
+
+  rpc_response_cache::stats rpc_response_cache::get_stats() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_lock);
+    return {m_hits, m_misses, m_evictions, m_entries.size(), m_size};
+  }
+}
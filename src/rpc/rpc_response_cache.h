@@ -0,0 +1,127 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "rpc/core_rpc_server_commands_defs.h"
+
+namespace cryptonote
+{
+  /// Serialized responses of RPC calls which are asked for over and over with the same arguments, like
+  /// recent block headers or fee estimates, kept until the chain tip (or tx pool) they were computed for
+  /// changes. Responses are evicted least recently used first to keep the cache under its size in bytes.
+  class rpc_response_cache
+  {
+  public:
+    /// What a response depends on, and so what keeps it valid
+    enum policy
+    {
+      same_tip,           //!< the main chain didn't change
+      same_tip_and_pool,  //!< neither the main chain nor the tx pool changed
+      same_tip_and_pool_fresh //!< as same_tip_and_pool, for at most a second for node state like connections
+    };
+
+    /// State of the chain and pool a response is computed for, taken before computing it
+    struct stamp
+    {
+      uint64_t tip_cookie;
+      uint64_t pool_cookie;
+      std::chrono::steady_clock::time_point time;
+    };
+
+    struct stats
+    {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t evictions;
+      size_t entries;
+      size_t size;
+    };
+
+    typedef std::function<uint64_t()> cookie_source;
+
+    rpc_response_cache(cookie_source tip_cookie, cookie_source pool_cookie, size_t max_size = 0);
+
+    /// Sets the size limit in bytes, 0 turns caching off
+    void set_max_size(size_t max_size);
+
+    /// Looks up the response to `key`, returns true and sets `response` if there is a valid one.
+    /// Otherwise `current` is the stamp to put() the response computed now with.
+    bool get(const std::string& key, policy p, std::string& response, stamp& current);
+
+    /// Caches `response` computed for `current`, unless it's too large or the state changed since
+    void put(const std::string& key, policy p, const stamp& current, const std::string& response);
+
+    void clear();
+
+    /// Largest response put() keeps
+    size_t max_entry_size() const;
+
+    /// Responses which aren't worth keeping are the busy and failed ones, and those from the bootstrap daemon
+    template<typename T>
+    static bool is_cacheable(const T& res) { return res.status == CORE_RPC_STATUS_OK && !res.untrusted; }
+
+    stats get_stats() const;
+
+  private:
+    struct entry
+    {
+      std::string key;
+      std::string response;
+      policy p;
+      stamp computed;
+    };
+    typedef std::list<entry> entry_list;
+
+    static constexpr size_t ENTRY_OVERHEAD = 128;
+
+    static size_t entry_size(const std::string& key, const std::string& response) { return key.size() + response.size() + ENTRY_OVERHEAD; }
+    stamp get_stamp() const;
+    static bool is_valid(policy p, const stamp& computed, const stamp& current);
+    void erase(entry_list::iterator it);
+
+    cookie_source m_tip_cookie;
+    cookie_source m_pool_cookie;
+    mutable boost::mutex m_lock;
+    size_t m_max_size;
+    size_t m_size;
+    entry_list m_entries; //most recently used first
+    std::unordered_map<std::string, entry_list::iterator> m_index;
+    uint64_t m_hits;
+    uint64_t m_misses;
+    uint64_t m_evictions;
+  };
+}
@@ -0,0 +1,234 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "zmq_pub.h"
+#include "zmq_server.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.zmq"
+
+namespace cryptonote
+{
+
+namespace rpc
+{
+
+ZmqPublisher::ZmqPublisher() :
+    stop_signal(false),
+    running(false),
+    dropped(0),
+    context(DEFAULT_NUM_ZMQ_THREADS)
+{
+}
+
+ZmqPublisher::~ZmqPublisher()
+{
+  stop();
+}
+
+bool ZmqPublisher::addTCPSocket(std::string address, std::string port)
+{
+  try
+  {
+    std::string addr_prefix("tcp://");
+
+    pub_socket.reset(new zmq::socket_t(context, ZMQ_PUB));
+
+    const int linger = 0;
+    pub_socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+
+    if (address.empty())
+      address = "*";
+    std::string bind_address = addr_prefix + address + std::string(":") + port;
+    pub_socket->bind(bind_address.c_str());
+  }
+  catch (const std::exception& e)
+  {
+    MERROR(std::string("Error creating ZMQ PUB socket: ") + e.what());
+    return false;
+  }
+  return true;
+}
+
+void ZmqPublisher::attach(core& c)
+{
+  c.get_blockchain_storage().set_block_added_handler([this](uint64_t height, const crypto::hash& id, const block& b) {
+    ZMQ_PUB_BLOCK msg;
+    msg.height = height;
+    msg.hash = id;
+    msg.prev_hash = b.prev_id;
+    msg.timestamp = b.timestamp;
+    msg.major_version = b.major_version;
+    msg.minor_version = b.minor_version;
+    msg.tx_hashes = b.tx_hashes;
+    publish("block", epee::serialization::store_t_to_binary(msg));
+  });
+
+  c.get_blockchain_storage().set_reorg_handler([this](uint64_t split_height, uint64_t old_height, uint64_t new_height) {
+    ZMQ_PUB_REORG msg;
+    msg.split_height = split_height;
+    msg.old_height = old_height;
+    msg.new_height = new_height;
+    publish("reorg", epee::serialization::store_t_to_binary(msg));
+  });
+
+  c.get_pool().set_tx_added_handler([this](const crypto::hash& id, size_t weight, uint64_t fee) {
+    ZMQ_PUB_TXPOOL_ADD msg;
+    msg.id = id;
+    msg.weight = weight;
+    msg.fee = fee;
+    publish("txpool_add", epee::serialization::store_t_to_binary(msg));
+  });
+
+  c.get_pool().set_tx_removed_handler([this](const crypto::hash& id, tx_memory_pool::removal_reason reason) {
+    ZMQ_PUB_TXPOOL_REMOVE msg;
+    msg.id = id;
+    msg.reason = reason;
+    publish("txpool_remove", epee::serialization::store_t_to_binary(msg));
+  });
+
+  // the network type is only known once the core is initialized
+  c.set_stakes_change_handler([this, &c](uint64_t block_height, const StakeTransactionProcessor::supernode_stake_array& stakes) {
+    const network_type nettype = c.get_nettype();
+    COMMAND_RPC_SUPERNODE_STAKES::request msg;
+    msg.block_height = block_height;
+    msg.stakes.reserve(stakes.size());
+    for (const supernode_stake& src : stakes)
+    {
+      COMMAND_RPC_SUPERNODE_STAKES::supernode_stake dst;
+      dst.amount = src.amount;
+      dst.tier = src.tier;
+      dst.block_height = src.block_height;
+      dst.unlock_time = src.unlock_time;
+      dst.supernode_public_id = src.supernode_public_id;
+      dst.supernode_public_address = address_strings.get(nettype, src.supernode_public_address);
+      msg.stakes.push_back(std::move(dst));
+    }
+    publish("stakes", epee::serialization::store_t_to_binary(msg));
+  });
+
+  c.set_blockchain_based_list_change_handler([this, &c](uint64_t block_height, const StakeTransactionProcessor::supernode_tier_array& tiers) {
+    const network_type nettype = c.get_nettype();
+    COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::request msg;
+    msg.block_height = block_height;
+    msg.tiers.resize(tiers.size());
+    for (size_t i=0; i<tiers.size(); i++)
+    {
+      msg.tiers[i].supernodes.reserve(tiers[i].size());
+      for (const BlockchainBasedList::supernode& src : tiers[i])
+      {
+        COMMAND_RPC_SUPERNODE_BLOCKCHAIN_BASED_LIST::supernode dst;
+        dst.supernode_public_id = src.supernode_public_id;
+        dst.supernode_public_address = address_strings.get(nettype, src.supernode_public_address);
+        dst.amount = src.amount;
+        msg.tiers[i].supernodes.push_back(std::move(dst));
+      }
+    }
+    publish("blockchain_based_list", epee::serialization::store_t_to_binary(msg));
+  });
+}
+
+void ZmqPublisher::publish(const char* topic, std::string&& payload)
+{
+  boost::unique_lock<boost::mutex> guard(lock);
+  if (!running)
+    return;
+  if (queue.size() >= MAX_QUEUED_MESSAGES)
+  {
+    if (dropped++ % 1000 == 0)
+      MWARNING("ZMQ publisher queue is full, dropped " << dropped << " event(s)");
+    return;
+  }
+  queue.emplace_back(topic, std::move(payload));
+  cond.notify_one();
+}
+
+void ZmqPublisher::send_loop()
+{
+  boost::unique_lock<boost::mutex> guard(lock);
+  while (true)
+  {
+    while (queue.empty() && !stop_signal)
+      cond.wait(guard);
+    if (stop_signal)
+      break;
+
+    std::pair<const char*, std::string> msg = std::move(queue.front());
+    queue.pop_front();
+    guard.unlock();
+
+    try
+    {
+      const size_t topic_size = strlen(msg.first);
+      zmq::message_t topic(topic_size);
+      memcpy(topic.data(), msg.first, topic_size);
+      zmq::message_t payload(msg.second.size());
+      memcpy(payload.data(), msg.second.data(), msg.second.size());
+
+      pub_socket->send(topic, ZMQ_SNDMORE);
+      pub_socket->send(payload);
+    }
+    catch (const zmq::error_t& e)
+    {
+      MERROR(std::string("ZMQ error: ") + e.what());
+    }
+
+    guard.lock();
+  }
+}
+
+void ZmqPublisher::run()
+{
+  if (!pub_socket)
+    return;
+  boost::unique_lock<boost::mutex> guard(lock);
+  running = true;
+  run_thread = boost::thread(boost::bind(&ZmqPublisher::send_loop, this));
+}
+
+void ZmqPublisher::stop()
+{
+  {
+    boost::unique_lock<boost::mutex> guard(lock);
+    if (!running) return;
+    running = false;
+    stop_signal = true;
+    cond.notify_one();
+  }
+
+  run_thread.join();
+  pub_socket.reset();
+}
+
+
+}  // namespace cryptonote
+
+}  // namespace rpc
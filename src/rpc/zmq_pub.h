@@ -0,0 +1,152 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <zmq.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "serialization/keyvalue_serialization.h"
+
+namespace cryptonote
+{
+
+class core;
+
+namespace rpc
+{
+
+/// Payloads of the published events, encoded with epee binary storage
+struct ZMQ_PUB_BLOCK
+{
+  uint64_t height;
+  crypto::hash hash;
+  crypto::hash prev_hash;
+  uint64_t timestamp;
+  uint8_t major_version;
+  uint8_t minor_version;
+  std::vector<crypto::hash> tx_hashes;
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(height)
+    KV_SERIALIZE_VAL_POD_AS_BLOB(hash)
+    KV_SERIALIZE_VAL_POD_AS_BLOB(prev_hash)
+    KV_SERIALIZE(timestamp)
+    KV_SERIALIZE(major_version)
+    KV_SERIALIZE(minor_version)
+    KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+  END_KV_SERIALIZE_MAP()
+};
+
+struct ZMQ_PUB_TXPOOL_ADD
+{
+  crypto::hash id;
+  uint64_t weight;
+  uint64_t fee;
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE_VAL_POD_AS_BLOB(id)
+    KV_SERIALIZE(weight)
+    KV_SERIALIZE(fee)
+  END_KV_SERIALIZE_MAP()
+};
+
+struct ZMQ_PUB_TXPOOL_REMOVE
+{
+  crypto::hash id;
+  uint8_t reason; //tx_memory_pool::removal_reason
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE_VAL_POD_AS_BLOB(id)
+    KV_SERIALIZE(reason)
+  END_KV_SERIALIZE_MAP()
+};
+
+struct ZMQ_PUB_REORG
+{
+  uint64_t split_height;
+  uint64_t old_height;
+  uint64_t new_height;
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(split_height)
+    KV_SERIALIZE(old_height)
+    KV_SERIALIZE(new_height)
+  END_KV_SERIALIZE_MAP()
+};
+
+/// Publishes new blocks, txpool changes, reorgs and supernode stake and blockchain based list changes on a
+/// ZMQ PUB socket, so consumers don't have to poll the daemon. Every message has two frames: the topic
+/// ("block", "txpool_add", "txpool_remove", "reorg", "stakes" or "blockchain_based_list") to subscribe to
+/// and the binary storage payload. Events are queued by the threads producing them and sent from a thread
+/// of the publisher, when the queue is full new events are dropped rather than stalling the core.
+class ZmqPublisher
+{
+  public:
+
+    static constexpr size_t MAX_QUEUED_MESSAGES = 10000;
+
+    ZmqPublisher();
+
+    ~ZmqPublisher();
+
+    bool addTCPSocket(std::string address, std::string port);
+
+    /// Installs the core, blockchain and txpool handlers, which must be done before the core runs
+    void attach(core& c);
+
+    void run();
+    void stop();
+
+  private:
+    void publish(const char* topic, std::string&& payload);
+    void send_loop();
+
+    boost::mutex lock;
+    boost::condition_variable cond;
+    std::deque<std::pair<const char*, std::string>> queue;
+    bool stop_signal;
+    bool running;
+    uint64_t dropped;
+
+    zmq::context_t context;
+
+    boost::thread run_thread;
+
+    std::unique_ptr<zmq::socket_t> pub_socket;
+
+    account_address_string_cache address_strings;
+};
+
+
+}  // namespace cryptonote
+
+}  // namespace rpc
@@ -27,6 +27,8 @@
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "zmq_server.h"
+#include "message.h"
+#include "misc_language.h"
 #include <boost/chrono/chrono.hpp>
 
 namespace cryptonote
@@ -35,18 +37,54 @@ namespace cryptonote
 namespace rpc
 {
 
-ZmqServer::ZmqServer(RpcHandler& h) :
+namespace
+{
+  const char* const WORKERS_ADDRESS = "inproc://zmq-rpc-workers";
+
+  // requests which may take long, each of them is allowed at most half of the workers
+  const char* const HEAVY_METHODS[] = {"get_blocks_fast", "get_hashes_fast", "get_transactions", "get_output_histogram", "get_output_keys"};
+
+  void forward_message(zmq::socket_t& from, zmq::socket_t& to)
+  {
+    int more = 0;
+    do
+    {
+      zmq::message_t part;
+      from.recv(&part);
+      size_t more_size = sizeof(more);
+      from.getsockopt(ZMQ_RCVMORE, &more, &more_size);
+      to.send(part, more ? ZMQ_SNDMORE : 0);
+    } while (more);
+  }
+}
+
+ZmqServer::ZmqServer(RpcHandler& h, unsigned worker_threads) :
     handler(h),
+    worker_threads(std::max(1u, worker_threads)),
     stop_signal(false),
     running(false),
     context(DEFAULT_NUM_ZMQ_THREADS) // TODO: make this configurable
 {
+  if (this->worker_threads > 1)
+  {
+    for (const char* method : HEAVY_METHODS)
+      setMethodConcurrencyLimit(method, this->worker_threads / 2);
+  }
 }
 
 ZmqServer::~ZmqServer()
 {
 }
 
+void ZmqServer::setMethodConcurrencyLimit(const std::string& method, unsigned limit)
+{
+  boost::lock_guard<boost::mutex> lock(method_limits_lock);
+  if (limit)
+    method_limits[method] = method_limit{limit, 0};
+  else
+    method_limits.erase(method);
+}
+
 void ZmqServer::serve()
 {
 
@@ -54,31 +92,70 @@ void ZmqServer::serve()
   {
     try
     {
-      zmq::message_t message;
+      if (!router_socket || !dealer_socket)
+      {
+        throw std::runtime_error("ZMQ RPC server socket is null");
+      }
 
-      if (!rep_socket)
+      zmq::pollitem_t items[] = {
+        {static_cast<void*>(*router_socket), 0, ZMQ_POLLIN, 0},
+        {static_cast<void*>(*dealer_socket), 0, ZMQ_POLLIN, 0}
+      };
+
+      while (!stop_signal)
       {
-        throw std::runtime_error("ZMQ RPC server reply socket is null");
+        zmq::poll(items, 2, DEFAULT_RPC_RECV_TIMEOUT_MS);
+
+        if (items[0].revents & ZMQ_POLLIN)
+          forward_message(*router_socket, *dealer_socket);
+        if (items[1].revents & ZMQ_POLLIN)
+          forward_message(*dealer_socket, *router_socket);
       }
-      while (rep_socket->recv(&message))
+    }
+    catch (const boost::thread_interrupted& e)
+    {
+      MDEBUG("ZMQ Server thread interrupted.");
+    }
+    catch (const zmq::error_t& e)
+    {
+      MERROR(std::string("ZMQ error: ") + e.what());
+    }
+    boost::this_thread::interruption_point();
+  }
+}
+
+void ZmqServer::work()
+{
+  // sockets are not thread safe, each worker has its own
+  zmq::socket_t rep_socket(context, ZMQ_REP);
+  rep_socket.setsockopt(ZMQ_RCVTIMEO, &DEFAULT_RPC_RECV_TIMEOUT_MS, sizeof(DEFAULT_RPC_RECV_TIMEOUT_MS));
+  rep_socket.connect(WORKERS_ADDRESS);
+
+  while (1)
+  {
+    try
+    {
+      zmq::message_t message;
+
+      while (!stop_signal && rep_socket.recv(&message))
       {
         std::string message_string(reinterpret_cast<const char *>(message.data()), message.size());
 
         MDEBUG(std::string("Received RPC request: \"") + message_string + "\"");
 
-        std::string response = handler.handle(message_string);
+        std::string response = handleRequest(message_string);
 
         zmq::message_t reply(response.size());
         memcpy((void *) reply.data(), response.c_str(), response.size());
 
-        rep_socket->send(reply);
+        rep_socket.send(reply);
         MDEBUG(std::string("Sent RPC reply: \"") + response + "\"");
 
       }
     }
     catch (const boost::thread_interrupted& e)
     {
-      MDEBUG("ZMQ Server thread interrupted.");
+      MDEBUG("ZMQ Server worker thread interrupted.");
     }
     catch (const zmq::error_t& e)
     {
@@ -88,6 +165,50 @@ void ZmqServer::serve()
   }
 }
 
+std::string ZmqServer::handleRequest(const std::string& request)
+{
+  {
+    boost::lock_guard<boost::mutex> lock(method_limits_lock);
+    if (method_limits.empty())
+      return handler.handle(request);
+  }
+
+  // only the method name is needed here, the handler parses and reports bad requests itself
+  rapidjson::Document doc;
+  doc.Parse(request.c_str());
+  if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("method") || !doc["method"].IsString())
+    return handler.handle(request);
+
+  const std::string method = doc["method"].GetString();
+  method_limit* limit = nullptr;
+  {
+    boost::lock_guard<boost::mutex> lock(method_limits_lock);
+    auto it = method_limits.find(method);
+    if (it != method_limits.end())
+    {
+      if (it->second.running >= it->second.limit)
+      {
+        MDEBUG("Too many concurrent ZMQ RPC requests of " << method);
+        // the reply is serialized by BUSY while doc still owns the id
+        rapidjson::Value no_id;
+        return BUSY(method, doc.HasMember("id") ? doc["id"] : no_id);
+      }
+      ++it->second.running;
+      limit = &it->second;
+    }
+  }
+
+  if (!limit)
+    return handler.handle(request);
+
+  // node pointers of unordered_map are stable, the entry is only erased by setMethodConcurrencyLimit at setup
+  epee::misc_utils::auto_scope_leave_caller release = epee::misc_utils::create_scope_leave_handler([this, limit]() {
+    boost::lock_guard<boost::mutex> lock(method_limits_lock);
+    --limit->running;
+  });
+  return handler.handle(request);
+}
+
 bool ZmqServer::addIPCSocket(std::string address, std::string port)
 {
   MERROR("ZmqServer::addIPCSocket not yet implemented!");
@@ -100,16 +221,21 @@ bool ZmqServer::addTCPSocket(std::string address, std::string port)
   {
     std::string addr_prefix("tcp://");
 
-    rep_socket.reset(new zmq::socket_t(context, ZMQ_REP));
+    router_socket.reset(new zmq::socket_t(context, ZMQ_ROUTER));
+    dealer_socket.reset(new zmq::socket_t(context, ZMQ_DEALER));
 
-    rep_socket->setsockopt(ZMQ_RCVTIMEO, &DEFAULT_RPC_RECV_TIMEOUT_MS, sizeof(DEFAULT_RPC_RECV_TIMEOUT_MS));
+    const int linger = 0;
+    router_socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    dealer_socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
 
     if (address.empty())
       address = "*";
     if (port.empty())
       port = "*";
     std::string bind_address = addr_prefix + address + std::string(":") + port;
-    rep_socket->bind(bind_address.c_str());
+    router_socket->bind(bind_address.c_str());
+    // inproc needs the bind before workers connect
+    dealer_socket->bind(WORKERS_ADDRESS);
   }
   catch (const std::exception& e)
   {
@@ -122,6 +248,8 @@ bool ZmqServer::addTCPSocket(std::string address, std::string port)
 void ZmqServer::run()
 {
   running = true;
+  for (unsigned i = 0; i < worker_threads; ++i)
+    workers.create_thread(boost::bind(&ZmqServer::work, this));
   run_thread = boost::thread(boost::bind(&ZmqServer::serve, this));
 }
 
@@ -134,6 +262,9 @@ void ZmqServer::stop()
   run_thread.interrupt();
   run_thread.join();
 
+  workers.interrupt_all();
+  workers.join_all();
+
   running = false;
 
   return;
@@ -29,9 +29,11 @@
 #pragma once
 
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 #include <zmq.hpp>
 #include <string>
 #include <memory>
+#include <unordered_map>
 
 #include "common/command_line.h"
 
@@ -45,12 +47,15 @@ namespace rpc
 
 static constexpr int DEFAULT_NUM_ZMQ_THREADS = 1;
 static constexpr int DEFAULT_RPC_RECV_TIMEOUT_MS = 1000;
+static constexpr unsigned DEFAULT_RPC_WORKER_THREADS = 4;
 
+// requests are received on a ROUTER socket and passed over a DEALER to a pool of
+// REP workers, so a slow request only holds one worker
 class ZmqServer
 {
   public:
 
-    ZmqServer(RpcHandler& h);
+    ZmqServer(RpcHandler& h, unsigned worker_threads = DEFAULT_RPC_WORKER_THREADS);
 
     ~ZmqServer();
 
@@ -64,8 +69,15 @@ class ZmqServer
     void run();
     void stop();
 
+    // at most limit requests of the method are handled at a time, others get a retry reply
+    void setMethodConcurrencyLimit(const std::string& method, unsigned limit);
+
   private:
+    void work();
+    std::string handleRequest(const std::string& request);
+
     RpcHandler& handler;
+    const unsigned worker_threads;
 
     volatile bool stop_signal;
     volatile bool running;
@@ -73,8 +85,19 @@ class ZmqServer
     zmq::context_t context;
 
     boost::thread run_thread;
+    boost::thread_group workers;
+
+    std::unique_ptr<zmq::socket_t> router_socket;
+    std::unique_ptr<zmq::socket_t> dealer_socket;
+
+    struct method_limit
+    {
+      unsigned limit;
+      unsigned running;
+    };
 
-    std::unique_ptr<zmq::socket_t> rep_socket;
+    boost::mutex method_limits_lock;
+    std::unordered_map<std::string, method_limit> method_limits;
 };
 
 
@@ -34,11 +34,13 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <boost/type_traits/make_unsigned.hpp>
 
 #include "common/varint.h"
+#include "span.h"
 #include "warnings.h"
 
 /* I have no clue what these lines means */
@@ -76,6 +78,9 @@ struct binary_archive_base
      flaws in the ownership model of many OOP languages, that is all. */
   stream_type &stream() { return stream_; } 
 
+  bool good() const { return stream_.good(); }
+  void set_fail() { stream_.setstate(std::ios::failbit); }
+
 protected:
   stream_type &stream_;
 };
@@ -94,16 +99,30 @@ template <bool W>
 struct binary_archive;
 
 
+/* \struct binary_archive<false>
+ *
+ * \brief reads directly from the bytes of a blob, without copying
+ *
+ * \detailed The blob must outlive the archive. Reads past its end put
+ * the archive in a failed state, as they did a stream.
+ */
 template <>
-struct binary_archive<false> : public binary_archive_base<std::istream, false>
+struct binary_archive<false>
 {
+  typedef boost::mpl::bool_<false> is_saving;
 
-  explicit binary_archive(stream_type &s) : base_type(s) {
-    stream_type::streampos pos = stream_.tellg();
-    stream_.seekg(0, std::ios_base::end);
-    eof_pos_ = stream_.tellg();
-    stream_.seekg(pos);
-  }
+  typedef uint8_t variant_tag_type;
+
+  explicit binary_archive(epee::span<const std::uint8_t> bytes) : bytes_(bytes), good_(true) { }
+
+  void tag(const char *) { }
+  void begin_object() { }
+  void end_object() { }
+  void begin_variant() { }
+  void end_variant() { }
+
+  bool good() const { return good_; }
+  void set_fail() { good_ = false; }
 
   template <class T>
   void serialize_int(T &v)
@@ -118,22 +137,32 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
   template <class T>
   void serialize_uint(T &v, size_t width = sizeof(T))
   {
+    if (!good_ || bytes_.size() < width)
+    {
+      set_fail();
+      return;
+    }
     T ret = 0;
     unsigned shift = 0;
     for (size_t i = 0; i < width; i++) {
-      //std::cerr << "tell: " << stream_.tellg() << " value: " << ret << std::endl;
-      char c;
-      stream_.get(c);
-      T b = (unsigned char)c;
+      T b = bytes_[i];
       ret += (b << shift);	// can this be changed to OR, i think it can.
       shift += 8;
     }
+    bytes_.remove_prefix(width);
     v = ret;
   }
   
   void serialize_blob(void *buf, size_t len, const char *delimiter="")
   {
-    stream_.read((char *)buf, len);
+    if (!good_ || bytes_.size() < len)
+    {
+      set_fail();
+      return;
+    }
+    if (len)
+      std::memcpy(buf, bytes_.data(), len);
+    bytes_.remove_prefix(len);
   }
   
   template <class T>
@@ -145,8 +174,16 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
   template <class T>
   void serialize_uvarint(T &v)
   {
-    typedef std::istreambuf_iterator<char> it;
-    tools::read_varint(it(stream_), it(), v); // XXX handle failure
+    if (!good_)
+      return;
+    const int read = tools::read_varint(bytes_.begin(), bytes_.end(), v);
+    // a varint cut short by the end of the blob ends with a continuation bit
+    if (read <= 0 || (bytes_[read - 1] & 0x80))
+    {
+      set_fail();
+      return;
+    }
+    bytes_.remove_prefix(read);
   }
 
   void begin_array(size_t &s)
@@ -165,15 +202,12 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
     serialize_int(t);
   }
 
-  size_t remaining_bytes() {
-    if (!stream_.good())
-      return 0;
-    //std::cerr << "tell: " << stream_.tellg() << std::endl;
-    assert(stream_.tellg() <= eof_pos_);
-    return eof_pos_ - stream_.tellg();
+  size_t remaining_bytes() const {
+    return good_ ? bytes_.size() : 0;
   }
 protected:
-  std::streamoff eof_pos_;
+  epee::span<const std::uint8_t> bytes_;
+  bool good_;
 };
 
 template <>
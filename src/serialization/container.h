@@ -66,13 +66,13 @@ bool do_serialize_container(Archive<false> &ar, C &v)
 {
   size_t cnt;
   ar.begin_array(cnt);
-  if (!ar.stream().good())
+  if (!ar.good())
     return false;
   v.clear();
 
   // very basic sanity check
   if (ar.remaining_bytes() < cnt) {
-    ar.stream().setstate(std::ios::failbit);
+    ar.set_fail();
     return false;
   }
 
@@ -85,7 +85,7 @@ bool do_serialize_container(Archive<false> &ar, C &v)
     if (!::serialization::detail::serialize_container_element(ar, e))
       return false;
     ::serialization::detail::do_add(v, std::move(e));
-    if (!ar.stream().good())
+    if (!ar.good())
       return false;
   }
   ar.end_array();
@@ -99,13 +99,13 @@ bool do_serialize_container(Archive<true> &ar, C &v)
   ar.begin_array(cnt);
   for (auto i = v.begin(); i != v.end(); ++i)
   {
-    if (!ar.stream().good())
+    if (!ar.good())
       return false;
     if (i != v.begin())
       ar.delimit_array();
     if(!::serialization::detail::serialize_container_element(ar, const_cast<typename C::value_type&>(*i)))
       return false;
-    if (!ar.stream().good())
+    if (!ar.good())
       return false;
   }
   ar.end_array();
@@ -111,7 +111,7 @@ namespace
 
 void toJsonValue(rapidjson::Document& doc, const std::string& i, rapidjson::Value& val)
 {
-  val = rapidjson::Value(i.c_str(), doc.GetAllocator());
+  val.SetString(i.data(), i.size(), doc.GetAllocator());
 }
 
 void fromJsonValue(const rapidjson::Value& val, std::string& str)
@@ -121,7 +121,7 @@ void fromJsonValue(const rapidjson::Value& val, std::string& str)
     throw WRONG_TYPE("string");
   }
 
-  str = val.GetString();
+  str.assign(val.GetString(), val.GetStringLength());
 }
 
 void toJsonValue(rapidjson::Document& doc, bool i, rapidjson::Value& val)
@@ -119,7 +119,9 @@ inline constexpr bool is_to_hex()
 template <class Type>
 typename std::enable_if<is_to_hex<Type>()>::type toJsonValue(rapidjson::Document& doc, const Type& pod, rapidjson::Value& value)
 {
-  value = rapidjson::Value(epee::string_tools::pod_to_hex(pod).c_str(), doc.GetAllocator());
+  char hex[sizeof(Type) * 2];
+  epee::to_hex::buffer_unchecked(hex, {reinterpret_cast<const std::uint8_t*>(&pod), sizeof(Type)});
+  value.SetString(hex, sizeof(hex), doc.GetAllocator());
 }
 
 template <class Type>
@@ -130,13 +132,12 @@ typename std::enable_if<is_to_hex<Type>()>::type fromJsonValue(const rapidjson::
     throw WRONG_TYPE("string");
   }
 
-  //TODO: handle failure to convert hex string to POD type
-  bool success = epee::string_tools::hex_to_pod(val.GetString(), t);
-
-  if (!success)
+  Type pod;
+  if (!epee::from_hex::to_buffer({reinterpret_cast<std::uint8_t*>(&pod), sizeof(Type)}, {val.GetString(), val.GetStringLength()}))
   {
     throw BAD_INPUT();
   }
+  t = pod;
 }
 
 void toJsonValue(rapidjson::Document& doc, const std::string& i, rapidjson::Value& val);
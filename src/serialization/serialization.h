@@ -222,7 +222,7 @@ inline bool do_serialize(Archive &ar, bool &v)
   do {							\
     ar.tag(#f);						\
     bool r = ::do_serialize(ar, f);			\
-    if (!r || !ar.stream().good()) return false;	\
+    if (!r || !ar.good()) return false;	\
   } while(0);
 
 /*! \macro FIELD_N(t,f)
@@ -233,7 +233,7 @@ inline bool do_serialize(Archive &ar, bool &v)
   do {							\
     ar.tag(t);						\
     bool r = ::do_serialize(ar, f);			\
-    if (!r || !ar.stream().good()) return false;	\
+    if (!r || !ar.good()) return false;	\
   } while(0);
 
 /*! \macro FIELD(f)
@@ -244,7 +244,7 @@ inline bool do_serialize(Archive &ar, bool &v)
   do {							\
     ar.tag(#f);						\
     bool r = ::do_serialize(ar, f);			\
-    if (!r || !ar.stream().good()) return false;	\
+    if (!r || !ar.good()) return false;	\
   } while(0);
 
 /*! \macro FIELDS(f)
@@ -254,7 +254,7 @@ inline bool do_serialize(Archive &ar, bool &v)
 #define FIELDS(f)							\
   do {									\
     bool r = ::do_serialize(ar, f);					\
-    if (!r || !ar.stream().good()) return false;			\
+    if (!r || !ar.good()) return false;			\
   } while(0);
 
 /*! \macro VARINT_FIELD(f)
@@ -264,7 +264,7 @@ inline bool do_serialize(Archive &ar, bool &v)
   do {						\
     ar.tag(#f);					\
     ar.serialize_varint(f);			\
-    if (!ar.stream().good()) return false;	\
+    if (!ar.good()) return false;	\
   } while(0);
 
 /*! \macro VARINT_FIELD_N(t, f)
@@ -275,7 +275,7 @@ inline bool do_serialize(Archive &ar, bool &v)
   do {						\
     ar.tag(t);					\
     ar.serialize_varint(f);			\
-    if (!ar.stream().good()) return false;	\
+    if (!ar.good()) return false;	\
   } while(0);
 
 
@@ -317,28 +317,21 @@ namespace serialization {
      *
      * \brief self explanatory
      */
-    template<class Stream>
-    bool do_check_stream_state(Stream& s, boost::mpl::bool_<true>)
+    template<class Archive>
+    bool do_check_stream_state(Archive& ar, boost::mpl::bool_<true>)
     {
-      return s.good();
+      return ar.good();
     }
     /*! \fn do_check_stream_state
      *
      * \brief self explanatory
      *
-     * \detailed Also checks to make sure that the stream is not at EOF
+     * \detailed Also checks to make sure that the whole input was read
      */
-    template<class Stream>
-    bool do_check_stream_state(Stream& s, boost::mpl::bool_<false>)
+    template<class Archive>
+    bool do_check_stream_state(Archive& ar, boost::mpl::bool_<false>)
     {
-      bool result = false;
-      if (s.good())
-	{
-	  std::ios_base::iostate state = s.rdstate();
-	  result = EOF == s.peek();
-	  s.clear(state);
-	}
-      return result;
+      return ar.good() && ar.remaining_bytes() == 0;
     }
   }
 
@@ -349,7 +342,7 @@ namespace serialization {
   template<class Archive>
   bool check_stream_state(Archive& ar)
   {
-    return detail::do_check_stream_state(ar.stream(), typename Archive::is_saving());
+    return detail::do_check_stream_state(ar, typename Archive::is_saving());
   }
 
   /*! \fn serialize
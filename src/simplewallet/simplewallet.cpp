@@ -1472,6 +1472,7 @@ bool simple_wallet::set_ring(const std::vector<std::string> &args)
     }
 
     char str[4096];
+    std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> rings;
     std::unique_ptr<FILE, tools::close_file> f(fopen(args[0].c_str(), "r"));
     if (f)
     {
@@ -1560,11 +1561,12 @@ bool simple_wallet::set_ring(const std::vector<std::string> &args)
         }
         if (!valid)
           continue;
-        if (!m_wallet->set_ring(key_image, ring, relative))
-          fail_msg_writer() << tr("Failed to set ring for key image: ") << key_image << ". " << tr("Continuing.");
+        rings.push_back({key_image, relative ? ring : cryptonote::absolute_output_offsets_to_relative(ring)});
       }
       f.reset();
     }
+    if (!rings.empty() && !m_wallet->set_rings(rings, true))
+      fail_msg_writer() << tr("Failed to set rings");
     return true;
   }
 
@@ -2541,8 +2543,8 @@ simple_wallet::simple_wallet()
                            tr("Verify a signature on the contents of a file."));
   m_cmd_binder.set_handler("export_key_images",
                            boost::bind(&simple_wallet::export_key_images, this, _1),
-                           tr("export_key_images <file>"),
-                           tr("Export a signed set of key images to a <file>."));
+                           tr("export_key_images <file> [all]"),
+                           tr("Export a signed set of key images to a <file>. Unless \"all\" is given, only the key images of the outputs imported last are exported."));
   m_cmd_binder.set_handler("import_key_images",
                            boost::bind(&simple_wallet::import_key_images, this, _1),
                            tr("import_key_images <file>"),
@@ -2553,8 +2555,8 @@ simple_wallet::simple_wallet()
                            tr("Attempts to reconnect HW wallet."));
   m_cmd_binder.set_handler("export_outputs",
                            boost::bind(&simple_wallet::export_outputs, this, _1),
-                           tr("export_outputs <file>"),
-                           tr("Export a set of outputs owned by this wallet."));
+                           tr("export_outputs [all] <file>"),
+                           tr("Export a set of outputs owned by this wallet. Unless \"all\" is given, only the outputs from the first one with an unknown key image are exported."));
   m_cmd_binder.set_handler("import_outputs",
                            boost::bind(&simple_wallet::import_outputs, this, _1),
                            tr("import_outputs <file>"),
@@ -7874,9 +7876,9 @@ bool simple_wallet::export_key_images(const std::vector<std::string> &args)
     fail_msg_writer() << tr("command not supported by HW wallet");
     return true;
   }
-  if (args.size() != 1)
+  if (args.size() != 1 && !(args.size() == 2 && args[1] == "all"))
   {
-    fail_msg_writer() << tr("usage: export_key_images <filename>");
+    fail_msg_writer() << tr("usage: export_key_images <filename> [all]");
     return true;
   }
   if (m_wallet->watch_only())
@@ -7892,7 +7894,7 @@ bool simple_wallet::export_key_images(const std::vector<std::string> &args)
 
   try
   {
-    if (!m_wallet->export_key_images(filename))
+    if (!m_wallet->export_key_images(filename, args.size() == 2))
     {
       fail_msg_writer() << tr("failed to save file ") << filename;
       return true;
@@ -7983,22 +7985,21 @@ bool simple_wallet::export_outputs(const std::vector<std::string> &args)
     fail_msg_writer() << tr("command not supported by HW wallet");
     return true;
   }
-  if (args.size() != 1)
+  if (args.size() != 1 && !(args.size() == 2 && args[0] == "all"))
   {
-    fail_msg_writer() << tr("usage: export_outputs <filename>");
+    fail_msg_writer() << tr("usage: export_outputs [all] <filename>");
     return true;
   }
 
   SCOPED_WALLET_UNLOCK();
-  std::string filename = args[0];
+  const bool all = args.size() == 2;
+  std::string filename = args.back();
   if (m_wallet->confirm_export_overwrite() && !check_file_overwrite(filename))
     return true;
 
   try
   {
-    std::string data = m_wallet->export_outputs_to_str();
-    bool r = epee::file_io_utils::save_string_to_file(filename, data);
-    if (!r)
+    if (!m_wallet->export_outputs_to_file(filename, all))
     {
       fail_msg_writer() << tr("failed to save file ") << filename;
       return true;
@@ -8029,18 +8030,10 @@ bool simple_wallet::import_outputs(const std::vector<std::string> &args)
   }
   std::string filename = args[0];
 
-  std::string data;
-  bool r = epee::file_io_utils::load_file_to_string(filename, data);
-  if (!r)
-  {
-    fail_msg_writer() << tr("failed to read file ") << filename;
-    return true;
-  }
-
   try
   {
     SCOPED_WALLET_UNLOCK();
-    size_t n_outputs = m_wallet->import_outputs_from_str(data);
+    size_t n_outputs = m_wallet->import_outputs_from_file(filename);
     success_msg_writer() << boost::lexical_cast<std::string>(n_outputs) << " outputs imported";
   }
   catch (const std::exception &e)
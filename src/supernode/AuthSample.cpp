@@ -28,7 +28,16 @@
 //
 
 #include "AuthSample.h"
+#include "common/metrics.h"
 
+namespace {
+
+tools::metrics::histogram SaleAuthTime("graft_rta_auth_seconds", "Time auth sample members spend on a step of a payment", "step=\"sale\"");
+tools::metrics::histogram PayAuthTime("graft_rta_auth_seconds", "Time auth sample members spend on a step of a payment", "step=\"pay\"");
+tools::metrics::counter SaleAuthFailures("graft_rta_auth_failures_total", "Payment steps the auth sample refused or failed", "step=\"sale\"");
+tools::metrics::counter PayAuthFailures("graft_rta_auth_failures_total", "Payment steps the auth sample refused or failed", "step=\"pay\"");
+
+}
 
 
 void supernode::AuthSample::Init()  {
@@ -38,15 +47,16 @@ void supernode::AuthSample::Init()  {
 
 
 bool supernode::AuthSample::PosProxySale(const rpc_command::POS_PROXY_SALE::request& in, rpc_command::POS_PROXY_SALE::response& out) {
+	tools::metrics::histogram::timer timer(SaleAuthTime);
 	RTA_TransactionRecord tr;
 	rpc_command::ConvertToTR(tr, in, m_Servant);
 
-	if( !Check(tr) ) return false;
+	if( !Check(tr) ) { SaleAuthFailures.inc(); return false; }
 
-	boost::shared_ptr<AuthSampleObject> data = boost::shared_ptr<AuthSampleObject>( new AuthSampleObject() );
+	boost::shared_ptr<AuthSampleObject> data = boost::make_shared<AuthSampleObject>();
 	data->Owner(this);
 	Setup(data);
-	if( !data->Init(tr) ) return false;
+	if( !data->Init(tr) ) { SaleAuthFailures.inc(); return false; }
 
 	data->PosIP = in.SenderIP;
 	data->PosPort = in.SenderPort;
@@ -59,11 +69,12 @@ bool supernode::AuthSample::PosProxySale(const rpc_command::POS_PROXY_SALE::requ
 }
 
 bool supernode::AuthSample::WalletProxyPay(const rpc_command::WALLET_PROXY_PAY::request& in, rpc_command::WALLET_PROXY_PAY::response& out) {
+	tools::metrics::histogram::timer timer(PayAuthTime);
 	boost::shared_ptr<BaseRTAObject> ff = ObjectByPayment(in.PaymentID);
 	boost::shared_ptr<AuthSampleObject> data = boost::dynamic_pointer_cast<AuthSampleObject>(ff);
-    if(!data) { LOG_PRINT_L4("not found object: "<<in.PaymentID<<"  in: "<<m_DAPIServer->Port()); return false; }
+    if(!data) { LOG_PRINT_L4("not found object: "<<in.PaymentID<<"  in: "<<m_DAPIServer->Port()); PayAuthFailures.inc(); return false; }
 
-    if( !data->WalletProxyPay(in, out) ) { LOG_PRINT_L4("!WalletProxyPay"); Remove(data); return false; }
+    if( !data->WalletProxyPay(in, out) ) { LOG_PRINT_L4("!WalletProxyPay"); Remove(data); PayAuthFailures.inc(); return false; }
 
 	return true;
 }
@@ -30,6 +30,8 @@
 
 #include "BaseRTAObject.h"
 
+std::atomic<int> supernode::BaseRTAObject::s_StatusWaiters(0);
+
 supernode::BaseRTAObject::BaseRTAObject() {
 	TimeMark = boost::posix_time::second_clock::local_time();
 }
@@ -48,6 +50,7 @@ void supernode::BaseRTAObject::Set(const FSN_ServantBase* ser, DAPI_RPC_Server*
 supernode::BaseRTAObject::~BaseRTAObject() {}
 
 void supernode::BaseRTAObject::InitSubnet() {
+	m_SubNetBroadcast.Lane = WorkerPool::ELane::RTA;
 	m_SubNetBroadcast.Set(m_DAPIServer, TransactionRecord.PaymentID, TransactionRecord.AuthNodes);
 }
 
@@ -57,9 +60,53 @@ bool supernode::BaseRTAObject::CheckSign(const string& wallet, const string& sig
 }
 
 void supernode::BaseRTAObject::MarkForDelete() {
-	boost::lock_guard<boost::recursive_mutex> lock(m_HanlderIdxGuard);
-	m_ReadyForDelete = true;
-	for(auto a : m_HanlderIdx) m_DAPIServer->RemoveHandler(a);
-	m_HanlderIdx.clear();
+	{
+		boost::lock_guard<boost::recursive_mutex> lock(m_HanlderIdxGuard);
+		m_ReadyForDelete = true;
+		if( !m_HanlderIdx.empty() ) m_DAPIServer->RemoveHandlers(m_HanlderIdx);
+		m_HanlderIdx.clear();
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(m_StatusGuard);
+	}
+	m_StatusChanged.notify_all();
+}
+
+void supernode::BaseRTAObject::SetStatus(NTransactionStatus s) {
+	{
+		boost::lock_guard<boost::mutex> lock(m_StatusGuard);
+		if( m_Status==s ) return;
+		m_Status = s;
+	}
+	m_StatusChanged.notify_all();
+}
+
+supernode::NTransactionStatus supernode::BaseRTAObject::Status() const {
+	boost::lock_guard<boost::mutex> lock(m_StatusGuard);
+	return m_Status;
+}
+
+supernode::NTransactionStatus supernode::BaseRTAObject::WaitStatus(int known, unsigned waitMillis) {
+	if( waitMillis==0 ) return Status();
+	waitMillis = std::min(waitMillis, rpc_command::DAPI_MAX_STATUS_WAIT_MILLIS);
+
+	// keep half of the DAPI threads for the payment flow itself
+	int maxWaiters = std::max(1, m_DAPIServer->NumThreads()/2);
+	if( ++s_StatusWaiters>maxWaiters ) {
+		--s_StatusWaiters;
+		return Status();
+	}
+
+	NTransactionStatus ret;
+	{
+		boost::unique_lock<boost::mutex> lock(m_StatusGuard);
+		m_StatusChanged.wait_for(lock, boost::chrono::milliseconds(waitMillis), [this, known]() {
+			boost::lock_guard<boost::recursive_mutex> hlock(m_HanlderIdxGuard);
+			return int(m_Status)!=known || m_ReadyForDelete;
+		});
+		ret = m_Status;
+	}
+	--s_StatusWaiters;
+	return ret;
 }
 
@@ -35,6 +35,8 @@
 #include "DAPI_RPC_Server.h"
 #include "FSN_ServantBase.h"
 #include "DAPI_RPC_Client.h"
+#include <boost/thread/condition_variable.hpp>
+#include <atomic>
 #include <string>
 using namespace std;
 
@@ -60,14 +62,18 @@ namespace supernode {
 
 		template<class IN_t, class OUT_t>
 		bool SendDAPICall(const string& ip, const string& port, const string& method, IN_t& req, OUT_t& resp) {
-			DAPI_RPC_Client call;
-			call.Set(ip, port);
 			req.PaymentID = TransactionRecord.PaymentID;
-			return call.Invoke(method, req, resp);
+			return DAPI_RPC_ClientPool::Instance().Invoke(ip, port, method, req, resp);
 		}
 
 		bool CheckSign(const string& wallet, const string& sign);
 
+		void SetStatus(NTransactionStatus s);
+		NTransactionStatus Status() const;
+		// blocks until status differs from known, the object is deleted or waitMillis elapse;
+		// returns at once when too many DAPI threads are already waiting
+		NTransactionStatus WaitStatus(int known, unsigned waitMillis);
+
 		template<class IN_t, class OUT_t>
 		void AddHandler( const string& method, boost::function<bool (const IN_t&, OUT_t&)> handler ) {
 			boost::lock_guard<boost::recursive_mutex> lock(m_HanlderIdxGuard);
@@ -90,6 +96,12 @@ namespace supernode {
 		vector<int> m_HanlderIdx;
 		bool m_ReadyForDelete = false;
 
+		private:
+		mutable boost::mutex m_StatusGuard;
+		boost::condition_variable m_StatusChanged;
+		NTransactionStatus m_Status = NTransactionStatus::None;
+		static std::atomic<int> s_StatusWaiters;
+
 	};
 
 }
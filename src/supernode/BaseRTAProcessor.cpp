@@ -46,7 +46,11 @@ void supernode::BaseRTAProcessor::Set(const FSN_ServantBase* ser, DAPI_RPC_Serve
 void supernode::BaseRTAProcessor::Add(boost::shared_ptr<BaseRTAObject> obj) {
 	{
 		boost::lock_guard<boost::recursive_mutex> lock(m_ObjectsGuard);
-		m_Objects.push_back(obj);
+		if( m_ObjectPositions.count(obj.get()) ) return;
+		obj->TimeMark = boost::posix_time::second_clock::local_time();
+		auto it = m_Objects.insert(m_Objects.end(), obj);
+		m_ObjectPositions[obj.get()] = SObjectPosition{it, obj->TransactionRecord.PaymentID};
+		m_ObjectsByPayment.emplace(obj->TransactionRecord.PaymentID, obj.get());
 	}
 	Tick();
 }
@@ -59,9 +63,10 @@ boost::shared_ptr<supernode::BaseRTAObject> supernode::BaseRTAProcessor::ObjectB
 	boost::shared_ptr<BaseRTAObject> ret;
 	{
 		boost::lock_guard<boost::recursive_mutex> lock(m_ObjectsGuard);
-		for(auto& a : m_Objects) if(a->TransactionRecord.PaymentID==payment_id) {
-			ret = a;
-			break;
+		auto range = m_ObjectsByPayment.equal_range(payment_id);
+		for(auto it=range.first;it!=range.second;++it) {
+			const boost::shared_ptr<BaseRTAObject>& a = *m_ObjectPositions.at(it->second).It;
+			if( !ret || a->TimeMark<ret->TimeMark ) ret = a;//the oldest one as before
 		}
 	}
 	return ret;
@@ -72,9 +77,16 @@ void supernode::BaseRTAProcessor::Remove(boost::shared_ptr<BaseRTAObject> obj) {
     LOG_PRINT_L4("Remove: "<<obj->TransactionRecord.PaymentID);
 	{
 		boost::lock_guard<boost::recursive_mutex> lock(m_ObjectsGuard);
-		auto it = find(m_Objects.begin(), m_Objects.end(), obj);
-		if( it!=m_Objects.end() ) m_Objects.erase(it);
-
+		auto pit = m_ObjectPositions.find(obj.get());
+		if( pit!=m_ObjectPositions.end() ) {
+			auto range = m_ObjectsByPayment.equal_range(pit->second.PaymentID);
+			for(auto it=range.first;it!=range.second;++it) if( it->second==obj.get() ) {
+				m_ObjectsByPayment.erase(it);
+				break;
+			}
+			m_Objects.erase(pit->second.It);
+			m_ObjectPositions.erase(pit);
+		}
 	}
 	{
 		obj->TimeMark = boost::posix_time::second_clock::local_time();
@@ -91,20 +103,16 @@ void supernode::BaseRTAProcessor::Tick() {
 		vector< boost::shared_ptr<BaseRTAObject> > vv;
 		{
 			boost::lock_guard<boost::recursive_mutex> lock(m_ObjectsGuard);
-			for(auto a: m_Objects) if( (now-a->TimeMark).total_milliseconds()>s_ObjectLifetime ) vv.push_back(a);//20 min
+			for(auto& a: m_Objects) {
+				if( (now-a->TimeMark).total_milliseconds()<=s_ObjectLifetime ) break;//20 min
+				vv.push_back(a);
+			}
 		}
 		for(auto a : vv) Remove(a);
 	}
 	{
 		boost::lock_guard<boost::recursive_mutex> lock(m_RemoveObjectsGuard);
-		for(int i=0;i<int(m_RemoveObjects.size());i++) if( (now-m_RemoveObjects[i]->TimeMark).total_milliseconds()>(5*60*1000) ) {
-			m_RemoveObjects.erase( m_RemoveObjects.begin()+i );
-			i--;
-		}
+		while( !m_RemoveObjects.empty() && (now-m_RemoveObjects.front()->TimeMark).total_milliseconds()>(5*60*1000) ) m_RemoveObjects.pop_front();
 	}
 
 }
-
-
-
-
@@ -31,6 +31,9 @@
 #define BASE_RTA_PROCESSOR_H_
 
 #include "BaseRTAObject.h"
+#include <deque>
+#include <list>
+#include <unordered_map>
 
 namespace supernode {
 
@@ -43,6 +46,8 @@ namespace supernode {
 
 		void Set(const FSN_ServantBase* ser, DAPI_RPC_Server* dapi);
 		virtual void Tick();
+		// count of tasks waiting for processing
+		virtual size_t QueueDepth() const { return 0; }
 
 		protected:
 		void Add(boost::shared_ptr<BaseRTAObject> obj);
@@ -53,13 +58,24 @@ namespace supernode {
         virtual void Init() = 0;
 
 		protected:
+		typedef list< boost::shared_ptr<BaseRTAObject> > ObjectList;
+
+		struct SObjectPosition {
+			ObjectList::iterator It;
+			string PaymentID;
+		};
+
 		const FSN_ServantBase* m_Servant = nullptr;
 		DAPI_RPC_Server* m_DAPIServer = nullptr;
 		mutable boost::recursive_mutex m_ObjectsGuard;
-		vector< boost::shared_ptr<BaseRTAObject> > m_Objects;
+		// all objects have the same lifetime, so the list is ordered by expiration time
+		ObjectList m_Objects;
+		unordered_map<const BaseRTAObject*, SObjectPosition> m_ObjectPositions;
+		unordered_multimap<string, const BaseRTAObject*> m_ObjectsByPayment;
 
 		mutable boost::recursive_mutex m_RemoveObjectsGuard;
-		vector< boost::shared_ptr<BaseRTAObject> > m_RemoveObjects;
+		// objects are kept for a while after removal, ordered by removal time
+		deque< boost::shared_ptr<BaseRTAObject> > m_RemoveObjects;
 
 //		mutable boost::mutex m_DeleteGuard;
 //		map< boost::posix_time::ptime, boost::shared_ptr<BaseRTAObject> > m_ForDelete;
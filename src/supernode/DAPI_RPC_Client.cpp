@@ -36,3 +36,103 @@ void supernode::DAPI_RPC_Client::Set(string ip, string port) {
 	boost::optional<epee::net_utils::http::login> http_login{};
 	set_server(ss, http_login);
 }
+
+bool supernode::DAPI_RPC_Client::InvokeRaw(const string& body, string& response, std::chrono::milliseconds timeout) {
+	epee::net_utils::http::fields_list fields;
+	fields.push_back( make_pair(rpc_command::DAPI_FORWARDED_HEADER, string("1")) );
+
+	const epee::net_utils::http::http_response_info* pri = NULL;
+	WasConnected = false;
+	if( !invoke(rpc_command::DAPI_URI, rpc_command::DAPI_METHOD, body, timeout, std::addressof(pri), std::move(fields)) ) {
+		LOG_ERROR("Failed to forward http request to  "<<m_URI);
+		return false;
+	}
+	WasConnected = true;
+
+	if( !pri || pri->m_response_code!=200 ) return false;
+	response = pri->m_body;
+	return true;
+}
+
+bool supernode::DAPI_RPC_ClientPool::InvokeRaw(const string& ip, const string& port, const string& body, string& response, std::chrono::milliseconds timeout) {
+	const string key = ip+string(":")+port;
+	bool reused = false;
+	unique_ptr<DAPI_RPC_Client> client = Acquire(ip, port, reused);
+
+	bool ret = client->InvokeRaw(body, response, timeout);
+
+	if(!ret && reused && !client->WasConnected) {
+		client.reset( new DAPI_RPC_Client() );
+		client->Set(ip, port);
+		ret = client->InvokeRaw(body, response, timeout);
+	}
+
+	if(ret) Release(key, std::move(client));
+	return ret;
+}
+
+supernode::DAPI_RPC_ClientPool& supernode::DAPI_RPC_ClientPool::Instance() {
+	static DAPI_RPC_ClientPool pool;
+	return pool;
+}
+
+unique_ptr<supernode::DAPI_RPC_Client> supernode::DAPI_RPC_ClientPool::Acquire(const string& ip, const string& port, bool& reused) {
+	const string key = ip+string(":")+port;
+	{
+		boost::lock_guard<boost::mutex> lock(m_Guard);
+		auto it = m_Idle.find(key);
+		if( it!=m_Idle.end() ) {
+			// the most recently used connection is the least likely to be closed by the member
+			while( !it->second.empty() ) {
+				unique_ptr<DAPI_RPC_Client> client = std::move(it->second.back().Client);
+				it->second.pop_back();
+				if( client->is_connected() ) {
+					if( it->second.empty() ) m_Idle.erase(it);
+					reused = true;
+					return client;
+				}
+			}
+			m_Idle.erase(it);
+		}
+	}
+
+	unique_ptr<DAPI_RPC_Client> client( new DAPI_RPC_Client() );
+	client->Set(ip, port);
+	reused = false;
+	return client;
+}
+
+void supernode::DAPI_RPC_ClientPool::Release(const string& key, unique_ptr<DAPI_RPC_Client> client) {
+	if( !client->is_connected() ) return;
+
+	auto now = std::chrono::steady_clock::now();
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+
+	deque<SIdleClient>& idle = m_Idle[key];
+	if( idle.size()>=MaxIdlePerHost ) idle.pop_front();
+	idle.push_back( SIdleClient{ std::move(client), now } );
+
+	if( now-m_LastEviction>=IdleTimeout ) EvictIdle(now);
+}
+
+void supernode::DAPI_RPC_ClientPool::EvictIdle(std::chrono::steady_clock::time_point now) {
+	m_LastEviction = now;
+	for(auto it=m_Idle.begin();it!=m_Idle.end();) {
+		deque<SIdleClient>& idle = it->second;
+		while( !idle.empty() && now-idle.front().Since>=IdleTimeout ) idle.pop_front();
+		if( idle.empty() ) it = m_Idle.erase(it);
+		else ++it;
+	}
+}
+
+size_t supernode::DAPI_RPC_ClientPool::IdleCount() {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+	size_t ret = 0;
+	for(auto& a : m_Idle) ret += a.second.size();
+	return ret;
+}
+
+void supernode::DAPI_RPC_ClientPool::Clear() {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+	m_Idle.clear();
+}
@@ -35,7 +35,12 @@
 #include "storages/portable_storage_template_helper.h"
 #include "storages/portable_storage.h"
 #include "supernode_rpc_command.h"
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
 #include <string>
+#include <boost/thread/mutex.hpp>
 using namespace std;
 
 
@@ -93,6 +98,9 @@ namespace supernode {
 
 		}
 
+		// sends already serialized DAPI request, used to forward requests between instances
+		bool InvokeRaw(const string& body, string& response, std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
 		protected:
 		string m_URI;
 
@@ -100,6 +108,58 @@ namespace supernode {
 	};
 
 
+	// keep-alive connections to supernodes keyed by ip:port, shared by all DAPI callers
+	class DAPI_RPC_ClientPool {
+		public:
+		static DAPI_RPC_ClientPool& Instance();
+
+		unsigned MaxIdlePerHost = 8;
+		std::chrono::seconds IdleTimeout = std::chrono::seconds(30);
+
+		// wasConnected - false if the member could not be reached at all
+		template<class t_request, class t_response>
+		bool Invoke(const string& ip, const string& port, const string& call, const t_request& out_struct, t_response& result_struct,
+					std::chrono::milliseconds timeout = std::chrono::seconds(5), bool* wasConnected = nullptr) {
+			const string key = ip+string(":")+port;
+			bool reused = false;
+			unique_ptr<DAPI_RPC_Client> client = Acquire(ip, port, reused);
+
+			bool ret = client->Invoke(call, out_struct, result_struct, timeout);
+
+			if(!ret && reused && !client->WasConnected) {
+				// idle connection could be closed by the member, try once more with a fresh one
+				client.reset( new DAPI_RPC_Client() );
+				client->Set(ip, port);
+				ret = client->Invoke(call, out_struct, result_struct, timeout);
+			}
+
+			if(wasConnected) *wasConnected = client->WasConnected;
+			if(ret) Release(key, std::move(client));
+			return ret;
+		}
+
+		bool InvokeRaw(const string& ip, const string& port, const string& body, string& response,
+					std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+		size_t IdleCount();
+		void Clear();
+
+		protected:
+		unique_ptr<DAPI_RPC_Client> Acquire(const string& ip, const string& port, bool& reused);
+		void Release(const string& key, unique_ptr<DAPI_RPC_Client> client);
+		void EvictIdle(std::chrono::steady_clock::time_point now);
+
+		struct SIdleClient {
+			unique_ptr<DAPI_RPC_Client> Client;
+			std::chrono::steady_clock::time_point Since;
+		};
+
+		boost::mutex m_Guard;
+		map< string, deque<SIdleClient> > m_Idle;
+		std::chrono::steady_clock::time_point m_LastEviction;
+	};
+
+
 }
 
 #endif /* DAPI_RPC_CLIENT_H_ */
@@ -31,6 +31,76 @@
 using namespace std;
 #include "DAPI_RPC_Server.h"
 #include "healthcheckapi.h"
+#include "DAPI_RPC_Client.h"
+#include "common/metrics.h"
+#include "rapidjson/reader.h"
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace {
+
+tools::metrics::family<tools::metrics::histogram> RequestTime("graft_dapi_request_seconds", "Time spent handling DAPI requests by method", "method");
+tools::metrics::counter ForwardedRequests("graft_dapi_forwarded_requests_total", "DAPI requests forwarded to the instance owning the payment");
+
+// requests which clients (POS, wallets) send for an existing payment
+bool IsRoutedMethod(const string& method) {
+    using namespace supernode;
+    return method==dapi_call::Pay || method==dapi_call::GetPayStatus || method==dapi_call::GetSaleStatus ||
+           method==dapi_call::PosRejectSale || method==dapi_call::WalletGetPosData || method==dapi_call::WalletRejectPay;
+}
+
+bool IsForwarded(const epee::net_utils::http::http_request_info& query_info) {
+    for(const auto& a : query_info.m_header_info.m_etc_fields)
+        if( boost::iequals(a.first, supernode::rpc_command::DAPI_FORWARDED_HEADER) ) return true;
+    return false;
+}
+
+// SAX handler which picks dapi_version, method and params.PaymentID from a DAPI request,
+// parsing stops as soon as all of them are found
+class DapiHeaderReader : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, DapiHeaderReader> {
+    public:
+    bool HasVersion = false;
+    bool HasMethod = false;
+    bool HasPaymentID = false;
+    string Version;
+    string Method;
+    string PaymentID;
+
+    bool Key(const char* str, rapidjson::SizeType length, bool) {
+        m_Key.assign(str, length);
+        return true;
+    }
+
+    bool String(const char* str, rapidjson::SizeType length, bool) {
+        if( m_Depth==1 && m_Key=="dapi_version" ) { Version.assign(str, length); HasVersion = true; }
+        else if( m_Depth==1 && m_Key=="method" ) { Method.assign(str, length); HasMethod = true; }
+        else if( m_Depth==2 && m_InParams && m_Key=="PaymentID" ) { PaymentID.assign(str, length); HasPaymentID = true; }
+        return !(HasVersion && HasMethod && HasPaymentID);
+    }
+
+    bool StartObject() {
+        if( m_Depth==1 && m_Key=="params" ) m_InParams = true;
+        ++m_Depth;
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        --m_Depth;
+        if( m_Depth==1 ) m_InParams = false;
+        return true;
+    }
+
+    bool StartArray() { ++m_Depth; return true; }
+    bool EndArray(rapidjson::SizeType) { --m_Depth; return true; }
+
+    bool Default() { return true; }
+
+    private:
+    int m_Depth = 0;
+    bool m_InParams = false;
+    string m_Key;
+};
+
+} // namespace
 
 bool supernode::DAPI_RPC_Server::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context) {
 	//LOG_PRINT_L4("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
@@ -56,33 +126,38 @@ bool supernode::DAPI_RPC_Server::HandleRequest(const epee::net_utils::http::http
     {
         if (query_info.m_http_method == epee::net_utils::http::http_method_get)
         {
-            if (m_Servant)
+            if (query_info.m_URI == "/metrics")
             {
-                HealthcheckAPI healthCheck(m_Servant->GetNodeAddress());
-                return healthCheck.processHealthchecks(query_info.m_URI, response_info);
+                response_info.m_mime_tipe = "text/plain; version=0.0.4";
+                response_info.m_body = tools::metrics::get();
+                return true;
             }
+            if (m_Healthcheck)
+                return m_Healthcheck->processHealthchecks(query_info.m_URI, response_info);
         }
         return false;
     }
-    uint64_t ticks = epee::misc_utils::get_tick_count();
-    epee::serialization::portable_storage ps;
-
-//    epee::json_rpc::error_response rsp;
-    string version;
-    std::string callback_name;
-    epee::serialization::storage_entry id_ = epee::serialization::storage_entry(std::string());
+    // find the handler before building the storage, requests nobody waits for are dropped cheaply
+    DapiHeaderReader header;
+    {
+        rapidjson::Reader reader;
+        rapidjson::StringStream stream(query_info.m_body.c_str());
+        rapidjson::ParseResult res = reader.Parse(stream, header);
+        if( !res && res.Code()!=rapidjson::kParseErrorTermination ) {
+            response_info.m_response_code = 500;
+            response_info.m_response_comment = "Parse error";
+        }
+    }
 
-    if( !ps.load_from_json(query_info.m_body) ) {
+    if( response_info.m_response_code!=200 ) {
         LOG_ERROR("!load_from_json");
-		response_info.m_response_code = 500;
-		response_info.m_response_comment = "Parse error";
-    } else if( !ps.get_value("dapi_version", version, nullptr) ) {
+    } else if( !header.HasVersion ) {
     	response_info.m_response_code = 500;
     	response_info.m_response_comment = "No DAPI version";
-    } else if( !ps.get_value("method", callback_name, nullptr) ) {
+    } else if( !header.HasMethod ) {
     	response_info.m_response_code = 500;
     	response_info.m_response_comment = "No method";
-    } else if( version!=rpc_command::DAPI_VERSION ) {
+    } else if( header.Version!=rpc_command::DAPI_VERSION ) {
     	response_info.m_response_code = 500;
     	response_info.m_response_comment = "Wrong DAPI version";
     }
@@ -93,34 +168,42 @@ bool supernode::DAPI_RPC_Server::HandleRequest(const epee::net_utils::http::http
     	return true;
     }
 
-    ps.get_value("id", id_, nullptr);
+    const string& callback_name = header.Method;
 
-    std::string payment_id;
-    {
-    	epee::json_rpc::request<SubNetData> resp;
-    	if( resp.load(ps) ) payment_id = resp.params.PaymentID;
+    if( !header.PaymentID.empty() && IsRoutedMethod(callback_name) && !IsForwarded(query_info) && !m_Router.IsOwn(header.PaymentID) ) {
+        ForwardedRequests.inc();
+        return ForwardRequest(m_Router.Owner(header.PaymentID), callback_name, query_info, response_info);
     }
 
+    shared_ptr<SCallHandler> handler = FindHandler(header.PaymentID, callback_name);
+    LOG_PRINT_L2(response_info.m_body);
+
+    if(!handler) { LOG_ERROR("handler not found for: "<<callback_name); return false; }
 
+    // only methods with a handler are timed, so the method label stays bounded
+    tools::metrics::histogram::timer request_timer(RequestTime.get(callback_name));
+    epee::serialization::portable_storage ps;
+    if( !ps.load_from_json(query_info.m_body) ) { LOG_ERROR("!load_from_json"); return false; }
+    if( !handler->Process(ps, response_info.m_body) ) { LOG_ERROR("Fail to process (ret false): "<<callback_name); return false; }
 
-    SCallHandler* handler = nullptr;
+    response_info.m_mime_tipe = "application/json";
+    response_info.m_header_info.m_content_type = " application/json";
+    return true;
+}
 
-    {
-    	boost::lock_guard<boost::recursive_mutex> lock(m_Handlers_Guard);
-    	for(unsigned i=0;i<m_vHandlers.size();i++) {
-    		SHandlerData& hh = m_vHandlers[i];
+bool supernode::DAPI_RPC_Server::ForwardRequest(const string& owner, const string& method, const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info) {
+    size_t pos = owner.rfind(':');
+    if( pos==string::npos ) { LOG_ERROR("wrong instance address: "<<owner); return false; }
 
-    		if(hh.Name!=callback_name) continue;
-    		if(hh.PaymentID.size() &&  hh.PaymentID!=payment_id) continue;
+    // status requests may be long polls held by the owner
+    std::chrono::milliseconds timeout = std::chrono::seconds(5);
+    if( method==dapi_call::GetSaleStatus || method==dapi_call::GetPayStatus ) timeout += std::chrono::milliseconds(rpc_command::DAPI_MAX_STATUS_WAIT_MILLIS);
 
-    		handler = hh.Handler;
-    		break;
-    	}
+    LOG_PRINT_L2("forward to "<<owner);
+    if( !DAPI_RPC_ClientPool::Instance().InvokeRaw(owner.substr(0, pos), owner.substr(pos + 1), query_info.m_body, response_info.m_body, timeout) ) {
+        LOG_ERROR("failed to forward request to "<<owner);
+        return false;
     }
-    LOG_PRINT_L2(response_info.m_body);
-
-    if(!handler) { LOG_ERROR("handler not found for: "<<callback_name); return false; }
-    if( !handler->Process(ps, response_info.m_body) ) { LOG_ERROR("Fail to process (ret false): "<<callback_name); return false; }
 
     response_info.m_mime_tipe = "application/json";
     response_info.m_header_info.m_content_type = " application/json";
@@ -133,11 +216,13 @@ const string& supernode::DAPI_RPC_Server::Port() const { return m_Port; }
 void supernode::DAPI_RPC_Server::setServant(FSN_Servant *servant)
 {
     m_Servant = servant;
+    m_Healthcheck.reset(servant ? new HealthcheckAPI(servant->GetNodeAddress(), servant) : nullptr);
 }
 
-void supernode::DAPI_RPC_Server::Set(const string& ip, const string& port, int numThreads) {
+void supernode::DAPI_RPC_Server::Set(const string& ip, const string& port, int numThreads, bool acceptorPerThread) {
 	m_Port = port;
 	m_IP = ip;
+	set_acceptor_per_thread(acceptorPerThread);
     auto rng = [](size_t len, uint8_t *ptr){ return crypto::rand(len, ptr); };
     init(rng, port, ip);
 	m_NumThreads = numThreads;
@@ -147,20 +232,55 @@ void supernode::DAPI_RPC_Server::Start() { run(m_NumThreads); }
 
 void supernode::DAPI_RPC_Server::Stop() { send_stop_signal(); }
 
+string supernode::DAPI_RPC_Server::HandlerKey(const string& paymentID, const string& method) {
+	return paymentID+string("\n")+method;
+}
+
 int supernode::DAPI_RPC_Server::AddHandlerData(const SHandlerData& h) {
-	boost::lock_guard<boost::recursive_mutex> lock(m_Handlers_Guard);
+	string key = HandlerKey(h.PaymentID, h.Name);
+	boost::unique_lock<boost::shared_mutex> lock(m_Handlers_Guard);
 	int idx = m_HandlerIdx;
 	m_HandlerIdx++;
-	m_vHandlers.push_back(h);
-	m_vHandlers.rbegin()->Idx = idx;
+	m_Handlers[key][idx] = h.Handler;
+	m_HandlerKeys[idx] = key;
 	return idx;
 }
 
 void supernode::DAPI_RPC_Server::RemoveHandler(int idx) {
-	boost::lock_guard<boost::recursive_mutex> lock(m_Handlers_Guard);
-	for(unsigned i=0;i<m_vHandlers.size();i++) if( m_vHandlers[i].Idx==idx ) {
-		m_vHandlers.erase( m_vHandlers.begin()+i );
-		break;
+	boost::unique_lock<boost::shared_mutex> lock(m_Handlers_Guard);
+	RemoveHandlerLocked(idx);
+}
+
+void supernode::DAPI_RPC_Server::RemoveHandlers(const vector<int>& idxs) {
+	boost::unique_lock<boost::shared_mutex> lock(m_Handlers_Guard);
+	for(int idx : idxs) RemoveHandlerLocked(idx);
+}
+
+void supernode::DAPI_RPC_Server::RemoveHandlerLocked(int idx) {
+	auto kit = m_HandlerKeys.find(idx);
+	if( kit==m_HandlerKeys.end() ) return;
+
+	auto hit = m_Handlers.find(kit->second);
+	if( hit!=m_Handlers.end() ) {
+		hit->second.erase(idx);
+		if( hit->second.empty() ) m_Handlers.erase(hit);
 	}
+	m_HandlerKeys.erase(kit);
+}
+
+shared_ptr<supernode::DAPI_RPC_Server::SCallHandler> supernode::DAPI_RPC_Server::FindHandler(const string& paymentID, const string& method) {
+	boost::shared_lock<boost::shared_mutex> lock(m_Handlers_Guard);
+
+	// global handler matches any payment id, the earlier registered one wins as before
+	const pair<const int, shared_ptr<SCallHandler> >* found = nullptr;
+	auto git = m_Handlers.find( HandlerKey(string(), method) );
+	if( git!=m_Handlers.end() ) found = &*git->second.begin();
+
+	if( !paymentID.empty() ) {
+		auto pit = m_Handlers.find( HandlerKey(paymentID, method) );
+		if( pit!=m_Handlers.end() && (!found || pit->second.begin()->first<found->first) ) found = &*pit->second.begin();
+	}
+
+	return found ? found->second : shared_ptr<SCallHandler>();
 }
 
@@ -37,7 +37,13 @@
 #include <boost/program_options/variables_map.hpp>
 #include "net/http_server_impl_base.h"
 #include "FSN_Servant.h"
+#include "healthcheckapi.h"
+#include "PaymentRouter.h"
+#include <boost/thread/shared_mutex.hpp>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 using namespace std;
 
 namespace supernode {
@@ -47,13 +53,18 @@ namespace supernode {
 		typedef epee::net_utils::connection_context_base connection_context;
 
 		public:
-		void Set(const string& ip, const string& port, int numThreads);
+		void Set(const string& ip, const string& port, int numThreads, bool acceptorPerThread = false);
 		void Start();//block
 		void Stop();
 		const string& IP() const;
 		const string& Port() const;
+		int NumThreads() const { return m_NumThreads; }
 
         void setServant(FSN_Servant *servant);
+        // nullptr until servant is set
+        HealthcheckAPI* Healthcheck() { return m_Healthcheck.get(); }
+        // routes client requests of a payment to the instance owning it
+        PaymentRouter& Router() { return m_Router; }
 
 		protected:
 		class SCallHandler {
@@ -85,7 +96,7 @@ namespace supernode {
 		};
 
 		struct SHandlerData {
-			SCallHandler* Handler = nullptr;
+			shared_ptr<SCallHandler> Handler;
 			string Name;
 			int Idx = -1;
 			string PaymentID;
@@ -96,7 +107,7 @@ namespace supernode {
 		template<class IN_t, class OUT_t>
 		int AddHandler( const string& method, boost::function<bool (const IN_t&, OUT_t&)> handler ) {
 			SHandlerData hh;
-			hh.Handler = new STemplateHandler<IN_t, OUT_t>(handler);
+			hh.Handler = std::make_shared< STemplateHandler<IN_t, OUT_t> >(handler);
 			hh.Name = method;
 			return AddHandlerData(hh);
 		}
@@ -108,7 +119,7 @@ namespace supernode {
 		template<class IN_t, class OUT_t>
 		int Add_UUID_MethodHandler( string paymentid, const string& method, boost::function<bool (const IN_t&, OUT_t&)> handler ) {
 			SHandlerData hh;
-			hh.Handler = new STemplateHandler<IN_t, OUT_t>(handler);
+			hh.Handler = std::make_shared< STemplateHandler<IN_t, OUT_t> >(handler);
 			hh.Name = method;
 			hh.PaymentID = paymentid;
 			return AddHandlerData(hh);
@@ -117,16 +128,24 @@ namespace supernode {
 		#define ADD_DAPI_GLOBAL_METHOD_HANDLER(payid, method, data, class_owner) Add_UUID_MethodHandler<data::request, data::response>( payid, dapi_call::method, bind( &class_owner::method, this, _1, _2) )
 
 		void RemoveHandler(int idx);
+		void RemoveHandlers(const vector<int>& idxs);
 
 
 		protected:
 		bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context) override;
 		bool HandleRequest(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& m_conn_context);
 		int AddHandlerData(const SHandlerData& h);
+		shared_ptr<SCallHandler> FindHandler(const string& paymentID, const string& method);
+		void RemoveHandlerLocked(int idx);
+		static string HandlerKey(const string& paymentID, const string& method);
+		bool ForwardRequest(const string& owner, const string& method, const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info);
 
 		protected:
-		boost::recursive_mutex m_Handlers_Guard;
-		vector<SHandlerData> m_vHandlers;
+		// handlers by (payment id, method), global handlers have empty payment id;
+		// if several handlers share a key the first registered one is used
+		boost::shared_mutex m_Handlers_Guard;
+		unordered_map< string, map<int, shared_ptr<SCallHandler> > > m_Handlers;
+		unordered_map<int, string> m_HandlerKeys;
 		int m_HandlerIdx = 0;
 
 		protected:
@@ -136,6 +155,8 @@ namespace supernode {
 		string m_IP;
 		string m_Port;
         FSN_Servant *m_Servant = nullptr;
+        std::unique_ptr<HealthcheckAPI> m_Healthcheck;
+        PaymentRouter m_Router;
 	};
 
 };
@@ -32,13 +32,18 @@
 #include "DAPI_RPC_Server.h"
 #include "DAPI_RPC_Client.h"
 #include <unistd.h>
+#include <algorithm>
+#include <random>
 
-static const unsigned s_AuditTime = 50*60*1000;//50 min
+static const unsigned s_AuditTime = 5*60*1000;//5 min
+// FSNs probed per audit round; every FSN is probed by this node once per sweep
+// and by s_AuditProbeCount nodes per round on average, whatever the network size is
+static const size_t s_AuditProbeCount = 8;
 static const uint64_t s_MinStakeBalance = 0;
 
 namespace supernode {
 
-FSN_ActualList::FSN_ActualList(FSN_ServantBase* servant, P2P_Broadcast* p2p, DAPI_RPC_Server* dapi) : m_All_FSN_Guard(servant->All_FSN_Guard), m_All_FSN(servant->All_FSN) {
+FSN_ActualList::FSN_ActualList(FSN_ServantBase* servant, P2P_Broadcast* p2p, DAPI_RPC_Server* dapi) : m_All_FSN_Guard(servant->All_FSN_Guard) {
 	m_Servant = servant;
 	m_P2P = p2p;
 	m_DAPIServer = dapi;
@@ -66,8 +71,8 @@ void FSN_ActualList::Stop() {
 }
 
 void FSN_ActualList::GetFSNList(const rpc_command::BROADCAST_NEAR_GET_ACTUAL_FSN_LIST::request& in, rpc_command::BROADCAST_NEAR_GET_ACTUAL_FSN_LIST::response& out) {
-	boost::lock_guard<boost::recursive_mutex> lock(m_All_FSN_Guard);
-	for(auto a : m_All_FSN) {
+	FSN_RegistryPtr reg = m_Servant->Registry();
+	for(auto a : reg->All) {
 		rpc_command::BROADCACT_ADD_FULL_SUPER_NODE data;
 		data.IP = a->IP;
 		data.Port = a->Port;
@@ -89,7 +94,6 @@ void FSN_ActualList::Run() {
 		vector<rpc_command::BROADCAST_NEAR_GET_ACTUAL_FSN_LIST::response> outv;
 		m_P2P->SendNear(p2p_call::GetFSNList, in, outv);
 
-		boost::lock_guard<boost::recursive_mutex> lock(m_All_FSN_Guard);
 		for(auto aa : outv)
 			for(auto a : aa.List) _OnAddFSN(a);
 
@@ -98,9 +102,10 @@ void FSN_ActualList::Run() {
 
 
 	while(m_Running) {
-		CheckIfIamFSN();
+		if( !m_StakesDriven ) CheckIfIamFSN();
 
 		while(m_Running) {
+			PollStakes();
 			auto now = boost::posix_time::second_clock::local_time();
 			if( (now-m_AuditStartAt).total_milliseconds()>s_AuditTime ) break;
 			sleep(1);
@@ -108,7 +113,7 @@ void FSN_ActualList::Run() {
 		if(!m_Running) break;
 
 		m_AuditStartAt = boost::posix_time::second_clock::local_time();
-		DoAudit();
+		if( !m_StakesDriven ) DoAudit();
 	}
 
 
@@ -117,23 +122,86 @@ void FSN_ActualList::Run() {
 void FSN_ActualList::DoAudit() {
 	vector< boost::shared_ptr<FSN_Data> > all;
 	{
-		boost::lock_guard<boost::recursive_mutex> lock(m_All_FSN_Guard);
-		all = m_All_FSN;
+		boost::lock_guard<boost::mutex> lock(m_AuditQueueGuard);
+		if( m_AuditQueue.empty() ) {
+			// start new sweep over all known FSNs in random order
+			m_AuditQueue = m_Servant->Registry()->All;
+			std::shuffle(m_AuditQueue.begin(), m_AuditQueue.end(), std::mt19937(std::random_device()()));
+		}
+		while( all.size()<s_AuditProbeCount && !m_AuditQueue.empty() ) {
+			all.push_back(m_AuditQueue.back());
+			m_AuditQueue.pop_back();
+		}
 	}
 
 	for(unsigned i=0;i<all.size() && m_Running;i++) {
 		if( CheckIsFSN(all[i]) ) continue;
 		auto data = m_Servant->FSN_DataByStakeAddr( all[i]->Stake.Addr );
 		if( !data ) continue;// was deleted
-
-		rpc_command::BROADCACT_LOST_STATUS_FULL_SUPER_NODE in;
-		in.StakeAddr = data->Stake.Addr;
-		m_P2P->Send(p2p_call::LostFSNStatus, in);
-		m_Servant->RemoveFsnAccount(data);
+		DropFSN(data);
 	}//for
 
 }
 
+void FSN_ActualList::DropFSN(boost::shared_ptr<FSN_Data> data) {
+	rpc_command::BROADCACT_LOST_STATUS_FULL_SUPER_NODE in;
+	in.StakeAddr = data->Stake.Addr;
+	m_P2P->Send(p2p_call::LostFSNStatus, in);
+	m_Servant->RemoveFsnAccount(data);
+}
+
+void FSN_ActualList::PollStakes() {
+	uint64_t known;
+	{
+		boost::lock_guard<boost::mutex> lock(m_StakesGuard);
+		known = m_StakesBlockNum;
+	}
+	cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request stakes;
+	if( m_Servant->GetStakesUpdate(known, stakes) ) OnStakesUpdate(stakes);
+}
+
+void FSN_ActualList::OnStakesUpdate(const cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request& in) {
+	vector<string> changed;
+	{
+		boost::lock_guard<boost::mutex> lock(m_StakesGuard);
+		if( m_StakesDriven && in.block_height<=m_StakesBlockNum ) return;// late or repeated update
+
+		unordered_map<string, StakeState> stakes;
+		stakes.reserve(in.stakes.size());
+		for(const auto& a : in.stakes) {
+			StakeState st{a.amount, a.tier, a.block_height, a.unlock_time};
+			auto it = m_Stakes.find(a.supernode_public_address);
+			if( it==m_Stakes.end() || !(it->second==st) ) changed.push_back(a.supernode_public_address);
+			stakes.emplace(a.supernode_public_address, st);
+		}
+		for(const auto& a : m_Stakes) if( !stakes.count(a.first) ) changed.push_back(a.first);
+
+		m_Stakes.swap(stakes);
+		m_StakesBlockNum = in.block_height;
+		m_StakesDriven = true;
+	}
+
+	if( changed.empty() ) return;
+	m_Work.Post( WorkerPool::ELane::Maintenance, [this, changed](){
+		OnStakesChangedFromWorker(changed);
+	} );
+}
+
+void FSN_ActualList::OnStakesChangedFromWorker(const vector<string>& stakeAddrs) {
+	const string myStake = m_Servant->GetMyStakeWallet().Addr;
+	for(const auto& addr : stakeAddrs) {
+		if(!m_Running) return;
+		if( addr==myStake ) {
+			CheckIfIamFSN();
+			continue;
+		}
+		// unknown FSNs are checked when they announce themselves
+		auto data = m_Servant->FSN_DataByStakeAddr(addr);
+		if( !data || CheckIsFSN(data) ) continue;
+		DropFSN(data);
+	}
+}
+
 void FSN_ActualList::CheckIfIamFSN(bool checkOnly) {
 	boost::shared_ptr<FSN_Data> data = boost::shared_ptr<FSN_Data>( new FSN_Data(m_Servant->GetMyStakeWallet(), m_Servant->GetMyMinerWallet(), m_DAPIServer->IP(), m_DAPIServer->Port()) );
 	if( !CheckIsFSN(data) ) return;
@@ -141,8 +209,9 @@ void FSN_ActualList::CheckIfIamFSN(bool checkOnly) {
 	if(checkOnly) return;
 
 	{
+		// writers lock so nobody adds the same endpoint in between
 		boost::lock_guard<boost::recursive_mutex> lock(m_All_FSN_Guard);
-		for(auto a : m_All_FSN) if( a->IP==data->IP && a->Port==data->Port ) return;
+		if( m_Servant->FSN_DataByEndpoint(data->IP, data->Port) ) return;
 		m_Servant->AddFsnAccount(data);
 	}
 
@@ -158,7 +227,7 @@ void FSN_ActualList::CheckIfIamFSN(bool checkOnly) {
 }
 
 boost::shared_ptr<FSN_Data> FSN_ActualList::_OnAddFSN(const rpc_command::BROADCACT_ADD_FULL_SUPER_NODE& in ) {
-	for(auto a : m_All_FSN) if( a->IP==in.IP && a->Port==in.Port ) return nullptr;
+	if( m_Servant->FSN_DataByEndpoint(in.IP, in.Port) ) return nullptr;
 
 	boost::shared_ptr<FSN_Data> data = boost::shared_ptr<FSN_Data>( new FSN_Data( FSN_WalletData(in.StakeAddr, in.StakeViewKey), FSN_WalletData(in.MinerAddr, in.MinerViewKey), in.IP, in.Port) );
 
@@ -166,23 +235,22 @@ boost::shared_ptr<FSN_Data> FSN_ActualList::_OnAddFSN(const rpc_command::BROADCA
 }
 
 void FSN_ActualList::OnAddFSN(const rpc_command::BROADCACT_ADD_FULL_SUPER_NODE& in ) {
-	m_Work.Service.post( [this, in](){
+	m_Work.Post( WorkerPool::ELane::Maintenance, [this, in](){
 		OnAddFSNFromWorker(in);
 	} );
 }
 
 void FSN_ActualList::OnAddFSNFromWorker(const rpc_command::BROADCACT_ADD_FULL_SUPER_NODE& in ) {
-	boost::shared_ptr<FSN_Data> data;
-	{
-		boost::lock_guard<boost::recursive_mutex> lock(m_All_FSN_Guard);
-		data = _OnAddFSN(in);
-	}
+	boost::shared_ptr<FSN_Data> data = _OnAddFSN(in);
+	if( !data || !CheckIsFSN(data) ) return;// VERY SLOW!!!
 
-	if( data && CheckIsFSN(data) ) m_Servant->AddFsnAccount(data);// VERY SLOW!!!
+	boost::lock_guard<boost::recursive_mutex> lock(m_All_FSN_Guard);
+	if( m_Servant->FSN_DataByEndpoint(data->IP, data->Port) ) return;// added while we were checking
+	m_Servant->AddFsnAccount(data);
 }
 
 void FSN_ActualList::OnLostFSNStatus(const rpc_command::BROADCACT_LOST_STATUS_FULL_SUPER_NODE& in) {
-	m_Work.Service.post( [this, in](){
+	m_Work.Post( WorkerPool::ELane::Maintenance, [this, in](){
 		OnLostFSNStatusFromWorker(in);
 	} );
 }
@@ -200,9 +268,7 @@ bool FSN_ActualList::CheckWalletOwner(boost::shared_ptr<FSN_Data> data, const st
 	in.Str = GenStrForSign( data->IP, data->Port, wa );
 	in.WalletAddr = wa;
 
-	DAPI_RPC_Client call;
-	call.Set(data->IP, data->Port);
-	if( !call.Invoke(dapi_call::FSN_CheckWalletOwnership, in, out) ) return false;
+	if( !DAPI_RPC_ClientPool::Instance().Invoke(data->IP, data->Port, dapi_call::FSN_CheckWalletOwnership, in, out) ) return false;
 	return m_Servant->IsSignValid(in.Str, in.WalletAddr, out.Sign);
 
 }
@@ -33,6 +33,8 @@
 #include "FSN_ServantBase.h"
 #include "supernode_rpc_command.h"
 #include "WorkerPool.h"
+#include <atomic>
+#include <unordered_map>
 
 namespace supernode {
 
@@ -55,6 +57,15 @@ public:
 	void OnAddFSNFromWorker(const rpc_command::BROADCACT_ADD_FULL_SUPER_NODE& in );
 	void OnLostFSNStatusFromWorker(const rpc_command::BROADCACT_LOST_STATUS_FULL_SUPER_NODE& in);
 
+	/*!
+	 * \brief OnStakesUpdate - supernode stakes from the daemon. Only FSNs whose stake was added,
+	 *                         changed or removed since the previous update are checked again.
+	 *                         After the first update the periodic sweep over all FSNs stops
+	 * \param in              - stakes at in.block_height
+	 */
+	void OnStakesUpdate(const cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request& in);
+	void OnStakesChangedFromWorker(const vector<string>& stakeAddrs);
+
 protected:
 	string GenStrForSign(const string& dapiIP, const string& dapiPort, const string& walletAddr);
 	bool CheckIsFSN(boost::shared_ptr<FSN_Data> data);
@@ -62,11 +73,12 @@ protected:
 	boost::shared_ptr<FSN_Data> _OnAddFSN(const rpc_command::BROADCACT_ADD_FULL_SUPER_NODE& in );
 	void Run();
 	void CheckIfIamFSN(bool checkOnly=false);
+	void PollStakes();
+	void DropFSN(boost::shared_ptr<FSN_Data> data);
 	virtual void DoAudit();
 
 protected:
-    boost::recursive_mutex& m_All_FSN_Guard;// DO NOT block for long time. if need - use copy
-    vector< boost::shared_ptr<FSN_Data> >& m_All_FSN;// access to this data may be done from different threads
+    boost::recursive_mutex& m_All_FSN_Guard;// registry writers only, lookups go through m_Servant->Registry()
     P2P_Broadcast* m_P2P = nullptr;
     DAPI_RPC_Server* m_DAPIServer = nullptr;
     FSN_ServantBase* m_Servant = nullptr;
@@ -75,6 +87,20 @@ protected:
 
     WorkerPool m_Work;
     boost::posix_time::ptime m_AuditStartAt;
+    boost::mutex m_AuditQueueGuard;
+    vector< boost::shared_ptr<FSN_Data> > m_AuditQueue;// FSNs left to probe in the current sweep
+
+    struct StakeState {
+        uint64_t Amount;
+        unsigned Tier;
+        uint64_t BlockNum;
+        uint64_t UnlockTime;
+        bool operator==(const StakeState& s) const { return Amount==s.Amount && Tier==s.Tier && BlockNum==s.BlockNum && UnlockTime==s.UnlockTime; }
+    };
+    boost::mutex m_StakesGuard;
+    unordered_map<string, StakeState> m_Stakes;// by stake wallet address, as of m_StakesBlockNum
+    uint64_t m_StakesBlockNum = 0;
+    std::atomic<bool> m_StakesDriven{false};// daemon sends stakes, no periodic sweep
 
 };
 
@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2014-2017 The Monero Project
 
 #include "FSN_Servant.h"
+#include "TxPool.h"
 #include <blockchain_db/blockchain_db.h>
 #include <cryptonote_core/tx_pool.h>
 #include <cryptonote_core/blockchain.h>
@@ -136,6 +137,16 @@ FSN_Servant::FSN_Servant(const string &bdb_path, const string &node_addr, const
 //    if (!initBlockchain(bdb_path, nettype))
 //        throw std::runtime_error("Failed to open blockchain");
 
+    if (m_bc)
+        m_viewKeyScanner.reset(new ViewKeyScanner(nettype));
+}
+
+void FSN_Servant::AttachCore(cryptonote::core &core)
+{
+    m_core = &core;
+    m_bc = &core.get_blockchain_storage();
+    if (!m_viewKeyScanner)
+        m_viewKeyScanner.reset(new ViewKeyScanner(m_nettype));
 }
 
 void FSN_Servant::Set(const string& stakeFileName, const string& stakePasswd, const string& minerFileName, const string& minerPasswd)
@@ -166,15 +177,14 @@ FSN_Servant::LastBlocksResolvedByFSN(uint64_t startFromBlock, uint64_t blockNums
     LOG_PRINT_L3("block height " << block_height);
     uint64_t endBlock = std::min(block_height - 1, startFromBlock + blockNums - 1);
 
-    // TODO: read/write lock
-    All_FSN_Guard.lock();
+    FSN_RegistryPtr reg = Registry();
 
     for (uint64_t block_index = endBlock; block_index >= startFromBlock; --block_index) {
 //FIXME: Commented since blockchain loading disabled.
 //        const cryptonote::block block = m_bdb->get_block_from_height(block_index);
         //2. for each blocks, apply function from xmrblocks (page.h:show_my_outputs)
         // TODO: can be faster algorithm?
-        for (const auto & fsn_wallet : All_FSN) {
+        for (const auto & fsn_wallet : reg->All) {
             crypto::secret_key viewkey;
             epee::string_tools::hex_to_pod(fsn_wallet->Miner.ViewKey, viewkey);
             cryptonote::address_parse_info address_info;
@@ -196,7 +206,6 @@ FSN_Servant::LastBlocksResolvedByFSN(uint64_t startFromBlock, uint64_t blockNums
 //            }
         }
     }
-    All_FSN_Guard.unlock();
 
     return result;
 }
@@ -215,6 +224,53 @@ uint64_t FSN_Servant::GetCurrentBlockHeight() const
 }
 
 
+bool FSN_Servant::GetPoolTransaction(const string& hash_str, cryptonote::transaction& tx) const
+{
+    if (!m_core)
+        return FSN_ServantBase::GetPoolTransaction(hash_str, tx);
+
+    crypto::hash hash;
+    if (!epee::string_tools::hex_to_pod(hash_str, hash)) {
+        LOG_ERROR("error parsing input hash");
+        return false;
+    }
+
+    cryptonote::blobdata blob;
+    if (!m_core->get_pool_transaction(hash, blob))
+        return false;
+
+    return cryptonote::parse_and_validate_tx_from_blob(blob, tx);
+}
+
+bool FSN_Servant::GetStakesUpdate(uint64_t knownBlockNum, cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request& out) const
+{
+    if (!m_core)
+        return false;
+
+    const uint64_t height = m_core->get_current_blockchain_height();
+    if (height == 0 || height - 1 == knownBlockNum)
+        return false;
+
+    cryptonote::supernode_stakes_snapshot_ptr snapshot = m_core->get_supernode_stakes_snapshot(height - 1);
+    if (!snapshot)
+        return false;
+
+    out.block_height = snapshot->block_number;
+    out.stakes.clear();
+    out.stakes.reserve(snapshot->stakes.size());
+    for (const cryptonote::supernode_stake& src : snapshot->stakes) {
+        cryptonote::COMMAND_RPC_SUPERNODE_STAKES::supernode_stake dst;
+        dst.amount = src.amount;
+        dst.tier = src.tier;
+        dst.block_height = src.block_height;
+        dst.unlock_time = src.unlock_time;
+        dst.supernode_public_id = src.supernode_public_id;
+        dst.supernode_public_address = m_addressStrings.get(m_nettype, src.supernode_public_address);
+        out.stakes.push_back(std::move(dst));
+    }
+    return true;
+}
+
 string FSN_Servant::SignByWalletPrivateKey(const string& str, const string& wallet_addr) const
 {
     Monero::Wallet * wallet = getMyWalletByAddress(wallet_addr);
@@ -234,6 +290,19 @@ bool FSN_Servant::IsSignValid(const string &message, const string &address, cons
 
 uint64_t FSN_Servant::GetWalletBalance(uint64_t block_num, const FSN_WalletData& wallet) const
 {
+    if (m_viewKeyScanner) {
+        if (!m_viewKeyScanner->AddAccount(wallet))
+            throw std::runtime_error("Invalid wallet address or view key: " + wallet.Addr);
+
+        syncViewKeyScanner();
+
+        uint64_t result = 0;
+        if (!m_viewKeyScanner->GetBalance(wallet.Addr, block_num, result))
+            LOG_ERROR("Balance of " << wallet.Addr << " is not available for block " << block_num);
+
+        return result;
+    }
+
     // create or open view-only wallet;
     Monero::Wallet * w = initViewOnlyWallet(wallet, m_nettype);
     uint64_t result = w->unlockedBalance(block_num);
@@ -243,15 +312,24 @@ uint64_t FSN_Servant::GetWalletBalance(uint64_t block_num, const FSN_WalletData&
 
 void FSN_Servant::AddFsnAccount(boost::shared_ptr<FSN_Data> fsn) {
 	FSN_ServantBase::AddFsnAccount(fsn);
+    if (m_viewKeyScanner) {
+        m_viewKeyScanner->AddAccount(fsn->Stake);
+        return;
+    }
     // create view-only wallet for stake account
     initViewOnlyWallet(fsn->Stake, m_nettype);
 }
 
 bool FSN_Servant::RemoveFsnAccount(boost::shared_ptr<FSN_Data> fsn) {
-    boost::lock_guard<boost::recursive_mutex> lock(All_FSN_Guard);// we use one mutex for All_FSN && for m_viewOnlyWallets
+    boost::lock_guard<boost::recursive_mutex> lock(All_FSN_Guard);// we use one mutex for registry writers && for m_viewOnlyWallets
 
     if( !FSN_ServantBase::RemoveFsnAccount(fsn) ) return false;
 
+    if (m_viewKeyScanner) {
+        m_viewKeyScanner->RemoveAccount(fsn->Stake.Addr);
+        return true;
+    }
+
     // TODO: RAII based (scoped) locks
     const auto &it = m_viewOnlyWallets.find(fsn->Stake.Addr);
     if (it != m_viewOnlyWallets.end()) {
@@ -423,6 +501,26 @@ Wallet *FSN_Servant::initViewOnlyWallet(const FSN_WalletData &walletData, networ
 
 
 
+void FSN_Servant::syncViewKeyScanner() const
+{
+    boost::lock_guard<boost::mutex> lock(m_viewKeyScannerSyncGuard);
+
+    // all accounts are checked in one pass over each block; accounts added later catch up from genesis
+    const uint64_t height = m_bc->get_current_blockchain_height();
+    std::vector<cryptonote::transaction> txs;
+
+    for (uint64_t h = m_viewKeyScanner->NextHeight(); h < height; ++h) {
+        const cryptonote::block block = m_bc->get_db().get_block_from_height(h);
+
+        txs.clear();
+        txs.reserve(block.tx_hashes.size());
+        for (const crypto::hash &tx_hash : block.tx_hashes)
+            txs.push_back(m_bc->get_db().get_tx(tx_hash));
+
+        m_viewKeyScanner->ScanBlock(h, block, txs);
+    }
+}
+
 FSN_WalletData FSN_Servant::walletData(Wallet *wallet)
 {
     FSN_WalletData result = FSN_WalletData(wallet->address(), wallet->secretViewKey());
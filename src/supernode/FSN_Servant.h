@@ -31,6 +31,7 @@
 #define FSN_SERVANT_H_
 
 #include "FSN_ServantBase.h"
+#include "ViewKeyScanner.h"
 #include <cryptonote_core/cryptonote_core.h>
 #include <wallet/api/wallet2_api.h>
 #include <boost/thread/mutex.hpp>
@@ -57,6 +58,12 @@ public:
     // TODO: add credentials for the node
     FSN_Servant(const string &bdb_path, const string &node_addr, const string &node_login, const string &node_password,
                 const string &fsn_wallets_dir, cryptonote::network_type nettype = cryptonote::MAINNET);
+    /*!
+     * \brief AttachCore - in-process mode: blockchain and pool are read from the daemon core
+     *                     running in the same process instead of own DB copy or RPC
+     * \param core       - daemon core, must outlive the servant
+     */
+    void AttachCore(cryptonote::core &core);
     // data for my wallet access
     void Set(const string& stakeFileName, const string& stakePasswd, const string& minerFileName, const string& minerPasswd);
     // start from blockchain top and check, if block solved by one from  full_super_node_servant::all_fsn
@@ -108,6 +115,11 @@ public:
     // calc balance from chain begin to block_num
     uint64_t GetWalletBalance(uint64_t block_num, const FSN_WalletData& wallet) const  override;
 
+    bool GetPoolTransaction(const string& hash_str, cryptonote::transaction& tx) const override;
+
+    // stakes of the top block, in-process mode only (see AttachCore)
+    bool GetStakesUpdate(uint64_t knownBlockNum, cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request& out) const override;
+
     virtual void AddFsnAccount(boost::shared_ptr<FSN_Data> fsn) override;
     virtual bool RemoveFsnAccount(boost::shared_ptr<FSN_Data> fsn) override;
 
@@ -134,16 +146,28 @@ private:
 
     Monero::Wallet * getMyWalletByAddress(const std::string &address) const;
 
+    /*!
+     * \brief syncViewKeyScanner - scans blocks which haven't been checked yet for FSN accounts
+     */
+    void syncViewKeyScanner() const;
+
 private:
     // directory where view-only wallets for other FSNs will be stored
     std::string                  m_fsnWalletsDir;
     cryptonote::BlockchainDB   * m_bdb     = nullptr;
     cryptonote::Blockchain     * m_bc      = nullptr;
     cryptonote::tx_memory_pool * m_mempool = nullptr;
+    // set in in-process mode, m_bc points to its blockchain then
+    cryptonote::core           * m_core    = nullptr;
 
     mutable Monero::Wallet *m_stakeWallet = nullptr;
     mutable Monero::Wallet *m_minerWallet = nullptr;
     mutable std::map<std::string, Monero::Wallet*> m_viewOnlyWallets;
+    // used instead of view-only wallets when blockchain is available
+    mutable std::unique_ptr<ViewKeyScanner> m_viewKeyScanner;
+    mutable boost::mutex m_viewKeyScannerSyncGuard;
+    // addresses of the stakes, which are sent on every stakes update
+    mutable cryptonote::account_address_string_cache m_addressStrings;
 
 };
 
@@ -28,16 +28,79 @@
 //
 
 #include "FSN_ServantBase.h"
+#include "TxPool.h"
 #include <boost/algorithm/string.hpp>
 
 
 namespace supernode {
 
+static boost::shared_ptr<FSN_Data> FindIn(const FSN_Registry& reg, const unordered_map<string, size_t>& index, const string& key) {
+    const auto it = index.find(key);
+    if( it==index.end() ) return nullptr;
+    return reg.All[it->second];
+}
+
+boost::shared_ptr<FSN_Data> FSN_Registry::FindByStakeAddr(const string& addr) const {
+    return FindIn(*this, ByStakeAddr, addr);
+}
+
+boost::shared_ptr<FSN_Data> FSN_Registry::FindByMinerAddr(const string& addr) const {
+    return FindIn(*this, ByMinerAddr, addr);
+}
+
+boost::shared_ptr<FSN_Data> FSN_Registry::FindByEndpoint(const string& ip, const string& port) const {
+    return FindIn(*this, ByEndpoint, EndpointKey(ip, port));
+}
+
+string FSN_Registry::EndpointKey(const string& ip, const string& port) {
+    return ip + ":" + port;
+}
+
+FSN_RegistryPtr FSN_ServantBase::Registry() const {
+    return boost::atomic_load(&m_registry);
+}
 
 boost::shared_ptr<FSN_Data> FSN_ServantBase::FSN_DataByStakeAddr(const string& addr) const {
-	boost::lock_guard<boost::recursive_mutex> lock(All_FSN_Guard);
-	for(auto a : All_FSN) if( a->Stake.Addr==addr ) return a;
-    return nullptr;
+    return Registry()->FindByStakeAddr(addr);
+}
+
+boost::shared_ptr<FSN_Data> FSN_ServantBase::FSN_DataByMinerAddr(const string& addr) const {
+    return Registry()->FindByMinerAddr(addr);
+}
+
+boost::shared_ptr<FSN_Data> FSN_ServantBase::FSN_DataByEndpoint(const string& ip, const string& port) const {
+    return Registry()->FindByEndpoint(ip, port);
+}
+
+vector< boost::shared_ptr<FSN_Data> > FSN_ServantBase::CachedAuthSample(uint64_t forBlockNum,
+    const std::function<vector< boost::shared_ptr<FSN_Data> >(const FSN_Registry&, uint64_t)>& select) const {
+    FSN_RegistryPtr reg = Registry();
+    boost::shared_ptr<const AuthSampleEntry>& slot = m_authSamples[forBlockNum % s_AuthSampleCacheSize];
+
+    boost::shared_ptr<const AuthSampleEntry> entry = boost::atomic_load(&slot);
+    if( entry && entry->BlockNum==forBlockNum && entry->Generation==reg->Generation ) return entry->Sample;
+
+    // two threads may both select on a miss; the result is the same, last store wins
+    boost::shared_ptr<AuthSampleEntry> fresh = boost::make_shared<AuthSampleEntry>();
+    fresh->BlockNum = forBlockNum;
+    fresh->Generation = reg->Generation;
+    fresh->Sample = select(*reg, forBlockNum);
+    boost::atomic_store(&slot, boost::shared_ptr<const AuthSampleEntry>(fresh));
+    return fresh->Sample;
+}
+
+void FSN_ServantBase::PublishRegistry(vector< boost::shared_ptr<FSN_Data> >&& all) {
+    boost::shared_ptr<FSN_Registry> reg = boost::make_shared<FSN_Registry>();
+    reg->All = std::move(all);
+    reg->Generation = Registry()->Generation + 1;
+    for(size_t i=0;i<reg->All.size();i++) {
+        const FSN_Data& a = *reg->All[i];
+        // first one wins on duplicates, as the linear search did
+        reg->ByStakeAddr.emplace(a.Stake.Addr, i);
+        reg->ByMinerAddr.emplace(a.Miner.Addr, i);
+        reg->ByEndpoint.emplace(FSN_Registry::EndpointKey(a.IP, a.Port), i);
+    }
+    boost::atomic_store(&m_registry, FSN_RegistryPtr(reg));
 }
 
 string FSN_ServantBase::GetNodeIp() const
@@ -85,18 +148,37 @@ void FSN_ServantBase::SetNodeAddress(const string &address)
 
 void FSN_ServantBase::AddFsnAccount(boost::shared_ptr<FSN_Data> fsn) {
 	boost::lock_guard<boost::recursive_mutex> lock(All_FSN_Guard);
-    All_FSN.push_back(fsn);
+    vector< boost::shared_ptr<FSN_Data> > all = Registry()->All;
+    all.push_back(fsn);
+    PublishRegistry(std::move(all));
+}
+
+bool FSN_ServantBase::GetPoolTransaction(const string& hash_str, cryptonote::transaction& tx) const {
+    TxPool* txPool = nullptr;
+    {
+        boost::lock_guard<boost::mutex> lock(m_txPoolGuard);
+        if (!m_txPool)
+            m_txPool.reset(new TxPool(GetNodeAddress(), GetNodeLogin(), GetNodePassword()));
+        txPool = m_txPool.get();
+    }
+    return txPool->get(hash_str, tx);
+}
+
+bool FSN_ServantBase::GetStakesUpdate(uint64_t knownBlockNum, cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request& out) const {
+    return false;
 }
 
 bool FSN_ServantBase::RemoveFsnAccount(boost::shared_ptr<FSN_Data> fsn) {
 	boost::lock_guard<boost::recursive_mutex> lock(All_FSN_Guard);
-    const auto & it = std::find_if(All_FSN.begin(), All_FSN.end(),
+    vector< boost::shared_ptr<FSN_Data> > all = Registry()->All;
+    const auto & it = std::find_if(all.begin(), all.end(),
                                    [fsn] (const boost::shared_ptr<FSN_Data> &other) {
                     return *fsn == *other;
             });
 
-    if(it==All_FSN.end()) return false;
-    All_FSN.erase(it);
+    if(it==all.end()) return false;
+    all.erase(it);
+    PublishRegistry(std::move(all));
     return true;
 }
 
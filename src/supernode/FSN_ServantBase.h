@@ -31,8 +31,35 @@
 #define FSN_SERVANTBASE_H_H_H_
 
 #include "supernode_common_struct.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 
 namespace supernode {
+	class TxPool;
+
+	// immutable snapshot of all known FSNs. never changed after publishing: every add/remove
+	// builds a new one and swaps it in, so readers just take the pointer and never lock
+	struct FSN_Registry {
+	    vector< boost::shared_ptr<FSN_Data> > All;
+	    unordered_map<string, size_t> ByStakeAddr;// index in All
+	    unordered_map<string, size_t> ByMinerAddr;
+	    unordered_map<string, size_t> ByEndpoint;// "IP:Port"
+	    uint64_t Generation = 0;// bumped on every change
+
+	    boost::shared_ptr<FSN_Data> FindByStakeAddr(const string& addr) const;
+	    boost::shared_ptr<FSN_Data> FindByMinerAddr(const string& addr) const;
+	    boost::shared_ptr<FSN_Data> FindByEndpoint(const string& ip, const string& port) const;
+
+	    static string EndpointKey(const string& ip, const string& port);
+	};
+
+	typedef boost::shared_ptr<const FSN_Registry> FSN_RegistryPtr;
+
 	class FSN_ServantBase {
 	public:
 		virtual ~FSN_ServantBase();
@@ -51,11 +78,45 @@ namespace supernode {
 
 	    virtual uint64_t GetWalletBalance(uint64_t block_num, const FSN_WalletData& wallet) const=0;
 
+	    /*!
+	     * \brief GetPoolTransaction - returns transaction from the pool of the node
+	     * \param hash_str            - transaction hash in hex
+	     * \param tx                  - output transaction
+	     * \return                    - false if transaction is not in pool
+	     */
+	    virtual bool GetPoolTransaction(const string& hash_str, cryptonote::transaction& tx) const;
+
+	    /*!
+	     * \brief GetStakesUpdate - supernode stakes known to the daemon, if there are newer ones
+	     * \param knownBlockNum    - block of the stakes the caller already has
+	     * \param out              - stakes in the daemon notification format
+	     * \return                 - false if nothing new or the servant has no stakes source
+	     */
+	    virtual bool GetStakesUpdate(uint64_t knownBlockNum, cryptonote::COMMAND_RPC_SUPERNODE_STAKES::request& out) const;
+
 	public:
 	    // Add WITHOUT any checks. And child add WITHOUT any checks for stake, ping or any other req FSN attrs
 	    virtual void AddFsnAccount(boost::shared_ptr<FSN_Data> fsn);
 	    virtual bool RemoveFsnAccount(boost::shared_ptr<FSN_Data> fsn);
 	    virtual boost::shared_ptr<FSN_Data> FSN_DataByStakeAddr(const string& addr) const;
+	    boost::shared_ptr<FSN_Data> FSN_DataByMinerAddr(const string& addr) const;
+	    boost::shared_ptr<FSN_Data> FSN_DataByEndpoint(const string& ip, const string& port) const;
+
+	    /*!
+	     * \brief Registry - current snapshot of all known FSNs, lock free. Keep the pointer
+	     *                   while iterating; it is not affected by later add/remove
+	     */
+	    FSN_RegistryPtr Registry() const;
+
+	    /*!
+	     * \brief CachedAuthSample - auth sample for the block, selected once per block and
+	     *                           registry generation and shared by all callers after that
+	     * \param forBlockNum      - block number
+	     * \param select           - selection over the registry snapshot, called on cache miss
+	     * \return                 - selected FSNs
+	     */
+	    vector< boost::shared_ptr<FSN_Data> > CachedAuthSample(uint64_t forBlockNum,
+	        const std::function<vector< boost::shared_ptr<FSN_Data> >(const FSN_Registry&, uint64_t)>& select) const;
         /*!
          * \brief GetNodeIp - returns IP addess of node
          * \return          string
@@ -108,8 +169,8 @@ namespace supernode {
 
 
 	public:
-	    mutable boost::recursive_mutex All_FSN_Guard;// DO NOT block for long time. if need - use copy
-	    vector< boost::shared_ptr<FSN_Data> > All_FSN;// access to this data may be done from different threads
+	    // serializes registry writers only (and check-then-add sequences of them), readers use Registry()
+	    mutable boost::recursive_mutex All_FSN_Guard;
 
     protected:
         cryptonote::network_type  m_nettype = cryptonote::MAINNET;
@@ -119,6 +180,25 @@ namespace supernode {
         int m_nodePort;
         std::string m_nodelogin;
         std::string m_nodePassword;
+
+    private:
+        struct AuthSampleEntry {
+            uint64_t BlockNum;
+            uint64_t Generation;
+            vector< boost::shared_ptr<FSN_Data> > Sample;
+        };
+        static const size_t s_AuthSampleCacheSize = 16;
+
+        void PublishRegistry(vector< boost::shared_ptr<FSN_Data> >&& all);
+
+        // accessed only through boost::atomic_load/atomic_store
+        FSN_RegistryPtr m_registry = boost::make_shared<FSN_Registry>();
+        // slot is forBlockNum % s_AuthSampleCacheSize, same atomic access
+        mutable boost::shared_ptr<const AuthSampleEntry> m_authSamples[s_AuthSampleCacheSize];
+
+        // shared by all RTA objects, created on first use
+        mutable std::unique_ptr<TxPool> m_txPool;
+        mutable boost::mutex m_txPoolGuard;
 	};
 
 
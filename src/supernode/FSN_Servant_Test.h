@@ -42,8 +42,8 @@ struct FSN_Servant_Test : public FSN_Servant {
                      cryptonote::network_type nettype = cryptonote::MAINNET) :
         FSN_Servant(bdb_path, daemon_addr, /*login*/"", /*password*/"", fsn_wallets_dir, nettype) {}
 
-	unsigned AuthSampleSize() const override { return All_FSN.size(); }
-	vector<boost::shared_ptr<FSN_Data>> GetAuthSample(uint64_t forBlockNum) const override { return All_FSN; }
+	unsigned AuthSampleSize() const override { return Registry()->All.size(); }
+	vector<boost::shared_ptr<FSN_Data>> GetAuthSample(uint64_t forBlockNum) const override { return Registry()->All; }
 };
 
 
@@ -0,0 +1,77 @@
+// Copyright (c) 2017, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "PaymentRouter.h"
+#include "crypto/hash.h"
+#include <algorithm>
+#include <cstring>
+
+const unsigned supernode::PaymentRouter::VirtualNodes;
+
+void supernode::PaymentRouter::Set(const std::vector<std::string>& instances, const std::string& self) {
+	std::vector<std::string> all = instances;
+	if( !all.empty() && std::find(all.begin(), all.end(), self)==all.end() ) all.push_back(self);
+
+	std::map<uint64_t, std::string> ring;
+	for(const auto& a : all) {
+		for(unsigned i=0;i<VirtualNodes;i++) ring.emplace( Point(a+"#"+std::to_string(i)), a );
+	}
+
+	boost::unique_lock<boost::shared_mutex> lock(m_Guard);
+	m_Ring.swap(ring);
+	m_Self = self;
+}
+
+bool supernode::PaymentRouter::Enabled() const {
+	boost::shared_lock<boost::shared_mutex> lock(m_Guard);
+	return !m_Ring.empty();
+}
+
+std::string supernode::PaymentRouter::Owner(const std::string& paymentID) const {
+	boost::shared_lock<boost::shared_mutex> lock(m_Guard);
+	if( m_Ring.empty() ) return std::string();
+
+	auto it = m_Ring.lower_bound( Point(paymentID) );
+	if( it==m_Ring.end() ) it = m_Ring.begin();
+	return it->second;
+}
+
+bool supernode::PaymentRouter::IsOwn(const std::string& paymentID) const {
+	std::string owner = Owner(paymentID);
+	boost::shared_lock<boost::shared_mutex> lock(m_Guard);
+	return owner.empty() || owner==m_Self;
+}
+
+uint64_t supernode::PaymentRouter::Point(const std::string& key) {
+	// must be the same on all instances, so std::hash is not used
+	crypto::hash h = crypto::cn_fast_hash(key.data(), key.size());
+	uint64_t ret;
+	memcpy(&ret, &h, sizeof(ret));
+	return ret;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2017, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef PAYMENTROUTER_H_
+#define PAYMENTROUTER_H_
+
+#include <boost/thread/shared_mutex.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace supernode {
+
+// consistent hash ring of supernode instances sharing the same clients (e.g. behind a load balancer);
+// every payment is owned by one instance, so all requests of the payment are served where its objects are
+class PaymentRouter {
+public:
+	static const unsigned VirtualNodes = 64;// points on the ring per instance
+
+	// instances and self are "ip:port", self is added if missing; empty instances list disables routing
+	void Set(const std::vector<std::string>& instances, const std::string& self);
+
+	bool Enabled() const;
+	// "ip:port" of the instance owning the payment, empty if routing is disabled
+	std::string Owner(const std::string& paymentID) const;
+	bool IsOwn(const std::string& paymentID) const;
+
+protected:
+	static uint64_t Point(const std::string& key);
+
+protected:
+	mutable boost::shared_mutex m_Guard;
+	std::map<uint64_t, std::string> m_Ring;
+	std::string m_Self;
+};
+
+}
+
+#endif /* PAYMENTROUTER_H_ */
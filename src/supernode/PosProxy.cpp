@@ -41,7 +41,7 @@ void supernode::PosProxy::Init() {
 bool supernode::PosProxy::Sale(const rpc_command::POS_SALE::request& in, rpc_command::POS_SALE::response& out) {
 	LOG_PRINT_L0("PosProxy::Sale" << in.POSAddress << in.Amount);
     //TODO: Add input data validation
-	boost::shared_ptr<PosSaleObject> data = boost::shared_ptr<PosSaleObject>( new PosSaleObject() );
+	boost::shared_ptr<PosSaleObject> data = boost::make_shared<PosSaleObject>();
 	data->Owner(this);
 	Setup(data);
 
@@ -54,9 +54,15 @@ bool supernode::PosProxy::Sale(const rpc_command::POS_SALE::request& in, rpc_com
     }
 	Add(data);
 
-	m_Work.Service.post( [data](){
+	bool posted = m_Work.Post( WorkerPool::ELane::RTA, [data](){
 		data->ContinueInit();
 	} );
+	if(!posted) {
+		Remove(data);
+		out.Result = ERROR_SALE_REQUEST_FAILED;
+		LOG_ERROR("PosProxy is overloaded, sale rejected");
+		return false;
+	}
 
 	out.BlockNum = data->TransactionRecord.BlockNum;
 	out.PaymentID = data->TransactionRecord.PaymentID;
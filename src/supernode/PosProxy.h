@@ -42,6 +42,9 @@ namespace supernode {
 		protected:
 		void Init() override;
 
+		public:
+		size_t QueueDepth() const override { return m_Work.Stats(WorkerPool::ELane::RTA).Depth; }
+
 
         protected:
         WorkerPool m_Work;
@@ -28,7 +28,6 @@
 //
 
 #include "PosSaleObject.h"
-#include "TxPool.h"
 #include "graft_defines.h"
 #include <utils/utils.h>
 #include <ringct/rctSigs.h>
@@ -47,9 +46,9 @@ bool supernode::PosSaleObject::Init(const RTA_TransactionRecordBase& src) {
 	TransactionRecord.PaymentID = GeneratePaymentID();
 	TransactionRecord.BlockNum = m_Servant->GetCurrentBlockHeight();
 	TransactionRecord.AuthNodes = m_Servant->GetAuthSample( TransactionRecord.BlockNum );
-    if( TransactionRecord.AuthNodes.empty() ) { LOG_PRINT_L0("SALE: AuthNodes.empty"); m_Status = NTransactionStatus::Fail; return false; }
+    if( TransactionRecord.AuthNodes.empty() ) { LOG_PRINT_L0("SALE: AuthNodes.empty"); SetStatus(NTransactionStatus::Fail); return false; }
 
-    m_Status = NTransactionStatus::InProgress;
+    SetStatus(NTransactionStatus::InProgress);
 
 	ADD_RTA_OBJECT_HANDLER(GetSaleStatus, rpc_command::POS_GET_SALE_STATUS, PosSaleObject);
 	ADD_RTA_OBJECT_HANDLER(PoSTRSigned, rpc_command::POS_TR_SIGNED, PosSaleObject);
@@ -69,7 +68,7 @@ void supernode::PosSaleObject::ContinueInit() {
 	inbr.SenderPort = m_DAPIServer->Port();
 	if( !m_SubNetBroadcast.Send(dapi_call::PosProxySale, inbr, outv) || outv.empty() ) {
         LOG_ERROR("!Send dapi_call::PosProxySale");
-		m_Status = NTransactionStatus::Fail;
+		SetStatus(NTransactionStatus::Fail);
 
 	}
 
@@ -77,14 +76,14 @@ void supernode::PosSaleObject::ContinueInit() {
 
 bool supernode::PosSaleObject::AuthWalletRejectPay(const rpc_command::WALLET_REJECT_PAY::request &in, rpc_command::WALLET_REJECT_PAY::response &out) {
 	LOG_PRINT_L0("PosSaleObject::AuthWalletRejectPay" << in.PaymentID);
-	m_Status = NTransactionStatus::RejectedByWallet;
+	SetStatus(NTransactionStatus::RejectedByWallet);
 	return true;
 }
 
 bool supernode::PosSaleObject::GetSaleStatus(const rpc_command::POS_GET_SALE_STATUS::request& in, rpc_command::POS_GET_SALE_STATUS::response& out)
 {
 	LOG_PRINT_L0("PosSaleObject::GetSaleStatus" << in.PaymentID);
-	out.Status = int(m_Status);
+	out.Status = int(WaitStatus(in.KnownStatus, in.WaitMillis));
     out.Result = STATUS_OK;
 	return true;
 }
@@ -99,10 +98,8 @@ bool supernode::PosSaleObject::PoSTRSigned(const rpc_command::POS_TR_SIGNED::req
 	}
 
     // get tranaction from pool by in.TransactionPoolID
-    // TODO: make txPool as a member of PosProxy or FSN_Servant?
-    TxPool txPool(m_Servant->GetNodeAddress(), m_Servant->GetNodeLogin(), m_Servant->GetNodePassword());
     cryptonote::transaction tx;
-    if (!txPool.get(in.TransactionPoolID, tx)) {
+    if (!m_Servant->GetPoolTransaction(in.TransactionPoolID, tx)) {
         LOG_ERROR("TX " << in.TransactionPoolID << " was not found in pool");
         return false;
     }
@@ -180,14 +177,14 @@ bool supernode::PosSaleObject::PoSTRSigned(const rpc_command::POS_TR_SIGNED::req
         return false;
     }
 
-    m_Status = NTransactionStatus::Success;
+    SetStatus(NTransactionStatus::Success);
     return true;
 }
 
 
 bool supernode::PosSaleObject::PosRejectSale(const supernode::rpc_command::POS_REJECT_SALE::request &in, supernode::rpc_command::POS_REJECT_SALE::response &out) {
 	LOG_PRINT_L0("PosSaleObject::PosRejectSale" << in.PaymentID);
-    m_Status = NTransactionStatus::RejectedByPOS;
+    SetStatus(NTransactionStatus::RejectedByPOS);
 
     //TODO: Add impl
 
@@ -198,7 +195,12 @@ bool supernode::PosSaleObject::PosRejectSale(const supernode::rpc_command::POS_R
 
 string supernode::PosSaleObject::GeneratePaymentID() {
     boost::uuids::random_generator gen;
-    boost::uuids::uuid id = gen();
-    return boost::uuids::to_string(id);
+    string ret;
+    // the payment must be owned by this instance, so requests of its clients are not forwarded
+    for(unsigned i=0;i<1000;i++) {
+        ret = boost::uuids::to_string( gen() );
+        if( m_DAPIServer->Router().IsOwn(ret) ) break;
+    }
+    return ret;
 }
 
@@ -34,7 +34,6 @@
 
 namespace supernode {
 	class PosProxy;
-    class TxPool;
 	class PosSaleObject : public BaseRTAObject {
 		public:
 		void Owner(PosProxy* o);
@@ -51,7 +50,6 @@ namespace supernode {
 
 		protected:
         unsigned m_Signs = 0;
-        NTransactionStatus m_Status = NTransactionStatus::None;
         PosProxy* m_Owner = nullptr;
         mutable boost::recursive_mutex m_TxInPoolGotGuard;
         bool m_TxInPoolGot = false;
@@ -32,6 +32,10 @@
 
 #include "supernode_common_struct.h"
 #include <string>
+#include <algorithm>
+#include <boost/chrono.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "DAPI_RPC_Client.h"
 #include "DAPI_RPC_Server.h"
 #include "WorkerPool.h"
@@ -65,98 +69,142 @@ namespace supernode {
 		unsigned RetryCount = 2;
 		std::chrono::milliseconds CallTimeout = std::chrono::seconds(5);
 		bool AllowSendSefl = true;
+		// lane of member calls in worker pool; RTA objects use RTA lane
+		WorkerPool::ELane Lane = WorkerPool::ELane::Broadcast;
 
 		public:
+		// state of one Send, shared with the member calls; calls finished after the deadline only touch it
+		template<class OUT_t>
+		struct SSendState {
+			SSendState(unsigned membersCount, unsigned required) : Out(membersCount), Rets(membersCount, 0), Pending(membersCount), Required(required) {}
+
+			bool Finished() const { return Pending==0 || Succeeded>=Required || Succeeded+Pending<Required; }
+
+			boost::mutex Guard;
+			boost::condition_variable Done;
+			vector<OUT_t> Out;
+			vector<int> Rets;
+			unsigned Pending;
+			unsigned Succeeded = 0;
+			unsigned Required;
+		};
+
+		// waits for responses of all members; with reqAllResps fails (and clears out) if any member failed,
+		// otherwise returns responses of members answered before the deadline
 		template<class IN_t, class OUT_t>
 		bool Send( const string& method, const IN_t& in, vector<OUT_t>& out, bool reqAllResps=true ) {
-			if(m_SendsCount) throw string("m_SendsCount not zero");
-
-			m_MembersGuard.lock();
-
-			out.resize( m_Members.size() );
-			vector<int> rets;
-			rets.resize( m_Members.size(), 0 );
-			m_SendsCount = m_Members.size();
-
-
-			for(unsigned i=0;i<m_Members.size();i++) {
-				OUT_t* outp = &out[i];
-				int* retp = &rets[i];
-				string ip = m_Members[i].IP;
-				string port = m_Members[i].Port;
-				m_Work.Service.post(
-					[this, method, in, outp, retp, ip, port]() {
-					DoCallInThread<IN_t, OUT_t>(method, in, outp, retp, ip, port);
-				} );
-			}
-
-			m_MembersGuard.unlock();
-
-			while(m_SendsCount) boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
-
-			bool ret = true;
+			boost::shared_ptr< SSendState<OUT_t> > state = Post<IN_t, OUT_t>(method, in, 0);
+			bool ret = Wait(*state, out);
 
 			if(reqAllResps) {
-				for(unsigned i=0;i<m_Members.size();i++) if( rets[i]==0 ) {
-					ret = false; break;
-				}
+				ret = ret && out.size()==state->Rets.size();
 				if(!ret) out.clear();
 			} else {
-				 vector<OUT_t> vv;
-				 for(unsigned i=0;i<out.size();i++) if( rets[i]!=0 ) vv.push_back( out[i] );
-				 out = vv;
+				ret = true;
 			}
 
 			return ret;
 		}
 
+		// returns as soon as 'required' members responded; true if they did before the deadline
+		template<class IN_t, class OUT_t>
+		bool SendFirst( const string& method, const IN_t& in, vector<OUT_t>& out, unsigned required ) {
+			boost::shared_ptr< SSendState<OUT_t> > state = Post<IN_t, OUT_t>(method, in, required);
+			return Wait(*state, out);
+		}
+
 		template<class IN_t>
 		void Send( const string& method, const IN_t& in) {
-			if(m_SendsCount) throw string("m_SendsCount not zero");
+			Post<IN_t, rpc_command::P2P_DUMMY_RESP>(method, in, 0);
+		}
+
+		template<class IN_t, class OUT_t>
+		void AddHandler( const string& method, boost::function<bool (const IN_t&, OUT_t&)> handler ) {
+			int idx = m_DAPIServer->Add_UUID_MethodHandler<IN_t, OUT_t>( m_PaymentID, method, handler );
+			m_MyHandlers.push_back(idx);
+		}
+		#define ADD_SUBNET_HANDLER(method, data, class_owner) AddHandler<data::request, data::response>( dapi_call::method, bind( &class_owner::method, this, _1, _2) );
 
-			rpc_command::P2P_DUMMY_RESP* outp = &m_DummyOut;
-			int* retp = &m_DummyRet;
+		protected:
+		boost::chrono::steady_clock::time_point Deadline() const {
+			return boost::chrono::steady_clock::now() + boost::chrono::milliseconds( (CallTimeout*RetryCount).count() );
+		}
 
+		// required==0 means all members
+		template<class IN_t, class OUT_t>
+		boost::shared_ptr< SSendState<OUT_t> > Post( const string& method, const IN_t& in, unsigned required ) {
 			boost::lock_guard<boost::recursive_mutex> lock(m_MembersGuard);
 
-			for(unsigned i=0;i<m_Members.size();i++) {
+			unsigned cnt = m_Members.size();
+			boost::shared_ptr< SSendState<OUT_t> > state = boost::make_shared< SSendState<OUT_t> >( cnt, required==0 ? cnt : required );
+			boost::shared_ptr<const IN_t> inp = boost::make_shared<const IN_t>(in);
+			boost::chrono::steady_clock::time_point deadline = Deadline();
+
+			for(unsigned i=0;i<cnt;i++) {
 				string ip = m_Members[i].IP;
 				string port = m_Members[i].Port;
-				m_Work.Service.post(
-					[this, method, in, outp, retp, ip, port]() {
-					DoCallInThread<IN_t, rpc_command::P2P_DUMMY_RESP>(method, in, outp, retp, ip, port);
+				bool posted = m_Work.Post( Lane,
+					[this, method, inp, state, i, ip, port, deadline]() {
+					DoCallInThread<IN_t, OUT_t>(method, *inp, *state, i, ip, port, deadline);
 				} );
-			}//for
+				if(!posted) {
+					// shed call counts as failed member
+					{
+						boost::lock_guard<boost::mutex> slock(state->Guard);
+						state->Pending--;
+					}
+					state->Done.notify_all();
+				}
+			}
+
+			return state;
 		}
 
+		template<class OUT_t>
+		bool Wait(SSendState<OUT_t>& state, vector<OUT_t>& out) {
+			boost::chrono::steady_clock::time_point deadline = Deadline();
+			boost::unique_lock<boost::mutex> lock(state.Guard);
 
-		template<class IN_t, class OUT_t>
-		void AddHandler( const string& method, boost::function<bool (const IN_t&, OUT_t&)> handler ) {
-			int idx = m_DAPIServer->Add_UUID_MethodHandler<IN_t, OUT_t>( m_PaymentID, method, handler );
-			m_MyHandlers.push_back(idx);
+			while( !state.Finished() ) {
+				if( state.Done.wait_until(lock, deadline)==boost::cv_status::timeout ) break;
+			}
+
+			out.clear();
+			for(unsigned i=0;i<state.Out.size();i++) if( state.Rets[i]!=0 ) out.push_back( state.Out[i] );
+
+			return state.Succeeded>=state.Required;
 		}
-		#define ADD_SUBNET_HANDLER(method, data, class_owner) AddHandler<data::request, data::response>( dapi_call::method, bind( &class_owner::method, this, _1, _2) );
 
-		public:
 		template<class IN_t, class OUT_t>
-		void DoCallInThread(string method, const IN_t in, OUT_t* outo, int* ret, string ip, string port) {
+		void DoCallInThread(const string& method, const IN_t& in, SSendState<OUT_t>& state, unsigned idx, const string& ip, const string& port, boost::chrono::steady_clock::time_point deadline) {
 			bool localcOk = false;
 			bool wasNoConnect = false;
+			OUT_t outo;
 			for(unsigned k=0;k<RetryCount;k++) {
-				DAPI_RPC_Client client;
-				client.Set( ip, port );
-				if( !client.Invoke<IN_t, OUT_t>(method, in, *outo, CallTimeout) ) {
-					wasNoConnect = wasNoConnect || !client.WasConnected;
+				auto left = boost::chrono::duration_cast<boost::chrono::milliseconds>(deadline - boost::chrono::steady_clock::now());
+				if( left.count()<=0 ) break;
+
+				bool wasConnected = false;
+				if( !DAPI_RPC_ClientPool::Instance().Invoke<IN_t, OUT_t>(ip, port, method, in, outo, std::min(CallTimeout, std::chrono::milliseconds(left.count())), &wasConnected) ) {
+					wasNoConnect = wasNoConnect || !wasConnected;
 					boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
 					continue;
 				}
 				localcOk = true;
 				break;
 			}//for K
-			*ret = localcOk?1:0;
 			if(!localcOk && wasNoConnect) IncNoConnectAndRemove(ip, port);
 
-			if(m_SendsCount) m_SendsCount--;
+			{
+				boost::lock_guard<boost::mutex> lock(state.Guard);
+				if(localcOk) {
+					state.Out[idx] = outo;
+					state.Rets[idx] = 1;
+					state.Succeeded++;
+				}
+				state.Pending--;
+			}
+			state.Done.notify_all();
 		}//do work
 
 
@@ -172,13 +220,8 @@ namespace supernode {
 		vector<int> m_MyHandlers;
 
 		protected:
-		int m_SendsCount = 0;
 	    WorkerPool m_Work;
 
-		protected:
-		rpc_command::P2P_DUMMY_RESP m_DummyOut;
-		int m_DummyRet=0;
-
 
 
 };
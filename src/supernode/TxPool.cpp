@@ -38,8 +38,11 @@ using namespace std;
 
 namespace supernode {
 
+constexpr size_t TxPool::MAX_CACHED_TXS;
+
 TxPool::TxPool(const std::string &daemon_addr, const std::string &daemon_login, const std::string &daemon_pass)
   : m_rpc_timeout(std::chrono::seconds(30))
+  , m_stop(false)
 {
 
     bool result = false;
@@ -51,11 +54,17 @@ TxPool::TxPool(const std::string &daemon_addr, const std::string &daemon_login,
     if (!result) {
         throw std::runtime_error("can't connect to node: " + daemon_addr);
     }
+
+    m_subscription_client.set_server(daemon_addr, login);
+    m_subscription_thread = boost::thread([this]() { subscriptionLoop(); });
 }
 
 TxPool::~TxPool()
 {
-
+    m_stop = true;
+    m_subscription_thread.interrupt();
+    if (m_subscription_thread.joinable())
+        m_subscription_thread.join();
 }
 
 bool TxPool::get(const string &hash_str, cryptonote::transaction &out_tx)
@@ -66,8 +75,39 @@ bool TxPool::get(const string &hash_str, cryptonote::transaction &out_tx)
         return false;
     }
 
+    cryptonote::blobdata bd;
+    bool cached = false;
+    {
+        boost::lock_guard<boost::mutex> lock(m_cache_guard);
+        const auto it = m_cache.find(hash);
+        if (it != m_cache.end()) {
+            bd = it->second;
+            cached = true;
+        }
+    }
+
+    if (!cached && !getFromDaemon(hash, bd))
+        return false;
+
+    crypto::hash tx_hash, tx_prefix_hash;
+    if (!cryptonote::parse_and_validate_tx_from_blob(bd, out_tx, tx_hash, tx_prefix_hash)) {
+        LOG_ERROR("failed to parse tx from blob");
+        return false;
+    }
+
+    if (hash != tx_hash) {
+        LOG_ERROR("wrong tx received from daemon");
+        return false;
+    }
+    return true;
+}
+
+bool TxPool::getFromDaemon(const crypto::hash &hash, std::string &bd)
+{
+    const std::string hash_str = epee::string_tools::pod_to_hex(hash);
+
     // get the pool state
-    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request req;
+    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request req = AUTO_VAL_INIT(req);
     cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response res;
 
     bool r = epee::net_utils::invoke_http_json("/get_transaction_pool_hashes.bin", req, res, m_http_client, m_rpc_timeout);
@@ -101,23 +141,63 @@ bool TxPool::get(const string &hash_str, cryptonote::transaction &out_tx)
         return false;
     }
 
-    cryptonote::blobdata bd;
-    crypto::hash tx_hash, tx_prefix_hash;
     if (!epee::string_tools::parse_hexstr_to_binbuff(res_tx.txs[0].as_hex, bd)) {
         LOG_ERROR("failed to parse tx from hex");
         return false;
     }
+    return true;
+}
 
-    if (!cryptonote::parse_and_validate_tx_from_blob(bd, out_tx, tx_hash, tx_prefix_hash)) {
-        LOG_ERROR("failed to parse tx from blob");
-        return false;
+void TxPool::subscriptionLoop()
+{
+    static const uint64_t WAIT_MILLIS = 5000; // bounds destructor wait as well
+    static const auto RETRY_DELAY = boost::chrono::seconds(5);
+
+    uint64_t start = 0;
+
+    while (!m_stop) {
+        cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN::request req;
+        cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_ADDED_BIN::response res;
+        req.start = start;
+        req.wait_millis = WAIT_MILLIS;
+
+        bool r = epee::net_utils::invoke_http_bin("/get_transaction_pool_added.bin", req, res, m_subscription_client, m_rpc_timeout);
+        if (m_stop)
+            break;
+
+        if (!r || res.status != CORE_RPC_STATUS_OK || res.tx_hashes.size() != res.txs.size()) {
+            // daemon is not available or doesn't support subscription, transactions are requested one by one meanwhile
+            MDEBUG("/get_transaction_pool_added.bin failed, retrying later");
+            try {
+                boost::this_thread::sleep_for(RETRY_DELAY);
+            } catch (const boost::thread_interrupted&) {
+                break;
+            }
+            continue;
+        }
+
+        if (!res.complete)
+            MDEBUG("some pool transactions have been missed, they will be requested from the daemon");
+
+        for (size_t i = 0; i < res.tx_hashes.size(); ++i)
+            addToCache(res.tx_hashes[i], std::move(res.txs[i]));
+
+        start = res.next;
     }
+}
 
-    if (hash != tx_hash) {
-        LOG_ERROR("wrong tx received from daemon");
-        return false;
+void TxPool::addToCache(const crypto::hash &hash, std::string &&blob)
+{
+    boost::lock_guard<boost::mutex> lock(m_cache_guard);
+
+    if (!m_cache.emplace(hash, std::move(blob)).second)
+        return;
+
+    m_cache_order.push_back(hash);
+    if (m_cache_order.size() > MAX_CACHED_TXS) {
+        m_cache.erase(m_cache_order.front());
+        m_cache_order.pop_front();
     }
-    return true;
 }
 
 bool TxPool::init(const string &daemon_address, boost::optional<epee::net_utils::http::login> daemon_login)
@@ -33,7 +33,12 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
 #include <boost/optional.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "net/http_client.h"
 #include "net/http_auth.h"
@@ -47,17 +52,36 @@ class TxPool
 public:
     TxPool(const std::string &daemon_addr, const std::string &daemon_login, const std::string &daemon_pass);
     virtual ~TxPool();
+    /*!
+     * \brief get - returns pool transaction; transactions pushed by the daemon are taken
+     *              from the local cache, others are requested from the daemon
+     */
     bool get(const std::string &hash_str, cryptonote::transaction &out_tx);
 
 
 protected:
     bool init(const std::string &daemon_address, boost::optional<epee::net_utils::http::login> daemon_login);
 
+    // long polls the daemon for transactions added to the pool and caches their blobs
+    void subscriptionLoop();
+    void addToCache(const crypto::hash &hash, std::string &&blob);
+    bool getFromDaemon(const crypto::hash &hash, std::string &bd);
+
 
 private:
+    static constexpr size_t MAX_CACHED_TXS = 4096;
+
     epee::net_utils::http::http_simple_client m_http_client;
     std::chrono::seconds m_rpc_timeout;
 
+    epee::net_utils::http::http_simple_client m_subscription_client;
+    boost::thread m_subscription_thread;
+    std::atomic<bool> m_stop;
+
+    boost::mutex m_cache_guard;
+    std::unordered_map<crypto::hash, std::string> m_cache;
+    std::deque<crypto::hash> m_cache_order;// oldest first
+
 };
 
 }
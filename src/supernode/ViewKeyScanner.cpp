@@ -0,0 +1,170 @@
+// Copyright (c) 2017, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "ViewKeyScanner.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "ringct/rctSigs.h"
+#include "device/device.hpp"
+#include "string_tools.h"
+
+supernode::ViewKeyScanner::ViewKeyScanner(cryptonote::network_type nettype, unsigned maxAccounts) : m_Nettype(nettype), m_MaxAccounts(maxAccounts) {}
+
+bool supernode::ViewKeyScanner::AddAccount(const FSN_WalletData& wallet) {
+	cryptonote::address_parse_info info;
+	if( !cryptonote::get_account_address_from_str(info, m_Nettype, wallet.Addr) ) return false;
+
+	crypto::secret_key viewKey;
+	if( !epee::string_tools::hex_to_pod(wallet.ViewKey, viewKey) ) return false;
+
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+
+	auto it = m_Accounts.find(wallet.Addr);
+	if( it!=m_Accounts.end() ) {
+		touch(it->second);
+		return true;
+	}
+
+	if( m_Accounts.size()>=m_MaxAccounts && !m_LRU.empty() ) {
+		m_Accounts.erase(m_LRU.back());
+		m_LRU.pop_back();
+	}
+
+	m_LRU.push_front(wallet.Addr);
+
+	SAccount& acc = m_Accounts[wallet.Addr];
+	acc.Address = info.address;
+	acc.ViewKey = viewKey;
+	acc.LRU = m_LRU.begin();
+
+	return true;
+}
+
+void supernode::ViewKeyScanner::RemoveAccount(const std::string& addr) {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+
+	auto it = m_Accounts.find(addr);
+	if( it==m_Accounts.end() ) return;
+
+	m_LRU.erase(it->second.LRU);
+	m_Accounts.erase(it);
+}
+
+bool supernode::ViewKeyScanner::HasAccount(const std::string& addr) const {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+	return m_Accounts.find(addr)!=m_Accounts.end();
+}
+
+uint64_t supernode::ViewKeyScanner::NextHeight() const {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+
+	uint64_t ret = UINT64_MAX;
+	for(const auto& acc : m_Accounts) ret = std::min(ret, acc.second.NextHeight);
+
+	return ret;
+}
+
+void supernode::ViewKeyScanner::ScanBlock(uint64_t height, const cryptonote::block& b, const std::vector<cryptonote::transaction>& txs) {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+
+	// tx public keys are the same for all accounts, parse them once per block
+	std::vector<crypto::public_key> txPubKeys;
+	txPubKeys.reserve(txs.size() + 1);
+	txPubKeys.push_back( cryptonote::get_tx_pub_key_from_extra(b.miner_tx) );
+	for(const auto& tx : txs) txPubKeys.push_back( cryptonote::get_tx_pub_key_from_extra(tx) );
+
+	for(auto& it : m_Accounts) {
+		SAccount& acc = it.second;
+		if( acc.NextHeight!=height ) continue;
+
+		scanTx(acc, height, b.miner_tx, txPubKeys[0]);
+		for(size_t i=0;i<txs.size();i++) scanTx(acc, height, txs[i], txPubKeys[i + 1]);
+
+		acc.NextHeight = height + 1;
+	}
+}
+
+void supernode::ViewKeyScanner::scanTx(SAccount& acc, uint64_t height, const cryptonote::transaction& tx, const crypto::public_key& txPubKey) {
+	if( txPubKey==crypto::null_pkey ) return;
+
+	crypto::key_derivation derivation;
+	if( !crypto::generate_key_derivation(txPubKey, acc.ViewKey, derivation) ) return;
+
+	for(size_t i=0;i<tx.vout.size();i++) {
+		const cryptonote::tx_out& out = tx.vout[i];
+		if( out.target.type()!=typeid(cryptonote::txout_to_key) ) continue;
+
+		crypto::public_key outKey;
+		if( !crypto::derive_public_key(derivation, i, acc.Address.m_spend_public_key, outKey) ) continue;
+		if( outKey!=boost::get<cryptonote::txout_to_key>(out.target).key ) continue;
+
+		uint64_t amount = out.amount;
+		if( tx.rct_signatures.type!=rct::RCTTypeNull && !cryptonote::is_coinbase(tx) ) {
+			crypto::secret_key scalar;
+			crypto::derivation_to_scalar(derivation, i, scalar);
+			try {
+				hw::device& hwdev = hw::get_device("default");
+				if( tx.rct_signatures.type==rct::RCTTypeFull ) amount = rct::decodeRct(tx.rct_signatures, rct::sk2rct(scalar), i, hwdev);
+				else amount = rct::decodeRctSimple(tx.rct_signatures, rct::sk2rct(scalar), i, hwdev);
+			} catch(const std::exception& e) {
+				LOG_ERROR("Failed to decode output amount: " << e.what());
+				continue;
+			}
+		}
+
+		uint64_t unlockHeight = height + ( cryptonote::is_coinbase(tx) ? CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW : CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE );
+		if( tx.unlock_time<CRYPTONOTE_MAX_BLOCK_NUMBER ) unlockHeight = std::max<uint64_t>(unlockHeight, tx.unlock_time);
+
+		acc.Outputs.push_back( SOutput{unlockHeight, amount} );
+	}
+}
+
+bool supernode::ViewKeyScanner::GetBalance(const std::string& addr, uint64_t blockNum, uint64_t& balance) {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+
+	auto it = m_Accounts.find(addr);
+	if( it==m_Accounts.end() ) return false;
+
+	SAccount& acc = it->second;
+	touch(acc);
+	if( acc.NextHeight<blockNum ) return false;
+
+	balance = 0;
+	for(const auto& out : acc.Outputs) if( out.UnlockHeight<=blockNum ) balance += out.Amount;
+
+	return true;
+}
+
+unsigned supernode::ViewKeyScanner::AccountsCount() const {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+	return m_Accounts.size();
+}
+
+void supernode::ViewKeyScanner::touch(SAccount& acc) {
+	m_LRU.splice(m_LRU.begin(), m_LRU, acc.LRU);
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2017, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef VIEWKEYSCANNER_H_
+#define VIEWKEYSCANNER_H_
+
+#include "supernode_common_struct.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace supernode {
+
+// incoming outputs of view-only accounts, found with one pass over each block for all accounts;
+// replaces per-FSN view-only wallets. least recently used accounts are dropped when the limit is reached
+class ViewKeyScanner {
+public:
+	static const unsigned DefaultMaxAccounts = 1024;
+
+public:
+	ViewKeyScanner(cryptonote::network_type nettype, unsigned maxAccounts = DefaultMaxAccounts);
+
+	// false if address or view key can't be parsed; new accounts are scanned from the genesis block
+	bool AddAccount(const FSN_WalletData& wallet);
+	void RemoveAccount(const std::string& addr);
+	bool HasAccount(const std::string& addr) const;
+
+	// lowest height which has to be scanned next, to bring all accounts up to date
+	uint64_t NextHeight() const;
+
+	// checks the block for accounts which have been scanned up to this height
+	void ScanBlock(uint64_t height, const cryptonote::block& b, const std::vector<cryptonote::transaction>& txs);
+
+	// sum of outputs unlocked at blockNum; false if account isn't tracked or hasn't been scanned up to blockNum
+	bool GetBalance(const std::string& addr, uint64_t blockNum, uint64_t& balance);
+
+	unsigned AccountsCount() const;
+
+protected:
+	struct SOutput {
+		uint64_t UnlockHeight;
+		uint64_t Amount;
+	};
+
+	struct SAccount {
+		cryptonote::account_public_address Address;
+		crypto::secret_key ViewKey;
+		uint64_t NextHeight = 0;
+		std::vector<SOutput> Outputs;
+		std::list<std::string>::iterator LRU;
+	};
+
+	void scanTx(SAccount& acc, uint64_t height, const cryptonote::transaction& tx, const crypto::public_key& txPubKey);
+	void touch(SAccount& acc);
+
+protected:
+	cryptonote::network_type m_Nettype;
+	unsigned m_MaxAccounts;
+	mutable boost::mutex m_Guard;
+	std::unordered_map<std::string, SAccount> m_Accounts;
+	std::list<std::string> m_LRU;// most recently used first
+
+};
+
+}
+
+#endif /* VIEWKEYSCANNER_H_ */
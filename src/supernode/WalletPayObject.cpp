@@ -52,14 +52,14 @@ bool supernode::WalletPayObject::OpenSenderWallet(const string &wallet, const st
 }
 
 void supernode::WalletPayObject::BeforStart() {
-    m_Status = NTransactionStatus::InProgress;
+    SetStatus(NTransactionStatus::InProgress);
     ADD_RTA_OBJECT_HANDLER(GetPayStatus, rpc_command::WALLET_GET_TRANSACTION_STATUS, WalletPayObject);
 }
 
 
 bool supernode::WalletPayObject::Init(const rpc_command::WALLET_PAY::request& src) {
     bool ret = _Init(src);
-    m_Status = ret ? NTransactionStatus::Success : NTransactionStatus::Fail;
+    SetStatus(ret ? NTransactionStatus::Success : NTransactionStatus::Fail);
     return ret;
 }
 
@@ -124,7 +124,7 @@ bool supernode::WalletPayObject::_Init(const rpc_command::WALLET_PAY::request& s
 
 bool supernode::WalletPayObject::GetPayStatus(const rpc_command::WALLET_GET_TRANSACTION_STATUS::request& in, rpc_command::WALLET_GET_TRANSACTION_STATUS::response& out) {
     LOG_PRINT_L0("WalletPayObject::GetPayStatus" << in.PaymentID);
-    out.Status = int(m_Status);
+    out.Status = int(WaitStatus(in.KnownStatus, in.WaitMillis));
     //TimeMark -= boost::posix_time::hours(3);
     out.Result = STATUS_OK;
     return true;
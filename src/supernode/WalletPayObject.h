@@ -66,7 +66,6 @@ protected:
     bool _Init(const rpc_command::WALLET_PAY::request& src);
 
 protected:
-    NTransactionStatus m_Status = NTransactionStatus::None;
     WalletProxy* m_Owner = nullptr;
     vector<string> m_Signs;
     string m_TransactionPoolID;
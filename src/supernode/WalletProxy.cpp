@@ -42,6 +42,7 @@ bool supernode::WalletProxy::WalletRejectPay(const rpc_command::WALLET_REJECT_PA
 	// TODO: if have PayID, don't call
     LOG_PRINT_L0("WalletProxy::WalletRejectPay" << in.PaymentID);
 	SubNetBroadcast sub;
+	sub.Lane = WorkerPool::ELane::RTA;
 	sub.Set( m_DAPIServer, in.PaymentID, m_Servant->GetAuthSample(in.BlockNum) );
 	vector<rpc_command::WALLET_REJECT_PAY::response> vout;
 	bool ret = sub.Send( dapi_call::WalletProxyRejectPay, in, vout );
@@ -52,18 +53,23 @@ bool supernode::WalletProxy::WalletRejectPay(const rpc_command::WALLET_REJECT_PA
 
 bool supernode::WalletProxy::Pay(const rpc_command::WALLET_PAY::request& in, rpc_command::WALLET_PAY::response& out) {
 	LOG_PRINT_L0("WalletProxy::Pay" << in.POSAddress << in.Amount);
-	boost::shared_ptr<WalletPayObject> data = boost::shared_ptr<WalletPayObject>( new WalletPayObject() );
+	boost::shared_ptr<WalletPayObject> data = boost::make_shared<WalletPayObject>();
 	data->Owner(this);
 	Setup(data);
 	data->BeforStart();
 	Add(data);
 
-	m_Work.Service.post( [data, in](){
+	bool posted = m_Work.Post( WorkerPool::ELane::RTA, [data, in](){
 	    if (!data->Init(in)) {
 	        LOG_ERROR("Failed to init WalletPayObject");
 	        return;
 	    }
 	} );
+	if(!posted) {
+		Remove(data);
+		LOG_ERROR("WalletProxy is overloaded, pay rejected");
+		return false;
+	}
 
     return true;
 }
@@ -76,7 +82,5 @@ bool supernode::WalletProxy::WalletGetPosData(const rpc_command::WALLET_GET_POS_
 
 	boost::shared_ptr<FSN_Data> data = *vv.begin();
 
-	DAPI_RPC_Client call;
-	call.Set(data->IP, data->Port);
-	return call.Invoke(dapi_call::WalletProxyGetPosData, in, out);
+	return DAPI_RPC_ClientPool::Instance().Invoke(data->IP, data->Port, dapi_call::WalletProxyGetPosData, in, out);
 }
@@ -47,6 +47,9 @@ namespace supernode {
 
         protected:
         void Init() override;
+
+        public:
+        size_t QueueDepth() const override { return m_Work.Stats(WorkerPool::ELane::RTA).Depth; }
         friend class ::WalletProxyTest_SendTx_Test;
 
         protected:
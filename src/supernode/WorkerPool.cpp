@@ -6,22 +6,129 @@
  */
 
 #include <supernode/WorkerPool.h>
+#include "misc_log_ex.h"
 
 namespace supernode {
 
-WorkerPool::WorkerPool() : Work(Service) {
+WorkerPool::WorkerPool() {
+	Lane(ELane::RTA).Stats.MaxQueue = 1024;
+}
+
+WorkerPool::~WorkerPool() {
+	Stop();
 }
 
 
-void WorkerPool::Workers(int cnt) {
-	for(int i=0;i<cnt;i++) {
-		Threadpool.create_thread( boost::bind(&boost::asio::io_service::run, &Service) );
+void WorkerPool::Workers(unsigned cnt, bool dedicatedRTA) {
+	if(cnt==0) cnt = std::max(1u, boost::thread::hardware_concurrency());
+
+	for(unsigned i=0;i<cnt;i++) {
+		m_Threadpool.create_thread( boost::bind(&WorkerPool::Run, this, false) );
 	}
+	if(dedicatedRTA) m_Threadpool.create_thread( boost::bind(&WorkerPool::Run, this, true) );
 }
 
 void WorkerPool::Stop() {
-	Service.stop();
-	Threadpool.join_all();
+	{
+		boost::lock_guard<boost::mutex> lock(m_Guard);
+		m_Stop = true;
+		// pending tasks are dropped, as io_service::stop did
+		for(auto& a : m_Lanes) a.Queue.clear();
+	}
+	m_Cond.notify_all();
+	m_Threadpool.join_all();
+}
+
+bool WorkerPool::Post(ELane lane, boost::function<void()> task) {
+	{
+		boost::lock_guard<boost::mutex> lock(m_Guard);
+		SLane& ll = Lane(lane);
+		ll.Stats.Posted++;
+
+		bool shed = m_Stop;
+		shed = shed || ( ll.Stats.MaxQueue && ll.Queue.size()>=ll.Stats.MaxQueue );
+		shed = shed || ( lane==ELane::Maintenance && RTABackPressure && Lane(ELane::RTA).Queue.size()>=RTABackPressure );
+
+		if(shed) {
+			ll.Stats.Shed++;
+			if( ll.Stats.Shed%100==1 ) LOG_PRINT_L0("WorkerPool: "<<ll.Stats.Shed<<" task(s) shed in lane "<<static_cast<int>(lane));
+			return false;
+		}
+
+		ll.Queue.push_back( STask{ std::move(task), boost::chrono::steady_clock::now() } );
+	}
+
+	// dedicated RTA worker may be one of waiters, so wake everyone for RTA tasks
+	if(lane==ELane::RTA) m_Cond.notify_all();
+	else m_Cond.notify_one();
+	return true;
+}
+
+void WorkerPool::SetMaxQueue(ELane lane, size_t maxQueue) {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+	Lane(lane).Stats.MaxQueue = maxQueue;
+}
+
+WorkerPool::SLaneStats WorkerPool::Stats(ELane lane) const {
+	boost::lock_guard<boost::mutex> lock(m_Guard);
+	SLaneStats ret = Lane(lane).Stats;
+	ret.Depth = Lane(lane).Queue.size();
+	return ret;
+}
+
+bool WorkerPool::HasTask(bool rtaOnly) const {
+	if(rtaOnly) return !Lane(ELane::RTA).Queue.empty();
+	for(auto& a : m_Lanes) if( !a.Queue.empty() ) return true;
+	return false;
+}
+
+WorkerPool::ELane WorkerPool::NextLane(bool rtaOnly) {
+	if(rtaOnly) return ELane::RTA;
+
+	const size_t count = static_cast<size_t>(ELane::Count);
+	size_t top = 0;
+	while( m_Lanes[top].Queue.empty() ) top++;
+
+	size_t lower = top+1;
+	while( lower<count && m_Lanes[lower].Queue.empty() ) lower++;
+
+	if(lower==count) {
+		m_Burst = 0;
+		return static_cast<ELane>(top);
+	}
+
+	if( m_Burst>=MaxPriorityBurst ) {
+		m_Burst = 0;
+		return static_cast<ELane>(lower);
+	}
+
+	m_Burst++;
+	return static_cast<ELane>(top);
+}
+
+void WorkerPool::Run(bool rtaOnly) {
+	for(;;) {
+		STask task;
+		{
+			boost::unique_lock<boost::mutex> lock(m_Guard);
+			m_Cond.wait(lock, [this, rtaOnly]() { return m_Stop || HasTask(rtaOnly); });
+			if(m_Stop) return;
+
+			SLane& ll = Lane( NextLane(rtaOnly) );
+			task = std::move( ll.Queue.front() );
+			ll.Queue.pop_front();
+
+			uint64_t wait = boost::chrono::duration_cast<boost::chrono::milliseconds>(boost::chrono::steady_clock::now() - task.PostTime).count();
+			ll.Stats.Started++;
+			ll.Stats.MaxWaitMillis = std::max(ll.Stats.MaxWaitMillis, wait);
+		}
+
+		try {
+			task.Func();
+		} catch(const std::exception& e) {
+			LOG_ERROR("WorkerPool: exception in task: "<<e.what());
+		}
+	}
 }
 
 } /* namespace supernode */
@@ -30,28 +30,77 @@
 #ifndef WORKERPOOL_H_
 #define WORKERPOOL_H_
 
-#include <boost/asio/io_service.hpp>
+#include <boost/function.hpp>
 #include <boost/bind.hpp>
+#include <boost/chrono.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <algorithm>
+#include <deque>
 
 
 namespace supernode {
 
+// worker threads with prioritized task lanes: RTA tasks first, then broadcasts, then maintenance
 class WorkerPool {
+public:
+	enum class ELane { RTA = 0, Broadcast, Maintenance, Count };
+
+	struct SLaneStats {
+		size_t Depth = 0;
+		size_t MaxQueue = 0;// 0 - unlimited
+		uint64_t Posted = 0;
+		uint64_t Started = 0;
+		uint64_t Shed = 0;
+		uint64_t MaxWaitMillis = 0;
+	};
+
 public:
 	WorkerPool();
-	void Workers(int cnt);
+	virtual ~WorkerPool();
+	// cnt==0 - one worker per cpu; dedicatedRTA adds one more thread serving RTA lane only
+	void Workers(unsigned cnt, bool dedicatedRTA=false);
 	void Stop();
 
-public:
-    boost::asio::io_service Service;
-    boost::thread_group Threadpool;
-    boost::asio::io_service::work Work;
+	// returns false if task was shed: lane is full, or it's maintenance and RTA lane is backed up
+	bool Post(ELane lane, boost::function<void()> task);
 
-};
+	void SetMaxQueue(ELane lane, size_t maxQueue);
+	SLaneStats Stats(ELane lane) const;
 
-}
+	// maintenance tasks are shed while RTA lane has this many waiting tasks, 0 - never
+	size_t RTABackPressure = 64;
+	// after so many higher lane tasks in a row one lower lane task is taken, so it won't starve
+	unsigned MaxPriorityBurst = 8;
 
-#endif
+protected:
+	struct STask {
+		boost::function<void()> Func;
+		boost::chrono::steady_clock::time_point PostTime;
+	};
 
+	struct SLane {
+		std::deque<STask> Queue;
+		SLaneStats Stats;
+	};
+
+	void Run(bool rtaOnly);
+	bool HasTask(bool rtaOnly) const;
+	ELane NextLane(bool rtaOnly);
+	SLane& Lane(ELane lane) { return m_Lanes[static_cast<size_t>(lane)]; }
+	const SLane& Lane(ELane lane) const { return m_Lanes[static_cast<size_t>(lane)]; }
+
+protected:
+	mutable boost::mutex m_Guard;
+	boost::condition_variable m_Cond;
+	SLane m_Lanes[static_cast<size_t>(ELane::Count)];
+	unsigned m_Burst = 0;
+	bool m_Stop = false;
+	boost::thread_group m_Threadpool;
+
+};
+
+}
 
+#endif /* WORKERPOOL_H_ */
@@ -1,33 +1,77 @@
 #include "healthcheckapi.h"
+#include "FSN_ServantBase.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "storages/http_abstract_invoke.h"
 #include "net/jsonrpc_structs.h"
 #include "net/net_utils_base.h"
+#include <atomic>
+#include <ctime>
 
 static const std::string HEALTH_URI("/health");
+static const unsigned s_RefreshIntervalMs = 5000;
 
 struct HealthResponse {
     std::string NodeAccess;
+    uint64_t DaemonHeight = 0;
+    uint64_t DaemonTargetHeight = 0;
+    uint64_t HeightLag = 0;
+    uint64_t PeerCount = 0;
+    bool StakeValid = false;
+    uint64_t QueueDepth = 0;
+    uint64_t UpdatedAt = 0;
 
     BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(NodeAccess)
+        KV_SERIALIZE(DaemonHeight)
+        KV_SERIALIZE(DaemonTargetHeight)
+        KV_SERIALIZE(HeightLag)
+        KV_SERIALIZE(PeerCount)
+        KV_SERIALIZE(StakeValid)
+        KV_SERIALIZE(QueueDepth)
+        KV_SERIALIZE(UpdatedAt)
     END_KV_SERIALIZE_MAP()
 
 };
 
-supernode::HealthcheckAPI::HealthcheckAPI(const std::string &daemonAddress)
+supernode::HealthcheckAPI::HealthcheckAPI(const std::string &daemonAddress, const FSN_ServantBase *servant)
+    : m_servant(servant)
+    , m_stop(false)
 {
     boost::optional<epee::net_utils::http::login> login{};
     m_http_client.set_server("http://" + daemonAddress, login);
+
+    HealthResponse response;
+    response.NodeAccess = "Fail";
+    auto snapshot = std::make_shared<std::string>();
+    epee::serialization::store_t_to_json(response, *snapshot);
+    m_snapshot = snapshot;
+
+    m_thread = boost::thread([this]() { run(); });
+}
+
+supernode::HealthcheckAPI::~HealthcheckAPI()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_stopGuard);
+        m_stop = true;
+    }
+    m_stopCond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
 }
 
-bool supernode::HealthcheckAPI::processHealthchecks(const std::string uri, epee::net_utils::http::http_response_info &response_info)
+void supernode::HealthcheckAPI::AddQueueDepthSource(boost::function<size_t ()> source)
+{
+    boost::lock_guard<boost::mutex> lock(m_sourcesGuard);
+    m_queueDepthSources.push_back(source);
+}
+
+bool supernode::HealthcheckAPI::processHealthchecks(const std::string &uri, epee::net_utils::http::http_response_info &response_info) const
 {
     if (uri == HEALTH_URI)
     {
-        HealthResponse response;
-        response.NodeAccess = cryptonodeCheck() ? "OK" : "Fail";
-        epee::serialization::store_t_to_json(response, response_info.m_body);
+        std::shared_ptr<const std::string> snapshot = std::atomic_load(&m_snapshot);
+        response_info.m_body = *snapshot;
         response_info.m_header_info.m_content_type = " application/json";
         response_info.m_mime_tipe = "application/json";
         response_info.m_response_comment = "OK";
@@ -37,17 +81,61 @@ bool supernode::HealthcheckAPI::processHealthchecks(const std::string uri, epee:
     return false;
 }
 
-bool supernode::HealthcheckAPI::cryptonodeCheck()
+void supernode::HealthcheckAPI::run()
 {
-    epee::json_rpc::request<cryptonote::COMMAND_RPC_GET_VERSION::request> req_t = AUTO_VAL_INIT(req_t);
-    epee::json_rpc::response<cryptonote::COMMAND_RPC_GET_VERSION::response, std::string> resp_t = AUTO_VAL_INIT(resp_t);
-    req_t.jsonrpc = "2.0";
-    req_t.id = epee::serialization::storage_entry(0);
-    req_t.method = "get_version";
-    bool r = epee::net_utils::invoke_http_json("/json_rpc", req_t, resp_t, m_http_client);
-    if (r && resp_t.result.status == CORE_RPC_STATUS_OK)
+    for (;;)
     {
-        return true;
+        refresh();
+
+        boost::unique_lock<boost::mutex> lock(m_stopGuard);
+        m_stopCond.wait_for(lock, boost::chrono::milliseconds(s_RefreshIntervalMs), [this]() { return m_stop; });
+        if (m_stop)
+            return;
     }
-    return false;
+}
+
+void supernode::HealthcheckAPI::refresh()
+{
+    HealthResponse response;
+
+    cryptonote::COMMAND_RPC_GET_INFO::request req = AUTO_VAL_INIT(req);
+    cryptonote::COMMAND_RPC_GET_INFO::response resp = AUTO_VAL_INIT(resp);
+    bool r = epee::net_utils::invoke_http_json("/getinfo", req, resp, m_http_client);
+    if (r && resp.status == CORE_RPC_STATUS_OK)
+    {
+        response.NodeAccess = "OK";
+        response.DaemonHeight = resp.height;
+        response.DaemonTargetHeight = resp.target_height;
+        response.HeightLag = resp.target_height > resp.height ? resp.target_height - resp.height : 0;
+        response.PeerCount = resp.outgoing_connections_count + resp.incoming_connections_count;
+    }
+    else
+    {
+        response.NodeAccess = "Fail";
+    }
+
+    if (m_servant)
+    {
+        try
+        {
+            // the stake is valid while the supernode stays in the audited FSN list
+            response.StakeValid = m_servant->FSN_DataByStakeAddr(m_servant->GetMyStakeWallet().Addr) != nullptr;
+        }
+        catch (const std::exception &)
+        {
+            // no stake wallet in wallet proxy mode
+        }
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_sourcesGuard);
+        for (const auto &source : m_queueDepthSources)
+            response.QueueDepth += source();
+    }
+
+    response.UpdatedAt = static_cast<uint64_t>(std::time(nullptr));
+
+    auto snapshot = std::make_shared<std::string>();
+    epee::serialization::store_t_to_json(response, *snapshot);
+    std::atomic_store(&m_snapshot, std::shared_ptr<const std::string>(std::move(snapshot)));
 }
@@ -3,22 +3,54 @@
 
 #include "net/http_client.h"
 #include "net/http_base.h"
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace supernode
 {
 
+class FSN_ServantBase;
+
+/*!
+ * \brief HealthcheckAPI - serves health status of the supernode; the status is refreshed
+ *                         by a background thread and requests are answered from memory
+ */
 class HealthcheckAPI
 {
 public:
-    HealthcheckAPI(const std::string &daemonAddress);
+    HealthcheckAPI(const std::string &daemonAddress, const FSN_ServantBase *servant = nullptr);
+    ~HealthcheckAPI();
+
+    /*!
+     * \brief AddQueueDepthSource - adds a function returning count of tasks waiting in some queue,
+     *                              the reported depth is a sum of all sources
+     */
+    void AddQueueDepthSource(boost::function<size_t ()> source);
 
-    bool processHealthchecks(const std::string uri, epee::net_utils::http::http_response_info& response_info);
+    bool processHealthchecks(const std::string &uri, epee::net_utils::http::http_response_info& response_info) const;
 
 private:
-    bool cryptonodeCheck();
+    void run();
+    void refresh();
 
     epee::net_utils::http::http_simple_client m_http_client;
+    const FSN_ServantBase *m_servant;
+
+    mutable boost::mutex m_sourcesGuard;
+    std::vector<boost::function<size_t ()>> m_queueDepthSources;
+
+    // serialized response, replaced atomically on refresh
+    std::shared_ptr<const std::string> m_snapshot;
+
+    boost::mutex m_stopGuard;
+    boost::condition_variable m_stopCond;
+    bool m_stop;
+    boost::thread m_thread;
 };
 
 }
@@ -69,6 +69,8 @@ int main(int argc, const char** argv) {
         const boost::property_tree::ptree& gen_conf = config.get_child("service");
         LOG_PRINT_L0("Log level changed to: " << gen_conf.get<int>("log_level", 0));
         mlog_set_log_level(gen_conf.get<int>("log_level", 0));
+        if (gen_conf.get<bool>("log_async", false))
+            mlog_start_async();
     }
     else
     {
@@ -92,10 +94,17 @@ int main(int argc, const char** argv) {
 	const boost::property_tree::ptree& dapi_conf = config.get_child("dapi");
 	supernode::rpc_command::SetDAPIVersion( dapi_conf.get<string>("version") );
 	supernode::DAPI_RPC_Server dapi_server;
-	dapi_server.Set( dapi_conf.get<string>("ip"), dapi_conf.get<string>("port"), dapi_conf.get<int>("threads") );
+	dapi_server.Set( dapi_conf.get<string>("ip"), dapi_conf.get<string>("port"), dapi_conf.get<int>("threads"), dapi_conf.get<int>("acceptor_per_thread", 0)==1 );
 
 	supernode::rpc_command::SetWalletProxyOnly( dapi_conf.get<int>("wallet_proxy_only", 0)==1 );
 
+	// instances behind the same load balancer, "ip:port,ip:port..."; cluster_self is the address of this one as others see it
+	const string cluster = dapi_conf.get<string>("cluster", "");
+	if( !cluster.empty() ) {
+		const string self = dapi_conf.get<string>("cluster_self", dapi_conf.get<string>("ip")+string(":")+dapi_conf.get<string>("port"));
+		dapi_server.Router().Set( supernode::helpers::StrTok(cluster, ","), self );
+	}
+
 	supernode::FSN_Servant* servant = nullptr;
 
 	// -------------------------------- Servant -----------------------------------------
@@ -152,6 +161,8 @@ int main(int argc, const char** argv) {
 	for(unsigned i=0;i<objs.size();i++) {
 		objs[i]->Set(servant, &dapi_server);
 		objs[i]->Start();
+		supernode::BaseRTAProcessor* obj = objs[i];
+		dapi_server.Healthcheck()->AddQueueDepthSource([obj]() { return obj->QueueDepth(); });
 	}
 
 
@@ -164,6 +175,8 @@ int main(int argc, const char** argv) {
 
 	//broadcast.Stop();// because handlers not deleted, so stop first, then delete objects
 
+	dapi_server.setServant(nullptr);// stops healthcheck refresh which reads the objects
+
 	for(unsigned i=0;i<objs.size();i++) {
 		objs[i]->Stop();
 		delete objs[i];
@@ -171,5 +184,6 @@ int main(int argc, const char** argv) {
 
 	if(servant) delete servant;
 
+    mlog_stop_async();
     return 0;
 }
@@ -33,6 +33,7 @@
 const string supernode::rpc_command::DAPI_URI = "/dapi";
 const string supernode::rpc_command::DAPI_METHOD = "POST";
 const string supernode::rpc_command::DAPI_PROTOCOL = "http";
+const string supernode::rpc_command::DAPI_FORWARDED_HEADER = "X-Graft-Forwarded";
 const string supernode::rpc_command::DAPI_VERSION = "http";
 
 void supernode::rpc_command::SetDAPIVersion(const string& v) {
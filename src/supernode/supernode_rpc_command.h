@@ -84,7 +84,9 @@ namespace supernode {
 		extern const string DAPI_URI;//  /dapi
         extern const string DAPI_METHOD;//  POST
 		extern const string DAPI_PROTOCOL;//  http for now
+		extern const string DAPI_FORWARDED_HEADER;// set on requests forwarded to the payment owner instance
 		extern const string DAPI_VERSION;
+		const unsigned DAPI_MAX_STATUS_WAIT_MILLIS = 30000;// upper bound of WaitMillis in status requests
 
 		bool IsWalletProxyOnly();
 		void SetWalletProxyOnly(bool b);
@@ -220,11 +222,16 @@ namespace supernode {
 
 		// ---------------------------------------
 		struct WALLET_GET_TRANSACTION_STATUS {
+			// long poll: with WaitMillis>0 the response is delayed until status differs from KnownStatus
 			struct request : public SubNetData {
 				BEGIN_KV_SERIALIZE_MAP()
 					KV_SERIALIZE(PaymentID)
+					KV_SERIALIZE_OPT(KnownStatus, -1)
+					KV_SERIALIZE_OPT(WaitMillis, (uint32_t)0)
 				END_KV_SERIALIZE_MAP()
 
+				int KnownStatus = -1;
+				uint32_t WaitMillis = 0;
 			};
 			struct response {
                 int64_t Result;
@@ -328,10 +335,16 @@ namespace supernode {
 
         // ---------------------------------------
 		struct POS_GET_SALE_STATUS {
+			// long poll: with WaitMillis>0 the response is delayed until status differs from KnownStatus
 			struct request : public SubNetData {
 				BEGIN_KV_SERIALIZE_MAP()
 					KV_SERIALIZE(PaymentID)
+					KV_SERIALIZE_OPT(KnownStatus, -1)
+					KV_SERIALIZE_OPT(WaitMillis, (uint32_t)0)
 				END_KV_SERIALIZE_MAP()
+
+				int KnownStatus = -1;
+				uint32_t WaitMillis = 0;
 			};
 			struct response {
                 int64_t Result;
@@ -27,9 +27,11 @@
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <algorithm>
+#include <cstring>
+#include <tuple>
 #include <boost/endian/conversion.hpp>
 #include "cryptmsg.h"
-#include "crypto/chacha.h"
 
 namespace {
 
@@ -48,24 +50,49 @@ inline size_t getEncryptChachaSize(size_t plainSize)
     return plainSize + sizeof(crypto::chacha_iv);
 }
 
-void encryptChacha(const uint8_t* plain, size_t plain_size, const crypto::secret_key &skey, uint8_t* cipher)
+void getChachaKey(const crypto::secret_key &skey, crypto::chacha_key &key)
 {
-  crypto::chacha_key key;
   crypto::generate_chacha_key(&skey, sizeof(skey), key, 1);
+}
+
+void encryptChacha(const uint8_t* plain, size_t plain_size, const crypto::chacha_key &key, uint8_t* cipher)
+{
   crypto::chacha_iv& iv = *reinterpret_cast<crypto::chacha_iv*>(cipher);
   iv = crypto::rand<crypto::chacha_iv>();
   crypto::chacha8(plain, plain_size, key, iv, reinterpret_cast<char*>(cipher) + sizeof(iv));
 }
 
-void decryptChacha(const uint8_t* cipher, size_t cipher_size, const crypto::secret_key &skey, uint8_t* plain)
+void encryptChacha(const uint8_t* plain, size_t plain_size, const crypto::secret_key &skey, uint8_t* cipher)
 {
-  const size_t prefix_size = sizeof(crypto::chacha_iv);
   crypto::chacha_key key;
-  crypto::generate_chacha_key(&skey, sizeof(skey), key, 1);
+  getChachaKey(skey, key);
+  encryptChacha(plain, plain_size, key, cipher);
+}
+
+void decryptChacha(const uint8_t* cipher, size_t cipher_size, const crypto::chacha_key &key, uint8_t* plain)
+{
+  const size_t prefix_size = sizeof(crypto::chacha_iv);
   const crypto::chacha_iv &iv = *reinterpret_cast<const crypto::chacha_iv*>(cipher);
   crypto::chacha8(reinterpret_cast<const char*>(cipher) + sizeof(iv), cipher_size - prefix_size, key, iv, reinterpret_cast<char*>(plain));
 }
 
+void decryptChacha(const uint8_t* cipher, size_t cipher_size, const crypto::secret_key &skey, uint8_t* plain)
+{
+  crypto::chacha_key key;
+  getChachaKey(skey, key);
+  decryptChacha(cipher, cipher_size, key, plain);
+}
+
+//chacha key of rB which is used to encrypt SessionX for the recipient B
+void getRecipientKey(const crypto::public_key& B, const crypto::secret_key& r, crypto::chacha_key& key)
+{
+    crypto::key_derivation rBv;
+    crypto::generate_key_derivation(B, r, rBv);
+    crypto::secret_key rB;
+    crypto::derivation_to_scalar(rBv, 0, rB);
+    getChachaKey(rB, key);
+}
+
 constexpr uint8_t cStart = 0xA5;
 constexpr uint8_t cEnd = 0x5A;
 
@@ -109,6 +136,35 @@ uint32_t getBhash(const crypto::public_key& B)
     return native_to_little(res);
 }
 
+//XEntries are sorted by Bhash in native order, so the recipient can use binary search
+inline uint32_t entryOrder(const XEntry& xe)
+{
+    return little_to_native(xe.Bhash);
+}
+
+bool entryLess(const XEntry& l, const XEntry& r)
+{
+    return entryOrder(l) < entryOrder(r);
+}
+
+inline size_t getMsgHeadSize(size_t BkeysCount)
+{
+    return sizeof(CryptoMessageHead) + (BkeysCount - 1) * sizeof(XEntry);
+}
+
+//makes decorated session key and encrypts input with it
+void encryptPayload(size_t inputSize, const uint8_t* input, SessionX& X, uint8_t* output)
+{
+    X.cstart = cStart; X.cend = cEnd;
+    //generate session key X.x
+    {
+        crypto::public_key tmpX;
+        crypto::generate_keys(tmpX,X.x);
+    }
+    //chacha encrypt input with x
+    encryptChacha(input, inputSize, X.x, output);
+}
+
 /*!
  * \brief encryptMsg - encrypts data for recipients using their B public keys (assumed public view keys).
  *
@@ -135,22 +191,15 @@ size_t encryptMsg(size_t inputSize, const uint8_t* input, size_t BkeysCount, con
         return 0;
 
     //prepare
-    size_t msgHeadSize = sizeof(CryptoMessageHead) + (BkeysCount - 1) * sizeof(XEntry);
+    size_t msgHeadSize = getMsgHeadSize(BkeysCount);
     size_t msgSize = msgHeadSize + getEncryptChachaSize(inputSize);
     if(outputSize < msgSize)
         return msgSize;
     if(!input || !Bkeys || !output)
         return 0;
 
-    //make decorated session key
-    SessionX X; X.cstart = cStart; X.cend = cEnd;
-    //generate session key X.x
-    {
-        crypto::public_key tmpX;
-        crypto::generate_keys(tmpX,X.x);
-    }
-    //chacha encrypt input with x
-    encryptChacha(input, inputSize, X.x, output + msgHeadSize);
+    SessionX X;
+    encryptPayload(inputSize, input, X, output + msgHeadSize);
 
     //fill head
     CryptoMessageHead& head = *reinterpret_cast<CryptoMessageHead*>(output);
@@ -167,13 +216,12 @@ size_t encryptMsg(size_t inputSize, const uint8_t* input, size_t BkeysCount, con
         XEntry& xe = *pxe;
         xe.Bhash = getBhash(B);
         //get rB key
-        crypto::key_derivation rBv;
-        crypto::generate_key_derivation(B, r, rBv);
-        crypto::secret_key rB;
-        crypto::derivation_to_scalar(rBv, 0, rB);
+        crypto::chacha_key rBkey;
+        getRecipientKey(B, r, rBkey);
         //encrypt X with rB key
-        encryptChacha(reinterpret_cast<const uint8_t*>(&X), sizeof(X), rB, xe.cipherX);
+        encryptChacha(reinterpret_cast<const uint8_t*>(&X), sizeof(X), rBkey, xe.cipherX);
     }
+    std::sort(head.xentries, head.xentries + BkeysCount, entryLess);
     return msgSize;
 }
 
@@ -215,20 +263,33 @@ size_t decryptMsg(size_t inputSize, const uint8_t* input, const crypto::secret_k
         if(!res) return false; //corrupted key
         Bhash = getBhash(B);
     }
-    //find XEntry for B
-    const XEntry* pxe = head.xentries;
-    for(size_t i=0; i<head_count; ++i, ++pxe)
+    //find XEntry for B, messages of older versions can have unsorted XEntries
+    const XEntry* first = head.xentries;
+    const XEntry* last = head.xentries + head_count;
+    if(std::is_sorted(first, last, entryLess))
+    {
+        XEntry key; key.Bhash = Bhash;
+        std::tie(first, last) = std::equal_range(first, last, key, entryLess);
+    }
+    bool derived = false;
+    crypto::chacha_key bRkey;
+    for(const XEntry* pxe = first; pxe != last; ++pxe)
     {
         const XEntry& xe = *pxe;
         if(xe.Bhash != Bhash) continue;
         //get bR key
-        crypto::key_derivation bRv;
-        crypto::generate_key_derivation(head.R, b, bRv);
-        crypto::secret_key bR;
-        crypto::derivation_to_scalar(bRv, 0, bR);
+        if(!derived)
+        {
+            crypto::key_derivation bRv;
+            crypto::generate_key_derivation(head.R, b, bRv);
+            crypto::secret_key bR;
+            crypto::derivation_to_scalar(bRv, 0, bR);
+            getChachaKey(bR, bRkey);
+            derived = true;
+        }
         //decrypt to X
         SessionX X;
-        decryptChacha(xe.cipherX, sizeof(xe.cipherX), bR, reinterpret_cast<uint8_t*>(&X));
+        decryptChacha(xe.cipherX, sizeof(xe.cipherX), bRkey, reinterpret_cast<uint8_t*>(&X));
         if(X.cstart != cStart || X.cend != cEnd) continue;
         //decrypt with session key
         decryptChacha(input + msgHeadSize, getEncryptChachaSize(head_plainSize), X.x, output);
@@ -261,6 +322,64 @@ void encryptMessage(const std::string& input, const crypto::public_key& Bkey, st
     encryptMessage(input, v, output);
 }
 
+MessageEncryptor::MessageEncryptor(const std::vector<crypto::public_key>& Bkeys)
+{
+    setRecipients(Bkeys);
+}
+
+bool MessageEncryptor::setRecipients(const std::vector<crypto::public_key>& Bkeys)
+{
+    std::vector<crypto::public_key> sortedBkeys = Bkeys;
+    std::sort(sortedBkeys.begin(), sortedBkeys.end(), [](const crypto::public_key& l, const crypto::public_key& r)
+    {
+        return memcmp(&l, &r, sizeof(l)) < 0;
+    });
+    if(!m_recipients.empty() && sortedBkeys == m_Bkeys)
+        return false;
+
+    m_Bkeys = std::move(sortedBkeys);
+    m_recipients.clear();
+    m_recipients.reserve(m_Bkeys.size());
+
+    crypto::secret_key r;
+    crypto::generate_keys(m_R, r);
+    for(const crypto::public_key& B : m_Bkeys)
+    {
+        m_recipients.emplace_back();
+        Recipient& recipient = m_recipients.back();
+        recipient.Bhash = getBhash(B);
+        getRecipientKey(B, r, recipient.key);
+    }
+    std::sort(m_recipients.begin(), m_recipients.end(), [](const Recipient& l, const Recipient& r)
+    {
+        return little_to_native(l.Bhash) < little_to_native(r.Bhash);
+    });
+    return true;
+}
+
+void MessageEncryptor::encrypt(const std::string& input, std::string& output) const
+{
+    assert(!input.empty() && !m_recipients.empty());
+    size_t msgHeadSize = getMsgHeadSize(m_recipients.size());
+    output.resize(msgHeadSize + getEncryptChachaSize(input.size()));
+    uint8_t* out = reinterpret_cast<uint8_t*>(&output[0]);
+
+    SessionX X;
+    encryptPayload(input.size(), reinterpret_cast<const uint8_t*>(input.data()), X, out + msgHeadSize);
+
+    CryptoMessageHead& head = *reinterpret_cast<CryptoMessageHead*>(out);
+    head.plainSize = native_to_little(uint32_t(input.size()));
+    head.R = m_R;
+    head.count = native_to_little(uint16_t(m_recipients.size()));
+    XEntry* pxe = head.xentries;
+    for(const Recipient& recipient : m_recipients)
+    {
+        XEntry& xe = *pxe++;
+        xe.Bhash = recipient.Bhash;
+        encryptChacha(reinterpret_cast<const uint8_t*>(&X), sizeof(X), recipient.key, xe.cipherX);
+    }
+}
+
 bool decryptMessage(const std::string& input, const crypto::secret_key& bkey, std::string& output)
 {
     assert(!input.empty());
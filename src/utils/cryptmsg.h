@@ -30,6 +30,7 @@
 #pragma once
 
 #include "crypto/crypto.h"
+#include "crypto/chacha.h"
 #include <vector>
 
 namespace graft { namespace crypto_tools {
@@ -52,6 +53,45 @@ void encryptMessage(const std::string& input, const std::vector<crypto::public_k
  */
 void encryptMessage(const std::string& input, const crypto::public_key& Bkey, std::string& output);
 
+/*!
+ * \brief MessageEncryptor - encrypts messages for the same set of recipients repeatedly.
+ *
+ * Produces the same format as encryptMessage, but the random key R and the keys of the recipients
+ * are calculated once per recipient set, so only the session key is generated for each message.
+ * Note, all messages for the set share R, so they can be linked to each other.
+ */
+class MessageEncryptor
+{
+public:
+    MessageEncryptor() = default;
+    explicit MessageEncryptor(const std::vector<crypto::public_key>& Bkeys);
+
+    /*!
+     * \brief setRecipients - sets B keys of recipients.
+     * \return false if the recipient set is not changed and cached keys are kept, true otherwise
+     */
+    bool setRecipients(const std::vector<crypto::public_key>& Bkeys);
+
+    /*!
+     * \brief encrypt - encrypts data for the recipients.
+     *
+     * \param input - data to encrypt.
+     * \param output - resulting encripted message.
+     */
+    void encrypt(const std::string& input, std::string& output) const;
+
+private:
+    struct Recipient
+    {
+        uint32_t Bhash;
+        crypto::chacha_key key; //chacha key of rB
+    };
+
+    std::vector<crypto::public_key> m_Bkeys; //sorted
+    crypto::public_key m_R;
+    std::vector<Recipient> m_recipients; //sorted by Bhash
+};
+
 /*!
  * \brief decryptMessage - (reverse of encryptMessage) decrypts data for one of the recipients using his secret key b.
  *
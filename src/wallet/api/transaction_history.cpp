@@ -37,6 +37,7 @@
 #include "wallet/wallet2.h"
 
 
+#include <algorithm>
 #include <string>
 #include <list>
 
@@ -49,6 +50,11 @@ TransactionHistory::~TransactionHistory() {}
 
 TransactionHistoryImpl::TransactionHistoryImpl(WalletImpl *wallet)
     : m_wallet(wallet)
+    , m_confirmed(0)
+    , m_paymentsIn(0)
+    , m_paymentsOut(0)
+    , m_height(0)
+    , m_topHash(crypto::null_hash)
 {
 
 }
@@ -92,6 +98,16 @@ std::vector<TransactionInfo *> TransactionHistoryImpl::getAll() const
     return m_history;
 }
 
+std::vector<TransactionInfo *> TransactionHistoryImpl::getPage(int offset, int count) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_historyMutex);
+    if (offset < 0 || count <= 0 || static_cast<size_t>(offset) >= m_history.size())
+        return {};
+    auto begin = m_history.begin() + offset;
+    auto end = begin + std::min<size_t>(count, m_history.end() - begin);
+    return std::vector<TransactionInfo*>(begin, end);
+}
+
 void TransactionHistoryImpl::refresh()
 {
     // multithreaded access:
@@ -99,15 +115,63 @@ void TransactionHistoryImpl::refresh()
     // for "write" access, locking exclusively
     boost::unique_lock<boost::shared_mutex> lock(m_historyMutex);
 
-    // TODO: configurable values;
-    uint64_t min_height = 0;
-    uint64_t max_height = (uint64_t)-1;
     uint64_t wallet_height = m_wallet->blockChainHeight();
 
-    // delete old transactions;
+    // pending transfers are few and change state freely, they are built again every time
+    for (size_t i = m_confirmed; i < m_history.size(); ++i)
+        delete m_history[i];
+    m_history.resize(m_confirmed);
+
+    // the transfers seen so far still stand if the block on top of them is still in the wallet's chain,
+    // otherwise the chain was reorganized or rescanned
+    crypto::hash top_hash;
+    if (m_height == 0 || wallet_height < m_height || !m_wallet->m_wallet->get_blockchain_hash(m_height - 1, top_hash) || top_hash != m_topHash)
+        clear();
+
+    const size_t num_payments_in = m_wallet->m_wallet->get_num_payments();
+    const size_t num_payments_out = m_wallet->m_wallet->get_num_confirmed_txs();
+    const size_t known = m_confirmed;
+    size_t payments_in = 0, payments_out = 0;
+    addConfirmed(m_height ? m_height - 1 : 0, wallet_height, payments_in, payments_out);
+    if (m_height != 0 && (m_paymentsIn + payments_in != num_payments_in || m_paymentsOut + payments_out != num_payments_out))
+    {
+        // transfers were added in blocks seen before, e.g. by importing key images
+        clear();
+        payments_in = payments_out = 0;
+        addConfirmed(0, wallet_height, payments_in, payments_out);
+    }
+    m_paymentsIn = num_payments_in;
+    m_paymentsOut = num_payments_out;
+
+    // the transfers seen before only get older, and their subaddresses may have been relabeled
+    for (size_t i = 0; i < known && i < m_confirmed; ++i) {
+        TransactionInfoImpl *ti = static_cast<TransactionInfoImpl*>(m_history[i]);
+        ti->m_confirmations = (wallet_height > ti->m_blockheight) ? wallet_height - ti->m_blockheight : 0;
+        ti->m_label = ti->m_subaddrIndex.size() == 1 ? m_wallet->m_wallet->get_subaddress_label({ti->m_subaddrAccount, *ti->m_subaddrIndex.begin()}) : "";
+    }
+
+    addPending();
+
+    m_height = wallet_height;
+    if (m_height == 0 || !m_wallet->m_wallet->get_blockchain_hash(m_height - 1, m_topHash))
+        m_height = 0;
+}
+
+void TransactionHistoryImpl::clear()
+{
     for (auto t : m_history)
         delete t;
     m_history.clear();
+    m_confirmed = 0;
+    m_paymentsIn = 0;
+    m_paymentsOut = 0;
+    m_height = 0;
+}
+
+void TransactionHistoryImpl::addConfirmed(uint64_t min_height, uint64_t wallet_height, size_t &payments_in, size_t &payments_out)
+{
+    uint64_t max_height = (uint64_t)-1;
+    const size_t first = m_history.size();
 
     // transactions are stored in wallet2:
     // - confirmed_transfer_details   - out transfers
@@ -186,6 +250,17 @@ void TransactionHistoryImpl::refresh()
         m_history.push_back(ti);
     }
 
+    // the new transfers are all in blocks above the ones seen before, so sorting them keeps the whole history in block order
+    std::stable_sort(m_history.begin() + first, m_history.end(), [](const TransactionInfo *a, const TransactionInfo *b) {
+        return a->blockHeight() < b->blockHeight();
+    });
+    m_confirmed = m_history.size();
+    payments_in = in_payments.size();
+    payments_out = out_payments.size();
+}
+
+void TransactionHistoryImpl::addPending()
+{
     // unconfirmed output transactions
     std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>> upayments_out;
     m_wallet->m_wallet->get_unconfirmed_payments_out(upayments_out);
@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include "wallet/api/wallet2_api.h"
+#include "crypto/hash.h"
 #include <boost/thread/shared_mutex.hpp>
 
 namespace Monero {
@@ -44,12 +45,25 @@ public:
     virtual TransactionInfo * transaction(int index)  const;
     virtual TransactionInfo * transaction(const std::string &id) const;
     virtual std::vector<TransactionInfo*> getAll() const;
+    virtual std::vector<TransactionInfo*> getPage(int offset, int count) const;
     virtual void refresh();
 
 private:
+    // appends the confirmed transfers in blocks above min_height, in block order
+    void addConfirmed(uint64_t min_height, uint64_t wallet_height, size_t &payments_in, size_t &payments_out);
+    void addPending();
+    void clear();
 
     // TransactionHistory is responsible of memory management
+    // confirmed transfers in block order, followed by the pending ones
     std::vector<TransactionInfo*> m_history;
+    size_t m_confirmed;
+    // numbers of wallet2 payments and confirmed txes at the last refresh
+    size_t m_paymentsIn;
+    size_t m_paymentsOut;
+    // wallet height and its top block hash at the last refresh, 0 if the history has to be built again
+    uint64_t m_height;
+    crypto::hash m_topHash;
     WalletImpl *m_wallet;
     mutable boost::shared_mutex   m_historyMutex;
 };
@@ -230,6 +230,9 @@ struct TransactionHistory
     virtual TransactionInfo * transaction(int index)  const = 0;
     virtual TransactionInfo * transaction(const std::string &id) const = 0;
     virtual std::vector<TransactionInfo*> getAll() const = 0;
+    //! up to count transactions from index offset on, confirmed ones in block order come before pending ones
+    virtual std::vector<TransactionInfo*> getPage(int offset, int count) const = 0;
+    //! only picks up transactions in blocks added since the last call, unless the chain was reorganized or rescanned
     virtual void refresh() = 0;
 };
 
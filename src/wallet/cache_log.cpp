@@ -0,0 +1,219 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fstream>
+#include <limits>
+#include <boost/filesystem.hpp>
+#include "common/int-util.h"
+#include "crypto/crypto.h"
+#include "file_io_utils.h"
+#include "memwipe.h"
+#include "misc_log_ex.h"
+#include "cache_log.h"
+
+extern "C"
+{
+#include "crypto/keccak.h"
+}
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.cache_log"
+
+#define CACHE_LOG_MAGIC "Graft cache log\001"
+
+namespace
+{
+  const size_t MAGIC_SIZE = sizeof(CACHE_LOG_MAGIC) - 1;
+  const size_t SEGMENT_OVERHEAD = sizeof(uint64_t) + sizeof(crypto::chacha_iv) + sizeof(crypto::hash);
+
+  void add_u64(KECCAK_CTX &ctx, uint64_t v)
+  {
+    v = SWAP64LE(v);
+    keccak_update(&ctx, (const uint8_t*)&v, sizeof(v));
+  }
+
+  crypto::hash segment_mac(const crypto::chacha_key &key, const crypto::hash &id, uint64_t offset, const crypto::chacha_iv &iv, const char *cipher, size_t size)
+  {
+    static const char domain[] = "cache log mac";
+    KECCAK_CTX ctx;
+    keccak_init(&ctx);
+    keccak_update(&ctx, key.data(), key.size());
+    keccak_update(&ctx, (const uint8_t*)domain, sizeof(domain) - 1);
+    keccak_update(&ctx, (const uint8_t*)&id, sizeof(id));
+    add_u64(ctx, offset);
+    add_u64(ctx, size);
+    keccak_update(&ctx, (const uint8_t*)&iv, sizeof(iv));
+    keccak_update(&ctx, (const uint8_t*)cipher, size);
+
+    crypto::hash mac;
+    keccak_finish(&ctx, (uint8_t*)&mac);
+    memwipe(&ctx, sizeof(ctx));
+    return mac;
+  }
+}
+
+namespace tools
+{
+namespace cache_log
+{
+
+uint64_t header_size()
+{
+  return MAGIC_SIZE + sizeof(crypto::hash);
+}
+
+bool create(const std::string &filename, const crypto::hash &id)
+{
+  std::string header(CACHE_LOG_MAGIC, MAGIC_SIZE);
+  header.append((const char*)&id, sizeof(id));
+  return epee::file_io_utils::save_string_to_file(filename, header);
+}
+
+bool read_id(const std::string &filename, crypto::hash &id, uint64_t &file_size)
+{
+  std::string header;
+  if (!epee::file_io_utils::get_file_size(filename, file_size) || file_size < header_size())
+    return false;
+
+  std::ifstream in(filename, std::ios_base::binary | std::ios_base::in);
+  header.resize(header_size());
+  in.read(&header[0], header.size());
+  if (!in || memcmp(header.data(), CACHE_LOG_MAGIC, MAGIC_SIZE))
+    return false;
+
+  memcpy(&id, header.data() + MAGIC_SIZE, sizeof(id));
+  return true;
+}
+
+bool append(const std::string &filename, const crypto::chacha_key &key, const crypto::hash &id, uint64_t &size, const std::vector<std::string> &payloads)
+{
+  crypto::hash file_id;
+  uint64_t file_size;
+  if (!read_id(filename, file_id, file_size) || file_id != id || file_size < size)
+  {
+    MERROR("Cache log " << filename << " doesn't match the wallet cache");
+    return false;
+  }
+
+  // drop segments a previous, interrupted store appended past the size the cache knows about
+  if (file_size > size)
+  {
+    boost::system::error_code ec;
+    boost::filesystem::resize_file(filename, size, ec);
+    if (ec)
+    {
+      MERROR("Failed to truncate cache log " << filename << ": " << ec.message());
+      return false;
+    }
+  }
+
+  std::string data;
+  uint64_t offset = size;
+  for (const std::string &payload: payloads)
+  {
+    const crypto::chacha_iv iv = crypto::rand<crypto::chacha_iv>();
+    const uint64_t payload_size = SWAP64LE((uint64_t)payload.size());
+
+    const size_t start = data.size();
+    data.append((const char*)&payload_size, sizeof(payload_size));
+    data.append((const char*)&iv, sizeof(iv));
+    data.resize(data.size() + payload.size());
+    crypto::chacha20(payload.data(), payload.size(), key, iv, &data[data.size() - payload.size()]);
+
+    const crypto::hash mac = segment_mac(key, id, offset, iv, data.data() + data.size() - payload.size(), payload.size());
+    data.append((const char*)&mac, sizeof(mac));
+    offset += data.size() - start;
+  }
+
+  if (!epee::file_io_utils::append_string_to_file(filename, data))
+  {
+    MERROR("Failed to append to cache log " << filename);
+    return false;
+  }
+
+  size = offset;
+  return true;
+}
+
+bool read(const std::string &filename, const crypto::chacha_key &key, const crypto::hash &id, uint64_t size, const std::function<bool(const std::string &payload)> &f)
+{
+  std::string data;
+  if (!epee::file_io_utils::load_file_to_string(filename, data, std::numeric_limits<size_t>::max()))
+  {
+    MERROR("Failed to read cache log " << filename);
+    return false;
+  }
+
+  if (data.size() < size || size < header_size() || memcmp(data.data(), CACHE_LOG_MAGIC, MAGIC_SIZE) ||
+      memcmp(data.data() + MAGIC_SIZE, &id, sizeof(id)))
+  {
+    MERROR("Cache log " << filename << " doesn't match the wallet cache");
+    return false;
+  }
+
+  std::string payload;
+  uint64_t offset = header_size();
+  while (offset < size)
+  {
+    uint64_t payload_size = 0;
+    if (size - offset >= SEGMENT_OVERHEAD)
+    {
+      memcpy(&payload_size, data.data() + offset, sizeof(payload_size));
+      payload_size = SWAP64LE(payload_size);
+    }
+    if (size - offset < SEGMENT_OVERHEAD || payload_size > size - offset - SEGMENT_OVERHEAD)
+    {
+      MERROR("Truncated segment at " << offset << " in cache log " << filename);
+      return false;
+    }
+
+    crypto::chacha_iv iv;
+    memcpy(&iv, data.data() + offset + sizeof(payload_size), sizeof(iv));
+    const char *cipher = data.data() + offset + sizeof(payload_size) + sizeof(iv);
+    crypto::hash mac;
+    memcpy(&mac, cipher + payload_size, sizeof(mac));
+    if (mac != segment_mac(key, id, offset, iv, cipher, payload_size))
+    {
+      MERROR("Segment at " << offset << " in cache log " << filename << " failed verification");
+      return false;
+    }
+
+    payload.resize(payload_size);
+    crypto::chacha20(cipher, payload_size, key, iv, &payload[0]);
+    if (!f(payload))
+      return false;
+
+    offset += SEGMENT_OVERHEAD + payload_size;
+  }
+
+  memwipe(&payload[0], payload.size());
+  return true;
+}
+
+}
+}
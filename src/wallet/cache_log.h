@@ -0,0 +1,64 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "crypto/chacha.h"
+#include "crypto/hash.h"
+
+namespace tools
+{
+  /// Append-only file of encrypted segments, used for wallet cache records which are only ever added,
+  /// so that storing the wallet only writes the records added since the previous store.
+  ///
+  /// Layout: magic, 32 byte log id, then segments of
+  ///   [8 byte LE ciphertext size][8 byte iv][ciphertext][32 byte mac]
+  /// The mac is keyed by the cache key and covers the log id and the offset of the segment, so segments
+  /// can be neither altered nor moved within or between logs. The wallet cache records the id and the
+  /// size of the log it was stored with, bytes past that size are left over from an interrupted store.
+  namespace cache_log
+  {
+    uint64_t header_size();
+
+    /// Creates (or truncates) the log with the header only
+    bool create(const std::string &filename, const crypto::hash &id);
+
+    /// Reads the log id and the current size of the file
+    bool read_id(const std::string &filename, crypto::hash &id, uint64_t &file_size);
+
+    /// Truncates the log to size and appends a segment for every payload, size is advanced past them
+    bool append(const std::string &filename, const crypto::chacha_key &key, const crypto::hash &id, uint64_t &size, const std::vector<std::string> &payloads);
+
+    /// Decrypts the segments up to size in order, fails if the log doesn't have the given id, if a segment
+    /// doesn't verify or if f returns false
+    bool read(const std::string &filename, const crypto::chacha_key &key, const crypto::hash &id, uint64_t size, const std::function<bool(const std::string &payload)> &f);
+  }
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "daemon_rpc_pool.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.rpc_pool"
+
+// connections kept open while no request is using them, more are opened while requests overlap
+#define DAEMON_RPC_POOL_MAX_IDLE 4
+
+namespace tools
+{
+
+boost::mutex daemon_rpc_pool::s_pools_mutex;
+std::vector<std::weak_ptr<daemon_rpc_pool>> daemon_rpc_pool::s_pools;
+
+std::shared_ptr<daemon_rpc_pool> daemon_rpc_pool::get(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, bool ssl)
+{
+  boost::lock_guard<boost::mutex> lock(s_pools_mutex);
+  s_pools.erase(std::remove_if(s_pools.begin(), s_pools.end(), [](const std::weak_ptr<daemon_rpc_pool> &p) { return p.expired(); }), s_pools.end());
+  for (const std::weak_ptr<daemon_rpc_pool> &p: s_pools)
+  {
+    std::shared_ptr<daemon_rpc_pool> pool = p.lock();
+    if (pool && pool->is_for(address, login, ssl))
+      return pool;
+  }
+  std::shared_ptr<daemon_rpc_pool> pool = std::make_shared<daemon_rpc_pool>(address, login, ssl);
+  s_pools.push_back(pool);
+  return pool;
+}
+
+daemon_rpc_pool::daemon_rpc_pool(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, bool ssl):
+  m_address(address),
+  m_login(login),
+  m_ssl(ssl)
+{
+}
+
+bool daemon_rpc_pool::is_for(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, bool ssl) const
+{
+  if (m_address != address || m_ssl != ssl || bool(m_login) != bool(login))
+    return false;
+  return !login || (m_login->username == login->username && m_login->password == login->password);
+}
+
+daemon_rpc_pool::lease daemon_rpc_pool::acquire()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_idle.empty())
+    {
+      std::unique_ptr<http_client> client = std::move(m_idle.back());
+      m_idle.pop_back();
+      return lease(*this, std::move(client));
+    }
+  }
+  // connects on its first request
+  std::unique_ptr<http_client> client(new http_client());
+  if (!client->set_server(m_address, m_login, m_ssl))
+    MERROR("Failed to set daemon address " << m_address);
+  return lease(*this, std::move(client));
+}
+
+void daemon_rpc_pool::release(std::unique_ptr<http_client> client)
+{
+  // a connection left broken by a failed request is opened again by the next one
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  if (m_idle.size() < DAEMON_RPC_POOL_MAX_IDLE)
+    m_idle.push_back(std::move(client));
+}
+
+}
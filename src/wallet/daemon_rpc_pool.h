@@ -0,0 +1,112 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/optional/optional.hpp>
+#include <boost/thread/mutex.hpp>
+#include "net/http_client.h"
+#include "storages/http_abstract_invoke.h"
+
+namespace tools
+{
+  /// Connections to a daemon which are shared by all the wallets of the process using it, so wallets
+  /// opened by the same wallet RPC server reuse each other's keep-alive connections.
+  ///
+  /// Every request borrows an idle connection, or opens a new one, for its duration, so requests from
+  /// different threads (e.g. the refresh thread pulling the next blocks and the wallet checking the
+  /// pool) go to the daemon side by side instead of queueing on a single connection.
+  class daemon_rpc_pool
+  {
+  public:
+    typedef epee::net_utils::http::http_simple_client http_client;
+
+    /// Returns the pool for the daemon, creating it when no wallet is using it yet
+    static std::shared_ptr<daemon_rpc_pool> get(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, bool ssl);
+
+    daemon_rpc_pool(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, bool ssl);
+
+    /// A connection borrowed from the pool, which goes back to it when the lease is destroyed
+    class lease
+    {
+    public:
+      lease(daemon_rpc_pool &pool, std::unique_ptr<http_client> client): m_pool(pool), m_client(std::move(client)) {}
+      lease(lease &&l): m_pool(l.m_pool), m_client(std::move(l.m_client)) {}
+      ~lease() { if (m_client) m_pool.release(std::move(m_client)); }
+      lease(const lease&) = delete;
+      lease &operator=(const lease&) = delete;
+
+      http_client &operator*() { return *m_client; }
+      http_client *operator->() { return m_client.get(); }
+
+    private:
+      daemon_rpc_pool &m_pool;
+      std::unique_ptr<http_client> m_client;
+    };
+
+    lease acquire();
+
+    template<class t_request, class t_response>
+    bool invoke_http_json(const boost::string_ref uri, const t_request& req, t_response& res, std::chrono::milliseconds timeout, const boost::string_ref http_method = "GET")
+    {
+      lease client = acquire();
+      return epee::net_utils::invoke_http_json(uri, req, res, *client, timeout, http_method);
+    }
+    template<class t_request, class t_response>
+    bool invoke_http_bin(const boost::string_ref uri, const t_request& req, t_response& res, std::chrono::milliseconds timeout, const boost::string_ref http_method = "GET")
+    {
+      lease client = acquire();
+      return epee::net_utils::invoke_http_bin(uri, req, res, *client, timeout, http_method);
+    }
+    template<class t_request, class t_response>
+    bool invoke_http_json_rpc(const boost::string_ref uri, const std::string& method_name, const t_request& req, t_response& res, std::chrono::milliseconds timeout, const boost::string_ref http_method = "GET", const std::string& req_id = "0")
+    {
+      lease client = acquire();
+      return epee::net_utils::invoke_http_json_rpc(uri, method_name, req, res, *client, timeout, http_method, req_id);
+    }
+
+  private:
+    void release(std::unique_ptr<http_client> client);
+
+    bool is_for(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, bool ssl) const;
+
+    // not keyed by the login, to keep the password out of the lookup
+    static boost::mutex s_pools_mutex;
+    static std::vector<std::weak_ptr<daemon_rpc_pool>> s_pools;
+
+    const std::string m_address;
+    const boost::optional<epee::net_utils::http::login> m_login;
+    const bool m_ssl;
+
+    boost::mutex m_mutex;
+    std::vector<std::unique_ptr<http_client>> m_idle;
+  };
+}
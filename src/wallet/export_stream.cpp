@@ -0,0 +1,140 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "common/int-util.h"
+#include "crypto/crypto.h"
+#include "memwipe.h"
+#include "misc_log_ex.h"
+#include "export_stream.h"
+
+extern "C"
+{
+#include "crypto/keccak.h"
+}
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.export_stream"
+
+namespace
+{
+  void add_u64(KECCAK_CTX &ctx, uint64_t v)
+  {
+    v = SWAP64LE(v);
+    keccak_update(&ctx, (const uint8_t*)&v, sizeof(v));
+  }
+
+  crypto::hash segment_mac(const crypto::chacha_key &key, uint64_t index, uint8_t last, const crypto::chacha_iv &iv, const char *cipher, size_t size)
+  {
+    static const char domain[] = "export stream mac";
+    KECCAK_CTX ctx;
+    keccak_init(&ctx);
+    keccak_update(&ctx, key.data(), key.size());
+    keccak_update(&ctx, (const uint8_t*)domain, sizeof(domain) - 1);
+    add_u64(ctx, index);
+    add_u64(ctx, size);
+    keccak_update(&ctx, &last, sizeof(last));
+    keccak_update(&ctx, (const uint8_t*)&iv, sizeof(iv));
+    keccak_update(&ctx, (const uint8_t*)cipher, size);
+
+    crypto::hash mac;
+    keccak_finish(&ctx, (uint8_t*)&mac);
+    memwipe(&ctx, sizeof(ctx));
+    return mac;
+  }
+}
+
+namespace tools
+{
+namespace export_stream
+{
+
+bool writer::write(const std::string &payload, bool last)
+{
+  const crypto::chacha_iv iv = crypto::rand<crypto::chacha_iv>();
+  const uint64_t payload_size = SWAP64LE((uint64_t)payload.size());
+  const uint8_t last_flag = last ? 1 : 0;
+
+  std::string cipher(payload.size(), '\0');
+  crypto::chacha20(payload.data(), payload.size(), m_key, iv, &cipher[0]);
+  const crypto::hash mac = segment_mac(m_key, m_index, last_flag, iv, cipher.data(), cipher.size());
+
+  m_out.write((const char*)&payload_size, sizeof(payload_size));
+  m_out.write((const char*)&last_flag, sizeof(last_flag));
+  m_out.write((const char*)&iv, sizeof(iv));
+  m_out.write(cipher.data(), cipher.size());
+  m_out.write((const char*)&mac, sizeof(mac));
+  ++m_index;
+  return m_out.good();
+}
+
+bool reader::read(std::string &payload, bool &last)
+{
+  if (m_done)
+  {
+    MERROR("Export has no segment past its last one");
+    return false;
+  }
+
+  uint64_t payload_size;
+  uint8_t last_flag;
+  crypto::chacha_iv iv;
+  m_in.read((char*)&payload_size, sizeof(payload_size));
+  m_in.read((char*)&last_flag, sizeof(last_flag));
+  m_in.read((char*)&iv, sizeof(iv));
+  payload_size = SWAP64LE(payload_size);
+  if (!m_in || payload_size > m_max_segment_size || last_flag > 1)
+  {
+    MERROR("Truncated or invalid segment " << m_index << " in export");
+    return false;
+  }
+
+  std::string cipher(payload_size, '\0');
+  crypto::hash mac;
+  m_in.read(&cipher[0], cipher.size());
+  m_in.read((char*)&mac, sizeof(mac));
+  if (!m_in)
+  {
+    MERROR("Truncated segment " << m_index << " in export");
+    return false;
+  }
+  if (mac != segment_mac(m_key, m_index, last_flag, iv, cipher.data(), cipher.size()))
+  {
+    MERROR("Segment " << m_index << " in export failed verification");
+    return false;
+  }
+
+  payload.resize(payload_size);
+  crypto::chacha20(cipher.data(), cipher.size(), m_key, iv, &payload[0]);
+  last = last_flag != 0;
+  m_done = last;
+  ++m_index;
+  return true;
+}
+
+}
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include "crypto/chacha.h"
+
+namespace tools
+{
+  /// Encrypted segments of a wallet export, written and read one at a time, so that neither the exporting
+  /// nor the importing wallet holds the whole export in memory.
+  ///
+  /// Layout after the magic of the export: segments of
+  ///   [8 byte LE ciphertext size][1 byte last flag][8 byte iv][ciphertext][32 byte mac]
+  /// The mac is keyed by the export key and covers the index of the segment and the last flag, so segments
+  /// can be neither altered, reordered nor dropped, and a truncated export doesn't read as a complete one.
+  namespace export_stream
+  {
+    class writer
+    {
+    public:
+      writer(std::ostream &out, const crypto::chacha_key &key): m_out(out), m_key(key), m_index(0) {}
+
+      /// Appends a segment, the last one tells the reader the export is complete
+      bool write(const std::string &payload, bool last);
+
+    private:
+      std::ostream &m_out;
+      const crypto::chacha_key &m_key;
+      uint64_t m_index;
+    };
+
+    class reader
+    {
+    public:
+      reader(std::istream &in, const crypto::chacha_key &key, uint64_t max_segment_size):
+        m_in(in), m_key(key), m_max_segment_size(max_segment_size), m_index(0), m_done(false) {}
+
+      /// Reads and decrypts the next segment, fails if it doesn't verify or if the last one was read already
+      bool read(std::string &payload, bool &last);
+
+      bool done() const { return m_done; }
+
+    private:
+      std::istream &m_in;
+      const crypto::chacha_key &m_key;
+      uint64_t m_max_segment_size;
+      uint64_t m_index;
+      bool m_done;
+    };
+  }
+}
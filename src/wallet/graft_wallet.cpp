@@ -6,17 +6,85 @@
 #include "rapidjson/writer.h"
 #include "common/json_util.h"
 #include "string_coding.h"
+#include "memwipe.h"
+#include <unordered_map>
 #include <boost/format.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
 
 #define SUBADDRESS_LOOKAHEAD_MAJOR 50
 #define SUBADDRESS_LOOKAHEAD_MINOR 200
 
 #define CACHE_KEY_TAIL 0x8d
 
+#define WALLET_SESSION_TTL 600 // seconds an account restored from data stays cached unused
+#define WALLET_SESSION_MAX_COUNT 1024
+
 using namespace crypto;
 
 namespace
 {
+  // accounts restored by loadFromData, keyed by a hash of the account data and the password, so
+  // restoring the same account again skips verifying its keys and deriving the cache keys
+  struct wallet_session
+  {
+    cryptonote::account_base account;
+    crypto::chacha_key cache_key;
+    crypto::chacha_key ringdb_key;
+    time_t last_used;
+  };
+
+  boost::mutex sessions_mutex;
+  std::unordered_map<crypto::hash, wallet_session> sessions;
+
+  crypto::hash get_session_id(const std::string &data, const std::string &password, uint64_t kdf_rounds)
+  {
+    std::string buf;
+    const uint64_t data_size = data.size();
+    buf.append((const char*)&kdf_rounds, sizeof(kdf_rounds));
+    buf.append((const char*)&data_size, sizeof(data_size));
+    buf.append(data);
+    buf.append(password);
+    crypto::hash id;
+    crypto::cn_fast_hash(buf.data(), buf.size(), id);
+    memwipe(&buf[0], buf.size());
+    return id;
+  }
+
+  bool find_session(const crypto::hash &id, wallet_session &session)
+  {
+    boost::lock_guard<boost::mutex> lock(sessions_mutex);
+    const time_t now = time(NULL);
+    for (auto i = sessions.begin(); i != sessions.end(); )
+    {
+      if (now - i->second.last_used > WALLET_SESSION_TTL)
+        i = sessions.erase(i);
+      else
+        ++i;
+    }
+    auto i = sessions.find(id);
+    if (i == sessions.end())
+      return false;
+    i->second.last_used = now;
+    session = i->second;
+    return true;
+  }
+
+  void add_session(const crypto::hash &id, const wallet_session &session)
+  {
+    boost::lock_guard<boost::mutex> lock(sessions_mutex);
+    if (sessions.size() >= WALLET_SESSION_MAX_COUNT && sessions.find(id) == sessions.end())
+    {
+      auto oldest = std::min_element(sessions.begin(), sessions.end(), [](const std::pair<const crypto::hash, wallet_session> &a, const std::pair<const crypto::hash, wallet_session> &b) {
+        return a.second.last_used < b.second.last_used;
+      });
+      sessions.erase(oldest);
+    }
+    wallet_session &entry = sessions[id];
+    entry = session;
+    entry.last_used = time(NULL);
+  }
+
   std::string get_default_db_path(cryptonote::network_type nettype)
   {
     boost::filesystem::path dir = tools::get_default_data_dir();
@@ -145,10 +213,25 @@ void tools::GraftWallet::loadFromData(const std::string &data, const std::string
     {
         enc_data = epee::string_encoding::base64_decode(data);
     }
-    if (!load_keys_from_data(enc_data, password))
+    const crypto::hash session_id = get_session_id(enc_data, password, m_kdf_rounds);
+    wallet_session session;
+    const bool cached = find_session(session_id, session);
+    if (!load_keys_from_data(enc_data, password, cached ? &session.account : nullptr))
     {
         THROW_WALLET_EXCEPTION_IF(true, error::file_read_error, m_keys_file);
     }
+    if (cached)
+    {
+        m_cache_key = session.cache_key;
+        m_ringdb_key = session.ringdb_key;
+    }
+    else if (m_key_device_type == hw::device::device_type::SOFTWARE)
+    {
+        session.account = m_account;
+        session.cache_key = m_cache_key;
+        session.ringdb_key = get_ringdb_key();
+        add_session(session_id, session);
+    }
     LOG_PRINT_L0("Loaded wallet keys file, with public address: " << m_account.get_public_address_str(nettype()));
 
     //keys loaded ok!
@@ -262,7 +345,8 @@ std::string tools::GraftWallet::store_keys_to_data(const std::string &password,
     return account_data;
 }
 
-bool tools::GraftWallet::load_keys_from_data(const std::string &data, const std::string &password)
+bool tools::GraftWallet::load_keys_from_data(const std::string &data, const std::string &password,
+                                             const cryptonote::account_base *verified_account)
 {
     rapidjson::Document json;
     std::string account_data;
@@ -493,6 +577,13 @@ bool tools::GraftWallet::load_keys_from_data(const std::string &data, const std:
       return false;
     }
 
+    if (verified_account)
+    {
+      // the keys were checked and the cache keys derived when this account was first loaded
+      m_account = *verified_account;
+      return true;
+    }
+
     r = epee::serialization::load_t_from_binary(m_account, account_data);
     THROW_WALLET_EXCEPTION_IF(!r, error::invalid_password);
     if (m_key_device_type == hw::device::device_type::LEDGER) {
@@ -78,7 +78,8 @@ public:
 
   std::string store_keys_to_data(const std::string& password, bool watch_only = false);
 private:
-  bool load_keys_from_data(const std::string& data, const std::string& password);
+  bool load_keys_from_data(const std::string& data, const std::string& password,
+                           const cryptonote::account_base *verified_account = nullptr);
   void setup_cache_keys(const epee::wipeable_string &password);
 };
 
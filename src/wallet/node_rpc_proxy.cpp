@@ -38,6 +38,10 @@ namespace tools
 
 static const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
 
+// distributions are kept when they end at least this deep, and only so many of them
+#define OUTPUT_DISTRIBUTION_CACHE_MIN_DEPTH CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE
+#define OUTPUT_DISTRIBUTION_CACHE_MAX_ENTRIES 256
+
 NodeRPCProxy::NodeRPCProxy(epee::net_utils::http::http_simple_client &http_client, boost::mutex &mutex)
   : m_http_client(http_client)
   , m_daemon_rpc_mutex(mutex)
@@ -58,6 +62,20 @@ void NodeRPCProxy::invalidate()
   m_target_height = 0;
   m_block_weight_limit = 0;
   m_get_info_time = 0;
+  m_output_distributions.clear();
+}
+
+void NodeRPCProxy::invalidate_from_height(uint64_t height)
+{
+  if (m_height > height)
+    m_height = height;
+  for (auto i = m_output_distributions.begin(); i != m_output_distributions.end(); )
+  {
+    if (std::get<2>(i->first) >= height)
+      i = m_output_distributions.erase(i);
+    else
+      ++i;
+  }
 }
 
 boost::optional<std::string> NodeRPCProxy::get_rpc_version(uint32_t &rpc_version) const
@@ -218,4 +236,43 @@ boost::optional<std::string> NodeRPCProxy::get_fee_quantization_mask(uint64_t &f
   return boost::optional<std::string>();
 }
 
+bool NodeRPCProxy::get_output_distribution(const cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request &req, cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response &res, std::chrono::milliseconds timeout) const
+{
+  // to_height 0 means up to the top, which changes with every block
+  uint64_t height = 0;
+  const bool cacheable = req.to_height != 0 && !get_height(height) && req.to_height + OUTPUT_DISTRIBUTION_CACHE_MIN_DEPTH <= height;
+
+  if (cacheable)
+  {
+    res.distributions.clear();
+    for (uint64_t amount: req.amounts)
+    {
+      const auto i = m_output_distributions.find(output_distribution_key{amount, req.from_height, req.to_height, req.cumulative});
+      if (i == m_output_distributions.end())
+        break;
+      res.distributions.push_back(i->second);
+      res.distributions.back().binary = req.binary;
+    }
+    if (res.distributions.size() == req.amounts.size())
+    {
+      res.status = CORE_RPC_STATUS_OK;
+      res.untrusted = false;
+      return true;
+    }
+    res.distributions.clear();
+  }
+
+  m_daemon_rpc_mutex.lock();
+  bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_output_distribution", req, res, m_http_client, timeout);
+  m_daemon_rpc_mutex.unlock();
+  if (!r || res.status != CORE_RPC_STATUS_OK || !cacheable)
+    return r;
+
+  if (m_output_distributions.size() + res.distributions.size() > OUTPUT_DISTRIBUTION_CACHE_MAX_ENTRIES)
+    m_output_distributions.clear();
+  for (const auto &d: res.distributions)
+    m_output_distributions[output_distribution_key{d.amount, req.from_height, req.to_height, req.cumulative}] = d;
+  return r;
+}
+
 }
@@ -28,10 +28,13 @@
 
 #pragma once
 
+#include <map>
 #include <string>
+#include <tuple>
 #include <boost/thread/mutex.hpp>
 #include "include_base_utils.h"
 #include "net/http_client.h"
+#include "rpc/core_rpc_server_commands_defs.h"
 
 namespace tools
 {
@@ -42,6 +45,8 @@ public:
   NodeRPCProxy(epee::net_utils::http::http_simple_client &http_client, boost::mutex &mutex);
 
   void invalidate();
+  /// Drops what the blocks from height on, which the wallet is detaching, were part of
+  void invalidate_from_height(uint64_t height);
 
   boost::optional<std::string> get_rpc_version(uint32_t &version) const;
   boost::optional<std::string> get_height(uint64_t &height) const;
@@ -51,6 +56,9 @@ public:
   boost::optional<std::string> get_earliest_height(uint8_t version, uint64_t &earliest_height) const;
   boost::optional<std::string> get_dynamic_base_fee_estimate(uint64_t grace_blocks, uint64_t &fee) const;
   boost::optional<std::string> get_fee_quantization_mask(uint64_t &fee_quantization_mask) const;
+  /// Same as the get_output_distribution json rpc call, but distributions ending deep enough below the
+  /// top to not be reorganized are kept and not asked again
+  bool get_output_distribution(const cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request &req, cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response &res, std::chrono::milliseconds timeout) const;
 
 private:
   boost::optional<std::string> get_info() const;
@@ -68,6 +76,9 @@ private:
   mutable uint64_t m_target_height;
   mutable uint64_t m_block_weight_limit;
   mutable time_t m_get_info_time;
+  // (amount, from_height, to_height, cumulative)
+  typedef std::tuple<uint64_t, uint64_t, uint64_t, bool> output_distribution_key;
+  mutable std::map<output_distribution_key, cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::distribution> m_output_distributions;
 };
 
 }
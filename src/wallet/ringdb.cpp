@@ -26,6 +26,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <lmdb.h>
 #include <boost/algorithm/string.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -265,34 +266,61 @@ void ringdb::close()
   }
 }
 
+void ringdb::cache_rings(const crypto::chacha_key &chacha_key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings, bool relative)
+{
+  CRITICAL_REGION_LOCAL(ring_cache_lock);
+  if (ring_cache.empty() || memcmp(ring_cache_key.data(), chacha_key.data(), chacha_key.size()))
+  {
+    ring_cache.clear();
+    ring_cache_key = chacha_key;
+  }
+  for (const auto &ring: rings)
+    ring_cache[ring.first] = relative ? cryptonote::relative_output_offsets_to_absolute(ring.second) : ring.second;
+}
+
 bool ringdb::add_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx)
+{
+  return add_rings(chacha_key, std::vector<const cryptonote::transaction_prefix*>(1, &tx));
+}
+
+bool ringdb::add_rings(const crypto::chacha_key &chacha_key, const std::vector<const cryptonote::transaction_prefix*> &txes)
 {
   MDB_txn *txn;
   int dbr;
   bool tx_active = false;
 
-  dbr = resize_env(env, filename.c_str(), get_ring_data_size(tx.vin.size()));
+  size_t n_inputs = 0;
+  for (const cryptonote::transaction_prefix *tx: txes)
+    n_inputs += tx->vin.size();
+
+  dbr = resize_env(env, filename.c_str(), get_ring_data_size(n_inputs));
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size");
   dbr = mdb_txn_begin(env, NULL, 0, &txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
   tx_active = true;
 
-  for (const auto &in: tx.vin)
+  std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> rings;
+  for (const cryptonote::transaction_prefix *tx: txes)
   {
-    if (in.type() != typeid(cryptonote::txin_to_key))
-      continue;
-    const auto &txin = boost::get<cryptonote::txin_to_key>(in);
-    const uint32_t ring_size = txin.key_offsets.size();
-    if (ring_size == 1)
-      continue;
-
-    store_relative_ring(txn, dbi_rings, txin.k_image, txin.key_offsets, chacha_key);
+    for (const auto &in: tx->vin)
+    {
+      if (in.type() != typeid(cryptonote::txin_to_key))
+        continue;
+      const auto &txin = boost::get<cryptonote::txin_to_key>(in);
+      const uint32_t ring_size = txin.key_offsets.size();
+      if (ring_size == 1)
+        continue;
+
+      store_relative_ring(txn, dbi_rings, txin.k_image, txin.key_offsets, chacha_key);
+      rings.push_back({txin.k_image, txin.key_offsets});
+    }
   }
 
   dbr = mdb_txn_commit(txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn adding ring to database: " + std::string(mdb_strerror(dbr)));
   tx_active = false;
+  cache_rings(chacha_key, rings, true);
   return true;
 }
 
@@ -318,6 +346,11 @@ bool ringdb::remove_rings(const crypto::chacha_key &chacha_key, const cryptonote
     if (ring_size == 1)
       continue;
 
+    {
+      CRITICAL_REGION_LOCAL(ring_cache_lock);
+      ring_cache.erase(txin.k_image);
+    }
+
     MDB_val key, data;
     std::string key_ciphertext = encrypt(txin.k_image, chacha_key);
     key.mv_data = (void*)key_ciphertext.data();
@@ -346,6 +379,17 @@ bool ringdb::get_ring(const crypto::chacha_key &chacha_key, const crypto::key_im
   int dbr;
   bool tx_active = false;
 
+  {
+    CRITICAL_REGION_LOCAL(ring_cache_lock);
+    const auto i = ring_cache.find(key_image);
+    if (i != ring_cache.end() && !memcmp(ring_cache_key.data(), chacha_key.data(), chacha_key.size()))
+    {
+      outs = i->second;
+      MDEBUG("Found cached ring for key image " << key_image);
+      return true;
+    }
+  }
+
   dbr = resize_env(env, filename.c_str(), 0);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
   dbr = mdb_txn_begin(env, NULL, 0, &txn);
@@ -373,27 +417,39 @@ bool ringdb::get_ring(const crypto::chacha_key &chacha_key, const crypto::key_im
   dbr = mdb_txn_commit(txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn getting ring from database: " + std::string(mdb_strerror(dbr)));
   tx_active = false;
+  cache_rings(chacha_key, {{key_image, outs}}, false);
   return true;
 }
 
 bool ringdb::set_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, const std::vector<uint64_t> &outs, bool relative)
+{
+  return set_rings(chacha_key, {{key_image, outs}}, relative);
+}
+
+bool ringdb::set_rings(const crypto::chacha_key &chacha_key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings, bool relative)
 {
   MDB_txn *txn;
   int dbr;
   bool tx_active = false;
 
-  dbr = resize_env(env, filename.c_str(), outs.size() * 64);
+  size_t n_outs = 0;
+  for (const auto &ring: rings)
+    n_outs += ring.second.size();
+
+  dbr = resize_env(env, filename.c_str(), n_outs * 64 + rings.size() * 64);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
   dbr = mdb_txn_begin(env, NULL, 0, &txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
   tx_active = true;
 
-  store_relative_ring(txn, dbi_rings, key_image, relative ? outs : cryptonote::absolute_output_offsets_to_relative(outs), chacha_key);
+  for (const auto &ring: rings)
+    store_relative_ring(txn, dbi_rings, ring.first, relative ? ring.second : cryptonote::absolute_output_offsets_to_relative(ring.second), chacha_key);
 
   dbr = mdb_txn_commit(txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn setting ring to database: " + std::string(mdb_strerror(dbr)));
   tx_active = false;
+  cache_rings(chacha_key, rings, relative);
   return true;
 }
 
@@ -407,6 +463,15 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
 
   THROW_WALLET_EXCEPTION_IF(outputs.size() > 1 && op == BLACKBALL_QUERY, tools::error::wallet_internal_error, "Blackball query only makes sense for a single output");
 
+  // visit the table in key order, so the cursor walks forward through pages it already has
+  std::vector<std::pair<uint64_t, uint64_t>> sorted_outputs;
+  if (outputs.size() > 1)
+  {
+    sorted_outputs = outputs;
+    std::sort(sorted_outputs.begin(), sorted_outputs.end());
+    sorted_outputs.erase(std::unique(sorted_outputs.begin(), sorted_outputs.end()), sorted_outputs.end());
+  }
+
   dbr = resize_env(env, filename.c_str(), 32 * 2 * outputs.size()); // a pubkey, and some slack
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
   dbr = mdb_txn_begin(env, NULL, 0, &txn);
@@ -418,7 +483,7 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create cursor for blackballs table: " + std::string(mdb_strerror(dbr)));
 
   MDB_val key, data;
-  for (const std::pair<uint64_t, uint64_t> &output: outputs)
+  for (const std::pair<uint64_t, uint64_t> &output: outputs.size() > 1 ? sorted_outputs : outputs)
   {
     key.mv_data = (void*)&output.first;
     key.mv_size = sizeof(output.first);
@@ -429,7 +494,8 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
     {
       case BLACKBALL_BLACKBALL:
         MDEBUG("Marking output " << output.first << "/" << output.second << " as spent");
-        dbr = mdb_cursor_put(cursor, &key, &data, MDB_APPENDDUP);
+        // MDB_APPENDDUP would reject, and so skip, an output below the last one already marked for its amount
+        dbr = mdb_cursor_put(cursor, &key, &data, MDB_NODUPDATA);
         if (dbr == MDB_KEYEXIST)
           dbr = 0;
         break;
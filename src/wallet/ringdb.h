@@ -29,8 +29,10 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <lmdb.h>
+#include "syncobj.h"
 #include "wipeable_string.h"
 #include "crypto/crypto.h"
 #include "cryptonote_basic/cryptonote_basic.h"
@@ -45,9 +47,11 @@ namespace tools
     ~ringdb();
 
     bool add_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx);
+    bool add_rings(const crypto::chacha_key &chacha_key, const std::vector<const cryptonote::transaction_prefix*> &txes);
     bool remove_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx);
     bool get_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, std::vector<uint64_t> &outs);
     bool set_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, const std::vector<uint64_t> &outs, bool relative);
+    bool set_rings(const crypto::chacha_key &chacha_key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings, bool relative);
 
     bool blackball(const std::pair<uint64_t, uint64_t> &output);
     bool blackball(const std::vector<std::pair<uint64_t, uint64_t>> &outputs);
@@ -57,6 +61,7 @@ namespace tools
 
   private:
     bool blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &outputs, int op);
+    void cache_rings(const crypto::chacha_key &chacha_key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings, bool relative);
 
   private:
     std::string filename;
@@ -64,5 +69,10 @@ namespace tools
     MDB_dbi dbi_rings;
     MDB_dbi dbi_blackballs;
     static int ref_counter;
+
+    // absolute rings of the key images looked up or stored so far, for the key they were encrypted with
+    epee::critical_section ring_cache_lock;
+    crypto::chacha_key ring_cache_key;
+    std::unordered_map<crypto::key_image, std::vector<uint64_t>> ring_cache;
   };
 }
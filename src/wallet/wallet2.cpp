@@ -29,6 +29,7 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <deque>
 #include <numeric>
 #include <random>
 #include <tuple>
@@ -38,6 +39,9 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include "include_base_utils.h"
 using namespace epee;
 
@@ -60,6 +64,7 @@ using namespace epee;
 #include "common/i18n.h"
 #include "common/util.h"
 #include "common/apply_permutation.h"
+#include "common/int-util.h"
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
@@ -70,6 +75,8 @@ using namespace epee;
 #include "common/notify.h"
 #include "ringct/rctSigs.h"
 #include "ringdb.h"
+#include "cache_log.h"
+#include "export_stream.h"
 #include "utils/utils.h"
 
 extern "C"
@@ -110,14 +117,23 @@ using namespace cryptonote;
 
 #define SECOND_OUTPUT_RELATEDNESS_THRESHOLD 0.0f
 
+// inputs whose decoys are requested together when building planned txes in parallel, well below the daemon's restricted RPC limit
+#define PARALLEL_TX_OUTS_BATCH_INPUTS 32
+
 #define SUBADDRESS_LOOKAHEAD_MAJOR 50
 #define SUBADDRESS_LOOKAHEAD_MINOR 200
 
-#define KEY_IMAGE_EXPORT_FILE_MAGIC "Graft key image export\002"
+#define KEY_IMAGE_EXPORT_FILE_MAGIC "Graft key image export\003"
+#define KEY_IMAGE_EXPORT_FILE_MAGIC_V2 "Graft key image export\002"
 
 #define MULTISIG_EXPORT_FILE_MAGIC "Graft multisig export\001"
 
-#define OUTPUT_EXPORT_FILE_MAGIC "Graft output export\003"
+#define OUTPUT_EXPORT_FILE_MAGIC "Graft output export\004"
+#define OUTPUT_EXPORT_FILE_MAGIC_V3 "Graft output export\003"
+
+// outputs per encrypted segment of an output export, and the largest segment an import accepts
+#define OUTPUT_EXPORT_SEGMENT_OUTPUTS 256
+#define OUTPUT_EXPORT_MAX_SEGMENT_SIZE (256 * 1024 * 1024)
 
 #define SEGREGATION_FORK_HEIGHT 99999999
 #define TESTNET_SEGREGATION_FORK_HEIGHT 99999999
@@ -126,8 +142,14 @@ using namespace cryptonote;
 
 #define FIRST_REFRESH_GRANULARITY     1024
 
+#define REFRESH_PIPELINE_DEPTH 2
+
+#define RCT_DISTRIBUTION_REFETCH_BLOCKS CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE /* refetched on update, in case of a reorg */
+
 #define GAMMA_PICK_HALF_WINDOW 5
 
+#define PAYMENTS_LOG_SEGMENT_RECORDS 4096
+
 static const std::string MULTISIG_SIGNATURE_MAGIC = "SigMultisigPkV1";
 static const std::string MULTISIG_EXTRA_INFO_MAGIC = "MultisigxV1";
 
@@ -208,6 +230,8 @@ struct options {
   const command_line::arg_descriptor<uint64_t> kdf_rounds = {"kdf-rounds", tools::wallet2::tr("Number of rounds for the key derivation function"), 1};
   const command_line::arg_descriptor<std::string> hw_device = {"hw-device", tools::wallet2::tr("HW device to use"), ""};
   const command_line::arg_descriptor<std::string> tx_notify = { "tx-notify" , "Run a program for each new incoming transaction, '%s' will be replaced by the transaction hash" , "" };
+  const command_line::arg_descriptor<uint64_t> refresh_pipeline_depth = {"refresh-pipeline-depth", tools::wallet2::tr("Number of block batches fetched and scanned ahead of the one being added to the wallet while refreshing"), REFRESH_PIPELINE_DEPTH};
+  const command_line::arg_descriptor<bool> parallel_tx_construction = {"parallel-tx-construction", tools::wallet2::tr("Plan split transactions from fee estimates and build them in parallel, for payouts to many destinations"), false};
 };
 
 void do_prepare_file_names(const std::string& file_path, std::string& keys_file, std::string& wallet_file)
@@ -258,6 +282,8 @@ std::unique_ptr<tools::wallet2> make_basic(const boost::program_options::variabl
   const network_type nettype = testnet ? TESTNET : stagenet ? STAGENET : MAINNET;
   const uint64_t kdf_rounds = command_line::get_arg(vm, opts.kdf_rounds);
   THROW_WALLET_EXCEPTION_IF(kdf_rounds == 0, tools::error::wallet_internal_error, "KDF rounds must not be 0");
+  const uint64_t refresh_pipeline_depth = command_line::get_arg(vm, opts.refresh_pipeline_depth);
+  THROW_WALLET_EXCEPTION_IF(refresh_pipeline_depth == 0, tools::error::wallet_internal_error, "Refresh pipeline depth must not be 0");
 
   auto daemon_address = command_line::get_arg(vm, opts.daemon_address);
   auto daemon_host = command_line::get_arg(vm, opts.daemon_host);
@@ -318,6 +344,8 @@ std::unique_ptr<tools::wallet2> make_basic(const boost::program_options::variabl
   boost::filesystem::path ringdb_path = command_line::get_arg(vm, opts.shared_ringdb_dir);
   wallet->set_ring_database(ringdb_path.string());
   wallet->device_name(device_name);
+  wallet->refresh_pipeline_depth(refresh_pipeline_depth);
+  wallet->parallel_tx_construction(command_line::get_arg(vm, opts.parallel_tx_construction));
 
   try
   {
@@ -609,6 +637,14 @@ static void emplace_or_replace(std::unordered_multimap<crypto::hash, tools::wall
   container.emplace(key, pd);
 }
 
+static std::string serialize_payments(const std::vector<std::pair<crypto::hash, tools::wallet2::payment_details>> &payments)
+{
+  std::stringstream oss;
+  boost::archive::portable_binary_oarchive ar(oss);
+  ar << payments;
+  return oss.str();
+}
+
 void drop_from_short_history(std::list<crypto::hash> &short_chain_history, size_t N)
 {
   std::list<crypto::hash>::iterator right;
@@ -775,6 +811,42 @@ uint32_t get_subaddress_clamped_sum(uint32_t idx, uint32_t extra)
   return idx + extra;
 }
 
+// calls f(i) for i in [0, n), in contiguous ranges over the threadpool when parallel,
+// the first exception thrown by f is rethrown once all ranges are done
+template<typename F>
+void for_each_index(size_t n, bool parallel, const F &f)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t threads = parallel ? std::min<size_t>(tpool.get_max_concurrency(), n / 16) : 0;
+  if (threads <= 1)
+  {
+    for (size_t i = 0; i < n; ++i)
+      f(i);
+    return;
+  }
+
+  tools::threadpool::waiter waiter;
+  std::vector<std::exception_ptr> errors(threads);
+  for (size_t t = 0; t < threads; ++t)
+  {
+    tpool.submit(&waiter, [&f, &errors, n, t, threads]() {
+      try
+      {
+        for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+          f(i);
+      }
+      catch (...)
+      {
+        errors[t] = std::current_exception();
+      }
+    }, true);
+  }
+  waiter.wait(&tpool);
+  for (const std::exception_ptr &e: errors)
+    if (e)
+      std::rethrow_exception(e);
+}
+
   //-----------------------------------------------------------------
 } //namespace
 
@@ -832,6 +904,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, boo
   m_default_mixin(0),
   m_default_priority(0),
   m_refresh_type(RefreshOptimizeCoinbase),
+  m_refresh_pipeline_depth(REFRESH_PIPELINE_DEPTH),
   m_auto_refresh(true),
   m_first_refresh_done(false),
   m_refresh_from_block_height(0),
@@ -842,6 +915,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, boo
   m_min_output_count(0),
   m_min_output_value(0),
   m_merge_destinations(false),
+  m_parallel_tx_construction(false),
   m_confirm_backlog(true),
   m_confirm_backlog_threshold(0),
   m_confirm_export_overwrite(true),
@@ -854,6 +928,9 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, boo
   m_kdf_rounds(kdf_rounds),
   is_old_file_format(false),
   m_node_rpc_proxy(m_http_client, m_daemon_rpc_mutex),
+  m_daemon_compact_blocks(true),
+  m_rct_distribution_start_height(0),
+  m_pool_cookie(0),
   m_subaddress_lookahead_major(SUBADDRESS_LOOKAHEAD_MAJOR),
   m_subaddress_lookahead_minor(SUBADDRESS_LOOKAHEAD_MINOR),
   m_light_wallet(false),
@@ -866,6 +943,10 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, boo
   m_ring_history_saved(false),
   m_ringdb(),
   m_last_block_reward(0),
+  m_key_image_export_offset(0),
+  m_payments_log_id(crypto::null_hash),
+  m_payments_log_size(0),
+  m_payments_log_unloaded(0),
   m_encrypt_keys_after_refresh(boost::none),
   m_unattended(unattended)
 {
@@ -907,6 +988,8 @@ void wallet2::init_options(boost::program_options::options_description& desc_par
   command_line::add_arg(desc_params, opts.kdf_rounds);
   command_line::add_arg(desc_params, opts.hw_device);
   command_line::add_arg(desc_params, opts.tx_notify);
+  command_line::add_arg(desc_params, opts.refresh_pipeline_depth);
+  command_line::add_arg(desc_params, opts.parallel_tx_construction);
 }
 
 std::pair<std::unique_ptr<wallet2>, tools::password_container> wallet2::make_from_json(const boost::program_options::variables_map& vm, bool unattended, const std::string& json_file, const std::function<boost::optional<tools::password_container>(const char *, bool)> &password_prompter)
@@ -960,6 +1043,10 @@ bool wallet2::init(std::string daemon_address, boost::optional<epee::net_utils::
   m_daemon_address = std::move(daemon_address);
   m_daemon_login = std::move(daemon_login);
   m_trusted_daemon = trusted_daemon;
+  m_daemon_compact_blocks = true;
+  m_rct_distribution.clear();
+  m_pool_cookie = 0;
+  m_daemon_rpc_pool = daemon_rpc_pool::get(get_daemon_address(), get_daemon_login(), ssl);
   // When switching from light wallet to full wallet, we need to reset the height we got from lw node.
   return m_http_client.set_server(get_daemon_address(), get_daemon_login(), ssl);
 }
@@ -1156,6 +1243,7 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
     {
       const uint32_t end = get_subaddress_clamped_sum((index2.major == index.major ? index.minor : 0), m_subaddress_lookahead_minor);
       const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, 0, end);
+      m_subaddresses.reserve(m_subaddresses.size() + pkeys.size());
       for (index2.minor = 0; index2.minor < end; ++index2.minor)
       {
          const crypto::public_key &D = pkeys[index2.minor];
@@ -1173,6 +1261,7 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
     const uint32_t begin = m_subaddress_labels[index.major].size();
     cryptonote::subaddress_index index2 = {index.major, begin};
     const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, index2.minor, end);
+    m_subaddresses.reserve(m_subaddresses.size() + pkeys.size());
     for (; index2.minor < end; ++index2.minor)
     {
        const crypto::public_key &D = pkeys[index2.minor - begin];
@@ -1219,6 +1308,7 @@ void wallet2::set_spent(size_t idx, uint64_t height)
 {
   transfer_details &td = m_transfers[idx];
   LOG_PRINT_L2("Setting SPENT at " << height << ": ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
+  unindex_transfer(idx);
   td.m_spent = true;
   td.m_spent_height = height;
 }
@@ -1229,6 +1319,31 @@ void wallet2::set_unspent(size_t idx)
   LOG_PRINT_L2("Setting UNSPENT: ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
   td.m_spent = false;
   td.m_spent_height = 0;
+  index_transfer(idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_transfer(size_t idx)
+{
+  const transfer_details &td = m_transfers[idx];
+  if (!td.m_spent)
+    m_unspent_transfers[td.m_subaddr_index.major].insert(idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::unindex_transfer(size_t idx)
+{
+  auto it = m_unspent_transfers.find(m_transfers[idx].m_subaddr_index.major);
+  if (it == m_unspent_transfers.end())
+    return;
+  it->second.erase(idx);
+  if (it->second.empty())
+    m_unspent_transfers.erase(it);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_transfer_index()
+{
+  m_unspent_transfers.clear();
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+    index_transfer(i);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::check_acc_out_precomp(const tx_out &o, const crypto::key_derivation &derivation, const std::vector<crypto::key_derivation> &additional_derivations, size_t i, tx_scan_info_t &tx_scan_info) const
@@ -1676,7 +1791,9 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 	    td.m_txid = txid;
             td.m_amount = amount;
             td.m_pk_index = pk_index - 1;
+            unindex_transfer(kit->second);
             td.m_subaddr_index = tx_scan_info[o].received->index;
+            index_transfer(kit->second);
             expand_subaddresses(tx_scan_info[o].received->index);
             if (tx.vout[o].amount == 0)
             {
@@ -1865,7 +1982,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           m_callback->on_unconfirmed_money_received(height, txid, tx, payment.m_amount, payment.m_subaddr_index);
       }
       else
-        m_payments.emplace(payment_id, payment);
+        add_payment(payment_id, payment);
       LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
     }
   }
@@ -1962,7 +2079,15 @@ void wallet2::process_new_blockchain_entry(const cryptonote::block& b, const cry
     THROW_WALLET_EXCEPTION_IF(bche.txs.size() != parsed_block.txes.size(), error::wallet_internal_error, "Wrong amount of transactions for block");
     for (size_t idx = 0; idx < b.tx_hashes.size(); ++idx)
     {
-      process_new_transaction(b.tx_hashes[idx], parsed_block.txes[idx], parsed_block.o_indices.indices[idx+1].indices, height, b.timestamp, false, false, false, tx_cache_data[tx_cache_data_offset++]);
+      const cryptonote::transaction *tx = &parsed_block.txes[idx];
+      cryptonote::transaction pruned_tx;
+      if (parsed_block.compact && spends_own_outputs(*tx))
+      {
+        // the rings of our own spends are recorded, but compact txes don't have them
+        get_pruned_tx(b.tx_hashes[idx], pruned_tx);
+        tx = &pruned_tx;
+      }
+      process_new_transaction(b.tx_hashes[idx], *tx, parsed_block.o_indices.indices[idx+1].indices, height, b.timestamp, false, false, false, tx_cache_data[tx_cache_data_offset++]);
     }
     TIME_MEASURE_FINISH(txs_handle_time);
     m_last_block_reward = cryptonote::get_outs_money_amount(b.miner_tx);
@@ -2011,14 +2136,26 @@ void wallet2::get_short_chain_history(std::list<crypto::hash>& ids, uint64_t gra
     ids.push_back(m_blockchain.genesis());
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::block &bl, crypto::hash &bl_id, bool &error) const
+void wallet2::parse_block_round(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, size_t start, size_t end) const
 {
-  error = !cryptonote::parse_and_validate_block_from_blob(blob, bl);
-  if (!error)
-    bl_id = get_block_hash(bl);
+  std::vector<const cryptonote::transaction*> miner_txs;
+  for (size_t i = start; i < end; ++i)
+  {
+    parsed_blocks[i].error = !cryptonote::parse_and_validate_block_from_blob(blocks[i].block, parsed_blocks[i].block);
+    if (!parsed_blocks[i].error)
+      miner_txs.push_back(&parsed_blocks[i].block.miner_tx);
+  }
+
+  // the miner tx hashes of the range are hashed in one batch and cached for the block hashes
+  std::vector<crypto::hash> miner_tx_hashes;
+  cryptonote::get_transaction_hashes(miner_txs, miner_tx_hashes);
+
+  for (size_t i = start; i < end; ++i)
+    if (!parsed_blocks[i].error)
+      parsed_blocks[i].hash = get_block_hash(parsed_blocks[i].block);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, bool &compact)
 {
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
@@ -2027,9 +2164,27 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
   req.prune = true;
   req.start_height = start_height;
   req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
+
+  compact = false;
+  if (m_daemon_compact_blocks)
+  {
+    cryptonote::COMMAND_RPC_GET_BLOCKS_COMPACT::request creq = AUTO_VAL_INIT(creq);
+    creq.block_ids = short_chain_history;
+    creq.start_height = start_height;
+    creq.no_miner_tx = req.no_miner_tx;
+    compact = invoke_pooled_http_bin("/get_blocks_compact.bin", creq, res, rpc_timeout);
+  }
+
+  bool r = compact;
+  if (!compact)
+  {
+    r = invoke_pooled_http_bin("/getblocks.bin", req, res, rpc_timeout);
+    if (r && m_daemon_compact_blocks)
+    {
+      MINFO("Daemon doesn't serve compact blocks, using full blocks");
+      m_daemon_compact_blocks = false;
+    }
+  }
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
@@ -2042,6 +2197,32 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
   o_indices = std::move(res.output_indices);
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::spends_own_outputs(const cryptonote::transaction &tx) const
+{
+  for (const auto &in: tx.vin)
+    if (in.type() == typeid(cryptonote::txin_to_key) && m_key_images.find(boost::get<cryptonote::txin_to_key>(in).k_image) != m_key_images.end())
+      return true;
+  return false;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_pruned_tx(const crypto::hash &txid, cryptonote::transaction &tx)
+{
+  cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request req = AUTO_VAL_INIT(req);
+  cryptonote::COMMAND_RPC_GET_TRANSACTIONS::response res = AUTO_VAL_INIT(res);
+  req.txs_hashes.push_back(epee::string_tools::pod_to_hex(txid));
+  req.decode_as_json = false;
+  req.prune = true;
+  bool r = invoke_pooled_http_json("/gettransactions", req, res, rpc_timeout);
+  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "gettransactions");
+  THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "gettransactions");
+  THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::wallet_internal_error, "Failed to get transaction " + epee::string_tools::pod_to_hex(txid) + ": " + res.status);
+  THROW_WALLET_EXCEPTION_IF(res.txs.size() != 1, error::wallet_internal_error, "Failed to get transaction " + epee::string_tools::pod_to_hex(txid) + " from daemon");
+
+  cryptonote::blobdata bd;
+  THROW_WALLET_EXCEPTION_IF(!epee::string_tools::parse_hexstr_to_binbuff(res.txs[0].as_hex, bd), error::wallet_internal_error, "Failed to parse transaction from daemon");
+  THROW_WALLET_EXCEPTION_IF(!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx), error::wallet_internal_error, "Failed to parse transaction from daemon");
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes)
 {
   cryptonote::COMMAND_RPC_GET_HASHES_FAST::request req = AUTO_VAL_INIT(req);
@@ -2049,9 +2230,7 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   req.block_ids = short_chain_history;
 
   req.start_height = start_height;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin("/gethashes.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
+  bool r = invoke_pooled_http_bin("/gethashes.bin", req, res, rpc_timeout);
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "gethashes.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "gethashes.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_hashes_error, res.status);
@@ -2060,24 +2239,18 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   hashes = std::move(res.m_block_ids);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added)
+void wallet2::scan_parsed_blocks(const std::vector<parsed_block> &parsed_blocks, const crypto::secret_key &view_secret_key, const std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses, std::vector<tx_cache_data> &tx_cache_data) const
 {
-  size_t current_index = start_height;
-  blocks_added = 0;
-
-  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
-  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
-
   tools::threadpool& tpool = tools::threadpool::getInstance();
   tools::threadpool::waiter waiter;
 
   size_t num_txes = 0;
-  std::vector<tx_cache_data> tx_cache_data;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  tx_cache_data.clear();
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
     num_txes += 1 + parsed_blocks[i].txes.size();
   tx_cache_data.resize(num_txes);
   size_t txidx = 0;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
     THROW_WALLET_EXCEPTION_IF(parsed_blocks[i].txes.size() != parsed_blocks[i].block.tx_hashes.size(),
         error::wallet_internal_error, "Mismatched parsed_blocks[i].txes.size() and parsed_blocks[i].block.tx_hashes.size()");
@@ -2096,27 +2269,58 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   hw::device &hwdev =  m_account.get_device();
   hw::reset_mode rst(hwdev);
   hwdev.set_mode(hw::device::TRANSACTION_PARSE);
-  const cryptonote::account_keys &keys = m_account.get_keys();
-
-  auto gender = [&](wallet2::is_out_data &iod) {
-    boost::unique_lock<hw::device> hwdev_lock(hwdev);
-    if (!hwdev.generate_key_derivation(iod.pkey, keys.m_view_secret_key, iod.derivation))
-    {
-      MWARNING("Failed to generate key derivation from tx pubkey, skipping");
-      static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
-      memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
-    }
-  };
 
+  // derivations of all tx pub keys of the batch, in chunks sharing the view key scalar recoding
+  std::vector<wallet2::is_out_data*> iods;
   for (auto &slot: tx_cache_data)
   {
     for (auto &iod: slot.primary)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+      iods.push_back(&iod);
     for (auto &iod: slot.additional)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+      iods.push_back(&iod);
+  }
+
+  auto gender = [&](size_t begin, size_t end) {
+    std::vector<crypto::public_key> pkeys;
+    std::vector<crypto::key_derivation> derivations;
+    pkeys.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i)
+      pkeys.push_back(iods[i]->pkey);
+    // keys which are not valid points keep the identity derivation
+    crypto::key_derivation identity;
+    static_assert(sizeof(identity) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+    memcpy(&identity, rct::identity().bytes, sizeof(identity));
+    derivations.resize(end - begin, identity);
+    {
+      boost::unique_lock<hw::device> hwdev_lock(hwdev);
+      if (!hwdev.generate_key_derivations(view_secret_key, epee::to_span(pkeys), epee::to_mut_span(derivations)))
+        MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+    }
+    for (size_t i = begin; i < end; ++i)
+      iods[i]->derivation = derivations[i - begin];
+  };
+
+  const size_t threads = std::max(1u, tpool.get_max_concurrency());
+  const size_t derivations_per_job = std::max<size_t>(64, (iods.size() + threads - 1) / threads);
+  for (size_t begin = 0; begin < iods.size(); begin += derivations_per_job)
+  {
+    const size_t end = std::min(iods.size(), begin + derivations_per_job);
+    tpool.submit(&waiter, [&gender, begin, end]() { gender(begin, end); }, true);
   }
   waiter.wait(&tpool);
 
+  scan_parsed_blocks_outputs(parsed_blocks, subaddresses, tx_cache_data);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::scan_parsed_blocks_outputs(const std::vector<parsed_block> &parsed_blocks, const std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses, std::vector<tx_cache_data> &tx_cache_data) const
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+
+  hw::device &hwdev =  m_account.get_device();
+  hw::reset_mode rst(hwdev);
+  hwdev.set_mode(hw::device::TRANSACTION_PARSE);
+
   auto geniod = [&](const cryptonote::transaction &tx, size_t n_vouts, size_t txidx) {
     for (size_t k = 0; k < n_vouts; ++k)
     {
@@ -2131,15 +2335,15 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
         {
           THROW_WALLET_EXCEPTION_IF(tx_cache_data[txidx].primary[l].received.size() != n_vouts,
               error::wallet_internal_error, "Unexpected received array size");
-          tx_cache_data[txidx].primary[l].received[k] = is_out_to_acc_precomp(m_subaddresses, key, tx_cache_data[txidx].primary[l].derivation, additional_derivations, k, hwdev);
+          tx_cache_data[txidx].primary[l].received[k] = is_out_to_acc_precomp(subaddresses, key, tx_cache_data[txidx].primary[l].derivation, additional_derivations, k, hwdev);
           additional_derivations.clear();
         }
       }
     }
   };
 
-  txidx = 0;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  size_t txidx = 0;
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
     if (m_refresh_type != RefreshType::RefreshNoCoinbase)
     {
@@ -2157,7 +2361,15 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   }
   THROW_WALLET_EXCEPTION_IF(txidx != tx_cache_data.size(), error::wallet_internal_error, "txidx did not reach expected value");
   waiter.wait(&tpool);
-  hwdev.set_mode(hw::device::NONE);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, const std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added)
+{
+  size_t current_index = start_height;
+  blocks_added = 0;
+
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
 
   size_t tx_cache_data_offset = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
@@ -2202,7 +2414,7 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   refresh(trusted_daemon, start_height, blocks_fetched, received_money);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error)
+void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<crypto::hash> &prev_block_hashes, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error)
 {
   error = false;
 
@@ -2210,28 +2422,28 @@ void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks
   {
     drop_from_short_history(short_chain_history, 3);
 
-    THROW_WALLET_EXCEPTION_IF(prev_blocks.size() != prev_parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
-
     // prepend the last 3 blocks, should be enough to guard against a block or two's reorg
-    std::vector<parsed_block>::const_reverse_iterator i = prev_parsed_blocks.rbegin();
-    for (size_t n = 0; n < std::min((size_t)3, prev_parsed_blocks.size()); ++n)
+    std::vector<crypto::hash>::const_reverse_iterator i = prev_block_hashes.rbegin();
+    for (size_t n = 0; n < std::min((size_t)3, prev_block_hashes.size()); ++n)
     {
-      short_chain_history.push_front(i->hash);
+      short_chain_history.push_front(*i);
       ++i;
     }
 
     // pull the new blocks
     std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
-    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
+    bool compact;
+    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices, compact);
     THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
 
     tools::threadpool& tpool = tools::threadpool::getInstance();
     tools::threadpool::waiter waiter;
     parsed_blocks.resize(blocks.size());
-    for (size_t i = 0; i < blocks.size(); ++i)
+    const size_t range = std::max<size_t>(16, (blocks.size() + tpool.get_max_concurrency() - 1) / tpool.get_max_concurrency());
+    for (size_t start = 0; start < blocks.size(); start += range)
     {
-      tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
-        std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+      const size_t end = std::min(start + range, blocks.size());
+      tpool.submit(&waiter, [&, start, end](){ parse_block_round(blocks, parsed_blocks, start, end); }, true);
     }
     waiter.wait(&tpool);
     for (size_t i = 0; i < blocks.size(); ++i)
@@ -2242,6 +2454,7 @@ void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks
         break;
       }
       parsed_blocks[i].o_indices = std::move(o_indices[i]);
+      parsed_blocks[i].compact = compact;
     }
 
     boost::mutex error_lock;
@@ -2295,7 +2508,7 @@ void wallet2::remove_obsolete_pool_txs(const std::vector<crypto::hash> &tx_hashe
 }
 
 //----------------------------------------------------------------------------------------------------
-void wallet2::update_pool_state(bool refreshed)
+void wallet2::update_pool_state(bool refreshed, const cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response *pool_hashes)
 {
   MDEBUG("update_pool_state start");
 
@@ -2310,14 +2523,35 @@ void wallet2::update_pool_state(bool refreshed)
   // get the pool state
   cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request req;
   cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response res;
-  m_daemon_rpc_mutex.lock();
-  bool r = epee::net_utils::invoke_http_json("/get_transaction_pool_hashes.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
-  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_transaction_pool_hashes.bin");
+  req.cookie = m_pool_cookie;
+  if (pool_hashes)
+  {
+    res = *pool_hashes;
+  }
+  else
+  {
+    bool r = invoke_pooled_http_json("/get_transaction_pool_hashes.bin", req, res, rpc_timeout);
+    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_transaction_pool_hashes.bin");
+  }
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_transaction_pool_hashes.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_tx_pool_error);
   MDEBUG("update_pool_state got pool");
 
+  // if the pool hasn't changed since its txes were last processed, only our pending txes need
+  // checking again, as the chain might have moved on
+  const bool pool_unchanged = req.cookie != 0 && res.unchanged;
+  const uint64_t pool_cookie = res.cookie;
+  if (pool_unchanged)
+  {
+    MDEBUG("update_pool_state pool unchanged");
+    res.tx_hashes = m_pool_tx_hashes;
+  }
+  else
+  {
+    m_pool_cookie = 0;
+    m_pool_tx_hashes = res.tx_hashes;
+  }
+
   // remove any pending tx that's not in the pool
   std::unordered_map<crypto::hash, wallet2::unconfirmed_transfer_details>::iterator it = m_unconfirmed_txs.begin();
   while (it != m_unconfirmed_txs.end())
@@ -2384,6 +2618,12 @@ void wallet2::update_pool_state(bool refreshed)
 
   MDEBUG("update_pool_state done second loop");
 
+  if (pool_unchanged)
+  {
+    MDEBUG("update_pool_state end");
+    return;
+  }
+
   // gather txids of new pool txes to us
   std::vector<std::pair<crypto::hash, bool>> txids;
   for (const auto &txid: res.tx_hashes)
@@ -2448,6 +2688,7 @@ void wallet2::update_pool_state(bool refreshed)
   }
 
   // get those txes
+  bool txs_processed = txids.empty();
   if (!txids.empty())
   {
     cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request req;
@@ -2457,14 +2698,13 @@ void wallet2::update_pool_state(bool refreshed)
     MDEBUG("asking for " << txids.size() << " transactions");
     req.decode_as_json = false;
     req.prune = false;
-    m_daemon_rpc_mutex.lock();
-    bool r = epee::net_utils::invoke_http_json("/gettransactions", req, res, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
+    bool r = invoke_pooled_http_json("/gettransactions", req, res, rpc_timeout);
     MDEBUG("Got " << r << " and " << res.status);
     if (r && res.status == CORE_RPC_STATUS_OK)
     {
       if (res.txs.size() == txids.size())
       {
+        txs_processed = true;
         for (const auto &tx_entry: res.txs)
         {
           if (tx_entry.in_pool)
@@ -2519,6 +2759,8 @@ void wallet2::update_pool_state(bool refreshed)
       LOG_PRINT_L0("Error calling gettransactions daemon RPC: r " << r << ", status " << res.status);
     }
   }
+  if (txs_processed)
+    m_pool_cookie = pool_cookie;
   MDEBUG("update_pool_state end");
 }
 //----------------------------------------------------------------------------------------------------
@@ -2652,11 +2894,7 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   size_t try_count = 0;
   crypto::hash last_tx_hash_id = m_transfers.size() ? m_transfers.back().m_txid : null_hash;
   std::list<crypto::hash> short_chain_history;
-  tools::threadpool& tpool = tools::threadpool::getInstance();
-  tools::threadpool::waiter waiter;
   uint64_t blocks_start_height;
-  std::vector<cryptonote::block_complete_entry> blocks;
-  std::vector<parsed_block> parsed_blocks;
   bool refreshed = false;
 
   // pull the first set of blocks
@@ -2689,96 +2927,252 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
     }
   });
 
+  // blocks are fetched, parsed and scanned for outputs to us by a producer thread, up to
+  // m_refresh_pipeline_depth batches ahead of the batch being added to the wallet
+  struct refresh_batch
+  {
+    uint64_t start_height = 0;
+    std::vector<cryptonote::block_complete_entry> blocks;
+    std::vector<parsed_block> parsed_blocks;
+    std::vector<tx_cache_data> tx_cache;
+    bool scanned = false;
+    size_t scanned_subaddresses = 0; // size of the subaddress map the outputs were checked against
+    bool error = false;
+  };
+  typedef std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddress_map;
+
+  // a hardware device has a single parsing session, so blocks are only scanned on this thread then
+  const bool scan_ahead = m_account.get_device().get_type() == hw::device::device_type::SOFTWARE;
+  const size_t pipeline_depth = std::max<size_t>(1, m_refresh_pipeline_depth);
+  const crypto::secret_key view_secret_key = m_account.get_keys().m_view_secret_key;
+  std::deque<refresh_batch> ready_batches;
+  std::shared_ptr<const subaddress_map> scan_subaddresses;
+  boost::mutex pipeline_mutex;
+  boost::condition_variable pipeline_cond;
+  bool pipeline_stop = false, pipeline_done = false;
+  boost::thread producer;
+  // the pool is asked for while the last blocks are being added, on another connection to the daemon
+  const uint64_t pool_cookie = m_pool_cookie;
+  boost::optional<cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response> pool_hashes;
+
+  auto produce = [&](uint64_t height) {
+    std::vector<crypto::hash> prev_block_hashes;
+    uint64_t prev_start_height = 0;
+    bool have_prev = false;
+    while (true)
+    {
+      refresh_batch batch;
+      pull_and_parse_next_blocks(height, batch.start_height, short_chain_history, prev_block_hashes, batch.blocks, batch.parsed_blocks, batch.error);
+      height = 0;
+
+      // the daemon sending the same blocks again means we've reached the top of its chain
+      const bool top = !batch.error && have_prev && batch.start_height == prev_start_height;
+      const bool last = batch.error || batch.blocks.empty() || top || !m_run.load(std::memory_order_relaxed);
+      boost::optional<cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response> top_pool_hashes;
+      if (top && m_run.load(std::memory_order_relaxed))
+      {
+        cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request req;
+        cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response res;
+        req.cookie = pool_cookie;
+        if (invoke_pooled_http_json("/get_transaction_pool_hashes.bin", req, res, rpc_timeout))
+          top_pool_hashes = std::move(res);
+      }
+      if (!last && scan_ahead)
+      {
+        std::shared_ptr<const subaddress_map> subaddresses;
+        {
+          boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+          subaddresses = scan_subaddresses;
+        }
+        try
+        {
+          scan_parsed_blocks(batch.parsed_blocks, view_secret_key, *subaddresses, batch.tx_cache);
+          batch.scanned = true;
+          batch.scanned_subaddresses = subaddresses->size();
+        }
+        catch (const std::exception &e)
+        {
+          // scanned again when the batch is processed, which reports the error
+          batch.tx_cache.clear();
+        }
+      }
+
+      prev_block_hashes.clear();
+      for (size_t i = batch.parsed_blocks.size() > 3 ? batch.parsed_blocks.size() - 3 : 0; i < batch.parsed_blocks.size(); ++i)
+        prev_block_hashes.push_back(batch.parsed_blocks[i].hash);
+      prev_start_height = batch.start_height;
+      have_prev = true;
+
+      boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+      while (!pipeline_stop && ready_batches.size() >= pipeline_depth)
+        pipeline_cond.wait(lock);
+      if (pipeline_stop)
+        return;
+      ready_batches.push_back(std::move(batch));
+      pool_hashes = std::move(top_pool_hashes);
+      pipeline_done = last;
+      pipeline_cond.notify_all();
+      if (last)
+        return;
+    }
+  };
+
+  auto start_pipeline = [&]() {
+    ready_batches.clear();
+    pool_hashes = boost::none;
+    pipeline_stop = pipeline_done = false;
+    scan_subaddresses = std::make_shared<const subaddress_map>(m_subaddresses);
+    const uint64_t height = start_height;
+    boost::thread::attributes attrs;
+    attrs.set_stack_size(THREAD_STACK_SIZE);
+    producer = boost::thread(attrs, [&, height]() {
+      try
+      {
+        produce(height);
+      }
+      catch (...)
+      {
+        boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+        ready_batches.emplace_back();
+        ready_batches.back().error = true;
+        pipeline_done = true;
+        pipeline_cond.notify_all();
+      }
+    });
+  };
+
+  auto stop_pipeline = [&]() {
+    {
+      boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+      pipeline_stop = true;
+      pipeline_cond.notify_all();
+    }
+    if (producer.joinable())
+      producer.join();
+    ready_batches.clear();
+  };
+
+  auto next_batch = [&](refresh_batch &batch) {
+    boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+    while (ready_batches.empty() && !pipeline_done)
+      pipeline_cond.wait(lock);
+    if (ready_batches.empty())
+      return false;
+    batch = std::move(ready_batches.front());
+    ready_batches.pop_front();
+    pipeline_cond.notify_all();
+    return true;
+  };
+
+  start_pipeline();
+  auto pipeline_stopper = epee::misc_utils::create_scope_leave_handler(stop_pipeline);
+
+  refresh_batch batch, next;
   bool first = true;
   while(m_run.load(std::memory_order_relaxed))
   {
     try
     {
-      // pull the next set of blocks while we're processing the current one
-      uint64_t next_blocks_start_height;
-      std::vector<cryptonote::block_complete_entry> next_blocks;
-      std::vector<parsed_block> next_parsed_blocks;
-      bool error = false;
       added_blocks = 0;
-      if (!first && blocks.empty())
+      if (first)
+      {
+        if (!next_batch(batch))
+          break;
+        first = false;
+
+        // handle error from async fetching thread
+        if (batch.error)
+        {
+          throw std::runtime_error("proxy exception in refresh thread");
+        }
+      }
+      if (batch.blocks.empty())
       {
         refreshed = false;
         break;
       }
-      tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error);});
 
-      if (!first)
+      if (!batch.scanned)
+        scan_parsed_blocks(batch.parsed_blocks, m_account.get_keys().m_view_secret_key, m_subaddresses, batch.tx_cache);
+      else if (batch.scanned_subaddresses != m_subaddresses.size())
+        // subaddresses were added by the batches processed meanwhile, check the outputs against them too
+        scan_parsed_blocks_outputs(batch.parsed_blocks, m_subaddresses, batch.tx_cache);
+
+      try
       {
-        try
-        {
-          process_parsed_blocks(blocks_start_height, blocks, parsed_blocks, added_blocks);
-        }
-        catch (const tools::error::out_of_hashchain_bounds_error&)
-        {
-          MINFO("Daemon claims next refresh block is out of hash chain bounds, resetting hash chain");
-          uint64_t stop_height = m_blockchain.offset();
-          std::vector<crypto::hash> tip(m_blockchain.size() - m_blockchain.offset());
-          for (size_t i = m_blockchain.offset(); i < m_blockchain.size(); ++i)
-            tip[i - m_blockchain.offset()] = m_blockchain[i];
-          cryptonote::block b;
-          generate_genesis(b);
-          m_blockchain.clear();
-          m_blockchain.push_back(get_block_hash(b));
-          short_chain_history.clear();
-          get_short_chain_history(short_chain_history);
-          fast_refresh(stop_height, blocks_start_height, short_chain_history, true);
-          THROW_WALLET_EXCEPTION_IF(m_blockchain.size() != stop_height, error::wallet_internal_error, "Unexpected hashchain size");
-          THROW_WALLET_EXCEPTION_IF(m_blockchain.offset() != 0, error::wallet_internal_error, "Unexpected hashchain offset");
-          for (const auto &h: tip)
-            m_blockchain.push_back(h);
-          short_chain_history.clear();
-          get_short_chain_history(short_chain_history);
-          start_height = stop_height;
-          throw std::runtime_error(""); // loop again
-        }
-        blocks_fetched += added_blocks;
+        process_parsed_blocks(batch.start_height, batch.blocks, batch.parsed_blocks, batch.tx_cache, added_blocks);
       }
-      waiter.wait(&tpool);
-      if(!first && blocks_start_height == next_blocks_start_height)
+      catch (const tools::error::out_of_hashchain_bounds_error&)
+      {
+        MINFO("Daemon claims next refresh block is out of hash chain bounds, resetting hash chain");
+        stop_pipeline();
+        uint64_t stop_height = m_blockchain.offset();
+        std::vector<crypto::hash> tip(m_blockchain.size() - m_blockchain.offset());
+        for (size_t i = m_blockchain.offset(); i < m_blockchain.size(); ++i)
+          tip[i - m_blockchain.offset()] = m_blockchain[i];
+        cryptonote::block b;
+        generate_genesis(b);
+        m_blockchain.clear();
+        m_blockchain.push_back(get_block_hash(b));
+        short_chain_history.clear();
+        get_short_chain_history(short_chain_history);
+        fast_refresh(stop_height, blocks_start_height, short_chain_history, true);
+        THROW_WALLET_EXCEPTION_IF(m_blockchain.size() != stop_height, error::wallet_internal_error, "Unexpected hashchain size");
+        THROW_WALLET_EXCEPTION_IF(m_blockchain.offset() != 0, error::wallet_internal_error, "Unexpected hashchain offset");
+        for (const auto &h: tip)
+          m_blockchain.push_back(h);
+        short_chain_history.clear();
+        get_short_chain_history(short_chain_history);
+        start_height = stop_height;
+        throw std::runtime_error(""); // loop again
+      }
+      blocks_fetched += added_blocks;
+      added_blocks = 0;
+
+      if (scan_subaddresses->size() != m_subaddresses.size())
+      {
+        std::shared_ptr<const subaddress_map> subaddresses = std::make_shared<const subaddress_map>(m_subaddresses);
+        boost::unique_lock<boost::mutex> lock(pipeline_mutex);
+        scan_subaddresses = subaddresses;
+      }
+
+      if (!next_batch(next))
+        break;
+      if(batch.start_height == next.start_height)
       {
         m_node_rpc_proxy.set_height(m_blockchain.size());
         refreshed = true;
         break;
       }
 
-      first = false;
-
       // handle error from async fetching thread
-      if (error)
+      if (next.error)
       {
         throw std::runtime_error("proxy exception in refresh thread");
       }
 
       // switch to the new blocks from the daemon
-      blocks_start_height = next_blocks_start_height;
-      blocks = std::move(next_blocks);
-      parsed_blocks = std::move(next_parsed_blocks);
+      batch = std::move(next);
     }
     catch (const tools::error::password_needed&)
     {
       blocks_fetched += added_blocks;
-      waiter.wait(&tpool);
+      stop_pipeline();
       throw;
     }
     catch (const std::exception&)
     {
       blocks_fetched += added_blocks;
-      waiter.wait(&tpool);
+      stop_pipeline();
       if(try_count < 3)
       {
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
         first = true;
         start_height = 0;
-        blocks.clear();
-        parsed_blocks.clear();
         short_chain_history.clear();
         get_short_chain_history(short_chain_history, 1);
         ++try_count;
+        start_pipeline();
       }
       else
       {
@@ -2794,13 +3188,25 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   {
     // If stop() is called we don't need to check pending transactions
     if(m_run.load(std::memory_order_relaxed))
-      update_pool_state(refreshed);
+      update_pool_state(refreshed, refreshed && pool_hashes ? &*pool_hashes : NULL);
   }
   catch (...)
   {
     LOG_PRINT_L1("Failed to check pending transactions");
   }
 
+  try
+  {
+    // keep the decoy distribution of a wallet which has sent before current, so building
+    // transactions doesn't wait for it
+    if(m_run.load(std::memory_order_relaxed) && !m_rct_distribution.empty())
+      update_rct_distribution();
+  }
+  catch (...)
+  {
+    LOG_PRINT_L1("Failed to update the output distribution");
+  }
+
   m_first_refresh_done = true;
 
   LOG_PRINT_L1("Refresh done, blocks received: " << blocks_fetched << ", balance (all accounts): " << print_money(balance_all()) << ", unlocked: " << print_money(unlocked_balance_all()));
@@ -2849,10 +3255,27 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     }
   }
 
+  if (!update_rct_distribution())
+    return false;
+  start_height = m_rct_distribution_start_height;
+  distribution = m_rct_distribution;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::update_rct_distribution()
+{
+  // the distribution is cumulative, so only the blocks since the last update (and a few before, which
+  // a reorg may have changed) are requested
+  uint64_t height;
+  const bool have_height = !m_node_rpc_proxy.get_height(height);
+  const uint64_t cached_end = m_rct_distribution_start_height + m_rct_distribution.size();
+  if (!m_rct_distribution.empty() && have_height && cached_end >= height)
+    return true;
+
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response res = AUTO_VAL_INIT(res);
   req.amounts.push_back(0);
-  req.from_height = 0;
+  req.from_height = m_rct_distribution.empty() ? 0 : std::max(m_rct_distribution_start_height, cached_end - std::min<uint64_t>(cached_end, RCT_DISTRIBUTION_REFETCH_BLOCKS));
   req.cumulative = true;
   req.binary = true;
   m_daemon_rpc_mutex.lock();
@@ -2883,14 +3306,30 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     MWARNING("Failed to request output distribution: results are not for amount 0");
     return false;
   }
-  start_height = res.distributions[0].start_height;
-  distribution = std::move(res.distributions[0].distribution);
+  cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::distribution &d = res.distributions[0];
+  if (req.from_height == 0)
+  {
+    m_rct_distribution_start_height = d.start_height;
+    m_rct_distribution = std::move(d.distribution);
+  }
+  else if (d.start_height == req.from_height)
+  {
+    m_rct_distribution.resize(req.from_height - m_rct_distribution_start_height);
+    m_rct_distribution.insert(m_rct_distribution.end(), d.distribution.begin(), d.distribution.end());
+  }
+  else
+  {
+    MWARNING("Unexpected output distribution start height " << d.start_height << ", requesting the whole distribution");
+    m_rct_distribution.clear();
+    return update_rct_distribution();
+  }
   return true;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::detach_blockchain(uint64_t height)
 {
   LOG_PRINT_L0("Detaching blockchain on height " << height);
+  m_node_rpc_proxy.invalidate_from_height(height);
 
   // size  1 2 3 4 5 6 7 8 9
   // block 0 1 2 3 4 5 6 7 8
@@ -2927,16 +3366,26 @@ void wallet2::detach_blockchain(uint64_t height)
     auto it_pk = m_pub_keys.find(m_transfers[i].get_public_key());
     THROW_WALLET_EXCEPTION_IF(it_pk == m_pub_keys.end(), error::wallet_internal_error, "public key not found");
     m_pub_keys.erase(it_pk);
+    unindex_transfer(i);
   }
   m_transfers.erase(it, m_transfers.end());
 
   size_t blocks_detached = m_blockchain.size() - height;
   m_blockchain.crop(height);
 
+  if (height <= m_rct_distribution_start_height)
+    m_rct_distribution.clear();
+  else if (height - m_rct_distribution_start_height < m_rct_distribution.size())
+    m_rct_distribution.resize(height - m_rct_distribution_start_height);
+
+  load_payments();
   for (auto it = m_payments.begin(); it != m_payments.end(); )
   {
     if(height <= it->second.m_block_height)
+    {
       it = m_payments.erase(it);
+      reset_payments_log();
+    }
     else
       ++it;
   }
@@ -2963,20 +3412,30 @@ bool wallet2::clear()
 {
   m_blockchain.clear();
   m_transfers.clear();
+  m_unspent_transfers.clear();
+  m_rct_distribution.clear();
   m_key_images.clear();
   m_pub_keys.clear();
   m_unconfirmed_txs.clear();
   m_payments.clear();
+  m_payments_log_id = crypto::null_hash;
+  m_payments_log_size = 0;
+  m_payments_log_file.clear();
+  m_payments_log_pending.clear();
+  m_payments_log_unloaded = 0;
   m_tx_keys.clear();
   m_additional_tx_keys.clear();
   m_confirmed_txs.clear();
   m_unconfirmed_payments.clear();
   m_scanned_pool_txs[0].clear();
   m_scanned_pool_txs[1].clear();
+  m_pool_cookie = 0;
+  m_pool_tx_hashes.clear();
   m_address_book.clear();
   m_subaddresses.clear();
   m_subaddress_labels.clear();
   m_multisig_rounds_passed = 0;
+  m_key_image_export_offset = 0;
   return true;
 }
 
@@ -4739,6 +5198,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
       error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
 #endif
   }
+  rebuild_transfer_index();
 
   cryptonote::block genesis;
   generate_genesis(genesis);
@@ -4771,6 +5231,12 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
 //----------------------------------------------------------------------------------------------------
 void wallet2::load_cache(const string &cache_filename)
 {
+  m_payments_log_id = crypto::null_hash;
+  m_payments_log_size = 0;
+  m_payments_log_file.clear();
+  m_payments_log_pending.clear();
+  m_payments_log_unloaded = 0;
+
   wallet2::cache_file_data cache_file_data;
   std::string buf;
   bool r = epee::file_io_utils::load_file_to_string(cache_filename, buf, std::numeric_limits<size_t>::max());
@@ -4853,6 +5319,30 @@ void wallet2::load_cache(const string &cache_filename)
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
         error::wallet_files_doesnt_correspond, m_keys_file, cache_filename);
+
+  if (m_payments_log_size != 0)
+  {
+    // only check the log here, its payments are read on first use
+    m_payments_log_file = cache_filename + ".payments";
+    const std::string new_log_file = m_payments_log_file + ".new";
+    crypto::hash id;
+    uint64_t size;
+
+    // a store interrupted after replacing the cache leaves the rewritten log next to the old one
+    if ((!cache_log::read_id(m_payments_log_file, id, size) || id != m_payments_log_id) &&
+        cache_log::read_id(new_log_file, id, size) && id == m_payments_log_id)
+    {
+      std::error_code e = tools::replace_file(new_log_file, m_payments_log_file);
+      THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_payments_log_file, e);
+    }
+
+    r = cache_log::read_id(m_payments_log_file, id, size);
+    THROW_WALLET_EXCEPTION_IF(!r || id != m_payments_log_id || size < m_payments_log_size, error::wallet_internal_error,
+        "Payments log " + m_payments_log_file + " doesn't match the wallet cache, remove the wallet cache to rescan the blockchain");
+    m_payments_log_unloaded = m_payments_log_size;
+  }
+
+  rebuild_transfer_index();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::trim_hashchain()
@@ -4980,6 +5470,10 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     if (!r) {
       LOG_ERROR("error removing file: " << old_file);
     }
+    // the payments log stays with the old wallet file, the next store writes a new one from memory
+    load_payments();
+    boost::system::error_code ec;
+    boost::filesystem::remove(old_file + ".payments", ec);
     // remove old keys file
     r = boost::filesystem::remove(old_keys_file);
     if (!r) {
@@ -4991,7 +5485,7 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
       LOG_ERROR("error removing file: " << old_address_file);
     }
   } else {
-    store_cache(new_file);
+    const bool payments_log_rewritten = store_cache(new_file, m_wallet_file + ".payments");
     //MONERO specific
 #if 0
     // save to new file
@@ -5018,11 +5512,51 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     // here we have "*.new" file, we need to rename it to be without ".new"
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
+
+    // the cache refers to the rewritten payments log now, if this fails load_cache finishes the rename
+    if (payments_log_rewritten)
+    {
+      e = tools::replace_file(m_payments_log_file + ".new", m_payments_log_file);
+      THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_payments_log_file, e);
+    }
   }
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::store_cache(const string &filename)
 {
+  store_cache(filename, std::string());
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::store_cache(const string &filename, const std::string &payments_log_file)
+{
+  const crypto::hash payments_log_id = m_payments_log_id;
+  const uint64_t payments_log_size = m_payments_log_size;
+  bool payments_log_rewritten = false;
+
+  if (payments_log_file.empty())
+  {
+    // payments are stored inline, without touching the log the wallet file may have
+    load_payments();
+    m_payments_log_id = crypto::null_hash;
+    m_payments_log_size = 0;
+  }
+  else if (!store_payments_log(payments_log_file, payments_log_rewritten))
+  {
+    MERROR("Failed to store payments log " << payments_log_file << ", storing payments inline");
+    load_payments();
+    m_payments_log_id = crypto::null_hash;
+    m_payments_log_size = 0;
+    m_payments_log_pending.clear();
+  }
+
+  auto payments_log_restorer = epee::misc_utils::create_scope_leave_handler([&, this]() {
+    if (payments_log_file.empty())
+    {
+      m_payments_log_id = payments_log_id;
+      m_payments_log_size = payments_log_size;
+    }
+  });
+
   // preparing wallet data
   std::stringstream oss;
   boost::archive::portable_binary_oarchive ar(oss);
@@ -5054,6 +5588,109 @@ void wallet2::store_cache(const string &filename)
     ostr.close();
     THROW_WALLET_EXCEPTION_IF(!success || !ostr.good(), error::file_save_error, filename);
 #endif
+
+  return payments_log_rewritten;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::store_payments_log(const std::string &log_file, bool &rewritten)
+{
+  rewritten = false;
+
+  if (m_payments_log_size != 0 && log_file == m_payments_log_file)
+  {
+    if (m_payments_log_pending.empty())
+      return true;
+
+    std::vector<std::string> payloads;
+    for (size_t i = 0; i < m_payments_log_pending.size(); i += PAYMENTS_LOG_SEGMENT_RECORDS)
+    {
+      const size_t end = std::min<size_t>(i + PAYMENTS_LOG_SEGMENT_RECORDS, m_payments_log_pending.size());
+      payloads.push_back(serialize_payments(std::vector<std::pair<crypto::hash, payment_details>>(m_payments_log_pending.begin() + i, m_payments_log_pending.begin() + end)));
+    }
+    if (cache_log::append(log_file, m_cache_key, m_payments_log_id, m_payments_log_size, payloads))
+    {
+      m_payments_log_pending.clear();
+      return true;
+    }
+    MWARNING("Failed to append to payments log " << log_file << ", rewriting it");
+  }
+
+  // no log yet, payments were removed or the log moves: write all of them to a new log, which replaces
+  // the current one only once the cache referring to it is stored
+  load_payments();
+
+  const std::string new_log_file = log_file + ".new";
+  const crypto::hash id = crypto::rand<crypto::hash>();
+  uint64_t size = cache_log::header_size();
+  if (!cache_log::create(new_log_file, id))
+    return false;
+
+  std::vector<std::pair<crypto::hash, payment_details>> segment;
+  segment.reserve(std::min<size_t>(m_payments.size(), PAYMENTS_LOG_SEGMENT_RECORDS));
+  for (auto i = m_payments.begin(); i != m_payments.end(); )
+  {
+    segment.push_back(*i++);
+    if (segment.size() == PAYMENTS_LOG_SEGMENT_RECORDS || i == m_payments.end())
+    {
+      if (!cache_log::append(new_log_file, m_cache_key, id, size, {serialize_payments(segment)}))
+        return false;
+      segment.clear();
+    }
+  }
+
+  m_payments_log_id = id;
+  m_payments_log_size = size;
+  m_payments_log_file = log_file;
+  m_payments_log_pending.clear();
+  rewritten = true;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_payments() const
+{
+  if (m_payments_log_unloaded == 0)
+    return;
+
+  payment_container payments;
+  bool r = cache_log::read(m_payments_log_file, m_cache_key, m_payments_log_id, m_payments_log_unloaded, [&payments](const std::string &payload) {
+    std::vector<std::pair<crypto::hash, payment_details>> segment;
+    try
+    {
+      std::stringstream iss;
+      iss << payload;
+      boost::archive::portable_binary_iarchive ar(iss);
+      ar >> segment;
+    }
+    catch (...)
+    {
+      return false;
+    }
+    for (auto &p: segment)
+      payments.emplace(std::move(p));
+    return true;
+  });
+  THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to load payments from " + m_payments_log_file + ", remove the wallet cache to rescan the blockchain");
+
+  // payments received since the cache was loaded are in m_payments already
+  for (auto &p: payments)
+    m_payments.emplace(std::move(p));
+  m_payments_log_unloaded = 0;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_payment(const crypto::hash &payment_id, const payment_details &payment)
+{
+  m_payments.emplace(payment_id, payment);
+  if (m_payments_log_size != 0)
+    m_payments_log_pending.emplace_back(payment_id, payment);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::reset_payments_log()
+{
+  // the log can only be appended to, so the next store rewrites it from m_payments
+  THROW_WALLET_EXCEPTION_IF(m_payments_log_unloaded != 0, error::wallet_internal_error, "Payments must be loaded before they are removed");
+  m_payments_log_id = crypto::null_hash;
+  m_payments_log_size = 0;
+  m_payments_log_pending.clear();
 }
 //----------------------------------------------------------------------------------------------------
 // TODO: implement till_block
@@ -5080,10 +5717,12 @@ uint64_t wallet2::unlocked_balance(uint32_t index_major/*, uint64_t till_block*/
 std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_major) const
 {
   std::map<uint32_t, uint64_t> amount_per_subaddr;
-  for (const auto& td: m_transfers)
+  const auto unspent = m_unspent_transfers.find(index_major);
+  if (unspent != m_unspent_transfers.end())
   {
-    if (td.m_subaddr_index.major == index_major && !td.m_spent)
+    for (size_t idx: unspent->second)
     {
+      const transfer_details& td = m_transfers[idx];
         // TODO:
 //      if (till_block > 0 && td.m_block_height > till_block)
 //            break;
@@ -5112,9 +5751,13 @@ std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_majo
 std::map<uint32_t, uint64_t> wallet2::unlocked_balance_per_subaddress(uint32_t index_major/*, uint64_t till_block*/) const
 {
   std::map<uint32_t, uint64_t> amount_per_subaddr;
-  for(const transfer_details& td: m_transfers)
+  const auto unspent = m_unspent_transfers.find(index_major);
+  if (unspent == m_unspent_transfers.end())
+    return amount_per_subaddr;
+  for(size_t idx: unspent->second)
   {
-    if(td.m_subaddr_index.major == index_major && !td.m_spent && is_transfer_unlocked(td))
+    const transfer_details& td = m_transfers[idx];
+    if(is_transfer_unlocked(td))
     {
         // TODO:
 //      if (till_block > 0 && td.m_block_height > till_block)
@@ -5162,6 +5805,7 @@ void wallet2::get_transfers(wallet2::transfer_container& incoming_transfers) con
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
+  load_payments();
   auto range = m_payments.equal_range(payment_id);
   std::for_each(range.first, range.second, [&payments, &min_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
     if (min_height < x.second.m_block_height &&
@@ -5175,6 +5819,7 @@ void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::pa
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
+  load_payments();
   auto range = std::make_pair(m_payments.begin(), m_payments.end());
   std::for_each(range.first, range.second, [&payments, &min_height, &max_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
     if (min_height < x.second.m_block_height && max_height >= x.second.m_block_height &&
@@ -5222,19 +5867,38 @@ void wallet2::get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2:
 //----------------------------------------------------------------------------------------------------
 void wallet2::rescan_spent()
 {
+  // Only outputs whose status can still change are asked about: the unspent ones, and the spent
+  // ones whose spend is in the pool, at an unknown height or recent enough to be reorged away.
+  // An output found spent at an unknown height is given the height it was checked at, so a reorg
+  // below that marks it unspent again and it gets checked again on the next call
+  std::string err;
+  const uint64_t daemon_height = get_daemon_blockchain_height(err);
+  const uint64_t height = std::max<uint64_t>(get_blockchain_current_height(), err.empty() ? daemon_height : 0);
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+  {
+    const transfer_details& td = m_transfers[i];
+    // a view wallet may not know about key images
+    if (!td.m_key_image_known || td.m_key_image_partial)
+      continue;
+    if (td.m_spent && td.m_spent_height && td.m_spent_height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= height)
+      continue;
+    indices.push_back(i);
+  }
+  MDEBUG("Checking " << indices.size() << " of " << m_transfers.size() << " outputs for spends at height " << height);
+
   // This is RPC call that can take a long time if there are many outputs,
   // so we call it several times, in stripes, so we don't time out spuriously
-  std::vector<int> spent_status;
-  spent_status.reserve(m_transfers.size());
   const size_t chunk_size = 1000;
-  for (size_t start_offset = 0; start_offset < m_transfers.size(); start_offset += chunk_size)
+  for (size_t start_offset = 0; start_offset < indices.size(); start_offset += chunk_size)
   {
-    const size_t n_outputs = std::min<size_t>(chunk_size, m_transfers.size() - start_offset);
-    MDEBUG("Calling is_key_image_spent on " << start_offset << " - " << (start_offset + n_outputs - 1) << ", out of " << m_transfers.size());
+    const size_t n_outputs = std::min<size_t>(chunk_size, indices.size() - start_offset);
+    MDEBUG("Calling is_key_image_spent on " << start_offset << " - " << (start_offset + n_outputs - 1) << ", out of " << indices.size());
     COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
     COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
+    req.key_images.reserve(n_outputs);
     for (size_t n = start_offset; n < start_offset + n_outputs; ++n)
-      req.key_images.push_back(string_tools::pod_to_hex(m_transfers[n].m_key_image));
+      req.key_images.push_back(string_tools::pod_to_hex(m_transfers[indices[n]].m_key_image));
     m_daemon_rpc_mutex.lock();
     bool r = epee::net_utils::invoke_http_json("/is_key_image_spent", req, daemon_resp, m_http_client, rpc_timeout);
     m_daemon_rpc_mutex.unlock();
@@ -5244,30 +5908,30 @@ void wallet2::rescan_spent()
     THROW_WALLET_EXCEPTION_IF(daemon_resp.spent_status.size() != n_outputs, error::wallet_internal_error,
       "daemon returned wrong response for is_key_image_spent, wrong amounts count = " +
       std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(n_outputs));
-    std::copy(daemon_resp.spent_status.begin(), daemon_resp.spent_status.end(), std::back_inserter(spent_status));
-  }
 
-  // update spent status
-  for (size_t i = 0; i < m_transfers.size(); ++i)
-  {
-    transfer_details& td = m_transfers[i];
-    // a view wallet may not know about key images
-    if (!td.m_key_image_known || td.m_key_image_partial)
-      continue;
-    if (td.m_spent != (spent_status[i] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT))
+    // update spent status
+    for (size_t n = 0; n < n_outputs; ++n)
     {
-      if (td.m_spent)
+      const size_t i = indices[start_offset + n];
+      transfer_details& td = m_transfers[i];
+      const int status = daemon_resp.spent_status[n];
+      if (status == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT)
       {
-        LOG_PRINT_L0("Marking output " << i << "(" << td.m_key_image << ") as unspent, it was marked as spent");
-        set_unspent(i);
-        td.m_spent_height = 0;
+        if (td.m_spent)
+        {
+          LOG_PRINT_L0("Marking output " << i << "(" << td.m_key_image << ") as unspent, it was marked as spent");
+          set_unspent(i);
+        }
+        continue;
       }
-      else
-      {
+      if (!td.m_spent)
         LOG_PRINT_L0("Marking output " << i << "(" << td.m_key_image << ") as spent, it was marked as unspent");
-        set_spent(i, td.m_spent_height);
-        // unknown height, if this gets reorged, it might still be missed
-      }
+      // a spend in the pool has no height yet, and is checked again until it's mined
+      uint64_t spent_height = 0;
+      if (status == COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN)
+        spent_height = td.m_spent && td.m_spent_height ? td.m_spent_height : height;
+      if (!td.m_spent || td.m_spent_height != spent_height)
+        set_spent(i, spent_height);
     }
   }
 }
@@ -6688,6 +7352,15 @@ bool wallet2::set_ring(const crypto::key_image &key_image, const std::vector<uin
   catch (const std::exception &e) { return false; }
 }
 
+bool wallet2::set_rings(const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings, bool relative)
+{
+  if (!m_ringdb)
+    return false;
+
+  try { return m_ringdb->set_rings(get_ringdb_key(), rings, relative); }
+  catch (const std::exception &e) { return false; }
+}
+
 bool wallet2::find_and_save_rings(bool force)
 {
   if (!force && m_ring_history_saved)
@@ -6736,6 +7409,9 @@ bool wallet2::find_and_save_rings(bool force)
 
     MDEBUG("Scanning " << res.txs.size() << " transactions");
     THROW_WALLET_EXCEPTION_IF(slice + res.txs.size() > txs_hashes.size(), error::wallet_internal_error, "Unexpected tx array size");
+    // the rings of the whole slice are saved in a single database transaction
+    std::vector<cryptonote::transaction> txs(res.txs.size());
+    std::vector<const cryptonote::transaction_prefix*> tx_prefixes;
     auto it = req.txs_hashes.begin();
     for (size_t i = 0; i < res.txs.size(); ++i, ++it)
     {
@@ -6744,12 +7420,13 @@ bool wallet2::find_and_save_rings(bool force)
     THROW_WALLET_EXCEPTION_IF(tx_info.tx_hash != *it, error::wallet_internal_error, "Wrong txid received");
     cryptonote::blobdata bd;
     THROW_WALLET_EXCEPTION_IF(!epee::string_tools::parse_hexstr_to_binbuff(tx_info.as_hex, bd), error::wallet_internal_error, "failed to parse tx from hexstr");
-    cryptonote::transaction tx;
+    cryptonote::transaction &tx = txs[i];
     crypto::hash tx_hash, tx_prefix_hash;
     THROW_WALLET_EXCEPTION_IF(!cryptonote::parse_and_validate_tx_from_blob(bd, tx, tx_hash, tx_prefix_hash), error::wallet_internal_error, "failed to parse tx from blob");
     THROW_WALLET_EXCEPTION_IF(epee::string_tools::pod_to_hex(tx_hash) != tx_info.tx_hash, error::wallet_internal_error, "txid mismatch");
-    THROW_WALLET_EXCEPTION_IF(!add_rings(get_ringdb_key(), tx), error::wallet_internal_error, "Failed to save ring");
+    tx_prefixes.push_back(&tx);
     }
+    THROW_WALLET_EXCEPTION_IF(!m_ringdb->add_rings(get_ringdb_key(), tx_prefixes), error::wallet_internal_error, "Failed to save rings");
   }
 
   MINFO("Found and saved rings for " << txs_hashes.size() << " transactions");
@@ -7015,9 +7692,7 @@ void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>>
       req_t.to_height = segregation_fork_height + 1;
       req_t.cumulative = true;
       req_t.binary = true;
-      m_daemon_rpc_mutex.lock();
-      bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_output_distribution", req_t, resp_t, m_http_client, rpc_timeout * 1000);
-      m_daemon_rpc_mutex.unlock();
+      bool r = m_node_rpc_proxy.get_output_distribution(req_t, resp_t, rpc_timeout * 1000);
       THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "transfer_selected");
       THROW_WALLET_EXCEPTION_IF(resp_t.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_output_distribution");
       THROW_WALLET_EXCEPTION_IF(resp_t.status != CORE_RPC_STATUS_OK, error::get_output_distribution, resp_t.status);
@@ -8134,6 +8809,7 @@ void wallet2::light_wallet_get_unspent_outs()
   
   // Clear old outputs
   m_transfers.clear();
+  m_unspent_transfers.clear();
   
   for (const auto &o: ores.outputs) {
     bool spent = false;
@@ -8247,6 +8923,7 @@ void wallet2::light_wallet_get_unspent_outs()
     m_key_images[td.m_key_image] = m_transfers.size()-1;
     m_pub_keys[td.get_public_key()] = m_transfers.size()-1;
   }
+  rebuild_transfer_index();
 }
 
 bool wallet2::light_wallet_get_address_info(cryptonote::COMMAND_RPC_GET_ADDRESS_INFO::response &response)
@@ -8288,6 +8965,7 @@ void wallet2::light_wallet_get_address_txs()
   
   // Create searchable vectors
   std::vector<crypto::hash> payments_txs;
+  load_payments();
   for(const auto &p: m_payments)
     payments_txs.push_back(p.second.m_tx_hash);
   std::vector<crypto::hash> unconfirmed_payments_txs;
@@ -8372,7 +9050,7 @@ void wallet2::light_wallet_get_address_txs()
         }
       } else {
         if (std::find(payments_txs.begin(), payments_txs.end(), tx_hash) == payments_txs.end()) {
-          m_payments.emplace(tx_hash, payment);
+          add_payment(tx_hash, payment);
           if (0 != m_callback) {
             m_callback->on_lw_money_received(t.height, payment.m_tx_hash, payment.m_amount);
           }
@@ -8537,6 +9215,45 @@ bool wallet2::light_wallet_key_image_is_ours(const crypto::key_image& key_image,
 // This system allows for sending (almost) the entire balance, since it does
 // not generate spurious change in all txes, thus decreasing the instantaneous
 // usable balance.
+std::vector<wallet2::transfer_batch_result> wallet2::create_transactions_batch(const std::vector<transfer_batch_entry>& entries, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices)
+{
+  std::vector<transfer_batch_result> results(entries.size());
+  std::vector<size_t> reserved;
+
+  // transfers selected for a group are marked spent till all groups are planned, commit_tx marks them for good
+  auto release_reserved = epee::misc_utils::create_scope_leave_handler([&]() {
+    for (size_t idx: reserved)
+      set_unspent(idx);
+  });
+
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    try
+    {
+      results[i].ptx_vector = create_transactions_2(entries[i].dsts, fake_outs_count, unlock_time, priority, entries[i].extra, subaddr_account, subaddr_indices);
+    }
+    catch (...)
+    {
+      results[i].error = std::current_exception();
+      continue;
+    }
+
+    for (const pending_tx& ptx: results[i].ptx_vector)
+    {
+      for (size_t idx: ptx.selected_transfers)
+      {
+        if (!m_transfers[idx].m_spent)
+        {
+          set_spent(idx, 0);
+          reserved.push_back(idx);
+        }
+      }
+    }
+  }
+
+  return results;
+}
+//----------------------------------------------------------------------------------------------------
 std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryptonote::tx_destination_entry> dsts, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra, uint32_t subaddr_account, std::set<uint32_t> subaddr_indices, bool rta_tx_fee)
 {
   //ensure device is let in NONE mode in any case
@@ -8600,6 +9317,10 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   const uint64_t fee_multiplier = get_fee_multiplier(priority, get_fee_algorithm());
   const uint64_t fee_quantization_mask = get_fee_quantization_mask();
 
+  // txes are planned with estimated fees and only built once they are all planned, side by side,
+  // which needs a device whose key operations can run on several threads at once
+  const bool parallel_construction = m_parallel_tx_construction && use_rct && !m_multisig && hwdev.get_type() == hw::device::SOFTWARE;
+
   // throw if attempting a transaction with no destinations
   THROW_WALLET_EXCEPTION_IF(dsts.empty(), error::zero_destination);
 
@@ -8893,7 +9614,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
       cryptonote::transaction test_tx;
       pending_tx test_ptx;
 
-      needed_fee = estimate_fee(use_per_byte_fee, use_rct ,tx.selected_transfers.size(), fake_outs_count, tx.dsts.size()+1, extra.size(), bulletproof, base_fee, fee_multiplier, fee_multiplier, rta_tx_fee);
+      needed_fee = estimate_fee(use_per_byte_fee, use_rct ,tx.selected_transfers.size(), fake_outs_count, tx.dsts.size()+1, extra.size(), bulletproof, base_fee, fee_multiplier, fee_quantization_mask, rta_tx_fee);
 
       uint64_t inputs = 0, outputs = needed_fee;
       for (size_t idx: tx.selected_transfers) inputs += m_transfers[idx].amount();
@@ -8906,6 +9627,25 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
         goto skip_tx;
       }
 
+      if (parallel_construction)
+      {
+        // the estimate errs on the large side, so the tx is kept as planned and built later
+        LOG_PRINT_L2("Planned a tx with " << tx.dsts.size() << " outputs and " << tx.selected_transfers.size() << " inputs, with " <<
+          print_money(needed_fee) << " estimated fee and " << print_money(inputs - outputs) << " change");
+        tx.weight = estimate_tx_weight(use_rct, tx.selected_transfers.size(), fake_outs_count, tx.dsts.size()+1, extra.size(), bulletproof);
+        tx.needed_fee = needed_fee;
+        accumulated_fee += needed_fee;
+        accumulated_change += inputs - outputs;
+        adding_fee = false;
+        if (!dsts.empty())
+        {
+          LOG_PRINT_L2("We have more to pay, starting another tx");
+          txes.push_back(TX());
+          original_output_index = 0;
+        }
+        goto skip_tx;
+      }
+
       LOG_PRINT_L2("Trying to create a tx now, with " << tx.dsts.size() << " outputs and " <<
         tx.selected_transfers.size() << " inputs");
       if (use_rct)
@@ -9012,7 +9752,75 @@ skip_tx:
     " total fee, " << print_money(accumulated_change) << " total change");
 
   hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-  for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
+  if (parallel_construction)
+  {
+    // decoys are requested for several planned txes at once
+    for (size_t first = 0; first < txes.size(); )
+    {
+      std::vector<size_t> batch_transfers;
+      size_t last = first;
+      while (last < txes.size() && (last == first || batch_transfers.size() + txes[last].selected_transfers.size() <= PARALLEL_TX_OUTS_BATCH_INPUTS))
+      {
+        batch_transfers.insert(batch_transfers.end(), txes[last].selected_transfers.begin(), txes[last].selected_transfers.end());
+        ++last;
+      }
+      std::vector<std::vector<tools::wallet2::get_outs_entry>> batch_outs;
+      get_outs(batch_outs, batch_transfers, fake_outs_count); // may throw
+      THROW_WALLET_EXCEPTION_IF(batch_outs.size() != batch_transfers.size(), error::wallet_internal_error, "Unexpected number of rings for planned txes");
+      size_t offset = 0;
+      for (; first < last; ++first)
+      {
+        TX &tx = txes[first];
+        tx.outs.assign(batch_outs.begin() + offset, batch_outs.begin() + offset + tx.selected_transfers.size());
+        offset += tx.selected_transfers.size();
+      }
+    }
+
+    // pin the weight limit so the workers don't ask the daemon for fork rules
+    const uint64_t weight_limit = m_upper_transaction_weight_limit;
+    m_upper_transaction_weight_limit = upper_transaction_weight_limit;
+    auto weight_limit_restorer = epee::misc_utils::create_scope_leave_handler([&]() { m_upper_transaction_weight_limit = weight_limit; });
+
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    std::vector<std::exception_ptr> errors(txes.size());
+    for (size_t n = 0; n < txes.size(); ++n)
+    {
+      tpool.submit(&waiter, [&, n]() {
+        TX &tx = txes[n];
+        try
+        {
+          transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, unlock_time, tx.needed_fee, extra,
+            tx.tx, tx.ptx, range_proof_type, tx_type);
+        }
+        catch (...)
+        {
+          errors[n] = std::current_exception();
+        }
+      }, true);
+    }
+    waiter.wait(&tpool);
+    for (const std::exception_ptr &e: errors)
+      if (e)
+        std::rethrow_exception(e);
+
+    for (TX &tx: txes)
+    {
+      auto txBlob = t_serializable_object_to_blob(tx.ptx.tx);
+      const uint64_t fee = calculate_fee(use_per_byte_fee, tx.ptx.tx, txBlob.size(), base_fee, fee_multiplier, fee_quantization_mask, rta_tx_fee);
+      if (fee > tx.needed_fee)
+      {
+        // should the estimate ever fall short, the difference comes out of the change
+        LOG_PRINT_L1("Estimated fee " << print_money(tx.needed_fee) << " is below the " << print_money(fee) << " needed, rebuilding tx");
+        tx.needed_fee = fee;
+        transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, unlock_time, tx.needed_fee, extra,
+          tx.tx, tx.ptx, range_proof_type, tx_type);
+        txBlob = t_serializable_object_to_blob(tx.ptx.tx);
+      }
+      tx.weight = get_transaction_weight(tx.ptx.tx, txBlob.size());
+    }
+  }
+  for (std::vector<TX>::iterator i = txes.begin(); !parallel_construction && i != txes.end(); ++i)
   {
     TX &tx = *i;
     cryptonote::transaction test_tx;
@@ -9437,18 +10245,20 @@ uint64_t wallet2::get_upper_transaction_weight_limit() const
 std::vector<size_t> wallet2::select_available_outputs(const std::function<bool(const transfer_details &td)> &f) const
 {
   std::vector<size_t> outputs;
-  size_t n = 0;
-  for (transfer_container::const_iterator i = m_transfers.begin(); i != m_transfers.end(); ++i, ++n)
+  for (const auto &unspent: m_unspent_transfers)
   {
-    if (i->m_spent)
-      continue;
-    if (i->m_key_image_partial)
-      continue;
-    if (!is_transfer_unlocked(*i))
-      continue;
-    if (f(*i))
-      outputs.push_back(n);
+    for (size_t n: unspent.second)
+    {
+      const transfer_details &td = m_transfers[n];
+      if (td.m_key_image_partial)
+        continue;
+      if (!is_transfer_unlocked(td))
+        continue;
+      if (f(td))
+        outputs.push_back(n);
+    }
   }
+  std::sort(outputs.begin(), outputs.end());
   return outputs;
 }
 //----------------------------------------------------------------------------------------------------
@@ -9535,6 +10345,14 @@ const wallet2::transfer_details &wallet2::get_transfer_details(size_t idx) const
   return m_transfers[idx];
 }
 //----------------------------------------------------------------------------------------------------
+std::vector<size_t> wallet2::get_unspent_transfers(uint32_t index_major) const
+{
+  const auto unspent = m_unspent_transfers.find(index_major);
+  if (unspent == m_unspent_transfers.end())
+    return {};
+  return std::vector<size_t>(unspent->second.begin(), unspent->second.end());
+}
+//----------------------------------------------------------------------------------------------------
 std::vector<size_t> wallet2::select_available_unmixable_outputs()
 {
   // request all outputs with less instances than the min ring size
@@ -9583,6 +10401,7 @@ void wallet2::discard_unmixable_outputs()
   std::vector<size_t> unmixable_outputs = select_available_unmixable_outputs();
   for (size_t idx : unmixable_outputs)
   {
+    unindex_transfer(idx);
     m_transfers[idx].m_spent = true;
   }
 }
@@ -10739,15 +11558,19 @@ crypto::public_key wallet2::get_tx_pub_key_from_received_outs(const tools::walle
   return crypto::null_pkey;
 }
 
-bool wallet2::export_key_images(const std::string &filename) const
+bool wallet2::export_key_images(const std::string &filename, bool all) const
 {
-  std::vector<std::pair<crypto::key_image, crypto::signature>> ski = export_key_images();
+  const size_t offset = all ? 0 : get_key_image_export_offset();
+  std::vector<std::pair<crypto::key_image, crypto::signature>> ski = export_key_images(offset);
   std::string magic(KEY_IMAGE_EXPORT_FILE_MAGIC, strlen(KEY_IMAGE_EXPORT_FILE_MAGIC));
   const cryptonote::account_public_address &keys = get_account().get_keys().m_account_address;
+  const uint64_t offset_le = SWAP64LE((uint64_t)offset);
 
   std::string data;
+  data.reserve(2 * sizeof(crypto::public_key) + sizeof(offset_le) + ski.size() * (sizeof(crypto::key_image) + sizeof(crypto::signature)));
   data += std::string((const char *)&keys.m_spend_public_key, sizeof(crypto::public_key));
   data += std::string((const char *)&keys.m_view_public_key, sizeof(crypto::public_key));
+  data += std::string((const char *)&offset_le, sizeof(offset_le));
   for (const auto &i: ski)
   {
     data += std::string((const char *)&i.first, sizeof(crypto::key_image));
@@ -10760,17 +11583,15 @@ bool wallet2::export_key_images(const std::string &filename) const
 }
 
 //----------------------------------------------------------------------------------------------------
-std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key_images() const
+std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key_images(size_t offset) const
 {
-  std::vector<std::pair<crypto::key_image, crypto::signature>> ski;
-
-  ski.reserve(m_transfers.size());
-  for (size_t n = 0; n < m_transfers.size(); ++n)
-  {
-    const transfer_details &td = m_transfers[n];
+  THROW_WALLET_EXCEPTION_IF(offset > m_transfers.size(), error::wallet_internal_error,
+      "Key image export offset is past the last transfer");
+  std::vector<std::pair<crypto::key_image, crypto::signature>> ski(m_transfers.size() - offset);
 
-    crypto::hash hash;
-    crypto::cn_fast_hash(&td.m_key_image, sizeof(td.m_key_image), hash);
+  // each key image is signed independently, the device is only shared when it's the software one
+  for_each_index(ski.size(), !key_on_device(), [&](size_t i) {
+    const transfer_details &td = m_transfers[offset + i];
 
     // get ephemeral public key
     const cryptonote::tx_out &out = td.m_tx.vout[td.m_internal_output_index];
@@ -10779,13 +11600,6 @@ std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key
     const cryptonote::txout_to_key &o = boost::get<const cryptonote::txout_to_key>(out.target);
     const crypto::public_key pkey = o.key;
 
-    // get tx pub key
-    std::vector<tx_extra_field> tx_extra_fields;
-    if(!parse_tx_extra(td.m_tx.extra, tx_extra_fields))
-    {
-      // Extra may only be partially parsed, it's OK if tx_extra_fields contains public key
-    }
-
     crypto::public_key tx_pub_key = get_tx_pub_key_from_received_outs(td);
     const std::vector<crypto::public_key> additional_tx_pub_keys = get_additional_tx_pub_keys_from_extra(td.m_tx);
 
@@ -10807,8 +11621,8 @@ std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key
 
     crypto::generate_ring_signature((const crypto::hash&)td.m_key_image, td.m_key_image, key_ptrs, in_ephemeral.sec, 0, &signature);
 
-    ski.push_back(std::make_pair(td.m_key_image, signature));
-  }
+    ski[i] = std::make_pair(td.m_key_image, signature);
+  });
   return ski;
 }
 
@@ -10819,8 +11633,10 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
 
   THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, std::string(tr("failed to read file ")) + filename);
 
+  // version 2 exports have no offset and start from the first transfer
   const size_t magiclen = strlen(KEY_IMAGE_EXPORT_FILE_MAGIC);
-  if (data.size() < magiclen || memcmp(data.data(), KEY_IMAGE_EXPORT_FILE_MAGIC, magiclen))
+  const bool has_offset = data.size() >= magiclen && !memcmp(data.data(), KEY_IMAGE_EXPORT_FILE_MAGIC, magiclen);
+  if (!has_offset && (data.size() < magiclen || memcmp(data.data(), KEY_IMAGE_EXPORT_FILE_MAGIC_V2, magiclen)))
   {
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Bad key image export file magic in ") + filename);
   }
@@ -10834,7 +11650,7 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Failed to decrypt ") + filename + ": " + e.what());
   }
 
-  const size_t headerlen = 2 * sizeof(crypto::public_key);
+  const size_t headerlen = 2 * sizeof(crypto::public_key) + (has_offset ? sizeof(uint64_t) : 0);
   THROW_WALLET_EXCEPTION_IF(data.size() < headerlen, error::wallet_internal_error, std::string("Bad data size from file ") + filename);
   const crypto::public_key &public_spend_key = *(const crypto::public_key*)&data[0];
   const crypto::public_key &public_view_key = *(const crypto::public_key*)&data[sizeof(crypto::public_key)];
@@ -10843,6 +11659,12 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
   {
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string( "Key images from ") + filename + " are for a different account");
   }
+  uint64_t offset = 0;
+  if (has_offset)
+  {
+    memcpy(&offset, &data[2 * sizeof(crypto::public_key)], sizeof(offset));
+    offset = SWAP64LE(offset);
+  }
 
   const size_t record_size = sizeof(crypto::key_image) + sizeof(crypto::signature);
   THROW_WALLET_EXCEPTION_IF((data.size() - headerlen) % record_size,
@@ -10859,16 +11681,21 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
     ski.push_back(std::make_pair(key_image, signature));
   }
   
-  return import_key_images(ski, spent, unspent);    
+  return import_key_images(ski, offset, spent, unspent);    
 }
 
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, uint64_t &spent, uint64_t &unspent, bool check_spent)
+{
+  return import_key_images(signed_key_images, 0, spent, unspent, check_spent);
+}
+//----------------------------------------------------------------------------------------------------
+uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, size_t offset, uint64_t &spent, uint64_t &unspent, bool check_spent)
 {
   COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
   COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
 
-  THROW_WALLET_EXCEPTION_IF(signed_key_images.size() > m_transfers.size(), error::wallet_internal_error,
+  THROW_WALLET_EXCEPTION_IF(offset > m_transfers.size() || signed_key_images.size() > m_transfers.size() - offset, error::wallet_internal_error,
       "The blockchain is out of date compared to the signed key images");
 
   if (signed_key_images.empty())
@@ -10878,9 +11705,10 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
     return 0;
   }
 
-  for (size_t n = 0; n < signed_key_images.size(); ++n)
-  {
-    const transfer_details &td = m_transfers[n];
+  // signatures are checked independently of each other
+  req.key_images.resize(signed_key_images.size());
+  for_each_index(signed_key_images.size(), true, [&](size_t n) {
+    const transfer_details &td = m_transfers[offset + n];
     const crypto::key_image &key_image = signed_key_images[n].first;
     const crypto::signature &signature = signed_key_images[n].second;
 
@@ -10902,15 +11730,16 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
         + boost::lexical_cast<std::string>(signed_key_images.size()) + ", key image " + epee::string_tools::pod_to_hex(key_image)
         + ", signature " + epee::string_tools::pod_to_hex(signature) + ", pubkey " + epee::string_tools::pod_to_hex(*pkeys[0]));
 
-    req.key_images.push_back(epee::string_tools::pod_to_hex(key_image));
-  }
+    req.key_images[n] = epee::string_tools::pod_to_hex(key_image);
+  });
 
   for (size_t n = 0; n < signed_key_images.size(); ++n)
   {
-    m_transfers[n].m_key_image = signed_key_images[n].first;
-    m_key_images[m_transfers[n].m_key_image] = n;
-    m_transfers[n].m_key_image_known = true;
-    m_transfers[n].m_key_image_partial = false;
+    transfer_details &td = m_transfers[offset + n];
+    td.m_key_image = signed_key_images[n].first;
+    m_key_images[td.m_key_image] = offset + n;
+    td.m_key_image_known = true;
+    td.m_key_image_partial = false;
   }
 
   if(check_spent)
@@ -10926,8 +11755,10 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(signed_key_images.size()));
     for (size_t n = 0; n < daemon_resp.spent_status.size(); ++n)
     {
-      transfer_details &td = m_transfers[n];
+      transfer_details &td = m_transfers[offset + n];
+      unindex_transfer(offset + n);
       td.m_spent = daemon_resp.spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
+      index_transfer(offset + n);
     }
   }
   spent = 0;
@@ -10948,20 +11779,20 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
 
   for(size_t i = 0; i < signed_key_images.size(); ++i)
   {
-    transfer_details &td = m_transfers[i];
+    transfer_details &td = m_transfers[offset + i];
     uint64_t amount = td.amount();
     if (td.m_spent)
       spent += amount;
     else
       unspent += amount;
-    LOG_PRINT_L2("Transfer " << i << ": " << print_money(amount) << " (" << td.m_global_output_index << "): "
+    LOG_PRINT_L2("Transfer " << offset + i << ": " << print_money(amount) << " (" << td.m_global_output_index << "): "
         << (td.m_spent ? "spent" : "unspent") << " (key image " << req.key_images[i] << ")");
 
     if (i < daemon_resp.spent_status.size() && daemon_resp.spent_status[i] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN)
     {
       const std::unordered_map<crypto::key_image, crypto::hash>::const_iterator skii = spent_key_images.find(td.m_key_image);
       if (skii == spent_key_images.end())
-        swept_transfers.push_back(i);
+        swept_transfers.push_back(offset + i);
       else
         spent_txids.insert(skii->second);
     }
@@ -11074,11 +11905,13 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       process_outgoing(*spent_txid, spent_tx, e.block_height, e.block_timestamp, tx_money_spent_in_ins, tx_money_got_in_outs, subaddr_account, subaddr_indices);
 
       // erase corresponding incoming payment
+      load_payments();
       for (auto j = m_payments.begin(); j != m_payments.end(); ++j)
       {
         if (j->second.m_tx_hash == *spent_txid)
         {
           m_payments.erase(j);
+          reset_payments_log();
           break;
         }
       }
@@ -11098,11 +11931,12 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
     }
   }
 
-  return m_transfers[signed_key_images.size() - 1].m_block_height;
+  return m_transfers[offset + signed_key_images.size() - 1].m_block_height;
 }
 wallet2::payment_container wallet2::export_payments() const
 {
   payment_container payments;
+  load_payments();
   for (auto const &p : m_payments)
   {
     payments.emplace(p);
@@ -11112,6 +11946,8 @@ wallet2::payment_container wallet2::export_payments() const
 void wallet2::import_payments(const payment_container &payments)
 {
   m_payments.clear();
+  m_payments_log_unloaded = 0;
+  reset_payments_log();
   for (auto const &p : payments)
   {
     m_payments.emplace(p);
@@ -11173,62 +12009,213 @@ std::vector<tools::wallet2::transfer_details> wallet2::export_outputs() const
   return outs;
 }
 //----------------------------------------------------------------------------------------------------
-std::string wallet2::export_outputs_to_str() const
+void wallet2::export_outputs(std::ostream &out, bool all) const
 {
-  std::vector<tools::wallet2::transfer_details> outs = export_outputs();
+  size_t offset = 0;
+  if (!all)
+  {
+    while (offset < m_transfers.size() && m_transfers[offset].m_key_image_known && !m_transfers[offset].m_key_image_partial)
+      ++offset;
+  }
 
-  std::stringstream oss;
-  boost::archive::portable_binary_oarchive ar(oss);
-  ar << outs;
+  crypto::chacha_key key;
+  crypto::generate_chacha_key(&get_account().get_keys().m_view_secret_key, sizeof(crypto::secret_key), key, m_kdf_rounds);
+
+  out.write(OUTPUT_EXPORT_FILE_MAGIC, strlen(OUTPUT_EXPORT_FILE_MAGIC));
+  tools::export_stream::writer writer(out, key);
 
-  std::string magic(OUTPUT_EXPORT_FILE_MAGIC, strlen(OUTPUT_EXPORT_FILE_MAGIC));
   const cryptonote::account_public_address &keys = get_account().get_keys().m_account_address;
+  const uint64_t offset_le = SWAP64LE((uint64_t)offset);
+  const uint64_t count_le = SWAP64LE((uint64_t)(m_transfers.size() - offset));
   std::string header;
   header += std::string((const char *)&keys.m_spend_public_key, sizeof(crypto::public_key));
   header += std::string((const char *)&keys.m_view_public_key, sizeof(crypto::public_key));
-  std::string ciphertext = encrypt_with_view_secret_key(header + oss.str());
-  return magic + ciphertext;
+  header += std::string((const char *)&offset_le, sizeof(offset_le));
+  header += std::string((const char *)&count_le, sizeof(count_le));
+  bool r = writer.write(header, offset == m_transfers.size());
+
+  // outputs are serialized a segment at a time, so the export is never held whole in memory
+  for (size_t begin = offset; r && begin < m_transfers.size(); begin += OUTPUT_EXPORT_SEGMENT_OUTPUTS)
+  {
+    const size_t end = std::min<size_t>(begin + OUTPUT_EXPORT_SEGMENT_OUTPUTS, m_transfers.size());
+    const std::vector<tools::wallet2::transfer_details> outs(m_transfers.begin() + begin, m_transfers.begin() + end);
+    std::stringstream oss;
+    {
+      boost::archive::portable_binary_oarchive ar(oss);
+      ar << outs;
+    }
+    r = writer.write(oss.str(), end == m_transfers.size());
+  }
+  THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to write outputs");
 }
 //----------------------------------------------------------------------------------------------------
-size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_details> &outputs)
+std::string wallet2::export_outputs_to_str(bool all) const
 {
-  m_transfers.clear();
-  m_transfers.reserve(outputs.size());
+  std::stringstream oss;
+  export_outputs(oss, all);
+  return oss.str();
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::export_outputs_to_file(const std::string &filename, bool all) const
+{
+  std::ofstream out(filename, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+  if (!out)
+    return false;
+  export_outputs(out, all);
+  out.close();
+  return !out.fail();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::truncate_transfers(size_t offset)
+{
+  for (size_t n = offset; n < m_transfers.size(); ++n)
+  {
+    const transfer_details &td = m_transfers[n];
+    const auto kit = m_key_images.find(td.m_key_image);
+    if (kit != m_key_images.end() && kit->second == n)
+      m_key_images.erase(kit);
+    const auto pit = m_pub_keys.find(td.get_public_key());
+    if (pit != m_pub_keys.end() && pit->second == n)
+      m_pub_keys.erase(pit);
+  }
+  m_transfers.erase(m_transfers.begin() + offset, m_transfers.end());
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::import_outputs_segment(std::vector<tools::wallet2::transfer_details> &outputs)
+{
+  const size_t first = m_transfers.size();
   for (size_t i = 0; i < outputs.size(); ++i)
   {
-    transfer_details td = outputs[i];
+    const transfer_details &td = outputs[i];
+    THROW_WALLET_EXCEPTION_IF(td.m_tx.vout.empty(), error::wallet_internal_error, "tx with no outputs at index " + boost::lexical_cast<std::string>(first + i));
+    THROW_WALLET_EXCEPTION_IF(td.m_internal_output_index >= td.m_tx.vout.size() || td.m_tx.vout[td.m_internal_output_index].target.type() != typeid(cryptonote::txout_to_key),
+        error::wallet_internal_error, "Unsupported output type");
+    // before deriving any key image, so that the subaddresses of all the outputs are looked up
+    expand_subaddresses(td.m_subaddr_index);
+  }
 
-    // the hot wallet wouldn't have known about key images (except if we already exported them)
+  // the hot wallet wouldn't have known about key images (except if we already exported them),
+  // they are derived independently of each other, in parallel unless the keys are on a device
+  for_each_index(outputs.size(), !key_on_device(), [&](size_t i) {
+    transfer_details &td = outputs[i];
     cryptonote::keypair in_ephemeral;
-
-    THROW_WALLET_EXCEPTION_IF(td.m_tx.vout.empty(), error::wallet_internal_error, "tx with no outputs at index " + boost::lexical_cast<std::string>(i));
     crypto::public_key tx_pub_key = get_tx_pub_key_from_received_outs(td);
     const std::vector<crypto::public_key> additional_tx_pub_keys = get_additional_tx_pub_keys_from_extra(td.m_tx);
 
-    THROW_WALLET_EXCEPTION_IF(td.m_tx.vout[td.m_internal_output_index].target.type() != typeid(cryptonote::txout_to_key),
-        error::wallet_internal_error, "Unsupported output type");
     const crypto::public_key& out_key = boost::get<cryptonote::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).key;
     bool r = cryptonote::generate_key_image_helper(m_account.get_keys(), m_subaddresses, out_key, tx_pub_key, additional_tx_pub_keys, td.m_internal_output_index, in_ephemeral, td.m_key_image, m_account.get_device());
     THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to generate key image");
-    expand_subaddresses(td.m_subaddr_index);
     td.m_key_image_known = true;
     td.m_key_image_partial = false;
     THROW_WALLET_EXCEPTION_IF(in_ephemeral.pub != out_key,
-        error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key at index " + boost::lexical_cast<std::string>(i));
+        error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key at index " + boost::lexical_cast<std::string>(first + i));
+  });
 
+  m_transfers.reserve(first + outputs.size());
+  for (transfer_details &td: outputs)
+  {
     m_key_images[td.m_key_image] = m_transfers.size();
     m_pub_keys[td.get_public_key()] = m_transfers.size();
     m_transfers.push_back(std::move(td));
   }
+}
+//----------------------------------------------------------------------------------------------------
+size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_details> &outputs)
+{
+  truncate_transfers(0);
+  auto rebuild = epee::misc_utils::create_scope_leave_handler([this]() { rebuild_transfer_index(); });
+
+  std::vector<tools::wallet2::transfer_details> segment = outputs;
+  import_outputs_segment(segment);
+  m_key_image_export_offset = 0;
+
+  return m_transfers.size();
+}
+//----------------------------------------------------------------------------------------------------
+size_t wallet2::import_outputs(std::istream &in)
+{
+  const size_t magiclen = strlen(OUTPUT_EXPORT_FILE_MAGIC);
+  std::string magic(magiclen, '\0');
+  in.read(&magic[0], magiclen);
+  if (in && magic == OUTPUT_EXPORT_FILE_MAGIC_V3)
+  {
+    std::stringstream legacy;
+    legacy << magic << in.rdbuf();
+    return import_outputs_from_str(legacy.str());
+  }
+  THROW_WALLET_EXCEPTION_IF(!in || magic != OUTPUT_EXPORT_FILE_MAGIC, error::wallet_internal_error, "Bad magic from outputs");
+
+  crypto::chacha_key key;
+  crypto::generate_chacha_key(&get_account().get_keys().m_view_secret_key, sizeof(crypto::secret_key), key, m_kdf_rounds);
+  tools::export_stream::reader reader(in, key, OUTPUT_EXPORT_MAX_SEGMENT_SIZE);
+
+  std::string payload;
+  bool last = false;
+  THROW_WALLET_EXCEPTION_IF(!reader.read(payload, last), error::wallet_internal_error, "Failed to decrypt outputs");
+  const size_t headerlen = 2 * sizeof(crypto::public_key) + 2 * sizeof(uint64_t);
+  THROW_WALLET_EXCEPTION_IF(payload.size() != headerlen, error::wallet_internal_error, "Bad data size for outputs");
+  const crypto::public_key &public_spend_key = *(const crypto::public_key*)&payload[0];
+  const crypto::public_key &public_view_key = *(const crypto::public_key*)&payload[sizeof(crypto::public_key)];
+  const cryptonote::account_public_address &keys = get_account().get_keys().m_account_address;
+  if (public_spend_key != keys.m_spend_public_key || public_view_key != keys.m_view_public_key)
+  {
+    THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Outputs from are for a different account"));
+  }
+  uint64_t offset, count;
+  memcpy(&offset, &payload[2 * sizeof(crypto::public_key)], sizeof(offset));
+  memcpy(&count, &payload[2 * sizeof(crypto::public_key) + sizeof(offset)], sizeof(count));
+  offset = SWAP64LE(offset);
+  count = SWAP64LE(count);
+  THROW_WALLET_EXCEPTION_IF(offset > m_transfers.size(), error::wallet_internal_error,
+      "Imported outputs omit more outputs than we know of, export them all from the view wallet");
+  THROW_WALLET_EXCEPTION_IF(count > std::numeric_limits<uint64_t>::max() - offset, error::wallet_internal_error, "Bad output count");
+
+  // the outputs before the offset are the ones we already had, with key images the view wallet knows
+  truncate_transfers(offset);
+  auto rebuild = epee::misc_utils::create_scope_leave_handler([this]() { rebuild_transfer_index(); });
+  while (!last)
+  {
+    THROW_WALLET_EXCEPTION_IF(!reader.read(payload, last), error::wallet_internal_error, "Failed to decrypt outputs");
+    std::vector<tools::wallet2::transfer_details> outputs;
+    try
+    {
+      std::stringstream iss;
+      iss << payload;
+      boost::archive::portable_binary_iarchive ar(iss);
+      ar >> outputs;
+    }
+    catch (const std::exception &e)
+    {
+      THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Failed to import outputs: ") + e.what());
+    }
+    THROW_WALLET_EXCEPTION_IF(outputs.size() > offset + count - m_transfers.size(), error::wallet_internal_error,
+        "More outputs than announced in the export");
+    import_outputs_segment(outputs);
+  }
+  THROW_WALLET_EXCEPTION_IF(m_transfers.size() != offset + count, error::wallet_internal_error,
+      "Fewer outputs than announced in the export");
+  m_key_image_export_offset = offset;
 
   return m_transfers.size();
 }
 //----------------------------------------------------------------------------------------------------
+size_t wallet2::import_outputs_from_file(const std::string &filename)
+{
+  std::ifstream in(filename, std::ios_base::binary | std::ios_base::in);
+  THROW_WALLET_EXCEPTION_IF(!in, error::wallet_internal_error, std::string(tr("failed to read file ")) + filename);
+  return import_outputs(in);
+}
+//----------------------------------------------------------------------------------------------------
 size_t wallet2::import_outputs_from_str(const std::string &outputs_st)
 {
   std::string data = outputs_st;
   const size_t magiclen = strlen(OUTPUT_EXPORT_FILE_MAGIC);
-  if (data.size() < magiclen || memcmp(data.data(), OUTPUT_EXPORT_FILE_MAGIC, magiclen))
+  if (data.size() >= magiclen && !memcmp(data.data(), OUTPUT_EXPORT_FILE_MAGIC, magiclen))
+  {
+    std::stringstream iss(outputs_st);
+    return import_outputs(iss);
+  }
+  if (data.size() < magiclen || memcmp(data.data(), OUTPUT_EXPORT_FILE_MAGIC_V3, magiclen))
   {
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Bad magic from outputs"));
   }
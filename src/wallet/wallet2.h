@@ -59,6 +59,7 @@
 #include "wallet_errors.h"
 #include "common/password.h"
 #include "node_rpc_proxy.h"
+#include "daemon_rpc_pool.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "wallet.wallet2"
@@ -156,6 +157,7 @@ namespace tools
     friend class ::Serialization_portability_wallet_Test;
     friend class GraftWallet;
     friend class wallet_keys_unlocker;
+    friend class wallet_scanner;
   public:
     static constexpr const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
 
@@ -428,6 +430,20 @@ namespace tools
       std::vector<crypto::key_image> key_images;
     };
 
+    //! destinations paid by their own txs in create_transactions_batch
+    struct transfer_batch_entry
+    {
+      std::vector<cryptonote::tx_destination_entry> dsts;
+      std::vector<uint8_t> extra;
+    };
+
+    //! txs created for a transfer_batch_entry, or the error which prevented it
+    struct transfer_batch_result
+    {
+      std::vector<pending_tx> ptx_vector;
+      std::exception_ptr error;
+    };
+
     struct multisig_tx_set
     {
       std::vector<pending_tx> m_ptx;
@@ -488,6 +504,7 @@ namespace tools
       cryptonote::block block;
       std::vector<cryptonote::transaction> txes;
       cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices o_indices;
+      bool compact; // txes are from /get_blocks_compact.bin, without ring members
       bool error;
     };
 
@@ -731,6 +748,8 @@ namespace tools
 
     void set_refresh_type(RefreshType refresh_type) { m_refresh_type = refresh_type; }
     RefreshType get_refresh_type() const { return m_refresh_type; }
+    void refresh_pipeline_depth(size_t depth) { m_refresh_pipeline_depth = depth; }
+    size_t refresh_pipeline_depth() const { return m_refresh_pipeline_depth; }
 
     cryptonote::network_type nettype() const { return m_nettype; }
     bool watch_only() const { return m_watch_only; }
@@ -793,6 +812,15 @@ namespace tools
     std::vector<wallet2::pending_tx> create_transactions_2(std::vector<cryptonote::tx_destination_entry> dsts, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra, uint32_t subaddr_account, std::set<uint32_t> subaddr_indices,     // pass subaddr_indices by value on purpose
        bool rta_tx_fee = false);
 
+    /*!
+     * \brief create_transactions_batch - creates txs for independent groups of destinations
+     *
+     * Inputs selected for a group are not selected for the following ones, so the txs of all
+     * groups may be relayed together. A group which can't be paid gets its error and doesn't
+     * stop the others. Nothing is relayed.
+     */
+    std::vector<transfer_batch_result> create_transactions_batch(const std::vector<transfer_batch_entry>& entries, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices);
+
     /*!
      * \brief create_transactions_graft - creates graft transaction
      * \param recepient_address - address who receive the coins
@@ -829,6 +857,8 @@ namespace tools
     void get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2::pool_payment_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
 
     uint64_t get_blockchain_current_height() const { return m_light_wallet_blockchain_height ? m_light_wallet_blockchain_height : m_blockchain.size(); }
+    // false if the block is above the wallet's height or below the hashes it keeps
+    bool get_blockchain_hash(uint64_t height, crypto::hash &hash) const { if (!m_blockchain.is_in_bounds(height)) return false; hash = m_blockchain[height]; return true; }
     void rescan_spent();
     void rescan_unspent();
     void rescan_blockchain(bool refresh = true);
@@ -864,7 +894,18 @@ namespace tools
       a & m_unconfirmed_txs;
       if(ver < 7)
         return;
-      a & m_payments;
+      if(ver < 26)
+      {
+        a & m_payments;
+      }
+      else
+      {
+        // payments are kept inline only when the cache isn't stored with a payments log
+        a & m_payments_log_id;
+        a & m_payments_log_size;
+        if (m_payments_log_size == 0)
+          a & m_payments;
+      }
       if(ver < 8)
         return;
       a & m_tx_keys;
@@ -941,6 +982,9 @@ namespace tools
       if(ver < 25)
         return;
       a & m_last_block_reward;
+      if(ver < 27)
+        return;
+      a & m_key_image_export_offset;
     }
 
     /*!
@@ -982,6 +1026,8 @@ namespace tools
     uint64_t get_min_output_value() const { return m_min_output_value; }
     void merge_destinations(bool merge) { m_merge_destinations = merge; }
     bool merge_destinations() const { return m_merge_destinations; }
+    void parallel_tx_construction(bool parallel) { m_parallel_tx_construction = parallel; }
+    bool parallel_tx_construction() const { return m_parallel_tx_construction; }
     bool confirm_backlog() const { return m_confirm_backlog; }
     void confirm_backlog(bool always) { m_confirm_backlog = always; }
     void set_confirm_backlog_threshold(uint32_t threshold) { m_confirm_backlog_threshold = threshold; };
@@ -1041,7 +1087,11 @@ namespace tools
         
     uint64_t get_num_rct_outputs();
     size_t get_num_transfer_details() const { return m_transfers.size(); }
+    size_t get_num_payments() const { load_payments(); return m_payments.size(); }
+    size_t get_num_confirmed_txs() const { return m_confirmed_txs.size(); }
     const transfer_details &get_transfer_details(size_t idx) const;
+    // indices of the transfers of the account which aren't spent, in ascending order
+    std::vector<size_t> get_unspent_transfers(uint32_t index_major) const;
 
     void get_hard_fork_info(uint8_t version, uint64_t &earliest_height) const;
     bool use_fork_rules(uint8_t version, int64_t early_blocks = 0) const;
@@ -1111,20 +1161,31 @@ namespace tools
 
     // Import/Export wallet data
     std::vector<tools::wallet2::transfer_details> export_outputs() const;
-    std::string export_outputs_to_str() const;
+    // unless all is set, only the outputs from the first one whose key image we don't know are exported,
+    // the cold wallet keeps the others and exports key images from the same offset
+    void export_outputs(std::ostream &out, bool all) const;
+    std::string export_outputs_to_str(bool all = false) const;
+    bool export_outputs_to_file(const std::string &filename, bool all = false) const;
     size_t import_outputs(const std::vector<tools::wallet2::transfer_details> &outputs);
+    size_t import_outputs(std::istream &in);
     size_t import_outputs_from_str(const std::string &outputs_st);
+    size_t import_outputs_from_file(const std::string &filename);
     payment_container export_payments() const;
     void import_payments(const payment_container &payments);
     void import_payments_out(const std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments);
     std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> export_blockchain() const;
     void import_blockchain(const std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> &bc);
-    bool export_key_images(const std::string &filename) const;
-    std::vector<std::pair<crypto::key_image, crypto::signature>> export_key_images() const;
+    bool export_key_images(const std::string &filename, bool all = false) const;
+    // key images of the transfers from offset on
+    std::vector<std::pair<crypto::key_image, crypto::signature>> export_key_images(size_t offset = 0) const;
+    // the offset a cold wallet exports key images from, where the last outputs it imported started
+    size_t get_key_image_export_offset() const { return std::min<size_t>(m_key_image_export_offset, m_transfers.size()); }
     uint64_t import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, uint64_t &spent, uint64_t &unspent, bool check_spent = true);
+    uint64_t import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, size_t offset, uint64_t &spent, uint64_t &unspent, bool check_spent = true);
     uint64_t import_key_images(const std::string &filename, uint64_t &spent, uint64_t &unspent);
 
-    void update_pool_state(bool refreshed = false);
+    // pool_hashes is the daemon's answer to a request with the current pool cookie, when it was already fetched
+    void update_pool_state(bool refreshed = false, const cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response *pool_hashes = NULL);
     void remove_obsolete_pool_txs(const std::vector<crypto::hash> &tx_hashes);
 
     std::string encrypt(const char *plaintext, size_t len, const crypto::secret_key &skey, bool authenticated = true) const;
@@ -1221,6 +1282,7 @@ namespace tools
     bool get_ring(const crypto::key_image &key_image, std::vector<uint64_t> &outs);
     bool get_rings(const crypto::hash &txid, std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &outs);
     bool set_ring(const crypto::key_image &key_image, const std::vector<uint64_t> &outs, bool relative);
+    bool set_rings(const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings, bool relative);
     bool find_and_save_rings(bool force = true);
 
     bool blackball_output(const std::pair<uint64_t, uint64_t> &output);
@@ -1277,11 +1339,30 @@ namespace tools
     void get_short_chain_history(std::list<crypto::hash>& ids, uint64_t granularity = 1) const;
     bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint64_t block_height) const;
     bool clear();
-    void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
+    // requests going on a connection of the daemon's pool, so they can overlap with others from the wallet
+    template<class t_request, class t_response>
+    bool invoke_pooled_http_json(const boost::string_ref uri, const t_request& req, t_response& res, std::chrono::milliseconds timeout, const boost::string_ref http_method = "GET")
+    {
+      if (m_daemon_rpc_pool)
+        return m_daemon_rpc_pool->invoke_http_json(uri, req, res, timeout, http_method);
+      return invoke_http_json(uri, req, res, timeout, http_method);
+    }
+    template<class t_request, class t_response>
+    bool invoke_pooled_http_bin(const boost::string_ref uri, const t_request& req, t_response& res, std::chrono::milliseconds timeout, const boost::string_ref http_method = "GET")
+    {
+      if (m_daemon_rpc_pool)
+        return m_daemon_rpc_pool->invoke_http_bin(uri, req, res, timeout, http_method);
+      return invoke_http_bin(uri, req, res, timeout, http_method);
+    }
+    void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, bool &compact);
+    bool spends_own_outputs(const cryptonote::transaction &tx) const;
+    void get_pruned_tx(const crypto::hash &txid, cryptonote::transaction &tx);
     void pull_hashes(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes);
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, bool force = false);
-    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error);
-    void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added);
+    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<crypto::hash> &prev_block_hashes, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error);
+    void scan_parsed_blocks(const std::vector<parsed_block> &parsed_blocks, const crypto::secret_key &view_secret_key, const std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses, std::vector<tx_cache_data> &tx_cache_data) const;
+    void scan_parsed_blocks_outputs(const std::vector<parsed_block> &parsed_blocks, const std::unordered_map<crypto::public_key, cryptonote::subaddress_index> &subaddresses, std::vector<tx_cache_data> &tx_cache_data) const;
+    void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, const std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added);
     uint64_t select_transfers(uint64_t needed_money, std::vector<size_t> unused_transfers_indices, std::vector<size_t>& selected_transfers) const;
     bool prepare_file_names(const std::string& file_path);
     void process_unconfirmed(const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t height);
@@ -1289,6 +1370,11 @@ namespace tools
     void add_unconfirmed_tx(const cryptonote::transaction& tx, uint64_t amount_in, const std::vector<cryptonote::tx_destination_entry> &dests, const crypto::hash &payment_id, uint64_t change_amount, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices);
     void generate_genesis(cryptonote::block& b) const;
     void check_genesis(const crypto::hash& genesis_hash) const; //throws
+    bool store_cache(const std::string &filename, const std::string &payments_log_file);
+    bool store_payments_log(const std::string &log_file, bool &rewritten);
+    void load_payments() const;
+    void add_payment(const crypto::hash &payment_id, const payment_details &payment);
+    void reset_payments_log();
     bool generate_chacha_key_from_secret_keys(crypto::chacha_key &key) const;
     void generate_chacha_key_from_password(const epee::wipeable_string &pass, crypto::chacha_key &key) const;
     crypto::hash get_payment_id(const pending_tx &ptx) const;
@@ -1296,7 +1382,7 @@ namespace tools
     void check_acc_out_precomp(const cryptonote::tx_out &o, const crypto::key_derivation &derivation, const std::vector<crypto::key_derivation> &additional_derivations, size_t i, const is_out_data *is_out_data, tx_scan_info_t &tx_scan_info) const;
     void check_acc_out_precomp_once(const cryptonote::tx_out &o, const crypto::key_derivation &derivation, const std::vector<crypto::key_derivation> &additional_derivations, size_t i, const is_out_data *is_out_data, tx_scan_info_t &tx_scan_info, bool &already_seen) const;
     void check_acc_out_precomp_once(const crypto::public_key &spend_public_key, const cryptonote::tx_out &o, const crypto::key_derivation &derivation, size_t i, bool &received, uint64_t &money_transfered, bool &error, bool &already_seen) const;
-    void parse_block_round(const cryptonote::blobdata &blob, cryptonote::block &bl, crypto::hash &bl_id, bool &error) const;
+    void parse_block_round(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, size_t start, size_t end) const;
     uint64_t get_upper_transaction_weight_limit() const;
     std::vector<uint64_t> get_unspent_amounts_vector() const;
     uint64_t get_dynamic_base_fee_estimate() const;
@@ -1304,6 +1390,11 @@ namespace tools
     std::vector<size_t> pick_preferred_rct_inputs(uint64_t needed_money, uint32_t subaddr_account, const std::set<uint32_t> &subaddr_indices) const;
     void set_spent(size_t idx, uint64_t height);
     void set_unspent(size_t idx);
+    void index_transfer(size_t idx);
+    void unindex_transfer(size_t idx);
+    void rebuild_transfer_index();
+    void truncate_transfers(size_t offset);
+    void import_outputs_segment(std::vector<transfer_details> &outputs);
     void get_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count);
     bool tx_add_fake_output(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, uint64_t global_index, const crypto::public_key& tx_public_key, const rct::key& mask, uint64_t real_index, bool unlocked) const;
     crypto::public_key get_tx_pub_key_from_received_outs(const tools::wallet2::transfer_details &td) const;
@@ -1328,6 +1419,7 @@ namespace tools
     void setup_keys(const epee::wipeable_string &password);
 
     bool get_rct_distribution(uint64_t &start_height, std::vector<uint64_t> &distribution);
+    bool update_rct_distribution();
 
     uint64_t get_segregation_fork_height() const;
     void unpack_multisig_info(const std::vector<std::string>& info,
@@ -1348,6 +1440,7 @@ namespace tools
     std::string m_wallet_file;
     std::string m_keys_file;
     epee::net_utils::http::http_simple_client m_http_client;
+    std::shared_ptr<daemon_rpc_pool> m_daemon_rpc_pool; // shared with the other wallets using the daemon
     hashchain m_blockchain;
     std::unordered_map<crypto::hash, unconfirmed_transfer_details> m_unconfirmed_txs;
     std::unordered_map<crypto::hash, confirmed_transfer_details> m_confirmed_txs;
@@ -1357,7 +1450,17 @@ namespace tools
     std::unordered_map<crypto::hash, std::vector<crypto::secret_key>> m_additional_tx_keys;
 
     transfer_container m_transfers;
-    payment_container m_payments;
+    // indices of m_transfers not marked spent, by subaddress account, kept by set_spent/set_unspent
+    std::unordered_map<uint32_t, std::set<size_t>> m_unspent_transfers;
+    // historical payments are read from the payments log on first use, see load_payments
+    mutable payment_container m_payments;
+    // the payments log this cache was stored with (no log if the size is 0), payments not yet appended to
+    // it and how far the log still has to be read into m_payments
+    crypto::hash m_payments_log_id;
+    uint64_t m_payments_log_size;
+    std::string m_payments_log_file;
+    std::vector<std::pair<crypto::hash, payment_details>> m_payments_log_pending;
+    mutable uint64_t m_payments_log_unloaded;
     std::unordered_map<crypto::key_image, size_t> m_key_images;
     std::unordered_map<crypto::public_key, size_t> m_pub_keys;
     cryptonote::account_public_address m_account_public_address;
@@ -1395,6 +1498,7 @@ namespace tools
     uint32_t m_default_mixin;
     uint32_t m_default_priority;
     RefreshType m_refresh_type;
+    size_t m_refresh_pipeline_depth;
     bool m_auto_refresh;
     bool m_first_refresh_done;
     uint64_t m_refresh_from_block_height;
@@ -1407,6 +1511,7 @@ namespace tools
     uint32_t m_min_output_count;
     uint64_t m_min_output_value;
     bool m_merge_destinations;
+    bool m_parallel_tx_construction;
     bool m_confirm_backlog;
     uint32_t m_confirm_backlog_threshold;
     bool m_confirm_export_overwrite;
@@ -1417,7 +1522,13 @@ namespace tools
     bool m_ignore_fractional_outputs;
     bool m_is_initialized;
     NodeRPCProxy m_node_rpc_proxy;
+    bool m_daemon_compact_blocks; /* cleared when the daemon doesn't serve /get_blocks_compact.bin */
+    // cumulative rct output distribution from the daemon, kept up to date after refresh once fetched
+    uint64_t m_rct_distribution_start_height;
+    std::vector<uint64_t> m_rct_distribution;
     std::unordered_set<crypto::hash> m_scanned_pool_txs[2];
+    uint64_t m_pool_cookie; // daemon pool cookie of m_pool_tx_hashes once all their txes were processed, 0 if none
+    std::vector<crypto::hash> m_pool_tx_hashes;
     size_t m_subaddress_lookahead_major, m_subaddress_lookahead_minor;
     std::string m_device_name;
 
@@ -1441,6 +1552,7 @@ namespace tools
     boost::optional<crypto::chacha_key> m_ringdb_key;
 
     uint64_t m_last_block_reward;
+    uint64_t m_key_image_export_offset;
     std::unique_ptr<tools::file_locker> m_keys_file_locker;
 
     crypto::chacha_key m_cache_key;
@@ -1451,7 +1563,7 @@ namespace tools
     std::shared_ptr<tools::Notify> m_tx_notify;
   };
 }
-BOOST_CLASS_VERSION(tools::wallet2, 25)
+BOOST_CLASS_VERSION(tools::wallet2, 27)
 BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 9)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info, 1)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info::LR, 0)
@@ -37,8 +37,10 @@ using namespace epee;
 
 #include "wallet_rpc_server.h"
 #include "wallet/wallet_args.h"
+#include "wallet/wallet_scanner.h"
 #include "common/command_line.h"
 #include "common/i18n.h"
+#include "common/util.h"
 #include "cryptonote_config.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_basic/account.h"
@@ -66,6 +68,8 @@ namespace
   const command_line::arg_descriptor<bool> arg_restricted = {"restricted-rpc", "Restricts to view-only commands", false};
   const command_line::arg_descriptor<std::string> arg_wallet_dir = {"wallet-dir", "Directory for newly created wallets"};
   const command_line::arg_descriptor<bool> arg_prompt_for_password = {"prompt-for-password", "Prompts for password when not provided", false};
+  const command_line::arg_descriptor<bool> arg_multi_wallet = {"multi-wallet", "Keeps every wallet opened or created in --wallet-dir open, serving each at /wallet/<filename>/json_rpc", false};
+  const command_line::arg_descriptor<unsigned> arg_rpc_threads = {"rpc-threads", "Number of threads serving requests in multi wallet mode, 0 for the number of CPU cores", 0};
 
   constexpr const char default_rpc_username[] = "monero";
 
@@ -182,31 +186,141 @@ namespace tools
     return i18n_translate(str, "tools::wallet_rpc_server");
   }
 
+  thread_local wallet2 *wallet_rpc_server::m_wallet = NULL;
+  thread_local wallet_rpc_server::hosted_wallet *wallet_rpc_server::m_current = NULL;
   //------------------------------------------------------------------------------------------------------------------------------
-  wallet_rpc_server::wallet_rpc_server():m_wallet(NULL), rpc_login_file(), m_stop(false), m_restricted(false), m_vm(NULL)
+  wallet_rpc_server::wallet_rpc_server():rpc_login_file(), m_stop(false), m_restricted(false), m_multi_wallet(false), m_vm(NULL)
   {
+    m_wallets[""] = std::make_shared<hosted_wallet>();
   }
   //------------------------------------------------------------------------------------------------------------------------------
   wallet_rpc_server::~wallet_rpc_server()
   {
-    if (m_wallet)
-      delete m_wallet;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   void wallet_rpc_server::set_wallet(wallet2 *cr)
   {
-    m_wallet = cr;
+    m_wallets[""]->wallet.reset(cr);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context)
+  {
+    LOG_PRINT_L2("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+    response.m_response_code = 200;
+    response.m_response_comment = "Ok";
+
+    // in multi wallet mode, /wallet/<filename>/json_rpc is for an open wallet and /json_rpc for none
+    static const std::string wallet_prefix = "/wallet/";
+    const epee::net_utils::http::http_request_info *request = &query_info;
+    epee::net_utils::http::http_request_info wallet_request;
+    std::string filename;
+    if (m_multi_wallet && boost::starts_with(query_info.m_URI, wallet_prefix))
+    {
+      const size_t end = query_info.m_URI.find('/', wallet_prefix.size());
+      if (end == std::string::npos || end == wallet_prefix.size())
+      {
+        response.m_response_code = 404;
+        response.m_response_comment = "Not found";
+        return true;
+      }
+      filename = query_info.m_URI.substr(wallet_prefix.size(), end - wallet_prefix.size());
+      wallet_request = query_info;
+      wallet_request.m_URI = query_info.m_URI.substr(end);
+      request = &wallet_request;
+    }
+
+    std::shared_ptr<hosted_wallet> hosted;
+    if (!m_multi_wallet || !filename.empty())
+    {
+      boost::lock_guard<boost::mutex> lock(m_wallets_mutex);
+      const auto i = m_wallets.find(filename);
+      if (i != m_wallets.end())
+        hosted = i->second;
+    }
+    if (!hosted && !filename.empty())
+    {
+      response.m_response_code = 404;
+      response.m_response_comment = "Not found";
+      return true;
+    }
+
+    boost::unique_lock<boost::mutex> wallet_lock;
+    if (hosted)
+      wallet_lock = boost::unique_lock<boost::mutex>(hosted->mutex);
+    m_current = hosted.get();
+    m_wallet = hosted ? hosted->wallet.get() : NULL;
+    auto current_resetter = epee::misc_utils::create_scope_leave_handler([]() {
+      m_current = NULL;
+      m_wallet = NULL;
+    });
+
+    if(!handle_http_request_map(*request, response, m_conn_context))
+    {
+      response.m_response_code = 404;
+      response.m_response_comment = "Not found";
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::refresh_wallets()
+  {
+    std::vector<std::shared_ptr<hosted_wallet>> hosted;
+    {
+      boost::lock_guard<boost::mutex> lock(m_wallets_mutex);
+      for (const auto &i: m_wallets)
+        hosted.push_back(i.second);
+    }
+
+    // wallets busy with a request are left for the next round, and the others are refreshed
+    // together, pulling the blocks once for all of them
+    std::vector<boost::unique_lock<boost::mutex>> locks;
+    std::vector<wallet2*> wallets;
+    for (const std::shared_ptr<hosted_wallet> &h: hosted)
+    {
+      boost::unique_lock<boost::mutex> lock(h->mutex, boost::try_to_lock);
+      if (!lock.owns_lock() || !h->wallet)
+        continue;
+      locks.push_back(std::move(lock));
+      wallets.push_back(h->wallet.get());
+    }
+    if (wallets.empty())
+      return;
+
+    bool refreshed = false;
+    if (wallets.size() > 1)
+    {
+      try
+      {
+        wallet_scanner scanner;
+        for (wallet2 *w: wallets)
+          scanner.add_wallet(w);
+        uint64_t blocks_fetched;
+        refreshed = scanner.refresh(blocks_fetched);
+      }
+      catch (const std::exception& ex)
+      {
+        LOG_ERROR("Exception while refreshing wallets, what=" << ex.what());
+      }
+    }
+    // wallets the scanner couldn't refresh catch up on their own
+    if (!refreshed)
+    {
+      for (wallet2 *w: wallets)
+      {
+        try {
+          w->refresh(w->is_trusted_daemon());
+        } catch (const std::exception& ex) {
+          LOG_ERROR("Exception at while refreshing, what=" << ex.what());
+        }
+      }
+    }
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::run()
   {
     m_stop = false;
     m_net_server.add_idle_handler([this](){
-      try {
-        if (m_wallet) m_wallet->refresh(m_wallet->is_trusted_daemon());
-      } catch (const std::exception& ex) {
-        LOG_ERROR("Exception at while refreshing, what=" << ex.what());
-      }
+      refresh_wallets();
       return true;
     }, 20000);
     m_net_server.add_idle_handler([this](){
@@ -218,17 +332,33 @@ namespace tools
       return true;
     }, 500);
 
-    //DO NOT START THIS SERVER IN MORE THEN 1 THREADS WITHOUT REFACTORING
-    return epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(1, true);
+    // requests only run side by side for different wallets, each holding its wallet's lock
+    size_t threads = 1;
+    if (m_multi_wallet)
+    {
+      threads = command_line::get_arg(*m_vm, arg_rpc_threads);
+      if (threads == 0)
+        threads = std::max<size_t>(2, tools::get_max_concurrency());
+    }
+    return epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(threads, true);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   void wallet_rpc_server::stop()
   {
-    if (m_wallet)
+    std::vector<std::shared_ptr<hosted_wallet>> hosted;
     {
-      m_wallet->store();
-      delete m_wallet;
-      m_wallet = NULL;
+      boost::lock_guard<boost::mutex> lock(m_wallets_mutex);
+      for (const auto &i: m_wallets)
+        hosted.push_back(i.second);
+    }
+    for (const std::shared_ptr<hosted_wallet> &h: hosted)
+    {
+      boost::lock_guard<boost::mutex> wallet_lock(h->mutex);
+      if (h->wallet)
+      {
+        h->wallet->store();
+        h->wallet.reset();
+      }
     }
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -244,6 +374,14 @@ namespace tools
     std::string bind_port = command_line::get_arg(*m_vm, arg_rpc_bind_port);
     const bool disable_auth = command_line::get_arg(*m_vm, arg_disable_rpc_login);
     m_restricted = command_line::get_arg(*m_vm, arg_restricted);
+    m_multi_wallet = command_line::get_arg(*m_vm, arg_multi_wallet);
+    if (m_multi_wallet && command_line::is_arg_defaulted(*m_vm, arg_wallet_dir))
+    {
+      MERROR(arg_multi_wallet.name << " needs " << arg_wallet_dir.name);
+      return false;
+    }
+    if (m_multi_wallet)
+      m_wallets.clear();
     if (!command_line::is_arg_defaulted(*m_vm, arg_wallet_dir))
     {
       if (!command_line::is_arg_defaulted(*m_vm, wallet_args::arg_wallet_file()))
@@ -330,6 +468,60 @@ namespace tools
       return false;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::host_wallet(const std::string &filename, std::unique_ptr<wallet2> wal, epee::json_rpc::error& er)
+  {
+    if (m_multi_wallet)
+    {
+      boost::lock_guard<boost::mutex> lock(m_wallets_mutex);
+      std::shared_ptr<hosted_wallet> &hosted = m_wallets[filename];
+      if (hosted)
+      {
+        er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+        er.message = "Wallet already open";
+        return false;
+      }
+      hosted = std::make_shared<hosted_wallet>();
+      hosted->wallet = std::move(wal);
+      return true;
+    }
+
+    // replaces the one wallet, whose lock this request holds
+    if (m_wallet)
+    {
+      try
+      {
+        m_wallet->store();
+      }
+      catch (const std::exception& e)
+      {
+        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
+        return false;
+      }
+    }
+    m_current->wallet = std::move(wal);
+    m_wallet = m_current->wallet.get();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::close_current_wallet()
+  {
+    m_current->wallet.reset();
+    m_wallet = NULL;
+    if (m_multi_wallet)
+    {
+      // requests already waiting on the wallet's lock find it closed
+      boost::lock_guard<boost::mutex> lock(m_wallets_mutex);
+      for (auto i = m_wallets.begin(); i != m_wallets.end(); ++i)
+      {
+        if (i->second.get() == m_current)
+        {
+          m_wallets.erase(i);
+          break;
+        }
+      }
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   void wallet_rpc_server::fill_transfer_entry(tools::wallet_rpc::transfer_entry &entry, const crypto::hash &txid, const crypto::hash &payment_id, const tools::wallet2::payment_details &pd)
   {
     entry.txid = string_tools::pod_to_hex(pd.m_tx_hash);
@@ -1147,6 +1339,104 @@ namespace tools
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_transfer_batch(const wallet_rpc::COMMAND_RPC_TRANSFER_BATCH::request& req, wallet_rpc::COMMAND_RPC_TRANSFER_BATCH::response& res, epee::json_rpc::error& er)
+  {
+    if (!m_wallet) return not_open(er);
+    if (m_restricted)
+    {
+      er.code = WALLET_RPC_ERROR_CODE_DENIED;
+      er.message = "Command unavailable in restricted mode.";
+      return false;
+    }
+    if (m_wallet->watch_only() || m_wallet->multisig())
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WATCH_ONLY;
+      er.message = "command not supported by watch-only or multisig wallet, use /transfer_split";
+      return false;
+    }
+
+    // every transfer is validated up front, the ones with bad destinations only fail themselves
+    std::vector<wallet2::transfer_batch_entry> entries;
+    std::vector<wallet_rpc::COMMAND_RPC_TRANSFER_BATCH::transfer_result*> entry_results;
+    for (const auto &transfer: req.transfers)
+    {
+      res.transfers.emplace_back();
+      wallet_rpc::COMMAND_RPC_TRANSFER_BATCH::transfer_result &result = res.transfers.back();
+      result.error_code = 0;
+
+      wallet2::transfer_batch_entry entry;
+      epee::json_rpc::error entry_er;
+      if (!validate_transfer(transfer.destinations, transfer.payment_id, entry.dsts, entry.extra, true, entry_er))
+      {
+        result.error_code = entry_er.code;
+        result.error_message = entry_er.message;
+        continue;
+      }
+      entries.push_back(std::move(entry));
+      entry_results.push_back(&result);
+    }
+
+    try
+    {
+      uint64_t mixin;
+      if(req.ring_size != 0)
+      {
+        mixin = m_wallet->adjust_mixin(req.ring_size - 1);
+      }
+      else
+      {
+        mixin = m_wallet->adjust_mixin(req.mixin);
+      }
+      uint32_t priority = m_wallet->adjust_priority(req.priority);
+
+      // inputs are planned for all transfers first, then all txs are sent back to back
+      LOG_PRINT_L2("on_transfer_batch calling create_transactions_batch for " << entries.size() << " transfers");
+      std::vector<wallet2::transfer_batch_result> batch = m_wallet->create_transactions_batch(entries, mixin, req.unlock_time, priority, req.account_index, req.subaddr_indices);
+
+      for (size_t i = 0; i < batch.size(); ++i)
+      {
+        wallet_rpc::COMMAND_RPC_TRANSFER_BATCH::transfer_result &result = *entry_results[i];
+        epee::json_rpc::error entry_er;
+        std::string multisig_txset, unsigned_txset;
+
+        if (!batch[i].error && batch[i].ptx_vector.empty())
+        {
+          result.error_code = WALLET_RPC_ERROR_CODE_TX_NOT_POSSIBLE;
+          result.error_message = "No transaction created";
+          continue;
+        }
+
+        try
+        {
+          if (batch[i].error)
+            std::rethrow_exception(batch[i].error);
+          if (!req.do_not_relay)
+            m_wallet->commit_tx(batch[i].ptx_vector);
+        }
+        catch (const std::exception& e)
+        {
+          handle_rpc_exception(std::current_exception(), entry_er, WALLET_RPC_ERROR_CODE_GENERIC_TRANSFER_ERROR);
+          result.error_code = entry_er.code;
+          result.error_message = entry_er.message;
+          continue;
+        }
+
+        if (!fill_response(batch[i].ptx_vector, req.get_tx_keys, result.tx_key_list, result.amount_list, result.fee_list, multisig_txset, unsigned_txset, true,
+            result.tx_hash_list, req.get_tx_hex, result.tx_blob_list, req.get_tx_metadata, result.tx_metadata_list, entry_er))
+        {
+          result.error_code = entry_er.code;
+          result.error_message = entry_er.message;
+        }
+      }
+    }
+    catch (const std::exception& e)
+    {
+      handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_GENERIC_TRANSFER_ERROR);
+      return false;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_sign_transfer(const wallet_rpc::COMMAND_RPC_SIGN_TRANSFER::request& req, wallet_rpc::COMMAND_RPC_SIGN_TRANSFER::response& res, epee::json_rpc::error& er)
   {
     if (!m_wallet) return not_open(er);
@@ -1761,12 +2051,16 @@ namespace tools
       available = false;
     }
 
-    wallet2::transfer_container transfers;
-    m_wallet->get_transfers(transfers);
+    // available transfers come from the wallet's unspent index, the others need the whole history
+    std::vector<size_t> indices;
+    if (available)
+      indices = m_wallet->get_unspent_transfers(req.account_index);
+    const size_t count = available ? indices.size() : m_wallet->get_num_transfer_details();
 
     bool transfers_found = false;
-    for (const auto& td : transfers)
+    for (size_t i = 0; i < count; ++i)
     {
+      const wallet2::transfer_details& td = m_wallet->get_transfer_details(available ? indices[i] : i);
       if (!filter || available != td.m_spent)
       {
         if (req.account_index != td.m_subaddr_index.major || (!req.subaddr_indices.empty() && req.subaddr_indices.count(td.m_subaddr_index.minor) == 0))
@@ -1775,7 +2069,6 @@ namespace tools
         {
           transfers_found = true;
         }
-        auto txBlob = t_serializable_object_to_blob(td.m_tx);
         wallet_rpc::transfer_details rpc_transfers;
         rpc_transfers.amount       = td.amount();
         rpc_transfers.spent        = td.m_spent;
@@ -2467,7 +2760,7 @@ namespace tools
 
     try
     {
-      res.outputs_data_hex = epee::string_tools::buff_to_hex_nodelimer(m_wallet->export_outputs_to_str());
+      res.outputs_data_hex = epee::string_tools::buff_to_hex_nodelimer(m_wallet->export_outputs_to_str(req.all));
     }
     catch (const std::exception &e)
     {
@@ -2520,7 +2813,9 @@ namespace tools
     if (!m_wallet) return not_open(er);
     try
     {
-      std::vector<std::pair<crypto::key_image, crypto::signature>> ski = m_wallet->export_key_images();
+      const size_t offset = req.all ? 0 : m_wallet->get_key_image_export_offset();
+      std::vector<std::pair<crypto::key_image, crypto::signature>> ski = m_wallet->export_key_images(offset);
+      res.offset = offset;
       res.signed_key_images.resize(ski.size());
       for (size_t n = 0; n < ski.size(); ++n)
       {
@@ -2578,7 +2873,7 @@ namespace tools
         ski[n].second = *reinterpret_cast<const crypto::signature*>(bd.data());
       }
       uint64_t spent = 0, unspent = 0;
-      uint64_t height = m_wallet->import_key_images(ski, spent, unspent);
+      uint64_t height = m_wallet->import_key_images(ski, req.offset, spent, unspent);
       res.spent = spent;
       res.unspent = unspent;
       res.height = height;
@@ -2932,21 +3227,7 @@ namespace tools
       return false;
     }
 
-    if (m_wallet)
-    {
-      try
-      {
-        m_wallet->store();
-      }
-      catch (const std::exception& e)
-      {
-        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
-        return false;
-      }
-      delete m_wallet;
-    }
-    m_wallet = wal.release();
-    return true;
+    return host_wallet(req.filename, std::move(wal), er);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_open_wallet(const wallet_rpc::COMMAND_RPC_OPEN_WALLET::request& req, wallet_rpc::COMMAND_RPC_OPEN_WALLET::response& res, epee::json_rpc::error& er)
@@ -3002,21 +3283,7 @@ namespace tools
       return false;
     }
 
-    if (m_wallet)
-    {
-      try
-      {
-        m_wallet->store();
-      }
-      catch (const std::exception& e)
-      {
-        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
-        return false;
-      }
-      delete m_wallet;
-    }
-    m_wallet = wal.release();
-    return true;
+    return host_wallet(req.filename, std::move(wal), er);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_close_wallet(const wallet_rpc::COMMAND_RPC_CLOSE_WALLET::request& req, wallet_rpc::COMMAND_RPC_CLOSE_WALLET::response& res, epee::json_rpc::error& er)
@@ -3032,8 +3299,7 @@ namespace tools
       handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
       return false;
     }
-    delete m_wallet;
-    m_wallet = NULL;
+    close_current_wallet();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -3759,6 +4025,8 @@ int main(int argc, char** argv) {
   command_line::add_arg(desc_params, arg_from_json);
   command_line::add_arg(desc_params, arg_wallet_dir);
   command_line::add_arg(desc_params, arg_prompt_for_password);
+  command_line::add_arg(desc_params, arg_multi_wallet);
+  command_line::add_arg(desc_params, arg_rpc_threads);
 
   daemonizer::init_options(hidden_options, desc_params);
   desc_params.add(hidden_options);
@@ -0,0 +1,194 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "common/threadpool.h"
+#include "misc_language.h"
+#include "wallet2.h"
+#include "wallet_scanner.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.scanner"
+
+namespace
+{
+  std::string wallet_name(const tools::wallet2 *wallet)
+  {
+    return wallet->get_account().get_public_address_str(wallet->nettype());
+  }
+}
+
+namespace tools
+{
+
+wallet_scanner::wallet_scanner(): m_run(true)
+{
+}
+
+void wallet_scanner::add_wallet(wallet2 *wallet)
+{
+  if (std::find(m_wallets.begin(), m_wallets.end(), wallet) == m_wallets.end())
+    m_wallets.push_back(wallet);
+}
+
+void wallet_scanner::remove_wallet(wallet2 *wallet)
+{
+  m_wallets.erase(std::remove(m_wallets.begin(), m_wallets.end(), wallet), m_wallets.end());
+}
+
+bool wallet_scanner::refresh(uint64_t &blocks_fetched)
+{
+  blocks_fetched = 0;
+  m_run.store(true, std::memory_order_relaxed);
+
+  bool all_refreshed = true;
+  std::vector<wallet2*> wallets;
+  bool need_miner_tx = false;
+  for (wallet2 *wallet: m_wallets)
+  {
+    try
+    {
+      // wallets restored from a height only pull hashes up to it, as in wallet2::refresh
+      if (wallet->m_refresh_from_block_height > wallet->m_blockchain.size())
+      {
+        std::list<crypto::hash> short_chain_history;
+        uint64_t blocks_start_height;
+        wallet->get_short_chain_history(short_chain_history);
+        wallet->fast_refresh(wallet->m_refresh_from_block_height, blocks_start_height, short_chain_history);
+      }
+      wallets.push_back(wallet);
+      need_miner_tx |= wallet->m_refresh_type != wallet2::RefreshNoCoinbase;
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to refresh wallet " << wallet_name(wallet) << ": " << e.what());
+      all_refreshed = false;
+    }
+  }
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  size_t try_count = 0;
+  while (m_run.load(std::memory_order_relaxed) && !wallets.empty())
+  {
+    // the daemon sends blocks from the last one the wallet furthest behind has in common with it
+    wallet2 *lead = *std::min_element(wallets.begin(), wallets.end(), [](const wallet2 *a, const wallet2 *b) {
+      return a->m_blockchain.size() < b->m_blockchain.size();
+    });
+    const uint64_t lead_height = lead->m_blockchain.size();
+
+    std::list<crypto::hash> short_chain_history;
+    lead->get_short_chain_history(short_chain_history);
+    uint64_t start_height = 0;
+    std::vector<cryptonote::block_complete_entry> blocks;
+    std::vector<wallet2::parsed_block> parsed_blocks;
+    bool error = false;
+    {
+      // miner txes are pulled when any of the wallets processes them
+      const wallet2::RefreshType refresh_type = lead->m_refresh_type;
+      auto refresh_type_restorer = epee::misc_utils::create_scope_leave_handler([&]() { lead->m_refresh_type = refresh_type; });
+      if (need_miner_tx)
+        lead->m_refresh_type = wallet2::RefreshOptimizeCoinbase;
+      lead->pull_and_parse_next_blocks(0, start_height, short_chain_history, {}, blocks, parsed_blocks, error);
+    }
+    if (error)
+    {
+      if (try_count++ < 3)
+      {
+        LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
+        continue;
+      }
+      MERROR("pull_blocks failed, try_count=" << try_count);
+      return false;
+    }
+    try_count = 0;
+    if (blocks.empty())
+      break;
+
+    // wallets which already have the last block are up to date with this batch
+    const uint64_t end_height = start_height + blocks.size();
+    std::vector<wallet2*> batch_wallets;
+    for (wallet2 *wallet: wallets)
+      if (!wallet->m_blockchain.is_in_bounds(end_height - 1) || wallet->m_blockchain[end_height - 1] != parsed_blocks.back().hash)
+        batch_wallets.push_back(wallet);
+
+    std::vector<uint64_t> blocks_added(batch_wallets.size(), 0);
+    std::vector<char> failed(batch_wallets.size(), 0);
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < batch_wallets.size(); ++i)
+    {
+      tpool.submit(&waiter, [&, i]() {
+        wallet2 *wallet = batch_wallets[i];
+        try
+        {
+          std::vector<wallet2::tx_cache_data> tx_cache_data;
+          wallet->scan_parsed_blocks(parsed_blocks, wallet->get_account().get_keys().m_view_secret_key, wallet->m_subaddresses, tx_cache_data);
+          wallet->process_parsed_blocks(start_height, blocks, parsed_blocks, tx_cache_data, blocks_added[i]);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to refresh wallet " << wallet_name(wallet) << ": " << e.what());
+          failed[i] = 1;
+        }
+      });
+    }
+    waiter.wait(&tpool);
+
+    for (size_t i = 0; i < batch_wallets.size(); ++i)
+    {
+      blocks_fetched += blocks_added[i];
+      if (failed[i])
+      {
+        all_refreshed = false;
+        wallets.erase(std::find(wallets.begin(), wallets.end(), batch_wallets[i]));
+      }
+    }
+
+    // nothing past what the lead had means the daemon has no more blocks
+    if (end_height <= lead_height)
+    {
+      for (wallet2 *wallet: wallets)
+      {
+        wallet->m_node_rpc_proxy.set_height(wallet->m_blockchain.size());
+        try
+        {
+          wallet->update_pool_state(true);
+        }
+        catch (...)
+        {
+          LOG_PRINT_L1("Failed to check pending transactions of wallet " << wallet_name(wallet));
+        }
+        wallet->m_first_refresh_done = true;
+      }
+      break;
+    }
+  }
+
+  return all_refreshed;
+}
+
+}
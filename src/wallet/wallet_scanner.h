@@ -0,0 +1,63 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+namespace tools
+{
+  class wallet2;
+
+  /// Refreshes many wallets using the same daemon with a single block download: every batch of blocks is
+  /// pulled and parsed once, then each wallet checks the outputs against its own view key and adds the
+  /// blocks to its own transfers, with the wallets running on the threadpool side by side.
+  ///
+  /// The wallets must not be refreshed, stored or otherwise used by other threads during refresh().
+  class wallet_scanner
+  {
+  public:
+    wallet_scanner();
+
+    void add_wallet(wallet2 *wallet);
+    void remove_wallet(wallet2 *wallet);
+    size_t size() const { return m_wallets.size(); }
+
+    /// Refreshes all wallets up to the daemon's height. A wallet failing to process a batch is left out
+    /// for the rest of the refresh and should be refreshed on its own, returns false if any was.
+    bool refresh(uint64_t &blocks_fetched);
+
+    /// Makes a running refresh() return after the current batch
+    void stop() { m_run.store(false, std::memory_order_relaxed); }
+
+  private:
+    std::vector<wallet2*> m_wallets;
+    std::atomic<bool> m_run;
+  };
+}
@@ -0,0 +1,562 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks of the LMDB blockchain database and of the Blockchain calls serving wallets and syncing
+// peers. They run on a synthetic chain generated from a seed, so that runs with the same options are
+// comparable, or on an existing chain database opened read only. Results are written as JSON.
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "cryptonote_core/tx_pool.h"
+#include "misc_log_ex.h"
+#include "ringct/rctOps.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace po = boost::program_options;
+using namespace cryptonote;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_db_dir = { "data-dir", "Chain database to benchmark, a synthetic chain is generated in it if it is empty; a temporary directory by default" };
+  const command_line::arg_descriptor<uint64_t> arg_blocks = { "blocks", "Blocks of the synthetic chain", 10000 };
+  const command_line::arg_descriptor<unsigned> arg_txs_per_block = { "txs-per-block", "Transactions in each block of the synthetic chain", 10 };
+  const command_line::arg_descriptor<unsigned> arg_ring_size = { "ring-size", "Ring size of the synthetic transactions and of the output lookups", 11 };
+  const command_line::arg_descriptor<unsigned> arg_batch_size = { "batch-size", "Blocks added in each batch transaction of the synthetic chain", 100 };
+  const command_line::arg_descriptor<uint64_t> arg_seed = { "seed", "Seed of the synthetic chain and of the queries", 1 };
+  const command_line::arg_descriptor<unsigned> arg_iterations = { "iterations", "Calls of each lookup benchmark, the scanning ones make a tenth of them", 10000 };
+  const command_line::arg_descriptor<std::string> arg_output = { "output", "JSON file the results are written to", "db_benchmarks.json" };
+
+  const std::pair<uint8_t, uint64_t> synthetic_hard_forks[] = { std::make_pair(1, 0), std::make_pair(0, 0) };
+  const test_options synthetic_test_options = { synthetic_hard_forks };
+
+  // blocks sampled for the transactions and key images the lookups ask for
+  const size_t SAMPLED_BLOCKS = 1000;
+
+  typedef std::chrono::steady_clock clock;
+
+  struct benchmark_result
+  {
+    std::string name;
+    uint64_t calls;
+    uint64_t failures;
+    double total_ms;
+    double mean_us;
+    double p50_us;
+    double p99_us;
+    double max_us;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(calls)
+      KV_SERIALIZE(failures)
+      KV_SERIALIZE(total_ms)
+      KV_SERIALIZE(mean_us)
+      KV_SERIALIZE(p50_us)
+      KV_SERIALIZE(p99_us)
+      KV_SERIALIZE(max_us)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct benchmark_report
+  {
+    std::string chain; // "synthetic" or "existing"
+    uint64_t seed;
+    uint64_t height;
+    uint64_t tx_count;
+    uint64_t rct_outputs;
+    unsigned ring_size;
+    std::vector<benchmark_result> results;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(chain)
+      KV_SERIALIZE(seed)
+      KV_SERIALIZE(height)
+      KV_SERIALIZE(tx_count)
+      KV_SERIALIZE(rct_outputs)
+      KV_SERIALIZE(ring_size)
+      KV_SERIALIZE(results)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  void add_result(benchmark_report &report, const std::string &name, std::vector<uint64_t> &nanos, uint64_t failures)
+  {
+    if (nanos.empty())
+      return;
+    std::sort(nanos.begin(), nanos.end());
+    uint64_t total = 0;
+    for (uint64_t ns: nanos)
+      total += ns;
+    auto percentile = [&nanos](double q) { return nanos[std::min<size_t>(nanos.size() - 1, nanos.size() * q)] / 1e3; };
+
+    benchmark_result result;
+    result.name = name;
+    result.calls = nanos.size();
+    result.failures = failures;
+    result.total_ms = total / 1e6;
+    result.mean_us = total / 1e3 / nanos.size();
+    result.p50_us = percentile(0.5);
+    result.p99_us = percentile(0.99);
+    result.max_us = nanos.back() / 1e3;
+    report.results.push_back(result);
+
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << result.calls << " calls"
+              << "  mean " << std::setw(10) << result.mean_us << " us"
+              << "  p50 " << std::setw(10) << result.p50_us << " us"
+              << "  p99 " << std::setw(10) << result.p99_us << " us";
+    if (failures)
+      std::cout << "  " << failures << " FAILED";
+    std::cout << std::endl;
+  }
+
+  // times each call of f(i), which returns false on failure
+  template<typename F>
+  void run_benchmark(benchmark_report &report, const std::string &name, size_t calls, F f)
+  {
+    std::vector<uint64_t> nanos;
+    nanos.reserve(calls);
+    uint64_t failures = 0;
+    for (size_t i = 0; i < calls; ++i)
+    {
+      const clock::time_point start = clock::now();
+      bool ok;
+      try
+      {
+        ok = f(i);
+      }
+      catch (const std::exception &e)
+      {
+        MERROR(name << " failed: " << e.what());
+        ok = false;
+      }
+      nanos.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+      if (!ok)
+        ++failures;
+    }
+    add_result(report, name, nanos, failures);
+  }
+
+  // the chain is not validated: transactions have the shape of two input bulletproof transactions
+  // with random signatures, ring members are picked from the outputs already in the chain
+  class synthetic_chain
+  {
+  public:
+    synthetic_chain(BlockchainDB &db, uint64_t seed, unsigned txs_per_block, unsigned ring_size)
+      : m_db(db), m_rng(seed), m_txs_per_block(txs_per_block), m_ring_size(std::max(1u, ring_size)), m_coins()
+    {
+      // commitments are expanded when transactions are parsed, so they have to be valid points
+      for (size_t i = 0; i < POINTS; ++i)
+        m_points.push_back(rct::scalarmultBase(rct::skGen()));
+    }
+
+    void generate(uint64_t blocks, unsigned batch_size, benchmark_report &report)
+    {
+      batch_size = std::max(1u, batch_size);
+      if (m_db.height() == 0)
+      {
+        block genesis;
+        generate_genesis_block(genesis, get_config(FAKECHAIN).GENESIS_TX, get_config(FAKECHAIN).GENESIS_NONCE);
+        m_coins = get_outs_money_amount(genesis.miner_tx);
+        m_db.add_block(genesis, get_transaction_weight(genesis.miner_tx), 1, m_coins, {});
+      }
+
+      // blocks are made before each batch is timed, so only the database work is measured
+      std::vector<uint64_t> batch_nanos, block_nanos;
+      std::vector<synthetic_block> batch;
+      while (m_db.height() < blocks)
+      {
+        const uint64_t first = m_db.height();
+        crypto::hash prev_id = m_db.top_block_hash();
+        batch.resize(std::min<uint64_t>(batch_size, blocks - first));
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+          make_block(first + i, prev_id, batch[i]);
+          prev_id = get_block_hash(batch[i].b);
+        }
+
+        const clock::time_point start = clock::now();
+        m_db.batch_start(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+          const clock::time_point block_start = clock::now();
+          m_coins += get_outs_money_amount(batch[i].b.miner_tx);
+          m_db.add_block(batch[i].b, batch[i].weight, first + i + 1, m_coins, batch[i].txs);
+          block_nanos.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - block_start).count());
+        }
+        m_db.batch_stop();
+        batch_nanos.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+      }
+      add_result(report, "BlockchainLMDB::add_block", block_nanos, 0);
+      add_result(report, "BlockchainLMDB::add_block batch of " + std::to_string(batch_size), batch_nanos, 0);
+    }
+
+  private:
+    struct synthetic_block
+    {
+      block b;
+      std::vector<transaction> txs;
+      size_t weight;
+    };
+
+    static const size_t POINTS = 1024;
+
+    const rct::key &random_point()
+    {
+      return m_points[m_rng() % m_points.size()];
+    }
+
+    void make_tx_outputs(transaction &tx, size_t count, uint64_t amount)
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        tx_out out;
+        out.amount = amount;
+        out.target = txout_to_key(rct::rct2pk(random_point()));
+        tx.vout.push_back(out);
+      }
+      add_tx_pub_key_to_extra(tx, rct::rct2pk(random_point()));
+    }
+
+    void make_rct_signatures(transaction &tx)
+    {
+      rct::rctSig &rv = tx.rct_signatures;
+      rv.type = rct::RCTTypeBulletproof;
+      rv.txnFee = m_rng() % COIN;
+      for (size_t i = 0; i < tx.vout.size(); ++i)
+      {
+        rv.ecdhInfo.push_back({rct::skGen(), rct::skGen(), rct::zero()});
+        rv.outPk.push_back({rct::pk2rct(boost::get<txout_to_key>(tx.vout[i].target).key), random_point()});
+      }
+
+      // a single bulletproof covering all outputs, as padded to the next power of two
+      rct::Bulletproof bp;
+      bp.A = bp.S = bp.T1 = bp.T2 = random_point();
+      bp.taux = bp.mu = bp.a = bp.b = bp.t = rct::skGen();
+      size_t rounds = 6;
+      while ((size_t(1) << (rounds - 6)) < tx.vout.size())
+        ++rounds;
+      for (size_t i = 0; i < rounds; ++i)
+      {
+        bp.L.push_back(random_point());
+        bp.R.push_back(random_point());
+      }
+      rv.p.bulletproofs.push_back(bp);
+
+      for (size_t i = 0; i < tx.vin.size(); ++i)
+      {
+        rct::mgSig mg;
+        mg.ss.resize(m_ring_size, rct::keyV(2));
+        for (rct::keyV &ss: mg.ss)
+          for (rct::key &k: ss)
+            k = rct::skGen();
+        mg.cc = rct::skGen();
+        rv.p.MGs.push_back(mg);
+        rv.p.pseudoOuts.push_back(random_point());
+      }
+    }
+
+    void make_block(uint64_t height, const crypto::hash &prev_id, synthetic_block &sb)
+    {
+      block &b = sb.b;
+      b = block();
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = 1341378000 + height * DIFFICULTY_TARGET_V2;
+      b.prev_id = prev_id;
+      b.nonce = m_rng();
+
+      b.miner_tx.version = 2;
+      b.miner_tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+      txin_gen gen;
+      gen.height = height;
+      b.miner_tx.vin.push_back(gen);
+      make_tx_outputs(b.miner_tx, 1, 1000 * COIN);
+      sb.weight = get_transaction_weight(b.miner_tx);
+
+      const uint64_t outputs = m_db.get_num_outputs(0);
+      sb.txs.resize(m_txs_per_block);
+      for (transaction &tx: sb.txs)
+      {
+        tx = transaction();
+        tx.version = 2;
+        for (size_t n = 0; n < 2; ++n)
+        {
+          txin_to_key in;
+          in.amount = 0;
+          std::vector<uint64_t> offsets;
+          for (unsigned i = 0; i < m_ring_size; ++i)
+            offsets.push_back(outputs ? m_rng() % outputs : 0);
+          std::sort(offsets.begin(), offsets.end());
+          in.key_offsets = absolute_output_offsets_to_relative(offsets);
+          in.k_image = crypto::rand<crypto::key_image>();
+          tx.vin.push_back(in);
+        }
+        make_tx_outputs(tx, 2, 0);
+        make_rct_signatures(tx);
+        tx.invalidate_hashes();
+        b.tx_hashes.push_back(get_transaction_hash(tx));
+        sb.weight += get_transaction_weight(tx);
+      }
+      b.invalidate_hashes();
+    }
+
+  private:
+    BlockchainDB &m_db;
+    std::mt19937_64 m_rng;
+    unsigned m_txs_per_block;
+    unsigned m_ring_size;
+    uint64_t m_coins;
+    std::vector<rct::key> m_points;
+  };
+
+  // hashes a peer at the given height sends, as Blockchain::get_short_chain_history
+  std::list<crypto::hash> short_chain_history(const BlockchainDB &db, uint64_t height)
+  {
+    std::list<crypto::hash> ids;
+    const uint64_t sz = height + 1;
+    uint64_t back_offset = 1, multiplier = 1;
+    for (size_t i = 0; back_offset < sz; ++i)
+    {
+      ids.push_back(db.get_block_hash_from_height(sz - back_offset));
+      if (i < 10)
+        ++back_offset;
+      else
+        back_offset += (multiplier *= 2);
+    }
+    ids.push_back(db.get_block_hash_from_height(0));
+    return ids;
+  }
+
+  void run_benchmarks(Blockchain &blockchain, unsigned ring_size, unsigned iterations, std::mt19937_64 &rng, benchmark_report &report)
+  {
+    BlockchainDB &db = blockchain.get_db();
+    const uint64_t height = db.height();
+    const uint64_t outputs = db.get_num_outputs(0);
+    const size_t scans = std::max(1u, iterations / 10);
+
+    // transactions and spent key images of randomly picked blocks
+    std::vector<crypto::hash> tx_hashes;
+    std::vector<crypto::key_image> key_images;
+    for (size_t i = 0; i < std::min<uint64_t>(height, SAMPLED_BLOCKS); ++i)
+    {
+      const block b = db.get_block_from_height(rng() % height);
+      tx_hashes.push_back(get_transaction_hash(b.miner_tx));
+      for (const crypto::hash &h: b.tx_hashes)
+      {
+        tx_hashes.push_back(h);
+        blobdata blob;
+        transaction tx;
+        if (!db.get_tx_blob(h, blob) || !parse_and_validate_tx_from_blob(blob, tx))
+          continue;
+        for (const txin_v &in: tx.vin)
+          if (in.type() == typeid(txin_to_key))
+            key_images.push_back(boost::get<txin_to_key>(in).k_image);
+      }
+    }
+
+    auto random_offsets = [&]() {
+      std::vector<uint64_t> offsets;
+      for (unsigned i = 0; i < ring_size; ++i)
+        offsets.push_back(rng() % outputs);
+      std::sort(offsets.begin(), offsets.end());
+      offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+      return offsets;
+    };
+
+    const std::string ring = "(ring " + std::to_string(ring_size) + ")";
+    if (outputs)
+    {
+      run_benchmark(report, "BlockchainLMDB::get_output_key " + ring, iterations, [&](size_t) {
+        std::vector<output_data_t> data;
+        db.get_output_key(0, random_offsets(), data);
+        return !data.empty();
+      });
+
+      run_benchmark(report, "Blockchain::get_outs " + ring, iterations, [&](size_t) {
+        COMMAND_RPC_GET_OUTPUTS_BIN::request req;
+        COMMAND_RPC_GET_OUTPUTS_BIN::response res;
+        for (uint64_t index: random_offsets())
+          req.outputs.push_back({0, index});
+        return blockchain.get_outs(req, res) && res.outs.size() == req.outputs.size();
+      });
+    }
+
+    if (!key_images.empty())
+    {
+      run_benchmark(report, "BlockchainLMDB::has_key_image (spent)", iterations, [&](size_t) {
+        return db.has_key_image(key_images[rng() % key_images.size()]);
+      });
+    }
+    run_benchmark(report, "BlockchainLMDB::has_key_image (unspent)", iterations, [&](size_t) {
+      return !db.has_key_image(crypto::rand<crypto::key_image>());
+    });
+
+    if (!tx_hashes.empty())
+    {
+      run_benchmark(report, "BlockchainLMDB::get_tx_blob", iterations, [&](size_t) {
+        blobdata blob;
+        return db.get_tx_blob(tx_hashes[rng() % tx_hashes.size()], blob);
+      });
+
+      run_benchmark(report, "BlockchainLMDB::get_pruned_tx_blob", iterations, [&](size_t) {
+        blobdata blob;
+        return db.get_pruned_tx_blob(tx_hashes[rng() % tx_hashes.size()], blob);
+      });
+    }
+
+    run_benchmark(report, "BlockchainLMDB::get_output_distribution", scans, [&](size_t) {
+      std::vector<uint64_t> distribution;
+      uint64_t base;
+      return db.get_output_distribution(0, 0, height - 1, distribution, base);
+    });
+
+    // peers and wallets asking from a random height of the chain
+    run_benchmark(report, "Blockchain::find_blockchain_supplement (chain entry)", scans, [&](size_t) {
+      NOTIFY_RESPONSE_CHAIN_ENTRY::request resp;
+      return blockchain.find_blockchain_supplement(short_chain_history(db, rng() % height), resp);
+    });
+
+    run_benchmark(report, "Blockchain::find_blockchain_supplement (blocks)", scans, [&](size_t) {
+      std::vector<std::pair<std::pair<blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, blobdata>>>> blocks;
+      uint64_t total_height, start_height;
+      return blockchain.find_blockchain_supplement(0, short_chain_history(db, rng() % height), blocks, total_height, start_height,
+        false, true, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT);
+    });
+  }
+}
+
+int main(int argc, char** argv)
+{
+  TRY_ENTRY();
+  tools::on_startup();
+
+  mlog_configure(mlog_get_default_log_path("db_benchmarks.log"), true);
+  mlog_set_log_level(0);
+
+  po::options_description desc_options("Command line options");
+  command_line::add_arg(desc_options, arg_db_dir);
+  command_line::add_arg(desc_options, arg_blocks);
+  command_line::add_arg(desc_options, arg_txs_per_block);
+  command_line::add_arg(desc_options, arg_ring_size);
+  command_line::add_arg(desc_options, arg_batch_size);
+  command_line::add_arg(desc_options, arg_seed);
+  command_line::add_arg(desc_options, arg_iterations);
+  command_line::add_arg(desc_options, arg_output);
+  command_line::add_arg(desc_options, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_options, cryptonote::arg_stagenet_on);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  std::string data_dir = command_line::get_arg(vm, arg_db_dir);
+  const bool temporary = data_dir.empty();
+  if (temporary)
+    data_dir = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  boost::filesystem::create_directories(data_dir);
+
+  benchmark_report report;
+  report.seed = command_line::get_arg(vm, arg_seed);
+  report.ring_size = std::max(1u, command_line::get_arg(vm, arg_ring_size));
+  std::mt19937_64 rng(report.seed);
+
+  // existing chains are opened read only, synthetic ones are generated first
+  const bool synthetic = !boost::filesystem::exists(boost::filesystem::path(data_dir) / CRYPTONOTE_BLOCKCHAINDATA_FILENAME);
+  BlockchainDB *db = new BlockchainLMDB();
+  db->open(data_dir, synthetic ? 0 : DBF_RDONLY);
+  report.chain = synthetic ? "synthetic" : "existing";
+
+  if (synthetic)
+  {
+    std::cout << "Generating a synthetic chain of " << command_line::get_arg(vm, arg_blocks) << " blocks in " << data_dir << std::endl;
+    HardFork hardfork(*db, 1, 0);
+    hardfork.init();
+    db->set_hard_fork(&hardfork);
+    synthetic_chain chain(*db, report.seed, command_line::get_arg(vm, arg_txs_per_block), report.ring_size);
+    chain.generate(std::max<uint64_t>(2, command_line::get_arg(vm, arg_blocks)), command_line::get_arg(vm, arg_batch_size), report);
+    db->set_hard_fork(nullptr);
+  }
+
+  const network_type nettype = synthetic ? FAKECHAIN : command_line::get_arg(vm, cryptonote::arg_testnet_on) ? TESTNET
+    : command_line::get_arg(vm, cryptonote::arg_stagenet_on) ? STAGENET : MAINNET;
+  std::unique_ptr<Blockchain> blockchain;
+  tx_memory_pool mempool(*blockchain);
+  blockchain.reset(new Blockchain(mempool));
+  if (!blockchain->init(db, nettype, true, synthetic ? &synthetic_test_options : nullptr))
+  {
+    std::cerr << "Failed to initialize the blockchain in " << data_dir << std::endl;
+    return 1;
+  }
+
+  report.height = db->height();
+  report.tx_count = db->get_tx_count();
+  report.rct_outputs = db->get_num_outputs(0);
+  std::cout << "Chain of " << report.height << " blocks, " << report.tx_count << " transactions and " << report.rct_outputs << " RingCT outputs" << std::endl;
+
+  run_benchmarks(*blockchain, report.ring_size, std::max(1u, command_line::get_arg(vm, arg_iterations)), rng, report);
+
+  blockchain->deinit();
+  if (temporary)
+    boost::filesystem::remove_all(data_dir);
+
+  const std::string output = command_line::get_arg(vm, arg_output);
+  if (!epee::serialization::store_t_to_json_file(report, output))
+  {
+    std::cerr << "Failed to write " << output << std::endl;
+    return 1;
+  }
+  std::cout << "Results written to " << output << std::endl;
+  return 0;
+
+  CATCH_ENTRY_L0("main", 1);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "include_base_utils.h"
+#include "file_io_utils.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+#include "storages/portable_storage_direct.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "fuzzer.h"
+
+// Loads the input with both portable_storage and direct_binary_reader, aborts if they don't agree on
+// the input being valid or on what they read from it
+class PortableStorageDirectFuzzer: public Fuzzer
+{
+public:
+  PortableStorageDirectFuzzer() {}
+  virtual int init();
+  virtual int run(const std::string &filename);
+};
+
+int PortableStorageDirectFuzzer::init()
+{
+  return 0;
+}
+
+template<class t_struct>
+static void check(const std::string &s)
+{
+  t_struct tree_struct = AUTO_VAL_INIT(tree_struct), direct_struct = AUTO_VAL_INIT(direct_struct);
+  epee::serialization::portable_storage ps;
+  epee::serialization::direct_binary_reader reader;
+  const bool tree_loaded = ps.load_from_binary(s) && tree_struct.load(ps);
+  const bool direct_loaded = reader.load_from_binary(s) && direct_struct.load(reader);
+  if (tree_loaded != direct_loaded)
+  {
+    std::cerr << "portable_storage " << (tree_loaded ? "accepts" : "rejects") << " an input direct_binary_reader " << (direct_loaded ? "accepts" : "rejects") << std::endl;
+    abort();
+  }
+
+  epee::serialization::portable_storage tree_out;
+  epee::serialization::direct_binary_writer direct_out;
+  std::string tree_blob, direct_blob;
+  tree_struct.store(tree_out);
+  tree_out.store_to_binary(tree_blob);
+  direct_struct.store(direct_out);
+  direct_out.store_to_binary(direct_blob);
+  if (tree_blob != direct_blob)
+  {
+    std::cerr << "portable_storage and direct_binary_reader read different values" << std::endl;
+    abort();
+  }
+}
+
+int PortableStorageDirectFuzzer::run(const std::string &filename)
+{
+  std::string s;
+
+  if (!epee::file_io_utils::load_file_to_string(filename, s))
+  {
+    std::cout << "Error: failed to load file " << filename << std::endl;
+    return 1;
+  }
+  check<cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request>(s);
+  check<cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request>(s);
+  check<cryptonote::CORE_SYNC_DATA>(s);
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  PortableStorageDirectFuzzer fuzzer;
+  return run_fuzzer(argc, argv, fuzzer);
+}
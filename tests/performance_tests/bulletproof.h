@@ -32,6 +32,7 @@
 
 #include "ringct/rctSigs.h"
 #include "ringct/bulletproofs.h"
+#include "common/threadpool.h"
 
 template<bool a_verify, size_t n_amounts>
 class test_bulletproof
@@ -61,6 +62,29 @@ private:
   rct::Bulletproof proof;
 };
 
+// proving on a pool of n_threads threads, to see how it scales
+template<size_t n_amounts, unsigned n_threads>
+class test_bulletproof_prove_threads
+{
+public:
+  static const size_t loop_count = 200 / n_amounts;
+
+  bool init()
+  {
+    tpool.reset(tools::threadpool::getNewForUnitTests(n_threads));
+    return rct::bulletproof_VERIFY(rct::bulletproof_PROVE(std::vector<uint64_t>(n_amounts, 749327532984), rct::skvGen(n_amounts), *tpool));
+  }
+
+  bool test()
+  {
+    rct::bulletproof_PROVE(std::vector<uint64_t>(n_amounts, 749327532984), rct::skvGen(n_amounts), *tpool);
+    return true;
+  }
+
+private:
+  std::unique_ptr<tools::threadpool> tpool;
+};
+
 template<bool batch, size_t start, size_t repeat, size_t mul, size_t add, size_t N>
 class test_aggregated_bulletproof
 {
@@ -0,0 +1,67 @@
+// Copyright (c) 2019, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "crypto/chacha.h"
+
+template<size_t bytes, bool chacha20>
+class test_chacha
+{
+public:
+  static const size_t loop_count = bytes < 4096 ? 100000 : bytes < 65536 ? 10000 : 100;
+
+  bool init()
+  {
+    m_data.resize(bytes);
+    m_cipher.resize(bytes);
+    crypto::rand(bytes, m_data.data());
+    crypto::rand(m_key.size(), m_key.data());
+    m_iv = crypto::rand<crypto::chacha_iv>();
+    return true;
+  }
+
+  bool test()
+  {
+    if (chacha20)
+      crypto::chacha20(m_data.data(), bytes, m_key, m_iv, m_cipher.data());
+    else
+      crypto::chacha8(m_data.data(), bytes, m_key, m_iv, m_cipher.data());
+    return true;
+  }
+
+private:
+  std::vector<uint8_t> m_data;
+  std::vector<char> m_cipher;
+  crypto::chacha_key m_key;
+  crypto::chacha_iv m_iv;
+};
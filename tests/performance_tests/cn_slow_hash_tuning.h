@@ -0,0 +1,237 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "crypto/hash.h"
+#include "performance_tests.h"
+
+/// Throughput of the cn_slow_hash variants used below the RandomX fork, measured for every thread count,
+/// huge pages vs malloc scratchpads and hardware vs software AES. The thread count after which adding
+/// threads stops paying off is written as prep_blocks_threads to a profile the daemon reads with
+/// --prep-blocks-threads-profile.
+class cn_slow_hash_tuning
+{
+public:
+  struct variant
+  {
+    const char* name;
+    int variant;
+    int modifier;
+  };
+
+  struct result
+  {
+    size_t variant_index;
+    unsigned threads;
+    bool huge_pages;
+    bool huge_pages_allocated;
+    bool software_aes;
+    double hashes_per_second;
+  };
+
+  cn_slow_hash_tuning(unsigned hashes_per_thread) : m_hashes_per_thread(std::max(1u, hashes_per_thread)) {}
+
+  bool run(const std::string& profile_path)
+  {
+    const unsigned max_threads = std::max(1u, boost::thread::hardware_concurrency());
+    std::vector<unsigned> thread_counts;
+
+    for (unsigned threads = 1; threads < max_threads; threads *= 2)
+      thread_counts.push_back(threads);
+
+    thread_counts.push_back(max_threads);
+
+    for (size_t i=0; i<variants().size(); i++)
+    {
+      for (unsigned threads : thread_counts)
+      {
+        for (int config=0; config<3; config++)
+        {
+          //software AES and malloc scratchpads are measured against the default configuration only
+
+          const bool huge_pages = config != 1, software_aes = config == 2;
+          m_results.push_back(measure(i, threads, huge_pages, software_aes));
+          print(m_results.back());
+        }
+      }
+    }
+
+    crypto::cn_slow_hash_set_options(1, -1);
+
+    const unsigned prep_blocks_threads = pick_threads(thread_counts);
+
+    std::cout << "prep_blocks_threads=" << prep_blocks_threads << std::endl;
+
+    return write_profile(profile_path, prep_blocks_threads);
+  }
+
+private:
+  static const std::vector<variant>& variants()
+  {
+    static const std::vector<variant> result = {
+      {"cn/0", 0, CN_MODIFIER_NONE},
+      {"cn/1", 1, CN_MODIFIER_NONE},
+      {"cn/2", 2, CN_MODIFIER_NONE},
+      {"cn/2 waltz", 2, CN_MODIFIER_WALTZ},
+      {"cn/2 reverse waltz", 2, CN_MODIFIER_REVERSE_WALTZ},
+    };
+    return result;
+  }
+
+  result measure(size_t variant_index, unsigned threads, bool huge_pages, bool software_aes) const
+  {
+    const variant& v = variants()[variant_index];
+
+    crypto::cn_slow_hash_set_options(huge_pages, software_aes);
+
+    boost::barrier start(threads + 1), ready(threads + 1);
+    std::vector<boost::thread> workers;
+    std::vector<char> allocated(threads, 0);
+
+    for (unsigned t=0; t<threads; t++)
+    {
+      workers.emplace_back([&, t]() {
+        crypto::cn_slow_hash_allocate_state();
+        allocated[t] = crypto::cn_slow_hash_huge_pages_allocated();
+
+        char data[76] = {0}; //size of a block hashing blob
+        data[0] = (char)t;
+        crypto::hash hash;
+
+        ready.wait();
+        start.wait();
+
+        for (unsigned i=0; i<m_hashes_per_thread; i++)
+        {
+          data[1] = (char)i;
+          crypto::cn_slow_hash(data, sizeof(data), hash, v.variant, v.modifier);
+        }
+
+        crypto::cn_slow_hash_free_state();
+      });
+    }
+
+    ready.wait();
+
+    performance_timer timer;
+    timer.start();
+
+    start.wait();
+
+    for (boost::thread& worker : workers)
+      worker.join();
+
+    const double seconds = std::max<double>(timer.elapsed_ms(), 1) / 1000;
+
+    result r;
+    r.variant_index        = variant_index;
+    r.threads              = threads;
+    r.huge_pages           = huge_pages;
+    r.huge_pages_allocated = std::all_of(allocated.begin(), allocated.end(), [](char a) { return a != 0; });
+    r.software_aes         = software_aes;
+    r.hashes_per_second    = threads * m_hashes_per_thread / seconds;
+    return r;
+  }
+
+  static void print(const result& r)
+  {
+    std::cout << std::left << std::setw(20) << variants()[r.variant_index].name
+              << " threads " << std::setw(4) << r.threads
+              << (r.huge_pages ? (r.huge_pages_allocated ? " huge pages" : " huge pages (unavailable)") : " malloc")
+              << (r.software_aes ? ", software AES" : ", default AES")
+              << ": " << std::fixed << std::setprecision(1) << r.hashes_per_second << " H/s" << std::endl;
+  }
+
+  /// Smallest thread count reaching 95% of the best mean throughput (relative to each variant's best),
+  /// so the daemon doesn't oversubscribe cores which only add memory bandwidth contention
+  unsigned pick_threads(const std::vector<unsigned>& thread_counts) const
+  {
+    std::vector<double> best(variants().size(), 0);
+
+    for (const result& r : m_results)
+      if (r.huge_pages && !r.software_aes)
+        best[r.variant_index] = std::max(best[r.variant_index], r.hashes_per_second);
+
+    std::vector<double> scores;
+
+    for (unsigned threads : thread_counts)
+    {
+      double score = 0;
+
+      for (const result& r : m_results)
+        if (r.threads == threads && r.huge_pages && !r.software_aes && best[r.variant_index] > 0)
+          score += r.hashes_per_second / best[r.variant_index];
+
+      scores.push_back(score / variants().size());
+    }
+
+    const double best_score = *std::max_element(scores.begin(), scores.end());
+
+    for (size_t i=0; i<thread_counts.size(); i++)
+      if (scores[i] >= best_score * 0.95)
+        return thread_counts[i];
+
+    return thread_counts.back();
+  }
+
+  bool write_profile(const std::string& path, unsigned prep_blocks_threads) const
+  {
+    std::ofstream out(path);
+
+    out << "# cn_slow_hash tuning profile written by performance_tests --cn-slow-hash-tuning" << std::endl;
+    out << "prep_blocks_threads=" << prep_blocks_threads << std::endl;
+    out << "# variant, threads, huge pages, software AES, H/s" << std::endl;
+
+    for (const result& r : m_results)
+      out << "# " << variants()[r.variant_index].name << ", " << r.threads << ", " << (r.huge_pages && r.huge_pages_allocated)
+          << ", " << r.software_aes << ", " << std::fixed << std::setprecision(1) << r.hashes_per_second << std::endl;
+
+    if (!out)
+    {
+      std::cout << "Failed to write tuning profile to " << path << std::endl;
+      return false;
+    }
+
+    std::cout << "Tuning profile written to " << path << std::endl;
+    return true;
+  }
+
+  unsigned m_hashes_per_thread;
+  std::vector<result> m_results;
+};
@@ -42,6 +42,7 @@
 #include "cn_slow_hash_2.h"
 #include "cn_slow_hash_waltz.h"
 #include "cn_slow_hash_reverse_waltz.h"
+#include "cn_slow_hash_tuning.h"
 #include "derive_public_key.h"
 #include "derive_secret_key.h"
 #include "ge_frombytes_vartime.h"
@@ -54,6 +55,7 @@
 #include "subaddress_expand.h"
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
+#include "chacha.h"
 #include "rct_mlsag.h"
 #include "equality.h"
 #include "range_proof.h"
@@ -61,6 +63,7 @@
 #include "bulletproof.h"
 #include "crypto_ops.h"
 #include "multiexp.h"
+#include "stake_processing.h"
 
 namespace po = boost::program_options;
 
@@ -68,8 +71,6 @@ int main(int argc, char** argv)
 {
   TRY_ENTRY();
   tools::on_startup();
-  set_process_affinity(1);
-  set_thread_high_priority();
 
   mlog_configure(mlog_get_default_log_path("performance_tests.log"), true);
 
@@ -78,10 +79,12 @@ int main(int argc, char** argv)
   const command_line::arg_descriptor<bool> arg_verbose = { "verbose", "Verbose output", false };
   const command_line::arg_descriptor<bool> arg_stats = { "stats", "Including statistics (min/median)", false };
   const command_line::arg_descriptor<unsigned> arg_loop_multiplier = { "loop-multiplier", "Run for that many times more loops", 1 };
+  const command_line::arg_descriptor<std::string> arg_cn_slow_hash_tuning = { "cn-slow-hash-tuning", "Benchmark cn_slow_hash variants on all threads and write a tuning profile for --prep-blocks-threads-profile to this file" };
   command_line::add_arg(desc_options, arg_filter);
   command_line::add_arg(desc_options, arg_verbose);
   command_line::add_arg(desc_options, arg_stats);
   command_line::add_arg(desc_options, arg_loop_multiplier);
+  command_line::add_arg(desc_options, arg_cn_slow_hash_tuning);
 
   po::variables_map vm;
   bool r = command_line::handle_error_helper(desc_options, [&]()
@@ -99,6 +102,17 @@ int main(int argc, char** argv)
   p.stats = command_line::get_arg(vm, arg_stats);
   p.loop_multiplier = command_line::get_arg(vm, arg_loop_multiplier);
 
+  const std::string cn_slow_hash_tuning_profile = command_line::get_arg(vm, arg_cn_slow_hash_tuning);
+  if (!cn_slow_hash_tuning_profile.empty())
+  {
+    // runs on all cores, so the single core affinity of the other tests isn't set
+    cn_slow_hash_tuning tuning(8 * p.loop_multiplier);
+    return tuning.run(cn_slow_hash_tuning_profile) ? 0 : 1;
+  }
+
+  set_process_affinity(1);
+  set_thread_high_priority();
+
   performance_timer timer;
   timer.start();
 
@@ -199,6 +213,11 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 16384);
 
+  TEST_PERFORMANCE2(filter, p, test_chacha, 64, false);
+  TEST_PERFORMANCE2(filter, p, test_chacha, 16384, false);
+  TEST_PERFORMANCE2(filter, p, test_chacha, 1048576, false);
+  TEST_PERFORMANCE2(filter, p, test_chacha, 16384, true);
+
   TEST_PERFORMANCE3(filter, p, test_ringct_mlsag, 1, 3, false);
   TEST_PERFORMANCE3(filter, p, test_ringct_mlsag, 1, 5, false);
   TEST_PERFORMANCE3(filter, p, test_ringct_mlsag, 1, 10, false);
@@ -225,6 +244,11 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE2(filter, p, test_bulletproof, true, 15); // 1 bulletproof with 15 amounts
   TEST_PERFORMANCE2(filter, p, test_bulletproof, false, 15);
 
+  TEST_PERFORMANCE2(filter, p, test_bulletproof_prove_threads, 16, 1); // 1 bulletproof with 16 amounts, on 1 to 8 threads
+  TEST_PERFORMANCE2(filter, p, test_bulletproof_prove_threads, 16, 2);
+  TEST_PERFORMANCE2(filter, p, test_bulletproof_prove_threads, 16, 4);
+  TEST_PERFORMANCE2(filter, p, test_bulletproof_prove_threads, 16, 8);
+
   TEST_PERFORMANCE6(filter, p, test_aggregated_bulletproof, false, 2, 1, 1, 0, 4);
   TEST_PERFORMANCE6(filter, p, test_aggregated_bulletproof, true, 2, 1, 1, 0, 4); // 4 proofs, each with 2 amounts
   TEST_PERFORMANCE6(filter, p, test_aggregated_bulletproof, false, 8, 1, 1, 0, 4);
@@ -245,6 +269,19 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE3(filter, p, test_ringct_mlsag, 1, 10, true);
   TEST_PERFORMANCE3(filter, p, test_ringct_mlsag, 1, 100, true);
 
+  TEST_PERFORMANCE2(filter, p, test_update_supernode_stakes, 1000, false);
+  TEST_PERFORMANCE2(filter, p, test_update_supernode_stakes, 10000, false);
+  TEST_PERFORMANCE2(filter, p, test_update_supernode_stakes, 1000, true);
+  TEST_PERFORMANCE2(filter, p, test_update_supernode_stakes, 10000, true);
+  TEST_PERFORMANCE1(filter, p, test_blockchain_based_list_apply_block, 1000);
+  TEST_PERFORMANCE1(filter, p, test_blockchain_based_list_apply_block, 10000);
+  TEST_PERFORMANCE1(filter, p, test_blockchain_based_list_store, 1000);
+  TEST_PERFORMANCE1(filter, p, test_blockchain_based_list_store, 10000);
+  TEST_PERFORMANCE1(filter, p, test_blockchain_based_list_load, 1000);
+  TEST_PERFORMANCE1(filter, p, test_blockchain_based_list_load, 10000);
+  TEST_PERFORMANCE1(filter, p, test_stake_synchronize, 1000);
+  TEST_PERFORMANCE1(filter, p, test_stake_synchronize, 10000);
+
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_sc_add);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_sc_sub);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_sc_mul);
@@ -255,7 +292,10 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_scalarmultKey);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_scalarmultH);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_scalarmult8);
+  TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_scalarmult);
+  TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_scalarmult_ref10);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_double_scalarmult_base_vartime);
+  TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_double_scalarmult_base_vartime_ref10);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_double_scalarmult_precomp_vartime);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_double_scalarmult_precomp_vartime2);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_addKeys2);
@@ -0,0 +1,321 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/blockchain_based_list.h"
+#include "cryptonote_core/stake_transaction_storage.h"
+#include "graft_rta_config.h"
+#include "string_tools.h"
+
+/// Synthetic chain with stake transactions spread evenly over its blocks; restakes of the same supernodes
+/// are mixed in, so there are about four stake transactions per supernode. The generator is seeded with a
+/// constant and every run sees the same chain.
+class stake_chain_generator
+{
+public:
+  static const uint64_t preloaded_blocks_count = 1000;
+
+  stake_chain_generator(size_t stake_tx_count)
+    : m_rng(42)
+    , m_txs_per_block(std::max<size_t>(1, stake_tx_count / preloaded_blocks_count))
+    , m_supernodes(std::max<size_t>(1, stake_tx_count / 4))
+  {
+    for (std::string& id : m_supernodes)
+    {
+      crypto::public_key key;
+      crypto::secret_key secret_key;
+      crypto::generate_keys(key, secret_key);
+      id = epee::string_tools::pod_to_hex(key);
+    }
+  }
+
+  /// Stake transactions of the block
+  void generate_block(uint64_t block_height, std::vector<cryptonote::stake_transaction>& txs)
+  {
+    txs.resize(m_txs_per_block);
+
+    for (cryptonote::stake_transaction& tx : txs)
+    {
+      tx = cryptonote::stake_transaction();
+
+      tx.hash                = crypto::rand<crypto::hash>();
+      tx.amount              = config::graft::TIER1_STAKE_AMOUNT + m_rng() % (config::graft::TIER4_STAKE_AMOUNT / COIN) * COIN;
+      tx.block_height        = block_height;
+      tx.unlock_time         = config::graft::STAKE_MIN_UNLOCK_TIME + m_rng() % config::graft::STAKE_MAX_UNLOCK_TIME_V15;
+      tx.supernode_public_id = m_supernodes[m_rng() % m_supernodes.size()];
+    }
+  }
+
+private:
+  std::mt19937_64 m_rng;
+  size_t m_txs_per_block;
+  std::vector<std::string> m_supernodes;
+};
+
+/// Storages fed with the synthetic chain block by block the same way StakeTransactionProcessor::process_block does
+class stake_processing_test_base
+{
+public:
+  stake_processing_test_base(size_t stake_tx_count)
+    : m_chain(stake_tx_count)
+    , m_dir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    , m_block_height()
+  {
+  }
+
+  ~stake_processing_test_base()
+  {
+    m_list.reset();
+    m_storage.reset();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(m_dir, ec);
+  }
+
+protected:
+  bool init_storages()
+  {
+    boost::system::error_code ec;
+    if (!boost::filesystem::create_directories(m_dir, ec))
+      return false;
+
+    m_storage.reset(new cryptonote::StakeTransactionStorage(stake_txs_file_name(), 0));
+    m_list.reset(new cryptonote::BlockchainBasedList(blockchain_based_list_file_name(), 0));
+    return true;
+  }
+
+  /// Process the next block of the synthetic chain
+  void process_next_block(bool update_storage)
+  {
+    process_block(*m_storage, *m_list, ++m_block_height, update_storage);
+  }
+
+  void process_block(cryptonote::StakeTransactionStorage& storage, cryptonote::BlockchainBasedList& list, uint64_t block_height, bool update_storage)
+  {
+    m_chain.generate_block(block_height, m_txs);
+
+    for (const cryptonote::stake_transaction& tx : m_txs)
+      storage.add_tx(tx);
+
+    storage.update_supernode_stakes(block_height);
+    storage.add_last_processed_block(block_height, crypto::null_hash);
+
+    if (update_storage)
+      storage.store();
+
+    list.apply_block(block_height, block_hash(block_height), storage);
+
+    if (update_storage)
+      list.store();
+  }
+
+  static crypto::hash block_hash(uint64_t block_height)
+  {
+    crypto::hash hash;
+    crypto::cn_fast_hash(&block_height, sizeof(block_height), hash);
+    return hash;
+  }
+
+  std::string stake_txs_file_name() const { return (m_dir / "stake_transactions.bin").string(); }
+  std::string blockchain_based_list_file_name() const { return (m_dir / "blockchain_based_list.bin").string(); }
+
+protected:
+  stake_chain_generator m_chain;
+  boost::filesystem::path m_dir;
+  std::unique_ptr<cryptonote::StakeTransactionStorage> m_storage;
+  std::unique_ptr<cryptonote::BlockchainBasedList> m_list;
+  uint64_t m_block_height;
+  std::vector<cryptonote::stake_transaction> m_txs;
+};
+
+/// Supernode stakes of the top block: rebuilt from all stake transactions or updated incrementally after a new block
+template<size_t stake_tx_count, bool incremental>
+class test_update_supernode_stakes : private stake_processing_test_base
+{
+public:
+  static const size_t loop_count = incremental ? 1000 : 100;
+
+  test_update_supernode_stakes() : stake_processing_test_base(stake_tx_count) {}
+
+  bool init()
+  {
+    if (!init_storages())
+      return false;
+
+    for (uint64_t i=0; i<stake_chain_generator::preloaded_blocks_count; i++)
+      process_next_block(false);
+
+    return true;
+  }
+
+  bool test()
+  {
+    if (incremental)
+    {
+      m_chain.generate_block(++m_block_height, m_txs);
+
+      for (const cryptonote::stake_transaction& tx : m_txs)
+        m_storage->add_tx(tx);
+    }
+    else
+    {
+      m_storage->clear_supernode_stakes();
+    }
+
+    m_storage->update_supernode_stakes(m_block_height);
+    return !m_storage->get_supernode_stakes(m_block_height).empty();
+  }
+};
+
+/// Processing of a new block by both storages without saving them (this includes the incremental stakes update)
+template<size_t stake_tx_count>
+class test_blockchain_based_list_apply_block : private stake_processing_test_base
+{
+public:
+  static const size_t loop_count = 1000;
+
+  test_blockchain_based_list_apply_block() : stake_processing_test_base(stake_tx_count) {}
+
+  bool init()
+  {
+    if (!init_storages())
+      return false;
+
+    for (uint64_t i=0; i<stake_chain_generator::preloaded_blocks_count; i++)
+      process_next_block(false);
+
+    return true;
+  }
+
+  bool test()
+  {
+    process_next_block(false);
+    return m_list->block_height() == m_block_height;
+  }
+};
+
+/// Processing of a new block followed by saving of both storages, as at the top of the chain
+template<size_t stake_tx_count>
+class test_blockchain_based_list_store : private stake_processing_test_base
+{
+public:
+  static const size_t loop_count = 1000;
+
+  test_blockchain_based_list_store() : stake_processing_test_base(stake_tx_count) {}
+
+  bool init()
+  {
+    if (!init_storages())
+      return false;
+
+    for (uint64_t i=0; i<stake_chain_generator::preloaded_blocks_count; i++)
+      process_next_block(false);
+
+    m_storage->store();
+    m_list->store();
+    return true;
+  }
+
+  bool test()
+  {
+    process_next_block(true);
+    return !m_list->need_store();
+  }
+};
+
+/// Loading of both storages saved after the synthetic chain, as at the daemon start
+template<size_t stake_tx_count>
+class test_blockchain_based_list_load : private stake_processing_test_base
+{
+public:
+  static const size_t loop_count = 10;
+
+  test_blockchain_based_list_load() : stake_processing_test_base(stake_tx_count) {}
+
+  bool init()
+  {
+    if (!init_storages())
+      return false;
+
+    for (uint64_t i=0; i<stake_chain_generator::preloaded_blocks_count; i++)
+      process_next_block(true);
+
+    m_list.reset();
+    m_storage.reset();
+    return true;
+  }
+
+  bool test()
+  {
+    cryptonote::StakeTransactionStorage storage(stake_txs_file_name(), 0);
+    cryptonote::BlockchainBasedList list(blockchain_based_list_file_name(), 0);
+    return list.block_height() == m_block_height && storage.get_last_processed_block_index() == m_block_height;
+  }
+};
+
+/// Synchronization of empty storages with the synthetic chain; blocks are processed as StakeTransactionProcessor::synchronize
+/// does after preparing them, with the storages saved once at the end
+template<size_t stake_tx_count>
+class test_stake_synchronize : private stake_processing_test_base
+{
+public:
+  static const size_t loop_count = 5;
+
+  test_stake_synchronize() : stake_processing_test_base(stake_tx_count) {}
+
+  bool init()
+  {
+    return true;
+  }
+
+  bool test()
+  {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(m_dir, ec);
+    if (!boost::filesystem::create_directories(m_dir, ec))
+      return false;
+
+    cryptonote::StakeTransactionStorage storage(stake_txs_file_name(), 0);
+    cryptonote::BlockchainBasedList list(blockchain_based_list_file_name(), 0);
+
+    for (uint64_t block_height=1; block_height<=stake_chain_generator::preloaded_blocks_count; block_height++)
+      process_block(storage, list, block_height, false);
+
+    list.store();
+    storage.store();
+    return list.block_height() == stake_chain_generator::preloaded_blocks_count;
+  }
+};
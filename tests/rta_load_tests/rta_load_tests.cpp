@@ -0,0 +1,362 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Load generator for RTA payments: starts a number of supernodes in this process, all using the same
+// daemon, and runs sale and pay flows against them from concurrent clients, reporting throughput and
+// latency percentiles. The supernodes use the wallets and blockchain of tests/data/supernode.
+
+#include <boost/program_options.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/command_line.h"
+#include "common/metrics.h"
+#include "common/util.h"
+#include "misc_log_ex.h"
+#include "string_tools.h"
+#include "supernode/AuthSample.h"
+#include "supernode/DAPI_RPC_Client.h"
+#include "supernode/DAPI_RPC_Server.h"
+#include "supernode/FSN_Servant_Test.h"
+#include "supernode/PosProxy.h"
+#include "supernode/WalletProxy.h"
+#include "wallet/graft_wallet.h"
+
+namespace po = boost::program_options;
+using namespace supernode;
+
+namespace
+{
+  const command_line::arg_descriptor<unsigned> arg_supernodes = { "supernodes", "Number of supernodes to start", 8 };
+  const command_line::arg_descriptor<unsigned> arg_auth_sample_size = { "auth-sample-size", "Supernodes authorizing each payment, at most --supernodes", 8 };
+  const command_line::arg_descriptor<unsigned> arg_clients = { "clients", "Payments run at the same time", 16 };
+  const command_line::arg_descriptor<unsigned> arg_payments = { "payments", "Payments each client runs", 10 };
+  const command_line::arg_descriptor<unsigned> arg_base_port = { "base-port", "DAPI port of the first supernode, the others take the following ones", 7500 };
+  const command_line::arg_descriptor<unsigned> arg_dapi_threads = { "dapi-threads", "DAPI server threads of each supernode", 10 };
+  const command_line::arg_descriptor<std::string> arg_daemon_address = { "daemon-address", "Daemon the supernodes use", "localhost:28281" };
+  const command_line::arg_descriptor<std::string> arg_data_dir = { "data-dir", "Directory with the test_blockchain and test_wallets of the supernodes, tests/data/supernode by default" };
+  const command_line::arg_descriptor<bool> arg_print_metrics = { "print-metrics", "Print the metrics of the supernodes at the end", false };
+
+  // wallets of tests/data/supernode/test_wallets, supernodes alternate their stake and miner wallets
+  const std::string STAKE_WALLET_ADDRESS = "T6T2LeLmi6hf58g7MeTA8i4rdbVY8WngXBK3oWS7pjjq9qPbcze1gvV32x7GaHx8uWHQGNFBy1JCY1qBofv56Vwb26Xr998SE";
+  const std::string STAKE_WALLET_VIEWKEY = "0ae7176e5332974de64713c329d406956e8ff2fd60c85e7ee6d8c88318111007";
+  const std::string MINER_WALLET_ADDRESS = "T6SnKmirXp6geLAoB7fn2eV51Ctr1WH1xWDnEGzS9pvQARTJQUXupiRKGR7czL7b5XdDnYXosVJu6Wj3Y3NYfiEA2sU2QiGVa";
+  const std::string MINER_WALLET_VIEWKEY = "8c0ccff03e9f2a9805e200f887731129495ff793dc678db6c5b53df814084f04";
+
+  const std::chrono::milliseconds STATUS_WAIT(10000);
+  const std::chrono::milliseconds STATUS_TIMEOUT = STATUS_WAIT + std::chrono::seconds(5);
+  const unsigned STATUS_POLLS_MAX = 6;
+
+  typedef std::chrono::steady_clock clock;
+
+  uint64_t micros_since(clock::time_point start)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+  }
+
+  // auth samples of a fixed size taken in turn from all supernodes, the same for every supernode
+  struct load_test_servant: public FSN_Servant_Test
+  {
+    load_test_servant(const std::string &bdb_path, const std::string &daemon_addr, unsigned auth_sample_size)
+      : FSN_Servant_Test(bdb_path, daemon_addr, "", cryptonote::TESTNET), m_auth_sample_size(auth_sample_size) {}
+
+    unsigned AuthSampleSize() const override { return std::min<size_t>(m_auth_sample_size, Registry()->All.size()); }
+
+    std::vector<boost::shared_ptr<FSN_Data>> GetAuthSample(uint64_t forBlockNum) const override
+    {
+      return CachedAuthSample(forBlockNum, [this](const FSN_Registry &reg, uint64_t block) {
+        std::vector<boost::shared_ptr<FSN_Data>> sample;
+        const size_t size = std::min<size_t>(m_auth_sample_size, reg.All.size());
+        for (size_t i = 0; i < size; ++i)
+          sample.push_back(reg.All[(block + i) % reg.All.size()]);
+        return sample;
+      });
+    }
+
+    unsigned m_auth_sample_size;
+  };
+
+  struct supernode_instance
+  {
+    std::unique_ptr<load_test_servant> servant;
+    DAPI_RPC_Server dapi_server;
+    std::vector<std::unique_ptr<BaseRTAProcessor>> processors;
+    boost::thread thread;
+    std::string port;
+
+    void start()
+    {
+      processors.emplace_back(new WalletProxy());
+      processors.emplace_back(new PosProxy());
+      processors.emplace_back(new AuthSample());
+      for (auto &p: processors)
+      {
+        p->Set(servant.get(), &dapi_server);
+        p->Start();
+      }
+      dapi_server.setServant(servant.get());
+      thread = boost::thread([this]() { dapi_server.Start(); });
+    }
+
+    void stop()
+    {
+      dapi_server.Stop();
+      thread.join();
+      dapi_server.setServant(nullptr);
+      for (auto &p: processors)
+        p->Stop();
+      processors.clear();
+    }
+  };
+
+  struct flow_stats
+  {
+    std::vector<uint64_t> sale_micros;
+    std::vector<uint64_t> auth_micros;
+    std::vector<uint64_t> total_micros;
+    unsigned failed = 0;
+  };
+
+  template<typename t_request, typename t_response>
+  bool invoke(const std::string &port, const std::string &method, const t_request &req, t_response &res, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+  {
+    DAPI_RPC_Client client;
+    client.Set("127.0.0.1", port);
+    return client.Invoke(method, req, res, timeout);
+  }
+
+  // waits out InProgress with long polls, returns the status following it
+  template<typename t_command>
+  NTransactionStatus wait_status(const std::string &port, const std::string &method, const std::string &payment_id)
+  {
+    typename t_command::request req;
+    req.PaymentID = payment_id;
+    req.KnownStatus = int(NTransactionStatus::InProgress);
+    req.WaitMillis = STATUS_WAIT.count();
+    for (unsigned i = 0; i < STATUS_POLLS_MAX; ++i)
+    {
+      typename t_command::response res;
+      if (!invoke(port, method, req, res, STATUS_TIMEOUT))
+        return NTransactionStatus::Fail;
+      if (NTransactionStatus(res.Status) != NTransactionStatus::InProgress)
+        return NTransactionStatus(res.Status);
+    }
+    return NTransactionStatus::Fail;
+  }
+
+  // one payment: a POS starts a sale on one supernode, a wallet pays it through another one
+  bool run_payment(const std::vector<std::string> &ports, const std::string &account, std::mt19937 &rng, flow_stats &stats)
+  {
+    const std::string &pos_port = ports[rng() % ports.size()];
+    const std::string &wallet_port = ports[rng() % ports.size()];
+
+    const clock::time_point start = clock::now();
+    rpc_command::POS_SALE::request sale_in;
+    rpc_command::POS_SALE::response sale_out;
+    sale_in.Amount = 1;
+    sale_in.POSSaleDetails = "load test";
+    sale_in.POSAddress = STAKE_WALLET_ADDRESS;
+    sale_in.POSViewKey = STAKE_WALLET_VIEWKEY;
+    if (!invoke(pos_port, dapi_call::Sale, sale_in, sale_out))
+    {
+      MERROR("Sale failed on port " << pos_port);
+      return false;
+    }
+    const uint64_t sale_micros = micros_since(start);
+
+    const clock::time_point pay_start = clock::now();
+    rpc_command::WALLET_PAY::request pay_in;
+    rpc_command::WALLET_PAY::response pay_out;
+    pay_in.Amount = sale_in.Amount;
+    pay_in.POSAddress = sale_in.POSAddress;
+    pay_in.BlockNum = sale_out.BlockNum;
+    pay_in.PaymentID = sale_out.PaymentID;
+    pay_in.Account = account;
+    if (!invoke(wallet_port, dapi_call::Pay, pay_in, pay_out, STATUS_TIMEOUT))
+    {
+      MERROR("Pay of " << sale_out.PaymentID << " failed on port " << wallet_port);
+      return false;
+    }
+    if (wait_status<rpc_command::WALLET_GET_TRANSACTION_STATUS>(wallet_port, dapi_call::GetPayStatus, sale_out.PaymentID) != NTransactionStatus::Success)
+    {
+      MERROR("Payment " << sale_out.PaymentID << " was not authorized");
+      return false;
+    }
+    const uint64_t auth_micros = micros_since(pay_start);
+
+    if (wait_status<rpc_command::POS_GET_SALE_STATUS>(pos_port, dapi_call::GetSaleStatus, sale_out.PaymentID) != NTransactionStatus::Success)
+    {
+      MERROR("Sale " << sale_out.PaymentID << " did not complete");
+      return false;
+    }
+
+    stats.sale_micros.push_back(sale_micros);
+    stats.auth_micros.push_back(auth_micros);
+    stats.total_micros.push_back(micros_since(start));
+    return true;
+  }
+
+  void print_latency(const char *name, std::vector<uint64_t> &micros)
+  {
+    std::sort(micros.begin(), micros.end());
+    auto percentile = [&micros](double q) { return micros[std::min<size_t>(micros.size() - 1, micros.size() * q)] / 1e3; };
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+              << " p50 " << std::setw(9) << percentile(0.5) << " ms"
+              << "  p99 " << std::setw(9) << percentile(0.99) << " ms"
+              << "  max " << std::setw(9) << micros.back() / 1e3 << " ms" << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  TRY_ENTRY();
+  tools::on_startup();
+
+  mlog_configure(mlog_get_default_log_path("rta_load_tests.log"), true);
+
+  po::options_description desc_options("Command line options");
+  command_line::add_arg(desc_options, arg_supernodes);
+  command_line::add_arg(desc_options, arg_auth_sample_size);
+  command_line::add_arg(desc_options, arg_clients);
+  command_line::add_arg(desc_options, arg_payments);
+  command_line::add_arg(desc_options, arg_base_port);
+  command_line::add_arg(desc_options, arg_dapi_threads);
+  command_line::add_arg(desc_options, arg_daemon_address);
+  command_line::add_arg(desc_options, arg_data_dir);
+  command_line::add_arg(desc_options, arg_print_metrics);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  const unsigned supernodes_count = command_line::get_arg(vm, arg_supernodes);
+  const unsigned clients = command_line::get_arg(vm, arg_clients);
+  const unsigned payments = command_line::get_arg(vm, arg_payments);
+  const unsigned base_port = command_line::get_arg(vm, arg_base_port);
+  std::string data_dir = command_line::get_arg(vm, arg_data_dir);
+  if (data_dir.empty())
+    data_dir = epee::string_tools::get_current_module_folder() + "/../data/supernode";
+  if (supernodes_count == 0 || clients == 0)
+  {
+    std::cerr << "--supernodes and --clients must be positive" << std::endl;
+    return 1;
+  }
+
+  // every supernode knows all the others
+  std::vector<std::string> ports;
+  for (unsigned i = 0; i < supernodes_count; ++i)
+    ports.push_back(std::to_string(base_port + i));
+
+  std::vector<std::unique_ptr<supernode_instance>> supernodes;
+  for (unsigned i = 0; i < supernodes_count; ++i)
+  {
+    std::unique_ptr<supernode_instance> sn(new supernode_instance());
+    sn->port = ports[i];
+    sn->servant.reset(new load_test_servant(data_dir + "/test_blockchain", command_line::get_arg(vm, arg_daemon_address), command_line::get_arg(vm, arg_auth_sample_size)));
+    const bool odd = i % 2;
+    sn->servant->Set(data_dir + "/test_wallets" + (odd ? "/miner_wallet" : "/stake_wallet"), "", data_dir + "/test_wallets" + (odd ? "/stake_wallet" : "/miner_wallet"), "");
+    for (unsigned j = 0; j < supernodes_count; ++j)
+    {
+      const FSN_WalletData stake = j % 2 ? FSN_WalletData{MINER_WALLET_ADDRESS, MINER_WALLET_VIEWKEY} : FSN_WalletData{STAKE_WALLET_ADDRESS, STAKE_WALLET_VIEWKEY};
+      const FSN_WalletData miner = j % 2 ? FSN_WalletData{STAKE_WALLET_ADDRESS, STAKE_WALLET_VIEWKEY} : FSN_WalletData{MINER_WALLET_ADDRESS, MINER_WALLET_VIEWKEY};
+      sn->servant->AddFsnAccount(boost::make_shared<FSN_Data>(stake, miner, "127.0.0.1", ports[j]));
+    }
+    sn->dapi_server.Set("127.0.0.1", sn->port, command_line::get_arg(vm, arg_dapi_threads));
+    sn->start();
+    supernodes.push_back(std::move(sn));
+  }
+  std::cout << "Started " << supernodes_count << " supernodes on ports " << ports.front() << "-" << ports.back() << std::endl;
+  // no readiness call, give the servers a moment to listen
+  boost::this_thread::sleep_for(boost::chrono::seconds(1));
+
+  // paying account in the form supernodes hand out to wallets
+  std::string account;
+  {
+    tools::GraftWallet wallet(cryptonote::TESTNET);
+    wallet.load(data_dir + "/test_wallets/stake_wallet", "");
+    account = BaseClientProxy::base64_encode(wallet.store_keys_to_data(""));
+  }
+
+  std::vector<flow_stats> stats(clients);
+  const clock::time_point start = clock::now();
+  boost::thread_group workers;
+  for (unsigned c = 0; c < clients; ++c)
+  {
+    workers.create_thread([&, c]() {
+      std::mt19937 rng(c);
+      for (unsigned i = 0; i < payments; ++i)
+        if (!run_payment(ports, account, rng, stats[c]))
+          ++stats[c].failed;
+    });
+  }
+  workers.join_all();
+  const double elapsed = micros_since(start) / 1e6;
+
+  for (auto &sn: supernodes)
+    sn->stop();
+
+  flow_stats total;
+  for (const flow_stats &s: stats)
+  {
+    total.sale_micros.insert(total.sale_micros.end(), s.sale_micros.begin(), s.sale_micros.end());
+    total.auth_micros.insert(total.auth_micros.end(), s.auth_micros.begin(), s.auth_micros.end());
+    total.total_micros.insert(total.total_micros.end(), s.total_micros.begin(), s.total_micros.end());
+    total.failed += s.failed;
+  }
+
+  const size_t completed = total.total_micros.size();
+  std::cout << completed << " payments completed, " << total.failed << " failed in " << std::fixed << std::setprecision(2) << elapsed << " s, "
+            << completed / elapsed << " TPS" << std::endl;
+  if (completed)
+  {
+    print_latency("sale", total.sale_micros);
+    print_latency("authorization", total.auth_micros);
+    print_latency("payment", total.total_micros);
+  }
+
+  if (command_line::get_arg(vm, arg_print_metrics))
+    std::cout << tools::metrics::get();
+
+  return total.failed ? 1 : 0;
+  CATCH_ENTRY_L0("main", 1);
+}
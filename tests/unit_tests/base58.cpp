@@ -538,3 +538,31 @@ TEST(get_account_address_from_str, parses_old_address_format)
   cryptonote::address_parse_info info;
   ASSERT_TRUE(cryptonote::get_account_address_from_str(info, cryptonote::MAINNET, "002391bbbb24dea6fd95232e97594a27769d0153d053d2102b789c498f57a2b00b69cd6f2f5c529c1660f2f4a2b50178d6640c20ce71fe26373041af97c5b10236fc"));
 }
+
+TEST(get_account_integrated_address_as_str, round_trips)
+{
+  cryptonote::account_public_address addr;
+  ASSERT_TRUE(serialization::parse_binary(test_serialized_keys, addr));
+  crypto::hash8 payment_id = {{1, 2, 3, 4, 5, 6, 7, 8}};
+  std::string addr_str = cryptonote::get_account_integrated_address_as_str(cryptonote::MAINNET, addr, payment_id);
+
+  cryptonote::address_parse_info info;
+  ASSERT_TRUE(cryptonote::get_account_address_from_str(info, cryptonote::MAINNET, addr_str));
+  ASSERT_TRUE(info.has_payment_id);
+  ASSERT_EQ(info.address, addr);
+  ASSERT_EQ(info.payment_id, payment_id);
+}
+
+TEST(account_address_string_cache, matches_get_account_address_as_str)
+{
+  cryptonote::account_public_address addr;
+  ASSERT_TRUE(serialization::parse_binary(test_serialized_keys, addr));
+  cryptonote::account_public_address other = addr;
+  other.m_view_public_key.data[0] ^= 1;
+
+  cryptonote::account_address_string_cache cache(1);
+  ASSERT_EQ(cache.get(cryptonote::MAINNET, addr), test_keys_addr_str);
+  ASSERT_EQ(cache.get(cryptonote::MAINNET, addr), test_keys_addr_str);
+  ASSERT_EQ(cache.get(cryptonote::MAINNET, other), cryptonote::get_account_address_as_str(cryptonote::MAINNET, false, other));
+  ASSERT_EQ(cache.get(cryptonote::TESTNET, addr), cryptonote::get_account_address_as_str(cryptonote::TESTNET, false, addr));
+}
@@ -85,3 +85,45 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, get_filled_span)
+{
+  cryptonote::block_queue bq;
+  std::vector<cryptonote::block_complete_entry> bcel;
+
+  bq.add_blocks(0, 10, uuid1());
+  ASSERT_FALSE(bq.get_filled_span(0, bcel));
+
+  bq.add_blocks(10, std::vector<cryptonote::block_complete_entry>(5), uuid1(), 1.0f, 0);
+  ASSERT_FALSE(bq.get_filled_span(11, bcel));
+  ASSERT_TRUE(bq.get_filled_span(10, bcel));
+  ASSERT_EQ(bcel.size(), 5);
+}
+
+TEST(block_queue, span_size_follows_throughput)
+{
+  cryptonote::block_queue bq;
+  cryptonote::block_queue::peer_stats stats;
+
+  ASSERT_FALSE(bq.get_peer_stats(uuid1(), stats));
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 2048), 20);
+
+  // 1000 bytes per block, 10 kB/s and 1 MB/s peers
+  bq.add_blocks(0, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 10000.0f, 10000);
+  bq.add_blocks(10, std::vector<cryptonote::block_complete_entry>(10), uuid2(), 1000000.0f, 10000);
+  ASSERT_TRUE(bq.get_peer_stats(uuid1(), stats));
+  ASSERT_EQ(stats.nblocks, 10);
+  ASSERT_EQ(stats.nspans, 1);
+
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 2048), 50);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 20, 2048), 2048);
+  ASSERT_LT(bq.get_speed(uuid1()), 0.1f);
+  ASSERT_EQ(bq.get_speed(uuid2()), 1.0f);
+
+  // the chain adds 100 blocks per second
+  bq.on_blocks_added(100, 1000000);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 20, 2048), 500);
+
+  bq.flush_stale_spans({uuid2()});
+  ASSERT_FALSE(bq.get_peer_stats(uuid1(), stats));
+}
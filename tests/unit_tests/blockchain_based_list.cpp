@@ -0,0 +1,339 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <random>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "cryptonote_core/blockchain_based_list.h"
+#include "graft_rta_config.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+void fill_stakes(StakeTransactionStorage& storage, uint64_t height, std::mt19937_64& rng)
+{
+  for (size_t i=0, count=rng() % 4; i<count; i++)
+  {
+    stake_transaction tx = {};
+
+    tx.amount              = (config::graft::TIER1_STAKE_AMOUNT / COIN + rng() % 250000) * COIN;
+    tx.block_height        = height;
+    tx.unlock_time         = config::graft::STAKE_MIN_UNLOCK_TIME + rng() % 500;
+    tx.supernode_public_id = std::to_string(rng() % 200);
+
+    storage.add_tx(tx);
+  }
+}
+
+bool equal_tiers(const BlockchainBasedList::supernode_tier_array& tiers1, const BlockchainBasedList::supernode_tier_array& tiers2)
+{
+  if (tiers1.size() != tiers2.size())
+    return false;
+
+  for (size_t i=0; i<tiers1.size(); i++)
+  {
+    if (tiers1[i].size() != tiers2[i].size())
+      return false;
+
+    for (size_t j=0; j<tiers1[i].size(); j++)
+      if (tiers1[i][j].supernode_public_id != tiers2[i][j].supernode_public_id || tiers1[i][j].amount != tiers2[i][j].amount)
+        return false;
+  }
+
+  return true;
+}
+
+/// Straightforward version of the list construction which copies supernodes and compares ids
+void select_reference_supernodes(std::mt19937_64& rng, size_t items_count, const BlockchainBasedList::supernode_array& src_list, BlockchainBasedList::supernode_array& dst_list)
+{
+  size_t src_list_size = src_list.size();
+
+  if (items_count > src_list_size)
+    items_count = src_list_size;
+
+  for (size_t i=0; i<src_list_size; i++)
+  {
+    if (rng() % (src_list_size - i) >= items_count)
+      continue;
+
+    dst_list.push_back(src_list[i]);
+    items_count--;
+  }
+}
+
+BlockchainBasedList::supernode_tier_array build_reference_tiers(const BlockchainBasedList::supernode_tier_array* prev_tiers, uint64_t height,
+  const crypto::hash& block_hash, StakeTransactionStorage& storage)
+{
+  const StakeTransactionStorage::supernode_stake_array& stakes = storage.get_supernode_stakes(height);
+  BlockchainBasedList::supernode_tier_array result;
+
+  for (size_t i=0; i<config::graft::TIERS_COUNT; i++)
+  {
+    BlockchainBasedList::supernode_array prev_supernodes, current_supernodes, new_supernodes;
+
+    if (prev_tiers)
+    {
+      for (const BlockchainBasedList::supernode& sn : (*prev_tiers)[i])
+      {
+        const supernode_stake* stake = storage.find_supernode_stake(height, sn.supernode_public_id);
+        if (stake && stake->amount && stake->tier == i + 1)
+          prev_supernodes.push_back(sn);
+      }
+    }
+
+    for (const supernode_stake& stake : stakes)
+    {
+      if (!stake.amount || stake.tier != i + 1)
+        continue;
+
+      BlockchainBasedList::supernode sn;
+      sn.supernode_public_id      = stake.supernode_public_id;
+      sn.supernode_public_address = stake.supernode_public_address;
+      sn.amount                   = stake.amount;
+      sn.block_height             = stake.block_height;
+      sn.unlock_time              = stake.unlock_time;
+      current_supernodes.push_back(sn);
+    }
+
+    std::seed_seq seed(reinterpret_cast<const unsigned char*>(&block_hash.data[0]), reinterpret_cast<const unsigned char*>(&block_hash.data[sizeof block_hash.data]));
+    std::mt19937_64 rng(seed);
+
+    std::stable_sort(current_supernodes.begin(), current_supernodes.end(), [](const BlockchainBasedList::supernode& s1, const BlockchainBasedList::supernode& s2) {
+      return s1.block_height < s2.block_height || (s1.block_height == s2.block_height && s1.supernode_public_id < s2.supernode_public_id);
+    });
+
+    select_reference_supernodes(rng, 16, prev_supernodes, new_supernodes);
+
+    current_supernodes.erase(std::remove_if(current_supernodes.begin(), current_supernodes.end(), [&](const BlockchainBasedList::supernode& sn1) {
+      for (const BlockchainBasedList::supernode& sn2 : new_supernodes)
+        if (sn1.supernode_public_id == sn2.supernode_public_id)
+          return true;
+      return false;
+    }), current_supernodes.end());
+
+    select_reference_supernodes(rng, 32 - new_supernodes.size(), current_supernodes, new_supernodes);
+
+    result.emplace_back(std::move(new_supernodes));
+  }
+
+  return result;
+}
+
+}
+
+TEST(BlockchainBasedList, store_and_load)
+{
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+
+  const std::string file_name = (dir / "blockchain_based_list.bin").string();
+
+  std::mt19937_64 rng(7);
+  StakeTransactionStorage stakes((dir / "stake_transactions.bin").string(), 0);
+  BlockchainBasedList list(file_name, 0);
+
+  for (uint64_t height=1; height<=1500; height++)
+  {
+    fill_stakes(stakes, height, rng);
+
+    crypto::hash block_hash = crypto::null_hash;
+    memcpy(block_hash.data, &height, sizeof(height));
+
+    list.apply_block(height, block_hash, stakes);
+
+    if (height % 3 == 0)
+      list.remove_latest_block(), list.apply_block(height, block_hash, stakes);
+
+    if (height % 7 == 0)
+      list.store();
+  }
+
+  list.store();
+
+  BlockchainBasedList loaded_list(file_name, 0);
+
+  ASSERT_EQ(loaded_list.block_height(), list.block_height());
+  ASSERT_EQ(loaded_list.history_depth(), list.history_depth());
+
+  for (size_t depth=0; depth<list.history_depth(); depth++)
+    ASSERT_TRUE(equal_tiers(loaded_list.tiers(depth), list.tiers(depth)));
+
+  boost::filesystem::remove_all(dir);
+}
+
+TEST(BlockchainBasedList, restore_checkpoint)
+{
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+
+  const std::string file_name = (dir / "blockchain_based_list.bin").string();
+
+  std::mt19937_64 rng(11);
+  StakeTransactionStorage stakes((dir / "stake_transactions.bin").string(), 0);
+  BlockchainBasedList list(file_name, 0);
+  StakeTransactionStorage::checkpoint stakes_checkpoint;
+  BlockchainBasedList::checkpoint list_checkpoint;
+  std::vector<BlockchainBasedList::supernode_tier_array> checkpoint_tiers;
+  size_t checkpoint_tx_count = 0;
+
+  for (uint64_t height=1; height<=1300; height++)
+  {
+    fill_stakes(stakes, height, rng);
+
+    crypto::hash block_hash = crypto::null_hash;
+    memcpy(block_hash.data, &height, sizeof(height));
+
+    stakes.add_last_processed_block(height, block_hash);
+    list.apply_block(height, block_hash, stakes);
+
+    if (height % 100 == 0)
+    {
+      stakes.store();
+      list.store();
+    }
+
+    if (height == 1200)
+    {
+        //history entries are mapped from the snapshot at this point
+
+      stakes.get_checkpoint(stakes_checkpoint);
+      list.get_checkpoint(list_checkpoint);
+
+      for (size_t depth=0; depth<list.history_depth(); depth++)
+        checkpoint_tiers.push_back(list.tiers(depth));
+
+      checkpoint_tx_count = stakes.get_tx_count();
+    }
+  }
+
+  stakes.restore_checkpoint(stakes_checkpoint);
+  list.restore_checkpoint(list_checkpoint);
+
+  ASSERT_EQ(stakes.get_last_processed_block_index(), 1200);
+  ASSERT_EQ(stakes.get_tx_count(), checkpoint_tx_count);
+  ASSERT_EQ(list.block_height(), 1200);
+  ASSERT_EQ(list.history_depth(), checkpoint_tiers.size());
+
+  for (size_t depth=0; depth<list.history_depth(); depth++)
+    ASSERT_TRUE(equal_tiers(list.tiers(depth), checkpoint_tiers[depth]));
+
+    //blocks of another chain are applied on top of the checkpoint
+
+  for (uint64_t height=1201; height<=1250; height++)
+  {
+    crypto::hash block_hash = crypto::null_hash;
+    block_hash.data[31] = 1;
+    memcpy(block_hash.data, &height, sizeof(height));
+
+    stakes.add_last_processed_block(height, block_hash);
+    list.apply_block(height, block_hash, stakes);
+  }
+
+  stakes.store();
+  list.store();
+
+  StakeTransactionStorage loaded_stakes((dir / "stake_transactions.bin").string(), 0);
+  BlockchainBasedList loaded_list(file_name, 0);
+
+  ASSERT_EQ(loaded_stakes.get_last_processed_block_index(), 1250);
+  ASSERT_EQ(loaded_stakes.get_tx_count(), checkpoint_tx_count);
+  ASSERT_EQ(loaded_list.block_height(), list.block_height());
+  ASSERT_EQ(loaded_list.history_depth(), list.history_depth());
+
+  for (size_t depth=0; depth<list.history_depth(); depth++)
+    ASSERT_TRUE(equal_tiers(loaded_list.tiers(depth), list.tiers(depth)));
+
+  boost::filesystem::remove_all(dir);
+}
+
+TEST(BlockchainBasedList, apply_block_matches_reference)
+{
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+
+  std::mt19937_64 rng(13);
+  StakeTransactionStorage stakes((dir / "stake_transactions.bin").string(), 0);
+  BlockchainBasedList list((dir / "blockchain_based_list.bin").string(), 0);
+
+  for (uint64_t height=1; height<=600; height++)
+  {
+    fill_stakes(stakes, height, rng);
+    fill_stakes(stakes, height, rng);
+
+    crypto::hash block_hash = crypto::null_hash;
+    memcpy(block_hash.data, &height, sizeof(height));
+
+    BlockchainBasedList::supernode_tier_array expected = build_reference_tiers(list.history_depth() ? &list.tiers() : nullptr, height, block_hash, stakes);
+
+    list.apply_block(height, block_hash, stakes);
+
+    ASSERT_TRUE(list.tiers() == expected);
+  }
+
+  boost::filesystem::remove_all(dir);
+}
+
+TEST(BlockchainBasedList, select_auth_sample)
+{
+  BlockchainBasedList::supernode_tier_array tiers(config::graft::TIERS_COUNT);
+
+  for (size_t i=0; i<config::graft::TIERS_COUNT; i++)
+  {
+    for (size_t j=0, count=i == 0 ? 1 : 10; j<count; j++)
+    {
+      BlockchainBasedList::supernode sn = {};
+      sn.supernode_public_id = std::to_string(i) + "/" + std::to_string(j);
+      tiers[i].push_back(sn);
+    }
+  }
+
+  crypto::hash block_hash = crypto::null_hash;
+  block_hash.data[0] = 1;
+
+  BlockchainBasedList::supernode_array sample1, sample2;
+
+  BlockchainBasedList::select_auth_sample(tiers, block_hash, sample1);
+  BlockchainBasedList::select_auth_sample(tiers, block_hash, sample2);
+
+  ASSERT_EQ(config::graft::AUTH_SAMPLE_SIZE, sample1.size());
+  ASSERT_TRUE(equal_tiers(BlockchainBasedList::supernode_tier_array(1, sample1), BlockchainBasedList::supernode_tier_array(1, sample2)));
+
+    //shortage of the first tier is taken from the second one
+
+  EXPECT_EQ("0/0", sample1[0].supernode_public_id);
+  EXPECT_EQ('1', sample1[1].supernode_public_id[0]);
+  EXPECT_EQ('1', sample1[3].supernode_public_id[0]);
+  EXPECT_EQ('2', sample1[4].supernode_public_id[0]);
+
+  for (size_t i=0; i<sample1.size(); i++)
+    for (size_t j=i+1; j<sample1.size(); j++)
+      EXPECT_NE(sample1[i].supernode_public_id, sample1[j].supernode_public_id);
+}
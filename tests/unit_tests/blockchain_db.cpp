@@ -30,6 +30,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <cstdio>
 #include <iostream>
+#include <set>
 #include <chrono>
 #include <thread>
 
@@ -303,6 +304,14 @@ TYPED_TEST(BlockchainDBTest, AddBlock)
 
     ASSERT_HASH_EQ(h, get_transaction_hash(tx));
   }
+
+  // test blocks have no stake transactions, so an index (if any) must be empty for them
+  std::vector<crypto::hash> stake_tx_hashes;
+  for (uint64_t height = 0; height < 2; height++)
+  {
+    if (this->m_db->get_stake_tx_hashes(height, stake_tx_hashes))
+      ASSERT_TRUE(stake_tx_hashes.empty());
+  }
 }
 
 TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
@@ -344,4 +353,332 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, RetrieveBlobsInBatches)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<blobdata> blobs;
+  ASSERT_NO_THROW(this->m_db->get_block_blobs_from_height(0, 2, blobs));
+  ASSERT_EQ(2, blobs.size());
+  ASSERT_EQ(this->m_db->get_block_blob_from_height(0), blobs[0]);
+  ASSERT_EQ(this->m_db->get_block_blob_from_height(1), blobs[1]);
+  ASSERT_THROW(this->m_db->get_block_blobs_from_height(1, 2, blobs), BLOCK_DNE);
+
+  // results follow the order of the hashes, whatever order they are read in
+  std::vector<crypto::hash> block_hashes = {get_block_hash(this->m_blocks[1]), crypto::null_hash, get_block_hash(this->m_blocks[0])};
+  std::vector<bool> found;
+  ASSERT_NO_THROW(this->m_db->get_block_blobs(block_hashes, blobs, found));
+  ASSERT_EQ(3, blobs.size());
+  ASSERT_EQ(std::vector<bool>({true, false, true}), found);
+  ASSERT_EQ(this->m_db->get_block_blob_from_height(1), blobs[0]);
+  ASSERT_EQ(this->m_db->get_block_blob_from_height(0), blobs[2]);
+
+  std::vector<crypto::hash> tx_hashes;
+  for (auto it = this->m_txs.rbegin(); it != this->m_txs.rend(); ++it)
+    for (const auto &tx: *it)
+      tx_hashes.push_back(get_transaction_hash(tx));
+  tx_hashes.push_back(crypto::null_hash);
+
+  for (bool pruned: {false, true})
+  {
+    ASSERT_NO_THROW(this->m_db->get_tx_blobs(tx_hashes, blobs, found, pruned));
+    ASSERT_EQ(tx_hashes.size(), blobs.size());
+    for (size_t i = 0; i + 1 < tx_hashes.size(); ++i)
+    {
+      blobdata expected;
+      ASSERT_TRUE(pruned ? this->m_db->get_pruned_tx_blob(tx_hashes[i], expected) : this->m_db->get_tx_blob(tx_hashes[i], expected));
+      ASSERT_TRUE(found[i]);
+      ASSERT_EQ(expected, blobs[i]);
+    }
+    ASSERT_FALSE(found.back());
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, RetrieveOutputKeysAndTxs)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::set<uint64_t> amounts;
+  for (const block &b: this->m_blocks)
+    for (const tx_out &out: b.miner_tx.vout)
+      amounts.insert(out.amount);
+
+  // the same as the single output lookups, in the order of the offsets
+  for (const uint64_t amount: amounts)
+  {
+    const uint64_t num_outputs = this->m_db->get_num_outputs(amount);
+    ASSERT_LT(0, num_outputs);
+    std::vector<uint64_t> offsets;
+    for (uint64_t i = num_outputs; i > 0; --i)
+      offsets.push_back(i - 1);
+
+    std::vector<output_data_t> outputs;
+    std::vector<tx_out_index> txs;
+    ASSERT_NO_THROW(this->m_db->get_output_keys_and_txs(amount, offsets, outputs, txs));
+    ASSERT_EQ(offsets.size(), outputs.size());
+    ASSERT_EQ(offsets.size(), txs.size());
+    for (size_t i = 0; i < offsets.size(); ++i)
+    {
+      const output_data_t od = this->m_db->get_output_key(amount, offsets[i]);
+      const tx_out_index toi = this->m_db->get_output_tx_and_index(amount, offsets[i]);
+      ASSERT_HASH_EQ(od.pubkey, outputs[i].pubkey);
+      ASSERT_HASH_EQ(od.commitment, outputs[i].commitment);
+      ASSERT_EQ(od.unlock_time, outputs[i].unlock_time);
+      ASSERT_EQ(od.height, outputs[i].height);
+      ASSERT_HASH_EQ(toi.first, txs[i].first);
+      ASSERT_EQ(toi.second, txs[i].second);
+    }
+
+    offsets.push_back(num_outputs);
+    ASSERT_THROW(this->m_db->get_output_keys_and_txs(amount, offsets, outputs, txs), OUTPUT_DNE);
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, RetrieveBlockInfosInBatches)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<block_info_t> infos;
+  ASSERT_NO_THROW(this->m_db->get_block_infos_from_height(0, 2, infos));
+  ASSERT_EQ(2, infos.size());
+  for (uint64_t height = 0; height < 2; ++height)
+  {
+    const block_info_t &info = infos[height];
+    ASSERT_EQ(height, info.height);
+    ASSERT_EQ(this->m_blocks[height].timestamp, info.timestamp);
+    ASSERT_EQ(t_coins[height], info.already_generated_coins);
+    ASSERT_EQ(t_sizes[height], info.weight);
+    ASSERT_EQ(t_diffs[height], info.cumulative_difficulty);
+    ASSERT_HASH_EQ(get_block_hash(this->m_blocks[height]), info.hash);
+    ASSERT_EQ(this->m_db->get_block_cumulative_rct_outputs({height}).front(), info.cumulative_rct_outputs);
+  }
+
+  ASSERT_NO_THROW(this->m_db->get_block_infos_from_height(1, 1, infos));
+  ASSERT_EQ(1, infos.size());
+  ASSERT_EQ(1, infos[0].height);
+  ASSERT_THROW(this->m_db->get_block_infos_from_height(1, 2, infos), BLOCK_DNE);
+}
+
+TYPED_TEST(BlockchainDBTest, ReadSessionPinsSnapshot)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+
+  {
+    db_rtxn_guard rtxn_guard(*this->m_db);
+    ASSERT_EQ(1, this->m_db->height());
+
+    // sessions do not nest
+    {
+      db_rtxn_guard nested_guard(*this->m_db);
+      ASSERT_FALSE(this->m_db->block_rtxn_start());
+    }
+
+    bool added = false;
+    std::thread writer([&]() {
+      try { this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]); added = true; }
+      catch (...) {}
+    });
+    writer.join();
+    ASSERT_TRUE(added);
+
+    // the nested guard did not end the session, which still sees the first block only
+    ASSERT_EQ(1, this->m_db->height());
+    ASSERT_FALSE(this->m_db->block_exists(get_block_hash(this->m_blocks[1])));
+  }
+
+  ASSERT_EQ(2, this->m_db->height());
+  ASSERT_TRUE(this->m_db->block_exists(get_block_hash(this->m_blocks[1])));
+}
+
+TYPED_TEST(BlockchainDBTest, CompressTxBlobs)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+
+  // existing txs are compressed on open, new ones when added; without zstd the flag is ignored
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_COMPRESS_TXS));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+
+  for (const auto &txs: this->m_txs)
+  {
+    for (const auto &tx: txs)
+    {
+      blobdata bd;
+      ASSERT_TRUE(this->m_db->get_tx_blob(get_transaction_hash(tx), bd));
+      ASSERT_EQ(tx_to_blob(tx), bd);
+      ASSERT_TRUE(this->m_db->get_pruned_tx_blob(get_transaction_hash(tx), bd));
+      ASSERT_EQ(tx_to_blob(tx).substr(0, bd.size()), bd);
+    }
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, GroupCommit)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_SAFE));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->set_group_commit(10));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // closing stops the sync thread and syncs what is left
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  ASSERT_EQ(2, this->m_db->height());
+  ASSERT_NO_THROW(this->m_db->set_group_commit(0));
+}
+
+TYPED_TEST(BlockchainDBTest, KeyImageFilter)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  crypto::key_image k_image = crypto::rand<crypto::key_image>();
+  ASSERT_FALSE(this->m_db->has_key_image(k_image));
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // the filter is built again on open
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+
+  size_t spent = 0;
+  for (const auto &txs: this->m_txs)
+    for (const auto &tx: txs)
+      for (const auto &in: tx.vin)
+        if (in.type() == typeid(txin_to_key))
+        {
+          ASSERT_TRUE(this->m_db->has_key_image(boost::get<txin_to_key>(in).k_image));
+          ++spent;
+        }
+  ASSERT_LT(0, spent);
+  ASSERT_FALSE(this->m_db->has_key_image(k_image));
+}
+
+TYPED_TEST(BlockchainDBTest, AltBlocks)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  alt_block_data_t data = {1, 2, 3, 4, crypto::null_hash};
+  const crypto::hash id0 = get_block_hash(this->m_blocks[0]);
+  const crypto::hash id1 = get_block_hash(this->m_blocks[1]);
+  ASSERT_NO_THROW(this->m_db->add_alt_block(id0, data, block_to_blob(this->m_blocks[0])));
+  data.height = 5;
+  ASSERT_NO_THROW(this->m_db->add_alt_block(id1, data, block_to_blob(this->m_blocks[1])));
+  ASSERT_NO_THROW(this->m_db->remove_alt_block(id0));
+
+  // alternative blocks are kept across a restart
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+
+  size_t count = 0;
+  ASSERT_TRUE(this->m_db->for_all_alt_blocks([&](const crypto::hash &id, const alt_block_data_t &d, const blobdata &blob) {
+    EXPECT_EQ(id1, id);
+    EXPECT_EQ(5, d.height);
+    EXPECT_EQ(3, d.cumulative_difficulty);
+    EXPECT_EQ(block_to_blob(this->m_blocks[1]), blob);
+    ++count;
+    return true;
+  }));
+  ASSERT_EQ(1, count);
+
+  ASSERT_NO_THROW(this->m_db->drop_alt_blocks());
+  count = 0;
+  ASSERT_TRUE(this->m_db->for_all_alt_blocks([&](const crypto::hash&, const alt_block_data_t&, const blobdata&) { ++count; return true; }));
+  ASSERT_EQ(0, count);
+}
+
+TEST(key_image_filter, no_false_negatives)
+{
+  key_image_filter filter(10000);
+  ASSERT_LE(10000, filter.get_capacity());
+
+  std::vector<crypto::key_image> k_images(filter.get_capacity());
+  for (auto &k_image: k_images)
+  {
+    k_image = crypto::rand<crypto::key_image>();
+    filter.insert(k_image);
+  }
+  for (const auto &k_image: k_images)
+    ASSERT_TRUE(filter.may_contain(k_image));
+
+  // a full filter still rejects nearly all other key images
+  size_t false_positives = 0;
+  for (size_t i = 0; i < 100000; ++i)
+    false_positives += filter.may_contain(crypto::rand<crypto::key_image>());
+  ASSERT_GT(1000, false_positives);
+}
+
 }  // anonymous namespace
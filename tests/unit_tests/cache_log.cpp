@@ -0,0 +1,134 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "crypto/chacha.h"
+#include "file_io_utils.h"
+#include "wallet/cache_log.h"
+
+namespace
+{
+  class cache_log_file
+  {
+  public:
+    cache_log_file():
+      filename((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("graft-cache-log-test-%%%%-%%%%")).string()),
+      id(crypto::rand<crypto::hash>())
+    {
+      crypto::generate_chacha_key("cache log test", 14, key, 1);
+    }
+    ~cache_log_file() { boost::system::error_code ec; boost::filesystem::remove(filename, ec); }
+
+    std::vector<std::string> read(uint64_t size, bool &r) const
+    {
+      std::vector<std::string> payloads;
+      r = tools::cache_log::read(filename, key, id, size, [&payloads](const std::string &payload) {
+        payloads.push_back(payload);
+        return true;
+      });
+      return payloads;
+    }
+
+    const std::string filename;
+    const crypto::hash id;
+    crypto::chacha_key key;
+  };
+}
+
+TEST(cache_log, append_and_read)
+{
+  cache_log_file log;
+  uint64_t size = tools::cache_log::header_size();
+  ASSERT_TRUE(tools::cache_log::create(log.filename, log.id));
+  ASSERT_TRUE(tools::cache_log::append(log.filename, log.key, log.id, size, {"first", ""}));
+  const uint64_t first_size = size;
+  ASSERT_TRUE(tools::cache_log::append(log.filename, log.key, log.id, size, {std::string(100000, 'x')}));
+
+  crypto::hash id;
+  uint64_t file_size;
+  ASSERT_TRUE(tools::cache_log::read_id(log.filename, id, file_size));
+  ASSERT_EQ(log.id, id);
+  ASSERT_EQ(size, file_size);
+
+  bool r;
+  std::vector<std::string> payloads = log.read(size, r);
+  ASSERT_TRUE(r);
+  ASSERT_EQ(std::vector<std::string>({"first", "", std::string(100000, 'x')}), payloads);
+
+  // segments past the size the cache knows about are ignored, and dropped by the next append
+  payloads = log.read(first_size, r);
+  ASSERT_TRUE(r);
+  ASSERT_EQ(std::vector<std::string>({"first", ""}), payloads);
+
+  size = first_size;
+  ASSERT_TRUE(tools::cache_log::append(log.filename, log.key, log.id, size, {"second"}));
+  payloads = log.read(size, r);
+  ASSERT_TRUE(r);
+  ASSERT_EQ(std::vector<std::string>({"first", "", "second"}), payloads);
+}
+
+TEST(cache_log, rejects_tampering)
+{
+  cache_log_file log;
+  uint64_t size = tools::cache_log::header_size();
+  ASSERT_TRUE(tools::cache_log::create(log.filename, log.id));
+  ASSERT_TRUE(tools::cache_log::append(log.filename, log.key, log.id, size, {"payment records"}));
+
+  std::string data;
+  ASSERT_TRUE(epee::file_io_utils::load_file_to_string(log.filename, data));
+  data[data.size() - 40] ^= 1;
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(log.filename, data));
+
+  bool r;
+  log.read(size, r);
+  ASSERT_FALSE(r);
+
+  // a log with another id doesn't match the cache either
+  ASSERT_TRUE(tools::cache_log::create(log.filename, crypto::rand<crypto::hash>()));
+  log.read(tools::cache_log::header_size(), r);
+  ASSERT_FALSE(r);
+  uint64_t append_size = tools::cache_log::header_size();
+  ASSERT_FALSE(tools::cache_log::append(log.filename, log.key, log.id, append_size, {"more"}));
+}
+
+TEST(cache_log, rejects_truncated_log)
+{
+  cache_log_file log;
+  uint64_t size = tools::cache_log::header_size();
+  ASSERT_TRUE(tools::cache_log::create(log.filename, log.id));
+  ASSERT_TRUE(tools::cache_log::append(log.filename, log.key, log.id, size, {"payment records"}));
+
+  boost::filesystem::resize_file(log.filename, size - 1);
+  bool r;
+  log.read(size, r);
+  ASSERT_FALSE(r);
+}
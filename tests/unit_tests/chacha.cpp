@@ -108,3 +108,20 @@ TEST_CHACHA8(0)
 TEST_CHACHA8(1)
 TEST_CHACHA8(2)
 TEST_CHACHA8(3)
+
+TEST(chacha8, long_input_is_consistent)
+{
+  // inputs of different lengths go through different block group sizes, the key stream must be the same
+  static const size_t lengths[] = {64, 255, 256, 511, 777, 1023, 1536, 4099};
+  const std::string zeros(4099, 0);
+  std::string longest(zeros.size(), 0);
+  crypto::chacha8(zeros.data(), zeros.size(), test_key_1, test_iv_1, &longest[0]);
+  ASSERT_EQ(longest.substr(0, test_1.text_length), std::string(reinterpret_cast<const char*>(test_cipher_text_1), test_1.text_length));
+
+  for (size_t length : lengths)
+  {
+    std::string buf(length, 0);
+    crypto::chacha8(zeros.data(), length, test_key_1, test_iv_1, &buf[0]);
+    ASSERT_EQ(buf, longest.substr(0, length));
+  }
+}
@@ -164,3 +164,17 @@ TEST(checkpoints_is_alternative_block_allowed, handles_two_and_more_checkpoints)
   ASSERT_TRUE (cp.is_alternative_block_allowed(11, 10));
   ASSERT_TRUE (cp.is_alternative_block_allowed(11, 11));
 }
+
+TEST(checkpoints_json, save_and_load)
+{
+  const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  checkpoints cp;
+  ASSERT_TRUE(cp.add_checkpoint(10, "0000000000000000000000000000000000000000000000000000000000000010"));
+  ASSERT_TRUE(cp.add_checkpoint(20, "0000000000000000000000000000000000000000000000000000000000000020"));
+  ASSERT_TRUE(cp.save_checkpoints_to_json(path));
+
+  checkpoints loaded;
+  ASSERT_TRUE(loaded.load_checkpoints_from_json(path));
+  boost::filesystem::remove(path);
+  ASSERT_EQ(cp.get_points(), loaded.get_points());
+}
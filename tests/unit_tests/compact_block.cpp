@@ -0,0 +1,89 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/compact_block.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+std::vector<crypto::hash> make_hashes(size_t count)
+{
+  std::vector<crypto::hash> result(count);
+  for (crypto::hash& h : result)
+    h = crypto::rand<crypto::hash>();
+  return result;
+}
+
+}
+
+TEST(compact_block, short_ids_depend_on_salt)
+{
+  const crypto::hash h = crypto::rand<crypto::hash>();
+
+  ASSERT_EQ(get_compact_short_id(1, h), get_compact_short_id(1, h));
+  ASSERT_NE(get_compact_short_id(1, h), get_compact_short_id(2, h));
+  ASSERT_LT(get_compact_short_id(1, h), 1ull << (COMPACT_BLOCK_SHORT_ID_SIZE * 8));
+  ASSERT_EQ(get_compact_short_ids(1, make_hashes(10)).size(), 10 * COMPACT_BLOCK_SHORT_ID_SIZE);
+}
+
+TEST(compact_block, resolve_from_pool)
+{
+  const uint64_t salt = crypto::rand<uint64_t>();
+  const std::vector<crypto::hash> block_txs = make_hashes(20);
+  const std::string short_ids = get_compact_short_ids(salt, block_txs);
+
+  std::vector<crypto::hash> pool = make_hashes(100);
+  pool.insert(pool.end(), block_txs.begin() + 2, block_txs.end());
+
+  std::vector<crypto::hash> tx_hashes(block_txs.size(), crypto::null_hash);
+  tx_hashes[0] = block_txs[0]; // prefilled
+
+  std::vector<uint64_t> missing;
+  ASSERT_TRUE(resolve_compact_short_ids(salt, short_ids, pool, tx_hashes, missing));
+  ASSERT_EQ(missing, std::vector<uint64_t>{1});
+
+  tx_hashes[1] = block_txs[1];
+  ASSERT_EQ(tx_hashes, block_txs);
+}
+
+TEST(compact_block, malformed_short_ids)
+{
+  std::vector<crypto::hash> tx_hashes(3, crypto::null_hash);
+  std::vector<uint64_t> missing;
+
+  ASSERT_FALSE(resolve_compact_short_ids(0, std::string(2 * COMPACT_BLOCK_SHORT_ID_SIZE, 'x'), {}, tx_hashes, missing));
+  ASSERT_FALSE(resolve_compact_short_ids(0, std::string(3 * COMPACT_BLOCK_SHORT_ID_SIZE + 1, 'x'), {}, tx_hashes, missing));
+  ASSERT_TRUE(resolve_compact_short_ids(0, std::string(3 * COMPACT_BLOCK_SHORT_ID_SIZE, 'x'), {}, tx_hashes, missing));
+  ASSERT_EQ(missing.size(), 3);
+}
@@ -72,3 +72,48 @@ TEST(Utils, cryptoMessage)
         EXPECT_EQ(res, false);
     }
 }
+
+TEST(Utils, cryptoMessageEncryptor)
+{
+    using namespace crypto;
+
+    std::vector<public_key> vec_B;
+    std::vector<secret_key> vec_b;
+    for(int i = 0; i < 8; ++i)
+    {
+        public_key B; secret_key b;
+        generate_keys(B,b);
+        vec_B.emplace_back(std::move(B)); vec_b.emplace_back(std::move(b));
+    }
+
+    graft::crypto_tools::MessageEncryptor encryptor(vec_B);
+    std::vector<public_key> reversed(vec_B.rbegin(), vec_B.rend());
+    EXPECT_FALSE(encryptor.setRecipients(reversed));
+
+    for(const std::string& data : {std::string("12345qwertasdfgzxcvb"), std::string("another message")})
+    {
+        std::string message;
+        encryptor.encrypt(data, message);
+
+        for(const auto& b : vec_b)
+        {
+            std::string plain;
+            bool res = graft::crypto_tools::decryptMessage(message, b, plain);
+            EXPECT_EQ(res, true);
+            EXPECT_EQ(plain, data);
+        }
+    }
+
+    {//changed set
+        public_key B; secret_key b;
+        generate_keys(B,b);
+        vec_B[0] = B;
+        EXPECT_TRUE(encryptor.setRecipients(vec_B));
+
+        std::string message, plain;
+        encryptor.encrypt("data", message);
+        EXPECT_TRUE(graft::crypto_tools::decryptMessage(message, b, plain));
+        EXPECT_EQ(plain, "data");
+        EXPECT_FALSE(graft::crypto_tools::decryptMessage(message, vec_b[0], plain));
+    }
+}
@@ -33,6 +33,7 @@
 #include <string>
 
 #include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "ringct/rctOps.h"
 
 namespace
 {
@@ -96,3 +97,114 @@ TEST(Crypto, verify_32)
     }
   }
 }
+
+#if defined(CRYPTO_OPS_64)
+TEST(Crypto, ge64_matches_ref10)
+{
+  for (int i = 0; i < 256; ++i)
+  {
+    const rct::key a = i == 0 ? rct::zero() : i == 1 ? rct::identity() : rct::skGen();
+    const rct::key b = rct::skGen();
+    const rct::key point = rct::scalarmultBase(rct::skGen());
+    ge_p3 p3;
+    ASSERT_EQ(ge_frombytes_vartime(&p3, point.bytes), 0);
+
+    ge_p2 res64, res10;
+    rct::key key64, key10;
+
+    ge_scalarmult(&res64, a.bytes, &p3);
+    ge_scalarmult_ref10(&res10, a.bytes, &p3);
+    ge_tobytes(key64.bytes, &res64);
+    ge_tobytes(key10.bytes, &res10);
+    ASSERT_EQ(key64, key10);
+
+    ge64_double_scalarmult_base_vartime(&res64, a.bytes, &p3, b.bytes);
+    ge_double_scalarmult_base_vartime_ref10(&res10, a.bytes, &p3, b.bytes);
+    ge_tobytes(key64.bytes, &res64);
+    ge_tobytes(key10.bytes, &res10);
+    ASSERT_EQ(key64, key10);
+  }
+}
+#endif
+
+TEST(Crypto, generate_key_derivations)
+{
+  const size_t count = 150;
+  const crypto::secret_key sec = rct::rct2sk(rct::skGen());
+  std::vector<crypto::public_key> keys(count);
+  for (size_t i = 0; i < count; ++i)
+    keys[i] = rct::rct2pk(rct::scalarmultBase(rct::skGen()));
+
+  // not a point
+  memset(&keys[77], 0, sizeof(keys[77]));
+  keys[77].data[0] = 2;
+  crypto::key_derivation unchanged;
+  memset(&unchanged, 0x5a, sizeof(unchanged));
+
+  std::vector<crypto::key_derivation> derivations(count, unchanged);
+  ASSERT_FALSE(crypto::generate_key_derivations(sec, epee::to_span(keys), epee::to_mut_span(derivations)));
+  for (size_t i = 0; i < count; ++i)
+  {
+    crypto::key_derivation derivation;
+    if (i == 77)
+    {
+      ASSERT_FALSE(crypto::generate_key_derivation(keys[i], sec, derivation));
+      ASSERT_EQ(memcmp(&derivations[i], &unchanged, sizeof(unchanged)), 0);
+      continue;
+    }
+    ASSERT_TRUE(crypto::generate_key_derivation(keys[i], sec, derivation));
+    ASSERT_EQ(memcmp(&derivations[i], &derivation, sizeof(derivation)), 0);
+  }
+}
+
+TEST(Crypto, check_signatures)
+{
+  const size_t count = 70;
+  crypto::hash prefix_hash;
+  crypto::cn_fast_hash("check_signatures", 16, prefix_hash);
+  std::vector<crypto::public_key> pubs(count);
+  std::vector<crypto::signature> sigs(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    crypto::secret_key sec;
+    crypto::generate_keys(pubs[i], sec);
+    crypto::generate_signature(prefix_hash, pubs[i], sec, sigs[i]);
+  }
+  ASSERT_TRUE(crypto::check_signatures(prefix_hash, epee::to_span(pubs), epee::to_span(sigs)));
+  ASSERT_TRUE(crypto::check_signatures(prefix_hash, {pubs.data(), 1}, {sigs.data(), 1}));
+  ASSERT_TRUE(crypto::check_signatures(prefix_hash, {}, {}));
+
+  std::swap(sigs[65], sigs[66]);
+  ASSERT_FALSE(crypto::check_signatures(prefix_hash, epee::to_span(pubs), epee::to_span(sigs)));
+  ASSERT_TRUE(crypto::check_signatures(prefix_hash, {pubs.data(), 64}, {sigs.data(), 64}));
+  ASSERT_FALSE(crypto::check_signatures(prefix_hash, epee::to_span(pubs), {sigs.data(), 64}));
+}
+
+TEST(Crypto, cn_fast_hash_batch)
+{
+  // lengths around the 136 byte keccak block, and more messages than lanes
+  std::vector<std::string> messages;
+  for (size_t length = 0; length < 300; length += 7)
+  {
+    messages.emplace_back(length, '\0');
+    crypto::rand(length, (uint8_t*)&messages.back()[0]);
+  }
+  messages.emplace_back(136, 'a');
+  messages.emplace_back(135, 'b');
+
+  std::vector<const void*> data;
+  std::vector<size_t> lengths;
+  for (const auto &m: messages)
+  {
+    data.push_back(m.data());
+    lengths.push_back(m.size());
+  }
+
+  for (size_t count: {size_t(0), size_t(1), size_t(3), size_t(8), messages.size()})
+  {
+    std::vector<crypto::hash> hashes(count);
+    crypto::cn_fast_hash_batch(data.data(), lengths.data(), hashes.data(), count);
+    for (size_t i = 0; i < count; ++i)
+      ASSERT_EQ(hashes[i], crypto::cn_fast_hash(messages[i].data(), messages[i].size()));
+  }
+}
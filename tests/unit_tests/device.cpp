@@ -29,6 +29,8 @@
 #include "gtest/gtest.h"
 #include "ringct/rctOps.h"
 #include "device/device_default.hpp"
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/subaddress_index.h"
 
 TEST(device, name)
 {
@@ -129,3 +131,26 @@ TEST(device, ecdh)
   ASSERT_EQ(tuple2.amount, tuple.amount);
   ASSERT_EQ(tuple2.senderPk, tuple.senderPk);
 }
+
+TEST(device, subaddress_spend_public_keys)
+{
+  hw::core::device_default dev;
+  cryptonote::account_base account;
+  account.generate();
+  const cryptonote::account_keys &keys = account.get_keys();
+
+  // small ranges are generated inline, large ones in parallel chunks
+  for (uint32_t major : {0u, 3u})
+  {
+    for (const std::pair<uint32_t, uint32_t> &range : std::vector<std::pair<uint32_t, uint32_t>>{{0, 0}, {0, 1}, {0, 70}, {5, 9}, {0, 1200}, {17, 1300}})
+    {
+      const std::vector<crypto::public_key> pkeys = dev.get_subaddress_spend_public_keys(keys, major, range.first, range.second);
+      ASSERT_EQ(pkeys.size(), range.second - range.first);
+      for (uint32_t minor = range.first; minor < range.second; ++minor)
+      {
+        const cryptonote::subaddress_index index = {major, minor};
+        ASSERT_EQ(pkeys[minor - range.first], dev.get_subaddress_spend_public_key(keys, index));
+      }
+    }
+  }
+}
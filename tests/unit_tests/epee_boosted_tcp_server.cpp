@@ -132,3 +132,30 @@ TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
   ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
   ASSERT_TRUE(srv.deinit_server());
 }
+
+TEST(boosted_tcp_server, accepts_on_an_acceptor_per_thread)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC);
+  srv.set_acceptor_per_thread(true);
+  ASSERT_TRUE(srv.init_server(0, test_server_host));
+  ASSERT_TRUE(srv.run_server(4, false));
+
+  boost::asio::io_service io_service;
+  std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> sockets;
+  const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(test_server_host), srv.get_binded_port());
+  for (int i = 0; i < 16; ++i)
+  {
+    sockets.emplace_back(new boost::asio::ip::tcp::socket(io_service));
+    sockets.back()->connect(endpoint);
+  }
+
+  // accepts run on the server threads, give them a moment
+  for (int i = 0; i < 500 && srv.get_connections_count() < 16; ++i)
+    epee::misc_utils::sleep_no_w(10);
+  ASSERT_EQ(16, srv.get_connections_count());
+
+  sockets.clear();
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
@@ -0,0 +1,224 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/http_protocol_handler.h"
+#include "net/net_utils_base.h"
+
+namespace
+{
+  struct test_http_endpoint : public epee::net_utils::i_service_endpoint
+  {
+    test_http_endpoint() : m_refs(0), m_closes(0) {}
+
+    virtual bool do_send(const void* ptr, size_t cb)
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      m_out.append(static_cast<const char*>(ptr), cb);
+      return true;
+    }
+    virtual bool close() { boost::unique_lock<boost::mutex> lock(m_mutex); ++m_closes; return true; }
+    virtual bool send_done() { return true; }
+    virtual bool call_run_once_service_io() { return true; }
+    virtual bool request_callback() { return true; }
+    virtual boost::asio::io_service& get_io_service() { return m_io_service; }
+    virtual bool add_ref() { boost::unique_lock<boost::mutex> lock(m_mutex); ++m_refs; return true; }
+    virtual bool release() { boost::unique_lock<boost::mutex> lock(m_mutex); --m_refs; return true; }
+
+    // the bodies of the responses sent, the test handler brackets them
+    std::string bodies()
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      std::string res;
+      for (size_t pos = m_out.find('['); pos != std::string::npos; pos = m_out.find('[', pos + 1))
+        res += m_out.substr(pos, m_out.find(']', pos) - pos + 1);
+      return res;
+    }
+
+    boost::asio::io_service m_io_service;
+    boost::mutex m_mutex;
+    std::string m_out;
+    int m_refs;
+    int m_closes;
+  };
+
+  struct test_http_handler : public epee::net_utils::http::simple_http_connection_handler<>
+  {
+    test_http_handler(epee::net_utils::i_service_endpoint* psnd_hndlr, config_type& config, epee::net_utils::connection_context_base& conn_context)
+      : simple_http_connection_handler(psnd_hndlr, config, conn_context)
+    {
+    }
+
+    virtual bool handle_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response)
+    {
+      if (query_info.m_URI == "/slow")
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+      response.m_response_code = 200;
+      response.m_response_comment = "OK";
+      response.m_body = "[" + query_info.m_URI + ":" + query_info.m_body + "]";
+      return true;
+    }
+  };
+
+  const std::string pipelined_requests =
+    "GET /slow HTTP/1.1\r\nHost: h\r\n\r\n"
+    "POST /b HTTP/1.1\r\nHost: h\r\nContent-Length: 3\r\n\r\nxyz"
+    "GET /c HTTP/1.1\r\nHost: h\r\nContent-Length: 0\r\n\r\n"
+    "GET /d HTTP/1.1\r\nHost: h\r\n\r\n";
+  const std::string pipelined_bodies = "[/slow:][/b:xyz][/c:][/d:]";
+}
+
+TEST(http_protocol_handler, handles_pipelined_requests)
+{
+  epee::net_utils::http::http_server_config config;
+  epee::net_utils::connection_context_base context;
+  test_http_endpoint endpoint;
+  test_http_handler handler(&endpoint, config, context);
+
+  ASSERT_TRUE(handler.handle_recv(pipelined_requests.data(), 40));
+  ASSERT_TRUE(handler.handle_recv(pipelined_requests.data() + 40, pipelined_requests.size() - 40));
+  ASSERT_EQ(pipelined_bodies, endpoint.bodies());
+  ASSERT_EQ(0, endpoint.m_closes);
+}
+
+TEST(http_protocol_handler, handles_pipelined_requests_on_workers)
+{
+  epee::net_utils::http::http_server_config config;
+  config.m_dispatcher = std::make_shared<epee::net_utils::http::request_dispatcher>(2);
+  config.m_dispatcher->set_limit("/slow", 1);
+  epee::net_utils::connection_context_base context;
+  test_http_endpoint endpoint;
+  {
+    test_http_handler handler(&endpoint, config, context);
+
+    // the rest arrives while the first request is running
+    ASSERT_TRUE(handler.handle_recv(pipelined_requests.data(), 40));
+    ASSERT_TRUE(handler.handle_recv(pipelined_requests.data() + 40, pipelined_requests.size() - 40));
+    config.m_dispatcher->stop();
+  }
+  ASSERT_EQ(pipelined_bodies, endpoint.bodies());
+  ASSERT_EQ(0, endpoint.m_refs);
+  ASSERT_EQ(0, endpoint.m_closes);
+
+  const auto stats = config.m_dispatcher->get_stats();
+  ASSERT_EQ(2u, stats.size());
+  ASSERT_EQ(1u, stats.at("/slow").handled);
+  ASSERT_EQ(3u, stats.at("").handled);
+  ASSERT_EQ(0u, stats.at("").running);
+}
+
+TEST(http_protocol_handler, closes_http10_connections_unless_kept_alive)
+{
+  const std::string requests = "GET /b HTTP/1.0\r\nHost: h\r\n\r\nGET /c HTTP/1.0\r\nHost: h\r\n\r\n";
+  epee::net_utils::connection_context_base context;
+  for (const bool workers : {false, true})
+  {
+    epee::net_utils::http::http_server_config config;
+    if (workers)
+      config.m_dispatcher = std::make_shared<epee::net_utils::http::request_dispatcher>(1);
+    test_http_endpoint endpoint;
+    test_http_handler handler(&endpoint, config, context);
+    const std::string data = "GET /a HTTP/1.0\r\nHost: h\r\nConnection: keep-alive\r\n\r\n" + requests;
+    const bool res = handler.handle_recv(data.data(), data.size());
+    if (workers)
+    {
+      config.m_dispatcher->stop();
+      ASSERT_EQ(1, endpoint.m_closes);
+    }
+    else
+    {
+      ASSERT_FALSE(res);
+    }
+    ASSERT_EQ("[/a:][/b:]", endpoint.bodies());
+    ASSERT_NE(std::string::npos, endpoint.m_out.find("Connection: keep-alive\r\n"));
+    ASSERT_NE(std::string::npos, endpoint.m_out.find("Connection: close\r\n"));
+  }
+}
+
+TEST(http_protocol_handler, negotiates_content_coding)
+{
+  using namespace epee::net_utils::http;
+  const bool gzip = content_coding_available(content_coding::gzip);
+  const bool zstd = content_coding_available(content_coding::zstd);
+
+  ASSERT_EQ(content_coding::identity, negotiate_content_coding(""));
+  ASSERT_EQ(content_coding::identity, negotiate_content_coding("br, identity"));
+  ASSERT_EQ(content_coding::identity, negotiate_content_coding("gzip;q=0, zstd;q=0"));
+  ASSERT_EQ(gzip ? content_coding::gzip : content_coding::identity, negotiate_content_coding("GZIP"));
+  ASSERT_EQ(zstd ? content_coding::zstd : content_coding::identity, negotiate_content_coding("zstd;q=0.5, gzip;q=0"));
+  ASSERT_EQ(gzip ? content_coding::gzip : zstd ? content_coding::zstd : content_coding::identity, negotiate_content_coding("zstd;q=0.5, gzip"));
+  ASSERT_EQ(zstd ? content_coding::zstd : gzip ? content_coding::gzip : content_coding::identity, negotiate_content_coding("*"));
+}
+
+TEST(http_protocol_handler, compresses_large_responses_when_accepted)
+{
+  using namespace epee::net_utils::http;
+  const std::string payload(4000, 'x');
+  const std::string request = "POST /a HTTP/1.1\r\nHost: h\r\nAccept-Encoding: zstd, gzip\r\nContent-Length: " + std::to_string(payload.size()) + "\r\n\r\n" + payload;
+  const std::string small_request = "GET /b HTTP/1.1\r\nHost: h\r\nAccept-Encoding: zstd, gzip\r\n\r\n";
+  const content_coding coding = negotiate_content_coding("zstd, gzip");
+
+  http_server_config config;
+  config.m_compression_threshold = 1024;
+  epee::net_utils::connection_context_base context;
+  test_http_endpoint endpoint;
+  test_http_handler handler(&endpoint, config, context);
+  ASSERT_TRUE(handler.handle_recv(request.data(), request.size()));
+
+  const size_t body_pos = endpoint.m_out.find("\r\n\r\n");
+  ASSERT_NE(std::string::npos, body_pos);
+  const std::string header = endpoint.m_out.substr(0, body_pos + 2);
+  const std::string body = endpoint.m_out.substr(body_pos + 4);
+  ASSERT_NE(std::string::npos, header.find("Vary:Accept-Encoding\r\n"));
+  if (coding == content_coding::identity)
+  {
+    ASSERT_EQ(std::string::npos, header.find("Content-Encoding"));
+    ASSERT_EQ("[/a:" + payload + "]", body);
+  }
+  else
+  {
+    ASSERT_NE(std::string::npos, header.find(std::string("Content-Encoding:") + content_coding_name(coding) + "\r\n"));
+    ASSERT_LT(body.size(), payload.size());
+    std::string decoded;
+    content_decoder decoder(coding, payload.size() * 2);
+    ASSERT_TRUE(decoder.update(body.data(), body.size(), decoded));
+    ASSERT_TRUE(decoder.finished());
+    ASSERT_EQ("[/a:" + payload + "]", decoded);
+  }
+
+  // too small to be worth it
+  endpoint.m_out.clear();
+  ASSERT_TRUE(handler.handle_recv(small_request.data(), small_request.size()));
+  ASSERT_EQ(std::string::npos, endpoint.m_out.find("Content-Encoding"));
+  ASSERT_EQ("[/b:]", endpoint.bodies());
+}
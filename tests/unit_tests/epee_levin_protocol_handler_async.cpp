@@ -527,6 +527,26 @@ TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_two_re
   ASSERT_EQ(2, m_commands_handler.invoke_counter());
 }
 
+TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_requests_split_across_reads)
+{
+  prepare_buf();
+  const std::string request = m_buf;
+  m_buf = request + request + request;
+
+  // the second read starts in the middle of the header of the third request
+  const size_t buf1_size = 2 * request.size() + sizeof(m_req_head) / 2;
+  std::string buf1 = m_buf.substr(0, buf1_size);
+  std::string buf2 = m_buf.substr(buf1_size);
+
+  ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(buf1.data(), buf1.size()));
+  ASSERT_EQ(2, m_commands_handler.invoke_counter());
+  ASSERT_EQ(m_in_data, m_commands_handler.last_in_buf());
+
+  ASSERT_TRUE(m_conn->m_protocol_handler.handle_recv(buf2.data(), buf2.size()));
+  ASSERT_EQ(3, m_commands_handler.invoke_counter());
+  ASSERT_EQ(m_in_data, m_commands_handler.last_in_buf());
+}
+
 TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_unexpected_response)
 {
   m_req_head.m_flags = LEVIN_PACKET_RESPONSE;
@@ -435,6 +435,41 @@ TEST(ToHex, Formatted)
   EXPECT_EQ(expected, out.str());
 }
 
+TEST(FromHex, Buffer)
+{
+  std::array<std::uint8_t, 4> out{{}};
+  EXPECT_TRUE(epee::from_hex::to_buffer(epee::to_mut_span(out), epee::to_span(std::string{"ffAB0100"})));
+  EXPECT_EQ((std::array<std::uint8_t, 4>{{0xFF, 0xAB, 0x01, 0x00}}), out);
+
+  EXPECT_FALSE(epee::from_hex::to_buffer(epee::to_mut_span(out), epee::to_span(std::string{"ffab01"})));
+  EXPECT_FALSE(epee::from_hex::to_buffer(epee::to_mut_span(out), epee::to_span(std::string{"ffab01000"})));
+  EXPECT_FALSE(epee::from_hex::to_buffer(epee::to_mut_span(out), epee::to_span(std::string{"ffab01g0"})));
+  EXPECT_FALSE(epee::from_hex::to_buffer(epee::to_mut_span(out), epee::to_span(std::string{" fab0100"})));
+
+  const std::vector<unsigned char> all_bytes = get_all_bytes();
+  const std::string hex = std_to_hex(all_bytes);
+  std::vector<std::uint8_t> decoded(all_bytes.size());
+  EXPECT_TRUE(epee::from_hex::to_buffer(epee::to_mut_span(decoded), epee::to_span(hex)));
+  EXPECT_TRUE(std::equal(all_bytes.begin(), all_bytes.end(), decoded.begin()));
+}
+
+TEST(StringTools, ParseHex)
+{
+  std::string res;
+  EXPECT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(std::string{"ffab0100"}, res));
+  EXPECT_EQ(std::string("\xff\xab\x01\x00", 4), res);
+  EXPECT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string{"ffa"}, res));
+  EXPECT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(std::string{"ffa"}, res, true));
+  EXPECT_EQ(std::string("\xff\x0a", 2), res);
+  EXPECT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string{"+f"}, res));
+  EXPECT_TRUE(res.empty());
+
+  std::array<char, 32> h;
+  EXPECT_TRUE(epee::string_tools::hex_to_pod(std::string(64, 'a'), h));
+  EXPECT_EQ(std::string(32, '\xaa'), std::string(h.data(), h.size()));
+  EXPECT_FALSE(epee::string_tools::hex_to_pod(std::string(62, 'a'), h));
+}
+
 TEST(StringTools, BuffToHex)
 {
   const std::vector<unsigned char> all_bytes = get_all_bytes();
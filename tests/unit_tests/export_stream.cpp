@@ -0,0 +1,162 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "crypto/chacha.h"
+#include "wallet/export_stream.h"
+
+namespace
+{
+  crypto::chacha_key make_key(char c)
+  {
+    crypto::chacha_key key;
+    memset(key.data(), c, key.size());
+    return key;
+  }
+
+  std::string write_segments(const crypto::chacha_key &key, const std::vector<std::string> &payloads)
+  {
+    std::stringstream ss;
+    tools::export_stream::writer writer(ss, key);
+    for (size_t n = 0; n < payloads.size(); ++n)
+      EXPECT_TRUE(writer.write(payloads[n], n + 1 == payloads.size()));
+    return ss.str();
+  }
+
+  // reads segments until the last one or a failure, returns whether the last one was reached
+  bool read_segments(const crypto::chacha_key &key, const std::string &data, std::vector<std::string> &payloads)
+  {
+    std::stringstream ss(data);
+    tools::export_stream::reader reader(ss, key, 1024 * 1024);
+    payloads.clear();
+    std::string payload;
+    bool last = false;
+    while (!last)
+    {
+      if (!reader.read(payload, last))
+        return false;
+      payloads.push_back(payload);
+    }
+    return reader.done();
+  }
+
+  // size of the framing of a segment around its ciphertext
+  const size_t segment_overhead = 8 + 1 + sizeof(crypto::chacha_iv) + sizeof(crypto::hash);
+}
+
+TEST(export_stream, round_trip)
+{
+  const crypto::chacha_key key = make_key(1);
+  const std::vector<std::string> payloads{"header", "", std::string(100000, 'x'), "last"};
+  const std::string data = write_segments(key, payloads);
+
+  size_t payload_size = 0;
+  for (const std::string &p: payloads)
+    payload_size += p.size();
+  ASSERT_EQ(data.size(), payload_size + payloads.size() * segment_overhead);
+  ASSERT_EQ(data.find("header"), std::string::npos);
+
+  std::vector<std::string> read;
+  ASSERT_TRUE(read_segments(key, data, read));
+  ASSERT_EQ(read, payloads);
+}
+
+TEST(export_stream, nothing_past_last)
+{
+  const crypto::chacha_key key = make_key(1);
+  const std::string data = write_segments(key, {"a"}) + write_segments(key, {"b"});
+
+  std::stringstream ss(data);
+  tools::export_stream::reader reader(ss, key, 1024);
+  std::string payload;
+  bool last = false;
+  ASSERT_TRUE(reader.read(payload, last));
+  ASSERT_TRUE(last);
+  ASSERT_FALSE(reader.read(payload, last));
+}
+
+TEST(export_stream, wrong_key)
+{
+  const std::string data = write_segments(make_key(1), {"a", "b"});
+  std::vector<std::string> read;
+  ASSERT_FALSE(read_segments(make_key(2), data, read));
+  ASSERT_TRUE(read.empty());
+}
+
+TEST(export_stream, tampered)
+{
+  const crypto::chacha_key key = make_key(1);
+  const std::string data = write_segments(key, {"first", "second"});
+  std::vector<std::string> read;
+  for (size_t n = 0; n < data.size(); ++n)
+  {
+    std::string tampered = data;
+    tampered[n] ^= 0x01;
+    ASSERT_FALSE(read_segments(key, tampered, read)) << "byte " << n;
+  }
+}
+
+TEST(export_stream, reordered_or_dropped)
+{
+  const crypto::chacha_key key = make_key(1);
+  const std::string data = write_segments(key, {"aaaa", "bbbb", "cccc"});
+  const size_t segment_size = 4 + segment_overhead;
+  ASSERT_EQ(data.size(), 3 * segment_size);
+  const std::string s0 = data.substr(0, segment_size), s1 = data.substr(segment_size, segment_size), s2 = data.substr(2 * segment_size);
+
+  std::vector<std::string> read;
+  ASSERT_FALSE(read_segments(key, s1 + s0 + s2, read));
+  ASSERT_FALSE(read_segments(key, s0 + s2, read));
+  ASSERT_FALSE(read_segments(key, s0 + s1 + s1 + s2, read));
+  ASSERT_TRUE(read_segments(key, s0 + s1 + s2, read));
+}
+
+TEST(export_stream, truncated)
+{
+  const crypto::chacha_key key = make_key(1);
+  const std::string data = write_segments(key, {"aaaa", "bbbb"});
+  std::vector<std::string> read;
+  for (size_t n = 0; n < data.size(); ++n)
+    ASSERT_FALSE(read_segments(key, data.substr(0, n), read)) << "length " << n;
+}
+
+TEST(export_stream, oversized_segment)
+{
+  const crypto::chacha_key key = make_key(1);
+  std::stringstream ss(write_segments(key, {std::string(2048, 'x')}));
+  tools::export_stream::reader reader(ss, key, 1024);
+  std::string payload;
+  bool last;
+  ASSERT_FALSE(reader.read(payload, last));
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <gtest/gtest.h>
+
+#include "cryptonote_core/graft_tx_extra_cache.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+crypto::hash make_hash(unsigned char value)
+{
+  crypto::hash result = crypto::null_hash;
+  result.data[0] = value;
+  return result;
+}
+
+}
+
+TEST(graft_tx_extra_cache, parse_rta_extras)
+{
+  rta_header hdr;
+  hdr.payment_id         = "payment";
+  hdr.auth_sample_height = 123;
+  hdr.keys.resize(3);
+
+  std::vector<rta_signature> signatures(3);
+
+  for (size_t i=0; i<signatures.size(); i++)
+    signatures[i].key_index = i;
+
+  transaction tx;
+  tx.type = transaction::tx_type_rta;
+
+  ASSERT_TRUE(add_graft_rta_header_to_extra(tx.extra, hdr));
+  ASSERT_TRUE(add_graft_rta_signatures_to_extra2(tx.extra2, signatures));
+
+  graft_tx_extra_cache cache;
+  graft_tx_extra_ptr extra = cache.get(make_hash(1), tx);
+
+  ASSERT_TRUE(extra->has_rta_header);
+  ASSERT_TRUE(extra->has_rta_signatures);
+  ASSERT_FALSE(extra->has_stake);
+  ASSERT_TRUE(extra->rta_hdr == hdr);
+  ASSERT_EQ(extra->rta_signatures.size(), 3u);
+
+    //cached extras are returned without parsing
+
+  ASSERT_EQ(cache.find(make_hash(1)), extra);
+  ASSERT_EQ(cache.get(make_hash(1), transaction()), extra);
+}
+
+TEST(graft_tx_extra_cache, no_graft_extras)
+{
+  transaction tx;
+  tx.type = transaction::tx_type_generic;
+
+  graft_tx_extra_ptr extra = graft_tx_extra_cache::parse(tx);
+
+  ASSERT_FALSE(extra->has_rta_header);
+  ASSERT_FALSE(extra->has_rta_signatures);
+  ASSERT_FALSE(extra->has_stake);
+}
+
+TEST(graft_tx_extra_cache, eviction)
+{
+  graft_tx_extra_cache cache(2);
+  transaction tx;
+
+  cache.get(make_hash(1), tx);
+  cache.get(make_hash(2), tx);
+
+  ASSERT_TRUE(cache.find(make_hash(1)) != nullptr); //hash 2 becomes the least recently used
+
+  cache.get(make_hash(3), tx);
+
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_TRUE(cache.find(make_hash(1)) != nullptr);
+  ASSERT_TRUE(cache.find(make_hash(2)) == nullptr);
+  ASSERT_TRUE(cache.find(make_hash(3)) != nullptr);
+
+  cache.erase(make_hash(1));
+
+  ASSERT_EQ(cache.size(), 1u);
+
+  cache.clear();
+
+  ASSERT_EQ(cache.size(), 0u);
+}
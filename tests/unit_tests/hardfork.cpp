@@ -97,6 +97,7 @@ public:
   virtual tx_out_index get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const { return tx_out_index(); }
   virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const {}
   virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false) {}
+  virtual void get_output_keys_and_txs(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, std::vector<tx_out_index> &indices) const {}
   virtual bool can_thread_bulk_indices() const { return false; }
   virtual std::vector<uint64_t> get_tx_output_indices(const crypto::hash& h) const { return std::vector<uint64_t>(); }
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_index) const { return std::vector<uint64_t>(); }
@@ -684,3 +685,43 @@ TEST(get, earliest_ideal_height)
     ASSERT_EQ(hf.get_earliest_ideal_height_for_version(10), std::numeric_limits<uint64_t>::max());
 }
 
+
+TEST(get, loaded_from_db)
+{
+    TestDB db;
+    HardFork hf(db, 1, 0, 1, 1, 1);
+
+    //                 v  h  t
+    ASSERT_TRUE(hf.add_fork(1, 0, 0));
+    ASSERT_TRUE(hf.add_fork(4, 2, 1));
+    ASSERT_TRUE(hf.add_fork(7, 4, 2));
+    ASSERT_TRUE(hf.add_fork(9, 6, 3));
+    hf.init();
+
+    for (uint64_t h = 0; h < 30; ++h) {
+      db.add_block(mkblock(hf, h, 9), 0, 0, 0, 0, crypto::hash());
+      ASSERT_TRUE(hf.add(db.get_block_from_height(h), h));
+    }
+
+    // a restarted daemon finds the versions stored by the previous one
+    HardFork hf2(db, 1, 0, 1, 1, 1);
+    ASSERT_TRUE(hf2.add_fork(1, 0, 0));
+    ASSERT_TRUE(hf2.add_fork(4, 2, 1));
+    ASSERT_TRUE(hf2.add_fork(7, 4, 2));
+    ASSERT_TRUE(hf2.add_fork(9, 6, 3));
+    hf2.init();
+    for (uint64_t h = 0; h < 30; ++h)
+      ASSERT_EQ(hf2.get(h), db.get_hard_fork_version(h));
+    ASSERT_EQ(hf2.get(30), 9);
+
+    // blocks replaced after a reorganization have their versions updated
+    for (uint64_t h = 3; h < 30; ++h)
+      db.remove_block();
+    hf2.reorganize_from_block_height(2);
+    for (uint64_t h = 3; h < 30; ++h) {
+      db.add_block(mkblock(hf2, h, 4), 0, 0, 0, 0, crypto::hash());
+      ASSERT_TRUE(hf2.add(db.get_block_from_height(h), h));
+    }
+    for (uint64_t h = 0; h < 30; ++h)
+      ASSERT_EQ(hf2.get(h), h < 2 ? 1 : 4);
+}
@@ -0,0 +1,181 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "rpc/light_wallet_db.h"
+
+namespace
+{
+  class LightWalletDB: public ::testing::Test
+  {
+  protected:
+    void SetUp() override
+    {
+      path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      db.open(path.string());
+      alice = add_account(100);
+      bob = add_account(100);
+    }
+
+    void TearDown() override
+    {
+      db.close();
+      boost::filesystem::remove_all(path);
+    }
+
+    cryptonote::light_wallet_db::account add_account(uint64_t start_height)
+    {
+      cryptonote::account_public_address address;
+      crypto::secret_key view_secret_key;
+      crypto::generate_keys(address.m_spend_public_key, view_secret_key);
+      crypto::generate_keys(address.m_view_public_key, view_secret_key);
+      cryptonote::light_wallet_db::account acc;
+      EXPECT_TRUE(db.add_account(address, view_secret_key, start_height, acc));
+      return acc;
+    }
+
+    static cryptonote::light_wallet_db::output make_output(uint64_t height, uint64_t global_index, uint64_t amount)
+    {
+      cryptonote::light_wallet_db::output o;
+      memset(&o, 0, sizeof(o));
+      o.height = height;
+      o.global_index = global_index;
+      o.amount = amount;
+      o.tx_pub_key = crypto::rand<crypto::public_key>();
+      o.out_index = 1;
+      o.rct = 1;
+      return o;
+    }
+
+    static cryptonote::light_wallet_db::input make_input(uint64_t height, std::vector<uint64_t> ring)
+    {
+      return {height, 0, 0, crypto::rand<crypto::hash>(), crypto::rand<crypto::key_image>(), 0, std::move(ring)};
+    }
+
+    static cryptonote::light_wallet_db::scan_batch make_batch(uint64_t from, uint64_t to, const std::vector<cryptonote::light_wallet_db::account>& accounts)
+    {
+      cryptonote::light_wallet_db::scan_batch batch;
+      batch.to_height = to;
+      for (const auto& acc: accounts)
+        batch.scanned_from[acc.id] = acc.scanned_height;
+      for (uint64_t h = from; h < to; ++h)
+        batch.blocks.emplace_back(h, crypto::rand<crypto::hash>());
+      return batch;
+    }
+
+    boost::filesystem::path path;
+    cryptonote::light_wallet_db db;
+    cryptonote::light_wallet_db::account alice, bob;
+  };
+}
+
+TEST_F(LightWalletDB, add_account)
+{
+  cryptonote::light_wallet_db::account acc;
+  ASSERT_FALSE(db.add_account(alice.address, crypto::secret_key(), 0, acc));
+  ASSERT_EQ(acc.id, alice.id);
+  ASSERT_TRUE(db.get_account(bob.address, acc));
+  ASSERT_EQ(acc.id, bob.id);
+  ASSERT_EQ(acc.scanned_height, 100);
+  ASSERT_EQ(db.get_accounts().size(), 2);
+}
+
+TEST_F(LightWalletDB, spends_of_ring_members)
+{
+  auto batch = make_batch(100, 200, {alice, bob});
+  batch.outputs.emplace_back(alice.id, make_output(110, 5, 1000));
+  batch.outputs.emplace_back(bob.id, make_output(120, 7, 2000));
+  batch.inputs.push_back(make_input(150, {3, 5, 9}));
+  batch.inputs.push_back(make_input(160, {1, 2, 4}));
+  db.store(batch);
+
+  const auto outputs = db.get_outputs(alice.id);
+  ASSERT_EQ(outputs.size(), 1);
+  ASSERT_EQ(outputs[0].global_index, 5);
+  const auto spends = db.get_spends(alice.id);
+  ASSERT_EQ(spends.size(), 1);
+  ASSERT_EQ(spends[0].amount, 1000);
+  ASSERT_EQ(spends[0].out_tx_pub_key, outputs[0].tx_pub_key);
+  ASSERT_EQ(spends[0].mixin, 2);
+  ASSERT_TRUE(db.get_spends(bob.id).empty());
+
+  cryptonote::light_wallet_db::account acc;
+  ASSERT_TRUE(db.get_account(alice.address, acc));
+  ASSERT_EQ(acc.scanned_height, 200);
+  uint64_t top;
+  crypto::hash hash;
+  ASSERT_TRUE(db.get_top_block(top, hash));
+  ASSERT_EQ(top, 199);
+}
+
+TEST_F(LightWalletDB, rollback)
+{
+  auto batch = make_batch(100, 200, {alice});
+  batch.outputs.emplace_back(alice.id, make_output(110, 5, 1000));
+  batch.outputs.emplace_back(alice.id, make_output(180, 6, 3000));
+  batch.inputs.push_back(make_input(190, {6}));
+  db.store(batch);
+  ASSERT_EQ(db.get_spends(alice.id).size(), 1);
+
+  db.rollback(150);
+  ASSERT_EQ(db.get_outputs(alice.id).size(), 1);
+  ASSERT_TRUE(db.get_spends(alice.id).empty());
+  cryptonote::light_wallet_db::account acc;
+  ASSERT_TRUE(db.get_account(alice.address, acc));
+  ASSERT_EQ(acc.scanned_height, 150);
+  uint64_t top;
+  crypto::hash hash;
+  ASSERT_TRUE(db.get_top_block(top, hash));
+  ASSERT_EQ(top, 149);
+
+  // the output dropped isn't matched any more
+  acc.scanned_height = 150;
+  batch = make_batch(150, 200, {acc});
+  batch.inputs.push_back(make_input(190, {6}));
+  db.store(batch);
+  ASSERT_TRUE(db.get_spends(alice.id).empty());
+}
+
+TEST_F(LightWalletDB, batch_of_reset_account_dropped)
+{
+  auto batch = make_batch(100, 200, {alice});
+  batch.outputs.emplace_back(alice.id, make_output(110, 5, 1000));
+  db.reset_account(alice.id, 0);
+  db.store(batch);
+  ASSERT_TRUE(db.get_outputs(alice.id).empty());
+  cryptonote::light_wallet_db::account acc;
+  ASSERT_TRUE(db.get_account(alice.address, acc));
+  ASSERT_EQ(acc.scanned_height, 0);
+  ASSERT_EQ(acc.start_height, 0);
+}
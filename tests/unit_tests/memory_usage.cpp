@@ -0,0 +1,113 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gtest/gtest.h"
+#include "common/memory_usage.h"
+
+namespace
+{
+  uint64_t stat_of(const std::string &subsystem)
+  {
+    for (const tools::memory::stat &s: tools::memory::get_stats())
+      if (s.subsystem == subsystem)
+        return s.bytes;
+    return (uint64_t)-1;
+  }
+
+  std::string metrics_of(const std::string &subsystem)
+  {
+    std::istringstream in(tools::metrics::get());
+    std::string line, out;
+    while (std::getline(in, line))
+      if (line.find("subsystem=\"" + subsystem + "\"") != std::string::npos)
+        out += line + "\n";
+    return out;
+  }
+}
+
+TEST(memory_usage, tracked_and_probed)
+{
+  uint64_t probed = 100;
+  tools::memory::account a("test_memory_a", [&probed](uint64_t &bytes) { bytes = probed; return true; });
+  ASSERT_EQ(a.value(), 100);
+  a.add(50);
+  a.sub(20);
+  ASSERT_EQ(a.value(), 130);
+  probed = 10;
+  ASSERT_EQ(a.value(), 40);
+}
+
+TEST(memory_usage, busy_probe_keeps_last_value)
+{
+  bool busy = false;
+  tools::memory::account a("test_memory_b", [&busy](uint64_t &bytes) { if (busy) return false; bytes = 64; return true; });
+  ASSERT_EQ(a.value(), 64);
+  busy = true;
+  ASSERT_EQ(a.value(), 64);
+}
+
+TEST(memory_usage, stats_by_subsystem)
+{
+  ASSERT_EQ(stat_of("test_memory_c"), (uint64_t)-1);
+  {
+    tools::memory::account a("test_memory_c"), b("test_memory_c"), c("test_memory_d");
+    a.add(1);
+    b.add(2);
+    c.add(4);
+    ASSERT_EQ(stat_of("test_memory_c"), 3);
+    ASSERT_EQ(stat_of("test_memory_d"), 4);
+
+    const std::vector<tools::memory::stat> stats = tools::memory::get_stats();
+    for (size_t i = 1; i < stats.size(); ++i)
+      ASSERT_LT(stats[i - 1].subsystem, stats[i].subsystem);
+  }
+  ASSERT_EQ(stat_of("test_memory_c"), (uint64_t)-1);
+}
+
+TEST(memory_usage, metrics)
+{
+  tools::memory::account a("test_memory_e");
+  a.add(123);
+  ASSERT_EQ(metrics_of("test_memory_e"), "graft_memory_bytes{subsystem=\"test_memory_e\"} 123\n");
+  ASSERT_NE(tools::metrics::get().find("# TYPE graft_memory_bytes gauge\n"), std::string::npos);
+}
+
+TEST(memory_usage, estimates)
+{
+  std::vector<uint64_t> v;
+  v.reserve(10);
+  ASSERT_EQ(tools::memory::vector_bytes(v), 10 * sizeof(uint64_t));
+  ASSERT_EQ(tools::memory::string_bytes(std::string("short")), 0);
+  ASSERT_GT(tools::memory::string_bytes(std::string(64, 'x')), 64);
+  std::unordered_map<int, int> m{{1, 1}, {2, 2}};
+  ASSERT_GE(tools::memory::hash_bytes(m), 2 * (sizeof(std::pair<const int, int>) + tools::memory::NODE_OVERHEAD) + m.bucket_count() * sizeof(void*));
+}
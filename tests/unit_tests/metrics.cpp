@@ -0,0 +1,118 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "common/metrics.h"
+
+namespace
+{
+  std::string metrics_named(const std::string &prefix)
+  {
+    std::istringstream in(tools::metrics::get());
+    std::string line, out;
+    while (std::getline(in, line))
+      if (line.find(prefix) != std::string::npos)
+        out += line + "\n";
+    return out;
+  }
+}
+
+TEST(metrics, counter_across_threads)
+{
+  tools::metrics::counter c("test_metrics_counter_total", "A counter");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 16; ++t)
+    threads.emplace_back([&c]() { for (int i = 0; i < 1000; ++i) c.inc(); });
+  for (auto &t: threads)
+    t.join();
+  c.inc(5);
+  ASSERT_EQ(c.value(), 16005);
+  ASSERT_EQ(metrics_named("test_metrics_counter_total"),
+    "# HELP test_metrics_counter_total A counter\n"
+    "# TYPE test_metrics_counter_total counter\n"
+    "test_metrics_counter_total 16005\n");
+}
+
+TEST(metrics, gauge)
+{
+  tools::metrics::gauge g("test_metrics_gauge", "A gauge", "kind=\"a\"");
+  g.set(10);
+  g.add(-3);
+  ASSERT_EQ(g.value(), 7);
+  ASSERT_EQ(metrics_named("test_metrics_gauge"),
+    "# HELP test_metrics_gauge A gauge\n"
+    "# TYPE test_metrics_gauge gauge\n"
+    "test_metrics_gauge{kind=\"a\"} 7\n");
+}
+
+TEST(metrics, histogram)
+{
+  tools::metrics::histogram h("test_metrics_histogram_seconds", "A histogram");
+  h.observe(50);
+  h.observe(700);
+  h.observe(100000000);
+  ASSERT_EQ(h.count(), 3);
+  ASSERT_EQ(h.sum_micros(), 100000750);
+
+  const std::string out = metrics_named("test_metrics_histogram_seconds");
+  ASSERT_NE(out.find("# TYPE test_metrics_histogram_seconds histogram\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_histogram_seconds_bucket{le=\"0.000050\"} 1\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_histogram_seconds_bucket{le=\"0.000500\"} 1\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_histogram_seconds_bucket{le=\"0.001000\"} 2\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_histogram_seconds_bucket{le=\"30.000000\"} 2\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_histogram_seconds_bucket{le=\"+Inf\"} 3\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_histogram_seconds_sum 100.000750\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_histogram_seconds_count 3\n"), std::string::npos);
+}
+
+TEST(metrics, family_shares_help)
+{
+  tools::metrics::family<tools::metrics::counter> f("test_metrics_family_total", "A family", "method");
+  f.get("b").inc(2);
+  f.get("a").inc();
+  f.get("b").inc();
+  ASSERT_EQ(&f.get("a"), &f.get("a"));
+
+  const std::string out = metrics_named("test_metrics_family_total");
+  ASSERT_EQ(out.find("# HELP"), 0);
+  ASSERT_EQ(out.find("# HELP", 1), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_family_total{method=\"a\"} 1\n"), std::string::npos);
+  ASSERT_NE(out.find("test_metrics_family_total{method=\"b\"} 3\n"), std::string::npos);
+}
+
+TEST(metrics, unregistered_when_destroyed)
+{
+  {
+    tools::metrics::counter c("test_metrics_gone_total", "Gone");
+    ASSERT_FALSE(metrics_named("test_metrics_gone_total").empty());
+  }
+  ASSERT_TRUE(metrics_named("test_metrics_gone_total").empty());
+}
@@ -26,6 +26,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <string.h>
 #include "gtest/gtest.h"
 
 #include "misc_log_ex.h"
@@ -193,3 +194,37 @@ TEST(mlocker, mlocked)
 }
 
 #endif
+
+TEST(mlocked_pool, reuses_freed_blocks)
+{
+  const size_t base_blocks = epee::mlocked_pool::get_num_allocated_blocks();
+  char *p0 = (char*)epee::mlocked_pool::allocate(24);
+  ASSERT_TRUE(p0 != NULL);
+  ASSERT_TRUE(epee::mlocked_pool::get_num_chunks() > 0);
+  ASSERT_EQ(epee::mlocked_pool::get_num_allocated_blocks(), base_blocks + 1);
+  memset(p0, 0x55, 24);
+  epee::mlocked_pool::deallocate(p0, 24);
+  ASSERT_EQ(epee::mlocked_pool::get_num_allocated_blocks(), base_blocks);
+  // the start of a free block links to the next one, the rest is wiped
+  for (size_t i = sizeof(void*); i < 24; ++i)
+    ASSERT_EQ(p0[i], 0);
+  char *p1 = (char*)epee::mlocked_pool::allocate(20);
+  ASSERT_EQ(p0, p1);
+  char *p2 = (char*)epee::mlocked_pool::allocate(20);
+  ASSERT_NE(p1, p2);
+  epee::mlocked_pool::deallocate(p1, 20);
+  epee::mlocked_pool::deallocate(p2, 20);
+  ASSERT_EQ(epee::mlocked_pool::get_num_allocated_blocks(), base_blocks);
+}
+
+TEST(mlocked_pool, large_blocks)
+{
+  const size_t base_blocks = epee::mlocked_pool::get_num_allocated_blocks();
+  const size_t base_chunks = epee::mlocked_pool::get_num_chunks();
+  char *p = (char*)epee::mlocked_pool::allocate(100000);
+  ASSERT_TRUE(p != NULL);
+  memset(p, 0x55, 100000);
+  ASSERT_EQ(epee::mlocked_pool::get_num_allocated_blocks(), base_blocks);
+  ASSERT_EQ(epee::mlocked_pool::get_num_chunks(), base_chunks);
+  epee::mlocked_pool::deallocate(p, 100000);
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "net/network_scheduler.hpp"
+
+using epee::net_utils::network_scheduler;
+
+namespace
+{
+  typedef network_scheduler::clock clock;
+
+  const clock::time_point start = clock::now() + boost::chrono::seconds(1);
+
+  clock::time_point at_ms(int ms)
+  {
+    return start + boost::chrono::milliseconds(ms);
+  }
+
+  struct recorder
+  {
+    std::vector<int> order;
+    network_scheduler::resume_t resume(int id) { return [this, id]() { order.push_back(id); }; }
+  };
+
+  void run(const std::vector<network_scheduler::resume_t> &resumes)
+  {
+    for (const auto &resume : resumes)
+      resume();
+  }
+}
+
+TEST(network_scheduler, no_limit_grants_everything)
+{
+  network_scheduler scheduler;
+  for (int i = 0; i < 100; ++i)
+    ASSERT_TRUE(scheduler.request(i, epee::net_utils::traffic_class_sync, 1024 * 1024, {}, at_ms(0)));
+
+  const auto stats = scheduler.get_stats();
+  EXPECT_EQ(100u * 1024 * 1024, stats[epee::net_utils::traffic_class_sync].bytes);
+  EXPECT_EQ(0u, stats[epee::net_utils::traffic_class_sync].delayed);
+}
+
+TEST(network_scheduler, limit_delays_writes)
+{
+  network_scheduler scheduler;
+  scheduler.set_rate(100000);
+  recorder r;
+
+  // the first write takes the class into debt, the next one waits for it to be paid
+  ASSERT_TRUE(scheduler.request(1, epee::net_utils::traffic_class_other, 200000, r.resume(1), at_ms(0)));
+  ASSERT_FALSE(scheduler.request(1, epee::net_utils::traffic_class_other, 1000, r.resume(2), at_ms(0)));
+
+  clock::time_point next;
+  run(scheduler.dispatch(at_ms(10), next));
+  EXPECT_TRUE(r.order.empty());
+  ASSERT_NE(clock::time_point::max(), next);
+  EXPECT_GT(next, at_ms(10));
+
+  // the root bucket pays its debt at the full rate, and lends to the only class sending
+  run(scheduler.dispatch(at_ms(2000), next));
+  ASSERT_EQ(std::vector<int>({2}), r.order);
+  EXPECT_EQ(clock::time_point::max(), next);
+
+  const auto stats = scheduler.get_stats();
+  EXPECT_EQ(1u, stats[epee::net_utils::traffic_class_other].delayed);
+  EXPECT_EQ(0u, stats[epee::net_utils::traffic_class_other].waiting);
+  EXPECT_GT(stats[epee::net_utils::traffic_class_other].borrowed_bytes, 0u);
+}
+
+TEST(network_scheduler, block_relay_goes_before_sync)
+{
+  network_scheduler scheduler;
+  scheduler.set_rate(100000);
+  recorder r;
+
+  ASSERT_TRUE(scheduler.request(1, epee::net_utils::traffic_class_sync, 500000, r.resume(0), at_ms(0)));
+  ASSERT_FALSE(scheduler.request(1, epee::net_utils::traffic_class_sync, 10000, r.resume(1), at_ms(0)));
+  ASSERT_FALSE(scheduler.request(2, epee::net_utils::traffic_class_sync, 10000, r.resume(2), at_ms(0)));
+
+  // a block sent while sync holds all the bandwidth goes on the block relay share
+  ASSERT_TRUE(scheduler.request(3, epee::net_utils::traffic_class_block_relay, 20000, r.resume(3), at_ms(0)));
+  ASSERT_FALSE(scheduler.request(4, epee::net_utils::traffic_class_block_relay, 20000, r.resume(4), at_ms(0)));
+
+  clock::time_point next;
+  run(scheduler.dispatch(at_ms(1000), next));
+  ASSERT_FALSE(r.order.empty());
+  EXPECT_EQ(4, r.order.front());
+}
+
+TEST(network_scheduler, peers_share_class_bytes)
+{
+  network_scheduler scheduler;
+  scheduler.set_rate(1000000);
+
+  // a peer writing 256k at a time against one writing 16k at a time, each writing again once granted
+  const size_t sizes[2] = { 256 * 1024, 16 * 1024 };
+  size_t sent[2] = { 0, 0 };
+  std::vector<int> granted;
+  auto write = [&](int peer, int ms) {
+    if (scheduler.request(peer, epee::net_utils::traffic_class_other, sizes[peer], [&granted, peer]() { granted.push_back(peer); }, at_ms(ms)))
+      granted.push_back(peer);
+  };
+  write(0, 0);
+  write(1, 0);
+
+  for (int ms = 0; ms < 20000; ms += 10)
+  {
+    clock::time_point next;
+    run(scheduler.dispatch(at_ms(ms), next));
+    while (!granted.empty())
+    {
+      const int peer = granted.back();
+      granted.pop_back();
+      sent[peer] += sizes[peer];
+      write(peer, ms);
+    }
+  }
+
+  ASSERT_GT(sent[0] + sent[1], 10000000u);
+  EXPECT_LT(std::abs((double)sent[0] - (double)sent[1]), (double)sizes[0] * 2);
+}
+
+TEST(network_scheduler, cancel_drops_waiting_write)
+{
+  network_scheduler scheduler;
+  scheduler.set_rate(100000);
+  recorder r;
+
+  ASSERT_TRUE(scheduler.request(1, epee::net_utils::traffic_class_tx_relay, 200000, r.resume(1), at_ms(0)));
+  ASSERT_FALSE(scheduler.request(1, epee::net_utils::traffic_class_tx_relay, 1000, r.resume(2), at_ms(0)));
+  ASSERT_FALSE(scheduler.request(2, epee::net_utils::traffic_class_tx_relay, 1000, r.resume(3), at_ms(0)));
+  scheduler.cancel(1);
+  EXPECT_EQ(1u, scheduler.get_stats()[epee::net_utils::traffic_class_tx_relay].waiting);
+
+  clock::time_point next;
+  run(scheduler.dispatch(at_ms(5000), next));
+  EXPECT_EQ(std::vector<int>({3}), r.order);
+}
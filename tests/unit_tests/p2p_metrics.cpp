@@ -0,0 +1,80 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <sstream>
+#include <gtest/gtest.h>
+#include "p2p/p2p_metrics.h"
+
+using namespace nodetool;
+
+TEST(p2p_metrics, histogram)
+{
+  latency_histogram histogram;
+
+  histogram.observe(50);
+  histogram.observe(100);
+  histogram.observe(2000000);
+  histogram.observe(10000000);
+
+  ASSERT_EQ(histogram.get_count(), 4u);
+  ASSERT_EQ(histogram.get_sum_micros(), 12000150u);
+
+  std::ostringstream out;
+  histogram.write(out, "test_seconds", "name=\"value\"");
+
+  std::string text = out.str();
+
+  ASSERT_NE(text.find("test_seconds_bucket{name=\"value\",le=\"0.000100\"} 2\n"), std::string::npos);
+  ASSERT_NE(text.find("test_seconds_bucket{name=\"value\",le=\"1.000000\"} 2\n"), std::string::npos);
+  ASSERT_NE(text.find("test_seconds_bucket{name=\"value\",le=\"5.000000\"} 3\n"), std::string::npos);
+  ASSERT_NE(text.find("test_seconds_bucket{name=\"value\",le=\"+Inf\"} 4\n"), std::string::npos);
+  ASSERT_NE(text.find("test_seconds_sum{name=\"value\"} 12.000150\n"), std::string::npos);
+  ASSERT_NE(text.find("test_seconds_count{name=\"value\"} 4\n"), std::string::npos);
+}
+
+TEST(p2p_metrics, commands)
+{
+  p2p_metrics metrics;
+
+  metrics.on_command(1020, 100, 10);
+  metrics.on_command(1020, 50, 20);
+  metrics.on_command(2002, 10, 30);
+  metrics.on_command(5000, 1, 40);
+
+  std::ostringstream out;
+  metrics.write(out);
+
+  std::string text = out.str();
+
+  ASSERT_NE(text.find("graft_p2p_command_bytes_in_total{command=\"1020\"} 150\n"), std::string::npos);
+  ASSERT_NE(text.find("graft_p2p_command_bytes_in_total{command=\"2002\"} 10\n"), std::string::npos);
+  ASSERT_NE(text.find("graft_p2p_command_bytes_in_total{command=\"other\"} 1\n"), std::string::npos);
+  ASSERT_NE(text.find("graft_p2p_command_handler_seconds_count{command=\"1020\"} 2\n"), std::string::npos);
+  ASSERT_EQ(text.find("command=\"1001\""), std::string::npos);
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_protocol/payload_compression.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+std::string make_blob(size_t size)
+{
+  std::string blob(size, 'a');
+  for (size_t i = 0; i < blob.size(); i += 7)
+    blob[i] = 'x' + i % 3;
+  return blob;
+}
+
+}
+
+TEST(payload_compression, round_trip)
+{
+  if (!payload_compression_available())
+    return;
+
+  const std::string blob = make_blob(200000);
+  std::string compressed, decompressed;
+  ASSERT_TRUE(compress_payload(blob, compressed));
+  ASSERT_LT(compressed.size(), blob.size());
+  ASSERT_TRUE(decompress_payload(compressed, decompressed, blob.size()));
+  ASSERT_EQ(decompressed, blob);
+}
+
+TEST(payload_compression, limits)
+{
+  if (!payload_compression_available())
+    return;
+
+  std::string compressed, decompressed;
+  ASSERT_TRUE(compress_payload(make_blob(200000), compressed));
+  // frames decompressing past the limit are refused
+  ASSERT_FALSE(decompress_payload(compressed, decompressed, 1000));
+  ASSERT_FALSE(decompress_payload("not a zstd frame", decompressed, 1000));
+
+  // blobs which don't get smaller are sent as they are
+  ASSERT_FALSE(compress_payload("ab", compressed));
+}
+
+TEST(payload_compression, unavailable)
+{
+  if (payload_compression_available())
+    return;
+
+  std::string compressed;
+  ASSERT_FALSE(compress_payload(make_blob(200000), compressed));
+}
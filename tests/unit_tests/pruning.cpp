@@ -0,0 +1,98 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "cryptonote_config.h"
+#include "common/pruning.h"
+
+static const uint64_t CHAIN_HEIGHT = 100 * CRYPTONOTE_PRUNING_STRIPE_SIZE;
+
+TEST(pruning, stripes_cycle)
+{
+  for (uint32_t s = 1; s <= CRYPTONOTE_PRUNING_NUM_STRIPES; ++s)
+  {
+    const uint64_t start = (s - 1) * (uint64_t)CRYPTONOTE_PRUNING_STRIPE_SIZE;
+    ASSERT_EQ(tools::get_pruning_stripe(start), s);
+    ASSERT_EQ(tools::get_pruning_stripe(start + CRYPTONOTE_PRUNING_STRIPE_SIZE - 1), s);
+    ASSERT_EQ(tools::get_pruning_stripe(start + CRYPTONOTE_PRUNING_STRIPE_SIZE * CRYPTONOTE_PRUNING_NUM_STRIPES), s);
+  }
+}
+
+TEST(pruning, unpruned_blocks)
+{
+  ASSERT_TRUE(tools::has_unpruned_block(0, CHAIN_HEIGHT, 0));
+  ASSERT_TRUE(tools::has_unpruned_block(0, CHAIN_HEIGHT, 1));
+  ASSERT_FALSE(tools::has_unpruned_block(0, CHAIN_HEIGHT, 2));
+  ASSERT_TRUE(tools::has_unpruned_block(CRYPTONOTE_PRUNING_STRIPE_SIZE, CHAIN_HEIGHT, 2));
+
+  // every node keeps the tip
+  for (uint32_t s = 1; s <= CRYPTONOTE_PRUNING_NUM_STRIPES; ++s)
+  {
+    ASSERT_TRUE(tools::has_unpruned_block(CHAIN_HEIGHT - CRYPTONOTE_PRUNING_TIP_BLOCKS, CHAIN_HEIGHT, s));
+    ASSERT_TRUE(tools::has_unpruned_block(CHAIN_HEIGHT - 1, CHAIN_HEIGHT, s));
+    ASSERT_TRUE(tools::has_unpruned_block(0, CRYPTONOTE_PRUNING_TIP_BLOCKS, s));
+  }
+
+  // all the old blocks are kept by exactly one stripe
+  for (uint64_t h = 0; h < CHAIN_HEIGHT - CRYPTONOTE_PRUNING_TIP_BLOCKS; h += 997)
+  {
+    size_t n = 0;
+    for (uint32_t s = 1; s <= CRYPTONOTE_PRUNING_NUM_STRIPES; ++s)
+      n += tools::has_unpruned_block(h, CHAIN_HEIGHT, s);
+    ASSERT_EQ(n, 1);
+  }
+}
+
+TEST(pruning, next_heights)
+{
+  ASSERT_EQ(tools::get_next_unpruned_block_height(5, CHAIN_HEIGHT, 1), 5);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(5, CHAIN_HEIGHT, 3), 2 * CRYPTONOTE_PRUNING_STRIPE_SIZE);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(2 * CRYPTONOTE_PRUNING_STRIPE_SIZE + 1, CHAIN_HEIGHT, 1), CRYPTONOTE_PRUNING_STRIPE_SIZE * CRYPTONOTE_PRUNING_NUM_STRIPES);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(CHAIN_HEIGHT - CRYPTONOTE_PRUNING_TIP_BLOCKS - 1, CHAIN_HEIGHT, 1), CHAIN_HEIGHT - CRYPTONOTE_PRUNING_TIP_BLOCKS);
+
+  ASSERT_EQ(tools::get_next_pruned_block_height(5, CHAIN_HEIGHT, 0), CHAIN_HEIGHT);
+  ASSERT_EQ(tools::get_next_pruned_block_height(5, CHAIN_HEIGHT, 1), CRYPTONOTE_PRUNING_STRIPE_SIZE);
+  ASSERT_EQ(tools::get_next_pruned_block_height(5, CHAIN_HEIGHT, 2), 5);
+  ASSERT_EQ(tools::get_next_pruned_block_height(CHAIN_HEIGHT - 1, CHAIN_HEIGHT, 2), CHAIN_HEIGHT);
+}
+
+TEST(pruning, support_flags)
+{
+  for (uint32_t s = 0; s <= CRYPTONOTE_PRUNING_NUM_STRIPES; ++s)
+  {
+    const uint32_t flags = P2P_SUPPORT_FLAGS | tools::make_pruning_support_flags(s);
+    ASSERT_EQ(flags & P2P_SUPPORT_FLAGS, P2P_SUPPORT_FLAGS);
+    ASSERT_EQ(tools::get_pruning_stripe_from_support_flags(flags), s);
+  }
+  for (int i = 0; i < 100; ++i)
+  {
+    const uint32_t s = tools::get_random_pruning_stripe();
+    ASSERT_GE(s, 1);
+    ASSERT_LE(s, CRYPTONOTE_PRUNING_NUM_STRIPES);
+  }
+}
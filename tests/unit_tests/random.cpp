@@ -28,6 +28,16 @@
 
 #include "gtest/gtest.h"
 
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #include "crypto/crypto.h"
 
 extern "C" {
@@ -45,3 +55,60 @@ TEST(random32_unbiased, less_than_order)
     ASSERT_EQ(memcmp(tmp, tmp2, 32), 0);
   }
 }
+
+TEST(random_bytes, threads_get_distinct_bytes)
+{
+  boost::mutex lock;
+  std::set<std::string> seen;
+  size_t count = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+  {
+    threads.emplace_back([&]() {
+      std::vector<std::string> outputs;
+      for (int i = 0; i < 1000; ++i)
+      {
+        // odd sizes make requests span the generator's output blocks
+        std::string bytes(1 + i % 47, '\0');
+        crypto::generate_random_bytes_thread_safe(bytes.size(), (uint8_t*)&bytes[0]);
+        if (bytes.size() >= 16)
+          outputs.push_back(bytes);
+      }
+      boost::lock_guard<boost::mutex> guard(lock);
+      count += outputs.size();
+      seen.insert(outputs.begin(), outputs.end());
+    });
+  }
+  for (auto &thread: threads)
+    thread.join();
+  ASSERT_EQ(count, seen.size());
+}
+
+#ifndef _WIN32
+TEST(random_bytes, reseeded_after_fork)
+{
+  uint8_t warmup[8];
+  crypto::generate_random_bytes_thread_safe(sizeof(warmup), warmup);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+  {
+    uint8_t child[32];
+    crypto::generate_random_bytes_thread_safe(sizeof(child), child);
+    ssize_t written = write(fds[1], child, sizeof(child));
+    _exit(written == sizeof(child) ? 0 : 1);
+  }
+
+  uint8_t parent[32], child[32];
+  crypto::generate_random_bytes_thread_safe(sizeof(parent), parent);
+  ASSERT_EQ((ssize_t)sizeof(child), read(fds[0], child, sizeof(child)));
+  int status = 0;
+  waitpid(pid, &status, 0);
+  close(fds[0]);
+  close(fds[1]);
+  ASSERT_NE(0, memcmp(parent, child, sizeof(parent)));
+}
+#endif
@@ -0,0 +1,90 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <string>
+#include <gtest/gtest.h>
+#include "p2p/request_cache.h"
+
+using namespace nodetool;
+
+TEST(request_cache, insert_and_duplicates)
+{
+  request_cache cache(1000);
+
+  ASSERT_TRUE(cache.insert("message1", 0));
+  ASSERT_TRUE(cache.insert("message2", 10));
+  ASSERT_FALSE(cache.insert("message1", 20));
+  ASSERT_TRUE(cache.contains("message2"));
+  ASSERT_FALSE(cache.contains("message3"));
+  ASSERT_EQ(cache.size(), 2u);
+
+  cache.clear();
+
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_FALSE(cache.contains("message1"));
+}
+
+TEST(request_cache, expiration)
+{
+  request_cache cache(1000);
+
+  ASSERT_TRUE(cache.insert("message1", 0));
+
+  cache.expire(999);
+
+  ASSERT_TRUE(cache.contains("message1"));
+
+  ASSERT_TRUE(cache.insert("message2", 1100));
+
+  cache.expire(2000);
+
+  ASSERT_FALSE(cache.contains("message1"));
+  ASSERT_TRUE(cache.contains("message2"));
+
+  cache.expire(10000);
+
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_TRUE(cache.insert("message1", 10000));
+}
+
+TEST(request_cache, overflow)
+{
+  static const size_t BUCKET_CAPACITY = 16;
+
+  request_cache cache(1000, BUCKET_CAPACITY);
+
+  size_t total = BUCKET_CAPACITY * request_cache::BUCKETS_COUNT * 2;
+
+  for (size_t i=0; i<total; i++)
+    ASSERT_TRUE(cache.insert("message" + std::to_string(i), 0));
+
+  ASSERT_LE(cache.size(), BUCKET_CAPACITY * request_cache::BUCKETS_COUNT);
+  ASSERT_TRUE(cache.contains("message" + std::to_string(total - 1)));
+  ASSERT_FALSE(cache.contains("message0"));
+}
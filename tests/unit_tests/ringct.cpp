@@ -33,11 +33,13 @@
 #include <cstdint>
 #include <algorithm>
 #include <sstream>
+#include <boost/thread/thread.hpp>
 
 #include "ringct/rctTypes.h"
 #include "ringct/rctSigs.h"
 #include "ringct/rctOps.h"
 #include "device/device.hpp"
+#include "cryptonote_core/bulletproof_batch_verifier.h"
 
 using namespace std;
 using namespace crypto;
@@ -374,6 +376,40 @@ static rct::rctSig make_sample_simple_rct_sig(int n_inputs, const uint64_t input
     return genRctSimple(rct::zero(), sc, pc, destinations, inamounts, outamounts, amount_keys, NULL, NULL, fee, 3, hw::get_device("default"));
 }
 
+static rct::rctSig make_sample_bulletproof_rct_sig(int n_inputs, const uint64_t input_amounts[], int n_outputs, const uint64_t output_amounts[], uint64_t fee)
+{
+    ctkeyV sc, pc;
+    ctkey sctmp, pctmp;
+    ctkeyM mixRing(n_inputs);
+    std::vector<unsigned int> index(n_inputs, 0);
+    ctkeyV outSk;
+    vector<xmr_amount> inamounts, outamounts;
+    keyV destinations;
+    keyV amount_keys;
+    key Sk, Pk;
+
+    for (int n = 0; n < n_inputs; ++n) {
+        inamounts.push_back(input_amounts[n]);
+        tie(sctmp, pctmp) = ctskpkGen(input_amounts[n]);
+        sc.push_back(sctmp);
+        pc.push_back(pctmp);
+        mixRing[n].push_back(pctmp);
+        for (int m = 0; m < 2; ++m) {
+            tie(sctmp, pctmp) = ctskpkGen(input_amounts[n]);
+            mixRing[n].push_back(pctmp);
+        }
+    }
+
+    for (int n = 0; n < n_outputs; ++n) {
+        outamounts.push_back(output_amounts[n]);
+        amount_keys.push_back(hash_to_scalar(zero()));
+        skpkGen(Sk, Pk);
+        destinations.push_back(Pk);
+    }
+
+    return genRctSimple(rct::zero(), sc, destinations, inamounts, outamounts, fee, mixRing, amount_keys, NULL, NULL, index, outSk, RangeProofPaddedBulletproof, hw::get_device("default"));
+}
+
 static bool range_proof_test(bool expected_valid,
     int n_inputs, const uint64_t input_amounts[], int n_outputs, const uint64_t output_amounts[], bool last_is_fee, bool simple)
 {
@@ -1116,3 +1152,56 @@ TEST(ringct, aggregated)
 
   ASSERT_TRUE(verRctSemanticsSimple(sp));
 }
+
+TEST(ringct, bulletproof_batch_verifier)
+{
+  static const size_t N_SIGS = 6;
+  std::vector<rctSig> s(N_SIGS);
+  std::vector<const rctSig*> sp(N_SIGS);
+
+  for (size_t n = 0; n < N_SIGS; ++n)
+  {
+    static const uint64_t inputs[] = {1000, 1000};
+    static const uint64_t outputs[] = {500, 1500};
+    s[n] = make_sample_bulletproof_rct_sig(NELTS(inputs), inputs, NELTS(outputs), outputs, 0);
+    sp[n] = &s[n];
+  }
+
+  s[1].p.bulletproofs[0].t = rct::skGen();
+  s[4].p.bulletproofs[0].t = rct::skGen();
+
+  std::vector<uint8_t> results(N_SIGS, 2);
+  cryptonote::bulletproof_batch_verifier::verify_range(sp, 0, N_SIGS, results);
+  ASSERT_EQ(results, std::vector<uint8_t>({1, 0, 1, 1, 0, 1}));
+
+  // callers joining the same window get their own results
+  cryptonote::bulletproof_batch_verifier verifier(1000, N_SIGS);
+  std::vector<const rctSig*> sp0(sp.begin(), sp.begin() + 2), sp1(sp.begin() + 2, sp.end());
+  std::vector<uint8_t> results0, results1;
+  boost::thread thread([&]() { verifier.verify(sp0, results0, true); });
+  verifier.verify(sp1, results1, true);
+  thread.join();
+  ASSERT_EQ(results0, std::vector<uint8_t>({1, 0}));
+  ASSERT_EQ(results1, std::vector<uint8_t>({1, 1, 0, 1}));
+}
+
+TEST(ringct, batched_non_semantics)
+{
+  static const size_t N_SIGS = 8;
+  std::vector<rctSig> s(N_SIGS);
+  std::vector<const rctSig*> sp(N_SIGS);
+
+  for (size_t n = 0; n < N_SIGS; ++n)
+  {
+    static const uint64_t inputs[] = {1000, 1000};
+    static const uint64_t outputs[] = {500, 1500};
+    s[n] = make_sample_simple_rct_sig(NELTS(inputs), inputs, NELTS(outputs), outputs, 0);
+    sp[n] = &s[n];
+  }
+
+  ASSERT_TRUE(verRctNonSemanticsSimple(sp));
+
+  // a bad MLSAG in any of the signatures fails the batch
+  s[N_SIGS / 2].p.MGs[1].cc = rct::skGen();
+  ASSERT_FALSE(verRctNonSemanticsSimple(sp));
+}
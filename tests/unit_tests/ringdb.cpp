@@ -136,6 +136,38 @@ TEST(ringdb, different_genesis)
   ASSERT_FALSE(ringdb.get_ring(KEY_2, KEY_IMAGE_1, outs2));
 }
 
+TEST(ringdb, set_rings)
+{
+  RingDB ringdb;
+  const crypto::key_image key_image_2 = generate_key_image();
+  std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> rings;
+  rings.push_back({KEY_IMAGE_1, {43, 7320, 8429}});
+  rings.push_back({key_image_2, {5, 6, 7}});
+  ASSERT_TRUE(ringdb.set_rings(KEY_1, rings, true));
+  std::vector<uint64_t> outs;
+  ASSERT_TRUE(ringdb.get_ring(KEY_1, KEY_IMAGE_1, outs));
+  ASSERT_EQ(outs, std::vector<uint64_t>({43, 43+7320, 43+7320+8429}));
+  ASSERT_TRUE(ringdb.get_ring(KEY_1, key_image_2, outs));
+  ASSERT_EQ(outs, std::vector<uint64_t>({5, 11, 18}));
+  ASSERT_FALSE(ringdb.get_ring(KEY_2, key_image_2, outs));
+}
+
+TEST(ringdb, add_and_remove_rings)
+{
+  RingDB ringdb;
+  cryptonote::transaction_prefix tx;
+  cryptonote::txin_to_key txin;
+  txin.k_image = KEY_IMAGE_1;
+  txin.key_offsets = {43, 7320, 8429};
+  tx.vin.push_back(txin);
+  ASSERT_TRUE(ringdb.add_rings(KEY_1, tx));
+  std::vector<uint64_t> outs;
+  ASSERT_TRUE(ringdb.get_ring(KEY_1, KEY_IMAGE_1, outs));
+  ASSERT_EQ(outs, std::vector<uint64_t>({43, 43+7320, 43+7320+8429}));
+  ASSERT_TRUE(ringdb.remove_rings(KEY_1, tx));
+  ASSERT_FALSE(ringdb.get_ring(KEY_1, KEY_IMAGE_1, outs));
+}
+
 TEST(spent_outputs, not_found)
 {
   RingDB ringdb;
@@ -174,6 +206,25 @@ TEST(spent_outputs, vector)
   ASSERT_TRUE(ringdb.blackballed(std::make_pair(30, 5)));
 }
 
+TEST(spent_outputs, unsorted_vector)
+{
+  RingDB ringdb;
+  ASSERT_TRUE(ringdb.blackball(std::make_pair(10, 8)));
+  std::vector<std::pair<uint64_t, uint64_t>> outputs;
+  outputs.push_back(std::make_pair(30, 5));
+  outputs.push_back(std::make_pair(10, 4));
+  outputs.push_back(std::make_pair(0, 1));
+  outputs.push_back(std::make_pair(10, 4));
+  outputs.push_back(std::make_pair(10, 3));
+  ASSERT_TRUE(ringdb.blackball(outputs));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(0, 1)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(10, 3)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(10, 4)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(10, 8)));
+  ASSERT_TRUE(ringdb.blackballed(std::make_pair(30, 5)));
+  ASSERT_FALSE(ringdb.blackballed(std::make_pair(10, 5)));
+}
+
 TEST(spent_outputs, mark_as_unspent)
 {
   RingDB ringdb;
@@ -0,0 +1,106 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include "rpc/rpc_request_coalescer.h"
+
+using namespace cryptonote;
+
+TEST(rpc_request_coalescer, computes_once_for_concurrent_calls)
+{
+  rpc_request_coalescer coalescer;
+  std::atomic<unsigned> computed(0), started(0);
+  std::atomic<bool> release(false);
+  const unsigned n = 8;
+  std::vector<std::string> responses(n);
+  std::vector<char> shared(n, 0);
+
+  auto compute = [&](std::string& response) {
+    ++computed;
+    while (!release)
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    response = "blocks";
+    return true;
+  };
+
+  std::vector<boost::thread> threads;
+  for (unsigned i = 0; i < n; ++i)
+    threads.emplace_back([&, i]() {
+      bool s = false;
+      ++started;
+      ASSERT_TRUE(coalescer.run("key", compute, responses[i], s));
+      shared[i] = s;
+    });
+  while (started < n)
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+  boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+  release = true;
+  for (auto &t: threads)
+    t.join();
+
+  ASSERT_EQ(1u, computed);
+  for (unsigned i = 0; i < n; ++i)
+    ASSERT_EQ("blocks", responses[i]);
+  ASSERT_EQ(n - 1, (unsigned)std::count(shared.begin(), shared.end(), 1));
+  const rpc_request_coalescer::stats stats = coalescer.get_stats();
+  ASSERT_EQ(1u, stats.computed);
+  ASSERT_EQ(n - 1, stats.shared);
+}
+
+TEST(rpc_request_coalescer, not_kept_after_done)
+{
+  rpc_request_coalescer coalescer;
+  unsigned computed = 0;
+  auto compute = [&](std::string& response) { response = std::to_string(++computed); return true; };
+  std::string response;
+  bool shared = true;
+
+  ASSERT_TRUE(coalescer.run("key", compute, response, shared));
+  ASSERT_FALSE(shared);
+  ASSERT_EQ("1", response);
+  ASSERT_TRUE(coalescer.run("key", compute, response, shared));
+  ASSERT_FALSE(shared);
+  ASSERT_EQ("2", response);
+  ASSERT_TRUE(coalescer.run("other", compute, response, shared));
+  ASSERT_EQ("3", response);
+}
+
+TEST(rpc_request_coalescer, failure_and_exception)
+{
+  rpc_request_coalescer coalescer;
+  std::string response;
+  bool shared;
+
+  ASSERT_FALSE(coalescer.run("key", [](std::string&) { return false; }, response, shared));
+  ASSERT_THROW(coalescer.run("key", [](std::string&) -> bool { throw std::runtime_error("error"); }, response, shared), std::runtime_error);
+  ASSERT_TRUE(coalescer.run("key", [](std::string& r) { r = "ok"; return true; }, response, shared));
+  ASSERT_EQ("ok", response);
+}
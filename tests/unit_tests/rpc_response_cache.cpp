@@ -0,0 +1,155 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+#include <gtest/gtest.h>
+#include "net/http_server_handlers_map2.h"
+#include "rpc/rpc_response_cache.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  struct cache_fixture
+  {
+    uint64_t tip = 1;
+    uint64_t pool = 1;
+    rpc_response_cache cache{[this]() { return tip; }, [this]() { return pool; }, 1 << 20};
+  };
+
+  struct test_result
+  {
+    uint64_t height;
+    std::string status;
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(height)
+      KV_SERIALIZE(status)
+    END_KV_SERIALIZE_MAP()
+  };
+}
+
+TEST(rpc_response_cache, hit_until_tip_changes)
+{
+  cache_fixture f;
+  std::string response;
+  rpc_response_cache::stamp stamp;
+
+  ASSERT_FALSE(f.cache.get("a", rpc_response_cache::same_tip, response, stamp));
+  f.cache.put("a", rpc_response_cache::same_tip, stamp, "response a");
+
+  f.pool = 2;
+  ASSERT_TRUE(f.cache.get("a", rpc_response_cache::same_tip, response, stamp));
+  ASSERT_EQ("response a", response);
+
+  f.tip = 2;
+  ASSERT_FALSE(f.cache.get("a", rpc_response_cache::same_tip, response, stamp));
+  ASSERT_EQ(0u, f.cache.get_stats().entries);
+
+  const rpc_response_cache::stats stats = f.cache.get_stats();
+  ASSERT_EQ(1u, stats.hits);
+  ASSERT_EQ(2u, stats.misses);
+}
+
+TEST(rpc_response_cache, pool_policy)
+{
+  cache_fixture f;
+  std::string response;
+  rpc_response_cache::stamp stamp;
+
+  ASSERT_FALSE(f.cache.get("a", rpc_response_cache::same_tip_and_pool, response, stamp));
+  f.cache.put("a", rpc_response_cache::same_tip_and_pool, stamp, "response a");
+  ASSERT_TRUE(f.cache.get("a", rpc_response_cache::same_tip_and_pool, response, stamp));
+
+  f.pool = 2;
+  ASSERT_FALSE(f.cache.get("a", rpc_response_cache::same_tip_and_pool, response, stamp));
+}
+
+TEST(rpc_response_cache, stale_put_is_dropped)
+{
+  cache_fixture f;
+  std::string response;
+  rpc_response_cache::stamp stamp;
+
+  ASSERT_FALSE(f.cache.get("a", rpc_response_cache::same_tip, response, stamp));
+  f.tip = 2; // a block was added while computing the response
+  f.cache.put("a", rpc_response_cache::same_tip, stamp, "response a");
+  ASSERT_EQ(0u, f.cache.get_stats().entries);
+}
+
+TEST(rpc_response_cache, lru_eviction)
+{
+  cache_fixture f;
+  f.cache.set_max_size(4096);
+  std::string response;
+  rpc_response_cache::stamp stamp;
+  const std::string big(300, 'x');
+
+  for (const char *key: {"a", "b", "c", "d", "e", "f", "g", "h", "i"})
+  {
+    f.cache.get(key, rpc_response_cache::same_tip, response, stamp);
+    f.cache.put(key, rpc_response_cache::same_tip, stamp, big);
+  }
+  ASSERT_LE(f.cache.get_stats().size, 4096u);
+  ASSERT_EQ(9u, f.cache.get_stats().entries);
+
+  // "a" is used again, so "b" is the least recently used one
+  ASSERT_TRUE(f.cache.get("a", rpc_response_cache::same_tip, response, stamp));
+  f.cache.get("j", rpc_response_cache::same_tip, response, stamp);
+  f.cache.put("j", rpc_response_cache::same_tip, stamp, big);
+  ASSERT_TRUE(f.cache.get("a", rpc_response_cache::same_tip, response, stamp));
+  ASSERT_FALSE(f.cache.get("b", rpc_response_cache::same_tip, response, stamp));
+  ASSERT_EQ(1u, f.cache.get_stats().evictions);
+
+  // larger than an eighth of the cache
+  f.cache.get("k", rpc_response_cache::same_tip, response, stamp);
+  f.cache.put("k", rpc_response_cache::same_tip, stamp, std::string(1024, 'x'));
+  ASSERT_FALSE(f.cache.get("k", rpc_response_cache::same_tip, response, stamp));
+
+  f.cache.set_max_size(0);
+  ASSERT_EQ(0u, f.cache.get_stats().entries);
+  f.cache.put("l", rpc_response_cache::same_tip, stamp, big);
+  ASSERT_FALSE(f.cache.get("l", rpc_response_cache::same_tip, response, stamp));
+}
+
+TEST(rpc_response_cache, json_rpc_frame)
+{
+  epee::json_rpc::response<test_result, epee::json_rpc::dummy_error> resp;
+  resp.jsonrpc = "2.0";
+  resp.id = epee::serialization::storage_entry(std::string("42"));
+  resp.result.height = 10;
+  resp.result.status = "OK";
+
+  std::string head, tail;
+  epee::json_rpc::get_response_json_frame(resp.id, head, tail);
+  const std::string framed = head + epee::serialization::store_t_to_json(resp.result, 1) + tail;
+  ASSERT_EQ(epee::serialization::store_t_to_json(resp), framed);
+
+  std::string streamed;
+  ASSERT_TRUE(epee::serialization::store_t_to_json_stream(resp.result, [&](std::string&& part) { streamed += part; return true; }, 1));
+  ASSERT_EQ(epee::serialization::store_t_to_json(resp.result, 1), streamed);
+}
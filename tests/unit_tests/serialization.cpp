@@ -138,11 +138,11 @@ TEST(Serialization, BinaryArchiveInts) {
   ASSERT_EQ(8, oss.str().size());
   ASSERT_EQ(string("\0\0\0\0\xff\0\0\0", 8), oss.str());
 
-  istringstream iss(oss.str());
-  binary_archive<false> iar(iss);
+  const string blob = oss.str();
+  binary_archive<false> iar{epee::strspan<std::uint8_t>(blob)};
   iar.serialize_int(x1);
-  ASSERT_EQ(8, iss.tellg());
-  ASSERT_TRUE(iss.good());
+  ASSERT_EQ(0, iar.remaining_bytes());
+  ASSERT_TRUE(iar.good());
 
   ASSERT_EQ(x, x1);
 }
@@ -157,11 +157,18 @@ TEST(Serialization, BinaryArchiveVarInts) {
   ASSERT_EQ(6, oss.str().size());
   ASSERT_EQ(string("\x80\x80\x80\x80\xF0\x1F", 6), oss.str());
 
-  istringstream iss(oss.str());
-  binary_archive<false> iar(iss);
+  const string blob = oss.str();
+  binary_archive<false> iar{epee::strspan<std::uint8_t>(blob)};
   iar.serialize_varint(x1);
-  ASSERT_TRUE(iss.good());
+  ASSERT_TRUE(iar.good());
   ASSERT_EQ(x, x1);
+
+  // a varint cut short fails the archive instead of reading past the blob
+  const string truncated = blob.substr(0, blob.size() - 1);
+  binary_archive<false> tar{epee::strspan<std::uint8_t>(truncated)};
+  tar.serialize_varint(x1);
+  ASSERT_FALSE(tar.good());
+  ASSERT_EQ(0, tar.remaining_bytes());
 }
 
 TEST(Serialization, Test1) {
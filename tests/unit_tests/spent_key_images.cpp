@@ -0,0 +1,105 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <gtest/gtest.h>
+
+#include "cryptonote_core/spent_key_images.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+crypto::key_image make_key_image(unsigned char value)
+{
+  crypto::key_image result;
+  memset(&result, 0, sizeof(result));
+  result.data[0] = value;
+  return result;
+}
+
+crypto::hash make_hash(unsigned char value)
+{
+  crypto::hash result = crypto::null_hash;
+  result.data[0] = value;
+  return result;
+}
+
+}
+
+TEST(spent_key_images, insert_and_erase)
+{
+  spent_key_images images;
+
+  ASSERT_TRUE(images.insert(make_key_image(1), make_hash(1), false));
+  ASSERT_TRUE(images.insert(make_key_image(2), make_hash(1), false));
+  ASSERT_TRUE(images.contains(make_key_image(1)));
+  ASSERT_FALSE(images.contains(make_key_image(3)));
+  ASSERT_EQ(images.size(), 2u);
+
+  ASSERT_FALSE(images.erase(make_key_image(1), make_hash(2)));
+  ASSERT_TRUE(images.erase(make_key_image(1), make_hash(1)));
+  ASSERT_FALSE(images.contains(make_key_image(1)));
+  ASSERT_EQ(images.size(), 1u);
+
+  images.clear();
+
+  ASSERT_EQ(images.size(), 0u);
+}
+
+TEST(spent_key_images, double_spend)
+{
+  spent_key_images images;
+
+  ASSERT_TRUE(images.insert(make_key_image(1), make_hash(1), false));
+  ASSERT_FALSE(images.insert(make_key_image(1), make_hash(2), false));
+  ASSERT_TRUE(images.insert(make_key_image(1), make_hash(2), true));
+  ASSERT_FALSE(images.insert(make_key_image(1), make_hash(2), true));
+
+  ASSERT_EQ(images.get_tx_ids(make_key_image(1)).size(), 2u);
+  ASSERT_TRUE(images.get_tx_ids(make_key_image(2)).empty());
+
+  ASSERT_TRUE(images.erase(make_key_image(1), make_hash(1)));
+  ASSERT_TRUE(images.contains(make_key_image(1)));
+  ASSERT_TRUE(images.erase(make_key_image(1), make_hash(2)));
+  ASSERT_FALSE(images.contains(make_key_image(1)));
+}
+
+TEST(spent_key_images, get_all)
+{
+  spent_key_images images;
+
+  for (unsigned char i=0; i<100; i++)
+    ASSERT_TRUE(images.insert(make_key_image(i), make_hash(i), false));
+
+  spent_key_images::key_images_container all = images.get_all();
+
+  ASSERT_EQ(all.size(), 100u);
+  ASSERT_EQ(all[make_key_image(42)].count(make_hash(42)), 1u);
+}
@@ -0,0 +1,211 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <map>
+#include <random>
+#include <tuple>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include "cryptonote_core/stake_transaction_storage.h"
+#include "graft_rta_config.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+typedef std::map<std::string, std::tuple<uint64_t, unsigned int, uint64_t, uint64_t>> stakes_map;
+
+stakes_map to_map(const StakeTransactionStorage::supernode_stake_array& stakes)
+{
+  stakes_map result;
+
+  for (const supernode_stake& stake : stakes)
+    result[stake.supernode_public_id] = std::make_tuple(stake.amount, stake.tier, stake.block_height, stake.unlock_time);
+
+  return result;
+}
+
+}
+
+TEST(StakeTransactionStorage, incremental_update_matches_rebuild)
+{
+  std::mt19937_64 rng(42);
+
+  StakeTransactionStorage incremental("non-existing-stake-transactions.bin", 0),
+                          full("non-existing-stake-transactions.bin", 0);
+
+  for (uint64_t height=config::graft::SUPERNODE_HISTORY_SIZE / 2; height<1000; height++)
+  {
+    for (size_t i=0, count=rng() % 3; i<count; i++)
+    {
+      stake_transaction tx = {};
+
+      tx.amount              = (rng() % 300000) * COIN;
+      tx.block_height        = height;
+      tx.unlock_time         = config::graft::STAKE_MIN_UNLOCK_TIME + rng() % 100;
+      tx.supernode_public_id = std::to_string(rng() % 20);
+
+      incremental.add_tx(tx);
+      full.add_tx(tx);
+    }
+
+    full.clear_supernode_stakes();
+
+    const StakeTransactionStorage::supernode_stake_array& incremental_stakes = incremental.get_supernode_stakes(height);
+    const StakeTransactionStorage::supernode_stake_array& full_stakes        = full.get_supernode_stakes(height);
+
+    ASSERT_EQ(incremental_stakes.size(), full_stakes.size());
+    ASSERT_EQ(to_map(incremental_stakes), to_map(full_stakes));
+
+    for (const supernode_stake& stake : full_stakes)
+    {
+      const supernode_stake* found_stake = incremental.find_supernode_stake(height, stake.supernode_public_id);
+
+      ASSERT_TRUE(found_stake != nullptr);
+      ASSERT_EQ(found_stake->amount, stake.amount);
+    }
+  }
+}
+
+TEST(StakeTransactionStorage, stakes_history_matches_rebuild)
+{
+  std::mt19937_64 rng(7);
+
+  StakeTransactionStorage incremental("non-existing-stake-transactions.bin", 0);
+  std::vector<stake_transaction> txs;
+
+  const uint64_t top_height = 4 * config::graft::SUPERNODE_HISTORY_SIZE;
+
+  for (uint64_t height=config::graft::SUPERNODE_HISTORY_SIZE / 2; height<=top_height; height++)
+  {
+    for (size_t i=0, count=rng() % 3; i<count; i++)
+    {
+      stake_transaction tx = {};
+
+      tx.amount              = (rng() % 300000) * COIN;
+      tx.block_height        = height;
+      tx.unlock_time         = config::graft::STAKE_MIN_UNLOCK_TIME + rng() % 100;
+      tx.supernode_public_id = std::to_string(rng() % 20);
+
+      incremental.add_tx(tx);
+      txs.push_back(tx);
+    }
+
+    incremental.update_supernode_stakes(height);
+  }
+
+    //alternate between past blocks of the window and the top block
+
+  for (uint64_t height=top_height - config::graft::SUPERNODE_HISTORY_SIZE; height<top_height; height+=7)
+  {
+    ASSERT_TRUE(incremental.is_in_stakes_history(height));
+
+    StakeTransactionStorage full("non-existing-stake-transactions.bin", 0);
+
+    for (const stake_transaction& tx : txs)
+      if (tx.block_height <= height)
+        full.add_tx(tx);
+
+    const StakeTransactionStorage::supernode_stake_array& historical_stakes = incremental.get_supernode_stakes(height);
+    const StakeTransactionStorage::supernode_stake_array& full_stakes       = full.get_supernode_stakes(height);
+
+    ASSERT_EQ(to_map(historical_stakes), to_map(full_stakes));
+
+    for (const supernode_stake& stake : full_stakes)
+    {
+      const supernode_stake* found_stake = incremental.find_supernode_stake(height, stake.supernode_public_id);
+
+      ASSERT_TRUE(found_stake != nullptr);
+      ASSERT_EQ(found_stake->amount, stake.amount);
+      ASSERT_GE(found_stake, historical_stakes.data());
+      ASSERT_LT(found_stake, historical_stakes.data() + historical_stakes.size());
+    }
+
+    const supernode_stake* top_stake = incremental.find_supernode_stake(top_height, full_stakes.empty() ? std::string() : full_stakes.front().supernode_public_id);
+    const StakeTransactionStorage::supernode_stake_array& top_stakes = incremental.get_supernode_stakes(top_height);
+
+    ASSERT_FALSE(incremental.is_in_stakes_history(top_height));
+    ASSERT_TRUE(!top_stake || (top_stake >= top_stakes.data() && top_stake < top_stakes.data() + top_stakes.size()));
+  }
+
+  ASSERT_FALSE(incremental.is_in_stakes_history(top_height - config::graft::SUPERNODE_HISTORY_SIZE - 1));
+}
+
+TEST(StakeTransactionStorage, journal_replay)
+{
+  boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  boost::filesystem::create_directories(dir);
+
+  const std::string file_name = (dir / "stake_transactions.bin").string();
+
+  {
+    StakeTransactionStorage storage(file_name, 0);
+
+    for (uint64_t height=1; height<=10; height++)
+    {
+      stake_transaction tx = {};
+
+      tx.amount              = height * COIN;
+      tx.block_height        = height;
+      tx.unlock_time         = config::graft::STAKE_MIN_UNLOCK_TIME;
+      tx.supernode_public_id = std::to_string(height);
+
+      storage.add_tx(tx);
+      storage.add_last_processed_block(height, crypto::null_hash);
+      storage.store();
+    }
+
+    storage.remove_last_processed_block();
+    storage.store();
+  }
+
+  {
+    StakeTransactionStorage storage(file_name, 0);
+
+    ASSERT_EQ(storage.get_last_processed_block_index(), 9);
+    ASSERT_EQ(storage.get_tx_count(), 9);
+  }
+
+    //partially written record at the end of the journal is dropped
+
+  {
+    std::ofstream ostr(file_name + ".journal", std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+    ostr << "garbage";
+  }
+
+  {
+    StakeTransactionStorage storage(file_name, 0);
+
+    ASSERT_EQ(storage.get_last_processed_block_index(), 9);
+    ASSERT_EQ(storage.get_tx_count(), 9);
+  }
+
+  boost::filesystem::remove_all(dir);
+}
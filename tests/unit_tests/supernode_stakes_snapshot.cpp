@@ -0,0 +1,100 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <gtest/gtest.h>
+#include "cryptonote_core/stake_transaction_processor.h"
+#include "crypto/crypto.h"
+#include "graft_rta_config.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+supernode_stake make_stake(const crypto::public_key& key, uint64_t amount)
+{
+  supernode_stake stake = {};
+
+  stake.amount              = amount;
+  stake.supernode_public_id = epee::string_tools::pod_to_hex(key);
+
+  return stake;
+}
+
+}
+
+TEST(supernode_stakes_snapshot, find_by_public_key)
+{
+  supernode_stakes_snapshot snapshot;
+  std::vector<crypto::public_key> keys;
+
+  for (size_t i=0; i<100; i++)
+  {
+    crypto::public_key key;
+    crypto::secret_key secret_key;
+
+    crypto::generate_keys(key, secret_key);
+    keys.push_back(key);
+    snapshot.stakes.push_back(make_stake(key, i % 3 ? config::graft::TIER1_STAKE_AMOUNT : config::graft::TIER1_STAKE_AMOUNT - 1));
+  }
+
+  supernode_stake invalid_id_stake = {};
+  invalid_id_stake.amount              = config::graft::TIER1_STAKE_AMOUNT;
+  invalid_id_stake.supernode_public_id = "not a key";
+  snapshot.stakes.push_back(invalid_id_stake);
+
+  snapshot.build_indexes();
+
+  for (size_t i=0; i<keys.size(); i++)
+  {
+    const supernode_stake* stake = snapshot.find_supernode_stake(keys[i]);
+
+    ASSERT_NE(nullptr, stake);
+    EXPECT_EQ(&snapshot.stakes[i], stake);
+    EXPECT_EQ(stake, snapshot.find_supernode_stake(stake->supernode_public_id));
+    EXPECT_EQ(i % 3 != 0, snapshot.is_valid_supernode(keys[i]));
+  }
+
+  crypto::public_key unknown_key;
+  crypto::secret_key secret_key;
+  crypto::generate_keys(unknown_key, secret_key);
+
+  EXPECT_EQ(nullptr, snapshot.find_supernode_stake(unknown_key));
+  EXPECT_FALSE(snapshot.is_valid_supernode(unknown_key));
+  EXPECT_NE(nullptr, snapshot.find_supernode_stake(std::string("not a key")));
+}
+
+TEST(supernode_stakes_snapshot, empty)
+{
+  supernode_stakes_snapshot snapshot;
+
+  snapshot.build_indexes();
+
+  EXPECT_EQ(nullptr, snapshot.find_supernode_stake(crypto::null_pkey));
+  EXPECT_FALSE(snapshot.is_valid_supernode(crypto::null_pkey));
+}
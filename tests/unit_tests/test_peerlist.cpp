@@ -28,6 +28,7 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <boost/serialization/map.hpp>
 #include "gtest/gtest.h"
 
 #include "common/util.h"
@@ -83,3 +84,147 @@ TEST(peer_list, merge_peer_lists)
 
 
 }
+
+TEST(peer_list, peer_quality)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  const epee::net_utils::network_address white = MAKE_IPV4_ADDRESS(123,43,12,1, 8080);
+  const epee::net_utils::network_address gray = MAKE_IPV4_ADDRESS(123,43,12,2, 8080);
+  ADD_WHITE_NODE(white, 121241, 34345);
+  ADD_GRAY_NODE(gray, 121242, 34345);
+
+  // only peers we connected to are measured
+  ASSERT_FALSE(plm.add_peer_rtt(gray, 100));
+  nodetool::peer_quality pq;
+  ASSERT_FALSE(plm.get_peer_quality(gray, pq));
+
+  ASSERT_TRUE(plm.add_peer_rtt(white, 100));
+  ASSERT_TRUE(plm.add_peer_rtt(white, 500));
+  ASSERT_TRUE(plm.add_peer_throughput(white, 1000000));
+  ASSERT_TRUE(plm.add_peer_block_delay(white, 0));
+  ASSERT_TRUE(plm.get_peer_quality(white, pq));
+  ASSERT_EQ(pq.rtt_samples, 2);
+  ASSERT_EQ(pq.rtt_ms, 200);
+  ASSERT_EQ(pq.throughput_samples, 1);
+  ASSERT_EQ(pq.throughput, 1000000);
+  ASSERT_EQ(pq.block_delay_samples, 1);
+  ASSERT_EQ(pq.block_delay_ms, 0);
+
+  std::vector<std::pair<nodetool::peerlist_entry, nodetool::peer_quality>> peers;
+  ASSERT_TRUE(plm.get_white_peers_with_quality(peers));
+  ASSERT_EQ(peers.size(), 1);
+  ASSERT_EQ(peers[0].first.adr, white);
+  ASSERT_EQ(peers[0].second.rtt_ms, 200);
+
+  // the measurements are kept with the peerlist
+  std::stringstream ss;
+  {
+    boost::archive::portable_binary_oarchive a(ss);
+    a << plm;
+  }
+  nodetool::peerlist_manager loaded;
+  loaded.init(false);
+  {
+    boost::archive::portable_binary_iarchive a(ss);
+    a >> loaded;
+  }
+  ASSERT_TRUE(loaded.get_peer_quality(white, pq));
+  ASSERT_EQ(pq.rtt_samples, 2);
+  ASSERT_EQ(pq.rtt_ms, 200);
+  ASSERT_EQ(pq.throughput, 1000000);
+  ASSERT_EQ(pq.block_delay_samples, 1);
+}
+
+TEST(peer_list, peerlist_head_since)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,1, 8080), 121241, 1000);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,2, 8080), 121242, 2000);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,3, 8080), 121243, 3000);
+
+  std::list<nodetool::peerlist_entry> bs_head;
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100));
+  ASSERT_EQ(bs_head.size(), 3);
+
+  // only the peers seen at or after the given time
+  bs_head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 2000));
+  ASSERT_EQ(bs_head.size(), 2);
+  ASSERT_EQ(bs_head.front().last_seen, 3000);
+  ASSERT_EQ(bs_head.back().last_seen, 2000);
+
+  bs_head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 3001));
+  ASSERT_TRUE(bs_head.empty());
+}
+
+TEST(peer_list, merge_keeps_newest)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  const epee::net_utils::network_address addr = MAKE_IPV4_ADDRESS(123,43,12,1, 8080);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,2, 8080), 121242, 1000);
+
+  std::list<nodetool::peerlist_entry> outer_bs;
+  nodetool::peerlist_entry ple;
+  ple.adr = addr;
+  ple.id = 121241;
+  ple.last_seen = 2000;
+  outer_bs.push_back(ple);
+  ple.adr = MAKE_IPV4_ADDRESS(123,43,12,2, 8080);
+  outer_bs.push_back(ple);
+  ASSERT_TRUE(plm.merge_peerlist(outer_bs));
+  // white peers are not added to the gray list
+  ASSERT_EQ(plm.get_gray_peers_count(), 1);
+
+  // an older record does not replace the one we have
+  outer_bs.clear();
+  ple.adr = addr;
+  ple.last_seen = 1500;
+  outer_bs.push_back(ple);
+  ASSERT_TRUE(plm.merge_peerlist(outer_bs));
+  ASSERT_TRUE(plm.get_gray_peer_by_index(ple, 0));
+  ASSERT_EQ(ple.last_seen, 2000);
+}
+
+TEST(peer_list, supernode_route_serialization)
+{
+  std::map<std::string, nodetool::supernode_route> routes;
+  nodetool::supernode_route &route = routes["supernode"];
+  route.last_announce_height = 1000;
+  route.last_announce_time = 123456;
+  route.max_hop = 3;
+  nodetool::peerlist_entry ple;
+  ple.adr = MAKE_IPV4_ADDRESS(123,43,12,1, 8080);
+  ple.id = 121241;
+  ple.last_seen = 2000;
+  route.peers.push_back(ple);
+  route.peer_hops.push_back(1);
+  ple.adr = MAKE_IPV4_ADDRESS(123,43,12,2, 8080);
+  ple.id = 121242;
+  route.peers.push_back(ple);
+  route.peer_hops.push_back(3);
+
+  std::stringstream ss;
+  {
+    boost::archive::portable_binary_oarchive a(ss);
+    a << routes;
+  }
+  std::map<std::string, nodetool::supernode_route> loaded;
+  {
+    boost::archive::portable_binary_iarchive a(ss);
+    a >> loaded;
+  }
+  ASSERT_EQ(loaded.size(), 1);
+  const nodetool::supernode_route &r = loaded["supernode"];
+  ASSERT_EQ(r.last_announce_height, 1000);
+  ASSERT_EQ(r.last_announce_time, 123456);
+  ASSERT_EQ(r.max_hop, 3);
+  ASSERT_EQ(r.peers.size(), 2);
+  ASSERT_EQ(r.peers[1].adr, ple.adr);
+  ASSERT_EQ(r.peers[1].id, 121242);
+  ASSERT_EQ(r.peer_hops.size(), 2);
+  ASSERT_EQ(r.peer_hops[1], 3);
+}
@@ -53,3 +53,105 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+TEST(protocol_pack, direct_binary_matches_portable_storage)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+  r.current_blockchain_height = 12345;
+  r.txs = {"tx0", std::string(300, 'x')};
+  for (size_t i = 0; i < 3; ++i)
+  {
+    cryptonote::block_complete_entry bce;
+    bce.block = std::string(70000 * i + 1, 'b');
+    bce.txs.assign(i, std::string(i + 1, 't'));
+    r.blocks.push_back(bce);
+  }
+  r.missed_ids.resize(2, crypto::null_hash);
+
+  epee::serialization::portable_storage ps;
+  std::string tree_buff, direct_buff;
+  r.store(ps);
+  ASSERT_TRUE(ps.store_to_binary(tree_buff));
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, direct_buff));
+  ASSERT_EQ(tree_buff, direct_buff);
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, direct_buff));
+  ASSERT_EQ(r2.current_blockchain_height, 12345);
+  ASSERT_EQ(r2.txs, r.txs);
+  ASSERT_EQ(r2.blocks.size(), 3u);
+  ASSERT_EQ(r2.blocks[2].block, r.blocks[2].block);
+  ASSERT_EQ(r2.blocks[2].txs, r.blocks[2].txs);
+  ASSERT_EQ(r2.missed_ids.size(), 2u);
+}
+
+TEST(protocol_pack, direct_binary_rejects_what_portable_storage_rejects)
+{
+  cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request r;
+  r.start_height = 1;
+  r.total_height = 3;
+  r.m_block_ids.resize(4, crypto::null_hash);
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+
+  for (size_t size = 0; size < buff.size(); ++size)
+  {
+    const std::string truncated = buff.substr(0, size);
+    epee::serialization::portable_storage ps;
+    epee::serialization::direct_binary_reader reader;
+    ASSERT_EQ(ps.load_from_binary(truncated), reader.load_from_binary(truncated));
+  }
+
+  // a section where the struct has a number can't be converted by either
+  epee::serialization::portable_storage ps;
+  ps.open_section("start_height", nullptr, true);
+  ASSERT_TRUE(ps.store_to_binary(buff));
+  cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request r2;
+  ASSERT_FALSE(r2.load(ps));
+  ASSERT_FALSE(epee::serialization::load_t_from_binary(r2, buff));
+}
+
+namespace
+{
+  struct json_stream_entry
+  {
+    std::string name;
+    std::vector<uint64_t> values;
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(values)
+    END_KV_SERIALIZE_MAP()
+  };
+  struct json_stream_struct
+  {
+    std::vector<json_stream_entry> entries;
+    json_stream_entry last;
+    std::string status;
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(entries)
+      KV_SERIALIZE(last)
+      KV_SERIALIZE(status)
+    END_KV_SERIALIZE_MAP()
+  };
+}
+
+TEST(protocol_pack, json_stream_matches_portable_storage)
+{
+  json_stream_struct s;
+  s.status = "OK \"quoted\"";
+  for (uint64_t i = 0; i < 2000; ++i)
+    s.entries.push_back({std::string(i % 100, 'n'), {i, i * i}});
+  s.last.name = "last";
+
+  std::string tree, streamed;
+  size_t pieces = 0;
+  ASSERT_TRUE(epee::serialization::store_t_to_json(s, tree));
+  ASSERT_TRUE(epee::serialization::store_t_to_json_stream(s, [&](std::string &&piece) { streamed += piece; ++pieces; return true; }));
+  // the fields are declared in name order, which is the order the tree writes them in
+  ASSERT_EQ(tree, streamed);
+  ASSERT_GT(pieces, 1u);
+
+  size_t calls = 0;
+  ASSERT_FALSE(epee::serialization::store_t_to_json_stream(s, [&](std::string &&piece) { return ++calls < 2; }));
+  ASSERT_EQ(calls, 2u);
+}
@@ -327,3 +327,32 @@ TEST(parse_tx_extra, handles_rta_signatures)
     }
 }
 
+TEST(parse_and_validate_tx_from_blob, uses_known_tx_hash)
+{
+    cryptonote::transaction tx;
+    tx.version = 1;
+    tx.unlock_time = 123;
+    const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+    const crypto::hash real_hash = cryptonote::get_transaction_hash(tx);
+
+    cryptonote::transaction parsed;
+    ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(blob, parsed));
+    ASSERT_FALSE(parsed.is_hash_valid());
+    ASSERT_EQ(cryptonote::get_transaction_hash(parsed), real_hash);
+
+    // the known hash is taken as is, so a fake one shows it's not recomputed
+    crypto::hash known_hash = crypto::null_hash;
+    known_hash.data[0] = 1;
+    ASSERT_TRUE(cryptonote::parse_and_validate_tx_from_blob(blob, parsed, known_hash));
+    ASSERT_TRUE(parsed.is_hash_valid());
+    ASSERT_TRUE(parsed.is_blob_size_valid());
+    ASSERT_EQ(parsed.blob_size, blob.size());
+    ASSERT_EQ(cryptonote::get_transaction_hash(parsed), known_hash);
+
+    // copies keep the cached hash
+    cryptonote::transaction copy(parsed);
+    ASSERT_TRUE(copy.is_hash_valid());
+    ASSERT_EQ(cryptonote::get_transaction_hash(copy), known_hash);
+
+    ASSERT_FALSE(cryptonote::parse_and_validate_tx_from_blob(cryptonote::blobdata(), parsed, known_hash));
+}
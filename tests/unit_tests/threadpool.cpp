@@ -144,3 +144,52 @@ TEST(threadpool, leaf_reentrancy)
   waiter.wait(tpool.get());
   ASSERT_EQ(counter, 500000);
 }
+
+TEST(threadpool, batch)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(4));
+  tools::threadpool::waiter waiter;
+
+  std::atomic<unsigned int> counter(0);
+  std::vector<std::function<void()>> tasks(1000, [&counter](){ ++counter; });
+  tpool->submit(&waiter, std::move(tasks), true);
+  waiter.wait(tpool.get());
+  ASSERT_EQ(counter, 1000);
+
+  const tools::threadpool::stats stats = tpool->get_stats();
+  ASSERT_EQ(stats.submitted, 1000);
+  ASSERT_EQ(stats.executed, 1000);
+  ASSERT_EQ(stats.queued, 0);
+}
+
+TEST(threadpool, high_priority_first)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(1));
+  tools::threadpool::waiter waiter;
+
+  std::vector<int> order;
+  tpool->submit(&waiter, [&order](){ order.push_back(0); });
+  tpool->submit(&waiter, [&order](){ order.push_back(1); });
+  tpool->submit(&waiter, [&order](){ order.push_back(2); }, false, tools::threadpool::PRIORITY_HIGH);
+  waiter.wait(tpool.get());
+  ASSERT_EQ(order, std::vector<int>({2, 0, 1}));
+}
+
+TEST(threadpool, nested_leaf_batches)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(8));
+  tools::threadpool::waiter waiter;
+
+  std::atomic<int> counter(0);
+  for (int i = 0; i < 100; ++i)
+  {
+    tpool->submit(&waiter, [&](){
+      tools::threadpool::waiter waiter;
+      std::vector<std::function<void()>> tasks(100, [&counter](){ ++counter; });
+      tpool->submit(&waiter, std::move(tasks), true);
+      waiter.wait(tpool.get());
+    });
+  }
+  waiter.wait(tpool.get());
+  ASSERT_EQ(counter, 10000);
+}
@@ -0,0 +1,171 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <sstream>
+#include <thread>
+#include "gtest/gtest.h"
+#include "common/trace.h"
+
+namespace
+{
+  std::vector<tools::trace::event> events_named(const char *name)
+  {
+    std::vector<tools::trace::event> events;
+    for (const auto &e: tools::trace::get_events())
+      if (std::string(e.name) == name)
+        events.push_back(e);
+    return events;
+  }
+
+  const tools::trace::histogram *histogram_named(const std::vector<tools::trace::histogram> &histograms, const char *name)
+  {
+    for (const auto &h: histograms)
+      if (h.name == name)
+        return &h;
+    return NULL;
+  }
+}
+
+TEST(trace, disabled_records_nothing)
+{
+  tools::trace::enable(false);
+  tools::trace::clear();
+  {
+    TRACE_SPAN("test.disabled");
+    ASSERT_EQ(tools::trace::current_span(), 0);
+  }
+  ASSERT_TRUE(events_named("test.disabled").empty());
+  ASSERT_EQ(histogram_named(tools::trace::get_histograms(), "test.disabled"), nullptr);
+}
+
+TEST(trace, nested_spans)
+{
+  tools::trace::enable(true);
+  tools::trace::clear();
+  uint64_t outer_id, inner_id;
+  {
+    TRACE_SPAN("test.outer");
+    outer_id = tools::trace::current_span();
+    ASSERT_NE(outer_id, 0);
+    {
+      TRACE_SPAN("test.inner");
+      inner_id = tools::trace::current_span();
+      ASSERT_NE(inner_id, outer_id);
+    }
+    ASSERT_EQ(tools::trace::current_span(), outer_id);
+  }
+  ASSERT_EQ(tools::trace::current_span(), 0);
+  tools::trace::enable(false);
+
+  const auto outer = events_named("test.outer");
+  const auto inner = events_named("test.inner");
+  ASSERT_EQ(outer.size(), 1);
+  ASSERT_EQ(inner.size(), 1);
+  ASSERT_EQ(outer[0].span_id, outer_id);
+  ASSERT_EQ(outer[0].parent_id, 0);
+  ASSERT_EQ(inner[0].span_id, inner_id);
+  ASSERT_EQ(inner[0].parent_id, outer_id);
+  ASSERT_LE(outer[0].start_ns, inner[0].start_ns);
+  ASSERT_GE(outer[0].start_ns + outer[0].duration_ns, inner[0].start_ns + inner[0].duration_ns);
+}
+
+TEST(trace, cross_thread_parent)
+{
+  tools::trace::enable(true);
+  tools::trace::clear();
+  {
+    TRACE_SPAN("test.submitter");
+    const uint64_t parent = tools::trace::current_span();
+    std::thread t([parent]() { tools::trace::span s("test.task", parent); });
+    t.join();
+  }
+  tools::trace::enable(false);
+
+  const auto submitter = events_named("test.submitter");
+  const auto task = events_named("test.task");
+  ASSERT_EQ(submitter.size(), 1);
+  ASSERT_EQ(task.size(), 1);
+  ASSERT_EQ(task[0].parent_id, submitter[0].span_id);
+  ASSERT_NE(task[0].thread, submitter[0].thread);
+}
+
+TEST(trace, histograms)
+{
+  tools::trace::enable(true);
+  tools::trace::clear();
+  for (int i = 0; i < 100; ++i)
+    TRACE_SPAN("test.histogram");
+  std::thread t([]() { for (int i = 0; i < 50; ++i) TRACE_SPAN("test.histogram"); });
+  t.join();
+  tools::trace::enable(false);
+
+  const auto histograms = tools::trace::get_histograms();
+  const tools::trace::histogram *h = histogram_named(histograms, "test.histogram");
+  ASSERT_NE(h, nullptr);
+  ASSERT_EQ(h->count, 150);
+  uint64_t bucketed = 0;
+  for (size_t i = 0; i < tools::trace::histogram::BUCKETS; ++i)
+    bucketed += h->buckets[i];
+  ASSERT_EQ(bucketed, 150);
+  ASSERT_LE(h->percentile_ns(0.5), h->percentile_ns(0.99));
+  ASSERT_LE(h->percentile_ns(0.99), h->max_ns);
+}
+
+TEST(trace, ring_keeps_latest)
+{
+  tools::trace::enable(true);
+  tools::trace::clear();
+  for (int i = 0; i < 100000; ++i)
+    TRACE_SPAN("test.ring");
+  tools::trace::enable(false);
+
+  const auto events = events_named("test.ring");
+  ASSERT_FALSE(events.empty());
+  ASSERT_LT(events.size(), 100000);
+  for (size_t i = 1; i < events.size(); ++i)
+    ASSERT_GT(events[i].span_id, events[i - 1].span_id);
+  ASSERT_EQ(histogram_named(tools::trace::get_histograms(), "test.ring")->count, 100000);
+}
+
+TEST(trace, chrome_trace)
+{
+  tools::trace::enable(true);
+  tools::trace::clear();
+  {
+    TRACE_SPAN("test.\"quoted\"");
+  }
+  tools::trace::enable(false);
+
+  std::stringstream ss;
+  ASSERT_EQ(tools::trace::write_chrome_trace(ss), 1);
+  const std::string json = ss.str();
+  ASSERT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0);
+  ASSERT_NE(json.find("\"ph\":\"X\""), std::string::npos);
+  ASSERT_NE(json.find("\"name\":\"test.\\\"quoted\\\"\""), std::string::npos);
+  ASSERT_NE(json.find("\"parent\":0"), std::string::npos);
+}
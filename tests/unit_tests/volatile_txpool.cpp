@@ -0,0 +1,110 @@
+// Copyright (c) 2020, The Graft Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/volatile_txpool.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+crypto::hash make_txid(int i)
+{
+  crypto::hash h = crypto::null_hash;
+  h.data[0] = (char)i;
+  return h;
+}
+
+txpool_tx_meta_t make_meta(uint64_t fee, bool do_not_relay)
+{
+  txpool_tx_meta_t meta;
+  memset(&meta, 0, sizeof(meta));
+  meta.fee          = fee;
+  meta.do_not_relay = do_not_relay;
+  return meta;
+}
+
+}
+
+TEST(volatile_txpool, add_get_remove)
+{
+  volatile_txpool pool;
+
+  pool.add_tx(make_txid(1), make_meta(10, false), "blob1");
+  pool.add_tx(make_txid(2), make_meta(20, true), "blob2");
+
+  EXPECT_THROW(pool.add_tx(make_txid(1), make_meta(10, false), "blob1"), DB_ERROR);
+  EXPECT_EQ(2u, pool.get_tx_count());
+  EXPECT_EQ(1u, pool.get_tx_count(false));
+  EXPECT_TRUE(pool.has_tx(make_txid(2)));
+
+  txpool_tx_meta_t meta;
+  cryptonote::blobdata bd;
+  ASSERT_TRUE(pool.get_tx_meta(make_txid(2), meta));
+  EXPECT_EQ(20u, meta.fee);
+  ASSERT_TRUE(pool.get_tx_blob(make_txid(2), bd));
+  EXPECT_EQ("blob2", bd);
+
+  pool.update_tx(make_txid(2), make_meta(30, false));
+  ASSERT_TRUE(pool.get_tx_meta(make_txid(2), meta));
+  EXPECT_EQ(30u, meta.fee);
+  EXPECT_EQ(2u, pool.get_tx_count(false));
+  EXPECT_THROW(pool.update_tx(make_txid(3), meta), DB_ERROR);
+
+  pool.remove_tx(make_txid(1));
+  pool.remove_tx(make_txid(3));
+  EXPECT_FALSE(pool.has_tx(make_txid(1)));
+  EXPECT_FALSE(pool.get_tx_blob(make_txid(1), bd));
+  EXPECT_EQ(1u, pool.get_tx_count());
+}
+
+TEST(volatile_txpool, for_all_txes_allows_removal)
+{
+  volatile_txpool pool;
+
+  for (int i=0; i<10; i++)
+    pool.add_tx(make_txid(i), make_meta(i, i % 2 != 0), "blob" + std::to_string(i));
+
+  size_t visited = 0;
+
+  EXPECT_TRUE(pool.for_all_txes([&](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+    EXPECT_FALSE(meta.do_not_relay);
+    EXPECT_TRUE(bd != nullptr);
+    EXPECT_EQ("blob" + std::to_string(meta.fee), *bd);
+    pool.remove_tx(txid);
+    visited++;
+    return true;
+  }, true, false));
+
+  EXPECT_EQ(5u, visited);
+  EXPECT_EQ(5u, pool.get_tx_count());
+  EXPECT_EQ(0u, pool.get_tx_count(false));
+}
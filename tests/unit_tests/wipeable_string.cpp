@@ -78,6 +78,26 @@ TEST(wipeable_string, push_back)
   ASSERT_TRUE(!memcmp(s0.data(), "foo", s0.size()));
 }
 
+TEST(wipeable_string, push_back_grows_geometrically)
+{
+  epee::wipeable_string s0;
+  size_t reallocations = 0;
+  const char *data = s0.data();
+  for (size_t i = 0; i < 4096; ++i)
+  {
+    s0.push_back('a' + i % 26);
+    if (s0.data() != data)
+    {
+      ++reallocations;
+      data = s0.data();
+    }
+  }
+  ASSERT_EQ(s0.size(), 4096);
+  ASSERT_LE(reallocations, 16);
+  for (size_t i = 0; i < 4096; ++i)
+    ASSERT_EQ(s0.data()[i], (char)('a' + i % 26));
+}
+
 TEST(wipeable_string, append_char)
 {
   epee::wipeable_string s0(std::string("fo"));